@@ -0,0 +1,52 @@
+#include "decode/CPUDecoder.h"
+#include "decode/beam_search.h"
+#include "decode/scan.h"
+
+#include <catch2/catch.hpp>
+#include <torch/torch.h>
+
+#define CUT_TAG "[decode]"
+
+namespace {
+
+// [T, N, C] scores of a chunk of the default 10000 samples at a stride of 5, at the fast and
+// HAC models' state_len of 4.
+torch::Tensor random_scores(int num_chunks) {
+    torch::manual_seed(42);
+    return torch::randn({2000, num_chunks, 1024}) * 3;
+}
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": CPU scans", CUT_TAG) {
+    const auto scores = random_scores(1);
+    const dorado::DecoderOptions options;
+
+    BENCHMARK("forward_scores") { return dorado::forward_scores(scores, options.blank_score); };
+    BENCHMARK("backward_scores") { return dorado::backward_scores(scores, options.blank_score); };
+}
+
+TEST_CASE(CUT_TAG ": beam search", CUT_TAG) {
+    const auto scores = random_scores(1);
+    const dorado::DecoderOptions options;
+    const auto fwd = dorado::forward_scores(scores, options.blank_score);
+    const auto bwd = dorado::backward_scores(scores, options.blank_score);
+    const auto posts = torch::softmax(fwd + bwd, -1);
+
+    BENCHMARK("beam_search_decode") {
+        return beam_search_decode(scores.select(1, 0), bwd.select(1, 0), posts.select(1, 0),
+                                  options.beam_width, options.beam_cut, options.blank_score,
+                                  options.q_shift, options.q_scale, options.temperature, 1.0f);
+    };
+}
+
+TEST_CASE(CUT_TAG ": CPUDecoder batch", CUT_TAG) {
+    const int num_chunks = 16;
+    const auto scores = random_scores(num_chunks);
+    const dorado::DecoderOptions options;
+    dorado::CPUDecoder decoder;
+
+    BENCHMARK("CPUDecoder::beam_search 16 chunks") {
+        return decoder.beam_search(scores, num_chunks, options);
+    };
+}
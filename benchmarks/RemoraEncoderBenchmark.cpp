@@ -0,0 +1,63 @@
+#include "modbase/remora_encoder.h"
+#include "utils/sequence_utils.h"
+
+#include <catch2/catch.hpp>
+#include <torch/torch.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#define CUT_TAG "[remora_encoder]"
+
+namespace {
+
+// A stride, context and kmer like those of the CpG models.
+constexpr size_t kBlockStride = 5;
+constexpr size_t kContextSamples = 200;
+constexpr int kBasesBefore = 4;
+constexpr int kBasesAfter = 4;
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": contexts of a read", CUT_TAG) {
+    // A read of about 5000 bases, with a random basecall.
+    std::mt19937 rng(42);
+    std::vector<uint8_t> moves(20000);
+    std::string sequence;
+    for (auto& move : moves) {
+        move = rng() % 4 == 0;
+        if (move) {
+            sequence.push_back("ACGT"[rng() % 4]);
+        }
+    }
+    const auto signal_len = moves.size() * kBlockStride;
+    const auto seq_to_sig_map = dorado::utils::moves_to_map(moves, kBlockStride, signal_len);
+    const auto signal = torch::randn({static_cast<int64_t>(signal_len)});
+
+    dorado::RemoraEncoder encoder(kBlockStride, kContextSamples, kBasesBefore, kBasesAfter);
+    encoder.init(dorado::utils::sequence_to_ints(sequence), seq_to_sig_map);
+
+    // Every C, as the motif hits of a C model would be.
+    std::vector<size_t> positions;
+    for (size_t i = 0; i < sequence.size(); ++i) {
+        if (sequence[i] == 'C') {
+            positions.push_back(i);
+        }
+    }
+
+    BENCHMARK("get_context every C") {
+        size_t num_samples = 0;
+        for (auto position : positions) {
+            num_samples += encoder.get_context(position).num_samples;
+        }
+        return num_samples;
+    };
+    BENCHMARK("get_contexts every C, one-hot") {
+        return encoder.get_contexts(positions, signal,
+                                    dorado::RemoraEncoder::KmerEncoding::OneHot);
+    };
+    BENCHMARK("get_contexts every C, bases") {
+        return encoder.get_contexts(positions, signal, dorado::RemoraEncoder::KmerEncoding::Bases);
+    };
+}
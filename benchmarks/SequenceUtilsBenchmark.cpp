@@ -0,0 +1,32 @@
+#include "utils/MoveTable.h"
+#include "utils/sequence_utils.h"
+
+#include <catch2/catch.hpp>
+
+#include <random>
+#include <vector>
+
+#define CUT_TAG "[sequence_utils]"
+
+TEST_CASE(CUT_TAG ": moves_to_map", CUT_TAG) {
+    // The moves of a read of 100k steps, about 25k bases.
+    constexpr size_t kBlockStride = 5;
+    std::mt19937 rng(42);
+    std::vector<uint8_t> moves(100000);
+    for (auto& move : moves) {
+        move = rng() % 4 == 0;
+    }
+    const dorado::utils::MoveTable move_table(moves);
+    const auto signal_len = moves.size() * kBlockStride;
+    std::vector<uint64_t> seq_to_sig_map;
+
+    BENCHMARK("moves_to_map 100k moves") {
+        dorado::utils::moves_to_map(moves, kBlockStride, signal_len, seq_to_sig_map);
+        return seq_to_sig_map.size();
+    };
+    BENCHMARK("moves_to_map 100k packed moves") {
+        dorado::utils::moves_to_map(move_table, kBlockStride, signal_len, seq_to_sig_map);
+        return seq_to_sig_map.size();
+    };
+    BENCHMARK("move_cum_sums 100k moves") { return dorado::utils::move_cum_sums(moves); };
+}
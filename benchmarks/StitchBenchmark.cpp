@@ -0,0 +1,70 @@
+#include "read_pipeline/ReadPipeline.h"
+#include "utils/stitch.h"
+
+#include <catch2/catch.hpp>
+#include <torch/torch.h>
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#define CUT_TAG "[stitch]"
+
+namespace {
+
+constexpr size_t kChunkSize = 10000;
+constexpr size_t kOverlap = 500;
+constexpr size_t kStride = 5;
+
+// A read of num_samples, chunked at the default chunk size and overlap, whose chunks have
+// been given random basecalls.  Every read made from the same seed is the same.
+std::shared_ptr<dorado::Read> make_called_read(int64_t num_samples, uint32_t seed) {
+    std::mt19937 rng(seed);
+    auto read = std::make_shared<dorado::Read>();
+    read->raw_data = torch::zeros({num_samples}, torch::kInt16);
+    read->model_stride = kStride;
+    dorado::utils::chunk_read(*read, {kChunkSize}, kOverlap, kStride);
+    for (auto& chunk : read->called_chunks) {
+        std::vector<uint8_t> moves(chunk.raw_chunk_size / kStride);
+        size_t num_bases = 0;
+        for (auto& move : moves) {
+            move = rng() % 3 == 0;
+            num_bases += move;
+        }
+        chunk.moves = dorado::utils::MoveTable(moves);
+        for (size_t i = 0; i < num_bases; ++i) {
+            chunk.seq.push_back("ACGT"[rng() % 4]);
+            chunk.qstring.push_back(char('!' + rng() % 40));
+        }
+    }
+    return read;
+}
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": stitch_chunks", CUT_TAG) {
+    // About 50 chunks, a long read's worth.
+    constexpr int64_t kNumSamples = 500000;
+
+    // Stitching consumes the chunks' calls, so each run stitches a read of its own.
+    BENCHMARK_ADVANCED("stitch_chunks 500k samples")(Catch::Benchmark::Chronometer meter) {
+        std::vector<std::shared_ptr<dorado::Read>> reads;
+        for (int i = 0; i < meter.runs(); ++i) {
+            reads.push_back(make_called_read(kNumSamples, 42));
+        }
+        meter.measure([&](int i) { dorado::utils::stitch_chunks(reads[i]); });
+    };
+
+    BENCHMARK_ADVANCED("stitch_called_chunk 500k samples")(Catch::Benchmark::Chronometer meter) {
+        std::vector<std::shared_ptr<dorado::Read>> reads;
+        for (int i = 0; i < meter.runs(); ++i) {
+            reads.push_back(make_called_read(kNumSamples, 42));
+        }
+        meter.measure([&](int i) {
+            auto& read = *reads[i];
+            for (size_t chunk = 0; chunk < read.num_chunks; ++chunk) {
+                dorado::utils::stitch_called_chunk(read, chunk);
+            }
+        });
+    };
+}
@@ -0,0 +1,32 @@
+#include "utils/tensor_utils.h"
+
+#include <catch2/catch.hpp>
+#include <torch/torch.h>
+
+#include <vector>
+
+#define CUT_TAG "[tensor_utils]"
+
+TEST_CASE(CUT_TAG ": quantile_counting", CUT_TAG) {
+    torch::manual_seed(42);
+    const auto quantiles = torch::tensor({0.2, 0.9}, {torch::kFloat32});
+    for (int64_t num_samples : {4000, 40000, 400000}) {
+        const auto signal = torch::randint(0, 2047, {num_samples}).to(torch::kInt16);
+        BENCHMARK("quantile_counting " + std::to_string(num_samples) + " samples") {
+            return dorado::utils::quantile_counting(signal, quantiles);
+        };
+    }
+}
+
+TEST_CASE(CUT_TAG ": convert_f32_to_f16", CUT_TAG) {
+    // A batch of 10000 sample chunks' worth.
+    constexpr size_t kCount = 10000 * 512;
+    torch::manual_seed(42);
+    const auto input = torch::randn({static_cast<int64_t>(kCount)});
+    std::vector<c10::Half> output(kCount);
+
+    BENCHMARK("convert_f32_to_f16 5M") {
+        dorado::utils::convert_f32_to_f16(output.data(), input.data_ptr<float>(), kCount);
+        return output.back();
+    };
+}
@@ -0,0 +1,16 @@
+#include "utils/trim.h"
+
+#include <catch2/catch.hpp>
+#include <torch/torch.h>
+
+#define CUT_TAG "[trim]"
+
+TEST_CASE(CUT_TAG ": trim", CUT_TAG) {
+    // Normalised noise, with the adapter's peak just after the start.
+    constexpr int64_t kNumSamples = 40000;
+    torch::manual_seed(42);
+    auto signal = torch::randn({kNumSamples});
+    signal.slice(0, 1, 2000) += 5;
+
+    BENCHMARK("trim 40k samples") { return dorado::utils::trim(signal); };
+}
@@ -0,0 +1,176 @@
+// Runs the Catch2 benchmarks, and optionally writes their results as JSON and compares them
+// against the results of an earlier run.
+//
+//   dorado_benchmarks --json baseline.json           # record a baseline
+//   dorado_benchmarks --baseline baseline.json       # fail if anything got slower
+//
+// The usual Catch2 options apply too, e.g. "[stitch]" to run only some of the benchmarks, or
+// --benchmark-samples to take more samples of each.
+// CATCH_CONFIG_ENABLE_BENCHMARKING is defined for the whole target.
+#define CATCH_CONFIG_RUNNER
+
+#include <catch2/catch.hpp>
+
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct BenchmarkResult {
+    std::string name;
+    double mean_ns;
+    double mean_lower_ns;
+    double mean_upper_ns;
+    double std_dev_ns;
+    size_t num_samples;
+    int iterations;
+};
+
+std::vector<BenchmarkResult>& results() {
+    static std::vector<BenchmarkResult> results;
+    return results;
+}
+
+// Keeps the result of each benchmark, alongside whichever reporter is showing them.
+class ResultListener : public Catch::TestEventListenerBase {
+public:
+    using TestEventListenerBase::TestEventListenerBase;
+
+    void benchmarkEnded(Catch::BenchmarkStats<> const& stats) override {
+        results().push_back({stats.info.name, stats.mean.point.count(),
+                             stats.mean.lower_bound.count(), stats.mean.upper_bound.count(),
+                             stats.standardDeviation.point.count(), stats.samples.size(),
+                             stats.info.iterations});
+    }
+};
+
+std::string json_escape(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped.push_back('\\');
+        }
+        escaped.push_back(c);
+    }
+    return escaped;
+}
+
+// One benchmark to a line, so that read_baseline() needn't parse JSON in general.
+void write_json(const std::string& path) {
+    std::ofstream out(path);
+    if (!out) {
+        throw std::runtime_error("Unable to open " + path);
+    }
+    out << std::setprecision(10) << "{\n\"benchmarks\": [\n";
+    for (size_t i = 0; i < results().size(); ++i) {
+        const auto& result = results()[i];
+        out << "{\"name\": \"" << json_escape(result.name) << "\", \"mean_ns\": " << result.mean_ns
+            << ", \"mean_lower_ns\": " << result.mean_lower_ns
+            << ", \"mean_upper_ns\": " << result.mean_upper_ns
+            << ", \"std_dev_ns\": " << result.std_dev_ns << ", \"samples\": " << result.num_samples
+            << ", \"iterations\": " << result.iterations << "}"
+            << (i + 1 < results().size() ? ",\n" : "\n");
+    }
+    out << "]\n}\n";
+}
+
+// The mean time of each benchmark in a file written by write_json(), by name.
+std::map<std::string, double> read_baseline(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("Unable to open " + path);
+    }
+    std::map<std::string, double> baseline;
+    const std::string name_key = "{\"name\": \"";
+    const std::string mean_key = "\"mean_ns\": ";
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.compare(0, name_key.size(), name_key) != 0) {
+            continue;
+        }
+        std::string name;
+        size_t pos = name_key.size();
+        for (; pos < line.size() && line[pos] != '"'; ++pos) {
+            if (line[pos] == '\\') {
+                ++pos;
+            }
+            name.push_back(line[pos]);
+        }
+        const auto mean_pos = line.find(mean_key, pos);
+        if (mean_pos == std::string::npos) {
+            throw std::runtime_error("No mean for " + name + " in " + path);
+        }
+        baseline[name] = std::strtod(line.c_str() + mean_pos + mean_key.size(), nullptr);
+    }
+    return baseline;
+}
+
+// Reports how each benchmark compares with the baseline, and returns the number which are
+// slower by more than tolerance, as a fraction of the baseline.
+int compare_with_baseline(const std::map<std::string, double>& baseline, double tolerance) {
+    int num_regressions = 0;
+    std::cout << "\nCompared with the baseline:\n";
+    for (const auto& result : results()) {
+        std::cout << std::left << std::setw(56) << result.name << std::right;
+        const auto it = baseline.find(result.name);
+        if (it == baseline.end() || it->second <= 0) {
+            std::cout << "  not in the baseline\n";
+            continue;
+        }
+        const double change = result.mean_ns / it->second - 1;
+        // The run's mean must be slower even at the low end of its confidence interval, so
+        // that noise alone doesn't fail a run.
+        const bool regressed =
+                change > tolerance && result.mean_lower_ns > it->second * (1 + tolerance);
+        std::cout << std::fixed << std::setprecision(1) << std::setw(8) << change * 100 << '%'
+                  << (regressed ? "  REGRESSION" : "") << std::defaultfloat << '\n';
+        num_regressions += regressed;
+    }
+    return num_regressions;
+}
+
+}  // namespace
+
+CATCH_REGISTER_LISTENER(ResultListener)
+
+int main(int argc, char* argv[]) {
+    Catch::Session session;
+
+    std::string json_path;
+    std::string baseline_path;
+    double tolerance = 0.1;
+    using Catch::clara::Opt;
+    session.cli(session.cli() |
+                Opt(json_path, "path")["--json"]("write the benchmark results as JSON") |
+                Opt(baseline_path, "path")["--baseline"](
+                        "compare the results with those of an earlier run's --json") |
+                Opt(tolerance, "fraction")["--tolerance"](
+                        "how much slower than the baseline a benchmark may be, default 0.1"));
+
+    if (const int result = session.applyCommandLine(argc, argv); result != 0) {
+        return result;
+    }
+    const int result = session.run();
+    if (result != 0) {
+        return result;
+    }
+
+    try {
+        if (!json_path.empty()) {
+            write_json(json_path);
+        }
+        if (!baseline_path.empty() &&
+            compare_with_baseline(read_baseline(baseline_path), tolerance) > 0) {
+            return 1;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,349 @@
+#include "BasecallSession.h"
+
+#include "decode/CPUDecoder.h"
+#include "nn/CRFModel.h"
+#include "nn/RemoraModel.h"
+#include "read_pipeline/BasecallerNode.h"
+#include "read_pipeline/ModBaseCallerNode.h"
+#include "read_pipeline/ScalerNode.h"
+#include "utils/TensorPool.h"
+#include "utils/thread_utils.h"
+#if DORADO_GPU_BUILD
+#ifdef __APPLE__
+#include "nn/MetalCRFModel.h"
+#else
+#include "nn/CudaCRFModel.h"
+#include "utils/cuda_utils.h"
+#endif
+#endif  // DORADO_GPU_BUILD
+
+#include <spdlog/spdlog.h>
+#include <torch/torch.h>
+
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+using dorado::BasecallSession;
+
+// The devices the session calls on: the CUDA devices of "cuda:all" and the like, or the device.
+std::vector<std::string> session_devices(const std::string& device) {
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+    if (device != "cpu") {
+        auto devices = dorado::utils::parse_cuda_device_string(device);
+        if (devices.empty()) {
+            throw std::runtime_error("CUDA device requested but no devices found.");
+        }
+        return devices;
+    }
+#endif
+    return {device};
+}
+
+// Runners for the model on each of devices, as the basecaller makes them.
+std::vector<dorado::Runner> create_runners(const BasecallSession::Options& options,
+                                           const std::vector<std::string>& devices) {
+    using namespace dorado;
+    std::vector<Runner> runners;
+    if (options.device == "cpu") {
+        // The CPU decoders' pool has a thread per core already, as the basecaller sets up.
+        torch::set_num_threads(1);
+        const auto batch_size = options.batch_size == 0 ? 128 : options.batch_size;
+        for (unsigned int i = 0; i < std::max(1u, std::thread::hardware_concurrency()); ++i) {
+            runners.push_back(std::make_shared<ModelRunner<CPUDecoder>>(
+                    options.model_path, options.device, options.chunk_size, batch_size));
+        }
+    }
+#if DORADO_GPU_BUILD
+#ifdef __APPLE__
+    else if (options.device == "metal") {
+        auto caller = create_metal_caller(options.model_path, options.chunk_size,
+                                          options.batch_size);
+        for (int i = 0; i < options.num_runners; ++i) {
+            runners.push_back(std::make_shared<MetalModelRunner>(caller));
+        }
+    }
+#else   // ifdef __APPLE__
+    else {
+        utils::use_pinned_tensor_pool();
+        for (const auto& device_string : devices) {
+            auto caller = create_cuda_caller(options.model_path, options.chunk_size,
+                                             options.batch_size, device_string);
+            for (int i = 0; i < options.num_runners; ++i) {
+                runners.push_back(std::make_shared<CudaModelRunner>(caller));
+            }
+        }
+    }
+#endif  // __APPLE__
+#endif  // DORADO_GPU_BUILD
+    if (runners.empty()) {
+        throw std::runtime_error("Unsupported device: " + options.device);
+    }
+    return runners;
+}
+
+// The runners kept for prefixes, with their own small batches and short chunks.
+std::vector<dorado::Runner> create_prefix_runners(const BasecallSession::Options& options,
+                                                  const std::vector<std::string>& devices) {
+    using namespace dorado;
+    std::vector<Runner> runners;
+    if (options.num_prefix_runners <= 0) {
+        return runners;
+    }
+    if (options.device == "cpu") {
+        for (int i = 0; i < options.num_prefix_runners; ++i) {
+            runners.push_back(std::make_shared<ModelRunner<CPUDecoder>>(
+                    options.model_path, options.device, options.prefix_chunk_size,
+                    options.prefix_batch_size));
+        }
+    }
+#if DORADO_GPU_BUILD
+#ifdef __APPLE__
+    else if (options.device == "metal") {
+        auto caller = create_metal_caller(options.model_path, options.prefix_chunk_size,
+                                          options.prefix_batch_size);
+        for (int i = 0; i < options.num_prefix_runners; ++i) {
+            runners.push_back(std::make_shared<MetalModelRunner>(caller));
+        }
+    }
+#else   // ifdef __APPLE__
+    else {
+        for (const auto& device_string : devices) {
+            auto caller = create_cuda_caller(options.model_path, options.prefix_chunk_size,
+                                             options.prefix_batch_size, device_string);
+            for (int i = 0; i < options.num_prefix_runners; ++i) {
+                runners.push_back(std::make_shared<CudaModelRunner>(caller));
+            }
+        }
+    }
+#endif  // __APPLE__
+#endif  // DORADO_GPU_BUILD
+    return runners;
+}
+
+}  // namespace
+
+namespace dorado {
+
+// Hands the reads the pipeline has called back to the session.
+class BasecallSession::ResultSink : public MessageSink {
+public:
+    ResultSink(BasecallSession& session, int num_worker_threads)
+            : MessageSink(1000), m_session(session) {
+        for (int i = 0; i < num_worker_threads; ++i) {
+            m_workers.emplace_back(&ResultSink::worker_thread, this);
+        }
+    }
+    ~ResultSink() {
+        terminate();
+        for (auto& worker : m_workers) {
+            worker.join();
+        }
+    }
+
+private:
+    void worker_thread() {
+        utils::set_thread_name("basecall_result");
+        Message message;
+        while (m_work_queue.try_pop(message)) {
+            // If this message isn't a read, we'll get a bad_variant_access exception.
+            m_session.complete(std::get<std::shared_ptr<Read>>(std::move(message)));
+        }
+    }
+
+    BasecallSession& m_session;
+    std::vector<std::thread> m_workers;
+};
+
+BasecallSession::BasecallSession(const Options& options) : m_options(options) {
+    if (!std::filesystem::exists(options.model_path)) {
+        throw std::runtime_error("Model " + options.model_path.string() + " not found.");
+    }
+    m_model_name = std::filesystem::canonical(options.model_path).filename().string();
+    m_sample_rate = get_model_sample_rate(options.model_path);
+
+    const auto devices = session_devices(options.device);
+    // The prefix runners are made first, so the others' batch sizes are picked from the
+    // memory they leave.
+    auto prefix_runners = create_prefix_runners(options, devices);
+    if (!prefix_runners.empty()) {
+        m_prefix_caller = std::make_unique<PrefixCaller>(
+                std::move(prefix_runners),
+                std::chrono::milliseconds(options.prefix_batch_wait_ms));
+    }
+    auto runners = create_runners(options, devices);
+    const auto model_stride = runners.front()->model_stride();
+    std::vector<std::shared_ptr<RemoraCaller>> remora_callers;
+    for (const auto& device : devices) {
+        for (const auto& remora_model : options.remora_models) {
+            remora_callers.push_back(std::make_shared<RemoraCaller>(
+                    remora_model, device, options.remora_batch_size, model_stride));
+        }
+    }
+    create_pipeline(std::move(runners), std::move(remora_callers), devices.size());
+    spdlog::debug("> Basecall session for {} on {}", m_model_name, options.device);
+}
+
+BasecallSession::BasecallSession(std::vector<Runner> runners,
+                                 std::vector<std::shared_ptr<RemoraCaller>> remora_callers,
+                                 const Options& options,
+                                 std::vector<Runner> prefix_runners)
+        : m_options(options) {
+    if (std::filesystem::exists(options.model_path)) {
+        m_model_name = std::filesystem::canonical(options.model_path).filename().string();
+        m_sample_rate = get_model_sample_rate(options.model_path);
+    } else {
+        m_model_name = options.model_path.filename().string();
+    }
+    if (!prefix_runners.empty()) {
+        m_prefix_caller = std::make_unique<PrefixCaller>(
+                std::move(prefix_runners),
+                std::chrono::milliseconds(options.prefix_batch_wait_ms));
+    }
+    create_pipeline(std::move(runners), std::move(remora_callers), 1);
+}
+
+BasecallSession::~BasecallSession() {
+    flush();
+    // The nodes are then destroyed from the scaler down, each handing its last reads on.
+}
+
+void BasecallSession::create_pipeline(std::vector<Runner> runners,
+                                      std::vector<std::shared_ptr<RemoraCaller>> remora_callers,
+                                      size_t num_devices) {
+    if (runners.empty()) {
+        throw std::runtime_error("No runners to basecall with.");
+    }
+    const auto model_stride = runners.front()->model_stride();
+    const auto overlap = (m_options.overlap / model_stride) * model_stride;
+    const auto thread_allocations = utils::default_thread_allocations(
+            int(num_devices),
+            remora_callers.empty() ? 0 : utils::default_parameters.remora_threads);
+
+    m_result_sink = std::make_unique<ResultSink>(*this, thread_allocations.writer_threads);
+    MessageSink* basecaller_sink = m_result_sink.get();
+    if (!remora_callers.empty()) {
+        m_mod_base_caller_node = std::make_unique<ModBaseCallerNode>(
+                *m_result_sink, std::move(remora_callers), thread_allocations.remora_threads,
+                num_devices, model_stride, m_options.remora_batch_size);
+        basecaller_sink = m_mod_base_caller_node.get();
+    }
+    m_basecaller_node = std::make_unique<BasecallerNode>(*basecaller_sink, std::move(runners),
+                                                         overlap, m_options.batch_latency_target_ms,
+                                                         m_model_name);
+    m_scaler_node = std::make_unique<ScalerNode>(*m_basecaller_node,
+                                                 thread_allocations.scaler_node_threads);
+}
+
+torch::Tensor BasecallSession::copy_signal(const RawRead& raw_read) const {
+    if (raw_read.signal == nullptr || raw_read.num_samples == 0) {
+        throw std::runtime_error("Read " + raw_read.read_id + " has no signal.");
+    }
+    if (raw_read.sample_rate != 0 && m_sample_rate != 0 && raw_read.sample_rate != m_sample_rate) {
+        throw std::runtime_error("Read " + raw_read.read_id + " has a sample rate of " +
+                                 std::to_string(raw_read.sample_rate) + "Hz, but " +
+                                 m_model_name + " is for " + std::to_string(m_sample_rate) +
+                                 "Hz.");
+    }
+    auto samples = utils::TensorPool::instance().empty(raw_read.num_samples, torch::kInt16);
+    std::memcpy(samples.data_ptr<int16_t>(), raw_read.signal,
+                raw_read.num_samples * sizeof(int16_t));
+    return samples;
+}
+
+void BasecallSession::submit(const RawRead& raw_read, Callback callback) {
+    auto read = std::make_shared<Read>();
+    read->raw_data = copy_signal(raw_read);
+    read->sample_rate = raw_read.sample_rate != 0 ? raw_read.sample_rate : m_sample_rate;
+    read->offset = raw_read.calibration_offset;
+    read->scaling = raw_read.calibration_scale;
+    read->read_id = raw_read.read_id;
+    read->run_id = raw_read.run_id;
+    read->flowcell_id = raw_read.flowcell_id;
+    read->num_trimmed_samples = 0;
+    read->start_time_ms = 0;
+    read->run_acquisition_start_time_ms = 0;
+    read->start_sample = raw_read.start_sample;
+    read->end_sample = raw_read.start_sample + raw_read.num_samples;
+    read->attributes.num_samples = raw_read.num_samples;
+    read->attributes.read_number = raw_read.read_number;
+    read->attributes.channel_number = raw_read.channel_number;
+    read->attributes.mux = raw_read.mux;
+    read->attributes.start_time = raw_read.start_time;
+    read->is_duplex = false;
+    read->is_priority = raw_read.is_priority;
+
+    {
+        std::unique_lock lock(m_mutex);
+        m_reads_completed.wait(lock, [this] {
+            return m_callbacks.size() < std::max<size_t>(1, m_options.max_reads_in_flight);
+        });
+        m_callbacks.emplace(read.get(), std::move(callback));
+    }
+    m_scaler_node->push_message(std::move(read));
+}
+
+std::future<std::shared_ptr<Read>> BasecallSession::submit(const RawRead& raw_read) {
+    auto promise = std::make_shared<std::promise<std::shared_ptr<Read>>>();
+    auto future = promise->get_future();
+    submit(raw_read,
+           [promise](std::shared_ptr<Read> read) { promise->set_value(std::move(read)); });
+    return future;
+}
+
+void BasecallSession::submit_prefix(const RawRead& raw_read, PrefixCaller::Callback callback) {
+    if (!m_prefix_caller) {
+        throw std::runtime_error("The basecall session has no prefix runners.");
+    }
+    m_prefix_caller->submit(raw_read.read_id, copy_signal(raw_read), std::move(callback));
+}
+
+std::future<ReadPrefix> BasecallSession::submit_prefix(const RawRead& raw_read) {
+    auto promise = std::make_shared<std::promise<ReadPrefix>>();
+    auto future = promise->get_future();
+    submit_prefix(raw_read,
+                  [promise](ReadPrefix prefix) { promise->set_value(std::move(prefix)); });
+    return future;
+}
+
+void BasecallSession::flush() {
+    std::unique_lock lock(m_mutex);
+    m_reads_completed.wait(lock, [this] { return m_callbacks.empty(); });
+}
+
+size_t BasecallSession::num_reads_in_flight() const {
+    std::lock_guard lock(m_mutex);
+    return m_callbacks.size();
+}
+
+void BasecallSession::complete(std::shared_ptr<Read> read) {
+    const Read* key = read.get();
+    Callback callback;
+    {
+        std::lock_guard lock(m_mutex);
+        auto it = m_callbacks.find(key);
+        if (it == m_callbacks.end()) {
+            spdlog::error("Basecall session was handed read {}, which it wasn't calling",
+                          read->read_id);
+            return;
+        }
+        callback = std::move(it->second);
+    }
+    try {
+        // A copy, so that the read isn't freed, and its address reused as the key of another,
+        // before its own entry is erased.
+        callback(read);
+    } catch (const std::exception& e) {
+        spdlog::error("Basecall session callback failed: {}", e.what());
+    }
+    // Only once the callback is done, so that flush() waits for it.
+    {
+        std::lock_guard lock(m_mutex);
+        m_callbacks.erase(key);
+    }
+    m_reads_completed.notify_all();
+}
+
+}  // namespace dorado
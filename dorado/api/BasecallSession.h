@@ -0,0 +1,155 @@
+#pragma once
+
+#include "PrefixCaller.h"
+#include "nn/ModelRunner.h"
+#include "read_pipeline/ReadPipeline.h"
+#include "utils/InternedString.h"
+#include "utils/parameters.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace dorado {
+
+class BasecallerNode;
+class ModBaseCallerNode;
+class RemoraCaller;
+class ScalerNode;
+
+// A read's signal as acquired, to be submitted to a BasecallSession.
+struct RawRead {
+    std::string read_id;
+    // Copied on submission, so it needn't outlive the call.
+    const int16_t* signal{nullptr};
+    size_t num_samples{0};
+    // The calibration of the signal: pA = calibration_scale * (signal + calibration_offset).
+    float calibration_offset{0.f};
+    float calibration_scale{1.f};
+    // 0 for the model's sample rate, which reads of any other rate are rejected for.
+    uint16_t sample_rate{0};
+
+    // Metadata passed through to the called read, e.g. for its BAM tags.  The run ID and
+    // model name make up its read group.
+    utils::InternedString run_id;
+    utils::InternedString flowcell_id;
+    int32_t channel_number{-1};
+    uint32_t mux{0};
+    int32_t read_number{-1};
+    // The acquisition start time of the read, e.g. "2023-02-21T12:46:01.529+00:00".
+    std::string start_time;
+    uint64_t start_sample{0};
+    // Calls the read ahead of others, e.g. for adaptive sampling decisions.
+    bool is_priority{false};
+};
+
+// Basecalls reads submitted from acquisition software, or anything else embedding dorado,
+// without going through files.  A session sets up the runners for its model on its devices
+// once, and reads from any number of threads are batched together on them.  Called reads are
+// handed to a callback, or through a future, as Reads with their sequence, quality string,
+// moves and any modified base calls.  With prefix runners, the starts of reads can also be
+// called on their own, e.g. from the signal so far of a read still being acquired, for
+// adaptive sampling decisions.
+//
+//   BasecallSession session({"dna_r10.4.1_e8.2_400bps_hac@v4.1.0"});
+//   auto called = session.submit(raw_read);
+//   std::cout << called.get()->seq;
+class BasecallSession {
+public:
+    struct Options {
+        std::filesystem::path model_path;
+        std::vector<std::filesystem::path> remora_models;
+        std::string device{utils::default_parameters.device};
+        // 0 to pick the batch size from the device's memory.
+        int batch_size{utils::default_parameters.batchsize};
+        int chunk_size{utils::default_parameters.chunksize};
+        int overlap{utils::default_parameters.overlap};
+        // Runners for each GPU, or for metal.  CPU calling has one per core.
+        int num_runners{utils::default_parameters.num_runners};
+        int remora_batch_size{utils::default_parameters.remora_batchsize};
+        int batch_latency_target_ms{utils::default_parameters.batch_latency_target};
+        // submit() blocks while this many reads are being called.
+        size_t max_reads_in_flight{1000};
+
+        // Runners kept for submit_prefix() on each device, or 0 for no prefix calling.  They
+        // call chunks of prefix_chunk_size, about 400 bases, in batches of up to
+        // prefix_batch_size, waiting no more than prefix_batch_wait_ms for a batch to fill.
+        int num_prefix_runners{0};
+        int prefix_chunk_size{4000};
+        int prefix_batch_size{16};
+        int prefix_batch_wait_ms{2};
+    };
+
+    // Loads the models onto the devices: throws if either isn't found.
+    explicit BasecallSession(const Options& options);
+    // Calls with runners already made, e.g. remote ones.  Only the options which aren't about
+    // making runners are used, and model_path only for the model's name and sample rate, if it
+    // exists.
+    BasecallSession(std::vector<Runner> runners,
+                    std::vector<std::shared_ptr<RemoraCaller>> remora_callers,
+                    const Options& options,
+                    std::vector<Runner> prefix_runners = {});
+    // Waits for the reads submitted to be called and handed over.
+    ~BasecallSession();
+
+    BasecallSession(const BasecallSession&) = delete;
+    BasecallSession& operator=(const BasecallSession&) = delete;
+
+    // Called on a pipeline thread, which can't call anything else meanwhile, so should be
+    // quick, and mustn't submit reads or flush().
+    using Callback = std::function<void(std::shared_ptr<Read>)>;
+
+    // Submits read for calling, blocking while max_reads_in_flight are already being called.
+    // Thread safe.  Throws if the read has no signal, or the wrong sample rate.
+    void submit(const RawRead& read, Callback callback);
+    std::future<std::shared_ptr<Read>> submit(const RawRead& read);
+
+    // Calls the start of read's signal on the prefix runners, returning the call of its first
+    // chunk.  Thread safe.  Throws if the session has no prefix runners, or as submit() does.
+    void submit_prefix(const RawRead& read, PrefixCaller::Callback callback);
+    std::future<ReadPrefix> submit_prefix(const RawRead& read);
+
+    // Waits until every read submitted so far has been handed over.
+    void flush();
+    size_t num_reads_in_flight() const;
+
+    const std::string& model_name() const { return m_model_name; }
+    uint16_t sample_rate() const { return m_sample_rate; }
+
+private:
+    class ResultSink;
+
+    void create_pipeline(std::vector<Runner> runners,
+                         std::vector<std::shared_ptr<RemoraCaller>> remora_callers,
+                         size_t num_devices);
+    // The read's signal, checked, in an int16 tensor of its own.
+    torch::Tensor copy_signal(const RawRead& read) const;
+    // Hands a called read to its callback.
+    void complete(std::shared_ptr<Read> read);
+
+    Options m_options;
+    std::string m_model_name;
+    uint16_t m_sample_rate{0};
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_reads_completed;
+    // The callbacks of the reads being called.
+    std::unordered_map<const Read*, Callback> m_callbacks;
+
+    // Destroyed from the scaler down, so each node is done before its sink goes.
+    std::unique_ptr<ResultSink> m_result_sink;
+    std::unique_ptr<ModBaseCallerNode> m_mod_base_caller_node;
+    std::unique_ptr<BasecallerNode> m_basecaller_node;
+    std::unique_ptr<ScalerNode> m_scaler_node;
+    std::unique_ptr<PrefixCaller> m_prefix_caller;
+};
+
+}  // namespace dorado
@@ -0,0 +1,142 @@
+#include "PrefixCaller.h"
+
+#include "utils/signal_utils.h"
+#include "utils/thread_utils.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+// The most samples at the start of a read in which to look for where to trim it, as the
+// ScalerNode trims.
+constexpr int kMaxTrimSamples = 8000;
+
+}  // namespace
+
+namespace dorado {
+
+PrefixCaller::PrefixCaller(std::vector<Runner> runners, std::chrono::milliseconds max_batch_wait)
+        : m_runners(std::move(runners)), m_max_batch_wait(max_batch_wait) {
+    if (m_runners.empty()) {
+        throw std::runtime_error("No runners to call prefixes with.");
+    }
+    for (size_t i = 0; i < m_runners.size(); ++i) {
+        m_workers.emplace_back(&PrefixCaller::worker_thread, this, i);
+    }
+}
+
+PrefixCaller::~PrefixCaller() {
+    {
+        std::lock_guard lock(m_mutex);
+        m_terminate = true;
+    }
+    m_requests_changed.notify_all();
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+void PrefixCaller::submit(std::string read_id, torch::Tensor samples, Callback callback) {
+    {
+        std::lock_guard lock(m_mutex);
+        m_requests.push_back({std::move(read_id), samples.contiguous(), std::move(callback),
+                              std::chrono::steady_clock::now()});
+    }
+    // All, as a worker waiting for its batch to fill wants to count this one.
+    m_requests_changed.notify_all();
+}
+
+void PrefixCaller::worker_thread(size_t runner_index) {
+    utils::set_thread_name("prefix_caller");
+    torch::InferenceMode inference_mode_guard;
+    auto& runner = *m_runners[runner_index];
+    const size_t batch_size = std::max<size_t>(1, runner.batch_size());
+    std::vector<Request> batch;
+    while (true) {
+        {
+            std::unique_lock lock(m_mutex);
+            m_requests_changed.wait(lock, [this] { return !m_requests.empty() || m_terminate; });
+            if (m_requests.empty()) {
+                return;
+            }
+            // Waits for others to join the batch, for no longer than the oldest is let wait.
+            const auto deadline = m_requests.front().submitted + m_max_batch_wait;
+            m_requests_changed.wait_until(lock, deadline, [this, batch_size] {
+                return m_requests.size() >= batch_size || m_terminate;
+            });
+            while (!m_requests.empty() && batch.size() < batch_size) {
+                batch.push_back(std::move(m_requests.front()));
+                m_requests.pop_front();
+            }
+        }
+        // Another worker may have taken the requests meanwhile.
+        if (!batch.empty()) {
+            call_batch(runner, batch);
+            batch.clear();
+        }
+    }
+}
+
+void PrefixCaller::call_batch(ModelRunnerBase& runner, std::vector<Request>& batch) {
+    using torch::indexing::Slice;
+    const size_t chunk_size = runner.chunk_size();
+    const size_t stride = runner.model_stride();
+
+    // The chunks point at the signals, which mustn't move.
+    std::vector<torch::Tensor> signals;
+    signals.reserve(batch.size());
+    std::vector<ChunkSignal> chunks;
+    // Index into chunks of each request's chunk, or -1 if trimming left it no signal.
+    std::vector<int> chunk_indices;
+    for (auto& request : batch) {
+        const size_t num_samples = request.samples.numel();
+        const auto scaling = utils::normalise_and_trim(
+                request.samples.data_ptr<int16_t>(), num_samples,
+                std::min(kMaxTrimSamples, static_cast<int>(num_samples / 2)));
+        auto signal = request.samples.view(torch::kFloat16)
+                              .index({Slice(scaling.trim_start, torch::indexing::None)});
+        const size_t length = std::min<size_t>(signal.size(0), chunk_size);
+        if (length < stride) {
+            chunk_indices.push_back(-1);
+            continue;
+        }
+        signals.push_back(std::move(signal));
+        chunk_indices.push_back(static_cast<int>(chunks.size()));
+        chunks.push_back({&signals.back(), 0, length});
+    }
+
+    std::vector<DecodedChunk> decoded;
+    if (!chunks.empty()) {
+        runner.accept_chunks(0, chunks);
+        decoded = runner.call_chunks(static_cast<int>(chunks.size()));
+    }
+
+    for (size_t i = 0; i < batch.size(); ++i) {
+        ReadPrefix prefix;
+        prefix.read_id = std::move(batch[i].read_id);
+        if (chunk_indices[i] >= 0) {
+            const auto& chunk = chunks[chunk_indices[i]];
+            auto& call = decoded[chunk_indices[i]];
+            // Short chunks are repeat padded, so the call is cut to the steps of the signal.
+            const size_t num_steps = std::min(call.moves.size(), chunk.length / stride);
+            const auto num_bases = std::min<size_t>(
+                    call.sequence.size(),
+                    std::count(call.moves.begin(), call.moves.begin() + num_steps, 1));
+            call.sequence.resize(num_bases);
+            call.qstring.resize(num_bases);
+            prefix.seq = std::move(call.sequence);
+            prefix.qstring = std::move(call.qstring);
+            prefix.num_samples = num_steps * stride;
+        }
+        try {
+            batch[i].callback(std::move(prefix));
+        } catch (const std::exception& e) {
+            spdlog::error("Prefix callback failed: {}", e.what());
+        }
+    }
+}
+
+}  // namespace dorado
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "nn/ModelRunner.h"
+
+#include <torch/torch.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dorado {
+
+// The basecall of the start of a read.
+struct ReadPrefix {
+    std::string read_id;
+    std::string seq;
+    std::string qstring;
+    // The samples called, after those trimmed from the start of the signal.
+    size_t num_samples{0};
+};
+
+// Calls the start of reads' signal, e.g. the signal acquired so far, for adaptive sampling
+// decisions, with as little latency as possible.  Each read's leading chunk is called on
+// runners kept for prefixes alone, and the call is returned as it is, without stitching,
+// modbase calling or conversion to BAM.  Each runner's thread calls whatever requests are
+// waiting, batching those which arrive within max_batch_wait of the first, so batches are
+// small when requests are few, and fill up under load.
+class PrefixCaller {
+public:
+    PrefixCaller(std::vector<Runner> runners, std::chrono::milliseconds max_batch_wait);
+    // Calls the requests already submitted.
+    ~PrefixCaller();
+
+    PrefixCaller(const PrefixCaller&) = delete;
+    PrefixCaller& operator=(const PrefixCaller&) = delete;
+
+    // Called on a runner's thread, so should be quick.
+    using Callback = std::function<void(ReadPrefix)>;
+    // samples is the read's raw int16 signal, which is normalised in place.  Thread safe.
+    void submit(std::string read_id, torch::Tensor samples, Callback callback);
+
+private:
+    struct Request {
+        std::string read_id;
+        torch::Tensor samples;
+        Callback callback;
+        std::chrono::steady_clock::time_point submitted;
+    };
+
+    void worker_thread(size_t runner_index);
+    void call_batch(ModelRunnerBase& runner, std::vector<Request>& batch);
+
+    std::vector<Runner> m_runners;
+    const std::chrono::milliseconds m_max_batch_wait;
+
+    std::mutex m_mutex;
+    std::condition_variable m_requests_changed;
+    std::deque<Request> m_requests;
+    bool m_terminate{false};
+    std::vector<std::thread> m_workers;
+};
+
+}  // namespace dorado
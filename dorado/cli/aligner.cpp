@@ -2,13 +2,21 @@
 #include "minimap.h"
 #include "utils/bam_utils.h"
 #include "utils/cli_utils.h"
+#include "read_pipeline/MessageRouter.h"
 #include "utils/log_utils.h"
+#include "utils/thread_utils.h"
 
 #include <argparse.hpp>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <filesystem>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <stdexcept>
 #include <string>
 #include <thread>
 #include <vector>
@@ -28,6 +36,181 @@ void add_pg_hdr(sam_hdr_t* hdr) {
                      MM_VERSION, NULL);
 }
 
+namespace {
+
+// The inputs, with each directory replaced by the HTS files in it, in name order.
+std::vector<std::string> expand_inputs(const std::vector<std::string>& inputs) {
+    const std::set<std::string> extensions{".bam", ".sam", ".cram"};
+    std::vector<std::string> files;
+    for (const auto& input : inputs) {
+        if (input == "-" || !std::filesystem::is_directory(input)) {
+            files.push_back(input);
+            continue;
+        }
+        std::vector<std::string> directory_files;
+        for (const auto& entry : std::filesystem::directory_iterator(input)) {
+            if (entry.is_regular_file() && extensions.count(entry.path().extension().string())) {
+                directory_files.push_back(entry.path().string());
+            }
+        }
+        std::sort(directory_files.begin(), directory_files.end());
+        files.insert(files.end(), directory_files.begin(), directory_files.end());
+    }
+    return files;
+}
+
+// Adds the read groups of from which hdr doesn't have already.
+void add_read_groups(sam_hdr_t* hdr, sam_hdr_t* from) {
+    kstring_t line = {0, 0, nullptr};
+    const int num_read_groups = sam_hdr_count_lines(from, "RG");
+    for (int i = 0; i < num_read_groups; ++i) {
+        const char* id = sam_hdr_line_name(from, "RG", i);
+        if (id == nullptr || sam_hdr_line_index(hdr, "RG", id) >= 0) {
+            continue;
+        }
+        if (sam_hdr_find_line_id(from, "RG", "ID", id, &line) == 0) {
+            sam_hdr_add_lines(hdr, line.s, line.l);
+        }
+    }
+    free(line.s);
+}
+
+struct AlignmentSettings {
+    std::string index;
+    int kmer_size;
+    int window_size;
+    uint64_t index_batch_size;
+    int aligner_threads;
+    int writer_threads;
+    int max_reads;  // Of each input.
+    size_t max_parallel_inputs;
+};
+
+// Calls fn(i) for each input i, settings.max_parallel_inputs of them at once, and rethrows the
+// first exception once they're all done.
+template <typename Fn>
+void for_each_input(size_t num_inputs, const AlignmentSettings& settings, Fn fn) {
+    std::atomic<size_t> next_input{0};
+    utils::run_concurrently(std::min(num_inputs, settings.max_parallel_inputs), [&](size_t) {
+        for (size_t i = next_input++; i < num_inputs; i = next_input++) {
+            fn(i);
+        }
+        return 0;
+    });
+}
+
+// Aligns the inputs on one Aligner, and so the same threads, writing every alignment to stdout
+// under a header with the read groups of all of them.  The inputs are read at once, so that
+// decompressing one doesn't leave the aligner waiting.
+void align_merged(const std::vector<std::string>& inputs, const AlignmentSettings& settings) {
+    spdlog::info("> loading index {}", settings.index);
+    HtsWriter writer("-", HtsWriter::OutputMode::BAM, settings.writer_threads, 0);
+    utils::Aligner aligner(writer, settings.index, settings.kmer_size, settings.window_size,
+                           settings.index_batch_size, settings.aligner_threads);
+
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        HtsReader reader(inputs[i]);
+        if (i == 0) {
+            writer.add_header(reader.header);
+        } else {
+            add_read_groups(writer.header, reader.header);
+        }
+    }
+    add_pg_hdr(writer.header);
+    utils::add_sq_hdr(writer.header, aligner.get_sequence_records_for_header());
+    writer.write_header();
+
+    // The aligner is done once every input's router has terminated.
+    std::vector<std::unique_ptr<MessageRouter>> routers;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        routers.push_back(std::make_unique<MessageRouter>(aligner));
+    }
+    const int reader_threads = std::max<int>(
+            1, settings.writer_threads / std::min(inputs.size(), settings.max_parallel_inputs));
+    spdlog::info("> starting alignment of {} inputs", inputs.size());
+    for_each_input(inputs.size(), settings, [&](size_t i) {
+        try {
+            HtsReader reader(inputs[i], reader_threads);
+            reader.read(*routers[i], settings.max_reads);
+        } catch (...) {
+            routers[i]->terminate();
+            throw;
+        }
+    });
+    writer.join();
+
+    spdlog::info("> finished alignment");
+    spdlog::info("> total/primary/unmapped {}/{}/{}", writer.total, writer.primary,
+                 writer.unmapped);
+}
+
+// Aligns each input to a BAM of the same name in output_dir, with its own header, sharing the
+// index loaded once.  The threads are split between the inputs aligned at once.
+void align_to_directory(const std::vector<std::string>& inputs,
+                        const std::filesystem::path& output_dir,
+                        const AlignmentSettings& settings) {
+    // Compared as they resolve, so that no input is written over however the paths are given.
+    std::set<std::filesystem::path> resolved_inputs;
+    for (const auto& input : inputs) {
+        if (input == "-") {
+            throw std::runtime_error("--output-dir needs inputs from files, not stdin");
+        }
+        resolved_inputs.insert(std::filesystem::weakly_canonical(input));
+    }
+    std::vector<std::filesystem::path> outputs;
+    std::set<std::filesystem::path> unique_outputs;
+    for (const auto& input : inputs) {
+        outputs.push_back(output_dir / std::filesystem::path(input).filename());
+        outputs.back().replace_extension(".bam");
+        const auto resolved_output = std::filesystem::weakly_canonical(outputs.back());
+        if (resolved_inputs.count(resolved_output)) {
+            throw std::runtime_error("Input " + resolved_output.string() +
+                                     " would be written over by its output");
+        }
+        if (!unique_outputs.insert(resolved_output).second) {
+            throw std::runtime_error("More than one input would be written to " +
+                                     outputs.back().string());
+        }
+    }
+    std::filesystem::create_directories(output_dir);
+
+    spdlog::info("> loading index {}", settings.index);
+    // Held until every input is done, so that it isn't freed between one input and the next.
+    const auto loaded_index = utils::hold_minimap_index(settings.index, settings.kmer_size,
+                                                 settings.window_size, settings.index_batch_size,
+                                                 settings.aligner_threads);
+
+    const size_t num_parallel = std::min(inputs.size(), settings.max_parallel_inputs);
+    const int aligner_threads = std::max<int>(1, settings.aligner_threads / num_parallel);
+    const int writer_threads = std::max<int>(1, settings.writer_threads / num_parallel);
+    std::atomic<size_t> total{0}, primary{0}, unmapped{0};
+    spdlog::info("> starting alignment of {} inputs to {}", inputs.size(), output_dir.string());
+    for_each_input(inputs.size(), settings, [&](size_t i) {
+        HtsWriter writer(outputs[i].string(), HtsWriter::OutputMode::BAM, writer_threads, 0);
+        utils::Aligner aligner(writer, settings.index, settings.kmer_size, settings.window_size,
+                               settings.index_batch_size, aligner_threads);
+        HtsReader reader(inputs[i], writer_threads);
+        writer.add_header(reader.header);
+        add_pg_hdr(writer.header);
+        utils::add_sq_hdr(writer.header, aligner.get_sequence_records_for_header());
+        writer.write_header();
+        reader.read(aligner, settings.max_reads);
+        writer.join();
+
+        spdlog::debug("> {}: total/primary/unmapped {}/{}/{}", outputs[i].string(), writer.total,
+                      writer.primary, writer.unmapped);
+        total += writer.total;
+        primary += writer.primary;
+        unmapped += writer.unmapped;
+    });
+
+    spdlog::info("> finished alignment");
+    spdlog::info("> total/primary/unmapped {}/{}/{}", total.load(), primary.load(),
+                 unmapped.load());
+}
+
+}  // namespace
+
 int aligner(int argc, char* argv[]) {
     utils::InitLogging();
 
@@ -50,6 +233,19 @@ int aligner(int argc, char* argv[]) {
     parser.add_argument("-k").help("k-mer size (maximum 28).").default_value(15).scan<'i', int>();
     parser.add_argument("-w").help("minimizer window size.").default_value(10).scan<'i', int>();
     parser.add_argument("-I").help("minimap2 index batch size.").default_value(std::string("16G"));
+    parser.add_argument("--index-cache")
+            .help("Directory the minimap2 indexes built from FASTA references are cached in, "
+                  "for later runs to load rather than build again. Indexes are never evicted, "
+                  "so none are cached unless this is given.")
+            .default_value(std::string(""));
+    parser.add_argument("--output-dir")
+            .help("Write each input's alignments to a BAM of the same name in this directory, "
+                  "rather than all of them to stdout.")
+            .default_value(std::string(""));
+    parser.add_argument("--max-parallel-inputs")
+            .help("Most inputs read, or with --output-dir aligned and written, at once.")
+            .default_value(4)
+            .scan<'i', int>();
     parser.add_argument("-v", "--verbose").default_value(false).implicit_value(true);
 
     try {
@@ -67,12 +263,15 @@ int aligner(int argc, char* argv[]) {
     }
 
     auto index(parser.get<std::string>("index"));
-    auto reads(parser.get<std::vector<std::string>>("reads"));
+    auto reads(expand_inputs(parser.get<std::vector<std::string>>("reads")));
     auto threads(parser.get<int>("threads"));
     auto max_reads(parser.get<int>("max-reads"));
     auto kmer_size(parser.get<int>("k"));
     auto window_size(parser.get<int>("w"));
     auto index_batch_size = utils::parse_string_to_size(parser.get<std::string>("I"));
+    utils::set_minimap_index_cache(parser.get<std::string>("--index-cache"));
+    const auto output_dir(parser.get<std::string>("--output-dir"));
+    const auto max_parallel_inputs = size_t(std::max(1, parser.get<int>("--max-parallel-inputs")));
 
     threads = threads == 0 ? std::thread::hardware_concurrency() : threads;
     // The input thread is the total number of threads to use for dorado
@@ -91,8 +290,8 @@ int aligner(int argc, char* argv[]) {
         }
 #endif
         reads.push_back("-");
-    } else if (reads.size() > 1) {
-        spdlog::error("> multi file input not yet handled");
+    } else if (reads.size() > 1 && std::count(reads.begin(), reads.end(), "-")) {
+        spdlog::error("> stdin can't be read along with other inputs");
         return 1;
     }
 
@@ -100,12 +299,30 @@ int aligner(int argc, char* argv[]) {
         spdlog::error("Requested index {} does not exist!", index);
         return 1;
     }
-    spdlog::info("> loading index {}", index);
 
+    if (!output_dir.empty() || reads.size() > 1) {
+        const AlignmentSettings settings{index,           kmer_size,       window_size,
+                                         index_batch_size, aligner_threads, writer_threads,
+                                         max_reads,       max_parallel_inputs};
+        try {
+            if (output_dir.empty()) {
+                align_merged(reads, settings);
+            } else {
+                align_to_directory(reads, output_dir, settings);
+            }
+        } catch (const std::exception& e) {
+            spdlog::error(e.what());
+            return 1;
+        }
+        return 0;
+    }
+
+    spdlog::info("> loading index {}", index);
     HtsWriter writer("-", HtsWriter::OutputMode::BAM, writer_threads, 0);
     utils::Aligner aligner(writer, index, kmer_size, window_size, index_batch_size,
                            aligner_threads);
-    HtsReader reader(reads[0]);
+    // Decompressing the input can take as long as compressing the output.
+    HtsReader reader(reads[0], writer_threads);
 
     spdlog::debug("> input fmt: {} aligned: {}", reader.format, reader.is_aligned);
     writer.add_header(reader.header);
@@ -1,5 +1,6 @@
 #include "Version.h"
 #include "data_loader/DataLoader.h"
+#include "data_loader/DatasetIndex.h"
 #include "decode/CPUDecoder.h"
 #include "nn/CRFModel.h"
 #include "utils/basecaller_utils.h"
@@ -7,6 +8,7 @@
 #if DORADO_GPU_BUILD
 #ifdef __APPLE__
 #include "nn/MetalCRFModel.h"
+#include "utils/metal_utils.h"
 #else
 #include "nn/CudaCRFModel.h"
 #include "utils/cuda_utils.h"
@@ -14,27 +16,54 @@
 #endif  // DORADO_GPU_BUILD
 #include "nn/ModelRunner.h"
 #include "nn/RemoraModel.h"
+#include "nn/RemoteModelRunner.h"
 #include "read_pipeline/BasecallerNode.h"
+#include "read_pipeline/CascadeRouter.h"
+#include "read_pipeline/FastqWriterNode.h"
+#include "read_pipeline/MessageRouter.h"
 #include "read_pipeline/ModBaseCallerNode.h"
 #include "read_pipeline/ReadFilterNode.h"
+#include "read_pipeline/ReadLatencyTracker.h"
 #include "read_pipeline/ReadToBamTypeNode.h"
+#include "read_pipeline/ReorderNode.h"
+#include "read_pipeline/SampleRateRouter.h"
 #include "read_pipeline/ScalerNode.h"
+#include "read_pipeline/PipelineTelemetry.h"
+#include "read_pipeline/ThreadAllocationController.h"
 #include "read_pipeline/StatsCounter.h"
+#include "utils/GpuMonitor.h"
+#include "utils/MemoryBudget.h"
+#include "utils/MemoryProfiler.h"
+#include "utils/MetricsServer.h"
+#include "utils/SignalCache.h"
+#include "utils/TensorPool.h"
+#include "utils/TraceRecorder.h"
 #include "utils/bam_utils.h"
+#include "utils/chunk_size_selection.h"
 #include "utils/cli_utils.h"
+#include "utils/cpu_dispatch.h"
+#include "utils/host_profile.h"
 #include "utils/log_utils.h"
 #include "utils/parameters.h"
+#include "utils/socket_utils.h"
+#include "utils/thread_utils.h"
 
 #include <argparse.hpp>
 #include <htslib/sam.h>
 #include <spdlog/spdlog.h>
 
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <csignal>
 #include <filesystem>
+#include <functional>
+#include <future>
 #include <iostream>
 #include <memory>
 #include <sstream>
 #include <thread>
+#include <unordered_map>
 
 namespace dorado {
 
@@ -42,11 +71,63 @@ using HtsWriter = utils::HtsWriter;
 using HtsReader = utils::HtsReader;
 using dorado::utils::default_parameters;
 
+namespace {
+
+// Time a client has to send its request once connected, and the longest request allowed.
+constexpr auto kServerRequestTimeout = std::chrono::seconds(10);
+constexpr size_t kMaxServerRequestLength = 4096;
+// Reads whose lengths --auto-chunksize picks the chunk size from, and the steps it's picked in.
+constexpr size_t kChunkSizeSampleReads = 10000;
+constexpr size_t kChunkSizeStep = 1000;
+
+// Basecalls the inputs requested by clients of the socket at socket_path, one at a time in
+// the order they connect, using basecall and the models it has already loaded.
+// A client sends the path of its input, either relative to root or absolute but within
+// it, followed by a newline.  The calls are written back over the connection, which is
+// closed once they are done, or with nothing written if the request can't be basecalled.
+// Runs until the process is stopped.
+void serve(const std::string& socket_path,
+           const std::string& root,
+           const std::function<void(const std::string&, int)>& basecall) {
+#ifndef _WIN32
+    // A client which disconnects early mustn't take the server down with it.
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+    utils::LocalSocketServer server(socket_path);
+    spdlog::info("> Listening for basecalling requests on {}", socket_path);
+    while (true) {
+        const int connection = server.accept();
+        const auto request =
+                utils::read_line(connection, kMaxServerRequestLength, kServerRequestTimeout);
+        const auto input_path =
+                request ? utils::resolve_path_within(root, *request) : std::nullopt;
+        if (!input_path) {
+            spdlog::warn("> Ignoring request for '{}', which isn't an input within {}",
+                         request.value_or(""), root);
+            utils::close_socket(connection);
+            continue;
+        }
+
+        spdlog::info("> Basecalling {}", input_path->string());
+        // Pick up files which have been written since the input was last requested.
+        DatasetIndex::clear_memory_cache();
+        try {
+            basecall(input_path->string(), connection);
+            spdlog::info("> Finished {}", input_path->string());
+        } catch (const std::exception& e) {
+            spdlog::error("Unable to basecall {}: {}", input_path->string(), e.what());
+        }
+        utils::close_socket(connection);
+    }
+}
+
+}  // namespace
+
 void setup(std::vector<std::string> args,
            const std::filesystem::path& model_path,
            const std::string& data_path,
            const std::string& remora_models,
-           const std::string& device,
+           const std::string& device_arg,
            const std::string& ref,
            size_t chunk_size,
            size_t overlap,
@@ -59,71 +140,353 @@ void setup(std::vector<std::string> args,
            bool emit_moves,
            size_t max_reads,
            size_t min_qscore,
+           size_t min_read_length,
            std::string read_list_file_path,
            bool recursive_file_loading,
            int kmer_size,
            int window_size,
            uint64_t mm2_index_batch_size,
-           bool skip_model_compatibility_check) {
+           bool skip_model_compatibility_check,
+           bool numa_affinity,
+           bool watch,
+           int watch_idle_timeout,
+           const std::string& watch_sentinel,
+           bool gpu_scaling,
+           const std::string& chunk_buckets,
+           int batch_latency_target_ms,
+           bool cuda_graphs,
+           const std::string& server_socket,
+           const utils::ShardedOutputSettings& sharded_output,
+           const std::string& sorted_output_path,
+           const utils::SortedOutputSettings& sorted_output,
+           const std::string& cram_reference,
+           bool compress_fastq,
+           const std::string& telemetry_file,
+           int metrics_port,
+           const std::string& trace_file,
+           bool read_latency,
+           const std::string& memory_profile,
+           const DatasetShard& dataset_shard,
+           const std::vector<std::string>& remote_runners,
+           const std::vector<std::filesystem::path>& extra_models,
+           const std::string& signal_cache_path,
+           const std::string& priority_read_list_file_path,
+           const std::string& priority_channels,
+           size_t ordered_output,
+           size_t readahead_bytes,
+           bool drop_page_cache,
+           float gpu_power_cap_watts,
+           bool auto_chunk_size,
+           const std::filesystem::path& cascade_model,
+           const CascadePolicy& cascade_policy,
+           bool fuse_remora_models,
+           const utils::HostProfile& host_profile) {
+    if (watch && !server_socket.empty()) {
+        throw std::runtime_error("--watch cannot be used with --server");
+    }
+    if (!sharded_output.directory.empty() && !server_socket.empty()) {
+        throw std::runtime_error("--output-dir cannot be used with --server");
+    }
+    if (!sorted_output_path.empty() && !server_socket.empty()) {
+        throw std::runtime_error("--sorted-output cannot be used with --server");
+    }
+
     torch::set_num_threads(1);
-    std::vector<Runner> runners;
 
-    // Default is 1 device.  CUDA path may alter this.
-    int num_devices = 1;
+    if (!ref.empty()) {
+        // Built while the models are loaded and their batch sizes picked, rather than after.
+        utils::preload_minimap_index(ref, kmer_size, window_size, mm2_index_batch_size,
+                                     std::max(1u, std::thread::hardware_concurrency() / 2));
+    }
 
-    if (device == "cpu") {
-        num_runners = std::thread::hardware_concurrency();
-        if (batch_size == 0) {
-            batch_size = 128;
+    // Smaller chunk sizes for short reads and the ends of reads, on top of chunk_size.
+    std::vector<int> bucket_chunk_sizes;
+    std::istringstream bucket_stream{chunk_buckets};
+    std::string bucket_chunk_size;
+    while (std::getline(bucket_stream, bucket_chunk_size, ',')) {
+        const int size = std::stoi(bucket_chunk_size);
+        if (size <= 0 || size >= static_cast<int>(chunk_size)) {
+            throw std::runtime_error(
+                    "--chunk-buckets sizes must be positive and less than the chunk size");
         }
-        spdlog::debug("- CPU calling: set batch size to {}, num_runners to {}", batch_size,
-                      num_runners);
+        bucket_chunk_sizes.push_back(size);
+    }
+
+    if (auto_chunk_size && server_socket.empty()) {
+        // Picked before the runners are made, so their batch sizes are picked for it.
+        const auto read_lengths = DataLoader::sample_read_lengths(
+                data_path, kChunkSizeSampleReads, recursive_file_loading, dataset_shard);
+        const std::vector<size_t> buckets(bucket_chunk_sizes.begin(), bucket_chunk_sizes.end());
+        const auto selected_chunk_size = utils::select_chunk_size(
+                read_lengths, utils::chunk_size_candidates(chunk_size, overlap, kChunkSizeStep),
+                buckets, overlap);
+        spdlog::info("> Chunk size {}, picked from the lengths of {} reads", selected_chunk_size,
+                     read_lengths.size());
+        chunk_size = selected_chunk_size;
+        // Buckets no smaller than the chunk size have nothing to take.
+        bucket_chunk_sizes.erase(std::remove_if(bucket_chunk_sizes.begin(),
+                                                bucket_chunk_sizes.end(),
+                                                [chunk_size](int size) {
+                                                    return size >= static_cast<int>(chunk_size);
+                                                }),
+                                 bucket_chunk_sizes.end());
+    }
 
-        for (size_t i = 0; i < num_runners; i++) {
-            runners.push_back(std::make_shared<ModelRunner<CPUDecoder>>(model_path, device,
-                                                                        chunk_size, batch_size));
+    if (!remora_models.empty() && output_mode == HtsWriter::OutputMode::FASTQ) {
+        throw std::runtime_error("Modified base models cannot be used with FASTQ output");
+    }
+    if (!extra_models.empty() && (!remora_models.empty() || !remote_runners.empty())) {
+        throw std::runtime_error(
+                "--extra-models cannot be used with modified base models or --remote-runners");
+    }
+    if (!cascade_model.empty()) {
+        if (!extra_models.empty() || !remora_models.empty() || !remote_runners.empty()) {
+            throw std::runtime_error(
+                    "--cascade-model cannot be used with --extra-models, modified base models or "
+                    "--remote-runners");
+        }
+        if (!cascade_policy.is_set()) {
+            throw std::runtime_error(
+                    "--cascade-model needs --cascade-max-qscore, --cascade-min-length or "
+                    "--cascade-read-ids to pick the reads to call again");
         }
     }
-#if DORADO_GPU_BUILD
-#ifdef __APPLE__
-    else if (device == "metal") {
-        auto caller = create_metal_caller(model_path, chunk_size, batch_size);
-        for (size_t i = 0; i < num_runners; i++) {
-            runners.push_back(std::make_shared<MetalModelRunner>(caller));
+
+    // Reads are routed to the model for their sample rate, so each model needs its own.
+    const auto model_sample_rate = get_model_sample_rate(model_path);
+    std::vector<uint16_t> extra_sample_rates;
+    for (const auto& extra_model : extra_models) {
+        const auto sample_rate = get_model_sample_rate(extra_model);
+        if (sample_rate == model_sample_rate ||
+            std::count(extra_sample_rates.begin(), extra_sample_rates.end(), sample_rate) > 0) {
+            throw std::runtime_error("More than one model was given for " +
+                                     std::to_string(sample_rate) + "Hz data");
+        }
+        extra_sample_rates.push_back(sample_rate);
+    }
+    if (!cascade_model.empty() && get_model_sample_rate(cascade_model) != model_sample_rate) {
+        throw std::runtime_error("The cascade model is for a different sample rate from the model");
+    }
+
+    std::vector<std::filesystem::path> remora_model_list;
+    std::istringstream stream{remora_models};
+    std::string model;
+    while (std::getline(stream, model, ',')) {
+        remora_model_list.push_back(model);
+    }
+
+    std::string model_name = std::filesystem::canonical(model_path).filename().string();
+    std::vector<std::string> extra_model_names;
+    for (const auto& extra_model : extra_models) {
+        extra_model_names.push_back(std::filesystem::canonical(extra_model).filename().string());
+    }
+    const std::string cascade_model_name =
+            cascade_model.empty() ? ""
+                                  : std::filesystem::canonical(cascade_model).filename().string();
+    auto read_list = utils::load_read_list(read_list_file_path);
+
+    // What the pipeline needs to know of an input before its reads are loaded.
+    struct InputScan {
+        std::unordered_map<std::string, ReadGroup> read_groups;
+        uint16_t sample_rate;
+        size_t num_reads;
+    };
+    auto scan_input = [&](const std::string& input_path) {
+        InputScan scan;
+        scan.read_groups = DataLoader::load_read_groups(input_path, model_name,
+                                                        recursive_file_loading, dataset_shard);
+        // Reads name the read group of the model which called them.
+        for (const auto& extra_model_name : extra_model_names) {
+            scan.read_groups.merge(DataLoader::load_read_groups(
+                    input_path, extra_model_name, recursive_file_loading, dataset_shard));
         }
-        if (runners.back()->batch_size() != batch_size) {
-            spdlog::debug("- set batch size to {}", runners.back()->batch_size());
+        if (!cascade_model_name.empty()) {
+            scan.read_groups.merge(DataLoader::load_read_groups(
+                    input_path, cascade_model_name, recursive_file_loading, dataset_shard));
         }
-    } else {
-        throw std::runtime_error(std::string("Unsupported device: ") + device);
+        scan.sample_rate =
+                DataLoader::get_sample_rate(input_path, recursive_file_loading, dataset_shard);
+        scan.num_reads = DataLoader::get_num_reads(input_path, read_list, recursive_file_loading,
+                                                   dataset_shard);
+        return scan;
+    };
+    // The input is scanned while the models are set up, rather than after.  A server's inputs
+    // aren't known until they're requested, and a watched input may not have any files yet.
+    std::future<InputScan> data_scan;
+    if (server_socket.empty() && !watch) {
+        data_scan = std::async(std::launch::async, scan_input, data_path);
     }
-#else   // ifdef __APPLE__
-    else {
-        auto devices = utils::parse_cuda_device_string(device);
-        num_devices = devices.size();
-        if (num_devices == 0) {
-            throw std::runtime_error("CUDA device requested but no devices found.");
-        }
-        for (auto device_string : devices) {
-            auto caller = create_cuda_caller(model_path, chunk_size, batch_size, device_string);
+
+    // With "cuda:all,cpu" or "metal,cpu", CPU runners call alongside the GPUs'.
+    const auto device_split = utils::split_cpu_from_device(device_arg);
+    const std::string& device = device_split.first;
+    const bool cpu_runners_alongside = device_split.second && device != "cpu";
+
+    // generate model callers before nodes or it affects the speed calculations
+    std::vector<std::shared_ptr<RemoraCaller>> remora_callers;
+
+    // Default is 1 device.  CUDA path may alter this.
+    int num_devices = 1;
+
+    // Each model's runners are made on every device, a model at a time.  On GPUs, each model's
+    // batch size is picked from memory_share of the memory the models before it leave, so
+    // that there's room for the models after it, and the models' runners take turns at the
+    // GPU like any others.
+    const size_t num_models = 1 + extra_models.size() + (cascade_model.empty() ? 0 : 1);
+    auto create_runners = [&](const std::filesystem::path& path, float memory_share) {
+        std::vector<Runner> runners;
+        if (device == "cpu" && !remote_runners.empty()) {
+            // The workers do the calling, leaving the CPUs to load and scale reads for them.
+            spdlog::debug("- CPU calling: only remote runners are used");
+        } else if (device == "cpu") {
+            // The models share the cores.
+            num_runners = std::max<size_t>(1, std::thread::hardware_concurrency() / num_models);
+            if (batch_size == 0) {
+                batch_size = 128;
+            }
+            spdlog::debug("- CPU calling: set batch size to {}, num_runners to {}", batch_size,
+                          num_runners);
+
             for (size_t i = 0; i < num_runners; i++) {
-                runners.push_back(std::make_shared<CudaModelRunner>(caller));
+                runners.push_back(std::make_shared<ModelRunner<CPUDecoder>>(
+                        path, device, chunk_size, batch_size));
+                for (auto bucket_size : bucket_chunk_sizes) {
+                    runners.push_back(std::make_shared<ModelRunner<CPUDecoder>>(
+                            path, device, bucket_size, batch_size));
+                }
+            }
+        }
+#if DORADO_GPU_BUILD
+#ifdef __APPLE__
+        else if (device == "metal") {
+            if (!bucket_chunk_sizes.empty()) {
+                // Metal kernels are built for the caller's chunk size.
+                spdlog::warn("--chunk-buckets is not supported on metal, ignoring");
+            }
+            auto caller = create_metal_caller(path, chunk_size, batch_size);
+            for (size_t i = 0; i < num_runners; i++) {
+                runners.push_back(std::make_shared<MetalModelRunner>(caller));
             }
             if (runners.back()->batch_size() != batch_size) {
-                spdlog::debug("- set batch size for {} to {}", device_string,
-                              runners.back()->batch_size());
+                spdlog::debug("- set batch size to {}", runners.back()->batch_size());
+            }
+        } else {
+            throw std::runtime_error(std::string("Unsupported device: ") + device);
+        }
+#else   // ifdef __APPLE__
+        else {
+            auto devices = utils::parse_cuda_device_string(device);
+            num_devices = devices.size();
+            if (num_devices == 0) {
+                throw std::runtime_error("CUDA device requested but no devices found.");
+            }
+            // Read signals are loaded into pinned buffers, which go to the GPUs without staging.
+            utils::use_pinned_tensor_pool();
+            const auto model_stride = load_crf_model_config(path).stride;
+            // Each device is set up on a thread of its own, so that loading the models onto
+            // them and picking their batch sizes overlaps.
+            struct DeviceSetup {
+                std::vector<Runner> runners;
+                std::vector<std::shared_ptr<RemoraCaller>> remora_callers;
+            };
+            auto setups = utils::run_concurrently(devices.size(), [&](size_t device_index) {
+                const auto& device_string = devices[device_index];
+                DeviceSetup setup;
+                // Remora models are set up first, so the basecaller's batch size is picked from
+                // the memory their batches leave.
+                size_t remora_memory_bytes = 0;
+                for (const auto& remora_model : remora_model_list) {
+                    auto caller = std::make_shared<RemoraCaller>(remora_model, device_string,
+                                                                 remora_batch_size, model_stride);
+                    remora_memory_bytes += caller->device_memory_bytes();
+                    setup.remora_callers.push_back(caller);
+                }
+                float memory_limit_fraction = memory_share;
+                if (remora_memory_bytes > 0) {
+                    const auto available = utils::available_memory(torch::Device(device_string));
+                    memory_limit_fraction *=
+                            std::max(0.f, 1.f - float(remora_memory_bytes) / float(available));
+                    spdlog::debug("- reserving {:.2f}GB on {} for modbase calling",
+                                  remora_memory_bytes / 1e+9, device_string);
+                }
+
+                auto caller = create_cuda_caller(path, chunk_size, batch_size, device_string,
+                                                 memory_limit_fraction, false, numa_affinity,
+                                                 cuda_graphs, gpu_power_cap_watts);
+                for (size_t i = 0; i < num_runners; i++) {
+                    setup.runners.push_back(std::make_shared<CudaModelRunner>(caller));
+                    for (auto bucket_size : bucket_chunk_sizes) {
+                        setup.runners.push_back(
+                                std::make_shared<CudaModelRunner>(caller, bucket_size));
+                    }
+                }
+                if (setup.runners.back()->batch_size() != batch_size) {
+                    spdlog::debug("- set batch size for {} to {}", device_string,
+                                  setup.runners.back()->batch_size());
+                }
+                return setup;
+            });
+            // In device order, as they were set up one at a time before.
+            for (auto& setup : setups) {
+                runners.insert(runners.end(), setup.runners.begin(), setup.runners.end());
+                remora_callers.insert(remora_callers.end(), setup.remora_callers.begin(),
+                                      setup.remora_callers.end());
             }
         }
-    }
 #endif  // __APPLE__
 #endif  // DORADO_GPU_BUILD
+        if (cpu_runners_alongside) {
+            // Each runner calls its own batches, and takes them as it's ready for them, so the
+            // faster GPU runners take most of the chunks.  Half the cores are left for the rest
+            // of the pipeline, which the GPUs keep much busier than CPU calling alone would.
+            const size_t num_cpu_runners =
+                    std::max<size_t>(1, std::thread::hardware_concurrency() / 2 / num_models);
+            constexpr size_t kCpuBatchSize = 128;
+            // In chunks of the GPU's size, as it may have adjusted it.
+            const size_t cpu_chunk_size =
+                    runners.empty() ? chunk_size : runners.front()->chunk_size();
+            for (size_t i = 0; i < num_cpu_runners; i++) {
+                runners.push_back(std::make_shared<ModelRunner<CPUDecoder>>(
+                        path, "cpu", cpu_chunk_size, kCpuBatchSize));
+            }
+            spdlog::info("> Calling on {} CPU runners alongside {}, in batches of {}",
+                         num_cpu_runners, device, kCpuBatchSize);
+        }
+        return runners;
+    };
+    auto runners = create_runners(model_path, 1.f / num_models);
+    std::vector<std::vector<Runner>> extra_runners;
+    for (size_t i = 0; i < extra_models.size(); ++i) {
+        extra_runners.push_back(create_runners(extra_models[i], 1.f / (num_models - 1 - i)));
+    }
+    // The cascade model takes the rest of the memory.
+    std::vector<Runner> cascade_runners;
+    if (!cascade_model.empty()) {
+        cascade_runners = create_runners(cascade_model, 1.f);
+    }
+
+    for (const auto& address : remote_runners) {
+        for (auto& runner : connect_remote_runners(address)) {
+            if (!runners.empty() && (runner->model_stride() != runners.front()->model_stride() ||
+                                     runner->chunk_size() != runners.front()->chunk_size())) {
+                throw std::runtime_error("The runners at " + address +
+                                         " have a different model stride or chunk size from the "
+                                         "others. Give every worker the same model and -c.");
+            }
+            runners.push_back(std::move(runner));
+        }
+    }
+    if (runners.empty()) {
+        throw std::runtime_error("No runners to basecall with.");
+    }
 
     // verify that all runners are using the same stride, in case we allow multiple models in future
+    // Runners for --chunk-buckets have smaller chunk sizes than the first.
     auto model_stride = runners.front()->model_stride();
     auto adjusted_chunk_size = runners.front()->chunk_size();
     assert(std::all_of(runners.begin(), runners.end(), [&](auto runner) {
         return runner->model_stride() == model_stride &&
-               runner->chunk_size() == adjusted_chunk_size;
+               runner->chunk_size() <= adjusted_chunk_size;
     }));
 
     if (chunk_size != adjusted_chunk_size) {
@@ -138,118 +501,445 @@ void setup(std::vector<std::string> args,
         overlap = adjusted_overlap;
     }
 
-    if (!remora_models.empty() && output_mode == HtsWriter::OutputMode::FASTQ) {
-        throw std::runtime_error("Modified base models cannot be used with FASTQ output");
-    }
-
     if (!ref.empty() && output_mode == HtsWriter::OutputMode::FASTQ) {
         throw std::runtime_error("Alignment to reference cannot be used with FASTQ output.");
     }
 
-    std::vector<std::filesystem::path> remora_model_list;
-    std::istringstream stream{remora_models};
-    std::string model;
-    while (std::getline(stream, model, ',')) {
-        remora_model_list.push_back(model);
+    // CUDA remora callers were set up alongside the basecallers for their devices.
+    if (remora_callers.empty()) {
+        for (const auto& remora_model : remora_model_list) {
+            auto caller = std::make_shared<RemoraCaller>(remora_model, device, remora_batch_size,
+                                                         model_stride);
+            remora_callers.push_back(caller);
+        }
     }
 
-    // generate model callers before nodes or it affects the speed calculations
-    std::vector<std::shared_ptr<RemoraCaller>> remora_callers;
+    auto priority_read_list = utils::load_read_list(priority_read_list_file_path);
+    auto priority_channel_set = utils::parse_channel_list(priority_channels);
+    bool rna = utils::is_rna_model(model_path), duplex = false;
 
-#if DORADO_GPU_BUILD && !defined(__APPLE__)
-    if (device != "cpu") {
-        auto devices = utils::parse_cuda_device_string(device);
-        num_devices = devices.size();
+    auto thread_allocations = utils::default_thread_allocations(
+            num_devices, !remora_model_list.empty() ? num_remora_threads : 0);
+    host_profile.apply(thread_allocations);
+
+    // Kept across calls, so that scrapers of a server's metrics needn't follow each call.
+    std::unique_ptr<utils::MetricsServer> metrics_server;
+    if (metrics_port > 0) {
+#ifndef _WIN32
+        // A scraper which disconnects early mustn't take the basecaller down with it.
+        std::signal(SIGPIPE, SIG_IGN);
+#endif
+        metrics_server = std::make_unique<utils::MetricsServer>(metrics_port);
+        spdlog::info("> Serving metrics on port {}", metrics_server->port());
+    }
+
+    // Opened once, so a server's calls share it.
+    std::shared_ptr<utils::SignalCache> signal_cache;
+    if (!signal_cache_path.empty()) {
+        signal_cache = std::make_shared<utils::SignalCache>(signal_cache_path,
+                                                            ScalerNode::scaling_key());
+    }
+
+    // Basecalls the reads in input_path, writing them to output_fd, or to stdout if it's
+    // negative.  The runners and callers are shared by every call.
+    auto basecall = [&](const std::string& input_path, int output_fd) {
+        if (!trace_file.empty()) {
+            utils::TraceRecorder::instance().start();
+        }
+        std::unique_ptr<utils::MemoryProfiler> memory_profiler;
+        if (!memory_profile.empty()) {
+            memory_profiler = std::make_unique<utils::MemoryProfiler>(
+                    memory_profile, utils::kMemoryProfileInterval);
+        }
+        auto scan = data_scan.valid() && input_path == data_path ? data_scan.get()
+                                                                  : scan_input(input_path);
+        auto& read_groups = scan.read_groups;
+
+        // Check sample rate of model vs data.  With --extra-models, reads at any other sample
+        // rate are called by the first model, with a warning.
+        auto data_sample_rate = scan.sample_rate;
+        if (!skip_model_compatibility_check && extra_models.empty() &&
+            (data_sample_rate != model_sample_rate)) {
+            std::stringstream err;
+            err << "Sample rate for model (" << model_sample_rate << ") and data ("
+                << data_sample_rate << ") don't match.";
+            throw std::runtime_error(err.str());
+        }
+
+        size_t num_reads = scan.num_reads;
+        num_reads = max_reads == 0 ? num_reads : std::min(num_reads, max_reads);
+        if (watch) {
+            // The total isn't known up front, so no progress bar.
+            num_reads = 0;
+        }
+
+        std::unique_ptr<sam_hdr_t, void (*)(sam_hdr_t*)> hdr(sam_hdr_init(), sam_hdr_destroy);
+        utils::add_pg_hdr(hdr.get(), args);
+        utils::add_rg_hdr(hdr.get(), read_groups);
+        std::shared_ptr<HtsWriter> bam_writer;
+        std::shared_ptr<utils::ShardedHtsWriter> sharded_writer;
+        // Between the writer and the nodes feeding it, and so destroyed between them.
+        std::unique_ptr<ReorderNode> reorder_node;
+        std::shared_ptr<utils::Aligner> aligner;
+        std::unique_ptr<ReadToBamType> read_converter;
+        std::unique_ptr<FastqWriterNode> fastq_writer;
+        // The CPU-bound nodes spawn spare workers, which the thread allocation controller
+        // hands to whichever of them is the current bottleneck.
+        const int kMaxWorkerThreadsFactor = 2;
+        if (output_mode == HtsWriter::OutputMode::FASTQ) {
+            // FASTQ is formatted straight from the reads, without going through BAM records.
+            fastq_writer = std::make_unique<FastqWriterNode>(
+                    output_fd, compress_fastq, rna, thread_allocations.read_converter_threads,
+                    thread_allocations.writer_threads, num_reads);
+        } else {
+            MessageSink* output_sink = nullptr;
+            if (!sharded_output.directory.empty()) {
+                sharded_writer = std::make_shared<utils::ShardedHtsWriter>(
+                        sharded_output, thread_allocations.writer_threads, num_reads);
+                output_sink = sharded_writer.get();
+            } else if (!sorted_output_path.empty()) {
+                bam_writer = std::make_shared<HtsWriter>(sorted_output_path, output_mode,
+                                                         thread_allocations.writer_threads,
+                                                         num_reads);
+                bam_writer->set_sorted_output(sorted_output);
+                output_sink = bam_writer.get();
+            } else if (output_fd < 0) {
+                bam_writer = std::make_shared<HtsWriter>(
+                        "-", output_mode, thread_allocations.writer_threads, num_reads);
+                output_sink = bam_writer.get();
+            } else {
+                bam_writer = std::make_shared<HtsWriter>(
+                        output_fd, output_mode, thread_allocations.writer_threads, num_reads);
+                output_sink = bam_writer.get();
+            }
+            if (ordered_output > 0) {
+                reorder_node = std::make_unique<ReorderNode>(*output_sink, ordered_output);
+                output_sink = reorder_node.get();
+            }
+            if (!ref.empty()) {
+                // The aligner takes the reads themselves, and makes their records as it maps
+                // them.
+                aligner = std::make_shared<utils::Aligner>(
+                        *output_sink, ref, kmer_size, window_size, mm2_index_batch_size,
+                        thread_allocations.aligner_threads);
+                aligner->set_read_conversion(emit_moves, rna, methylation_threshold_pct);
+                utils::add_sq_hdr(hdr.get(), aligner->get_sequence_records_for_header());
+            }
+            if (sharded_writer) {
+                sharded_writer->add_header(hdr.get());
+            } else {
+                if (!cram_reference.empty()) {
+                    bam_writer->set_cram_reference(cram_reference);
+                }
+                bam_writer->add_header(hdr.get());
+                bam_writer->write_header();
+            }
+            if (!aligner) {
+                read_converter = std::make_unique<ReadToBamType>(
+                        *output_sink, emit_moves, rna, thread_allocations.read_converter_threads,
+                        methylation_threshold_pct, 1000,
+                        kMaxWorkerThreadsFactor * thread_allocations.read_converter_threads);
+            }
+        }
+        MessageSink& reads_sink = fastq_writer ? static_cast<MessageSink&>(*fastq_writer)
+                                  : aligner    ? static_cast<MessageSink&>(*aligner)
+                                               : *read_converter;
+        StatsCounterNode stats_node(reads_sink, duplex);
 
-        for (auto device_string : devices) {
-            for (const auto& remora_model : remora_model_list) {
-                auto caller = std::make_shared<RemoraCaller>(remora_model, device_string,
-                                                             remora_batch_size, model_stride);
-                remora_callers.push_back(caller);
+        std::unique_ptr<ModBaseCallerNode> mod_base_caller_node;
+        MessageSink* read_filter_node_sink = static_cast<MessageSink*>(&stats_node);
+        if (!remora_model_list.empty()) {
+            mod_base_caller_node = std::make_unique<ModBaseCallerNode>(
+                    stats_node, remora_callers, thread_allocations.remora_threads, num_devices,
+                    model_stride, remora_batch_size, 1000, fuse_remora_models);
+            read_filter_node_sink = static_cast<MessageSink*>(mod_base_caller_node.get());
+        }
+        // Reads are filtered as soon as they're basecalled, so that modbase calling, alignment
+        // and conversion are only spent on reads which will be written.
+        ReadFilterNode read_filter_node(*read_filter_node_sink, min_qscore, min_read_length,
+                                        thread_allocations.read_filter_threads);
+        // Reads dropped on the way are skipped by the reorder node, so that the reads after
+        // them don't wait for them.
+        std::function<void(const Read&)> skip_dropped_read;
+        if (reorder_node) {
+            skip_dropped_read = [&reorder_node](const Read& read) {
+                reorder_node->skip(read.sequence_number);
+            };
+            read_filter_node.set_on_read_dropped(skip_dropped_read);
+        }
+        // With --extra-models each model has a BasecallerNode, with its own batches, fed the
+        // reads at its sample rate.  They reach the read filter through routers, so that it's
+        // terminated once they all have been.
+        std::vector<std::unique_ptr<MessageRouter>> basecaller_routers;
+        auto basecaller_sink = [&]() -> MessageSink& {
+            if (extra_models.empty() && cascade_model.empty()) {
+                return read_filter_node;
+            }
+            return *basecaller_routers.emplace_back(
+                    std::make_unique<MessageRouter>(read_filter_node));
+        };
+        // With --cascade-model, the reads the policy picks from the first model's calls are
+        // called again by the cascade model, and only the final call of each goes on.
+        std::unique_ptr<BasecallerNode> cascade_basecaller_node;
+        std::unique_ptr<CascadeRouter> cascade_router;
+        if (!cascade_model.empty()) {
+            const auto stride = cascade_runners.front()->model_stride();
+            cascade_basecaller_node = std::make_unique<BasecallerNode>(
+                    basecaller_sink(), cascade_runners, (overlap / stride) * stride,
+                    batch_latency_target_ms, cascade_model_name);
+            cascade_router = std::make_unique<CascadeRouter>(
+                    basecaller_sink(), *cascade_basecaller_node, cascade_policy);
+        }
+        BasecallerNode basecaller_node(
+                cascade_router ? static_cast<MessageSink&>(*cascade_router) : basecaller_sink(),
+                runners, overlap, batch_latency_target_ms, model_name);
+        std::vector<std::unique_ptr<BasecallerNode>> extra_basecaller_nodes;
+        for (size_t i = 0; i < extra_models.size(); ++i) {
+            const auto stride = extra_runners[i].front()->model_stride();
+            extra_basecaller_nodes.push_back(std::make_unique<BasecallerNode>(
+                    basecaller_sink(), extra_runners[i], (overlap / stride) * stride,
+                    batch_latency_target_ms, extra_model_names[i]));
+        }
+        if (skip_dropped_read) {
+            basecaller_node.set_on_read_dropped(skip_dropped_read);
+            if (cascade_basecaller_node) {
+                cascade_basecaller_node->set_on_read_dropped(skip_dropped_read);
+            }
+            for (auto& node : extra_basecaller_nodes) {
+                node->set_on_read_dropped(skip_dropped_read);
+            }
+        }
+        std::unique_ptr<SampleRateRouter> sample_rate_router;
+        MessageSink* scaler_node_sink = &basecaller_node;
+        if (!extra_models.empty()) {
+            sample_rate_router = std::make_unique<SampleRateRouter>(basecaller_node);
+            for (size_t i = 0; i < extra_models.size(); ++i) {
+                sample_rate_router->route(extra_sample_rates[i], *extra_basecaller_nodes[i]);
             }
+            scaler_node_sink = sample_rate_router.get();
         }
-    } else
+        std::string scaling_device = "cpu";
+        if (gpu_scaling) {
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+            if (device != "cpu" && num_devices == 1) {
+                scaling_device = utils::parse_cuda_device_string(device).front();
+            }
 #endif
-    {
-        for (const auto& remora_model : remora_model_list) {
-            auto caller = std::make_shared<RemoraCaller>(remora_model, device, remora_batch_size,
-                                                         model_stride);
-            remora_callers.push_back(caller);
+            if (scaling_device == "cpu") {
+                spdlog::warn("--gpu-scaling requires a single CUDA device, scaling on the CPU");
+            }
         }
-    }
+        ScalerNode scaler_node(*scaler_node_sink, thread_allocations.scaler_node_threads, 1000,
+                               kMaxWorkerThreadsFactor * thread_allocations.scaler_node_threads,
+                               scaling_device, signal_cache);
 
-    std::string model_name = std::filesystem::canonical(model_path).filename().string();
-    auto read_groups = DataLoader::load_read_groups(data_path, model_name, recursive_file_loading);
+        ThreadAllocationController thread_controller;
+        thread_controller.add_node(
+                "scaler", scaler_node, scaler_node.worker_gate(), 1,
+                kMaxWorkerThreadsFactor * thread_allocations.scaler_node_threads);
+        if (read_converter) {
+            thread_controller.add_node(
+                    "read_converter", *read_converter, read_converter->worker_gate(), 1,
+                    kMaxWorkerThreadsFactor * thread_allocations.read_converter_threads);
+        }
+        thread_controller.start();
 
-    auto read_list = utils::load_read_list(read_list_file_path);
+        // Per-node queue telemetry, logged with --verbose and written to --telemetry-file.  It
+        // always runs, so that a stalled pipeline's bottleneck is reported with what to do about
+        // it.
+        auto telemetry = std::make_unique<PipelineTelemetry>(std::chrono::milliseconds(1000),
+                                                             telemetry_file);
+        telemetry->add_node("scaler", scaler_node,
+                            gpu_scaling ? "the CPU is oversubscribed"
+                                        : "scale on the GPU with --gpu-scaling");
+        telemetry->add_node("basecaller", basecaller_node,
+                            "basecalling runs at the model's speed on this device");
+        for (size_t i = 0; i < extra_basecaller_nodes.size(); ++i) {
+            telemetry->add_node("basecaller_" + extra_model_names[i], *extra_basecaller_nodes[i],
+                                "basecalling runs at the model's speed on this device");
+        }
+        if (cascade_basecaller_node) {
+            telemetry->add_node("basecaller_" + cascade_model_name, *cascade_basecaller_node,
+                                "too many reads are called again; tighten the cascade policy");
+        }
+        telemetry->add_node("read_filter", read_filter_node, "the CPU is oversubscribed");
+        if (mod_base_caller_node) {
+            telemetry->add_node("modbase_caller", *mod_base_caller_node,
+                                "modified base calling is the limit; call fewer modified base "
+                                "models");
+        }
+        telemetry->add_node("stats", stats_node, "the CPU is oversubscribed");
+        if (fastq_writer) {
+            telemetry->add_node("fastq_writer", *fastq_writer,
+                                "writer-bound; write to faster storage, or drop --compress-fastq");
+        } else {
+            if (aligner) {
+                telemetry->add_node("aligner", *aligner,
+                                    "aligner-bound; run on more CPU cores, or align afterwards "
+                                    "with dorado aligner");
+            } else {
+                telemetry->add_node("read_converter", *read_converter,
+                                    "the CPU is oversubscribed");
+            }
+            if (reorder_node) {
+                telemetry->add_node("reorder", *reorder_node,
+                                    "the CPU is oversubscribed, or lower --ordered-output");
+            }
+            if (sharded_writer) {
+                telemetry->add_node("writer", *sharded_writer,
+                                    "writer-bound; write to faster storage, or raise "
+                                    "--output-shards");
+            } else {
+                telemetry->add_node("writer", *bam_writer,
+                                    "writer-bound; write to faster storage, or write several "
+                                    "files at once with --output-dir");
+            }
+        }
+        telemetry->start();
 
-    // Check sample rate of model vs data.
-    auto data_sample_rate = DataLoader::get_sample_rate(data_path, recursive_file_loading);
-    auto model_sample_rate = get_model_sample_rate(model_path);
-    if (!skip_model_compatibility_check && (data_sample_rate != model_sample_rate)) {
-        std::stringstream err;
-        err << "Sample rate for model (" << model_sample_rate << ") and data (" << data_sample_rate
-            << ") don't match.";
-        throw std::runtime_error(err.str());
-    }
+        // Reads are followed from the scaler to the node which writes or converts them.
+        std::unique_ptr<ReadLatencyTracker> latency_tracker;
+        if (read_latency) {
+            latency_tracker = std::make_unique<ReadLatencyTracker>();
+            latency_tracker->add_stage("scaler", scaler_node);
+            latency_tracker->add_stage("basecaller", basecaller_node);
+            for (size_t i = 0; i < extra_basecaller_nodes.size(); ++i) {
+                latency_tracker->add_stage("basecaller_" + extra_model_names[i],
+                                           *extra_basecaller_nodes[i]);
+            }
+            if (cascade_basecaller_node) {
+                latency_tracker->add_stage("basecaller_" + cascade_model_name,
+                                           *cascade_basecaller_node);
+            }
+            latency_tracker->add_stage("read_filter", read_filter_node);
+            if (mod_base_caller_node) {
+                latency_tracker->add_stage("modbase_caller", *mod_base_caller_node);
+            }
+            latency_tracker->add_stage("stats", stats_node);
+            latency_tracker->add_stage("output", reads_sink);
+        }
 
-    size_t num_reads = DataLoader::get_num_reads(data_path, read_list, recursive_file_loading);
-    num_reads = max_reads == 0 ? num_reads : std::min(num_reads, max_reads);
+        utils::GpuMonitor gpu_monitor;
+#if DORADO_GPU_BUILD
+        if (device != "cpu") {
+#ifdef __APPLE__
+            utils::add_metal_monitor_device(gpu_monitor);
+#else
+            utils::add_gpu_monitor_devices(gpu_monitor, device);
+#endif
+        }
+#endif
+        gpu_monitor.start();
 
-    bool rna = utils::is_rna_model(model_path), duplex = false;
+        auto metrics = std::make_shared<utils::MetricsRegistry>();
+        if (metrics_server) {
+            stats_node.add_metrics(*metrics);
+            basecaller_node.add_metrics(*metrics);
+            for (size_t i = 0; i < extra_basecaller_nodes.size(); ++i) {
+                extra_basecaller_nodes[i]->add_metrics(*metrics, extra_model_names[i]);
+            }
+            if (cascade_basecaller_node) {
+                cascade_basecaller_node->add_metrics(*metrics, cascade_model_name);
+            }
+            if (mod_base_caller_node) {
+                mod_base_caller_node->add_metrics(*metrics);
+            }
+            if (fastq_writer) {
+                fastq_writer->add_metrics(*metrics);
+            } else if (sharded_writer) {
+                sharded_writer->add_metrics(*metrics);
+            } else {
+                bam_writer->add_metrics(*metrics);
+            }
+            utils::MemoryBudget::instance().add_metrics(*metrics);
+            gpu_monitor.add_metrics(*metrics);
+            if (latency_tracker) {
+                latency_tracker->add_metrics(*metrics);
+            }
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+            if (device != "cpu") {
+                utils::add_gpu_memory_metrics(*metrics, device);
+            }
+#endif
+        }
+        const utils::ScopedMetrics scoped_metrics(metrics_server.get(), std::move(metrics));
 
-    auto const thread_allocations = utils::default_thread_allocations(
-            num_devices, !remora_model_list.empty() ? num_remora_threads : 0);
+        DataLoader loader(scaler_node, "cpu", thread_allocations.loader_threads, max_reads,
+                          std::move(read_list));
+        loader.set_max_concurrent_files(default_parameters.max_concurrent_files);
+        loader.set_readahead(readahead_bytes, drop_page_cache);
+        loader.set_shard(dataset_shard);
+        loader.set_signal_cache(signal_cache);
+        loader.set_priority_reads(std::move(priority_read_list), std::move(priority_channel_set));
+        if (sharded_writer && !sharded_writer->completed_read_ids().empty()) {
+            loader.set_skipped_read_ids(sharded_writer->completed_read_ids());
+        }
+        // Reads whose signal is too short to give min_read_length bases, even at twice the
+        // model's speed, are dropped before they're scaled, rather than after calling.
+        const auto min_signal_samples = utils::min_signal_samples_for_length(
+                min_read_length, data_sample_rate,
+                utils::get_bases_per_second_by_model_name(model_name));
+        if (min_signal_samples > 0) {
+            spdlog::debug("> Dropping reads of fewer than {} samples as they're loaded",
+                          min_signal_samples);
+            // They're taken off the progress bar's total, which counted them.
+            loader.set_min_signal_samples(min_signal_samples, [&] {
+                if (fastq_writer) {
+                    fastq_writer->remove_expected_reads(1);
+                } else if (sharded_writer) {
+                    sharded_writer->remove_expected_reads(1);
+                } else {
+                    bam_writer->remove_expected_reads(1);
+                }
+            });
+        }
+
+        if (watch) {
+            loader.watch_reads(input_path, recursive_file_loading,
+                               std::chrono::seconds(watch_idle_timeout), watch_sentinel);
+        } else {
+            loader.load_reads(input_path, recursive_file_loading);
+        }
 
-    std::unique_ptr<sam_hdr_t, void (*)(sam_hdr_t*)> hdr(sam_hdr_init(), sam_hdr_destroy);
-    utils::add_pg_hdr(hdr.get(), args);
-    utils::add_rg_hdr(hdr.get(), read_groups);
-    std::shared_ptr<HtsWriter> bam_writer;
-    std::shared_ptr<utils::Aligner> aligner;
-    MessageSink* converted_reads_sink = nullptr;
-    if (ref.empty()) {
-        bam_writer = std::make_shared<HtsWriter>("-", output_mode,
-                                                 thread_allocations.writer_threads, num_reads);
-        bam_writer->add_header(hdr.get());
-        bam_writer->write_header();
-        converted_reads_sink = bam_writer.get();
-    } else {
-        bam_writer = std::make_shared<HtsWriter>("-", output_mode,
-                                                 thread_allocations.writer_threads, num_reads);
-        aligner = std::make_shared<utils::Aligner>(*bam_writer, ref, kmer_size, window_size,
-                                                   mm2_index_batch_size,
-                                                   thread_allocations.aligner_threads);
-        utils::add_sq_hdr(hdr.get(), aligner->get_sequence_records_for_header());
-        bam_writer->add_header(hdr.get());
-        bam_writer->write_header();
-        converted_reads_sink = aligner.get();
-    }
-    ReadToBamType read_converter(*converted_reads_sink, emit_moves, rna,
-                                 thread_allocations.read_converter_threads,
-                                 methylation_threshold_pct);
-    StatsCounterNode stats_node(read_converter, duplex);
-    ReadFilterNode read_filter_node(stats_node, min_qscore, default_parameters.min_seqeuence_length,
-                                    thread_allocations.read_filter_threads);
-
-    std::unique_ptr<ModBaseCallerNode> mod_base_caller_node;
-    MessageSink* basecaller_node_sink = static_cast<MessageSink*>(&read_filter_node);
-    if (!remora_model_list.empty()) {
-        mod_base_caller_node = std::make_unique<ModBaseCallerNode>(
-                read_filter_node, std::move(remora_callers), thread_allocations.remora_threads,
-                num_devices, model_stride, remora_batch_size);
-        basecaller_node_sink = static_cast<MessageSink*>(mod_base_caller_node.get());
-    }
-    const int kBatchTimeoutMS = 100;
-    BasecallerNode basecaller_node(*basecaller_node_sink, std::move(runners), overlap,
-                                   kBatchTimeoutMS, model_name);
-    ScalerNode scaler_node(basecaller_node, thread_allocations.scaler_node_threads);
-
-    DataLoader loader(scaler_node, "cpu", thread_allocations.loader_threads, max_reads, read_list);
-
-    loader.load_reads(data_path, recursive_file_loading);
-
-    bam_writer->join();
-    stats_node.dump_stats();
+        if (fastq_writer) {
+            fastq_writer->join();
+        } else if (sharded_writer) {
+            sharded_writer->join();
+        } else {
+            bam_writer->join();
+        }
+        telemetry->stop();
+        gpu_monitor.stop();
+        if (!trace_file.empty()) {
+            auto& trace_recorder = utils::TraceRecorder::instance();
+            trace_recorder.stop();
+            trace_recorder.write_chrome_trace(trace_file);
+        }
+        const double gpu_energy_joules = gpu_monitor.energy_joules();
+        stats_node.dump_stats(std::isnan(gpu_energy_joules) ? 0 : gpu_energy_joules);
+        if (loader.num_short_reads_dropped() > 0) {
+            spdlog::info("> Reads too short to basecall, dropped as they were loaded: {}",
+                         loader.num_short_reads_dropped());
+        }
+        gpu_monitor.log_summary();
+        if (latency_tracker) {
+            latency_tracker->log_summary();
+        }
+        telemetry->summary();
+        // The last report, while the pipeline still holds what it has.
+        memory_profiler.reset();
+    };
+
+    if (server_socket.empty()) {
+        if (watch && !DataLoader::wait_for_input_files(data_path, recursive_file_loading,
+                                                       std::chrono::seconds(watch_idle_timeout))) {
+            throw std::runtime_error("No input files appeared in " + data_path);
+        }
+        basecall(data_path, -1);
+        return;
+    }
+
+    serve(server_socket, data_path, basecall);
 }
 
 int basecaller(int argc, char* argv[]) {
@@ -259,15 +949,23 @@ int basecaller(int argc, char* argv[]) {
 
     parser.add_argument("model").help("the basecaller model to run.");
 
-    parser.add_argument("data").help("the data directory.");
+    parser.add_argument("data").help(
+            "the data directory. With --server, the directory that requested inputs must be "
+            "within.");
 
     parser.add_argument("-v", "--verbose").default_value(false).implicit_value(true);
 
     parser.add_argument("-x", "--device")
             .help("device string in format \"cuda:0,...,N\", \"cuda:all\", \"metal\", \"cpu\" "
-                  "etc..")
+                  "etc.. Add \",cpu\", e.g. \"cuda:all,cpu\", to call on the CPU alongside the "
+                  "GPUs.")
             .default_value(default_parameters.device);
 
+    parser.add_argument("--cpu-isa")
+            .help("the most capable instruction set CPU kernels may use: generic, avx2, avx512, "
+                  "neon or sve. By default, the best this CPU supports.")
+            .default_value(std::string());
+
     parser.add_argument("-l", "--read-ids")
             .help("A file with a newline-delimited list of reads to basecall. If not provided, all "
                   "reads will be basecalled")
@@ -277,6 +975,12 @@ int basecaller(int argc, char* argv[]) {
 
     parser.add_argument("--min-qscore").default_value(0).scan<'i', int>();
 
+    parser.add_argument("--min-read-length")
+            .help("Discard reads shorter than this many bases. Reads with too little signal to be "
+                  "this long are dropped as they're loaded, before basecalling.")
+            .default_value(int(default_parameters.min_seqeuence_length))
+            .scan<'i', int>();
+
     parser.add_argument("-b", "--batchsize")
             .default_value(default_parameters.batchsize)
             .scan<'i', int>()
@@ -286,6 +990,13 @@ int basecaller(int argc, char* argv[]) {
             .default_value(default_parameters.chunksize)
             .scan<'i', int>();
 
+    parser.add_argument("--auto-chunksize")
+            .help("Pick the chunk size, no larger than --chunksize, from the lengths of a "
+                  "sample of the input's reads, to waste the least signal on padding and "
+                  "overlap.  Any --chunk-buckets are taken into account.")
+            .default_value(false)
+            .implicit_value(true);
+
     parser.add_argument("-o", "--overlap")
             .default_value(default_parameters.overlap)
             .scan<'i', int>();
@@ -315,6 +1026,12 @@ int basecaller(int argc, char* argv[]) {
             .default_value(std::string())
             .help("a comma separated list of modified base models");
 
+    parser.add_argument("--fuse-modified-bases-models")
+            .default_value(false)
+            .implicit_value(true)
+            .help("call modified base models which take the same inputs together: reads are "
+                  "encoded once for them, and their batches go to the device once");
+
     parser.add_argument("--modified-bases-threshold")
             .default_value(default_parameters.methylation_threshold)
             .scan<'f', float>()
@@ -325,10 +1042,23 @@ int basecaller(int argc, char* argv[]) {
             .help("Output in fastq format.")
             .default_value(false)
             .implicit_value(true);
+    parser.add_argument("--compress-fastq")
+            .help("With --emit-fastq, compress the output with BGZF, which gzip can read.")
+            .default_value(false)
+            .implicit_value(true);
     parser.add_argument("--emit-sam")
             .help("Output in SAM format.")
             .default_value(false)
             .implicit_value(true);
+    parser.add_argument("--emit-cram")
+            .help("Output in CRAM 3.1 format. Aligned calls are compressed against "
+                  "--cram-reference.")
+            .default_value(false)
+            .implicit_value(true);
+    parser.add_argument("--cram-reference")
+            .help("With --emit-cram, the FASTA reference to compress against. Defaults to "
+                  "--reference, unless that's a minimap2 index.")
+            .default_value(std::string(""));
 
     parser.add_argument("--emit-moves").default_value(false).implicit_value(true);
 
@@ -344,6 +1074,250 @@ int basecaller(int argc, char* argv[]) {
             .default_value(10)
             .scan<'i', int>();
     parser.add_argument("-I").help("minimap2 index batch size.").default_value(std::string("16G"));
+    parser.add_argument("--index-cache")
+            .help("Directory the minimap2 indexes built from FASTA references are cached in, "
+                  "for later runs to load rather than build again. Indexes are never evicted, "
+                  "so none are cached unless this is given.")
+            .default_value(std::string(""));
+    parser.add_argument("--models-cache")
+            .help("Directory models are downloaded through and kept in for later runs, e.g. "
+                  "on a volume shared by several machines. Empty means no cache.")
+            .default_value(utils::default_models_cache().string());
+
+    parser.add_argument("--watch")
+            .help("Keep running and basecall new files as they are written to the data "
+                  "directory.")
+            .default_value(false)
+            .implicit_value(true);
+
+    parser.add_argument("--watch-idle-timeout")
+            .help("With --watch, stop after this many seconds without a new file. 0 waits "
+                  "indefinitely.")
+            .default_value(600)
+            .scan<'i', int>();
+
+    parser.add_argument("--watch-sentinel")
+            .help("With --watch, stop once a file with this name appears in the data directory.")
+            .default_value(std::string(""));
+
+    parser.add_argument("--numa-affinity")
+            .help("Pin each GPU's threads and host buffers to the CPUs of its closest NUMA node.")
+            .default_value(false)
+            .implicit_value(true);
+
+    parser.add_argument("--gpu-scaling")
+            .help("Normalise and trim signal on the GPU instead of the CPU. Requires a single "
+                  "CUDA device.")
+            .default_value(false)
+            .implicit_value(true);
+
+    parser.add_argument("--chunk-buckets")
+            .help("Comma separated list of chunk sizes, smaller than the chunk size, to call "
+                  "short reads and the ends of reads at instead of padding them to a full chunk.")
+            .default_value(std::string(""));
+
+    parser.add_argument("--batch-latency-target")
+            .help("Milliseconds a chunk should take from joining a batch to being called. "
+                  "Partial batches are called to meet it, or sooner if chunks stop arriving.")
+            .default_value(default_parameters.batch_latency_target)
+            .scan<'i', int>();
+
+    parser.add_argument("--host-profile")
+            .help("Settings tuned for this host by `dorado tune`, used for those not given here. "
+                  "Defaults to $DORADO_HOST_PROFILE, or ~/.dorado/host_profile.toml if there's "
+                  "one.")
+            .default_value(std::string(""));
+
+    parser.add_argument("--no-host-profile")
+            .help("Ignore the settings tuned for this host, using the defaults instead.")
+            .default_value(false)
+            .implicit_value(true);
+
+    parser.add_argument("--cuda-graphs")
+            .help("Capture the model's forward pass as a CUDA graph for each batch shape and "
+                  "replay it, to cut kernel launch overhead.")
+            .default_value(false)
+            .implicit_value(true);
+
+    parser.add_argument("--gpu-power-cap")
+            .help("Cap each GPU's power at this many watts, and pick batch sizes for the most "
+                  "samples per joule rather than per second.  Capping takes root: without it, "
+                  "only the batch sizes are picked for energy.  0 for no cap.")
+            .default_value(0.f)
+            .scan<'f', float>();
+
+    parser.add_argument("--server")
+            .help("Keep the models loaded and basecall inputs requested over a Unix socket at "
+                  "this path, one at a time. Clients send an input path and a newline, and "
+                  "receive the calls as unaligned BAM, unless --emit-sam or --emit-fastq is set.")
+            .default_value(std::string(""));
+
+    parser.add_argument("--output-dir")
+            .help("Write the calls to BAM files in this directory, several at once, instead of "
+                  "to stdout. The files are listed in manifest.tsv once basecalling is done.")
+            .default_value(std::string(""));
+
+    parser.add_argument("--sorted-output")
+            .help("With --reference, write the calls to this BAM file, sorted by coordinate and "
+                  "indexed, instead of to stdout. Nothing is written until basecalling is done.")
+            .default_value(std::string(""));
+
+    parser.add_argument("--sort-scratch-dir")
+            .help("With --sorted-output, the directory records are spilled to while they're "
+                  "sorted, which needs about as much space as the output. Defaults to the "
+                  "output's directory.")
+            .default_value(std::string(""));
+
+    parser.add_argument("--sort-memory")
+            .help("With --sorted-output, the memory records are held in before they're spilled, "
+                  "e.g. 8G.")
+            .default_value(std::string("2G"));
+
+    parser.add_argument("--readahead")
+            .help("How much of the input files to have read into the page cache ahead of "
+                  "loading them, in large asynchronous reads which keep fast storage busy, e.g. "
+                  "4G. 0 reads them only as they're loaded.")
+            .default_value(std::string("1G"));
+
+    parser.add_argument("--drop-page-cache")
+            .help("Drop each input file from the page cache once it has been loaded, so that "
+                  "large inputs don't push everything else out of it.")
+            .default_value(false)
+            .implicit_value(true);
+
+    parser.add_argument("--ordered-output")
+            .help("Write the records in the order their reads were loaded in, holding up to this "
+                  "many back to put them in order, so that conversion and alignment can run on "
+                  "every thread. Reads filtered out, or whose basecalls failed, aren't waited "
+                  "for. 0 writes them as they're done.")
+            .default_value(0)
+            .scan<'i', int>();
+
+    parser.add_argument("--output-shards")
+            .help("With --output-dir, the number of files written at once.")
+            .default_value(4)
+            .scan<'i', int>();
+
+    parser.add_argument("--shard-max-reads")
+            .help("With --output-dir, start a new file once one has this many records. 0 means "
+                  "no limit.")
+            .default_value(0)
+            .scan<'i', int>();
+
+    parser.add_argument("--shard-max-size")
+            .help("With --output-dir, start a new file once one has this many bytes of "
+                  "uncompressed records, e.g. 4G. 0 means no limit.")
+            .default_value(std::string("0"));
+
+    parser.add_argument("--extra-models")
+            .help("a comma separated list of further basecaller models, each for data at a "
+                  "different sample rate from the others. Every model is loaded on the devices "
+                  "and each read is called by the one for its sample rate.")
+            .default_value(std::string());
+
+    parser.add_argument("--cascade-model")
+            .help("A more accurate basecaller model, for the same sample rate, to call again the "
+                  "reads which --cascade-max-qscore, --cascade-min-length and --cascade-read-ids "
+                  "pick from the first model's calls. Both models share the devices, and only "
+                  "each read's final call is written.")
+            .default_value(std::string());
+
+    parser.add_argument("--cascade-max-qscore")
+            .help("Call reads again whose first call's mean Q score is below this. 0 for any.")
+            .default_value(0.f)
+            .scan<'g', float>();
+
+    parser.add_argument("--cascade-min-length")
+            .help("Call reads again whose first call has at least this many bases, and the Q "
+                  "score of --cascade-max-qscore, if given. 0 for any length.")
+            .default_value(0)
+            .scan<'i', int>();
+
+    parser.add_argument("--cascade-read-ids")
+            .help("A file of read IDs, one per line, e.g. from target regions, to call again "
+                  "whatever their first call.")
+            .default_value(std::string(""));
+
+    parser.add_argument("--signal-cache")
+            .help("Keep the normalised signal of the reads in this file, and load the reads "
+                  "cached by earlier runs from it rather than decompressing them, e.g. when the "
+                  "same data is basecalled with several models. Takes 2 bytes per sample.")
+            .default_value(std::string());
+
+    parser.add_argument("--priority-read-ids")
+            .help("A file with a newline-delimited list of reads to basecall and write ahead of "
+                  "the rest, e.g. adaptive sampling targets.")
+            .default_value(std::string());
+
+    parser.add_argument("--priority-channels")
+            .help("A comma separated list of channels, or ranges of them, e.g. 1-64,100, whose "
+                  "reads are basecalled and written ahead of the rest.")
+            .default_value(std::string());
+
+    parser.add_argument("--remote-runners")
+            .help("Also call on the runners served by dorado worker at these host:port "
+                  "addresses, e.g. on other GPU nodes. With -x cpu, only they are used.")
+            .nargs(argparse::nargs_pattern::at_least_one)
+            .default_value(std::vector<std::string>{});
+
+    parser.add_argument("--shard")
+            .help("Only basecall the ith of N parts of the input, as i/N counting from 0, for "
+                  "splitting a dataset between nodes. Files are assigned to parts by a hash of "
+                  "their path, so the N nodes given 0/N to N-1/N call every file once.")
+            .default_value(std::string(""));
+
+    parser.add_argument("--resume")
+            .help("With --output-dir, carry on from where an interrupted run into the same "
+                  "directory stopped, skipping the reads it wrote and writing the rest to new "
+                  "files.")
+            .default_value(false)
+            .implicit_value(true);
+
+    parser.add_argument("--max-host-memory")
+            .help("Most host memory reads in flight may take up, e.g. 64G. Reads are held back "
+                  "from the pipeline while it's used up. 0 means no limit.")
+            .default_value(std::string("0"));
+
+    parser.add_argument("--share-gpus")
+            .help("Share the GPUs with other dorado processes on this host which also pass this, "
+                  "taking turns one batch at a time and leaving each other's GPU memory alone. "
+                  "Linux only.")
+            .default_value(false)
+            .implicit_value(true);
+
+    parser.add_argument("--cuda-mps")
+            .help("As --share-gpus, but with the processes' batches running side by side under "
+                  "the CUDA MPS control daemon, which must be running. Linux only.")
+            .default_value(false)
+            .implicit_value(true);
+
+    parser.add_argument("--metrics-port")
+            .help("Serve throughput, batching and memory metrics over HTTP on this port, at "
+                  "/metrics, for Prometheus to scrape. 0 means no metrics are served.")
+            .default_value(0)
+            .scan<'i', int>();
+
+    parser.add_argument("--telemetry-file")
+            .help("Append each pipeline node's queue depth, throughput and wait times, sampled "
+                  "every second, to this tab-separated file.")
+            .default_value(std::string(""));
+
+    parser.add_argument("--trace-file")
+            .help("Write a timeline of batching, model, decoding and writing spans to this file, "
+                  "for chrome://tracing or Perfetto. With --server, each call overwrites it.")
+            .default_value(std::string(""));
+
+    parser.add_argument("--memory-profile")
+            .help("Log the allocator's stats as basecalling runs, and write its heap profiles and "
+                  "stats to files starting with this prefix. Heap profiles, which show the "
+                  "memory each node's threads hold, need JE_MALLOC_CONF=prof:true set. Linux only.")
+            .default_value(std::string(""));
+
+    parser.add_argument("--read-latency")
+            .help("Time each read from scaling to output, and report the percentiles of its "
+                  "latency in each node and overall, at the end and with --metrics-port.")
+            .default_value(false)
+            .implicit_value(true);
 
     argparse::ArgumentParser internal_parser;
 
@@ -363,6 +1337,17 @@ int basecaller(int argc, char* argv[]) {
         spdlog::set_level(spdlog::level::debug);
     }
 
+    if (const auto cpu_isa = parser.get<std::string>("--cpu-isa"); !cpu_isa.empty()) {
+        try {
+            utils::set_cpu_isa(utils::parse_cpu_isa(cpu_isa));
+        } catch (const std::exception& e) {
+            spdlog::error("{}", e.what());
+            std::exit(EXIT_FAILURE);
+        }
+    }
+    spdlog::debug("> CPU features: {}, kernels use {}", utils::describe_cpu_features(),
+                  utils::to_string(utils::cpu_isa()));
+
     auto model = parser.get<std::string>("model");
     auto mod_bases = parser.get<std::vector<std::string>>("--modified-bases");
     auto mod_bases_models = parser.get<std::string>("--modified-bases-models");
@@ -391,36 +1376,183 @@ int basecaller(int argc, char* argv[]) {
 
     auto emit_fastq = parser.get<bool>("--emit-fastq");
     auto emit_sam = parser.get<bool>("--emit-sam");
+    auto emit_cram = parser.get<bool>("--emit-cram");
 
-    if (emit_fastq && emit_sam) {
-        throw std::runtime_error("Only one of --emit-{fastq, sam} can be set (or none).");
+    if (int(emit_fastq) + int(emit_sam) + int(emit_cram) > 1) {
+        throw std::runtime_error("Only one of --emit-{fastq, sam, cram} can be set (or none).");
+    }
+    if (parser.get<bool>("--compress-fastq") && !emit_fastq) {
+        throw std::runtime_error("--compress-fastq can only be used with --emit-fastq.");
     }
 
+    const auto server_socket = parser.get<std::string>("--server");
     if (emit_fastq) {
         output_mode = HtsWriter::OutputMode::FASTQ;
-    } else if (emit_sam || utils::is_fd_tty(stdout)) {
+    } else if (emit_sam) {
+        output_mode = HtsWriter::OutputMode::SAM;
+    } else if (emit_cram) {
+        output_mode = HtsWriter::OutputMode::CRAM;
+    } else if (!server_socket.empty()) {
+        // Calls are sent to clients over a local socket, so there's no need to compress them.
+        output_mode = HtsWriter::OutputMode::UBAM;
+    } else if (utils::is_fd_tty(stdout)) {
         output_mode = HtsWriter::OutputMode::SAM;
     } else if (utils::is_fd_pipe(stdout)) {
         output_mode = HtsWriter::OutputMode::UBAM;
     }
 
+    utils::ShardedOutputSettings sharded_output;
+    sharded_output.directory = parser.get<std::string>("--output-dir");
+    if (!sharded_output.directory.empty()) {
+        if (emit_fastq || emit_sam || emit_cram) {
+            throw std::runtime_error(
+                    "--output-dir writes BAM, so cannot be used with --emit-{fastq, sam, cram}.");
+        }
+        const int num_shards = parser.get<int>("--output-shards");
+        const int max_reads_per_shard = parser.get<int>("--shard-max-reads");
+        if (num_shards <= 0 || max_reads_per_shard < 0) {
+            throw std::runtime_error(
+                    "--output-shards must be positive, and --shard-max-reads not negative.");
+        }
+        sharded_output.num_shards = num_shards;
+        sharded_output.max_records_per_file = max_reads_per_shard;
+        sharded_output.max_bytes_per_file =
+                utils::parse_string_to_size(parser.get<std::string>("--shard-max-size"));
+        sharded_output.resume = parser.get<bool>("--resume");
+    } else if (parser.get<bool>("--resume")) {
+        throw std::runtime_error("--resume needs the --output-dir of the run to carry on.");
+    }
+
+    const auto sorted_output_path = parser.get<std::string>("--sorted-output");
+    utils::SortedOutputSettings sorted_output;
+    if (!sorted_output_path.empty()) {
+        if (parser.get<std::string>("--reference").empty() || emit_fastq || emit_sam ||
+            emit_cram || !sharded_output.directory.empty()) {
+            throw std::runtime_error(
+                    "--sorted-output needs --reference, and writes BAM, so cannot be used with "
+                    "--emit-{fastq, sam, cram} or --output-dir.");
+        }
+        output_mode = HtsWriter::OutputMode::BAM;
+        sorted_output.scratch_directory = parser.get<std::string>("--sort-scratch-dir");
+        sorted_output.max_memory_bytes =
+                utils::parse_string_to_size(parser.get<std::string>("--sort-memory"));
+        if (sorted_output.max_memory_bytes == 0) {
+            throw std::runtime_error("--sort-memory must be positive.");
+        }
+    }
+
+    const auto ordered_output = static_cast<size_t>(parser.get<int>("--ordered-output"));
+    if (ordered_output > 0 && (emit_fastq || !sorted_output_path.empty())) {
+        throw std::runtime_error(
+                "--ordered-output cannot be used with --emit-fastq or --sorted-output.");
+    }
+
+    const int min_read_length = parser.get<int>("--min-read-length");
+    if (min_read_length < 0) {
+        throw std::runtime_error("--min-read-length must not be negative.");
+    }
+
+    auto cram_reference = parser.get<std::string>("--cram-reference");
+    if (!cram_reference.empty() && !emit_cram) {
+        throw std::runtime_error("--cram-reference can only be used with --emit-cram.");
+    }
+    if (emit_cram && cram_reference.empty()) {
+        cram_reference = parser.get<std::string>("--reference");
+        if (std::filesystem::path(cram_reference).extension() == ".mmi") {
+            throw std::runtime_error(
+                    "CRAM is compressed against the reference's sequence, which a minimap2 "
+                    "index doesn't have, so --emit-cram needs the FASTA as --cram-reference.");
+        }
+    }
+
+    DatasetShard dataset_shard;
+    if (const auto shard = parser.get<std::string>("--shard"); !shard.empty()) {
+        dataset_shard = parse_dataset_shard(shard);
+    }
+
+    std::vector<std::filesystem::path> extra_models;
+    std::istringstream extra_models_stream{parser.get<std::string>("--extra-models")};
+    std::string extra_model;
+    while (std::getline(extra_models_stream, extra_model, ',')) {
+        extra_models.push_back(extra_model);
+    }
+
+    utils::set_minimap_index_cache(parser.get<std::string>("--index-cache"));
+    utils::set_models_cache(parser.get<std::string>("--models-cache"));
+    utils::MemoryBudget::instance().set_limit(
+            utils::parse_string_to_size(parser.get<std::string>("--max-host-memory")));
+
     spdlog::info("> Creating basecall pipeline");
 
     try {
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+        if (parser.get<bool>("--cuda-mps")) {
+            utils::check_cuda_mps();
+            utils::enable_gpu_sharing(false);
+        } else if (parser.get<bool>("--share-gpus")) {
+            utils::enable_gpu_sharing(true);
+        }
+#endif
+        CascadePolicy cascade_policy;
+        cascade_policy.max_qscore = parser.get<float>("--cascade-max-qscore");
+        cascade_policy.min_length = std::max(0, parser.get<int>("--cascade-min-length"));
+        cascade_policy.read_list =
+                utils::load_read_list(parser.get<std::string>("--cascade-read-ids"));
+        // Options given on the command line take precedence over those tuned for the host.
+        utils::HostProfile host_profile;
+        if (!parser.get<bool>("--no-host-profile")) {
+            host_profile = utils::select_host_profile(parser.get<std::string>("--host-profile"),
+                                                      parser.get<std::string>("-x"), model);
+        }
+        int chunk_size = parser.get<int>("-c");
+        if (!parser.is_used("-c") && host_profile.chunk_size > 0) {
+            chunk_size = host_profile.chunk_size;
+        }
+        int batch_size = parser.get<int>("-b");
+        if (!parser.is_used("-b") && host_profile.batch_size > 0) {
+            batch_size = host_profile.batch_size;
+        }
+        const int num_runners = host_profile.num_runners > 0 ? host_profile.num_runners
+                                                             : default_parameters.num_runners;
+        const int remora_threads = host_profile.remora_threads > 0
+                                           ? host_profile.remora_threads
+                                           : default_parameters.remora_threads;
         setup(args, model, parser.get<std::string>("data"), mod_bases_models,
-              parser.get<std::string>("-x"), parser.get<std::string>("--reference"),
-              parser.get<int>("-c"), parser.get<int>("-o"), parser.get<int>("-b"),
-              default_parameters.num_runners, default_parameters.remora_batchsize,
-              default_parameters.remora_threads, methylation_threshold, output_mode,
+              parser.get<std::string>("-x"), parser.get<std::string>("--reference"), chunk_size,
+              parser.get<int>("-o"), batch_size, num_runners,
+              default_parameters.remora_batchsize, remora_threads, methylation_threshold,
+              output_mode,
               parser.get<bool>("--emit-moves"), parser.get<int>("--max-reads"),
-              parser.get<int>("--min-qscore"), parser.get<std::string>("--read-ids"),
+              parser.get<int>("--min-qscore"), min_read_length,
+              parser.get<std::string>("--read-ids"),
               parser.get<bool>("--recursive"), parser.get<int>("k"), parser.get<int>("w"),
               utils::parse_string_to_size(parser.get<std::string>("I")),
-              internal_parser.get<bool>("--skip-model-compatibility-check"));
+              internal_parser.get<bool>("--skip-model-compatibility-check"),
+              parser.get<bool>("--numa-affinity"), parser.get<bool>("--watch"),
+              parser.get<int>("--watch-idle-timeout"),
+              parser.get<std::string>("--watch-sentinel"), parser.get<bool>("--gpu-scaling"),
+              parser.get<std::string>("--chunk-buckets"),
+              parser.get<int>("--batch-latency-target"), parser.get<bool>("--cuda-graphs"),
+              server_socket, sharded_output, sorted_output_path, sorted_output, cram_reference,
+              parser.get<bool>("--compress-fastq"),
+              parser.get<std::string>("--telemetry-file"), parser.get<int>("--metrics-port"),
+              parser.get<std::string>("--trace-file"), parser.get<bool>("--read-latency"),
+              parser.get<std::string>("--memory-profile"), dataset_shard,
+              parser.get<std::vector<std::string>>("--remote-runners"), extra_models,
+              parser.get<std::string>("--signal-cache"),
+              parser.get<std::string>("--priority-read-ids"),
+              parser.get<std::string>("--priority-channels"), ordered_output,
+              utils::parse_string_to_size(parser.get<std::string>("--readahead")),
+              parser.get<bool>("--drop-page-cache"), parser.get<float>("--gpu-power-cap"),
+              parser.get<bool>("--auto-chunksize"), parser.get<std::string>("--cascade-model"),
+              cascade_policy, parser.get<bool>("--fuse-modified-bases-models"), host_profile);
     } catch (const std::exception& e) {
         spdlog::error("{}", e.what());
+        utils::TensorPool::instance().shutdown();
         return 1;
     }
+    // The pipeline is gone, so free pinned buffers while CUDA is still up.
+    utils::TensorPool::instance().shutdown();
 
     spdlog::info("> Finished");
     return 0;
@@ -1,26 +1,86 @@
+#include "../decode/CPUDecoder.h"
+#include "../decode/scan.h"
+#include "../nn/CRFModel.h"
+#include "../nn/ModelRunner.h"
+#include "../nn/RemoraModel.h"
+#include "../read_pipeline/BasecallerNode.h"
+#include "../read_pipeline/FakeDataLoader.h"
+#include "../read_pipeline/ModBaseCallerNode.h"
+#include "../read_pipeline/PipelineTelemetry.h"
+#include "../read_pipeline/ReadToBamTypeNode.h"
+#include "../read_pipeline/ScalerNode.h"
+#include "../read_pipeline/StatsCounter.h"
+#include "../utils/MetricsServer.h"
+#include "../utils/models.h"
+#include "../utils/parameters.h"
+#include "../utils/signal_utils.h"
 #include "../utils/tensor_utils.h"
+#include "../utils/workload_trace.h"
 #include "Version.h"
+#if DORADO_GPU_BUILD
+#ifdef __APPLE__
+#include "../nn/MetalCRFModel.h"
+#else
+#include "../decode/GPUDecoder.h"
+#include "../nn/CudaCRFModel.h"
+#include "../utils/cuda_utils.h"
+
+#include <ATen/cuda/CUDAEvent.h>
+#endif
+#endif  // DORADO_GPU_BUILD
 
 #include <argparse.hpp>
+#include <spdlog/spdlog.h>
 #include <torch/torch.h>
 
 #include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace dorado {
 
-int benchmark(int argc, char* argv[]) {
-    argparse::ArgumentParser parser("dorado", DORADO_VERSION, argparse::default_arguments::help);
+namespace {
 
-    try {
-        parser.parse_args(argc, argv);
-    } catch (const std::exception& e) {
-        std::cerr << e.what() << std::endl;
-        std::cerr << parser;
-        std::exit(1);
+// Runs f once, reporting the result it describes, the time taken and the throughput over
+// num_bytes of input.
+template <typename F>
+void run_variant(const std::string& name, size_t num_bytes, F&& f) {
+    auto start = std::chrono::steady_clock::now();
+    const std::string result = f();
+    auto end = std::chrono::steady_clock::now();
+
+    const auto duration = std::chrono::duration<double>(end - start).count();
+    std::cerr << std::left << std::setw(14) << name << result << " "
+              << static_cast<int64_t>(duration * 1e6) << "us";
+    if (duration > 0) {
+        std::cerr << " " << std::fixed << std::setprecision(2) << num_bytes / duration / 1e9
+                  << " GB/s" << std::defaultfloat;
     }
+    std::cerr << std::endl;
+}
+
+std::string describe_quantiles(const torch::Tensor& res) {
+    std::ostringstream result;
+    result << " q20=" << res[0].item<int>() << " q90=" << res[1].item<int>();
+    return result.str();
+}
 
-    std::vector<size_t> sizes{1000, 1000, 2000, 3000, 4000, 10000, 100000, 1000000, 10000000};
+// Times the quantile, histogram and scan kernels on random inputs of several sizes.
+void run_kernel_benchmarks() {
+    std::vector<size_t> sizes{1000,   1000,    2000,     3000,     4000,
+                              10000,  100000,  1000000,  10000000, 100000000};
+    // torch::quantile refuses inputs larger than this.
+    const size_t kMaxTorchQuantileSize = size_t(1) << 24;
+    // Sample count for the approximate strided histogram.
+    const size_t kStridedSamples = size_t(1) << 20;
 
     for (auto n : sizes) {
         std::cerr << "samples : " << n << std::endl;
@@ -29,42 +89,533 @@ int benchmark(int argc, char* argv[]) {
         auto x = torch::randint(0, 2047, n);
         auto q = torch::tensor({0.2, 0.9}, {torch::kFloat32});
 
-        // torch::quantile
-        auto start = std::chrono::system_clock::now();
-        auto res = torch::quantile(x, q);
-        auto end = std::chrono::system_clock::now();
+        if (n <= kMaxTorchQuantileSize) {
+            run_variant("torch:quant", x.nbytes(),
+                        [&] { return describe_quantiles(torch::quantile(x, q)); });
+        }
+        run_variant("nth_element", x.nbytes(),
+                    [&] { return describe_quantiles(utils::quantile(x, q)); });
 
-        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        x = x.to(torch::kInt16);
+        const auto* const samples = x.data_ptr<int16_t>();
 
-        std::cerr << "torch:quant  "
-                  << " q20=" << res[0].item<int>() << " q90=" << res[1].item<int>() << " "
-                  << duration << "us" << std::endl;
+        run_variant("counting", x.nbytes(),
+                    [&] { return describe_quantiles(utils::quantile_counting(x, q)); });
 
-        // nth_element
-        start = std::chrono::system_clock::now();
-        res = utils::quantile(x, q);
-        end = std::chrono::system_clock::now();
+        run_variant("histogram", x.nbytes(), [&] {
+            const utils::SignalHistogram histogram(samples, n);
+            std::ostringstream result;
+            result << " q20=" << histogram.quantile(0.2f) << " q90=" << histogram.quantile(0.9f);
+            return result.str();
+        });
 
-        duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        run_variant("histogram:5q", x.nbytes(), [&] {
+            const utils::SignalHistogram histogram(samples, n);
+            std::ostringstream result;
+            for (float quantile : {0.05f, 0.2f, 0.5f, 0.9f, 0.95f}) {
+                result << " q" << static_cast<int>(quantile * 100) << "="
+                       << histogram.quantile(quantile);
+            }
+            return result.str();
+        });
 
-        std::cerr << "nth_element  "
-                  << " q20=" << res[0].item<int>() << " q90=" << res[1].item<int>() << " "
-                  << duration << "us" << std::endl;
+        run_variant("median/mad", x.nbytes(), [&] {
+            const utils::SignalHistogram histogram(samples, n);
+            std::ostringstream result;
+            result << " med=" << histogram.median() << " mad=" << histogram.mad();
+            return result.str();
+        });
 
-        x = x.to(torch::kInt16);
+        // Throughput here is relative to the whole signal, not just the samples read.
+        run_variant("strided", x.nbytes(), [&] {
+            const utils::SignalHistogram histogram(
+                    samples, n, utils::SignalHistogram::stride_for(n, kStridedSamples));
+            std::ostringstream result;
+            result << " q20=" << histogram.quantile(0.2f) << " q90=" << histogram.quantile(0.9f);
+            return result.str();
+        });
+
+        std::cerr << std::endl;
+    }
+
+    // CRF forward/backward scans of a batch of chunks, at the fast model's state_len of 4.
+    const float kFixedStayScore = 2.f;
+    for (int num_timesteps : {200, 2000}) {
+        std::cerr << "scan timesteps : " << num_timesteps << std::endl;
+        const auto scores = torch::randn({num_timesteps, 16, 1024});
+        torch::Tensor expected;
+        run_variant("torch:fwd", scores.nbytes(), [&] {
+            expected = forward_scores_torch(scores, kFixedStayScore);
+            return std::string();
+        });
+        run_variant("native:fwd", scores.nbytes(), [&] {
+            const auto result = forward_scores(scores, kFixedStayScore);
+            return " max_diff=" + std::to_string((result - expected).abs().max().item<float>());
+        });
+        run_variant("torch:bwd", scores.nbytes(), [&] {
+            expected = backward_scores_torch(scores, kFixedStayScore);
+            return std::string();
+        });
+        run_variant("native:bwd", scores.nbytes(), [&] {
+            const auto result = backward_scores(scores, kFixedStayScore);
+            return " max_diff=" + std::to_string((result - expected).abs().max().item<float>());
+        });
+        std::cerr << std::endl;
+    }
+}
+
+// The end of the benchmark pipeline, which drops what it's given but counts it, so that the
+// benchmark knows when the last read is through without tearing the pipeline down first.
+class CountingSink : public MessageSink {
+public:
+    CountingSink() : MessageSink(1000), m_thread(&CountingSink::worker_thread, this) {}
+    ~CountingSink() {
+        terminate();
+        m_thread.join();
+    }
+    uint32_t read_fields_used() const override { return 0; }
+
+    void wait_for(size_t num_messages) {
+        std::unique_lock lock(m_mutex);
+        m_cv.wait(lock, [&] { return m_num_messages >= num_messages; });
+    }
+
+private:
+    void worker_thread() {
+        Message message;
+        while (m_work_queue.try_pop(message)) {
+            message = Message();
+            {
+                std::lock_guard lock(m_mutex);
+                ++m_num_messages;
+            }
+            m_cv.notify_all();
+        }
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    size_t m_num_messages{0};
+    std::thread m_thread;
+};
+
+struct PipelineSettings {
+    std::filesystem::path model_path;
+    std::vector<std::filesystem::path> remora_models;
+    std::string device;
+    int chunk_size;
+    int overlap;
+    int batch_size;
+    int num_runners;
+    int num_reads;
+    FakeReadOptions read_options;
+    // A workload trace to replay instead of sending num_reads at once, at replay_speed.
+    std::filesystem::path replay_trace;
+    double replay_speed;
+};
+
+// Runners for the model on the device, as the basecaller makes them.  num_devices is set to
+// the number of devices they're spread over.
+std::vector<Runner> create_runners(const PipelineSettings& settings, int& num_devices) {
+    std::vector<Runner> runners;
+    num_devices = 1;
+    if (settings.device == "cpu") {
+        const auto batch_size = settings.batch_size == 0 ? 128 : settings.batch_size;
+        for (unsigned int i = 0; i < std::thread::hardware_concurrency(); ++i) {
+            runners.push_back(std::make_shared<ModelRunner<CPUDecoder>>(
+                    settings.model_path, settings.device, settings.chunk_size, batch_size));
+        }
+    }
+#if DORADO_GPU_BUILD
+#ifdef __APPLE__
+    else if (settings.device == "metal") {
+        auto caller = create_metal_caller(settings.model_path, settings.chunk_size,
+                                          settings.batch_size);
+        for (int i = 0; i < settings.num_runners; ++i) {
+            runners.push_back(std::make_shared<MetalModelRunner>(caller));
+        }
+    }
+#else   // ifdef __APPLE__
+    else {
+        const auto devices = utils::parse_cuda_device_string(settings.device);
+        num_devices = devices.size();
+        if (num_devices == 0) {
+            throw std::runtime_error("CUDA device requested but no devices found.");
+        }
+        for (const auto& device_string : devices) {
+            auto caller = create_cuda_caller(settings.model_path, settings.chunk_size,
+                                             settings.batch_size, device_string);
+            for (int i = 0; i < settings.num_runners; ++i) {
+                runners.push_back(std::make_shared<CudaModelRunner>(caller));
+            }
+        }
+    }
+#endif  // __APPLE__
+#endif  // DORADO_GPU_BUILD
+    if (runners.empty()) {
+        throw std::runtime_error("Unsupported device: " + settings.device);
+    }
+    return runners;
+}
+
+// Runs synthetic reads through the scaler, basecaller, modbase caller if there are models,
+// and BAM conversion, and reports the throughput of the whole and how each stage's queue fared.
+void run_pipeline_benchmark(PipelineSettings settings) {
+    torch::set_num_threads(1);
+
+    int num_devices = 1;
+    const auto runners = create_runners(settings, num_devices);
+    const auto model_stride = runners.front()->model_stride();
+    const auto overlap = (settings.overlap / model_stride) * model_stride;
+
+    std::vector<std::shared_ptr<RemoraCaller>> remora_callers;
+    for (const auto& remora_model : settings.remora_models) {
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+        if (settings.device != "cpu") {
+            for (const auto& device_string : utils::parse_cuda_device_string(settings.device)) {
+                remora_callers.push_back(std::make_shared<RemoraCaller>(
+                        remora_model, device_string, utils::default_parameters.remora_batchsize,
+                        model_stride));
+            }
+            continue;
+        }
+#endif
+        remora_callers.push_back(std::make_shared<RemoraCaller>(
+                remora_model, settings.device, utils::default_parameters.remora_batchsize,
+                model_stride));
+    }
+
+    const auto thread_allocations = utils::default_thread_allocations(
+            num_devices,
+            remora_callers.empty() ? 0 : utils::default_parameters.remora_threads);
+    const auto model_name = std::filesystem::canonical(settings.model_path).filename().string();
+
+    CountingSink counting_sink;
+    ReadToBamType read_converter(counting_sink, false, utils::is_rna_model(settings.model_path),
+                                 thread_allocations.read_converter_threads);
+    StatsCounterNode stats_node(read_converter, false);
+    std::unique_ptr<ModBaseCallerNode> mod_base_caller_node;
+    MessageSink* basecaller_sink = &stats_node;
+    if (!remora_callers.empty()) {
+        mod_base_caller_node = std::make_unique<ModBaseCallerNode>(
+                stats_node, remora_callers, thread_allocations.remora_threads, num_devices,
+                model_stride, utils::default_parameters.remora_batchsize);
+        basecaller_sink = mod_base_caller_node.get();
+    }
+    BasecallerNode basecaller_node(*basecaller_sink, runners, overlap,
+                                   utils::default_parameters.batch_latency_target, model_name);
+    ScalerNode scaler_node(basecaller_node, thread_allocations.scaler_node_threads);
+
+    settings.read_options.sample_rate = get_model_sample_rate(settings.model_path);
+    FakeDataLoader loader(scaler_node, settings.read_options);
+    std::vector<std::shared_ptr<Read>> reads;
+    std::vector<utils::TraceRead> trace;
+    size_t num_reads = 0;
+    int64_t num_samples = 0;
+    if (!settings.replay_trace.empty()) {
+        trace = utils::load_workload_trace(settings.replay_trace,
+                                           settings.read_options.sample_rate);
+        num_reads = trace.size();
+        for (const auto& read : trace) {
+            num_samples += read.num_samples;
+        }
+        spdlog::info("> Replaying {} reads of {} samples from {} at {}x speed", num_reads,
+                     num_samples, settings.replay_trace.string(), settings.replay_speed);
+    } else {
+        reads = loader.make_reads(settings.num_reads);
+        num_reads = reads.size();
+        for (const auto& read : reads) {
+            num_samples += read->raw_data.size(0);
+        }
+        spdlog::info("> Running {} synthetic reads of {} samples through the pipeline",
+                     num_reads, num_samples);
+    }
+
+    // The registry reads the nodes' own counts, and the telemetry their queues, over the run.
+    utils::MetricsRegistry metrics;
+    basecaller_node.add_metrics(metrics);
+    if (mod_base_caller_node) {
+        mod_base_caller_node->add_metrics(metrics);
+    }
+    stats_node.add_metrics(metrics);
+    PipelineTelemetry telemetry;
+    telemetry.add_node("scaler", scaler_node);
+    telemetry.add_node("basecaller", basecaller_node);
+    if (mod_base_caller_node) {
+        telemetry.add_node("modbase_caller", *mod_base_caller_node);
+    }
+    telemetry.add_node("stats", stats_node);
+    telemetry.add_node("read_converter", read_converter);
+
+    const auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> replay_lag{0};
+    if (!trace.empty()) {
+        replay_lag = loader.replay(trace, settings.replay_speed);
+    } else {
+        loader.send_reads(std::move(reads));
+    }
+    // Every read makes one record, so the run is over once the last gets to the end.
+    counting_sink.wait_for(num_reads);
+    const auto elapsed_s =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const auto stages = telemetry.sample();
+
+    const double num_chunks = metrics.total("dorado_basecaller_chunks_total");
+    const double num_slots = metrics.total("dorado_basecaller_batch_slots_total");
+    std::cerr << std::fixed << std::setprecision(2);
+    std::cerr << "elapsed       " << elapsed_s << " s\n";
+    if (!trace.empty()) {
+        // A pipeline which keeps up with the trace is held up by it, not the other way around.
+        std::cerr << "replay lag    " << replay_lag.count() << " s\n";
+    }
+    std::cerr << "samples/s     " << std::setprecision(0) << num_samples / elapsed_s << "\n";
+    std::cerr << "chunks/s      " << num_chunks / elapsed_s << "\n";
+    std::cerr << "bases/s       " << metrics.total("dorado_bases_total") / elapsed_s << "\n";
+    if (num_slots > 0) {
+        std::cerr << "batch fill    " << std::setprecision(2) << num_chunks / num_slots << "\n";
+    }
+    if (mod_base_caller_node) {
+        std::cerr << "modbase chunks/s " << std::setprecision(0)
+                  << metrics.total("dorado_modbase_chunks_total") / elapsed_s << "\n";
+    }
+    // A stage whose producers are blocked on its full queue is the bottleneck, and one whose
+    // workers are waiting on an empty queue is starved by something upstream.  Waits are summed
+    // over threads, as a fraction of the run.
+    std::cerr << "\n"
+              << std::left << std::setw(16) << "stage" << std::right << std::setw(12)
+              << "msgs/s" << std::setw(14) << "push_blocked" << std::setw(13) << "pop_waiting"
+              << "\n";
+    for (const auto& stage : stages) {
+        std::cerr << std::left << std::setw(16) << stage.name << std::right << std::setw(12)
+                  << std::setprecision(1) << stage.messages_per_s << std::setw(14)
+                  << std::setprecision(2) << stage.push_blocked << std::setw(13)
+                  << stage.pop_waiting << "\n";
+    }
+    std::cerr << std::defaultfloat << std::endl;
+}
 
-        // counting
-        start = std::chrono::system_clock::now();
-        res = utils::quantile_counting(x, q);
-        end = std::chrono::system_clock::now();
-        duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+// Times each layer of the model, and decoding, over num_batches of random input, and prints
+// the achieved throughput and bandwidth of each, as the basecaller would run them.
+void run_model_profile(const PipelineSettings& settings, int num_batches) {
+    if (settings.device == "metal") {
+        // The Metal model runs as a few fused kernels, not a module per layer.
+        throw std::runtime_error("Model profiling isn't supported on metal");
+    }
+    torch::set_num_threads(1);
+    const auto model_config = load_crf_model_config(settings.model_path);
+    DecoderOptions decoder_options;
+    decoder_options.q_shift = model_config.qbias;
+    decoder_options.q_scale = model_config.qscale;
 
-        std::cerr << "counting     "
-                  << " q20=" << res[0].item<int>() << " q90=" << res[1].item<int>() << " "
-                  << duration << "us" << std::endl
-                  << std::endl;
+    std::string device = settings.device;
+    auto dtype = cpu_model_dtype(model_config);
+    int batch_size = settings.batch_size == 0 ? 128 : settings.batch_size;
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+    if (device != "cpu") {
+        // One device tells as much as several.
+        device = utils::parse_cuda_device_string(device).front();
+        dtype = GPUDecoder::dtype;
+        batch_size = settings.batch_size == 0 ? 512 : settings.batch_size;
     }
+#endif
+    const auto options = torch::TensorOptions().dtype(dtype).device(device);
+    spdlog::info("> Profiling {} on {}, {} batches of {} chunks of {} samples",
+                 settings.model_path.filename().string(), device, num_batches, batch_size,
+                 settings.chunk_size);
+
+    torch::Tensor scores;
+    auto layers = profile_crf_model(settings.model_path, model_config, options, batch_size,
+                                    settings.chunk_size, num_batches, scores);
+
+    torch::InferenceMode guard;
+    LayerProfile decode{"decode", "beam search", 0, 0,
+                        static_cast<double>(scores.numel() * scores.element_size())};
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+    if (options.device().is_cuda()) {
+        GPUDecoder decoder;
+        decoder.gpu_part(scores, batch_size, decoder_options);
+        for (int batch = 0; batch < num_batches; ++batch) {
+            at::cuda::CUDAEvent start(cudaEventDefault), stop(cudaEventDefault);
+            start.record();
+            decoder.gpu_part(scores, batch_size, decoder_options);
+            stop.record();
+            stop.synchronize();
+            decode.time_ms += start.elapsed_time(stop) / num_batches;
+        }
+        decode.details = "beam search, on the GPU";
+    } else
+#endif
+    {
+        // The CPU decoder takes [T, N, C].
+        const auto cpu_scores = scores.transpose(0, 1);
+        CPUDecoder decoder;
+        for (int batch = 0; batch < num_batches; ++batch) {
+            const auto start = std::chrono::steady_clock::now();
+            decoder.beam_search(cpu_scores, batch_size, decoder_options);
+            decode.time_ms += std::chrono::duration<double, std::milli>(
+                                      std::chrono::steady_clock::now() - start)
+                                      .count() /
+                              num_batches;
+        }
+    }
+    layers.push_back(decode);
+
+    double total_ms = 0;
+    for (const auto& layer : layers) {
+        total_ms += layer.time_ms;
+    }
+    std::cerr << std::left << std::setw(10) << "layer" << std::setw(26) << "details"
+              << std::right << std::setw(12) << "ms/batch" << std::setw(8) << "share"
+              << std::setw(10) << "TFLOPS" << std::setw(10) << "GB/s" << "\n"
+              << std::fixed;
+    for (const auto& layer : layers) {
+        const double time_s = layer.time_ms / 1000;
+        std::cerr << std::left << std::setw(10) << layer.name << std::setw(26) << layer.details
+                  << std::right << std::setprecision(3) << std::setw(12) << layer.time_ms
+                  << std::setprecision(1) << std::setw(7) << 100 * layer.time_ms / total_ms
+                  << '%' << std::setprecision(2) << std::setw(10);
+        if (layer.flops > 0) {
+            std::cerr << layer.flops / time_s / 1e12;
+        } else {
+            std::cerr << "-";
+        }
+        std::cerr << std::setprecision(1) << std::setw(10) << layer.bytes / time_s / 1e9 << "\n";
+    }
+    const double samples = double(batch_size) * settings.chunk_size;
+    std::cerr << std::left << std::setw(36) << "total" << std::right << std::setprecision(3)
+              << std::setw(12) << total_ms << "\n\n"
+              << "samples/s " << std::setprecision(0) << samples / (total_ms / 1000)
+              << std::defaultfloat << std::endl;
+}
+
+}  // namespace
+
+int benchmark(int argc, char* argv[]) {
+    argparse::ArgumentParser parser("dorado", DORADO_VERSION, argparse::default_arguments::help);
+
+    parser.add_argument("model")
+            .help("the basecaller model to run synthetic reads through. Without one, the signal "
+                  "and scan kernels are timed instead.")
+            .nargs(argparse::nargs_pattern::optional)
+            .default_value(std::string(""));
+
+    parser.add_argument("-x", "--device")
+            .help("device string in format \"cuda:0,...,N\", \"cuda:all\", \"metal\", \"cpu\" "
+                  "etc..")
+            .default_value(utils::default_parameters.device);
+
+    parser.add_argument("-b", "--batchsize")
+            .default_value(utils::default_parameters.batchsize)
+            .scan<'i', int>()
+            .help("if 0 an optimal batchsize will be selected");
+
+    parser.add_argument("-c", "--chunksize")
+            .default_value(utils::default_parameters.chunksize)
+            .scan<'i', int>();
+
+    parser.add_argument("-o", "--overlap")
+            .default_value(utils::default_parameters.overlap)
+            .scan<'i', int>();
+
+    parser.add_argument("-r", "--num_runners")
+            .default_value(utils::default_parameters.num_runners)
+            .scan<'i', int>();
+
+    parser.add_argument("--modified-bases-models")
+            .help("a comma separated list of modified base models to run as well.")
+            .default_value(std::string(""));
+
+    parser.add_argument("-n", "--num-reads")
+            .help("the number of synthetic reads.")
+            .default_value(1000)
+            .scan<'i', int>();
 
+    parser.add_argument("--read-length")
+            .help("the mean length of the synthetic reads, in samples.")
+            .default_value(40000)
+            .scan<'i', int>();
+
+    parser.add_argument("--read-length-sd")
+            .help("the standard deviation of the reads' lengths, which are gamma distributed. 0 "
+                  "makes every read the mean length.")
+            .default_value(0)
+            .scan<'i', int>();
+
+    parser.add_argument("--seed")
+            .help("seeds the synthetic reads, so that runs with the same seed call the same "
+                  "reads.")
+            .default_value(42)
+            .scan<'i', int>();
+
+    parser.add_argument("--replay")
+            .help("a workload trace to replay instead of the synthetic reads: a sequencing "
+                  "summary, or any tab separated file with its channel, mux, start_time and "
+                  "duration columns, or num_samples instead of duration. Reads of its lengths "
+                  "and channels are sent at the times they finished in the run.")
+            .default_value(std::string(""));
+
+    parser.add_argument("--replay-speed")
+            .help("how many times faster than the run to replay the trace, or 0 for as fast as "
+                  "the pipeline takes the reads.")
+            .default_value(1.0f)
+            .scan<'f', float>();
+
+    parser.add_argument("--profile-model")
+            .help("instead of running the pipeline, time each layer of the model and decoding "
+                  "over this many batches of random input, and report their throughput and "
+                  "bandwidth.")
+            .default_value(0)
+            .scan<'i', int>();
+
+    parser.add_argument("-v", "--verbose").default_value(false).implicit_value(true);
+
+    try {
+        parser.parse_args(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << parser;
+        std::exit(1);
+    }
+
+    if (parser.get<bool>("--verbose")) {
+        spdlog::set_level(spdlog::level::debug);
+    }
+
+    const auto model = parser.get<std::string>("model");
+    if (model.empty()) {
+        run_kernel_benchmarks();
+        return 0;
+    }
+
+    PipelineSettings settings;
+    settings.model_path = model;
+    std::istringstream remora_models{parser.get<std::string>("--modified-bases-models")};
+    std::string remora_model;
+    while (std::getline(remora_models, remora_model, ',')) {
+        settings.remora_models.push_back(remora_model);
+    }
+    settings.device = parser.get<std::string>("-x");
+    settings.chunk_size = parser.get<int>("-c");
+    settings.overlap = parser.get<int>("-o");
+    settings.batch_size = parser.get<int>("-b");
+    settings.num_runners = parser.get<int>("-r");
+    settings.num_reads = parser.get<int>("--num-reads");
+    settings.read_options.mean_length = parser.get<int>("--read-length");
+    settings.read_options.length_sd = parser.get<int>("--read-length-sd");
+    settings.read_options.seed = static_cast<uint32_t>(parser.get<int>("--seed"));
+    settings.replay_trace = parser.get<std::string>("--replay");
+    settings.replay_speed = parser.get<float>("--replay-speed");
+
+    try {
+        if (const int num_batches = parser.get<int>("--profile-model"); num_batches > 0) {
+            run_model_profile(settings, num_batches);
+        } else {
+            run_pipeline_benchmark(std::move(settings));
+        }
+    } catch (const std::exception& e) {
+        spdlog::error("{}", e.what());
+        return 1;
+    }
     return 0;
 }
 
@@ -1,9 +1,14 @@
 namespace dorado {
 
 int basecaller(int argc, char *argv[]);
+int benchmark(int argc, char *argv[]);
 int duplex(int argc, char *argv[]);
 int download(int argc, char *argv[]);
 int aligner(int argc, char *argv[]);
 int summary(int argc, char *argv[]);
+int pack_model(int argc, char *argv[]);
+int worker(int argc, char *argv[]);
+int modbase(int argc, char *argv[]);
+int tune(int argc, char *argv[]);
 
 }  // namespace dorado
@@ -27,6 +27,11 @@ int download(int argc, char* argv[]) {
             .default_value(std::string("."))
             .help("the directory to download the models into");
 
+    parser.add_argument("--models-cache")
+            .default_value(utils::default_models_cache().string())
+            .help("the directory to download the models through and keep them in for later "
+                  "runs, e.g. on a volume shared by several machines");
+
     parser.add_argument("--list").default_value(false).implicit_value(true).help(
             "list the available models for download");
 
@@ -100,6 +105,7 @@ int download(int argc, char* argv[]) {
         return 1;
     }
 
+    utils::set_models_cache(parser.get<std::string>("--models-cache"));
     utils::download_models(directory.string(), selected_model);
 
     return 0;
@@ -2,22 +2,33 @@
 #include "data_loader/DataLoader.h"
 #include "decode/CPUDecoder.h"
 #include "nn/CRFModel.h"
+#include "read_pipeline/BamJoinNode.h"
 #include "read_pipeline/BaseSpaceDuplexCallerNode.h"
 #include "read_pipeline/BasecallerNode.h"
 #include "read_pipeline/DuplexSplitNode.h"
+#include "read_pipeline/MessageRouter.h"
 #include "read_pipeline/PairingNode.h"
 #include "read_pipeline/ReadFilterNode.h"
 #include "read_pipeline/ReadToBamTypeNode.h"
 #include "read_pipeline/ScalerNode.h"
 #include "read_pipeline/StatsCounter.h"
 #include "read_pipeline/StereoDuplexEncoderNode.h"
+#include "utils/GpuMonitor.h"
+#include "utils/MemoryBudget.h"
+#include "utils/MemoryProfiler.h"
+#include "utils/MetricsServer.h"
+#include "utils/TensorPool.h"
+#include "utils/TraceRecorder.h"
 #include "utils/bam_utils.h"
 #include "utils/cli_utils.h"
 #include "utils/duplex_utils.h"
+#include "utils/host_profile.h"
 #include "utils/log_utils.h"
+#include "utils/thread_utils.h"
 #if DORADO_GPU_BUILD
 #ifdef __APPLE__
 #include "nn/MetalCRFModel.h"
+#include "utils/metal_utils.h"
 #else
 #include "nn/CudaCRFModel.h"
 #include "utils/cuda_utils.h"
@@ -32,6 +43,9 @@
 #include <spdlog/spdlog.h>
 #include <utils/basecaller_utils.h>
 
+#include <cmath>
+#include <csignal>
+#include <future>
 #include <memory>
 #include <thread>
 #include <unordered_set>
@@ -53,6 +67,11 @@ int duplex(int argc, char* argv[]) {
             .default_value(std::string(""))
             .help("Space-delimited csv containing read ID pairs. If not provided, pairing will be "
                   "performed automatically");
+    parser.add_argument("--simplex-bam")
+            .default_value(std::string(""))
+            .help("Simplex calls of the reads, with moves, from basecaller --emit-moves with the "
+                  "same model. The reads' basecalls are taken from it rather than called again, "
+                  "so only the stereo model is run.");
     parser.add_argument("--emit-fastq").default_value(false).implicit_value(true);
     parser.add_argument("--emit-sam")
             .help("Output in SAM format.")
@@ -105,6 +124,15 @@ int duplex(int argc, char* argv[]) {
     parser.add_argument("-v", "--verbose").default_value(false).implicit_value(true);
 
     parser.add_argument("-I").help("minimap2 index batch size.").default_value(std::string("16G"));
+    parser.add_argument("--index-cache")
+            .help("Directory the minimap2 indexes built from FASTA references are cached in, "
+                  "for later runs to load rather than build again. Indexes are never evicted, "
+                  "so none are cached unless this is given.")
+            .default_value(std::string(""));
+    parser.add_argument("--models-cache")
+            .help("Directory models are downloaded through and kept in for later runs, e.g. "
+                  "on a volume shared by several machines. Empty means no cache.")
+            .default_value(utils::default_models_cache().string());
 
     parser.add_argument("--guard-gpus")
             .default_value(false)
@@ -113,6 +141,65 @@ int duplex(int argc, char* argv[]) {
                   "cause "
                   "performance regression.");
 
+    parser.add_argument("--max-host-memory")
+            .help("Most host memory reads in flight may take up, e.g. 64G. Reads are held back "
+                  "from the pipeline while it's used up. 0 means no limit.")
+            .default_value(std::string("0"));
+
+    parser.add_argument("--share-gpus")
+            .help("Share the GPUs with other dorado processes on this host which also pass this, "
+                  "taking turns one batch at a time and leaving each other's GPU memory alone. "
+                  "Linux only.")
+            .default_value(false)
+            .implicit_value(true);
+
+    parser.add_argument("--cuda-mps")
+            .help("As --share-gpus, but with the processes' batches running side by side under "
+                  "the CUDA MPS control daemon, which must be running. Linux only.")
+            .default_value(false)
+            .implicit_value(true);
+
+    parser.add_argument("--pairing-spill-dir")
+            .help("Spill the signal of reads waiting for their partners to a scratch file in this "
+                  "directory, rather than holding it in memory, and read it back as pairs are "
+                  "made.")
+            .default_value(std::string(""));
+
+    parser.add_argument("--gpu-stereo-encoding")
+            .help("Build the stereo model's features from read pairs on the GPU instead of the "
+                  "CPU. Requires a single CUDA device.")
+            .default_value(false)
+            .implicit_value(true);
+
+    parser.add_argument("--metrics-port")
+            .help("Serve throughput, pairing and memory metrics over HTTP on this port, at "
+                  "/metrics, for Prometheus to scrape. 0 means no metrics are served.")
+            .default_value(0)
+            .scan<'i', int>();
+
+    parser.add_argument("--trace-file")
+            .help("Write a timeline of batching, model, decoding and writing spans to this file, "
+                  "for chrome://tracing or Perfetto.")
+            .default_value(std::string(""));
+
+    parser.add_argument("--host-profile")
+            .help("Settings tuned for this host by `dorado tune`, used for the simplex model's "
+                  "chunk size and runners where they aren't given here. Its batch size is still "
+                  "picked from the memory the stereo model leaves. Defaults to "
+                  "$DORADO_HOST_PROFILE, or ~/.dorado/host_profile.toml if there's one.")
+            .default_value(std::string(""));
+
+    parser.add_argument("--no-host-profile")
+            .help("Ignore the settings tuned for this host, using the defaults instead.")
+            .default_value(false)
+            .implicit_value(true);
+
+    parser.add_argument("--memory-profile")
+            .help("Log the allocator's stats as pairs are called, and write its heap profiles and "
+                  "stats to files starting with this prefix. Heap profiles, which show the "
+                  "memory each node's threads hold, need JE_MALLOC_CONF=prof:true set. Linux only.")
+            .default_value(std::string(""));
+
     try {
         auto remaining_args = parser.parse_known_args(argc, argv);
         auto internal_parser = utils::parse_internal_options(remaining_args);
@@ -125,10 +212,32 @@ int duplex(int argc, char* argv[]) {
         auto min_qscore(parser.get<int>("--min-qscore"));
         auto ref = parser.get<std::string>("--reference");
         bool guard_gpus = parser.get<bool>("--guard-gpus");
+        utils::set_minimap_index_cache(parser.get<std::string>("--index-cache"));
+        utils::set_models_cache(parser.get<std::string>("--models-cache"));
+        utils::MemoryBudget::instance().set_limit(
+                utils::parse_string_to_size(parser.get<std::string>("--max-host-memory")));
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+        if (parser.get<bool>("--cuda-mps")) {
+            utils::check_cuda_mps();
+            utils::enable_gpu_sharing(false);
+        } else if (parser.get<bool>("--share-gpus")) {
+            utils::enable_gpu_sharing(true);
+        }
+#endif
         std::vector<std::string> args(argv, argv + argc);
         if (parser.get<bool>("--verbose")) {
             spdlog::set_level(spdlog::level::debug);
         }
+        const auto trace_file = parser.get<std::string>("--trace-file");
+        if (!trace_file.empty()) {
+            utils::TraceRecorder::instance().start();
+        }
+        std::unique_ptr<utils::MemoryProfiler> memory_profiler;
+        if (const auto memory_profile = parser.get<std::string>("--memory-profile");
+            !memory_profile.empty()) {
+            memory_profiler = std::make_unique<utils::MemoryProfiler>(
+                    memory_profile, utils::kMemoryProfileInterval);
+        }
         std::map<std::string, std::string> template_complement_map;
         auto read_list = utils::load_read_list(parser.get<std::string>("--read-ids"));
 
@@ -191,6 +300,39 @@ int duplex(int argc, char* argv[]) {
         }
         ReadToBamType read_converter(*converted_reads_sink, emit_moves, rna, 2);
         StatsCounterNode stats_node(read_converter, duplex);
+
+        utils::GpuMonitor gpu_monitor;
+#if DORADO_GPU_BUILD
+        if (device != "cpu") {
+#ifdef __APPLE__
+            utils::add_metal_monitor_device(gpu_monitor);
+#else
+            utils::add_gpu_monitor_devices(gpu_monitor, device);
+#endif
+        }
+#endif
+        gpu_monitor.start();
+
+        std::unique_ptr<utils::MetricsServer> metrics_server;
+        auto metrics = std::make_shared<utils::MetricsRegistry>();
+        if (parser.get<int>("--metrics-port") > 0) {
+#ifndef _WIN32
+            // A scraper which disconnects early mustn't take the caller down with it.
+            std::signal(SIGPIPE, SIG_IGN);
+#endif
+            metrics_server = std::make_unique<utils::MetricsServer>(
+                    parser.get<int>("--metrics-port"));
+            spdlog::info("> Serving metrics on port {}", metrics_server->port());
+            stats_node.add_metrics(*metrics);
+            bam_writer->add_metrics(*metrics);
+            utils::MemoryBudget::instance().add_metrics(*metrics);
+            gpu_monitor.add_metrics(*metrics);
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+            if (device != "cpu" && device != "metal") {
+                utils::add_gpu_memory_metrics(*metrics, device);
+            }
+#endif
+        }
         // The minimum sequence length is set to 5 to avoid issues with duplex node printing very short sequences for mismatched pairs.
         ReadFilterNode read_filter_node(stats_node, min_qscore,
                                         default_parameters.min_seqeuence_length, 5);
@@ -205,13 +347,14 @@ int duplex(int argc, char* argv[]) {
             // create a set of the read_ids
             auto read_ids = utils::get_read_list_from_pairs(template_complement_map);
 
-            spdlog::info("> Loading reads");
-            auto read_map = utils::read_bam(reads, read_list_from_pairs);
-
             spdlog::info("> Starting Basespace Duplex Pipeline");
             threads = threads == 0 ? std::thread::hardware_concurrency() : threads;
             BaseSpaceDuplexCallerNode duplex_caller_node(read_filter_node, template_complement_map,
-                                                         read_map, threads);
+                                                         threads);
+            const utils::ScopedMetrics scoped_metrics(metrics_server.get(), metrics);
+
+            // Pairs are called as soon as both their reads have been read.
+            utils::read_bam(reads, read_list_from_pairs, duplex_caller_node);
         } else {  // Execute a Stereo Duplex pipeline.
 
             const auto model_path = std::filesystem::canonical(std::filesystem::path(model));
@@ -230,9 +373,55 @@ int duplex(int argc, char* argv[]) {
             const auto stereo_model_path =
                     model_path.parent_path() / std::filesystem::path(stereo_model_name);
 
+            // A missing stereo model is downloaded while the rest is set up, up to loading it.
+            std::future<void> stereo_model_download;
             if (!std::filesystem::exists(stereo_model_path)) {
-                utils::download_models(model_path.parent_path().u8string(), stereo_model_name);
+                stereo_model_download =
+                        std::async(std::launch::async, utils::download_models,
+                                   model_path.parent_path().u8string(), stereo_model_name);
             }
+            auto wait_for_stereo_model = [&] {
+                if (stereo_model_download.valid()) {
+                    stereo_model_download.get();
+                }
+                if (!std::filesystem::exists(stereo_model_path)) {
+                    throw std::runtime_error("Stereo model " + stereo_model_name +
+                                             " could not be downloaded.");
+                }
+            };
+
+            // With simplex calls to reuse, the simplex model isn't loaded at all.
+            const auto simplex_bam = parser.get<std::string>("--simplex-bam");
+            BamRecordMap simplex_records;
+            if (!simplex_bam.empty()) {
+                spdlog::info("> Loading simplex calls from {}", simplex_bam);
+                // Only the reads which may be paired are kept.
+                auto wanted_read_ids = read_list;
+                if (!read_list_from_pairs.empty()) {
+                    std::unordered_set<std::string> pair_read_ids;
+                    for (const auto& read_id : read_list_from_pairs) {
+                        if (!read_list || read_list->contains(read_id)) {
+                            pair_read_ids.insert(read_id);
+                        }
+                    }
+                    wanted_read_ids = utils::ReadIdSet(pair_read_ids);
+                }
+                HtsReader simplex_reader(simplex_bam, 4);
+                const size_t num_skipped =
+                        simplex_records.add_records(simplex_reader, wanted_read_ids);
+                if (num_skipped > 0) {
+                    spdlog::info("> Simplex records skipped (secondary, supplementary or "
+                                 "without moves): {}",
+                                 num_skipped);
+                }
+                if (simplex_records.size() == 0) {
+                    throw std::runtime_error(
+                            "--simplex-bam has no records with moves, from --emit-moves.");
+                }
+                // Only the reads with simplex calls are loaded.
+                read_list = utils::ReadIdSet(simplex_records.read_ids());
+            }
+            const bool call_simplex = simplex_records.size() == 0;
 
             std::vector<Runner> runners;
             std::vector<Runner> stereo_runners;
@@ -242,14 +431,31 @@ int duplex(int argc, char* argv[]) {
             int batch_size(parser.get<int>("-b"));
             int chunk_size(parser.get<int>("-c"));
             int overlap(parser.get<int>("-o"));
-            const size_t num_runners = default_parameters.num_runners;
+            size_t num_runners = default_parameters.num_runners;
+            // Settings are tuned for the simplex model alone, so the stereo runners keep these.
+            const int stereo_chunk_size = chunk_size;
+            const size_t num_stereo_runners = num_runners;
+            // Options given on the command line take precedence over those tuned for the host.
+            // A tuned batch size isn't taken: it was tuned with all of the device's memory, where
+            // the simplex model here gets what the stereo one leaves, so its batch size is left
+            // to be picked within that.
+            if (!parser.get<bool>("--no-host-profile")) {
+                const auto host_profile = utils::select_host_profile(
+                        parser.get<std::string>("--host-profile"), device, model_path);
+                if (!parser.is_used("-c") && host_profile.chunk_size > 0) {
+                    chunk_size = host_profile.chunk_size;
+                }
+                if (host_profile.num_runners > 0) {
+                    num_runners = host_profile.num_runners;
+                }
+            }
 
             if (device == "cpu") {
                 if (batch_size == 0) {
                     batch_size = std::thread::hardware_concurrency();
                     spdlog::debug("- set batch size to {}", batch_size);
                 }
-                for (size_t i = 0; i < num_runners; i++) {
+                for (size_t i = 0; call_simplex && i < num_runners; i++) {
                     runners.push_back(std::make_shared<ModelRunner<CPUDecoder>>(
                             model_path, device, chunk_size, batch_size));
                 }
@@ -257,20 +463,23 @@ int duplex(int argc, char* argv[]) {
 #if DORADO_GPU_BUILD
 #ifdef __APPLE__
             else if (device == "metal") {
-                auto simplex_caller = create_metal_caller(model_path, chunk_size, batch_size);
-                for (int i = 0; i < num_runners; i++) {
-                    runners.push_back(std::make_shared<MetalModelRunner>(simplex_caller));
-                }
-                if (runners.back()->batch_size() != batch_size) {
-                    spdlog::debug("- set batch size to {}", runners.back()->batch_size());
+                if (call_simplex) {
+                    auto simplex_caller = create_metal_caller(model_path, chunk_size, batch_size);
+                    for (int i = 0; i < num_runners; i++) {
+                        runners.push_back(std::make_shared<MetalModelRunner>(simplex_caller));
+                    }
+                    if (runners.back()->batch_size() != batch_size) {
+                        spdlog::debug("- set batch size to {}", runners.back()->batch_size());
+                    }
                 }
 
                 // For now, the minimal batch size is used for the duplex model.
                 int stereo_batch_size = 48;
 
-                auto duplex_caller =
-                        create_metal_caller(stereo_model_path, chunk_size, stereo_batch_size);
-                for (size_t i = 0; i < num_runners; i++) {
+                wait_for_stereo_model();
+                auto duplex_caller = create_metal_caller(stereo_model_path, stereo_chunk_size,
+                                                         stereo_batch_size);
+                for (size_t i = 0; i < num_stereo_runners; i++) {
                     stereo_runners.push_back(std::make_shared<MetalModelRunner>(duplex_caller));
                 }
             } else {
@@ -278,37 +487,66 @@ int duplex(int argc, char* argv[]) {
             }
 #else   // ifdef __APPLE__
             else {
-                // Note: The memory assignment between simplex and duplex callers have been
-                // performed based on empirical results considering a SUP model for simplex
-                // calling.
                 auto devices = utils::parse_cuda_device_string(device);
                 num_devices = devices.size();
                 if (num_devices == 0) {
                     throw std::runtime_error("CUDA device requested but no devices found.");
                 }
-                for (auto device_string : devices) {
-                    // Use most of GPU mem but leave some for buffer.
-                    auto caller = create_cuda_caller(model_path, chunk_size, batch_size,
-                                                     device_string, 0.9f, guard_gpus);
-                    for (size_t i = 0; i < num_runners; i++) {
-                        runners.push_back(std::make_shared<CudaModelRunner>(caller));
+                // Read signals are loaded into pinned buffers, which go to the GPUs without staging.
+                utils::use_pinned_tensor_pool();
+                wait_for_stereo_model();
+                // Each device is set up on a thread of its own, so that loading the models onto
+                // them and picking their batch sizes overlaps.
+                struct DeviceSetup {
+                    std::vector<Runner> stereo_runners;
+                    std::vector<Runner> runners;
+                };
+                auto setups = utils::run_concurrently(devices.size(), [&](size_t device_index) {
+                    const auto& device_string = devices[device_index];
+                    DeviceSetup setup;
+                    // The stereo caller is set up first, so that its batches have memory set
+                    // aside rather than getting whatever the simplex caller leaves.  Its batch
+                    // size is ALWAYS auto tuned (i.e. the batch_size passed in is 0), within a
+                    // share of the memory: the stereo model is much smaller than the simplex one,
+                    // and only pairs need it.
+                    const float kStereoMemoryFraction = 0.3f;
+                    auto stereo_caller =
+                            create_cuda_caller(stereo_model_path, stereo_chunk_size, 0,
+                                               device_string, kStereoMemoryFraction, guard_gpus);
+                    for (size_t i = 0; i < num_stereo_runners; i++) {
+                        setup.stereo_runners.push_back(
+                                std::make_shared<CudaModelRunner>(stereo_caller));
                     }
-                    if (runners.back()->batch_size() != batch_size) {
-                        spdlog::debug("- set batch size for {} to {}", device_string,
-                                      runners.back()->batch_size());
+                    const auto stereo_memory_bytes = cuda_caller_batch_memory_bytes(stereo_caller);
+                    const auto available = utils::available_memory(torch::Device(device_string));
+                    spdlog::debug("- reserving {:.2f}GB on {} for stereo batches of {}",
+                                  stereo_memory_bytes / 1e+9, device_string,
+                                  setup.stereo_runners.back()->batch_size());
+                    if (!call_simplex) {
+                        return setup;
                     }
-                }
 
-                for (auto device_string : devices) {
-                    // The fraction argument for GPU memory allocates the fraction of the
-                    // _remaining_ memory to the caller. So, we allocate all of the available
-                    // memory after simplex caller has been instantiated to the duplex caller.
-                    // ALWAYS auto tune the duplex batch size (i.e. batch_size passed in is 0.)
-                    auto caller = create_cuda_caller(stereo_model_path, chunk_size, 0,
-                                                     device_string, 1.f, guard_gpus);
+                    // Use most of the rest of GPU mem but leave some for buffer.
+                    const float memory_limit_fraction =
+                            0.9f * std::max(0.f, 1.f - float(stereo_memory_bytes) /
+                                                               float(available));
+                    auto caller = create_cuda_caller(model_path, chunk_size, batch_size,
+                                                     device_string, memory_limit_fraction,
+                                                     guard_gpus);
                     for (size_t i = 0; i < num_runners; i++) {
-                        stereo_runners.push_back(std::make_shared<CudaModelRunner>(caller));
+                        setup.runners.push_back(std::make_shared<CudaModelRunner>(caller));
                     }
+                    if (setup.runners.back()->batch_size() != batch_size) {
+                        spdlog::debug("- set batch size for {} to {}", device_string,
+                                      setup.runners.back()->batch_size());
+                    }
+                    return setup;
+                });
+                // In device order, as they were set up one at a time before.
+                for (auto& setup : setups) {
+                    stereo_runners.insert(stereo_runners.end(), setup.stereo_runners.begin(),
+                                          setup.stereo_runners.end());
+                    runners.insert(runners.end(), setup.runners.begin(), setup.runners.end());
                 }
             }
 #endif  // __APPLE__
@@ -319,46 +557,105 @@ int duplex(int argc, char* argv[]) {
 
             auto adjusted_stereo_overlap = (overlap / stereo_model_stride) * stereo_model_stride;
 
-            const int kStereoBatchTimeoutMS = 5000;
+            // Both duplex reads from the stereo basecaller and simplex reads from the
+            // pairing node feed the read filter, so both reach it through routers.
+            MessageRouter stereo_output_router(read_filter_node);
+            const int kStereoBatchLatencyTargetMS = 5000;
             auto stereo_basecaller_node = std::make_unique<BasecallerNode>(
-                    read_filter_node, std::move(stereo_runners), adjusted_stereo_overlap,
-                    kStereoBatchTimeoutMS);
-            auto simplex_model_stride = runners.front()->model_stride();
+                    stereo_output_router, std::move(stereo_runners), adjusted_stereo_overlap,
+                    kStereoBatchLatencyTargetMS);
+            auto simplex_model_stride = call_simplex
+                                                ? runners.front()->model_stride()
+                                                : size_t(simplex_records.model_stride());
+
+            std::string stereo_encoding_device;
+            if (parser.get<bool>("--gpu-stereo-encoding")) {
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+                if (device != "cpu" && num_devices == 1) {
+                    stereo_encoding_device = utils::parse_cuda_device_string(device).front();
+                }
+#endif
+                if (stereo_encoding_device.empty()) {
+                    spdlog::warn(
+                            "--gpu-stereo-encoding requires a single CUDA device, encoding on the "
+                            "CPU");
+                }
+            }
+            StereoDuplexEncoderNode stereo_node = StereoDuplexEncoderNode(
+                    *stereo_basecaller_node, simplex_model_stride, threads, stereo_encoding_device);
 
-            StereoDuplexEncoderNode stereo_node =
-                    StereoDuplexEncoderNode(*stereo_basecaller_node, simplex_model_stride);
+            // Only read pairs need stereo encoding: simplex reads bypass the stereo path.
+            MessageRouter pairing_output_router(read_filter_node);
+            pairing_output_router.route<std::shared_ptr<ReadPair>>(stereo_node);
 
-            PairingNode pairing_node(stereo_node,
+            PairingNode pairing_node(pairing_output_router,
                                      template_complement_map.empty()
                                              ? std::optional<std::map<std::string, std::string>>{}
-                                             : template_complement_map);
-
-            // Initialize duplex split settings and create a duplex split node
-            // with the given settings and number of devices. If
-            // splitter_settings.enabled is set to false, the splitter node will
-            // act as a passthrough, meaning it won't perform any splitting
-            // operations and will just pass data through.
-            DuplexSplitSettings splitter_settings;
-            DuplexSplitNode splitter_node(pairing_node, splitter_settings, num_devices);
-
-            auto adjusted_simplex_overlap = (overlap / simplex_model_stride) * simplex_model_stride;
+                                             : template_complement_map,
+                                     60000, 10000, parser.get<std::string>("--pairing-spill-dir"));
+
+            // Reads go to the pairing node basecalled and split, or with their simplex calls
+            // restored, which were split by the basecaller that made them.
+            std::unique_ptr<DuplexSplitNode> splitter_node;
+            std::unique_ptr<BasecallerNode> basecaller_node;
+            std::unique_ptr<BamJoinNode> simplex_join_node;
+            MessageSink* scaled_reads_sink = nullptr;
+            if (call_simplex) {
+                // Initialize duplex split settings and create a duplex split node
+                // with the given settings and number of devices. If
+                // splitter_settings.enabled is set to false, the splitter node will
+                // act as a passthrough, meaning it won't perform any splitting
+                // operations and will just pass data through.
+                DuplexSplitSettings splitter_settings;
+                splitter_node = std::make_unique<DuplexSplitNode>(pairing_node, splitter_settings,
+                                                                  num_devices);
+
+                auto adjusted_simplex_overlap =
+                        (overlap / simplex_model_stride) * simplex_model_stride;
+                basecaller_node = std::make_unique<BasecallerNode>(
+                        *splitter_node, std::move(runners), adjusted_simplex_overlap,
+                        default_parameters.batch_latency_target);
+                scaled_reads_sink = basecaller_node.get();
+            } else {
+                simplex_join_node = std::make_unique<BamJoinNode>(pairing_node, simplex_records,
+                                                                  num_devices * 2, false);
+                scaled_reads_sink = simplex_join_node.get();
+            }
 
-            const int kSimplexBatchTimeoutMS = 100;
-            auto basecaller_node = std::make_unique<BasecallerNode>(
-                    splitter_node, std::move(runners), adjusted_simplex_overlap,
-                    kSimplexBatchTimeoutMS);
+            ScalerNode scaler_node(*scaled_reads_sink, num_devices * 2);
 
-            ScalerNode scaler_node(*basecaller_node, num_devices * 2);
+            if (metrics_server) {
+                if (basecaller_node) {
+                    basecaller_node->add_metrics(*metrics);
+                }
+                stereo_basecaller_node->add_metrics(*metrics, "stereo");
+                pairing_node.add_metrics(*metrics);
+                stereo_node.add_metrics(*metrics);
+            }
+            const utils::ScopedMetrics scoped_metrics(metrics_server.get(), metrics);
 
             DataLoader loader(scaler_node, "cpu", num_devices, 0, std::move(read_list));
             loader.load_reads(reads, parser.get<bool>("--recursive"), DataLoader::BY_CHANNEL);
         }
         bam_writer->join();  // Explicitly wait for all output rows to be written.
-        stats_node.dump_stats();
+        gpu_monitor.stop();
+        if (!trace_file.empty()) {
+            auto& trace_recorder = utils::TraceRecorder::instance();
+            trace_recorder.stop();
+            trace_recorder.write_chrome_trace(trace_file);
+        }
+        const double gpu_energy_joules = gpu_monitor.energy_joules();
+        stats_node.dump_stats(std::isnan(gpu_energy_joules) ? 0 : gpu_energy_joules);
+        gpu_monitor.log_summary();
+        // The last report, while the pipeline still holds what it has.
+        memory_profiler.reset();
     } catch (const std::exception& e) {
         spdlog::error(e.what());
+        utils::TensorPool::instance().shutdown();
         return 1;
     }
+    // The pipeline is gone, so free pinned buffers while CUDA is still up.
+    utils::TensorPool::instance().shutdown();
     return 0;
 }
 }  // namespace dorado
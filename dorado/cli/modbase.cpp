@@ -0,0 +1,183 @@
+#include "Version.h"
+#include "data_loader/DataLoader.h"
+#include "nn/RemoraModel.h"
+#include "read_pipeline/BamJoinNode.h"
+#include "read_pipeline/ModBaseCallerNode.h"
+#include "read_pipeline/ScalerNode.h"
+#include "utils/bam_utils.h"
+#include "utils/cli_utils.h"
+#include "utils/log_utils.h"
+#include "utils/parameters.h"
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+#include "utils/cuda_utils.h"
+#endif
+
+#include <argparse.hpp>
+#include <htslib/sam.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dorado {
+
+using HtsWriter = utils::HtsWriter;
+using HtsReader = utils::HtsReader;
+using dorado::utils::default_parameters;
+
+int modbase(int argc, char* argv[]) {
+    utils::InitLogging();
+
+    argparse::ArgumentParser parser("dorado", DORADO_VERSION, argparse::default_arguments::help);
+    parser.add_description(
+            "Modified base calling of reads already basecalled with --emit-moves, from their "
+            "signal and the records of their basecall, without basecalling them again.");
+    parser.add_argument("models").help("a comma separated list of modified base models.");
+    parser.add_argument("data").help("the data directory, of the reads' POD5 or FAST5 files.");
+    parser.add_argument("--bam")
+            .help("the basecall, in any HTS format, as written with --emit-moves.")
+            .required();
+
+    parser.add_argument("-v", "--verbose").default_value(false).implicit_value(true);
+
+    parser.add_argument("-x", "--device")
+            .help("device string in format \"cuda:0,...,N\", \"cuda:all\", \"metal\", \"cpu\" "
+                  "etc..")
+            .default_value(default_parameters.device);
+
+    parser.add_argument("-b", "--batchsize")
+            .default_value(default_parameters.remora_batchsize)
+            .scan<'i', int>()
+            .help("the modified base models' batch size.");
+
+    parser.add_argument("-r", "--recursive")
+            .default_value(false)
+            .implicit_value(true)
+            .help("Recursively scan through directories to load FAST5 and POD5 files");
+
+    parser.add_argument("--modified-bases-threshold")
+            .default_value(default_parameters.methylation_threshold)
+            .scan<'f', float>()
+            .help("the minimum predicted methylation probability for a modified base to be emitted "
+                  "in an all-context model, [0, 1]");
+
+    parser.add_argument("--emit-sam")
+            .help("Output in SAM format.")
+            .default_value(false)
+            .implicit_value(true);
+
+    try {
+        parser.parse_args(argc, argv);
+    } catch (const std::exception& e) {
+        std::ostringstream parser_stream;
+        parser_stream << parser;
+        spdlog::error("{}\n{}", e.what(), parser_stream.str());
+        std::exit(1);
+    }
+
+    if (parser.get<bool>("--verbose")) {
+        spdlog::set_level(spdlog::level::debug);
+    }
+
+    std::vector<std::filesystem::path> model_list;
+    std::istringstream stream{parser.get<std::string>("models")};
+    std::string model;
+    while (std::getline(stream, model, ',')) {
+        model_list.push_back(model);
+    }
+    const auto data_path = parser.get<std::string>("data");
+    const auto device = parser.get<std::string>("-x");
+    const auto batch_size = static_cast<size_t>(parser.get<int>("-b"));
+    const auto methylation_threshold = parser.get<float>("--modified-bases-threshold");
+    if (model_list.empty() || methylation_threshold < 0.f || methylation_threshold > 1.f) {
+        spdlog::error("At least one model is needed, and --modified-bases-threshold must be "
+                      "between 0 and 1.");
+        return 1;
+    }
+
+    auto output_mode = HtsWriter::OutputMode::BAM;
+    if (parser.get<bool>("--emit-sam") || utils::is_fd_tty(stdout)) {
+        output_mode = HtsWriter::OutputMode::SAM;
+    } else if (utils::is_fd_pipe(stdout)) {
+        output_mode = HtsWriter::OutputMode::UBAM;
+    }
+
+    try {
+        // The records are held until their reads have been modbase called, so that the reads'
+        // signal can be loaded in whatever order the data is in.
+        spdlog::info("> Loading the basecall from {}", parser.get<std::string>("--bam"));
+        HtsReader reader(parser.get<std::string>("--bam"),
+                         std::max(1u, std::thread::hardware_concurrency() / 4));
+        // Every record is written out, but only the primary records with moves are joined up
+        // with the reads' signal.
+        BamRecordMap records(true);
+        const size_t num_other_records = records.add_records(reader);
+        if (num_other_records > 0) {
+            spdlog::info("> Records not modbase called themselves (secondary, supplementary or "
+                         "without moves): {}",
+                         num_other_records);
+        }
+        if (records.size() == 0) {
+            throw std::runtime_error("The BAM has no records with moves, from --emit-moves.");
+        }
+        const auto model_stride = static_cast<size_t>(records.model_stride());
+
+        std::vector<std::shared_ptr<RemoraCaller>> remora_callers;
+        std::vector<std::string> devices{device};
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+        if (device != "cpu" && device != "metal") {
+            devices = utils::parse_cuda_device_string(device);
+            if (devices.empty()) {
+                throw std::runtime_error("CUDA device requested but no devices found.");
+            }
+        }
+#endif
+        for (const auto& device_string : devices) {
+            for (const auto& remora_model : model_list) {
+                remora_callers.push_back(std::make_shared<RemoraCaller>(
+                        remora_model, device_string, batch_size, model_stride));
+            }
+        }
+        const auto thread_allocations = utils::default_thread_allocations(
+                int(devices.size()), default_parameters.remora_threads);
+
+        HtsWriter writer("-", output_mode, thread_allocations.writer_threads, records.size());
+        writer.add_header(reader.header);
+        std::string command_line = "dorado";
+        for (int i = 0; i < argc; ++i) {
+            command_line += " " + std::string(argv[i]);
+        }
+        sam_hdr_add_pg(writer.header, "modbase", "PN", "dorado", "VN", DORADO_VERSION, "CL",
+                       command_line.c_str(), NULL);
+        writer.write_header();
+
+        BamModBaseTagNode tag_node(writer, records, methylation_threshold,
+                                   thread_allocations.read_converter_threads);
+        ModBaseCallerNode mod_base_caller_node(tag_node, remora_callers,
+                                               thread_allocations.remora_threads, devices.size(),
+                                               model_stride, batch_size);
+        BamJoinNode join_node(mod_base_caller_node, records,
+                              thread_allocations.read_filter_threads);
+        ScalerNode scaler_node(join_node, thread_allocations.scaler_node_threads);
+
+        DataLoader loader(scaler_node, "cpu", thread_allocations.loader_threads, 0,
+                          records.read_ids());
+        loader.load_reads(data_path, parser.get<bool>("--recursive"));
+        writer.join();
+
+        spdlog::info("> Records written: {}", writer.total);
+    } catch (const std::exception& e) {
+        spdlog::error("{}", e.what());
+        return 1;
+    }
+
+    spdlog::info("> Finished");
+    return 0;
+}
+
+}  // namespace dorado
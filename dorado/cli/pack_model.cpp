@@ -0,0 +1,62 @@
+#include "Version.h"
+#include "nn/CRFModel.h"
+#include "utils/log_utils.h"
+#include "utils/tensor_utils.h"
+
+#include <argparse.hpp>
+#include <spdlog/spdlog.h>
+
+#include <filesystem>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace dorado {
+
+int pack_model(int argc, char* argv[]) {
+    utils::InitLogging();
+
+    argparse::ArgumentParser parser("dorado", DORADO_VERSION, argparse::default_arguments::help);
+
+    parser.add_argument("model").help(
+            "the basecaller model directory, which the packed weights are written into.");
+
+    parser.add_argument("-v", "--verbose").default_value(false).implicit_value(true);
+
+    try {
+        parser.parse_args(argc, argv);
+    } catch (const std::exception& e) {
+        std::ostringstream parser_stream;
+        parser_stream << parser;
+        spdlog::error("{}\n{}", e.what(), parser_stream.str());
+        std::exit(1);
+    }
+
+    if (parser.get<bool>("--verbose")) {
+        spdlog::set_level(spdlog::level::debug);
+    }
+
+    const fs::path model_path(parser.get<std::string>("model"));
+    const auto packed_weights_path = model_path / kPackedWeightsFileName;
+    const auto temp_path = packed_weights_path.string() + ".tmp";
+    try {
+        const auto model_config = load_crf_model_config(model_path);
+        const auto names =
+                crf_model_weight_names(model_config.out_features.has_value(), model_config.bias);
+        const auto tensors = utils::load_tensors(model_path, names);
+        // Write to a temporary file first, so that a basecaller starting meanwhile never
+        // sees a partial file.
+        utils::save_packed_tensors(temp_path, names, tensors);
+        fs::rename(temp_path, packed_weights_path);
+    } catch (const std::exception& e) {
+        spdlog::error("> error: {}", e.what());
+        std::error_code error;
+        fs::remove(temp_path, error);
+        return 1;
+    }
+
+    spdlog::info("> Packed weights written to {}", packed_weights_path.string());
+    return 0;
+}
+
+}  // namespace dorado
@@ -1,4 +1,5 @@
 #include "Version.h"
+#include "utils/WorkStealingExecutor.h"
 #include "utils/bam_utils.h"
 #include "utils/log_utils.h"
 
@@ -7,9 +8,22 @@
 #include <date/tz.h>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
 #include <cctype>
+#include <charconv>
 #include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
 #include <filesystem>
+#include <future>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <string_view>
+#include <thread>
 
 namespace dorado {
 
@@ -45,12 +59,387 @@ double time_difference_seconds(const std::string &timestamp1, const std::string
     }
 }
 
+namespace {
+
+// Reads fixed width digits from text at pos, advancing pos, or returns -1 if they aren't there.
+int parse_digits(std::string_view text, size_t &pos, size_t num_digits) {
+    if (pos + num_digits > text.size()) {
+        return -1;
+    }
+    int value = 0;
+    for (size_t i = 0; i < num_digits; ++i) {
+        const char c = text[pos++];
+        if (c < '0' || c > '9') {
+            return -1;
+        }
+        value = value * 10 + (c - '0');
+    }
+    return value;
+}
+
+// Days since 1970-01-01 of a date in the proleptic Gregorian calendar.
+int64_t days_from_civil(int64_t year, int month, int day) {
+    year -= month <= 2;
+    const int64_t era = (year >= 0 ? year : year - 399) / 400;
+    const int64_t year_of_era = year - era * 400;
+    const int64_t day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    const int64_t day_of_era =
+            year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + day_of_era - 719468;
+}
+
+// Microseconds since the epoch of a timestamp as dorado writes them, e.g.
+// "2017-04-29T09:10:04.123+01:00" or "2017-04-29T09:10:04Z", or nullopt for anything else so
+// that the caller can fall back to time_difference_seconds.
+std::optional<int64_t> parse_timestamp_us(std::string_view text) {
+    size_t pos = 0;
+    auto expect = [&](char c) { return pos < text.size() && text[pos++] == c; };
+    const int year = parse_digits(text, pos, 4);
+    if (year < 0 || !expect('-')) {
+        return std::nullopt;
+    }
+    const int month = parse_digits(text, pos, 2);
+    if (month < 1 || month > 12 || !expect('-')) {
+        return std::nullopt;
+    }
+    const int day = parse_digits(text, pos, 2);
+    if (day < 1 || day > 31 || !expect('T')) {
+        return std::nullopt;
+    }
+    const int hours = parse_digits(text, pos, 2);
+    if (hours < 0 || !expect(':')) {
+        return std::nullopt;
+    }
+    const int minutes = parse_digits(text, pos, 2);
+    if (minutes < 0 || !expect(':')) {
+        return std::nullopt;
+    }
+    const int seconds = parse_digits(text, pos, 2);
+    if (seconds < 0) {
+        return std::nullopt;
+    }
+    int64_t microseconds = 0;
+    if (pos < text.size() && text[pos] == '.') {
+        ++pos;
+        // As many digits as there are, with those past microseconds truncated.
+        int64_t scale = 100000;
+        const size_t first = pos;
+        while (pos < text.size() && text[pos] >= '0' && text[pos] <= '9') {
+            microseconds += (text[pos++] - '0') * scale;
+            scale /= 10;
+        }
+        if (pos == first) {
+            return std::nullopt;
+        }
+    }
+    int64_t offset_minutes = 0;
+    if (pos < text.size() && text[pos] == 'Z') {
+        ++pos;
+    } else if (pos < text.size() && (text[pos] == '+' || text[pos] == '-')) {
+        const int sign = text[pos++] == '-' ? -1 : 1;
+        const int offset_hours = parse_digits(text, pos, 2);
+        if (pos < text.size() && text[pos] == ':') {
+            ++pos;
+        }
+        const int offset_mins = parse_digits(text, pos, 2);
+        if (offset_hours < 0 || offset_mins < 0) {
+            return std::nullopt;
+        }
+        offset_minutes = sign * (offset_hours * 60 + offset_mins);
+    } else {
+        return std::nullopt;
+    }
+    if (pos != text.size()) {
+        return std::nullopt;
+    }
+    const int64_t total_seconds = days_from_civil(year, month, day) * 86400 + hours * 3600 +
+                                  minutes * 60 + seconds - offset_minutes * 60;
+    return total_seconds * 1000000 + microseconds;
+}
+
+// Pointers to the type byte of each tag the summary uses, as bam_aux_get returns them, or null
+// for tags the record doesn't have.
+struct SummaryTags {
+    const uint8_t *rg = nullptr;
+    const uint8_t *f5 = nullptr;
+    const uint8_t *fn = nullptr;
+    const uint8_t *ch = nullptr;
+    const uint8_t *mx = nullptr;
+    const uint8_t *st = nullptr;
+    const uint8_t *du = nullptr;
+    const uint8_t *qs = nullptr;
+    const uint8_t *ns = nullptr;
+    const uint8_t *ts = nullptr;
+};
+
+// Finds the summary's tags in one pass over the record's aux data, rather than a bam_aux_get
+// search for each.  As with bam_aux_get, the first of any repeated tag is used.
+SummaryTags find_summary_tags(const bam1_t *record) {
+    SummaryTags tags;
+    auto set = [](const uint8_t *&tag, const uint8_t *value) {
+        if (!tag) {
+            tag = value;
+        }
+    };
+    const uint8_t *aux = bam_get_aux(record);
+    const uint8_t *end = record->data + record->l_data;
+    while (aux + 3 <= end) {
+        const uint8_t *value = aux + 2;
+        switch (aux[0] << 8 | aux[1]) {
+        case 'R' << 8 | 'G':
+            set(tags.rg, value);
+            break;
+        case 'f' << 8 | '5':
+            set(tags.f5, value);
+            break;
+        case 'f' << 8 | 'n':
+            set(tags.fn, value);
+            break;
+        case 'c' << 8 | 'h':
+            set(tags.ch, value);
+            break;
+        case 'm' << 8 | 'x':
+            set(tags.mx, value);
+            break;
+        case 's' << 8 | 't':
+            set(tags.st, value);
+            break;
+        case 'd' << 8 | 'u':
+            set(tags.du, value);
+            break;
+        case 'q' << 8 | 's':
+            set(tags.qs, value);
+            break;
+        case 'n' << 8 | 's':
+            set(tags.ns, value);
+            break;
+        case 't' << 8 | 's':
+            set(tags.ts, value);
+            break;
+        default:
+            break;
+        }
+
+        // Skip the type byte and the value.
+        const uint8_t *next = value + 1;
+        switch (*value) {
+        case 'A':
+        case 'c':
+        case 'C':
+            next += 1;
+            break;
+        case 's':
+        case 'S':
+            next += 2;
+            break;
+        case 'i':
+        case 'I':
+        case 'f':
+            next += 4;
+            break;
+        case 'd':
+            next += 8;
+            break;
+        case 'Z':
+        case 'H':
+            while (next < end && *next) {
+                ++next;
+            }
+            ++next;
+            break;
+        case 'B': {
+            if (next + 5 > end) {
+                return tags;
+            }
+            int size = 4;
+            if (*next == 'c' || *next == 'C') {
+                size = 1;
+            } else if (*next == 's' || *next == 'S') {
+                size = 2;
+            }
+            uint32_t count;
+            std::memcpy(&count, next + 1, sizeof(count));
+            next += 5 + int64_t(size) * count;
+            break;
+        }
+        default:
+            // Corrupt aux data: keep what has been found so far.
+            return tags;
+        }
+        aux = next;
+    }
+    return tags;
+}
+
+int tag_int(const uint8_t *tag) { return tag ? static_cast<int>(bam_aux2i(tag)) : 0; }
+
+float tag_float(const uint8_t *tag) { return tag ? static_cast<float>(bam_aux2f(tag)) : 0.f; }
+
+std::string_view tag_string(const uint8_t *tag) {
+    const char *value = tag ? bam_aux2Z(tag) : nullptr;
+    return value ? std::string_view(value) : std::string_view();
+}
+
+// What every row of the summary needs to know about the file.
+struct SummaryContext {
+    sam_hdr_t *header;
+    bool is_aligned;
+    std::string separator;
+    // Each read group's experiment start time, as given and as parsed.
+    std::map<std::string, std::string> exp_start_times;
+    std::map<std::string, std::optional<int64_t>, std::less<>> exp_start_times_us;
+};
+
+// Formats as iostream does by default, so that output is as it was.
+void append_number(std::string &buffer, double value) {
+    char text[32];
+    const int length = std::snprintf(text, sizeof(text), "%g", value);
+    buffer.append(text, length);
+}
+
+void append_number(std::string &buffer, int64_t value) {
+    char text[24];
+    const auto result = std::to_chars(std::begin(text), std::end(text), value);
+    buffer.append(text, result.ptr);
+}
+
+// Appends the record's row to buffer, throwing if it has no read group.
+void append_row(std::string &buffer, bam1_t *record, const SummaryContext &context) {
+    const auto &separator = context.separator;
+    const auto tags = find_summary_tags(record);
+
+    const auto rg_value = tag_string(tags.rg);
+    if (rg_value.empty()) {
+        throw std::runtime_error("Cannot generate sequencing summary for files with no RG tags");
+    }
+    const auto run_id = rg_value.substr(0, rg_value.find('_'));
+
+    auto filename = tag_string(tags.f5);
+    if (filename.empty()) {
+        filename = tag_string(tags.fn);
+    }
+    const auto seqlen = record->core.l_qseq;
+    const auto duration = tag_float(tags.du);
+    const auto num_samples = tag_int(tags.ns);
+    const auto trim_samples = tag_int(tags.ts);
+
+    const float sample_rate = num_samples / duration;
+    const float template_duration = (num_samples - trim_samples) / sample_rate;
+    const auto start_time_dt = tag_string(tags.st);
+    const auto exp_start = context.exp_start_times_us.find(rg_value);
+    if (exp_start == context.exp_start_times_us.end()) {
+        throw std::out_of_range("No DT in the header for read group " + std::string(rg_value));
+    }
+    const auto start_time_us = parse_timestamp_us(start_time_dt);
+    double start_time;
+    if (start_time_us && exp_start->second) {
+        start_time = static_cast<double>(*start_time_us - *exp_start->second) / 1000000;
+    } else {
+        start_time = time_difference_seconds(std::string(start_time_dt),
+                                             context.exp_start_times.at(std::string(rg_value)));
+    }
+    const auto template_start_time = start_time + (duration - template_duration);
+
+    buffer.append(filename).append(separator);
+    buffer.append(bam_get_qname(record)).append(separator);
+    buffer.append(run_id).append(separator);
+    append_number(buffer, int64_t(tag_int(tags.ch)));
+    buffer.append(separator);
+    append_number(buffer, int64_t(tag_int(tags.mx)));
+    buffer.append(separator);
+    append_number(buffer, start_time);
+    buffer.append(separator);
+    append_number(buffer, duration);
+    buffer.append(separator);
+    append_number(buffer, template_start_time);
+    buffer.append(separator);
+    append_number(buffer, template_duration);
+    buffer.append(separator);
+    append_number(buffer, int64_t(seqlen));
+    buffer.append(separator);
+    append_number(buffer, int64_t(tag_int(tags.qs)));
+
+    if (context.is_aligned) {
+        std::string_view alignment_genome = "*";
+        int32_t alignment_genome_start = -1;
+        int32_t alignment_genome_end = -1;
+        int32_t alignment_strand_start = -1;
+        int32_t alignment_strand_end = -1;
+        std::string_view alignment_direction = "*";
+        int32_t alignment_length = 0;
+        int32_t alignment_mapq = 0;
+        int alignment_num_aligned = 0;
+        int alignment_num_correct = 0;
+        int alignment_num_insertions = 0;
+        int alignment_num_deletions = 0;
+        int alignment_num_substitutions = 0;
+        float strand_coverage = 0.0;
+        float alignment_identity = 0.0;
+        float alignment_accurary = 0.0;
+
+        if (!(record->core.flag & BAM_FUNMAP)) {
+            alignment_mapq = static_cast<int>(record->core.qual);
+            alignment_genome = context.header->target_name[record->core.tid];
+
+            alignment_genome_start = record->core.pos;
+            alignment_genome_end = bam_endpos(record);
+            alignment_direction = bam_is_rev(record) ? "-" : "+";
+
+            auto alignment_counts = utils::get_alignment_op_counts(record);
+            alignment_num_aligned = alignment_counts.matches;
+            alignment_num_correct = alignment_counts.matches - alignment_counts.substitutions;
+            alignment_num_insertions = alignment_counts.insertions;
+            alignment_num_deletions = alignment_counts.deletions;
+            alignment_num_substitutions = alignment_counts.substitutions;
+            alignment_length = alignment_counts.matches + alignment_counts.insertions +
+                               alignment_counts.deletions;
+            alignment_strand_start = alignment_counts.softclip_start;
+            alignment_strand_end = seqlen - alignment_counts.softclip_end;
+
+            strand_coverage =
+                    (alignment_strand_end - alignment_strand_start) / static_cast<float>(seqlen);
+            alignment_identity =
+                    alignment_num_correct / static_cast<float>(alignment_counts.matches);
+            alignment_accurary = alignment_num_correct / static_cast<float>(alignment_length);
+        }
+
+        buffer.append(separator).append(alignment_genome);
+        for (int64_t value : {alignment_genome_start, alignment_genome_end,
+                              alignment_strand_start, alignment_strand_end}) {
+            buffer.append(separator);
+            append_number(buffer, value);
+        }
+        buffer.append(separator).append(alignment_direction);
+        for (int64_t value : {alignment_length, alignment_num_aligned, alignment_num_correct,
+                              alignment_num_insertions, alignment_num_deletions,
+                              alignment_num_substitutions, alignment_mapq}) {
+            buffer.append(separator);
+            append_number(buffer, value);
+        }
+        for (double value : {strand_coverage, alignment_identity, alignment_accurary}) {
+            buffer.append(separator);
+            append_number(buffer, value);
+        }
+    }
+
+    buffer.push_back('\n');
+}
+
+// Records formatted by each task.
+constexpr size_t kRecordsPerChunk = 4096;
+
+}  // namespace
+
 int summary(int argc, char *argv[]) {
     utils::InitLogging();
 
     argparse::ArgumentParser parser("dorado", DORADO_VERSION, argparse::default_arguments::help);
     parser.add_argument("reads").help("SAM/BAM file produced by dorado basecaller.");
     parser.add_argument("-s", "--separator").default_value(std::string("\t"));
+    parser.add_argument("-t", "--threads")
+            .help("number of threads for decompressing the input, 0 for up to 4.")
+            .default_value(0)
+            .scan<'i', int>();
     parser.add_argument("-v", "--verbose").default_value(false).implicit_value(true);
 
     try {
@@ -91,7 +480,11 @@ int summary(int argc, char *argv[]) {
     auto reads(parser.get<std::string>("reads"));
     auto separator(parser.get<std::string>("separator"));
 
-    HtsReader reader(reads);
+    auto threads(parser.get<int>("threads"));
+    threads = threads > 0 ? threads
+                          : std::clamp(int(std::thread::hardware_concurrency()), 1, 4);
+
+    HtsReader reader(reads, threads);
 
     auto read_group_exp_start_time = utils::get_read_group_info(reader.header, "DT");
 
@@ -115,108 +508,50 @@ int summary(int argc, char *argv[]) {
 
     std::cout << '\n';
 
-    while (reader.read() && !interrupt) {
-        if (reader.record->core.flag & (BAM_FSECONDARY | BAM_FSUPPLEMENTARY)) {
-            continue;
-        }
-
-        auto rg_value = reader.get_tag<std::string>("RG");
-        if (rg_value.length() == 0) {
-            spdlog::error("> Cannot generate sequencing summary for files with no RG tags");
-            return 1;
-        }
-        auto rg_split = rg_value.find("_");
-        auto run_id = rg_value.substr(0, rg_split);
-        auto model = rg_value.substr(rg_split + 1, rg_value.length());
-
-        auto filename = reader.get_tag<std::string>("f5");
-        if (filename.empty()) {
-            filename = reader.get_tag<std::string>("fn");
-        }
-        auto read_id = bam_get_qname(reader.record);
-        auto channel = reader.get_tag<int>("ch");
-        auto mux = reader.get_tag<int>("mx");
-
-        auto start_time_dt = reader.get_tag<std::string>("st");
-        auto duration = reader.get_tag<float>("du");
-
-        auto seqlen = reader.record->core.l_qseq;
-        auto mean_qscore = reader.get_tag<int>("qs");
-
-        auto num_samples = reader.get_tag<int>("ns");
-        auto trim_samples = reader.get_tag<int>("ts");
-
-        float sample_rate = num_samples / duration;
-        float template_duration = (num_samples - trim_samples) / sample_rate;
-        auto exp_start_dt = read_group_exp_start_time.at(rg_value);
-        auto start_time = time_difference_seconds(start_time_dt, exp_start_dt);
-        auto template_start_time = start_time + (duration - template_duration);
-
-        std::cout << filename << separator << read_id << separator << run_id << separator << channel
-                  << separator << mux << separator << start_time << separator << duration
-                  << separator << template_start_time << separator << template_duration << separator
-                  << seqlen << separator << mean_qscore;
-
-        if (reader.is_aligned) {
-            int32_t query_start = 0;
-            int32_t query_end = 0;
-            std::string alignment_genome = "*";
-            int32_t alignment_genome_start = -1;
-            int32_t alignment_genome_end = -1;
-            int32_t alignment_strand_start = -1;
-            int32_t alignment_strand_end = -1;
-            std::string alignment_direction = "*";
-            int32_t alignment_length = 0;
-            int32_t alignment_mapq = 0;
-            int alignment_num_aligned = 0;
-            int alignment_num_correct = 0;
-            int alignment_num_insertions = 0;
-            int alignment_num_deletions = 0;
-            int alignment_num_substitutions = 0;
-            float strand_coverage = 0.0;
-            float alignment_identity = 0.0;
-            float alignment_accurary = 0.0;
-
-            if (!(reader.record->core.flag & BAM_FUNMAP)) {
-                alignment_mapq = static_cast<int>(reader.record->core.qual);
-                alignment_genome = reader.header->target_name[reader.record->core.tid];
-
-                alignment_genome_start = reader.record->core.pos;
-                alignment_genome_end = bam_endpos(reader.record.get());
-                alignment_direction = bam_is_rev(reader.record) ? "-" : "+";
-
-                auto alignment_counts = utils::get_alignment_op_counts(reader.record.get());
-                alignment_num_aligned = alignment_counts.matches;
-                alignment_num_correct = alignment_counts.matches - alignment_counts.substitutions;
-                alignment_num_insertions = alignment_counts.insertions;
-                alignment_num_deletions = alignment_counts.deletions;
-                alignment_num_substitutions = alignment_counts.substitutions;
-                alignment_length = alignment_counts.matches + alignment_counts.insertions +
-                                   alignment_counts.deletions;
-                alignment_strand_start = alignment_counts.softclip_start;
-                alignment_strand_end = seqlen - alignment_counts.softclip_end;
-
-                strand_coverage = (alignment_strand_end - alignment_strand_start) /
-                                  static_cast<float>(seqlen);
-                alignment_identity =
-                        alignment_num_correct / static_cast<float>(alignment_counts.matches);
-                alignment_accurary = alignment_num_correct / static_cast<float>(alignment_length);
-            }
+    SummaryContext context{reader.header, reader.is_aligned, separator,
+                           std::move(read_group_exp_start_time), {}};
+    for (const auto &[read_group, exp_start_time] : context.exp_start_times) {
+        context.exp_start_times_us.emplace(read_group, parse_timestamp_us(exp_start_time));
+    }
 
-            std::cout << separator << alignment_genome << separator << alignment_genome_start
-                      << separator << alignment_genome_end << separator << alignment_strand_start
-                      << separator << alignment_strand_end << separator << alignment_direction
-                      << separator << alignment_length << separator << alignment_num_aligned
-                      << separator << alignment_num_correct << separator << alignment_num_insertions
-                      << separator << alignment_num_deletions << separator
-                      << alignment_num_substitutions << separator << alignment_mapq << separator
-                      << strand_coverage << separator << alignment_identity << separator
-                      << alignment_accurary;
-        }
+    // Records are read in chunks, each chunk's rows are formatted into one buffer on the
+    // executor, and the buffers are written out in the order they were read.
+    utils::TaskQueue formatters(utils::WorkStealingExecutor::instance(), threads);
+    std::deque<std::future<std::string>> chunks;
+    auto write_chunk = [&chunks] {
+        const auto text = chunks.front().get();
+        chunks.pop_front();
+        std::cout.write(text.data(), text.size());
+    };
 
-        std::cout << '\n';
+    try {
+        std::vector<BamPtr> records;
+        while (!interrupt && reader.read_batch(records, kRecordsPerChunk)) {
+            chunks.push_back(formatters.async([&context, records = std::move(records)] {
+                std::string text;
+                text.reserve(records.size() * 256);
+                for (const auto &record : records) {
+                    if (!(record->core.flag & (BAM_FSECONDARY | BAM_FSUPPLEMENTARY))) {
+                        append_row(text, record.get(), context);
+                    }
+                }
+                return text;
+            }));
+            records.clear();
+            // Enough chunks in hand to keep every thread busy, but no more.
+            while (chunks.size() > size_t(2 * threads)) {
+                write_chunk();
+            }
+        }
+        while (!chunks.empty()) {
+            write_chunk();
+        }
+    } catch (const std::exception &e) {
+        std::cout.flush();
+        spdlog::error("> {}", e.what());
+        return 1;
     }
-
+    std::cout.flush();
     return 0;
 }
 
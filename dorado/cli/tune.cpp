@@ -0,0 +1,436 @@
+#include "../data_loader/DataLoader.h"
+#include "../decode/CPUDecoder.h"
+#include "../nn/CRFModel.h"
+#include "../nn/ModelRunner.h"
+#include "../nn/RemoraModel.h"
+#include "../read_pipeline/BasecallerNode.h"
+#include "../read_pipeline/ModBaseCallerNode.h"
+#include "../read_pipeline/NullNode.h"
+#include "../read_pipeline/ReadFilterNode.h"
+#include "../read_pipeline/ReadToBamTypeNode.h"
+#include "../read_pipeline/ScalerNode.h"
+#include "../utils/host_profile.h"
+#include "../utils/models.h"
+#include "../utils/parameters.h"
+#include "../utils/read_utils.h"
+#include "Version.h"
+#if DORADO_GPU_BUILD
+#ifdef __APPLE__
+#include "../nn/MetalCRFModel.h"
+#else
+#include "../nn/CudaCRFModel.h"
+#include "../utils/cuda_utils.h"
+#endif
+#endif  // DORADO_GPU_BUILD
+
+#include <argparse.hpp>
+#include <spdlog/spdlog.h>
+#include <torch/torch.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace dorado {
+
+namespace {
+
+// A setting is only taken in place of the best so far if it's this much faster, so that the
+// noise between passes doesn't pick settings at random.
+constexpr double kMinSpeedup = 1.02;
+
+// Keeps the reads the DataLoader loads, which all fit in its queue, for every pass to call.
+class SampleSink : public MessageSink {
+public:
+    explicit SampleSink(size_t max_reads) : MessageSink(max_reads) {}
+    uint32_t read_fields_used() const override { return 0; }
+
+    std::vector<std::shared_ptr<Read>> take_reads() {
+        terminate();
+        std::vector<std::shared_ptr<Read>> reads;
+        Message message;
+        while (m_work_queue.try_pop(message)) {
+            reads.push_back(std::get<std::shared_ptr<Read>>(std::move(message)));
+        }
+        return reads;
+    }
+};
+
+// One point of the search.  A batch size of 0 is picked by the runners, as the basecaller's is.
+struct TuneSettings {
+    int chunk_size;
+    int batch_size;
+    int num_runners;
+    int scaler_node_threads;
+    int read_converter_threads;
+    int remora_threads;
+
+    bool operator<(const TuneSettings& other) const {
+        return std::tie(chunk_size, batch_size, num_runners, scaler_node_threads,
+                        read_converter_threads, remora_threads) <
+               std::tie(other.chunk_size, other.batch_size, other.num_runners,
+                        other.scaler_node_threads, other.read_converter_threads,
+                        other.remora_threads);
+    }
+};
+
+struct PassResult {
+    double samples_per_second{0};
+    // The batch size the runners called with, which a batch size of 0 leaves to them.
+    int batch_size{0};
+};
+
+struct TuneInputs {
+    std::filesystem::path model_path;
+    std::vector<std::filesystem::path> remora_models;
+    std::string device;
+    int num_devices{1};
+    int overlap;
+    int read_filter_threads{1};
+    std::vector<std::shared_ptr<Read>> reads;
+    int64_t num_samples{0};
+};
+
+int count_devices(const std::string& device) {
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+    if (device != "cpu" && device != "metal") {
+        const auto num_devices = int(utils::parse_cuda_device_string(device).size());
+        if (num_devices == 0) {
+            throw std::runtime_error("CUDA device requested but no devices found.");
+        }
+        return num_devices;
+    }
+#endif
+    return 1;
+}
+
+// Runners for the model on the device, as the basecaller makes them.
+std::vector<Runner> create_runners(const TuneInputs& inputs, const TuneSettings& settings) {
+    std::vector<Runner> runners;
+    if (inputs.device == "cpu") {
+        // The models share the cores, however many runners are asked for.
+        const auto batch_size = settings.batch_size == 0 ? 128 : settings.batch_size;
+        for (unsigned int i = 0; i < std::thread::hardware_concurrency(); ++i) {
+            runners.push_back(std::make_shared<ModelRunner<CPUDecoder>>(
+                    inputs.model_path, inputs.device, settings.chunk_size, batch_size));
+        }
+    }
+#if DORADO_GPU_BUILD
+#ifdef __APPLE__
+    else if (inputs.device == "metal") {
+        auto caller = create_metal_caller(inputs.model_path, settings.chunk_size,
+                                          settings.batch_size);
+        for (int i = 0; i < settings.num_runners; ++i) {
+            runners.push_back(std::make_shared<MetalModelRunner>(caller));
+        }
+    }
+#else   // ifdef __APPLE__
+    else {
+        for (const auto& device_string : utils::parse_cuda_device_string(inputs.device)) {
+            auto caller = create_cuda_caller(inputs.model_path, settings.chunk_size,
+                                             settings.batch_size, device_string);
+            for (int i = 0; i < settings.num_runners; ++i) {
+                runners.push_back(std::make_shared<CudaModelRunner>(caller));
+            }
+        }
+    }
+#endif  // __APPLE__
+#endif  // DORADO_GPU_BUILD
+    if (runners.empty()) {
+        throw std::runtime_error("Unsupported device: " + inputs.device);
+    }
+    return runners;
+}
+
+// Calls copies of the sample reads through the scaler, basecaller, read filter, modbase caller
+// if there are models, and BAM conversion with settings, first a tenth of them to warm the
+// pipeline up, then all of them, timed.  Loading the models isn't timed, nor is writing, which
+// takes a small share of the threads.  Throws if any read fails to basecall, as when the
+// settings leave the device short of memory.
+PassResult run_pass(const TuneInputs& inputs, const TuneSettings& settings) {
+    const auto runners = create_runners(inputs, settings);
+    const auto model_stride = runners.front()->model_stride();
+    const auto overlap = (inputs.overlap / model_stride) * model_stride;
+
+    std::vector<std::shared_ptr<RemoraCaller>> remora_callers;
+    for (const auto& remora_model : inputs.remora_models) {
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+        if (inputs.device != "cpu") {
+            for (const auto& device_string : utils::parse_cuda_device_string(inputs.device)) {
+                remora_callers.push_back(std::make_shared<RemoraCaller>(
+                        remora_model, device_string, utils::default_parameters.remora_batchsize,
+                        model_stride));
+            }
+            continue;
+        }
+#endif
+        remora_callers.push_back(std::make_shared<RemoraCaller>(
+                remora_model, inputs.device, utils::default_parameters.remora_batchsize,
+                model_stride));
+    }
+
+    const auto model_name = std::filesystem::canonical(inputs.model_path).filename().string();
+    // Each call has a pipeline of its own, on the same runners, which is drained before it
+    // returns.  Every read is then through, however many records it made, or wherever it was
+    // dropped, so the end needn't count what comes out.
+    auto call_reads = [&](size_t num_reads) {
+        std::atomic<size_t> num_failed{0};
+        {
+            NullNode null_node;
+            ReadToBamType read_converter(null_node, false, utils::is_rna_model(inputs.model_path),
+                                         settings.read_converter_threads);
+            std::unique_ptr<ModBaseCallerNode> mod_base_caller_node;
+            MessageSink* read_filter_sink = &read_converter;
+            if (!remora_callers.empty()) {
+                mod_base_caller_node = std::make_unique<ModBaseCallerNode>(
+                        read_converter, remora_callers, settings.remora_threads,
+                        inputs.num_devices, model_stride,
+                        utils::default_parameters.remora_batchsize);
+                read_filter_sink = mod_base_caller_node.get();
+            }
+            // As the basecaller filters them, so that reads too short to be written aren't
+            // modbase called or converted.
+            ReadFilterNode read_filter_node(*read_filter_sink, 0,
+                                            utils::default_parameters.min_seqeuence_length,
+                                            inputs.read_filter_threads);
+            BasecallerNode basecaller_node(read_filter_node, runners, overlap,
+                                           utils::default_parameters.batch_latency_target,
+                                           model_name);
+            basecaller_node.set_on_read_dropped([&num_failed](const Read&) { ++num_failed; });
+            ScalerNode scaler_node(basecaller_node, settings.scaler_node_threads);
+
+            // The pipeline changes the reads it calls, so each pass calls copies of them.
+            for (size_t i = 0; i < num_reads; ++i) {
+                auto read = utils::copy_read_metadata(*inputs.reads[i]);
+                read->raw_data = inputs.reads[i]->raw_data.clone();
+                scaler_node.push_message(std::move(read));
+            }
+        }
+        if (num_failed > 0) {
+            throw std::runtime_error(std::to_string(num_failed.load()) + " of " +
+                                     std::to_string(num_reads) + " reads failed to basecall");
+        }
+    };
+    call_reads(std::max<size_t>(1, inputs.reads.size() / 10));
+
+    const auto start = std::chrono::steady_clock::now();
+    call_reads(inputs.reads.size());
+    const auto elapsed_s =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return {inputs.num_samples / elapsed_s, int(runners.front()->batch_size())};
+}
+
+std::vector<int> parse_int_list(const std::string& text) {
+    std::vector<int> values;
+    std::istringstream stream(text);
+    std::string value;
+    while (std::getline(stream, value, ',')) {
+        values.push_back(std::stoi(value));
+    }
+    return values;
+}
+
+// A default count of threads, with half and twice as many.
+std::vector<int> thread_candidates(int num_threads) {
+    return {std::max(1, num_threads / 2), num_threads, num_threads * 2};
+}
+
+}  // namespace
+
+int tune(int argc, char* argv[]) {
+    argparse::ArgumentParser parser("dorado", DORADO_VERSION, argparse::default_arguments::help);
+
+    parser.add_argument("model").help("the basecaller model to tune for.");
+
+    parser.add_argument("data").help(
+            "the data directory or file (POD5/FAST5 format) to sample reads from.");
+
+    parser.add_argument("-x", "--device")
+            .help("device string in format \"cuda:0,...,N\", \"cuda:all\", \"metal\", \"cpu\" "
+                  "etc..")
+            .default_value(utils::default_parameters.device);
+
+    parser.add_argument("-r", "--recursive")
+            .default_value(false)
+            .implicit_value(true)
+            .help("Recursively scan through directories to load FAST5 and POD5 files");
+
+    parser.add_argument("-n", "--num-reads")
+            .help("the number of reads to sample from the data, which each pass calls.")
+            .default_value(500)
+            .scan<'i', int>();
+
+    parser.add_argument("-o", "--overlap")
+            .default_value(utils::default_parameters.overlap)
+            .scan<'i', int>();
+
+    parser.add_argument("--modified-bases-models")
+            .help("a comma separated list of modified base models to tune with as well.")
+            .default_value(std::string(""));
+
+    parser.add_argument("--chunksizes")
+            .help("a comma separated list of the chunk sizes to try.")
+            .default_value(std::string("5000,10000,15000"));
+
+    parser.add_argument("--batchsizes")
+            .help("a comma separated list of the batch sizes to try, where 0 has the device "
+                  "pick one. By default the device's pick and half of it are tried.")
+            .default_value(std::string(""));
+
+    parser.add_argument("--runners")
+            .help("a comma separated list of the numbers of runners per device to try. Not "
+                  "tuned on the CPU, where the basecaller runs one per core.")
+            .default_value(std::string("1,2,3,4"));
+
+    parser.add_argument("--host-profile")
+            .help("the profile to write the fastest settings to, alongside those tuned for other "
+                  "devices and models. Defaults to $DORADO_HOST_PROFILE, or "
+                  "~/.dorado/host_profile.toml, which the basecaller and duplex read.")
+            .default_value(std::string(""));
+
+    parser.add_argument("-v", "--verbose").default_value(false).implicit_value(true);
+
+    try {
+        parser.parse_args(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        std::cerr << parser;
+        std::exit(1);
+    }
+
+    if (parser.get<bool>("--verbose")) {
+        spdlog::set_level(spdlog::level::debug);
+    }
+
+    try {
+        torch::set_num_threads(1);
+
+        TuneInputs inputs;
+        inputs.model_path = parser.get<std::string>("model");
+        std::istringstream remora_models{parser.get<std::string>("--modified-bases-models")};
+        std::string remora_model;
+        while (std::getline(remora_models, remora_model, ',')) {
+            inputs.remora_models.push_back(remora_model);
+        }
+        inputs.device = parser.get<std::string>("-x");
+        inputs.num_devices = count_devices(inputs.device);
+        inputs.overlap = parser.get<int>("-o");
+
+        const auto num_reads = static_cast<size_t>(std::max(1, parser.get<int>("--num-reads")));
+        {
+            SampleSink sample_sink(num_reads);
+            DataLoader loader(sample_sink, "cpu", std::max(1u, std::thread::hardware_concurrency()),
+                              num_reads);
+            loader.load_reads(parser.get<std::string>("data"), parser.get<bool>("--recursive"));
+            inputs.reads = sample_sink.take_reads();
+        }
+        if (inputs.reads.empty()) {
+            throw std::runtime_error("No reads found in " + parser.get<std::string>("data"));
+        }
+        for (const auto& read : inputs.reads) {
+            inputs.num_samples += read->raw_data.size(0);
+        }
+        spdlog::info("> Tuning on {} reads of {} samples", inputs.reads.size(),
+                     inputs.num_samples);
+
+        const bool modbase = !inputs.remora_models.empty();
+        const auto default_threads = utils::default_thread_allocations(
+                inputs.num_devices, modbase ? utils::default_parameters.remora_threads : 0);
+        inputs.read_filter_threads = std::max(1, default_threads.read_filter_threads);
+        TuneSettings best{utils::default_parameters.chunksize,
+                          0,
+                          utils::default_parameters.num_runners,
+                          default_threads.scaler_node_threads,
+                          default_threads.read_converter_threads,
+                          default_threads.remora_threads};
+
+        // Passes are run once per settings, and ones which fail, e.g. for want of device
+        // memory, are reported and scored 0.
+        std::map<TuneSettings, PassResult> results;
+        auto measure = [&](const TuneSettings& settings) {
+            auto result = results.find(settings);
+            if (result != results.end()) {
+                return result->second;
+            }
+            PassResult pass;
+            try {
+                pass = run_pass(inputs, settings);
+            } catch (const std::exception& e) {
+                spdlog::warn("Pass failed: {}", e.what());
+            }
+            spdlog::info(
+                    "> chunk size {}, batch size {}, runners {}, scaler threads {}, converter "
+                    "threads {}, modbase threads {}: {:.4g} samples/s",
+                    settings.chunk_size, pass.batch_size, settings.num_runners,
+                    settings.scaler_node_threads, settings.read_converter_threads,
+                    settings.remora_threads, pass.samples_per_second);
+            return results[settings] = pass;
+        };
+
+        // Each setting is swept in turn, with the others at their best so far.  The settings
+        // interact, but the device ones most, so they're tuned first, and the thread counts of
+        // the nodes feeding and draining the device after.
+        auto best_result = measure(best);
+        auto sweep = [&](int TuneSettings::*setting, const std::vector<int>& candidates) {
+            for (const int value : candidates) {
+                auto settings = best;
+                settings.*setting = value;
+                const auto result = measure(settings);
+                if (result.samples_per_second > best_result.samples_per_second * kMinSpeedup) {
+                    best = settings;
+                    best_result = result;
+                }
+            }
+        };
+        sweep(&TuneSettings::chunk_size, parse_int_list(parser.get<std::string>("--chunksizes")));
+        auto batch_sizes = parse_int_list(parser.get<std::string>("--batchsizes"));
+        if (batch_sizes.empty() && best_result.batch_size > 1) {
+            batch_sizes = {best_result.batch_size / 2};
+        }
+        sweep(&TuneSettings::batch_size, batch_sizes);
+        if (inputs.device != "cpu") {
+            sweep(&TuneSettings::num_runners, parse_int_list(parser.get<std::string>("--runners")));
+        }
+        sweep(&TuneSettings::scaler_node_threads, thread_candidates(best.scaler_node_threads));
+        sweep(&TuneSettings::read_converter_threads,
+              thread_candidates(best.read_converter_threads));
+        if (modbase) {
+            sweep(&TuneSettings::remora_threads, thread_candidates(best.remora_threads));
+        }
+        if (best_result.samples_per_second == 0) {
+            throw std::runtime_error("Every pass failed, so there are no settings to keep");
+        }
+
+        utils::HostProfile profile;
+        profile.chunk_size = best.chunk_size;
+        profile.batch_size = best.batch_size;
+        profile.num_runners = inputs.device == "cpu" ? 0 : best.num_runners;
+        profile.scaler_node_threads = best.scaler_node_threads;
+        profile.read_converter_threads = best.read_converter_threads;
+        profile.remora_threads = modbase ? best.remora_threads : 0;
+        profile.samples_per_second = best_result.samples_per_second;
+
+        std::filesystem::path profile_path = parser.get<std::string>("--host-profile");
+        if (profile_path.empty()) {
+            profile_path = utils::default_host_profile_path();
+        }
+        utils::save_host_profile(profile_path, inputs.device, inputs.model_path, profile);
+        spdlog::info("> Wrote the settings for {:.4g} samples/s to {}",
+                     best_result.samples_per_second, profile_path.string());
+    } catch (const std::exception& e) {
+        spdlog::error("{}", e.what());
+        return 1;
+    }
+    return 0;
+}
+
+}  // namespace dorado
@@ -0,0 +1,141 @@
+#include "Version.h"
+#include "decode/CPUDecoder.h"
+#include "nn/ModelRunner.h"
+#include "nn/RemoteModelRunner.h"
+#if DORADO_GPU_BUILD
+#ifdef __APPLE__
+#include "nn/MetalCRFModel.h"
+#else
+#include "nn/CudaCRFModel.h"
+#include "utils/cuda_utils.h"
+#endif
+#endif  // DORADO_GPU_BUILD
+#include "utils/log_utils.h"
+#include "utils/parameters.h"
+#include "utils/socket_utils.h"
+
+#include <argparse.hpp>
+#include <spdlog/spdlog.h>
+#include <torch/torch.h>
+
+#include <atomic>
+#include <csignal>
+#include <filesystem>
+#include <sstream>
+
+namespace dorado {
+
+using dorado::utils::default_parameters;
+
+int worker(int argc, char* argv[]) {
+    utils::InitLogging();
+
+    argparse::ArgumentParser parser("dorado", DORADO_VERSION, argparse::default_arguments::help);
+
+    parser.add_argument("model").help("the basecaller model to run.");
+
+    parser.add_argument("-v", "--verbose").default_value(false).implicit_value(true);
+
+    parser.add_argument("-x", "--device")
+            .help("device string in format \"cuda:0,...,N\", \"cuda:all\", \"metal\", \"cpu\" "
+                  "etc..")
+            .default_value(default_parameters.device);
+
+    parser.add_argument("-b", "--batchsize")
+            .default_value(default_parameters.batchsize)
+            .scan<'i', int>()
+            .help("if 0 an optimal batchsize will be selected");
+
+    parser.add_argument("-c", "--chunksize")
+            .default_value(default_parameters.chunksize)
+            .scan<'i', int>()
+            .help("must match the chunk size of any local runners of the basecaller.");
+
+    parser.add_argument("-r", "--runners")
+            .default_value(default_parameters.num_runners)
+            .scan<'i', int>()
+            .help("runners served for each device, each to one connection at a time.");
+
+    parser.add_argument("--port")
+            .help("TCP port to serve the runners on, for basecaller --remote-runners.")
+            .required()
+            .scan<'i', int>();
+
+    try {
+        parser.parse_args(argc, argv);
+    } catch (const std::exception& e) {
+        std::ostringstream parser_stream;
+        parser_stream << parser;
+        spdlog::error("{}\n{}", e.what(), parser_stream.str());
+        std::exit(1);
+    }
+
+    if (parser.get<bool>("--verbose")) {
+        spdlog::set_level(spdlog::level::debug);
+    }
+
+    const std::filesystem::path model_path(parser.get<std::string>("model"));
+    const auto device = parser.get<std::string>("-x");
+    int batch_size = parser.get<int>("-b");
+    const int chunk_size = parser.get<int>("-c");
+    const int num_runners = parser.get<int>("-r");
+    const int port = parser.get<int>("--port");
+    if (num_runners <= 0 || port <= 0 || port > 65535) {
+        spdlog::error("--runners must be positive, and --port a valid port.");
+        return 1;
+    }
+
+    try {
+        torch::set_num_threads(1);
+
+        std::vector<Runner> runners;
+        if (device == "cpu") {
+            if (batch_size == 0) {
+                batch_size = 128;
+            }
+            for (int i = 0; i < num_runners; ++i) {
+                runners.push_back(std::make_shared<ModelRunner<CPUDecoder>>(
+                        model_path, device, chunk_size, batch_size));
+            }
+        }
+#if DORADO_GPU_BUILD
+#ifdef __APPLE__
+        else if (device == "metal") {
+            auto caller = create_metal_caller(model_path, chunk_size, batch_size);
+            for (int i = 0; i < num_runners; ++i) {
+                runners.push_back(std::make_shared<MetalModelRunner>(caller));
+            }
+        }
+#else   // ifdef __APPLE__
+        else {
+            for (const auto& device_string : utils::parse_cuda_device_string(device)) {
+                auto caller = create_cuda_caller(model_path, chunk_size, batch_size, device_string);
+                for (int i = 0; i < num_runners; ++i) {
+                    runners.push_back(std::make_shared<CudaModelRunner>(caller));
+                }
+            }
+        }
+#endif  // __APPLE__
+#endif  // DORADO_GPU_BUILD
+        if (runners.empty()) {
+            throw std::runtime_error("Unsupported device: " + device);
+        }
+
+#ifndef _WIN32
+        // A coordinator which goes away mid-call mustn't take the worker down with it.
+        std::signal(SIGPIPE, SIG_IGN);
+#endif
+        utils::TcpSocketServer server(static_cast<uint16_t>(port));
+        spdlog::info("> Serving {} runners of batch size {} on port {}", runners.size(),
+                     runners.front()->batch_size(), server.port());
+        // Runs until the process is stopped.
+        const std::atomic<bool> stop{false};
+        serve_remote_runners(server, runners, stop);
+    } catch (const std::exception& e) {
+        spdlog::error("{}", e.what());
+        return 1;
+    }
+    return 0;
+}
+
+}  // namespace dorado
@@ -2,9 +2,16 @@
 
 #include "../utils/compat_utils.h"
 #include "../utils/types.h"
-#include "cxxpool.h"
+#include "DatasetIndex.h"
+#include "DirectoryWatcher.h"
 #include "pod5_format/c_api.h"
 #include "read_pipeline/ReadPipeline.h"
+#include "utils/AsyncQueue.h"
+#include "utils/FileReadahead.h"
+#include "utils/SignalCache.h"
+#include "utils/TensorPool.h"
+#include "utils/WorkStealingExecutor.h"
+#include "utils/log_utils.h"
 #include "utils/time_utils.h"
 #include "vbz_plugin_user_utils.h"
 
@@ -12,11 +19,20 @@
 #include <highfive/H5File.hpp>
 #include <spdlog/spdlog.h>
 
+#include <atomic>
 #include <cctype>
+#include <condition_variable>
 #include <ctime>
+#include <exception>
 #include <filesystem>
+#include <memory>
 #include <mutex>
 #include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <unordered_set>
 
 namespace {
 
@@ -54,22 +70,40 @@ void string_reader(HighFive::Attribute& attribute, std::string& target_str) {
 
 namespace dorado {
 
+namespace {
+
+// The most reads loaded at once when loading by channel, beyond which a window of channels
+// stops growing.  Windows are whole channels, so may go over it.
+constexpr size_t kMaxChannelWindowReads = 1000;
+
+// A POD5 record batch whose reads are being decoded in the background.
+struct PendingPod5Batch {
+    Pod5ReadRecordBatch_t* batch{nullptr};
+    // Size of the raw signal of the reads being decoded.
+    size_t signal_bytes{0};
+    std::vector<std::future<std::shared_ptr<Read>>> reads;
+};
+
+}  // namespace
+
 std::shared_ptr<dorado::Read> process_pod5_read(size_t row,
                                                 Pod5ReadRecordBatch* batch,
                                                 Pod5FileReader* file,
-                                                const std::string path,
-                                                std::string device) {
+                                                const utils::InternedString& filename,
+                                                std::string device,
+                                                const dorado::utils::SignalCache* signal_cache) {
     uint16_t read_table_version = 0;
     ReadBatchRowInfo_t read_data;
     if (pod5_get_read_batch_row_info_data(batch, row, READ_BATCH_ROW_INFO_VERSION, &read_data,
                                           &read_table_version) != POD5_OK) {
-        spdlog::error("Failed to get read {}", row);
+        DORADO_LOG_RATE_LIMITED(spdlog::level::err, "Failed to get read {}", row);
     }
 
     //Retrieve global information for the run
     RunInfoDictData_t* run_info_data;
     if (pod5_get_run_info(batch, read_data.run_info, &run_info_data) != POD5_OK) {
-        spdlog::error("Failed to get Run Info {}{}", row, pod5_get_error_string());
+        DORADO_LOG_RATE_LIMITED(spdlog::level::err, "Failed to get Run Info {}{}", row,
+                                pod5_get_error_string());
     }
     auto run_acquisition_start_time_ms = run_info_data->acquisition_start_time_ms;
     auto run_sample_rate = run_info_data->sample_rate;
@@ -78,15 +112,25 @@ std::shared_ptr<dorado::Read> process_pod5_read(size_t row,
     pod5_error_t err = pod5_format_read_id(read_data.read_id, read_id_tmp);
     std::string read_id_str(read_id_tmp);
 
-    auto options = torch::TensorOptions().dtype(torch::kInt16);
-    auto samples = torch::empty(read_data.num_samples, options);
-
-    if (pod5_get_read_complete_signal(file, batch, row, read_data.num_samples,
-                                      samples.data_ptr<int16_t>()) != POD5_OK) {
-        spdlog::error("Failed to get read {} signal: {}", row, pod5_get_error_string());
+    auto new_read = std::make_shared<dorado::Read>();
+    // Reads normalised by an earlier run come from the signal cache, which saves decompressing
+    // and normalising them again.
+    torch::Tensor samples;
+    utils::SignalScaling cached_scaling;
+    if (signal_cache && signal_cache->load(read_id_str, samples, cached_scaling) &&
+        samples.numel() == int64_t(read_data.num_samples)) {
+        new_read->cached_scaling = cached_scaling;
+    } else {
+        // The signal is decompressed straight into pooled storage, which becomes the read's
+        // raw_data.  The storage is recycled once the read is done with.
+        samples = utils::TensorPool::instance().empty(read_data.num_samples, torch::kInt16);
+        if (pod5_get_read_complete_signal(file, batch, row, read_data.num_samples,
+                                          samples.data_ptr<int16_t>()) != POD5_OK) {
+            DORADO_LOG_RATE_LIMITED(spdlog::level::err, "Failed to get read {} signal: {}", row,
+                                    pod5_get_error_string());
+        }
     }
 
-    auto new_read = std::make_shared<dorado::Read>();
     new_read->raw_data = samples;
     new_read->sample_rate = run_sample_rate;
 
@@ -101,7 +145,7 @@ std::shared_ptr<dorado::Read> process_pod5_read(size_t row,
     new_read->read_id = std::move(read_id_str);
     new_read->num_trimmed_samples = 0;
     new_read->attributes.read_number = read_data.read_number;
-    new_read->attributes.fast5_filename = std::filesystem::path(path.c_str()).filename().string();
+    new_read->attributes.fast5_filename = filename;
     new_read->attributes.mux = read_data.well;
     new_read->attributes.num_samples = read_data.num_samples;
     new_read->attributes.channel_number = read_data.channel;
@@ -113,13 +157,161 @@ std::shared_ptr<dorado::Read> process_pod5_read(size_t row,
     new_read->is_duplex = false;
 
     if (pod5_free_run_info(run_info_data) != POD5_OK) {
-        spdlog::error("Failed to free run info");
+        DORADO_LOG_RATE_LIMITED(spdlog::level::err, "Failed to free run info");
     }
     return new_read;
 }
 
+namespace {
+
+// HDF5 isn't thread safe unless built to be, and even then serialises its calls, so every
+// HDF5 call made while loading FAST5 files holds this.
+std::mutex& hdf5_mutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+
+// Reads the read in group read of a multi-read FAST5 file.  The caller holds hdf5_mutex().
+std::shared_ptr<dorado::Read> process_fast5_read(HighFive::Group read,
+                                                 const utils::InternedString& fast5_filename) {
+    // Fetch the digitisation parameters
+    HighFive::Group channel_id_group = read.getGroup("channel_id");
+    HighFive::Attribute digitisation_attr = channel_id_group.getAttribute("digitisation");
+    HighFive::Attribute range_attr = channel_id_group.getAttribute("range");
+    HighFive::Attribute offset_attr = channel_id_group.getAttribute("offset");
+    HighFive::Attribute sampling_rate_attr = channel_id_group.getAttribute("sampling_rate");
+    HighFive::Attribute channel_number_attr = channel_id_group.getAttribute("channel_number");
+
+    int32_t channel_number;
+    if (channel_number_attr.getDataType().string().substr(0, 6) == "String") {
+        std::string channel_number_string;
+        string_reader(channel_number_attr, channel_number_string);
+        std::istringstream channel_stream(channel_number_string);
+        channel_stream >> channel_number;
+    } else {
+        channel_number_attr.read(channel_number);
+    }
+
+    float digitisation;
+    digitisation_attr.read(digitisation);
+    float range;
+    range_attr.read(range);
+    float offset;
+    offset_attr.read(offset);
+    float sampling_rate;
+    sampling_rate_attr.read(sampling_rate);
+
+    HighFive::Group raw = read.getGroup("Raw");
+    // Signal is read once, whole, so caching its chunks would only cost a copy, and memory
+    // which is never reused.
+    const hid_t access_props = H5Pcreate(H5P_DATASET_ACCESS);
+    H5Pset_chunk_cache(access_props, H5D_CHUNK_CACHE_NSLOTS_DEFAULT, 0,
+                       H5D_CHUNK_CACHE_W0_DEFAULT);
+    const hid_t dataset = H5Dopen2(raw.getId(), "Signal", access_props);
+    H5Pclose(access_props);
+    if (dataset < 0) {
+        throw std::runtime_error("Unable to open FAST5 Signal in " + fast5_filename.str());
+    }
+    const hid_t type = H5Dget_type(dataset);
+    const bool is_int16 = H5Tget_class(type) == H5T_INTEGER && H5Tget_size(type) == 2;
+    H5Tclose(type);
+    const hid_t space = H5Dget_space(dataset);
+    const auto num_samples = H5Sget_simple_extent_npoints(space);
+    H5Sclose(space);
+    // Pooled, like POD5 signal.
+    auto samples = is_int16 ? utils::TensorPool::instance().empty(num_samples, torch::kInt16)
+                            : torch::Tensor();
+    const bool read_ok = is_int16 && H5Dread(dataset, H5T_NATIVE_INT16, H5S_ALL, H5S_ALL,
+                                             H5P_DEFAULT, samples.data_ptr()) >= 0;
+    H5Dclose(dataset);
+    if (!is_int16) {
+        throw std::runtime_error("Invalid FAST5 Signal data type in " + fast5_filename.str());
+    }
+    if (!read_ok) {
+        throw std::runtime_error("Unable to read FAST5 Signal in " + fast5_filename.str());
+    }
+
+    HighFive::Attribute mux_attr = raw.getAttribute("start_mux");
+    HighFive::Attribute read_number_attr = raw.getAttribute("read_number");
+    HighFive::Attribute start_time_attr = raw.getAttribute("start_time");
+    HighFive::Attribute read_id_attr = raw.getAttribute("read_id");
+    uint32_t mux;
+    uint32_t read_number;
+    uint64_t start_time;
+    std::string read_id;
+    mux_attr.read(mux);
+    read_number_attr.read(read_number);
+    start_time_attr.read(start_time);
+    string_reader(read_id_attr, read_id);
+
+    HighFive::Group tracking_id_group = read.getGroup("tracking_id");
+    HighFive::Attribute exp_start_time_attr = tracking_id_group.getAttribute("exp_start_time");
+    std::string exp_start_time;
+    string_reader(exp_start_time_attr, exp_start_time);
+
+    auto start_time_str = utils::adjust_time(exp_start_time,
+                                             static_cast<uint32_t>(start_time / sampling_rate));
+
+    auto new_read = std::make_shared<dorado::Read>();
+    new_read->sample_rate = sampling_rate;
+    new_read->raw_data = samples;
+    new_read->digitisation = digitisation;
+    new_read->range = range;
+    new_read->offset = offset;
+    new_read->scaling = range / digitisation;
+    new_read->read_id = read_id;
+    new_read->num_trimmed_samples = 0;
+    new_read->attributes.mux = mux;
+    new_read->attributes.read_number = read_number;
+    new_read->attributes.channel_number = channel_number;
+    new_read->attributes.start_time = start_time_str;
+    new_read->attributes.fast5_filename = fast5_filename;
+    new_read->is_duplex = false;
+    return new_read;
+}
+
+}  // namespace
+
 void Pod5Destructor::operator()(Pod5FileReader_t* pod5) { pod5_close_and_free_reader(pod5); }
 
+bool DatasetShard::contains(const std::string& relative_path) const {
+    if (count <= 1) {
+        return true;
+    }
+    // FNV-1a, which unlike std::hash is the same on every platform and build.
+    uint64_t hash = 0xcbf29ce484222325;
+    for (const unsigned char c : relative_path) {
+        hash = (hash ^ c) * 0x100000001b3;
+    }
+    return hash % count == index;
+}
+
+DatasetShard parse_dataset_shard(const std::string& text) {
+    DatasetShard shard;
+    const auto slash = text.find('/');
+    try {
+        if (slash == std::string::npos) {
+            throw std::invalid_argument(text);
+        }
+        size_t index_length = 0, count_length = 0;
+        shard.index = std::stoul(text.substr(0, slash), &index_length);
+        shard.count = std::stoul(text.substr(slash + 1), &count_length);
+        if (index_length != slash || slash + 1 + count_length != text.size()) {
+            throw std::invalid_argument(text);
+        }
+    } catch (const std::logic_error&) {
+        throw std::runtime_error("Invalid shard " + text + ", expected i/N.");
+    }
+    if (shard.count == 0 || shard.index >= shard.count) {
+        throw std::runtime_error("Invalid shard " + text + ", i must be less than N.");
+    }
+    return shard;
+}
+
+bool DataLoader::in_shard(const std::string& data_path, const std::filesystem::path& file) const {
+    return m_shard.contains(file.lexically_relative(data_path).generic_string());
+}
+
 void DataLoader::load_reads(const std::string& path,
                             bool recursive_file_loading,
                             ReadOrder traversal_order) {
@@ -137,55 +329,20 @@ void DataLoader::load_reads(const std::string& path,
     auto iterate_directory = [&](const auto& iterator_fn) {
         switch (traversal_order) {
         case BY_CHANNEL:
-            // If traversal in channel order is required, the following algorithm
-            // is used -
-            // 1. iterate through all the read metadata to collect channel information
-            // across all pod5 files
-            // 2. store the read list sorted by channel number
-            spdlog::info("> Reading read channel info");
-            load_read_channels(path, recursive_file_loading);
-            spdlog::info("> Processed read channel info");
-            // 3. for each channel, iterate through all files and in each iteration
-            // only load the reads that correspond to that channel.
-            for (int channel = 0; channel <= m_max_channel; channel++) {
-                for (const auto& entry : iterator_fn(path)) {
-                    if (m_loaded_read_count == m_max_reads) {
-                        break;
-                    }
-                    auto path = std::filesystem::path(entry);
-                    std::string ext = path.extension().string();
-                    std::transform(ext.begin(), ext.end(), ext.begin(),
-                                   [](unsigned char c) { return std::tolower(c); });
-                    if (ext == ".fast5") {
-                        throw std::runtime_error(
-                                "Traversing reads by channel is only availabls for POD5. "
-                                "Encountered FAST5 at " +
-                                path.string());
-                    } else if (ext == ".pod5") {
-                        auto& channel_to_read_ids = m_file_channel_read_order_map.at(path.string());
-                        auto& read_ids = channel_to_read_ids[channel];
-                        if (!read_ids.empty()) {
-                            load_pod5_reads_from_file_by_read_ids(path.string(), read_ids);
-                        }
-                    }
-                }
-            }
+            load_reads_by_channel(path, recursive_file_loading);
             break;
-        case UNRESTRICTED:
+        case UNRESTRICTED: {
+            std::vector<std::string> files;
             for (const auto& entry : iterator_fn(path)) {
-                if (m_loaded_read_count == m_max_reads) {
-                    break;
-                }
                 std::string ext = std::filesystem::path(entry).extension().string();
                 std::transform(ext.begin(), ext.end(), ext.begin(),
                                [](unsigned char c) { return std::tolower(c); });
-                if (ext == ".fast5") {
-                    load_fast5_reads_from_file(entry.path().string());
-                } else if (ext == ".pod5") {
-                    load_pod5_reads_from_file(entry.path().string());
+                if ((ext == ".fast5" || ext == ".pod5") && in_shard(path, entry.path())) {
+                    files.push_back(entry.path().string());
                 }
             }
-            break;
+            load_files(files);
+        } break;
         default:
             throw std::runtime_error("Unsupported traversal order detected " +
                                      std::to_string(traversal_order));
@@ -204,282 +361,367 @@ void DataLoader::load_reads(const std::string& path,
     m_read_sink.terminate();
 }
 
-int DataLoader::get_num_reads(std::string data_path,
-                              std::optional<std::unordered_set<std::string>> read_list,
-                              bool recursive_file_loading) {
-    size_t num_reads = 0;
+namespace {
 
-    auto iterate_directory = [&](const auto& iterator_fn) {
-        for (const auto& entry : iterator_fn(data_path)) {
-            std::string ext = std::filesystem::path(entry).extension().string();
-            std::transform(ext.begin(), ext.end(), ext.begin(),
-                           [](unsigned char c) { return std::tolower(c); });
-            if (ext == ".pod5") {
-                pod5_init();
-
-                // Open the file ready for walking:
-                Pod5FileReader_t* file = pod5_open_file(entry.path().string().c_str());
-
-                size_t read_count;
-                pod5_get_read_count(file, &read_count);
-                if (!file) {
-                    spdlog::error("Failed to open file {}: {}", entry.path().string().c_str(),
-                                  pod5_get_error_string());
-                }
+bool is_read_file(const std::filesystem::path& path) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return ext == ".pod5" || ext == ".fast5";
+}
 
-                num_reads += read_count;
-                if (pod5_close_and_free_reader(file) != POD5_OK) {
-                    spdlog::error("Failed to close and free POD5 reader");
-                }
+// How long a file already in a watched directory must be unmodified for before it's taken to be
+// finished, rather than waited on until it's closed.
+constexpr std::chrono::seconds kWatchSettleTime{5};
+
+template <typename Fn>
+void for_each_read_file(const std::string& path, bool recursive_file_loading, Fn&& fn) {
+    auto iterate_directory = [&](auto&& iterator) {
+        for (const auto& entry : iterator) {
+            if (is_read_file(entry.path())) {
+                fn(entry.path());
             }
         }
     };
-
     if (recursive_file_loading) {
-        iterate_directory([](const auto& path) {
-            return std::filesystem::recursive_directory_iterator(path);
-        });
+        iterate_directory(std::filesystem::recursive_directory_iterator(path));
     } else {
-        iterate_directory(
-                [](const auto& path) { return std::filesystem::directory_iterator(path); });
+        iterate_directory(std::filesystem::directory_iterator(path));
     }
+}
 
-    if (read_list) {
-        num_reads = std::min(num_reads, read_list->size());
-    }
+}  // namespace
 
-    return num_reads;
-}
+void DataLoader::watch_reads(const std::string& path,
+                             bool recursive_file_loading,
+                             std::chrono::seconds idle_timeout,
+                             const std::string& sentinel_file_name) {
+    if (!std::filesystem::is_directory(path)) {
+        spdlog::error("Requested input path {} is not a directory!", path);
+        m_read_sink.terminate();
+        return;
+    }
 
-void DataLoader::load_read_channels(std::string data_path, bool recursive_file_loading) {
-    auto iterate_directory = [&](const auto& iterator_fn) {
-        for (const auto& entry : iterator_fn(data_path)) {
-            auto file_path = std::filesystem::path(entry);
-            std::string ext = file_path.extension().string();
-            std::transform(ext.begin(), ext.end(), ext.begin(),
-                           [](unsigned char c) { return std::tolower(c); });
-            if (ext != ".pod5") {
-                continue;
-            }
-            pod5_init();
+    // Start watching before listing, so files written in between aren't missed.
+    DirectoryWatcher watcher(path, recursive_file_loading);
+    std::unordered_set<std::string> loaded_files;
 
-            // Use a std::map to store by sorted channel order.
-            m_file_channel_read_order_map.emplace(file_path.string(), channel_to_read_id_t());
-            auto& channel_to_read_id = m_file_channel_read_order_map[file_path.string()];
+    // Files still being written are held back by the watcher, and reported when they're done.
+    std::vector<std::string> existing_files;
+    for (const auto& file : watcher.existing_files(kWatchSettleTime)) {
+        if (!is_read_file(file)) {
+            continue;
+        }
+        if (in_shard(path, file)) {
+            existing_files.push_back(file.string());
+        }
+        loaded_files.insert(file.string());
+    }
+    load_files(existing_files);
 
-            // Open the file ready for walking:
-            Pod5FileReader_t* file = pod5_open_file(file_path.string().c_str());
+    const auto sentinel_path = std::filesystem::path(path) / sentinel_file_name;
+    auto sentinel_exists = [&] {
+        return !sentinel_file_name.empty() && std::filesystem::exists(sentinel_path);
+    };
 
-            if (!file) {
-                spdlog::error("Failed to open file {}: {}", file_path.string().c_str(),
-                              pod5_get_error_string());
-                continue;
-            }
-            std::size_t batch_count = 0;
-            if (pod5_get_read_batch_count(&batch_count, file) != POD5_OK) {
-                spdlog::error("Failed to query batch count: {}", pod5_get_error_string());
+    spdlog::info("> Watching {} for new files", path);
+    auto last_file_time = std::chrono::steady_clock::now();
+    while (m_num_reserved_reads < m_max_reads && !sentinel_exists()) {
+        // Wake regularly to check for the sentinel, e.g. if it was created elsewhere
+        // and moved in.
+        auto file = watcher.next_file(std::chrono::seconds(1));
+        if (file) {
+            if (is_read_file(*file) && !loaded_files.insert(file->string()).second) {
+                spdlog::warn("> {} was written again after it was loaded, ignoring the changes",
+                             file->string());
+            } else if (is_read_file(*file) && in_shard(path, *file)) {
+                spdlog::debug("> Loading {}", file->string());
+                load_files({file->string()});
             }
+            last_file_time = std::chrono::steady_clock::now();
+        } else if (idle_timeout.count() > 0 &&
+                   std::chrono::steady_clock::now() - last_file_time >= idle_timeout) {
+            spdlog::info("> No new files for {}s, stopping", idle_timeout.count());
+            break;
+        }
+    }
+    if (sentinel_exists()) {
+        spdlog::info("> Found {}, stopping", sentinel_path.string());
+    }
 
-            for (std::size_t batch_index = 0; batch_index < batch_count; ++batch_index) {
-                Pod5ReadRecordBatch_t* batch = nullptr;
-                if (pod5_get_read_batch(&batch, file, batch_index) != POD5_OK) {
-                    spdlog::error("Failed to get batch: {}", pod5_get_error_string());
-                    continue;
-                }
+    m_read_sink.terminate();
+}
 
-                std::size_t batch_row_count = 0;
-                if (pod5_get_read_batch_row_count(&batch_row_count, batch) != POD5_OK) {
-                    spdlog::error("Failed to get batch row count");
-                    continue;
-                }
+bool DataLoader::wait_for_input_files(const std::string& path,
+                                      bool recursive_file_loading,
+                                      std::chrono::seconds timeout) {
+    DirectoryWatcher watcher(path, recursive_file_loading);
+    bool found = false;
+    for_each_read_file(path, recursive_file_loading,
+                       [&](const std::filesystem::path&) { found = true; });
+    if (found) {
+        return true;
+    }
 
-                for (std::size_t row = 0; row < batch_row_count; ++row) {
-                    uint16_t read_table_version = 0;
-                    ReadBatchRowInfo_t read_data;
-                    if (pod5_get_read_batch_row_info_data(batch, row, READ_BATCH_ROW_INFO_VERSION,
-                                                          &read_data,
-                                                          &read_table_version) != POD5_OK) {
-                        spdlog::error("Failed to get read {}", row);
-                        continue;
-                    }
+    spdlog::info("> Waiting for input files in {}", path);
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (timeout.count() == 0 || std::chrono::steady_clock::now() < deadline) {
+        auto file = watcher.next_file(std::chrono::seconds(1));
+        if (file && is_read_file(*file)) {
+            return true;
+        }
+    }
+    return false;
+}
 
-                    int channel = read_data.channel;
+int DataLoader::get_num_reads(std::string data_path,
+                              const std::optional<utils::ReadIdSet>& read_list,
+                              bool recursive_file_loading,
+                              const DatasetShard& shard) {
+    size_t num_reads = 0;
+    const auto index = DatasetIndex::get(data_path, recursive_file_loading, shard);
+    for (const auto& file : index->files()) {
+        if (file.format == IndexedFile::Format::POD5) {
+            num_reads += file.num_reads;
+        }
+    }
 
-                    // Update maximum number of channels encountered.
-                    m_max_channel = std::max(m_max_channel, channel);
+    if (read_list) {
+        num_reads = std::min(num_reads, read_list->size());
+    }
 
-                    // Store the read_id in the channel's list.
-                    ReadID read_id;
-                    std::memcpy(read_id.data(), read_data.read_id, POD5_READ_ID_SIZE);
-                    channel_to_read_id[channel].push_back(std::move(read_id));
-                }
+    return num_reads;
+}
 
-                if (pod5_free_read_batch(batch) != POD5_OK) {
-                    spdlog::error("Failed to release batch");
+std::vector<uint64_t> DataLoader::sample_read_lengths(std::string data_path,
+                                                      size_t max_reads,
+                                                      bool recursive_file_loading,
+                                                      const DatasetShard& shard) {
+    std::vector<uint64_t> lengths;
+    const auto index = DatasetIndex::get(data_path, recursive_file_loading, shard);
+    pod5_init();
+    for (const auto& file : index->files()) {
+        if (lengths.size() >= max_reads) {
+            break;
+        }
+        if (file.format != IndexedFile::Format::POD5) {
+            continue;
+        }
+        Pod5FileReader_t* reader = pod5_open_file(file.path.string().c_str());
+        if (!reader) {
+            spdlog::error("Failed to open file {}: {}", file.path.string(),
+                          pod5_get_error_string());
+            continue;
+        }
+        std::size_t batch_count = 0;
+        if (pod5_get_read_batch_count(&batch_count, reader) != POD5_OK) {
+            spdlog::error("Failed to query batch count: {}", pod5_get_error_string());
+        }
+        for (std::size_t batch_index = 0; batch_index < batch_count && lengths.size() < max_reads;
+             ++batch_index) {
+            Pod5ReadRecordBatch_t* batch = nullptr;
+            if (pod5_get_read_batch(&batch, reader, batch_index) != POD5_OK) {
+                spdlog::error("Failed to get batch: {}", pod5_get_error_string());
+                continue;
+            }
+            std::size_t batch_row_count = 0;
+            if (pod5_get_read_batch_row_count(&batch_row_count, batch) != POD5_OK) {
+                spdlog::error("Failed to get batch row count");
+            }
+            for (std::size_t row = 0; row < batch_row_count && lengths.size() < max_reads; ++row) {
+                uint16_t read_table_version = 0;
+                ReadBatchRowInfo_t read_data;
+                if (pod5_get_read_batch_row_info_data(batch, row, READ_BATCH_ROW_INFO_VERSION,
+                                                      &read_data,
+                                                      &read_table_version) == POD5_OK) {
+                    lengths.push_back(read_data.num_samples);
                 }
             }
-            if (pod5_close_and_free_reader(file) != POD5_OK) {
-                spdlog::error("Failed to close and free POD5 reader");
+            if (pod5_free_read_batch(batch) != POD5_OK) {
+                spdlog::error("Failed to release batch");
             }
         }
+        if (pod5_close_and_free_reader(reader) != POD5_OK) {
+            spdlog::error("Failed to close and free POD5 reader");
+        }
+    }
+    return lengths;
+}
+
+void DataLoader::load_reads_by_channel(const std::string& data_path,
+                                       bool recursive_file_loading) {
+    // Each file's reads are located once, from its read table and one traversal plan, and sorted
+    // by channel.  Reads are then loaded a window of whole channels at a time across all the
+    // files, and pushed in channel order, so only one window's reads are held at once.
+    spdlog::info("> Reading read channel info");
+    const auto index = DatasetIndex::get(data_path, recursive_file_loading, m_shard);
+    const auto& files = index->files();
+    std::vector<std::string> paths;
+    std::vector<std::vector<Pod5ReadLocation>> file_locations;
+    for (size_t file_index = 0; file_index < files.size(); ++file_index) {
+        if (files[file_index].format != IndexedFile::Format::POD5) {
+            throw std::runtime_error(
+                    "Traversing reads by channel is only availabls for POD5. "
+                    "Encountered FAST5 at " +
+                    files[file_index].path.string());
+        }
+        paths.push_back(files[file_index].path.string());
+        file_locations.push_back(plan_channel_order(paths.back(), index->read_table(file_index)));
+    }
+    spdlog::info("> Processed read channel info");
+
+    // The next channel to load is the lowest any file has left from positions.
+    auto next_channel = [&](const std::vector<size_t>& positions) {
+        std::optional<int32_t> channel;
+        for (size_t i = 0; i < paths.size(); ++i) {
+            if (positions[i] < file_locations[i].size()) {
+                const auto file_channel = file_locations[i][positions[i]].channel;
+                channel = channel ? std::min(*channel, file_channel) : file_channel;
+            }
+        }
+        return channel;
     };
 
-    if (recursive_file_loading) {
-        iterate_directory([](const auto& path) {
-            return std::filesystem::recursive_directory_iterator(path);
+    std::vector<size_t> window_starts(paths.size(), 0);
+    while (m_num_reserved_reads < m_max_reads) {
+        auto window_ends = window_starts;
+        size_t num_window_reads = 0;
+        while (num_window_reads < kMaxChannelWindowReads) {
+            const auto channel = next_channel(window_ends);
+            if (!channel) {
+                break;
+            }
+            for (size_t i = 0; i < paths.size(); ++i) {
+                const auto& locations = file_locations[i];
+                while (window_ends[i] < locations.size() &&
+                       locations[window_ends[i]].channel == *channel) {
+                    ++window_ends[i];
+                    ++num_window_reads;
+                }
+            }
+        }
+        if (num_window_reads == 0) {
+            break;
+        }
+
+        std::vector<std::shared_ptr<Read>> reads;
+        reads.reserve(num_window_reads);
+        for (size_t i = 0; i < paths.size(); ++i) {
+            if (window_ends[i] == window_starts[i]) {
+                continue;
+            }
+            std::vector<Pod5ReadLocation> locations(
+                    file_locations[i].begin() + window_starts[i],
+                    file_locations[i].begin() + window_ends[i]);
+            std::sort(locations.begin(), locations.end(), [](const auto& a, const auto& b) {
+                return std::tie(a.batch, a.row) < std::tie(b.batch, b.row);
+            });
+            load_pod5_reads_by_location(paths[i], locations, reads);
+        }
+        window_starts = std::move(window_ends);
+
+        // Within a channel, reads stay in file, then batch, order.
+        std::stable_sort(reads.begin(), reads.end(), [](const auto& a, const auto& b) {
+            return a->attributes.channel_number < b->attributes.channel_number;
         });
-    } else {
-        iterate_directory(
-                [](const auto& path) { return std::filesystem::directory_iterator(path); });
+        for (auto& read : reads) {
+            send_read(std::move(read));
+        }
     }
 }
 
 std::unordered_map<std::string, ReadGroup> DataLoader::load_read_groups(
         std::string data_path,
         std::string model_path,
-        bool recursive_file_loading) {
+        bool recursive_file_loading,
+        const DatasetShard& shard) {
     std::unordered_map<std::string, ReadGroup> read_groups;
 
-    auto iterate_directory = [&](const auto& iterator_fn) {
-        for (const auto& entry : iterator_fn(data_path)) {
-            std::string ext = std::filesystem::path(entry).extension().string();
-            std::transform(ext.begin(), ext.end(), ext.begin(),
-                           [](unsigned char c) { return std::tolower(c); });
-            if (ext == ".pod5") {
-                pod5_init();
-
-                // Open the file ready for walking:
-                Pod5FileReader_t* file = pod5_open_file(entry.path().string().c_str());
-
-                if (!file) {
-                    spdlog::error("Failed to open file {}: {}", entry.path().string().c_str(),
-                                  pod5_get_error_string());
-                } else {
-                    // First get the run info count
-                    run_info_index_t run_info_count;
-                    pod5_get_file_run_info_count(file, &run_info_count);
-                    for (run_info_index_t idx = 0; idx < run_info_count; idx++) {
-                        RunInfoDictData_t* run_info_data;
-                        pod5_get_file_run_info(file, idx, &run_info_data);
-
-                        auto exp_start_time_ms = run_info_data->acquisition_start_time_ms;
-                        std::string flowcell_id = run_info_data->flow_cell_id;
-                        std::string device_id = run_info_data->system_name;
-                        std::string run_id = run_info_data->acquisition_id;
-                        std::string sample_id = run_info_data->sample_id;
-
-                        if (pod5_free_run_info(run_info_data) != POD5_OK) {
-                            spdlog::error("Failed to free run info");
-                        }
-
-                        std::string id = run_id + "_" + model_path;
-                        read_groups[id] = ReadGroup{
-                                run_id,
-                                model_path,
-                                flowcell_id,
-                                device_id,
-                                utils::get_string_timestamp_from_unix_time(exp_start_time_ms),
-                                sample_id};
-                    }
-                    if (pod5_close_and_free_reader(file) != POD5_OK) {
-                        spdlog::error("Failed to close and free POD5 reader");
-                    }
-                }
-            }
+    const auto index = DatasetIndex::get(data_path, recursive_file_loading, shard);
+    for (const auto& file : index->files()) {
+        for (const auto& run : file.runs) {
+            std::string id = run.run_id + "_" + model_path;
+            read_groups[id] = ReadGroup{
+                    run.run_id,
+                    model_path,
+                    run.flowcell_id,
+                    run.device_id,
+                    utils::get_string_timestamp_from_unix_time(run.acquisition_start_time_ms),
+                    run.sample_id};
         }
-    };
-
-    if (recursive_file_loading) {
-        iterate_directory([](const auto& path) {
-            return std::filesystem::recursive_directory_iterator(path);
-        });
-    } else {
-        iterate_directory(
-                [](const auto& path) { return std::filesystem::directory_iterator(path); });
     }
 
     return read_groups;
 }
 
-uint16_t DataLoader::get_sample_rate(std::string data_path, bool recursive_file_loading) {
-    std::optional<uint16_t> sample_rate = std::nullopt;
-
-    auto iterate_directory = [&](const auto& iterator_fn) {
-        for (const auto& entry : iterator_fn((data_path))) {
-            std::string ext = std::filesystem::path(entry).extension().string();
-            std::transform(ext.begin(), ext.end(), ext.begin(),
-                           [](unsigned char c) { return std::tolower(c); });
-            if (ext == ".pod5") {
-                pod5_init();
-
-                // Open the file ready for walking:
-                Pod5FileReader_t* file = pod5_open_file(entry.path().string().c_str());
-
-                if (!file) {
-                    spdlog::error("Failed to open file {}: {}", entry.path().string().c_str(),
-                                  pod5_get_error_string());
-                } else {
-                    // First get the run info count
-                    run_info_index_t run_info_count;
-                    pod5_get_file_run_info_count(file, &run_info_count);
-                    if (run_info_count > static_cast<run_info_index_t>(0)) {
-                        RunInfoDictData_t* run_info_data;
-                        pod5_get_file_run_info(file, 0, &run_info_data);
-                        sample_rate = run_info_data->sample_rate;
-
-                        if (pod5_free_run_info(run_info_data) != POD5_OK) {
-                            spdlog::error("Failed to free POD5 run info");
-                        }
-                    }
-                }
+uint16_t DataLoader::get_sample_rate(std::string data_path,
+                                     bool recursive_file_loading,
+                                     const DatasetShard& shard) {
+    const auto index = DatasetIndex::get(data_path, recursive_file_loading, shard);
+    for (const auto& file : index->files()) {
+        if (file.sample_rate) {
+            return file.sample_rate;
+        }
+    }
+    throw std::runtime_error("Unable to determine sample rate for data.");
+}
 
-                if (pod5_close_and_free_reader(file) != POD5_OK) {
-                    spdlog::error("Failed to close and free POD5 reader");
-                }
-            } else if (ext == ".fast5") {
-                H5Easy::File file(entry.path().string(), H5Easy::File::ReadOnly);
-                HighFive::Group reads = file.getGroup("/");
-                int num_reads = reads.getNumberObjects();
-
-                if (num_reads > 0) {
-                    auto read_id = reads.getObjectName(0);
-                    HighFive::Group read = reads.getGroup(read_id);
-
-                    HighFive::Group channel_id_group = read.getGroup("channel_id");
-                    HighFive::Attribute sampling_rate_attr =
-                            channel_id_group.getAttribute("sampling_rate");
-
-                    float sampling_rate;
-                    sampling_rate_attr.read(sampling_rate);
-                    sample_rate = static_cast<uint16_t>(sampling_rate);
-                }
-            }
+std::vector<DataLoader::Pod5ReadLocation> DataLoader::plan_channel_order(
+        const std::string& path,
+        const IndexedReadTable& table) const {
+    pod5_init();
+    Pod5FileReader_t* file = pod5_open_file(path.c_str());
+    if (!file) {
+        spdlog::error("Failed to open file {}: {}", path, pod5_get_error_string());
+        return {};
+    }
 
-            // Break out of loop if sample rate is found.
-            if (sample_rate) {
-                break;
-            }
-        }
-    };
+    std::size_t batch_count = 0;
+    if (pod5_get_read_batch_count(&batch_count, file) != POD5_OK) {
+        spdlog::error("Failed to query batch count: {}", pod5_get_error_string());
+    }
 
-    if (recursive_file_loading) {
-        iterate_directory([](const auto& path) {
-            return std::filesystem::recursive_directory_iterator(path);
-        });
-    } else {
-        iterate_directory(
-                [](const auto& path) { return std::filesystem::directory_iterator(path); });
+    // The table is in file order, so a plan for all of it gives each read's row in table order.
+    const size_t num_reads = table.read_ids.size();
+    std::vector<std::uint32_t> traversal_batch_counts(batch_count);
+    std::vector<std::uint32_t> traversal_batch_rows(num_reads);
+    size_t find_success_count = 0;
+    pod5_error_t err = pod5_plan_traversal(
+            file, reinterpret_cast<const uint8_t*>(table.read_ids.data()), num_reads,
+            traversal_batch_counts.data(), traversal_batch_rows.data(), &find_success_count);
+    if (pod5_close_and_free_reader(file) != POD5_OK) {
+        spdlog::error("Failed to close and free POD5 reader");
+    }
+    if (err != POD5_OK) {
+        spdlog::error("Couldn't create plan for {} with reads {}", path, num_reads);
+        return {};
+    }
+    if (find_success_count != num_reads) {
+        spdlog::error("Reads found by plan {}, reads in input {}", find_success_count, num_reads);
+        throw std::runtime_error("Plan traveral didn't yield correct number of reads");
     }
 
-    if (sample_rate) {
-        return *sample_rate;
-    } else {
-        throw std::runtime_error("Unable to determine sample rate for data.");
+    std::vector<Pod5ReadLocation> locations;
+    locations.reserve(num_reads);
+    size_t read_index = 0;
+    for (std::size_t batch_index = 0; batch_index < batch_count; ++batch_index) {
+        for (uint32_t i = 0; i < traversal_batch_counts[batch_index]; ++i, ++read_index) {
+            if (!is_wanted(table.read_ids[read_index].data())) {
+                continue;
+            }
+            locations.push_back({table.channels[read_index], uint32_t(batch_index),
+                                 traversal_batch_rows[read_index]});
+        }
     }
+    std::stable_sort(locations.begin(), locations.end(), [](const auto& a, const auto& b) {
+        return a.channel < b.channel;
+    });
+    return locations;
 }
 
-void DataLoader::load_pod5_reads_from_file_by_read_ids(const std::string& path,
-                                                       const std::vector<ReadID>& read_ids) {
+void DataLoader::load_pod5_reads_by_location(const std::string& path,
+                                             const std::vector<Pod5ReadLocation>& locations,
+                                             std::vector<std::shared_ptr<Read>>& reads) {
     pod5_init();
 
     // Open the file ready for walking:
@@ -495,86 +737,64 @@ void DataLoader::load_pod5_reads_from_file_by_read_ids(const std::string& path,
         return;
     }
 
-    std::vector<uint8_t> read_id_array(POD5_READ_ID_SIZE * read_ids.size());
-    for (int i = 0; i < read_ids.size(); i++) {
-        std::memcpy(read_id_array.data() + POD5_READ_ID_SIZE * i, read_ids[i].data(),
-                    POD5_READ_ID_SIZE);
-    }
-
-    std::size_t batch_count = 0;
-    if (pod5_get_read_batch_count(&batch_count, file) != POD5_OK) {
-        spdlog::error("Failed to query batch count: {}", pod5_get_error_string());
-    }
-
-    std::vector<std::uint32_t> traversal_batch_counts(batch_count);
-    std::vector<std::uint32_t> traversal_batch_rows(read_ids.size());
-    size_t find_success_count;
-    pod5_error_t err = pod5_plan_traversal(file, read_id_array.data(), read_ids.size(),
-                                           traversal_batch_counts.data(),
-                                           traversal_batch_rows.data(), &find_success_count);
-    if (err != POD5_OK) {
-        spdlog::error("Couldn't create plan for {} with reads {}", path, read_ids.size());
-        return;
-    }
-
-    if (find_success_count != read_ids.size()) {
-        spdlog::error("Reads found by plan {}, reads in input {}", find_success_count,
-                      read_ids.size());
-        throw std::runtime_error("Plan traveral didn't yield correct number of reads");
-    }
+    utils::TaskQueue tasks(utils::WorkStealingExecutor::instance(), m_num_worker_threads);
+    const utils::InternedString filename = std::filesystem::path(path).filename().string();
 
-    cxxpool::thread_pool pool{m_num_worker_threads};
+    for (auto batch_begin = locations.begin(); batch_begin != locations.end();) {
+        const auto batch_index = batch_begin->batch;
+        const auto batch_end =
+                std::find_if(batch_begin, locations.end(),
+                             [batch_index](const auto& location) {
+                                 return location.batch != batch_index;
+                             });
 
-    uint32_t row_offset = 0;
-    for (std::size_t batch_index = 0; batch_index < batch_count; ++batch_index) {
-        if (m_loaded_read_count == m_max_reads) {
-            break;
-        }
         Pod5ReadRecordBatch_t* batch = nullptr;
         if (pod5_get_read_batch(&batch, file, batch_index) != POD5_OK) {
             spdlog::error("Failed to get batch: {}", pod5_get_error_string());
+            batch_begin = batch_end;
             continue;
         }
 
         std::vector<std::future<std::shared_ptr<Read>>> futures;
-        for (std::size_t row_idx = 0; row_idx < traversal_batch_counts[batch_index]; row_idx++) {
-            uint32_t row = traversal_batch_rows[row_idx + row_offset];
-
-            uint16_t read_table_version = 0;
-            ReadBatchRowInfo_t read_data;
-            if (pod5_get_read_batch_row_info_data(batch, row, READ_BATCH_ROW_INFO_VERSION,
-                                                  &read_data, &read_table_version) != POD5_OK) {
-                spdlog::error("Failed to get read {}", row);
-                continue;
+        for (auto location = batch_begin; location != batch_end; ++location) {
+            const size_t row = location->row;
+            // Short reads are dropped before they take a reservation, so that they don't count
+            // towards the max reads limit.
+            if (m_min_signal_samples > 0) {
+                uint16_t read_table_version = 0;
+                ReadBatchRowInfo_t read_data;
+                if (pod5_get_read_batch_row_info_data(batch, row, READ_BATCH_ROW_INFO_VERSION,
+                                                      &read_data,
+                                                      &read_table_version) == POD5_OK &&
+                    read_data.num_samples < m_min_signal_samples) {
+                    drop_short_read();
+                    continue;
+                }
             }
-
-            char read_id_tmp[37];
-            pod5_error_t err = pod5_format_read_id(read_data.read_id, read_id_tmp);
-            std::string read_id_str(read_id_tmp);
-            if (!m_allowed_read_ids ||
-                (m_allowed_read_ids->find(read_id_str) != m_allowed_read_ids->end())) {
-                futures.push_back(pool.push(process_pod5_read, row, batch, file, path, m_device));
+            if (!reserve_read()) {
+                break;
             }
+            futures.push_back(tasks.async([row, batch, file, &filename, this] {
+                return process_pod5_read(row, batch, file, filename, m_device,
+                                         m_signal_cache.get());
+            }));
         }
-
-        for (auto& v : futures) {
-            auto read = v.get();
-            m_read_sink.push_message(std::move(read));
-            m_loaded_read_count++;
+        for (auto& future : futures) {
+            reads.push_back(future.get());
         }
 
         if (pod5_free_read_batch(batch) != POD5_OK) {
             spdlog::error("Failed to release batch");
         }
-
-        row_offset += traversal_batch_counts[batch_index];
+        batch_begin = batch_end;
     }
     if (pod5_close_and_free_reader(file) != POD5_OK) {
         spdlog::error("Failed to close and free POD5 reader");
     }
 }
 
-void DataLoader::load_pod5_reads_from_file(const std::string& path) {
+void DataLoader::load_pod5_reads_from_file(const std::string& path,
+                                           const FileProgress& progress) {
     pod5_init();
 
     // Open the file ready for walking:
@@ -589,149 +809,323 @@ void DataLoader::load_pod5_reads_from_file(const std::string& path) {
         spdlog::error("Failed to query batch count: {}", pod5_get_error_string());
     }
 
-    cxxpool::thread_pool pool{m_num_worker_threads};
-
-    for (std::size_t batch_index = 0; batch_index < batch_count; ++batch_index) {
-        if (m_loaded_read_count == m_max_reads) {
-            break;
-        }
-        Pod5ReadRecordBatch_t* batch = nullptr;
-        if (pod5_get_read_batch(&batch, file, batch_index) != POD5_OK) {
-            spdlog::error("Failed to get batch: {}", pod5_get_error_string());
-        }
+    utils::TaskQueue tasks(utils::WorkStealingExecutor::instance(), m_num_worker_threads);
+    const utils::InternedString filename = std::filesystem::path(path).filename().string();
+
+    // Batches are fetched, and their reads decoded, on a separate thread which runs up to
+    // m_max_prefetch_batches ahead of the batch whose reads are being pushed downstream,
+    // so long as the decoded signal fits within m_prefetch_memory_budget.
+    AsyncQueue<std::unique_ptr<PendingPod5Batch>> ready_batches(m_max_prefetch_batches + 1);
+    std::mutex budget_mutex;
+    std::condition_variable budget_cv;
+    size_t batches_in_flight = 0;
+    size_t bytes_in_flight = 0;
+    // Set if the reads can't be pushed on, so prefetching should stop.
+    bool stop_prefetching = false;
+
+    std::thread prefetch_thread([&] {
+        bool reached_max_reads = false;
+        for (std::size_t batch_index = 0; batch_index < batch_count && !reached_max_reads;
+             ++batch_index) {
+            auto pending = std::make_unique<PendingPod5Batch>();
+            if (pod5_get_read_batch(&pending->batch, file, batch_index) != POD5_OK) {
+                spdlog::error("Failed to get batch: {}", pod5_get_error_string());
+                continue;
+            }
 
-        std::size_t batch_row_count = 0;
-        if (pod5_get_read_batch_row_count(&batch_row_count, batch) != POD5_OK) {
-            spdlog::error("Failed to get batch row count");
-        }
-        batch_row_count = std::min(batch_row_count, m_max_reads - m_loaded_read_count);
+            std::size_t batch_row_count = 0;
+            if (pod5_get_read_batch_row_count(&batch_row_count, pending->batch) != POD5_OK) {
+                spdlog::error("Failed to get batch row count");
+            }
 
-        std::vector<std::future<std::shared_ptr<Read>>> futures;
+            std::vector<std::size_t> rows;
+            for (std::size_t row = 0; row < batch_row_count && !reached_max_reads; ++row) {
+                uint16_t read_table_version = 0;
+                ReadBatchRowInfo_t read_data;
+                if (pod5_get_read_batch_row_info_data(pending->batch, row,
+                                                      READ_BATCH_ROW_INFO_VERSION, &read_data,
+                                                      &read_table_version) != POD5_OK) {
+                    DORADO_LOG_RATE_LIMITED(spdlog::level::err, "Failed to get read {}", row);
+                }
 
-        for (std::size_t row = 0; row < batch_row_count; ++row) {
-            // TODO - check the read ID here, for each one, only send the row if it is in the list of ones we care about
+                if (is_wanted(read_data.read_id) &&
+                    read_data.num_samples < m_min_signal_samples) {
+                    drop_short_read();
+                } else if (is_wanted(read_data.read_id)) {
+                    // Other files may be loading concurrently, so the max reads limit is
+                    // shared through reservations.
+                    if (!reserve_read()) {
+                        reached_max_reads = true;
+                        break;
+                    }
+                    rows.push_back(row);
+                    pending->signal_bytes += read_data.num_samples * sizeof(int16_t);
+                }
+            }
 
-            uint16_t read_table_version = 0;
-            ReadBatchRowInfo_t read_data;
-            if (pod5_get_read_batch_row_info_data(batch, row, READ_BATCH_ROW_INFO_VERSION,
-                                                  &read_data, &read_table_version) != POD5_OK) {
-                spdlog::error("Failed to get read {}", row);
+            {
+                // A batch is always let through when nothing else is in flight, so a
+                // single batch larger than the budget can't stall loading.
+                std::unique_lock lock(budget_mutex);
+                budget_cv.wait(lock, [&] {
+                    return stop_prefetching || batches_in_flight == 0 ||
+                           (batches_in_flight <= m_max_prefetch_batches &&
+                            bytes_in_flight + pending->signal_bytes <= m_prefetch_memory_budget);
+                });
+                if (stop_prefetching) {
+                    pod5_free_read_batch(pending->batch);
+                    break;
+                }
+                ++batches_in_flight;
+                bytes_in_flight += pending->signal_bytes;
             }
 
-            char read_id_tmp[37];
-            pod5_error_t err = pod5_format_read_id(read_data.read_id, read_id_tmp);
-            std::string read_id_str(read_id_tmp);
-            if (!m_allowed_read_ids ||
-                (m_allowed_read_ids->find(read_id_str) != m_allowed_read_ids->end())) {
-                futures.push_back(pool.push(process_pod5_read, row, batch, file, path, m_device));
+            auto batch = pending->batch;
+            for (auto row : rows) {
+                pending->reads.push_back(tasks.async([this, row, batch, file, &filename] {
+                    return process_pod5_read(row, batch, file, filename, m_device,
+                                             m_signal_cache.get());
+                }));
+            }
+            if (!ready_batches.try_push(std::move(pending))) {
+                // Prefetching has been stopped.  A failed push leaves pending as it was, and its
+                // reads use the batch until they're done.
+                for (auto& read : pending->reads) {
+                    read.wait();
+                }
+                pod5_free_read_batch(pending->batch);
+                break;
+            }
+        }
+        ready_batches.terminate();
+    });
+
+    // If pushing the reads on throws, the prefetch thread may be waiting for budget or for
+    // room in ready_batches, so it's told to stop and joined before the exception leaves.
+    class PrefetchStopper {
+    public:
+        PrefetchStopper(std::thread& thread, std::function<void()> stop)
+                : m_thread(thread), m_stop(std::move(stop)) {}
+        ~PrefetchStopper() {
+            if (m_thread.joinable()) {
+                m_stop();
+                m_thread.join();
             }
         }
 
-        for (auto& v : futures) {
-            auto read = v.get();
-            m_read_sink.push_message(read);
-            m_loaded_read_count++;
+    private:
+        std::thread& m_thread;
+        std::function<void()> m_stop;
+    } prefetch_stopper(prefetch_thread, [&] {
+        {
+            std::lock_guard lock(budget_mutex);
+            stop_prefetching = true;
+        }
+        budget_cv.notify_all();
+        ready_batches.terminate();
+    });
+
+    std::unique_ptr<PendingPod5Batch> pending;
+    size_t num_batches_done = 0;
+    while (ready_batches.try_pop(pending)) {
+        for (auto& v : pending->reads) {
+            send_read(v.get());
+        }
+        if (progress) {
+            progress(++num_batches_done, batch_count);
         }
 
-        if (pod5_free_read_batch(batch) != POD5_OK) {
+        if (pod5_free_read_batch(pending->batch) != POD5_OK) {
             spdlog::error("Failed to release batch");
         }
+        {
+            std::lock_guard lock(budget_mutex);
+            --batches_in_flight;
+            bytes_in_flight -= pending->signal_bytes;
+        }
+        budget_cv.notify_one();
     }
+    prefetch_thread.join();
+
     if (pod5_close_and_free_reader(file) != POD5_OK) {
         spdlog::error("Failed to close and free POD5 reader");
     }
 }
 
-void DataLoader::load_fast5_reads_from_file(const std::string& path) {
-    // Read the file into a vector of torch tensors
-    H5Easy::File file(path, H5Easy::File::ReadOnly);
-    HighFive::Group reads = file.getGroup("/");
-    int num_reads = reads.getNumberObjects();
-
-    for (int i = 0; i < num_reads && m_loaded_read_count < m_max_reads; i++) {
-        auto read_id = reads.getObjectName(i);
-        HighFive::Group read = reads.getGroup(read_id);
-
-        // Fetch the digitisation parameters
-        HighFive::Group channel_id_group = read.getGroup("channel_id");
-        HighFive::Attribute digitisation_attr = channel_id_group.getAttribute("digitisation");
-        HighFive::Attribute range_attr = channel_id_group.getAttribute("range");
-        HighFive::Attribute offset_attr = channel_id_group.getAttribute("offset");
-        HighFive::Attribute sampling_rate_attr = channel_id_group.getAttribute("sampling_rate");
-        HighFive::Attribute channel_number_attr = channel_id_group.getAttribute("channel_number");
-
-        int32_t channel_number;
-        if (channel_number_attr.getDataType().string().substr(0, 6) == "String") {
-            std::string channel_number_string;
-            string_reader(channel_number_attr, channel_number_string);
-            std::istringstream channel_stream(channel_number_string);
-            channel_stream >> channel_number;
-        } else {
-            channel_number_attr.read(channel_number);
-        }
-
-        float digitisation;
-        digitisation_attr.read(digitisation);
-        float range;
-        range_attr.read(range);
-        float offset;
-        offset_attr.read(offset);
-        float sampling_rate;
-        sampling_rate_attr.read(sampling_rate);
-
-        HighFive::Group raw = read.getGroup("Raw");
-        auto ds = raw.getDataSet("Signal");
-        if (ds.getDataType().string() != "Integer16")
-            throw std::runtime_error("Invalid FAST5 Signal data type of " +
-                                     ds.getDataType().string());
-
-        auto options = torch::TensorOptions().dtype(torch::kInt16);
-        auto samples = torch::empty(ds.getElementCount(), options);
-        ds.read(samples.data_ptr<int16_t>());
-
-        HighFive::Attribute mux_attr = raw.getAttribute("start_mux");
-        HighFive::Attribute read_number_attr = raw.getAttribute("read_number");
-        HighFive::Attribute start_time_attr = raw.getAttribute("start_time");
-        HighFive::Attribute read_id_attr = raw.getAttribute("read_id");
-        uint32_t mux;
-        uint32_t read_number;
-        uint64_t start_time;
-        mux_attr.read(mux);
-        read_number_attr.read(read_number);
-        start_time_attr.read(start_time);
-        string_reader(read_id_attr, read_id);
-
-        std::string fast5_filename = std::filesystem::path(path).filename().string();
-
-        HighFive::Group tracking_id_group = read.getGroup("tracking_id");
-        HighFive::Attribute exp_start_time_attr = tracking_id_group.getAttribute("exp_start_time");
-        std::string exp_start_time;
-        string_reader(exp_start_time_attr, exp_start_time);
-
-        auto start_time_str = utils::adjust_time(exp_start_time,
-                                                 static_cast<uint32_t>(start_time / sampling_rate));
-
-        auto new_read = std::make_shared<Read>();
-        new_read->sample_rate = sampling_rate;
-        new_read->raw_data = samples;
-        new_read->digitisation = digitisation;
-        new_read->range = range;
-        new_read->offset = offset;
-        new_read->scaling = range / digitisation;
-        new_read->read_id = read_id;
-        new_read->num_trimmed_samples = 0;
-        new_read->attributes.mux = mux;
-        new_read->attributes.read_number = read_number;
-        new_read->attributes.channel_number = channel_number;
-        new_read->attributes.start_time = start_time_str;
-        new_read->attributes.fast5_filename = fast5_filename;
-        new_read->is_duplex = false;
-
-        if (!m_allowed_read_ids ||
-            (m_allowed_read_ids->find(new_read->read_id) != m_allowed_read_ids->end())) {
-            m_read_sink.push_message(new_read);
-            m_loaded_read_count++;
+void DataLoader::load_files(const std::vector<std::string>& paths) {
+    // Read ahead in the order the files are claimed in, which is the order they're listed in.
+    std::unique_ptr<utils::FileReadahead> readahead;
+    if (m_readahead_bytes > 0 || m_drop_page_cache) {
+        readahead = std::make_unique<utils::FileReadahead>(paths, m_readahead_bytes,
+                                                           m_drop_page_cache);
+    }
+    auto load_file = [this, &paths, &readahead](size_t index) {
+        const auto& path = paths[index];
+        std::string ext = std::filesystem::path(path).extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(),
+                       [](unsigned char c) { return std::tolower(c); });
+        // The readahead moves through the file as its reads are loaded.
+        FileProgress progress;
+        if (readahead) {
+            progress = [&readahead, index](size_t num_done, size_t num_parts) {
+                readahead->file_progress(index, num_done, num_parts);
+            };
+        }
+        if (ext == ".fast5") {
+            load_fast5_reads_from_file(path, progress);
+        } else if (ext == ".pod5") {
+            load_pod5_reads_from_file(path, progress);
+        }
+        if (readahead) {
+            readahead->file_loaded(index);
         }
+    };
+
+    const size_t num_threads = std::min(m_max_concurrent_files, paths.size());
+    if (num_threads <= 1) {
+        for (size_t file_index = 0; file_index < paths.size(); ++file_index) {
+            if (m_num_reserved_reads == m_max_reads) {
+                break;
+            }
+            load_file(file_index);
+        }
+        return;
+    }
+
+    // Each thread keeps one file open at a time, taking the next unclaimed file when it's
+    // done.  All threads push to the same sink, so reads from the files in flight are
+    // interleaved as they're decoded rather than one file at a time.
+    std::atomic<size_t> next_file{0};
+    std::mutex error_mutex;
+    std::exception_ptr first_error;
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < num_threads; ++i) {
+        threads.emplace_back([&] {
+            try {
+                for (size_t file_index = next_file++; file_index < paths.size();
+                     file_index = next_file++) {
+                    if (m_num_reserved_reads == m_max_reads) {
+                        break;
+                    }
+                    load_file(file_index);
+                }
+            } catch (...) {
+                std::lock_guard lock(error_mutex);
+                if (!first_error) {
+                    first_error = std::current_exception();
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (first_error) {
+        std::rethrow_exception(first_error);
+    }
+}
+
+bool DataLoader::reserve_read() {
+    size_t num_reserved = m_num_reserved_reads.load();
+    do {
+        if (num_reserved >= m_max_reads) {
+            return false;
+        }
+    } while (!m_num_reserved_reads.compare_exchange_weak(num_reserved, num_reserved + 1));
+    return true;
+}
+
+void DataLoader::drop_short_read() {
+    ++m_num_short_reads_dropped;
+    if (m_on_short_read_dropped) {
+        m_on_short_read_dropped();
+    }
+}
+
+void DataLoader::send_read(std::shared_ptr<Read> read) {
+    read->is_priority = (m_priority_read_ids && m_priority_read_ids->contains(read->read_id)) ||
+                        m_priority_channels.count(read->attributes.channel_number) > 0;
+    read->memory_reservation.resize(read->host_memory_bytes());
+    read->sequence_number = ++m_loaded_read_count;
+    m_read_sink.push_message(std::move(read));
+}
+
+void DataLoader::load_fast5_reads_from_file(const std::string& path,
+                                            const FileProgress& progress) {
+    const utils::InternedString fast5_filename = std::filesystem::path(path).filename().string();
+    std::vector<std::string> read_group_names;
+    {
+        std::lock_guard lock(hdf5_mutex());
+        H5Easy::File file(path, H5Easy::File::ReadOnly);
+        read_group_names = file.getGroup("/").listObjectNames();
+    }
+
+    // The read groups are spread across the workers, each with its own handle on the file.
+    // Each read is read from the file in one go, with the HDF5 lock held, and the worker
+    // sends it on while the others read theirs.
+    std::atomic<size_t> next_read{0};
+    std::mutex error_mutex;
+    std::exception_ptr first_error;
+    auto load_read_groups = [&] {
+        std::optional<H5Easy::File> file;
+        std::optional<HighFive::Group> reads;
+        try {
+            std::unique_lock lock(hdf5_mutex());
+            file.emplace(path, H5Easy::File::ReadOnly);
+            reads = file->getGroup("/");
+            lock.unlock();
+            for (size_t i = next_read++; i < read_group_names.size(); i = next_read++) {
+                if (m_num_reserved_reads >= m_max_reads) {
+                    break;
+                }
+                // The workers take the read groups in turn, so those before this one are done,
+                // or nearly.
+                if (progress) {
+                    progress(i, read_group_names.size());
+                }
+                // Read groups are named read_<read ID>, so reads which aren't wanted are
+                // skipped before their signal is decompressed.
+                const auto& group_name = read_group_names[i];
+                constexpr std::string_view kReadGroupPrefix = "read_";
+                if (group_name.rfind(kReadGroupPrefix, 0) == 0 &&
+                    !is_wanted(std::string_view(group_name).substr(kReadGroupPrefix.size()))) {
+                    continue;
+                }
+                lock.lock();
+                auto new_read = process_fast5_read(reads->getGroup(group_name), fast5_filename);
+                lock.unlock();
+                if (!is_wanted(new_read->read_id)) {
+                    continue;
+                }
+                if (size_t(new_read->raw_data.size(0)) < m_min_signal_samples) {
+                    drop_short_read();
+                } else if (reserve_read()) {
+                    send_read(std::move(new_read));
+                }
+            }
+        } catch (...) {
+            std::lock_guard lock(error_mutex);
+            if (!first_error) {
+                first_error = std::current_exception();
+            }
+        }
+        // Closed with the lock held, like every other HDF5 call.
+        std::lock_guard lock(hdf5_mutex());
+        reads.reset();
+        file.reset();
+    };
+
+    const size_t num_threads = std::min(m_num_worker_threads, read_group_names.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < num_threads; ++i) {
+        threads.emplace_back(load_read_groups);
+    }
+    load_read_groups();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (first_error) {
+        std::rethrow_exception(first_error);
     }
 }
 
@@ -739,7 +1133,7 @@ DataLoader::DataLoader(MessageSink& read_sink,
                        const std::string& device,
                        size_t num_worker_threads,
                        size_t max_reads,
-                       std::optional<std::unordered_set<std::string>> read_list)
+                       std::optional<utils::ReadIdSet> read_list)
         : m_read_sink(read_sink),
           m_device(device),
           m_num_worker_threads(num_worker_threads),
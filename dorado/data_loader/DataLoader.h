@@ -1,7 +1,16 @@
 #pragma once
+#include "utils/ReadIdSet.h"
+
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <unordered_map>
@@ -12,18 +21,37 @@ struct Pod5FileReader;
 
 namespace dorado {
 
+namespace utils {
+class SignalCache;
+}
+
 class MessageSink;
+class Read;
+struct IndexedReadTable;
 struct ReadGroup;
 
 constexpr size_t POD5_READ_ID_SIZE = 16;
 using ReadID = std::array<uint8_t, POD5_READ_ID_SIZE>;
-typedef std::map<int, std::vector<ReadID>> channel_to_read_id_t;
 
 struct Pod5Destructor {
     void operator()(Pod5FileReader*);
 };
 using Pod5Ptr = std::unique_ptr<Pod5FileReader, Pod5Destructor>;
 
+// One of count disjoint parts of a dataset, so that it can be split between nodes with --shard.
+// Files are assigned to shards by a hash of their path relative to the data directory, so every
+// node agrees on the split without listing the others' files, and files keep their shard as
+// more are added.
+struct DatasetShard {
+    size_t index{0};
+    size_t count{1};
+
+    bool contains(const std::string& relative_path) const;
+};
+
+// Parses "i/N", the ith of N shards counting from 0.
+DatasetShard parse_dataset_shard(const std::string& text);
+
 class DataLoader {
 public:
     enum ReadOrder {
@@ -35,39 +63,166 @@ public:
                const std::string& device,
                size_t num_worker_threads,
                size_t max_reads = 0,
-               std::optional<std::unordered_set<std::string>> read_list = std::nullopt);
+               std::optional<utils::ReadIdSet> read_list = std::nullopt);
     ~DataLoader() = default;
     void load_reads(const std::string& path,
                     bool recursive_file_loading = false,
                     ReadOrder traversal_order = UNRESTRICTED);
 
+    // Live mode: loads the files already in path, then keeps watching it and loads each
+    // new file as soon as it has been written.  Returns once no new file has appeared
+    // for idle_timeout (if non-zero), or once a file named sentinel_file_name (if not
+    // empty) appears in path.
+    void watch_reads(const std::string& path,
+                     bool recursive_file_loading,
+                     std::chrono::seconds idle_timeout,
+                     const std::string& sentinel_file_name);
+
+    // Blocks until path contains at least one POD5 or FAST5 file.  Returns false if
+    // none appears within timeout (if non-zero).
+    static bool wait_for_input_files(const std::string& path,
+                                     bool recursive_file_loading,
+                                     std::chrono::seconds timeout);
+
+    // The metadata queries only look at the files in shard.
     static std::unordered_map<std::string, ReadGroup> load_read_groups(
             std::string data_path,
             std::string model_path,
-            bool recursive_file_loading = false);
+            bool recursive_file_loading = false,
+            const DatasetShard& shard = {});
 
-    static int get_num_reads(
-            std::string data_path,
-            std::optional<std::unordered_set<std::string>> read_list = std::nullopt,
-            bool recursive_file_loading = false);
+    static int get_num_reads(std::string data_path,
+                             const std::optional<utils::ReadIdSet>& read_list = std::nullopt,
+                             bool recursive_file_loading = false,
+                             const DatasetShard& shard = {});
+
+    // The signal lengths of up to max_reads reads from the first record batches of the POD5
+    // files, read from their read tables without decoding any signal, e.g. to pick a chunk size
+    // for the run.  Empty if there are no POD5 files.
+    static std::vector<uint64_t> sample_read_lengths(std::string data_path,
+                                                     size_t max_reads,
+                                                     bool recursive_file_loading = false,
+                                                     const DatasetShard& shard = {});
 
-    static uint16_t get_sample_rate(std::string data_path, bool recursive_file_loading = false);
+    // Limits how far POD5 loading reads ahead of the reads being pushed to the sink:
+    // up to max_batches record batches are fetched and decoded in the background,
+    // provided their raw signal fits within memory_budget_bytes.
+    void set_prefetch_limits(size_t max_batches, size_t memory_budget_bytes) {
+        m_max_prefetch_batches = max_batches;
+        m_prefetch_memory_budget = memory_budget_bytes;
+    }
+
+    // Number of files loaded concurrently in UNRESTRICTED order.  Keeping several files
+    // open at once hides per-file open latency when there are many small files.
+    void set_max_concurrent_files(size_t max_concurrent_files) {
+        m_max_concurrent_files = std::max<size_t>(max_concurrent_files, 1);
+    }
+
+    // Has the files being loaded read into the page cache up to max_bytes_ahead ahead of the
+    // loaders, in large asynchronous spans, and, with drop_page_cache, dropped from it once
+    // they've been loaded.  See utils::FileReadahead.  Only files loaded in UNRESTRICTED order
+    // are read ahead.
+    void set_readahead(size_t max_bytes_ahead, bool drop_page_cache) {
+        m_readahead_bytes = max_bytes_ahead;
+        m_drop_page_cache = drop_page_cache;
+    }
+
+    // Reads which are left out, such as those a resumed run has already written.  They're
+    // dropped as the read tables are scanned, before any signal is decoded.
+    void set_skipped_read_ids(utils::ReadIdSet skipped_read_ids) {
+        m_skipped_read_ids = std::move(skipped_read_ids);
+    }
+
+    // Only the files in shard are loaded, or watched for.
+    void set_shard(const DatasetShard& shard) { m_shard = shard; }
+
+    // POD5 reads in signal_cache are loaded from it, already normalised, instead of being
+    // decompressed.
+    void set_signal_cache(std::shared_ptr<const utils::SignalCache> signal_cache) {
+        m_signal_cache = std::move(signal_cache);
+    }
+
+    // Reads in priority_read_ids, if given, or from any of priority_channels are loaded as
+    // priority reads, which overtake the rest through the pipeline.
+    void set_priority_reads(std::optional<utils::ReadIdSet> priority_read_ids,
+                            std::unordered_set<int32_t> priority_channels) {
+        m_priority_read_ids = std::move(priority_read_ids);
+        m_priority_channels = std::move(priority_channels);
+    }
+
+    // Reads with fewer than min_samples samples, too short to give reads long enough to keep,
+    // are dropped rather than sent on: POD5 reads before their signal is decoded.  None count
+    // towards the max reads limit.  on_dropped, if given, is called from the loading threads
+    // for each read dropped, e.g. to take it off a progress bar's total.
+    void set_min_signal_samples(size_t min_samples, std::function<void()> on_dropped = {}) {
+        m_min_signal_samples = min_samples;
+        m_on_short_read_dropped = std::move(on_dropped);
+    }
+    size_t num_short_reads_dropped() const { return m_num_short_reads_dropped; }
+
+    static uint16_t get_sample_rate(std::string data_path,
+                                    bool recursive_file_loading = false,
+                                    const DatasetShard& shard = {});
 
 private:
-    void load_fast5_reads_from_file(const std::string& path);
-    void load_pod5_reads_from_file(const std::string& path);
-    void load_pod5_reads_from_file_by_read_ids(const std::string& path,
-                                               const std::vector<ReadID>& read_ids);
-    void load_read_channels(std::string data_path, bool recursive_file_loading = false);
+    // Called with how many of a file's parts, its POD5 batches or FAST5 reads, have been
+    // loaded so far, and how many there are.
+    using FileProgress = std::function<void(size_t num_done, size_t num_parts)>;
+    void load_fast5_reads_from_file(const std::string& path, const FileProgress& progress = {});
+    void load_pod5_reads_from_file(const std::string& path, const FileProgress& progress = {});
+    // Where a read is in a POD5 file.
+    struct Pod5ReadLocation {
+        int32_t channel;
+        uint32_t batch;
+        uint32_t row;
+    };
+    // Locates every read of the POD5 file at path, whose read table is table, that is in the
+    // read list, sorted by channel.
+    std::vector<Pod5ReadLocation> plan_channel_order(const std::string& path,
+                                                     const IndexedReadTable& table) const;
+    // Loads the reads at locations, which are sorted by batch and row, appending them to reads.
+    void load_pod5_reads_by_location(const std::string& path,
+                                     const std::vector<Pod5ReadLocation>& locations,
+                                     std::vector<std::shared_ptr<Read>>& reads);
+    // Loads every POD5 file in data_path, with the reads of each channel pushed before those of
+    // the next.
+    void load_reads_by_channel(const std::string& data_path, bool recursive_file_loading);
+    void load_files(const std::vector<std::string>& paths);
+    // Whether file, under data_path, is in this loader's shard.
+    bool in_shard(const std::string& data_path, const std::filesystem::path& file) const;
+    // Claims one of the max_reads slots.  Returns false once max_reads have been claimed.
+    bool reserve_read();
+    // Whether the read is in the read list, if there is one, and isn't skipped.
+    template <typename ReadId>
+    bool is_wanted(const ReadId& read_id) const {
+        return (!m_allowed_read_ids || m_allowed_read_ids->contains(read_id)) &&
+               !m_skipped_read_ids.contains(read_id);
+    }
+    // Reserves the read's memory from the host memory budget, waiting until it's available,
+    // and passes the read on.
+    void send_read(std::shared_ptr<Read> read);
+    // Counts a read too short to send on.
+    void drop_short_read();
     MessageSink& m_read_sink;  // Where should the loaded reads go?
-    size_t m_loaded_read_count{0};
+    std::atomic<size_t> m_loaded_read_count{0};
+    std::atomic<size_t> m_num_reserved_reads{0};
     std::string m_device;
     size_t m_num_worker_threads{1};
     size_t m_max_reads{0};
-    std::optional<std::unordered_set<std::string>> m_allowed_read_ids;
-
-    std::unordered_map<std::string, channel_to_read_id_t> m_file_channel_read_order_map;
-    int m_max_channel{0};
+    std::optional<utils::ReadIdSet> m_allowed_read_ids;
+    utils::ReadIdSet m_skipped_read_ids;
+    DatasetShard m_shard;
+    std::shared_ptr<const utils::SignalCache> m_signal_cache;
+    std::optional<utils::ReadIdSet> m_priority_read_ids;
+    std::unordered_set<int32_t> m_priority_channels;
+    size_t m_max_prefetch_batches{2};
+    size_t m_prefetch_memory_budget{size_t(1) << 30};
+    size_t m_max_concurrent_files{1};
+    size_t m_readahead_bytes{0};
+    bool m_drop_page_cache{false};
+    size_t m_min_signal_samples{0};
+    std::atomic<size_t> m_num_short_reads_dropped{0};
+    std::function<void()> m_on_short_read_dropped;
 };
 
 }  // namespace dorado
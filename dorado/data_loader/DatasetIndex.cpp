@@ -0,0 +1,447 @@
+#include "DatasetIndex.h"
+
+#include "pod5_format/c_api.h"
+#include "utils/FileLock.h"
+
+#include <highfive/H5Easy.hpp>
+#include <highfive/H5File.hpp>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+using namespace dorado;
+
+constexpr char kIndexMagic[8] = {'D', 'O', 'R', 'A', 'D', 'O', 'I', 'X'};
+constexpr uint32_t kIndexVersion = 1;
+
+template <typename T>
+void write_value(std::ostream& stream, const T& value) {
+    stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+T read_value(std::istream& stream) {
+    T value{};
+    stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+    return value;
+}
+
+void write_string(std::ostream& stream, const std::string& str) {
+    write_value(stream, static_cast<uint32_t>(str.size()));
+    stream.write(str.data(), str.size());
+}
+
+std::string read_string(std::istream& stream) {
+    const auto size = read_value<uint32_t>(stream);
+    std::string str;
+    if (stream) {
+        str.resize(size);
+        stream.read(str.data(), size);
+    }
+    return str;
+}
+
+// Summary fields of a file record.  The path is written separately, relative to the
+// data directory, so that the index survives the directory being moved.
+void write_summary(std::ostream& stream, const IndexedFile& file) {
+    write_value(stream, static_cast<uint8_t>(file.format));
+    write_value(stream, file.file_size);
+    write_value(stream, file.mtime);
+    write_value(stream, file.num_reads);
+    write_value(stream, file.sample_rate);
+    write_value(stream, static_cast<uint32_t>(file.runs.size()));
+    for (const auto& run : file.runs) {
+        write_string(stream, run.run_id);
+        write_string(stream, run.flowcell_id);
+        write_string(stream, run.device_id);
+        write_string(stream, run.sample_id);
+        write_value(stream, run.acquisition_start_time_ms);
+    }
+}
+
+void read_summary(std::istream& stream, IndexedFile& file) {
+    file.format = static_cast<IndexedFile::Format>(read_value<uint8_t>(stream));
+    file.file_size = read_value<uint64_t>(stream);
+    file.mtime = read_value<int64_t>(stream);
+    file.num_reads = read_value<uint64_t>(stream);
+    file.sample_rate = read_value<uint16_t>(stream);
+    const auto num_runs = read_value<uint32_t>(stream);
+    for (uint32_t i = 0; i < num_runs && stream; ++i) {
+        IndexedRunInfo run;
+        run.run_id = read_string(stream);
+        run.flowcell_id = read_string(stream);
+        run.device_id = read_string(stream);
+        run.sample_id = read_string(stream);
+        run.acquisition_start_time_ms = read_value<int64_t>(stream);
+        file.runs.push_back(std::move(run));
+    }
+}
+
+void write_table(std::ostream& stream, const IndexedReadTable& table) {
+    write_value(stream, static_cast<uint64_t>(table.read_ids.size()));
+    stream.write(reinterpret_cast<const char*>(table.read_ids.data()),
+                 table.read_ids.size() * sizeof(ReadID));
+    stream.write(reinterpret_cast<const char*>(table.channels.data()),
+                 table.channels.size() * sizeof(int32_t));
+}
+
+IndexedReadTable read_table_at(std::istream& stream) {
+    IndexedReadTable table;
+    const auto num_reads = read_value<uint64_t>(stream);
+    if (stream) {
+        table.read_ids.resize(num_reads);
+        table.channels.resize(num_reads);
+        stream.read(reinterpret_cast<char*>(table.read_ids.data()), num_reads * sizeof(ReadID));
+        stream.read(reinterpret_cast<char*>(table.channels.data()), num_reads * sizeof(int32_t));
+    }
+    return table;
+}
+
+// A file record from an existing index file.
+struct CachedFile {
+    IndexedFile file;
+    // Offset of the record's read table within the index file.
+    uint64_t table_offset{0};
+};
+
+// Reads the summaries in an existing index file, open in stream, keyed by path relative to the
+// data directory.  Returns an empty map if there's no usable index.
+std::map<std::string, CachedFile> read_index_file(std::istream& stream,
+                                                  const fs::path& index_path) {
+    std::map<std::string, CachedFile> cached_files;
+    if (!stream) {
+        return cached_files;
+    }
+
+    char magic[sizeof(kIndexMagic)];
+    stream.read(magic, sizeof(magic));
+    if (!stream || std::memcmp(magic, kIndexMagic, sizeof(magic)) != 0 ||
+        read_value<uint32_t>(stream) != kIndexVersion) {
+        spdlog::debug("Ignoring unrecognised index file {}", index_path.string());
+        return cached_files;
+    }
+
+    const auto num_files = read_value<uint64_t>(stream);
+    for (uint64_t i = 0; i < num_files && stream; ++i) {
+        auto relative_path = read_string(stream);
+        CachedFile cached;
+        read_summary(stream, cached.file);
+        cached.table_offset = stream.tellg();
+        const auto num_reads = read_value<uint64_t>(stream);
+        stream.seekg(num_reads * (sizeof(ReadID) + sizeof(int32_t)), std::ios::cur);
+        if (stream) {
+            cached_files.emplace(std::move(relative_path), std::move(cached));
+        }
+    }
+    if (!stream) {
+        spdlog::debug("Ignoring truncated index file {}", index_path.string());
+        cached_files.clear();
+    }
+    return cached_files;
+}
+
+// Collects all the metadata for a POD5 file in one pass.
+bool scan_pod5_file(const fs::path& path, IndexedFile& file, IndexedReadTable& table) {
+    pod5_init();
+
+    Pod5FileReader_t* reader = pod5_open_file(path.string().c_str());
+    if (!reader) {
+        spdlog::error("Failed to open file {}: {}", path.string(), pod5_get_error_string());
+        return false;
+    }
+
+    size_t read_count = 0;
+    pod5_get_read_count(reader, &read_count);
+    file.num_reads = read_count;
+
+    run_info_index_t run_info_count = 0;
+    pod5_get_file_run_info_count(reader, &run_info_count);
+    for (run_info_index_t idx = 0; idx < run_info_count; idx++) {
+        RunInfoDictData_t* run_info_data;
+        if (pod5_get_file_run_info(reader, idx, &run_info_data) != POD5_OK) {
+            spdlog::error("Failed to get run info {}: {}", idx, pod5_get_error_string());
+            continue;
+        }
+        if (idx == 0) {
+            file.sample_rate = run_info_data->sample_rate;
+        }
+        file.runs.push_back({run_info_data->acquisition_id, run_info_data->flow_cell_id,
+                             run_info_data->system_name, run_info_data->sample_id,
+                             run_info_data->acquisition_start_time_ms});
+        if (pod5_free_run_info(run_info_data) != POD5_OK) {
+            spdlog::error("Failed to free run info");
+        }
+    }
+
+    std::size_t batch_count = 0;
+    if (pod5_get_read_batch_count(&batch_count, reader) != POD5_OK) {
+        spdlog::error("Failed to query batch count: {}", pod5_get_error_string());
+    }
+    table.read_ids.reserve(read_count);
+    table.channels.reserve(read_count);
+    for (std::size_t batch_index = 0; batch_index < batch_count; ++batch_index) {
+        Pod5ReadRecordBatch_t* batch = nullptr;
+        if (pod5_get_read_batch(&batch, reader, batch_index) != POD5_OK) {
+            spdlog::error("Failed to get batch: {}", pod5_get_error_string());
+            continue;
+        }
+
+        std::size_t batch_row_count = 0;
+        if (pod5_get_read_batch_row_count(&batch_row_count, batch) != POD5_OK) {
+            spdlog::error("Failed to get batch row count");
+        }
+
+        for (std::size_t row = 0; row < batch_row_count; ++row) {
+            uint16_t read_table_version = 0;
+            ReadBatchRowInfo_t read_data;
+            if (pod5_get_read_batch_row_info_data(batch, row, READ_BATCH_ROW_INFO_VERSION,
+                                                  &read_data, &read_table_version) != POD5_OK) {
+                spdlog::error("Failed to get read {}", row);
+                continue;
+            }
+            ReadID read_id;
+            std::memcpy(read_id.data(), read_data.read_id, POD5_READ_ID_SIZE);
+            table.read_ids.push_back(read_id);
+            table.channels.push_back(read_data.channel);
+        }
+
+        if (pod5_free_read_batch(batch) != POD5_OK) {
+            spdlog::error("Failed to release batch");
+        }
+    }
+
+    if (pod5_close_and_free_reader(reader) != POD5_OK) {
+        spdlog::error("Failed to close and free POD5 reader");
+    }
+    return true;
+}
+
+bool scan_fast5_file(const fs::path& path, IndexedFile& file) {
+    H5Easy::File h5_file(path.string(), H5Easy::File::ReadOnly);
+    HighFive::Group reads = h5_file.getGroup("/");
+    file.num_reads = reads.getNumberObjects();
+
+    if (file.num_reads > 0) {
+        HighFive::Group read = reads.getGroup(reads.getObjectName(0));
+        HighFive::Group channel_id_group = read.getGroup("channel_id");
+        HighFive::Attribute sampling_rate_attr = channel_id_group.getAttribute("sampling_rate");
+
+        float sampling_rate;
+        sampling_rate_attr.read(sampling_rate);
+        file.sample_rate = static_cast<uint16_t>(sampling_rate);
+    }
+    return true;
+}
+
+}  // namespace
+
+namespace dorado {
+
+std::mutex DatasetIndex::s_indexes_mutex;
+std::map<DatasetIndex::Key, std::shared_ptr<const DatasetIndex>> DatasetIndex::s_indexes;
+
+std::shared_ptr<const DatasetIndex> DatasetIndex::get(const std::string& data_path,
+                                                      bool recursive_file_loading,
+                                                      const DatasetShard& shard) {
+    std::lock_guard lock(s_indexes_mutex);
+    auto& index = s_indexes[{data_path, recursive_file_loading, shard.index, shard.count}];
+    if (!index) {
+        std::shared_ptr<DatasetIndex> new_index(new DatasetIndex());
+        new_index->build(data_path, recursive_file_loading, shard);
+        index = std::move(new_index);
+    }
+    return index;
+}
+
+void DatasetIndex::clear_memory_cache() {
+    std::lock_guard lock(s_indexes_mutex);
+    s_indexes.clear();
+}
+
+void DatasetIndex::build(const std::string& data_path,
+                         bool recursive_file_loading,
+                         const DatasetShard& shard) {
+    const fs::path index_path = fs::path(data_path) / kIndexFileName;
+    // Kept open for reading the tables, which stay there even if another process replaces the
+    // index meanwhile.
+    auto index_stream = std::make_unique<std::ifstream>(index_path, std::ios::binary);
+    auto cached_files = read_index_file(*index_stream, index_path);
+
+    // Gather the input files, reusing cached metadata where it's still valid.
+    std::vector<std::string> relative_paths;
+    std::vector<std::optional<IndexedReadTable>> scanned_tables;
+    auto iterate_directory = [&](const auto& iterator_fn) {
+        for (const auto& entry : iterator_fn(data_path)) {
+            std::string ext = entry.path().extension().string();
+            std::transform(ext.begin(), ext.end(), ext.begin(),
+                           [](unsigned char c) { return std::tolower(c); });
+            if (ext != ".pod5" && ext != ".fast5") {
+                continue;
+            }
+
+            auto relative_path = entry.path().lexically_relative(data_path).generic_string();
+            if (!shard.contains(relative_path)) {
+                continue;
+            }
+
+            IndexedFile file;
+            file.path = entry.path();
+            file.format = ext == ".pod5" ? IndexedFile::Format::POD5 : IndexedFile::Format::FAST5;
+            std::error_code error;
+            file.file_size = fs::file_size(file.path, error);
+            file.mtime = fs::last_write_time(file.path, error).time_since_epoch().count();
+
+            auto cached = cached_files.find(relative_path);
+            if (cached != cached_files.end() && cached->second.file.format == file.format &&
+                cached->second.file.file_size == file.file_size &&
+                cached->second.file.mtime == file.mtime) {
+                cached->second.file.path = file.path;
+                m_files.push_back(cached->second.file);
+                m_table_offsets.push_back(cached->second.table_offset);
+                scanned_tables.emplace_back();
+            } else {
+                IndexedReadTable table;
+                const bool scanned = file.format == IndexedFile::Format::POD5
+                                             ? scan_pod5_file(file.path, file, table)
+                                             : scan_fast5_file(file.path, file);
+                if (!scanned) {
+                    continue;
+                }
+                m_files.push_back(std::move(file));
+                m_table_offsets.push_back(0);
+                scanned_tables.emplace_back(std::move(table));
+            }
+            relative_paths.push_back(std::move(relative_path));
+        }
+    };
+
+    if (recursive_file_loading) {
+        iterate_directory([](const auto& path) { return fs::recursive_directory_iterator(path); });
+    } else {
+        iterate_directory([](const auto& path) { return fs::directory_iterator(path); });
+    }
+
+    m_index_path = index_path;
+    m_index_stream = std::move(index_stream);
+    m_unsaved_tables = std::move(scanned_tables);
+    const bool up_to_date =
+            std::none_of(m_unsaved_tables.begin(), m_unsaved_tables.end(),
+                         [](const auto& table) { return table.has_value(); });
+    if (up_to_date) {
+        return;
+    }
+
+    // Write a new index file.  Cached records for files outside this traversal, e.g. in
+    // subdirectories of a non-recursive run or in other shards, are carried over.  Nodes
+    // indexing other shards of the same directory may be rewriting it too, so they take turns,
+    // each carrying over the records in the index as the last one left it.
+    std::unique_ptr<utils::FileLock> lock;
+    try {
+        lock = std::make_unique<utils::FileLock>(index_path.string() + ".lock");
+    } catch (const std::exception& e) {
+        spdlog::debug("Unable to lock index file {}, metadata won't be cached: {}",
+                      index_path.string(), e.what());
+        return;
+    }
+    auto latest_stream = std::make_unique<std::ifstream>(index_path, std::ios::binary);
+    auto latest_files = read_index_file(*latest_stream, index_path);
+    for (const auto& relative_path : relative_paths) {
+        latest_files.erase(relative_path);
+    }
+    const fs::path temp_index_path = index_path.string() + ".tmp";
+    std::vector<uint64_t> new_table_offsets(m_files.size());
+    {
+        std::ofstream out(temp_index_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            spdlog::debug("Unable to write index file {}, metadata won't be cached",
+                          index_path.string());
+            return;
+        }
+        out.write(kIndexMagic, sizeof(kIndexMagic));
+        write_value(out, kIndexVersion);
+        write_value(out, static_cast<uint64_t>(m_files.size() + latest_files.size()));
+
+        auto write_record = [&](const std::string& relative_path, const IndexedFile& file,
+                                const IndexedReadTable& table) {
+            write_string(out, relative_path);
+            write_summary(out, file);
+            const uint64_t table_offset = out.tellp();
+            write_table(out, table);
+            return table_offset;
+        };
+        bool old_tables_ok = true;
+        auto load_old_table = [&](std::istream& old_index, uint64_t table_offset) {
+            old_index.clear();
+            old_index.seekg(table_offset);
+            auto table = read_table_at(old_index);
+            old_tables_ok &= bool(old_index);
+            return table;
+        };
+
+        for (size_t i = 0; i < m_files.size(); ++i) {
+            const auto& table = m_unsaved_tables[i]
+                                        ? *m_unsaved_tables[i]
+                                        : load_old_table(*m_index_stream, m_table_offsets[i]);
+            new_table_offsets[i] = write_record(relative_paths[i], m_files[i], table);
+        }
+        for (const auto& [relative_path, cached] : latest_files) {
+            write_record(relative_path, cached.file,
+                         load_old_table(*latest_stream, cached.table_offset));
+        }
+
+        if (!out || !old_tables_ok) {
+            spdlog::debug("Failed writing index file {}, metadata won't be cached",
+                          index_path.string());
+            out.close();
+            fs::remove(temp_index_path);
+            return;
+        }
+    }
+
+    // Every table is in the new file now, and Windows won't replace a file which is open.
+    latest_stream.reset();
+    m_index_stream.reset();
+    std::error_code error;
+    fs::rename(temp_index_path, index_path, error);
+    if (error) {
+        // The tables are still read from the new file, which is removed once it's open where
+        // that's allowed.
+        spdlog::debug("Unable to replace index file {}: {}", index_path.string(),
+                      error.message());
+        m_index_stream = std::make_unique<std::ifstream>(temp_index_path, std::ios::binary);
+        fs::remove(temp_index_path, error);
+    } else {
+        // Opened before the lock is released, so that it's this index, with these offsets.
+        m_index_stream = std::make_unique<std::ifstream>(index_path, std::ios::binary);
+    }
+    m_table_offsets = std::move(new_table_offsets);
+    m_unsaved_tables.assign(m_files.size(), std::nullopt);
+}
+
+IndexedReadTable DatasetIndex::read_table(size_t file_index) const {
+    if (m_unsaved_tables[file_index]) {
+        return *m_unsaved_tables[file_index];
+    }
+    std::lock_guard lock(m_index_stream_mutex);
+    auto& stream = *m_index_stream;
+    stream.clear();
+    stream.seekg(m_table_offsets[file_index]);
+    auto table = read_table_at(stream);
+    if (!stream) {
+        throw std::runtime_error("Failed to read index file " + m_index_path.string());
+    }
+    return table;
+}
+
+}  // namespace dorado
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "DataLoader.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace dorado {
+
+// Run level metadata for a POD5 file, from which read groups are built.
+struct IndexedRunInfo {
+    std::string run_id;
+    std::string flowcell_id;
+    std::string device_id;
+    std::string sample_id;
+    int64_t acquisition_start_time_ms{0};
+};
+
+// Read IDs and channels of every read in a POD5 file, in file order.
+struct IndexedReadTable {
+    std::vector<ReadID> read_ids;
+    std::vector<int32_t> channels;
+};
+
+// Metadata for one input file.
+struct IndexedFile {
+    enum class Format : uint8_t { POD5, FAST5 };
+
+    std::filesystem::path path;
+    Format format{Format::POD5};
+    // Used to detect files which have changed since they were indexed.
+    uint64_t file_size{0};
+    int64_t mtime{0};
+
+    uint64_t num_reads{0};
+    // 0 if the sample rate couldn't be determined.
+    uint16_t sample_rate{0};
+    std::vector<IndexedRunInfo> runs;
+};
+
+// Metadata for every POD5 and FAST5 file under a data directory, gathered so that the
+// CLI setup queries (read counts, read groups, sample rate and channel ordering) don't
+// each have to rescan the input.
+// The index is cached on disk in a sidecar file in the data directory, keyed by each
+// file's path, size and modification time, and reused by later invocations.  Files
+// missing from the cache, or which have changed, are scanned in a single pass that
+// collects all of their metadata at once.  If the data directory isn't writable the
+// index is still built, but only kept for the lifetime of the process.
+class DatasetIndex {
+public:
+    static constexpr const char* kIndexFileName = ".dorado_index";
+
+    // Returns the index for the data directory, building and caching it if necessary.
+    // Indexes are also cached in memory, so repeated calls are cheap.  Only the files in shard
+    // are listed, and files outside it are never opened.
+    static std::shared_ptr<const DatasetIndex> get(const std::string& data_path,
+                                                   bool recursive_file_loading,
+                                                   const DatasetShard& shard = {});
+    // Drops the indexes cached in memory, so that later calls to get() pick up files
+    // which have appeared or changed since.  The on disk index is kept.
+    static void clear_memory_cache();
+
+    // Input files, in directory iteration order.
+    const std::vector<IndexedFile>& files() const { return m_files; }
+
+    // Loads the read table of files()[file_index].  Tables aren't held in memory, since
+    // they're only needed for channel ordered loading and can be very large.
+    IndexedReadTable read_table(size_t file_index) const;
+
+private:
+    static std::mutex s_indexes_mutex;
+    using Key = std::tuple<std::string, bool, size_t, size_t>;
+    static std::map<Key, std::shared_ptr<const DatasetIndex>> s_indexes;
+
+    DatasetIndex() = default;
+    void build(const std::string& data_path,
+               bool recursive_file_loading,
+               const DatasetShard& shard);
+
+    std::vector<IndexedFile> m_files;
+    // Where each file's read table can be found in the index file.
+    std::vector<uint64_t> m_table_offsets;
+    std::filesystem::path m_index_path;
+    // The index file the offsets are in, kept open in case another process replaces it.
+    std::unique_ptr<std::ifstream> m_index_stream;
+    mutable std::mutex m_index_stream_mutex;
+    // Tables for files which couldn't be written to the index file, indexed as m_files.
+    std::vector<std::optional<IndexedReadTable>> m_unsaved_tables;
+};
+
+}  // namespace dorado
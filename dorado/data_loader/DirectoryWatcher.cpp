@@ -0,0 +1,286 @@
+#include "DirectoryWatcher.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// How long ago path was last modified, or nothing if it can't be told.
+std::optional<fs::file_time_type::duration> time_since_modified(const fs::path& path) {
+    std::error_code error;
+    const auto mtime = fs::last_write_time(path, error);
+    if (error) {
+        return std::nullopt;
+    }
+    return fs::file_time_type::clock::now() - mtime;
+}
+
+template <typename Fn>
+void for_each_file(const fs::path& path, bool recursive, Fn&& fn) {
+    std::error_code error;
+    auto visit = [&](const fs::directory_entry& entry) {
+        std::error_code file_error;
+        if (entry.is_regular_file(file_error)) {
+            fn(entry.path());
+        }
+    };
+    if (recursive) {
+        for (const auto& entry : fs::recursive_directory_iterator(path, error)) {
+            visit(entry);
+        }
+    } else {
+        for (const auto& entry : fs::directory_iterator(path, error)) {
+            visit(entry);
+        }
+    }
+}
+
+}  // namespace
+
+namespace dorado {
+
+#ifdef __linux__
+
+DirectoryWatcher::DirectoryWatcher(const std::string& path, bool recursive)
+        : m_path(path), m_recursive(recursive) {
+    m_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotify_fd < 0) {
+        throw std::runtime_error("Failed to initialise inotify: " +
+                                 std::string(std::strerror(errno)));
+    }
+    add_watch(m_path);
+    if (m_recursive) {
+        for (const auto& entry : fs::recursive_directory_iterator(m_path)) {
+            if (entry.is_directory()) {
+                add_watch(entry.path());
+            }
+        }
+    }
+}
+
+DirectoryWatcher::~DirectoryWatcher() { close(m_inotify_fd); }
+
+void DirectoryWatcher::add_watch(const fs::path& dir) {
+    // Modifications only matter for the held files, but can't be watched per file without a
+    // watch each.
+    const int wd = inotify_add_watch(
+            m_inotify_fd, dir.c_str(),
+            IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_MODIFY | IN_ONLYDIR);
+    if (wd < 0) {
+        spdlog::warn("Unable to watch directory {}: {}", dir.string(), std::strerror(errno));
+        return;
+    }
+    m_watched_dirs[wd] = dir;
+}
+
+void DirectoryWatcher::read_events() {
+    alignas(inotify_event) char buffer[4096];
+    while (true) {
+        const ssize_t length = read(m_inotify_fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            // EAGAIN: no more events.
+            return;
+        }
+        for (char* ptr = buffer; ptr < buffer + length;) {
+            const auto* event = reinterpret_cast<const inotify_event*>(ptr);
+            ptr += sizeof(inotify_event) + event->len;
+
+            auto dir = m_watched_dirs.find(event->wd);
+            if (dir == m_watched_dirs.end() || event->len == 0) {
+                continue;
+            }
+            const fs::path path = dir->second / event->name;
+
+            if (event->mask & IN_ISDIR) {
+                if (m_recursive && (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+                    add_watch(path);
+                    // Anything written before the watch was added would otherwise be missed.
+                    std::error_code error;
+                    for (const auto& entry : fs::recursive_directory_iterator(path, error)) {
+                        if (entry.is_directory()) {
+                            add_watch(entry.path());
+                        } else {
+                            m_pending_files.push_back(entry.path());
+                        }
+                    }
+                }
+            } else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                m_held_files.erase(path);
+                m_pending_files.push_back(path);
+            } else if (event->mask & IN_MODIFY) {
+                if (auto held = m_held_files.find(path); held != m_held_files.end()) {
+                    held->second = std::chrono::steady_clock::now();
+                }
+            }
+        }
+    }
+}
+
+void DirectoryWatcher::release_settled_files() {
+    const auto now = std::chrono::steady_clock::now();
+    for (auto held = m_held_files.begin(); held != m_held_files.end();) {
+        if (now - held->second >= m_settle_time) {
+            spdlog::debug("> {} is unchanged for {}ms, taking it as finished",
+                          held->first.string(), m_settle_time.count());
+            m_pending_files.push_back(held->first);
+            held = m_held_files.erase(held);
+        } else {
+            ++held;
+        }
+    }
+}
+
+std::vector<fs::path> DirectoryWatcher::existing_files(std::chrono::milliseconds settle_time) {
+    m_settle_time = settle_time;
+    // Events queued since construction would otherwise arrive after the files are sorted,
+    // and could report a file which is about to be returned here.
+    read_events();
+    std::vector<fs::path> files;
+    for_each_file(m_path, m_recursive, [&](const fs::path& file) {
+        const auto age = time_since_modified(file);
+        if (age && *age >= settle_time) {
+            files.push_back(file);
+        } else {
+            // Settling is timed from now, as when it was last modified can't be trusted
+            // across clocks.
+            m_held_files[file] = std::chrono::steady_clock::now();
+        }
+    });
+    // Files closed meanwhile are already finished, and files among the pending ones are
+    // returned rather than reported twice.
+    for (auto pending = m_pending_files.begin(); pending != m_pending_files.end();) {
+        const auto returned = std::find(files.begin(), files.end(), *pending);
+        if (returned != files.end()) {
+            pending = m_pending_files.erase(pending);
+        } else {
+            m_held_files.erase(*pending);
+            ++pending;
+        }
+    }
+    return files;
+}
+
+std::optional<fs::path> DirectoryWatcher::next_file(std::chrono::milliseconds timeout) {
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    release_settled_files();
+    while (m_pending_files.empty()) {
+        const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0) {
+            return std::nullopt;
+        }
+        // Held files settle without any event, so they're checked at least every second.
+        auto wait = remaining;
+        if (!m_held_files.empty()) {
+            wait = std::min<std::chrono::milliseconds>(wait, std::chrono::seconds(1));
+        }
+        pollfd fds{m_inotify_fd, POLLIN, 0};
+        if (poll(&fds, 1, static_cast<int>(wait.count())) > 0) {
+            read_events();
+        }
+        release_settled_files();
+    }
+    auto file = std::move(m_pending_files.front());
+    m_pending_files.pop_front();
+    return file;
+}
+
+#else  // __linux__
+
+DirectoryWatcher::DirectoryWatcher(const std::string& path, bool recursive)
+        : m_path(path), m_recursive(recursive) {
+    poll_directory();
+    // Files already present aren't reported.
+    for (auto& [file, state] : m_files) {
+        state.reported = true;
+    }
+    m_pending_files.clear();
+}
+
+DirectoryWatcher::~DirectoryWatcher() = default;
+
+std::vector<fs::path> DirectoryWatcher::existing_files(std::chrono::milliseconds settle_time) {
+    // Files still changing are reported by polling once they stop, as new files are.  Settling
+    // takes a poll interval here rather than settle_time.
+    std::vector<fs::path> files;
+    for (auto& [file, state] : m_files) {
+        const auto age = time_since_modified(file);
+        if (age && *age >= settle_time) {
+            files.push_back(file);
+        } else {
+            state.reported = false;
+        }
+    }
+    return files;
+}
+
+void DirectoryWatcher::poll_directory() {
+    auto check_file = [this](const fs::directory_entry& entry) {
+        std::error_code error;
+        if (!entry.is_regular_file(error)) {
+            return;
+        }
+        const auto size = entry.file_size(error);
+        const auto mtime = entry.last_write_time(error);
+        if (error) {
+            return;
+        }
+        auto [it, inserted] = m_files.try_emplace(entry.path());
+        auto& state = it->second;
+        if (inserted || state.size != size || state.mtime != mtime) {
+            state.size = size;
+            state.mtime = mtime;
+            state.reported = false;
+        } else if (!state.reported) {
+            // Unchanged since the last scan, so assume the writer has finished.
+            state.reported = true;
+            m_pending_files.push_back(entry.path());
+        }
+    };
+
+    std::error_code error;
+    if (m_recursive) {
+        for (const auto& entry : fs::recursive_directory_iterator(m_path, error)) {
+            check_file(entry);
+        }
+    } else {
+        for (const auto& entry : fs::directory_iterator(m_path, error)) {
+            check_file(entry);
+        }
+    }
+}
+
+std::optional<fs::path> DirectoryWatcher::next_file(std::chrono::milliseconds timeout) {
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (m_pending_files.empty()) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return std::nullopt;
+        }
+        std::this_thread::sleep_for(std::min<std::chrono::milliseconds>(
+                kPollInterval, std::chrono::duration_cast<std::chrono::milliseconds>(
+                                       deadline - std::chrono::steady_clock::now())));
+        poll_directory();
+    }
+    auto file = std::move(m_pending_files.front());
+    m_pending_files.pop_front();
+    return file;
+}
+
+#endif  // __linux__
+
+}  // namespace dorado
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace dorado {
+
+// Reports files that are finished being written to a directory, e.g. by a sequencer.
+// On Linux this uses inotify, and a file is reported once it is closed after writing
+// or moved into the directory.  Elsewhere the directory is polled, and a file is
+// reported once its size and modification time have stopped changing.
+// Only files which appear after construction are reported, other than those existing_files()
+// holds back.
+class DirectoryWatcher {
+public:
+    DirectoryWatcher(const std::string& path, bool recursive);
+    ~DirectoryWatcher();
+
+    DirectoryWatcher(const DirectoryWatcher&) = delete;
+    DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+
+    // Waits up to timeout for the next finished file.  Returns std::nullopt on timeout.
+    std::optional<std::filesystem::path> next_file(std::chrono::milliseconds timeout);
+
+    // The files already in the directory which haven't been modified for settle_time, so are
+    // taken to be finished.  The rest may still be being written, so are held back, and
+    // reported by next_file() once they're closed after writing, or once they've gone
+    // settle_time without being modified.
+    std::vector<std::filesystem::path> existing_files(std::chrono::milliseconds settle_time);
+
+private:
+    std::filesystem::path m_path;
+    bool m_recursive;
+    std::deque<std::filesystem::path> m_pending_files;
+
+#ifdef __linux__
+    void add_watch(const std::filesystem::path& dir);
+    void read_events();
+
+    // Reports the held files which have gone m_settle_time without being modified.
+    void release_settled_files();
+
+    int m_inotify_fd{-1};
+    std::unordered_map<int, std::filesystem::path> m_watched_dirs;
+    // Files which existing_files() held back, to when they were last modified.
+    std::map<std::filesystem::path, std::chrono::steady_clock::time_point> m_held_files;
+    std::chrono::milliseconds m_settle_time{0};
+#else
+    struct FileState {
+        uintmax_t size{0};
+        std::filesystem::file_time_type mtime;
+        bool reported{false};
+    };
+    void poll_directory();
+
+    // Interval between directory scans, which is also how long a file must be
+    // unchanged for before it's considered finished.
+    static constexpr std::chrono::milliseconds kPollInterval{1000};
+    std::map<std::filesystem::path, FileState> m_files;
+#endif
+};
+
+}  // namespace dorado
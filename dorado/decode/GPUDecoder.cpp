@@ -3,6 +3,7 @@
 #include "Decoder.h"
 
 #include <c10/cuda/CUDAGuard.h>
+#include <cuda_runtime_api.h>
 #include <nvtx3/nvtx3.hpp>
 #include <torch/torch.h>
 
@@ -10,9 +11,28 @@ extern "C" {
 #include "koi.h"
 }
 
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+constexpr int64_t kCompactHeaderBytes = 2 * sizeof(int32_t);
+constexpr int kMaxCompactQscore = 63;
+
+int64_t packed_moves_bytes(int64_t T) { return (T + 7) / 8; }
+
+}  // namespace
+
 namespace dorado {
 
-torch::Tensor GPUDecoder::gpu_part(torch::Tensor scores, int num_chunks, DecoderOptions options) {
+int64_t GPUDecoder::compact_chunk_bytes(int64_t T) {
+    return kCompactHeaderBytes + packed_moves_bytes(T) + T;
+}
+
+torch::Tensor GPUDecoder::gpu_part(torch::Tensor scores,
+                                   int num_chunks,
+                                   DecoderOptions options,
+                                   torch::Tensor output) {
     nvtx3::scoped_range loop{"gpu_decode"};
     long int N = scores.sizes()[0];
     long int T = scores.sizes()[1];
@@ -26,31 +46,65 @@ torch::Tensor GPUDecoder::gpu_part(torch::Tensor scores, int num_chunks, Decoder
     auto tensor_options_int8 =
             torch::TensorOptions().dtype(torch::kInt8).device(scores.device()).requires_grad(false);
 
-    if (!initialized) {
-        chunks = torch::empty({N, 4}, tensor_options_int32);
-        chunks.index({torch::indexing::Slice(), 0}) = torch::arange(0, int(T * N), int(T));
-        chunks.index({torch::indexing::Slice(), 2}) = torch::arange(0, int(T * N), int(T));
-        chunks.index({torch::indexing::Slice(), 1}) = int(T);
-        chunks.index({torch::indexing::Slice(), 3}) = 0;
-
-        chunk_results = torch::empty({N, 8}, tensor_options_int32);
-
-        chunk_results = chunk_results.contiguous();
-
-        aux = torch::empty(N * (T + 1) * (C + 4 * options.beam_width), tensor_options_int8);
-        path = torch::zeros(N * (T + 1), tensor_options_int32);
-
-        moves_sequence_qstring = torch::zeros({3, N * T}, tensor_options_int8);
-
-        initialized = true;
+    c10::cuda::CUDAGuard device_guard(scores.device());
+    auto &full = buffers[T];
+    if (full.num_rows < N) {
+        // Partial batches are decoded in views of the buffers of the full batch, rather than
+        // buffers of their own, which the batch size calibration doesn't leave room for.
+        // The buffers are only replaced by larger ones, once no copy is reading the old.
+        m_copy_done.synchronize();
+        const int64_t num_rows = std::max<int64_t>(N, full.num_rows);
+        full.num_rows = num_rows;
+        full.chunks = torch::empty({num_rows, 4}, tensor_options_int32);
+        full.chunks.index({torch::indexing::Slice(), 0}) =
+                torch::arange(0, int(T * num_rows), int(T));
+        full.chunks.index({torch::indexing::Slice(), 2}) =
+                torch::arange(0, int(T * num_rows), int(T));
+        full.chunks.index({torch::indexing::Slice(), 1}) = int(T);
+        full.chunks.index({torch::indexing::Slice(), 3}) = 0;
+
+        full.chunk_results = torch::empty({num_rows, 8}, tensor_options_int32);
+
+        full.aux = torch::empty(num_rows * (T + 1) * (C + 4 * options.beam_width),
+                                tensor_options_int8);
+        full.path = torch::zeros(num_rows * (T + 1), tensor_options_int32);
+
+        full.moves_sequence_qstring = torch::zeros({3, num_rows * T}, tensor_options_int8);
+        full.compact_results = torch::Tensor();
+        full.move_bit_values = torch::tensor({1, 2, 4, 8, 16, 32, 64, 128},
+                                             tensor_options_int8.dtype(torch::kUInt8));
     }
+    if (!output.defined() && !full.compact_results.defined()) {
+        full.compact_results = torch::empty({full.num_rows, compact_chunk_bytes(T)},
+                                            tensor_options_int8.dtype(torch::kUInt8));
+    }
+    // Each chunk's part of the buffers is at the same offset whatever the batch size, so a
+    // partial batch uses the first N chunks' parts.
+    const auto chunks = full.chunks.narrow(0, 0, N);
+    const auto chunk_results = full.chunk_results.narrow(0, 0, N);
+    const auto aux = full.aux.narrow(0, 0, N * (T + 1) * (C + 4 * options.beam_width));
+    const auto path = full.path.narrow(0, 0, N * (T + 1));
+    const auto &move_bit_values = full.move_bit_values;
+
+    auto stream = c10::cuda::getDefaultCUDAStream(scores.device().index());
+    // The compaction's torch ops have to be queued after the decode kernels.
+    c10::cuda::CUDAStreamGuard stream_guard(stream);
+    auto compact = full.compact_results;
+    if (output.defined()) {
+        compact = output;
+    } else {
+        // The last batch's results may still be being copied out of the buffers.
+        m_copy_done.block(stream);
+    }
+    // Moves, sequence and qstring each take the first N * T of their row of the full buffer.
+    auto results = full.moves_sequence_qstring.narrow(1, 0, N * T);
+    for (int64_t row = 0; row < results.size(0); ++row) {
+        cudaMemsetAsync(results[row].data_ptr(), 0, N * T, stream.stream());
+    }
+    auto moves = results[0];
+    auto sequence = results[1];
+    auto qstring = results[2];
 
-    moves_sequence_qstring.index({torch::indexing::Slice()}) = 0.0;
-    auto moves = moves_sequence_qstring[0];
-    auto sequence = moves_sequence_qstring[1];
-    auto qstring = moves_sequence_qstring[2];
-
-    c10::cuda::CUDAGuard device_guard(scores.device());
     host_back_guide_step(chunks.data_ptr(), chunk_results.data_ptr(), N, scores.data_ptr(), C,
                          aux.data_ptr(), path.data_ptr(), moves.data_ptr(), NULL,
                          sequence.data_ptr(), qstring.data_ptr(), options.q_scale, options.q_shift,
@@ -72,28 +126,96 @@ torch::Tensor GPUDecoder::gpu_part(torch::Tensor scores, int num_chunks, Decoder
                     qstring.data_ptr(), options.q_scale, options.q_shift, options.beam_width,
                     options.beam_cut, options.blank_score, options.move_pad);
 
-    return moves_sequence_qstring.reshape({3, N, -1});
+    // Only the chunks' rows are compacted, and the sequence and qstring only up to each
+    // chunk's number of bases are read back.
+    nvtx3::scoped_range compact_range{"gpu_decode_compact"};
+    compact = compact.narrow(0, 0, num_chunks);
+    const auto moves_u8 = results[0].view({N, T}).narrow(0, 0, num_chunks).view(torch::kUInt8);
+    const auto sequence_u8 = results[1].view({N, T}).narrow(0, 0, num_chunks).view(torch::kUInt8);
+    const auto qstring_u8 = results[2].view({N, T}).narrow(0, 0, num_chunks).view(torch::kUInt8);
+    compact_rows(moves_u8, sequence_u8, qstring_u8, move_bit_values, compact);
+    return compact;
+}
+
+void GPUDecoder::compact_rows(const torch::Tensor &moves,
+                              const torch::Tensor &sequence,
+                              const torch::Tensor &qstring,
+                              const torch::Tensor &move_bit_values,
+                              torch::Tensor compact) {
+    const int64_t num_chunks = moves.size(0);
+    const int64_t T = moves.size(1);
+
+    auto header = torch::empty({num_chunks, 2}, moves.options().dtype(torch::kInt32));
+    header.select(1, 0).copy_(moves.sum({1}, false, torch::kInt32));
+    header.select(1, 1).fill_(int(T));
+    // Viewed as bytes, the [num_chunks, 2] int32s are [num_chunks, kCompactHeaderBytes].
+    compact.narrow(1, 0, kCompactHeaderBytes).copy_(header.view(torch::kUInt8));
+
+    const int64_t packed_T = packed_moves_bytes(T);
+    const auto padded_moves = torch::constant_pad_nd(moves, {0, packed_T * 8 - T});
+    compact.narrow(1, kCompactHeaderBytes, packed_T)
+            .copy_((padded_moves.view({num_chunks, packed_T, 8}) * move_bit_values)
+                           .sum(2, false, torch::kUInt8));
+
+    // The bases are ASCII, and their code is base_to_int's.
+    const auto base_codes = torch::bitwise_and(
+            torch::bitwise_xor(torch::bitwise_right_shift(sequence, 2),
+                               torch::bitwise_right_shift(sequence, 1)),
+            3);
+    const auto qscores = (qstring.clamp_min(33) - 33).clamp_max(kMaxCompactQscore);
+    compact.narrow(1, kCompactHeaderBytes + packed_T, T)
+            .copy_(torch::bitwise_or(base_codes, qscores * 4));
+}
+
+void GPUDecoder::copy_to_host(const torch::Tensor &compact_results,
+                              torch::Tensor &output,
+                              at::cuda::CUDAEvent &output_ready) {
+    const auto device_index = compact_results.device().index();
+    if (!m_stream) {
+        m_stream = c10::cuda::getStreamFromPool(false, device_index);
+    }
+    // The copy has to wait for the decode kernels.
+    at::cuda::CUDAEvent decode_done;
+    decode_done.record(c10::cuda::getDefaultCUDAStream(device_index));
+    decode_done.block(*m_stream);
+    {
+        c10::cuda::CUDAStreamGuard stream_guard(*m_stream);
+        output.narrow(0, 0, compact_results.size(0))
+                .copy_(compact_results, /*non_blocking=*/true);
+    }
+    m_copy_done.record(*m_stream);
+    output_ready.record(*m_stream);
 }
 
-std::vector<DecodedChunk> GPUDecoder::cpu_part(torch::Tensor moves_sequence_qstring_cpu) {
+std::vector<DecodedChunk> GPUDecoder::cpu_part(torch::Tensor compact_results_cpu) {
     nvtx3::scoped_range loop{"cpu_decode"};
-    assert(moves_sequence_qstring_cpu.device() == torch::kCPU);
-    auto moves_cpu = moves_sequence_qstring_cpu[0];
-    auto sequence_cpu = moves_sequence_qstring_cpu[1];
-    auto qstring_cpu = moves_sequence_qstring_cpu[2];
-    int N = moves_cpu.size(0);
-    int T = moves_cpu.size(1);
+    assert(compact_results_cpu.device() == torch::kCPU);
+    assert(compact_results_cpu.is_contiguous());
+    static constexpr char kBases[] = "ACGT";
+    const int64_t N = compact_results_cpu.size(0);
+    const int64_t row_bytes = compact_results_cpu.size(1);
+    const auto *const rows = compact_results_cpu.data_ptr<uint8_t>();
 
     std::vector<DecodedChunk> called_chunks;
-
-    for (int idx = 0; idx < N; idx++) {
-        std::vector<uint8_t> mov((uint8_t *)moves_cpu[idx].data_ptr(),
-                                 (uint8_t *)moves_cpu[idx].data_ptr() + T);
-        auto num_bases = moves_cpu[idx].sum().item<int>();
-        std::string seq((char *)sequence_cpu[idx].data_ptr(),
-                        (char *)sequence_cpu[idx].data_ptr() + num_bases);
-        std::string qstr((char *)qstring_cpu[idx].data_ptr(),
-                         (char *)qstring_cpu[idx].data_ptr() + num_bases);
+    called_chunks.reserve(N);
+    for (int64_t idx = 0; idx < N; idx++) {
+        const uint8_t *const row = rows + idx * row_bytes;
+        int32_t header[2];
+        std::memcpy(header, row, sizeof(header));
+        const auto [num_bases, T] = header;
+        const uint8_t *const packed_moves = row + kCompactHeaderBytes;
+        const uint8_t *const bases = packed_moves + packed_moves_bytes(T);
+
+        std::vector<uint8_t> mov(T);
+        for (int32_t t = 0; t < T; ++t) {
+            mov[t] = (packed_moves[t / 8] >> (t % 8)) & 1;
+        }
+        std::string seq(num_bases, ' ');
+        std::string qstr(num_bases, ' ');
+        for (int32_t i = 0; i < num_bases; ++i) {
+            seq[i] = kBases[bases[i] & 3];
+            qstr[i] = static_cast<char>((bases[i] >> 2) + 33);
+        }
 
         called_chunks.emplace_back(DecodedChunk{std::move(seq), std::move(qstr), std::move(mov)});
     }
@@ -104,7 +226,7 @@ std::vector<DecodedChunk> GPUDecoder::cpu_part(torch::Tensor moves_sequence_qstr
 std::vector<DecodedChunk> GPUDecoder::beam_search(const torch::Tensor &scores,
                                                   int num_chunks,
                                                   const DecoderOptions &options) {
-    return cpu_part(gpu_part(scores, num_chunks, options));
+    return cpu_part(gpu_part(scores, num_chunks, options).cpu());
 }
 
 }  // namespace dorado
@@ -2,8 +2,14 @@
 
 #include "Decoder.h"
 
+#include <ATen/cuda/CUDAEvent.h>
+#include <c10/cuda/CUDAStream.h>
 #include <torch/torch.h>
 
+#include <cstdint>
+#include <map>
+#include <optional>
+
 namespace dorado {
 
 class GPUDecoder : Decoder {
@@ -16,16 +22,60 @@ public:
     // We split beam_search into two parts, the first one running on the GPU and the second
     // one on the CPU. While the second part is running we can submit more commands to the GPU
     // on another thread.
-    torch::Tensor gpu_part(torch::Tensor scores, int num_chunks, DecoderOptions options);
-    std::vector<DecodedChunk> cpu_part(torch::Tensor moves_sequence_qstring_cpu);
+    // koi launches the decode kernels on the default stream, so that's where the work is queued.
+    // The result is the first num_chunks chunks' calls, compacted on the device into a uint8
+    // [num_chunks, compact_chunk_bytes(T)] tensor so that little has to be copied to the host.
+    // If output is given, the device's view of mapped host memory of at least that shape, the
+    // result is written straight into it, as on an integrated GPU, and there's nothing to copy.
+    torch::Tensor gpu_part(torch::Tensor scores,
+                           int num_chunks,
+                           DecoderOptions options,
+                           torch::Tensor output = {});
+    // Queues the copy of gpu_part's result into the first rows of output, in pinned host memory,
+    // on the decoder's own stream, and records output_ready once it's done.  So work queued on
+    // the default stream after the decode doesn't wait for the copy, except the next gpu_part,
+    // which reuses the buffers.
+    void copy_to_host(const torch::Tensor &compact_results,
+                      torch::Tensor &output,
+                      at::cuda::CUDAEvent &output_ready);
+    // Reads each chunk's row of gpu_part's result, in host memory.
+    std::vector<DecodedChunk> cpu_part(torch::Tensor compact_results_cpu);
+
+    // A chunk of T timesteps' row of gpu_part's result: its number of bases and of moves, T, as
+    // int32s, then its moves packed 8 to a byte, the first in the lowest bit, then a byte per
+    // base, with the base's 2 bit code (ACGT) in the low bits and its qscore, capped at 63, in
+    // the upper 6.  So T / 8 + T + 8 bytes rather than the 3 * T of the dense decode.
+    static int64_t compact_chunk_bytes(int64_t T);
+
+    // Writes the rows of gpu_part's result into compact, [N, compact_chunk_bytes(T)] uint8s, from
+    // the dense decode's [N, T] uint8 moves, ASCII bases and ASCII qscores, padded with zeros
+    // after each chunk's bases.  move_bit_values is {1, 2, 4, ..., 128}.  The torch ops it runs
+    // work on any device, so it's public for testing on the CPU.
+    static void compact_rows(const torch::Tensor& moves,
+                             const torch::Tensor& sequence,
+                             const torch::Tensor& qstring,
+                             const torch::Tensor& move_bit_values,
+                             torch::Tensor compact);
 
 private:
-    torch::Tensor chunks;
-    torch::Tensor chunk_results;
-    torch::Tensor aux;
-    torch::Tensor path;
-    torch::Tensor moves_sequence_qstring;
-    bool initialized{false};
+    struct Buffers {
+        // The largest batch size they've been allocated for.
+        int64_t num_rows{0};
+        torch::Tensor chunks;
+        torch::Tensor chunk_results;
+        torch::Tensor aux;
+        torch::Tensor path;
+        torch::Tensor moves_sequence_qstring;
+        torch::Tensor compact_results;
+        torch::Tensor move_bit_values;
+    };
+    // Keyed by chunk length, since runners sharing a decoder can call different chunk sizes.
+    // Batches of any size up to a buffer's are decoded in it.
+    std::map<int64_t, Buffers> buffers;
+    // Created on first use, on the device being decoded on.
+    std::optional<c10::cuda::CUDAStream> m_stream;
+    // Recorded after the last copy out of the buffers.
+    at::cuda::CUDAEvent m_copy_done;
 };
 
 }  // namespace dorado
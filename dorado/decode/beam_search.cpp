@@ -2,6 +2,8 @@
 
 #include "fast_hash.h"
 
+#include "../utils/simd.h"
+
 #include <math.h>
 #include <spdlog/spdlog.h>
 #include <torch/torch.h>
@@ -17,10 +19,14 @@
 
 namespace {
 
+using dorado::utils::CpuDispatch;
+using dorado::utils::CpuIsa;
+
 // 16 bit state supports 7-mers with 4 bases.
 typedef int16_t state_t;
 
 const int num_bases = 4;
+static_assert(num_bases == 4, "Steps are hashed with chainfasthash64_x4, one lane per base");
 
 // This is the data we need to retain for the whole beam
 struct BeamElement {
@@ -44,7 +50,37 @@ float log_sum_exp(float x, float y, float t) {
     return fmaxf(x, y) + ((abs_diff < 17.0f) ? (log1pf(expf(-abs_diff)) * t) : 0.0f);
 }
 
-bool score_sort(const BeamFrontElement& a, const BeamFrontElement& b) { return a.score > b.score; }
+// Returns the number of scores >= threshold.
+size_t count_scores_at_least_generic(const float* const scores, size_t count, float threshold) {
+    size_t result = 0;
+    for (size_t i = 0; i < count; ++i) {
+        result += scores[i] >= threshold;
+    }
+    return result;
+}
+
+#if ENABLE_AVX2_IMPL
+__attribute__((target("avx2,popcnt"))) size_t count_scores_at_least_avx2(const float* const scores,
+                                                                         size_t count,
+                                                                         float threshold) {
+    const __m256 threshold_elems = _mm256_set1_ps(threshold);
+    size_t result = 0;
+    size_t i = 0;
+    // 8 comparisons per iteration, counted from the sign bits of the mask.
+    for (; i + 8 <= count; i += 8) {
+        const __m256 mask =
+                _mm256_cmp_ps(_mm256_loadu_ps(scores + i), threshold_elems, _CMP_GE_OQ);
+        result += _mm_popcnt_u32(static_cast<unsigned int>(_mm256_movemask_ps(mask)));
+    }
+    for (; i < count; ++i) {
+        result += scores[i] >= threshold;
+    }
+    return result;
+}
+#endif
+
+const CpuDispatch<decltype(count_scores_at_least_generic)> count_scores_at_least(
+        count_scores_at_least_generic, {{CpuIsa::AVX2, AVX2_KERNEL(count_scores_at_least_avx2)}});
 
 int get_num_states(size_t num_trans_states) {
 #ifdef REMOVE_FIXED_BEAM_STAYS
@@ -148,18 +184,28 @@ float beam_search(const T* const scores,
     std::vector<BeamFrontElement> beam_front_vector_2(max_beam_candidates);
     std::vector<BeamFrontElement>* current_beam_front = &beam_front_vector_1;
     std::vector<BeamFrontElement>* prev_beam_front = &beam_front_vector_2;
+    // Scores of the current beam front, packed together for the cutoff search.
+    std::vector<float> candidate_scores(max_beam_candidates);
+    // Open addressing table of step candidate indices + 1, keyed by hash, at most half full.
+    size_t step_hash_table_size = 1;
+    while (step_hash_table_size < 2 * num_bases * max_beam_width) {
+        step_hash_table_size *= 2;
+    }
+    std::vector<uint16_t> step_hash_table(step_hash_table_size);
+    const size_t step_hash_table_mask = step_hash_table_size - 1;
 
     // Find the score an initial element needs in order to make it into the beam
-    T beam_init_threshold = std::numeric_limits<T>::lowest();
+    // Back guides are floats whatever the type of the scores.
+    float beam_init_threshold = std::numeric_limits<float>::lowest();
     if (max_beam_width < num_states) {
         // Copy the first set of back guides and sort to extract max_beam_width highest elements
-        std::vector<T> sorted_back_guides(num_states);
-        memcpy(sorted_back_guides.data(), back_guide, num_states * sizeof(T));
+        std::vector<float> sorted_back_guides(num_states);
+        memcpy(sorted_back_guides.data(), back_guide, num_states * sizeof(float));
 
         // Note we don't need a full sort here to get the max_beam_width highest values
         std::nth_element(sorted_back_guides.begin(),
                          sorted_back_guides.begin() + max_beam_width - 1, sorted_back_guides.end(),
-                         std::greater<T>());
+                         std::greater<float>());
         beam_init_threshold = sorted_back_guides[max_beam_width - 1];
     }
 
@@ -242,15 +288,17 @@ float beam_search(const T* const scores,
         for (size_t prev_elem_idx = 0; prev_elem_idx < current_beam_width; prev_elem_idx++) {
             const auto& previous_element = (*prev_beam_front)[prev_elem_idx];
 
-            // Expand all the possible steps
+            // Expand all the possible steps, hashing all their states at once
+            const size_t first_new_state = (previous_element.state * num_bases) % num_states;
+            uint64_t new_hashes[num_bases];
+            chainfasthash64_x4(previous_element.hash, first_new_state, new_hashes);
             for (size_t new_base = 0; new_base < num_bases; new_base++) {
-                state_t new_state =
-                        state_t((previous_element.state * num_bases) % num_states + new_base);
+                state_t new_state = state_t(first_new_state + new_base);
                 const state_t move_idx = generate_move_index(previous_element.state, new_state,
                                                              num_bases, num_states);
                 float new_score = previous_element.score + fetch_block_score(move_idx) +
                                   static_cast<float>(block_back_scores[new_state]);
-                uint64_t new_hash = chainfasthash64(previous_element.hash, new_state);
+                uint64_t new_hash = new_hashes[new_base];
 
                 // Add new element to the candidate list
                 (*current_beam_front)[new_elem_count++] = {new_hash, new_score, new_state,
@@ -274,20 +322,34 @@ float beam_search(const T* const scores,
                                                        (uint8_t)prev_elem_idx, true};
         }
 
+        // Index the steps by hash, so that each stay is only compared with the steps which
+        // share its hash rather than with every step.
+        std::fill(step_hash_table.begin(), step_hash_table.end(), uint16_t(0));
+        const size_t num_steps = num_bases * current_beam_width;
+        for (size_t step_elem_idx = 0; step_elem_idx < num_steps; step_elem_idx++) {
+            size_t slot = (*current_beam_front)[step_elem_idx].hash & step_hash_table_mask;
+            while (step_hash_table[slot] != 0) {
+                slot = (slot + 1) & step_hash_table_mask;
+            }
+            step_hash_table[slot] = uint16_t(step_elem_idx + 1);
+        }
+
         // For each new stay, see if any steps result in the same sequence hash, and merge if so
         for (size_t prev_elem_idx = 0; prev_elem_idx < current_beam_width; prev_elem_idx++) {
             // The index of the stay in the beamfront
             size_t stay_elem_idx = num_bases * current_beam_width + prev_elem_idx;
             // latest base is in smallest bits
-            int stay_latest_base = int((*current_beam_front)[stay_elem_idx].state % num_bases);
-
-            // Go through all the possible step extensions that match this destination base with the stay and compare
-            //  their hashes, merging if we find any
-            for (size_t prev_elem_comp_idx = 0; prev_elem_comp_idx < current_beam_width;
-                 prev_elem_comp_idx++) {
-                size_t step_elem_idx = prev_elem_comp_idx * num_bases + stay_latest_base;
-                if ((*current_beam_front)[stay_elem_idx].hash ==
-                    (*current_beam_front)[step_elem_idx].hash) {
+            size_t stay_latest_base = (*current_beam_front)[stay_elem_idx].state % num_bases;
+            const uint64_t stay_hash = (*current_beam_front)[stay_elem_idx].hash;
+
+            // Go through the step extensions with this hash that match this destination base
+            //  with the stay, merging if we find any.  Steps with equal hashes were inserted in
+            //  order, so they're visited in order.
+            for (size_t slot = stay_hash & step_hash_table_mask; step_hash_table[slot] != 0;
+                 slot = (slot + 1) & step_hash_table_mask) {
+                const size_t step_elem_idx = step_hash_table[slot] - 1;
+                if (step_elem_idx % num_bases == stay_latest_base &&
+                    (*current_beam_front)[step_elem_idx].hash == stay_hash) {
                     if ((*current_beam_front)[stay_elem_idx].score >
                         (*current_beam_front)[step_elem_idx].score) {
                         // Fold the step into the stay
@@ -310,29 +372,27 @@ float beam_search(const T* const scores,
             }
         }
 
-        // There are now `new_elem_count` elements in the list.  Let's get the max
+        // There are now `new_elem_count` elements in the list.  Let's get the max, and pack
+        // the scores so the cutoff search below can count them without striding over the
+        // other fields.
         float max_score = -std::numeric_limits<float>::max();
         for (size_t elem_idx = 0; elem_idx < new_elem_count; elem_idx++) {
-            if ((*current_beam_front)[elem_idx].score > max_score)
-                max_score = (*current_beam_front)[elem_idx].score;
+            const float score = (*current_beam_front)[elem_idx].score;
+            candidate_scores[elem_idx] = score;
+            if (score > max_score)
+                max_score = score;
         }
 
         // Starting point for finding the cutoff score is the beam cut score
         float beam_cutoff_score = max_score - log_beam_cut;
 
-        auto get_elem_count = [](const std::vector<BeamFrontElement>* current_beam_front,
-                                 size_t new_elem_count, float beam_score) {
+        auto get_elem_count = [&candidate_scores, new_elem_count](float beam_score) {
             // Count the elements which meet the beam score
-            size_t count = 0;
-            for (size_t elem_idx = 0; elem_idx < new_elem_count; elem_idx++) {
-                if ((*current_beam_front)[elem_idx].score >= beam_score)
-                    count++;
-            }
-            return count;
+            return count_scores_at_least(candidate_scores.data(), new_elem_count, beam_score);
         };
 
         // Count the elements which meet the min score
-        size_t elem_count = get_elem_count(current_beam_front, new_elem_count, beam_cutoff_score);
+        size_t elem_count = get_elem_count(beam_cutoff_score);
 
         if (elem_count > max_beam_width) {
             // Need to find a score which doesn't return too many scores, but doesn't reduce beam width too much
@@ -353,7 +413,7 @@ float beam_search(const T* const scores,
                     hi_score = beam_cutoff_score;
                     beam_cutoff_score = (beam_cutoff_score + low_score) / 2.0f;  // binary search.
                 }
-                elem_count = get_elem_count(current_beam_front, new_elem_count, beam_cutoff_score);
+                elem_count = get_elem_count(beam_cutoff_score);
                 num_guesses++;
             }
             // If we made 10 guesses and didn't find a suitable score, a couple of things may have happened:
@@ -365,7 +425,7 @@ float beam_search(const T* const scores,
             //  - in this case we should just take the hi_score and accept it will return us less than 80% of the beam
             if (num_guesses == MAX_GUESSES) {
                 beam_cutoff_score = hi_score;
-                elem_count = get_elem_count(current_beam_front, new_elem_count, beam_cutoff_score);
+                elem_count = get_elem_count(beam_cutoff_score);
             }
         }
         // Clamp the element count to the max beam width in case of failure 2 from above.
@@ -373,7 +433,7 @@ float beam_search(const T* const scores,
 
         size_t write_idx = 0;
         for (unsigned int read_idx = 0; read_idx < new_elem_count; read_idx++) {
-            if ((*current_beam_front)[read_idx].score >= beam_cutoff_score) {
+            if (candidate_scores[read_idx] >= beam_cutoff_score) {
                 if (write_idx < max_beam_width) {
                     (*prev_beam_front)[write_idx] = (*current_beam_front)[read_idx];
                     write_idx++;
@@ -381,10 +441,15 @@ float beam_search(const T* const scores,
             }
         }
 
-        // At the last timestep, we need to sort the prev_beam_front as the best path needs to be at the start
-        // NOTE: We only want the top score out, so the cutoff is set to 1
-        if (block_idx == num_blocks - 1) {
-            merge_sort(prev_beam_front->data(), elem_count, 1, score_sort);
+        // At the last timestep, the best path needs to be at the start of prev_beam_front.
+        // Nothing else is read from the final beam, so there is no need to sort the rest.
+        if (block_idx == num_blocks - 1 && elem_count > 0) {
+            const auto best_elem = std::max_element(
+                    prev_beam_front->begin(), prev_beam_front->begin() + elem_count,
+                    [](const BeamFrontElement& a, const BeamFrontElement& b) {
+                        return a.score < b.score;
+                    });
+            std::iter_swap(prev_beam_front->begin(), best_elem);
         }
 
         size_t beam_offset = (block_idx + 1) * max_beam_width;
@@ -25,6 +25,8 @@
 
 #include "fast_hash.h"
 
+#include "../utils/simd.h"
+
 // Compression function for Merkle-Damgard construction.
 // This function is generated using the framework provided.
 static uint64_t mix(uint64_t h) {
@@ -106,4 +108,51 @@ uint64_t chainfasthash64(uint64_t hash, uint64_t val) {
     hash ^= mix(val);
     hash *= m;
     return mix(hash);
-}
\ No newline at end of file
+}
+
+static void chainfasthash64_x4_generic(uint64_t hash, uint64_t val, uint64_t out[4]) {
+    for (uint64_t i = 0; i < 4; ++i) {
+        out[i] = chainfasthash64(hash, val + i);
+    }
+}
+
+#if ENABLE_AVX2_IMPL
+// AVX2 has no 64 bit multiply, so build the low 64 bits of the product from 32 bit halves.
+__attribute__((target("avx2"))) static __m256i mul64(__m256i a, uint64_t b) {
+    const __m256i b_lo = _mm256_set1_epi64x((long long)(b & 0xffffffffULL));
+    const __m256i b_hi = _mm256_set1_epi64x((long long)(b >> 32));
+    const __m256i lo = _mm256_mul_epu32(a, b_lo);
+    const __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b_lo),
+                                           _mm256_mul_epu32(a, b_hi));
+    return _mm256_add_epi64(lo, _mm256_slli_epi64(cross, 32));
+}
+
+__attribute__((target("avx2"))) static __m256i mix(__m256i h) {
+    h = _mm256_xor_si256(h, _mm256_srli_epi64(h, 23));
+    h = mul64(h, 0x2127599bf4325c37ULL);
+    return _mm256_xor_si256(h, _mm256_srli_epi64(h, 47));
+}
+
+// One 64 bit lane per value.
+__attribute__((target("avx2"))) static void chainfasthash64_x4_avx2(uint64_t hash,
+                                                                    uint64_t val,
+                                                                    uint64_t out[4]) {
+    const uint64_t m = 0x880355f21e6d1965ULL;
+
+    const __m256i vals = _mm256_add_epi64(_mm256_set1_epi64x((long long)val),
+                                          _mm256_setr_epi64x(0, 1, 2, 3));
+    __m256i hashes = _mm256_xor_si256(_mm256_set1_epi64x((long long)hash), mix(vals));
+    hashes = mix(mul64(hashes, m));
+    _mm256_storeu_si256((__m256i *)out, hashes);
+}
+#endif
+
+using dorado::utils::CpuDispatch;
+using dorado::utils::CpuIsa;
+
+static const CpuDispatch<decltype(chainfasthash64_x4_generic)> chainfasthash64_x4_impl(
+        chainfasthash64_x4_generic, {{CpuIsa::AVX2, AVX2_KERNEL(chainfasthash64_x4_avx2)}});
+
+void chainfasthash64_x4(uint64_t hash, uint64_t val, uint64_t out[4]) {
+    chainfasthash64_x4_impl(hash, val, out);
+}
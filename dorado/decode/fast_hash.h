@@ -49,4 +49,12 @@ uint64_t fasthash64(const void *buf, size_t len, uint64_t seed);
  * @hash: Hash of previous data
  * @val:  New value to chain to hash
  */
-uint64_t chainfasthash64(uint64_t hash, uint64_t val);
\ No newline at end of file
+uint64_t chainfasthash64(uint64_t hash, uint64_t val);
+
+/**
+ * chainfasthash64_x4 - chain each of 4 consecutive values to the same hash
+ * @hash: Hash of previous data
+ * @val:  First value to chain; the rest are val + 1, val + 2 and val + 3
+ * @out:  chainfasthash64(hash, val + i) for each i
+ */
+void chainfasthash64_x4(uint64_t hash, uint64_t val, uint64_t out[4]);
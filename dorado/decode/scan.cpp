@@ -0,0 +1,357 @@
+#include "scan.h"
+
+#include "../utils/simd.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+
+namespace {
+
+using dorado::utils::CpuDispatch;
+using dorado::utils::CpuIsa;
+
+constexpr int kNumBases = 4;
+
+at::Tensor scan(const torch::Tensor& Ms,
+                const float fixed_stay_score,
+                const torch::Tensor& idx,
+                const torch::Tensor& v0) {
+    const int T = Ms.size(0);
+    const int N = Ms.size(1);
+    const int C = Ms.size(2);
+
+    torch::Tensor alpha = Ms.new_full({T + 1, N, C}, -1E38);
+    alpha[0] = v0;
+
+    for (int t = 0; t < T; t++) {
+        auto scored_steps = torch::add(alpha.index({t, torch::indexing::Slice(), idx}), Ms[t]);
+        auto scored_stay = torch::add(alpha.index({t, torch::indexing::Slice()}), fixed_stay_score)
+                                   .unsqueeze(-1);
+        auto scored_transitions = torch::cat({scored_stay, scored_steps}, -1);
+
+        alpha[t + 1] = torch::logsumexp(scored_transitions, -1);
+    }
+
+    return alpha;
+}
+
+float logsumexp5(const float (&x)[5]) {
+    const float max = *std::max_element(std::begin(x), std::end(x));
+    float sum = 0.f;
+    for (float value : x) {
+        sum += std::exp(value - max);
+    }
+    return max + std::log(sum);
+}
+
+// Within one timestep, state s = 4a + b can be reached by staying in s, or by stepping from
+// each of the states a + k * num_states / 4, scored by step_scores[4s + k].
+void forward_step_scalar(const float* const prev,
+                         const float* const step_scores,
+                         float fixed_stay_score,
+                         int num_states,
+                         float* const next) {
+    const int quarter = num_states / kNumBases;
+    for (int s = 0; s < num_states; ++s) {
+        const int pred = s / kNumBases;
+        const float* const m = step_scores + s * kNumBases;
+        next[s] = logsumexp5({prev[s] + fixed_stay_score, prev[pred] + m[0],
+                              prev[pred + quarter] + m[1], prev[pred + 2 * quarter] + m[2],
+                              prev[pred + 3 * quarter] + m[3]});
+    }
+}
+
+// The converse of the above: state s = k * num_states / 4 + r steps to each state 4r + j,
+// scored by step_scores[4(4r + j) + k].
+void backward_step_scalar(const float* const next,
+                          const float* const step_scores,
+                          float fixed_stay_score,
+                          int num_states,
+                          float* const prev) {
+    const int quarter = num_states / kNumBases;
+    for (int s = 0; s < num_states; ++s) {
+        const int k = s / quarter;
+        const int succ = (s % quarter) * kNumBases;
+        const float* const m = step_scores + succ * kNumBases + k;
+        prev[s] = logsumexp5({next[s] + fixed_stay_score, next[succ] + m[0],
+                              next[succ + 1] + m[kNumBases], next[succ + 2] + m[2 * kNumBases],
+                              next[succ + 3] + m[3 * kNumBases]});
+    }
+}
+
+#if ENABLE_AVX2_IMPL
+// Cephes-style exp, accurate to a couple of ulp.  Only used on arguments <= 0 here.
+__attribute__((target("avx2,fma"))) __m256 exp_ps(__m256 x) {
+    x = _mm256_max_ps(x, _mm256_set1_ps(-87.f));
+    const __m256 n = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504088896341f)),
+                                     _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    // x - n * ln(2), in two parts to keep precision.
+    x = _mm256_fnmadd_ps(n, _mm256_set1_ps(0.693359375f), x);
+    x = _mm256_fnmadd_ps(n, _mm256_set1_ps(-2.12194440e-4f), x);
+
+    __m256 y = _mm256_set1_ps(1.9875691500e-4f);
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.3981999507e-3f));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(8.3334519073e-3f));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(4.1665795894e-2f));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.6666665459e-1f));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(5.0000001201e-1f));
+    y = _mm256_fmadd_ps(y, _mm256_mul_ps(x, x), _mm256_add_ps(x, _mm256_set1_ps(1.f)));
+
+    // Multiply by 2^n by building its exponent bits.
+    const __m256i pow2n = _mm256_slli_epi32(
+            _mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(y, _mm256_castsi256_ps(pow2n));
+}
+
+// Cephes-style log, for the positive, normal arguments logsumexp gives it.
+__attribute__((target("avx2,fma"))) __m256 log_ps(__m256 x) {
+    const __m256i bits = _mm256_castps_si256(x);
+    // x = m * 2^e, with m in [0.5, 1).
+    __m256 e = _mm256_cvtepi32_ps(
+            _mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(126)));
+    __m256 m = _mm256_castsi256_ps(_mm256_or_si256(
+            _mm256_and_si256(bits, _mm256_set1_epi32(0x007fffff)), _mm256_set1_epi32(0x3f000000)));
+
+    // Shift m into [sqrt(0.5), sqrt(2)), and take 1 off.
+    const __m256 small = _mm256_cmp_ps(m, _mm256_set1_ps(0.707106781186547524f), _CMP_LT_OQ);
+    e = _mm256_sub_ps(e, _mm256_and_ps(small, _mm256_set1_ps(1.f)));
+    m = _mm256_add_ps(_mm256_sub_ps(m, _mm256_set1_ps(1.f)), _mm256_and_ps(small, m));
+
+    const __m256 z = _mm256_mul_ps(m, m);
+    __m256 y = _mm256_set1_ps(7.0376836292e-2f);
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(-1.1514610310e-1f));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(1.1676998740e-1f));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(-1.2420140846e-1f));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(1.4249322787e-1f));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(-1.6668057665e-1f));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(2.0000714765e-1f));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(-2.4999993993e-1f));
+    y = _mm256_fmadd_ps(y, m, _mm256_set1_ps(3.3333331174e-1f));
+    y = _mm256_mul_ps(_mm256_mul_ps(y, m), z);
+
+    y = _mm256_fmadd_ps(e, _mm256_set1_ps(-2.12194440e-4f), y);
+    y = _mm256_fnmadd_ps(z, _mm256_set1_ps(0.5f), y);
+    m = _mm256_add_ps(m, y);
+    return _mm256_fmadd_ps(e, _mm256_set1_ps(0.693359375f), m);
+}
+
+__attribute__((target("avx2,fma"))) __m256 logsumexp5(__m256 a,
+                                                      __m256 b,
+                                                      __m256 c,
+                                                      __m256 d,
+                                                      __m256 e) {
+    const __m256 max = _mm256_max_ps(_mm256_max_ps(_mm256_max_ps(a, b), _mm256_max_ps(c, d)), e);
+    __m256 sum = exp_ps(_mm256_sub_ps(a, max));
+    sum = _mm256_add_ps(sum, exp_ps(_mm256_sub_ps(b, max)));
+    sum = _mm256_add_ps(sum, exp_ps(_mm256_sub_ps(c, max)));
+    sum = _mm256_add_ps(sum, exp_ps(_mm256_sub_ps(d, max)));
+    sum = _mm256_add_ps(sum, exp_ps(_mm256_sub_ps(e, max)));
+    return _mm256_add_ps(max, log_ps(sum));
+}
+
+// Loads 8 rows of 4 floats, row i starting at src + i * row_stride, and returns the 4 columns.
+__attribute__((target("avx2,fma"))) void load_transposed_8x4(const float* const src,
+                                                             int row_stride,
+                                                             __m256 (&columns)[4]) {
+    __m256 rows[4];
+    for (int i = 0; i < 4; ++i) {
+        // Rows i and i + 4 go in the low and high lanes, which the in-lane shuffles below
+        // turn into columns in row order.
+        rows[i] = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(src + i * row_stride)),
+                                       _mm_loadu_ps(src + (i + 4) * row_stride), 1);
+    }
+    const __m256 t0 = _mm256_unpacklo_ps(rows[0], rows[1]);
+    const __m256 t1 = _mm256_unpacklo_ps(rows[2], rows[3]);
+    const __m256 t2 = _mm256_unpackhi_ps(rows[0], rows[1]);
+    const __m256 t3 = _mm256_unpackhi_ps(rows[2], rows[3]);
+    columns[0] = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+    columns[1] = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+    columns[2] = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    columns[3] = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+__attribute__((target("avx2,fma"))) void forward_step_avx2(const float* const prev,
+                                                           const float* const step_scores,
+                                                           float fixed_stay_score,
+                                                           int num_states,
+                                                           float* const next) {
+    if (num_states % 8 != 0) {
+        forward_step_scalar(prev, step_scores, fixed_stay_score, num_states, next);
+        return;
+    }
+
+    const int quarter = num_states / kNumBases;
+    const __m256 stay_score = _mm256_set1_ps(fixed_stay_score);
+    // 8 consecutive states have 2 distinct predecessors for each k, each shared by 4 states.
+    const __m256i pred_lanes = _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1);
+    for (int s = 0; s < num_states; s += 8) {
+        __m256 m[4];
+        load_transposed_8x4(step_scores + s * kNumBases, kNumBases, m);
+        __m256 steps[4];
+        for (int k = 0; k < 4; ++k) {
+            const __m128 preds = _mm_castpd_ps(_mm_load_sd(
+                    reinterpret_cast<const double*>(prev + s / kNumBases + k * quarter)));
+            steps[k] = _mm256_add_ps(
+                    _mm256_permutevar8x32_ps(_mm256_castps128_ps256(preds), pred_lanes), m[k]);
+        }
+        const __m256 stay = _mm256_add_ps(_mm256_loadu_ps(prev + s), stay_score);
+        _mm256_storeu_ps(next + s, logsumexp5(stay, steps[0], steps[1], steps[2], steps[3]));
+    }
+}
+
+__attribute__((target("avx2,fma"))) void backward_step_avx2(const float* const next,
+                                                            const float* const step_scores,
+                                                            float fixed_stay_score,
+                                                            int num_states,
+                                                            float* const prev) {
+    const int quarter = num_states / kNumBases;
+    if (quarter % 8 != 0) {
+        backward_step_scalar(next, step_scores, fixed_stay_score, num_states, prev);
+        return;
+    }
+
+    const __m256 stay_score = _mm256_set1_ps(fixed_stay_score);
+    // States r + k * quarter for the 8 consecutive r below all step to the same 32 successors,
+    // 4r + j, so those are shared across k.
+    for (int r = 0; r < quarter; r += 8) {
+        __m256 succs[4];
+        load_transposed_8x4(next + r * kNumBases, kNumBases, succs);
+        // m[j][k] is the score of stepping to 4r + j by k.
+        __m256 m[4][4];
+        for (int j = 0; j < 4; ++j) {
+            load_transposed_8x4(step_scores + (r * kNumBases + j) * kNumBases,
+                                kNumBases * kNumBases, m[j]);
+        }
+        for (int k = 0; k < 4; ++k) {
+            const int s = k * quarter + r;
+            const __m256 stay = _mm256_add_ps(_mm256_loadu_ps(next + s), stay_score);
+            _mm256_storeu_ps(prev + s, logsumexp5(stay, _mm256_add_ps(succs[0], m[0][k]),
+                                                  _mm256_add_ps(succs[1], m[1][k]),
+                                                  _mm256_add_ps(succs[2], m[2][k]),
+                                                  _mm256_add_ps(succs[3], m[3][k])));
+        }
+    }
+}
+#endif
+
+const CpuDispatch<decltype(forward_step_scalar)> forward_step(
+        forward_step_scalar, {{CpuIsa::AVX2, AVX2_KERNEL(forward_step_avx2)}});
+const CpuDispatch<decltype(backward_step_scalar)> backward_step(
+        backward_step_scalar, {{CpuIsa::AVX2, AVX2_KERNEL(backward_step_avx2)}});
+
+// Runs forward_step or backward_step over every timestep of each chunk.
+template <bool Backward>
+torch::Tensor scan_native(const torch::Tensor& scores_in, const float fixed_stay_score) {
+    // Each [t, n] row of scores has to be contiguous, but slices of chunks are fine.
+    auto scores = scores_in.to(torch::kFloat32);
+    if (scores.stride(2) != 1) {
+        scores = scores.contiguous();
+    }
+    const int T = scores.size(0);
+    const int N = scores.size(1);
+    const int C = scores.size(2);
+    const int num_states = C / kNumBases;
+    if (num_states % kNumBases != 0) {
+        throw std::runtime_error("Unexpected number of CRF transition scores: " +
+                                 std::to_string(C));
+    }
+
+    auto result = torch::empty({T + 1, N, num_states}, torch::kFloat32);
+    const float* const scores_ptr = scores.data_ptr<float>();
+    float* const result_ptr = result.data_ptr<float>();
+    const std::int64_t result_stride = static_cast<std::int64_t>(N) * num_states;
+    for (int n = 0; n < N; ++n) {
+        float* const chunk_result = result_ptr + static_cast<std::int64_t>(n) * num_states;
+        const float* const chunk_scores = scores_ptr + n * scores.stride(1);
+        if (Backward) {
+            std::fill_n(chunk_result + T * result_stride, num_states, 0.f);
+            for (int t = T - 1; t >= 0; --t) {
+                backward_step(chunk_result + (t + 1) * result_stride,
+                              chunk_scores + t * scores.stride(0), fixed_stay_score, num_states,
+                              chunk_result + t * result_stride);
+            }
+        } else {
+            std::fill_n(chunk_result, num_states, 0.f);
+            for (int t = 0; t < T; ++t) {
+                forward_step(chunk_result + t * result_stride, chunk_scores + t * scores.stride(0),
+                             fixed_stay_score, num_states, chunk_result + (t + 1) * result_stride);
+            }
+        }
+    }
+    return result;
+}
+
+}  // namespace
+
+namespace dorado {
+
+torch::Tensor forward_scores(const torch::Tensor& scores, const float fixed_stay_score) {
+    return scan_native<false>(scores, fixed_stay_score);
+}
+
+torch::Tensor backward_scores(const torch::Tensor& scores, const float fixed_stay_score) {
+    return scan_native<true>(scores, fixed_stay_score);
+}
+
+torch::Tensor forward_scores_torch(const torch::Tensor& scores, const float fixed_stay_score) {
+    const int T = scores.size(0);  // Signal len
+    const int N = scores.size(1);  // Num batches
+    const int C = scores.size(2);  // 4^state_len * 4 = 4^(state_len + 1)
+
+    const int n_base = 4;
+    const int state_len = std::log(C) / std::log(n_base) - 1;
+
+    // Transition scores reshaped so that the 4 scores for each predecessor state are arranged along the
+    // innermost dimension.
+    const torch::Tensor Ms = scores.reshape({T, N, -1, n_base});
+
+    // Number of states per timestep.
+    const int num_states = pow(n_base, state_len);
+
+    // Guide values at first timestep.
+    const auto v0 = Ms.new_full({{N, num_states}}, 0.0f);
+
+    // For each state, the indices of the 4 states that could precede it via a step transition.
+    const auto idx = torch::arange(num_states)
+                             .repeat_interleave(n_base)
+                             .reshape({n_base, -1})
+                             .t()
+                             .contiguous();
+
+    return scan(Ms, fixed_stay_score, idx, v0);
+}
+
+torch::Tensor backward_scores_torch(const torch::Tensor& scores, const float fixed_stay_score) {
+    const int N = scores.size(1);  // Num batches
+    const int C = scores.size(2);  // 4^state_len * 4 = 4^(state_len + 1)
+
+    const int n_base = 4;
+
+    const int state_len = std::log(C) / std::log(n_base) - 1;
+
+    // Number of states per timestep.
+    const int num_states = pow(n_base, state_len);
+
+    // Guide values at last timestep.
+    const torch::Tensor vT = scores.new_full({N, num_states}, 0.0f);
+
+    const auto idx = torch::arange(num_states)
+                             .repeat_interleave(n_base)
+                             .reshape({n_base, -1})
+                             .t()
+                             .contiguous();
+    auto idx_T = idx.flatten().argsort().reshape(idx.sizes());
+
+    const auto Ms_T = scores.index({torch::indexing::Slice(), torch::indexing::Slice(), idx_T});
+
+    // For each state, the indices of the 4 states that could succeed it via a step transition.
+    idx_T = torch::bitwise_right_shift(idx_T, 2);
+
+    return scan(Ms_T.flip(0), fixed_stay_score, idx_T.to(torch::kInt64), vT).flip(0);
+}
+
+}  // namespace dorado
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <torch/torch.h>
+
+namespace dorado {
+
+// Forward and backward scores of the CRF in the log semiring, as beam search uses them.
+// scores is [T, N, C]: T timesteps of N chunks, each with C = 4^(state_len + 1) transition
+// scores, laid out as the 4 step transitions into each state.  Results are
+// [T + 1, N, 4^state_len]; the forward scores start with zeroes at timestep 0, and the backward
+// scores end with zeroes at timestep T.
+// These run a SIMD kernel over the states of each chunk, one timestep at a time.
+torch::Tensor forward_scores(const torch::Tensor& scores, float fixed_stay_score);
+torch::Tensor backward_scores(const torch::Tensor& scores, float fixed_stay_score);
+
+// The same scores computed with libtorch ops.  Much slower, as every timestep dispatches
+// several small ops, but kept for testing and benchmarking the above against.
+torch::Tensor forward_scores_torch(const torch::Tensor& scores, float fixed_stay_score);
+torch::Tensor backward_scores_torch(const torch::Tensor& scores, float fixed_stay_score);
+
+}  // namespace dorado
@@ -40,9 +40,11 @@ int main(int argc, char* argv[]) {
     spdlog::cfg::load_env_levels();
 
     const std::map<std::string, entry_ptr> subcommands = {
-            {"basecaller", &dorado::basecaller}, {"duplex", &dorado::duplex},
-            {"download", &dorado::download},     {"aligner", &dorado::aligner},
-            {"summary", &dorado::summary},
+            {"basecaller", &dorado::basecaller}, {"benchmark", &dorado::benchmark},
+            {"duplex", &dorado::duplex},         {"download", &dorado::download},
+            {"aligner", &dorado::aligner},       {"summary", &dorado::summary},
+            {"pack-model", &dorado::pack_model}, {"worker", &dorado::worker},
+            {"modbase", &dorado::modbase},       {"tune", &dorado::tune},
     };
 
     std::vector<std::string> arguments(argv + 1, argv + argc);
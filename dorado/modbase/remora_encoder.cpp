@@ -4,6 +4,8 @@
 #include "utils/sequence_utils.h"
 
 #include <algorithm>
+#include <cstddef>
+#include <cstring>
 #include <stdexcept>
 
 namespace dorado {
@@ -34,11 +36,51 @@ void RemoraEncoder::init(const std::vector<int>& sequence_ints,
 }
 
 RemoraEncoder::Context RemoraEncoder::get_context(size_t seq_pos) const {
+    auto context = get_context_bounds(seq_pos);
+    context.data.resize(m_kmer_len * RemoraUtils::NUM_BASES * m_context_samples);
+    encode_kmer(context, context.data.data());
+    return context;
+}
+
+RemoraEncoder::ContextBatch RemoraEncoder::get_contexts(const std::vector<size_t>& seq_positions,
+                                                        const torch::Tensor& signal,
+                                                        KmerEncoding kmer_encoding) const {
+    const auto num_contexts = static_cast<int64_t>(seq_positions.size());
+    ContextBatch batch;
+    batch.signals = torch::zeros({num_contexts, m_context_samples}, signal.options());
+    if (kmer_encoding == KmerEncoding::OneHot) {
+        batch.kmers = torch::zeros(
+                {num_contexts, m_kmer_len * RemoraUtils::NUM_BASES, m_context_samples});
+    } else {
+        batch.kmers = torch::full({num_contexts, m_kmer_len, m_context_samples}, -1,
+                                  torch::kInt8);
+    }
+    const int64_t encoded_len = batch.kmers.size(1) * batch.kmers.size(2);
+
+    const auto contiguous_signal = signal.contiguous();
+    const auto* const signal_ptr = static_cast<const std::byte*>(contiguous_signal.data_ptr());
+    auto* const signals_ptr = static_cast<std::byte*>(batch.signals.data_ptr());
+    const size_t elem_size = signal.element_size();
+    for (int64_t i = 0; i < num_contexts; ++i) {
+        const auto context = get_context_bounds(seq_positions[i]);
+        // Padding is left as the zeroes the signals were initialised with.
+        std::memcpy(&signals_ptr[(i * m_context_samples + context.lead_samples_needed) * elem_size],
+                    &signal_ptr[context.first_sample * elem_size],
+                    context.num_samples * elem_size);
+        if (kmer_encoding == KmerEncoding::OneHot) {
+            encode_kmer(context, &batch.kmers.data_ptr<float>()[i * encoded_len]);
+        } else {
+            encode_kmer_bases(context, &batch.kmers.data_ptr<int8_t>()[i * encoded_len]);
+        }
+    }
+    return batch;
+}
+
+RemoraEncoder::Context RemoraEncoder::get_context_bounds(size_t seq_pos) const {
     if (seq_pos >= size_t(m_seq_len)) {
         throw std::out_of_range("Sequence position out of range.");
     }
 
-    auto encoded_kmer_len = m_kmer_len * RemoraUtils::NUM_BASES;
     Context context{};
     int base_sample_pos =
             (compute_sample_pos(int(seq_pos)) + compute_sample_pos(int(seq_pos) + 1)) / 2;
@@ -59,49 +101,6 @@ RemoraEncoder::Context RemoraEncoder::get_context(size_t seq_pos) const {
         context.num_samples = size_t(last_sample) - context.first_sample;
         context.tail_samples_needed = 0;
     }
-
-    // find base position for first and last sample
-    auto start_it = std::upper_bound(m_sample_offsets.begin(), m_sample_offsets.end(),
-                                     context.first_sample);
-    auto end_it = std::lower_bound(m_sample_offsets.begin(), m_sample_offsets.end(),
-                                   context.first_sample + context.num_samples);
-
-    auto seq_start = std::distance(m_sample_offsets.begin(), start_it) - 1;
-    auto seq_end = std::distance(m_sample_offsets.begin(), end_it);
-
-    std::vector<int> seq_ints;
-
-    if (seq_start >= m_bases_before &&
-        seq_end + m_bases_after < static_cast<int>(m_sequence_ints.size())) {
-        seq_ints = {m_sequence_ints.begin() + seq_start - m_bases_before,
-                    m_sequence_ints.begin() + seq_end + m_bases_after};
-    } else {
-        seq_ints.insert(seq_ints.end(), seq_end - seq_start + m_bases_before + m_bases_after, -1);
-        auto fill_st = 0;
-        auto chunk_seq_st = seq_start - m_bases_before;
-        auto chunk_seq_en = seq_end + m_bases_after;
-        if (seq_start < m_bases_before) {
-            fill_st = m_bases_before - seq_start;
-            chunk_seq_st = 0;
-        }
-        if (seq_end + m_bases_after > static_cast<int>(m_sequence_ints.size())) {
-            chunk_seq_en = m_sequence_ints.size();
-        }
-        std::copy(m_sequence_ints.begin() + chunk_seq_st, m_sequence_ints.begin() + chunk_seq_en,
-                  seq_ints.begin() + fill_st);
-    }
-
-    std::vector<int> chunk_seq_to_sig = {m_sample_offsets.begin() + seq_start,
-                                         m_sample_offsets.begin() + seq_end + 1};
-    std::transform(
-            chunk_seq_to_sig.begin(), chunk_seq_to_sig.end(), chunk_seq_to_sig.begin(),
-            [sig_start = context.first_sample, seq_to_sig_offset = context.lead_samples_needed](
-                    auto val) { return val -= sig_start - seq_to_sig_offset; });
-    chunk_seq_to_sig.front() = 0;
-    chunk_seq_to_sig.back() = m_context_samples;
-
-    context.data = encode_kmer(seq_ints, chunk_seq_to_sig);
-
     return context;
 }
 
@@ -120,25 +119,69 @@ int RemoraEncoder::compute_sample_pos(int base_pos) const {
     return m_sample_offsets[base_offset];
 }
 
-std::vector<float> RemoraEncoder::encode_kmer(const std::vector<int>& seq,
-                                              const std::vector<int>& seq_mappings) const {
-    const size_t seq_len = seq.size() - m_bases_before - m_bases_after;
-    std::vector<float> output(m_kmer_len * RemoraUtils::NUM_BASES * m_context_samples);
+template <typename Visitor>
+void RemoraEncoder::visit_kmer_bases(const Context& context, Visitor&& visit) const {
+    // find base position for first and last sample
+    auto start_it = std::upper_bound(m_sample_offsets.begin(), m_sample_offsets.end(),
+                                     context.first_sample);
+    auto end_it = std::lower_bound(m_sample_offsets.begin(), m_sample_offsets.end(),
+                                   context.first_sample + context.num_samples);
+
+    const int seq_start = int(std::distance(m_sample_offsets.begin(), start_it)) - 1;
+    const int seq_end = int(std::distance(m_sample_offsets.begin(), end_it));
 
-    for (size_t kmer_pos = 0; kmer_pos < m_kmer_len; ++kmer_pos) {
-        const auto enc_offset = RemoraUtils::NUM_BASES * kmer_pos;
-        for (size_t seq_pos = 0; seq_pos < seq_len; ++seq_pos) {
-            auto base = seq[seq_pos + kmer_pos];
+    // The context's samples at which each base in [seq_start, seq_end] begins, with the first
+    // base taken to start at the beginning of the context and the last to end at its end.
+    const int sample_shift = int(context.lead_samples_needed) - int(context.first_sample);
+    auto base_sample = [&](int seq_pos) {
+        if (seq_pos == seq_start) {
+            return 0;
+        }
+        if (seq_pos == seq_end) {
+            return m_context_samples;
+        }
+        return m_sample_offsets[seq_pos] + sample_shift;
+    };
+
+    for (int kmer_pos = 0; kmer_pos < m_kmer_len; ++kmer_pos) {
+        for (int seq_pos = seq_start; seq_pos < seq_end; ++seq_pos) {
+            // Bases beyond either end of the sequence are left unencoded.
+            const int kmer_base_pos = seq_pos - m_bases_before + kmer_pos;
+            if (kmer_base_pos < 0 || kmer_base_pos >= m_seq_len) {
+                continue;
+            }
+            const auto base = m_sequence_ints[kmer_base_pos];
             if (base == -1) {
                 continue;
             }
-            auto base_st = seq_mappings[seq_pos];
-            auto base_en = seq_mappings[seq_pos + 1];
-            std::fill(&output[m_context_samples * (enc_offset + base) + base_st],
-                      &output[m_context_samples * (enc_offset + base) + base_en], 1.0f);
+            visit(kmer_pos, base, base_sample(seq_pos), base_sample(seq_pos + 1));
         }
     }
-    return output;
+}
+
+void RemoraEncoder::encode_kmer(const Context& context, float* output) const {
+    visit_kmer_bases(context, [&](int kmer_pos, int base, int sample_start, int sample_end) {
+        auto* const row = &output[m_context_samples * (RemoraUtils::NUM_BASES * kmer_pos + base)];
+        std::fill(&row[sample_start], &row[sample_end], 1.0f);
+    });
+}
+
+void RemoraEncoder::encode_kmer_bases(const Context& context, int8_t* output) const {
+    visit_kmer_bases(context, [&](int kmer_pos, int base, int sample_start, int sample_end) {
+        auto* const row = &output[m_context_samples * kmer_pos];
+        std::fill(&row[sample_start], &row[sample_end], static_cast<int8_t>(base));
+    });
+}
+
+torch::Tensor RemoraEncoder::expand_kmer_bases(const torch::Tensor& kmer_bases,
+                                               torch::ScalarType dtype) {
+    const auto bases = torch::arange(RemoraUtils::NUM_BASES, kmer_bases.options())
+                               .view({1, 1, RemoraUtils::NUM_BASES, 1});
+    // Bases of -1 match none of them, so are left all zeroes.
+    return (kmer_bases.unsqueeze(2) == bases)
+            .to(dtype)
+            .view({kmer_bases.size(0), kmer_bases.size(1) * RemoraUtils::NUM_BASES,
+                   kmer_bases.size(2)});
 }
 
 }  // namespace dorado
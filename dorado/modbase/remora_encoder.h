@@ -22,9 +22,6 @@ private:
 
     int compute_sample_pos(int base_pos) const;
 
-    std::vector<float> encode_kmer(const std::vector<int>& seq,
-                                   const std::vector<int>& seq_mappings) const;
-
 public:
     /** Encoder for Remora-style modified base detection.
      *  @param block_stride The number of samples corresponding to a single entry in the movement vector.
@@ -50,6 +47,22 @@ public:
         size_t tail_samples_needed;  ///< Number of samples, if any, to pad the end of the raw data slice with.
     };
 
+    /// How get_contexts encodes kmers.
+    enum class KmerEncoding {
+        /// float32 [num_contexts, kmer_len * 4, context_samples], as get_context encodes them.
+        OneHot,
+        /// int8 [num_contexts, kmer_len, context_samples], each the base (A=0, C=1, G=2, T=3), or -1
+        /// if there is none.  A sixteenth of the size of OneHot, for expanding on the device
+        /// with expand_kmer_bases.
+        Bases,
+    };
+
+    /// Encoded contexts of several positions, one per row of each tensor.
+    struct ContextBatch {
+        torch::Tensor signals;  ///< [num_contexts, context_samples] signal slices, zero padded.
+        torch::Tensor kmers;    ///< Kmer encodings, as given by the KmerEncoding.
+    };
+
     /** Get the encoded data of the context centered on a specified sequence position.
      *  @param seq_pos The position of the base to center the encoded data on.
      *  @return Encoded data for the context.
@@ -60,6 +73,41 @@ public:
      *  The data is arranged in Feature-Time order i.e each column corresponds to the kmer at a given sample.
      */
     Context get_context(size_t seq_pos) const;
+
+    /** Get the encoded data and signal slices of the contexts centered on several sequence positions.
+     *  @param seq_positions The positions of the bases to center the contexts on.
+     *  @param signal The signal of the read, which the slices are taken from.
+     *  @param kmer_encoding How the kmers of each context are encoded.
+     *  @return Each context's signal slice, of the signal's dtype, and its encoded kmers, in one
+     *  contiguous tensor each, so that the motif hits of a read need no allocations of their own.
+     */
+    ContextBatch get_contexts(const std::vector<size_t>& seq_positions,
+                              const torch::Tensor& signal,
+                              KmerEncoding kmer_encoding = KmerEncoding::OneHot) const;
+
+    /** Expand kmers encoded as KmerEncoding::Bases to one-hot encodings, on whichever device they are on.
+     *  @param kmer_bases [N, kmer_len, context_samples] int8 bases.
+     *  @param dtype The type of the result.
+     *  @return [N, kmer_len * 4, context_samples] one-hot encodings, as KmerEncoding::OneHot would give.
+     */
+    static torch::Tensor expand_kmer_bases(const torch::Tensor& kmer_bases, torch::ScalarType dtype);
+
+private:
+    // Everything in the context centred on seq_pos but its encoded data.
+    Context get_context_bounds(size_t seq_pos) const;
+
+    // Writes the encoding of context to output, which must hold kmer_len * 4 * context_samples
+    // zeroed floats.
+    void encode_kmer(const Context& context, float* output) const;
+
+    // Writes the bases of context to output, which must hold kmer_len * context_samples bytes
+    // set to -1.
+    void encode_kmer_bases(const Context& context, int8_t* output) const;
+
+    // Calls visit(kmer_pos, base, sample_start, sample_end) for each base of each kmer position
+    // in context, with the range of the context's samples it covers.
+    template <typename Visitor>
+    void visit_kmer_bases(const Context& context, Visitor&& visit) const;
 };
 
 }  // namespace dorado
@@ -32,11 +32,14 @@ std::vector<float> RemoraScaler::extract_levels(const std::vector<int>& int_seq)
         return levels;
     }
 
-    auto int_kmer_start_ptr = int_seq.data();
+    // The index of each kmer is rolled on from the one before, a base at a time, rather than
+    // built up again from all of its bases.
+    const size_t index_mask = m_kmer_levels.size() - 1;
+    size_t index = index_from_int_kmer(int_seq.data(), m_kmer_len - 1);
     auto levels_ptr = levels.data() + m_centre_index;
-    for (size_t pos = 0; pos < int_seq.size() - m_kmer_len;
-         ++pos, ++int_kmer_start_ptr, ++levels_ptr) {
-        *(levels_ptr) = m_kmer_levels[index_from_int_kmer(int_kmer_start_ptr, m_kmer_len)];
+    for (size_t pos = 0; pos < int_seq.size() - m_kmer_len; ++pos, ++levels_ptr) {
+        index = ((index << 2) | size_t(int_seq[pos + m_kmer_len - 1])) & index_mask;
+        *(levels_ptr) = m_kmer_levels[index];
     }
     return levels;
 }
@@ -53,33 +56,37 @@ std::pair<float, float> RemoraScaler::rescale(const torch::Tensor samples,
 
     auto n = std::min({seq_to_sig_map.size() - 1, max_bases});
 
-    std::vector<float> optim_dacs(n, 0.f);
-    std::vector<float> new_levels(n, 0.f);
+    // Only the bases left once clip_bases are trimmed from each end are taken.
+    size_t first = 0, last = n;
+    if (clip_bases > 0 && levels.size() > clip_bases * 2) {
+        first = std::min(clip_bases, n);
+        last = std::max(n - std::min(clip_bases, n), first);
+    }
+    std::vector<float> optim_dacs(last - first);
+    std::vector<float> new_levels(std::begin(levels) + first, std::begin(levels) + last);
 
     {
         nvtx3::scoped_range loop{"initialize_vectors"};
         assert(samples.is_contiguous());
         assert(samples.dtype() == torch::kFloat16);
         using SignalType = c10::Half;
-        SignalType* samples_ptr = samples.data_ptr<SignalType>();
+        const SignalType* samples_ptr = samples.data_ptr<SignalType>();
         // get the mid-point of the base
-        for (size_t i = 0; i < n; i++) {
-            int pos = (seq_to_sig_map[i] + seq_to_sig_map[i + 1]) / 2;
-            optim_dacs[i] = static_cast<float>(samples_ptr[pos]);
-            new_levels[i] = levels[i];
+        for (size_t i = first; i < last; i++) {
+            const auto pos = (seq_to_sig_map[i] + seq_to_sig_map[i + 1]) / 2;
+            optim_dacs[i - first] = static_cast<float>(samples_ptr[pos]);
         }
     }
 
-    if (clip_bases > 0 && levels.size() > clip_bases * 2) {
-        new_levels = {std::begin(new_levels) + clip_bases, std::end(new_levels) - clip_bases};
-        optim_dacs = {std::begin(optim_dacs) + clip_bases, std::end(optim_dacs) - clip_bases};
-    }
-
-    std::vector<float> quants(19);
-    std::generate(std::begin(quants), std::end(quants), [n = 0.f]() mutable { return n += 0.05f; });
+    static const std::vector<float> quants = [] {
+        std::vector<float> q(19);
+        std::generate(std::begin(q), std::end(q), [n = 0.f]() mutable { return n += 0.05f; });
+        return q;
+    }();
 
-    new_levels = utils::quantiles(new_levels, quants);
-    optim_dacs = utils::quantiles(optim_dacs, quants);
+    // The vectors are only needed for their quantiles, so they're reordered in place.
+    new_levels = utils::quantiles_in_place(new_levels, quants);
+    optim_dacs = utils::quantiles_in_place(optim_dacs, quants);
 
     auto [new_scale, new_offset, rcoeff] = utils::linear_regression(optim_dacs, new_levels);
     return {new_offset, new_scale};
@@ -17,18 +17,29 @@ public:
 
 struct RemoraChunk {
     RemoraChunk(std::shared_ptr<Read> read,
-                torch::Tensor input_signal,
-                std::vector<float> kmer_data,
-                size_t position)
+                torch::Tensor input_signals,
+                torch::Tensor kmer_data,
+                size_t row,
+                size_t position,
+                size_t model = 0)
             : source_read(read),
-              signal(input_signal),
+              signals(std::move(input_signals)),
               encoded_kmers(std::move(kmer_data)),
-              context_hit(position) {}
-
-    std::weak_ptr<Read> source_read;
-    torch::Tensor signal;
-    std::vector<float> encoded_kmers;
+              input_row(row),
+              context_hit(position),
+              model_id(model) {}
+
+    // Keeps the read alive until all of its chunks have been scored.
+    std::shared_ptr<Read> source_read;
+    // The signal slices and kmer encodings of all of the read's chunks for one model, or for
+    // the models fused with it, shared between them, of which this chunk's are at input_row.
+    // Released once copied to the model's input.
+    torch::Tensor signals;
+    torch::Tensor encoded_kmers;
+    size_t input_row;
     size_t context_hit;
+    // The model which scores the chunk.
+    size_t model_id;
     std::vector<float> scores;
 };
 
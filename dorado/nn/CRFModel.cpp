@@ -1,13 +1,17 @@
 #include "CRFModel.h"
 
+#include "QuantizedLSTM.h"
+#include "../utils/cpu_features.h"
 #include "../utils/models.h"
 #include "../utils/module_utils.h"
 #include "../utils/tensor_utils.h"
 
 #if DORADO_GPU_BUILD && !defined(__APPLE__)
+#include "cuda_conv.h"
 #include "../utils/cuda_utils.h"
 
 #include <ATen/cuda/CUDAContext.h>
+#include <ATen/cuda/CUDAEvent.h>
 #include <c10/cuda/CUDAGuard.h>
 
 extern "C" {
@@ -26,7 +30,9 @@ extern "C" {
 #include <toml.hpp>
 #include <torch/torch.h>
 
+#include <chrono>
 #include <limits>
+#include <map>
 #include <string>
 
 // Different configurations for running Quantised LSTM
@@ -50,6 +56,10 @@ static bool cuda_lstm_is_quantized(int layer_size, cudaDeviceProp *prop) {
 
 #endif  // if USE_CUDA_LSTM
 
+static bool cpu_lstm_is_quantized(int layer_size) {
+    return !g_options_no_i8 && (layer_size == 96 || layer_size == 128);
+}
+
 #if CUDA_PROFILE_TO_CERR
 #define CUDA_CHECK(X)                                                                         \
     {                                                                                         \
@@ -228,6 +238,27 @@ struct ConvolutionImpl : Module {
                 return res;
             }
         }
+        if (!to_lstm && x.device() != torch::kCPU && x.dtype() == torch::kFloat16 &&
+            has_conv_swish_f16(in_size, out_size, window_size)) {
+            // The small-channel layers at the full signal rate are bound by memory bandwidth,
+            // so the convolution, bias, swish and clamp are fused, rather than each going
+            // through device memory in turn.
+            c10::cuda::CUDAGuard device_guard(x.device());
+            auto stream = at::cuda::getCurrentCUDAStream().stream();
+
+            const int batch_size = x.size(0);
+            const int chunk_size_in = x.size(2);
+            const int chunk_size_out = (chunk_size_in - 1) / stride + 1;
+            auto w_device = conv->weight.to(x.options()).contiguous();
+            auto b_device = conv->bias.to(x.options()).contiguous();
+            auto res = torch::empty({batch_size, out_size, chunk_size_out}, x.options());
+            conv_swish_f16(stream, batch_size, chunk_size_in, chunk_size_out, in_size, out_size,
+                           window_size, stride, x.stride(0), x.stride(1), x.stride(2),
+                           x.data_ptr(), w_device.data_ptr(), b_device.data_ptr(), max_value,
+                           res.data_ptr());
+            // Output is [N, C_out, T_out], contiguous
+            return res;
+        }
 #endif
         // Alternative route - non CUDALSTM route.
         x = activation(conv(x));
@@ -273,7 +304,11 @@ struct LinearCRFImpl : Module {
             auto stream = at::cuda::getCurrentCUDAStream().stream();
 
             x = x.contiguous().reshape({N * T, -1});
-            scores = torch::matmul(x, linear->weight.t());
+            if (!weight_t.defined()) {
+                weight_t = linear->weight.t().contiguous();
+            }
+            scores = torch::empty({N * T, weight_t.size(1)}, x.options());
+            dorado::utils::matmul_f16(x, weight_t, scores);
             host_bias_tanh_scale_f16(stream, N * T, scores.size(1), scale, scores.data_ptr(),
                                      linear->bias.data_ptr());
             scores = scores.view({N, T, -1});
@@ -300,6 +335,8 @@ struct LinearCRFImpl : Module {
     bool expand_blanks;
     Linear linear{nullptr};
     Tanh activation{nullptr};
+    // The weights transposed for matmul_f16, made on the first CUDA call.
+    torch::Tensor weight_t;
 };
 
 #if USE_CUDA_LSTM
@@ -687,10 +724,16 @@ struct LSTMStackImpl : Module {
         rnn3 = register_module("rnn3", LSTM(LSTMOptions(size, size).batch_first(true)));
         rnn4 = register_module("rnn4", LSTM(LSTMOptions(size, size).batch_first(true)));
         rnn5 = register_module("rnn5", LSTM(LSTMOptions(size, size).batch_first(true)));
+
+        m_quantize = cpu_lstm_is_quantized(size);
     };
 
     torch::Tensor forward(torch::Tensor x) {
         // Input is [N, T, C], contiguity optional
+        if (m_quantize && x.device() == torch::kCPU && x.dtype() == torch::kFloat32) {
+            // Output is [N, T, C], contiguous
+            return forward_quantized(x);
+        }
 
         auto [y1, h1] = rnn1(x.flip(1));
         auto [y2, h2] = rnn2(y1.flip(1));
@@ -703,6 +746,29 @@ struct LSTMStackImpl : Module {
     }
 
     LSTM rnn1{nullptr}, rnn2{nullptr}, rnn3{nullptr}, rnn4{nullptr}, rnn5{nullptr};
+
+private:
+    torch::Tensor forward_quantized(torch::Tensor x) {
+        // Weights are only loaded after construction, so quantise them on first use.
+        if (m_quantized_layers.empty()) {
+            for (auto &rnn : {rnn1, rnn2, rnn3, rnn4, rnn5}) {
+                auto params = rnn->named_parameters();
+                m_quantized_layers.emplace_back(params["weight_ih_l0"], params["weight_hh_l0"],
+                                                params["bias_ih_l0"], params["bias_hh_l0"]);
+            }
+        }
+
+        // Running a layer in reverse is equivalent to the flips around the fp32 layers.
+        bool reverse = true;
+        for (const auto &layer : m_quantized_layers) {
+            x = layer.forward(x, reverse);
+            reverse = !reverse;
+        }
+        return x;
+    }
+
+    bool m_quantize;
+    std::vector<QuantizedLSTMLayer> m_quantized_layers;
 };
 
 struct ClampImpl : Module {
@@ -876,9 +942,7 @@ CRFModelConfig load_crf_model_config(const std::filesystem::path &path) {
     return config;
 }
 
-std::vector<torch::Tensor> load_crf_model_weights(const std::filesystem::path &dir,
-                                                  bool decomposition,
-                                                  bool linear_layer_bias) {
+std::vector<std::string> crf_model_weight_names(bool decomposition, bool linear_layer_bias) {
     auto tensors = std::vector<std::string>{
 
             "0.conv.weight.tensor",      "0.conv.bias.tensor",
@@ -912,9 +976,34 @@ std::vector<torch::Tensor> load_crf_model_weights(const std::filesystem::path &d
         tensors.push_back("10.linear.weight.tensor");
     }
 
+    return tensors;
+}
+
+std::vector<torch::Tensor> load_crf_model_weights(const std::filesystem::path &dir,
+                                                  bool decomposition,
+                                                  bool linear_layer_bias) {
+    const auto tensors = crf_model_weight_names(decomposition, linear_layer_bias);
+    const auto packed_weights_path = dir / kPackedWeightsFileName;
+    if (std::filesystem::exists(packed_weights_path)) {
+        // Weights updated in place, e.g. by downloading the model again, would otherwise be
+        // hidden by the old packed copy.
+        if (utils::packed_tensors_are_current(packed_weights_path, dir, tensors)) {
+            return utils::load_packed_tensors(packed_weights_path, tensors);
+        }
+        spdlog::warn("Ignoring {}, which is older than the model's weights: run `dorado "
+                     "pack-model` again",
+                     packed_weights_path.string());
+    }
     return utils::load_tensors(dir, tensors);
 }
 
+torch::ScalarType cpu_model_dtype(const CRFModelConfig &model_config) {
+    if (cpu_lstm_is_quantized(model_config.insize) || !utils::cpu_has_bf16_matmul()) {
+        return torch::kF32;
+    }
+    return torch::kBFloat16;
+}
+
 ModuleHolder<AnyModule> load_crf_model(const std::filesystem::path &path,
                                        const CRFModelConfig &model_config,
                                        const torch::TensorOptions &options) {
@@ -934,6 +1023,137 @@ ModuleHolder<AnyModule> load_crf_model(const std::filesystem::path &path,
     }
 }
 
+namespace {
+
+// Times work queued between start() and stop_ms(): on a CUDA device, as it runs on the current
+// stream, and otherwise by the clock.
+class LayerTimer {
+public:
+    explicit LayerTimer(const torch::Device &device) : m_cuda(device.is_cuda()) {}
+
+    void start() {
+#if USE_CUDA_LSTM
+        if (m_cuda) {
+            m_start_event.record();
+            return;
+        }
+#endif
+        m_start_time = std::chrono::steady_clock::now();
+    }
+
+    double stop_ms() {
+#if USE_CUDA_LSTM
+        if (m_cuda) {
+            m_stop_event.record();
+            m_stop_event.synchronize();
+            return m_start_event.elapsed_time(m_stop_event);
+        }
+#endif
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() -
+                                                         m_start_time)
+                .count();
+    }
+
+private:
+    bool m_cuda;
+    std::chrono::steady_clock::time_point m_start_time;
+#if USE_CUDA_LSTM
+    at::cuda::CUDAEvent m_start_event{cudaEventDefault};
+    at::cuda::CUDAEvent m_stop_event{cudaEventDefault};
+#endif
+};
+
+template <class Model>
+std::vector<LayerProfile> profile_model_layers(Model &&model,
+                                               const std::filesystem::path &path,
+                                               const CRFModelConfig &model_config,
+                                               const torch::TensorOptions &options,
+                                               int batch_size,
+                                               int chunk_size,
+                                               int num_batches,
+                                               torch::Tensor &scores) {
+    populate_model(model, path, options, model_config.out_features.has_value(),
+                   model_config.bias);
+    torch::InferenceMode guard;
+
+    // The encoder runs the layers, but only those registered with the model have names.
+    std::map<const torch::nn::Module *, std::string> layer_names;
+    for (const auto &child : model->named_children()) {
+        layer_names[child.value().get()] = child.key();
+    }
+
+    chunk_size -= chunk_size % model_config.stride;
+    const auto input = torch::randn({batch_size, model_config.num_features, chunk_size}, options);
+    std::vector<LayerProfile> profiles;
+    LayerTimer timer(options.device());
+    // Batch -1 warms up, e.g. picking cuDNN algorithms, and is left out of the timings.
+    for (int batch = -1; batch < num_batches; ++batch) {
+        auto x = input;
+        size_t layer_idx = 0;
+        for (const auto &layer : *model->encoder) {
+            const auto layer_input = x;
+            timer.start();
+            x = layer.forward(x);
+            const double time_ms = timer.stop_ms();
+
+            if (batch < 0) {
+                const auto name_it = layer_names.find(layer.ptr().get());
+                LayerProfile profile{name_it != layer_names.end() ? name_it->second : "clamp",
+                                     "", 0, 0, 0};
+                // Every weight matrix is applied once per time step, which the convolutions
+                // before the striding one take at the full sample rate.
+                const bool full_rate = profile.name == "conv1" || profile.name == "conv2";
+                const double positions =
+                        double(batch_size) *
+                        (full_rate ? chunk_size : chunk_size / model_config.stride);
+                double weights = 0;
+                double weight_bytes = 0;
+                for (const auto &parameter : layer.ptr()->parameters()) {
+                    if (parameter.dim() >= 2) {
+                        weights += parameter.numel();
+                    }
+                    weight_bytes += parameter.numel() * parameter.element_size();
+                }
+                profile.flops = 2 * positions * weights;
+                profile.bytes = layer_input.numel() * layer_input.element_size() +
+                                x.numel() * x.element_size() + weight_bytes;
+                if (auto rnns = std::dynamic_pointer_cast<
+                            typename std::decay_t<decltype(model->rnns)>::ContainedType>(
+                            layer.ptr())) {
+                    profile.details = std::string(rnns->m_quantize ? "int8" : "float") +
+                                      " LSTM, size " + std::to_string(model_config.insize);
+                }
+                profiles.push_back(profile);
+            } else {
+                profiles[layer_idx].time_ms += time_ms / num_batches;
+            }
+            ++layer_idx;
+        }
+        scores = x;
+    }
+    return profiles;
+}
+
+}  // namespace
+
+std::vector<LayerProfile> profile_crf_model(const std::filesystem::path &path,
+                                            const CRFModelConfig &model_config,
+                                            const torch::TensorOptions &options,
+                                            int batch_size,
+                                            int chunk_size,
+                                            int num_batches,
+                                            torch::Tensor &scores) {
+#if USE_CUDA_LSTM
+    if (options.device().is_cuda()) {
+        c10::cuda::CUDAGuard device_guard(options.device());
+        return profile_model_layers(nn::CudaCRFModel(model_config, false), path, model_config,
+                                    options, batch_size, chunk_size, num_batches, scores);
+    }
+#endif
+    return profile_model_layers(nn::CpuCRFModel(model_config, true), path, model_config, options,
+                                batch_size, chunk_size, num_batches, scores);
+}
+
 uint16_t get_model_sample_rate(const std::filesystem::path &model_path) {
     std::string model_name = std::filesystem::canonical(model_path).filename().string();
     // Find the sample rate from model config.
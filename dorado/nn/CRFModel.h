@@ -4,6 +4,7 @@
 
 #include <filesystem>
 #include <optional>
+#include <string>
 #include <vector>
 
 namespace dorado {
@@ -31,14 +32,52 @@ struct CRFModelConfig {
 
 CRFModelConfig load_crf_model_config(const std::filesystem::path& path);
 
+// Weights written by `dorado pack-model`, which are loaded instead of the separate tensor
+// files if they're present in the model directory and no tensor file is newer.
+constexpr const char* kPackedWeightsFileName = "weights.dorado";
+
+// The tensor files holding the weights of a model, in the order load_crf_model_weights
+// returns them.
+std::vector<std::string> crf_model_weight_names(bool decomposition, bool bias);
+
 std::vector<torch::Tensor> load_crf_model_weights(const std::filesystem::path& dir,
                                                   bool decomposition,
                                                   bool bias);
 
+// The precision to run the model in on CPU: bf16 where the CPU has bf16 matmuls, unless the
+// model's LSTM is small enough to be quantised to int8, which is faster still, else fp32.
+torch::ScalarType cpu_model_dtype(const CRFModelConfig& model_config);
+
 torch::nn::ModuleHolder<torch::nn::AnyModule> load_crf_model(const std::filesystem::path& path,
                                                              const CRFModelConfig& model_config,
                                                              const torch::TensorOptions& options);
 
 uint16_t get_model_sample_rate(const std::filesystem::path& model_path);
 
+// The cost of one layer of the model for a batch, as measured by profile_crf_model.
+struct LayerProfile {
+    std::string name;
+    // e.g. whether an LSTM stack runs quantized.
+    std::string details;
+    // Mean time per batch.
+    double time_ms;
+    // Multiply-adds count as 2.
+    double flops;
+    // The activations read and written and the weights read, which is the least the layer
+    // can move, so achieved bandwidth may be higher.
+    double bytes;
+};
+
+// Runs num_batches of random input, batch_size chunks of chunk_size samples each, through
+// the model's layers one at a time, after a warm-up batch, and gives each layer's cost.  Layers
+// are timed with CUDA events on CUDA devices, and by the clock on the CPU.  scores is set to the
+// model's output for the last batch, [N, T, C], e.g. to profile decoding with.
+std::vector<LayerProfile> profile_crf_model(const std::filesystem::path& path,
+                                            const CRFModelConfig& model_config,
+                                            const torch::TensorOptions& options,
+                                            int batch_size,
+                                            int chunk_size,
+                                            int num_batches,
+                                            torch::Tensor& scores);
+
 }  // namespace dorado
@@ -3,13 +3,23 @@
 #include "decode/GPUDecoder.h"
 #include "utils/cuda_utils.h"
 #include "utils/math_utils.h"
+#include "utils/TraceRecorder.h"
+#include "utils/thread_utils.h"
 
+#include <ATen/cuda/CUDAEvent.h>
+#include <ATen/cuda/CUDAGraph.h>
+#include <c10/cuda/CUDACachingAllocator.h>
 #include <c10/cuda/CUDAGuard.h>
 #include <c10/cuda/CUDAStream.h>
 #include <nvtx3/nvtx3.hpp>
+#include <spdlog/spdlog.h>
 #include <toml.hpp>
 #include <torch/torch.h>
 
+#include <atomic>
+#include <map>
+#include <utility>
+
 using namespace std::chrono_literals;
 
 namespace dorado {
@@ -21,7 +31,10 @@ public:
                int batch_size,
                const std::string &device,
                float memory_limit_fraction,
-               bool exclusive_gpu_access) {
+               bool exclusive_gpu_access,
+               bool numa_affinity,
+               bool cuda_graphs,
+               float power_cap_watts) {
         const auto model_config = load_crf_model_config(model_path);
         m_model_stride = static_cast<size_t>(model_config.stride);
 
@@ -31,12 +44,49 @@ public:
         m_decoder = std::make_unique<GPUDecoder>();
         m_num_input_features = model_config.num_features;
         m_exclusive_gpu_access = exclusive_gpu_access;
+        m_cuda_graphs = cuda_graphs;
         // adjust chunk size to be a multiple of the stride
         m_out_chunk_size = chunk_size / m_model_stride;
         m_in_chunk_size = m_out_chunk_size * m_model_stride;
 
+        m_device = device;
         m_options = torch::TensorOptions().dtype(GPUDecoder::dtype).device(device);
         assert(m_options.device().is_cuda());
+        m_integrated = utils::is_integrated_gpu(m_options.device().index());
+        if (m_integrated) {
+            spdlog::info("> {} is an integrated GPU, so batches are called in shared memory",
+                         device);
+        }
+
+        if (numa_affinity) {
+            const auto affinity = utils::get_device_affinity(m_options.device().index());
+            if (affinity.cpus.empty()) {
+                spdlog::warn("Unable to determine CPU affinity for {}, threads will not be pinned",
+                             device);
+            } else {
+                spdlog::info("> {} is local to NUMA node {}, CPUs {}", device, affinity.numa_node,
+                             utils::format_cpu_list(affinity.cpus));
+                m_cpu_affinity = affinity.cpus;
+            }
+        }
+
+        // Setting up takes a turn on a device shared with other processes, so that their
+        // batches don't take memory this caller is measuring, and records the memory it set
+        // aside for them to leave out.
+        namespace allocator = c10::cuda::CUDACachingAllocator;
+        constexpr auto kAggregate = static_cast<size_t>(allocator::StatType::AGGREGATE);
+        const int device_index = m_options.device().index();
+        if (power_cap_watts > 0) {
+            // Before the batch size is picked, since it's picked at the capped clocks.
+            utils::cap_gpu_power(device_index, power_cap_watts);
+        }
+        auto *arbiter = utils::gpu_arbiter(device_index);
+        utils::GpuArbiter::Turn setup_turn;
+        if (arbiter) {
+            setup_turn = arbiter->acquire_turn();
+        }
+        const auto before_model_bytes =
+                allocator::getDeviceStats(device_index).allocated_bytes[kAggregate].current;
 
         m_module = load_crf_model(model_path, model_config, m_options);
 
@@ -45,15 +95,32 @@ public:
         int batch_size_granularity = get_batch_size_granularity(model_config, m_options);
         m_batch_size = utils::pad_to(batch_size, batch_size_granularity);
         if (batch_size == 0) {
-            m_batch_size =
-                    utils::auto_gpu_batch_size(m_module, model_config, m_options,
-                                               batch_size_granularity, memory_limit_fraction);
-        } else {
-            // Warmup
+            m_batch_size = utils::auto_gpu_batch_size(
+                    m_module, model_path, model_config, m_options, m_in_chunk_size,
+                    batch_size_granularity, memory_limit_fraction, power_cap_watts);
+        }
+
+        // Warmup, measuring the device memory a batch needs on top of the model, so that it can
+        // be set aside for this caller when another is set up on the same device.
+        const auto start_bytes =
+                allocator::getDeviceStats(device_index).allocated_bytes[kAggregate].current;
+        allocator::resetPeakStats(device_index);
+        {
             auto input =
                     torch::empty({m_batch_size, m_num_input_features, m_in_chunk_size}, m_options);
             m_module->forward(input);
-            torch::cuda::synchronize(m_options.device().index());
+            torch::cuda::synchronize(device_index);
+        }
+        const auto peak_bytes =
+                allocator::getDeviceStats(device_index).allocated_bytes[kAggregate].peak;
+        m_batch_memory_bytes = size_t(peak_bytes - start_bytes);
+        // Hand the cached blocks back, so that they count as available to whatever's set up
+        // next.
+        allocator::emptyCache();
+        if (arbiter) {
+            arbiter->add_reservation(size_t(start_bytes - before_model_bytes) +
+                                     m_batch_memory_bytes);
+            setup_turn.release();
         }
 
         m_cuda_thread.reset(new std::thread(&CudaCaller::cuda_thread_fn, this));
@@ -67,53 +134,92 @@ public:
         m_cuda_thread->join();
     }
 
+    // Batches the GPU kernels take are multiples of this.
+    static constexpr int kBatchSizeGranularity = 64;
+
     static int get_batch_size_granularity(const CRFModelConfig &model_config,
                                           const torch::TensorOptions &options) {
         // TODO: we may want to use different numbers based on model type and GPU arch
-        return 64;
+        return kBatchSizeGranularity;
     }
 
     struct NNTask {
-        NNTask(torch::Tensor input_, int num_chunks_) : input(input_), num_chunks(num_chunks_) {}
+        NNTask(torch::Tensor input_,
+               torch::Tensor output_,
+               torch::Tensor device_output_,
+               int num_chunks_,
+               at::cuda::CUDAEvent &input_ready_)
+                : input(input_),
+                  output(output_),
+                  device_output(device_output_),
+                  num_chunks(num_chunks_),
+                  input_ready(input_ready_) {}
         torch::Tensor input;
+        // Pinned host memory, which the results are copied back to.
+        torch::Tensor output;
+        // If defined, the device's view of output, which is mapped memory, and which the
+        // results are decoded straight into.
+        torch::Tensor device_output;
         std::mutex mut;
         std::condition_variable cv;
-        torch::Tensor out;
+        // Set once the work for the task has been queued on the compute stream.
         bool done{false};
         int num_chunks;
+        // Recorded once input is ready to be read on the device.
+        at::cuda::CUDAEvent &input_ready;
+        // Recorded once the results are in output.
+        at::cuda::CUDAEvent output_ready;
     };
 
+    // input must be in device memory, and is only read once input_ready has completed.
+    // device_output may be undefined, or the device's view of output if it's mapped memory.
     std::vector<DecodedChunk> call_chunks(torch::Tensor &input,
                                           torch::Tensor &output,
+                                          torch::Tensor &device_output,
                                           int num_chunks,
-                                          c10::cuda::CUDAStream stream) {
+                                          at::cuda::CUDAEvent &input_ready) {
         NVTX3_FUNC_RANGE();
-        c10::cuda::CUDAStreamGuard stream_guard(stream);
-
         if (num_chunks == 0) {
             return std::vector<DecodedChunk>();
         }
-        NNTask task(input.to(m_options.device()), num_chunks);
+        NNTask task(input, output, device_output, num_chunks, input_ready);
         {
-            std::lock_guard<std::mutex> lock(m_input_lock);
-            m_input_queue.push_front(&task);
-        }
-        m_input_cv.notify_one();
+            utils::TraceSpan span("wait_for_gpu");
+            {
+                std::lock_guard<std::mutex> lock(m_input_lock);
+                m_input_queue.push_front(&task);
+            }
+            m_input_cv.notify_one();
 
-        std::unique_lock lock(task.mut);
-        while (!task.done) {
-            task.cv.wait(lock);
-        }
+            std::unique_lock lock(task.mut);
+            while (!task.done) {
+                task.cv.wait(lock);
+            }
+            lock.unlock();
 
-        output.copy_(task.out);
-        return m_decoder->cpu_part(output);
+            // Waiting on the event only waits for this batch, while the caller's thread goes
+            // on to queue the next one.
+            task.output_ready.synchronize();
+        }
+        // Only the rows holding chunks need decoding.
+        utils::TraceSpan span("cpu_decode");
+        return m_decoder->cpu_part(output.narrow(0, 0, num_chunks));
     }
 
     void cuda_thread_fn() {
+        utils::set_thread_name("cuda_caller");
         NVTX3_FUNC_RANGE();
+        utils::set_thread_affinity(m_cpu_affinity);
         torch::InferenceMode guard;
         c10::cuda::CUDAGuard device_guard(m_options.device());
+        // Every batch's model and decode run in order on the default stream, which the decode
+        // kernels are launched on.  Results are copied back on the decoder's own stream, so the
+        // next batch's model starts as soon as the decode kernels finish.  Nothing here waits
+        // for the device, so the next batch is queued while the last is still running.  The
+        // runners' copy streams are non-blocking, so their copies overlap it.
         auto stream = c10::cuda::getCurrentCUDAStream(m_options.device().index());
+        // Graphs can't be captured on the default stream.
+        auto graph_stream = c10::cuda::getStreamFromPool(false, m_options.device().index());
 
         while (true) {
             std::unique_lock<std::mutex> input_lock(m_input_lock);
@@ -132,16 +238,90 @@ public:
             auto gpu_lock = dorado::utils::acquire_gpu_lock(m_options.device().index(),
                                                             m_exclusive_gpu_access);
             std::unique_lock<std::mutex> task_lock(task->mut);
-            auto scores = m_module->forward(task->input);
-            torch::cuda::synchronize();
-            task->out = m_decoder->gpu_part(scores, task->num_chunks, m_decoder_options);
-            stream.synchronize();
+            // The device works asynchronously, so this spans queueing the batch's model and
+            // decode kernels, and any wait for the queue to have room for them.
+            utils::TraceSpan span("queue_forward_and_decode");
+            task->input_ready.block(stream);
+            auto scores = m_cuda_graphs ? graph_forward(task->input, stream, graph_stream)
+                                        : m_module->forward(task->input);
+            auto out = m_decoder->gpu_part(scores, task->num_chunks, m_decoder_options,
+                                           task->device_output);
+            if (task->device_output.defined()) {
+                // The results are in host memory as soon as the decode kernels are done.
+                task->output_ready.record(stream);
+            } else {
+                m_decoder->copy_to_host(out, task->output, task->output_ready);
+            }
+            if (m_exclusive_gpu_access || gpu_lock.turn.holds_turn()) {
+                // Nothing else may use the device until this batch is finished.
+                task->output_ready.synchronize();
+            }
             task->done = true;
             task->cv.notify_one();
             task_lock.unlock();
         }
     }
 
+    // The model's forward pass captured as a CUDA graph, for one input shape.  The graph
+    // always reads from input and writes to scores.
+    struct CapturedForward {
+        torch::Tensor input;
+        torch::Tensor scores;
+        std::unique_ptr<at::cuda::CUDAGraph> graph;
+    };
+
+    // Runs the model on input by replaying the graph captured for its shape, capturing one
+    // first if there's none yet.  Work is ordered with the rest of stream, and the scores
+    // returned are only valid until the next call for the same shape is queued on stream.
+    torch::Tensor graph_forward(const torch::Tensor &input,
+                                c10::cuda::CUDAStream stream,
+                                c10::cuda::CUDAStream graph_stream) {
+        NVTX3_FUNC_RANGE();
+        // Anything already queued on stream, including the copy of input and the decode of
+        // the last scores, must happen first.
+        at::cuda::CUDAEvent stream_ready;
+        stream_ready.record(stream);
+        stream_ready.block(graph_stream);
+
+        c10::cuda::CUDAStreamGuard stream_guard(graph_stream);
+        auto captured_it = m_captured_forwards.find(input.sizes().vec());
+        if (captured_it == m_captured_forwards.end()) {
+            CapturedForward captured;
+            captured.input = torch::empty_like(input);
+            captured.input.copy_(input);
+            try {
+                // Run once outside the capture, so nothing initialised lazily is captured.
+                m_module->forward(captured.input);
+                captured.graph = std::make_unique<at::cuda::CUDAGraph>();
+                captured.graph->capture_begin();
+                captured.scores = m_module->forward(captured.input);
+                captured.graph->capture_end();
+            } catch (const std::exception &e) {
+                spdlog::warn("Unable to capture CUDA graph, running the model directly: {}",
+                             e.what());
+                m_cuda_graphs = false;
+                auto scores = m_module->forward(input);
+                at::cuda::CUDAEvent scores_ready;
+                scores_ready.record(graph_stream);
+                scores_ready.block(stream);
+                return scores;
+            }
+            spdlog::debug("> Captured CUDA graph for batch size {}, chunk size {}", input.size(0),
+                          input.size(2));
+            captured_it =
+                    m_captured_forwards.emplace(input.sizes().vec(), std::move(captured)).first;
+        }
+
+        auto &captured = captured_it->second;
+        captured.input.copy_(input, /*non_blocking=*/true);
+        captured.graph->replay();
+
+        at::cuda::CUDAEvent scores_ready;
+        scores_ready.record(graph_stream);
+        scores_ready.block(stream);
+        return captured.scores;
+    }
+
     std::string m_device;
     torch::TensorOptions m_options;
     std::unique_ptr<GPUDecoder> m_decoder;
@@ -154,7 +334,20 @@ public:
     std::condition_variable m_input_cv;
     std::unique_ptr<std::thread> m_cuda_thread;
     int m_num_input_features, m_batch_size, m_in_chunk_size, m_out_chunk_size;
+    // Device memory a batch takes on top of the model.
+    size_t m_batch_memory_bytes{0};
+    // Whether the device shares the host's memory, so that runners' batches and results are
+    // mapped host memory rather than copied to and from the device.
+    bool m_integrated{false};
     bool m_exclusive_gpu_access{false};
+    // Whether to run the model by replaying CUDA graphs.  Decoding isn't captured, as the
+    // decode kernels are launched on the default stream.  Atomic, as runners read it to shape
+    // their batches while a failed capture may turn it off.
+    std::atomic<bool> m_cuda_graphs{false};
+    // Keyed by input shape.
+    std::map<std::vector<int64_t>, CapturedForward> m_captured_forwards;
+    // CPUs local to the device, if threads are being pinned.
+    std::vector<int> m_cpu_affinity;
 };
 
 std::shared_ptr<CudaCaller> create_cuda_caller(const std::filesystem::path &model_path,
@@ -162,33 +355,120 @@ std::shared_ptr<CudaCaller> create_cuda_caller(const std::filesystem::path &mode
                                                int batch_size,
                                                const std::string &device,
                                                float memory_limit_fraction,
-                                               bool exclusive_gpu_access) {
+                                               bool exclusive_gpu_access,
+                                               bool numa_affinity,
+                                               bool cuda_graphs,
+                                               float power_cap_watts) {
     return std::make_shared<CudaCaller>(model_path, chunk_size, batch_size, device,
-                                        memory_limit_fraction, exclusive_gpu_access);
+                                        memory_limit_fraction, exclusive_gpu_access,
+                                        numa_affinity, cuda_graphs, power_cap_watts);
 }
 
-CudaModelRunner::CudaModelRunner(std::shared_ptr<CudaCaller> caller)
+size_t cuda_caller_batch_memory_bytes(const std::shared_ptr<CudaCaller> &caller) {
+    return caller->m_batch_memory_bytes;
+}
+
+CudaModelRunner::CudaModelRunner(std::shared_ptr<CudaCaller> caller, int chunk_size)
         : m_caller(caller),
           m_stream(c10::cuda::getStreamFromPool(false, m_caller->m_options.device().index())) {
+    // The model runs on whatever length of input it's given, so runners of a shared caller
+    // can each call a different chunk size.
+    int out_chunk_size = caller->m_out_chunk_size;
+    if (chunk_size != 0) {
+        out_chunk_size = chunk_size / static_cast<int>(caller->m_model_stride);
+    }
+    const int in_chunk_size = out_chunk_size * static_cast<int>(caller->m_model_stride);
+
+    if (m_caller->m_integrated) {
+        // The device reads the batch where it's assembled, and decodes into the buffer the
+        // results are read from, so nothing is copied through the memory they share.
+        const auto device = m_caller->m_options.device();
+        auto input = utils::empty_mapped(
+                {caller->m_batch_size, caller->m_num_input_features, in_chunk_size},
+                m_caller->m_options.dtype().toScalarType(), device);
+        m_input = input.host;
+        m_device_input = input.device;
+        auto output = utils::empty_mapped(
+                {caller->m_batch_size, GPUDecoder::compact_chunk_bytes(out_chunk_size)},
+                torch::kUInt8, device);
+        m_output = output.host;
+        m_device_output = output.device;
+        return;
+    }
+
+    m_device_input = torch::empty(
+            {caller->m_batch_size, caller->m_num_input_features, in_chunk_size},
+            m_caller->m_options);
+
+    // Allocate the pinned buffers from the device's local CPUs, so the pages are placed
+    // on the NUMA node closest to the device.
+    utils::ScopedThreadAffinity affinity(m_caller->m_cpu_affinity);
     auto opts = torch::TensorOptions().device(torch::kCPU).pinned_memory(true);
-    m_input = torch::empty(
-            {caller->m_batch_size, caller->m_num_input_features, caller->m_in_chunk_size},
-            opts.dtype(m_caller->m_options.dtype()));
+    m_input = torch::empty({caller->m_batch_size, caller->m_num_input_features, in_chunk_size},
+                           opts.dtype(m_caller->m_options.dtype()));
 
-    m_output = torch::empty({3, caller->m_batch_size, caller->m_out_chunk_size},
-                            opts.dtype(torch::kInt8));
+    m_output = torch::empty(
+            {caller->m_batch_size, GPUDecoder::compact_chunk_bytes(out_chunk_size)},
+            opts.dtype(torch::kUInt8));
 }
 
 void CudaModelRunner::accept_chunk(int chunk_idx, const torch::Tensor &chunk) {
-    m_input.index_put_({chunk_idx, torch::indexing::Ellipsis}, chunk);
+    if (chunk.is_cuda()) {
+        // Signal scaled on the device skips the pinned host buffer entirely.
+        m_device_input.index_put_({chunk_idx, torch::indexing::Ellipsis}, chunk);
+        m_batch_on_device = true;
+    } else {
+        m_input.index_put_({chunk_idx, torch::indexing::Ellipsis}, chunk);
+    }
+}
+
+void CudaModelRunner::accept_chunks(int first_chunk_idx, const std::vector<ChunkSignal> &chunks) {
+    // Host signal is copied straight into the pinned buffer.
+    if (!copy_chunks_to_batch(m_input, first_chunk_idx, chunks)) {
+        ModelRunnerBase::accept_chunks(first_chunk_idx, chunks);
+    }
 }
 
 std::vector<DecodedChunk> CudaModelRunner::call_chunks(int num_chunks) {
-    return m_caller->call_chunks(m_input, m_output, num_chunks, m_stream);
+    if (num_chunks == 0) {
+        m_batch_on_device = false;
+        return {};
+    }
+    if (std::exchange(m_batch_on_device, false)) {
+        // The chunks were copied in on this thread's current stream, which the caller's
+        // stream has to wait for.
+        m_input_ready.record(
+                c10::cuda::getCurrentCUDAStream(m_caller->m_options.device().index()));
+    } else if (m_caller->m_integrated) {
+        // m_device_input is m_input, as the device sees it, so there's nothing to wait for.
+        m_input_ready.record(m_stream);
+    } else {
+        // Copy the batch up on this runner's own stream, so that it only waits for the
+        // pinned buffer to be filled rather than for anything else on the device.  Neither
+        // buffer is touched again until the batch has been called, by which time the copy
+        // is long done.
+        c10::cuda::CUDAStreamGuard stream_guard(m_stream);
+        utils::TraceSpan span("queue_h2d_copy");
+        m_device_input.narrow(0, 0, num_chunks)
+                .copy_(m_input.narrow(0, 0, num_chunks), /*non_blocking=*/true);
+        m_input_ready.record(m_stream);
+    }
+    // A partial batch is called in fewer rows, unless it's replayed from a graph, which would
+    // take a capture, and its memory, for each shape.
+    auto batch = m_device_input;
+    if (!m_caller->m_cuda_graphs) {
+        batch = m_device_input.narrow(
+                0, 0,
+                trimmed_batch_size(num_chunks, m_device_input.size(0),
+                                   CudaCaller::kBatchSizeGranularity));
+    }
+    return m_caller->call_chunks(batch, m_output, m_device_output, num_chunks, m_input_ready);
 }
 
 size_t CudaModelRunner::model_stride() const { return m_caller->m_model_stride; }
 size_t CudaModelRunner::chunk_size() const { return m_input.size(2); }
 size_t CudaModelRunner::batch_size() const { return m_input.size(0); }
+std::vector<int> CudaModelRunner::cpu_affinity() const { return m_caller->m_cpu_affinity; }
+std::string CudaModelRunner::device() const { return m_caller->m_device; }
 
 }  // namespace dorado
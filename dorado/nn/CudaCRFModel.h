@@ -2,6 +2,7 @@
 
 #include "ModelRunner.h"
 
+#include <ATen/cuda/CUDAEvent.h>
 #include <c10/cuda/CUDAStream.h>
 #include <torch/torch.h>
 
@@ -18,22 +19,44 @@ std::shared_ptr<CudaCaller> create_cuda_caller(const std::filesystem::path& mode
                                                int batch_size,
                                                const std::string& device,
                                                float memory_limit_fraction = 1.f,
-                                               bool exclusive_gpu_access = false);
+                                               bool exclusive_gpu_access = false,
+                                               bool numa_affinity = false,
+                                               bool cuda_graphs = false,
+                                               float power_cap_watts = 0.f);
+
+// The device memory a batch of caller's takes on top of its model, measured when it was created.
+size_t cuda_caller_batch_memory_bytes(const std::shared_ptr<CudaCaller>& caller);
 
 class CudaModelRunner : public ModelRunnerBase {
 public:
-    explicit CudaModelRunner(std::shared_ptr<CudaCaller> caller);
+    // If chunk_size is non-zero the runner calls chunks of that size, rounded down to a
+    // multiple of the model stride, rather than the caller's chunk size.
+    explicit CudaModelRunner(std::shared_ptr<CudaCaller> caller, int chunk_size = 0);
     void accept_chunk(int chunk_idx, const torch::Tensor& chunk) final;
+    void accept_chunks(int first_chunk_idx, const std::vector<ChunkSignal>& chunks) final;
     std::vector<DecodedChunk> call_chunks(int num_chunks) final;
     size_t model_stride() const final;
     size_t chunk_size() const final;
     size_t batch_size() const final;
+    std::vector<int> cpu_affinity() const final;
+    std::string device() const final;
 
 private:
     std::shared_ptr<CudaCaller> m_caller;
+    // Stream the batch is copied to the device on.
     c10::cuda::CUDAStream m_stream;
+    // Pinned host buffers for the batch and its results.
     torch::Tensor m_input;
     torch::Tensor m_output;
+    // The batch in device memory, copied from m_input or, if the chunks were already in
+    // device memory, assembled directly.  A batch is either entirely in m_input or entirely
+    // in m_device_input.  On an integrated GPU, m_input and m_output are mapped memory, and
+    // m_device_input and m_device_output are the device's views of them.
+    torch::Tensor m_device_input;
+    torch::Tensor m_device_output;
+    bool m_batch_on_device{false};
+    // Recorded once m_device_input holds the batch.
+    at::cuda::CUDAEvent m_input_ready;
 };
 
 }  // namespace dorado
@@ -4,15 +4,25 @@
 #include "MetalCRFModel.h"
 
 #include "../decode/beam_search.h"
+#include "../utils/batch_size_calibration.h"
 #include "../utils/math_utils.h"
 #include "../utils/metal_utils.h"
 #include "../utils/module_utils.h"
 #include "../utils/tensor_utils.h"
+#include "../utils/thread_utils.h"
+#include "../utils/TraceRecorder.h"
 
 #include <math.h>
 #include <spdlog/spdlog.h>
 #include <torch/torch.h>
 
+#include <array>
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <set>
+#include <string>
 #include <vector>
 
 using namespace dorado::utils;
@@ -29,8 +39,29 @@ namespace {
 // SIMD tile size dictated by the metal spec.
 const int kTileSize = 8;
 
-bool finishCommandBuffer(const char *label, MTL::CommandBuffer *cb, int try_count) {
-    cb->commit();
+// Batches whose command buffers can be queued on the GPU at once.  Each has its own set of
+// score buffers, so the GPU can work on one while the last is being decoded.
+constexpr size_t kMaxBatchesInFlight = 2;
+
+// The beam_search kernel holds the beam in one simdgroup, one element per lane.
+constexpr size_t kMaxGpuBeamWidth = 32;
+
+// Matches BeamSearchArgs in nn.metal.
+struct BeamSearchArgs {
+    int32_t T;
+    int32_t N;
+    int32_t C;
+    int32_t beam_width;
+    float log_beam_cut;
+    float fixed_stay_score;
+    float temperature;
+    float q_shift;
+    float q_scale;
+    int32_t chunk_offset;
+};
+
+// Waits for cb, which has already been committed, and returns whether it succeeded.
+bool waitForCommandBuffer(const char *label, MTL::CommandBuffer *cb, int try_count) {
     cb->waitUntilCompleted();
 
     auto status = cb->status();
@@ -49,6 +80,98 @@ bool finishCommandBuffer(const char *label, MTL::CommandBuffer *cb, int try_coun
     return success;
 }
 
+// SIMD group counts the LSTM and linear kernels are tuned over.  Both kernels stride over
+// their output tiles by SIMD group, so any count gives the same results, and 32 is the most
+// a threadgroup can hold.  The tile sizes within each SIMD group are template arguments,
+// tied to the 48 chunk batch granularity, so stay fixed.
+constexpr std::array<int, 5> kTunedSimdGroups{8, 12, 16, 24, 32};
+
+// Timesteps each tuning candidate is run for, which is enough to rank them without
+// noticeably slowing model loading.
+constexpr int kTuningChunkSize = 64;
+
+// SIMD group counts which work well on M1 devices, used if tuning can't run.
+int default_simd_groups(int layer_size) {
+    switch (layer_size) {
+    case 128:
+        return 16;
+    case 192:
+        return 12;
+    case 256:
+        return 32;
+    case 384:
+        return 24;
+    case 512:
+        return 32;
+    case 768:
+        return 32;
+    case 1024:
+        return 32;
+    default:
+        return 16;
+    }
+}
+
+// Identifies the device in kernel tuning cache entries.  GPUs of the same name can have
+// different core counts, which change the number of threadgroups launched.
+std::string tuning_device_id(MTL::Device *const device) {
+    return std::string(device->name()->utf8String()) + '/' +
+           std::to_string(get_mtl_device_core_count());
+}
+
+// Returns the SIMD group count in kTunedSimdGroups for which kernel_name, compiled with
+// constants, runs fastest on buffers.  tg_buffer_lens gives the threadgroup memory a count
+// needs.  Each candidate is run twice, and only the second run timed, so that the first pays
+// for any page faults.  Counts the pipeline can't launch are skipped, and if no candidate can
+// be timed, fallback is returned.
+int tune_simd_groups(MTL::Device *const device,
+                     MTL::CommandQueue *const command_queue,
+                     const std::string &kernel_name,
+                     const std::vector<std::tuple<std::string, MetalConstant>> &constants,
+                     const std::vector<MTL::Buffer *> &buffers,
+                     const std::function<std::vector<int>(int)> &tg_buffer_lens,
+                     int threadgroups,
+                     int fallback) {
+    int best_simd_groups = fallback;
+    double best_time = std::numeric_limits<double>::max();
+    for (const int simd_groups : kTunedSimdGroups) {
+        const int threads = simd_groups * 32;
+        if (threads > static_cast<int>(device->maxThreadsPerThreadgroup().width)) {
+            continue;
+        }
+        auto *const cps = make_cps(device, kernel_name, constants, threads);
+        if (static_cast<int>(cps->maxTotalThreadsPerThreadgroup()) < threads) {
+            // Too many registers for this many threads.
+            cps->release();
+            continue;
+        }
+        std::optional<double> time;
+        for (int run = 0; run < 2; ++run) {
+            auto *const command_buffer = command_queue->commandBuffer();
+            launch_kernel_no_wait(cps, command_buffer, buffers, tg_buffer_lens(simd_groups),
+                                  threadgroups, threads);
+            command_buffer->commit();
+            command_buffer->waitUntilCompleted();
+            if (command_buffer->status() != MTL::CommandBufferStatusCompleted) {
+                time.reset();
+                break;
+            }
+            time = command_buffer->GPUEndTime() - command_buffer->GPUStartTime();
+        }
+        cps->release();
+        if (!time) {
+            continue;
+        }
+        spdlog::debug("Kernel {} with {} SIMD groups: {} ms", kernel_name, simd_groups,
+                      1000.0 * *time);
+        if (*time < best_time) {
+            best_time = *time;
+            best_simd_groups = simd_groups;
+        }
+    }
+    return best_simd_groups;
+}
+
 }  // namespace
 
 namespace dorado {
@@ -207,7 +330,8 @@ struct MetalBlockImpl : Module {
                    int batch_size_,
                    const CRFModelConfig &config_,
                    int out_split_,
-                   MTL::Device *const device_)
+                   MTL::Device *const device_,
+                   const std::filesystem::path &model_path)
             : device(device_),
               in_chunk_size(chunk_size_),
               batch_size(batch_size_),
@@ -243,39 +367,7 @@ struct MetalBlockImpl : Module {
         args_linear2 = create_vec_buffer<int32_t>(
                 device, {out_batch_tiles, 0, out_batch_tiles, lstm_chunk_size});
 
-        switch (config.insize) {
-        case 128:
-            kernel_simd_groups = 16;
-            break;
-        case 192:
-            kernel_simd_groups = 12;
-            break;
-        case 256:
-            kernel_simd_groups = 32;
-            break;
-        case 384:
-            kernel_simd_groups = 24;
-            break;
-        case 512:
-            kernel_simd_groups = 32;
-            break;
-        case 768:
-            kernel_simd_groups = 32;
-            break;
-        case 1024:
-            kernel_simd_groups = 32;
-            break;
-        default:
-            kernel_simd_groups = 16;
-        }
         kernel_thread_groups = get_mtl_device_core_count();
-        const int lstm_threads = kernel_simd_groups * 32;
-        lstm_cps[0] = make_cps(device, "lstm",
-                               {{"kLstmLayerSize", config.insize}, {"kLstmReversedInTime", false}},
-                               lstm_threads);
-        lstm_cps[1] = make_cps(device, "lstm",
-                               {{"kLstmLayerSize", config.insize}, {"kLstmReversedInTime", true}},
-                               lstm_threads);
         to_half_cps = make_cps(device, "float_to_half", {});
 
         // The temp buffer used for these purposes (number of elements of `torch_dtype` in []):
@@ -302,11 +394,13 @@ struct MetalBlockImpl : Module {
         rnn4 = register_module("rnn_4", MetalLSTM(config.insize, false, device));
         rnn5 = register_module("rnn_5", MetalLSTM(config.insize, true, device));
 
-        const int linear_threads = kernel_simd_groups * 32;
         // If the intermediate feature size between conv1 and conv2 is 16, then this is a v4
         // type model, where the linear layer output is clamped rather than run through tanh.
         // Otherwise the intermediate feature size is 4.
         assert(config.conv == 4 || config.conv == 16);
+        // Function constants of the linear layer kernels, and the output size of the first.
+        std::vector<std::tuple<std::string, MetalConstant>> linear_constants[2];
+        int linear1_out_size = config.outsize;
         if (config.out_features.has_value()) {
             // The linear layer is decomposed into 2 matmuls.
             const int decomposition = config.out_features.value();
@@ -315,45 +409,36 @@ struct MetalBlockImpl : Module {
             const bool kSecondLayerBias = false;
             linear2 = register_module("linear2",
                                       MetalLinear(decomposition, config.outsize, kSecondLayerBias));
-            const auto linear_constants1 = std::vector<std::tuple<std::string, MetalConstant>>(
-                    {{"kLinearInSize", config.insize},
-                     {"kLinearOutSize", decomposition},
-                     {"kLinearOutputScale", 1.0f},
-                     {"kLinearOutputClamp", false},
-                     {"kLinearOutputTanh", false},
-                     {"kLinearOutputAsByte", false}});
-            linear_cps[0] =
-                    make_cps(device, "linear_from_rev_lstm", linear_constants1, linear_threads);
-            const auto linear_constants2 = std::vector<std::tuple<std::string, MetalConstant>>(
-                    {{"kLinearInSize", decomposition},
-                     {"kLinearOutSize", config.outsize},
-                     // Rescale from clamped [-5.0, 5.0] range to byte range.
-                     {"kLinearOutputScale", 127.0f / 5.0f},
-                     {"kLinearOutputClamp", true},
-                     {"kLinearOutputTanh", false},
-                     {"kLinearOutputAsByte", true}});
-            linear_cps[1] = make_cps(device, "linear", linear_constants2, linear_threads);
+            linear_constants[0] = {{"kLinearInSize", config.insize},
+                                   {"kLinearOutSize", decomposition},
+                                   {"kLinearOutputScale", 1.0f},
+                                   {"kLinearOutputClamp", false},
+                                   {"kLinearOutputTanh", false},
+                                   {"kLinearOutputAsByte", false}};
+            linear_constants[1] = {{"kLinearInSize", decomposition},
+                                   {"kLinearOutSize", config.outsize},
+                                   // Rescale from clamped [-5.0, 5.0] range to byte range.
+                                   {"kLinearOutputScale", 127.0f / 5.0f},
+                                   {"kLinearOutputClamp", true},
+                                   {"kLinearOutputTanh", false},
+                                   {"kLinearOutputAsByte", true}};
+            linear1_out_size = decomposition;
             mat_temp_elems = std::max(mat_temp_elems,
                                       decomposition * (batch_size / out_split_) * lstm_chunk_size);
         } else {
             const bool is_v3_model = (config.num_features == 1 && config.conv == 4) ||
                                      (config.num_features == 13 && config.conv == 16);
-            const auto linear_constants = std::vector<std::tuple<std::string, MetalConstant>>(
-                    {{"kLinearInSize", config.insize},
-                     {"kLinearOutSize", config.outsize},
-                     // If v4, rescale from clamped [-5.0, 5.0] range to byte range.
-                     // If v3, rescale from tanh [-1.0, 1,0] range to byte range.
-                     {"kLinearOutputScale", is_v3_model ? 127.0f : (127.0f / 5.0f)},
-                     {"kLinearOutputClamp", !is_v3_model},
-                     {"kLinearOutputTanh", is_v3_model},
-                     {"kLinearOutputAsByte", true}});
-            linear_cps[0] =
-                    make_cps(device, "linear_from_rev_lstm", linear_constants, linear_threads);
+            linear_constants[0] = {{"kLinearInSize", config.insize},
+                                   {"kLinearOutSize", config.outsize},
+                                   // If v4, rescale from clamped [-5.0, 5.0] range to byte range.
+                                   // If v3, rescale from tanh [-1.0, 1,0] range to byte range.
+                                   {"kLinearOutputScale", is_v3_model ? 127.0f : (127.0f / 5.0f)},
+                                   {"kLinearOutputClamp", !is_v3_model},
+                                   {"kLinearOutputTanh", is_v3_model},
+                                   {"kLinearOutputAsByte", true}};
             // Single matmul that may or may not have a bias.
-            if (!config.out_features.has_value()) {
-                linear1 = register_module("linear1",
-                                          MetalLinear(config.insize, config.outsize, config.bias));
-            }
+            linear1 = register_module("linear1",
+                                      MetalLinear(config.insize, config.outsize, config.bias));
         }
 
         // This buffer is used for several layers of the model.
@@ -361,6 +446,85 @@ struct MetalBlockImpl : Module {
                 device, size_t(lstm_chunk_size + 3) * batch_size * config.insize * dtype_bytes);
         mat_state = create_buffer(device, batch_size * config.insize * dtype_bytes);
         mat_temp = create_buffer(device, mat_temp_elems * dtype_bytes * 20 * config.num_features);
+
+        tune_kernels(model_path, out_split_, linear1_out_size, linear_constants[0]);
+
+        const auto lstm_constants = [&](bool reversed) {
+            return std::vector<std::tuple<std::string, MetalConstant>>{
+                    {"kLstmLayerSize", config.insize}, {"kLstmReversedInTime", reversed}};
+        };
+        lstm_cps[0] = make_cps(device, "lstm", lstm_constants(false), lstm_simd_groups * 32);
+        lstm_cps[1] = make_cps(device, "lstm", lstm_constants(true), lstm_simd_groups * 32);
+        linear_cps[0] = make_cps(device, "linear_from_rev_lstm", linear_constants[0],
+                                 linear_simd_groups * 32);
+        if (config.out_features.has_value()) {
+            linear_cps[1] =
+                    make_cps(device, "linear", linear_constants[1], linear_simd_groups * 32);
+        }
+    }
+
+    // Picks the SIMD group counts of the LSTM and linear kernels, by timing each candidate on
+    // a few timesteps of this block's buffers, unless the choice for this device, layer size
+    // and batch size is already in the model directory's tuning cache.  The weights haven't
+    // been loaded yet, but their values don't affect how long the kernels take.
+    void tune_kernels(const std::filesystem::path &model_path,
+                      int out_split,
+                      int linear1_out_size,
+                      const std::vector<std::tuple<std::string, MetalConstant>> &linear_constants) {
+        KernelTuningCache cache(model_path);
+        const auto device_id = tuning_device_id(device);
+        const int fallback = default_simd_groups(config.insize);
+
+        if (const auto cached = cache.find(device_id, "lstm", config.insize, batch_size)) {
+            lstm_simd_groups = *cached;
+        } else {
+            MTL::Buffer *const args = create_vec_buffer<int32_t>(
+                    device, {batch_size / kTileSize, kTuningChunkSize});
+            lstm_simd_groups = tune_simd_groups(
+                    device, command_queue, "lstm",
+                    {{"kLstmLayerSize", config.insize}, {"kLstmReversedInTime", false}},
+                    {args, mat_working_mem, mtl_for_tensor(rnn1->t_weights_bias), mat_state},
+                    lstm_tg_buffer_lens, kernel_thread_groups, fallback);
+            args->release();
+            cache.insert(device_id, "lstm", config.insize, batch_size, lstm_simd_groups);
+        }
+
+        if (const auto cached = cache.find(device_id, "linear", config.insize, batch_size)) {
+            linear_simd_groups = *cached;
+        } else {
+            // The first (possibly only) linear kernel, for one split of the batch.  Its output
+            // goes to a scratch buffer, as the real one belongs to the caller.
+            const int32_t in_batch_tiles = batch_size / kTileSize;
+            const int32_t out_batch_tiles = (batch_size / out_split) / kTileSize;
+            MTL::Buffer *const args = create_vec_buffer<int32_t>(
+                    device, {in_batch_tiles, 0, out_batch_tiles, kTuningChunkSize});
+            MTL::Buffer *const weights = create_buffer(
+                    device, size_t(config.insize + 1) * linear1_out_size * dtype_bytes);
+            MTL::Buffer *const out = create_buffer(device, size_t(kTuningChunkSize) *
+                                                                   out_batch_tiles * kTileSize *
+                                                                   linear1_out_size * dtype_bytes);
+            linear_simd_groups = tune_simd_groups(
+                    device, command_queue, "linear_from_rev_lstm", linear_constants,
+                    {args, mat_working_mem, weights, out}, linear_tg_buffer_lens,
+                    kernel_thread_groups, fallback);
+            for (auto *const buffer : {args, weights, out}) {
+                buffer->release();
+            }
+            cache.insert(device_id, "linear", config.insize, batch_size, linear_simd_groups);
+        }
+        spdlog::debug("Metal kernels use {} SIMD groups for LSTM and {} for linear layers",
+                      lstm_simd_groups, linear_simd_groups);
+    }
+
+    // Threadgroup memory buffer sizes of the LSTM and linear kernels, which depend on their
+    // SIMD group counts.
+    static std::vector<int> lstm_tg_buffer_lens(int simd_groups) {
+        const int res_buf_size = dtype_bytes * simd_groups * 2 * kTileSize * kTileSize;
+        const int out_buf_size = dtype_bytes * simd_groups * kTileSize * kTileSize;
+        return {res_buf_size, out_buf_size};
+    }
+    static std::vector<int> linear_tg_buffer_lens(int simd_groups) {
+        return {static_cast<int>(dtype_bytes * simd_groups * kTileSize * kTileSize)};
     }
 
     void load_weights() {
@@ -417,7 +581,8 @@ struct MetalBlockImpl : Module {
         }
     }
 
-    // Executes the model, with the linear layer held off by linear_hold_off, if non-NULL.
+    // Encodes the model into a new command buffer, which is returned uncommitted, with the
+    // linear layer held off by linear_hold_off, if non-NULL.
     MTL::CommandBuffer *forward_async(torch::Tensor &in,
                                       MTL::SharedEvent *const linear_hold_off_event,
                                       uint64_t linear_hold_off_id,
@@ -436,32 +601,25 @@ struct MetalBlockImpl : Module {
         }
         conv2->run(command_buffer, mat_working_mem, mat_temp);
         conv3->run(command_buffer, mat_temp, mat_working_mem);
-        finishCommandBuffer("convolutions", command_buffer, 0);
-        command_buffer = command_queue->commandBuffer();
 
         for (auto &rnn : {rnn1, rnn2, rnn3, rnn4, rnn5}) {
             const std::vector<MTL::Buffer *> buffers{
                     args_lstm, mat_working_mem, mtl_for_tensor(rnn->t_weights_bias), mat_state};
-            const int kResBufSize = dtype_bytes * kernel_simd_groups * 2 * kTileSize * kTileSize;
-            const int kOutBufSize = dtype_bytes * kernel_simd_groups * kTileSize * kTileSize;
-            const std::vector<int> tg_buffer_lens{kResBufSize, kOutBufSize};
-            launch_kernel_no_wait(lstm_cps[rnn->reverse], command_buffer, buffers, tg_buffer_lens,
-                                  kernel_thread_groups, kernel_simd_groups * 32);
+            launch_kernel_no_wait(lstm_cps[rnn->reverse], command_buffer, buffers,
+                                  lstm_tg_buffer_lens(lstm_simd_groups), kernel_thread_groups,
+                                  lstm_simd_groups * 32);
         }
-        finishCommandBuffer("lstm", command_buffer, 0);
-        command_buffer = command_queue->commandBuffer();
 
         // The output buffers of conv/LSTM layers are not used by the decoding, so
         // can be overwritten by subsequent batches as soon as they have been consumed by
-        // the linear layer.  The output of the linear layer must be protected until
-        // it has been decoded.
+        // the linear layer.  Command buffers on the same queue run in order, so a batch's
+        // convolutions don't start before the last batch's linear layer is done with them.
+        // The output of the linear layer must be protected until it has been decoded.
         command_buffer->encodeWait(linear_hold_off_event, linear_hold_off_id);
 
         // For now the same SIMD group count, and therefore threadgroup memory buffer size, is
         // used for all linear layer kernel invocations.
-        const int kLinearTGOutBufSize =
-                static_cast<int>(dtype_bytes * kernel_simd_groups * kTileSize * kTileSize);
-        const std::vector<int> linear_tg_buffer_lens{kLinearTGOutBufSize};
+        const auto tg_buffer_lens = linear_tg_buffer_lens(linear_simd_groups);
 
         // The output of the linear layer is split into multiple buffers, each generated
         // by a separate kernel launch.
@@ -471,17 +629,17 @@ struct MetalBlockImpl : Module {
             if (config.out_features.has_value()) {
                 launch_kernel_no_wait(linear_cps[0], command_buffer,
                                       {args_buffer, mat_working_mem, linear_weights[0], mat_temp},
-                                      linear_tg_buffer_lens, kernel_thread_groups,
-                                      kernel_simd_groups * 32);
+                                      tg_buffer_lens, kernel_thread_groups,
+                                      linear_simd_groups * 32);
                 launch_kernel_no_wait(linear_cps[1], command_buffer,
                                       {args_linear2, mat_temp, linear_weights[1], out_buffer},
-                                      linear_tg_buffer_lens, kernel_thread_groups,
-                                      kernel_simd_groups * 32);
+                                      tg_buffer_lens, kernel_thread_groups,
+                                      linear_simd_groups * 32);
             } else {
                 launch_kernel_no_wait(linear_cps[0], command_buffer,
                                       {args_buffer, mat_working_mem, linear_weights[0], out_buffer},
-                                      linear_tg_buffer_lens, kernel_thread_groups,
-                                      kernel_simd_groups * 32);
+                                      tg_buffer_lens, kernel_thread_groups,
+                                      linear_simd_groups * 32);
             }
         }
         return command_buffer;
@@ -493,7 +651,8 @@ struct MetalBlockImpl : Module {
     MTL::Buffer *mat_working_mem, *mat_state, *mat_temp, *args_lstm, *args_to_half,
             *linear_weights[2], *args_linear2;
     std::vector<MTL::Buffer *> args_linear;
-    int in_chunk_size, lstm_chunk_size, batch_size, kernel_thread_groups, kernel_simd_groups;
+    int in_chunk_size, lstm_chunk_size, batch_size, kernel_thread_groups;
+    int lstm_simd_groups, linear_simd_groups;
     CRFModelConfig config;
     MetalLSTM rnn1{nullptr}, rnn2{nullptr}, rnn3{nullptr}, rnn4{nullptr}, rnn5{nullptr};
     MetalConv1d conv1{nullptr}, conv2{nullptr}, conv3{nullptr};
@@ -507,9 +666,11 @@ struct MetalModelImpl : Module {
                    int chunk_size,
                    int batch_size,
                    int out_split,
-                   MTL::Device *const device) {
-        mtl_block = register_module("mtl_block",
-                                    MetalBlock(chunk_size, batch_size, config, out_split, device));
+                   MTL::Device *const device,
+                   const std::filesystem::path &model_path) {
+        mtl_block = register_module(
+                "mtl_block",
+                MetalBlock(chunk_size, batch_size, config, out_split, device, model_path));
     }
 
     void load_state_dict(const std::vector<torch::Tensor> &weights) {
@@ -594,8 +755,8 @@ public:
         m_out_batch_size = m_batch_size / m_out_split;
         assert(m_out_batch_size % MTL_CORE_BATCH_SIZE == 0);
 
-        m_model =
-                nn::MetalModel(model_config, m_in_chunk_size, m_batch_size, m_out_split, m_device);
+        m_model = nn::MetalModel(model_config, m_in_chunk_size, m_batch_size, m_out_split, m_device,
+                                 model_path);
         m_model->load_state_dict(state_dict);
         m_model->eval();
 
@@ -618,10 +779,48 @@ public:
 
         int y = pow(n_base, model_config.state_len);
 
-        for (int i = 0; i < m_out_split; ++i) {
-            m_scores_int8.push_back(torch::empty({T, m_out_batch_size, C}, torch::kInt8));
-            m_posts.push_back(torch::empty({m_out_batch_size, T + 1, Cs}));
-            m_bwd.push_back(torch::empty({m_out_batch_size, T + 1, Cs}));
+        for (size_t buffers_idx = 0; buffers_idx < kMaxBatchesInFlight; ++buffers_idx) {
+            for (int i = 0; i < m_out_split; ++i) {
+                m_scores_int8[buffers_idx].push_back(
+                        torch::empty({T, m_out_batch_size, C}, torch::kInt8));
+                m_posts[buffers_idx].push_back(torch::empty({m_out_batch_size, T + 1, Cs}));
+                m_bwd[buffers_idx].push_back(torch::empty({m_out_batch_size, T + 1, Cs}));
+            }
+        }
+
+        // This stage is operating on the split outputs of the linear layer, so
+        // the effective batch size is m_out_batch_size.
+        const std::vector<int32_t> scan_args{m_out_chunk_size, m_out_batch_size, m_states};
+        m_scan_args = create_vec_buffer(m_device, scan_args);
+
+        // Unless the beam is too wide for it, beam search runs on the GPU too, and only its
+        // results are read back.
+        m_gpu_decode = m_decoder_options.beam_width <= kMaxGpuBeamWidth;
+        spdlog::debug("Metal beam search on {}", m_gpu_decode ? "GPU" : "CPU");
+        if (m_gpu_decode) {
+            m_beam_search_cps = make_cps(m_device, "beam_search", {});
+            const int beam_width = static_cast<int>(m_decoder_options.beam_width);
+            const float log_beam_cut =
+                    (m_decoder_options.beam_cut > 0.0f)
+                            ? (m_decoder_options.temperature * logf(m_decoder_options.beam_cut))
+                            : std::numeric_limits<float>::max();
+            for (int i = 0; i < m_out_split; ++i) {
+                const std::vector<BeamSearchArgs> beam_search_args{
+                        {m_out_chunk_size, m_out_batch_size, m_states, beam_width, log_beam_cut,
+                         m_decoder_options.blank_score, m_decoder_options.temperature,
+                         m_decoder_options.q_shift, m_decoder_options.q_scale,
+                         i * m_out_batch_size}};
+                m_beam_search_args.push_back(create_vec_buffer(m_device, beam_search_args));
+            }
+            for (auto &buffers : m_decode_buffers) {
+                buffers.beam = torch::empty({m_batch_size, T + 1, beam_width}, torch::kInt32);
+                buffers.states = torch::empty({m_batch_size, T}, torch::kInt32);
+                buffers.block_probs = torch::empty({m_batch_size, T});
+                buffers.moves = torch::empty({m_batch_size, T}, torch::kUInt8);
+                buffers.sequence = torch::empty({m_batch_size, T}, torch::kInt8);
+                buffers.qstring = torch::empty({m_batch_size, T}, torch::kInt8);
+                buffers.sequence_len = torch::empty({m_batch_size}, torch::kInt32);
+            }
         }
 
         // v3 scores come from a tanh activation whose [-1, 1] range is packed into bytes.
@@ -660,6 +859,8 @@ public:
         int decode_chunks_finished{0};
         // Event ID to be signalled when decoding for this task is complete, set by metal_thread_fn.
         uint64_t decode_complete_event_id = static_cast<uint64_t>(0);
+        // Which set of score buffers the task's model output is written to.
+        int buffers_idx = 0;
     };
 
     void call_chunks(torch::Tensor &input, int num_chunks, std::vector<DecodedChunk> &out_chunks) {
@@ -680,20 +881,75 @@ public:
         }
     }
 
+    // Encodes the model and scans for task into a command buffer and commits it.
+    MTL::CommandBuffer *commit_task(const NNTask &task) {
+        // The linear layer should not execute until the last batch to use the same score
+        // buffers has been decoded, since they hold its scores and fwd/bwd scans.
+        const auto id = task.decode_complete_event_id;
+        const auto hold_off_id = id > kMaxBatchesInFlight ? id - kMaxBatchesInFlight : 0;
+        auto &scores_int8 = m_scores_int8[task.buffers_idx];
+        MTL::CommandBuffer *const cb = m_model->forward_async(*task.input, m_decode_complete_event,
+                                                              hold_off_id, scores_int8);
+
+        // The same buffer is used for the forward scan results and the output of
+        // m_add_softmax_cps.
+        auto &fwd = m_posts[task.buffers_idx];
+        auto &bwd = m_bwd[task.buffers_idx];
+        for (int i = 0; i < m_out_split; ++i) {
+            // TODO: optimise grid size
+            launch_kernel_no_wait(
+                    m_fwd_scan_cps, cb,
+                    {m_scan_args, mtl_for_tensor(scores_int8.at(i)), mtl_for_tensor(fwd.at(i))},
+                    {}, m_out_batch_size, m_states);
+
+            launch_kernel_no_wait(
+                    m_bwd_scan_cps, cb,
+                    {m_scan_args, mtl_for_tensor(scores_int8.at(i)), mtl_for_tensor(bwd.at(i))},
+                    {}, m_out_batch_size, m_states);
+
+            launch_kernel_no_wait(
+                    m_add_softmax_cps, cb,
+                    {m_scan_args, mtl_for_tensor(fwd.at(i)), mtl_for_tensor(bwd.at(i))}, {},
+                    m_out_batch_size, m_states);
+
+            if (m_gpu_decode) {
+                // One simdgroup per chunk.
+                const auto &out = m_decode_buffers[task.buffers_idx];
+                launch_kernel_no_wait(
+                        m_beam_search_cps, cb,
+                        {m_beam_search_args.at(i), mtl_for_tensor(scores_int8.at(i)),
+                         mtl_for_tensor(bwd.at(i)), mtl_for_tensor(fwd.at(i)),
+                         mtl_for_tensor(out.beam), mtl_for_tensor(out.states),
+                         mtl_for_tensor(out.block_probs), mtl_for_tensor(out.moves),
+                         mtl_for_tensor(out.sequence), mtl_for_tensor(out.qstring),
+                         mtl_for_tensor(out.sequence_len)},
+                        {}, m_out_batch_size, 32);
+            }
+        }
+        cb->commit();
+        return cb;
+    }
+
     void metal_thread_fn() {
-        // Incrementing ID used to prevent the linear layer of run i+1 overwriting the scores of
-        // run i before the CPU has finished decoding all run i's chunks.
+        utils::set_thread_name("metal_caller");
+        // Incrementing ID used to prevent the linear layer of run i+kMaxBatchesInFlight
+        // overwriting the scores of run i before the CPU has finished decoding all run i's chunks.
         // Start at 1, since at event creation ID 0 is deemed to have been signalled.
         auto next_decode_complete_event_id = static_cast<uint64_t>(1);
 
         // For unknown reasons, concurrent access to the GPU from multiple instances of this thread --
         // i.e. with > 1 instance of MetalCaller -- results in errors, usually command buffer error code 1.
-        // Holding this mutex while executing models seemingly prevents these errors.
+        // Holding this mutex while executing models seemingly prevented these errors.  Now that
+        // batches are pipelined, it's held while each is encoded and committed.
         static std::mutex inter_caller_mutex;
 
+        // Tasks whose command buffers have been committed, oldest first.  The next batch is
+        // queued while these run, so the GPU doesn't sit idle between batches.
+        std::deque<std::pair<NNTask *, MTL::CommandBuffer *>> in_flight;
+
         while (true) {
             std::unique_lock<std::mutex> input_lock(m_input_lock);
-            while (m_input_queue.empty() && !m_terminate) {
+            while (m_input_queue.empty() && in_flight.empty() && !m_terminate) {
                 m_input_cv.wait_for(input_lock, 100ms);
             }
             // TODO: finish work before terminating?
@@ -701,6 +957,31 @@ public:
                 return;
             }
 
+            if (m_input_queue.empty() || in_flight.size() == kMaxBatchesInFlight) {
+                input_lock.unlock();
+                // Nothing more can be queued, so wait for the oldest batch and hand it on.
+                auto [task, cb] = in_flight.front();
+                in_flight.pop_front();
+
+                // TODO: find a more robust way of dealing with Metal kernel launch issues
+                // Batches queued after this one don't use its buffers, or wait for its decode,
+                // so it can be resubmitted behind them.
+                for (int try_count = 0;
+                     !waitForCommandBuffer("model/scan", cb, try_count) && try_count < 4;
+                     ++try_count) {
+                    std::this_thread::sleep_for(20ms);
+                    std::lock_guard<std::mutex> lock(inter_caller_mutex);
+                    cb = commit_task(*task);
+                }
+
+                // Pass task on to decode threads
+                std::unique_lock<std::mutex> decode_lock(m_decode_lock);
+                m_decode_queue.push_front(task);
+                decode_lock.unlock();
+                m_decode_cv.notify_all();
+                continue;
+            }
+
             NNTask *const task = m_input_queue.back();
             m_input_queue.pop_back();
             input_lock.unlock();
@@ -709,57 +990,16 @@ public:
             // This ID will be signalled by the CPU once it has finished relevant decoding work,
             // allowing the GPU to proceed.
             task->decode_complete_event_id = next_decode_complete_event_id++;
+            task->buffers_idx =
+                    static_cast<int>(task->decode_complete_event_id % kMaxBatchesInFlight);
 
-            // TODO: find a more robust way of dealing with Metal kernel launch issues
-            for (int try_count = 0; try_count < 5; ++try_count) {
-                std::lock_guard<std::mutex> lock(inter_caller_mutex);
-
-                // The linear layer should not execute until the previous batch has been decoded,
-                // since the same buffers are used for successive batches' scores, fwd/bwd scans.
-                MTL::CommandBuffer *const cb =
-                        m_model->forward_async(*task->input, m_decode_complete_event,
-                                               task->decode_complete_event_id - 1, m_scores_int8);
-
-                // The same buffer is used for the forward scan results and the output of
-                // m_add_softmax_cps.
-                auto &fwd = m_posts;
-                // This stage is operating on the split outputs of the linear layer, so
-                // the effective batch size is m_out_batch_size.
-                std::vector<int32_t> scan_args_{m_out_chunk_size, m_out_batch_size, m_states};
-                auto scan_args = create_vec_buffer(m_device, scan_args_);
-
-                for (int i = 0; i < m_out_split; ++i) {
-                    // TODO: optimise grid size
-                    launch_kernel_no_wait(m_fwd_scan_cps, cb,
-                                          {scan_args, mtl_for_tensor(m_scores_int8.at(i)),
-                                           mtl_for_tensor(fwd.at(i))},
-                                          {}, m_out_batch_size, m_states);
-
-                    launch_kernel_no_wait(m_bwd_scan_cps, cb,
-                                          {scan_args, mtl_for_tensor(m_scores_int8.at(i)),
-                                           mtl_for_tensor(m_bwd.at(i))},
-                                          {}, m_out_batch_size, m_states);
-
-                    launch_kernel_no_wait(
-                            m_add_softmax_cps, cb,
-                            {scan_args, mtl_for_tensor(fwd.at(i)), mtl_for_tensor(m_bwd.at(i))}, {},
-                            m_out_batch_size, m_states);
-                }
-                if (finishCommandBuffer("linear/scan/softmax", cb, try_count)) {
-                    break;
-                }
-                std::this_thread::sleep_for(20ms);
-            }
-
-            // Pass task on to decode threads
-            std::unique_lock<std::mutex> decode_lock(m_decode_lock);
-            m_decode_queue.push_front(task);
-            decode_lock.unlock();
-            m_decode_cv.notify_all();
+            std::lock_guard<std::mutex> lock(inter_caller_mutex);
+            in_flight.emplace_back(task, commit_task(*task));
         }
     }
 
     void decode_thread_fn(int thread_id) {
+        utils::set_thread_name("metal_decode");
         while (true) {
             std::unique_lock<std::mutex> decode_lock(m_decode_lock);
             while (m_decode_queue.empty() && !m_terminate) {
@@ -777,36 +1017,74 @@ public:
             }
             decode_lock.unlock();
 
+            if (m_gpu_decode) {
+                // The chunk has already been decoded, so just copy out the results.
+                const auto &out = m_decode_buffers[task->buffers_idx];
+                const int T = m_out_chunk_size;
+                const int sequence_len = out.sequence_len.data_ptr<int32_t>()[chunk_idx];
+                const auto *const sequence =
+                        reinterpret_cast<const char *>(out.sequence.data_ptr<int8_t>()) +
+                        chunk_idx * T;
+                const auto *const qstring =
+                        reinterpret_cast<const char *>(out.qstring.data_ptr<int8_t>()) +
+                        chunk_idx * T;
+                const auto *const moves = out.moves.data_ptr<uint8_t>() + chunk_idx * T;
+                (*task->out_chunks)[chunk_idx] = DecodedChunk{
+                        std::string(sequence, sequence_len), std::string(qstring, sequence_len),
+                        std::vector<uint8_t>(moves, moves + T)};
+                finish_decoded_chunk(task);
+                continue;
+            }
+
             // Model outputs are split across m_out_split buffers.
-            assert(m_scores_int8.size() == m_out_split);
-            assert(m_bwd.size() == m_out_split);
-            assert(m_posts.size() == m_out_split);
+            const auto &scores_int8 = m_scores_int8[task->buffers_idx];
+            const auto &bwd = m_bwd[task->buffers_idx];
+            const auto &posts = m_posts[task->buffers_idx];
+            assert(scores_int8.size() == m_out_split);
+            assert(bwd.size() == m_out_split);
+            assert(posts.size() == m_out_split);
             const int out_buf_idx = chunk_idx / m_out_batch_size;
             const int buf_chunk_idx = chunk_idx % m_out_batch_size;
 
             auto [sequence, qstring, moves] = beam_search_decode(
-                    m_scores_int8.at(out_buf_idx).index({Slice(), buf_chunk_idx}),
-                    m_bwd.at(out_buf_idx)[buf_chunk_idx], m_posts.at(out_buf_idx)[buf_chunk_idx],
+                    scores_int8.at(out_buf_idx).index({Slice(), buf_chunk_idx}),
+                    bwd.at(out_buf_idx)[buf_chunk_idx], posts.at(out_buf_idx)[buf_chunk_idx],
                     m_decoder_options.beam_width, m_decoder_options.beam_cut,
                     m_decoder_options.blank_score, m_decoder_options.q_shift,
                     m_decoder_options.q_scale, m_decoder_options.temperature, score_scale);
 
             (*task->out_chunks)[chunk_idx] = DecodedChunk{sequence, qstring, moves};
+            finish_decoded_chunk(task);
+        }
+    }
 
-            // Wake the waiting thread which called `call_chunks()` if we're done decoding
-            std::unique_lock<std::mutex> task_lock(task->mut);
-            bool done = ++(task->decode_chunks_finished) == task->num_chunks;
-            task_lock.unlock();
-            if (done) {
-                // Now that all chunks are decoded, signal that the GPU can overwrite the scores
-                // buffer with subsequent work.
-                assert(m_decode_complete_event != nullptr);
-                m_decode_complete_event->setSignaledValue(task->decode_complete_event_id);
-                task->cv.notify_one();
-            }
+    void finish_decoded_chunk(NNTask *const task) {
+        // Wake the waiting thread which called `call_chunks()` if we're done decoding
+        std::unique_lock<std::mutex> task_lock(task->mut);
+        bool done = ++(task->decode_chunks_finished) == task->num_chunks;
+        task_lock.unlock();
+        if (done) {
+            // Now that all chunks are decoded, signal that the GPU can overwrite the scores
+            // buffers with subsequent work.
+            signal_decode_complete(task->decode_complete_event_id);
+            task->cv.notify_one();
         }
     }
 
+    // Tasks in flight can finish decoding out of order, but the event's value must only go up,
+    // so it's only advanced to an ID once every task before it is decoded too.
+    void signal_decode_complete(uint64_t decode_complete_event_id) {
+        assert(m_decode_complete_event != nullptr);
+        std::lock_guard<std::mutex> decode_lock(m_decode_lock);
+        m_decoded_event_ids.insert(decode_complete_event_id);
+        auto signalled_id = m_decode_complete_event->signaledValue();
+        while (!m_decoded_event_ids.empty() && *m_decoded_event_ids.begin() == signalled_id + 1) {
+            m_decoded_event_ids.erase(m_decoded_event_ids.begin());
+            ++signalled_id;
+        }
+        m_decode_complete_event->setSignaledValue(signalled_id);
+    }
+
     bool m_terminate{false};
     std::deque<NNTask *> m_input_queue;
     std::deque<NNTask *> m_decode_queue;
@@ -822,7 +1100,22 @@ public:
     MTL::ComputePipelineState *m_bwd_scan_cps, *m_fwd_scan_cps, *m_add_softmax_cps;
     // Used to signal completion of an NNTask's decoding.
     MTL::SharedEvent *m_decode_complete_event = nullptr;
-    std::vector<torch::Tensor> m_scores_int8, m_posts, m_bwd;
+    // IDs of decoded tasks that are waiting on an earlier task before they can be signalled.
+    std::set<uint64_t> m_decoded_event_ids;
+    // One set of buffers per batch in flight.
+    std::array<std::vector<torch::Tensor>, kMaxBatchesInFlight> m_scores_int8, m_posts, m_bwd;
+    MTL::Buffer *m_scan_args;
+    // Set if beam search runs on the GPU, in which case its results are written here.
+    bool m_gpu_decode = false;
+    MTL::ComputePipelineState *m_beam_search_cps = nullptr;
+    // One per piece of the linear output.
+    std::vector<MTL::Buffer *> m_beam_search_args;
+    struct DecodeBuffers {
+        // Working space for the kernel.
+        torch::Tensor beam, states, block_probs;
+        torch::Tensor moves, sequence, qstring, sequence_len;
+    };
+    std::array<DecodeBuffers, kMaxBatchesInFlight> m_decode_buffers;
     int m_in_chunk_size, m_out_chunk_size, m_batch_size, m_states, m_model_stride;
     // Number of pieces the linear output is split into, for reasons of
     // buffer size constraints.
@@ -845,9 +1138,15 @@ MetalModelRunner::MetalModelRunner(std::shared_ptr<MetalCaller> caller) : m_call
     // is to be submitted directly then it must also have this arrangement.
     // Note that this is not the same as other caller implementations, which
     // have T innermost.
-    m_input = torch::empty(
-            {caller->m_batch_size, caller->m_in_chunk_size, caller->m_num_input_features},
-            torch::kF16);
+    // m_input is backed by a shared buffer, so accept_chunk writes chunks straight into memory
+    // the GPU reads, and the first convolution takes it without a copy.  The same buffer is
+    // reused for every batch the runner calls.
+    const std::vector<int64_t> input_sizes{caller->m_batch_size, caller->m_in_chunk_size,
+                                           caller->m_num_input_features};
+    const auto input_bytes = static_cast<size_t>(caller->m_batch_size) * caller->m_in_chunk_size *
+                             caller->m_num_input_features * torch::elementSize(torch::kF16);
+    m_input = tensor_for_mtl(create_buffer(caller->m_device, input_bytes), input_sizes,
+                             torch::kF16);
 }
 
 void MetalModelRunner::accept_chunk(int chunk_idx, const torch::Tensor &chunk) {
@@ -863,8 +1162,20 @@ void MetalModelRunner::accept_chunk(int chunk_idx, const torch::Tensor &chunk) {
     }
 }
 
+void MetalModelRunner::accept_chunks(int first_chunk_idx, const std::vector<ChunkSignal> &chunks) {
+    // With a single feature, channels innermost is the same layout as timesteps innermost.
+    if (m_caller->m_num_input_features == 1) {
+        auto batch = m_input.view({m_input.size(0), 1, m_input.size(1)});
+        if (copy_chunks_to_batch(batch, first_chunk_idx, chunks)) {
+            return;
+        }
+    }
+    ModelRunnerBase::accept_chunks(first_chunk_idx, chunks);
+}
+
 std::vector<DecodedChunk> MetalModelRunner::call_chunks(int num_chunks) {
     std::vector<DecodedChunk> out_chunks(num_chunks);
+    utils::TraceSpan span("forward_and_decode");
     m_caller->call_chunks(m_input, num_chunks, out_chunks);
     return out_chunks;
 }
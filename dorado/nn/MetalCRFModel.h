@@ -20,10 +20,12 @@ class MetalModelRunner final : public ModelRunnerBase {
 public:
     explicit MetalModelRunner(std::shared_ptr<MetalCaller> caller);
     void accept_chunk(int chunk_idx, const torch::Tensor& chunk) final;
+    void accept_chunks(int first_chunk_idx, const std::vector<ChunkSignal>& chunks) final;
     std::vector<DecodedChunk> call_chunks(int num_chunks) final;
     size_t model_stride() const final;
     size_t chunk_size() const final;
     size_t batch_size() const final;
+    std::string device() const final { return "metal"; }
 
 private:
     std::shared_ptr<MetalCaller> m_caller;
@@ -0,0 +1,71 @@
+#include "ModelRunner.h"
+
+#include "../utils/tensor_utils.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+
+namespace dorado {
+
+void ModelRunnerBase::accept_chunks(int first_chunk_idx, const std::vector<ChunkSignal> &chunks) {
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        accept_chunk(first_chunk_idx + static_cast<int>(i), chunk_input(chunks[i], chunk_size()));
+    }
+}
+
+torch::Tensor chunk_input(const ChunkSignal &chunk, size_t chunk_size) {
+    using torch::indexing::Ellipsis;
+    using torch::indexing::Slice;
+    auto input = chunk.signal->index(
+            {Ellipsis, Slice(int64_t(chunk.offset), int64_t(chunk.offset + chunk.length))});
+    if (chunk.length == chunk_size) {
+        return input;
+    }
+    // Stereo signal has a row per feature, each repeated along time.
+    const auto [n, overhang] = std::div(int(chunk_size), int(chunk.length));
+    std::vector<int64_t> repeats(input.dim(), 1);
+    repeats.back() = n;
+    return torch::concat({input.repeat(repeats), input.index({Ellipsis, Slice(0, overhang)})},
+                         -1);
+}
+
+bool copy_chunks_to_batch(torch::Tensor &batch,
+                          int first_chunk_idx,
+                          const std::vector<ChunkSignal> &chunks) {
+    if (batch.dim() != 3 || !batch.device().is_cpu() || !batch.is_contiguous() ||
+        first_chunk_idx + chunks.size() > size_t(batch.size(0))) {
+        return false;
+    }
+    const int64_t num_features = batch.size(1);
+    const size_t chunk_size = batch.size(2);
+    for (const auto &chunk : chunks) {
+        const auto &signal = *chunk.signal;
+        const int64_t num_rows = signal.dim() == 1 ? 1 : signal.size(0);
+        if (signal.dim() > 2 || num_rows != num_features || !signal.device().is_cpu() ||
+            signal.dtype() != batch.dtype() || !signal.is_contiguous() || chunk.length == 0 ||
+            chunk.length > chunk_size || chunk.offset + chunk.length > size_t(signal.size(-1))) {
+            return false;
+        }
+    }
+
+    auto *const batch_ptr = static_cast<std::byte *>(batch.data_ptr());
+    const size_t chunk_bytes = num_features * chunk_size * batch.element_size();
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        const auto &chunk = chunks[i];
+        utils::copy_repeat_padded(batch_ptr + (first_chunk_idx + i) * chunk_bytes, chunk_size,
+                                  *chunk.signal, chunk.offset, chunk.length);
+    }
+    return true;
+}
+
+int64_t trimmed_batch_size(int64_t num_chunks, int64_t batch_size, int64_t granularity) {
+    int64_t num_rows = batch_size;
+    while (num_rows % 2 == 0 && num_rows / 2 >= std::max<int64_t>(num_chunks, 1) &&
+           (num_rows / 2) % granularity == 0) {
+        num_rows /= 2;
+    }
+    return num_rows;
+}
+
+}  // namespace dorado
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../decode/Decoder.h"
+#include "../utils/TraceRecorder.h"
 #include "CRFModel.h"
 
 #include <spdlog/spdlog.h>
@@ -8,20 +9,55 @@
 #include <torch/torch.h>
 
 #include <string>
+#include <vector>
 
 namespace dorado {
 
+// One chunk of a batch: length samples of signal, from offset along its last dimension, which
+// are repeat padded out to the runner's chunk size if there are fewer.
+struct ChunkSignal {
+    const torch::Tensor *signal;
+    size_t offset;
+    size_t length;
+};
+
 class ModelRunnerBase {
 public:
     virtual void accept_chunk(int chunk_idx, const torch::Tensor &chunk) = 0;
+    // Puts chunks into the batch, from first_chunk_idx on.  By default each is sliced out,
+    // padded and passed to accept_chunk.
+    virtual void accept_chunks(int first_chunk_idx, const std::vector<ChunkSignal> &chunks);
     virtual std::vector<DecodedChunk> call_chunks(int num_chunks) = 0;
     virtual size_t model_stride() const = 0;
     virtual size_t chunk_size() const = 0;
     virtual size_t batch_size() const = 0;
+    // CPUs that threads driving this runner should be bound to, or empty if they may
+    // run anywhere.
+    virtual std::vector<int> cpu_affinity() const { return {}; }
+    // The device the runner calls on, e.g. "cuda:0", for reporting.
+    virtual std::string device() const = 0;
 };
 
 using Runner = std::shared_ptr<ModelRunnerBase>;
 
+// The chunk, repeat padded to chunk_size, as accept_chunk takes it.
+torch::Tensor chunk_input(const ChunkSignal &chunk, size_t chunk_size);
+
+// Copies chunks into batch, a contiguous host tensor of [batch size, features, chunk size],
+// from first_chunk_idx on, with memcpy rather than tensor indexing.  Each runner copies its
+// own batches, so the runners' threads already copy in parallel.  Returns false, having copied
+// nothing, unless every chunk's signal is a contiguous host tensor of batch's dtype with a row
+// for each feature.
+bool copy_chunks_to_batch(torch::Tensor &batch,
+                          int first_chunk_idx,
+                          const std::vector<ChunkSignal> &chunks);
+
+// The rows of a batch of batch_size to run the model on for num_chunks of them: batch_size
+// halved for as long as that still holds them and stays a multiple of granularity.  Partial
+// batches, as at the end of a run, are called in a fraction of the time of a full one, in few
+// enough shapes that each is only set up once.
+int64_t trimmed_batch_size(int64_t num_chunks, int64_t batch_size, int64_t granularity);
+
 template <typename T>
 class ModelRunner final : public ModelRunnerBase {
 public:
@@ -30,10 +66,12 @@ public:
                 int chunk_size,
                 int batch_size);
     void accept_chunk(int chunk_idx, const torch::Tensor &chunk) final;
+    void accept_chunks(int first_chunk_idx, const std::vector<ChunkSignal> &chunks) final;
     std::vector<DecodedChunk> call_chunks(int num_chunks) final;
     size_t model_stride() const final { return m_model_stride; }
     size_t chunk_size() const final { return m_input.size(2); }
     size_t batch_size() const final { return m_input.size(0); }
+    std::string device() const final { return m_device; }
 
 private:
     std::string m_device;
@@ -49,7 +87,8 @@ template <typename T>
 ModelRunner<T>::ModelRunner(const std::filesystem::path &model_path,
                             const std::string &device,
                             int chunk_size,
-                            int batch_size) {
+                            int batch_size)
+        : m_device(device) {
     const auto model_config = load_crf_model_config(model_path);
     m_model_stride = static_cast<size_t>(model_config.stride);
 
@@ -58,20 +97,33 @@ ModelRunner<T>::ModelRunner(const std::filesystem::path &model_path,
     m_decoder_options.q_scale = model_config.qscale;
     m_decoder = std::make_unique<T>();
 
-    m_options = torch::TensorOptions().dtype(T::dtype).device(device);
+    // The decoder accepts reduced precision scores, so on CPU the model may run in bf16.
+    const auto dtype = device == "cpu" ? cpu_model_dtype(model_config) : T::dtype;
+    if (dtype != T::dtype) {
+        spdlog::debug("> Running {} in {} on {}", model_path.filename().string(),
+                      c10::toString(dtype), device);
+    }
+    m_options = torch::TensorOptions().dtype(dtype).device(device);
     m_module = load_crf_model(model_path, model_config, m_options);
 
     // adjust chunk size to be a multiple of the stride
     chunk_size -= chunk_size % m_model_stride;
 
     m_input = torch::zeros({batch_size, 1, chunk_size},
-                           torch::TensorOptions().dtype(T::dtype).device(torch::kCPU));
+                           torch::TensorOptions().dtype(dtype).device(torch::kCPU));
 }
 
 template <typename T>
 std::vector<DecodedChunk> ModelRunner<T>::call_chunks(int num_chunks) {
     torch::InferenceMode guard;
-    auto scores = m_module->forward(m_input.to(m_options.device_opt().value()));
+    torch::Tensor scores;
+    {
+        utils::TraceSpan span("forward");
+        const auto num_rows = trimmed_batch_size(num_chunks, m_input.size(0), 1);
+        scores = m_module->forward(
+                m_input.narrow(0, 0, num_rows).to(m_options.device_opt().value()));
+    }
+    utils::TraceSpan span("decode");
     return m_decoder->beam_search(scores, num_chunks, m_decoder_options);
 }
 
@@ -80,4 +132,12 @@ void ModelRunner<T>::accept_chunk(int chunk_idx, const torch::Tensor &chunk) {
     m_input.index_put_({chunk_idx, 0}, chunk);
 }
 
+template <typename T>
+void ModelRunner<T>::accept_chunks(int first_chunk_idx, const std::vector<ChunkSignal> &chunks) {
+    // Signal in another dtype from the model's is converted chunk by chunk.
+    if (!copy_chunks_to_batch(m_input, first_chunk_idx, chunks)) {
+        ModelRunnerBase::accept_chunks(first_chunk_idx, chunks);
+    }
+}
+
 }  // namespace dorado
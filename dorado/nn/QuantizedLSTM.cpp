@@ -0,0 +1,251 @@
+#include "QuantizedLSTM.h"
+
+#include "../utils/simd.h"
+
+#include <ATen/Parallel.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+
+using dorado::utils::CpuDispatch;
+using dorado::utils::CpuIsa;
+
+// The hidden state is within (-1, 1), so it's quantised with a fixed scale.
+constexpr float kStateScale = 127.f;
+
+// Samples whose recurrent matmuls are done together, so each weight row is loaded once for
+// all of them.
+constexpr int kSampleTile = 4;
+
+// Adds weights * states to gates, for num_samples <= kSampleTile samples.
+// weights is [rows, cols] and states [num_samples, cols].  The gates of consecutive samples
+// are gate_stride apart.
+// Cols is the number of columns if it's known at compile time, for the layer sizes of the
+// models run on the CPU, so that the loops over them are fully unrolled, or 0 to take cols.
+template <int Cols>
+void recurrent_matmul_cols_generic(const std::int8_t* const weights,
+                                   const float* const scales,
+                                   int rows,
+                                   int cols,
+                                   const std::int16_t* const states,
+                                   int num_samples,
+                                   float* const gates,
+                                   std::int64_t gate_stride) {
+    const int num_cols = Cols ? Cols : cols;
+    for (int row = 0; row < rows; ++row) {
+        const std::int8_t* const weight_row = weights + static_cast<std::int64_t>(row) * num_cols;
+        for (int sample = 0; sample < num_samples; ++sample) {
+            const std::int16_t* const state = states + sample * num_cols;
+            std::int32_t sum = 0;
+            for (int col = 0; col < num_cols; ++col) {
+                sum += static_cast<std::int32_t>(weight_row[col]) * state[col];
+            }
+            gates[sample * gate_stride + row] += static_cast<float>(sum) * scales[row];
+        }
+    }
+}
+
+void recurrent_matmul_generic(const std::int8_t* const weights,
+                              const float* const scales,
+                              int rows,
+                              int cols,
+                              const std::int16_t* const states,
+                              int num_samples,
+                              float* const gates,
+                              std::int64_t gate_stride) {
+    switch (cols) {
+    case 96:
+        return recurrent_matmul_cols_generic<96>(weights, scales, rows, cols, states, num_samples,
+                                                 gates, gate_stride);
+    case 128:
+        return recurrent_matmul_cols_generic<128>(weights, scales, rows, cols, states, num_samples,
+                                                  gates, gate_stride);
+    default:
+        return recurrent_matmul_cols_generic<0>(weights, scales, rows, cols, states, num_samples,
+                                                gates, gate_stride);
+    }
+}
+
+#if ENABLE_AVX2_IMPL
+__attribute__((target("avx2"))) std::int32_t horizontal_sum(__m256i v) {
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+}
+
+// As recurrent_matmul_cols_generic.  With Cols known, each weight row's vectors are loaded
+// once into registers for all the samples, and there's no scalar tail.
+template <int Cols>
+__attribute__((target("avx2"))) void recurrent_matmul_cols_avx2(const std::int8_t* const weights,
+                                                                const float* const scales,
+                                                                int rows,
+                                                                int cols,
+                                                                const std::int16_t* const states,
+                                                                int num_samples,
+                                                                float* const gates,
+                                                                std::int64_t gate_stride) {
+    assert(num_samples <= kSampleTile);
+    // 16 int16 multiplies per _mm256_madd_epi16, pairwise summed into 8 int32 lanes.
+    static constexpr int kUnroll = 16;
+    static_assert(Cols % kUnroll == 0);
+    const int num_cols = Cols ? Cols : cols;
+    const int vector_cols = Cols ? Cols : cols - cols % kUnroll;
+    for (int row = 0; row < rows; ++row) {
+        const std::int8_t* const weight_row = weights + static_cast<std::int64_t>(row) * num_cols;
+        __m256i sums[kSampleTile];
+        for (int sample = 0; sample < num_samples; ++sample) {
+            sums[sample] = _mm256_setzero_si256();
+        }
+        for (int col = 0; col < vector_cols; col += kUnroll) {
+            const __m256i weight_elems = _mm256_cvtepi8_epi16(
+                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(weight_row + col)));
+            for (int sample = 0; sample < num_samples; ++sample) {
+                const __m256i state_elems = _mm256_loadu_si256(
+                        reinterpret_cast<const __m256i*>(states + sample * num_cols + col));
+                sums[sample] = _mm256_add_epi32(sums[sample],
+                                                _mm256_madd_epi16(weight_elems, state_elems));
+            }
+        }
+        for (int sample = 0; sample < num_samples; ++sample) {
+            const std::int16_t* const state = states + sample * num_cols;
+            std::int32_t sum = horizontal_sum(sums[sample]);
+            for (int col = vector_cols; col < num_cols; ++col) {
+                sum += static_cast<std::int32_t>(weight_row[col]) * state[col];
+            }
+            gates[sample * gate_stride + row] += static_cast<float>(sum) * scales[row];
+        }
+    }
+}
+
+__attribute__((target("avx2"))) void recurrent_matmul_avx2(const std::int8_t* const weights,
+                                                           const float* const scales,
+                                                           int rows,
+                                                           int cols,
+                                                           const std::int16_t* const states,
+                                                           int num_samples,
+                                                           float* const gates,
+                                                           std::int64_t gate_stride) {
+    switch (cols) {
+    case 96:
+        return recurrent_matmul_cols_avx2<96>(weights, scales, rows, cols, states, num_samples,
+                                              gates, gate_stride);
+    case 128:
+        return recurrent_matmul_cols_avx2<128>(weights, scales, rows, cols, states, num_samples,
+                                               gates, gate_stride);
+    default:
+        return recurrent_matmul_cols_avx2<0>(weights, scales, rows, cols, states, num_samples,
+                                             gates, gate_stride);
+    }
+}
+#endif
+
+const CpuDispatch<decltype(recurrent_matmul_generic)> recurrent_matmul(
+        recurrent_matmul_generic, {{CpuIsa::AVX2, AVX2_KERNEL(recurrent_matmul_avx2)}});
+
+float sigmoid(float x) { return 1.f / (1.f + std::exp(-x)); }
+
+}  // namespace
+
+namespace dorado::nn {
+
+QuantizedLSTMLayer::QuantizedLSTMLayer(const torch::Tensor& weight_ih,
+                                       const torch::Tensor& weight_hh,
+                                       const torch::Tensor& bias_ih,
+                                       const torch::Tensor& bias_hh)
+        : m_layer_size(static_cast<int>(weight_hh.size(1))) {
+    const auto gate_size = 4 * m_layer_size;
+    if (weight_ih.size(0) != gate_size || weight_ih.size(1) != m_layer_size ||
+        weight_hh.size(0) != gate_size || bias_ih.numel() != gate_size ||
+        bias_hh.numel() != gate_size) {
+        throw std::runtime_error("Unexpected LSTM weight sizes");
+    }
+
+    torch::NoGradGuard no_grad;
+    const auto cpu_f32 = torch::TensorOptions().device(torch::kCPU).dtype(torch::kFloat32);
+    m_weight_ih_t = weight_ih.to(cpu_f32).t().contiguous();
+    m_bias = (bias_ih.to(cpu_f32) + bias_hh.to(cpu_f32)).contiguous();
+
+    const auto weights = weight_hh.to(cpu_f32).contiguous();
+    const auto row_max = std::get<0>(weights.abs().max(1));
+    // Rows of zeroes get a scale of zero, rather than dividing by zero.
+    const auto quantization_scale =
+            torch::where(row_max > 0, 127.f / row_max, torch::zeros_like(row_max));
+    const auto quantized = (weights * quantization_scale.unsqueeze(1))
+                                   .round()
+                                   .clamp(-127, 127)
+                                   .to(torch::kInt8)
+                                   .contiguous();
+    const auto dequantize_scales = (row_max / (127.f * kStateScale)).contiguous();
+
+    m_weight_hh.resize(quantized.numel());
+    std::memcpy(m_weight_hh.data(), quantized.data_ptr<std::int8_t>(), m_weight_hh.size());
+    m_dequantize_scales.assign(dequantize_scales.data_ptr<float>(),
+                               dequantize_scales.data_ptr<float>() + gate_size);
+}
+
+torch::Tensor QuantizedLSTMLayer::forward(const torch::Tensor& x, bool reverse) const {
+    // Input is [N, T, C], contiguity optional
+    assert(x.dim() == 3 && x.size(2) == m_layer_size);
+    assert(x.device() == torch::kCPU && x.dtype() == torch::kFloat32);
+    const int batch_size = static_cast<int>(x.size(0));
+    const int chunk_size = static_cast<int>(x.size(1));
+    const int layer_size = m_layer_size;
+    const int gate_size = 4 * layer_size;
+
+    // The input contributions to the gates of every timestep, [N, T, 4C].
+    auto gates = torch::addmm(m_bias, x.reshape({-1, layer_size}), m_weight_ih_t)
+                         .view({batch_size, chunk_size, gate_size});
+    auto out = torch::empty({batch_size, chunk_size, layer_size}, x.options());
+    float* const gates_ptr = gates.data_ptr<float>();
+    float* const out_ptr = out.data_ptr<float>();
+    const std::int64_t gate_stride = static_cast<std::int64_t>(chunk_size) * gate_size;
+    const std::int64_t out_stride = static_cast<std::int64_t>(chunk_size) * layer_size;
+
+    const int num_tiles = (batch_size + kSampleTile - 1) / kSampleTile;
+    at::parallel_for(0, num_tiles, 1, [&](std::int64_t begin, std::int64_t end) {
+        std::vector<std::int16_t> states(kSampleTile * layer_size);
+        std::vector<float> cells(kSampleTile * layer_size);
+        for (std::int64_t tile = begin; tile < end; ++tile) {
+            const int first_sample = static_cast<int>(tile) * kSampleTile;
+            const int num_samples = std::min(kSampleTile, batch_size - first_sample);
+            std::fill(states.begin(), states.end(), std::int16_t(0));
+            std::fill(cells.begin(), cells.end(), 0.f);
+            for (int step = 0; step < chunk_size; ++step) {
+                const int t = reverse ? chunk_size - 1 - step : step;
+                float* const step_gates = gates_ptr + first_sample * gate_stride +
+                                          static_cast<std::int64_t>(t) * gate_size;
+                recurrent_matmul(m_weight_hh.data(), m_dequantize_scales.data(), gate_size,
+                                 layer_size, states.data(), num_samples, step_gates, gate_stride);
+
+                for (int sample = 0; sample < num_samples; ++sample) {
+                    const float* const g = step_gates + sample * gate_stride;
+                    float* const h = out_ptr + (first_sample + sample) * out_stride +
+                                     static_cast<std::int64_t>(t) * layer_size;
+                    float* const c = cells.data() + sample * layer_size;
+                    std::int16_t* const state = states.data() + sample * layer_size;
+                    for (int i = 0; i < layer_size; ++i) {
+                        // Gates are ordered i, f, g, o, as in torch::nn::LSTM.
+                        const float input_gate = sigmoid(g[i]);
+                        const float forget_gate = sigmoid(g[layer_size + i]);
+                        const float cell_gate = std::tanh(g[2 * layer_size + i]);
+                        const float output_gate = sigmoid(g[3 * layer_size + i]);
+                        c[i] = forget_gate * c[i] + input_gate * cell_gate;
+                        h[i] = output_gate * std::tanh(c[i]);
+                        state[i] = static_cast<std::int16_t>(std::lrint(h[i] * kStateScale));
+                    }
+                }
+            }
+        }
+    });
+
+    // Output is [N, T, C], contiguous
+    return out;
+}
+
+}  // namespace dorado::nn
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <torch/torch.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace dorado::nn {
+
+// One LSTM layer for the CPU, with the recurrent matmul done in int8.
+// The input matmul covers every timestep at once, so stays an fp32 GEMM.  The recurrent one
+// has to be done a timestep at a time, which is what dominates the fp32 LSTM's run time.
+// Weights are quantised per output row, and the hidden state, which tanh keeps within
+// (-1, 1), with a fixed scale.
+class QuantizedLSTMLayer {
+public:
+    // Weights as torch::nn::LSTM stores them: weight_ih and weight_hh are
+    // [4 * layer_size, layer_size], and the biases [4 * layer_size], with gates ordered i, f, g, o.
+    QuantizedLSTMLayer(const torch::Tensor& weight_ih,
+                       const torch::Tensor& weight_hh,
+                       const torch::Tensor& bias_ih,
+                       const torch::Tensor& bias_hh);
+
+    // Input is [N, T, C], contiguity optional.  If reverse is set, timesteps are processed from
+    // last to first.  Output is [N, T, C], contiguous, in the same time order as the input.
+    torch::Tensor forward(const torch::Tensor& x, bool reverse) const;
+
+private:
+    int m_layer_size;
+    // [C, 4C]
+    torch::Tensor m_weight_ih_t;
+    // bias_ih + bias_hh, [4C]
+    torch::Tensor m_bias;
+    // Quantised weight_hh, [4C, C] row major.
+    std::vector<std::int8_t> m_weight_hh;
+    // Per row factors converting int8 dot products back to fp32.
+    std::vector<float> m_dequantize_scales;
+};
+
+}  // namespace dorado::nn
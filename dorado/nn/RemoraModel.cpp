@@ -4,11 +4,17 @@
 #include "modbase/remora_scaler.h"
 #include "modbase/remora_utils.h"
 #include "utils/base_mod_utils.h"
+#include "utils/math_utils.h"
 #include "utils/module_utils.h"
 #include "utils/sequence_utils.h"
 #include "utils/tensor_utils.h"
 
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+#include "utils/cuda_utils.h"
+#endif
+
 #ifndef __APPLE__
+#include <c10/cuda/CUDACachingAllocator.h>
 #include <c10/cuda/CUDAGuard.h>
 #include <c10/cuda/CUDAStream.h>
 #endif
@@ -17,6 +23,7 @@
 #include <toml.hpp>
 #include <torch/torch.h>
 
+#include <algorithm>
 #include <array>
 #include <stdexcept>
 #include <unordered_map>
@@ -25,6 +32,10 @@ using namespace torch::nn;
 using namespace torch::indexing;
 
 namespace {
+
+// Partial batches are rounded up to a multiple of this many chunks.
+constexpr int kBatchGranularity = 64;
+
 template <class Model>
 ModuleHolder<AnyModule> populate_model(Model&& model,
                                        const std::filesystem::path& path,
@@ -39,6 +50,17 @@ ModuleHolder<AnyModule> populate_model(Model&& model,
     auto holder = ModuleHolder<AnyModule>(module);
     return holder;
 }
+
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+// This process's turn on device, if it's shared with other processes which take turns on it,
+// so that modbase batches wait their turn as basecall batches do.
+dorado::utils::GpuLock acquire_turn(const torch::Device& device) {
+    if (!device.is_cuda()) {
+        return {};
+    }
+    return dorado::utils::acquire_gpu_lock(device.index(), false);
+}
+#endif
 }  // namespace
 
 namespace dorado {
@@ -306,6 +328,23 @@ void BaseModParams::parse(std::filesystem::path const& model_path, bool all_memb
     }
 }
 
+bool BaseModParams::same_signal_scaling(const BaseModParams& other) const {
+    if (refine_do_rough_rescale != other.refine_do_rough_rescale) {
+        return false;
+    }
+    // Without rough rescaling signals aren't changed at all.
+    return !refine_do_rough_rescale ||
+           (refine_kmer_levels == other.refine_kmer_levels &&
+            refine_kmer_len == other.refine_kmer_len &&
+            refine_kmer_center_idx == other.refine_kmer_center_idx);
+}
+
+bool BaseModParams::same_inputs(const BaseModParams& other) const {
+    return context_before == other.context_before && context_after == other.context_after &&
+           bases_before == other.bases_before && bases_after == other.bases_after &&
+           same_signal_scaling(other);
+}
+
 RemoraCaller::RemoraCaller(const std::filesystem::path& model_path,
                            const std::string& device,
                            int batch_size,
@@ -326,6 +365,7 @@ RemoraCaller::RemoraCaller(const std::filesystem::path& model_path,
 #endif
     m_module = load_remora_model(model_path, m_options);
     m_params.parse(model_path);
+    m_motif_scanner.add_motif(m_params.motif, m_params.motif_offset);
 
     auto sig_len = static_cast<int64_t>(m_params.context_before + m_params.context_after);
     auto kmer_len = m_params.bases_after + m_params.bases_before + 1;
@@ -336,31 +376,52 @@ RemoraCaller::RemoraCaller(const std::filesystem::path& model_path,
                                  .device(torch::kCPU);
 
     m_input_sigs = torch::empty({batch_size, 1, sig_len}, input_options);
-    m_input_seqs =
-            torch::empty({batch_size, RemoraUtils::NUM_BASES * kmer_len, sig_len}, input_options);
+    // One-hot kmer encodings are 4 * kmer_len values per sample, which would be most of what
+    // is copied to a GPU, so GPUs are sent one byte per base and expand them themselves.
+    m_expand_kmers_on_device = m_options.device().is_cuda();
+    if (m_expand_kmers_on_device) {
+        m_input_seqs = torch::empty({batch_size, kmer_len, sig_len},
+                                    input_options.dtype(torch::kInt8));
+    } else {
+        m_input_seqs = torch::empty({batch_size, RemoraUtils::NUM_BASES * kmer_len, sig_len},
+                                    input_options);
+    }
 
     if (m_params.refine_do_rough_rescale) {
         m_scaler = std::make_unique<RemoraScaler>(m_params.refine_kmer_levels,
                                                   m_params.refine_kmer_len,
                                                   m_params.refine_kmer_center_idx);
     }
+
+#ifndef __APPLE__
+    if (m_options.device().is_cuda()) {
+        // Measure what a full batch needs, so a basecaller sharing the device can leave it
+        // free.  This also gets the one-off costs of the first call, e.g. picking cuDNN
+        // algorithms, out of the way.
+        namespace allocator = c10::cuda::CUDACachingAllocator;
+        constexpr auto kAggregate = static_cast<size_t>(allocator::StatType::AGGREGATE);
+        const int device_index = m_options.device().index();
+        const auto start_bytes =
+                allocator::getDeviceStats(device_index).allocated_bytes[kAggregate].current;
+        allocator::resetPeakStats(device_index);
+        m_input_sigs.zero_();
+        m_input_seqs.zero_();
+        call_chunks(batch_size);
+        const auto peak_bytes =
+                allocator::getDeviceStats(device_index).allocated_bytes[kAggregate].peak;
+        m_device_memory_bytes = size_t(peak_bytes - start_bytes);
+        // Hand the cached blocks back, so that they count as available to whatever's set up
+        // next.
+        allocator::emptyCache();
+        spdlog::debug("Remora model {}: batch size {} needs {:.2f}GB of device memory",
+                      model_path.filename().string(), batch_size, m_device_memory_bytes / 1e+9);
+    }
+#endif
 }
 
 std::vector<size_t> RemoraCaller::get_motif_hits(const std::string& seq) const {
     NVTX3_FUNC_RANGE();
-    std::vector<size_t> context_hits;
-    const auto& motif = m_params.motif;
-    const auto motif_offset = m_params.motif_offset;
-    size_t kmer_len = motif.size();
-    size_t search_pos = 0;
-    while (search_pos < seq.size() - kmer_len + 1) {
-        search_pos = seq.find(motif, search_pos);
-        if (search_pos != std::string::npos) {
-            context_hits.push_back(search_pos + motif_offset);
-            ++search_pos;
-        }
-    }
-    return context_hits;
+    return m_motif_scanner.scan(seq).front();
 }
 
 torch::Tensor RemoraCaller::scale_signal(torch::Tensor signal,
@@ -380,35 +441,26 @@ torch::Tensor RemoraCaller::scale_signal(torch::Tensor signal,
     return scaled_signal;
 }
 
-void RemoraCaller::accept_chunk(int chunk_idx,
-                                const at::Tensor& signal,
-                                const std::vector<float>& kmers) {
+void RemoraCaller::accept_chunks(int first_chunk_idx,
+                                 const torch::Tensor& signals,
+                                 const torch::Tensor& kmers,
+                                 size_t first_row,
+                                 size_t num_chunks) {
     // As usual, avoid torch indexing because it is glacially slow.
-    // GPU base calling uses float16 signals and input tensors, but float32
-    // sequence encodings.
+    // GPU base calling uses float16 signals and input tensors, and int8 kmer
+    // bases, which call_chunks expands to one-hot encodings.
     // CPU base calling uses float16 signals, float32 input tensors, and
     // float32 sequence encodings.
-    assert(signal.size(0) == m_input_sigs.size(2));
+    assert(signals.size(1) == m_input_sigs.size(2));
+    assert(kmers.size(1) * kmers.size(2) == m_input_seqs.size(1) * m_input_seqs.size(2));
 
-    const auto sig_len = signal.size(0);
-    dorado::utils::copy_tensor_elems(m_input_sigs, chunk_idx * sig_len, signal, 0, sig_len);
+    const auto sig_len = signals.size(1);
+    dorado::utils::copy_tensor_elems(m_input_sigs, first_chunk_idx * sig_len, signals,
+                                     first_row * sig_len, num_chunks * sig_len);
 
     const auto kmer_elem_count = m_input_seqs.size(1) * m_input_seqs.size(2);
-    if (m_input_seqs.dtype() == torch::kFloat16) {
-        // float32 kmer encoding -> float16 kmer encoding input
-        using InputType = c10::Half;
-        InputType* const input_seqs_ptr = m_input_seqs.data_ptr<InputType>();
-        dorado::utils::convert_f32_to_f16(&input_seqs_ptr[chunk_idx * kmer_elem_count],
-                                          kmers.data(), kmer_elem_count);
-    } else if (m_input_seqs.dtype() == torch::kFloat32) {
-        // float32 kmer encoding -> float32 kmer encoding input
-        using InputType = float;
-        InputType* const input_seqs_ptr = m_input_seqs.data_ptr<InputType>();
-        std::memcpy(&input_seqs_ptr[chunk_idx * kmer_elem_count], kmers.data(),
-                    kmer_elem_count * sizeof(InputType));
-    } else {
-        throw std::runtime_error("Unsupported input dtype");
-    }
+    dorado::utils::copy_tensor_elems(m_input_seqs, first_chunk_idx * kmer_elem_count, kmers,
+                                     first_row * kmer_elem_count, num_chunks * kmer_elem_count);
 }
 
 torch::Tensor RemoraCaller::call_chunks(int num_chunks) {
@@ -416,15 +468,83 @@ torch::Tensor RemoraCaller::call_chunks(int num_chunks) {
 
     torch::InferenceMode guard;
 
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+    // Held until the scores are back on the host, so the batch is done before the turn passes.
+    const auto gpu_lock = acquire_turn(m_options.device());
+#endif
 #ifndef __APPLE__
     // If m_stream is set, sets the current stream to m_stream, and the current device to the device associated
     // with the stream. Resets both to their prior state on destruction
     c10::cuda::OptionalCUDAStreamGuard stream_guard(m_stream);
 #endif
-    auto scores = m_module->forward(m_input_sigs.to(m_options.device()),
-                                    m_input_seqs.to(m_options.device()));
+    // Partial batches only copy and run the rows they use, rounded up so that only a handful of
+    // batch shapes are ever seen.
+    const int64_t num_rows =
+            std::min<int64_t>(utils::pad_to(num_chunks, kBatchGranularity), m_batch_size);
+    auto [input_sigs, input_seqs] = device_inputs(num_rows);
+    auto scores = m_module->forward(input_sigs, input_seqs);
+
+    return scores.narrow(0, 0, num_chunks).to(torch::kCPU);
+}
+
+bool RemoraCaller::shares_inputs_with(const RemoraCaller& other) const {
+    return m_options.device() == other.m_options.device() &&
+           m_options.dtype() == other.m_options.dtype() && m_batch_size == other.m_batch_size &&
+           m_expand_kmers_on_device == other.m_expand_kmers_on_device &&
+           m_params.same_inputs(other.m_params);
+}
 
-    return scores.to(torch::kCPU);
+std::vector<torch::Tensor> RemoraCaller::call_chunks(int num_chunks,
+                                                     const std::vector<RemoraCaller*>& callers,
+                                                     const std::vector<int>& row_callers) {
+    nvtx3::scoped_range loop{"remora_nn_fused"};
+    assert(int(row_callers.size()) == num_chunks);
+
+    torch::InferenceMode guard;
+
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+    const auto gpu_lock = acquire_turn(m_options.device());
+#endif
+#ifndef __APPLE__
+    c10::cuda::OptionalCUDAStreamGuard stream_guard(m_stream);
+#endif
+    auto [input_sigs, input_seqs] = device_inputs(num_chunks);
+
+    // Each model is given the rows it's to call, gathered on the device, padded by repeating the
+    // last as the rows of a partial batch are.
+    std::vector<torch::Tensor> scores(callers.size());
+    for (size_t i = 0; i < callers.size(); ++i) {
+        std::vector<int64_t> rows;
+        for (int row = 0; row < num_chunks; ++row) {
+            if (row_callers[row] == int(i)) {
+                rows.push_back(row);
+            }
+        }
+        if (rows.empty()) {
+            continue;
+        }
+        const auto num_rows = rows.size();
+        rows.resize(std::min(utils::pad_to(int(num_rows), kBatchGranularity), m_batch_size),
+                    rows.back());
+        auto indices = torch::tensor(rows).to(m_options.device());
+        scores[i] = callers[i]->m_module->forward(input_sigs.index_select(0, indices),
+                                                  input_seqs.index_select(0, indices));
+        scores[i] = scores[i].narrow(0, 0, num_rows);
+    }
+    for (auto& model_scores : scores) {
+        if (model_scores.defined()) {
+            model_scores = model_scores.to(torch::kCPU);
+        }
+    }
+    return scores;
+}
+
+std::pair<torch::Tensor, torch::Tensor> RemoraCaller::device_inputs(int64_t num_rows) const {
+    auto input_seqs = m_input_seqs.narrow(0, 0, num_rows).to(m_options.device());
+    if (m_expand_kmers_on_device) {
+        input_seqs = RemoraEncoder::expand_kmer_bases(input_seqs, m_options.dtype().toScalarType());
+    }
+    return {m_input_sigs.narrow(0, 0, num_rows).to(m_options.device()), input_seqs};
 }
 
 }  // namespace dorado
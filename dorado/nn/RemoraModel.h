@@ -1,6 +1,7 @@
 #pragma once
 
 #include "modbase/remora_scaler.h"
+#include "utils/motif_scanner.h"
 
 #if DORADO_GPU_BUILD && !defined(__APPLE__)
 #include <c10/cuda/CUDAStream.h>
@@ -11,6 +12,7 @@
 #include <filesystem>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace dorado {
@@ -43,6 +45,12 @@ struct BaseModParams {
     bool refine_do_rough_rescale;   ///< Whether to perform rough rescaling
 
     void parse(std::filesystem::path const& model_path, bool all_members = true);
+
+    /// Whether signals are scaled the same way for both models, so can be scaled once for both.
+    bool same_signal_scaling(const BaseModParams& other) const;
+    /// Whether both models take the same inputs, i.e. contexts of as many samples, encoding
+    /// kmers of as many bases, from signals scaled the same way.  Their motifs may differ.
+    bool same_inputs(const BaseModParams& other) const;
 };
 
 class RemoraCaller {
@@ -56,7 +64,13 @@ class RemoraCaller {
     std::unique_ptr<RemoraScaler> m_scaler;
 
     BaseModParams m_params;
+    utils::MotifScanner m_motif_scanner;
     const int m_batch_size;
+    // Whether m_input_seqs holds kmer bases, to be one-hot encoded on the device, rather than
+    // one-hot encodings.
+    bool m_expand_kmers_on_device{false};
+    // Peak device memory of a full batch, on top of the model's weights.
+    size_t m_device_memory_bytes{0};
 
 public:
     RemoraCaller(const std::filesystem::path& model_path,
@@ -71,8 +85,37 @@ public:
                                const std::vector<uint64_t>& seq_to_sig_map) const;
     std::vector<size_t> get_motif_hits(const std::string& seq) const;
 
-    void accept_chunk(int chunk_idx, const torch::Tensor& signal, const std::vector<float>& kmers);
+    // Whether accept_chunks takes kmers encoded as RemoraEncoder::KmerEncoding::Bases, rather
+    // than one-hot encodings.
+    bool expands_kmers_on_device() const { return m_expand_kmers_on_device; }
+
+    // The device memory calling a full batch needs, beyond what the caller already holds, or 0
+    // if it doesn't run on a CUDA device.
+    size_t device_memory_bytes() const { return m_device_memory_bytes; }
+
+    // Copies num_chunks rows of signals and kmers, from first_row, to the model input from
+    // first_chunk_idx.
+    void accept_chunks(int first_chunk_idx,
+                       const torch::Tensor& signals,
+                       const torch::Tensor& kmers,
+                       size_t first_row,
+                       size_t num_chunks);
     torch::Tensor call_chunks(int num_chunks);
+
+    // Whether other takes inputs of the same shape and encoding on the same device, so this
+    // caller's inputs can be given to other's model.
+    bool shares_inputs_with(const RemoraCaller& other) const;
+    // Calls the num_chunks rows of this caller's inputs with the models of callers, each of which
+    // must share this caller's inputs, on the rows row_callers gives the index in callers of.
+    // The inputs go to the device once, and the models run back to back on this caller's
+    // stream.  Returns each model's scores for its rows, in order.
+    std::vector<torch::Tensor> call_chunks(int num_chunks,
+                                           const std::vector<RemoraCaller*>& callers,
+                                           const std::vector<int>& row_callers);
+
+private:
+    // The first num_rows of the inputs, on the device, with kmers expanded.
+    std::pair<torch::Tensor, torch::Tensor> device_inputs(int64_t num_rows) const;
 };
 
 }  // namespace dorado
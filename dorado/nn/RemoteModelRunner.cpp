@@ -0,0 +1,296 @@
+#include "RemoteModelRunner.h"
+
+#include "utils/TraceRecorder.h"
+#include "utils/socket_utils.h"
+#include "utils/thread_utils.h"
+
+#include <spdlog/spdlog.h>
+#include <torch/torch.h>
+
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+// Starts every worker's greeting, so that a runner connected to something else fails at once.
+constexpr uint32_t kProtocolMagic = 0x31575244;  // "DRW1"
+// Longest string either end will accept, well beyond any chunk's sequence.
+constexpr uint32_t kMaxStringLength = 1 << 24;
+// How many times a lost connection is made again, and how long apart, before a batch fails.
+constexpr int kMaxReconnects = 5;
+constexpr auto kReconnectInterval = 2s;
+
+template <typename T>
+void append_value(std::string& message, const T& value) {
+    message.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void append_string(std::string& message, std::string_view value) {
+    append_value(message, static_cast<uint32_t>(value.size()));
+    message.append(value);
+}
+
+template <typename T>
+bool read_value(int fd, T& value) {
+    return dorado::utils::read_all(fd, &value, sizeof(T));
+}
+
+template <typename String>
+bool read_string(int fd, String& value) {
+    uint32_t length = 0;
+    if (!read_value(fd, length) || length > kMaxStringLength) {
+        return false;
+    }
+    value.resize(length);
+    return dorado::utils::read_all(fd, value.data(), length);
+}
+
+std::string greeting(const dorado::RemoteRunnerInfo& info) {
+    std::string message;
+    append_value(message, kProtocolMagic);
+    append_value(message, info.model_stride);
+    append_value(message, info.chunk_size);
+    append_value(message, info.batch_size);
+    append_value(message, info.num_connections);
+    append_string(message, info.device);
+    return message;
+}
+
+// Calls batches sent over fd on runner until the runner at the other end disconnects.
+void serve_connection(int fd, dorado::ModelRunnerBase& runner) {
+    const auto chunk_size = runner.chunk_size();
+    const auto batch_size = runner.batch_size();
+    auto input = torch::empty({int64_t(batch_size), int64_t(chunk_size)}, torch::kHalf);
+    uint32_t num_chunks = 0;
+    while (read_value(fd, num_chunks)) {
+        if (num_chunks > batch_size ||
+            !dorado::utils::read_all(fd, input.data_ptr(),
+                                     num_chunks * chunk_size * input.element_size())) {
+            return;
+        }
+        std::vector<dorado::DecodedChunk> decoded;
+        {
+            dorado::utils::TraceSpan span("remote_call");
+            for (uint32_t i = 0; i < num_chunks; ++i) {
+                runner.accept_chunk(i, input[i]);
+            }
+            decoded = runner.call_chunks(num_chunks);
+        }
+
+        std::string message;
+        append_value(message, static_cast<uint32_t>(decoded.size()));
+        for (const auto& chunk : decoded) {
+            append_string(message, chunk.sequence);
+            append_string(message, chunk.qstring);
+            append_string(message,
+                          std::string_view(reinterpret_cast<const char*>(chunk.moves.data()),
+                                           chunk.moves.size()));
+        }
+        if (!dorado::utils::write_all(fd, message)) {
+            return;
+        }
+    }
+}
+
+}  // namespace
+
+namespace dorado {
+
+RemoteModelRunner::RemoteModelRunner(const std::string& host, uint16_t port)
+        : m_host(host), m_port(port), m_address(host + ":" + std::to_string(port)) {
+    connect();
+    m_input = torch::empty({int64_t(m_info.batch_size), int64_t(m_info.chunk_size)},
+                           torch::kHalf);
+}
+
+RemoteModelRunner::~RemoteModelRunner() {
+    if (m_fd >= 0) {
+        utils::close_socket(m_fd);
+    }
+}
+
+void RemoteModelRunner::connect() {
+    const int fd = utils::connect_tcp_socket(m_host, m_port);
+    utils::set_tcp_no_delay(fd);
+    RemoteRunnerInfo info;
+    uint32_t magic = 0;
+    if (!read_value(fd, magic) || magic != kProtocolMagic || !read_value(fd, info.model_stride) ||
+        !read_value(fd, info.chunk_size) || !read_value(fd, info.batch_size) ||
+        !read_value(fd, info.num_connections) || !read_string(fd, info.device)) {
+        utils::close_socket(fd);
+        throw std::runtime_error("No dorado worker answered at " + m_address);
+    }
+    if (info.batch_size == 0) {
+        utils::close_socket(fd);
+        throw std::runtime_error("The worker at " + m_address + " has no runners free");
+    }
+    // Batches are already being assembled to the first connection's shape.
+    if (m_input.defined() && (info.model_stride != m_info.model_stride ||
+                              info.chunk_size != m_info.chunk_size ||
+                              info.batch_size < m_info.batch_size)) {
+        utils::close_socket(fd);
+        throw std::runtime_error("The worker at " + m_address + " came back with another model");
+    }
+    if (!m_input.defined()) {
+        m_info = std::move(info);
+    }
+    m_fd = fd;
+}
+
+void RemoteModelRunner::accept_chunk(int chunk_idx, const torch::Tensor& chunk) {
+    m_input.index_put_({chunk_idx}, chunk.to(torch::kCPU, torch::kHalf));
+}
+
+void RemoteModelRunner::accept_chunks(int first_chunk_idx, const std::vector<ChunkSignal>& chunks) {
+    auto batch = m_input.view({m_input.size(0), 1, m_input.size(1)});
+    if (!copy_chunks_to_batch(batch, first_chunk_idx, chunks)) {
+        ModelRunnerBase::accept_chunks(first_chunk_idx, chunks);
+    }
+}
+
+std::vector<DecodedChunk> RemoteModelRunner::call_chunks(int num_chunks) {
+    if (num_chunks == 0) {
+        return {};
+    }
+    std::vector<DecodedChunk> decoded;
+    for (int reconnects = 0; !try_call(num_chunks, decoded); ++reconnects) {
+        if (reconnects == kMaxReconnects) {
+            throw std::runtime_error("Lost the connection to the worker at " + m_address);
+        }
+        spdlog::warn("Lost the connection to the worker at {}, reconnecting", m_address);
+        std::this_thread::sleep_for(kReconnectInterval);
+        try {
+            connect();
+        } catch (const std::exception& e) {
+            spdlog::debug("{}", e.what());
+        }
+    }
+    return decoded;
+}
+
+bool RemoteModelRunner::try_call(int num_chunks, std::vector<DecodedChunk>& decoded) {
+    if (m_fd < 0) {
+        return false;
+    }
+    bool ok = false;
+    {
+        utils::TraceSpan span("remote_send");
+        std::string message;
+        append_value(message, static_cast<uint32_t>(num_chunks));
+        message.append(static_cast<const char*>(m_input.data_ptr()),
+                       num_chunks * m_info.chunk_size * m_input.element_size());
+        ok = utils::write_all(m_fd, message);
+    }
+    if (ok) {
+        utils::TraceSpan span("remote_wait");
+        uint32_t num_decoded = 0;
+        ok = read_value(m_fd, num_decoded) && num_decoded == uint32_t(num_chunks);
+        decoded.resize(ok ? num_decoded : 0);
+        for (auto& chunk : decoded) {
+            ok = ok && read_string(m_fd, chunk.sequence) && read_string(m_fd, chunk.qstring) &&
+                 read_string(m_fd, chunk.moves);
+        }
+    }
+    if (!ok) {
+        utils::close_socket(m_fd);
+        m_fd = -1;
+        decoded.clear();
+    }
+    return ok;
+}
+
+std::vector<Runner> connect_remote_runners(const std::string& address) {
+    const auto colon = address.rfind(':');
+    int port = 0;
+    try {
+        port = colon == std::string::npos ? 0 : std::stoi(address.substr(colon + 1));
+    } catch (const std::logic_error&) {
+    }
+    if (port <= 0 || port > 65535) {
+        throw std::runtime_error("Invalid worker address " + address + ", expected host:port");
+    }
+    const auto host = address.substr(0, colon);
+
+    auto first = std::make_shared<RemoteModelRunner>(host, uint16_t(port));
+    std::vector<Runner> runners{first};
+    for (uint32_t i = 1; i < first->info().num_connections; ++i) {
+        try {
+            runners.push_back(std::make_shared<RemoteModelRunner>(host, uint16_t(port)));
+        } catch (const std::exception& e) {
+            // The worker is shared with another coordinator, which has the rest.
+            spdlog::warn("{}", e.what());
+            break;
+        }
+    }
+    spdlog::info("> Connected {} runners on {} at {}", runners.size(), first->info().device,
+                 address);
+    return runners;
+}
+
+void serve_remote_runners(utils::TcpSocketServer& server,
+                          const std::vector<Runner>& runners,
+                          const std::atomic<bool>& stop) {
+    // Each runner serves one connection at a time, on its own thread.
+    std::mutex mutex;
+    std::vector<bool> in_use(runners.size(), false);
+    std::vector<std::thread> threads(runners.size());
+
+    while (!stop) {
+        const auto fd = server.accept(100ms);
+        if (!fd) {
+            continue;
+        }
+        utils::set_tcp_no_delay(*fd);
+
+        std::unique_lock lock(mutex);
+        const auto free_runner = std::find(in_use.begin(), in_use.end(), false);
+        if (free_runner == in_use.end()) {
+            lock.unlock();
+            RemoteRunnerInfo busy;
+            busy.num_connections = uint32_t(runners.size());
+            utils::write_all(*fd, greeting(busy));
+            utils::close_socket(*fd);
+            spdlog::warn("Turned a connection away, since every runner is in use");
+            continue;
+        }
+        const size_t index = free_runner - in_use.begin();
+        in_use[index] = true;
+        lock.unlock();
+        // The slot's last connection has finished.
+        if (threads[index].joinable()) {
+            threads[index].join();
+        }
+
+        const auto& runner = runners[index];
+        RemoteRunnerInfo info{uint32_t(runner->model_stride()), uint32_t(runner->chunk_size()),
+                              uint32_t(runner->batch_size()), uint32_t(runners.size()),
+                              runner->device()};
+        threads[index] = std::thread([&, index, fd = *fd, info = std::move(info)] {
+            utils::set_thread_name("remote_runner");
+            spdlog::debug("> Runner {} on {} connected", index, info.device);
+            try {
+                if (utils::write_all(fd, greeting(info))) {
+                    serve_connection(fd, *runners[index]);
+                }
+            } catch (const std::exception& e) {
+                spdlog::error("Runner {} on {}: {}", index, info.device, e.what());
+            }
+            utils::close_socket(fd);
+            spdlog::debug("> Runner {} on {} disconnected", index, info.device);
+            std::lock_guard guard(mutex);
+            in_use[index] = false;
+        });
+    }
+
+    for (auto& thread : threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+}
+
+}  // namespace dorado
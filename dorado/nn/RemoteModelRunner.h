@@ -0,0 +1,79 @@
+#pragma once
+
+#include "ModelRunner.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dorado {
+
+namespace utils {
+class TcpSocketServer;
+}
+
+// What a worker tells each runner which connects to it.
+struct RemoteRunnerInfo {
+    uint32_t model_stride{0};
+    uint32_t chunk_size{0};
+    uint32_t batch_size{0};
+    // The number of connections the worker serves at once, one for each of its runners.
+    uint32_t num_connections{0};
+    std::string device;
+};
+
+// Calls chunks on a runner hosted by a worker process, typically on a GPU node, so that one
+// coordinator that loads and scales reads can drive the GPUs of several machines.  Chunks are
+// batched up locally, as half precision, and each call sends the whole batch to the worker in
+// one message, half the bytes of the float signal, and waits for its decoded chunks.  Each
+// runner has its own connection, and so its own runner on the worker, so BasecallerNode keeps
+// it as busy as a local one.  Both ends must have the same byte order.  A batch whose
+// connection is lost is sent again on a new one, so a worker which restarts only delays it.
+class RemoteModelRunner final : public ModelRunnerBase {
+public:
+    // Connects to the worker listening on port on host.  Throws if it can't.
+    RemoteModelRunner(const std::string& host, uint16_t port);
+    ~RemoteModelRunner();
+    RemoteModelRunner(const RemoteModelRunner&) = delete;
+    RemoteModelRunner& operator=(const RemoteModelRunner&) = delete;
+
+    void accept_chunk(int chunk_idx, const torch::Tensor& chunk) final;
+    void accept_chunks(int first_chunk_idx, const std::vector<ChunkSignal>& chunks) final;
+    // Throws if the connection to the worker is lost, and can't be made again.
+    std::vector<DecodedChunk> call_chunks(int num_chunks) final;
+    size_t model_stride() const final { return m_info.model_stride; }
+    size_t chunk_size() const final { return m_info.chunk_size; }
+    size_t batch_size() const final { return m_info.batch_size; }
+    // The worker's device, as reported by it, with the worker's address.
+    std::string device() const final { return m_address + "/" + m_info.device; }
+
+    const RemoteRunnerInfo& info() const { return m_info; }
+
+private:
+    // Connects to the worker and reads its greeting into m_info.  Throws if it can't.
+    void connect();
+    // Sends the batch and reads back its decoded chunks.  Returns false if the connection was
+    // lost, in which case it's closed.
+    bool try_call(int num_chunks, std::vector<DecodedChunk>& decoded);
+
+    const std::string m_host;
+    const uint16_t m_port;
+    const std::string m_address;
+    int m_fd{-1};
+    RemoteRunnerInfo m_info;
+    // The batch being assembled, [batch_size, chunk_size] in half precision.
+    torch::Tensor m_input;
+};
+
+// Connects to the worker at address, given as host:port, with as many runners as it serves.
+std::vector<Runner> connect_remote_runners(const std::string& address);
+
+// Serves runners to RemoteModelRunners connecting to server, each connection on its own thread
+// and given a runner of its own until it disconnects.  Connections beyond the number of
+// runners are turned away.  Returns once stop is set, after the connections have closed.
+void serve_remote_runners(utils::TcpSocketServer& server,
+                          const std::vector<Runner>& runners,
+                          const std::atomic<bool>& stop);
+
+}  // namespace dorado
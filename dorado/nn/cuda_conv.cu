@@ -0,0 +1,172 @@
+#include "cuda_conv.h"
+
+#include <cuda_fp16.h>
+
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+constexpr int kThreadsPerBlock = 256;
+
+// One thread per output timestep, computing every output feature of it.  Neighbouring
+// threads read neighbouring samples, so the loads of each window coalesce, and the output of
+// each feature is written contiguously in time.  The window is kept in registers, and the
+// weights in shared memory, as they're too few to be worth tiling.
+template <int IN, int OUT, int K>
+__global__ void conv_swish_kernel(int chunk_size_in,
+                                  int chunk_size_out,
+                                  int stride,
+                                  int64_t in_stride_n,
+                                  int64_t in_stride_c,
+                                  int64_t in_stride_t,
+                                  const __half *__restrict__ in,
+                                  const __half *__restrict__ weights,
+                                  const __half *__restrict__ bias,
+                                  float max_value,
+                                  __half *__restrict__ out) {
+    __shared__ float shared_weights[OUT * IN * K];
+    __shared__ float shared_bias[OUT];
+    for (int i = threadIdx.x; i < OUT * IN * K; i += blockDim.x) {
+        shared_weights[i] = __half2float(weights[i]);
+    }
+    for (int i = threadIdx.x; i < OUT; i += blockDim.x) {
+        shared_bias[i] = __half2float(bias[i]);
+    }
+    __syncthreads();
+
+    const int t = blockIdx.x * blockDim.x + threadIdx.x;
+    if (t >= chunk_size_out) {
+        return;
+    }
+    const int n = blockIdx.y;
+    const __half *const in_n = in + n * in_stride_n;
+
+    float window[IN][K];
+    const int window_start = t * stride - K / 2;
+#pragma unroll
+    for (int c = 0; c < IN; ++c) {
+#pragma unroll
+        for (int k = 0; k < K; ++k) {
+            const int t_in = window_start + k;
+            window[c][k] = (t_in >= 0 && t_in < chunk_size_in)
+                                   ? __half2float(in_n[c * in_stride_c + t_in * in_stride_t])
+                                   : 0.f;
+        }
+    }
+
+    __half *const out_n = out + int64_t(n) * OUT * chunk_size_out + t;
+#pragma unroll
+    for (int o = 0; o < OUT; ++o) {
+        float acc = shared_bias[o];
+#pragma unroll
+        for (int c = 0; c < IN; ++c) {
+#pragma unroll
+            for (int k = 0; k < K; ++k) {
+                acc += shared_weights[(o * IN + c) * K + k] * window[c][k];
+            }
+        }
+        // Swish, i.e. x * sigmoid(x), then the clamp.
+        acc = fminf(acc / (1.f + __expf(-acc)), max_value);
+        out_n[o * int64_t(chunk_size_out)] = __float2half(acc);
+    }
+}
+
+template <int IN, int OUT, int K>
+void launch(cudaStream_t stream,
+            int batch_size,
+            int chunk_size_in,
+            int chunk_size_out,
+            int stride,
+            int64_t in_stride_n,
+            int64_t in_stride_c,
+            int64_t in_stride_t,
+            const void *in,
+            const void *weights,
+            const void *bias,
+            float max_value,
+            void *out) {
+    const dim3 grid((chunk_size_out + kThreadsPerBlock - 1) / kThreadsPerBlock, batch_size);
+    conv_swish_kernel<IN, OUT, K><<<grid, kThreadsPerBlock, 0, stream>>>(
+            chunk_size_in, chunk_size_out, stride, in_stride_n, in_stride_c, in_stride_t,
+            static_cast<const __half *>(in), static_cast<const __half *>(weights),
+            static_cast<const __half *>(bias), max_value, static_cast<__half *>(out));
+}
+
+using Launcher = void (*)(cudaStream_t,
+                          int,
+                          int,
+                          int,
+                          int,
+                          int64_t,
+                          int64_t,
+                          int64_t,
+                          const void *,
+                          const void *,
+                          const void *,
+                          float,
+                          void *);
+
+// The first and second layers of the models there are: conv1 takes the signal, or 13 features
+// of it, to conv features, and conv2 takes those to 16.
+Launcher find_launcher(int in_size, int out_size, int window_size) {
+    if (window_size != 5) {
+        return nullptr;
+    }
+    if (in_size == 1 && out_size == 4) {
+        return launch<1, 4, 5>;
+    } else if (in_size == 1 && out_size == 16) {
+        return launch<1, 16, 5>;
+    } else if (in_size == 13 && out_size == 16) {
+        return launch<13, 16, 5>;
+    } else if (in_size == 4 && out_size == 16) {
+        return launch<4, 16, 5>;
+    } else if (in_size == 16 && out_size == 16) {
+        return launch<16, 16, 5>;
+    }
+    return nullptr;
+}
+
+}  // namespace
+
+namespace dorado::nn {
+
+bool has_conv_swish_f16(int in_size, int out_size, int window_size) {
+    return find_launcher(in_size, out_size, window_size) != nullptr;
+}
+
+void conv_swish_f16(cudaStream_t stream,
+                    int batch_size,
+                    int chunk_size_in,
+                    int chunk_size_out,
+                    int in_size,
+                    int out_size,
+                    int window_size,
+                    int stride,
+                    int64_t in_stride_n,
+                    int64_t in_stride_c,
+                    int64_t in_stride_t,
+                    const void *in,
+                    const void *weights,
+                    const void *bias,
+                    float max_value,
+                    void *out) {
+    const auto launcher = find_launcher(in_size, out_size, window_size);
+    if (!launcher) {
+        throw std::runtime_error("No fused convolution kernel for " + std::to_string(in_size) +
+                                 " -> " + std::to_string(out_size) + " features, window " +
+                                 std::to_string(window_size));
+    }
+    if (batch_size == 0 || chunk_size_out == 0) {
+        return;
+    }
+    launcher(stream, batch_size, chunk_size_in, chunk_size_out, stride, in_stride_n, in_stride_c,
+             in_stride_t, in, weights, bias, max_value, out);
+    const auto result = cudaGetLastError();
+    if (result != cudaSuccess) {
+        throw std::runtime_error(std::string("Fused convolution failed: ") +
+                                 cudaGetErrorString(result));
+    }
+}
+
+}  // namespace dorado::nn
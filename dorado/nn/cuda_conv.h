@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cuda_runtime.h>
+
+#include <cstdint>
+
+namespace dorado::nn {
+
+// Whether conv_swish_f16 has a kernel for convolutions of this shape.  Only the small-channel
+// layers at the start of the conv stack, which run at the full signal rate, are covered.
+bool has_conv_swish_f16(int in_size, int out_size, int window_size);
+
+// Runs a convolution of window_size, padded by window_size / 2, with bias, swish and clamping
+// to max_value fused into one kernel, so the activations only go to device memory once.
+// in is [batch_size, in_size, chunk_size_in] f16 with the strides given, weights are
+// [out_size, in_size, window_size] and bias [out_size] f16, both contiguous, and out is
+// [batch_size, out_size, chunk_size_out] f16, contiguous.  Throws if there's no kernel for
+// the shape, or the launch fails.
+void conv_swish_f16(cudaStream_t stream,
+                    int batch_size,
+                    int chunk_size_in,
+                    int chunk_size_out,
+                    int in_size,
+                    int out_size,
+                    int window_size,
+                    int stride,
+                    int64_t in_stride_n,
+                    int64_t in_stride_c,
+                    int64_t in_stride_t,
+                    const void *in,
+                    const void *weights,
+                    const void *bias,
+                    float max_value,
+                    void *out);
+
+}  // namespace dorado::nn
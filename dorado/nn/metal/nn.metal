@@ -208,6 +208,393 @@ kernel void add_softmax(
     }
 }
 
+struct BeamSearchArgs {
+    int T;
+    int N;
+    int C;
+    int beam_width;
+    // temperature * log(beam_cut), or FLT_MAX for no cut.
+    float log_beam_cut;
+    float fixed_stay_score;
+    float temperature;
+    float q_shift;
+    float q_scale;
+    // Index of the first of this launch's chunks in the output buffers.
+    int chunk_offset;
+};
+
+namespace {
+
+constant int kBeamSearchMaxWidth = 32;
+constant char kBeamSearchAlphabet[] = "ACGT";
+
+struct BeamFrontElement {
+    ulong hash;
+    float score;
+    int state;
+    int prev_element_index;
+    bool stay;
+};
+
+// Beam elements are kept as state | prev_element_index << 16 | stay << 24.
+inline uint pack_beam_element(int state, int prev_element_index, bool stay) {
+    return (uint(state) & 0xffff) | (uint(prev_element_index) << 16) | (uint(stay) << 24);
+}
+
+// As in fast_hash.cpp.
+inline ulong fasthash_mix(ulong h) {
+    h ^= h >> 23;
+    h *= 0x2127599bf4325c37UL;
+    h ^= h >> 47;
+    return h;
+}
+
+inline ulong chainfasthash64(ulong hash, ulong val) {
+    hash ^= fasthash_mix(val);
+    hash *= 0x880355f21e6d1965UL;
+    return fasthash_mix(hash);
+}
+
+inline float log_sum_exp(float x, float y, float t) {
+    const float abs_diff = fabs(x - y) / t;
+    return fmax(x, y) + ((abs_diff < 17.0f) ? (log(1.0f + exp(-abs_diff)) * t) : 0.0f);
+}
+
+// Maps floats to uints with the same ordering.
+inline uint float_to_ordered(float f) {
+    const uint u = as_type<uint>(f);
+    return (u & 0x80000000u) ? ~u : (u | 0x80000000u);
+}
+
+inline float ordered_to_float(uint u) {
+    return as_type<float>((u & 0x80000000u) ? (u & 0x7fffffffu) : ~u);
+}
+
+// Returns the number of the simdgroup's candidates with scores >= threshold.
+inline int count_scores_at_least(bool active,
+                                 float stay_score,
+                                 thread const float* const step_scores,
+                                 float threshold) {
+    int count = 0;
+    if (active) {
+        count += stay_score >= threshold;
+        for (int base = 0; base < 4; ++base) {
+            count += step_scores[base] >= threshold;
+        }
+    }
+    return simd_sum(count);
+}
+
+}
+
+// The same beam search as beam_search_decode on the CPU, with the moves, sequence and qstring
+// of each chunk written out.  Each threadgroup is one simdgroup, which decodes one chunk, with
+// each lane holding one element of the beam.
+kernel void beam_search(
+    device const BeamSearchArgs* const args,
+    device const int8_t* const scores_in,
+    device const ftype_out* const bwd,
+    device const ftype_out* const posts,
+    // Working space: [chunk, T + 1, beam_width] packed beam elements, and the path's state
+    // and probability at each timestep.
+    device uint* const beam_out,
+    device int* const states_out,
+    device float* const block_probs_out,
+    device uint8_t* const moves_out,
+    device char* const sequence_out,
+    device char* const qstring_out,
+    device int* const sequence_len_out,
+    uint lane [[thread_index_in_simdgroup]],
+    uint gid [[threadgroup_position_in_grid]])
+{
+    constexpr int kNumBases = 4;
+    constexpr ulong kHashSeed = 0x880355f21e6d1965UL;
+
+    const int T = args->T;
+    const int N = args->N;
+    const int num_states = args->C;
+    const int ts_states = num_states * kNumBases;
+    const int max_beam_width = args->beam_width;
+    const float log_beam_cut = args->log_beam_cut;
+    const float temperature = args->temperature;
+    const int chunk = gid;
+    const int out_chunk = args->chunk_offset + chunk;
+    const int i = lane;
+
+    device const int8_t* const chunk_scores = scores_in + chunk * ts_states;
+    device const ftype_out* const chunk_bwd = bwd + chunk * (T + 1) * num_states;
+    device const ftype_out* const chunk_posts = posts + chunk * (T + 1) * num_states;
+    device uint* const beam = beam_out + out_chunk * (T + 1) * max_beam_width;
+    device int* const states = states_out + out_chunk * T;
+    device float* const block_probs = block_probs_out + out_chunk * T;
+    device uint8_t* const moves = moves_out + out_chunk * T;
+
+    threadgroup BeamFrontElement front[kBeamSearchMaxWidth];
+    threadgroup ulong step_hashes[kNumBases * kBeamSearchMaxWidth];
+    threadgroup float step_scores[kNumBases * kBeamSearchMaxWidth];
+
+    // Find the score an initial element needs in order to make it into the beam: the
+    // max_beam_width'th highest back guide, found a bit at a time.
+    float beam_init_threshold = -FLT_MAX;
+    if (max_beam_width < num_states) {
+        uint threshold_key = 0;
+        for (int bit = 31; bit >= 0; --bit) {
+            const uint candidate_key = threshold_key | (1u << bit);
+            int count = 0;
+            for (int state = i; state < num_states; state += 32) {
+                count += float_to_ordered(chunk_bwd[state]) >= candidate_key;
+            }
+            if (simd_sum(count) >= max_beam_width) {
+                threshold_key = candidate_key;
+            }
+        }
+        beam_init_threshold = ordered_to_float(threshold_key);
+    }
+
+    // Initialise the beam with the first max_beam_width states that meet the threshold.
+    int current_beam_width = min(max_beam_width, num_states);
+    int num_initial = 0;
+    for (int state_base = 0; state_base < num_states && num_initial < max_beam_width;
+         state_base += 32) {
+        const int state = state_base + i;
+        const bool in_beam = state < num_states && chunk_bwd[state] >= beam_init_threshold;
+        const int beam_element = num_initial + simd_prefix_exclusive_sum(int(in_beam));
+        if (in_beam && beam_element < max_beam_width) {
+            front[beam_element] = {chainfasthash64(kHashSeed, state), 0.0f, state, 0, false};
+            beam[beam_element] = pack_beam_element(state, 0, false);
+        }
+        num_initial += simd_sum(int(in_beam));
+    }
+    threadgroup_barrier(mem_flags::mem_threadgroup);
+
+    for (int block_idx = 0; block_idx < T; ++block_idx) {
+        device const int8_t* const block_scores = chunk_scores + block_idx * N * ts_states;
+        device const ftype_out* const block_back_scores =
+                chunk_bwd + (block_idx + 1) * num_states;
+
+        // Expand this lane's element with each of the steps and a stay.
+        const bool active = i < current_beam_width;
+        const BeamFrontElement prev = front[active ? i : 0];
+        const int first_new_state = (prev.state * kNumBases) % num_states;
+        const int move_idx_offset = (prev.state * kNumBases) / num_states;
+        float new_step_scores[kNumBases];
+        ulong new_step_hashes[kNumBases];
+        for (int base = 0; base < kNumBases; ++base) {
+            const int new_state = first_new_state + base;
+            const int move_idx = new_state * kNumBases + move_idx_offset;
+            new_step_scores[base] = prev.score + ScaleByteScore(block_scores[move_idx]) +
+                                    block_back_scores[new_state];
+            new_step_hashes[base] = chainfasthash64(prev.hash, new_state);
+            if (active) {
+                step_hashes[i * kNumBases + base] = new_step_hashes[base];
+                step_scores[i * kNumBases + base] = new_step_scores[base];
+            }
+        }
+        float stay_score =
+                prev.score + args->fixed_stay_score + block_back_scores[prev.state];
+        threadgroup_barrier(mem_flags::mem_threadgroup);
+
+        // See if any step results in the same sequence hash as this lane's stay, and merge if
+        // so.  Two elements can only share a hash by collision, so each step matches at most
+        // one stay, and we take the first step that matches.
+        if (active) {
+            const int stay_latest_base = prev.state % kNumBases;
+            for (int step_elem = 0; step_elem < current_beam_width; ++step_elem) {
+                const int step_elem_idx = step_elem * kNumBases + stay_latest_base;
+                if (step_hashes[step_elem_idx] == prev.hash) {
+                    const float step_score = step_scores[step_elem_idx];
+                    const float merged_score = log_sum_exp(stay_score, step_score, temperature);
+                    if (stay_score > step_score) {
+                        // Fold the step into the stay
+                        stay_score = merged_score;
+                        step_scores[step_elem_idx] = -FLT_MAX;
+                    } else {
+                        // Fold the stay into the step
+                        step_scores[step_elem_idx] = merged_score;
+                        stay_score = -FLT_MAX;
+                    }
+                    break;
+                }
+            }
+        }
+        threadgroup_barrier(mem_flags::mem_threadgroup);
+        for (int base = 0; base < kNumBases; ++base) {
+            new_step_scores[base] = step_scores[i * kNumBases + base];
+        }
+
+        // Find the cutoff score that keeps the beam within max_beam_width, as on the CPU.
+        float lane_max = -FLT_MAX;
+        if (active) {
+            lane_max = stay_score;
+            for (int base = 0; base < kNumBases; ++base) {
+                lane_max = fmax(lane_max, new_step_scores[base]);
+            }
+        }
+        const float max_score = simd_max(lane_max);
+        float beam_cutoff_score = max_score - log_beam_cut;
+
+        int elem_count =
+                count_scores_at_least(active, stay_score, new_step_scores, beam_cutoff_score);
+        if (elem_count > max_beam_width) {
+            // 80% of beam width is the minimum we accept.
+            const int min_beam_width = (max_beam_width * 8) / 10;
+            float low_score = beam_cutoff_score;
+            float hi_score = max_score;
+            int num_guesses = 1;
+            constexpr int kMaxGuesses = 10;
+            while ((elem_count > max_beam_width || elem_count < min_beam_width) &&
+                   num_guesses < kMaxGuesses) {
+                if (elem_count > max_beam_width) {
+                    // Make a higher guess
+                    low_score = beam_cutoff_score;
+                    beam_cutoff_score = (beam_cutoff_score + hi_score) / 2.0f;
+                } else {
+                    // Make a lower guess
+                    hi_score = beam_cutoff_score;
+                    beam_cutoff_score = (beam_cutoff_score + low_score) / 2.0f;
+                }
+                elem_count = count_scores_at_least(active, stay_score, new_step_scores,
+                                                   beam_cutoff_score);
+                num_guesses++;
+            }
+            // See beam_search.cpp for why the upper limit is taken.
+            if (num_guesses == kMaxGuesses) {
+                beam_cutoff_score = hi_score;
+                elem_count = count_scores_at_least(active, stay_score, new_step_scores,
+                                                   beam_cutoff_score);
+            }
+        }
+        elem_count = min(elem_count, max_beam_width);
+
+        // Keep the elements that meet the cutoff, in the CPU's order: all the steps, by
+        // element, followed by all the stays.
+        int num_steps_kept = 0;
+        for (int base = 0; base < kNumBases; ++base) {
+            num_steps_kept += active && new_step_scores[base] >= beam_cutoff_score;
+        }
+        const bool stay_kept = active && stay_score >= beam_cutoff_score;
+        int write_idx = simd_prefix_exclusive_sum(num_steps_kept);
+        for (int base = 0; base < kNumBases; ++base) {
+            if (active && new_step_scores[base] >= beam_cutoff_score) {
+                if (write_idx < max_beam_width) {
+                    front[write_idx] = {new_step_hashes[base], new_step_scores[base],
+                                        first_new_state + base, i, false};
+                }
+                ++write_idx;
+            }
+        }
+        const int stay_write_idx =
+                simd_sum(num_steps_kept) + simd_prefix_exclusive_sum(int(stay_kept));
+        if (stay_kept && stay_write_idx < max_beam_width) {
+            front[stay_write_idx] = {prev.hash, stay_score, prev.state, i, true};
+        }
+        threadgroup_barrier(mem_flags::mem_threadgroup);
+
+        // At the last timestep, the best path needs to be at the start of the beam.
+        if (block_idx == T - 1 && elem_count > 0) {
+            const float score = i < elem_count ? front[i].score : -INFINITY;
+            const float best_score = simd_max(score);
+            const int best_elem = simd_min(i < elem_count && score == best_score ? i : 32);
+            threadgroup_barrier(mem_flags::mem_threadgroup);
+            if (i == 0 && best_elem != 0) {
+                const BeamFrontElement best = front[best_elem];
+                front[best_elem] = front[0];
+                front[0] = best;
+            }
+            threadgroup_barrier(mem_flags::mem_threadgroup);
+        }
+
+        if (i < elem_count) {
+            // Remove backwards contribution from score
+            front[i].score -= block_back_scores[front[i].state];
+            beam[(block_idx + 1) * max_beam_width + i] = pack_beam_element(
+                    front[i].state, front[i].prev_element_index, front[i].stay);
+        }
+        current_beam_width = elem_count;
+        threadgroup_barrier(mem_flags::mem_threadgroup);
+    }
+
+    // Trace the best path back through the beam.  Note that we don't emit the seed state at
+    // the front of the beam.
+    if (i == 0) {
+        int element_index = 0;
+        for (int beam_idx = T; beam_idx != 0; --beam_idx) {
+            const uint element = beam[beam_idx * max_beam_width + element_index];
+            states[beam_idx - 1] = int(element & 0xffff);
+            moves[beam_idx - 1] = (element >> 24) ? 0 : 1;
+            element_index = int((element >> 16) & 0xff);
+        }
+        moves[0] = 1;  // Always step in the first event
+    }
+    threadgroup_barrier(mem_flags::mem_device);
+
+    // Compute a probability for each block, based on the path kmer.
+    for (int block_idx = i; block_idx < T; block_idx += 32) {
+        const int state = states[block_idx];
+        device const ftype_out* const timestep_posts =
+                chunk_posts + (block_idx + 1) * num_states;
+        float block_prob = timestep_posts[state];
+
+        // Add the probabilities of the unique left- and right-shifted kmers.
+        int shifted_states[2 * kNumBases];
+        const int l_shift_idx = state / kNumBases;
+        const int r_shift_idx = (state * kNumBases) % num_states;
+        const int msb = num_states / kNumBases;
+        for (int shift_base = 0; shift_base < kNumBases; ++shift_base) {
+            shifted_states[2 * shift_base] = l_shift_idx + msb * shift_base;
+            shifted_states[2 * shift_base + 1] = r_shift_idx + shift_base;
+        }
+        for (int state_idx = 0; state_idx < 2 * kNumBases; ++state_idx) {
+            const int candidate_state = shifted_states[state_idx];
+            bool count_state = candidate_state != state;
+            for (int inner_state = 0; count_state && inner_state < state_idx; ++inner_state) {
+                count_state = shifted_states[inner_state] != candidate_state;
+            }
+            if (count_state) {
+                block_prob += timestep_posts[candidate_state];
+            }
+        }
+        block_prob = clamp(block_prob, 0.0f, 1.0f);
+        block_probs[block_idx] = pow(block_prob, 0.4f);  // Power fudge factor
+    }
+    threadgroup_barrier(mem_flags::mem_device);
+
+    // Emit a base for each step, with a qscore from the probabilities of it and its stays.
+    if (i == 0) {
+        device char* const sequence = sequence_out + out_chunk * T;
+        device char* const qstring = qstring_out + out_chunk * T;
+        int seq_pos = 0;
+        float base_prob = 0.0f;
+        float total_prob = 0.0f;
+        for (int block_idx = 0; block_idx <= T; ++block_idx) {
+            if (block_idx == T || block_idx == 0 || moves[block_idx]) {
+                if (block_idx != 0) {
+                    const float prob = -10.0f * log10(1.0f - base_prob / total_prob);
+                    const float qscore =
+                            max(1.0f, min(50.0f, prob * args->q_scale + args->q_shift));
+                    qstring[seq_pos - 1] = char(33.5f + qscore);
+                }
+                if (block_idx == T) {
+                    break;
+                }
+                sequence[seq_pos++] = kBeamSearchAlphabet[states[block_idx] % kNumBases];
+                base_prob = 0.0f;
+                total_prob = 0.0f;
+            }
+            // The called base gets the block's probability, and the "wrong" bases share the
+            // rest.
+            const int base = states[block_idx] % kNumBases;
+            const float block_prob = block_probs[block_idx];
+            const float wrong_base_prob = (1.0f - block_prob) / 3.0f;
+            base_prob += block_prob;
+            for (int k = 0; k < kNumBases; ++k) {
+                total_prob += (k == base) ? block_prob : wrong_base_prob;
+            }
+        }
+        sequence_len_out[out_chunk] = seq_pos;
+    }
+}
+
 struct ConvArgs {
     int in_size;
     int win_size;
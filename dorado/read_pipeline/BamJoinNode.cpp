@@ -0,0 +1,314 @@
+#include "BamJoinNode.h"
+
+#include "htslib/sam.h"
+#include "utils/bam_utils.h"
+#include "utils/sequence_utils.h"
+#include "utils/thread_utils.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+namespace {
+
+// The stride the record's move table was made with, which is its first entry, or 0 if the
+// record has no move table.
+int move_table_stride(const bam1_t* record) {
+    uint8_t* mv = bam_aux_get(record, "mv");
+    if (!mv || bam_auxB_len(mv) == 0) {
+        return 0;
+    }
+    return static_cast<int>(bam_auxB2i(mv, 0));
+}
+
+void remove_tag(bam1_t* record, const char* tag) {
+    if (uint8_t* data = bam_aux_get(record, tag)) {
+        bam_aux_del(record, data);
+    }
+}
+
+}  // namespace
+
+namespace dorado {
+
+bool BamRecordMap::add(BamPtr record) {
+    const bool is_primary = !(record->core.flag & (BAM_FSECONDARY | BAM_FSUPPLEMENTARY));
+    const int stride = is_primary ? move_table_stride(record.get()) : 0;
+    if (stride <= 0) {
+        if (m_keep_other_records) {
+            std::lock_guard lock(m_mutex);
+            m_other_records[bam_get_qname(record.get())].push_back(std::move(record));
+        }
+        return false;
+    }
+
+    std::lock_guard lock(m_mutex);
+    if (m_model_stride != 0 && stride != m_model_stride) {
+        throw std::runtime_error("Record " + std::string(bam_get_qname(record.get())) +
+                                 " has moves of stride " + std::to_string(stride) +
+                                 ", but the records before it have stride " +
+                                 std::to_string(m_model_stride));
+    }
+    m_model_stride = stride;
+    std::string read_id = bam_get_qname(record.get());
+    m_records[std::move(read_id)] = std::move(record);
+    return true;
+}
+
+size_t BamRecordMap::add_records(utils::HtsReader& reader,
+                                 const std::optional<utils::ReadIdSet>& read_ids) {
+    size_t num_skipped = 0;
+    std::vector<BamPtr> batch;
+    while (reader.read_batch(batch, 1000)) {
+        for (auto& record : batch) {
+            if (!read_ids || read_ids->contains(std::string_view(bam_get_qname(record.get())))) {
+                num_skipped += !add(std::move(record));
+            }
+        }
+        batch.clear();
+    }
+    return num_skipped;
+}
+
+const bam1_t* BamRecordMap::find(const std::string& read_id) const {
+    std::lock_guard lock(m_mutex);
+    auto it = m_records.find(read_id);
+    // The record itself isn't moved by other records being added or taken.
+    return it == m_records.end() ? nullptr : it->second.get();
+}
+
+BamPtr BamRecordMap::take(const std::string& read_id) {
+    std::lock_guard lock(m_mutex);
+    auto it = m_records.find(read_id);
+    if (it == m_records.end()) {
+        return nullptr;
+    }
+    auto record = std::move(it->second);
+    m_records.erase(it);
+    return record;
+}
+
+std::vector<BamPtr> BamRecordMap::take_others(const std::string& read_id) {
+    std::lock_guard lock(m_mutex);
+    auto it = m_other_records.find(read_id);
+    if (it == m_other_records.end()) {
+        return {};
+    }
+    auto records = std::move(it->second);
+    m_other_records.erase(it);
+    return records;
+}
+
+std::vector<BamPtr> BamRecordMap::take_remaining() {
+    std::lock_guard lock(m_mutex);
+    std::vector<BamPtr> records;
+    for (auto& [read_id, record] : m_records) {
+        records.push_back(std::move(record));
+        if (auto others = m_other_records.find(read_id); others != m_other_records.end()) {
+            std::move(others->second.begin(), others->second.end(), std::back_inserter(records));
+            m_other_records.erase(others);
+        }
+    }
+    for (auto& [read_id, others] : m_other_records) {
+        std::move(others.begin(), others.end(), std::back_inserter(records));
+    }
+    m_records.clear();
+    m_other_records.clear();
+    return records;
+}
+
+std::unordered_set<std::string> BamRecordMap::read_ids() const {
+    std::lock_guard lock(m_mutex);
+    std::unordered_set<std::string> read_ids;
+    read_ids.reserve(m_records.size());
+    for (const auto& [read_id, record] : m_records) {
+        read_ids.insert(read_id);
+    }
+    return read_ids;
+}
+
+size_t BamRecordMap::size() const {
+    std::lock_guard lock(m_mutex);
+    return m_records.size();
+}
+
+bool BamJoinNode::restore_basecall(Read& read, const bam1_t* record) {
+    const int stride = move_table_stride(record);
+    if (stride <= 0) {
+        return false;
+    }
+    // A record from a different version of the scaler wouldn't line up with the signal.
+    if (uint8_t* ts = bam_aux_get(record, "ts");
+        ts && uint64_t(bam_aux2i(ts)) != read.num_trimmed_samples) {
+        return false;
+    }
+
+    const auto length = static_cast<size_t>(record->core.l_qseq);
+    const uint8_t* seq = bam_get_seq(record);
+    const uint8_t* qual = bam_get_qual(record);
+    read.seq.resize(length);
+    read.qstring.resize(length);
+    for (size_t i = 0; i < length; ++i) {
+        read.seq[i] = seq_nt16_str[bam_seqi(seq, i)];
+        // Records without qualities have 0xff for the first.
+        read.qstring[i] = static_cast<char>((qual[0] == 0xff ? 0 : qual[i]) + 33);
+    }
+    if (record->core.flag & BAM_FREVERSE) {
+        read.seq = utils::reverse_complement(read.seq);
+        std::reverse(read.qstring.begin(), read.qstring.end());
+    }
+
+    uint8_t* mv = bam_aux_get(record, "mv");
+    const uint32_t num_moves = bam_auxB_len(mv) - 1;
+    std::vector<uint8_t> moves(num_moves);
+    for (uint32_t i = 0; i < num_moves; ++i) {
+        moves[i] = static_cast<uint8_t>(bam_auxB2i(mv, i + 1));
+    }
+    read.moves = utils::MoveTable(moves);
+    read.model_stride = stride;
+
+    // Every base must be called from a step within the signal.
+    const auto signal_length = static_cast<size_t>(read.raw_data_size());
+    return read.moves.count() == length && num_moves > 0 &&
+           (num_moves - 1) * size_t(stride) < signal_length;
+}
+
+void BamJoinNode::worker_thread() {
+    utils::set_thread_name("bam_join");
+
+    Message message;
+    while (m_work_queue.try_pop(message)) {
+        // If this message isn't a read, we'll get a bad_variant_access exception.
+        auto read = std::get<std::shared_ptr<Read>>(std::move(message));
+
+        const bam1_t* record = m_records.find(read->read_id);
+        if (!record) {
+            // e.g. the subreads of a split read, or reads whose basecalls were filtered out.
+            ++m_num_reads_unmatched;
+        } else if (!restore_basecall(*read, record)) {
+            ++m_num_reads_mismatched;
+        } else {
+            if (!m_keep_records) {
+                m_records.take(read->read_id);
+            }
+            read->memory_reservation.resize(read->host_memory_bytes());
+            m_sink.push_message(std::move(read));
+        }
+    }
+
+    if (--m_active_threads == 0) {
+        m_sink.terminate();
+        if (m_num_reads_unmatched > 0) {
+            spdlog::info("> Reads skipped (no record in the BAM): {}", m_num_reads_unmatched);
+        }
+        if (m_num_reads_mismatched > 0) {
+            spdlog::warn("> Reads skipped (record doesn't match the signal): {}",
+                         m_num_reads_mismatched);
+        }
+    }
+}
+
+BamJoinNode::BamJoinNode(MessageSink& sink,
+                         BamRecordMap& records,
+                         size_t num_worker_threads,
+                         bool keep_records)
+        : MessageSink(1000), m_sink(sink), m_records(records), m_keep_records(keep_records) {
+    m_active_threads = num_worker_threads;
+    for (size_t i = 0; i < num_worker_threads; i++) {
+        m_workers.push_back(std::make_unique<std::thread>(&BamJoinNode::worker_thread, this));
+    }
+}
+
+BamJoinNode::~BamJoinNode() {
+    terminate();
+    for (auto& m : m_workers) {
+        m->join();
+    }
+    m_sink.terminate();
+}
+
+void BamModBaseTagNode::worker_thread() {
+    utils::set_thread_name("bam_modbase_tag");
+
+    Message message;
+    while (m_work_queue.try_pop(message)) {
+        // If this message isn't a read, we'll get a bad_variant_access exception.
+        auto read = std::get<std::shared_ptr<Read>>(std::move(message));
+
+        auto record = m_records.take(read->read_id);
+        if (!record) {
+            continue;
+        }
+        // A read's records go on in one push, so that nothing downstream, e.g. a checkpoint of
+        // a sharded writer, can fall between them.
+        std::vector<Message> records;
+        const int32_t length = record->core.l_qseq;
+        records.push_back(std::move(record));
+        for (auto& other : m_records.take_others(read->read_id)) {
+            records.push_back(std::move(other));
+        }
+        for (auto& message : records) {
+            auto* tagged = std::get<BamPtr>(message).get();
+            // MM and ML are defined on the sequence as it was sequenced, as the read has it,
+            // whichever strand the record is aligned to.
+            remove_tag(tagged, "MM");
+            remove_tag(tagged, "ML");
+            remove_tag(tagged, "MN");
+            if (tagged->core.l_qseq == length) {
+                read->append_modbase_tags(tagged, m_modbase_threshold);
+            } else {
+                ++m_num_records_untagged;
+            }
+        }
+        m_sink.push_messages(std::move(records));
+    }
+
+    if (--m_active_threads == 0) {
+        // The records of reads which weren't modbase called, e.g. those without moves, or
+        // whose signal wasn't found, go on as they are.
+        auto remaining = m_records.take_remaining();
+        if (!remaining.empty()) {
+            spdlog::warn("> Records passed on without modbase calls, for want of a read: {}",
+                         remaining.size());
+            std::vector<Message> messages;
+            for (auto& record : remaining) {
+                messages.push_back(std::move(record));
+            }
+            m_sink.push_messages(std::move(messages));
+        }
+        if (m_num_records_untagged > 0) {
+            spdlog::info("> Records passed on without modbase calls, for want of the whole "
+                         "sequence: {}",
+                         m_num_records_untagged);
+        }
+        m_sink.terminate();
+    }
+}
+
+BamModBaseTagNode::BamModBaseTagNode(MessageSink& sink,
+                                     BamRecordMap& records,
+                                     float modbase_threshold_frac,
+                                     size_t num_worker_threads)
+        : MessageSink(1000),
+          m_sink(sink),
+          m_records(records),
+          m_modbase_threshold(
+                  static_cast<uint8_t>(std::min(modbase_threshold_frac * 256.0f, 255.0f))) {
+    m_active_threads = num_worker_threads;
+    for (size_t i = 0; i < num_worker_threads; i++) {
+        m_workers.push_back(
+                std::make_unique<std::thread>(&BamModBaseTagNode::worker_thread, this));
+    }
+}
+
+BamModBaseTagNode::~BamModBaseTagNode() {
+    terminate();
+    for (auto& m : m_workers) {
+        m->join();
+    }
+    m_sink.terminate();
+}
+
+}  // namespace dorado
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "ReadPipeline.h"
+#include "utils/ReadIdSet.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace dorado {
+
+namespace utils {
+class HtsReader;
+}
+
+// The records of an earlier basecall, by read ID, for BamJoinNode to join back up with the
+// reads' signal and BamModBaseTagNode to write the reads' modified base calls into.  Reads are
+// joined up with their primary record with a move table, since it has the whole basecall.
+// With keep_other_records set, the rest, i.e. secondary and supplementary records and those
+// without moves, are kept too, to be written out with their read's.
+class BamRecordMap {
+public:
+    explicit BamRecordMap(bool keep_other_records = false)
+            : m_keep_other_records(keep_other_records) {}
+
+    // Keeps record, returning false if it isn't a primary record with a move table, in which
+    // case it's only kept with keep_other_records.  Throws if its move table is from a model of
+    // a different stride to the records before it.
+    bool add(BamPtr record);
+    // Adds the records read from reader, of the reads in read_ids if given, returning how many
+    // of those weren't primary records with a move table.
+    size_t add_records(utils::HtsReader& reader,
+                       const std::optional<utils::ReadIdSet>& read_ids = std::nullopt);
+
+    // The record of read_id, or nullptr.  It stays in the map until taken.
+    const bam1_t* find(const std::string& read_id) const;
+    // Removes the record of read_id from the map, returning nullptr if there is none.
+    BamPtr take(const std::string& read_id);
+    // Removes the other records of read_id from the map.
+    std::vector<BamPtr> take_others(const std::string& read_id);
+    // Removes every record left, primary or not.
+    std::vector<BamPtr> take_remaining();
+
+    // The reads with a primary record with moves.
+    std::unordered_set<std::string> read_ids() const;
+    // The number of primary records with moves.
+    size_t size() const;
+    // The stride of the model the records were basecalled with, or 0 if there are none.
+    int model_stride() const { return m_model_stride; }
+
+private:
+    const bool m_keep_other_records;
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::string, BamPtr> m_records;
+    std::unordered_map<std::string, std::vector<BamPtr>> m_other_records;
+    int m_model_stride{0};
+};
+
+// Restores the basecall of each read from its record in records, so that the read can be
+// modbase called without being basecalled again.  Reads come from a ScalerNode, which
+// normalises and trims their signal just as it did for the basecall, and those with no
+// record, or whose record doesn't match their signal, are dropped.  Unless keep_records is
+// set, for a later node to take them, each record is freed once its read has been joined.
+class BamJoinNode : public MessageSink {
+public:
+    BamJoinNode(MessageSink& sink,
+                BamRecordMap& records,
+                size_t num_worker_threads,
+                bool keep_records = true);
+    ~BamJoinNode();
+
+    // Sets read's seq, qstring, moves and model_stride from record, in the orientation the read
+    // was sequenced in.  Returns false if the record's move table doesn't fit the read's signal,
+    // as trimmed by the scaler.
+    static bool restore_basecall(Read& read, const bam1_t* record);
+
+private:
+    MessageSink& m_sink;
+    BamRecordMap& m_records;
+    const bool m_keep_records;
+    void worker_thread();
+
+    std::vector<std::unique_ptr<std::thread>> m_workers;
+    std::atomic<size_t> m_active_threads{0};
+    std::atomic<size_t> m_num_reads_unmatched{0};
+    std::atomic<size_t> m_num_reads_mismatched{0};
+};
+
+// Takes each modbase called read's records out of records, replaces any modified base tags
+// they had with the read's own, and passes them on together.  The tags are only written on
+// the read's other records if they have its whole sequence: the rest, e.g. hard clipped
+// supplementary alignments, are passed on without any.  Once every read has been tagged, the
+// records left, of reads which weren't modbase called, are passed on as they are.
+class BamModBaseTagNode : public MessageSink {
+public:
+    BamModBaseTagNode(MessageSink& sink,
+                      BamRecordMap& records,
+                      float modbase_threshold_frac,
+                      size_t num_worker_threads);
+    ~BamModBaseTagNode();
+
+private:
+    MessageSink& m_sink;
+    BamRecordMap& m_records;
+    uint8_t m_modbase_threshold;
+    void worker_thread();
+
+    std::vector<std::unique_ptr<std::thread>> m_workers;
+    std::atomic<size_t> m_active_threads{0};
+    std::atomic<size_t> m_num_records_untagged{0};
+};
+
+}  // namespace dorado
@@ -1,48 +1,68 @@
 #include "BaseSpaceDuplexCallerNode.h"
 
 #include "3rdparty/edlib/edlib/include/edlib.h"
-#include "cxxpool.h"
+#include "utils/alignment_utils.h"
 #include "utils/duplex_utils.h"
 #include "utils/sequence_utils.h"
+#include "utils/thread_utils.h"
 
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
 #include <chrono>
+#include <iterator>
+#include <string>
+#include <vector>
 
 using namespace std::chrono_literals;
 namespace {
-// Given two sequences, their quality scores, and alignments, computes a consensus sequence
-std::pair<std::vector<char>, std::vector<char>> compute_basespace_consensus(
-        int alignment_start_position,
-        int alignment_end_position,
-        std::vector<uint8_t> target_quality_scores,
-        int target_cursor,
-        std::vector<uint8_t> query_quality_scores,
-        int query_cursor,
-        const std::string_view target_sequence,
-        const std::string_view query_sequence,
-        unsigned char* alignment) {
-    std::vector<char> consensus;
-    std::vector<char> quality_scores_phred;
+// Given two sequences, their quality scores, and alignments, computes a consensus sequence and
+// its quality scores into consensus and consensus_qstring.
+void compute_basespace_consensus(int alignment_start_position,
+                                 int alignment_end_position,
+                                 const std::vector<uint8_t>& target_quality_scores,
+                                 int target_cursor,
+                                 const std::vector<uint8_t>& query_quality_scores,
+                                 int query_cursor,
+                                 const std::string_view target_sequence,
+                                 const std::string_view query_sequence,
+                                 const unsigned char* alignment,
+                                 std::string& consensus,
+                                 std::string& consensus_qstring) {
+    // Each alignment position adds at most one base, so the output is written in place and
+    // trimmed to size at the end.
+    const int max_consensus_length = std::max(alignment_end_position - alignment_start_position, 0);
+    consensus.resize(max_consensus_length);
+    consensus_qstring.resize(max_consensus_length);
+    char* const consensus_ptr = consensus.data();
+    char* const consensus_qstring_ptr = consensus_qstring.data();
+    int consensus_length = 0;
+
+    const int target_length =
+            static_cast<int>(std::min(target_quality_scores.size(), target_sequence.size()));
+    const int query_length =
+            static_cast<int>(std::min(query_quality_scores.size(), query_sequence.size()));
 
     // Loop over each alignment position, within given alignment boundaries
-    for (int i = alignment_start_position;
-         i < alignment_end_position && target_cursor < target_quality_scores.size() &&
-         query_cursor < query_quality_scores.size();
+    for (int i = alignment_start_position; i < alignment_end_position &&
+                                           target_cursor < target_length &&
+                                           query_cursor < query_length;
          i++) {
         //Comparison between q-scores is done in Phred space which is offset by 33
-        if (target_quality_scores.at(target_cursor) >=
-            query_quality_scores.at(query_cursor)) {  // Target has a higher quality score
+        if (target_quality_scores[target_cursor] >=
+            query_quality_scores[query_cursor]) {  // Target has a higher quality score
             // If there is *not* an insertion to the query, add the nucleotide from the target cursor
             if (alignment[i] != 2) {
-                consensus.push_back(target_sequence.at(target_cursor));
-                quality_scores_phred.push_back(target_quality_scores.at(target_cursor));
+                consensus_ptr[consensus_length] = target_sequence[target_cursor];
+                consensus_qstring_ptr[consensus_length] = target_quality_scores[target_cursor];
+                ++consensus_length;
             }
         } else {
             // If there is *not* an insertion to the target, add the nucleotide from the query cursor
             if (alignment[i] != 1) {
-                consensus.push_back(query_sequence.at(query_cursor));
-                quality_scores_phred.push_back(query_quality_scores.at(query_cursor));
+                consensus_ptr[consensus_length] = query_sequence[query_cursor];
+                consensus_qstring_ptr[consensus_length] = query_quality_scores[query_cursor];
+                ++consensus_length;
             }
         }
 
@@ -56,67 +76,105 @@ std::pair<std::vector<char>, std::vector<char>> compute_basespace_consensus(
             query_cursor++;
         }
     }
-    return std::make_pair(consensus, quality_scores_phred);
+    consensus.resize(consensus_length);
+    consensus_qstring.resize(consensus_length);
 }
 }  // namespace
 
 namespace dorado {
 
 void BaseSpaceDuplexCallerNode::worker_thread() {
-    cxxpool::thread_pool pool{m_num_worker_threads};
-    std::vector<std::future<void>> futures;
+    utils::set_thread_name("basespace");
+    Message message;
+    while (m_work_queue.try_pop(message)) {
+        if (!std::holds_alternative<std::shared_ptr<Read>>(message)) {
+            continue;
+        }
+        auto read = std::get<std::shared_ptr<Read>>(message);
+        auto partners_it = m_partners.find(read->read_id);
+        if (partners_it == m_partners.end()) {
+            continue;
+        }
 
-    for (auto key : m_template_complement_map) {
-        futures.push_back(pool.push([key, this] { return basespace(key.first, key.second); }));
+        // Every partner which has already arrived completes a pair.
+        size_t num_partners_pending = 0;
+        for (const auto& partner : partners_it->second) {
+            auto cached_it = m_cached_reads_by_id.find(partner.read_id);
+            if (cached_it == m_cached_reads_by_id.end()) {
+                ++num_partners_pending;
+                continue;
+            }
+            auto partner_read = cached_it->second->read;
+            if (--cached_it->second->num_partners_pending == 0) {
+                m_cached_reads.erase(cached_it->second);
+                m_cached_reads_by_id.erase(cached_it);
+            }
+
+            auto template_read = partner.is_template ? read : partner_read;
+            auto complement_read = partner.is_template ? partner_read : read;
+            m_basespace_tasks.push([this, template_read = std::move(template_read),
+                                    complement_read = std::move(complement_read)] {
+                basespace(template_read, complement_read);
+            });
+        }
+
+        if (num_partners_pending > 0) {
+            cache_read(std::move(read), num_partners_pending);
+        }
     }
-    for (auto& v : futures) {
-        v.get();
+
+    // Wait for calls in flight before telling the sink there's nothing more to come.
+    m_basespace_tasks.wait();
+
+    if (!m_cached_reads.empty() || m_num_evicted_reads > 0) {
+        spdlog::debug(
+                "{} reads in the pairs file were not paired, as their partners were not found, "
+                "and {} were evicted from the cache before their partners arrived",
+                m_cached_reads.size(), m_num_evicted_reads);
     }
+    m_cached_reads.clear();
+    m_cached_reads_by_id.clear();
 
     // Notify the sink that the Node has terminated
     m_sink.terminate();
 }
 
-void BaseSpaceDuplexCallerNode::basespace(std::string template_read_id,
-                                          std::string complement_read_id) {
-    EdlibAlignConfig align_config = edlibDefaultAlignConfig();
-    align_config.task = EDLIB_TASK_PATH;
-
-    std::string_view template_sequence;
-    std::shared_ptr<Read> template_read;
-    std::vector<uint8_t> template_quality_scores;
-    auto template_read_it = m_reads.find(template_read_id);
-    if (template_read_it == m_reads.end()) {
-        spdlog::debug("Template Read ID={} is present in pairs file but read was not found",
-                      template_read_id);
-        return;
-    } else {
-        template_read = template_read_it->second;
-        template_sequence = template_read->seq;
-        template_quality_scores =
-                std::vector<uint8_t>(template_read->qstring.begin(), template_read->qstring.end());
+void BaseSpaceDuplexCallerNode::cache_read(std::shared_ptr<Read> read,
+                                           size_t num_partners_pending) {
+    // A read seen again, e.g. from input listed twice, replaces the cached copy, rather than
+    // leaving it in the list for eviction to find under an ID which now names the new one.
+    if (auto cached = m_cached_reads_by_id.find(read->read_id);
+        cached != m_cached_reads_by_id.end()) {
+        m_cached_reads.erase(cached->second);
+        m_cached_reads_by_id.erase(cached);
     }
-
-    // For basespace, a q score filter is run over the quality scores.
-    utils::preprocess_quality_scores(template_quality_scores);
-
-    auto complement_read_it = m_reads.find(complement_read_id);
-    if (complement_read_it == m_reads.end()) {
-        spdlog::debug("Complement ID={} paired with Template ID={} was not found",
-                      complement_read_id, template_read_id);
-        return;
+    if (m_cached_reads.size() >= m_max_cached_reads) {
+        spdlog::debug("Read ID={} evicted from the cache before its partner arrived",
+                      m_cached_reads.front().read->read_id);
+        m_cached_reads_by_id.erase(m_cached_reads.front().read->read_id);
+        m_cached_reads.pop_front();
+        ++m_num_evicted_reads;
     }
+    const auto read_id = read->read_id;
+    m_cached_reads.push_back({std::move(read), num_partners_pending});
+    m_cached_reads_by_id[read_id] = std::prev(m_cached_reads.end());
+}
 
+void BaseSpaceDuplexCallerNode::basespace(const std::shared_ptr<Read>& template_read,
+                                          const std::shared_ptr<Read>& complement_read) {
+    std::string_view template_sequence = template_read->seq;
     if (template_sequence.empty()) {
         return;
     }
+    auto template_quality_scores =
+            std::vector<uint8_t>(template_read->qstring.begin(), template_read->qstring.end());
+
+    // For basespace, a q score filter is run over the quality scores.
+    utils::preprocess_quality_scores(template_quality_scores);
 
     // We have both sequences and can perform the consensus
-    auto complement_read = complement_read_it->second;
-    auto complement_quality_scores_reverse =
-            std::vector<uint8_t>(complement_read->qstring.begin(), complement_read->qstring.end());
-    std::reverse(complement_quality_scores_reverse.begin(),
-                 complement_quality_scores_reverse.end());
+    auto complement_quality_scores_reverse = std::vector<uint8_t>(
+            complement_read->qstring.rbegin(), complement_read->qstring.rend());
 
     // For basespace, a q score filter is run over the quality scores.
     utils::preprocess_quality_scores(complement_quality_scores_reverse);
@@ -125,10 +183,15 @@ void BaseSpaceDuplexCallerNode::basespace(std::string template_read_id,
     auto complement_sequence_reverse_complement =
             dorado::utils::reverse_complement(complement_read->seq);
 
-    EdlibAlignResult result =
-            edlibAlign(template_sequence.data(), template_sequence.size(),
-                       complement_sequence_reverse_complement.data(),
-                       complement_sequence_reverse_complement.size(), align_config);
+    // Bounded as the stereo encoder's alignment is, so pairs too far apart for consensus are
+    // given up on early rather than aligned in full.
+    EdlibAlignResult result = utils::align_within_error_rate(
+            template_sequence, complement_sequence_reverse_complement,
+            utils::kMaxDuplexAlignmentErrorRate);
+    if (result.status != EDLIB_STATUS_OK || result.editDistance < 0) {
+        edlibFreeAlignResult(result);
+        return;
+    }
 
     // Now - we have to do the actual basespace alignment itself
     int query_cursor = 0;
@@ -158,17 +221,15 @@ void BaseSpaceDuplexCallerNode::basespace(std::string template_read_id,
             ((end_alignment_position - start_alignment_position) > kMinTrimmedAlignmentLength);
 
     if (consensus_possible) {
-        auto [consensus, quality_scores_phred] = compute_basespace_consensus(
-                start_alignment_position, end_alignment_position, template_quality_scores,
-                target_cursor, complement_quality_scores_reverse, query_cursor, template_sequence,
-                complement_sequence_reverse_complement, result.alignment);
-
         auto duplex_read = std::make_shared<Read>();
-        duplex_read->seq = std::string(consensus.begin(), consensus.end());
-        duplex_read->qstring =
-                std::string(quality_scores_phred.begin(), quality_scores_phred.end());
+        compute_basespace_consensus(start_alignment_position, end_alignment_position,
+                                    template_quality_scores, target_cursor,
+                                    complement_quality_scores_reverse, query_cursor,
+                                    template_sequence, complement_sequence_reverse_complement,
+                                    result.alignment, duplex_read->seq, duplex_read->qstring);
 
         duplex_read->read_id = template_read->read_id + ";" + complement_read->read_id;
+        duplex_read->is_priority = template_read->is_priority || complement_read->is_priority;
         m_sink.push_message(duplex_read);
     }
     edlibFreeAlignResult(result);
@@ -177,13 +238,16 @@ void BaseSpaceDuplexCallerNode::basespace(std::string template_read_id,
 BaseSpaceDuplexCallerNode::BaseSpaceDuplexCallerNode(
         MessageSink& sink,
         std::map<std::string, std::string> template_complement_map,
-        utils::read_map reads,
-        size_t threads)
+        size_t threads,
+        size_t max_cached_reads)
         : MessageSink(1000),
           m_sink(sink),
-          m_template_complement_map(std::move(template_complement_map)),
-          m_reads(std::move(reads)),
-          m_num_worker_threads(threads) {
+          m_max_cached_reads(max_cached_reads),
+          m_basespace_tasks(utils::WorkStealingExecutor::instance(), threads) {
+    for (const auto& [template_id, complement_id] : template_complement_map) {
+        m_partners[template_id].push_back({complement_id, true});
+        m_partners[complement_id].push_back({template_id, false});
+    }
     m_worker_thread =
             std::make_unique<std::thread>(&BaseSpaceDuplexCallerNode::worker_thread, this);
 }
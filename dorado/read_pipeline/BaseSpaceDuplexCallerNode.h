@@ -1,27 +1,59 @@
 #pragma once
 #include "ReadPipeline.h"
-#include "utils/bam_utils.h"
+#include "utils/WorkStealingExecutor.h"
+
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 namespace dorado {
-// Duplex caller node receives a map of template_id to complement_id (typically generated from a pairs file),
-// and a map of `read_id` to `dorado::Read` object. It then performs duplex calling and pushes `dorado::Read`
-// objects to its output queue.
+// Duplex caller node receives a map of template_id to complement_id (typically generated from a
+// pairs file), and then `dorado::Read` objects in any order.  As soon as both reads of a pair have
+// arrived it performs duplex calling on them, and pushes the duplex `dorado::Read` to its output
+// queue.  Reads are only held until their partner arrives, and at most max_cached_reads at a time,
+// so the reads needn't all fit in memory at once.
 class BaseSpaceDuplexCallerNode : public MessageSink {
 public:
     BaseSpaceDuplexCallerNode(MessageSink& sink,
                               std::map<std::string, std::string> template_complement_map,
-                              utils::read_map reads,
-                              size_t threads);
+                              size_t threads,
+                              size_t max_cached_reads = 100000);
     ~BaseSpaceDuplexCallerNode();
 
 private:
     void worker_thread();
-    void basespace(std::string template_read_id, std::string complement_read_id);
+    void basespace(const std::shared_ptr<Read>& template_read,
+                   const std::shared_ptr<Read>& complement_read);
+    // Holds read until all its partners have arrived, evicting the longest held read if the
+    // cache is full.
+    void cache_read(std::shared_ptr<Read> read, size_t num_partners_pending);
+
     MessageSink&
             m_sink;  // MessageSink to consume Duplex Called Reads. This will typically be a writer node
-    size_t m_num_worker_threads{1};
     std::unique_ptr<std::thread> m_worker_thread;
-    std::map<std::string, std::string> m_template_complement_map;
-    utils::read_map m_reads;
+
+    // The pairs each read is in, as its partner's ID and whether the read is the template.
+    struct Partner {
+        std::string read_id;
+        bool is_template;
+    };
+    std::unordered_map<std::string, std::vector<Partner>> m_partners;
+
+    // Reads which have arrived before at least one of their partners, in order of arrival.
+    struct CachedRead {
+        std::shared_ptr<Read> read;
+        size_t num_partners_pending;
+    };
+    std::list<CachedRead> m_cached_reads;
+    std::unordered_map<std::string, std::list<CachedRead>::iterator> m_cached_reads_by_id;
+    const size_t m_max_cached_reads;
+    size_t m_num_evicted_reads{0};
+
+    // Basespace calls are run as tasks on the shared executor.
+    utils::TaskQueue m_basespace_tasks;
 };
 }  // namespace dorado
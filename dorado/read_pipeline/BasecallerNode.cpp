@@ -1,42 +1,61 @@
 #include "BasecallerNode.h"
 
 #include "../decode/CPUDecoder.h"
+#include "../utils/MetricsServer.h"
+#include "../utils/TraceRecorder.h"
 #include "../utils/stitch.h"
+#include "../utils/thread_utils.h"
 
 #include <nvtx3/nvtx3.hpp>
+#include <spdlog/spdlog.h>
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <cstdlib>
 #include <memory>
 
 using namespace std::chrono_literals;
-using namespace torch::indexing;
+
+namespace {
+
+// Weight of the newest batch in each runner's measured throughput.
+constexpr float kThroughputSmoothing = 0.2f;
+
+}  // namespace
 
 namespace dorado {
 
 void BasecallerNode::input_worker_thread() {
+    utils::set_thread_name("basecall_input");
     Message message;
 
-    // Allow 5 batches per model runner on the chunks_in queue
-    size_t max_chunks_in = 0;
-    // Allows optimal batch size to be used for every GPU
-    for (auto &runner : m_model_runners) {
-        max_chunks_in += runner->batch_size() * 5;
-    }
-
     while (m_work_queue.try_pop(message)) {
         // If this message isn't a read, we'll get a bad_variant_access exception.
         auto read = std::get<std::shared_ptr<Read>>(message);
-        // If a read has already been basecalled, just send it to the sink without basecalling again
-        // TODO: This is necessary because some reads (e.g failed Stereo Encoding) will be passed
-        // to the basecaller node having already been called. This should be fixed in the future with
-        // support for graphs of nodes rather than linear pipelines.
+        // If a read has already been basecalled, just send it to the sink without basecalling again.
+        // Pipelines which mix called and uncalled reads should route called reads around this
+        // node with a MessageRouter instead of relying on this passthrough.
         if (!read->seq.empty()) {
             m_sink.push_message(read);
             continue;
         }
-        // Now that we have acquired a read, wait until we can push to chunks_in
-        while (true) {
+
+        // Chunk up the read.  Nothing else can see the read's chunks until they're queued.
+        utils::chunk_read(*read, m_chunk_sizes, m_overlap, m_model_stride);
+        m_num_signal_samples += read->raw_data.size(-1);
+
+        // The read's chunks are queued in order, as many at a time as their buckets have room
+        // for, so an ultra-long read's thousands of chunks are fed in as earlier ones are
+        // batched rather than all sitting in the queues at once.  Those called are stitched
+        // and freed as they go, so only a window of the read's basecalls is held at a time.
+        // Priority reads' chunks go in queues of their own, which are batched first.
+        size_t num_queued = 0;
+        auto next_bucket_has_space = [this, &read, &num_queued] {
+            auto &bucket = m_buckets[bucket_index(read->called_chunks[num_queued].raw_chunk_size)];
+            return bucket.chunks_in_for(*read).size() < bucket.max_chunks_in;
+        };
+        while (num_queued < read->called_chunks.size()) {
             std::unique_lock<std::mutex> chunk_lock(m_chunks_in_mutex);
             // A new condition was added to the condition variable which adjusts the predicate
             // to check for number of working reads. This is to deal with some degenerate cases during
@@ -46,121 +65,226 @@ void BasecallerNode::input_worker_thread() {
             // This change below more effectively puts a ceiling on the host memory usage.
             // Keeping the condition a function of the current sink size (empmirically at 5k reads this
             // caps memory around 30GB).
-            m_chunks_in_has_space_cv.wait_for(chunk_lock, 10ms, [this, &max_chunks_in] {
-                return (m_chunks_in.size() < max_chunks_in) &&
-                       (m_working_reads.size() < 5 * m_max_reads);
-            });
-
-            if (m_chunks_in.size() >= max_chunks_in) {
+            // A read which has started being queued is always let finish.  Priority reads are
+            // held to the ceiling too; they're ahead of the bulk in the input queue.
+            auto can_queue = [this, &num_queued, &next_bucket_has_space] {
+                return next_bucket_has_space() &&
+                       (num_queued > 0 || m_working_reads.size() < 5 * m_max_reads);
+            };
+            m_chunks_in_has_space_cv.wait_for(chunk_lock, 10ms, can_queue);
+            if (!can_queue()) {
                 continue;
             }
 
-            // Chunk up the read and put the chunks into the pending chunk list.
-            size_t raw_size =
-                    read->raw_data.sizes()[read->raw_data.sizes().size() - 1];  // Time dimension.
-
-            size_t offset = 0;
-            size_t chunk_in_read_idx = 0;
-            size_t signal_chunk_step = m_chunk_size - m_overlap;
-            m_chunks_in.push_back(
-                    std::make_shared<Chunk>(read, offset, chunk_in_read_idx++, m_chunk_size));
-            read->num_chunks = 1;
-            auto last_chunk_offset = raw_size - m_chunk_size;
-            auto misalignment = last_chunk_offset % m_model_stride;
-            if (misalignment != 0) {
-                // move last chunk start to the next stride boundary. we'll zero pad any excess samples required.
-                last_chunk_offset += m_model_stride - misalignment;
+            if (num_queued == 0) {
+                // Put the read in the working list before any of its chunks can be called, so
+                // it's there to be completed.
+                std::lock_guard working_reads_lock(m_working_reads_mutex);
+                m_working_reads.emplace(read.get(), read);
             }
-            while (offset + m_chunk_size < raw_size) {
-                offset = std::min(offset + signal_chunk_step, last_chunk_offset);
-                m_chunks_in.push_back(
-                        std::make_shared<Chunk>(read, offset, chunk_in_read_idx++, m_chunk_size));
-                read->num_chunks++;
+            // called_chunks is complete, so pointers into it stay valid until the read is
+            // released, which is only once all its chunks have been called.
+            while (num_queued < read->called_chunks.size() && next_bucket_has_space()) {
+                auto &chunk = read->called_chunks[num_queued++];
+                m_buckets[bucket_index(chunk.raw_chunk_size)].chunks_in_for(*read).push_back(
+                        &chunk);
             }
-            read->called_chunks.resize(read->num_chunks);
-            read->num_chunks_called.store(0);
             chunk_lock.unlock();
-
-            // Put the read in the working list
-            {
-                std::lock_guard working_reads_lock(m_working_reads_mutex);
-                m_working_reads.push_back(std::move(read));
-            }
-            break;  // Go back to watching the input reads
+            m_chunks_added_cv.notify_all();
         }
     }
 
     // Notify the basecaller threads that it is safe to gracefully terminate the basecaller
     m_terminate_basecaller.store(true);
+    m_chunks_added_cv.notify_all();
+}
+
+size_t BasecallerNode::bucket_index(size_t chunk_size) const {
+    return std::lower_bound(m_chunk_sizes.begin(), m_chunk_sizes.end(), chunk_size) -
+           m_chunk_sizes.begin();
+}
+
+size_t BasecallerNode::drain_share(int worker_id, size_t num_remaining) const {
+    const size_t bucket = m_runner_buckets[worker_id];
+    const float throughput = m_runner_throughputs[worker_id].load();
+    float bucket_throughput = 0;
+    bool fastest = true;
+    // Chunks already batched count towards each runner's share, so that what's left is spread
+    // evenly rather than each runner taking its share of whatever the last one left.
+    size_t num_outstanding = num_remaining;
+    for (size_t i = 0; i < m_model_runners.size(); ++i) {
+        if (m_runner_buckets[i] != bucket) {
+            continue;
+        }
+        num_outstanding += m_runner_chunks_batched[i].load();
+        const float other_throughput = m_runner_throughputs[i].load();
+        if (other_throughput == 0) {
+            // Not every runner has been measured, so there's nothing to share by.
+            return num_remaining;
+        }
+        bucket_throughput += other_throughput;
+        // Ties go to the first runner, so that one is always the fastest.
+        if (other_throughput > throughput ||
+            (other_throughput == throughput && i < size_t(worker_id))) {
+            fastest = false;
+        }
+    }
+
+    // A small batch is no quicker to call, so if the other runners would clear what's
+    // left before this one could call any of it, leave it to them.
+    const float batch_seconds = m_model_runners[worker_id]->batch_size() / throughput;
+    const float others_seconds = num_remaining / (bucket_throughput - throughput);
+    if (!fastest && batch_seconds > others_seconds) {
+        return 0;
+    }
+    const auto share =
+            static_cast<size_t>(std::ceil(num_outstanding * throughput / bucket_throughput));
+    const size_t num_batched = m_runner_chunks_batched[worker_id].load();
+    return share > num_batched ? std::min(share - num_batched, num_remaining) : 0;
 }
 
 void BasecallerNode::basecall_current_batch(int worker_id) {
     NVTX3_FUNC_RANGE();
+    utils::TraceSpan span("basecall_batch");
     auto model_runner = m_model_runners[worker_id];
-    auto decode_results = model_runner->call_chunks(m_batched_chunks[worker_id].size());
+    const auto call_start = AdaptiveBatchTimeout::Clock::now();
+    std::vector<DecodedChunk> decode_results;
+    bool call_failed = false;
+    try {
+        decode_results = model_runner->call_chunks(m_batched_chunks[worker_id].size());
+    } catch (const std::exception &e) {
+        // Rather than take the pipeline down, the batch's reads are dropped.  Their chunks are
+        // given empty calls, so that the reads can still be stitched and completed.
+        spdlog::error("Basecalling a batch on {} failed, so its reads are dropped: {}",
+                      model_runner->device(), e.what());
+        call_failed = true;
+        decode_results.resize(m_batched_chunks[worker_id].size());
+        for (size_t i = 0; i < decode_results.size(); ++i) {
+            auto *const chunk = m_batched_chunks[worker_id][i];
+            chunk->source_read->basecall_failed = true;
+            decode_results[i].moves.assign(
+                    std::max<size_t>(1, chunk->raw_chunk_size / model_runner->model_stride()), 0);
+        }
+    }
+    const auto call_end = AdaptiveBatchTimeout::Clock::now();
+    m_batch_timeouts[worker_id].batch_called(call_start, call_end);
+
+    // Partial batches are called in fewer rows, in less time, but not in proportion to how
+    // full they are, so throughput is measured from full batches, or whatever was called
+    // first until there's been one.
+    const float call_seconds = std::chrono::duration<float>(call_end - call_start).count();
+    const bool full_batch = m_batched_chunks[worker_id].size() == model_runner->batch_size();
+    if (!call_failed && call_seconds > 0 &&
+        (full_batch || m_runner_throughputs[worker_id].load() == 0)) {
+        const float batch_throughput = model_runner->batch_size() / call_seconds;
+        auto &throughput = m_runner_throughputs[worker_id];
+        const float previous = throughput.load();
+        throughput.store(previous == 0
+                                 ? batch_throughput
+                                 : previous + kThroughputSmoothing * (batch_throughput - previous));
+    }
+    m_buckets[m_runner_buckets[worker_id]].num_chunks_called += m_batched_chunks[worker_id].size();
+    m_runner_chunks_called[worker_id].fetch_add(m_batched_chunks[worker_id].size(),
+                                                std::memory_order_relaxed);
+    m_runner_batches_called[worker_id].fetch_add(1, std::memory_order_relaxed);
 
+    utils::TraceSpan stitch_span("stitch");
     for (size_t i = 0; i < m_batched_chunks[worker_id].size(); i++) {
-        m_batched_chunks[worker_id][i]->seq = decode_results[i].sequence;
-        m_batched_chunks[worker_id][i]->qstring = decode_results[i].qstring;
-        m_batched_chunks[worker_id][i]->moves = decode_results[i].moves;
+        auto *const chunk = m_batched_chunks[worker_id][i];
+        chunk->seq = std::move(decode_results[i].sequence);
+        chunk->qstring = std::move(decode_results[i].qstring);
+        chunk->moves = utils::MoveTable(decode_results[i].moves);
+        // The chunk is stitched into its read as soon as those before it have been, so a long
+        // read's basecalls are freed as it goes rather than all held until its last chunk.
+        // Once the last chunk is stitched the read may be released, so neither the read nor
+        // the chunk can be touched afterwards unless this call stitched it.
+        Read *const source_read = chunk->source_read;
+        if (utils::stitch_called_chunk(*source_read, chunk->idx_in_read)) {
+            complete_read(source_read);
+        }
     }
+    m_batched_chunks[worker_id].clear();
+    m_runner_chunks_batched[worker_id].store(0);
+}
 
-    // We need to assign each chunk back to the read it came from
-    for (auto &complete_chunk : m_batched_chunks[worker_id]) {
-        std::shared_ptr<Read> source_read = complete_chunk->source_read.lock();
-        source_read->called_chunks[complete_chunk->idx_in_read] = complete_chunk;
-        ++source_read->num_chunks_called;
+void BasecallerNode::complete_read(Read *read) {
+    std::shared_ptr<Read> completed_read;
+    {
+        std::lock_guard working_reads_lock(m_working_reads_mutex);
+        auto read_iter = m_working_reads.find(read);
+        completed_read = std::move(read_iter->second);
+        m_working_reads.erase(read_iter);
     }
-    m_batched_chunks[worker_id].clear();
+    // Queued outside the lock, since the push waits while the queue is full, and the input
+    // thread would wait on the lock meanwhile.  The queue can't be terminated in between, as
+    // only the last worker to finish does that, and this one hasn't.
+    m_completed_reads.try_push(std::move(completed_read));
 }
 
 void BasecallerNode::working_reads_manager() {
-    while (true) {
+    utils::set_thread_name("basecall_output");
+    std::shared_ptr<Read> read;
+    size_t num_reads_failed = 0;
+    while (m_completed_reads.try_pop(read)) {
         nvtx3::scoped_range loop{"working_reads_manager"};
-
-        std::deque<std::shared_ptr<Read>> completed_reads;
-        {
-            std::lock_guard working_reads_lock(m_working_reads_mutex);
-            if (m_terminate_manager.load() && m_working_reads.empty()) {
-                break;
-            }
-            for (auto read_iter = m_working_reads.begin(); read_iter != m_working_reads.end();) {
-                if ((*read_iter)->num_chunks_called.load() == (*read_iter)->num_chunks) {
-                    (*read_iter)->model_name =
-                            m_model_name;  // Before sending read to sink, assign its model name
-                    completed_reads.push_back(*read_iter);
-                    read_iter = m_working_reads.erase(read_iter);
-                } else {
-                    read_iter++;
-                }
+        if (read->basecall_failed) {
+            ++num_reads_failed;
+            if (m_on_read_dropped) {
+                m_on_read_dropped(*read);
             }
+            continue;
         }
-
-        if (completed_reads.empty()) {
-            std::this_thread::sleep_for(10ms);
+        read->model_name = m_model_name;  // Before sending read to sink, assign its model name
+        // The read was stitched as its chunks were called.  Nothing uses the chunks now, and
+        // the signal and moves are only kept for nodes downstream which use them.
+        std::vector<Chunk>().swap(read->called_chunks);
+        const uint32_t fields_used = m_sink.read_fields_used();
+        if (!(fields_used & ReadFields::RAW_DATA)) {
+            read->release_raw_data();
+        } else if (read->raw_data.is_cuda()) {
+            // Signal scaled on the device comes back to the host for downstream nodes.
+            read->raw_data = read->raw_data.cpu();
         }
-
-        for (auto &read : completed_reads) {
-            utils::stitch_chunks(read);
-            m_sink.push_message(read);
+        if (!(fields_used & ReadFields::MOVES)) {
+            read->moves = utils::MoveTable();
         }
+        // Never waits, since this thread is the only way out for the reads it would wait on.
+        // A read whose basecall takes more than it frees keeps what it had if that won't fit.
+        read->memory_reservation.try_resize(read->host_memory_bytes());
+        m_sink.push_message(std::move(read));
     }
 
+    if (num_reads_failed > 0) {
+        spdlog::error("> Reads dropped since their basecalls failed: {}", num_reads_failed);
+    }
     m_sink.terminate();
 }
 
 void BasecallerNode::basecall_worker_thread(int worker_id) {
-    auto last_chunk_reserve_time = std::chrono::system_clock::now();
+    utils::set_thread_name("basecall");
+    // Keep the worker next to its device, if the runner asks for it.
+    utils::set_thread_affinity(m_model_runners[worker_id]->cpu_affinity());
+
     int batch_size = m_model_runners[worker_id]->batch_size();
+    auto &bucket = m_buckets[m_runner_buckets[worker_id]];
+    const size_t chunk_size = bucket.chunk_size;
+    auto &batch_timeout = m_batch_timeouts[worker_id];
+    // A batch with priority chunks in is called as soon as no more chunks are waiting, rather
+    // than waiting for the batch timeout.
+    bool batch_has_priority = false;
+    auto call_batch = [this, worker_id, &batch_has_priority] {
+        basecall_current_batch(worker_id);
+        batch_has_priority = false;
+    };
     while (true) {
         std::unique_lock<std::mutex> chunks_lock(m_chunks_in_mutex);
 
-        if (m_chunks_in.empty()) {
+        if (!bucket.has_chunks_in()) {
             if (m_terminate_basecaller.load()) {
                 chunks_lock.unlock();  // Not strictly necessary
                 // We dispatch any part-full buffer here to finish basecalling.
                 if (!m_batched_chunks[worker_id].empty()) {
-                    basecall_current_batch(worker_id);
+                    call_batch();
                 }
 
                 {
@@ -173,78 +297,84 @@ void BasecallerNode::basecall_worker_thread(int worker_id) {
                 size_t num_remaining_runners = --m_num_active_model_runners;
 
                 if (num_remaining_runners == 0) {
-                    m_terminate_manager.store(true);
+                    // Every read has been completed, so the manager can finish once it has
+                    // drained the queue.
+                    m_completed_reads.terminate();
                 }
 
                 return;
 
             } else {
-                // There's no chunks available to call at the moment, sleep and try again
-                chunks_lock.unlock();
-
-                auto current_time = std::chrono::system_clock::now();
-                auto delta = std::chrono::duration_cast<std::chrono::milliseconds>(
-                        current_time - last_chunk_reserve_time);
-                if (delta.count() > m_batch_timeout_ms && !m_batched_chunks[worker_id].empty()) {
-                    basecall_current_batch(worker_id);
+                // There's no chunks available to call at the moment.  Call any partial batch
+                // once it's due, otherwise wait for more chunks.
+                if (batch_has_priority ||
+                    batch_timeout.should_call(AdaptiveBatchTimeout::Clock::now())) {
+                    chunks_lock.unlock();
+                    call_batch();
+                } else if (m_batched_chunks[worker_id].empty()) {
+                    m_chunks_added_cv.wait_for(chunks_lock, 100ms);
                 } else {
-                    std::this_thread::sleep_for(100ms);
+                    m_chunks_added_cv.wait_until(chunks_lock, batch_timeout.deadline());
                 }
                 continue;
             }
         }
 
-        // There's chunks to get_scores, so let's add them to our input tensor
-        while (m_batched_chunks[worker_id].size() != batch_size && !m_chunks_in.empty()) {
-            std::shared_ptr<Chunk> chunk = m_chunks_in.front();
-            m_chunks_in.pop_front();
-            chunks_lock.unlock();
-            m_chunks_in_has_space_cv.notify_one();
-
-            // Copy the chunk into the input tensor
-            std::shared_ptr<Read> source_read = chunk->source_read.lock();
-
-            auto input_slice = source_read->raw_data.index(
-                    {Ellipsis, Slice(chunk->input_offset, chunk->input_offset + m_chunk_size)});
-            size_t slice_size;
-            if (input_slice.ndimension() == 1) {
-                slice_size = input_slice.size(0);
-            } else {
-                slice_size = input_slice.sizes()[1];
-            }
-
-            // repeat-pad any non-full chunks
-            // Stereo and Simplex encoding need to be treated differently
-            if (slice_size != m_chunk_size) {
-                if (input_slice.ndimension() == 1) {
-                    auto [n, overhang] = std::div((int)m_chunk_size, (int)slice_size);
-                    input_slice = torch::concat(
-                            {input_slice.repeat({n}),
-                             input_slice.index({Ellipsis, torch::indexing::Slice(0, overhang)})});
-                } else if (input_slice.ndimension() == 2) {
-                    auto [n, overhang] = std::div((int)m_chunk_size, (int)slice_size);
-                    input_slice = torch::concat(
-                            {input_slice.repeat({1, n}),
-                             input_slice.index({Ellipsis, torch::indexing::Slice(0, overhang)})},
-                            1);
-                }
+        // Once there are no more chunks to come, take no more than this runner's share of
+        // what's left, so that slower runners don't hold up the end of the run.
+        size_t max_batch_chunks = batch_size;
+        if (m_terminate_basecaller.load()) {
+            const size_t share = drain_share(worker_id, bucket.num_chunks_in());
+            if (share == 0 && m_batched_chunks[worker_id].empty()) {
+                // Faster runners will finish what's left sooner than this one could.
+                m_chunks_added_cv.wait_for(chunks_lock, 10ms);
+                continue;
             }
+            max_batch_chunks =
+                    std::min(max_batch_chunks, m_batched_chunks[worker_id].size() + share);
+        }
 
-            // Insert the chunk in the input tensor
-            m_model_runners[worker_id]->accept_chunk(
-                    static_cast<int>(m_batched_chunks[worker_id].size()), input_slice);
-
+        // There's chunks to get_scores, so take as many as the batch has room for, then copy
+        // them into the runner's input tensor in one go once the lock is released.
+        const size_t first_new_chunk = m_batched_chunks[worker_id].size();
+        std::vector<ChunkSignal> new_chunks;
+        while (m_batched_chunks[worker_id].size() < max_batch_chunks && bucket.has_chunks_in()) {
+            auto &chunks_in = bucket.priority_chunks_in.empty() ? bucket.chunks_in
+                                                                : bucket.priority_chunks_in;
+            Chunk *chunk = chunks_in.front();
+            chunks_in.pop_front();
+            // The signal is either the read's samples, or a row of samples per feature for
+            // stereo reads.  A chunk overhanging the end of its read is repeat padded.
+            const auto &signal = chunk->source_read->raw_data;
+            const size_t length =
+                    std::min(chunk_size, size_t(signal.size(-1)) - chunk->input_offset);
+            new_chunks.push_back({&signal, chunk->input_offset, length});
             m_batched_chunks[worker_id].push_back(chunk);
-            chunks_lock.lock();
-
-            last_chunk_reserve_time = std::chrono::system_clock::now();
+            batch_has_priority = batch_has_priority || chunk->source_read->is_priority;
         }
-
+        // Under the lock, so that other runners' drain shares see the chunks either still
+        // waiting or batched.
+        m_runner_chunks_batched[worker_id].store(m_batched_chunks[worker_id].size());
         chunks_lock.unlock();
+        m_chunks_in_has_space_cv.notify_all();
 
-        if (m_batched_chunks[worker_id].size() == batch_size) {
-            // Input tensor is full, let's get_scores.
-            basecall_current_batch(worker_id);
+        if (!new_chunks.empty()) {
+            utils::TraceSpan span("add_chunks_to_batch");
+            for (const auto &new_chunk : new_chunks) {
+                bucket.num_padding_samples += chunk_size - new_chunk.length;
+            }
+            // If the signal is in device memory the runner copies it in there.
+            m_model_runners[worker_id]->accept_chunks(static_cast<int>(first_new_chunk),
+                                                       new_chunks);
+            const auto now = AdaptiveBatchTimeout::Clock::now();
+            for (size_t i = 0; i < new_chunks.size(); ++i) {
+                batch_timeout.chunk_added(now);
+            }
+        }
+
+        if (m_batched_chunks[worker_id].size() == max_batch_chunks) {
+            // Input tensor is full, or has all this runner should take, let's get_scores.
+            call_batch();
         }
     }
 }
@@ -252,21 +382,45 @@ void BasecallerNode::basecall_worker_thread(int worker_id) {
 BasecallerNode::BasecallerNode(MessageSink &sink,
                                std::vector<Runner> model_runners,
                                size_t overlap,
-                               int batch_timeout_ms,
+                               int batch_latency_target_ms,
                                std::string model_name,
                                size_t max_reads)
         : MessageSink(max_reads),
           m_sink(sink),
           m_model_runners(std::move(model_runners)),
-          m_chunk_size(m_model_runners.front()->chunk_size()),
           m_overlap(overlap),
           m_model_stride(m_model_runners.front()->model_stride()),
           m_terminate_basecaller(false),
-          m_batch_timeout_ms(batch_timeout_ms),
           m_model_name(std::move(model_name)),
-          m_max_reads(max_reads) {
+          m_max_reads(max_reads),
+          m_completed_reads(max_reads) {
+    for (auto &runner : m_model_runners) {
+        m_chunk_sizes.push_back(runner->chunk_size());
+    }
+    std::sort(m_chunk_sizes.begin(), m_chunk_sizes.end());
+    m_chunk_sizes.erase(std::unique(m_chunk_sizes.begin(), m_chunk_sizes.end()),
+                        m_chunk_sizes.end());
+
+    // Allow 5 batches per model runner on each chunks_in queue
+    // Allows optimal batch size to be used for every GPU
+    m_buckets = std::vector<ChunkBucket>(m_chunk_sizes.size());
+    for (size_t i = 0; i < m_chunk_sizes.size(); ++i) {
+        m_buckets[i].chunk_size = m_chunk_sizes[i];
+    }
+    for (auto &runner : m_model_runners) {
+        m_runner_buckets.push_back(bucket_index(runner->chunk_size()));
+        m_buckets[m_runner_buckets.back()].max_chunks_in += runner->batch_size() * 5;
+    }
+
     // Setup worker state
     size_t const num_workers = m_model_runners.size();
+    for (size_t i = 0; i < num_workers; ++i) {
+        m_batch_timeouts.emplace_back(std::chrono::milliseconds(batch_latency_target_ms));
+    }
+    m_runner_throughputs = std::vector<std::atomic<float>>(num_workers);
+    m_runner_chunks_batched = std::vector<std::atomic<size_t>>(num_workers);
+    m_runner_chunks_called = std::vector<std::atomic<int64_t>>(num_workers);
+    m_runner_batches_called = std::vector<std::atomic<int64_t>>(num_workers);
     m_batched_chunks.resize(num_workers);
     m_basecall_workers.resize(num_workers);
     m_num_active_model_runners = num_workers;
@@ -289,6 +443,74 @@ BasecallerNode::~BasecallerNode() {
     }
     m_working_reads_manager->join();
     termination_time = std::chrono::system_clock::now();
+    log_chunk_stats();
+}
+
+void BasecallerNode::add_metrics(utils::MetricsRegistry &registry,
+                                 const std::string &kind) const {
+    using Type = utils::MetricsRegistry::Type;
+    for (size_t i = 0; i < m_model_runners.size(); ++i) {
+        const auto &runner = m_model_runners[i];
+        const std::string labels = "kind=\"" + kind + "\",runner=\"" + std::to_string(i) +
+                                   "\",device=\"" + runner->device() + "\",chunk_size=\"" +
+                                   std::to_string(runner->chunk_size()) + "\"";
+        const auto chunk_size = static_cast<double>(runner->chunk_size());
+        const auto batch_size = static_cast<double>(runner->batch_size());
+        registry.add("dorado_basecaller_chunks_total", "Chunks called by each runner.",
+                     Type::COUNTER, [this, i] { return m_runner_chunks_called[i].load(); },
+                     labels);
+        // Over the same interval, chunks over batch slots is how full batches were.
+        registry.add("dorado_basecaller_batch_slots_total",
+                     "Chunks the batches each runner called had room for.", Type::COUNTER,
+                     [this, i, batch_size] {
+                         return m_runner_batches_called[i].load() * batch_size;
+                     },
+                     labels);
+        registry.add("dorado_basecaller_called_samples_total",
+                     "Samples in the chunks called by each runner, including padding and "
+                     "overlap.",
+                     Type::COUNTER,
+                     [this, i, chunk_size] {
+                         return m_runner_chunks_called[i].load() * chunk_size;
+                     },
+                     labels);
+        registry.add("dorado_basecaller_runner_chunks_per_second",
+                     "Running mean of each runner's throughput in full batches.", Type::GAUGE,
+                     [this, i] { return m_runner_throughputs[i].load(); }, labels);
+    }
+}
+
+void BasecallerNode::log_chunk_stats() const {
+    // Only worth reporting by default if there's a trade-off being made.
+    const auto level = m_buckets.size() > 1 ? spdlog::level::info : spdlog::level::debug;
+    int64_t num_called_samples = 0;
+    for (const auto &bucket : m_buckets) {
+        const int64_t bucket_samples = bucket.num_chunks_called * bucket.chunk_size;
+        num_called_samples += bucket_samples;
+        spdlog::log(level, "> Chunk size {}: {} chunks called, {:.1f}% padding",
+                    bucket.chunk_size, bucket.num_chunks_called.load(),
+                    bucket_samples ? 100.0 * bucket.num_padding_samples / bucket_samples : 0.0);
+    }
+    // What's left over is either padding or signal called twice in the overlap of chunks.
+    if (m_num_signal_samples > 0) {
+        spdlog::log(level, "> Samples called: {} for {} samples of signal, {:.1f}% overhead",
+                    num_called_samples, m_num_signal_samples.load(),
+                    100.0 * (num_called_samples - m_num_signal_samples) / m_num_signal_samples);
+    }
+
+    LatencyHistogram batch_latencies;
+    for (const auto &batch_timeout : m_batch_timeouts) {
+        batch_latencies.merge(batch_timeout.batch_latencies());
+    }
+    if (batch_latencies.count() > 0) {
+        spdlog::debug("> Batch latency: median {:.0f}ms, p99 {:.0f}ms over {} batches",
+                      batch_latencies.quantile(0.5f), batch_latencies.quantile(0.99f),
+                      batch_latencies.count());
+    }
+
+    for (size_t i = 0; i < m_model_runners.size(); ++i) {
+        spdlog::debug("> Runner {}: {:.0f} chunks/s", i, m_runner_throughputs[i].load());
+    }
 }
 
 }  // namespace dorado
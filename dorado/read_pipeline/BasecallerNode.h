@@ -1,20 +1,45 @@
 #pragma once
 #include "../nn/ModelRunner.h"
+#include "BatchTimeout.h"
 #include "ReadPipeline.h"
 
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
 namespace dorado {
 
+namespace utils {
+class MetricsRegistry;
+}
+
 class BasecallerNode : public MessageSink {
 public:
-    // Chunk size and overlap are in raw samples
+    // Overlap is in raw samples.  Runners may have different chunk sizes, in which case
+    // reads are called in chunks of the largest size, with short reads and the ends of reads
+    // going to runners of the smallest size which fits them rather than being padded.
+    // Partial batches are called so that chunks are called within batch_latency_target_ms
+    // of joining a batch, or sooner if chunks stop arriving.
     BasecallerNode(MessageSink &sink,
                    std::vector<Runner> model_runners,
                    size_t overlap,
-                   int batch_timeout_ms,
+                   int batch_latency_target_ms,
                    std::string model_name = "",
                    size_t max_reads = 1000);
     ~BasecallerNode();
 
+    // Adds each runner's chunks called and batch slots filled so far to registry, labelled
+    // with kind to tell them from another basecaller's, e.g. the stereo one of duplex.
+    void add_metrics(utils::MetricsRegistry &registry, const std::string &kind = "simplex") const;
+
+    // Called with each read dropped as its basecall failed, e.g. for a ReorderNode to skip it.
+    // Must be set before any reads are pushed.
+    void set_on_read_dropped(std::function<void(const Read &)> on_dropped) {
+        m_on_read_dropped = std::move(on_dropped);
+    }
+
 private:
     // Consume reads from input queue
     void input_worker_thread();
@@ -22,22 +47,55 @@ private:
     void basecall_worker_thread(int worker_id);
     // Basecall batch of chunks
     void basecall_current_batch(int worker_id);
+    // Hands a read whose chunks have all been called to working_reads_manager
+    void complete_read(Read *read);
     // Construct complete reads
     void working_reads_manager();
+    // Once all chunks have been queued, how many of the num_remaining chunks in a runner's
+    // bucket it should add to its batch, so that it's called its share, in proportion to its
+    // measured throughput, of those and the chunks already batched.  Returns 0 if faster
+    // runners would be done with all of them before it could call a batch.
+    size_t drain_share(int worker_id, size_t num_remaining) const;
+    // Index into m_buckets of the bucket for chunks of chunk_size.
+    size_t bucket_index(size_t chunk_size) const;
+    // Log how much of the signal passed to the runners was padding or overlap, how long
+    // batches took to be called, and how fast each runner was.
+    void log_chunk_stats() const;
+
+    // Runners of one chunk size, and the chunks waiting for them.
+    struct ChunkBucket {
+        size_t chunk_size{0};
+        // Most chunks allowed to wait in each of chunks_in and priority_chunks_in.
+        size_t max_chunks_in{0};
+        // Gets filled with chunks from the input reads.  The chunks are owned by the reads
+        // in m_working_reads.
+        std::deque<Chunk *> chunks_in;
+        // Chunks of priority reads, which are batched ahead of those in chunks_in.
+        std::deque<Chunk *> priority_chunks_in;
+
+        bool has_chunks_in() const { return !chunks_in.empty() || !priority_chunks_in.empty(); }
+        size_t num_chunks_in() const { return chunks_in.size() + priority_chunks_in.size(); }
+        // The queue for chunks of read.
+        std::deque<Chunk *> &chunks_in_for(const Read &read) {
+            return read.is_priority ? priority_chunks_in : chunks_in;
+        }
+
+        std::atomic<int64_t> num_chunks_called{0};
+        // Repeat padded samples, in chunks overhanging the end of their read.
+        std::atomic<int64_t> num_padding_samples{0};
+    };
 
     MessageSink &m_sink;
     // Vector of model runners (each with their own GPU access etc)
     std::vector<Runner> m_model_runners;
-    // Chunk length
-    size_t m_chunk_size;
+    // Chunk sizes of the runners, ascending.
+    std::vector<size_t> m_chunk_sizes;
     // Minimum overlap between two adjacent chunks in a read. Overlap is used to reduce edge effects and improve accuracy.
     size_t m_overlap;
     // Stride of the model in the runners
     size_t m_model_stride;
-    // Time in milliseconds before partial batches are called.
-    int m_batch_timeout_ms;
     // model_name
-    std::string m_model_name;
+    utils::InternedString m_model_name;
     // max reads
     size_t m_max_reads;
 
@@ -45,25 +103,44 @@ private:
     std::atomic<int> m_num_active_model_runners{0};
 
     std::atomic<bool> m_terminate_basecaller{false};
-    std::atomic<bool> m_terminate_manager{false};
 
     // Time when Basecaller Node is initialised. Used for benchmarking and debugging
     std::chrono::time_point<std::chrono::system_clock> initialization_time;
     // Time when Basecaller Node terminates. Used for benchmarking and debugging
     std::chrono::time_point<std::chrono::system_clock> termination_time;
-    // Signalled when there is space in m_chunks_in
+    // Signalled when there is space in a bucket's chunks_in
     std::condition_variable m_chunks_in_has_space_cv;
-    // Global chunk input list
+    // Signalled when chunks are added to any bucket's chunks_in, or there are no more
+    std::condition_variable m_chunks_added_cv;
+    // Guards the chunk input lists of every bucket
     std::mutex m_chunks_in_mutex;
-    // Gets filled with chunks from the input reads
-    std::deque<std::shared_ptr<Chunk>> m_chunks_in;
+    // One per chunk size, indexed as m_chunk_sizes.
+    std::vector<ChunkBucket> m_buckets;
+    // Index into m_buckets of each model runner's chunk size.
+    std::vector<size_t> m_runner_buckets;
+    // Raw samples in the reads which have been chunked.
+    std::atomic<int64_t> m_num_signal_samples{0};
 
     std::mutex m_working_reads_mutex;
-    // Reads removed from input queue and being basecalled.
-    std::deque<std::shared_ptr<Read>> m_working_reads;
+    // Reads removed from input queue and being basecalled, keyed by address so that
+    // chunks can find their owning pointer.
+    std::unordered_map<Read *, std::shared_ptr<Read>> m_working_reads;
+    // Reads whose chunks have all been called, waiting to be stitched.
+    LockFreeQueue<std::shared_ptr<Read>> m_completed_reads;
 
     // If we go multi-threaded, there will be one of these batches per thread
-    std::vector<std::deque<std::shared_ptr<Chunk>>> m_batched_chunks;
+    std::vector<std::deque<Chunk *>> m_batched_chunks;
+    // When to call each runner's partial batch.
+    std::vector<AdaptiveBatchTimeout> m_batch_timeouts;
+    // Running mean of each runner's throughput in chunks per second, if it has called a
+    // batch yet, or 0.
+    std::vector<std::atomic<float>> m_runner_throughputs;
+    // Chunks in each runner's batch, being filled or called.
+    std::vector<std::atomic<size_t>> m_runner_chunks_batched;
+    // Chunks each runner has called, and batches it has called them in.
+    std::vector<std::atomic<int64_t>> m_runner_chunks_called;
+    std::vector<std::atomic<int64_t>> m_runner_batches_called;
+    std::function<void(const Read &)> m_on_read_dropped;
 
     // Class members are initialised in declaration order regardless of initialiser list order.
     // Class data members whose construction launches threads must therefore have their
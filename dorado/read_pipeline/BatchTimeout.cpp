@@ -0,0 +1,96 @@
+#include "BatchTimeout.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace dorado {
+
+namespace {
+
+AdaptiveBatchTimeout::Clock::duration update_mean(AdaptiveBatchTimeout::Clock::duration mean,
+                                                  AdaptiveBatchTimeout::Clock::duration sample) {
+    if (mean.count() == 0) {
+        return sample;
+    }
+    return std::chrono::duration_cast<AdaptiveBatchTimeout::Clock::duration>(
+            mean * (1.f - AdaptiveBatchTimeout::kSmoothing) +
+            sample * AdaptiveBatchTimeout::kSmoothing);
+}
+
+}  // namespace
+
+void LatencyHistogram::add(float latency_ms) {
+    int bucket = 0;
+    if (latency_ms > kMinLatencyMs) {
+        bucket = static_cast<int>(std::log2(latency_ms / kMinLatencyMs) * kBucketsPerDoubling);
+    }
+    ++m_buckets[std::clamp(bucket, 0, kNumBuckets - 1)];
+    ++m_count;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (int i = 0; i < kNumBuckets; ++i) {
+        m_buckets[i] += other.m_buckets[i];
+    }
+    m_count += other.m_count;
+}
+
+float LatencyHistogram::quantile(float q) const {
+    if (m_count == 0) {
+        return 0.f;
+    }
+    const auto rank = static_cast<uint64_t>(q * (m_count - 1));
+    uint64_t seen = 0;
+    int bucket = 0;
+    for (; bucket < kNumBuckets - 1; ++bucket) {
+        seen += m_buckets[bucket];
+        if (seen > rank) {
+            break;
+        }
+    }
+    // The geometric middle of the bucket.
+    return kMinLatencyMs * std::exp2((bucket + 0.5f) / kBucketsPerDoubling);
+}
+
+AdaptiveBatchTimeout::AdaptiveBatchTimeout(std::chrono::milliseconds latency_target)
+        : m_latency_target(latency_target) {}
+
+void AdaptiveBatchTimeout::chunk_added(Clock::time_point now) {
+    if (m_have_last_arrival) {
+        m_mean_arrival_interval = update_mean(m_mean_arrival_interval, now - m_last_arrival);
+    }
+    if (m_batch_size++ == 0) {
+        m_first_arrival = now;
+    }
+    m_last_arrival = now;
+    m_have_last_arrival = true;
+}
+
+void AdaptiveBatchTimeout::batch_called(Clock::time_point call_start, Clock::time_point call_end) {
+    if (m_batch_size == 0) {
+        return;
+    }
+    m_mean_call_time = update_mean(m_mean_call_time, call_end - call_start);
+    m_batch_latencies.add(
+            std::chrono::duration<float, std::milli>(call_end - m_first_arrival).count());
+    m_batch_size = 0;
+    // Chunks which turned up while the batch was being called were just waiting for the
+    // runner, so the gap since the last arrival says nothing about the arrival rate.
+    m_last_arrival = call_end;
+}
+
+AdaptiveBatchTimeout::Clock::time_point AdaptiveBatchTimeout::deadline() const {
+    const Clock::duration max_wait = std::max<Clock::duration>(
+            m_latency_target - m_mean_call_time, kMinTimeout);
+    // Until there's an arrival rate to go on, nothing says more chunks aren't coming.
+    Clock::duration stall_timeout = max_wait;
+    if (m_mean_arrival_interval.count() != 0) {
+        stall_timeout = std::clamp<Clock::duration>(
+                std::chrono::duration_cast<Clock::duration>(m_mean_arrival_interval *
+                                                            kStallIntervals),
+                kMinTimeout, max_wait);
+    }
+    return std::min(m_first_arrival + max_wait, m_last_arrival + stall_timeout);
+}
+
+}  // namespace dorado
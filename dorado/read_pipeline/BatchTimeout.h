@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+namespace dorado {
+
+// Counts of latencies in buckets which grow geometrically, so that quantiles are known to a
+// few percent in constant space however long the run.
+class LatencyHistogram {
+public:
+    // Latencies below this all go in the first bucket.
+    static constexpr float kMinLatencyMs = 1.f;
+    static constexpr int kBucketsPerDoubling = 8;
+    // Up to kMinLatencyMs * 2^24, over 4 hours, with anything longer in the last bucket.
+    static constexpr int kNumBuckets = 24 * kBucketsPerDoubling;
+
+    void add(float latency_ms);
+    void merge(const LatencyHistogram& other);
+
+    uint64_t count() const { return m_count; }
+    // The latency at quantile q, from 0 to 1, to within a bucket.  0 if nothing was added.
+    float quantile(float q) const;
+
+private:
+    std::array<uint64_t, kNumBuckets> m_buckets{};
+    uint64_t m_count{0};
+};
+
+// Decides when a model runner should call a partial batch, from the rate at which chunks
+// have been arriving at it.  A partial batch is called once either
+//  - no chunk has arrived for several of the typical intervals between chunks, so more
+//    aren't coming soon, e.g. at the end of the input, or
+//  - its oldest chunk has waited as long as the latency target allows, after leaving
+//    time for the batch itself to be called.
+// Steady but slow arrivals, as when basecalling live, therefore fill batches for as long
+// as latency allows rather than being called a few chunks at a time, and bursts which
+// stop are called almost immediately rather than waiting out a fixed timeout.
+class AdaptiveBatchTimeout {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Shortest pause in arrivals after which a partial batch is called.
+    static constexpr std::chrono::milliseconds kMinTimeout{5};
+    // A pause of this many mean inter-arrival intervals means arrivals have stopped.
+    static constexpr float kStallIntervals = 4.f;
+    // Weight of the newest sample in the running means.
+    static constexpr float kSmoothing = 0.1f;
+
+    // latency_target is the time a chunk should take from joining a batch to having
+    // been called.
+    explicit AdaptiveBatchTimeout(std::chrono::milliseconds latency_target);
+
+    // A chunk was added to the current batch.
+    void chunk_added(Clock::time_point now);
+    // The current batch, which was called between call_start and call_end, is finished.
+    void batch_called(Clock::time_point call_start, Clock::time_point call_end);
+
+    // If a partial batch is waiting, the time at which it should be called.
+    Clock::time_point deadline() const;
+    bool should_call(Clock::time_point now) const { return m_batch_size > 0 && now >= deadline(); }
+
+    // Time from the first chunk of each batch being added to the batch being called.
+    const LatencyHistogram& batch_latencies() const { return m_batch_latencies; }
+
+private:
+    const Clock::duration m_latency_target;
+    // Running means, or zero before there's anything to go on.
+    Clock::duration m_mean_arrival_interval{0};
+    Clock::duration m_mean_call_time{0};
+
+    int m_batch_size{0};
+    Clock::time_point m_first_arrival;
+    Clock::time_point m_last_arrival;
+    // Whether m_last_arrival is set, since the first arrival has no interval.
+    bool m_have_last_arrival{false};
+
+    LatencyHistogram m_batch_latencies;
+};
+
+}  // namespace dorado
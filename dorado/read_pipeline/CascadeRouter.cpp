@@ -0,0 +1,89 @@
+#include "CascadeRouter.h"
+
+#include "utils/sequence_utils.h"
+
+#include <spdlog/spdlog.h>
+
+#include <utility>
+
+namespace dorado {
+
+bool CascadePolicy::recall(const Read& read) const {
+    if (read_list && read_list->contains(read.read_id)) {
+        return true;
+    }
+    if (max_qscore <= 0.f && min_length == 0) {
+        return false;
+    }
+    // The length is checked first, as it's free.
+    return read.seq.size() >= min_length &&
+           (max_qscore <= 0.f || utils::mean_qscore_from_qstring(read.qstring) < max_qscore);
+}
+
+CascadeRouter::CascadeRouter(MessageSink& sink, MessageSink& recall_sink, CascadePolicy policy)
+        : MessageSink(1), m_sink(sink), m_recall_sink(recall_sink), m_policy(std::move(policy)) {}
+
+CascadeRouter::~CascadeRouter() {
+    // Ensure downstream sinks aren't left waiting if an upstream node didn't terminate us.
+    terminate();
+}
+
+MessageSink& CascadeRouter::route(Message& message) {
+    if (!std::holds_alternative<std::shared_ptr<Read>>(message)) {
+        return m_sink;
+    }
+    auto& read = *std::get<std::shared_ptr<Read>>(message);
+    ++m_num_reads_in;
+    if (m_policy.recall(read)) {
+        ++m_num_reads_recalled;
+        // The BasecallerNode passes on reads which already have a call.
+        read.seq.clear();
+        read.qstring.clear();
+        read.moves = utils::MoveTable();
+        return m_recall_sink;
+    }
+    // As the BasecallerNode would have, had it been sending the read here.
+    const uint32_t fields_used = m_sink.read_fields_used();
+    if (!(fields_used & ReadFields::RAW_DATA)) {
+        read.release_raw_data();
+    }
+    if (!(fields_used & ReadFields::MOVES)) {
+        read.moves = utils::MoveTable();
+    }
+    read.memory_reservation.try_resize(read.host_memory_bytes());
+    return m_sink;
+}
+
+void CascadeRouter::push_message(Message&& message) {
+    route(message).push_message(std::move(message));
+}
+
+void CascadeRouter::push_messages(std::vector<Message>&& messages) {
+    // Forward runs of messages bound for the same sink as a single batch, preserving order.
+    std::vector<Message> run;
+    MessageSink* run_destination = nullptr;
+    for (auto& message : messages) {
+        MessageSink* sink = &route(message);
+        if (sink != run_destination && !run.empty()) {
+            run_destination->push_messages(std::move(run));
+        }
+        run_destination = sink;
+        run.push_back(std::move(message));
+    }
+    if (!run.empty()) {
+        run_destination->push_messages(std::move(run));
+    }
+    messages.clear();
+}
+
+void CascadeRouter::terminate() {
+    if (m_terminated.exchange(true)) {
+        return;
+    }
+    spdlog::info("> Re-called {} of {} reads with the accurate model", m_num_reads_recalled.load(),
+                 m_num_reads_in.load());
+    m_sink.terminate();
+    m_recall_sink.terminate();
+}
+
+}  // namespace dorado
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "ReadPipeline.h"
+#include "utils/ReadIdSet.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace dorado {
+
+// Which reads first called with a fast model are called again with an accurate one.  A read is
+// re-called if it's in read_list, or if its first call meets every other criterion set.  At
+// least one must be set.
+struct CascadePolicy {
+    // Reads with a mean Q score below this, or 0 for any Q score.
+    float max_qscore{0.f};
+    // Reads of at least this many bases, or 0 for any length.
+    size_t min_length{0};
+    // Reads re-called whatever their first call, e.g. those from target regions.
+    std::optional<utils::ReadIdSet> read_list;
+
+    bool is_set() const { return max_qscore > 0.f || min_length > 0 || read_list.has_value(); }
+    bool recall(const Read& read) const;
+};
+
+// Sits between the BasecallerNode of a fast model and the rest of the pipeline, sending the
+// reads the policy picks to the BasecallerNode of an accurate model instead, with their calls
+// cleared.  The rest go on as they are, so only each read's final call goes downstream, to
+// which both this and the accurate model's BasecallerNode should send reads through
+// MessageRouters.  The two models' runners share the devices as any others do.  Like a
+// MessageRouter, reads are forwarded directly, without a queue or worker thread of its own.
+// Terminating the router terminates both sinks.
+class CascadeRouter : public MessageSink {
+public:
+    CascadeRouter(MessageSink& sink, MessageSink& recall_sink, CascadePolicy policy);
+    ~CascadeRouter();
+
+    void push_message(Message&& message) override;
+    void push_messages(std::vector<Message>&& messages) override;
+    // Only the first call has an effect.
+    void terminate() override;
+    // The signal is kept for the reads to be re-called.
+    uint32_t read_fields_used() const override {
+        return ReadFields::RAW_DATA | m_sink.read_fields_used() | m_recall_sink.read_fields_used();
+    }
+
+    int64_t num_reads_recalled() const { return m_num_reads_recalled.load(); }
+
+private:
+    // The sink for message, with the read in it made ready for it.
+    MessageSink& route(Message& message);
+
+    MessageSink& m_sink;
+    MessageSink& m_recall_sink;
+    const CascadePolicy m_policy;
+    std::atomic<bool> m_terminated{false};
+
+    std::atomic<int64_t> m_num_reads_in{0};
+    std::atomic<int64_t> m_num_reads_recalled{0};
+};
+
+}  // namespace dorado
@@ -4,12 +4,15 @@
 #include "utils/duplex_utils.h"
 #include "utils/read_utils.h"
 #include "utils/sequence_utils.h"
+#include "utils/thread_utils.h"
 #include "utils/time_utils.h"
 #include "utils/uuid_utils.h"
 
 #include <openssl/sha.h>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <array>
 #include <chrono>
 #include <cmath>
 #include <iomanip>
@@ -45,44 +48,79 @@ PosRanges merge_ranges(const PosRanges& ranges, size_t merge_dist) {
     return merged;
 }
 
-std::vector<std::pair<size_t, size_t>> detect_pore_signal(const torch::Tensor& signal,
-                                                          float threshold,
-                                                          size_t cluster_dist,
-                                                          size_t ignore_prefix) {
-    std::vector<std::pair<size_t, size_t>> ans;
-    auto pore_a = signal.accessor<float, 1>();
-    int64_t cl_start = -1;
-    int64_t cl_end = -1;
-
-    for (size_t i = ignore_prefix; i < pore_a.size(0); i++) {
-        if (pore_a[i] > threshold) {
-            //check if we need to start new cluster
-            if (cl_end == -1 || i > cl_end + cluster_dist) {
-                //report previous cluster
-                if (cl_end != -1) {
-                    assert(cl_start != -1);
-                    ans.push_back({cl_start, cl_end});
+//finds clusters of samples above each of thresholds, in a single pass over the fp16 signal
+//clusters come back in the order of thresholds
+std::vector<std::vector<std::pair<size_t, size_t>>> detect_pore_signal(
+        const torch::Tensor& signal,
+        const std::vector<float>& thresholds,
+        size_t cluster_dist,
+        size_t ignore_prefix) {
+    assert(signal.dtype() == torch::kFloat16 && signal.is_contiguous());
+    const auto* const samples = static_cast<const c10::Half*>(signal.data_ptr());
+    const size_t num_samples = signal.size(0);
+    const size_t num_thresholds = thresholds.size();
+    const float min_threshold = *std::min_element(thresholds.begin(), thresholds.end());
+
+    std::vector<std::vector<std::pair<size_t, size_t>>> ans(num_thresholds);
+    std::vector<int64_t> cl_start(num_thresholds, -1);
+    std::vector<int64_t> cl_end(num_thresholds, -1);
+
+    //pore signal is rare, so blocks are converted and checked against the lowest threshold in
+    //loops the compiler can vectorise, and only blocks with a sample above it are looked at
+    //sample by sample
+    constexpr size_t kBlockSize = 64;
+    std::array<float, kBlockSize> block;
+    for (size_t block_start = ignore_prefix; block_start < num_samples;
+         block_start += kBlockSize) {
+        const size_t block_size = std::min(kBlockSize, num_samples - block_start);
+        int num_above = 0;
+        for (size_t j = 0; j < block_size; j++) {
+            block[j] = static_cast<float>(samples[block_start + j]);
+            num_above += block[j] > min_threshold;
+        }
+        if (num_above == 0) {
+            continue;
+        }
+
+        for (size_t j = 0; j < block_size; j++) {
+            const size_t i = block_start + j;
+            for (size_t k = 0; k < num_thresholds; k++) {
+                if (block[j] > thresholds[k]) {
+                    //check if we need to start new cluster
+                    if (cl_end[k] == -1 || i > cl_end[k] + cluster_dist) {
+                        //report previous cluster
+                        if (cl_end[k] != -1) {
+                            assert(cl_start[k] != -1);
+                            ans[k].push_back({cl_start[k], cl_end[k]});
+                        }
+                        cl_start[k] = i;
+                    }
+                    cl_end[k] = i + 1;
                 }
-                cl_start = i;
             }
-            cl_end = i + 1;
         }
     }
-    //report last cluster
-    if (cl_end != -1) {
-        assert(cl_start != -1);
-        assert(cl_start < pore_a.size(0) && cl_end <= pore_a.size(0));
-        ans.push_back(std::pair{cl_start, cl_end});
+    //report last clusters
+    for (size_t k = 0; k < num_thresholds; k++) {
+        if (cl_end[k] != -1) {
+            assert(cl_start[k] != -1);
+            assert(cl_start[k] < num_samples && cl_end[k] <= num_samples);
+            ans[k].push_back(std::pair{cl_start[k], cl_end[k]});
+        }
     }
 
     return ans;
 }
 
-//[start, end)
-std::optional<PosRange> find_best_adapter_match(const std::string& adapter,
-                                                const std::string& seq,
-                                                int dist_thr,
-                                                PosRange subrange) {
+struct AdapterMatch {
+    PosRange range;  //[start, end)
+    int edist;
+};
+
+std::optional<AdapterMatch> find_best_adapter_alignment(const std::string& adapter,
+                                                        const std::string& seq,
+                                                        int dist_thr,
+                                                        PosRange subrange) {
     assert(subrange.first <= subrange.second && subrange.second <= seq.size());
     auto shift = subrange.first;
     auto span = subrange.second - subrange.first;
@@ -95,15 +133,28 @@ std::optional<PosRange> find_best_adapter_match(const std::string& adapter,
     auto edlib_result =
             edlibAlign(adapter.c_str(), adapter.size(), seq.c_str() + shift, span, edlib_cfg);
     assert(edlib_result.status == EDLIB_STATUS_OK);
-    std::optional<PosRange> res = std::nullopt;
+    std::optional<AdapterMatch> res = std::nullopt;
     if (edlib_result.status == EDLIB_STATUS_OK && edlib_result.editDistance != -1) {
         assert(edlib_result.editDistance <= dist_thr);
-        res = {edlib_result.startLocations[0] + shift, edlib_result.endLocations[0] + shift + 1};
+        res = AdapterMatch{{edlib_result.startLocations[0] + shift,
+                            edlib_result.endLocations[0] + shift + 1},
+                           edlib_result.editDistance};
     }
     edlibFreeAlignResult(edlib_result);
     return res;
 }
 
+//[start, end)
+std::optional<PosRange> find_best_adapter_match(const std::string& adapter,
+                                                const std::string& seq,
+                                                int dist_thr,
+                                                PosRange subrange) {
+    if (auto match = find_best_adapter_alignment(adapter, seq, dist_thr, subrange)) {
+        return match->range;
+    }
+    return std::nullopt;
+}
+
 //currently just finds a single best match
 //TODO efficiently find more matches
 std::vector<PosRange> find_adapter_matches(const std::string& adapter,
@@ -121,7 +172,8 @@ std::vector<PosRange> find_adapter_matches(const std::string& adapter,
 }
 
 //semi-global alignment of "template region" to "complement region"
-bool check_rc_match(const std::string& seq, PosRange templ_r, PosRange compl_r, int dist_thr) {
+//returns the edit distance, or -1 if it's over dist_thr
+int rc_match_edist(const std::string& seq, PosRange templ_r, PosRange compl_r, int dist_thr) {
     assert(templ_r.second > templ_r.first);
     assert(compl_r.second > compl_r.first);
     assert(dist_thr >= 0);
@@ -135,11 +187,15 @@ bool check_rc_match(const std::string& seq, PosRange templ_r, PosRange compl_r,
                                    rc_compl.c_str(), rc_compl.size(), edlib_cfg);
     assert(edlib_result.status == EDLIB_STATUS_OK);
 
-    bool match = (edlib_result.status == EDLIB_STATUS_OK) && (edlib_result.editDistance != -1);
-    assert(!match || edlib_result.editDistance <= dist_thr);
+    const int edist = edlib_result.status == EDLIB_STATUS_OK ? edlib_result.editDistance : -1;
+    assert(edist <= dist_thr);
 
     edlibFreeAlignResult(edlib_result);
-    return match;
+    return edist;
+}
+
+bool check_rc_match(const std::string& seq, PosRange templ_r, PosRange compl_r, int dist_thr) {
+    return rc_match_edist(seq, templ_r, compl_r, dist_thr) != -1;
 }
 
 //TODO end_reason access?
@@ -160,12 +216,14 @@ std::shared_ptr<Read> subread(const Read& read, PosRange seq_range, PosRange sig
     assert(signal_range.second % stride == 0 ||
            (signal_range.second == read.raw_data.size(0) && seq_range.second == read.seq.size()));
 
-    auto subread = utils::shallow_copy_read(read);
+    // Only the subread's part of the basecall is copied, rather than all of the read's, which
+    // would be held by every subread at once.  The signal is a view of the read's.
+    auto subread = utils::copy_read_metadata(read);
 
     const auto subread_id = utils::derive_uuid(
             read.read_id, std::to_string(seq_range.first) + "-" + std::to_string(seq_range.second));
     subread->read_id = subread_id;
-    subread->raw_data = subread->raw_data.index(
+    subread->raw_data = read.raw_data.index(
             {torch::indexing::Slice(signal_range.first, signal_range.second)});
     subread->attributes.read_number = -1;
 
@@ -178,10 +236,9 @@ std::shared_ptr<Read> subread(const Read& read, PosRange seq_range, PosRange sig
     //we adjust for it in new start time above
     subread->num_trimmed_samples = 0;
 
-    subread->seq = subread->seq.substr(seq_range.first, seq_range.second - seq_range.first);
-    subread->qstring = subread->qstring.substr(seq_range.first, seq_range.second - seq_range.first);
-    subread->moves = std::vector<uint8_t>(subread->moves.begin() + signal_range.first / stride,
-                                          subread->moves.begin() + signal_range.second / stride);
+    subread->seq = read.seq.substr(seq_range.first, seq_range.second - seq_range.first);
+    subread->qstring = read.qstring.substr(seq_range.first, seq_range.second - seq_range.first);
+    subread->moves = read.moves.slice(signal_range.first / stride, signal_range.second / stride);
     assert(signal_range.second == read.raw_data.size(0) ||
            subread->moves.size() * stride == subread->raw_data.size(0));
 
@@ -193,45 +250,71 @@ std::shared_ptr<Read> subread(const Read& read, PosRange seq_range, PosRange sig
     return subread;
 }
 
+//whether region r has a match within dist_thr edits, from an earlier check of it where that
+//decides it: a match found within a smaller threshold, or the best match found within a larger
+//one. otherwise align(dist_thr) checks it again, so each check runs at its own threshold
+template <typename RegionChecks, typename AlignF>
+bool check_region(RegionChecks& checks, PosRange r, int dist_thr, AlignF&& align) {
+    auto [check, inserted] = checks.try_emplace(r);
+    auto& checked = check->second;
+    if (inserted || (checked.edist == -1 && checked.dist_thr < dist_thr)) {
+        checked.edist = align(dist_thr);
+        checked.dist_thr = dist_thr;
+    }
+    return checked.edist != -1 && checked.edist <= dist_thr;
+}
+
 }  // namespace
 
 namespace dorado {
 
-DuplexSplitNode::ExtRead::ExtRead(std::shared_ptr<Read> r)
-        : read(std::move(r)),
-          data_as_float32(read->raw_data.to(torch::kFloat)),
-          move_sums(utils::move_cum_sums(read->moves)) {
-    assert(!move_sums.empty());
-    assert(move_sums.back() == read->seq.length());
+DuplexSplitNode::ExtRead::ExtRead(std::shared_ptr<Read> r, const DuplexSplitSettings& settings)
+        : read(std::move(r)) {
+    assert(!read->moves.empty());
+    assert(read->moves.count() == read->seq.length());
+
+    //pA formula before scaling:
+    //pA = read->scaling * (raw + read->offset);
+    //pA formula after scaling:
+    //pA = read->scale * raw + read->shift
+    const std::vector<float> pore_thresholds{settings.pore_thr, settings.relaxed_pore_thr};
+    std::vector<float> raw_thresholds;
+    for (auto pore_thr : pore_thresholds) {
+        raw_thresholds.push_back((pore_thr - read->shift) / read->scale);
+    }
+    //no copy if the signal is already contiguous fp16, as it is coming from basecalling
+    auto pore_sample_ranges = detect_pore_signal(
+            read->raw_data.to(torch::kFloat16).contiguous(), raw_thresholds,
+            settings.pore_cl_dist, settings.expect_pore_prefix);
+    for (size_t k = 0; k < pore_thresholds.size(); k++) {
+        pore_sample_ranges_by_thr[pore_thresholds[k]] = std::move(pore_sample_ranges[k]);
+    }
 }
 
 PosRanges DuplexSplitNode::possible_pore_regions(const DuplexSplitNode::ExtRead& read,
                                                  float pore_thr) const {
     PosRanges pore_regions;
 
-    //pA formula before scaling:
-    //pA = read->scaling * (raw + read->offset);
-    //pA formula after scaling:
-    //pA = read->scale * raw + read->shift
     spdlog::trace("Analyzing signal in read {}", read.read->read_id);
 
-    auto pore_sample_ranges = detect_pore_signal(
-            read.data_as_float32, (pore_thr - read.read->shift) / read.read->scale,
-            m_settings.pore_cl_dist, m_settings.expect_pore_prefix);
+    //signal was scanned for every threshold when the read was extended
+    const auto& pore_sample_ranges = read.pore_sample_ranges_by_thr.at(pore_thr);
 
     for (auto pore_sample_range : pore_sample_ranges) {
         auto move_start = pore_sample_range.first / read.read->model_stride;
         auto move_end = pore_sample_range.second / read.read->model_stride;
         assert(move_end >= move_start);
-        //NB move_start can get to move_sums.size(), because of the stride rounding?
-        if (move_start >= read.move_sums.size() || move_end >= read.move_sums.size() ||
-            read.move_sums[move_start] == 0) {
+        //NB move_start can get to moves.size(), because of the stride rounding?
+        //the bases called up to and including a move are its rank one past it
+        const auto& moves = read.read->moves;
+        if (move_start >= moves.size() || move_end >= moves.size() ||
+            moves.rank(move_start + 1) == 0) {
             //either at very end of the signal or basecalls have not started yet
             continue;
         }
-        auto start_pos = read.move_sums[move_start] - 1;
+        auto start_pos = moves.rank(move_start + 1) - 1;
         //NB. adding adapter length
-        auto end_pos = read.move_sums[move_end];
+        auto end_pos = moves.rank(move_end + 1);
         assert(end_pos > start_pos);
         pore_regions.push_back({start_pos, end_pos});
     }
@@ -239,25 +322,36 @@ PosRanges DuplexSplitNode::possible_pore_regions(const DuplexSplitNode::ExtRead&
     return pore_regions;
 }
 
-bool DuplexSplitNode::check_nearby_adapter(const Read& read, PosRange r, int adapter_edist) const {
-    return find_best_adapter_match(m_settings.adapter, read.seq, adapter_edist,
-                                   //including spacer region in search
-                                   {r.first, std::min(r.second + m_settings.pore_adapter_range,
-                                                      (uint64_t)read.seq.size())})
-            .has_value();
+//spacer region checks are cached, so that finders checking the same region at the same or
+//a decided threshold don't align it again
+bool DuplexSplitNode::check_nearby_adapter(ExtRead& read, PosRange r, int adapter_edist) const {
+    const auto& seq = read.read->seq;
+    return check_region(read.adapter_checks, r, adapter_edist, [&](int dist_thr) {
+        auto match = find_best_adapter_alignment(
+                m_settings.adapter, seq, dist_thr,
+                //including spacer region in search
+                {r.first,
+                 std::min(r.second + m_settings.pore_adapter_range, (uint64_t)seq.size())});
+        return match ? match->edist : -1;
+    });
 }
 
 //r is potential spacer region
-bool DuplexSplitNode::check_flank_match(const Read& read, PosRange r, int dist_thr) const {
-    return r.first >= m_settings.end_flank &&
-           r.second + m_settings.start_flank <= read.seq.length() &&
-           check_rc_match(read.seq, {r.first - m_settings.end_flank, r.first - m_settings.end_trim},
-                          //including spacer region in search
-                          {r.first, r.second + m_settings.start_flank}, dist_thr);
+bool DuplexSplitNode::check_flank_match(ExtRead& read, PosRange r, int dist_thr) const {
+    const auto& seq = read.read->seq;
+    if (r.first < m_settings.end_flank || r.second + m_settings.start_flank > seq.length()) {
+        return false;
+    }
+    return check_region(read.flank_checks, r, dist_thr, [&](int thr) {
+        return rc_match_edist(seq, {r.first - m_settings.end_flank, r.first - m_settings.end_trim},
+                              //including spacer region in search
+                              {r.first, r.second + m_settings.start_flank}, thr);
+    });
 }
 
 std::optional<DuplexSplitNode::PosRange> DuplexSplitNode::identify_extra_middle_split(
-        const Read& read) const {
+        ExtRead& ext_read) const {
+    const auto& read = *ext_read.read;
     const auto r_l = read.seq.size();
     const auto search_span = std::max(m_settings.middle_adapter_search_span,
                                       int(std::round(m_settings.middle_adapter_search_frac * r_l)));
@@ -271,7 +365,7 @@ std::optional<DuplexSplitNode::PosRange> DuplexSplitNode::identify_extra_middle_
                 {r_l / 2 - search_span / 2, r_l / 2 + search_span / 2})) {
         auto adapter_start = adapter_match->first;
         spdlog::trace("Checking middle match & start/end match");
-        if (check_flank_match(read, {adapter_start, adapter_start},
+        if (check_flank_match(ext_read, {adapter_start, adapter_start},
                               m_settings.relaxed_flank_edist) &&
             check_rc_match(read.seq, {r_l - m_settings.end_flank, r_l - m_settings.end_trim},
                            {0, m_settings.start_flank}, m_settings.relaxed_flank_edist)) {
@@ -292,8 +386,7 @@ std::vector<std::shared_ptr<Read>> DuplexSplitNode::subreads(
     subreads.reserve(spacers.size() + 1);
 
     const auto stride = read->model_stride;
-    const auto seq_to_sig_map =
-            utils::moves_to_map(read->moves, stride, read->raw_data.size(0), read->seq.size() + 1);
+    const auto seq_to_sig_map = utils::moves_to_map(read->moves, stride, read->raw_data.size(0));
 
     //TODO maybe simplify by adding begin/end stubs?
     uint64_t start_pos = 0;
@@ -319,54 +412,54 @@ std::vector<std::pair<std::string, DuplexSplitNode::SplitFinderF>>
 DuplexSplitNode::build_split_finders() const {
     std::vector<std::pair<std::string, SplitFinderF>> split_finders;
     split_finders.push_back(
-            {"PORE_ADAPTER", [&](const ExtRead& read) {
+            {"PORE_ADAPTER", [&](ExtRead& read) {
                  return filter_ranges(
                          possible_pore_regions(read, m_settings.pore_thr), [&](PosRange r) {
-                             return check_nearby_adapter(*read.read, r, m_settings.adapter_edist);
+                             return check_nearby_adapter(read, r, m_settings.adapter_edist);
                          });
              }});
 
     if (!m_settings.simplex_mode) {
         split_finders.push_back(
-                {"PORE_FLANK", [&](const ExtRead& read) {
+                {"PORE_FLANK", [&](ExtRead& read) {
                      return merge_ranges(
                              filter_ranges(possible_pore_regions(read, m_settings.pore_thr),
                                            [&](PosRange r) {
-                                               return check_flank_match(*read.read, r,
+                                               return check_flank_match(read, r,
                                                                         m_settings.flank_edist);
                                            }),
                              m_settings.end_flank + m_settings.start_flank);
                  }});
 
         split_finders.push_back(
-                {"PORE_ALL", [&](const ExtRead& read) {
+                {"PORE_ALL", [&](ExtRead& read) {
                      return merge_ranges(
                              filter_ranges(possible_pore_regions(read, m_settings.relaxed_pore_thr),
                                            [&](PosRange r) {
                                                return check_nearby_adapter(
-                                                              *read.read, r,
+                                                              read, r,
                                                               m_settings.relaxed_adapter_edist) &&
                                                       check_flank_match(
-                                                              *read.read, r,
+                                                              read, r,
                                                               m_settings.relaxed_flank_edist);
                                            }),
                              m_settings.end_flank + m_settings.start_flank);
                  }});
 
         split_finders.push_back(
-                {"ADAPTER_FLANK", [&](const ExtRead& read) {
+                {"ADAPTER_FLANK", [&](ExtRead& read) {
                      return filter_ranges(find_adapter_matches(m_settings.adapter, read.read->seq,
                                                                m_settings.adapter_edist,
                                                                m_settings.expect_adapter_prefix),
                                           [&](PosRange r) {
-                                              return check_flank_match(*read.read,
+                                              return check_flank_match(read,
                                                                        {r.first, r.first},
                                                                        m_settings.flank_edist);
                                           });
                  }});
 
-        split_finders.push_back({"ADAPTER_MIDDLE", [&](const ExtRead& read) {
-                                     if (auto split = identify_extra_middle_split(*read.read)) {
+        split_finders.push_back({"ADAPTER_MIDDLE", [&](ExtRead& read) {
+                                     if (auto split = identify_extra_middle_split(read)) {
                                          return PosRanges{*split};
                                      } else {
                                          return PosRanges();
@@ -390,7 +483,7 @@ std::vector<std::shared_ptr<Read>> DuplexSplitNode::split(std::shared_ptr<Read>
         return std::vector<std::shared_ptr<Read>>{std::move(init_read)};
     }
 
-    std::vector<ExtRead> to_split{ExtRead(init_read)};
+    std::vector<ExtRead> to_split{ExtRead(init_read, m_settings)};
     for (const auto& [description, split_f] : m_split_finders) {
         spdlog::trace("Running {}", description);
         std::vector<ExtRead> split_round_result;
@@ -403,7 +496,7 @@ std::vector<std::shared_ptr<Read>> DuplexSplitNode::split(std::shared_ptr<Read>
                 split_round_result.push_back(std::move(r));
             } else {
                 for (auto sr : subreads(r.read, spacers)) {
-                    split_round_result.emplace_back(sr);
+                    split_round_result.emplace_back(sr, m_settings);
                 }
             }
         }
@@ -425,6 +518,7 @@ std::vector<std::shared_ptr<Read>> DuplexSplitNode::split(std::shared_ptr<Read>
 }
 
 void DuplexSplitNode::worker_thread() {
+    utils::set_thread_name("duplex_split");
     m_active++;  // Track active threads.
     Message message;
 
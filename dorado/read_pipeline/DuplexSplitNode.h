@@ -1,6 +1,8 @@
 #pragma once
 #include "ReadPipeline.h"
 
+#include <map>
+
 namespace dorado {
 
 struct DuplexSplitSettings {
@@ -52,18 +54,25 @@ private:
     //TODO consider precomputing and reusing ranges with high signal
     struct ExtRead {
         std::shared_ptr<Read> read;
-        torch::Tensor data_as_float32;
-        std::vector<uint64_t> move_sums;
+        //signal ranges above each of the settings' pore thresholds (in pA), found in one pass
+        std::map<float, std::vector<std::pair<size_t, size_t>>> pore_sample_ranges_by_thr;
+        //the best adapter and flank matches of the spacer regions checked so far
+        struct RegionCheck {
+            int edist{-1};  //-1 if there was no match within dist_thr
+            int dist_thr{-1};
+        };
+        std::map<PosRange, RegionCheck> adapter_checks;
+        std::map<PosRange, RegionCheck> flank_checks;
 
-        explicit ExtRead(std::shared_ptr<Read> r);
+        ExtRead(std::shared_ptr<Read> r, const DuplexSplitSettings& settings);
     };
 
-    typedef std::function<PosRanges(const ExtRead&)> SplitFinderF;
+    typedef std::function<PosRanges(ExtRead&)> SplitFinderF;
 
     std::vector<PosRange> possible_pore_regions(const ExtRead& read, float pore_thr) const;
-    bool check_nearby_adapter(const Read& read, PosRange r, int adapter_edist) const;
-    bool check_flank_match(const Read& read, PosRange r, int dist_thr) const;
-    std::optional<PosRange> identify_extra_middle_split(const Read& read) const;
+    bool check_nearby_adapter(ExtRead& read, PosRange r, int adapter_edist) const;
+    bool check_flank_match(ExtRead& read, PosRange r, int dist_thr) const;
+    std::optional<PosRange> identify_extra_middle_split(ExtRead& read) const;
 
     std::vector<std::shared_ptr<Read>> subreads(std::shared_ptr<Read> read,
                                                 const PosRanges& spacers) const;
@@ -1,25 +1,167 @@
 #include "FakeDataLoader.h"
 
 #include "read_pipeline/ReadPipeline.h"
+#include "utils/TensorPool.h"
+#include "utils/time_utils.h"
 
 #include <torch/torch.h>
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
 #include <memory>
+#include <random>
+#include <thread>
+
+namespace {
+
+// Calibration of a typical R10.4.1 read, which makes its samples currents in picoamps.
+constexpr float kDigitisation = 8192.f;
+constexpr float kRange = 1500.f;
+constexpr float kOffset = -250.f;
+// The raw level and noise of an open pore's current, roughly.
+constexpr float kMeanSample = 750.f;
+constexpr float kSampleSd = 80.f;
+// Samples of noise which replayed reads' signals are cut from.
+constexpr int64_t kNoisePoolSamples = 1 << 20;
+
+}  // namespace
 
 namespace dorado {
 
-void FakeDataLoader::load_reads(const int num_reads) {
+FakeDataLoader::FakeDataLoader(MessageSink& read_sink)
+        : FakeDataLoader(read_sink, FakeReadOptions{}) {}
+
+FakeDataLoader::FakeDataLoader(MessageSink& read_sink, const FakeReadOptions& options)
+        : m_read_sink(read_sink), m_options(options) {}
+
+void FakeDataLoader::load_reads(const int num_reads) { send_reads(make_reads(num_reads)); }
+
+std::vector<std::shared_ptr<Read>> FakeDataLoader::make_reads(int num_reads) {
+    // Seeded by the reads made before too, so reads made in several goes aren't repeats.
+    std::mt19937 generator(m_options.seed + static_cast<uint32_t>(m_num_reads_made));
+    std::normal_distribution<float> samples(kMeanSample, kSampleSd);
+    const double mean = static_cast<double>(std::max<int64_t>(m_options.mean_length, 1));
+    const double sd = static_cast<double>(m_options.length_sd);
+    std::gamma_distribution<double> lengths(sd > 0 ? mean * mean / (sd * sd) : 1.0,
+                                            sd > 0 ? sd * sd / mean : 1.0);
+
+    std::vector<std::shared_ptr<Read>> reads;
+    reads.reserve(num_reads);
     for (int i = 0; i < num_reads; ++i) {
-        std::shared_ptr<Read> fake_read = std::make_shared<Read>();
+        const auto read_size =
+                sd > 0 ? std::max<int64_t>(static_cast<int64_t>(lengths(generator)), 1)
+                       : static_cast<int64_t>(mean);
+
+        auto fake_read = make_read(read_size);
+        auto* const raw_data = fake_read->raw_data.data_ptr<int16_t>();
+        for (int64_t j = 0; j < read_size; ++j) {
+            raw_data[j] = static_cast<int16_t>(std::clamp(samples(generator), 0.f, 2047.f));
+        }
+        fake_read->attributes.read_number = static_cast<int32_t>(i);
+        reads.push_back(std::move(fake_read));
+    }
+    return reads;
+}
 
-        constexpr int64_t read_size = 40000;
-        fake_read->raw_data = torch::randint(0, 10000, {read_size}, torch::kInt16);
-        fake_read->read_id = "Placeholder-read-id";
+std::shared_ptr<Read> FakeDataLoader::make_read(int64_t num_samples) {
+    auto fake_read = std::make_shared<Read>();
+    fake_read->raw_data = utils::TensorPool::instance().empty(num_samples, torch::kInt16);
+    fake_read->digitisation = kDigitisation;
+    fake_read->range = kRange;
+    fake_read->offset = kOffset;
+    fake_read->scaling = kRange / kDigitisation;
+    fake_read->sample_rate = m_options.sample_rate;
 
-        m_read_sink.push_message(fake_read);
+    // Valid UUIDs, so that they can be told apart and go through anything that parses them.
+    char read_id[37];
+    std::snprintf(read_id, sizeof(read_id), "00000000-0000-4000-8000-%012llx",
+                  static_cast<unsigned long long>(m_num_reads_made++));
+    fake_read->read_id = read_id;
+    fake_read->run_id = "fake";
+    fake_read->num_trimmed_samples = 0;
+    fake_read->start_time_ms = 0;
+    fake_read->run_acquisition_start_time_ms = 0;
+    fake_read->start_sample = 0;
+    fake_read->end_sample = num_samples;
+    fake_read->attributes.num_samples = num_samples;
+    fake_read->attributes.read_number = 0;
+    fake_read->attributes.channel_number = 1;
+    fake_read->attributes.mux = 1;
+    fake_read->attributes.start_time = "1970-01-01T00:00:00.000+00:00";
+    fake_read->is_duplex = false;
+    return fake_read;
+}
+
+void FakeDataLoader::send_reads(std::vector<std::shared_ptr<Read>> reads) {
+    for (auto& read : reads) {
+        read->memory_reservation.resize(read->host_memory_bytes());
+        m_read_sink.push_message(std::move(read));
     }
 }
 
-FakeDataLoader::FakeDataLoader(MessageSink& read_sink) : m_read_sink(read_sink) {}
+std::chrono::duration<double> FakeDataLoader::replay(const std::vector<utils::TraceRead>& trace,
+                                                     double speed) {
+    if (trace.empty()) {
+        return {};
+    }
+    std::mt19937 generator(m_options.seed + static_cast<uint32_t>(m_num_reads_made));
+    std::normal_distribution<float> samples(kMeanSample, kSampleSd);
+    std::vector<int16_t> noise(kNoisePoolSamples);
+    for (auto& sample : noise) {
+        sample = static_cast<int16_t>(std::clamp(samples(generator), 0.f, 2047.f));
+    }
+    std::uniform_int_distribution<int64_t> noise_offsets(0, kNoisePoolSamples - 1);
+
+    const double sample_rate = static_cast<double>(m_options.sample_rate);
+    auto end_time = [sample_rate](const utils::TraceRead& read) {
+        return read.start_time + static_cast<double>(read.num_samples) / sample_rate;
+    };
+    const double first_end_time = end_time(trace.front());
+    // Reads are numbered on each channel, as the device numbers them.
+    std::map<int32_t, int32_t> read_numbers;
+    std::chrono::duration<double> max_lag{0};
+
+    const auto start = std::chrono::steady_clock::now();
+    for (const auto& trace_read : trace) {
+        const auto num_samples = static_cast<int64_t>(trace_read.num_samples);
+        auto read = make_read(num_samples);
+        auto* const raw_data = read->raw_data.data_ptr<int16_t>();
+        // Reads can be much longer than the pool, so are cut from it as many times as it takes.
+        int64_t offset = noise_offsets(generator);
+        for (int64_t filled = 0; filled < num_samples;) {
+            const int64_t length = std::min(num_samples - filled, kNoisePoolSamples - offset);
+            std::memcpy(raw_data + filled, noise.data() + offset, length * sizeof(int16_t));
+            filled += length;
+            offset = 0;
+        }
+
+        const auto start_time_ms = static_cast<uint64_t>(trace_read.start_time * 1000);
+        read->start_time_ms = start_time_ms;
+        read->start_sample = static_cast<uint64_t>(trace_read.start_time * sample_rate);
+        read->end_sample = read->start_sample + num_samples;
+        read->attributes.channel_number = trace_read.channel;
+        read->attributes.mux = trace_read.mux;
+        read->attributes.read_number = read_numbers[trace_read.channel]++;
+        read->attributes.start_time = utils::get_string_timestamp_from_unix_time(start_time_ms);
+        read->memory_reservation.resize(read->host_memory_bytes());
+
+        if (speed > 0) {
+            const std::chrono::duration<double> since_start(
+                    (end_time(trace_read) - first_end_time) / speed);
+            const auto due =
+                    start +
+                    std::chrono::duration_cast<std::chrono::steady_clock::duration>(since_start);
+            std::this_thread::sleep_until(due);
+            m_read_sink.push_message(std::move(read));
+            max_lag = std::max<std::chrono::duration<double>>(
+                    max_lag, std::chrono::steady_clock::now() - due);
+        } else {
+            m_read_sink.push_message(std::move(read));
+        }
+    }
+    return max_lag;
+}
 
 }  // namespace dorado
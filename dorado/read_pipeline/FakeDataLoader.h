@@ -1,17 +1,61 @@
 #pragma once
 
+#include "utils/workload_trace.h"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
 namespace dorado {
 
 class MessageSink;
+class Read;
+
+// How the reads of a FakeDataLoader are made up.
+struct FakeReadOptions {
+    // Read lengths are drawn from a gamma distribution of this mean and standard deviation,
+    // which, like real read lengths, has a long tail.  A deviation of 0 makes every read the
+    // mean length.
+    int64_t mean_length{40000};
+    int64_t length_sd{0};
+    uint64_t sample_rate{4000};
+    // The same seed always makes the same reads.
+    uint32_t seed{42};
+};
 
-// Supplies a stream of reads with random signals for testing purposes.
+// Supplies a stream of reads with random signals for testing and benchmarking purposes.
+// The signals are noise at the level of a pore's current, with the calibration of a real
+// read, so they're scaled, basecalled and written like real reads, if to no useful sequence.
 class FakeDataLoader {
 public:
     FakeDataLoader(MessageSink& read_sink);
+    FakeDataLoader(MessageSink& read_sink, const FakeReadOptions& options);
+
     void load_reads(int num_reads);
 
+    // Makes reads without sending them, so that they can be sent later with send_reads(),
+    // e.g. to time a pipeline without the time taken to make them.
+    std::vector<std::shared_ptr<Read>> make_reads(int num_reads);
+    void send_reads(std::vector<std::shared_ptr<Read>> reads);
+
+    // Replays a run's workload: reads of the trace's lengths, on its channels and muxes, with
+    // its start times, are each sent when they finished in the run, measured from the first,
+    // divided by speed, or as fast as the sink takes them for a speed of 0.  Signals are cut
+    // from a pool of noise, so that making them keeps up with a whole flowcell.  Returns how
+    // far at most the sending fell behind the trace, as the sink held it up.
+    std::chrono::duration<double> replay(const std::vector<utils::TraceRead>& trace,
+                                         double speed = 1.0);
+
 private:
+    // A read, calibrated and numbered as fake reads are, on channel 1, with room for its
+    // signal, which is left for the caller to fill in.
+    std::shared_ptr<Read> make_read(int64_t num_samples);
+
     MessageSink& m_read_sink;
+    FakeReadOptions m_options;
+    // Reads made so far, which number their read IDs.
+    uint64_t m_num_reads_made{0};
 };
 
 }  // namespace dorado
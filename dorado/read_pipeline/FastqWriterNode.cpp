@@ -0,0 +1,165 @@
+#include "FastqWriterNode.h"
+
+#include "utils/MetricsServer.h"
+#include "utils/ProgressReporter.h"
+#include "utils/TraceRecorder.h"
+#include "utils/sequence_utils.h"
+#include "utils/thread_utils.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+void append_int_tag(std::string& buffer, const char* tag, int64_t value) {
+    char digits[24];
+    const auto result = std::to_chars(std::begin(digits), std::end(digits), value);
+    buffer += '\t';
+    buffer += tag;
+    buffer += ":i:";
+    buffer.append(digits, result.ptr);
+}
+
+void append_string_tag(std::string& buffer, const char* tag, const std::string& value) {
+    buffer += '\t';
+    buffer += tag;
+    buffer += ":Z:";
+    buffer += value;
+}
+
+}  // namespace
+
+namespace dorado {
+
+FastqWriterNode::FastqWriterNode(int fd,
+                                 bool compress,
+                                 bool rna,
+                                 size_t num_worker_threads,
+                                 size_t compression_threads,
+                                 size_t num_reads)
+        : MessageSink(10000), m_rna(rna) {
+    // BGZF closes the descriptor it's given, so give it a copy.
+    const int source_fd = fd < 0 ? fileno(stdout) : fd;
+#ifdef _WIN32
+    const int file_fd = _dup(source_fd);
+#else
+    const int file_fd = dup(source_fd);
+#endif
+    m_file = file_fd < 0 ? nullptr : bgzf_dopen(file_fd, compress ? "w" : "wu");
+    if (!m_file) {
+        throw std::runtime_error("Could not open FASTQ output");
+    }
+    if (compress && compression_threads > 0 &&
+        bgzf_mt(m_file, static_cast<int>(compression_threads), 128) < 0) {
+        throw std::runtime_error("Could not enable multi threading for FASTQ compression.");
+    }
+
+    m_progress = std::make_unique<utils::ProgressReporter>(num_reads);
+    for (size_t i = 0; i < std::max(num_worker_threads, size_t(1)); i++) {
+        m_workers.push_back(std::make_unique<std::thread>(
+                std::thread(&FastqWriterNode::worker_thread, this)));
+    }
+}
+
+FastqWriterNode::~FastqWriterNode() {
+    terminate();
+    join();
+    if (bgzf_close(m_file) < 0) {
+        spdlog::error("Failed to finish writing FASTQ output");
+    }
+}
+
+void FastqWriterNode::join() {
+    for (auto& worker : m_workers) {
+        if (worker->joinable()) {
+            worker->join();
+        }
+    }
+    m_progress->stop();
+}
+
+void FastqWriterNode::remove_expected_reads(size_t count) { m_progress->remove_expected(count); }
+
+void FastqWriterNode::format_read(const Read& read, std::string& buffer) {
+    buffer += '@';
+    buffer += read.read_id;
+    append_int_tag(
+            buffer, "qs",
+            static_cast<int>(std::round(utils::mean_qscore_from_qstring(read.qstring))));
+    if (!read.is_duplex) {
+        append_int_tag(buffer, "ch", read.attributes.channel_number);
+        append_int_tag(buffer, "mx", read.attributes.mux);
+        append_int_tag(buffer, "rn", read.attributes.read_number);
+        append_string_tag(buffer, "st", read.attributes.start_time);
+        if (const auto rg = read.read_group(); !rg.empty()) {
+            append_string_tag(buffer, "RG", rg);
+        }
+    }
+    append_int_tag(buffer, "dx", read.is_duplex ? 1 : 0);
+    buffer += '\n';
+    buffer += read.seq;
+    buffer += "\n+\n";
+    buffer += read.qstring;
+    buffer += '\n';
+}
+
+void FastqWriterNode::add_metrics(utils::MetricsRegistry& registry) const {
+    using Type = utils::MetricsRegistry::Type;
+    registry.add("dorado_writer_records_total", "Records written.", Type::COUNTER,
+                 [this] { return m_num_reads_written.load(); });
+    registry.add("dorado_writer_bytes_total", "Bytes of the records written, uncompressed.",
+                 Type::COUNTER, [this] { return m_num_bytes_written.load(); });
+}
+
+void FastqWriterNode::write_buffer(std::string& buffer) {
+    if (buffer.empty()) {
+        return;
+    }
+    utils::TraceSpan span("write");
+    std::lock_guard<std::mutex> lock(m_file_mutex);
+    if (bgzf_write(m_file, buffer.data(), buffer.size()) < 0) {
+        throw std::runtime_error("Failed to write FASTQ output");
+    }
+    m_num_bytes_written.fetch_add(buffer.size(), std::memory_order_relaxed);
+    buffer.clear();
+}
+
+void FastqWriterNode::worker_thread() {
+    utils::set_thread_name("fastq_writer");
+    std::string buffer;
+    buffer.reserve(kBufferSize + kBufferSize / 4);
+    std::vector<Message> messages;
+    while (m_work_queue.try_pop_batch(messages, kMaxBatchSize)) {
+        for (auto& message : messages) {
+            // If this message isn't a read, we'll get a bad_variant_access exception.
+            auto read = std::get<std::shared_ptr<Read>>(std::move(message));
+            if (m_rna) {
+                std::reverse(read->seq.begin(), read->seq.end());
+                std::reverse(read->qstring.begin(), read->qstring.end());
+            }
+            format_read(*read, buffer);
+            // Duplex reads aren't counted, as the number expected is of simplex reads.
+            if (!read->is_duplex) {
+                m_progress->add();
+            }
+        }
+        m_num_reads_written += messages.size();
+        messages.clear();
+        if (buffer.size() >= kBufferSize) {
+            write_buffer(buffer);
+        }
+    }
+    write_buffer(buffer);
+}
+
+}  // namespace dorado
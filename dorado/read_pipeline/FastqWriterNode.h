@@ -0,0 +1,68 @@
+#pragma once
+
+#include "ReadPipeline.h"
+#include "htslib/bgzf.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dorado {
+
+namespace utils {
+class MetricsRegistry;
+class ProgressReporter;
+}  // namespace utils
+
+// Writes reads as FASTQ straight from their sequences and quality strings, rather than turning
+// them into BAM records for htslib to turn back into text.  Each worker thread formats reads
+// into its own large buffer, which is written out whole, so the only contention is on writes.
+// With compression, the output is BGZF, which gzip can read, compressed on a pool of threads.
+// Each header line has the read ID followed by some of its tags, tab separated and SAM style,
+// as samtools fastq -T writes them.
+class FastqWriterNode : public MessageSink {
+public:
+    // Writes to fd, or to stdout if it's negative.  The descriptor is left open for the caller
+    // to close once the writer has been destroyed.  num_reads is how many reads are expected,
+    // for the progress bar, or 0 if it isn't known.
+    FastqWriterNode(int fd,
+                    bool compress,
+                    bool rna,
+                    size_t num_worker_threads,
+                    size_t compression_threads,
+                    size_t num_reads);
+    ~FastqWriterNode();
+    void join();
+    // Takes count reads which won't be written off the number expected.  Thread safe.
+    void remove_expected_reads(size_t count);
+
+    size_t num_reads_written() const { return m_num_reads_written; }
+    // Adds the records written so far, and their uncompressed bytes, to registry.
+    void add_metrics(utils::MetricsRegistry& registry) const;
+    uint32_t read_fields_used() const override { return 0; }
+
+    // Appends read's FASTQ record to buffer.
+    static void format_read(const Read& read, std::string& buffer);
+
+private:
+    // Maximum number of reads taken from the input queue at once.
+    static constexpr size_t kMaxBatchSize = 64;
+    // A worker writes its buffer out once it holds this many bytes.
+    static constexpr size_t kBufferSize = 4 * 1024 * 1024;
+
+    void worker_thread();
+    void write_buffer(std::string& buffer);
+
+    BGZF* m_file{nullptr};
+    std::mutex m_file_mutex;
+    std::vector<std::unique_ptr<std::thread>> m_workers;
+    std::atomic<size_t> m_num_reads_written{0};
+    std::atomic<size_t> m_num_bytes_written{0};
+    std::unique_ptr<utils::ProgressReporter> m_progress;
+    bool m_rna;
+};
+
+}  // namespace dorado
@@ -0,0 +1,97 @@
+#include "MessageRouter.h"
+
+#include <algorithm>
+
+namespace dorado {
+
+MessageRouter::MessageRouter(MessageSink& default_sink) : MessageSink(1) {
+    m_destinations.fill(&default_sink);
+    default_sink.add_routed_input();
+}
+
+MessageRouter::~MessageRouter() {
+    // Ensure downstream sinks aren't left waiting if an upstream node didn't terminate us.
+    terminate();
+}
+
+bool MessageRouter::feeds(const MessageSink* sink) const {
+    return std::find(m_destinations.begin(), m_destinations.end(), sink) !=
+                   m_destinations.end() ||
+           std::find(m_added_destinations.begin(), m_added_destinations.end(), sink) !=
+                   m_added_destinations.end();
+}
+
+std::vector<MessageSink*> MessageRouter::destinations() const {
+    std::vector<MessageSink*> sinks;
+    for (auto* sink : m_destinations) {
+        if (std::find(sinks.begin(), sinks.end(), sink) == sinks.end()) {
+            sinks.push_back(sink);
+        }
+    }
+    for (auto* sink : m_added_destinations) {
+        if (std::find(sinks.begin(), sinks.end(), sink) == sinks.end()) {
+            sinks.push_back(sink);
+        }
+    }
+    return sinks;
+}
+
+void MessageRouter::set_destination(size_t type_index, MessageSink& sink) {
+    // Each distinct destination counts this router once as an input.
+    if (!feeds(&sink)) {
+        sink.add_routed_input();
+    }
+    MessageSink* previous = m_destinations[type_index];
+    m_destinations[type_index] = &sink;
+    if (!feeds(previous)) {
+        --previous->m_num_routed_inputs;
+    }
+}
+
+void MessageRouter::add_destination(MessageSink& sink) {
+    if (!feeds(&sink)) {
+        sink.add_routed_input();
+    }
+    m_added_destinations.push_back(&sink);
+}
+
+void MessageRouter::push_message(Message&& message) {
+    destination(message).push_message(std::move(message));
+}
+
+void MessageRouter::push_messages(std::vector<Message>&& messages) {
+    // Forward runs of messages bound for the same sink as a single batch, preserving order.
+    std::vector<Message> run;
+    MessageSink* run_destination = nullptr;
+    for (auto& message : messages) {
+        MessageSink* sink = &destination(message);
+        if (sink != run_destination && !run.empty()) {
+            run_destination->push_messages(std::move(run));
+        }
+        run_destination = sink;
+        run.push_back(std::move(message));
+    }
+    if (!run.empty()) {
+        run_destination->push_messages(std::move(run));
+    }
+    messages.clear();
+}
+
+uint32_t MessageRouter::read_fields_used() const {
+    uint32_t fields = 0;
+    for (const auto* sink : destinations()) {
+        fields |= sink->read_fields_used();
+    }
+    return fields;
+}
+
+void MessageRouter::terminate() {
+    if (m_terminated.exchange(true)) {
+        return;
+    }
+    for (auto* sink : destinations()) {
+        sink->routed_input_terminated();
+    }
+}
+
+}  // namespace dorado
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "ReadPipeline.h"
+
+#include <array>
+#include <atomic>
+#include <variant>
+#include <vector>
+
+namespace dorado {
+
+// A MessageRouter is the branching point of a pipeline graph.  Nodes which produce more
+// than one kind of message push into a router, which forwards each message directly,
+// without an intermediate queue or worker thread, to the sink registered for its type.
+// Message types without an explicit route go to the default sink.
+//
+// A sink can be the destination of several routers (fan-in).  It is terminated once
+// every router feeding it has been terminated, so all producers for such a sink must
+// reach it via a router rather than by holding a direct reference.
+//
+// Routers must outlive the nodes which push into them.
+//
+// Subclasses can route by a message's content rather than its type, overriding destination()
+// to pick among sinks they've added with add_destination().
+class MessageRouter : public MessageSink {
+public:
+    explicit MessageRouter(MessageSink& default_sink);
+    ~MessageRouter();
+
+    // Sends all messages holding a T to sink instead of the default sink.
+    template <typename T>
+    MessageRouter& route(MessageSink& sink) {
+        set_destination(Message(std::in_place_type<T>).index(), sink);
+        return *this;
+    }
+
+    void push_message(Message&& message) override;
+    void push_messages(std::vector<Message>&& messages) override;
+    // Only the first call has an effect.
+    void terminate() override;
+    uint32_t read_fields_used() const override;
+
+protected:
+    // The sink message goes to.  By default, the one registered for its type.
+    virtual MessageSink& destination(const Message& message) {
+        return *m_destinations[message.index()];
+    }
+    // Counts sink as one this router feeds, so that it's terminated along with the router.
+    void add_destination(MessageSink& sink);
+
+private:
+    void set_destination(size_t type_index, MessageSink& sink);
+    // Whether any message can go to sink.
+    bool feeds(const MessageSink* sink) const;
+    // Each sink fed, once.
+    std::vector<MessageSink*> destinations() const;
+
+    std::array<MessageSink*, std::variant_size_v<Message>> m_destinations;
+    // Sinks added by subclasses.
+    std::vector<MessageSink*> m_added_destinations;
+    std::atomic<bool> m_terminated{false};
+};
+
+}  // namespace dorado
@@ -4,19 +4,25 @@
 #include "modbase/remora_utils.h"
 #include "nn/RemoraModel.h"
 #include "utils/base_mod_utils.h"
+#include "utils/MetricsServer.h"
+#include "utils/TraceRecorder.h"
 #include "utils/math_utils.h"
+#include "utils/motif_scanner.h"
 #include "utils/sequence_utils.h"
+#include "utils/thread_utils.h"
 
 #include <nvtx3/nvtx3.hpp>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
 #include <chrono>
 #include <cstring>
 using namespace std::chrono_literals;
 
 namespace dorado {
 
-constexpr auto FORCE_TIMEOUT = 100ms;
+// The longest the first chunk of a partial batch waits for the batch to fill before it's called.
+constexpr auto MAX_BATCH_LATENCY = 100ms;
 
 ModBaseCallerNode::ModBaseCallerNode(MessageSink& sink,
                                      std::vector<std::shared_ptr<RemoraCaller>> model_callers,
@@ -24,7 +30,8 @@ ModBaseCallerNode::ModBaseCallerNode(MessageSink& sink,
                                      size_t num_devices,
                                      size_t block_stride,
                                      size_t batch_size,
-                                     size_t max_reads)
+                                     size_t max_reads,
+                                     bool fuse_models)
         : MessageSink(max_reads),
           m_sink(sink),
           m_num_devices(num_devices),
@@ -32,15 +39,19 @@ ModBaseCallerNode::ModBaseCallerNode(MessageSink& sink,
           m_block_stride(block_stride),
           m_callers(std::move(model_callers)) {
     init_modbase_info();
+    init_model_groups(fuse_models);
+    m_model_context_hits = std::vector<std::atomic<int64_t>>(m_callers.size() / m_num_devices);
+    m_caller_chunks_called = std::vector<std::atomic<int64_t>>(m_callers.size());
+    m_caller_batches_called = std::vector<std::atomic<int64_t>>(m_callers.size());
 
     m_output_worker = std::make_unique<std::thread>(&ModBaseCallerNode::output_worker_thread, this);
 
-    size_t num_model_callers = m_callers.size();
+    const size_t num_caller_workers = m_model_groups.size() * num_devices;
 
-    m_chunk_queues.resize(num_model_callers / num_devices);
-    m_batched_chunks.resize(num_model_callers);
+    m_chunk_queues.resize(m_model_groups.size());
+    m_batched_chunks.resize(num_caller_workers);
 
-    for (size_t i = 0; i < num_model_callers; i++) {
+    for (size_t i = 0; i < num_caller_workers; i++) {
         std::unique_ptr<std::thread> t =
                 std::make_unique<std::thread>(&ModBaseCallerNode::caller_worker_thread, this, i);
         m_caller_workers.push_back(std::move(t));
@@ -129,20 +140,57 @@ ModBaseCallerNode::~ModBaseCallerNode() {
 
 void ModBaseCallerNode::init_modbase_info() {
     std::vector<std::reference_wrapper<BaseModParams const>> base_mod_params;
+    m_motif_scanner = std::make_unique<utils::MotifScanner>();
     for (size_t id = 0; id < m_callers.size() / m_num_devices; ++id) {
-        base_mod_params.emplace_back(m_callers[id]->params());
+        const auto& params = m_callers[id]->params();
+        base_mod_params.emplace_back(params);
+        m_motif_scanner->add_motif(params.motif, params.motif_offset);
+
+        size_t scaling_model = 0;
+        while (!m_callers[scaling_model]->params().same_signal_scaling(params)) {
+            ++scaling_model;
+        }
+        m_signal_scaling_model.push_back(scaling_model);
     }
     get_modbase_info_and_maybe_init(base_mod_params, this);
 }
 
+void ModBaseCallerNode::init_model_groups(bool fuse_models) {
+    // The callers of each device are alike, so those of the first are compared.
+    const size_t num_models = m_callers.size() / m_num_devices;
+    for (size_t model_id = 0; model_id < num_models; ++model_id) {
+        size_t group_id = 0;
+        while (group_id < m_model_groups.size() &&
+               !(fuse_models && m_callers[m_model_groups[group_id].front()]->shares_inputs_with(
+                                        *m_callers[model_id]))) {
+            ++group_id;
+        }
+        if (group_id == m_model_groups.size()) {
+            m_model_groups.emplace_back();
+        }
+        m_model_groups[group_id].push_back(model_id);
+    }
+    for (const auto& group : m_model_groups) {
+        if (group.size() > 1) {
+            std::string motifs;
+            for (auto model_id : group) {
+                motifs += (motifs.empty() ? "" : ", ") + m_callers[model_id]->params().motif;
+            }
+            spdlog::debug("Calling the modbase models of motifs {} together", motifs);
+        }
+    }
+}
+
 void ModBaseCallerNode::runner_worker_thread(size_t runner_id) {
+    utils::set_thread_name("modbase_runner");
     Message message;
     while (m_work_queue.try_pop(message)) {
         nvtx3::scoped_range range{"runner_worker_thread"};
         // If this message isn't a read, we'll get a bad_variant_access exception.
         auto read = std::get<std::shared_ptr<Read>>(message);
 
-        const size_t max_chunks_in = m_batch_size * 5;  // size per queue: one queue per caller
+        // Size per queue: one queue per model group.
+        const size_t max_chunks_in = m_batch_size * 5;
         auto chunk_queues_available = [this, &max_chunks_in] {
             return std::all_of(
                     std::begin(m_chunk_queues), std::end(m_chunk_queues),
@@ -154,35 +202,78 @@ void ModBaseCallerNode::runner_worker_thread(size_t runner_id) {
             m_chunk_queues_cv.wait(chunk_lock, chunk_queues_available);
             chunk_lock.unlock();
 
-            {
-                nvtx3::scoped_range range{"base_mod_probs_init"};
-                // initialize base_mod_probs _before_ we start handing out chunks
-                read->base_mod_probs.resize(read->seq.size() * m_num_states, 0);
-                for (size_t i = 0; i < read->seq.size(); ++i) {
-                    // Initialize for what corresponds to 100% canonical base for each position.
-                    int base_id = RemoraUtils::BASE_IDS[read->seq[i]];
-                    if (base_id < 0) {
-                        throw std::runtime_error("Invalid character in sequence.");
-                    }
-                    read->base_mod_probs[i * m_num_states + m_base_prob_offsets[base_id]] = 1.0f;
+            for (const char base : read->seq) {
+                if (RemoraUtils::BASE_IDS[base] < 0) {
+                    throw std::runtime_error("Invalid character in sequence.");
                 }
             }
             read->base_mod_info = m_base_mod_info;
 
             std::vector<int> sequence_ints = utils::sequence_to_ints(read->seq);
-            std::vector<uint64_t> seq_to_sig_map = utils::moves_to_map(
-                    read->moves, m_block_stride, read->raw_data.size(0), read->seq.size() + 1);
+            std::vector<uint64_t> seq_to_sig_map =
+                    utils::moves_to_map(read->moves, m_block_stride, read->raw_data.size(0));
 
+            // Count every chunk before any is queued, so the read can't be completed while
+            // chunks for later models are still being generated.
+            const size_t num_models = m_callers.size() / m_num_devices;
+            const auto context_hits_per_model = m_motif_scanner->scan(read->seq);
             read->num_modbase_chunks = 0;
             read->num_modbase_chunks_called = 0;
-            for (size_t caller_id = 0; caller_id < m_callers.size() / m_num_devices; ++caller_id) {
+            m_num_bases_scanned.fetch_add(read->seq.size(), std::memory_order_relaxed);
+            read->base_mod_positions.clear();
+            for (size_t model_id = 0; model_id < num_models; ++model_id) {
+                const auto& context_hits = context_hits_per_model[model_id];
+                read->num_modbase_chunks += context_hits.size();
+                m_model_context_hits[model_id].fetch_add(context_hits.size(),
+                                                         std::memory_order_relaxed);
+                read->base_mod_positions.insert(read->base_mod_positions.end(),
+                                                context_hits.begin(), context_hits.end());
+            }
+            {
+                nvtx3::scoped_range range{"base_mod_probs_init"};
+                // Only the hits are scored, so only they have room for probabilities, which
+                // must be allocated _before_ we start handing out chunks.
+                auto& positions = read->base_mod_positions;
+                std::sort(positions.begin(), positions.end());
+                positions.erase(std::unique(positions.begin(), positions.end()), positions.end());
+                read->base_mod_probs.assign(positions.size() * m_num_states, 0);
+            }
+            if (read->num_modbase_chunks == 0) {
+                // No modbases to call, pass directly to next node
+                m_sink.push_message(read);
+                break;
+            }
+
+            std::vector<torch::Tensor> scaled_signals(num_models);
+            for (size_t group_id = 0; group_id < m_model_groups.size(); ++group_id) {
                 nvtx3::scoped_range range{"generate_chunks"};
-                const auto& caller = m_callers[caller_id];
-                auto& chunk_queue = m_chunk_queues[caller_id];
+                utils::TraceSpan span("modbase_generate_chunks");
+                const auto& group = m_model_groups[group_id];
+                const auto& caller = m_callers[group.front()];
+                auto& chunk_queue = m_chunk_queues[group_id];
+                // The models of a group take the same inputs, so a hit of several of them is
+                // only encoded once.
+                std::vector<size_t> context_hits;
+                for (auto model_id : group) {
+                    const auto& model_hits = context_hits_per_model[model_id];
+                    context_hits.insert(context_hits.end(), model_hits.begin(), model_hits.end());
+                }
+                if (context_hits.empty()) {
+                    continue;
+                }
+                if (group.size() > 1) {
+                    std::sort(context_hits.begin(), context_hits.end());
+                    context_hits.erase(std::unique(context_hits.begin(), context_hits.end()),
+                                       context_hits.end());
+                }
 
-                // scale signal based on model parameters
-                auto scaled_signal =
-                        caller->scale_signal(read->raw_data, sequence_ints, seq_to_sig_map);
+                // scale signal based on model parameters, unless an earlier model has already
+                // scaled it the same way
+                auto& scaled_signal = scaled_signals[m_signal_scaling_model[group.front()]];
+                if (!scaled_signal.defined()) {
+                    scaled_signal =
+                            caller->scale_signal(read->raw_data, sequence_ints, seq_to_sig_map);
+                }
 
                 auto& params = caller->params();
                 auto context_samples = (params.context_before + params.context_after);
@@ -191,23 +282,27 @@ void ModBaseCallerNode::runner_worker_thread(size_t runner_id) {
                                       params.bases_after);
                 encoder.init(sequence_ints, seq_to_sig_map);
 
-                auto context_hits = caller->get_motif_hits(read->seq);
+                // Every hit's signal slice and encoding goes into one slab of each.
+                auto contexts = encoder.get_contexts(
+                        context_hits, scaled_signal,
+                        caller->expands_kmers_on_device() ? RemoraEncoder::KmerEncoding::Bases
+                                                          : RemoraEncoder::KmerEncoding::OneHot);
+
                 std::vector<std::shared_ptr<RemoraChunk>> reads_to_enqueue;
                 reads_to_enqueue.reserve(context_hits.size());
-                for (auto context_hit : context_hits) {
-                    auto slice = encoder.get_context(context_hit);
-                    auto input_signal = scaled_signal.index({torch::indexing::Slice(
-                            slice.first_sample, slice.first_sample + slice.num_samples)});
-                    if (slice.lead_samples_needed != 0 || slice.tail_samples_needed != 0) {
-                        input_signal = torch::constant_pad_nd(input_signal,
-                                                              {(int64_t)slice.lead_samples_needed,
-                                                               (int64_t)slice.tail_samples_needed});
+                for (auto model_id : group) {
+                    const auto& model_hits = context_hits_per_model[model_id];
+                    for (size_t i = 0; i < model_hits.size(); ++i) {
+                        const size_t row = group.size() == 1
+                                                   ? i
+                                                   : std::lower_bound(context_hits.begin(),
+                                                                      context_hits.end(),
+                                                                      model_hits[i]) -
+                                                             context_hits.begin();
+                        reads_to_enqueue.push_back(std::make_shared<RemoraChunk>(
+                                read, contexts.signals, contexts.kmers, row, model_hits[i],
+                                model_id));
                     }
-
-                    reads_to_enqueue.push_back(std::make_shared<RemoraChunk>(
-                            read, input_signal, std::move(slice.data), context_hit));
-
-                    ++read->num_modbase_chunks;
                 }
                 chunk_lock.lock();
                 chunk_queue.insert(chunk_queue.end(), reads_to_enqueue.begin(),
@@ -217,14 +312,8 @@ void ModBaseCallerNode::runner_worker_thread(size_t runner_id) {
                                                        : m_chunks_added_cv.notify_one();
             }
 
-            if (read->num_modbase_chunks != 0) {
-                // Put the read in the working list
-                std::scoped_lock<std::mutex> working_reads_lock(m_working_reads_mutex);
-                m_working_reads.push_back(read);
-            } else {
-                // No modbases to call, pass directly to next node
-                m_sink.push_message(read);
-            }
+            // The read's chunks keep it alive, and the last of them to be scored passes
+            // it on.
             break;
         }
     }
@@ -236,25 +325,34 @@ void ModBaseCallerNode::runner_worker_thread(size_t runner_id) {
     }
 }
 
-void ModBaseCallerNode::caller_worker_thread(size_t caller_id) {
-    auto& caller = m_callers[caller_id];
+void ModBaseCallerNode::caller_worker_thread(size_t worker_id) {
+    utils::set_thread_name("modbase_caller");
+    const auto num_models = m_callers.size() / m_num_devices;
+    const auto device_id = worker_id / m_model_groups.size();
+    const auto group_id = worker_id % m_model_groups.size();
+    // The group's first model stages the batches for all of them.
+    auto& caller = m_callers[device_id * num_models + m_model_groups[group_id].front()];
 
-    auto num_models = m_callers.size() / m_num_devices;
-    auto& chunk_queue = m_chunk_queues[caller_id % num_models];
-    auto& batched_chunks = m_batched_chunks[caller_id];
-    auto last_chunk_reserve_time = std::chrono::system_clock::now();
+    auto& chunk_queue = m_chunk_queues[group_id];
+    auto& batched_chunks = m_batched_chunks[worker_id];
+    // When the first chunk of the current batch was taken, which bounds how long the batch can
+    // wait for more, however slowly chunks trickle in.
+    auto batch_start_time = std::chrono::steady_clock::now();
 
     while (true) {
         nvtx3::scoped_range range{"caller_worker_thread"};
         std::unique_lock<std::mutex> chunks_lock(m_chunk_queues_mutex);
-        if (!m_chunks_added_cv.wait_until(
-                    chunks_lock, last_chunk_reserve_time + FORCE_TIMEOUT,
-                    [&chunk_queue, this] { return !chunk_queue.empty() || m_terminate_callers; })) {
+        auto chunks_available = [&chunk_queue, this] {
+            return !chunk_queue.empty() || m_terminate_callers;
+        };
+        if (batched_chunks.empty()) {
+            // Nothing is waiting to be called, so there's no deadline.
+            m_chunks_added_cv.wait(chunks_lock, chunks_available);
+        } else if (!m_chunks_added_cv.wait_until(
+                           chunks_lock, batch_start_time + MAX_BATCH_LATENCY, chunks_available)) {
             // timeout without new chunks or termination call
             chunks_lock.unlock();
-            if (!batched_chunks.empty()) {
-                call_current_batch(caller_id);
-            }
+            call_current_batch(worker_id);
             continue;
         }
 
@@ -263,7 +361,7 @@ void ModBaseCallerNode::caller_worker_thread(size_t caller_id) {
             // call the remaining batch
             chunks_lock.unlock();  // Not strictly necessary
             if (!batched_chunks.empty()) {
-                call_current_batch(caller_id);
+                call_current_batch(worker_id);
             }
             // Reduce the count of active model callers.  If this was the last active
             // model caller also send termination signal to sink
@@ -283,13 +381,15 @@ void ModBaseCallerNode::caller_worker_thread(size_t caller_id) {
         // significantly.  This matters because slack time in this thread currently
         // gates Remora model GPU throughput on fast systems.
         size_t previous_chunk_count = batched_chunks.size();
+        if (previous_chunk_count == 0) {
+            batch_start_time = std::chrono::steady_clock::now();
+        }
         {
             nvtx3::scoped_range range{"push_chunks"};
             while (batched_chunks.size() != m_batch_size && !chunk_queue.empty()) {
                 std::shared_ptr<RemoraChunk> chunk = chunk_queue.front();
                 chunk_queue.pop_front();
                 batched_chunks.push_back(chunk);
-                last_chunk_reserve_time = std::chrono::system_clock::now();
             }
         }
         // Relinquish the chunk queue mutex, allowing other chunk queue
@@ -297,50 +397,106 @@ void ModBaseCallerNode::caller_worker_thread(size_t caller_id) {
         chunks_lock.unlock();
         m_chunk_queues_cv.notify_one();
 
-        // Insert the chunks we just obtained into the model input tensors.
+        // Insert the chunks we just obtained into the model input tensors.  Chunks queued
+        // together from one read are consecutive rows of the same tensors, so runs of them
+        // are copied at once.
+        for (size_t chunk_idx = previous_chunk_count; chunk_idx < batched_chunks.size();) {
+            const auto& chunk = batched_chunks[chunk_idx];
+            size_t num_chunks = 1;
+            while (chunk_idx + num_chunks < batched_chunks.size()) {
+                const auto& next_chunk = batched_chunks[chunk_idx + num_chunks];
+                if (!next_chunk->signals.is_same(chunk->signals) ||
+                    next_chunk->input_row != chunk->input_row + num_chunks) {
+                    break;
+                }
+                ++num_chunks;
+            }
+            caller->accept_chunks(chunk_idx, chunk->signals, chunk->encoded_kmers,
+                                  chunk->input_row, num_chunks);
+            chunk_idx += num_chunks;
+        }
         for (size_t chunk_idx = previous_chunk_count; chunk_idx < batched_chunks.size();
              ++chunk_idx) {
-            const auto& chunk = batched_chunks[chunk_idx];
-            caller->accept_chunk(chunk_idx, chunk->signal, chunk->encoded_kmers);
+            batched_chunks[chunk_idx]->signals.reset();
+            batched_chunks[chunk_idx]->encoded_kmers.reset();
         }
 
-        if (m_batched_chunks[caller_id].size() == m_batch_size) {
-            // Input tensor is full, let's get_scores.
-            call_current_batch(caller_id);
+        if (batched_chunks.size() == m_batch_size ||
+            std::chrono::steady_clock::now() >= batch_start_time + MAX_BATCH_LATENCY) {
+            // Input tensor is full, or the batch has waited long enough, let's get_scores.
+            call_current_batch(worker_id);
         }
     }
 }
 
-void ModBaseCallerNode::call_current_batch(size_t caller_id) {
+void ModBaseCallerNode::call_current_batch(size_t worker_id) {
     nvtx3::scoped_range loop{"call_current_batch"};
+    utils::TraceSpan span("modbase_batch");
+
+    const auto num_models = m_callers.size() / m_num_devices;
+    const auto device_id = worker_id / m_model_groups.size();
+    const auto& group = m_model_groups[worker_id % m_model_groups.size()];
+    auto& batched_chunks = m_batched_chunks[worker_id];
+    const auto caller_id = [&](size_t member) { return device_id * num_models + group[member]; };
+
+    // The index in the group of the model of each chunk.
+    std::vector<int> row_members(batched_chunks.size());
+    for (size_t i = 0; i < batched_chunks.size(); ++i) {
+        row_members[i] = int(std::find(group.begin(), group.end(), batched_chunks[i]->model_id) -
+                             group.begin());
+    }
 
-    auto& caller = m_callers[caller_id];
-    auto results = caller->call_chunks(m_batched_chunks[caller_id].size());
+    auto& caller = m_callers[caller_id(0)];
+    std::vector<torch::Tensor> results;
+    if (group.size() == 1) {
+        results.push_back(caller->call_chunks(int(batched_chunks.size())));
+    } else {
+        std::vector<RemoraCaller*> callers;
+        for (size_t member = 0; member < group.size(); ++member) {
+            callers.push_back(m_callers[caller_id(member)].get());
+        }
+        results = caller->call_chunks(int(batched_chunks.size()), callers, row_members);
+    }
+    m_caller_batches_called[caller_id(0)].fetch_add(1, std::memory_order_relaxed);
 
     // Convert results to float32 with one call and address via a raw pointer,
     // to avoid huge libtorch indexing overhead.
-    auto results_f32 = results.to(torch::kFloat32);
-    assert(results_f32.is_contiguous());
-    const auto* const results_f32_ptr = results_f32.data_ptr<float>();
+    std::vector<const float*> results_f32_ptrs(results.size());
+    for (size_t member = 0; member < results.size(); ++member) {
+        if (results[member].defined()) {
+            results[member] = results[member].to(torch::kFloat32);
+            assert(results[member].is_contiguous());
+            results_f32_ptrs[member] = results[member].data_ptr<float>();
+        }
+    }
 
     std::unique_lock processed_chunks_lock(m_processed_chunks_mutex);
-    auto row_size = results.size(1);
 
-    // Put results into chunk
-    for (size_t i = 0; i < m_batched_chunks[caller_id].size(); ++i) {
-        auto& chunk = m_batched_chunks[caller_id][i];
+    // Put results into chunk, each from the next row of its model's results.
+    std::vector<int64_t> next_rows(results.size(), 0);
+    for (size_t i = 0; i < batched_chunks.size(); ++i) {
+        auto& chunk = batched_chunks[i];
+        const int member = row_members[i];
+        const auto row_size = results[member].size(1);
         chunk->scores.resize(row_size);
-        std::memcpy(chunk->scores.data(), &results_f32_ptr[i * row_size], row_size * sizeof(float));
+        std::memcpy(chunk->scores.data(), &results_f32_ptrs[member][next_rows[member] * row_size],
+                    row_size * sizeof(float));
+        ++next_rows[member];
         m_processed_chunks.push_back(chunk);
     }
 
     processed_chunks_lock.unlock();
     m_processed_chunks_cv.notify_one();
 
-    m_batched_chunks[caller_id].clear();
+    for (size_t member = 0; member < next_rows.size(); ++member) {
+        m_caller_chunks_called[caller_id(member)].fetch_add(next_rows[member],
+                                                            std::memory_order_relaxed);
+    }
+    batched_chunks.clear();
 }
 
 void ModBaseCallerNode::output_worker_thread() {
+    utils::set_thread_name("modbase_output");
     while (true) {
         // Wait until we are provided with a read
         std::unique_lock processed_chunks_lock(m_processed_chunks_mutex);
@@ -352,33 +508,64 @@ void ModBaseCallerNode::output_worker_thread() {
             return;
         }
 
+        std::vector<std::shared_ptr<Read>> completed_reads;
         for (const auto& chunk : m_processed_chunks) {
-            auto source_read = chunk->source_read.lock();
+            const auto& source_read = chunk->source_read;
             int64_t result_pos = chunk->context_hit;
             int64_t offset =
                     m_base_prob_offsets[RemoraUtils::BASE_IDS[source_read->seq[result_pos]]];
+            const auto& positions = source_read->base_mod_positions;
+            const auto scored_idx =
+                    std::lower_bound(positions.begin(), positions.end(), result_pos) -
+                    positions.begin();
             for (size_t i = 0; i < chunk->scores.size(); ++i) {
-                source_read->base_mod_probs[m_num_states * result_pos + offset + i] =
+                source_read->base_mod_probs[m_num_states * scored_idx + offset + i] =
                         uint8_t(std::min(std::floor(chunk->scores[i] * 256), 255.0f));
             }
-            source_read->num_modbase_chunks_called += 1;
+            // This thread is the only one which counts scored chunks.
+            if (++source_read->num_modbase_chunks_called == source_read->num_modbase_chunks) {
+                completed_reads.push_back(source_read);
+            }
         }
 
         m_processed_chunks.clear();
         processed_chunks_lock.unlock();
 
         // Now move any completed reads to the output queue
-        std::unique_lock<std::mutex> working_reads_lock(m_working_reads_mutex);
-        for (auto read_iter = m_working_reads.begin(); read_iter != m_working_reads.end();) {
-            if ((*read_iter)->num_modbase_chunks_called.load() ==
-                (*read_iter)->num_modbase_chunks) {
-                m_sink.push_message(*read_iter);
-                read_iter = m_working_reads.erase(read_iter);
-            } else {
-                ++read_iter;
-            }
+        for (auto& read : completed_reads) {
+            m_sink.push_message(std::move(read));
         }
-        working_reads_lock.unlock();
+    }
+}
+
+void ModBaseCallerNode::add_metrics(utils::MetricsRegistry& registry) const {
+    using Type = utils::MetricsRegistry::Type;
+    registry.add("dorado_modbase_bases_scanned_total", "Bases scanned for modbase motifs.",
+                 Type::COUNTER, [this] { return m_num_bases_scanned.load(); });
+    const size_t num_models = m_model_context_hits.size();
+    for (size_t model_id = 0; model_id < num_models; ++model_id) {
+        const std::string labels = "model=\"" + std::to_string(model_id) + "\",motif=\"" +
+                                   m_callers[model_id]->params().motif + "\"";
+        // Over the same interval, hits over bases scanned is the model's hit rate.
+        registry.add("dorado_modbase_motif_hits_total",
+                     "Hits of each model's motif in the bases scanned, each of which is called.",
+                     Type::COUNTER,
+                     [this, model_id] { return m_model_context_hits[model_id].load(); }, labels);
+    }
+    for (size_t caller_id = 0; caller_id < m_callers.size(); ++caller_id) {
+        const std::string labels = "caller=\"" + std::to_string(caller_id) + "\",model=\"" +
+                                   std::to_string(caller_id % num_models) + "\"";
+        registry.add("dorado_modbase_chunks_total", "Chunks called by each modbase caller.",
+                     Type::COUNTER,
+                     [this, caller_id] { return m_caller_chunks_called[caller_id].load(); },
+                     labels);
+        registry.add("dorado_modbase_batch_slots_total",
+                     "Chunks the batches each modbase caller called had room for.", Type::COUNTER,
+                     [this, caller_id] {
+                         return m_caller_batches_called[caller_id].load() *
+                                static_cast<double>(m_batch_size);
+                     },
+                     labels);
     }
 }
 
@@ -9,10 +9,19 @@
 
 namespace dorado {
 
+namespace utils {
+class MetricsRegistry;
+class MotifScanner;
+}
+
 class RemoraCaller;
 struct RemoraChunk;
 struct BaseModParams;
 
+// With fuse_models, models which take the same inputs, as RemoraCaller::shares_inputs_with
+// has it, are called together: each read is encoded once for all of them, their chunks share
+// one queue and batch, and each batch goes to the device once, for the models to be run on
+// their rows of it back to back.
 class ModBaseCallerNode : public MessageSink {
 public:
     ModBaseCallerNode(MessageSink& sink,
@@ -21,9 +30,14 @@ public:
                       size_t num_devices,
                       size_t block_stride,
                       size_t batch_size,
-                      size_t max_reads = 1000);
+                      size_t max_reads = 1000,
+                      bool fuse_models = false);
     ~ModBaseCallerNode();
 
+    // Adds the motif hits found in the bases scanned so far, and the chunks and batches each
+    // caller has called, to registry.
+    void add_metrics(utils::MetricsRegistry& registry) const;
+
     struct Info {
         std::string long_names;
         std::string alphabet;
@@ -51,11 +65,14 @@ private:
     // Worker threads, scales and chunks reads for callers and enqueues them
     void runner_worker_thread(size_t runner_id);
 
-    // Worker thread per caller, performs the GPU calls to the remora models
-    void caller_worker_thread(size_t caller_id);
+    // Groups the models which are called together, each on its own unless fuse_models.
+    void init_model_groups(bool fuse_models);
+
+    // Worker thread per model group per device, performs the GPU calls to the remora models
+    void caller_worker_thread(size_t worker_id);
 
-    // Called by caller_worker_thread, calls the model and enqueues the results
-    void call_current_batch(size_t caller_id);
+    // Called by caller_worker_thread, calls the models and enqueues the results
+    void call_current_batch(size_t worker_id);
 
     MessageSink& m_sink;
     size_t m_num_devices;
@@ -69,13 +86,10 @@ private:
     std::vector<std::unique_ptr<std::thread>> m_runner_workers;
 
     std::deque<std::shared_ptr<RemoraChunk>> m_processed_chunks;
+    // The batch of each caller worker, and the queue of chunks of each model group.
     std::vector<std::deque<std::shared_ptr<RemoraChunk>>> m_batched_chunks;
     std::vector<std::deque<std::shared_ptr<RemoraChunk>>> m_chunk_queues;
 
-    std::mutex m_working_reads_mutex;
-    // Reads removed from input queue and being modbasecalled.
-    std::deque<std::shared_ptr<Read>> m_working_reads;
-
     std::mutex m_chunk_queues_mutex;
     std::condition_variable m_chunk_queues_cv;
     std::condition_variable m_chunks_added_cv;
@@ -90,9 +104,23 @@ private:
     bool m_terminate_output{false};
 
     std::shared_ptr<const utils::BaseModInfo> m_base_mod_info;
+    // Finds the motif hits of every model in one pass over a read, with motif i being that
+    // of m_callers[i].
+    std::unique_ptr<utils::MotifScanner> m_motif_scanner;
+    // For each model, the first which scales signals the same way, whose scaled signal it uses.
+    std::vector<size_t> m_signal_scaling_model;
+    // The models of each group, the first of which stages their batches.
+    std::vector<std::vector<size_t>> m_model_groups;
     // The offsets to the canonical bases in the modbase alphabet
     std::array<size_t, 4> m_base_prob_offsets;
     size_t m_num_states{4};
+
+    // Bases of the reads scanned for motifs, and the hits of each model's motif in them.
+    std::atomic<int64_t> m_num_bases_scanned{0};
+    std::vector<std::atomic<int64_t>> m_model_context_hits;
+    // Chunks each caller has called, and batches it has called them in.
+    std::vector<std::atomic<int64_t>> m_caller_chunks_called;
+    std::vector<std::atomic<int64_t>> m_caller_batches_called;
 };
 
 }  // namespace dorado
@@ -9,6 +9,7 @@ public:
     // NullNode has no sink - input messages go nowhere
     NullNode();
     ~NullNode();
+    uint32_t read_fields_used() const override { return 0; }
 
 private:
     void worker_thread();
@@ -1,10 +1,23 @@
 #include "PairingNode.h"
+
+#include "utils/MemoryBudget.h"
+#include "utils/MetricsServer.h"
+#include "utils/thread_utils.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
 namespace {
+
+// The most threads the pairs file is loaded on.
+constexpr size_t kMaxLoadThreads = 16;
+
 bool is_within_time_and_length_criteria(const std::shared_ptr<dorado::Read>& read1,
                                         const std::shared_ptr<dorado::Read>& read2) {
     int max_time_delta_ms = 5000;
     float min_seq_len_ratio = 0.95f;
-    int delta = read2->start_time_ms - read1->get_end_time_ms();
+    auto delta = int64_t(read2->start_time_ms) - int64_t(read1->get_end_time_ms());
     int seq_len1 = read1->seq.length();
     int seq_len2 = read2->seq.length();
     float len_ratio = static_cast<float>(std::min(seq_len1, seq_len2)) /
@@ -16,65 +29,52 @@ bool is_within_time_and_length_criteria(const std::shared_ptr<dorado::Read>& rea
 namespace dorado {
 
 void PairingNode::pair_list_worker_thread() {
+    utils::set_thread_name("pairing");
     Message message;
     while (m_work_queue.try_pop(message)) {
         // If this message isn't a read, we'll get a bad_variant_access exception.
         auto read = std::get<std::shared_ptr<Read>>(message);
+        m_num_reads_in.fetch_add(1, std::memory_order_relaxed);
 
-        bool read_is_template = false;
-        bool partner_found = false;
-        std::string partner_id;
-
-        // Check if read is a template with corresponding complement
-        std::unique_lock<std::mutex> tc_lock(m_tc_map_mutex);
-
-        auto it = m_template_complement_map.find(read->read_id);
-        if (it != m_template_complement_map.end()) {
-            partner_id = it->second;
-            tc_lock.unlock();
-            read_is_template = true;
-            partner_found = true;
-        } else {
-            {
-                std::lock_guard<std::mutex> ct_lock(m_ct_map_mutex);
-                auto it = m_complement_template_map.find(read->read_id);
-                if (it != m_complement_template_map.end()) {
-                    partner_id = it->second;
-                    partner_found = true;
-                }
-            }
+        // Every ID in the pairs file parsed, so a read whose ID doesn't has no pair, and is
+        // dropped like any other read without one.
+        utils::ReadIdBytes read_id;
+        if (!utils::parse_read_id(read->read_id, read_id)) {
+            continue;
         }
+        auto pair = m_pairs.find(read_id);
+        if (!pair) {
+            continue;
+        }
+        // Reads wait here for partners the loader has yet to supply, so this mustn't wait on
+        // the budget.
+        read->memory_reservation.try_resize(read->host_memory_bytes());
 
-        if (partner_found) {
-            std::unique_lock<std::mutex> read_cache_lock(m_read_cache_mutex);
-            if (read_cache.find(partner_id) == read_cache.end()) {
-                // Partner is not in the read cache
-                read_cache[read->read_id] = read;
-                read_cache_lock.unlock();
-            } else {
-                auto partner_read_itr = read_cache.find(partner_id);
-                auto partner_read = partner_read_itr->second;
-                read_cache.erase(partner_read_itr);
-                read_cache_lock.unlock();
-
-                std::shared_ptr<Read> template_read;
-                std::shared_ptr<Read> complement_read;
-
-                if (read_is_template) {
-                    template_read = read;
-                    complement_read = partner_read;
-                } else {
-                    complement_read = read;
-                    template_read = partner_read;
-                }
-
-                ReadPair read_pair;
-                read_pair.read_1 = template_read;
-                read_pair.read_2 = complement_read;
-
-                m_sink.push_message(std::make_shared<ReadPair>(read_pair));
+        // Both reads of a pair go to the same cache entry, so whichever comes second finds the
+        // first, however the threads interleave.  A read is spilled before it's cached, as its
+        // partner may take it from the cache at any time after, so a partner already there is
+        // looked for first.
+        std::optional<std::shared_ptr<Read>> partner_read;
+        if (m_spill) {
+            partner_read = m_read_cache.extract(pair->template_id);
+        }
+        if (!partner_read) {
+            spill(*read);
+            partner_read = m_read_cache.extract_or_insert(pair->template_id, read);
+            if (!partner_read) {
+                continue;
             }
+            // The partner came in meanwhile.
+            restore(*read);
         }
+        restore(**partner_read);
+
+        ReadPair read_pair;
+        read_pair.read_1 = pair->is_template ? read : *partner_read;
+        read_pair.read_2 = pair->is_template ? *partner_read : read;
+
+        m_num_pairs_made.fetch_add(1, std::memory_order_relaxed);
+        m_sink.push_message(std::make_shared<ReadPair>(read_pair));
     }
     if (--m_num_worker_threads == 0) {
         m_sink.terminate();
@@ -82,101 +82,306 @@ void PairingNode::pair_list_worker_thread() {
 }
 
 void PairingNode::pair_generating_worker_thread() {
+    utils::set_thread_name("pairing");
     Message message;
     while (m_work_queue.try_pop(message)) {
         // If this message isn't a read, we'll get a bad_variant_access exception.
         auto read = std::get<std::shared_ptr<Read>>(message);
+        m_num_reads_in.fetch_add(1, std::memory_order_relaxed);
 
-        int channel = read->attributes.channel_number;
-        int mux = read->attributes.mux;
-        std::string run_id = read->run_id;
-        std::string flowcell_id = read->flowcell_id;
-
-        int max_num_keys = 10;
-        std::unique_lock<std::mutex> lock(m_pairing_mtx);
-        UniquePoreIdentifierKey key = std::make_tuple(channel, mux, run_id, flowcell_id);
-        auto found = channel_mux_read_map.find(key);
-        // Check if the key is already in the list
-        if (found == channel_mux_read_map.end()) {
-            // Key is not in the dequeue
-
-            if (m_working_channel_mux_keys.size() >= max_num_keys) {
-                // Remove the oldest key (front of the list)
-                auto oldest_key = m_working_channel_mux_keys.front();
-                m_working_channel_mux_keys.pop_front();
-
-                auto oldest_key_it = channel_mux_read_map.find(oldest_key);
-
-                // Remove the oldest key from the map
-                for (auto read_ptr : oldest_key_it->second) {
-                    m_sink.push_message(read_ptr);
-                }
-                channel_mux_read_map.erase(oldest_key);
-                assert(channel_mux_read_map.size() == m_working_channel_mux_keys.size());
-            }
-            // Add the new key to the end of the list
-            m_working_channel_mux_keys.push_back(key);
-        }
-
-        auto compare_reads_by_time = [](const std::shared_ptr<Read>& read1,
-                                        const std::shared_ptr<Read>& read2) {
-            return read1->attributes.start_time < read2->attributes.start_time;
-        };
+        UniquePoreIdentifierKey key = std::make_tuple(
+                read->attributes.channel_number, read->attributes.mux, read->run_id,
+                read->flowcell_id);
 
-        if (channel_mux_read_map.count(key)) {
-            auto later_read =
-                    std::lower_bound(channel_mux_read_map[key].begin(),
-                                     channel_mux_read_map[key].end(), read, compare_reads_by_time);
+        // Never waits, as the reads cached here may be what the budget is waiting on.  The
+        // cache gives memory back instead, below.
+        read->memory_reservation.try_resize(read->host_memory_bytes());
 
-            if (later_read != channel_mux_read_map[key].begin()) {
-                auto earlier_read = std::prev(later_read);
+        // Signal is only spilled and restored once the lock is released, so that reads on other
+        // pores are paired meanwhile, and what's passed on goes once its signal is back.
+        PassOn pass_on;
+        auto signal = std::make_shared<CachedSignal>();
+        {
+            std::lock_guard<std::mutex> lock(m_pairing_mtx);
+            auto& pore_reads = m_pore_reads[key];
+            pore_reads.last_used = ++m_num_reads_seen;
+            pore_reads.latest_start_time_ms =
+                    std::max(pore_reads.latest_start_time_ms, read->start_time_ms);
+            auto& reads = pore_reads.reads;
 
-                if (is_within_time_and_length_criteria(*earlier_read, read)) {
-                    ReadPair pair = {*earlier_read, read};
-                    m_sink.push_message(std::make_shared<ReadPair>(pair));
+            // Reads on a pore don't overlap, so are in the same order by start and end time,
+            // and the only candidates are the reads either side of this one.
+            auto later_read = std::upper_bound(
+                    reads.begin(), reads.end(), read->start_time_ms,
+                    [](uint64_t start_time_ms, const std::shared_ptr<Read>& other) {
+                        return start_time_ms < other->start_time_ms;
+                    });
+            bool paired = false;
+            if (later_read != reads.begin()) {
+                const auto& earlier_read = *std::prev(later_read);
+                if (is_within_time_and_length_criteria(earlier_read, read)) {
+                    pass_on.restores.emplace_back(earlier_read,
+                                                  m_cached_signals.at(earlier_read.get()));
+                    pass_on.messages.push_back(
+                            std::make_shared<ReadPair>(ReadPair{earlier_read, read}));
+                    m_num_pairs_made.fetch_add(1, std::memory_order_relaxed);
+                    paired = true;
                 }
             }
-
-            if (later_read != channel_mux_read_map[key].end()) {
+            if (later_read != reads.end()) {
                 if (is_within_time_and_length_criteria(read, *later_read)) {
-                    ReadPair pair = {read, *later_read};
-                    m_sink.push_message(std::make_shared<ReadPair>(pair));
+                    pass_on.restores.emplace_back(*later_read,
+                                                  m_cached_signals.at(later_read->get()));
+                    pass_on.messages.push_back(
+                            std::make_shared<ReadPair>(ReadPair{read, *later_read}));
+                    m_num_pairs_made.fetch_add(1, std::memory_order_relaxed);
+                    paired = true;
                 }
             }
+            // A read already passed on in a pair is shared with its partner's pair downstream,
+            // so keeps its signal.
+            signal->spill_pending = !paired;
+            signal->bytes = signal->counted_bytes = read->memory_reservation.bytes();
+            m_num_cached_bytes += signal->counted_bytes;
+            m_cached_signals.emplace(read.get(), signal);
+            reads.insert(later_read, read);
+            ++m_num_cached_reads;
 
-            channel_mux_read_map[key].insert(later_read, read);
+            evict_expired_reads(pore_reads, pass_on);
+            while (m_num_cached_reads > m_max_cached_reads || cache_over_memory_budget()) {
+                evict_least_recent_pore(pass_on);
+            }
+        }
 
-        } else {
-            channel_mux_read_map[key].push_back(read);
+        for (auto& [cached_read, cached_signal] : pass_on.restores) {
+            restore_cached(*cached_read, *cached_signal);
+        }
+        for (auto& outgoing : pass_on.messages) {
+            m_sink.push_message(std::move(outgoing));
+        }
+        // Another worker pairing with this read meanwhile waits for the spill, then reads it
+        // back.
+        spill_cached(*read, *signal);
+
+        if (m_spill) {
+            std::lock_guard<std::mutex> lock(m_pairing_mtx);
+            update_cached_bytes(*signal);
+            for (const auto& restored : pass_on.restores) {
+                update_cached_bytes(*restored.second);
+            }
         }
     }
     if (--m_num_worker_threads == 0) {
-        std::unique_lock<std::mutex> lock(m_pairing_mtx);
-        // There are still reads in channel_mux_read_map. Push them to the sink.
+        // There are still reads in m_pore_reads. Push them to the sink.
         // Last thread alive is responsible for cleaning up the cache.
-        for (const auto& kv : channel_mux_read_map) {
-            // kv is a std::pair<UniquePoreIdentifierKey, std::list<std::shared_ptr<Read>>>
-            const auto& reads_list = kv.second;
-
-            for (const auto& read_ptr : reads_list) {
-                // Push each read message
-                m_sink.push_message(read_ptr);
+        PassOn pass_on;
+        {
+            std::lock_guard<std::mutex> lock(m_pairing_mtx);
+            while (!m_pore_reads.empty()) {
+                pass_on_reads(m_pore_reads.begin()->second.reads, pass_on);
+                m_pore_reads.erase(m_pore_reads.begin());
             }
         }
+        for (auto& [read, signal] : pass_on.restores) {
+            restore_cached(*read, *signal);
+        }
+        for (auto& outgoing : pass_on.messages) {
+            m_sink.push_message(std::move(outgoing));
+        }
 
         m_sink.terminate();
     }
 }
 
+void PairingNode::pass_on_reads(std::deque<std::shared_ptr<Read>>& reads,
+                                PassOn& pass_on,
+                                size_t max_reads) {
+    for (size_t i = 0; i < max_reads && !reads.empty(); ++i) {
+        auto& read = reads.front();
+        auto signal = m_cached_signals.extract(read.get());
+        m_num_cached_bytes -= signal.mapped()->counted_bytes;
+        signal.mapped()->cached = false;
+        pass_on.restores.emplace_back(read, std::move(signal.mapped()));
+        pass_on.messages.push_back(std::move(read));
+        reads.pop_front();
+        --m_num_cached_reads;
+    }
+}
+
+void PairingNode::evict_expired_reads(PoreReads& pore_reads, PassOn& pass_on) {
+    auto& reads = pore_reads.reads;
+    size_t num_expired = 0;
+    while (num_expired < reads.size() &&
+           reads[num_expired]->get_end_time_ms() + m_time_horizon_ms <
+                   pore_reads.latest_start_time_ms) {
+        ++num_expired;
+    }
+    pass_on_reads(reads, pass_on, num_expired);
+}
+
+void PairingNode::evict_least_recent_pore(PassOn& pass_on) {
+    auto least_recent = std::min_element(
+            m_pore_reads.begin(), m_pore_reads.end(),
+            [](const auto& a, const auto& b) { return a.second.last_used < b.second.last_used; });
+    pass_on_reads(least_recent->second.reads, pass_on);
+    m_pore_reads.erase(least_recent);
+}
+
+void PairingNode::spill_cached(Read& read, CachedSignal& signal) {
+    std::lock_guard<std::mutex> lock(signal.mutex);
+    if (signal.spill_pending) {
+        signal.spill_pending = false;
+        spill(read);
+        signal.bytes = read.memory_reservation.bytes();
+    }
+}
+
+void PairingNode::restore_cached(Read& read, CachedSignal& signal) {
+    std::lock_guard<std::mutex> lock(signal.mutex);
+    // A read passed on before its spill began is never spilled.
+    signal.spill_pending = false;
+    restore(read);
+    signal.bytes = read.memory_reservation.bytes();
+}
+
+void PairingNode::update_cached_bytes(CachedSignal& signal) {
+    if (signal.cached) {
+        const size_t bytes = signal.bytes;
+        m_num_cached_bytes = m_num_cached_bytes + bytes - signal.counted_bytes;
+        signal.counted_bytes = bytes;
+    }
+}
+
+bool PairingNode::cache_over_memory_budget() const {
+    const auto& budget = utils::MemoryBudget::instance();
+    return !m_pore_reads.empty() && m_num_cached_bytes > budget.limit() / 2 &&
+           budget.has_waiters();
+}
+
+void PairingNode::spill(Read& read) {
+    if (!m_spill || !read.raw_data.defined()) {
+        return;
+    }
+    // Signal nothing downstream reads needn't be written out to be read back.
+    if (!(m_sink.read_fields_used() & ReadFields::RAW_DATA)) {
+        read.release_raw_data();
+        read.memory_reservation.try_resize(read.host_memory_bytes());
+        return;
+    }
+    const auto extent = m_spill->spill(read.raw_data);
+    read.release_raw_data();
+    {
+        std::lock_guard lock(m_spilled_mutex);
+        m_spilled.emplace(&read, extent);
+    }
+    read.memory_reservation.try_resize(read.host_memory_bytes());
+}
+
+void PairingNode::restore(Read& read) {
+    if (!m_spill) {
+        return;
+    }
+    std::optional<utils::SignalSpill::Extent> extent;
+    {
+        std::lock_guard lock(m_spilled_mutex);
+        auto it = m_spilled.find(&read);
+        if (it == m_spilled.end()) {
+            return;
+        }
+        extent = it->second;
+        m_spilled.erase(it);
+    }
+    read.raw_data = m_spill->restore(*extent);
+    // Never waits, for the same reason reads don't as they're cached.
+    read.memory_reservation.try_resize(read.host_memory_bytes());
+}
+
+void PairingNode::load_pairs(const std::map<std::string, std::string>& template_complement_map) {
+    std::vector<std::pair<utils::ReadIdBytes, utils::ReadIdBytes>> pairs(
+            template_complement_map.size());
+    std::vector<const std::pair<const std::string, std::string>*> entries;
+    entries.reserve(template_complement_map.size());
+    for (const auto& entry : template_complement_map) {
+        entries.push_back(&entry);
+    }
+
+    // Parsing the IDs is most of the work, so threads each parse a stripe of the pairs.
+    const size_t num_threads =
+            std::clamp<size_t>(std::thread::hardware_concurrency(), 1, kMaxLoadThreads);
+    std::atomic<size_t> num_invalid{0};
+    auto parse_pairs = [&](size_t first) {
+        for (size_t i = first; i < entries.size(); i += num_threads) {
+            if (!utils::parse_read_id(entries[i]->first, pairs[i].first) ||
+                !utils::parse_read_id(entries[i]->second, pairs[i].second)) {
+                ++num_invalid;
+            }
+        }
+    };
+    // Complements go in before templates, so that a read in two pairs ends up as the template.
+    auto insert_pairs = [&](size_t first, bool templates) {
+        for (size_t i = first; i < entries.size(); i += num_threads) {
+            const auto& [template_id, complement_id] = pairs[i];
+            m_pairs.insert_or_assign(templates ? template_id : complement_id,
+                                     {template_id, templates});
+        }
+    };
+    auto run_threads = [num_threads](const auto& work) {
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < num_threads; ++i) {
+            threads.emplace_back(work, i);
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    };
+
+    run_threads(parse_pairs);
+    if (num_invalid > 0) {
+        throw std::runtime_error("Pairs file has " + std::to_string(num_invalid.load()) +
+                                 " pairs with invalid read ids.");
+    }
+
+    // A read can't be its own complement, and a complement in two pairs would be paired with
+    // whichever template was inserted last.
+    std::vector<utils::ReadIdBytes> complements;
+    complements.reserve(pairs.size());
+    for (size_t i = 0; i < pairs.size(); ++i) {
+        if (pairs[i].first == pairs[i].second) {
+            throw std::runtime_error("Pairs file pairs read " + entries[i]->first +
+                                     " with itself.");
+        }
+        complements.push_back(pairs[i].second);
+    }
+    std::sort(complements.begin(), complements.end());
+    const auto duplicate = std::adjacent_find(complements.begin(), complements.end());
+    if (duplicate != complements.end()) {
+        const auto entry = std::find_if(pairs.begin(), pairs.end(), [&](const auto& pair) {
+            return pair.second == *duplicate;
+        });
+        throw std::runtime_error("Pairs file has complement " +
+                                 entries[entry - pairs.begin()]->second +
+                                 " in more than one pair.");
+    }
+    m_pairs.reserve(2 * pairs.size());
+    run_threads([&](size_t first) { insert_pairs(first, false); });
+    run_threads([&](size_t first) { insert_pairs(first, true); });
+}
+
 PairingNode::PairingNode(MessageSink& sink,
-                         std::optional<std::map<std::string, std::string>> template_complement_map)
-        : m_sink(sink), MessageSink(1000), m_num_worker_threads(2) {
+                         std::optional<std::map<std::string, std::string>> template_complement_map,
+                         uint64_t time_horizon_ms,
+                         size_t max_cached_reads,
+                         const std::filesystem::path& spill_directory)
+        : MessageSink(1000),
+          m_sink(sink),
+          m_num_worker_threads(2),
+          m_time_horizon_ms(time_horizon_ms),
+          m_max_cached_reads(max_cached_reads) {
+    if (!spill_directory.empty()) {
+        m_spill = std::make_unique<utils::SignalSpill>(spill_directory);
+    }
     if (template_complement_map.has_value()) {
-        m_template_complement_map = template_complement_map.value();
-        // Set up the complement-template_map
-        for (auto& key : m_template_complement_map) {
-            m_complement_template_map[key.second] = key.first;
-        }
+        load_pairs(*template_complement_map);
 
         for (size_t i = 0; i < m_num_worker_threads; i++) {
             m_workers.push_back(std::make_unique<std::thread>(
@@ -196,4 +401,18 @@ PairingNode::~PairingNode() {
         m->join();
     }
 }
+
+void PairingNode::add_metrics(utils::MetricsRegistry& registry) const {
+    using Type = utils::MetricsRegistry::Type;
+    registry.add("dorado_pairing_reads_total", "Reads taken in for pairing.", Type::COUNTER,
+                 [this] { return m_num_reads_in.load(); });
+    registry.add("dorado_pairing_pairs_total", "Pairs made of the reads taken in.",
+                 Type::COUNTER, [this] { return m_num_pairs_made.load(); });
+    if (m_spill) {
+        registry.add("dorado_pairing_spilled_bytes",
+                     "Signal of the reads waiting for partners spilled to the scratch file.",
+                     Type::GAUGE, [this] { return double(m_spill->spilled_bytes()); });
+    }
+}
+
 }  // namespace dorado
@@ -1,48 +1,150 @@
 #pragma once
 
 #include "ReadPipeline.h"
+#include "utils/ReadIdMap.h"
+#include "utils/SignalSpill.h"
 
 #include <atomic>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <limits>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace dorado {
 
+namespace utils {
+class MetricsRegistry;
+}
+
 class PairingNode : public MessageSink {
 public:
+    // Without a template_complement_map, pairs are generated from reads on the same pore within
+    // time_horizon_ms of the latest read on it, of which up to max_cached_reads are kept.
+    // With a spill_directory, the signal of the reads waiting for partners is spilled to a
+    // scratch file there, and read back as they're passed on.
     PairingNode(MessageSink& sink,
-                std::optional<std::map<std::string, std::string>> = std::nullopt);
+                std::optional<std::map<std::string, std::string>> template_complement_map =
+                        std::nullopt,
+                uint64_t time_horizon_ms = 60000,
+                size_t max_cached_reads = 10000,
+                const std::filesystem::path& spill_directory = {});
     ~PairingNode();
 
+    // Adds the reads taken in and the pairs made from them so far to registry.
+    void add_metrics(utils::MetricsRegistry& registry) const;
+
 private:
     void pair_list_worker_thread();
     void pair_generating_worker_thread();
 
     // A key for a unique Pore, Duplex reads must have the same UniquePoreIdentifierKey
     // The values are channel, mux, run_id, flowcell_id
-    using UniquePoreIdentifierKey = std::tuple<int, int, std::string, std::string>;
+    using UniquePoreIdentifierKey =
+            std::tuple<int, int, utils::InternedString, utils::InternedString>;
+
+    // The pair a read from the pairs file is in.
+    struct PairEntry {
+        utils::ReadIdBytes template_id;
+        bool is_template;
+    };
+
+    // Fills m_pairs from template_complement_map, parsing the read IDs on several threads.
+    void load_pairs(const std::map<std::string, std::string>& template_complement_map);
 
     std::vector<std::unique_ptr<std::thread>> m_workers;
     MessageSink& m_sink;
-    std::map<std::string, std::string> m_template_complement_map;
-    std::map<std::string, std::string> m_complement_template_map;
-
-    std::mutex m_tc_map_mutex;
-    std::mutex m_ct_map_mutex;
-    std::mutex m_read_cache_mutex;
+    // Both the template and complement of every pair, where a read which is a template in one
+    // pair and a complement in another is taken as the template.
+    utils::ReadIdMap<PairEntry> m_pairs;
 
     std::atomic<int> m_num_worker_threads;
 
-    std::map<std::string, std::shared_ptr<Read>> read_cache;
+    // Reads taken in, and pairs made of them.
+    std::atomic<int64_t> m_num_reads_in{0};
+    std::atomic<int64_t> m_num_pairs_made{0};
+
+    // The first read of each pair to arrive, by template ID, until its partner does.
+    utils::ReadIdMap<std::shared_ptr<Read>> m_read_cache;
 
-    std::map<UniquePoreIdentifierKey, std::list<std::shared_ptr<Read>>> channel_mux_read_map;
+    // The reads from one pore which may still be paired.
+    struct PoreReads {
+        std::deque<std::shared_ptr<Read>> reads;  // In order of start_time_ms.
+        uint64_t latest_start_time_ms = 0;
+        uint64_t last_used = 0;  // The value of m_num_reads_seen when a read last came in.
+    };
 
-    std::deque<UniquePoreIdentifierKey> m_working_channel_mux_keys;
+    // The signal of a read in m_pore_reads, which is spilled and restored outside
+    // m_pairing_mtx, so that other reads are paired meanwhile.
+    struct CachedSignal {
+        // Held while the signal is spilled or restored, so that a read being passed on waits
+        // for its signal to be back.
+        std::mutex mutex;
+        bool spill_pending{false};
+        // What the read reserves since it was last spilled or restored.
+        std::atomic<size_t> bytes{0};
+        // Under m_pairing_mtx: what m_num_cached_bytes counts for the read, brought up to date
+        // with bytes after each spill or restore, while it's still cached.
+        size_t counted_bytes{0};
+        bool cached{true};
+    };
+    // What a worker passes on once it releases m_pairing_mtx, after restoring the signal of the
+    // cached reads they hold.
+    struct PassOn {
+        std::vector<std::pair<std::shared_ptr<Read>, std::shared_ptr<CachedSignal>>> restores;
+        std::vector<Message> messages;
+    };
+
+    // Moves up to max_reads from the front of reads, which are cached, to pass_on.
+    // m_pairing_mtx must be held, as for the evictions.
+    void pass_on_reads(std::deque<std::shared_ptr<Read>>& reads,
+                       PassOn& pass_on,
+                       size_t max_reads = std::numeric_limits<size_t>::max());
+    // Passes on the reads of pore_reads which ended more than m_time_horizon_ms before its
+    // latest read started.
+    void evict_expired_reads(PoreReads& pore_reads, PassOn& pass_on);
+    // Passes on all the reads of the pore least recently given a read, making way for others.
+    void evict_least_recent_pore(PassOn& pass_on);
+    // Whether others are waiting on the host memory budget while the cache holds more than
+    // half of it, in which case the cache should give some of it up.
+    bool cache_over_memory_budget() const;
+
+    // Moves the signal of a read being cached to m_spill, if there is one, shrinking its
+    // memory reservation.  The read mustn't have been passed on.
+    void spill(Read& read);
+    // Reads a read's signal back from m_spill, if it was spilled, before it's passed on.  Its
+    // reservation grows again unless that would have to wait.
+    void restore(Read& read);
+    // spill() and restore() for a read in m_pore_reads, without m_pairing_mtx.  A read is only
+    // spilled if it hasn't been restored to be passed on in the meantime.
+    void spill_cached(Read& read, CachedSignal& signal);
+    void restore_cached(Read& read, CachedSignal& signal);
+    // Brings m_num_cached_bytes up to date with signal.  m_pairing_mtx must be held.
+    void update_cached_bytes(CachedSignal& signal);
+
+    const uint64_t m_time_horizon_ms;
+    const size_t m_max_cached_reads;
+
+    std::map<UniquePoreIdentifierKey, PoreReads> m_pore_reads;
+    size_t m_num_cached_reads{0};
+    size_t m_num_cached_bytes{0};  // Reserved by the cached reads.
+    uint64_t m_num_reads_seen{0};
 
     std::mutex m_pairing_mtx;
+    // The signal state of each read in m_pore_reads.
+    std::unordered_map<const Read*, std::shared_ptr<CachedSignal>> m_cached_signals;
+
+    std::unique_ptr<utils::SignalSpill> m_spill;
+    // Where the signal of each read spilled went.
+    std::mutex m_spilled_mutex;
+    std::unordered_map<const Read*, utils::SignalSpill::Extent> m_spilled;
 };
 
 }  // namespace dorado
@@ -0,0 +1,165 @@
+#include "PipelineTelemetry.h"
+
+#include <spdlog/spdlog.h>
+
+#include <stdexcept>
+
+namespace dorado {
+
+PipelineTelemetry::PipelineTelemetry(std::chrono::milliseconds sample_interval,
+                                     const std::string& output_path)
+        : m_sample_interval(sample_interval),
+          m_start_time(std::chrono::steady_clock::now()),
+          m_last_sample_time(m_start_time) {
+    if (!output_path.empty()) {
+        // Appended to, so that the runs of a server all end up in the one file.
+        m_output.open(output_path, std::ios::app);
+        if (!m_output) {
+            throw std::runtime_error("Unable to open telemetry file " + output_path);
+        }
+        if (m_output.tellp() == 0) {
+            m_output << "time_s\tnode\tqueue_size\tqueue_capacity\tmessages_per_s\tpush_blocked"
+                        "\tpop_waiting\n";
+        }
+    }
+}
+
+PipelineTelemetry::~PipelineTelemetry() { stop(); }
+
+void PipelineTelemetry::add_node(std::string name, const MessageSink& node, std::string hint) {
+    if (m_thread) {
+        throw std::runtime_error("Nodes must be added before telemetry is started.");
+    }
+    m_nodes.push_back({std::move(name), &node, std::move(hint), node.get_queue_stats()});
+}
+
+void PipelineTelemetry::start() {
+    if (!m_thread && !m_nodes.empty()) {
+        m_start_time = std::chrono::steady_clock::now();
+        m_last_sample_time = m_start_time;
+        for (auto& node : m_nodes) {
+            node.last_stats = node.node->get_queue_stats();
+        }
+        m_thread = std::make_unique<std::thread>(&PipelineTelemetry::sampling_thread, this);
+    }
+}
+
+void PipelineTelemetry::stop() {
+    {
+        std::lock_guard lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    if (m_thread) {
+        m_thread->join();
+        m_thread.reset();
+        // The last part interval, so that the file covers the whole run.
+        report(sample());
+    }
+}
+
+std::vector<PipelineTelemetry::NodeSample> PipelineTelemetry::sample() {
+    const auto now = std::chrono::steady_clock::now();
+    const double interval_s =
+            std::max(std::chrono::duration<double>(now - m_last_sample_time).count(), 1e-9);
+    const double time_s = std::chrono::duration<double>(now - m_start_time).count();
+    m_last_sample_time = now;
+
+    std::vector<NodeSample> samples;
+    samples.reserve(m_nodes.size());
+    for (auto& node : m_nodes) {
+        const auto stats = node.node->get_queue_stats();
+        const auto& last = node.last_stats;
+        NodeSample sample;
+        sample.name = node.name;
+        sample.time_s = time_s;
+        sample.queue_size = stats.size;
+        sample.queue_capacity = stats.capacity;
+        sample.messages_per_s = (stats.num_popped - last.num_popped) / interval_s;
+        sample.push_blocked = (stats.push_blocked_ns - last.push_blocked_ns) * 1e-9 / interval_s;
+        sample.pop_waiting = (stats.pop_waiting_ns - last.pop_waiting_ns) * 1e-9 / interval_s;
+        samples.push_back(std::move(sample));
+        node.push_blocked_s += (stats.push_blocked_ns - last.push_blocked_ns) * 1e-9;
+        node.last_stats = stats;
+    }
+    return samples;
+}
+
+std::optional<size_t> PipelineTelemetry::find_bottleneck(const std::vector<NodeSample>& samples) {
+    for (size_t i = samples.size(); i > 0; --i) {
+        if (samples[i - 1].push_blocked >= kBlockedThreshold) {
+            return i - 1;
+        }
+    }
+    return std::nullopt;
+}
+
+void PipelineTelemetry::diagnose(const std::vector<NodeSample>& samples) {
+    ++m_num_samples;
+    const auto bottleneck = find_bottleneck(samples);
+    if (bottleneck) {
+        ++m_nodes[*bottleneck].bottleneck_samples;
+    }
+    m_bottleneck_streak = bottleneck == m_bottleneck ? m_bottleneck_streak + 1 : 1;
+    m_bottleneck = bottleneck;
+
+    // Only a settled bottleneck is worth reporting, and only once until it moves.
+    if (bottleneck && m_bottleneck_streak == kStallSamples && bottleneck != m_reported_bottleneck) {
+        const auto& node = m_nodes[*bottleneck];
+        const auto& sample = samples[*bottleneck];
+        spdlog::info("> Pipeline is held back by {}: producers blocked {:.0f}% of the time{}{}",
+                     node.name, 100 * sample.push_blocked, node.hint.empty() ? "" : " - ",
+                     node.hint);
+        m_reported_bottleneck = bottleneck;
+    }
+}
+
+void PipelineTelemetry::summary() const {
+    if (m_num_samples == 0) {
+        return;
+    }
+    const NodeInfo* worst = nullptr;
+    for (const auto& node : m_nodes) {
+        spdlog::debug("> {}: bottleneck for {:.0f}% of the run, producers blocked {:.1f}s",
+                      node.name, 100.0 * node.bottleneck_samples / m_num_samples,
+                      node.push_blocked_s);
+        if (node.bottleneck_samples > 0 &&
+            (!worst || node.bottleneck_samples > worst->bottleneck_samples)) {
+            worst = &node;
+        }
+    }
+    if (!worst) {
+        spdlog::info("> No pipeline stage held the others back");
+        return;
+    }
+    spdlog::info("> Pipeline bottleneck: {} for {:.0f}% of the run{}{}", worst->name,
+                 100.0 * worst->bottleneck_samples / m_num_samples,
+                 worst->hint.empty() ? "" : " - ", worst->hint);
+}
+
+void PipelineTelemetry::report(const std::vector<NodeSample>& samples) {
+    diagnose(samples);
+    for (const auto& sample : samples) {
+        spdlog::debug("> {}: queue {}/{}, {:.1f} messages/s, push blocked {:.0f}%, pop waiting "
+                      "{:.0f}%",
+                      sample.name, sample.queue_size, sample.queue_capacity,
+                      sample.messages_per_s, 100 * sample.push_blocked, 100 * sample.pop_waiting);
+        if (m_output.is_open()) {
+            m_output << sample.time_s << '\t' << sample.name << '\t' << sample.queue_size << '\t'
+                     << sample.queue_capacity << '\t' << sample.messages_per_s << '\t'
+                     << sample.push_blocked << '\t' << sample.pop_waiting << '\n';
+        }
+    }
+    if (m_output.is_open()) {
+        m_output.flush();
+    }
+}
+
+void PipelineTelemetry::sampling_thread() {
+    std::unique_lock lock(m_mutex);
+    while (!m_cv.wait_for(lock, m_sample_interval, [this] { return m_stop; })) {
+        report(sample());
+    }
+}
+
+}  // namespace dorado
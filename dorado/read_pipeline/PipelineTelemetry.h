@@ -0,0 +1,106 @@
+#pragma once
+
+#include "ReadPipeline.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dorado {
+
+// Periodically samples the input queue of every registered pipeline node, and reports for
+// each interval how many messages the node took, how full its queue was, and how much of the
+// time its producers were blocked on a full queue and its workers were waiting on an empty one.
+// A node whose producers are blocked is the bottleneck; one whose workers are waiting is
+// starved by something upstream.  Samples are logged at debug level, so show with --verbose,
+// and can also be appended to a tab-separated file for plotting.
+//
+// From the samples the telemetry also diagnoses which node holds the pipeline back: the most
+// downstream one whose producers spent a good part of the interval blocked, since anything above
+// it is only blocked on it in turn.  When the same node has been the bottleneck for a while its
+// hint is logged, and summary() says over how much of the run each node was the bottleneck.
+class PipelineTelemetry {
+public:
+    struct NodeSample {
+        std::string name;
+        // Seconds since start() at the end of the interval.
+        double time_s;
+        size_t queue_size;
+        size_t queue_capacity;
+        double messages_per_s;
+        // Time spent waiting over the interval, summed over threads, as a fraction of the
+        // interval's length.  Values above 1 mean several threads were waiting at once.
+        double push_blocked;
+        double pop_waiting;
+    };
+
+    // If output_path isn't empty, samples are appended to that file.
+    explicit PipelineTelemetry(
+            std::chrono::milliseconds sample_interval = std::chrono::milliseconds(1000),
+            const std::string& output_path = "");
+    ~PipelineTelemetry();
+
+    // Nodes are added in pipeline order, from upstream to downstream.  hint says what to do
+    // when the node is the bottleneck.  The node must outlive the telemetry, or stop() must be
+    // called first.
+    void add_node(std::string name, const MessageSink& node, std::string hint = "");
+
+    // Starts sampling in the background.  Nodes must be added before starting.
+    void start();
+    void stop();
+
+    // Samples every node, giving the changes since the last sample, or since nodes were
+    // added.  Exposed for testing.
+    std::vector<NodeSample> sample();
+
+    // The index of the node holding the pipeline back over an interval, if any node was.
+    static std::optional<size_t> find_bottleneck(const std::vector<NodeSample>& samples);
+
+    // Logs where the pipeline spent its time blocked over the run, and the hint for the node that
+    // was most often the bottleneck.  Call after stop().
+    void summary() const;
+
+private:
+    struct NodeInfo {
+        std::string name;
+        const MessageSink* node;
+        std::string hint;
+        LockFreeQueue<Message>::Stats last_stats;
+        // Over the run.
+        size_t bottleneck_samples{0};
+        double push_blocked_s{0};
+    };
+
+    // The fraction of an interval producers must have spent blocked.
+    static constexpr double kBlockedThreshold = 0.25;
+    // The intervals one node must be the bottleneck in a row before its hint is logged.
+    static constexpr size_t kStallSamples = 10;
+
+    void sampling_thread();
+    void report(const std::vector<NodeSample>& samples);
+    void diagnose(const std::vector<NodeSample>& samples);
+
+    std::vector<NodeInfo> m_nodes;
+    std::chrono::milliseconds m_sample_interval;
+    std::chrono::steady_clock::time_point m_start_time;
+    std::chrono::steady_clock::time_point m_last_sample_time;
+    std::ofstream m_output;
+
+    size_t m_num_samples{0};
+    std::optional<size_t> m_bottleneck;
+    size_t m_bottleneck_streak{0};
+    std::optional<size_t> m_reported_bottleneck;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_stop{false};
+    std::unique_ptr<std::thread> m_thread;
+};
+
+}  // namespace dorado
@@ -1,12 +1,14 @@
 #include "ReadFilterNode.h"
 
 #include "utils/sequence_utils.h"
+#include "utils/thread_utils.h"
 
 #include <spdlog/spdlog.h>
 
 namespace dorado {
 
 void ReadFilterNode::worker_thread() {
+    utils::set_thread_name("read_filter");
     m_active_threads++;
 
     Message message;
@@ -18,6 +20,9 @@ void ReadFilterNode::worker_thread() {
         if ((utils::mean_qscore_from_qstring(read->qstring) < m_min_qscore) ||
             read->seq.size() < m_min_read_length) {
             ++m_num_reads_filtered;
+            if (m_on_read_dropped) {
+                m_on_read_dropped(*read);
+            }
         } else {
             m_sink.push_message(read);
         }
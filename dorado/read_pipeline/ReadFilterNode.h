@@ -3,6 +3,7 @@
 #include "ReadPipeline.h"
 
 #include <atomic>
+#include <functional>
 #include <memory>
 #include <string>
 #include <thread>
@@ -23,6 +24,13 @@ public:
                    size_t min_read_length,
                    size_t num_worker_threads);
     ~ReadFilterNode();
+    uint32_t read_fields_used() const override { return m_sink.read_fields_used(); }
+
+    // Called from the worker threads with each read filtered out, e.g. for a ReorderNode to
+    // skip it.  Must be set before any reads are pushed.
+    void set_on_read_dropped(std::function<void(const Read&)> on_dropped) {
+        m_on_read_dropped = std::move(on_dropped);
+    }
 
 private:
     MessageSink& m_sink;
@@ -35,6 +43,7 @@ private:
     size_t m_min_qscore;
     size_t m_min_read_length;
     std::atomic<size_t> m_num_reads_filtered;
+    std::function<void(const Read&)> m_on_read_dropped;
 };
 
 }  // namespace dorado
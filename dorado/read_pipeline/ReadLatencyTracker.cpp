@@ -0,0 +1,112 @@
+#include "ReadLatencyTracker.h"
+
+#include "utils/MetricsServer.h"
+
+#include <spdlog/spdlog.h>
+
+#include <array>
+#include <chrono>
+#include <stdexcept>
+
+namespace {
+
+using dorado::utils::LatencyHistogram;
+
+constexpr std::array<double, 4> kPercentiles{50, 90, 99, 99.9};
+
+std::string format_percentiles(const LatencyHistogram& histogram) {
+    std::string text;
+    for (const double percentile : kPercentiles) {
+        text += fmt::format("p{} {:.3f}s, ", percentile,
+                            histogram.value_at_percentile(percentile) * 1e-6);
+    }
+    return text + fmt::format("max {:.3f}s", histogram.max() * 1e-6);
+}
+
+}  // namespace
+
+namespace dorado {
+
+ReadLatencyTracker::~ReadLatencyTracker() {
+    for (auto& stage : m_stages) {
+        stage.node->set_latency_tracker(nullptr, 0);
+    }
+}
+
+void ReadLatencyTracker::add_stage(std::string name, MessageSink& node) {
+    if (m_stages.size() == Read::kMaxLatencyStages) {
+        throw std::runtime_error("Reads can only be followed through " +
+                                 std::to_string(Read::kMaxLatencyStages) + " stages.");
+    }
+    node.set_latency_tracker(this, m_stages.size());
+    m_stages.push_back({std::move(name), &node, std::make_unique<utils::LatencyHistogram>()});
+}
+
+void ReadLatencyTracker::stamp(size_t stage, const Message& message) {
+    if (!std::holds_alternative<std::shared_ptr<Read>>(message)) {
+        return;
+    }
+    auto& read = *std::get<std::shared_ptr<Read>>(message);
+    const int64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   std::chrono::steady_clock::now().time_since_epoch())
+                                   .count();
+    if (read.latency_stages_reached == 0) {
+        read.latency_start_ns = now_ns;
+    }
+    read.latency_stage_us[stage] = uint32_t((now_ns - read.latency_start_ns) / 1000);
+    read.latency_stages_reached |= uint8_t(1) << stage;
+    if (stage + 1 != m_stages.size()) {
+        return;
+    }
+
+    // The read is done, so each stage it passed through takes it until the next.
+    size_t next = stage;
+    for (size_t i = stage; i-- > 0;) {
+        if (read.latency_stages_reached & (uint8_t(1) << i)) {
+            m_stages[i].latency->record(read.latency_stage_us[next] - read.latency_stage_us[i]);
+            next = i;
+        }
+    }
+    m_total.record(read.latency_stage_us[stage]);
+}
+
+const utils::LatencyHistogram& ReadLatencyTracker::stage_latency(size_t stage) const {
+    return *m_stages.at(stage).latency;
+}
+
+void ReadLatencyTracker::log_summary() const {
+    if (m_total.count() == 0) {
+        return;
+    }
+    spdlog::info("> Read latency over {} reads: {}", m_total.count(), format_percentiles(m_total));
+    for (size_t i = 0; i + 1 < m_stages.size(); ++i) {
+        spdlog::info(">   {}: {}", m_stages[i].name, format_percentiles(*m_stages[i].latency));
+    }
+}
+
+void ReadLatencyTracker::add_metrics(utils::MetricsRegistry& registry) const {
+    using Type = utils::MetricsRegistry::Type;
+    auto add_histogram = [&registry](const LatencyHistogram& histogram,
+                                     const std::string& stage) {
+        const std::string labels = "stage=\"" + stage + "\"";
+        for (const double percentile : kPercentiles) {
+            registry.add(
+                    "dorado_read_latency_seconds",
+                    "Time reads took from entering a stage to entering the next, or from "
+                    "loading to output for the total, at each quantile.",
+                    Type::GAUGE,
+                    [&histogram, percentile] {
+                        return histogram.value_at_percentile(percentile) * 1e-6;
+                    },
+                    labels + ",quantile=\"" + fmt::format("{}", percentile / 100) + "\"");
+        }
+        registry.add("dorado_read_latency_reads_total", "Reads whose latency has been counted.",
+                     Type::COUNTER, [&histogram] { return histogram.count(); }, labels);
+    };
+    add_histogram(m_total, "total");
+    for (size_t i = 0; i + 1 < m_stages.size(); ++i) {
+        add_histogram(*m_stages[i].latency, m_stages[i].name);
+    }
+}
+
+}  // namespace dorado
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "ReadPipeline.h"
+#include "utils/LatencyHistogram.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dorado {
+
+namespace utils {
+class MetricsRegistry;
+}
+
+// Follows reads through a pipeline, for tail latencies from loading to output.  Each node added
+// as a stage timestamps the reads pushed to it on the read itself, and once a read enters the
+// last stage the time it spent in each stage before, from entering it to entering the next
+// stage it reached, is added to that stage's histogram, and the time since it entered the first
+// to the total's.  Reads which don't reach the last stage, such as those filtered out, aren't
+// counted.  Nodes which aren't stages cost nothing.
+class ReadLatencyTracker {
+public:
+    ReadLatencyTracker() = default;
+    ~ReadLatencyTracker();
+    ReadLatencyTracker(const ReadLatencyTracker&) = delete;
+    ReadLatencyTracker& operator=(const ReadLatencyTracker&) = delete;
+
+    // Stages are added in pipeline order, up to Read::kMaxLatencyStages of them.  Nodes
+    // timestamp reads until the tracker is destroyed, which must be before they are.
+    void add_stage(std::string name, MessageSink& node);
+
+    // Called by the stage's node as a message is pushed to it.
+    void stamp(size_t stage, const Message& message);
+
+    // The number of stages, and the histogram of the time reads spent in one.  The last stage
+    // has no histogram of its own, since reads are counted on entering it.
+    size_t num_stages() const { return m_stages.size(); }
+    const utils::LatencyHistogram& stage_latency(size_t stage) const;
+    const utils::LatencyHistogram& total_latency() const { return m_total; }
+
+    // Logs the percentiles of the total and per stage latencies.
+    void log_summary() const;
+    // Adds the latency percentiles, in seconds, and the reads counted to registry.
+    void add_metrics(utils::MetricsRegistry& registry) const;
+
+private:
+    struct Stage {
+        std::string name;
+        MessageSink* node;
+        std::unique_ptr<utils::LatencyHistogram> latency;
+    };
+
+    std::vector<Stage> m_stages;
+    utils::LatencyHistogram m_total;
+};
+
+}  // namespace dorado
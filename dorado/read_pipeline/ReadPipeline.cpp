@@ -1,12 +1,17 @@
 #include "ReadPipeline.h"
 
+#include "ReadLatencyTracker.h"
+
 #include "htslib/sam.h"
 #include "utils/base_mod_utils.h"
 #include "utils/sequence_utils.h"
 
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <charconv>
 #include <chrono>
+#include <cstring>
 #include <iomanip>
 #include <sstream>
 
@@ -42,18 +47,76 @@ bool get_modbase_channel_name(std::string &channel_name, const std::string &mod_
     spdlog::error("Unknown modified base abbreviation: {}", mod_abbreviation);
     return false;
 }
+
+// Appends a B array tag of count single byte values to aln, and returns where they go, for the
+// caller to fill in.  Saves building the array elsewhere just for bam_aux_update_array to copy.
+uint8_t *append_byte_array_tag(bam1_t *aln, const char *tag, char subtype, uint32_t count) {
+    const size_t tag_size = 2 + 1 + 1 + sizeof(count) + count;
+    if (aln->l_data + tag_size > aln->m_data &&
+        sam_realloc_bam_data(aln, aln->l_data + tag_size) < 0) {
+        throw std::runtime_error("Failed to allocate memory for BAM tag " + std::string(tag));
+    }
+    uint8_t *data = aln->data + aln->l_data;
+    data[0] = tag[0];
+    data[1] = tag[1];
+    data[2] = 'B';
+    data[3] = subtype;
+    std::memcpy(data + 4, &count, sizeof(count));
+    aln->l_data += tag_size;
+    return data + 4 + sizeof(count);
+}
+
+void append_modbase_tag_values(bam1_t *aln,
+                               const std::string &modbase_string,
+                               const std::vector<uint8_t> &modbase_probs) {
+    bam_aux_append(aln, "MM", 'Z', modbase_string.length() + 1,
+                   (uint8_t *)modbase_string.c_str());
+    std::copy(modbase_probs.begin(), modbase_probs.end(),
+              append_byte_array_tag(aln, "ML", 'C', modbase_probs.size()));
+}
+
+void append_number(std::string &str, int number) {
+    char digits[16];
+    const auto result = std::to_chars(std::begin(digits), std::end(digits), number);
+    str.append(digits, result.ptr);
+}
+
 }  // namespace
 
 namespace dorado {
 
+void Read::release_raw_data() {
+    if (raw_data.defined()) {
+        released_raw_data_size = raw_data.size(0);
+        raw_data = torch::Tensor();
+    }
+}
+
+int64_t Read::raw_data_size() const {
+    return raw_data.defined() ? raw_data.size(0) : std::max<int64_t>(released_raw_data_size, 0);
+}
+
+size_t Read::host_memory_bytes() const {
+    size_t bytes = sizeof(Read) + seq.size() + qstring.size() + moves.memory_bytes() +
+                   base_mod_positions.size() * sizeof(uint32_t) + base_mod_probs.size() +
+                   called_chunks.capacity() * sizeof(Chunk);
+    if (raw_data.defined() && raw_data.device().is_cpu()) {
+        bytes += raw_data.nbytes();
+    }
+    for (const auto &chunk : called_chunks) {
+        bytes += chunk.seq.size() + chunk.qstring.size() + chunk.moves.memory_bytes();
+    }
+    return bytes;
+}
+
 void Read::generate_read_tags(bam1_t *aln, bool emit_moves) const {
     int qs = static_cast<int>(std::round(utils::mean_qscore_from_qstring(qstring)));
     bam_aux_append(aln, "qs", 'i', sizeof(qs), (uint8_t *)&qs);
 
-    float du = (float)(raw_data.size(0) + num_trimmed_samples) / (float)sample_rate;
+    float du = (float)(raw_data_size() + num_trimmed_samples) / (float)sample_rate;
     bam_aux_append(aln, "du", 'f', sizeof(du), (uint8_t *)&du);
 
-    int ns = raw_data.size(0) + num_trimmed_samples;
+    int ns = raw_data_size() + num_trimmed_samples;
     bam_aux_append(aln, "ns", 'i', sizeof(ns), (uint8_t *)&ns);
 
     int ts = num_trimmed_samples;
@@ -86,21 +149,30 @@ void Read::generate_read_tags(bam1_t *aln, bool emit_moves) const {
     uint32_t duplex = 0;
     bam_aux_append(aln, "dx", 'i', sizeof(duplex), (uint8_t *)&duplex);
 
-    if (run_id != "" && model_name != "") {
-        std::string rg(run_id + "_" + model_name);
+    if (const auto rg = read_group(); !rg.empty()) {
         bam_aux_append(aln, "RG", 'Z', rg.length() + 1, (uint8_t *)rg.c_str());
     }
 
     if (emit_moves) {
-        std::vector<uint8_t> m(moves.size() + 1, 0);
+        uint8_t *m = append_byte_array_tag(aln, "mv", 'c', moves.size() + 1);
         m[0] = model_stride;
+        moves.unpack(m + 1);
+    }
+}
 
-        for (size_t idx = 0; idx < moves.size(); idx++) {
-            m[idx + 1] = static_cast<uint8_t>(moves[idx]);
-        }
-
-        bam_aux_update_array(aln, "mv", 'c', m.size(), (uint8_t *)m.data());
+utils::InternedString Read::read_group() const {
+    thread_local utils::InternedString cached_run_id;
+    thread_local utils::InternedString cached_model_name;
+    thread_local utils::InternedString cached_read_group;
+    if (run_id != cached_run_id || model_name != cached_model_name) {
+        cached_run_id = run_id;
+        cached_model_name = model_name;
+        cached_read_group = (run_id.empty() || model_name.empty())
+                                    ? utils::InternedString()
+                                    : utils::InternedString(run_id.str() + "_" +
+                                                            model_name.str());
     }
+    return cached_read_group;
 }
 
 void Read::generate_duplex_read_tags(bam1_t *aln) const {
@@ -121,6 +193,13 @@ std::vector<BamPtr> Read::extract_sam_lines(bool emit_moves, uint8_t modbase_thr
         throw std::runtime_error("Empty sequence and qstring provided for read id " + read_id);
     }
 
+    // The modified base tags are formatted first, so that the record's data can be allocated
+    // once, big enough for every tag.  The buffers are kept from read to read.
+    thread_local std::string modbase_string;
+    thread_local std::vector<uint8_t> modbase_probs;
+    const bool has_modbase_tags =
+            generate_modbase_tags(modbase_string, modbase_probs, modbase_threshold);
+
     std::vector<BamPtr> alns;
     if (mappings.empty()) {
         bam1_t *aln = bam_init1();
@@ -133,20 +212,49 @@ std::vector<BamPtr> Read::extract_sam_lines(bool emit_moves, uint8_t modbase_thr
         int next_pos = -1;  // UNMAPPED - will be written as 0
         size_t template_length = seq.size();
 
-        // Convert string qscore to phred vector.
-        std::vector<uint8_t> qscore;
-        std::transform(qstring.begin(), qstring.end(), std::back_inserter(qscore),
-                       [](char c) { return (uint8_t)(c)-33; });
+        constexpr size_t kNumericTagSize = 2 + 1 + 4;
+        constexpr size_t kStringTagSize = 2 + 1 + 1;
+        constexpr size_t kArrayTagSize = 2 + 1 + 1 + 4;
+        size_t aux_size;
+        if (is_duplex) {
+            aux_size = 2 * kNumericTagSize;
+        } else {
+            // qs, du, ns, ts, mx, ch, rn, sm, sd and dx, then st, fn, sv and RG.
+            aux_size = 10 * kNumericTagSize + 4 * kStringTagSize +
+                       attributes.start_time.size() + attributes.fast5_filename.size() +
+                       std::strlen("quantile") + read_group().size();
+            if (emit_moves) {
+                aux_size += kArrayTagSize + moves.size() + 1;
+            }
+        }
+        if (has_modbase_tags) {
+            aux_size += kStringTagSize + modbase_string.size() + kArrayTagSize +
+                        modbase_probs.size();
+        }
 
-        bam_set1(aln, read_id.length(), read_id.c_str(), flags, -1, leftmost_pos, map_q, 0, nullptr,
-                 -1, next_pos, 0, seq.length(), seq.c_str(), (char *)qscore.data(), 0);
+        // With no qualities given, bam_set1 leaves room for them, and they're written straight
+        // into the record.
+        if (bam_set1(aln, read_id.length(), read_id.c_str(), flags, -1, leftmost_pos, map_q, 0,
+                     nullptr, -1, next_pos, 0, seq.length(), seq.c_str(), nullptr, aux_size) < 0) {
+            bam_destroy1(aln);
+            throw std::runtime_error("Failed to create BAM record for read id " + read_id);
+        }
+        // The record has room for seq.length() qualities, which is bounded by rather than
+        // relying on the size check above.
+        uint8_t *qual = bam_get_qual(aln);
+        for (size_t i = 0; i < seq.length(); ++i) {
+            qual[i] = static_cast<uint8_t>(qstring[i] - 33);
+        }
 
         if (is_duplex) {
             generate_duplex_read_tags(aln);
         } else {
             generate_read_tags(aln, emit_moves);
         }
-        generate_modbase_string(aln, modbase_threshold);
+        if (has_modbase_tags) {
+            append_modbase_tag_values(aln, modbase_string, modbase_probs);
+        }
+        aln->id = sequence_number;
         alns.push_back(BamPtr(aln));
     }
 
@@ -157,28 +265,39 @@ std::vector<BamPtr> Read::extract_sam_lines(bool emit_moves, uint8_t modbase_thr
     return alns;
 }
 
+void Read::append_modbase_tags(bam1_t *record, uint8_t modbase_threshold) const {
+    thread_local std::string modbase_string;
+    thread_local std::vector<uint8_t> modbase_probs;
+    if (generate_modbase_tags(modbase_string, modbase_probs, modbase_threshold)) {
+        append_modbase_tag_values(record, modbase_string, modbase_probs);
+    }
+}
+
 uint64_t Read::get_end_time_ms() {
     return start_time_ms +
            (attributes.num_samples * 1000) / sample_rate;  //TODO get rid of the trimmed thing?
 }
 
-void Read::generate_modbase_string(bam1_t *aln, uint8_t threshold) const {
+bool Read::generate_modbase_tags(std::string &modbase_string,
+                                 std::vector<uint8_t> &modbase_prob,
+                                 uint8_t threshold) const {
+    modbase_string.clear();
+    modbase_prob.clear();
     if (!base_mod_info) {
-        return;
+        return false;
     }
 
     const size_t num_channels = base_mod_info->alphabet.size();
     const std::string cardinal_bases = "ACGT";
     char current_cardinal = 0;
-    if (seq.length() * num_channels != base_mod_probs.size()) {
+    if (base_mod_positions.size() * num_channels != base_mod_probs.size() ||
+        (!base_mod_positions.empty() && base_mod_positions.back() >= seq.length())) {
         throw std::runtime_error(
-                "Mismatch between base_mod_probs size and sequence length * num channels in "
+                "Mismatch between base_mod_probs size and number of positions * num channels in "
                 "modbase_alphabet!");
     }
 
     std::istringstream mod_name_stream(base_mod_info->long_names);
-    std::string modbase_string = "";
-    std::vector<uint8_t> modbase_prob;
 
     // Create a mask indicating which bases are modified.
     std::map<char, bool> base_has_context = {
@@ -196,8 +315,8 @@ void Read::generate_modbase_string(bam1_t *aln, uint8_t threshold) const {
         }
     }
     auto modbase_mask = context_handler.get_sequence_mask(seq);
-    context_handler.update_mask(modbase_mask, seq, base_mod_info->alphabet, base_mod_probs,
-                                threshold);
+    context_handler.update_mask(modbase_mask, seq, base_mod_info->alphabet, base_mod_positions,
+                                base_mod_probs, threshold);
 
     // Iterate over the provided alphabet and find all the channels we need to write out
     for (size_t channel_idx = 0; channel_idx < num_channels; channel_idx++) {
@@ -210,41 +329,79 @@ void Read::generate_modbase_string(bam1_t *aln, uint8_t threshold) const {
             mod_name_stream >> modbase_name;
             std::string bam_name;
             if (!get_modbase_channel_name(bam_name, modbase_name)) {
-                return;
+                return false;
             }
 
             // Write out the results we found
-            modbase_string += std::string(1, current_cardinal) + "+" + bam_name;
-            modbase_string += base_has_context[current_cardinal] ? "?" : ".";
+            modbase_string += current_cardinal;
+            modbase_string += '+';
+            modbase_string += bam_name;
+            modbase_string += base_has_context[current_cardinal] ? '?' : '.';
             int skipped_bases = 0;
+            // The next scored base at or after base_idx.
+            size_t scored_idx = 0;
             for (size_t base_idx = 0; base_idx < seq.size(); base_idx++) {
                 if (seq[base_idx] == current_cardinal) {
                     if (modbase_mask[base_idx] == 1) {
-                        modbase_string += "," + std::to_string(skipped_bases);
+                        modbase_string += ',';
+                        append_number(modbase_string, skipped_bases);
                         skipped_bases = 0;
+                        while (scored_idx < base_mod_positions.size() &&
+                               base_mod_positions[scored_idx] < base_idx) {
+                            ++scored_idx;
+                        }
+                        const bool scored = scored_idx < base_mod_positions.size() &&
+                                            base_mod_positions[scored_idx] == base_idx;
                         modbase_prob.push_back(
-                                base_mod_probs[base_idx * num_channels + channel_idx]);
+                                scored ? base_mod_probs[scored_idx * num_channels + channel_idx]
+                                       : 0);
                     } else {
                         // Skip this base
                         skipped_bases++;
                     }
                 }
             }
-            modbase_string += ";";
+            modbase_string += ';';
         }
     }
+    return true;
+}
 
-    bam_aux_append(aln, "MM", 'Z', modbase_string.length() + 1, (uint8_t *)modbase_string.c_str());
-    bam_aux_update_array(aln, "ML", 'C', modbase_prob.size(), (uint8_t *)modbase_prob.data());
+size_t MessageLane::operator()(const Message &message) const {
+    if (const auto *read = std::get_if<std::shared_ptr<Read>>(&message)) {
+        return (*read)->is_priority ? kPriority : kBulk;
+    }
+    if (const auto *pair = std::get_if<std::shared_ptr<ReadPair>>(&message)) {
+        // A pair needn't have both its reads, e.g. while it's being built.
+        const auto is_priority = [](const std::shared_ptr<Read> &read) {
+            return read && read->is_priority;
+        };
+        return is_priority((*pair)->read_1) || is_priority((*pair)->read_2) ? kPriority : kBulk;
+    }
+    return kBulk;
 }
 
 void MessageSink::push_message(Message &&message) {
+    if (m_latency_tracker) {
+        m_latency_tracker->stamp(m_latency_stage, message);
+    }
     const bool success = m_work_queue.try_push(std::move(message));
     // try_push will fail if the sink has been told to terminate.
     // We do not expect to be pushing reads from this source if that is the case.
     assert(success);
 }
 
+void MessageSink::push_messages(std::vector<Message> &&messages) {
+    if (m_latency_tracker) {
+        for (const auto &message : messages) {
+            m_latency_tracker->stamp(m_latency_stage, message);
+        }
+    }
+    const bool success = m_work_queue.try_push_batch(std::move(messages));
+    // As above, nothing should be pushed to a terminated sink.
+    assert(success);
+}
+
 MessageSink::MessageSink(size_t max_messages) : m_work_queue(max_messages) {}
 
 }  // namespace dorado
@@ -1,12 +1,21 @@
 #pragma once
-#include "utils/AsyncQueue.h"
+#include "utils/InternedString.h"
+#include "utils/LanedQueue.h"
+#include "utils/LockFreeQueue.h"
+#include "utils/MemoryBudget.h"
+#include "utils/MoveTable.h"
+#include "utils/signal_utils.h"
 #include "utils/types.h"
 
 #include <torch/torch.h>
 
+#include <array>
+#include <atomic>
 #include <cstdint>
 #include <limits>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <variant>
 #include <vector>
@@ -18,25 +27,36 @@ struct BaseModInfo;
 }
 
 class Read;
+class ReadLatencyTracker;
 
+// Fields of a Read which nodes may declare they use, so that the basecaller can free the rest
+// once it is done with them.  Fields not listed here are always kept.
+struct ReadFields {
+    static constexpr uint32_t RAW_DATA = 1 << 0;
+    static constexpr uint32_t MOVES = 1 << 1;
+    static constexpr uint32_t ALL = RAW_DATA | MOVES;
+};
+
+// A chunk of a read's signal, and its basecall.
+// Chunks live in their read's called_chunks, so the chunks of a read are allocated
+// together.  They refer back to the read by plain pointer: the read is kept alive until
+// all of its chunks have been called.
 struct Chunk {
-    Chunk(std::shared_ptr<Read> const& read,
-          size_t offset,
-          size_t chunk_in_read_idx,
-          size_t chunk_size)
-            : source_read(read),
+    Chunk(Read& read, size_t offset, size_t chunk_in_read_idx, size_t chunk_size)
+            : source_read(&read),
               input_offset(offset),
               idx_in_read(chunk_in_read_idx),
               raw_chunk_size(chunk_size) {}
 
-    std::weak_ptr<Read> source_read;
+    Read* source_read;
     size_t input_offset;    // Where does this chunk start in the input raw read data
     size_t idx_in_read;     // Just for tracking that the chunks don't go out of order
     size_t raw_chunk_size;  // Just for knowing the original chunk size
 
     std::string seq;
     std::string qstring;
-    std::vector<uint8_t> moves;  // For stitching.
+    utils::MoveTable moves;  // For stitching.
+    bool is_called{false};   // Set, under the read's stitch_mutex, once it's basecalled.
 };
 
 // Class representing a read, including raw data
@@ -47,7 +67,7 @@ public:
         int32_t read_number{-1};  // Per-channel number of each read as it was acquired by minknow
         int32_t channel_number{-1};  //Channel ID
         std::string start_time{};    //Read acquisition start time
-        std::string fast5_filename{};
+        utils::InternedString fast5_filename{};
         uint64_t num_samples;
     };
 
@@ -56,6 +76,12 @@ public:
     };
 
     torch::Tensor raw_data;  // Loaded from source file
+    // Frees raw_data, keeping its length for the read's tags.
+    void release_raw_data();
+    // Samples in raw_data, including once it has been released.
+    int64_t raw_data_size() const;
+    int64_t released_raw_data_size{-1};  // Length of raw_data when it was released, or -1.
+
     float digitisation;      // Loaded from source file
     float range;             // Loaded from source file
     float offset;            // Loaded from source file
@@ -67,12 +93,21 @@ public:
 
     float shift;  // To be set by scaler
     float scale;  // To be set by scaler
+    // Set if raw_data was loaded from a SignalCache, already normalised with this scaling,
+    // for the scaler to pass on.
+    std::optional<utils::SignalScaling> cached_scaling;
 
     float scaling;  // Scale factor applied to convert raw integers from sequencer into pore current values
 
     size_t num_chunks;  // Number of chunks in the read. Reads raw data is split into chunks for efficient basecalling.
-    std::vector<std::shared_ptr<Chunk>> called_chunks;  // Vector of basecalled chunks.
+    std::vector<Chunk> called_chunks;      // The read's chunks, basecalled in place.
     std::atomic_size_t num_chunks_called;  // Number of chunks which have been basecalled
+    // Chunks whose basecalls have been stitched into seq, qstring and moves, and freed.
+    // Guarded, with the chunks' is_called, by stitch_mutex.
+    size_t num_chunks_stitched{0};
+    std::mutex stitch_mutex;
+    // Set if a batch holding one of the read's chunks couldn't be called, so the read is dropped.
+    std::atomic<bool> basecall_failed{false};
 
     size_t num_modbase_chunks;
     std::atomic_size_t
@@ -83,13 +118,22 @@ public:
     std::string read_id;                  // Unique read ID (UUID4)
     std::string seq;                      // Read basecall
     std::string qstring;                  // Read Qstring (Phred)
-    std::vector<uint8_t> moves;           // Move table
-    std::vector<uint8_t> base_mod_probs;  // Modified base probabilities
-    std::string run_id;                   // Run ID - used in read group
-    std::string flowcell_id;              // Flowcell ID - used in read group
-    std::string model_name;               // Read group
+    utils::MoveTable moves;               // Move table
+    // Modified base probabilities of the bases at base_mod_positions, in increasing order, one
+    // for each channel of base_mod_info's alphabet.  Bases no model scored aren't listed, and
+    // have no chance of being modified.
+    std::vector<uint32_t> base_mod_positions;
+    std::vector<uint8_t> base_mod_probs;
+    // Shared by every read from a run or file, so interned rather than copied per read.
+    utils::InternedString run_id;       // Run ID - used in read group
+    utils::InternedString flowcell_id;  // Flowcell ID - used in read group
+    utils::InternedString model_name;   // Read group
 
     std::string parent_read_id;  // Origin read ID for all its subreads. Empty for nonsplit reads.
+    // The order the DataLoader sent the read on in, from 1, or 0 for a read it didn't load.
+    // Subreads keep their parent's.  It's carried in the id of the read's BAM records, which
+    // isn't written to the file, for a ReorderNode to put them back in load order.
+    uint64_t sequence_number{0};
 
     std::shared_ptr<const utils::BaseModInfo>
             base_mod_info;  // Modified base settings of the models that ran on this read
@@ -99,16 +143,43 @@ public:
     Attributes attributes;
     std::vector<Mapping> mappings;
     std::vector<BamPtr> extract_sam_lines(bool emit_moves, uint8_t modbase_threshold = 0) const;
+    // Appends the read's MM and ML tags, if it has any, to record, which holds the read's
+    // sequence, e.g. a record of an earlier basecall of the read.
+    void append_modbase_tags(bam1_t* record, uint8_t modbase_threshold = 0) const;
+    // The read's RG value, run_id + "_" + model_name, or empty without either.  Interned, so
+    // that it stays valid however many reads' groups are looked up meanwhile, and each thread
+    // keeps the last one, so it's only formatted again when the run or model changes.
+    utils::InternedString read_group() const;
 
     uint64_t start_sample;
     uint64_t end_sample;
     uint64_t run_acquisition_start_time_ms;
     bool is_duplex;
+    // Set for reads wanted with as little latency as possible, e.g. those of adaptive sampling
+    // targets, which jump ahead of the others in each node's queue and in batching.
+    bool is_priority{false};
+
+    // The read's share of the host memory budget.  Nodes bring it up to date with
+    // host_memory_bytes() as the read changes.
+    utils::MemoryReservation memory_reservation;
+    // Estimated host memory taken up by the read's signal, basecall and chunks.
+    size_t host_memory_bytes() const;
+
+    // When the read entered each stage a ReadLatencyTracker follows, in microseconds after it
+    // entered the first, for the stages in latency_stages_reached.
+    static constexpr size_t kMaxLatencyStages = 8;
+    int64_t latency_start_ns{0};
+    std::array<uint32_t, kMaxLatencyStages> latency_stage_us{};
+    uint8_t latency_stages_reached{0};
 
 private:
     void generate_duplex_read_tags(bam1_t*) const;
     void generate_read_tags(bam1_t* aln, bool emit_moves) const;
-    void generate_modbase_string(bam1_t* aln, uint8_t threshold = 0) const;
+    // Formats the MM and ML tags' values into modbase_string and modbase_prob, returning false
+    // if the read has none.
+    bool generate_modbase_tags(std::string& modbase_string,
+                               std::vector<uint8_t>& modbase_prob,
+                               uint8_t threshold = 0) const;
 };
 
 // A pair of reads for Duplex calling
@@ -126,6 +197,16 @@ public:
 // To add more message types, simply add them to the list of types in the std::variant.
 using Message = std::variant<std::shared_ptr<Read>, BamPtr, std::shared_ptr<ReadPair>>;
 
+// The lanes of a MessageSink's queue.  Priority reads, and pairs with one in, go in the first,
+// so they're popped ahead of everything else waiting.
+struct MessageLane {
+    static constexpr size_t kPriority = 0;
+    static constexpr size_t kBulk = 1;
+    static constexpr size_t kNumLanes = 2;
+    size_t operator()(const Message& message) const;
+};
+using MessageQueue = LanedQueue<Message, MessageLane::kNumLanes, MessageLane>;
+
 // Base class for an object which consumes messages.
 // MessageSink is a node within a pipeline.
 // NOTE: In order to prevent potential deadlocks when
@@ -136,15 +217,57 @@ using Message = std::variant<std::shared_ptr<Read>, BamPtr, std::shared_ptr<Read
 class MessageSink {
 public:
     MessageSink(size_t max_messages);
+    virtual ~MessageSink() = default;
     // Pushed messages must be rvalues: the sink takes ownership.
-    void push_message(
+    virtual void push_message(
             Message&&
                     message);  // Push a message into message sink.  This can block if the sink's queue is full.
-    void terminate() { m_work_queue.terminate(); }
+    // Push several messages at once, in order.  The vector is left empty.
+    // Cheaper than repeated push_message calls when a node produces messages in bursts.
+    virtual void push_messages(std::vector<Message>&& messages);
+    virtual void terminate() { m_work_queue.terminate(); }
+
+    // The ReadFields used by this node or any node downstream of it.  Nodes which pass reads
+    // on should include their sink's.  Nodes which don't say are assumed to use every field.
+    virtual uint32_t read_fields_used() const { return ReadFields::ALL; }
+
+    // Fraction of the input queue's capacity currently in use, in [0, 1].
+    // A node whose input stays full is a pipeline bottleneck.
+    float get_queue_occupancy() const {
+        return static_cast<float>(m_work_queue.size()) /
+               static_cast<float>(m_work_queue.capacity());
+    }
+
+    // Running counts and wait times of the input queue, for PipelineTelemetry.
+    LockFreeQueue<Message>::Stats get_queue_stats() const { return m_work_queue.stats(); }
+
+    // Has reads pushed to this node timestamped as entering the tracker's stage, or not, if
+    // tracker is null.
+    void set_latency_tracker(ReadLatencyTracker* tracker, size_t stage) {
+        m_latency_tracker = tracker;
+        m_latency_stage = stage;
+    }
 
 protected:
     // Queue of work items for this node.
-    AsyncQueue<Message> m_work_queue;
+    // Lock-free so that the many worker threads feeding and draining nodes don't contend
+    // on a mutex for every message.  Priority messages are popped first.
+    MessageQueue m_work_queue;
+
+private:
+    ReadLatencyTracker* m_latency_tracker{nullptr};
+    size_t m_latency_stage{0};
+
+    friend class MessageRouter;
+    // Number of MessageRouters which have this sink as a destination and have not yet
+    // terminated.  A sink fed by several routers terminates once all of them have.
+    std::atomic<int> m_num_routed_inputs{0};
+    void add_routed_input() { ++m_num_routed_inputs; }
+    void routed_input_terminated() {
+        if (--m_num_routed_inputs == 0) {
+            terminate();
+        }
+    }
 };
 
 }  // namespace dorado
@@ -1,29 +1,44 @@
 #include "ReadToBamTypeNode.h"
 
+#include "utils/thread_utils.h"
+
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
 #include <chrono>
 
 namespace dorado {
 
 void ReadToBamType::worker_thread() {
+    utils::set_thread_name("read_to_bam");
     m_active_threads++;
 
-    Message message;
-    while (m_work_queue.try_pop(message)) {
-        // If this message isn't a read, we'll get a bad_variant_access exception.
-        auto read = std::get<std::shared_ptr<Read>>(message);
+    std::vector<Message> messages;
+    std::vector<Message> output;
+    m_worker_gate.acquire();
+    while (m_work_queue.try_pop_batch(messages, kMaxBatchSize)) {
+        for (auto& message : messages) {
+            // If this message isn't a read, we'll get a bad_variant_access exception.
+            auto read = std::get<std::shared_ptr<Read>>(message);
 
-        if (m_rna) {
-            std::reverse(read->seq.begin(), read->seq.end());
-            std::reverse(read->qstring.begin(), read->qstring.end());
-        }
+            if (m_rna) {
+                std::reverse(read->seq.begin(), read->seq.end());
+                std::reverse(read->qstring.begin(), read->qstring.end());
+            }
 
-        auto alns = read->extract_sam_lines(m_emit_moves, m_modbase_threshold);
-        for (auto& aln : alns) {
-            m_sink.push_message(std::move(aln));
+            auto alns = read->extract_sam_lines(m_emit_moves, m_modbase_threshold);
+            for (auto& aln : alns) {
+                output.push_back(std::move(aln));
+            }
         }
+        messages.clear();
+        m_sink.push_messages(std::move(output));
+
+        // Give up our permit between batches, so the limit can be lowered.
+        m_worker_gate.release();
+        m_worker_gate.acquire();
     }
+    m_worker_gate.release();
 
     auto num_active_threads = --m_active_threads;
     if (num_active_threads == 0) {
@@ -36,15 +51,17 @@ ReadToBamType::ReadToBamType(MessageSink& sink,
                              bool rna,
                              size_t num_worker_threads,
                              float modbase_threshold_frac,
-                             size_t max_reads)
+                             size_t max_reads,
+                             size_t max_worker_threads)
         : MessageSink(max_reads),
           m_sink(sink),
           m_emit_moves(emit_moves),
           m_rna(rna),
           m_modbase_threshold(
                   static_cast<uint8_t>(std::min(modbase_threshold_frac * 256.0f, 255.0f))),
-          m_active_threads(0) {
-    for (size_t i = 0; i < num_worker_threads; i++) {
+          m_active_threads(0),
+          m_worker_gate(num_worker_threads) {
+    for (size_t i = 0; i < std::max(num_worker_threads, max_worker_threads); i++) {
         m_workers.push_back(
                 std::make_unique<std::thread>(std::thread(&ReadToBamType::worker_thread, this)));
     }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "ReadPipeline.h"
+#include "utils/ConcurrencyGate.h"
 
 #include <atomic>
 #include <chrono>
@@ -16,16 +17,25 @@ public:
                   bool rna,
                   size_t num_worker_threads,
                   float modbase_threshold_frac = 0,
-                  size_t max_reads = 1000);
+                  size_t max_reads = 1000,
+                  size_t max_worker_threads = 0);
     ~ReadToBamType();
 
+    // Controls how many of the worker threads are active.  See ScalerNode.
+    utils::ConcurrencyGate& worker_gate() { return m_worker_gate; }
+    uint32_t read_fields_used() const override { return m_emit_moves ? ReadFields::MOVES : 0; }
+
 private:
+    // Maximum number of reads taken from the input queue at once.
+    static constexpr size_t kMaxBatchSize = 32;
+
     MessageSink& m_sink;
     void worker_thread();
 
     // Async worker for writing.
     std::vector<std::unique_ptr<std::thread>> m_workers;
     std::atomic<size_t> m_active_threads;
+    utils::ConcurrencyGate m_worker_gate;
 
     bool m_emit_moves;
     bool m_rna;
@@ -0,0 +1,92 @@
+#include "ReorderNode.h"
+
+#include "utils/thread_utils.h"
+
+#include <htslib/sam.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+
+namespace dorado {
+
+ReorderNode::ReorderNode(MessageSink& sink, size_t max_held_records)
+        : MessageSink(1000), m_sink(sink), m_max_held_records(max_held_records) {
+    m_worker = std::make_unique<std::thread>(&ReorderNode::worker_thread, this);
+}
+
+ReorderNode::~ReorderNode() {
+    terminate();
+    m_worker->join();
+    m_sink.terminate();
+}
+
+void ReorderNode::worker_thread() {
+    utils::set_thread_name("reorder");
+    Message message;
+    while (m_work_queue.try_pop(message)) {
+        if (!std::holds_alternative<BamPtr>(message)) {
+            m_sink.push_message(std::move(message));
+            continue;
+        }
+        auto record = std::get<BamPtr>(std::move(message));
+        // The DataLoader's number of the record's read, which isn't written to the file.
+        const uint64_t sequence_number = record->id;
+        // skip() sends a record without even a name.
+        const bool is_skipped = record->l_data == 0;
+        if (is_skipped) {
+            record.reset();
+        }
+        if (sequence_number == 0) {
+            if (!is_skipped) {
+                m_sink.push_message(std::move(record));
+            }
+            continue;
+        }
+        if (sequence_number < m_last_released) {
+            if (!is_skipped) {
+                ++m_num_late_records;
+                m_sink.push_message(std::move(record));
+            }
+            continue;
+        }
+        m_latest_arrived = std::max(m_latest_arrived, sequence_number);
+        m_held.push_back({sequence_number, m_num_arrived++, std::move(record)});
+        std::push_heap(m_held.begin(), m_held.end(), Later{});
+        release(m_max_held_records);
+    }
+    release(0);
+    if (m_num_late_records > 0) {
+        spdlog::warn("> {} records were written out of order, more than {} records late",
+                     m_num_late_records.load(), m_max_held_records);
+    }
+}
+
+void ReorderNode::skip(uint64_t sequence_number) {
+    BamPtr record(bam_init1());
+    record->id = sequence_number;
+    push_message(std::move(record));
+}
+
+void ReorderNode::release(size_t max_records) {
+    while (!m_held.empty()) {
+        const uint64_t sequence_number = m_held.front().sequence_number;
+        // More of the read last released may come, so its records go on as they do.  The next
+        // read's are held until a later one's come, as the last of its own may still be on
+        // their way.
+        const bool in_order = sequence_number <= m_last_released ||
+                              (sequence_number == m_last_released + 1 &&
+                               m_latest_arrived > sequence_number);
+        if (!in_order && m_held.size() <= max_records) {
+            break;
+        }
+        std::pop_heap(m_held.begin(), m_held.end(), Later{});
+        auto& held = m_held.back();
+        m_last_released = std::max(m_last_released, held.sequence_number);
+        if (held.record) {
+            m_sink.push_message(std::move(held.record));
+        }
+        m_held.pop_back();
+    }
+}
+
+}  // namespace dorado
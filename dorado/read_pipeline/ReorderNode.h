@@ -0,0 +1,69 @@
+#pragma once
+
+#include "ReadPipeline.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace dorado {
+
+// Puts BAM records back in the order their reads were loaded in, as numbered by the
+// DataLoader, so that the nodes before it can run on as many threads as they like, while the
+// file still comes out in load order.  A record is held until those of every read before its
+// own have gone on, and until a record of a later read has come, so that a read's records,
+// e.g. those of its subreads or alignments, go on together.  Nodes which drop reads report them
+// through skip(), so that later reads don't wait for them.  Reads can still go missing, so once
+// more than max_held_records are held the earliest go on regardless: records no further out of
+// order than that are put right.  Any arriving after records of later reads have gone on are
+// passed on at once, as are records and other messages without a number.
+class ReorderNode : public MessageSink {
+public:
+    ReorderNode(MessageSink& sink, size_t max_held_records);
+    ~ReorderNode();
+    uint32_t read_fields_used() const override { return m_sink.read_fields_used(); }
+
+    // Tells the node that the read numbered sequence_number has no records, e.g. as it was
+    // filtered out, so that the reads after it needn't wait for it.  Thread safe.
+    void skip(uint64_t sequence_number);
+
+    // Records which came too late to be put back in order.
+    size_t num_late_records() const { return m_num_late_records; }
+
+private:
+    struct HeldRecord {
+        uint64_t sequence_number;
+        // Keeps records of the same read in the order they came in.
+        uint64_t arrival;
+        // Null for a read which was skipped.
+        BamPtr record;
+    };
+    struct Later {
+        bool operator()(const HeldRecord& a, const HeldRecord& b) const {
+            return a.sequence_number != b.sequence_number
+                           ? a.sequence_number > b.sequence_number
+                           : a.arrival > b.arrival;
+        }
+    };
+
+    void worker_thread();
+    // Passes on the held records which are next in order, once a later read has come, and the
+    // earliest of the rest, while more than max_records are held.
+    void release(size_t max_records);
+
+    MessageSink& m_sink;
+    const size_t m_max_held_records;
+    // A heap, with the earliest record first.
+    std::vector<HeldRecord> m_held;
+    uint64_t m_num_arrived{0};
+    // The number of the latest read whose records have gone on.
+    uint64_t m_last_released{0};
+    // The number of the latest read which has come, or been skipped.
+    uint64_t m_latest_arrived{0};
+    std::atomic<size_t> m_num_late_records{0};
+    std::unique_ptr<std::thread> m_worker;
+};
+
+}  // namespace dorado
@@ -0,0 +1,33 @@
+#include "SampleRateRouter.h"
+
+#include <spdlog/spdlog.h>
+
+namespace dorado {
+
+SampleRateRouter::SampleRateRouter(MessageSink& default_sink)
+        : MessageRouter(default_sink), m_default_sink(default_sink) {}
+
+SampleRateRouter& SampleRateRouter::route(uint64_t sample_rate, MessageSink& sink) {
+    m_sinks[sample_rate] = &sink;
+    add_destination(sink);
+    return *this;
+}
+
+MessageSink& SampleRateRouter::destination(const Message& message) {
+    if (!std::holds_alternative<std::shared_ptr<Read>>(message)) {
+        return MessageRouter::destination(message);
+    }
+    const auto sample_rate = std::get<std::shared_ptr<Read>>(message)->sample_rate;
+    const auto sink = m_sinks.find(sample_rate);
+    if (sink != m_sinks.end()) {
+        return *sink->second;
+    }
+    std::lock_guard lock(m_unrouted_mutex);
+    if (m_unrouted_sample_rates.insert(sample_rate).second) {
+        spdlog::warn("No model was given for reads at {}Hz, which are called with the first",
+                     sample_rate);
+    }
+    return m_default_sink;
+}
+
+}  // namespace dorado
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "MessageRouter.h"
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+
+namespace dorado {
+
+// A MessageRouter which sends each read on to the sink registered for its sample rate, so that
+// a mixed dataset is called with a model for each of its sample rates, each model with a
+// BasecallerNode of its own.  Reads at a sample rate with no sink, and other messages, go to
+// the default sink.
+class SampleRateRouter : public MessageRouter {
+public:
+    explicit SampleRateRouter(MessageSink& default_sink);
+
+    // Sends reads at sample_rate to sink instead of the default sink.
+    SampleRateRouter& route(uint64_t sample_rate, MessageSink& sink);
+
+private:
+    MessageSink& destination(const Message& message) override;
+
+    MessageSink& m_default_sink;
+    std::map<uint64_t, MessageSink*> m_sinks;
+
+    // Sample rates without a sink of their own, each warned about once.
+    std::mutex m_unrouted_mutex;
+    std::set<uint64_t> m_unrouted_sample_rates;
+};
+
+}  // namespace dorado
@@ -1,56 +1,96 @@
 #include "ScalerNode.h"
 
-#include "utils/tensor_utils.h"
-#include "utils/trim.h"
+#include "utils/SignalCache.h"
+#include "utils/signal_utils.h"
+#include "utils/thread_utils.h"
+
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+#include <c10/cuda/CUDAGuard.h>
+#include <c10/cuda/CUDAStream.h>
+#endif
 
 #include <algorithm>
 #include <chrono>
+#include <optional>
 
 using namespace std::chrono_literals;
 using Slice = torch::indexing::Slice;
 
 namespace {
 
-std::pair<float, float> normalisation(torch::Tensor& x) {
-    // Calculate shift and scale factors for normalisation.
-    auto quantiles = dorado::utils::quantile_counting(x, torch::tensor({0.2, 0.9}));
-    float q20 = quantiles[0].item<float>();
-    float q90 = quantiles[1].item<float>();
-    float shift = std::max(10.0f, 0.51f * (q20 + q90));
-    float scale = std::max(1.0f, 0.53f * (q90 - q20));
-    return {shift, scale};
-}
+// Reads longer than this, around an hour of signal, have their quantiles estimated from
+// a strided sample of the signal so that a single ultra-long read doesn't stall a worker.
+constexpr size_t kMaxQuantileSamples = size_t(1) << 24;
+// The most samples at the start of a read in which to look for where to trim it.
+constexpr int kMaxTrimSamples = 8000;
 
 }  // namespace
 
 namespace dorado {
 
 void ScalerNode::worker_thread() {
+    utils::set_thread_name("scaler");
+    torch::InferenceMode inference_mode_guard;
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+    // Each worker gets its own stream, so workers don't serialise on the default one.
+    std::optional<c10::cuda::CUDAStreamGuard> stream_guard;
+    if (m_scaling_device.is_cuda()) {
+        stream_guard.emplace(c10::cuda::getStreamFromPool(false, m_scaling_device.index()));
+    }
+#endif
+
     Message message;
+    m_worker_gate.acquire();
     while (m_work_queue.try_pop(message)) {
         // If this message isn't a read, we'll get a bad_variant_access exception.
         auto read = std::get<std::shared_ptr<Read>>(message);
 
-        const auto [shift, scale] = normalisation(read->raw_data);
         // raw_data comes from DataLoader with dtype int16.  We send it on as float16 after
-        // shifting/scaling in float32 form.
-        read->raw_data = ((read->raw_data.to(torch::kFloat) - shift) / scale).to(torch::kFloat16);
+        // shifting/scaling.
+        // 8000 value may be changed in future. Currently this is found to work well.
+        int max_samples = std::min(kMaxTrimSamples, static_cast<int>(read->raw_data.size(0) / 2));
+        utils::SignalScaling scaling;
+        if (read->cached_scaling) {
+            // Normalised by an earlier run.
+            scaling = *read->cached_scaling;
+            read->raw_data = read->raw_data.to(m_scaling_device);
+        } else if (m_scaling_device.is_cpu()) {
+            // float16 is the same size as int16, so this is done in place.
+            // The read must be the only user of the samples' storage.
+            read->raw_data = read->raw_data.contiguous();
+            scaling = utils::normalise_and_trim(read->raw_data.data_ptr<int16_t>(),
+                                                read->raw_data.numel(), max_samples,
+                                                kMaxQuantileSamples);
+            read->raw_data = read->raw_data.view(torch::kFloat16);
+        } else {
+            // Upload the raw int16 signal, which is half the size of the float16 chunks the
+            // basecaller would otherwise copy, and do the rest on the device.
+            read->raw_data = utils::normalise_and_trim(read->raw_data.to(m_scaling_device),
+                                                       max_samples, scaling);
+        }
+        if (m_signal_cache && !read->cached_scaling) {
+            m_signal_cache->store(read->read_id, scaling, read->raw_data);
+        }
 
         // move the shift and scale into pA.
-        read->scale = read->scaling * scale;
-        read->shift = read->scaling * (shift + read->offset);
+        read->scale = read->scaling * scaling.scale;
+        read->shift = read->scaling * (scaling.shift + read->offset);
 
-        // 8000 value may be changed in future. Currently this is found to work well.
-        int max_samples = std::min(8000, static_cast<int>(read->raw_data.size(0) / 2));
-        int trim_start =
-                utils::trim(read->raw_data.index({Slice(torch::indexing::None, max_samples)}));
+        read->raw_data = read->raw_data.index({Slice(scaling.trim_start, torch::indexing::None)});
+        read->num_trimmed_samples = scaling.trim_start;
 
-        read->raw_data = read->raw_data.index({Slice(trim_start, torch::indexing::None)});
-        read->num_trimmed_samples = trim_start;
+        // Reads which didn't come from a DataLoader have nothing reserved yet, and signal
+        // moved to the device no longer counts.  Waits if the budget is used up.
+        read->memory_reservation.resize(read->host_memory_bytes());
 
         // Pass the read to the next node
         m_sink.push_message(read);
+
+        // Give up our permit between reads, so the limit can be lowered.
+        m_worker_gate.release();
+        m_worker_gate.acquire();
     }
+    m_worker_gate.release();
 
     int num_worker_threads = --m_num_worker_threads;
     if (num_worker_threads == 0) {
@@ -58,8 +98,18 @@ void ScalerNode::worker_thread() {
     }
 }
 
-ScalerNode::ScalerNode(MessageSink& sink, int num_worker_threads, size_t max_reads)
-        : MessageSink(max_reads), m_sink(sink), m_num_worker_threads(num_worker_threads) {
+ScalerNode::ScalerNode(MessageSink& sink,
+                       int num_worker_threads,
+                       size_t max_reads,
+                       int max_worker_threads,
+                       const std::string& scaling_device,
+                       std::shared_ptr<utils::SignalCache> signal_cache)
+        : MessageSink(max_reads),
+          m_sink(sink),
+          m_scaling_device(scaling_device),
+          m_signal_cache(std::move(signal_cache)),
+          m_num_worker_threads(std::max(num_worker_threads, max_worker_threads)),
+          m_worker_gate(num_worker_threads) {
     for (int i = 0; i < m_num_worker_threads; i++) {
         std::unique_ptr<std::thread> scaler_worker_thread =
                 std::make_unique<std::thread>(&ScalerNode::worker_thread, this);
@@ -67,6 +117,11 @@ ScalerNode::ScalerNode(MessageSink& sink, int num_worker_threads, size_t max_rea
     }
 }
 
+std::string ScalerNode::scaling_key() {
+    return "quantiles=0.2,0.9;max_trim_samples=" + std::to_string(kMaxTrimSamples) +
+           ";max_quantile_samples=" + std::to_string(kMaxQuantileSamples);
+}
+
 ScalerNode::~ScalerNode() {
     terminate();
 
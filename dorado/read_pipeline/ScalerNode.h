@@ -1,19 +1,47 @@
 #pragma once
 #include "ReadPipeline.h"
+#include "utils/ConcurrencyGate.h"
+
+#include <memory>
+#include <string>
 
 namespace dorado {
 
+namespace utils {
+class SignalCache;
+}
+
 class ScalerNode : public MessageSink {
 public:
-    ScalerNode(MessageSink& sink, int num_worker_threads = 5, size_t max_reads = 1000);
+    // max_worker_threads > num_worker_threads spawns spare workers which are held back by
+    // worker_gate() until a ThreadAllocationController raises the limit.
+    // If scaling_device is a CUDA device, reads are uploaded to it and scaled there, and
+    // are sent on with their signal in device memory.
+    // If there's a signal_cache, reads are stored in it once normalised, and reads loaded from
+    // it, already normalised, are only trimmed.
+    ScalerNode(MessageSink& sink,
+               int num_worker_threads = 5,
+               size_t max_reads = 1000,
+               int max_worker_threads = 0,
+               const std::string& scaling_device = "cpu",
+               std::shared_ptr<utils::SignalCache> signal_cache = nullptr);
     ~ScalerNode();
 
+    // Identifies how reads are normalised, for a SignalCache.
+    static std::string scaling_key();
+
+    // Controls how many of the worker threads are active.
+    utils::ConcurrencyGate& worker_gate() { return m_worker_gate; }
+
 private:
     void worker_thread();  // Worker thread performs scaling and trimming asynchronously.
     MessageSink&
             m_sink;  // MessageSink to consume scaled reads. Typically this will be a Basecaller Node.
+    torch::Device m_scaling_device;
+    std::shared_ptr<utils::SignalCache> m_signal_cache;
     std::vector<std::unique_ptr<std::thread>> worker_threads;
     std::atomic<int> m_num_worker_threads;
+    utils::ConcurrencyGate m_worker_gate;
 };
 
 }  // namespace dorado
@@ -1,5 +1,8 @@
 #include "StatsCounter.h"
 
+#include "utils/MetricsServer.h"
+#include "utils/thread_utils.h"
+
 #include <spdlog/spdlog.h>
 
 #include <chrono>
@@ -25,14 +28,16 @@ StatsCounterNode::~StatsCounterNode() {
 }
 
 void StatsCounterNode::worker_thread() {
+    utils::set_thread_name("stats");
     Message message;
     while (m_work_queue.try_pop(message)) {
         // If this message isn't a read, we'll get a bad_variant_access exception.
         auto read = std::get<std::shared_ptr<Read>>(message);
 
-        m_num_bases_processed += read->seq.length();
-        m_num_samples_processed += read->raw_data.size(0);
-        ++m_num_reads_processed;
+        // Only read for reporting, so nothing needs ordering with them.
+        m_num_bases_processed.fetch_add(read->seq.length(), std::memory_order_relaxed);
+        m_num_samples_processed.fetch_add(read->raw_data_size(), std::memory_order_relaxed);
+        m_num_reads_processed.fetch_add(1, std::memory_order_relaxed);
 
         m_sink.push_message(read);
     }
@@ -41,7 +46,7 @@ void StatsCounterNode::worker_thread() {
     m_end_time = std::chrono::system_clock::now();
 }
 
-void StatsCounterNode::dump_stats() {
+void StatsCounterNode::dump_stats(double gpu_energy_joules) {
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(m_end_time -
                                                                           m_initialization_time)
                             .count();
@@ -54,6 +59,24 @@ void StatsCounterNode::dump_stats() {
         samples_sec << std::scientific << m_num_samples_processed / (duration / 1000.0);
         spdlog::info("> Basecalled @ Samples/s: {}", samples_sec.str());
     }
+    if (gpu_energy_joules > 0 && m_num_bases_processed > 0) {
+        spdlog::info("> GPU energy: {:.1f}kJ, {:.1f}kJ/Gbase", gpu_energy_joules / 1e3,
+                     gpu_energy_joules / 1e3 / (m_num_bases_processed / 1e9));
+    }
+}
+
+void StatsCounterNode::add_metrics(utils::MetricsRegistry& registry) const {
+    using Type = utils::MetricsRegistry::Type;
+    const std::string labels = m_duplex ? R"(kind="duplex")" : R"(kind="simplex")";
+    registry.add("dorado_reads_total", "Reads called.", Type::COUNTER,
+                 [this] { return m_num_reads_processed.load(std::memory_order_relaxed); },
+                 labels);
+    registry.add("dorado_samples_total", "Signal samples in the reads called.", Type::COUNTER,
+                 [this] { return m_num_samples_processed.load(std::memory_order_relaxed); },
+                 labels);
+    registry.add("dorado_bases_total", "Bases called.", Type::COUNTER,
+                 [this] { return m_num_bases_processed.load(std::memory_order_relaxed); },
+                 labels);
 }
 
 }  // namespace dorado
@@ -9,6 +9,10 @@
 
 namespace dorado {
 
+namespace utils {
+class MetricsRegistry;
+}
+
 // Collect and calculate throughput related
 // statistics for the pipeline to track dorado
 // overall performance.
@@ -17,7 +21,12 @@ public:
     StatsCounterNode(MessageSink& sink, bool duplex);
     ~StatsCounterNode();
 
-    void dump_stats();
+    // With the energy the GPUs used over the run, as GpuMonitor measures it, that's logged too,
+    // per gigabase called.  0 if it wasn't measured.
+    void dump_stats(double gpu_energy_joules = 0);
+    // Adds the reads, samples and bases counted so far to registry.
+    void add_metrics(utils::MetricsRegistry& registry) const;
+    uint32_t read_fields_used() const override { return m_sink.read_fields_used(); }
 
 private:
     void worker_thread();
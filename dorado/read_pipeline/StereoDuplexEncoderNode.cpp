@@ -1,15 +1,115 @@
 #include "StereoDuplexEncoderNode.h"
 
 #include "3rdparty/edlib/edlib/include/edlib.h"
+#include "utils/MetricsServer.h"
+#include "utils/TensorPool.h"
+#include "utils/alignment_utils.h"
 #include "utils/duplex_utils.h"
 #include "utils/sequence_utils.h"
+#include "utils/thread_utils.h"
+
+#include <spdlog/spdlog.h>
+
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+#include <ATen/cuda/CUDAEvent.h>
+#include <c10/cuda/CUDAGuard.h>
+#include <c10/cuda/CUDAStream.h>
+#endif
 
 #include <algorithm>
 #include <array>
+#include <cmath>
 #include <cstring>
+#include <limits>
 #include <vector>
 
-using namespace torch::indexing;
+namespace {
+
+// The most memory the features built on the device take there before they're basecalled.  The
+// basecaller may hold many pairs, queued and chunked, and the features of pairs encoded past
+// this are built on the host instead, which the basecaller copies over a batch at a time.
+constexpr int64_t kMaxDeviceFeatureBytes = int64_t(1) << 30;
+
+// What the features of each alignment column are built from, when they're built on a device.
+enum ColumnField {
+    // The column's first sample of template signal, and how many it has, 0 for an insertion
+    // to the query.
+    kColumnTemplateStart,
+    kColumnTemplateLength,
+    // The same for the complement signal, which is used in reverse, so counted from its end.
+    kColumnComplementStart,
+    kColumnComplementLength,
+    // The bases as 0-3, or -1 where the column has none, and their Q scores without the +33.
+    kColumnTemplateBase,
+    kColumnComplementBase,
+    kColumnTemplateQScore,
+    kColumnComplementQScore,
+    kNumColumnFields,
+};
+
+// The stereo features of the signals, with tensor ops on their device, from columns, an int32
+// tensor of a row for each ColumnField, on the same device.  Each sample of the stereo signal
+// is mapped to its column and its offset into it, and every feature is gathered from those,
+// giving the same values as the loop on the host in stereo_encode.
+torch::Tensor build_stereo_features(const torch::Tensor& template_signal,
+                                    const torch::Tensor& complement_signal,
+                                    const torch::Tensor& columns,
+                                    int64_t stereo_signal_len) {
+    const auto fields = columns.to(torch::kInt64);
+    const auto column_lengths =
+            torch::maximum(fields[kColumnTemplateLength], fields[kColumnComplementLength]);
+    // The output size is known, so the device needn't be waited on for it.
+    const auto sample_columns = torch::repeat_interleave(column_lengths, stereo_signal_len);
+    const auto at_samples = [&sample_columns](const torch::Tensor& field) {
+        return field.index_select(0, sample_columns);
+    };
+    const auto column_starts = torch::cumsum(column_lengths, 0) - column_lengths;
+    const auto offsets =
+            torch::arange(stereo_signal_len, fields.options()) - at_samples(column_starts);
+
+    // As pad_value on the host: the product in double, then rounded to float.
+    const auto pad_value = (torch::minimum(template_signal.min(), complement_signal.min())
+                                    .to(torch::kFloat64) *
+                            0.8)
+                                   .to(torch::kFloat32)
+                                   .to(torch::kFloat16);
+    const auto zeros = torch::zeros_like(offsets);
+    const auto in_template = offsets < at_samples(fields[kColumnTemplateLength]);
+    const auto template_indices =
+            torch::where(in_template, at_samples(fields[kColumnTemplateStart]) + offsets, zeros);
+    const auto template_feature = torch::where(
+            in_template, template_signal.index_select(0, template_indices), pad_value);
+    const auto in_complement = offsets < at_samples(fields[kColumnComplementLength]);
+    const auto complement_indices = torch::where(
+            in_complement,
+            complement_signal.size(0) - 1 - (at_samples(fields[kColumnComplementStart]) + offsets),
+            zeros);
+    const auto complement_feature = torch::where(
+            in_complement, complement_signal.index_select(0, complement_indices), pad_value);
+
+    // Each base is one of 4 features, set across its column.
+    const auto nucleotides = torch::arange(4, fields.options()).unsqueeze(1);
+    const auto template_bases = at_samples(fields[kColumnTemplateBase]);
+    const auto complement_bases = at_samples(fields[kColumnComplementBase]);
+    const auto q_score = [](const torch::Tensor& bases, const torch::Tensor& q_scores) {
+        return torch::where(bases >= 0, q_scores.to(torch::kFloat32) / 90.0f,
+                            torch::zeros_like(q_scores, torch::kFloat32));
+    };
+
+    // In the order of the feature indices in stereo_encode.
+    return torch::cat({template_feature.unsqueeze(0), complement_feature.unsqueeze(0),
+                       (nucleotides == template_bases.unsqueeze(0)).to(torch::kFloat16),
+                       (nucleotides == complement_bases.unsqueeze(0)).to(torch::kFloat16),
+                       (offsets == 0).to(torch::kFloat16).unsqueeze(0),
+                       q_score(template_bases, at_samples(fields[kColumnTemplateQScore]))
+                               .to(torch::kFloat16)
+                               .unsqueeze(0),
+                       q_score(complement_bases, at_samples(fields[kColumnComplementQScore]))
+                               .to(torch::kFloat16)
+                               .unsqueeze(0)});
+}
+
+}  // namespace
 
 namespace dorado {
 std::shared_ptr<dorado::Read> StereoDuplexEncoderNode::stereo_encode(
@@ -27,14 +127,28 @@ std::shared_ptr<dorado::Read> StereoDuplexEncoderNode::stereo_encode(
     const auto complement_sequence_reverse_complement =
             dorado::utils::reverse_complement(complement_read->seq);
 
-    // Align the two reads to one another and print out the score.
-    EdlibAlignConfig align_config = edlibDefaultAlignConfig();
-    align_config.task = EDLIB_TASK_PATH;
+    // Most pairs of reads close enough in time and length aren't a template and its complement
+    // at all, and their sketches rule them out for a fraction of the cost of aligning them.
+    ++m_num_pairs_in;
+    const auto template_sketch = utils::minimizer_sketch(template_read->seq);
+    const auto complement_sketch = utils::minimizer_sketch(complement_sequence_reverse_complement);
+    if (utils::sketch_similarity(template_sketch, complement_sketch) <
+        utils::kMinDuplexSketchSimilarity) {
+        ++m_num_pairs_rejected_by_sketch;
+        return read;
+    }
+
+    // Align the two reads to one another, giving up on pairs too far apart for consensus.
+    static constexpr float kMaxAlignmentErrorRate = utils::kMaxDuplexAlignmentErrorRate;
+    EdlibAlignResult result = utils::align_within_error_rate(
+            template_read->seq, complement_sequence_reverse_complement, kMaxAlignmentErrorRate);
 
-    EdlibAlignResult result =
-            edlibAlign(template_read->seq.data(), template_read->seq.size(),
-                       complement_sequence_reverse_complement.data(),
-                       complement_sequence_reverse_complement.size(), align_config);
+    // No alignment was found within the bound.
+    if (result.status != EDLIB_STATUS_OK || result.editDistance < 0) {
+        edlibFreeAlignResult(result);
+        ++m_num_pairs_rejected_by_alignment;
+        return read;
+    }
 
     int query_cursor = 0;
     int target_cursor = result.startLocations[0];
@@ -54,11 +168,12 @@ std::shared_ptr<dorado::Read> StereoDuplexEncoderNode::stereo_encode(
     const bool consensus_possible =
             (start_alignment_position < end_alignment_position) &&
             ((end_alignment_position - start_alignment_position) > kMinTrimmedAlignmentLength) &&
-            alignment_error_rate < 0.2;
+            alignment_error_rate < kMaxAlignmentErrorRate;
 
     if (!consensus_possible) {
         // There wasn't a good enough match -- return early with an empty read.
         edlibFreeAlignResult(result);
+        ++m_num_pairs_rejected_by_alignment;
         return read;
     }
 
@@ -68,10 +183,6 @@ std::shared_ptr<dorado::Read> StereoDuplexEncoderNode::stereo_encode(
     static constexpr unsigned char kAlignInsertionToQuery = 2;
     static constexpr unsigned char kAlignMismatch = 3;
 
-    // Move along the alignment, filling out the stereo-encoded tensor
-    const int max_size = template_read->raw_data.size(0) + complement_read->raw_data.size(0);
-    const auto opts = torch::TensorOptions().dtype(torch::kFloat16).device(torch::kCPU);
-
     static constexpr int kNumFeatures = 13;
     // Indices of features in the first dimension of the output tensor.
     static constexpr int kFeatureTemplateSignal = 0;
@@ -81,146 +192,233 @@ std::shared_ptr<dorado::Read> StereoDuplexEncoderNode::stereo_encode(
     static constexpr int kFeatureMoveTable = 10;
     static constexpr int kFeatureTemplateQScore = 11;
     static constexpr int kFeatureComplementQScore = 12;
-    auto tmp = torch::zeros({kNumFeatures, max_size}, opts);
-
-    int template_signal_cursor = 0;
-    int complement_signal_cursor = 0;
 
-    std::vector<uint8_t> template_moves_expanded;
-    for (int i = 0; i < template_read->moves.size(); i++) {
-        template_moves_expanded.push_back(template_read->moves[i]);
-        for (int j = 0; j < m_input_signal_stride - 1; j++) {
-            template_moves_expanded.push_back(0);
-        }
-    }
-
-    int extra_padding = template_read->raw_data.size(0) - template_moves_expanded.size();
-    for (int i = 0; i < extra_padding; i++) {
-        template_moves_expanded.push_back(0);
+    // libtorch indexing calls go on a carefree romp through various heap
+    // allocations/deallocations and object constructions/destructions, and so are
+    // glacially slow.  We therefore work with raw pointers throughout.
+    const auto* const template_raw_data_ptr =
+            static_cast<const SampleType*>(template_read->raw_data.data_ptr());
+    const auto* const complement_raw_data_ptr =
+            static_cast<const SampleType*>(complement_read->raw_data.data_ptr());
+    const int64_t template_signal_len = template_read->raw_data.size(0);
+    const int64_t complement_signal_len = complement_read->raw_data.size(0);
+
+    // Moves expanded to one entry per sample, padded with 0s to at least the signal length.
+    const size_t stride = m_input_signal_stride;
+    std::vector<uint8_t> template_moves_expanded(
+            std::max(size_t(template_signal_len), template_read->moves.size() * stride), 0);
+    for (size_t i = 0; i < template_read->moves.size(); i++) {
+        template_moves_expanded[i * stride] = template_read->moves[i];
     }
 
+    int template_signal_cursor = 0;
     int template_moves_seen = template_moves_expanded[template_signal_cursor];
     while (template_moves_seen < target_cursor + 1) {
         template_signal_cursor++;
         template_moves_seen += template_moves_expanded[template_signal_cursor];
     }
 
-    std::vector<uint8_t> complement_moves_expanded;
-    for (int i = 0; i < complement_read->moves.size(); i++) {
-        complement_moves_expanded.push_back(complement_read->moves[i]);
-        for (int j = 0; j < m_input_signal_stride - 1; j++) {
-            complement_moves_expanded.push_back(0);
+    // The complement is used in reverse, so its expanded moves are too: each base's move now
+    // follows its samples, and a leading 1 stands in for the move which starts the first base.
+    const size_t complement_moves_len =
+            std::max(size_t(complement_signal_len), complement_read->moves.size() * stride);
+    std::vector<uint8_t> complement_moves_expanded(complement_moves_len, 0);
+    complement_moves_expanded[0] = 1;
+    for (size_t i = 0; i < complement_read->moves.size(); i++) {
+        // The move reversed onto sample 0 is replaced by the leading 1.
+        if (i * stride > 0) {
+            complement_moves_expanded[complement_moves_len - i * stride] =
+                    complement_read->moves[i];
         }
     }
 
-    extra_padding = complement_read->raw_data.size(0) - complement_moves_expanded.size();
-    for (int i = 0; i < extra_padding; i++) {
-        complement_moves_expanded.push_back(0);
-    }
-    complement_moves_expanded.push_back(1);
-    std::reverse(complement_moves_expanded.begin(), complement_moves_expanded.end());
-    complement_moves_expanded.pop_back();
-
-    auto complement_signal = complement_read->raw_data;
-    complement_signal = torch::flip(complement_read->raw_data, 0);
-
+    int complement_signal_cursor = 0;
     int complement_moves_seen = complement_read->moves[complement_signal_cursor];
     while (complement_moves_seen < query_cursor + 1) {
         complement_signal_cursor++;
         complement_moves_seen += complement_moves_expanded[complement_signal_cursor];
     }
 
-    const float pad_value = 0.8 * std::min(torch::min(complement_signal).item<float>(),
-                                           torch::min(template_read->raw_data).item<float>());
+    // The number of samples from cursor to the start of the next base, including cursor's own.
+    // We are relying on strings of 0s ended in a 1.
+    const auto segment_length = [](const std::vector<uint8_t>& moves_expanded, int cursor) {
+        // The search is bounded by the end of the moves, however short the last base.
+        const size_t start = std::min(size_t(cursor) + 1, moves_expanded.size());
+        const size_t remaining = moves_expanded.size() - start;
+        const auto* const start_ptr = moves_expanded.data() + start;
+        const auto* const next_move_ptr =
+                static_cast<const uint8_t*>(std::memchr(start_ptr, 1, remaining));
+        return 1 + int(next_move_ptr ? (next_move_ptr - start_ptr) : remaining);
+    };
+
+    // First find how long each alignment column is in signal space, and so the length of the
+    // stereo-encoded signal, so that the output can be filled in place.
+    struct ColumnLengths {
+        int template_length;
+        int complement_length;
+    };
+    std::vector<ColumnLengths> column_lengths;
+    column_lengths.reserve(end_alignment_position - start_alignment_position);
+    int stereo_signal_len = 0;
+    {
+        int template_cursor = template_signal_cursor;
+        int complement_cursor = complement_signal_cursor;
+        for (int i = start_alignment_position; i < end_alignment_position; i++) {
+            ColumnLengths lengths{0, 0};
+            // If there is *not* an insertion to the query, the column has template signal.
+            if (result.alignment[i] != kAlignInsertionToQuery) {
+                lengths.template_length = segment_length(template_moves_expanded, template_cursor);
+                template_cursor += lengths.template_length;
+            }
+            // If there is *not* an insertion to the target, the column has complement signal.
+            if (result.alignment[i] != kAlignInsertionToTarget) {
+                lengths.complement_length =
+                        segment_length(complement_moves_expanded, complement_cursor);
+                complement_cursor += lengths.complement_length;
+            }
+            column_lengths.push_back(lengths);
+            stereo_signal_len += std::max(lengths.template_length, lengths.complement_length);
+        }
+    }
 
-    // Start with all signal feature entries equal to the padding value.
-    tmp.index({torch::indexing::Slice(None, 2)}) = pad_value;
+    read->read_id = template_read->read_id + ";" + complement_read->read_id;
+    read->is_duplex = true;
+    read->is_priority = template_read->is_priority || complement_read->is_priority;
+    ++m_num_pairs_encoded;
+
+    // Taken for the features on the device until they're freed, if that's within the limit.
+    const int64_t feature_bytes = int64_t(kNumFeatures) * stereo_signal_len * sizeof(SampleType);
+    bool on_device = false;
+    if (m_encoding_device) {
+        on_device = m_device_feature_bytes->fetch_add(feature_bytes) + feature_bytes <=
+                    kMaxDeviceFeatureBytes;
+        if (!on_device) {
+            m_device_feature_bytes->fetch_sub(feature_bytes);
+        }
+    }
 
-    // libtorch indexing calls go on a carefree romp through various heap
-    // allocations/deallocations and object constructions/destructions, and so are
-    // glacially slow.  We therefore work with raw pointers within the main loop.
-    const auto* const template_raw_data_ptr =
-            static_cast<SampleType*>(template_read->raw_data.data_ptr());
-    const auto* const flipped_complement_raw_data_ptr =
-            static_cast<SampleType*>(complement_signal.data_ptr());
+    if (on_device) {
+        // Only the signals and the columns go to the device, rather than the features, which
+        // are many times the size.
+        const int num_columns = end_alignment_position - start_alignment_position;
+        std::vector<int32_t> columns(size_t(kNumColumnFields) * num_columns);
+        const auto field = [&columns, num_columns](ColumnField field, int column) -> int32_t& {
+            return columns[size_t(field) * num_columns + column];
+        };
+        for (int column = 0; column < num_columns; ++column) {
+            const auto [template_length, complement_length] = column_lengths[column];
+            const auto alignment = result.alignment[start_alignment_position + column];
+            field(kColumnTemplateStart, column) = template_signal_cursor;
+            field(kColumnTemplateLength, column) = template_length;
+            field(kColumnComplementStart, column) = complement_signal_cursor;
+            field(kColumnComplementLength, column) = complement_length;
+            template_signal_cursor += template_length;
+            complement_signal_cursor += complement_length;
+            field(kColumnTemplateBase, column) = -1;
+            if (alignment != kAlignInsertionToQuery) {
+                field(kColumnTemplateBase, column) =
+                        dorado::utils::base_to_int(template_read->seq[target_cursor]);
+                field(kColumnTemplateQScore, column) = template_read->qstring[target_cursor] - 33;
+                ++target_cursor;
+            }
+            field(kColumnComplementBase, column) = -1;
+            if (alignment != kAlignInsertionToTarget) {
+                field(kColumnComplementBase, column) = dorado::utils::base_to_int(
+                        complement_sequence_reverse_complement.at(query_cursor));
+                field(kColumnComplementQScore, column) =
+                        complement_read->qstring.rbegin()[query_cursor] - 33;
+                ++query_cursor;
+            }
+        }
+        edlibFreeAlignResult(result);
 
+        torch::InferenceMode inference_mode_guard;
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+        // Encodes run on the shared executor's threads, so each gets a stream of its own.
+        std::optional<c10::cuda::CUDAStreamGuard> stream_guard;
+        if (m_encoding_device->is_cuda()) {
+            stream_guard.emplace(c10::cuda::getStreamFromPool(false, m_encoding_device->index()));
+        }
+#endif
+        const auto device_columns =
+                torch::from_blob(columns.data(), {kNumColumnFields, num_columns}, torch::kInt32)
+                        .to(*m_encoding_device);
+        const auto features =
+                build_stereo_features(template_read->raw_data.to(*m_encoding_device),
+                                      complement_read->raw_data.to(*m_encoding_device),
+                                      device_columns, stereo_signal_len);
+        // The features hand back what they took once the last of them is freed, which may be
+        // after the node is.
+        read->raw_data = torch::from_blob(
+                features.data_ptr(), features.sizes(),
+                [features, in_use = m_device_feature_bytes, feature_bytes](void*) {
+                    in_use->fetch_sub(feature_bytes);
+                },
+                features.options());
+#if DORADO_GPU_BUILD && !defined(__APPLE__)
+        // The basecaller reads the features on its own streams, and columns goes out of scope.
+        // Pool streams are shared between threads, so only this encode's work is waited for.
+        if (stream_guard) {
+            at::cuda::CUDAEvent features_ready;
+            features_ready.record(stream_guard->current_stream());
+            features_ready.synchronize();
+        }
+#endif
+        return read;
+    }
+
+    // The output comes from the pool, since every pair needs one.
+    auto stereo_signal = utils::TensorPool::instance()
+                                 .empty(int64_t(kNumFeatures) * stereo_signal_len, torch::kFloat16)
+                                 .view({kNumFeatures, stereo_signal_len});
+    auto* const stereo_signal_ptr = static_cast<SampleType*>(stereo_signal.data_ptr());
     std::array<SampleType*, kNumFeatures> feature_ptrs;
     for (int feature_idx = 0; feature_idx < kNumFeatures; ++feature_idx) {
-        auto& feature_ptr = feature_ptrs[feature_idx];
-        feature_ptr = static_cast<SampleType*>(tmp[feature_idx].data_ptr());
+        feature_ptrs[feature_idx] = stereo_signal_ptr + int64_t(feature_idx) * stereo_signal_len;
+    }
+
+    // Signal features start out as the padding value, and the rest as 0.
+    float min_sample = std::numeric_limits<float>::max();
+    for (int64_t i = 0; i < template_signal_len; ++i) {
+        min_sample = std::min(min_sample, static_cast<float>(template_raw_data_ptr[i]));
     }
+    for (int64_t i = 0; i < complement_signal_len; ++i) {
+        min_sample = std::min(min_sample, static_cast<float>(complement_raw_data_ptr[i]));
+    }
+    const float pad_value = 0.8 * min_sample;
+    std::fill_n(feature_ptrs[kFeatureTemplateSignal], 2 * stereo_signal_len,
+                static_cast<SampleType>(pad_value));
+    std::fill_n(feature_ptrs[kFeatureTemplateFirstNucleotide],
+                (kNumFeatures - 2) * stereo_signal_len, static_cast<SampleType>(0.0f));
+
+    // Converts Q scores from char to SampleType, with appropriate scale/offset.
+    const auto convert_q_score = [](char q_in) {
+        return static_cast<SampleType>(static_cast<float>(q_in - 33) / 90.0f);
+    };
 
     int stereo_global_cursor = 0;  // Index into the stereo-encoded signal
     for (int i = start_alignment_position; i < end_alignment_position; i++) {
         // We move along every alignment position. For every position we need to add signal and padding.
-        // Let us add the respective nucleotides and q-scores
-        int template_segment_length = 0;    // index into this segment in signal-space
-        int complement_segment_length = 0;  // index into this segment in signal-space
-
-        // If there is *not* an insertion to the query, add the nucleotide from the target cursor
-        if (result.alignment[i] != kAlignInsertionToQuery) {
-            // TODO -- these memcpys could be merged
-            std::memcpy(&feature_ptrs[kFeatureTemplateSignal]
-                                     [stereo_global_cursor + template_segment_length],
-                        &template_raw_data_ptr[template_signal_cursor], sizeof(SampleType));
-            template_segment_length++;
-            template_signal_cursor++;
-            auto max_signal_length = template_moves_expanded.size();
-
-            // We are relying on strings of 0s ended in a 1.  It would be more efficient
-            // in any case to store run length data above.
-            // We're also assuming uint8_t is an alias for char (not guaranteed in principle).
-            const auto* const start_ptr = &template_moves_expanded[template_signal_cursor];
-            auto* const next_move_ptr =
-                    static_cast<const uint8_t*>(std::memchr(start_ptr, 1, max_signal_length));
-            const size_t sample_count =
-                    next_move_ptr ? (next_move_ptr - start_ptr) : max_signal_length;
-
-            // Assumes contiguity of successive elements.
-            std::memcpy(&feature_ptrs[kFeatureTemplateSignal]
-                                     [stereo_global_cursor + template_segment_length],
-                        &template_raw_data_ptr[template_signal_cursor],
-                        sample_count * sizeof(SampleType));
-
-            template_signal_cursor += sample_count;
-            template_segment_length += sample_count;
-        }
-
-        // If there is *not* an insertion to the target, add the nucleotide from the query cursor
-        if (result.alignment[i] != kAlignInsertionToTarget) {
-            std::memcpy(&feature_ptrs[kFeatureComplementSignal]
-                                     [stereo_global_cursor + complement_segment_length],
-                        &flipped_complement_raw_data_ptr[complement_signal_cursor],
-                        sizeof(SampleType));
-
-            complement_segment_length++;
-            complement_signal_cursor++;
-            auto max_signal_length = complement_moves_expanded.size();
-
-            // See comments above.
-            const auto* const start_ptr = &complement_moves_expanded[complement_signal_cursor];
-            auto* const next_move_ptr =
-                    static_cast<const uint8_t*>(std::memchr(start_ptr, 1, max_signal_length));
-            const size_t sample_count =
-                    next_move_ptr ? (next_move_ptr - start_ptr) : max_signal_length;
-
-            std::memcpy(&feature_ptrs[kFeatureComplementSignal]
-                                     [stereo_global_cursor + complement_segment_length],
-                        &flipped_complement_raw_data_ptr[complement_signal_cursor],
-                        sample_count * sizeof(SampleType));
-
-            complement_signal_cursor += sample_count;
-            complement_segment_length += sample_count;
-        }
-
+        const auto [template_segment_length, complement_segment_length] =
+                column_lengths[i - start_alignment_position];
         const int total_segment_length =
                 std::max(template_segment_length, complement_segment_length);
         const int start_ts = stereo_global_cursor;
 
-        // Converts Q scores from char to SampleType, with appropriate scale/offset.
-        const auto convert_q_score = [](char q_in) {
-            return static_cast<SampleType>(static_cast<float>(q_in - 33) / 90.0f);
-        };
+        // Assumes contiguity of successive elements.
+        std::memcpy(&feature_ptrs[kFeatureTemplateSignal][start_ts],
+                    &template_raw_data_ptr[template_signal_cursor],
+                    template_segment_length * sizeof(SampleType));
+        template_signal_cursor += template_segment_length;
+
+        // The complement signal is used in reverse.
+        auto* const complement_feature_ptr = &feature_ptrs[kFeatureComplementSignal][start_ts];
+        const auto* const complement_segment_end =
+                complement_raw_data_ptr + (complement_signal_len - 1 - complement_signal_cursor);
+        for (int j = 0; j < complement_segment_length; ++j) {
+            complement_feature_ptr[j] = complement_segment_end[-j];
+        }
+        complement_signal_cursor += complement_segment_length;
 
         // Now, add the nucleotides and q scores
         if (result.alignment[i] != kAlignInsertionToQuery) {
@@ -258,12 +456,7 @@ std::shared_ptr<dorado::Read> StereoDuplexEncoderNode::stereo_encode(
         stereo_global_cursor += total_segment_length;
     }
 
-    tmp = tmp.index(
-            {torch::indexing::Slice(None), torch::indexing::Slice(None, stereo_global_cursor)});
-
-    read->read_id = template_read->read_id + ";" + complement_read->read_id;
-    read->raw_data = tmp;  // use the encoded signal
-    read->is_duplex = true;
+    read->raw_data = stereo_signal;  // use the encoded signal
 
     edlibFreeAlignResult(result);
 
@@ -274,49 +467,72 @@ std::shared_ptr<dorado::Read> StereoDuplexEncoderNode::stereo_encode(
 namespace dorado {
 
 void StereoDuplexEncoderNode::worker_thread() {
+    utils::set_thread_name("stereo_encoder");
     Message message;
     while (m_work_queue.try_pop(message)) {
         if (std::holds_alternative<std::shared_ptr<ReadPair>>(message)) {
             auto read_pair = std::get<std::shared_ptr<ReadPair>>(message);
-            std::shared_ptr<Read> stereo_encoded_read =
-                    stereo_encode(read_pair->read_1, read_pair->read_2);
-
-            if (stereo_encoded_read->raw_data.ndimension() ==
-                2) {  // 2 dims for stereo encoding, 1 for simplex
-                m_sink.push_message(
-                        stereo_encoded_read);  // Strereo-encoded read created, send it to sink
-            }
+            // Encoding is the expensive part, so it runs on the shared executor.
+            // push() blocks while the node has its maximum number of encodes in flight.
+            m_encode_tasks.push([this, read_pair = std::move(read_pair)] {
+                std::shared_ptr<Read> stereo_encoded_read =
+                        stereo_encode(read_pair->read_1, read_pair->read_2);
+
+                if (stereo_encoded_read->raw_data.ndimension() ==
+                    2) {  // 2 dims for stereo encoding, 1 for simplex
+                    m_sink.push_message(
+                            stereo_encoded_read);  // Strereo-encoded read created, send it to sink
+                }
+            });
         } else if (std::holds_alternative<std::shared_ptr<Read>>(message)) {
             auto read = std::get<std::shared_ptr<Read>>(message);
             m_sink.push_message(read);
         }
     }
 
-    int num_worker_threads = --m_num_worker_threads;
-    if (num_worker_threads == 0) {
-        m_sink.terminate();
-    }
+    // Wait for encodes in flight before telling the sink there's nothing more to come.
+    m_encode_tasks.wait();
+    spdlog::info("> Stereo encoded {} of {} pairs: {} rejected by their sketches, {} by alignment",
+                 m_num_pairs_encoded.load(), m_num_pairs_in.load(),
+                 m_num_pairs_rejected_by_sketch.load(), m_num_pairs_rejected_by_alignment.load());
+    m_sink.terminate();
 }
 
-StereoDuplexEncoderNode::StereoDuplexEncoderNode(MessageSink& sink, int input_signal_stride)
+StereoDuplexEncoderNode::StereoDuplexEncoderNode(MessageSink& sink,
+                                                 int input_signal_stride,
+                                                 size_t num_worker_threads,
+                                                 const std::string& encoding_device)
         : m_input_signal_stride(input_signal_stride),
           MessageSink(1000),
           m_sink(sink),
-          m_num_worker_threads(std::thread::hardware_concurrency()) {
-    for (int i = 0; i < m_num_worker_threads; i++) {
-        std::unique_ptr<std::thread> stereo_encoder_worker_thread =
-                std::make_unique<std::thread>(&StereoDuplexEncoderNode::worker_thread, this);
-        worker_threads.push_back(std::move(stereo_encoder_worker_thread));
+          m_encode_tasks(utils::WorkStealingExecutor::instance(),
+                         num_worker_threads == 0 ? std::thread::hardware_concurrency()
+                                                 : num_worker_threads) {
+    if (!encoding_device.empty()) {
+        m_encoding_device = torch::Device(encoding_device);
     }
+    m_input_worker = std::make_unique<std::thread>(&StereoDuplexEncoderNode::worker_thread, this);
 }
 
 StereoDuplexEncoderNode::~StereoDuplexEncoderNode() {
     terminate();
-    for (auto& t : worker_threads) {
-        t->join();
-    }
+    m_input_worker->join();
 
     m_sink.terminate();
 }
 
+void StereoDuplexEncoderNode::add_metrics(utils::MetricsRegistry& registry) const {
+    using Type = utils::MetricsRegistry::Type;
+    registry.add("dorado_stereo_pairs_total", "Pairs taken in for stereo encoding.", Type::COUNTER,
+                 [this] { return m_num_pairs_in.load(); });
+    registry.add("dorado_stereo_pairs_rejected_by_sketch_total",
+                 "Pairs whose minimizer sketches share too little for them to align.",
+                 Type::COUNTER, [this] { return m_num_pairs_rejected_by_sketch.load(); });
+    registry.add("dorado_stereo_pairs_rejected_by_alignment_total",
+                 "Pairs which don't align closely enough for duplex consensus.", Type::COUNTER,
+                 [this] { return m_num_pairs_rejected_by_alignment.load(); });
+    registry.add("dorado_stereo_pairs_encoded_total", "Pairs stereo encoded for the duplex model.",
+                 Type::COUNTER, [this] { return m_num_pairs_encoded.load(); });
+}
+
 }  // namespace dorado
@@ -1,25 +1,50 @@
 #pragma once
 #include "../nn/ModelRunner.h"
 #include "ReadPipeline.h"
+#include "utils/WorkStealingExecutor.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
 
 namespace dorado {
 
+namespace utils {
+class MetricsRegistry;
+}
+
 class StereoDuplexEncoderNode : public MessageSink {
 public:
-    StereoDuplexEncoderNode(MessageSink &sink, int input_signal_stride);
+    // At most num_worker_threads pairs are encoded at once, or one per hardware thread if it's 0.
+    // If encoding_device is empty, the features are built on the host.  Otherwise, e.g. for
+    // cuda:0, the reads' signals and a compact description of their alignment are copied to
+    // the device and the features are built there, and sent on in its memory, which saves a
+    // host tensor of every pair's features and its copy to the device.  Pairs waiting on the
+    // basecaller past a limit on the device memory their features take are built on the host.
+    StereoDuplexEncoderNode(MessageSink &sink,
+                            int input_signal_stride,
+                            size_t num_worker_threads = 0,
+                            const std::string &encoding_device = "");
 
     std::shared_ptr<dorado::Read> stereo_encode(std::shared_ptr<dorado::Read> template_read,
                                                 std::shared_ptr<dorado::Read> complement_read);
 
     ~StereoDuplexEncoderNode();
 
+    // Adds the pairs taken in, those rejected, by their sketches or alignment, and those encoded
+    // so far to registry.
+    void add_metrics(utils::MetricsRegistry &registry) const;
+
 private:
     // Consume reads from input queue
     void worker_thread();
     MessageSink &m_sink;
 
-    std::vector<std::unique_ptr<std::thread>> worker_threads;
-    std::atomic<int> m_num_worker_threads;
+    // Stereo encodes are run as tasks on the shared executor.
+    utils::TaskQueue m_encode_tasks;
+    std::unique_ptr<std::thread> m_input_worker;
 
     // Time when Basecaller Node is initialised. Used for benchmarking and debugging
     std::chrono::time_point<std::chrono::system_clock> initialization_time;
@@ -29,6 +54,18 @@ private:
 
     // The stride which was used to simplex call the data
     int m_input_signal_stride;
+
+    // Where the features are built, if not on the host.
+    std::optional<torch::Device> m_encoding_device;
+    // Bytes taken by features on the device which haven't been freed, shared with their
+    // deleters, which may run after the node is destroyed.
+    std::shared_ptr<std::atomic<int64_t>> m_device_feature_bytes =
+            std::make_shared<std::atomic<int64_t>>(0);
+
+    std::atomic<int64_t> m_num_pairs_in{0};
+    std::atomic<int64_t> m_num_pairs_rejected_by_sketch{0};
+    std::atomic<int64_t> m_num_pairs_rejected_by_alignment{0};
+    std::atomic<int64_t> m_num_pairs_encoded{0};
 };
 
 }  // namespace dorado
\ No newline at end of file
@@ -0,0 +1,93 @@
+#include "ThreadAllocationController.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace dorado {
+
+ThreadAllocationController::ThreadAllocationController(std::chrono::milliseconds sample_interval)
+        : m_sample_interval(sample_interval) {}
+
+ThreadAllocationController::~ThreadAllocationController() { stop(); }
+
+void ThreadAllocationController::add_node(std::string name,
+                                          const MessageSink& node,
+                                          utils::ConcurrencyGate& gate,
+                                          size_t min_workers,
+                                          size_t max_workers) {
+    if (m_thread) {
+        throw std::runtime_error("Nodes must be added before the controller is started.");
+    }
+    min_workers = std::max<size_t>(min_workers, 1);
+    max_workers = std::max(max_workers, min_workers);
+    gate.set_limit(std::clamp(gate.limit(), min_workers, max_workers));
+    m_nodes.push_back({std::move(name), &node, &gate, min_workers, max_workers});
+}
+
+void ThreadAllocationController::start() {
+    if (!m_thread && m_nodes.size() > 1) {
+        m_thread = std::make_unique<std::thread>(&ThreadAllocationController::sampling_thread,
+                                                 this);
+    }
+}
+
+void ThreadAllocationController::stop() {
+    {
+        std::lock_guard lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    if (m_thread) {
+        m_thread->join();
+        m_thread.reset();
+    }
+}
+
+bool ThreadAllocationController::rebalance() {
+    NodeInfo* receiver = nullptr;
+    NodeInfo* donor = nullptr;
+    float receiver_occupancy = kHighOccupancy;
+    float donor_occupancy = kLowOccupancy;
+
+    for (auto& node : m_nodes) {
+        const float occupancy = node.node->get_queue_occupancy();
+        const size_t limit = node.gate->limit();
+        if (occupancy > receiver_occupancy && limit < node.max_workers) {
+            receiver = &node;
+            receiver_occupancy = occupancy;
+        }
+        if (occupancy < donor_occupancy && limit > node.min_workers) {
+            donor = &node;
+            donor_occupancy = occupancy;
+        }
+    }
+
+    if (!receiver || !donor || receiver == donor) {
+        return false;
+    }
+
+    // Shrink the donor first so the total number of active workers never overshoots.
+    donor->gate->set_limit(donor->gate->limit() - 1);
+    receiver->gate->set_limit(receiver->gate->limit() + 1);
+    spdlog::trace("Moved a worker from {} (queue {:.0f}% full, {} workers) to {} ({:.0f}% full, {} "
+                  "workers)",
+                  donor->name, 100 * donor_occupancy, donor->gate->limit(), receiver->name,
+                  100 * receiver_occupancy, receiver->gate->limit());
+    return true;
+}
+
+void ThreadAllocationController::sampling_thread() {
+    std::unique_lock lock(m_mutex);
+    while (!m_cv.wait_for(lock, m_sample_interval, [this] { return m_stop; })) {
+        rebalance();
+    }
+    std::string allocations;
+    for (auto& node : m_nodes) {
+        allocations += " " + node.name + "=" + std::to_string(node.gate->limit());
+    }
+    spdlog::debug("> Final worker thread allocations:{}", allocations);
+}
+
+}  // namespace dorado
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "ReadPipeline.h"
+#include "utils/ConcurrencyGate.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dorado {
+
+// Moves worker threads between CPU-bound pipeline nodes while a pipeline is running.
+// Each registered node exposes the ConcurrencyGate which limits its active workers.
+// The controller periodically samples the fill level of every registered node's input
+// queue: if one node's input is backing up while another's is close to empty, one
+// worker permit moves from the idle node to the congested one.  The total number of
+// active workers across registered nodes therefore stays constant.
+class ThreadAllocationController {
+public:
+    // Input queues fuller than this are considered congested.
+    static constexpr float kHighOccupancy = 0.5f;
+    // Input queues emptier than this are considered to have spare workers.
+    static constexpr float kLowOccupancy = 0.1f;
+
+    explicit ThreadAllocationController(
+            std::chrono::milliseconds sample_interval = std::chrono::milliseconds(500));
+    ~ThreadAllocationController();
+
+    // The node and gate must outlive the controller, or stop() must be called first.
+    // The node's gate limit will be kept within [min_workers, max_workers].
+    void add_node(std::string name,
+                  const MessageSink& node,
+                  utils::ConcurrencyGate& gate,
+                  size_t min_workers,
+                  size_t max_workers);
+
+    // Starts sampling in the background.  Nodes must be added before starting.
+    void start();
+    void stop();
+
+    // Performs one sampling and rebalancing step.  Returns true if a worker was moved.
+    // Exposed for testing.
+    bool rebalance();
+
+private:
+    struct NodeInfo {
+        std::string name;
+        const MessageSink* node;
+        utils::ConcurrencyGate* gate;
+        size_t min_workers;
+        size_t max_workers;
+    };
+
+    void sampling_thread();
+
+    std::vector<NodeInfo> m_nodes;
+    std::chrono::milliseconds m_sample_interval;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_stop{false};
+    std::unique_ptr<std::thread> m_thread;
+};
+
+}  // namespace dorado
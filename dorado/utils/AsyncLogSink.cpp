@@ -0,0 +1,88 @@
+#include "AsyncLogSink.h"
+
+#include "thread_utils.h"
+
+#include <spdlog/details/log_msg.h>
+#include <spdlog/fmt/fmt.h>
+
+#include <vector>
+
+namespace {
+
+// Messages written between checks of the dropped count.
+constexpr size_t kMaxBatchSize = 64;
+
+}  // namespace
+
+namespace dorado::utils {
+
+AsyncLogSink::AsyncLogSink(std::shared_ptr<spdlog::sinks::sink> sink, size_t capacity)
+        : m_sink(std::move(sink)), m_queue(capacity), m_writer(&AsyncLogSink::writer_thread, this) {}
+
+AsyncLogSink::~AsyncLogSink() {
+    m_queue.terminate();
+    m_writer.join();
+}
+
+void AsyncLogSink::log(const spdlog::details::log_msg& msg) {
+    if (msg.level >= spdlog::level::err) {
+        flush();
+        m_sink->log(msg);
+        m_sink->flush();
+        return;
+    }
+    Message message{std::string(msg.logger_name.data(), msg.logger_name.size()),
+                    msg.level,
+                    msg.time,
+                    msg.thread_id,
+                    msg.source,
+                    std::string(msg.payload.data(), msg.payload.size())};
+    if (m_queue.try_push_now(std::move(message))) {
+        m_num_queued.fetch_add(1, std::memory_order_release);
+    } else {
+        m_num_dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void AsyncLogSink::flush() {
+    const size_t num_queued = m_num_queued.load(std::memory_order_acquire);
+    while (m_num_written.load(std::memory_order_acquire) < num_queued) {
+        std::this_thread::yield();
+    }
+    m_sink->flush();
+}
+
+void AsyncLogSink::set_pattern(const std::string& pattern) { m_sink->set_pattern(pattern); }
+
+void AsyncLogSink::set_formatter(std::unique_ptr<spdlog::formatter> sink_formatter) {
+    m_sink->set_formatter(std::move(sink_formatter));
+}
+
+void AsyncLogSink::writer_thread() {
+    set_thread_name("log_writer");
+    lower_thread_priority();
+    size_t num_dropped_reported = 0;
+    std::vector<Message> messages;
+    while (m_queue.try_pop_batch(messages, kMaxBatchSize)) {
+        for (const auto& message : messages) {
+            spdlog::details::log_msg msg(message.time, message.source, message.logger_name,
+                                         message.level, message.payload);
+            msg.thread_id = message.thread_id;
+            m_sink->log(msg);
+        }
+        m_num_written.fetch_add(messages.size(), std::memory_order_release);
+        messages.clear();
+
+        const size_t num_dropped = m_num_dropped.load(std::memory_order_relaxed);
+        if (num_dropped > num_dropped_reported) {
+            const auto payload = fmt::format("{} log messages dropped, logged faster than "
+                                             "they could be written",
+                                             num_dropped - num_dropped_reported);
+            m_sink->log(spdlog::details::log_msg("", spdlog::level::warn, payload));
+            num_dropped_reported = num_dropped;
+        }
+    }
+    m_sink->flush();
+}
+
+}  // namespace dorado::utils
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "LockFreeQueue.h"
+
+#include <spdlog/sinks/sink.h>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace dorado::utils {
+
+// An spdlog sink which hands messages to a thread of its own to write to the sink it wraps, so
+// that pipeline threads logging never wait on stderr.  Messages are queued in a lock-free ring,
+// and formatted and written by the low priority writer thread.  A message logged while the ring
+// is full is dropped rather than waited for, and the writer says how many were.  Errors are
+// never dropped: they're written and flushed by the thread logging them, once what was queued
+// before them has been, so that they're out before a run which hit them can die.
+class AsyncLogSink : public spdlog::sinks::sink {
+public:
+    explicit AsyncLogSink(std::shared_ptr<spdlog::sinks::sink> sink, size_t capacity = 8192);
+    // Writes the messages still queued.
+    ~AsyncLogSink() override;
+
+    AsyncLogSink(const AsyncLogSink&) = delete;
+    AsyncLogSink& operator=(const AsyncLogSink&) = delete;
+
+    // Thread safe, and never blocks, but for errors.
+    void log(const spdlog::details::log_msg& msg) override;
+    // Waits for the messages logged so far to be written, then flushes the wrapped sink.
+    void flush() override;
+    void set_pattern(const std::string& pattern) override;
+    void set_formatter(std::unique_ptr<spdlog::formatter> sink_formatter) override;
+
+    size_t num_dropped() const { return m_num_dropped.load(std::memory_order_relaxed); }
+
+private:
+    // A copy of a log_msg, which only refers to strings which are the caller's.
+    struct Message {
+        std::string logger_name;
+        spdlog::level::level_enum level{spdlog::level::off};
+        spdlog::log_clock::time_point time;
+        size_t thread_id{0};
+        spdlog::source_loc source;
+        std::string payload;
+    };
+
+    void writer_thread();
+
+    const std::shared_ptr<spdlog::sinks::sink> m_sink;
+    LockFreeQueue<Message> m_queue;
+    std::atomic<size_t> m_num_queued{0};
+    std::atomic<size_t> m_num_written{0};
+    std::atomic<size_t> m_num_dropped{0};
+    std::thread m_writer;
+};
+
+}  // namespace dorado::utils
@@ -4,6 +4,7 @@
 #include <mutex>
 #include <optional>
 #include <queue>
+#include <vector>
 
 // Asynchronous queue for producer/consumer use.
 // Items must be movable.
@@ -23,6 +24,10 @@ class AsyncQueue {
     // Number of items that can be added before further additions block, pending
     // consumption of items.
     size_t m_capacity = 0;
+    // Number of try_push_batch calls waiting for room for their whole batch.  While there
+    // are any, pops wake every pusher, since a single wakeup could go to a batch that still
+    // doesn't fit while a pusher that would fit sleeps on.
+    size_t m_num_batch_waiters = 0;
     // If true, CV waits should terminate regardless of other state.
     // Pending attempts to push or pop items will fail.
     bool m_terminate = false;
@@ -78,8 +83,92 @@ public:
         m_items.pop();
 
         // Inform a waiting thread that the queue is not full.
+        const bool wake_all = m_num_batch_waiters > 0;
         lock.unlock();
-        m_not_full_cv.notify_one();
+        if (wake_all) {
+            m_not_full_cv.notify_all();
+        } else {
+            m_not_full_cv.notify_one();
+        }
+
+        return true;
+    }
+
+    // Attempts to add all items to the queue, in order, under as few lock acquisitions
+    // as capacity allows.
+    // A batch no larger than the capacity is added all at once, blocking until there is
+    // space for all of it, so that batches pushed from different threads are never
+    // interleaved.  A larger batch is added as space allows.
+    // Blocks until there is space or terminate() is called.
+    // Returns true if all items were added.  If terminate() was called, any items not
+    // yet added are dropped and false is returned.
+    // items is left empty.
+    bool try_push_batch(std::vector<Item>&& items) {
+        const size_t space_needed = items.size() <= m_capacity ? items.size() : 1;
+        auto it = items.begin();
+        while (it != items.end()) {
+            std::unique_lock lock(m_mutex);
+            ++m_num_batch_waiters;
+            m_not_full_cv.wait(lock, [this, space_needed] {
+                return m_items.size() + space_needed <= m_capacity || m_terminate;
+            });
+            --m_num_batch_waiters;
+            if (m_terminate) {
+                items.clear();
+                return false;
+            }
+            size_t num_pushed = 0;
+            while (it != items.end() && m_items.size() < m_capacity) {
+                m_items.push(std::move(*it));
+                ++it;
+                ++num_pushed;
+            }
+            lock.unlock();
+            if (num_pushed == 1) {
+                m_not_empty_cv.notify_one();
+            } else {
+                m_not_empty_cv.notify_all();
+            }
+        }
+        items.clear();
+        return true;
+    }
+
+    // Obtains up to max_items items from the queue, appending them to items.
+    // Blocks until at least one item is available.
+    // If the queue is empty, and we are terminating, returns false.
+    bool try_pop_batch(std::vector<Item>& items, size_t max_items) {
+        return try_pop_batch(items, max_items, [](const Item&, const Item&) { return false; });
+    }
+
+    // As above, but carries on past max_items while same_group(last, next) says the next item
+    // belongs with the last one taken, so that a group is never split between batches.  Only
+    // groups pushed together in one try_push_batch are sure to be in the queue in full.
+    template <class SameGroup>
+    bool try_pop_batch(std::vector<Item>& items, size_t max_items, SameGroup same_group) {
+        std::unique_lock lock(m_mutex);
+        m_not_empty_cv.wait(lock, [this] { return !m_items.empty() || m_terminate; });
+
+        if (m_terminate && m_items.empty()) {
+            return false;
+        }
+
+        size_t num_popped = 0;
+        while (!m_items.empty() &&
+               (num_popped < max_items ||
+                (num_popped > 0 && same_group(items.back(), m_items.front())))) {
+            items.push_back(std::move(m_items.front()));
+            m_items.pop();
+            ++num_popped;
+        }
+
+        const bool wake_all = m_num_batch_waiters > 0;
+        lock.unlock();
+        if (num_popped == 1 && !wake_all) {
+            m_not_full_cv.notify_one();
+        } else {
+            m_not_full_cv.notify_all();
+        }
 
         return true;
     }
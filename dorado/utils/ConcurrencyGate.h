@@ -0,0 +1,53 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+namespace dorado::utils {
+
+// Limits how many of a node's worker threads are active at once.
+// Nodes spawn their maximum number of workers up front, and each worker holds a permit
+// from the gate while it processes a message.  Adjusting the limit at runtime moves
+// processing capacity between nodes without creating or destroying threads.
+class ConcurrencyGate {
+public:
+    explicit ConcurrencyGate(size_t limit) : m_limit(std::max<size_t>(limit, 1)) {}
+
+    // Blocks until fewer than limit() permits are held.
+    void acquire() {
+        std::unique_lock lock(m_mutex);
+        m_cv.wait(lock, [this] { return m_num_active < m_limit; });
+        ++m_num_active;
+    }
+
+    void release() {
+        {
+            std::lock_guard lock(m_mutex);
+            --m_num_active;
+        }
+        m_cv.notify_one();
+    }
+
+    void set_limit(size_t limit) {
+        {
+            std::lock_guard lock(m_mutex);
+            m_limit = std::max<size_t>(limit, 1);
+        }
+        m_cv.notify_all();
+    }
+
+    size_t limit() const {
+        std::lock_guard lock(m_mutex);
+        return m_limit;
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    size_t m_limit;
+    size_t m_num_active{0};
+};
+
+}  // namespace dorado::utils
@@ -0,0 +1,80 @@
+#include "FileLock.h"
+
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace dorado::utils {
+
+FileLock::FileLock(const std::filesystem::path& path) : FileLock(path, true) {}
+
+FileLock::FileLock(const std::filesystem::path& path, bool wait) {
+#ifdef _WIN32
+    m_handle = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE,
+                           FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                           OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_handle == INVALID_HANDLE_VALUE) {
+        m_handle = nullptr;
+        throw std::runtime_error("Could not open lock file " + path.string());
+    }
+    OVERLAPPED overlapped{};
+    const DWORD flags = LOCKFILE_EXCLUSIVE_LOCK | (wait ? 0 : LOCKFILE_FAIL_IMMEDIATELY);
+    m_locked = LockFileEx(m_handle, flags, 0, MAXDWORD, MAXDWORD, &overlapped);
+    if (!m_locked && (wait || GetLastError() != ERROR_LOCK_VIOLATION)) {
+        CloseHandle(m_handle);
+        m_handle = nullptr;
+        throw std::runtime_error("Could not lock " + path.string());
+    }
+#else
+    m_fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (m_fd < 0) {
+        throw std::runtime_error("Could not open lock file " + path.string() + ": " +
+                                 std::strerror(errno));
+    }
+    int result = 0;
+    do {
+        result = flock(m_fd, LOCK_EX | (wait ? 0 : LOCK_NB));
+    } while (result < 0 && errno == EINTR);
+    m_locked = result == 0;
+    if (!m_locked && (wait || errno != EWOULDBLOCK)) {
+        const auto error = errno;
+        close(m_fd);
+        m_fd = -1;
+        throw std::runtime_error("Could not lock " + path.string() + ": " + std::strerror(error));
+    }
+#endif
+}
+
+FileLock::~FileLock() {
+#ifdef _WIN32
+    if (m_handle) {
+        if (m_locked) {
+            OVERLAPPED overlapped{};
+            UnlockFileEx(m_handle, 0, MAXDWORD, MAXDWORD, &overlapped);
+        }
+        CloseHandle(m_handle);
+    }
+#else
+    // Closing the file releases the lock.
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+#endif
+}
+
+std::unique_ptr<FileLock> FileLock::try_lock(const std::filesystem::path& path) {
+    std::unique_ptr<FileLock> lock(new FileLock(path, false));
+    return lock->m_locked ? std::move(lock) : nullptr;
+}
+
+}  // namespace dorado::utils
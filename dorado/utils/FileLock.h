@@ -0,0 +1,36 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+
+namespace dorado::utils {
+
+// An exclusive advisory lock on a file, held until it's destroyed, for processes sharing a file,
+// e.g. nodes writing to one directory.  Each lock is taken on its own open of the file, so
+// threads of the same process exclude each other too.  Only other FileLocks are kept out: the
+// file itself can still be read and written.  Locks over NFS need a kernel which supports them.
+class FileLock {
+public:
+    // Blocks until the lock on path is taken, creating the file if it doesn't exist.  Throws if
+    // the file can't be opened.
+    explicit FileLock(const std::filesystem::path& path);
+    ~FileLock();
+
+    FileLock(const FileLock&) = delete;
+    FileLock& operator=(const FileLock&) = delete;
+
+    // As above, but returns null rather than waiting if another lock holds the file.
+    static std::unique_ptr<FileLock> try_lock(const std::filesystem::path& path);
+
+private:
+    FileLock(const std::filesystem::path& path, bool wait);
+
+#ifdef _WIN32
+    void* m_handle{nullptr};
+#else
+    int m_fd{-1};
+#endif
+    bool m_locked{false};
+};
+
+}  // namespace dorado::utils
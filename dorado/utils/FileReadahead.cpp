@@ -0,0 +1,173 @@
+#include "FileReadahead.h"
+
+#include "thread_utils.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <filesystem>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#if defined(__linux__) || defined(__APPLE__)
+int open_for_advice(const std::string& path) { return ::open(path.c_str(), O_RDONLY); }
+void close_for_advice(int fd) {
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+#else
+int open_for_advice(const std::string&) { return -1; }
+void close_for_advice(int) {}
+#endif
+
+// Asks the kernel to start reading length bytes at offset of the open file fd into the page
+// cache, without waiting for them.
+void advise_will_need(int fd, uint64_t offset, uint64_t length) {
+    if (fd < 0) {
+        return;
+    }
+#if defined(__linux__)
+    posix_fadvise(fd, static_cast<off_t>(offset), static_cast<off_t>(length),
+                  POSIX_FADV_WILLNEED);
+#elif defined(__APPLE__)
+    radvisory advice{static_cast<off_t>(offset), static_cast<int>(length)};
+    fcntl(fd, F_RDADVISE, &advice);
+#endif
+}
+
+// Drops the file at path's clean pages from the page cache.
+void advise_dont_need(const std::string& path) {
+#if defined(__linux__)
+    const int fd = open_for_advice(path);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+    close_for_advice(fd);
+#else
+    (void)path;
+#endif
+}
+
+}  // namespace
+
+namespace dorado::utils {
+
+FileReadahead::FileReadahead(std::vector<std::string> paths,
+                             size_t max_bytes_ahead,
+                             bool drop_when_loaded)
+        : m_paths(std::move(paths)),
+          m_max_bytes_ahead(max_bytes_ahead),
+          m_drop_when_loaded(drop_when_loaded),
+          m_requested_end(m_paths.size(), 0),
+          m_loaded_end(m_paths.size(), 0),
+          m_loaded(m_paths.size(), false) {
+    m_file_sizes.reserve(m_paths.size());
+    for (const auto& path : m_paths) {
+        std::error_code error;
+        const auto size = std::filesystem::file_size(path, error);
+        m_file_sizes.push_back(error ? 0 : size);
+    }
+    m_thread = std::thread(&FileReadahead::readahead_thread, this);
+}
+
+FileReadahead::~FileReadahead() {
+    {
+        std::lock_guard lock(m_mutex);
+        m_terminate = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+}
+
+uint64_t FileReadahead::bytes_ahead_in_file(size_t index) const {
+    return m_requested_end[index] - std::min(m_requested_end[index], m_loaded_end[index]);
+}
+
+void FileReadahead::file_progress(size_t index, size_t num_done, size_t num_parts) {
+    {
+        std::lock_guard lock(m_mutex);
+        if (index >= m_paths.size() || m_loaded[index] || num_parts == 0) {
+            return;
+        }
+        const auto loaded_end = static_cast<uint64_t>(
+                double(m_file_sizes[index]) * double(std::min(num_done, num_parts)) / num_parts);
+        if (loaded_end <= m_loaded_end[index]) {
+            return;
+        }
+        m_bytes_ahead -= bytes_ahead_in_file(index);
+        m_loaded_end[index] = loaded_end;
+        m_bytes_ahead += bytes_ahead_in_file(index);
+    }
+    m_cv.notify_all();
+}
+
+void FileReadahead::file_loaded(size_t index) {
+    {
+        std::lock_guard lock(m_mutex);
+        if (index >= m_paths.size() || m_loaded[index]) {
+            return;
+        }
+        m_bytes_ahead -= bytes_ahead_in_file(index);
+        m_loaded[index] = true;
+    }
+    m_cv.notify_all();
+    if (m_drop_when_loaded) {
+        advise_dont_need(m_paths[index]);
+    }
+}
+
+uint64_t FileReadahead::bytes_requested() const {
+    std::lock_guard lock(m_mutex);
+    return m_bytes_requested;
+}
+
+void FileReadahead::readahead_thread() {
+    utils::set_thread_name("readahead");
+    if (m_max_bytes_ahead == 0) {
+        return;
+    }
+    for (size_t index = 0; index < m_paths.size(); ++index) {
+        const int fd = open_for_advice(m_paths[index]);
+        for (uint64_t offset = 0; offset < m_file_sizes[index];) {
+            const uint64_t length = std::min(kSpanBytes, m_file_sizes[index] - offset);
+            {
+                std::unique_lock lock(m_mutex);
+                m_cv.wait(lock, [&] {
+                    // A span is always let through when nothing else is ahead, so a budget
+                    // smaller than a span can't stall the readahead.
+                    return m_terminate || m_loaded[index] || m_bytes_ahead == 0 ||
+                           m_bytes_ahead + length <= m_max_bytes_ahead;
+                });
+                if (m_terminate) {
+                    close_for_advice(fd);
+                    return;
+                }
+                // The loaders have got here first, so the rest of the file needn't be read ahead.
+                if (m_loaded[index]) {
+                    break;
+                }
+                // Nor need what they've got past, so readahead picks up from where they are.
+                if (m_loaded_end[index] > offset) {
+                    offset = m_loaded_end[index];
+                    m_requested_end[index] = offset;
+                    continue;
+                }
+                m_requested_end[index] = offset + length;
+                m_bytes_ahead += length;
+                m_bytes_requested += length;
+            }
+            advise_will_need(fd, offset, length);
+            offset += length;
+        }
+        close_for_advice(fd);
+    }
+    spdlog::debug("> Read ahead {:.1f} GB of input", m_bytes_requested / 1e9);
+}
+
+}  // namespace dorado::utils
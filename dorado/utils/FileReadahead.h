@@ -0,0 +1,68 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dorado::utils {
+
+// Reads files into the page cache, on a thread of its own, ahead of loaders which read them in
+// order with small synchronous reads, as the POD5 and HDF5 libraries do.  The kernel is asked
+// for each file in large spans, which it reads asynchronously, so the device has many requests
+// in flight rather than one at a time, and the loaders find the pages already cached.  No more
+// than max_bytes_ahead beyond where the loaders have got to are asked for at once, and none for
+// 0, so a file larger than the budget is read ahead in a window moving through it.  With
+// drop_when_loaded, each file's pages are dropped from the page cache once it has been loaded,
+// so that reading a multi-terabyte input doesn't push everything else out of the cache.
+// Readahead is a hint: where the platform has no way to give it, files are read as they would
+// have been.
+class FileReadahead {
+public:
+    FileReadahead(std::vector<std::string> paths, size_t max_bytes_ahead, bool drop_when_loaded);
+    ~FileReadahead();
+
+    FileReadahead(const FileReadahead&) = delete;
+    FileReadahead& operator=(const FileReadahead&) = delete;
+
+    // Tells the readahead that the first num_done of the num_parts parts paths[index] is loaded
+    // in, e.g. POD5 batches, have been loaded.  The file is taken to be that far through, so
+    // the budget spent on the bytes before is given back, and readahead never falls behind it.
+    void file_progress(size_t index, size_t num_done, size_t num_parts);
+    // Tells the readahead that paths[index] has been loaded, and its pages are done with.
+    void file_loaded(size_t index);
+
+    // Bytes asked to be read ahead so far.
+    uint64_t bytes_requested() const;
+
+private:
+    // The size of the spans files are asked for in.
+    static constexpr uint64_t kSpanBytes = uint64_t(8) << 20;
+
+    void readahead_thread();
+    // Bytes asked for of paths[index] beyond where the loaders have got to.  m_mutex must be
+    // held.
+    uint64_t bytes_ahead_in_file(size_t index) const;
+
+    const std::vector<std::string> m_paths;
+    const uint64_t m_max_bytes_ahead;
+    const bool m_drop_when_loaded;
+    std::vector<uint64_t> m_file_sizes;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    // Bytes asked for beyond where the loaders have got to, in files which haven't been loaded.
+    uint64_t m_bytes_ahead{0};
+    uint64_t m_bytes_requested{0};
+    // How far into each file has been asked for, and how far the loaders have got.
+    std::vector<uint64_t> m_requested_end;
+    std::vector<uint64_t> m_loaded_end;
+    std::vector<bool> m_loaded;
+    bool m_terminate{false};
+    std::thread m_thread;
+};
+
+}  // namespace dorado::utils
@@ -0,0 +1,385 @@
+#include "GpuArbiter.h"
+
+#include "FileLock.h"
+
+#include <spdlog/spdlog.h>
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#endif  // __linux__
+
+namespace {
+
+// Bumped whenever the layout of the segment changes.
+constexpr uint32_t kSegmentVersion = 1;
+constexpr uint32_t kSegmentReady = 0x44475041;
+constexpr int kMaxProcesses = 64;
+// Waits wake this often to check for processes which have exited.  Wakeups lost to a process
+// killed while waiting only delay the others by as much.
+constexpr auto kWaitInterval = std::chrono::milliseconds(100);
+// How long a process attaching waits for the one creating the segment to set it up.
+constexpr auto kAttachTimeout = std::chrono::seconds(5);
+
+#ifdef __linux__
+std::runtime_error system_error(const std::string& what, int error) {
+    return std::runtime_error(what + ": " + std::strerror(error));
+}
+
+// The file a process holds a lock on while it has slot, next to the segment in /dev/shm, which
+// any process sharing the segment also sees.
+std::filesystem::path slot_lock_path(const std::string& segment_name, int slot) {
+    return "/dev/shm" + segment_name + "-slot" + std::to_string(slot) + ".lock";
+}
+#endif  // __linux__
+
+}  // namespace
+
+namespace dorado::utils {
+
+#ifdef __linux__
+
+struct GpuArbiter::Segment {
+    struct Slot {
+        // 0 if the slot is free.
+        pid_t pid;
+        uint32_t waiting;
+        uint64_t reserved_bytes;
+        uint64_t turns;
+    };
+
+    // kSegmentReady once the process creating the segment has set it up.
+    std::atomic<uint32_t> ready;
+    uint32_t version;
+    pthread_mutex_t mutex;
+    pthread_cond_t turn_passed;
+    // The slot with the turn, or -1.
+    int32_t holder;
+    Slot slots[kMaxProcesses];
+};
+
+class GpuArbiter::SegmentLock {
+public:
+    SegmentLock(Segment& segment, const std::string& segment_name)
+            : m_segment(segment), m_segment_name(segment_name) {
+        const int result = pthread_mutex_lock(&m_segment.mutex);
+        if (result == EOWNERDEAD) {
+            // The process holding the lock died, but nothing is changed in more than one step.
+            pthread_mutex_consistent(&m_segment.mutex);
+        } else if (result != 0) {
+            throw system_error("Failed to lock the GPU arbitration segment", result);
+        }
+        clear_exited_processes();
+    }
+    ~SegmentLock() { pthread_mutex_unlock(&m_segment.mutex); }
+
+    SegmentLock(const SegmentLock&) = delete;
+    SegmentLock& operator=(const SegmentLock&) = delete;
+
+    // Waits for the turn to be passed on, or kWaitInterval.
+    void wait() {
+        timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        const auto wait_ns = std::chrono::nanoseconds(kWaitInterval).count();
+        deadline.tv_nsec += static_cast<long>(wait_ns);
+        deadline.tv_sec += deadline.tv_nsec / 1000000000;
+        deadline.tv_nsec %= 1000000000;
+        const int result =
+                pthread_cond_timedwait(&m_segment.turn_passed, &m_segment.mutex, &deadline);
+        if (result == EOWNERDEAD) {
+            pthread_mutex_consistent(&m_segment.mutex);
+        }
+        clear_exited_processes();
+    }
+
+    // Passes the turn from the holder to the next slot waiting after it, or leaves it free.
+    void pass_turn() {
+        const int from = m_segment.holder < 0 ? 0 : m_segment.holder;
+        m_segment.holder = -1;
+        for (int i = 1; i <= kMaxProcesses; ++i) {
+            const int slot = (from + i) % kMaxProcesses;
+            if (m_segment.slots[slot].pid != 0 && m_segment.slots[slot].waiting) {
+                m_segment.holder = slot;
+                break;
+            }
+        }
+        pthread_cond_broadcast(&m_segment.turn_passed);
+    }
+
+private:
+    void clear_exited_processes() {
+        for (int slot = 0; slot < kMaxProcesses; ++slot) {
+            auto& process = m_segment.slots[slot];
+            if (process.pid == 0 || !process_exited(slot)) {
+                continue;
+            }
+            spdlog::debug("> Clearing the GPU arbitration slot of exited process {}",
+                          process.pid);
+            process = {};
+            if (m_segment.holder == slot) {
+                pass_turn();
+            }
+        }
+    }
+
+    // Whether the process with slot has exited, letting go of its slot's lock.  Any process
+    // claiming the slot again can only do so while holding the segment's lock, as this one is.
+    bool process_exited(int slot) const {
+        try {
+            return FileLock::try_lock(slot_lock_path(m_segment_name, slot)) != nullptr;
+        } catch (const std::exception& e) {
+            spdlog::debug("> Unable to check GPU arbitration slot {}: {}", slot, e.what());
+            return false;
+        }
+    }
+
+    Segment& m_segment;
+    const std::string& m_segment_name;
+};
+
+GpuArbiter::GpuArbiter(const std::string& segment_name) : m_segment_name(segment_name) {
+    int fd = shm_open(segment_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0666);
+    const bool created = fd >= 0;
+    if (!created) {
+        if (errno != EEXIST) {
+            throw system_error("Failed to create GPU arbitration segment " + segment_name, errno);
+        }
+        fd = shm_open(segment_name.c_str(), O_RDWR, 0);
+        if (fd < 0) {
+            throw system_error("Failed to open GPU arbitration segment " + segment_name, errno);
+        }
+    }
+
+    const auto deadline = std::chrono::steady_clock::now() + kAttachTimeout;
+    // Throws once the process creating the segment has taken too long to set it up.
+    auto wait_for_creator = [&] {
+        if (std::chrono::steady_clock::now() > deadline) {
+            throw std::runtime_error("GPU arbitration segment " + segment_name +
+                                     " was never set up: remove /dev/shm" + segment_name +
+                                     " if no dorado process is using it");
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    };
+    if (created) {
+        // So that other users' processes can share the device too, whatever the umask.
+        fchmod(fd, 0666);
+        if (ftruncate(fd, sizeof(Segment)) != 0) {
+            const int error = errno;
+            close(fd);
+            shm_unlink(segment_name.c_str());
+            throw system_error("Failed to size GPU arbitration segment " + segment_name, error);
+        }
+    } else {
+        struct stat status;
+        try {
+            while (fstat(fd, &status) == 0 && size_t(status.st_size) < sizeof(Segment)) {
+                wait_for_creator();
+            }
+        } catch (...) {
+            close(fd);
+            throw;
+        }
+    }
+
+    void* memory = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        throw system_error("Failed to map GPU arbitration segment " + segment_name, errno);
+    }
+    m_segment = static_cast<Segment*>(memory);
+
+    if (created) {
+        pthread_mutexattr_t mutex_attr;
+        pthread_mutexattr_init(&mutex_attr);
+        pthread_mutexattr_setpshared(&mutex_attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&mutex_attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&m_segment->mutex, &mutex_attr);
+        pthread_mutexattr_destroy(&mutex_attr);
+        pthread_condattr_t cond_attr;
+        pthread_condattr_init(&cond_attr);
+        pthread_condattr_setpshared(&cond_attr, PTHREAD_PROCESS_SHARED);
+        pthread_cond_init(&m_segment->turn_passed, &cond_attr);
+        pthread_condattr_destroy(&cond_attr);
+        m_segment->version = kSegmentVersion;
+        m_segment->holder = -1;
+        m_segment->ready.store(kSegmentReady, std::memory_order_release);
+    } else {
+        while (m_segment->ready.load(std::memory_order_acquire) != kSegmentReady) {
+            try {
+                wait_for_creator();
+            } catch (...) {
+                munmap(m_segment, sizeof(Segment));
+                throw;
+            }
+        }
+        if (m_segment->version != kSegmentVersion) {
+            munmap(m_segment, sizeof(Segment));
+            throw std::runtime_error("GPU arbitration segment " + segment_name +
+                                     " is from another version of dorado");
+        }
+    }
+
+    SegmentLock lock(*m_segment, m_segment_name);
+    for (int slot = 0; slot < kMaxProcesses; ++slot) {
+        if (m_segment->slots[slot].pid != 0) {
+            continue;
+        }
+        const auto lock_path = slot_lock_path(m_segment_name, slot);
+        try {
+            m_slot_lock = FileLock::try_lock(lock_path);
+        } catch (const std::exception& e) {
+            spdlog::debug("> Unable to lock GPU arbitration slot {}: {}", slot, e.what());
+        }
+        if (!m_slot_lock) {
+            continue;
+        }
+        // So that other users' processes can check the slot too, whatever the umask.
+        std::error_code error;
+        std::filesystem::permissions(
+                lock_path,
+                std::filesystem::perms::owner_read | std::filesystem::perms::owner_write |
+                        std::filesystem::perms::group_read |
+                        std::filesystem::perms::group_write |
+                        std::filesystem::perms::others_read |
+                        std::filesystem::perms::others_write,
+                error);
+        m_segment->slots[slot] = {};
+        // Only for logging: whether the process is still there is told by the lock.
+        m_segment->slots[slot].pid = getpid();
+        m_slot = slot;
+        break;
+    }
+    if (m_slot < 0) {
+        munmap(m_segment, sizeof(Segment));
+        throw std::runtime_error("GPU arbitration segment " + segment_name + " has all " +
+                                 std::to_string(kMaxProcesses) + " of its slots taken");
+    }
+}
+
+GpuArbiter::~GpuArbiter() {
+    {
+        SegmentLock lock(*m_segment, m_segment_name);
+        m_segment->slots[m_slot] = {};
+        if (m_segment->holder == m_slot) {
+            lock.pass_turn();
+        }
+    }
+    munmap(m_segment, sizeof(Segment));
+    // Only let go of once the slot is free, so no other process clears it meanwhile.
+    m_slot_lock.reset();
+}
+
+GpuArbiter::Turn GpuArbiter::acquire_turn() {
+    std::unique_lock local_lock(m_local_mutex);
+    SegmentLock lock(*m_segment, m_segment_name);
+    auto& slot = m_segment->slots[m_slot];
+    slot.waiting = 1;
+    if (m_segment->holder < 0) {
+        m_segment->holder = m_slot;
+    }
+    while (m_segment->holder != m_slot) {
+        lock.wait();
+    }
+    slot.waiting = 0;
+    ++slot.turns;
+    return Turn(this, std::move(local_lock));
+}
+
+void GpuArbiter::release_turn() {
+    SegmentLock lock(*m_segment, m_segment_name);
+    if (m_segment->holder == m_slot) {
+        lock.pass_turn();
+    }
+}
+
+void GpuArbiter::add_reservation(size_t bytes) {
+    SegmentLock lock(*m_segment, m_segment_name);
+    m_segment->slots[m_slot].reserved_bytes += bytes;
+}
+
+size_t GpuArbiter::reserved_by_others() const {
+    SegmentLock lock(*m_segment, m_segment_name);
+    size_t reserved = 0;
+    for (int slot = 0; slot < kMaxProcesses; ++slot) {
+        if (slot != m_slot) {
+            reserved += m_segment->slots[slot].reserved_bytes;
+        }
+    }
+    return reserved;
+}
+
+int GpuArbiter::num_processes() const {
+    SegmentLock lock(*m_segment, m_segment_name);
+    int num_processes = 0;
+    for (const auto& slot : m_segment->slots) {
+        num_processes += slot.pid != 0;
+    }
+    return num_processes;
+}
+
+uint64_t GpuArbiter::turns_taken() const {
+    SegmentLock lock(*m_segment, m_segment_name);
+    return m_segment->slots[m_slot].turns;
+}
+
+void GpuArbiter::remove(const std::string& segment_name) {
+    shm_unlink(segment_name.c_str());
+    for (int slot = 0; slot < kMaxProcesses; ++slot) {
+        std::error_code error;
+        std::filesystem::remove(slot_lock_path(segment_name, slot), error);
+    }
+}
+
+#else  // __linux__
+
+struct GpuArbiter::Segment {};
+
+GpuArbiter::GpuArbiter(const std::string&) {
+    throw std::runtime_error("Sharing GPUs between processes is only supported on Linux");
+}
+GpuArbiter::~GpuArbiter() = default;
+GpuArbiter::Turn GpuArbiter::acquire_turn() { return {}; }
+void GpuArbiter::release_turn() {}
+void GpuArbiter::add_reservation(size_t) {}
+size_t GpuArbiter::reserved_by_others() const { return 0; }
+int GpuArbiter::num_processes() const { return 0; }
+uint64_t GpuArbiter::turns_taken() const { return 0; }
+void GpuArbiter::remove(const std::string&) {}
+
+#endif  // __linux__
+
+GpuArbiter::Turn::Turn(Turn&& other) noexcept
+        : m_arbiter(std::exchange(other.m_arbiter, nullptr)),
+          m_local_lock(std::move(other.m_local_lock)) {}
+
+GpuArbiter::Turn& GpuArbiter::Turn::operator=(Turn&& other) noexcept {
+    if (this != &other) {
+        release();
+        m_arbiter = std::exchange(other.m_arbiter, nullptr);
+        m_local_lock = std::move(other.m_local_lock);
+    }
+    return *this;
+}
+
+void GpuArbiter::Turn::release() {
+    if (auto* arbiter = std::exchange(m_arbiter, nullptr)) {
+        arbiter->release_turn();
+        m_local_lock.unlock();
+    }
+}
+
+}  // namespace dorado::utils
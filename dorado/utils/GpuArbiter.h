@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace dorado::utils {
+
+class FileLock;
+
+// Shares a GPU between the dorado processes on a host, through a shared memory segment for
+// the device.  Processes take turns on the device, one batch at a time, handed round those
+// waiting in order so that none is starved and no two processes' batches are timesliced
+// against each other.  Each process also records the device memory it has set aside, so that
+// one starting up doesn't size its batches into memory another has only freed for now.  The
+// slots of processes which have exited, even by crashing, are cleared by the others.  Each
+// process holds a FileLock on a file in /dev/shm for its slot, which the kernel releases when
+// it exits, so that's seen across PID namespaces and whatever PIDs are reused.
+// Only supported on Linux: elsewhere the constructor throws.
+class GpuArbiter {
+public:
+    // Attaches to the segment called segment_name, e.g. "/dorado-gpu-0000_3b_00.0", creating it
+    // if no other process has.  Throws if it can't be opened, or every slot is taken.
+    explicit GpuArbiter(const std::string& segment_name);
+    ~GpuArbiter();
+
+    GpuArbiter(const GpuArbiter&) = delete;
+    GpuArbiter& operator=(const GpuArbiter&) = delete;
+
+    // This process's turn on the device, which is passed on when it's released or destroyed.
+    class Turn {
+    public:
+        Turn() = default;
+        Turn(Turn&& other) noexcept;
+        Turn& operator=(Turn&& other) noexcept;
+        ~Turn() { release(); }
+
+        bool holds_turn() const { return m_arbiter != nullptr; }
+        void release();
+
+    private:
+        friend class GpuArbiter;
+        Turn(GpuArbiter* arbiter, std::unique_lock<std::mutex> local_lock)
+                : m_arbiter(arbiter), m_local_lock(std::move(local_lock)) {}
+
+        GpuArbiter* m_arbiter{nullptr};
+        std::unique_lock<std::mutex> m_local_lock;
+    };
+    // Blocks until it's this process's turn.  The threads of a process take turns among
+    // themselves first, so only one of them waits on the other processes at once.
+    Turn acquire_turn();
+
+    // Adds bytes to the device memory this process has set aside.
+    void add_reservation(size_t bytes);
+    // The device memory set aside by the other processes attached.
+    size_t reserved_by_others() const;
+    // The processes attached, including this one.
+    int num_processes() const;
+    // How many turns this process has had.
+    uint64_t turns_taken() const;
+
+    // Removes the segment and its slots' lock files, e.g. after a test.  Processes already
+    // attached keep using them.
+    static void remove(const std::string& segment_name);
+
+private:
+    struct Segment;
+
+    // Locks the segment, clearing the slots of processes which have exited.
+    class SegmentLock;
+    void release_turn();
+
+    Segment* m_segment{nullptr};
+    const std::string m_segment_name;
+    int m_slot{-1};
+    // Held for as long as this process is attached, to show that its slot is in use.
+    std::unique_ptr<FileLock> m_slot_lock;
+    // Held by the thread of this process with, or waiting for, its turn.
+    std::mutex m_local_mutex;
+};
+
+}  // namespace dorado::utils
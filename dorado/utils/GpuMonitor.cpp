@@ -0,0 +1,198 @@
+#include "GpuMonitor.h"
+
+#include "MetricsServer.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+using dorado::utils::GpuMonitor;
+
+struct CounterInfo {
+    const char* metric_name;
+    const char* help;
+    const char* log_name;
+    // Logged values are divided by scale.
+    double scale;
+    const char* unit;
+    int precision;
+};
+
+const std::array<CounterInfo, GpuMonitor::NUM_COUNTERS> kCounters{{
+        {"dorado_gpu_utilisation_percent", "Time the GPU was running kernels, as a percentage.",
+         "utilisation", 1, "%", 0},
+        {"dorado_gpu_memory_used_bytes", "Memory in use on the GPU.", "memory used", 1e9, "GB",
+         1},
+        {"dorado_gpu_pcie_rx_bytes_per_second", "PCIe throughput from the host to the GPU.",
+         "PCIe to device", 1e9, "GB/s", 2},
+        {"dorado_gpu_pcie_tx_bytes_per_second", "PCIe throughput from the GPU to the host.",
+         "PCIe from device", 1e9, "GB/s", 2},
+        {"dorado_gpu_power_watts", "Power drawn by the GPU.", "power", 1, "W", 0},
+        {"dorado_gpu_energy_joules_total", "Energy used by the GPU since sampling started.",
+         "energy", 1e3, "kJ", 1},
+}};
+
+// Energy is a running total, so only what was used while sampling is of interest.
+double energy_used(const GpuMonitor::Summary& summary) {
+    return summary.count > 0 ? summary.max - summary.min : GpuMonitor::kNotReported;
+}
+
+}  // namespace
+
+namespace dorado::utils {
+
+GpuMonitor::GpuMonitor(std::chrono::milliseconds sample_interval)
+        : m_sample_interval(sample_interval) {}
+
+GpuMonitor::~GpuMonitor() { stop(); }
+
+void GpuMonitor::add_device(std::string name, Reader reader) {
+    if (m_thread) {
+        throw std::runtime_error("GPUs must be added before the monitor is started.");
+    }
+    Device device{std::move(name), std::move(reader), {}, {}};
+    const auto first = device.reader();
+    for (size_t i = 0; i < NUM_COUNTERS; ++i) {
+        device.reported[i] = !std::isnan(first[i]);
+    }
+    m_devices.push_back(std::move(device));
+}
+
+void GpuMonitor::start() {
+    if (!m_thread && !m_devices.empty()) {
+        m_thread = std::make_unique<std::thread>(&GpuMonitor::sampling_thread, this);
+    }
+}
+
+void GpuMonitor::stop() {
+    {
+        std::lock_guard lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    if (m_thread) {
+        m_thread->join();
+        m_thread.reset();
+    }
+}
+
+void GpuMonitor::sample() {
+    // Reading a device can take a while, so it's done without holding the lock.
+    std::vector<Sample> samples;
+    samples.reserve(m_devices.size());
+    for (const auto& device : m_devices) {
+        samples.push_back(device.reader());
+    }
+
+    std::lock_guard lock(m_mutex);
+    for (size_t d = 0; d < m_devices.size(); ++d) {
+        for (size_t i = 0; i < NUM_COUNTERS; ++i) {
+            const double value = samples[d][i];
+            if (std::isnan(value)) {
+                continue;
+            }
+            auto& summary = m_devices[d].summaries[i];
+            summary.min = std::min(summary.min, value);
+            summary.max = std::max(summary.max, value);
+            summary.sum += value;
+            summary.last = value;
+            ++summary.count;
+        }
+    }
+}
+
+GpuMonitor::Summary GpuMonitor::summary(size_t device, Counter counter) const {
+    std::lock_guard lock(m_mutex);
+    return m_devices.at(device).summaries[counter];
+}
+
+double GpuMonitor::energy_joules() const {
+    std::lock_guard lock(m_mutex);
+    double total = kNotReported;
+    for (const auto& device : m_devices) {
+        const double energy = energy_used(device.summaries[ENERGY]);
+        if (!std::isnan(energy)) {
+            total = std::isnan(total) ? energy : total + energy;
+        }
+    }
+    return total;
+}
+
+void GpuMonitor::log_summary() const {
+    std::lock_guard lock(m_mutex);
+    for (const auto& device : m_devices) {
+        std::string counters;
+        for (size_t i = 0; i < ENERGY; ++i) {
+            const auto& summary = device.summaries[i];
+            if (summary.count == 0) {
+                continue;
+            }
+            const auto& info = kCounters[i];
+            counters += fmt::format("{}{} {:.{}f}/{:.{}f}/{:.{}f}{}", counters.empty() ? "" : ", ",
+                                    info.log_name, summary.min / info.scale, info.precision,
+                                    summary.mean() / info.scale, info.precision,
+                                    summary.max / info.scale, info.precision, info.unit);
+        }
+        if (!counters.empty()) {
+            spdlog::info("> GPU {} min/mean/max: {}", device.name, counters);
+        }
+        const double energy = energy_used(device.summaries[ENERGY]);
+        if (!std::isnan(energy)) {
+            const auto& info = kCounters[ENERGY];
+            spdlog::info("> GPU {} {}: {:.{}f}{}", device.name, info.log_name,
+                         energy / info.scale, info.precision, info.unit);
+        }
+    }
+}
+
+void GpuMonitor::add_metrics(MetricsRegistry& registry) const {
+    using Stat = double (*)(const Summary&);
+    const std::array<std::pair<const char*, Stat>, 4> stats{{
+            {"current", [](const Summary& s) { return s.count ? s.last : 0.0; }},
+            {"min", [](const Summary& s) { return s.count ? s.min : 0.0; }},
+            {"mean", [](const Summary& s) { return s.count ? s.mean() : 0.0; }},
+            {"max", [](const Summary& s) { return s.count ? s.max : 0.0; }},
+    }};
+    for (size_t d = 0; d < m_devices.size(); ++d) {
+        for (size_t i = 0; i < NUM_COUNTERS; ++i) {
+            if (!m_devices[d].reported[i]) {
+                continue;
+            }
+            const auto counter = static_cast<Counter>(i);
+            const std::string device_label = "device=\"" + m_devices[d].name + "\"";
+            if (counter == ENERGY) {
+                registry.add(kCounters[i].metric_name, kCounters[i].help,
+                             MetricsRegistry::Type::COUNTER,
+                             [this, d] {
+                                 const double energy = energy_used(summary(d, ENERGY));
+                                 return std::isnan(energy) ? 0.0 : energy;
+                             },
+                             device_label);
+                continue;
+            }
+            for (const auto& [stat_name, stat] : stats) {
+                registry.add(kCounters[i].metric_name, kCounters[i].help,
+                             MetricsRegistry::Type::GAUGE,
+                             [this, d, counter, stat = stat] { return stat(summary(d, counter)); },
+                             device_label + ",stat=\"" + stat_name + "\"");
+            }
+        }
+    }
+}
+
+void GpuMonitor::sampling_thread() {
+    // At least one sample is taken, however short the run.
+    std::unique_lock lock(m_mutex);
+    do {
+        lock.unlock();
+        sample();
+        lock.lock();
+    } while (!m_cv.wait_for(lock, m_sample_interval, [this] { return m_stop; }));
+}
+
+}  // namespace dorado::utils
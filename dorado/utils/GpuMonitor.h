@@ -0,0 +1,92 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dorado::utils {
+
+class MetricsRegistry;
+
+// Samples the utilisation, memory, PCIe throughput, power and energy use of each GPU in the
+// background, and keeps the minimum, mean and maximum of each over the run.  Low utilisation
+// with little PCIe traffic suggests batches too small to keep the GPU busy, while PCIe
+// throughput near the link's limit suggests host to device copies are.  Devices are read
+// through a platform specific reader, as add_gpu_monitor_devices() and
+// add_metal_monitor_device() add.
+class GpuMonitor {
+public:
+    enum Counter { UTILISATION, MEMORY_USED, PCIE_RX, PCIE_TX, POWER, ENERGY, NUM_COUNTERS };
+    // Utilisation as a percentage, memory used in bytes, PCIe throughput in bytes/s, with RX
+    // towards the device, power in watts, and energy in joules used since some point before
+    // the run, e.g. since the driver was loaded.  Counters a device doesn't report are NaN.
+    using Sample = std::array<double, NUM_COUNTERS>;
+    using Reader = std::function<Sample()>;
+
+    static constexpr double kNotReported = std::numeric_limits<double>::quiet_NaN();
+
+    struct Summary {
+        double min{std::numeric_limits<double>::infinity()};
+        double max{-std::numeric_limits<double>::infinity()};
+        double sum{0};
+        double last{kNotReported};
+        size_t count{0};
+
+        double mean() const { return count > 0 ? sum / count : kNotReported; }
+    };
+
+    explicit GpuMonitor(
+            std::chrono::milliseconds sample_interval = std::chrono::milliseconds(1000));
+    ~GpuMonitor();
+
+    // The device's counters are those reader reports when it's first called, here.  Devices
+    // must be added before starting.
+    void add_device(std::string name, Reader reader);
+    size_t num_devices() const { return m_devices.size(); }
+
+    // Starts sampling in the background, if there are any devices.
+    void start();
+    void stop();
+
+    // Reads every device once.  Exposed for testing.
+    void sample();
+
+    Summary summary(size_t device, Counter counter) const;
+    // The energy the devices used between the first and latest samples, or NaN if none of them
+    // report it.
+    double energy_joules() const;
+
+    // Logs each device's counters as min/mean/max over the samples taken.
+    void log_summary() const;
+    // Adds the latest, minimum, mean and maximum of each device's reported counters to registry.
+    void add_metrics(MetricsRegistry& registry) const;
+
+private:
+    struct Device {
+        std::string name;
+        Reader reader;
+        std::array<bool, NUM_COUNTERS> reported;
+        std::array<Summary, NUM_COUNTERS> summaries;
+    };
+
+    void sampling_thread();
+
+    std::vector<Device> m_devices;
+    std::chrono::milliseconds m_sample_interval;
+
+    // Guards the summaries, which metrics are read from as they're sampled, and m_stop.
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_stop{false};
+    std::unique_ptr<std::thread> m_thread;
+};
+
+}  // namespace dorado::utils
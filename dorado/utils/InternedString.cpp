@@ -0,0 +1,38 @@
+#include "InternedString.h"
+
+#include <mutex>
+#include <unordered_set>
+
+namespace {
+
+// The nodes of an unordered_set stay put as it grows, so the strings can be pointed to.
+std::mutex table_mutex;
+std::unordered_set<std::string> table;
+
+const std::string* intern(std::string_view value) {
+    thread_local const std::string* last_interned = nullptr;
+    if (last_interned && *last_interned == value) {
+        return last_interned;
+    }
+    std::lock_guard lock(table_mutex);
+    auto it = table.find(std::string(value));
+    if (it == table.end()) {
+        it = table.emplace(value).first;
+    }
+    last_interned = &*it;
+    return last_interned;
+}
+
+}  // namespace
+
+namespace dorado::utils {
+
+InternedString::InternedString(std::string_view value)
+        : m_value(value.empty() ? nullptr : intern(value)) {}
+
+const std::string& InternedString::empty_string() {
+    static const std::string empty;
+    return empty;
+}
+
+}  // namespace dorado::utils
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+
+namespace dorado::utils {
+
+// An immutable string, such as a run ID or file name, which millions of reads share.  Equal
+// strings are interned as one copy, which lives as long as the process, so copying one, as
+// every read split or shallow copied does, copies a pointer, and comparing two compares
+// pointers.  Interning takes a lock, but each thread first checks the last string it interned,
+// as reads from one file find the same one again.  Only strings with few distinct values
+// should be interned: the table never shrinks.
+class InternedString {
+public:
+    InternedString() = default;
+    InternedString(std::string_view value);
+    InternedString(const std::string& value) : InternedString(std::string_view(value)) {}
+    InternedString(const char* value) : InternedString(std::string_view(value)) {}
+
+    const std::string& str() const { return m_value ? *m_value : empty_string(); }
+    operator const std::string&() const { return str(); }
+    const char* c_str() const { return str().c_str(); }
+    size_t size() const { return m_value ? m_value->size() : 0; }
+    size_t length() const { return size(); }
+    bool empty() const { return m_value == nullptr; }
+
+    // The same for equal strings, so that caches can be keyed by it.
+    const void* id() const { return m_value; }
+
+    friend bool operator==(const InternedString& a, const InternedString& b) {
+        return a.m_value == b.m_value;
+    }
+    friend bool operator!=(const InternedString& a, const InternedString& b) {
+        return a.m_value != b.m_value;
+    }
+    // Orders strings by their value, so that maps keyed by them iterate in the same order
+    // from run to run.
+    friend bool operator<(const InternedString& a, const InternedString& b) {
+        return a.m_value != b.m_value && a.str() < b.str();
+    }
+
+private:
+    static const std::string& empty_string();
+
+    // Null for the empty string.
+    const std::string* m_value{nullptr};
+};
+
+}  // namespace dorado::utils
+
+template <>
+struct std::hash<dorado::utils::InternedString> {
+    size_t operator()(const dorado::utils::InternedString& value) const {
+        return std::hash<const void*>()(value.id());
+    }
+};
@@ -0,0 +1,367 @@
+#pragma once
+
+#include "LockFreeQueue.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Queue made of NumLanes LockFreeQueues, the lanes, which are popped in order: nothing is
+// taken from a lane while any lane before it has items, so items pushed to lane 0 overtake
+// everything waiting in the others.  Items keep their order within a lane.  LaneOf maps an
+// item to its lane, below NumLanes.  The lanes share the capacity the queue is made with, so
+// pushes to any lane block while the queue as a whole is full.
+// The interface and termination semantics otherwise match LockFreeQueue.
+// Items must be movable.
+template <class Item, size_t NumLanes, class LaneOf>
+class LanedQueue {
+    static_assert(NumLanes > 0);
+    // Number of failed attempts before a popping thread parks, as in LockFreeQueue.
+    static constexpr int kSpinCount = 64;
+    static constexpr int kYieldCount = 16;
+
+    // Each lane can hold the whole capacity, so pushes only ever wait for a slot.
+    std::array<std::unique_ptr<LockFreeQueue<Item>>, NumLanes> m_lanes;
+    LaneOf m_lane_of;
+    const size_t m_capacity;
+    // Slots taken by items pushed, or being pushed, and not yet popped.
+    std::atomic<size_t> m_num_slots_taken{0};
+
+    // Set by terminate(), after which pushes fail.
+    std::atomic<bool> m_terminate{false};
+    // Set once m_terminate is and every push which had taken its slots has reached its lane,
+    // so that a pop which then finds every lane empty knows nothing more is coming.
+    std::atomic<bool> m_terminated{false};
+    // Pushes between checking m_terminate and returning.
+    std::atomic<int> m_pushes_in_flight{0};
+    // Taken for the whole of a grouped try_pop_batch.
+    std::mutex m_grouped_pop_mutex;
+
+    // Threads park here, rather than in a lane, so poppers wake for an item in any lane and
+    // pushers for a slot freed by any.
+    std::mutex m_park_mutex;
+    std::condition_variable m_not_empty_cv;
+    std::condition_variable m_not_full_cv;
+    std::atomic<int> m_parked_poppers{0};
+    std::atomic<int> m_parked_pushers{0};
+    // Pushers parked waiting for more than one slot.  While there are any, a freed slot wakes
+    // every pusher, since a single wakeup could go to a batch there's still no room for.
+    std::atomic<int> m_parked_batch_pushers{0};
+    std::atomic<uint64_t> m_pop_waiting_ns{0};
+    std::atomic<uint64_t> m_push_blocked_ns{0};
+
+    bool pop_once(Item& item) {
+        for (auto& lane : m_lanes) {
+            if (lane->try_pop_now(item)) {
+                release_slot();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Takes num_slots slots at once, no more than the capacity, blocking until that many are
+    // free or terminate() is called.  Returns false if it was.
+    bool take_slots(size_t num_slots) {
+        std::chrono::steady_clock::time_point wait_start;
+        auto finish = [this, &wait_start](bool taken) {
+            if (wait_start != decltype(wait_start)()) {
+                const auto waited = std::chrono::steady_clock::now() - wait_start;
+                m_push_blocked_ns.fetch_add(
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(waited).count(),
+                        std::memory_order_relaxed);
+            }
+            return taken;
+        };
+        for (int attempt = 0;; ++attempt) {
+            if (m_terminate.load(std::memory_order_seq_cst)) {
+                return finish(false);
+            }
+            size_t num_taken = m_num_slots_taken.load(std::memory_order_relaxed);
+            while (num_taken + num_slots <= m_capacity) {
+                if (m_num_slots_taken.compare_exchange_weak(num_taken, num_taken + num_slots,
+                                                            std::memory_order_seq_cst)) {
+                    return finish(true);
+                }
+            }
+            if (attempt == 0) {
+                wait_start = std::chrono::steady_clock::now();
+            }
+            if (attempt < kSpinCount) {
+                if (attempt >= kYieldCount) {
+                    std::this_thread::yield();
+                }
+            } else {
+                std::unique_lock lock(m_park_mutex);
+                m_parked_pushers.fetch_add(1, std::memory_order_seq_cst);
+                if (num_slots > 1) {
+                    m_parked_batch_pushers.fetch_add(1, std::memory_order_seq_cst);
+                }
+                m_not_full_cv.wait(lock, [this, num_slots] {
+                    return m_num_slots_taken.load() + num_slots <= m_capacity ||
+                           m_terminate.load();
+                });
+                if (num_slots > 1) {
+                    m_parked_batch_pushers.fetch_sub(1, std::memory_order_seq_cst);
+                }
+                m_parked_pushers.fetch_sub(1, std::memory_order_seq_cst);
+                attempt = 0;
+            }
+        }
+    }
+
+    void release_slot() {
+        m_num_slots_taken.fetch_sub(1, std::memory_order_seq_cst);
+        if (m_parked_pushers.load(std::memory_order_seq_cst) > 0) {
+            { std::lock_guard lock(m_park_mutex); }
+            if (m_parked_batch_pushers.load(std::memory_order_seq_cst) > 0) {
+                m_not_full_cv.notify_all();
+            } else {
+                m_not_full_cv.notify_one();
+            }
+        }
+    }
+
+    bool can_pop() const {
+        for (const auto& lane : m_lanes) {
+            if (lane->has_items()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Wakes a parked popper for each of num_items items pushed, or all of them for several.
+    void wake_poppers(size_t num_items) {
+        if (m_parked_poppers.load(std::memory_order_seq_cst) > 0) {
+            { std::lock_guard lock(m_park_mutex); }
+            if (num_items > 1) {
+                m_not_empty_cv.notify_all();
+            } else {
+                m_not_empty_cv.notify_one();
+            }
+        }
+    }
+
+    // Counts a push as in flight for its lifetime, for terminate() to wait on.
+    class PushGuard {
+    public:
+        explicit PushGuard(std::atomic<int>& in_flight) : m_in_flight(in_flight) {
+            m_in_flight.fetch_add(1, std::memory_order_seq_cst);
+        }
+        ~PushGuard() { m_in_flight.fetch_sub(1, std::memory_order_seq_cst); }
+
+    private:
+        std::atomic<int>& m_in_flight;
+    };
+
+public:
+    LanedQueue(size_t capacity, LaneOf lane_of = LaneOf())
+            : m_lane_of(std::move(lane_of)), m_capacity(std::max<size_t>(capacity, 1)) {
+        for (auto& lane : m_lanes) {
+            lane = std::make_unique<LockFreeQueue<Item>>(m_capacity);
+        }
+    }
+
+    ~LanedQueue() { terminate(); }
+
+    LanedQueue(const LanedQueue&) = delete;
+    LanedQueue& operator=(const LanedQueue&) = delete;
+
+    // Adds an item to its lane, blocking while the queue is full, until there is space or
+    // terminate() is called.  Returns false if terminate() was called, without adding it.
+    bool try_push(Item&& item) {
+        PushGuard guard(m_pushes_in_flight);
+        if (!take_slots(1)) {
+            return false;
+        }
+        if (!m_lanes[m_lane_of(item)]->try_push(std::move(item))) {
+            release_slot();
+            return false;
+        }
+        wake_poppers(1);
+        return true;
+    }
+
+    // Obtains the next item from the first lane with any, returning true on success.
+    // If every lane is empty, and we are terminating, returns false.
+    // Otherwise we block while every lane is empty.
+    bool try_pop(Item& item) {
+        std::chrono::steady_clock::time_point wait_start;
+        auto finish = [this, &wait_start](bool popped) {
+            if (wait_start != decltype(wait_start)()) {
+                const auto waited = std::chrono::steady_clock::now() - wait_start;
+                m_pop_waiting_ns.fetch_add(
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(waited).count(),
+                        std::memory_order_relaxed);
+            }
+            return popped;
+        };
+        for (int attempt = 0;; ++attempt) {
+            if (pop_once(item)) {
+                return finish(true);
+            }
+            // Termination takes effect once every lane has been drained, and the pushes in
+            // flight when it began have landed.
+            if (m_terminated.load(std::memory_order_acquire) && !can_pop()) {
+                return finish(false);
+            }
+            if (attempt == 0) {
+                wait_start = std::chrono::steady_clock::now();
+            }
+            if (attempt < kSpinCount) {
+                if (attempt >= kYieldCount) {
+                    std::this_thread::yield();
+                }
+            } else {
+                std::unique_lock lock(m_park_mutex);
+                m_parked_poppers.fetch_add(1, std::memory_order_seq_cst);
+                m_not_empty_cv.wait(lock, [this] { return can_pop() || m_terminated.load(); });
+                m_parked_poppers.fetch_sub(1, std::memory_order_seq_cst);
+                attempt = 0;
+            }
+        }
+    }
+
+    // Adds all items, in order, each to its lane.  The slots for a batch no larger than the
+    // capacity are taken at once, blocking until there are enough, and each lane's run of it
+    // is then added whole with that lane's try_push_batch, so that batches pushed from
+    // different threads are never interleaved within a lane.  A larger batch is added a
+    // capacity's worth at a time.
+    // Returns true if all items were added.  If terminate() was called, any items not yet
+    // added are dropped and false is returned.
+    // items is left empty.
+    bool try_push_batch(std::vector<Item>&& items) {
+        PushGuard guard(m_pushes_in_flight);
+        std::array<std::vector<Item>, NumLanes> runs;
+        bool success = true;
+        for (size_t start = 0; start < items.size(); start += m_capacity) {
+            const size_t end = std::min(items.size(), start + m_capacity);
+            if (!take_slots(end - start)) {
+                success = false;
+                break;
+            }
+            for (size_t i = start; i < end; ++i) {
+                runs[m_lane_of(items[i])].push_back(std::move(items[i]));
+            }
+            // The lanes have room for every slot taken, and aren't terminated while this push
+            // is in flight, so these neither wait nor fail.
+            for (size_t lane = 0; lane < NumLanes; ++lane) {
+                if (!runs[lane].empty()) {
+                    m_lanes[lane]->try_push_batch(std::move(runs[lane]));
+                }
+            }
+            wake_poppers(end - start);
+        }
+        items.clear();
+        return success;
+    }
+
+    // Obtains up to max_items items, in lane order, appending them to items.
+    // Blocks until at least one item is available.
+    // If every lane is empty, and we are terminating, returns false.
+    bool try_pop_batch(std::vector<Item>& items, size_t max_items) {
+        if (max_items == 0) {
+            return true;
+        }
+        Item item;
+        if (!try_pop(item)) {
+            return false;
+        }
+        items.push_back(std::move(item));
+        for (size_t num_popped = 1; num_popped < max_items && pop_once(item); ++num_popped) {
+            items.push_back(std::move(item));
+        }
+        return true;
+    }
+
+    // As above, but carries on past max_items while same_group(last, next) says the next item
+    // in the last item's lane belongs with the last one taken, so that a group is never split
+    // between batches.  try_push_batch adds a batch no larger than the capacity to each lane
+    // in one run, so a group pushed that way is in the queue in full or not at all.
+    // The next item is looked at before it's taken, so grouped pops take turns, and the queue
+    // mustn't be popped any other way meanwhile.
+    template <class SameGroup>
+    bool try_pop_batch(std::vector<Item>& items, size_t max_items, SameGroup same_group) {
+        std::lock_guard lock(m_grouped_pop_mutex);
+        const size_t num_before = items.size();
+        if (!try_pop_batch(items, max_items)) {
+            return false;
+        }
+        if (items.size() == num_before) {
+            return true;
+        }
+        auto& lane = *m_lanes[m_lane_of(items.back())];
+        auto in_last_group = [&](const Item& next) { return same_group(items.back(), next); };
+        Item item;
+        while (lane.try_pop_now_if(item, in_last_group)) {
+            release_slot();
+            items.push_back(std::move(item));
+        }
+        return true;
+    }
+
+    // Approximate number of items in all the lanes.
+    size_t size() const {
+        size_t size = 0;
+        for (const auto& lane : m_lanes) {
+            size += lane->size();
+        }
+        return size;
+    }
+
+    // Capacity shared by the lanes.
+    size_t capacity() const { return m_capacity; }
+
+    // Items in a lane, e.g. to see how many are waiting ahead of the rest.
+    size_t lane_size(size_t lane) const { return m_lanes[lane]->size(); }
+
+    // The lanes' stats summed, but for the waits, which are timed across the lanes, and the
+    // capacity, which is shared.
+    typename LockFreeQueue<Item>::Stats stats() const {
+        typename LockFreeQueue<Item>::Stats stats{};
+        for (const auto& lane : m_lanes) {
+            const auto lane_stats = lane->stats();
+            stats.num_pushed += lane_stats.num_pushed;
+            stats.num_popped += lane_stats.num_popped;
+            stats.size += lane_stats.size;
+        }
+        stats.capacity = capacity();
+        stats.push_blocked_ns = m_push_blocked_ns.load(std::memory_order_relaxed);
+        stats.pop_waiting_ns = m_pop_waiting_ns.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    // Tells the queue, and its lanes, to terminate any waits.  Returns once the pushes which
+    // started before it have either landed or failed, so no item they add is lost to a pop
+    // which gives up on the queue meanwhile.
+    void terminate() {
+        {
+            std::lock_guard lock(m_park_mutex);
+            m_terminate.store(true, std::memory_order_seq_cst);
+        }
+        m_not_full_cv.notify_all();
+
+        // A push which has taken its slot is sure of room in its lane, which isn't terminated
+        // until it lands, so this is never a long wait.
+        while (m_pushes_in_flight.load(std::memory_order_seq_cst) > 0) {
+            std::this_thread::yield();
+        }
+        {
+            std::lock_guard lock(m_park_mutex);
+            m_terminated.store(true, std::memory_order_seq_cst);
+        }
+        for (auto& lane : m_lanes) {
+            lane->terminate();
+        }
+        m_not_empty_cv.notify_all();
+    }
+};
@@ -0,0 +1,77 @@
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// The index of the highest set bit of a nonzero value.
+int highest_bit(uint64_t value) {
+    int bit = 0;
+    while (value >>= 1) {
+        ++bit;
+    }
+    return bit;
+}
+
+}  // namespace
+
+namespace dorado::utils {
+
+size_t LatencyHistogram::bucket_index(uint64_t value) {
+    value = std::min<uint64_t>(value, std::numeric_limits<uint32_t>::max());
+    if (value < 2 * kSubBucketCount) {
+        return value;
+    }
+    // The value's top kSubBucketBits + 1 bits, which start at kSubBucketCount, pick its bucket
+    // within its power of two.
+    const int shift = highest_bit(value) - kSubBucketBits;
+    return shift * kSubBucketCount + (value >> shift);
+}
+
+uint64_t LatencyHistogram::bucket_highest_value(size_t index) {
+    if (index < 2 * kSubBucketCount) {
+        return index;
+    }
+    const size_t shift = index / kSubBucketCount - 1;
+    const uint64_t lowest = uint64_t(index - shift * kSubBucketCount) << shift;
+    return lowest + (uint64_t(1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t value_us) {
+    m_buckets[bucket_index(value_us)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(value_us, std::memory_order_relaxed);
+    uint64_t max = m_max.load(std::memory_order_relaxed);
+    while (value_us > max &&
+           !m_max.compare_exchange_weak(max, value_us, std::memory_order_relaxed)) {
+    }
+}
+
+double LatencyHistogram::mean() const {
+    const uint64_t num_values = count();
+    return num_values > 0 ? double(m_sum.load(std::memory_order_relaxed)) / num_values : 0.0;
+}
+
+uint64_t LatencyHistogram::value_at_percentile(double percentile) const {
+    const uint64_t num_values = count();
+    if (num_values == 0) {
+        return 0;
+    }
+    // The rank of the value wanted, counting from 1.
+    const auto rank = std::max<uint64_t>(
+            1, uint64_t(std::ceil(std::clamp(percentile, 0.0, 100.0) / 100 * num_values)));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kNumBuckets; ++i) {
+        seen += m_buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            // No value recorded is above the maximum, even if its bucket goes higher, and the
+            // last bucket holds anything too large for the others.
+            return i + 1 == kNumBuckets ? max() : std::min(bucket_highest_value(i), max());
+        }
+    }
+    return max();
+}
+
+}  // namespace dorado::utils
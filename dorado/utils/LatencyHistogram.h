@@ -0,0 +1,43 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace dorado::utils {
+
+// A histogram of latencies in microseconds, in the manner of HdrHistogram: each power of two
+// range of values is split into 32 equal buckets, so any value is counted within about 3% of
+// itself, from a microsecond up to the hour or so a uint32_t holds.  Recording is a couple of
+// relaxed atomic adds, so any number of threads can record at once, and the counts take a
+// fixed 7KB however many values are recorded.
+class LatencyHistogram {
+public:
+    void record(uint64_t value_us);
+
+    uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+    // 0 if nothing has been recorded, as is the value at any percentile.
+    double mean() const;
+    uint64_t max() const { return m_max.load(std::memory_order_relaxed); }
+    // The highest value counted in the bucket of the value at percentile, in [0, 100], i.e.
+    // the value below which at least percentile% of the recorded values fall.
+    uint64_t value_at_percentile(double percentile) const;
+
+private:
+    static constexpr int kSubBucketBits = 5;
+    static constexpr size_t kSubBucketCount = size_t(1) << kSubBucketBits;
+    // Values of up to 32 bits, in the linear range below 2 * kSubBucketCount and then 32 bucket
+    // ranges of each power of two above it.
+    static constexpr size_t kNumBuckets = kSubBucketCount * (32 - kSubBucketBits + 1);
+
+    static size_t bucket_index(uint64_t value);
+    static uint64_t bucket_highest_value(size_t index);
+
+    std::array<std::atomic<uint64_t>, kNumBuckets> m_buckets{};
+    std::atomic<uint64_t> m_count{0};
+    std::atomic<uint64_t> m_sum{0};
+    std::atomic<uint64_t> m_max{0};
+};
+
+}  // namespace dorado::utils
@@ -0,0 +1,507 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Bounded multi-producer/multi-consumer queue based on a ring of sequenced cells
+// (D. Vyukov's bounded MPMC design).  Pushes and pops that can proceed do so without
+// taking any lock.  Threads that cannot proceed spin for a short while and then park
+// on a condition variable, so idle pipeline nodes do not burn cores.
+// The interface and termination semantics match AsyncQueue, so it can be used as a
+// drop-in replacement.
+// Items must be movable.
+template <class Item>
+class LockFreeQueue {
+    // Padding used to keep the producer and consumer positions on separate cache lines.
+    static constexpr size_t kCacheLineSize = 64;
+    // Number of failed attempts before a thread parks on the relevant condition variable.
+    static constexpr int kSpinCount = 64;
+    // Number of failed attempts, within kSpinCount, after which we yield between attempts.
+    static constexpr int kYieldCount = 16;
+
+    struct Cell {
+        // Encodes the state of the cell relative to the queue positions:
+        // sequence == pos means the cell is free for the producer at pos.
+        // sequence == pos + 1 means the cell holds the item for the consumer at pos.
+        std::atomic<size_t> sequence;
+        alignas(Item) unsigned char storage[sizeof(Item)];
+
+        Item* item() { return std::launder(reinterpret_cast<Item*>(storage)); }
+    };
+
+    const size_t m_capacity;
+    std::unique_ptr<Cell[]> m_cells;
+
+    alignas(kCacheLineSize) std::atomic<size_t> m_push_pos{0};
+    alignas(kCacheLineSize) std::atomic<size_t> m_pop_pos{0};
+
+    // If true, waits should terminate regardless of other state.
+    // Pending attempts to push items will fail.  Pops succeed until the queue is drained.
+    alignas(kCacheLineSize) std::atomic<bool> m_terminate{false};
+    // Set once m_terminate is and every push which started before it has landed, so that
+    // a pop which finds the queue empty after it knows nothing more is coming.
+    std::atomic<bool> m_terminated{false};
+    // Pushes between checking m_terminate and returning.
+    std::atomic<int> m_pushes_in_flight{0};
+
+    // Parking state.  The mutex is only ever taken by threads that have given up spinning,
+    // or by the other side when it knows there is at least one parked thread.
+    std::mutex m_park_mutex;
+    // Signalled when an item has been consumed, and the queue therefore has space.
+    std::condition_variable m_not_full_cv;
+    // Signalled when an item has been added, and the queue therefore is not empty.
+    std::condition_variable m_not_empty_cv;
+    // Number of threads parked, or about to park, on each CV.
+    std::atomic<int> m_parked_pushers{0};
+    std::atomic<int> m_parked_poppers{0};
+    // Pushers parked waiting for room for a whole batch.  While there are any, a pop wakes
+    // every pusher, since a single wakeup could go to a batch there's still no room for.
+    std::atomic<int> m_parked_batch_pushers{0};
+
+    // Total time threads have spent waiting in try_push for space, and in try_pop for items.
+    // Only waits which outlast a first failed attempt are timed, so the fast path never
+    // reads the clock.
+    std::atomic<uint64_t> m_push_blocked_ns{0};
+    std::atomic<uint64_t> m_pop_waiting_ns{0};
+
+    // Adds the time from its first start() to its destruction onto a wait counter.
+    class WaitTimer {
+    public:
+        explicit WaitTimer(std::atomic<uint64_t>& total_ns) : m_total_ns(total_ns) {}
+        ~WaitTimer() {
+            if (m_started) {
+                const auto elapsed = std::chrono::steady_clock::now() - m_start;
+                m_total_ns.fetch_add(
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+                        std::memory_order_relaxed);
+            }
+        }
+        void start() {
+            if (!m_started) {
+                m_start = std::chrono::steady_clock::now();
+                m_started = true;
+            }
+        }
+
+    private:
+        std::atomic<uint64_t>& m_total_ns;
+        std::chrono::steady_clock::time_point m_start;
+        bool m_started{false};
+    };
+
+    // Single attempt to add an item.  Returns false if the queue is full.
+    bool push_once(Item& item) {
+        size_t pos = m_push_pos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = m_cells[pos % m_capacity];
+            const size_t seq = cell.sequence.load(std::memory_order_acquire);
+            if (seq == pos) {
+                if (m_push_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    new (cell.storage) Item(std::move(item));
+                    cell.sequence.store(pos + 1, std::memory_order_seq_cst);
+                    return true;
+                }
+            } else if (seq < pos) {
+                // The cell still holds an item from the previous lap: we're full.
+                return false;
+            } else {
+                pos = m_push_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Single attempt to add up to num_items items, in order, reserving the run of free cells
+    // at the push position with one update of it.  Returns how many were added, 0 if there
+    // aren't min_items free cells, no more than the capacity.
+    size_t push_run_once(Item* items, size_t num_items, size_t min_items) {
+        size_t pos = m_push_pos.load(std::memory_order_relaxed);
+        while (true) {
+            // Cells are only ever claimed at the push position, so while it stays at pos
+            // the free cells found from it can't be taken by anyone else.
+            size_t num_free = 0;
+            bool stale = false;
+            while (num_free < num_items && num_free < m_capacity) {
+                const size_t cell_pos = pos + num_free;
+                const size_t seq =
+                        m_cells[cell_pos % m_capacity].sequence.load(std::memory_order_acquire);
+                if (seq == cell_pos) {
+                    ++num_free;
+                } else {
+                    // An older item still held means the queue is full from here; a newer
+                    // sequence means another pusher has moved on past pos.
+                    stale = seq > cell_pos;
+                    break;
+                }
+            }
+            if (num_free < min_items) {
+                if (stale) {
+                    pos = m_push_pos.load(std::memory_order_relaxed);
+                    continue;
+                }
+                return 0;
+            }
+            if (m_push_pos.compare_exchange_weak(pos, pos + num_free,
+                                                 std::memory_order_relaxed)) {
+                for (size_t i = 0; i < num_free; ++i) {
+                    Cell& cell = m_cells[(pos + i) % m_capacity];
+                    new (cell.storage) Item(std::move(items[i]));
+                    cell.sequence.store(pos + i + 1, std::memory_order_seq_cst);
+                }
+                return num_free;
+            }
+        }
+    }
+
+    // Wakes every parked thread, for when several items or spaces appear at once.
+    void wake_all(std::atomic<int>& parked, std::condition_variable& cv) {
+        if (parked.load(std::memory_order_seq_cst) > 0) {
+            { std::lock_guard lock(m_park_mutex); }
+            cv.notify_all();
+        }
+    }
+
+    // Single attempt to remove an item.  Returns false if the queue is empty.
+    bool pop_once(Item& item) {
+        size_t pos = m_pop_pos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = m_cells[pos % m_capacity];
+            const size_t seq = cell.sequence.load(std::memory_order_acquire);
+            if (seq == pos + 1) {
+                if (m_pop_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    Item* stored = cell.item();
+                    item = std::move(*stored);
+                    stored->~Item();
+                    cell.sequence.store(pos + m_capacity, std::memory_order_seq_cst);
+                    return true;
+                }
+            } else if (seq < pos + 1) {
+                // The producer for this slot hasn't published yet: we're empty.
+                return false;
+            } else {
+                pos = m_pop_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // True if the next push would find num_items free cells, no more than the capacity.
+    bool can_push(size_t num_items = 1) const {
+        const size_t pos = m_push_pos.load(std::memory_order_seq_cst);
+        for (size_t cell_pos = pos; cell_pos < pos + num_items; ++cell_pos) {
+            if (m_cells[cell_pos % m_capacity].sequence.load(std::memory_order_seq_cst) !=
+                cell_pos) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // True if the next pop would find a published item.
+    bool can_pop() const {
+        const size_t pos = m_pop_pos.load(std::memory_order_seq_cst);
+        return m_cells[pos % m_capacity].sequence.load(std::memory_order_seq_cst) == pos + 1;
+    }
+
+    // Wakes a parked thread, if there is one.  Taking the mutex ensures a thread that
+    // is about to park either sees the new state in its predicate or receives the notify.
+    void wake_one(std::atomic<int>& parked, std::condition_variable& cv) {
+        if (parked.load(std::memory_order_seq_cst) > 0) {
+            { std::lock_guard lock(m_park_mutex); }
+            cv.notify_one();
+        }
+    }
+
+    // Wakes a parked pusher for a popped item, or all of them while a batch is waiting.
+    void wake_pusher() {
+        if (m_parked_batch_pushers.load(std::memory_order_seq_cst) > 0) {
+            wake_all(m_parked_pushers, m_not_full_cv);
+        } else {
+            wake_one(m_parked_pushers, m_not_full_cv);
+        }
+    }
+
+    template <class Pred>
+    void park(std::atomic<int>& parked, std::condition_variable& cv, Pred pred) {
+        std::unique_lock lock(m_park_mutex);
+        parked.fetch_add(1, std::memory_order_seq_cst);
+        cv.wait(lock, pred);
+        parked.fetch_sub(1, std::memory_order_seq_cst);
+    }
+
+    // Counts a push as in flight for its lifetime, for terminate() to wait on.
+    class PushGuard {
+    public:
+        explicit PushGuard(std::atomic<int>& in_flight) : m_in_flight(in_flight) {
+            m_in_flight.fetch_add(1, std::memory_order_seq_cst);
+        }
+        ~PushGuard() { m_in_flight.fetch_sub(1, std::memory_order_seq_cst); }
+
+    private:
+        std::atomic<int>& m_in_flight;
+    };
+
+    static void backoff(int attempt) {
+        if (attempt >= kYieldCount) {
+            std::this_thread::yield();
+        }
+    }
+
+public:
+    // Attempts to push items beyond capacity will block.
+    LockFreeQueue(size_t capacity)
+            : m_capacity(std::max<size_t>(capacity, 1)), m_cells(new Cell[m_capacity]) {
+        for (size_t i = 0; i < m_capacity; ++i) {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~LockFreeQueue() {
+        // Ensure CV waits terminate before destruction.
+        terminate();
+        // Destroy anything which was never consumed.
+        for (size_t pos = m_pop_pos.load(); pos != m_push_pos.load(); ++pos) {
+            Cell& cell = m_cells[pos % m_capacity];
+            if (cell.sequence.load() == pos + 1) {
+                cell.item()->~Item();
+            }
+        }
+    }
+
+    LockFreeQueue(const LockFreeQueue&) = delete;
+    LockFreeQueue& operator=(const LockFreeQueue&) = delete;
+
+    // Attempts to add an item to the queue.
+    // If the queue is full, this method blocks until there is space or
+    // terminate() is called.
+    // If space was available and the item was added, true is returned.
+    // If terminate() was called, the item is not added and false is returned.
+    // Items pushed must be rvalues, since we assume sole ownership.
+    bool try_push(Item&& item) {
+        PushGuard guard(m_pushes_in_flight);
+        WaitTimer timer(m_push_blocked_ns);
+        for (int attempt = 0;; ++attempt) {
+            if (m_terminate.load(std::memory_order_seq_cst)) {
+                return false;
+            }
+            if (push_once(item)) {
+                // Inform a waiting thread that there is now an item available.
+                wake_one(m_parked_poppers, m_not_empty_cv);
+                return true;
+            }
+            timer.start();
+            if (attempt < kSpinCount) {
+                backoff(attempt);
+            } else {
+                park(m_parked_pushers, m_not_full_cv,
+                     [this] { return can_push() || m_terminate.load(); });
+                attempt = 0;
+            }
+        }
+    }
+
+    // Obtains the next item in the queue, returning true on success.
+    // If the queue is empty, and we are terminating, returns false.
+    // Otherwise we block if the queue is empty.
+    bool try_pop(Item& item) {
+        WaitTimer timer(m_pop_waiting_ns);
+        for (int attempt = 0;; ++attempt) {
+            if (pop_once(item)) {
+                // Inform a waiting thread that the queue is not full.
+                wake_pusher();
+                return true;
+            }
+            // Termination takes effect once all items have been popped from the queue, and
+            // the pushes in flight when it began have landed.
+            if (m_terminated.load(std::memory_order_acquire) && !can_pop()) {
+                return false;
+            }
+            timer.start();
+            if (attempt < kSpinCount) {
+                backoff(attempt);
+            } else {
+                park(m_parked_poppers, m_not_empty_cv,
+                     [this] { return can_pop() || m_terminated.load(); });
+                attempt = 0;
+            }
+        }
+    }
+
+    // Adds the item if there's space for it, without waiting, returning true on success.
+    // Returns false, leaving item as it was, if the queue is full or terminating.
+    bool try_push_now(Item&& item) {
+        PushGuard guard(m_pushes_in_flight);
+        if (m_terminate.load(std::memory_order_seq_cst) || !push_once(item)) {
+            return false;
+        }
+        wake_one(m_parked_poppers, m_not_empty_cv);
+        return true;
+    }
+
+    // Attempts to add all items to the queue, in order, with a single reservation of cells
+    // for each run of them there's space for, rather than an item at a time.
+    // A batch no larger than the capacity is added as one run, blocking until there is
+    // space for all of it, so that batches pushed from different threads are never
+    // interleaved.  A larger batch is added as space allows, and other pushers' items may
+    // come between its runs.
+    // Blocks until there is space or terminate() is called.
+    // Returns true if all items were added.  If terminate() was called, any items not
+    // yet added are dropped and false is returned.
+    // items is left empty.
+    bool try_push_batch(std::vector<Item>&& items) {
+        PushGuard guard(m_pushes_in_flight);
+        WaitTimer timer(m_push_blocked_ns);
+        const size_t min_items = items.size() <= m_capacity ? items.size() : 1;
+        size_t num_pushed = 0;
+        bool success = true;
+        for (int attempt = 0; num_pushed < items.size(); ++attempt) {
+            if (m_terminate.load(std::memory_order_seq_cst)) {
+                success = false;
+                break;
+            }
+            const size_t num_added = push_run_once(items.data() + num_pushed,
+                                                   items.size() - num_pushed, min_items);
+            if (num_added > 0) {
+                num_pushed += num_added;
+                if (num_added > 1) {
+                    wake_all(m_parked_poppers, m_not_empty_cv);
+                } else {
+                    wake_one(m_parked_poppers, m_not_empty_cv);
+                }
+                attempt = -1;
+                continue;
+            }
+            timer.start();
+            if (attempt < kSpinCount) {
+                backoff(attempt);
+            } else {
+                if (min_items > 1) {
+                    m_parked_batch_pushers.fetch_add(1, std::memory_order_seq_cst);
+                }
+                park(m_parked_pushers, m_not_full_cv,
+                     [this, min_items] { return can_push(min_items) || m_terminate.load(); });
+                if (min_items > 1) {
+                    m_parked_batch_pushers.fetch_sub(1, std::memory_order_seq_cst);
+                }
+                attempt = -1;
+            }
+        }
+        items.clear();
+        return success;
+    }
+
+    // Obtains up to max_items items from the queue, appending them to items.
+    // Blocks until at least one item is available.
+    // If the queue is empty, and we are terminating, returns false.
+    bool try_pop_batch(std::vector<Item>& items, size_t max_items) {
+        if (max_items == 0) {
+            return true;
+        }
+        Item item;
+        if (!try_pop(item)) {
+            return false;
+        }
+        items.push_back(std::move(item));
+        // Take whatever else is immediately available, without waiting.
+        for (size_t num_popped = 1; num_popped < max_items && pop_once(item); ++num_popped) {
+            items.push_back(std::move(item));
+            wake_pusher();
+        }
+        return true;
+    }
+
+    // Obtains the next item in the queue if there is one, without waiting, returning true
+    // on success.
+    bool try_pop_now(Item& item) {
+        if (!pop_once(item)) {
+            return false;
+        }
+        wake_pusher();
+        return true;
+    }
+
+    // Obtains the next item in the queue if there is one and pred(item) holds, without
+    // waiting, returning true on success.  An item whose cell a push has claimed but not yet
+    // filled is waited for, so that a batch still being added isn't cut short.
+    // pred sees the item before it's taken, so this mustn't race other pops of the queue.
+    template <class Pred>
+    bool try_pop_now_if(Item& item, Pred pred) {
+        const size_t pos = m_pop_pos.load(std::memory_order_relaxed);
+        Cell& cell = m_cells[pos % m_capacity];
+        for (int attempt = 0; cell.sequence.load(std::memory_order_acquire) != pos + 1;
+             ++attempt) {
+            if (m_push_pos.load(std::memory_order_seq_cst) <= pos) {
+                return false;
+            }
+            backoff(attempt);
+        }
+        return pred(static_cast<const Item&>(*cell.item())) && try_pop_now(item);
+    }
+
+    // True if the next pop would find an item.  Only a snapshot, like size().
+    bool has_items() const { return can_pop(); }
+
+    // Approximate number of items in the queue.  Only a snapshot, since other threads
+    // may be pushing or popping concurrently.
+    size_t size() const {
+        const size_t pop_pos = m_pop_pos.load(std::memory_order_relaxed);
+        const size_t push_pos = m_push_pos.load(std::memory_order_relaxed);
+        return push_pos > pop_pos ? std::min(push_pos - pop_pos, m_capacity) : 0;
+    }
+
+    size_t capacity() const { return m_capacity; }
+
+    // Running totals since the queue was made, for telemetry.  Differences between two
+    // snapshots give rates over the time between them.  Wait times are summed over threads,
+    // so can grow faster than wall time when several threads wait at once.
+    struct Stats {
+        size_t num_pushed;
+        size_t num_popped;
+        size_t size;
+        size_t capacity;
+        uint64_t push_blocked_ns;
+        uint64_t pop_waiting_ns;
+    };
+    Stats stats() const {
+        Stats stats;
+        stats.num_popped = m_pop_pos.load(std::memory_order_relaxed);
+        stats.num_pushed = std::max(m_push_pos.load(std::memory_order_relaxed), stats.num_popped);
+        stats.size = std::min(stats.num_pushed - stats.num_popped, m_capacity);
+        stats.capacity = m_capacity;
+        stats.push_blocked_ns = m_push_blocked_ns.load(std::memory_order_relaxed);
+        stats.pop_waiting_ns = m_pop_waiting_ns.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+    // Tells the queue to terminate any waits.  Returns once the pushes which started
+    // before it have either landed or failed, so no item they add is lost to a pop which
+    // gives up on the queue meanwhile.
+    void terminate() {
+        {
+            std::lock_guard lock(m_park_mutex);
+            m_terminate.store(true, std::memory_order_seq_cst);
+        }
+        // notify_all, since in general an arbitrary number of threads can be
+        // parked inside try_push/try_pop.
+        m_not_full_cv.notify_all();
+
+        // A push which saw m_terminate unset is between claiming a cell and publishing it,
+        // or is about to give up, so this is never a long wait.
+        while (m_pushes_in_flight.load(std::memory_order_seq_cst) > 0) {
+            std::this_thread::yield();
+        }
+        {
+            std::lock_guard lock(m_park_mutex);
+            m_terminated.store(true, std::memory_order_seq_cst);
+        }
+        m_not_empty_cv.notify_all();
+    }
+};
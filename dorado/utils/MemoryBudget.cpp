@@ -0,0 +1,119 @@
+#include "MemoryBudget.h"
+
+#include "MetricsServer.h"
+
+#include <utility>
+
+namespace dorado::utils {
+
+MemoryReservation::MemoryReservation() : m_budget(&MemoryBudget::instance()) {}
+
+MemoryReservation::MemoryReservation(MemoryReservation&& other) noexcept
+        : m_budget(other.m_budget), m_bytes(std::exchange(other.m_bytes, 0)) {}
+
+MemoryReservation& MemoryReservation::operator=(MemoryReservation&& other) noexcept {
+    if (this != &other) {
+        resize(0);
+        m_budget = other.m_budget;
+        m_bytes = std::exchange(other.m_bytes, 0);
+    }
+    return *this;
+}
+
+void MemoryReservation::resize(size_t num_bytes) {
+    if (num_bytes > m_bytes) {
+        m_budget->grow(m_bytes, num_bytes - m_bytes);
+    } else if (num_bytes < m_bytes) {
+        m_budget->shrink(m_bytes - num_bytes);
+    }
+    m_bytes = num_bytes;
+}
+
+bool MemoryReservation::try_resize(size_t num_bytes) {
+    if (num_bytes > m_bytes) {
+        if (!m_budget->try_grow(m_bytes, num_bytes - m_bytes)) {
+            return false;
+        }
+        m_bytes = num_bytes;
+    } else {
+        resize(num_bytes);
+    }
+    return true;
+}
+
+MemoryBudget& MemoryBudget::instance() {
+    static auto* budget = new MemoryBudget();
+    return *budget;
+}
+
+void MemoryBudget::set_limit(size_t limit_bytes) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_limit = limit_bytes;
+    }
+    m_cv.notify_all();
+}
+
+size_t MemoryBudget::limit() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_limit;
+}
+
+size_t MemoryBudget::reserved_bytes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_reserved;
+}
+
+bool MemoryBudget::has_waiters() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_num_waiters > 0;
+}
+
+void MemoryBudget::add_metrics(MetricsRegistry& registry) const {
+    using Type = MetricsRegistry::Type;
+    registry.add("dorado_host_memory_reserved_bytes", "Host memory held by reads in flight.",
+                 Type::GAUGE, [this] { return reserved_bytes(); });
+    registry.add("dorado_host_memory_limit_bytes",
+                 "Most host memory reads in flight may hold, or 0 for no limit.", Type::GAUGE,
+                 [this] { return limit(); });
+    registry.add("dorado_host_memory_waiters", "Reservations waiting for host memory.",
+                 Type::GAUGE, [this] {
+                     std::lock_guard<std::mutex> lock(m_mutex);
+                     return m_num_waiters;
+                 });
+}
+
+bool MemoryBudget::fits(size_t current, size_t extra) const {
+    // The reservation's own bytes are in m_reserved, so if they're all of it nothing else is
+    // held and it can have what it asks for.
+    return m_limit == 0 || m_reserved + extra <= m_limit || m_reserved == current;
+}
+
+void MemoryBudget::grow(size_t current, size_t extra) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!fits(current, extra)) {
+        ++m_num_waiters;
+        m_cv.wait(lock, [&] { return fits(current, extra); });
+        --m_num_waiters;
+    }
+    m_reserved += extra;
+}
+
+bool MemoryBudget::try_grow(size_t current, size_t extra) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!fits(current, extra)) {
+        return false;
+    }
+    m_reserved += extra;
+    return true;
+}
+
+void MemoryBudget::shrink(size_t num_bytes) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_reserved -= num_bytes;
+    }
+    m_cv.notify_all();
+}
+
+}  // namespace dorado::utils
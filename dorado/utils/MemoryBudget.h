@@ -0,0 +1,83 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+namespace dorado::utils {
+
+class MemoryBudget;
+class MetricsRegistry;
+
+// Bytes held from a MemoryBudget, which are given back when the reservation is destroyed.
+// Default constructed reservations draw on the process-wide budget, and start empty.
+class MemoryReservation {
+public:
+    MemoryReservation();
+    explicit MemoryReservation(MemoryBudget& budget) : m_budget(&budget) {}
+    ~MemoryReservation() { resize(0); }
+
+    MemoryReservation(MemoryReservation&& other) noexcept;
+    MemoryReservation& operator=(MemoryReservation&& other) noexcept;
+    MemoryReservation(const MemoryReservation&) = delete;
+    MemoryReservation& operator=(const MemoryReservation&) = delete;
+
+    // Grows or shrinks the reservation to num_bytes, blocking while growing it would go over
+    // the budget.
+    void resize(size_t num_bytes);
+    // As resize, but returns false rather than blocking, leaving the reservation as it was.
+    bool try_resize(size_t num_bytes);
+
+    size_t bytes() const { return m_bytes; }
+
+private:
+    MemoryBudget* m_budget;
+    size_t m_bytes{0};
+};
+
+// A limit on the host memory held by reads in flight, counted in bytes rather than reads, so
+// that a run of long reads can't take more than its share.  Nodes reserve memory for each
+// read they take on, and wait while the budget is used up, which holds back their input until
+// reads further down the pipeline are done with.
+// A reservation bigger than the whole budget is granted once nothing else is reserved, so
+// that one huge read can't stall the pipeline forever.  Without a limit, reservations are
+// counted but never wait.
+class MemoryBudget {
+public:
+    explicit MemoryBudget(size_t limit_bytes = 0) : m_limit(limit_bytes) {}
+
+    MemoryBudget(const MemoryBudget&) = delete;
+    MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+    // The process-wide budget, which has no limit until one is set.  It's never destroyed,
+    // since reads may outlive any static destruction order.
+    static MemoryBudget& instance();
+
+    // 0 means no limit.  Reservations already waiting are checked against the new limit.
+    void set_limit(size_t limit_bytes);
+    size_t limit() const;
+
+    size_t reserved_bytes() const;
+    // Whether any reservation is waiting for memory to be given back.
+    bool has_waiters() const;
+
+    // Adds the bytes reserved, the limit and the number of reservations waiting to registry.
+    void add_metrics(MetricsRegistry& registry) const;
+
+private:
+    friend class MemoryReservation;
+
+    // Whether a reservation of current bytes can grow by extra.  m_mutex must be held.
+    bool fits(size_t current, size_t extra) const;
+    void grow(size_t current, size_t extra);
+    bool try_grow(size_t current, size_t extra);
+    void shrink(size_t num_bytes);
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    size_t m_limit;
+    size_t m_reserved{0};
+    size_t m_num_waiters{0};
+};
+
+}  // namespace dorado::utils
@@ -0,0 +1,199 @@
+#include "MemoryProfiler.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <regex>
+
+#ifdef __linux__
+// jemalloc, with its je_ prefix, is linked in through dorado_allocator_lib.  The references are
+// weak so that anything linked without it, such as the unit tests, finds them null instead of
+// failing to link.
+extern "C" {
+int je_mallctl(const char* name, void* oldp, size_t* oldlenp, void* newp, size_t newlen)
+        __attribute__((weak));
+void je_malloc_stats_print(void (*write_cb)(void*, const char*), void* cbopaque, const char* opts)
+        __attribute__((weak));
+}
+#endif  // __linux__
+
+namespace {
+
+template <typename T>
+bool read_mallctl(const char* name, T& value) {
+#ifdef __linux__
+    size_t size = sizeof(value);
+    return je_mallctl && je_mallctl(name, &value, &size, nullptr, 0) == 0;
+#else
+    return false;
+#endif
+}
+
+template <typename T>
+bool write_mallctl(const char* name, T value) {
+#ifdef __linux__
+    return je_mallctl && je_mallctl(name, nullptr, nullptr, &value, sizeof(value)) == 0;
+#else
+    return false;
+#endif
+}
+
+std::string format_gb(size_t bytes) { return fmt::format("{:.2f}GB", bytes / 1e9); }
+
+}  // namespace
+
+namespace dorado::utils {
+
+bool jemalloc_available() {
+#ifdef __linux__
+    return je_mallctl != nullptr;
+#else
+    return false;
+#endif
+}
+
+bool heap_profiling_available() {
+    bool prof = false;
+    return read_mallctl("opt.prof", prof) && prof;
+}
+
+bool get_allocator_stats(AllocatorStats& stats) {
+    // Stats are only brought up to date by advancing the epoch.
+    uint64_t epoch = 1;
+#ifdef __linux__
+    size_t epoch_size = sizeof(epoch);
+    if (!je_mallctl || je_mallctl("epoch", &epoch, &epoch_size, &epoch, epoch_size) != 0) {
+        return false;
+    }
+#else
+    (void)epoch;
+    return false;
+#endif
+    return read_mallctl("stats.allocated", stats.allocated) &&
+           read_mallctl("stats.active", stats.active) &&
+           read_mallctl("stats.metadata", stats.metadata) &&
+           read_mallctl("stats.resident", stats.resident) &&
+           read_mallctl("stats.mapped", stats.mapped) &&
+           read_mallctl("stats.retained", stats.retained) &&
+           read_mallctl("arenas.narenas", stats.num_arenas);
+}
+
+void set_heap_profile_thread_name(const char* name) {
+    // jemalloc copies the name.  Without heap profiling this fails, which is fine.
+    write_mallctl("thread.prof.name", name);
+}
+
+std::vector<HeapProfileThreads> parse_heap_profile_threads(std::istream& profile) {
+    // The per thread totals come before the first backtrace, one to a line, as
+    //   t<id>: <live objects>: <live bytes> [<total objects>: <total bytes>] <name>
+    // with t* for them all.
+    static const std::regex thread_line(R"(^\s*t\d+: (\d+): (\d+) \[\d+: \d+\](?: (.*))?$)");
+    std::map<std::string, HeapProfileThreads> by_name;
+    std::string line;
+    while (std::getline(profile, line) && line.rfind('@', 0) != 0) {
+        std::smatch match;
+        if (!std::regex_match(line, match, thread_line)) {
+            continue;
+        }
+        const std::string name = match[3].matched ? match[3].str() : "unnamed";
+        auto& threads = by_name[name];
+        threads.name = name;
+        threads.objects += std::stoull(match[1].str());
+        threads.bytes += std::stoull(match[2].str());
+    }
+
+    std::vector<HeapProfileThreads> threads;
+    for (auto& [name, named_threads] : by_name) {
+        threads.push_back(std::move(named_threads));
+    }
+    std::stable_sort(threads.begin(), threads.end(),
+                     [](const auto& a, const auto& b) { return a.bytes > b.bytes; });
+    return threads;
+}
+
+MemoryProfiler::MemoryProfiler(std::string output_prefix, std::chrono::seconds interval)
+        : m_output_prefix(std::move(output_prefix)),
+          m_interval(interval),
+          m_heap_profiling(heap_profiling_available()) {
+    if (!jemalloc_available()) {
+        spdlog::warn("Memory profiling needs jemalloc, which is only used on Linux");
+        return;
+    }
+    if (m_heap_profiling) {
+        write_mallctl("prof.active", true);
+    } else {
+        spdlog::warn(
+                "Heap profiling is off, so only allocator stats will be reported. Run with "
+                "JE_MALLOC_CONF=prof:true,prof_active:false to see which threads hold memory.");
+    }
+    m_thread = std::make_unique<std::thread>(&MemoryProfiler::profiling_thread, this);
+}
+
+MemoryProfiler::~MemoryProfiler() {
+    if (!m_thread) {
+        return;
+    }
+    {
+        std::lock_guard lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_thread->join();
+
+    report(m_output_prefix + ".heap");
+    if (m_heap_profiling) {
+        write_mallctl("prof.active", false);
+    }
+#ifdef __linux__
+    if (je_malloc_stats_print) {
+        std::ofstream stats_file(m_output_prefix + ".stats.txt");
+        je_malloc_stats_print(
+                [](void* out, const char* text) { *static_cast<std::ofstream*>(out) << text; },
+                &stats_file, nullptr);
+    }
+#endif
+}
+
+void MemoryProfiler::report(const std::string& heap_profile_path) {
+    AllocatorStats stats;
+    if (get_allocator_stats(stats)) {
+        spdlog::info("> Memory: allocated {}, active {}, metadata {}, resident {}, mapped {}, "
+                     "retained {}, {} arenas",
+                     format_gb(stats.allocated), format_gb(stats.active),
+                     format_gb(stats.metadata), format_gb(stats.resident),
+                     format_gb(stats.mapped), format_gb(stats.retained), stats.num_arenas);
+    }
+    if (!m_heap_profiling) {
+        return;
+    }
+
+    const char* path = heap_profile_path.c_str();
+    if (!write_mallctl("prof.dump", path)) {
+        spdlog::warn("Unable to write heap profile {}", heap_profile_path);
+        return;
+    }
+    std::ifstream profile(heap_profile_path);
+    const auto threads = parse_heap_profile_threads(profile);
+    size_t total_bytes = 0;
+    for (const auto& named_threads : threads) {
+        total_bytes += named_threads.bytes;
+    }
+    constexpr size_t kMaxThreadsLogged = 5;
+    for (size_t i = 0; i < std::min(threads.size(), kMaxThreadsLogged); ++i) {
+        spdlog::info(">   {}: {:.1f}% of live sampled bytes", threads[i].name,
+                     100.0 * threads[i].bytes / std::max<size_t>(total_bytes, 1));
+    }
+}
+
+void MemoryProfiler::profiling_thread() {
+    std::unique_lock lock(m_mutex);
+    while (!m_cv.wait_for(lock, m_interval, [this] { return m_stop; })) {
+        lock.unlock();
+        report(fmt::format("{}.{}.heap", m_output_prefix, m_num_dumps++));
+        lock.lock();
+    }
+}
+
+}  // namespace dorado::utils
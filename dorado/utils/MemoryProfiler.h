@@ -0,0 +1,80 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dorado::utils {
+
+// What jemalloc, which dorado allocates through on Linux, has taken from the system, in bytes.
+// allocated is what's held by the program, active the pages it's held on, and resident and
+// mapped what the allocator has, including its own metadata.  retained is address space
+// given back to the system but kept mapped for reuse.
+struct AllocatorStats {
+    size_t allocated{0};
+    size_t active{0};
+    size_t metadata{0};
+    size_t resident{0};
+    size_t mapped{0};
+    size_t retained{0};
+    unsigned num_arenas{0};
+};
+
+// Whether allocations go through jemalloc, which is only so on Linux.
+bool jemalloc_available();
+// Whether jemalloc was started with heap profiling, as JE_MALLOC_CONF=prof:true does.  It has
+// to be set before the first allocation, so can't be turned on from the command line.
+bool heap_profiling_available();
+// Returns false if jemalloc isn't available.
+bool get_allocator_stats(AllocatorStats& stats);
+
+// Names the calling thread in heap profiles, so their allocations can be put down to the
+// pipeline node the thread belongs to.  Does nothing without heap profiling.
+void set_heap_profile_thread_name(const char* name);
+
+// The live allocations sampled in a jemalloc heap profile, for the threads of one name.
+struct HeapProfileThreads {
+    std::string name;
+    size_t objects{0};
+    size_t bytes{0};
+};
+// Sums the live allocations in a heap profile dump by thread name, largest first.  Threads
+// which weren't named are put together as "unnamed".  The counts are of sampled allocations,
+// so the shares are what's meaningful: jeprof scales them to estimate the real sizes.
+std::vector<HeapProfileThreads> parse_heap_profile_threads(std::istream& profile);
+
+// How often --memory-profile reports.
+constexpr auto kMemoryProfileInterval = std::chrono::seconds(30);
+
+// For --memory-profile.  While in scope, logs the allocator's stats every interval and, with
+// heap profiling available, samples allocations, dumps the heap profile to
+// <output_prefix>.<n>.heap and logs which threads hold the most.  On destruction the last heap
+// profile goes to <output_prefix>.heap, for jeprof, and jemalloc's full per arena stats to
+// <output_prefix>.stats.txt.
+class MemoryProfiler {
+public:
+    MemoryProfiler(std::string output_prefix, std::chrono::seconds interval);
+    ~MemoryProfiler();
+
+private:
+    void report(const std::string& heap_profile_path);
+    void profiling_thread();
+
+    std::string m_output_prefix;
+    std::chrono::seconds m_interval;
+    bool m_heap_profiling;
+    size_t m_num_dumps{0};
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_stop{false};
+    std::unique_ptr<std::thread> m_thread;
+};
+
+}  // namespace dorado::utils
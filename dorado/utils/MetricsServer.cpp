@@ -0,0 +1,144 @@
+#include "MetricsServer.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+// How long a scraper has to send each line of its request, and the longest line allowed.
+constexpr auto kRequestTimeout = std::chrono::seconds(1);
+constexpr size_t kMaxRequestLineLength = 8192;
+// How often the serving thread checks whether it's being stopped.
+constexpr auto kAcceptTimeout = std::chrono::milliseconds(100);
+
+std::string http_response(const std::string& status,
+                          const std::string& content_type,
+                          const std::string& body) {
+    return "HTTP/1.1 " + status + "\r\nContent-Type: " + content_type +
+           "\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" +
+           body;
+}
+
+}  // namespace
+
+namespace dorado::utils {
+
+void MetricsRegistry::add(const std::string& name,
+                          const std::string& help,
+                          Type type,
+                          std::function<double()> value,
+                          const std::string& labels) {
+    auto metric = std::find_if(m_metrics.begin(), m_metrics.end(),
+                               [&name](const Metric& metric) { return metric.name == name; });
+    if (metric == m_metrics.end()) {
+        m_metrics.push_back({name, help, type, {}});
+        metric = std::prev(m_metrics.end());
+    } else if (metric->type != type) {
+        throw std::runtime_error("Metric " + name + " added with different types");
+    }
+    metric->values.emplace_back(labels, std::move(value));
+}
+
+std::string MetricsRegistry::format() const {
+    std::ostringstream out;
+    out << std::setprecision(15);
+    for (const auto& metric : m_metrics) {
+        out << "# HELP " << metric.name << ' ' << metric.help << '\n';
+        out << "# TYPE " << metric.name << ' '
+            << (metric.type == Type::COUNTER ? "counter" : "gauge") << '\n';
+        for (const auto& [labels, value] : metric.values) {
+            out << metric.name;
+            if (!labels.empty()) {
+                out << '{' << labels << '}';
+            }
+            out << ' ' << value() << '\n';
+        }
+    }
+    return out.str();
+}
+
+double MetricsRegistry::total(const std::string& name) const {
+    double total = 0;
+    for (const auto& metric : m_metrics) {
+        if (metric.name == name) {
+            for (const auto& [labels, value] : metric.values) {
+                total += value();
+            }
+        }
+    }
+    return total;
+}
+
+MetricsServer::MetricsServer(uint16_t port) : m_socket(port) {
+    m_thread = std::thread(&MetricsServer::serving_thread, this);
+}
+
+MetricsServer::~MetricsServer() {
+    m_stop = true;
+    m_thread.join();
+}
+
+void MetricsServer::set_registry(std::shared_ptr<const MetricsRegistry> registry) {
+    std::lock_guard lock(m_registry_mutex);
+    m_registry = std::move(registry);
+}
+
+void MetricsServer::serving_thread() {
+    while (!m_stop) {
+        std::optional<int> connection;
+        try {
+            connection = m_socket.accept(kAcceptTimeout);
+        } catch (const std::exception& e) {
+            spdlog::error("Metrics server stopped: {}", e.what());
+            return;
+        }
+        if (connection) {
+            handle_connection(*connection);
+            close_socket(*connection);
+        }
+    }
+}
+
+void MetricsServer::handle_connection(int connection) {
+    const auto request_line = read_line(connection, kMaxRequestLineLength, kRequestTimeout);
+    if (!request_line) {
+        return;
+    }
+    // The headers aren't needed, but are read up to the blank line which ends them, so that
+    // the client isn't reset by the connection closing on unread data.
+    while (true) {
+        const auto header = read_line(connection, kMaxRequestLineLength, kRequestTimeout);
+        if (!header) {
+            return;
+        }
+        if (header->empty() || *header == "\r") {
+            break;
+        }
+    }
+
+    std::istringstream request(*request_line);
+    std::string method, target;
+    request >> method >> target;
+    std::string response;
+    if (method != "GET") {
+        response = http_response("405 Method Not Allowed", "text/plain", "");
+    } else if (target != "/metrics" && target.rfind("/metrics?", 0) != 0) {
+        response = http_response("404 Not Found", "text/plain", "");
+    } else {
+        std::string body;
+        {
+            std::lock_guard lock(m_registry_mutex);
+            if (m_registry) {
+                body = m_registry->format();
+            }
+        }
+        response = http_response("200 OK", "text/plain; version=0.0.4; charset=utf-8", body);
+    }
+    write_all(connection, response);
+}
+
+}  // namespace dorado::utils
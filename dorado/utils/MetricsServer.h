@@ -0,0 +1,96 @@
+#pragma once
+
+#include "socket_utils.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace dorado::utils {
+
+// The metrics of a pipeline, as callbacks which read them from the nodes' own counters when
+// they're scraped, so keeping them costs the pipeline nothing more than the counters do.
+class MetricsRegistry {
+public:
+    enum class Type { COUNTER, GAUGE };
+
+    // Metrics of the same name, which must have the same help and type, are told apart by
+    // their labels, given as e.g. R"(device="cuda:0")".
+    void add(const std::string& name,
+             const std::string& help,
+             Type type,
+             std::function<double()> value,
+             const std::string& labels = "");
+
+    // Every metric's current value, in the Prometheus text exposition format.
+    std::string format() const;
+    // The current value of the metric called name summed over its labels, or 0 if there's no
+    // such metric.
+    double total(const std::string& name) const;
+
+private:
+    struct Metric {
+        std::string name;
+        std::string help;
+        Type type;
+        std::vector<std::pair<std::string, std::function<double()>>> values;
+    };
+    std::vector<Metric> m_metrics;
+};
+
+// Serves the metrics of a registry over HTTP at /metrics on a TCP port, for Prometheus or
+// anything else which reads its format to scrape.
+class MetricsServer {
+public:
+    // Port 0 picks any free port.  Throws if the port can't be listened on.
+    explicit MetricsServer(uint16_t port);
+    ~MetricsServer();
+
+    uint16_t port() const { return m_socket.port(); }
+
+    // Serves the metrics of registry, or none if it's null, in place of those before.  Once
+    // this returns the previous registry is no longer read, so what its callbacks refer to
+    // can be destroyed.
+    void set_registry(std::shared_ptr<const MetricsRegistry> registry);
+
+private:
+    void serving_thread();
+    void handle_connection(int connection);
+
+    TcpSocketServer m_socket;
+    std::mutex m_registry_mutex;
+    std::shared_ptr<const MetricsRegistry> m_registry;
+    std::atomic<bool> m_stop{false};
+    std::thread m_thread;
+};
+
+// Has a server, if there is one, serve a registry's metrics for as long as it's in scope, so
+// that the registry stops being read before the nodes its callbacks refer to are destroyed.
+class ScopedMetrics {
+public:
+    ScopedMetrics(MetricsServer* server, std::shared_ptr<const MetricsRegistry> registry)
+            : m_server(server) {
+        if (m_server) {
+            m_server->set_registry(std::move(registry));
+        }
+    }
+    ~ScopedMetrics() {
+        if (m_server) {
+            m_server->set_registry(nullptr);
+        }
+    }
+
+    ScopedMetrics(const ScopedMetrics&) = delete;
+    ScopedMetrics& operator=(const ScopedMetrics&) = delete;
+
+private:
+    MetricsServer* m_server;
+};
+
+}  // namespace dorado::utils
@@ -0,0 +1,226 @@
+#include "MoveTable.h"
+
+#include <algorithm>
+#include <cassert>
+#include <utility>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+
+int popcount(uint64_t word) {
+#ifdef _MSC_VER
+    return static_cast<int>(__popcnt64(word));
+#else
+    return __builtin_popcountll(word);
+#endif
+}
+
+int count_trailing_zeros(uint64_t word) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(word);
+#endif
+}
+
+// The low num_bits bits set, for num_bits <= 64.
+uint64_t low_bits_mask(size_t num_bits) {
+    return num_bits >= 64 ? ~uint64_t(0) : (uint64_t(1) << num_bits) - 1;
+}
+
+}  // namespace
+
+namespace dorado::utils {
+
+MoveTable::MoveTable(const std::vector<uint8_t>& moves) : MoveTable(moves.data(), moves.size()) {}
+
+MoveTable::MoveTable(const uint8_t* moves, size_t num_moves) {
+    m_words.assign((num_moves + kWordBits - 1) / kWordBits, 0);
+    for (size_t i = 0; i < num_moves; ++i) {
+        m_words[i / kWordBits] |= uint64_t(moves[i] != 0) << (i % kWordBits);
+    }
+    m_size = num_moves;
+    update_block_ranks(0);
+}
+
+void MoveTable::push_back(bool move) { append_bits(move, 1); }
+
+void MoveTable::pop_back() {
+    assert(m_size > 0);
+    --m_size;
+    const size_t offset = m_size % kWordBits;
+    if (offset == 0) {
+        m_words.pop_back();
+    } else {
+        m_words.back() &= low_bits_mask(offset);
+    }
+    // The entry was in the last block, whose rank only counts blocks before it.
+    m_block_ranks.resize(m_size / kBlockBits + 1);
+}
+
+MoveTable::MoveTable(MoveTable&& other) noexcept
+        : m_words(std::move(other.m_words)),
+          m_block_ranks(std::move(other.m_block_ranks)),
+          m_size(other.m_size) {
+    other.m_words.clear();
+    other.m_block_ranks.assign(1, 0);
+    other.m_size = 0;
+}
+
+MoveTable& MoveTable::operator=(MoveTable&& other) noexcept {
+    if (this != &other) {
+        m_words = std::move(other.m_words);
+        m_block_ranks = std::move(other.m_block_ranks);
+        m_size = other.m_size;
+        other.m_words.clear();
+        other.m_block_ranks.assign(1, 0);
+        other.m_size = 0;
+    }
+    return *this;
+}
+
+void MoveTable::clear() {
+    m_words.clear();
+    m_block_ranks.assign(1, 0);
+    m_size = 0;
+}
+
+void MoveTable::reserve(size_t num_moves) {
+    m_words.reserve((num_moves + kWordBits - 1) / kWordBits);
+    m_block_ranks.reserve(num_moves / kBlockBits + 1);
+}
+
+void MoveTable::shrink_to_fit() {
+    m_words.shrink_to_fit();
+    m_block_ranks.shrink_to_fit();
+}
+
+void MoveTable::append(const MoveTable& other, size_t begin, size_t end) {
+    assert(&other != this && begin <= end && end <= other.m_size);
+    const size_t first_changed = m_size;
+    for (size_t pos = begin; pos < end; pos += kWordBits) {
+        const size_t num_bits = std::min(kWordBits, end - pos);
+        append_bits(other.get_bits(pos, num_bits), num_bits);
+    }
+    update_block_ranks(first_changed);
+}
+
+MoveTable MoveTable::slice(size_t begin, size_t end) const {
+    MoveTable slice;
+    slice.reserve(end - begin);
+    slice.append(*this, begin, end);
+    return slice;
+}
+
+size_t MoveTable::rank(size_t pos) const {
+    assert(pos <= m_size);
+    const size_t block = pos / kBlockBits;
+    const size_t word = pos / kWordBits;
+    size_t rank = m_block_ranks[block];
+    for (size_t i = block * kWordsPerBlock; i < word; ++i) {
+        rank += popcount(m_words[i]);
+    }
+    if (pos % kWordBits != 0) {
+        rank += popcount(m_words[word] & low_bits_mask(pos % kWordBits));
+    }
+    return rank;
+}
+
+size_t MoveTable::select(size_t n) const {
+    assert(n < count());
+    // The last block with no more than n moves before it holds the nth.
+    const auto block_it =
+            std::prev(std::upper_bound(m_block_ranks.begin(), m_block_ranks.end(), n));
+    size_t remaining = n - *block_it;
+    size_t word = (block_it - m_block_ranks.begin()) * kWordsPerBlock;
+    for (;; ++word) {
+        const size_t word_moves = popcount(m_words[word]);
+        if (remaining < word_moves) {
+            break;
+        }
+        remaining -= word_moves;
+    }
+    // Clear the moves before the one wanted, which is then the lowest set bit.
+    uint64_t bits = m_words[word];
+    for (; remaining > 0; --remaining) {
+        bits &= bits - 1;
+    }
+    return word * kWordBits + count_trailing_zeros(bits);
+}
+
+void MoveTable::move_positions(uint64_t* out, uint64_t scale) const {
+    for (size_t word = 0; word < m_words.size(); ++word) {
+        for (uint64_t bits = m_words[word]; bits != 0; bits &= bits - 1) {
+            *out++ = (word * kWordBits + count_trailing_zeros(bits)) * scale;
+        }
+    }
+}
+
+void MoveTable::unpack(uint8_t* out) const {
+    for (size_t i = 0; i < m_size; ++i) {
+        out[i] = (m_words[i / kWordBits] >> (i % kWordBits)) & 1;
+    }
+}
+
+std::vector<uint8_t> MoveTable::to_vector() const {
+    std::vector<uint8_t> moves(m_size);
+    unpack(moves.data());
+    return moves;
+}
+
+size_t MoveTable::memory_bytes() const {
+    return m_words.capacity() * sizeof(uint64_t) + m_block_ranks.capacity() * sizeof(size_t);
+}
+
+bool MoveTable::operator==(const MoveTable& other) const {
+    // Bits past the end are clear in both, so whole words compare.
+    return m_size == other.m_size && m_words == other.m_words;
+}
+
+void MoveTable::append_bits(uint64_t bits, size_t num_bits) {
+    const size_t offset = m_size % kWordBits;
+    if (offset == 0) {
+        m_words.push_back(bits);
+    } else {
+        m_words.back() |= bits << offset;
+        if (offset + num_bits > kWordBits) {
+            m_words.push_back(bits >> (kWordBits - offset));
+        }
+    }
+    const size_t first_changed = m_size;
+    m_size += num_bits;
+    if (num_bits == 1) {
+        // Single entries are appended one by one, so their ranks are kept up as they go.
+        update_block_ranks(first_changed);
+    }
+}
+
+uint64_t MoveTable::get_bits(size_t pos, size_t num_bits) const {
+    const size_t word = pos / kWordBits;
+    const size_t offset = pos % kWordBits;
+    uint64_t bits = m_words[word] >> offset;
+    if (offset != 0 && offset + num_bits > kWordBits) {
+        bits |= m_words[word + 1] << (kWordBits - offset);
+    }
+    return bits & low_bits_mask(num_bits);
+}
+
+void MoveTable::update_block_ranks(size_t first_changed) {
+    const size_t num_blocks = m_size / kBlockBits + 1;
+    const size_t first_block = std::min(first_changed / kBlockBits, m_block_ranks.size() - 1);
+    m_block_ranks.resize(num_blocks);
+    for (size_t block = first_block + 1; block < num_blocks; ++block) {
+        size_t rank = m_block_ranks[block - 1];
+        for (size_t i = 0; i < kWordsPerBlock; ++i) {
+            rank += popcount(m_words[(block - 1) * kWordsPerBlock + i]);
+        }
+        m_block_ranks[block] = rank;
+    }
+}
+
+}  // namespace dorado::utils
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace dorado::utils {
+
+// A move table packed one bit per model step, where a set bit is a step on which a base was
+// emitted.  Alongside the bits, the number of moves before each block of 512 steps is kept up
+// to date, so the bases before any step (rank) are counted in constant time, and the step of
+// any base (select) is found by a binary search over the blocks and a scan within one.
+class MoveTable {
+public:
+    MoveTable() = default;
+    // Nonzero entries are moves.
+    explicit MoveTable(const std::vector<uint8_t>& moves);
+    MoveTable(const uint8_t* moves, size_t num_moves);
+
+    MoveTable(const MoveTable&) = default;
+    MoveTable& operator=(const MoveTable&) = default;
+    // The moved-from table is left empty, as the block ranks must hold at least one entry.
+    MoveTable(MoveTable&& other) noexcept;
+    MoveTable& operator=(MoveTable&& other) noexcept;
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    bool operator[](size_t pos) const {
+        return (m_words[pos / kWordBits] >> (pos % kWordBits)) & 1;
+    }
+    bool back() const { return (*this)[m_size - 1]; }
+
+    void push_back(bool move);
+    void pop_back();
+    void clear();
+    void reserve(size_t num_moves);
+    // Frees any capacity past what the entries need.
+    void shrink_to_fit();
+    size_t capacity() const { return m_words.capacity() * kWordBits; }
+
+    // Appends entries [begin, end) of other, which mustn't be this table.
+    void append(const MoveTable& other, size_t begin, size_t end);
+    // Entries [begin, end) as a table of their own.
+    MoveTable slice(size_t begin, size_t end) const;
+
+    // The number of moves in entries [0, pos), for pos <= size().
+    size_t rank(size_t pos) const;
+    // The number of moves in the table, i.e. bases called.
+    size_t count() const { return rank(m_size); }
+    // The entry of the nth move, counting from 0, for n < count().
+    size_t select(size_t n) const;
+
+    // Writes the entry of each move, multiplied by scale, into out, which has room for count()
+    // of them.
+    void move_positions(uint64_t* out, uint64_t scale = 1) const;
+
+    // Writes the entries as 0/1 bytes into out, which has room for size() of them.
+    void unpack(uint8_t* out) const;
+    std::vector<uint8_t> to_vector() const;
+
+    // Host memory held by the bits and the index.
+    size_t memory_bytes() const;
+
+    bool operator==(const MoveTable& other) const;
+    bool operator!=(const MoveTable& other) const { return !(*this == other); }
+
+private:
+    static constexpr size_t kWordBits = 64;
+    static constexpr size_t kWordsPerBlock = 8;
+    static constexpr size_t kBlockBits = kWordBits * kWordsPerBlock;
+
+    // Appends the low num_bits of bits, the rest of which are clear.
+    void append_bits(uint64_t bits, size_t num_bits);
+    // Up to 64 entries from pos, in the low bits.
+    uint64_t get_bits(size_t pos, size_t num_bits) const;
+    // Recounts the moves before each block after the one holding entry first_changed.
+    void update_block_ranks(size_t first_changed);
+
+    // Bits past m_size are clear, so whole words can be popcounted.
+    std::vector<uint64_t> m_words;
+    // One per block up to and including the one holding entry m_size.
+    std::vector<size_t> m_block_ranks{0};
+    size_t m_size{0};
+};
+
+}  // namespace dorado::utils
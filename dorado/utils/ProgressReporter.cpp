@@ -0,0 +1,63 @@
+#include "ProgressReporter.h"
+
+#include "thread_utils.h"
+
+#include <algorithm>
+
+namespace dorado::utils {
+
+ProgressReporter::ProgressReporter(size_t num_expected, std::chrono::milliseconds interval)
+        : m_num_expected(num_expected),
+          m_interval(interval),
+          m_thread(&ProgressReporter::render_thread, this) {}
+
+ProgressReporter::~ProgressReporter() { stop(); }
+
+void ProgressReporter::stop() {
+    {
+        std::lock_guard lock(m_mutex);
+        if (m_stop) {
+            return;
+        }
+        m_stop = true;
+    }
+    m_stopping.notify_one();
+    m_thread.join();
+}
+
+void ProgressReporter::render_thread() {
+    set_thread_name("progress");
+    lower_thread_priority();
+    render(0);
+    size_t rendered = 0;
+    size_t rendered_removed = 0;
+    std::unique_lock lock(m_mutex);
+    while (!m_stop) {
+        m_stopping.wait_for(lock, m_interval, [this] { return m_stop; });
+        const size_t count = m_count.load(std::memory_order_relaxed);
+        const size_t num_removed = m_num_removed.load(std::memory_order_relaxed);
+        if (count != rendered || num_removed != rendered_removed) {
+            render(count);
+            rendered = count;
+            rendered_removed = num_removed;
+        }
+    }
+    // Clear progress information.
+    std::cerr << "\r";
+}
+
+void ProgressReporter::render(size_t count) {
+    if (m_num_expected != 0) {
+        const size_t num_removed = m_num_removed.load(std::memory_order_relaxed);
+        const size_t num_expected = m_num_expected - std::min(num_removed, m_num_expected);
+        const size_t num_written = std::min(count, num_expected);
+        m_progress_bar.set_progress(
+                num_expected == 0 ? 100.f
+                                  : 100.f * static_cast<float>(num_written) / num_expected);
+        std::cerr << "\033[K";
+    } else {
+        std::cerr << "\r> Output records written: " << count;
+    }
+}
+
+}  // namespace dorado::utils
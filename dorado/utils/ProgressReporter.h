@@ -0,0 +1,61 @@
+#pragma once
+
+#include <indicators/block_progress_bar.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+namespace dorado::utils {
+
+// Shows on stderr how many of the reads expected have been written, as a progress bar, or how
+// many records have been written if none were expected.  The threads doing the work only bump
+// an atomic count, and a low priority thread of the reporter's own redraws it every interval,
+// so that they never wait on stderr.
+class ProgressReporter {
+public:
+    explicit ProgressReporter(size_t num_expected,
+                              std::chrono::milliseconds interval = std::chrono::milliseconds(250));
+    ~ProgressReporter();
+
+    ProgressReporter(const ProgressReporter&) = delete;
+    ProgressReporter& operator=(const ProgressReporter&) = delete;
+
+    // Thread safe.
+    void add(size_t count = 1) { m_count.fetch_add(count, std::memory_order_relaxed); }
+    size_t count() const { return m_count.load(std::memory_order_relaxed); }
+    // Thread safe.  For reads which were expected but won't be written, e.g. those dropped as
+    // they're loaded.
+    void remove_expected(size_t count = 1) {
+        m_num_removed.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    // Draws the final count, and clears the line for what's logged next.  Called by the
+    // destructor, if not before.
+    void stop();
+
+private:
+    void render_thread();
+    void render(size_t count);
+
+    const size_t m_num_expected;
+    const std::chrono::milliseconds m_interval;
+    std::atomic<size_t> m_count{0};
+    std::atomic<size_t> m_num_removed{0};
+
+    std::mutex m_mutex;
+    std::condition_variable m_stopping;
+    bool m_stop{false};
+    indicators::BlockProgressBar m_progress_bar{
+            indicators::option::Stream{std::cerr},     indicators::option::BarWidth{30},
+            indicators::option::ShowElapsedTime{true}, indicators::option::ShowRemainingTime{true},
+            indicators::option::ShowPercentage{true},
+    };
+    std::thread m_thread;
+};
+
+}  // namespace dorado::utils
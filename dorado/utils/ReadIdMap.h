@@ -0,0 +1,236 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace dorado::utils {
+
+// A read ID as its 16 binary bytes, laid out as ReadID in DataLoader.h.
+using ReadIdBytes = std::array<uint8_t, 16>;
+
+// Parses a UUID format read ID, e.g. "550e8400-e29b-41d4-a716-446655440000", in either case.
+// Returns false, leaving bytes unspecified, if read_id isn't one.
+inline bool parse_read_id(std::string_view read_id, ReadIdBytes& bytes) {
+    constexpr size_t kUuidLength = 36;
+    if (read_id.size() != kUuidLength) {
+        return false;
+    }
+    auto hex_value = [](char c) -> int {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        }
+        if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        }
+        if (c >= 'A' && c <= 'F') {
+            return c - 'A' + 10;
+        }
+        return -1;
+    };
+    size_t pos = 0;
+    for (auto& byte : bytes) {
+        // Dashes come after the 4th, 6th, 8th and 10th bytes.
+        if (pos == 8 || pos == 13 || pos == 18 || pos == 23) {
+            if (read_id[pos++] != '-') {
+                return false;
+            }
+        }
+        const int high = hex_value(read_id[pos++]);
+        const int low = hex_value(read_id[pos++]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        byte = static_cast<uint8_t>(high << 4 | low);
+    }
+    return true;
+}
+
+// A map from binary read IDs to Values which many threads can use at once.  Keys are spread
+// over shards by hash, each an open addressing hash table with its own lock, so threads only
+// contend when they touch the same shard.
+// Values must be default constructible and movable.
+template <class Value>
+class ReadIdMap {
+public:
+    explicit ReadIdMap(size_t expected_size = 0) { reserve(expected_size); }
+
+    // Sizes the shards for expected_size entries, so that filling the map doesn't rehash.
+    void reserve(size_t expected_size) {
+        for (auto& shard : m_shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.reserve(expected_size / kNumShards + 1);
+        }
+    }
+
+    // Sets the value for key, replacing any it already has.
+    void insert_or_assign(const ReadIdBytes& key, Value value) {
+        const size_t hash = hash_key(key);
+        auto& shard = shard_for(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.insert_or_assign(key, hash, std::move(value));
+    }
+
+    std::optional<Value> find(const ReadIdBytes& key) const {
+        const size_t hash = hash_key(key);
+        const auto& shard = shard_for(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        const size_t index = shard.find(key, hash);
+        if (index == Shard::kNotFound) {
+            return std::nullopt;
+        }
+        return shard.slots[index].value;
+    }
+
+    // Removes key's entry, if it has one, returning its value.
+    std::optional<Value> extract(const ReadIdBytes& key) {
+        const size_t hash = hash_key(key);
+        auto& shard = shard_for(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.extract(key, hash);
+    }
+
+    // If key has an entry, removes it and returns its value, otherwise inserts value for key and
+    // returns nothing.  Lets two threads meet on a key without either missing the other.
+    std::optional<Value> extract_or_insert(const ReadIdBytes& key, Value value) {
+        const size_t hash = hash_key(key);
+        auto& shard = shard_for(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto existing = shard.extract(key, hash);
+        if (!existing) {
+            shard.insert_or_assign(key, hash, std::move(value));
+        }
+        return existing;
+    }
+
+    size_t size() const {
+        size_t size = 0;
+        for (const auto& shard : m_shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            size += shard.size;
+        }
+        return size;
+    }
+
+private:
+    static constexpr int kShardBits = 6;
+    static constexpr size_t kNumShards = size_t(1) << kShardBits;
+
+    struct Slot {
+        ReadIdBytes key;
+        bool occupied = false;
+        Value value;
+    };
+
+    // A linear probing hash table, whose capacity is a power of 2 and at most 3/4 full.
+    struct Shard {
+        static constexpr size_t kNotFound = SIZE_MAX;
+
+        mutable std::mutex mutex;
+        std::vector<Slot> slots;
+        size_t size = 0;
+
+        void reserve(size_t num_entries) {
+            size_t capacity = 16;
+            while (capacity * 3 / 4 < num_entries) {
+                capacity *= 2;
+            }
+            if (capacity > slots.size()) {
+                rehash(capacity);
+            }
+        }
+
+        size_t mask() const { return slots.size() - 1; }
+
+        size_t find(const ReadIdBytes& key, size_t hash) const {
+            if (slots.empty()) {
+                return kNotFound;
+            }
+            for (size_t index = hash & mask();; index = (index + 1) & mask()) {
+                if (!slots[index].occupied) {
+                    return kNotFound;
+                }
+                if (slots[index].key == key) {
+                    return index;
+                }
+            }
+        }
+
+        void insert_or_assign(const ReadIdBytes& key, size_t hash, Value value) {
+            if ((size + 1) * 4 > slots.size() * 3) {
+                rehash(slots.empty() ? 16 : slots.size() * 2);
+            }
+            size_t index = hash & mask();
+            while (slots[index].occupied && slots[index].key != key) {
+                index = (index + 1) & mask();
+            }
+            if (!slots[index].occupied) {
+                slots[index].key = key;
+                slots[index].occupied = true;
+                ++size;
+            }
+            slots[index].value = std::move(value);
+        }
+
+        std::optional<Value> extract(const ReadIdBytes& key, size_t hash) {
+            size_t index = find(key, hash);
+            if (index == kNotFound) {
+                return std::nullopt;
+            }
+            std::optional<Value> value = std::move(slots[index].value);
+            // Shift later entries of the probe sequence back over the gap, rather than leaving a
+            // tombstone, so that lookups stay short however many entries come and go.
+            for (size_t next = (index + 1) & mask(); slots[next].occupied;
+                 next = (next + 1) & mask()) {
+                const size_t home = hash_key(slots[next].key) & mask();
+                // Whether next's home slot is cyclically outside (index, next], i.e. next can move
+                // back to index without becoming unreachable.
+                if (((next - home) & mask()) >= ((next - index) & mask())) {
+                    slots[index] = std::move(slots[next]);
+                    index = next;
+                }
+            }
+            slots[index].occupied = false;
+            slots[index].value = Value();
+            --size;
+            return value;
+        }
+
+        void rehash(size_t capacity) {
+            std::vector<Slot> old_slots(capacity);
+            old_slots.swap(slots);
+            size = 0;
+            for (auto& slot : old_slots) {
+                if (slot.occupied) {
+                    insert_or_assign(slot.key, hash_key(slot.key), std::move(slot.value));
+                }
+            }
+        }
+    };
+
+    // Read IDs are random UUIDs, but the version and variant bits aren't, so the halves are
+    // mixed rather than one being used as is.
+    static size_t hash_key(const ReadIdBytes& key) {
+        uint64_t low, high;
+        std::memcpy(&low, key.data(), sizeof(low));
+        std::memcpy(&high, key.data() + sizeof(low), sizeof(high));
+        uint64_t hash = (low ^ (high * 0x9e3779b97f4a7c15ull)) * 0xbf58476d1ce4e5b9ull;
+        return static_cast<size_t>(hash ^ (hash >> 31));
+    }
+
+    // Shards are picked by the top bits of the hash, and slots within them by the bottom bits.
+    Shard& shard_for(size_t hash) { return m_shards[hash >> (sizeof(size_t) * 8 - kShardBits)]; }
+    const Shard& shard_for(size_t hash) const {
+        return m_shards[hash >> (sizeof(size_t) * 8 - kShardBits)];
+    }
+
+    std::array<Shard, kNumShards> m_shards;
+};
+
+}  // namespace dorado::utils
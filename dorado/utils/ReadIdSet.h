@@ -0,0 +1,70 @@
+#pragma once
+
+#include "ReadIdMap.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace dorado::utils {
+
+// A set of read IDs, as given with --read-ids.  UUID format IDs, which are all POD5 files
+// hold, are kept as 16 binary bytes in a sorted array, and looked up by binary search on the
+// binary IDs readers already have, without formatting or hashing strings.  That takes a sixth
+// of the memory of a set of strings.  Any other IDs, as FAST5 files may have, are kept as
+// strings.
+class ReadIdSet {
+public:
+    ReadIdSet() = default;
+    ReadIdSet(const std::unordered_set<std::string>& read_ids) {
+        reserve(read_ids.size());
+        for (const auto& read_id : read_ids) {
+            add(read_id);
+        }
+        finalise();
+    }
+
+    // IDs may be added in any order, with duplicates, but can only be looked up once
+    // finalise() has been called after the last is added.
+    void reserve(size_t num_read_ids) { m_uuids.reserve(num_read_ids); }
+    void add(std::string_view read_id) {
+        ReadIdBytes bytes;
+        if (parse_read_id(read_id, bytes)) {
+            m_uuids.push_back(bytes);
+        } else {
+            m_other_ids.emplace(read_id);
+        }
+    }
+    void finalise() {
+        std::sort(m_uuids.begin(), m_uuids.end());
+        m_uuids.erase(std::unique(m_uuids.begin(), m_uuids.end()), m_uuids.end());
+        m_uuids.shrink_to_fit();
+    }
+
+    // read_id points to 16 binary bytes, as in a POD5 read table.
+    bool contains(const uint8_t* read_id) const {
+        ReadIdBytes bytes;
+        std::memcpy(bytes.data(), read_id, bytes.size());
+        return std::binary_search(m_uuids.begin(), m_uuids.end(), bytes);
+    }
+    bool contains(std::string_view read_id) const {
+        ReadIdBytes bytes;
+        if (parse_read_id(read_id, bytes)) {
+            return std::binary_search(m_uuids.begin(), m_uuids.end(), bytes);
+        }
+        return m_other_ids.count(std::string(read_id)) > 0;
+    }
+
+    size_t size() const { return m_uuids.size() + m_other_ids.size(); }
+    bool empty() const { return size() == 0; }
+
+private:
+    std::vector<ReadIdBytes> m_uuids;
+    std::unordered_set<std::string> m_other_ids;
+};
+
+}  // namespace dorado::utils
@@ -0,0 +1,194 @@
+#include "SignalCache.h"
+
+#include "FileLock.h"
+#include "TensorPool.h"
+
+#include <spdlog/spdlog.h>
+
+#include <cstring>
+#include <stdexcept>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr char kSignalCacheMagic[8] = {'D', 'O', 'R', 'A', 'D', 'O', 'S', '1'};
+
+template <typename T>
+void append_value(std::string& buffer, T value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// Reads a T at offset into data, of size bytes, advancing offset.  Returns false if there
+// are too few bytes left.
+template <typename T>
+bool read_value(const char* data, size_t size, size_t& offset, T& value) {
+    if (size - offset < sizeof(T)) {
+        return false;
+    }
+    std::memcpy(&value, data + offset, sizeof(T));
+    offset += sizeof(T);
+    return true;
+}
+
+}  // namespace
+
+namespace dorado::utils {
+
+SignalCache::SignalCache(const std::filesystem::path& path, const std::string& scaling_key)
+        : m_path(path), m_lock_path(std::filesystem::path(path) += ".lock") {
+    // Held until the file is indexed and open, so no other process appends meanwhile.
+    const FileLock lock(m_lock_path);
+    std::string header(kSignalCacheMagic, sizeof(kSignalCacheMagic));
+    append_value<uint32_t>(header, uint32_t(scaling_key.size()));
+    header.append(scaling_key);
+
+    std::error_code error;
+    const size_t file_size = std::filesystem::exists(path) ? std::filesystem::file_size(path) : 0;
+    size_t valid_size = 0;
+    if (file_size >= header.size()) {
+        map(file_size);
+        if (std::memcmp(m_data, header.data(), header.size()) == 0) {
+            valid_size = header.size();
+        } else {
+            // Another process may still be using it, so it isn't started afresh.
+            unmap();
+            spdlog::warn("The signal cache {} was written with different scaling, so isn't used",
+                         path.string());
+            return;
+        }
+    }
+
+    // Index the complete reads.
+    size_t offset = valid_size;
+    while (valid_size > 0) {
+        uint32_t read_id_length = 0;
+        if (!read_value(m_data, m_size, offset, read_id_length) ||
+            m_size - offset < read_id_length) {
+            break;
+        }
+        std::string read_id(m_data + offset, read_id_length);
+        offset += read_id_length;
+        Entry entry{};
+        if (!read_value(m_data, m_size, offset, entry.scaling.shift) ||
+            !read_value(m_data, m_size, offset, entry.scaling.scale) ||
+            !read_value(m_data, m_size, offset, entry.scaling.trim_start) ||
+            !read_value(m_data, m_size, offset, entry.num_samples) ||
+            (m_size - offset) / sizeof(c10::Half) < entry.num_samples) {
+            break;
+        }
+        entry.offset = offset;
+        offset += entry.num_samples * sizeof(c10::Half);
+        m_entries.emplace(std::move(read_id), entry);
+        valid_size = offset;
+    }
+
+    if (valid_size != file_size) {
+        // Drop whatever follows the last complete read, which only an interrupted run can leave
+        // since writers hold the lock until their read is written, or the whole file if it's
+        // too short to have a header.
+        unmap();
+        std::filesystem::resize_file(path, valid_size, error);
+        if (error) {
+            std::filesystem::remove(path);
+            m_entries.clear();
+            valid_size = 0;
+        }
+        if (valid_size > 0) {
+            map(valid_size);
+        }
+    }
+
+    m_output.open(path, std::ios::binary | std::ios::app);
+    if (!m_output) {
+        throw std::runtime_error("Unable to open signal cache " + path.string());
+    }
+    if (valid_size == 0) {
+        m_output.write(header.data(), header.size());
+        m_output.flush();
+    }
+    spdlog::info("> Signal cache {} has {} reads", path.string(), m_entries.size());
+}
+
+SignalCache::~SignalCache() { unmap(); }
+
+void SignalCache::map(size_t size) {
+#ifndef _WIN32
+    const int fd = open(m_path.string().c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Unable to open signal cache " + m_path.string());
+    }
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Unable to map signal cache " + m_path.string());
+    }
+    m_data = static_cast<const char*>(mapping);
+#else
+    m_buffer.resize(size);
+    std::ifstream stream(m_path, std::ios::binary);
+    if (!stream.read(m_buffer.data(), size)) {
+        throw std::runtime_error("Unable to read signal cache " + m_path.string());
+    }
+    m_data = m_buffer.data();
+#endif
+    m_size = size;
+}
+
+void SignalCache::unmap() {
+#ifndef _WIN32
+    if (m_data) {
+        munmap(const_cast<char*>(m_data), m_size);
+    }
+#else
+    m_buffer = {};
+#endif
+    m_data = nullptr;
+    m_size = 0;
+}
+
+bool SignalCache::load(const std::string& read_id,
+                       torch::Tensor& signal,
+                       SignalScaling& scaling) const {
+    const auto entry = m_entries.find(read_id);
+    if (entry == m_entries.end()) {
+        return false;
+    }
+    signal = TensorPool::instance().empty(entry->second.num_samples, torch::kFloat16);
+    std::memcpy(signal.data_ptr(), m_data + entry->second.offset,
+                entry->second.num_samples * sizeof(c10::Half));
+    scaling = entry->second.scaling;
+    return true;
+}
+
+void SignalCache::store(const std::string& read_id,
+                        const SignalScaling& scaling,
+                        const torch::Tensor& signal) {
+    if (!m_output.is_open() || m_entries.count(read_id) > 0) {
+        return;
+    }
+    const auto samples = signal.to(torch::kCPU, torch::kFloat16).contiguous();
+    std::string record;
+    append_value<uint32_t>(record, uint32_t(read_id.size()));
+    record.append(read_id);
+    append_value(record, scaling.shift);
+    append_value(record, scaling.scale);
+    append_value<int32_t>(record, scaling.trim_start);
+    append_value<uint64_t>(record, samples.numel());
+
+    std::lock_guard lock(m_output_mutex);
+    // The record goes out whole while the lock is held, appending at the end of the file as
+    // other processes left it.
+    const FileLock file_lock(m_lock_path);
+    m_output.write(record.data(), record.size());
+    m_output.write(static_cast<const char*>(samples.data_ptr()), samples.nbytes());
+    m_output.flush();
+    if (!m_output) {
+        spdlog::warn("Unable to write read {} to the signal cache {}", read_id, m_path.string());
+    }
+}
+
+}  // namespace dorado::utils
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "signal_utils.h"
+
+#include <torch/torch.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace dorado::utils {
+
+// A local cache of normalised float16 read signal, with the SignalScaling each read was
+// normalised with, so that repeat runs over the same data, e.g. with different models, skip
+// decompressing and normalising the reads.  Reads are appended to one file as they're
+// normalised, and those cached by earlier runs are copied out of a memory mapping of it.
+//
+// The file starts with kSignalCacheMagic and the scaling key, then each read is its read ID
+// length as a uint32, its read ID, its shift and scale as floats, trim_start as an int32, its
+// number of samples as a uint64 and the samples.  All values are in native byte order.  A
+// final read cut short by an interrupted run is dropped.  A file written with a different
+// scaling key is left alone, and not used.
+//
+// Several processes may share a cache: each takes a FileLock on the file with ".lock" appended
+// to its path while indexing it and while appending each read, so records never interleave.
+// Reads cached by another process after this one opened the cache aren't loaded.
+class SignalCache {
+public:
+    // scaling_key identifies how the signal is normalised, so that reads normalised any
+    // other way aren't reused.
+    SignalCache(const std::filesystem::path& path, const std::string& scaling_key);
+    ~SignalCache();
+
+    SignalCache(const SignalCache&) = delete;
+    SignalCache& operator=(const SignalCache&) = delete;
+
+    // Copies the signal of read_id, if an earlier run cached it, into a pooled float16
+    // tensor.  Returns false if it isn't cached.
+    bool load(const std::string& read_id, torch::Tensor& signal, SignalScaling& scaling) const;
+
+    // Appends a read's normalised float16 signal, untrimmed, unless it's cached already.
+    void store(const std::string& read_id,
+               const SignalScaling& scaling,
+               const torch::Tensor& signal);
+
+    // Reads cached by earlier runs.
+    size_t num_cached_reads() const { return m_entries.size(); }
+
+private:
+    struct Entry {
+        SignalScaling scaling;
+        // Where the samples start in the mapping.
+        size_t offset;
+        uint64_t num_samples;
+    };
+
+    // Maps the first size bytes of the file.
+    void map(size_t size);
+    void unmap();
+
+    const std::filesystem::path m_path;
+    const std::filesystem::path m_lock_path;
+    const char* m_data{nullptr};
+    size_t m_size{0};
+#ifdef _WIN32
+    std::vector<char> m_buffer;
+#endif
+    // The reads in the mapping.  Fixed once constructed, so lookups needn't lock.
+    std::unordered_map<std::string, Entry> m_entries;
+
+    std::mutex m_output_mutex;
+    // Not open if the file holds another scaling key's reads.
+    std::ofstream m_output;
+};
+
+}  // namespace dorado::utils
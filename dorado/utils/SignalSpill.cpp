@@ -0,0 +1,129 @@
+#include "SignalSpill.h"
+
+#include "TensorPool.h"
+
+#include <spdlog/spdlog.h>
+
+#include <iomanip>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+
+namespace dorado::utils {
+
+SignalSpill::SignalSpill(const std::filesystem::path& directory) {
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error) {
+        throw std::runtime_error("Could not create spill directory " + directory.string() + ": " +
+                                 error.message());
+    }
+    // Named at random, so that several processes can spill to the same directory.
+    std::random_device random;
+    do {
+        std::ostringstream name;
+        name << "dorado_signal_spill_" << std::hex << std::setfill('0') << std::setw(8)
+             << random() << ".tmp";
+        m_path = directory / name.str();
+    } while (std::filesystem::exists(m_path));
+
+    m_file.open(m_path, std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary);
+    if (!m_file) {
+        throw std::runtime_error("Could not create spill file " + m_path.string());
+    }
+}
+
+SignalSpill::~SignalSpill() {
+    m_file.close();
+    std::error_code error;
+    if (!std::filesystem::remove(m_path, error) && error) {
+        spdlog::warn("Could not remove spill file {}: {}", m_path.string(), error.message());
+    }
+}
+
+SignalSpill::Extent SignalSpill::spill(const torch::Tensor& signal) {
+    const auto contiguous = signal.contiguous();
+    const uint64_t num_bytes = contiguous.nbytes();
+    Extent extent{0, contiguous.numel(), contiguous.scalar_type()};
+    if (num_bytes == 0) {
+        return extent;
+    }
+
+    std::lock_guard lock(m_mutex);
+    extent.offset = allocate(num_bytes);
+    m_file.seekp(std::streamoff(extent.offset));
+    m_file.write(static_cast<const char*>(contiguous.data_ptr()), std::streamsize(num_bytes));
+    if (!m_file) {
+        m_file.clear();
+        free(extent.offset, num_bytes);
+        throw std::runtime_error("Could not write to spill file " + m_path.string());
+    }
+    m_spilled_bytes += num_bytes;
+    return extent;
+}
+
+torch::Tensor SignalSpill::restore(const Extent& extent) {
+    auto signal = TensorPool::instance().empty(extent.num_elements, extent.dtype);
+    const uint64_t num_bytes = signal.nbytes();
+    if (num_bytes == 0) {
+        return signal;
+    }
+
+    std::lock_guard lock(m_mutex);
+    m_file.seekg(std::streamoff(extent.offset));
+    m_file.read(static_cast<char*>(signal.data_ptr()), std::streamsize(num_bytes));
+    const bool failed = !m_file;
+    m_file.clear();
+    free(extent.offset, num_bytes);
+    m_spilled_bytes -= num_bytes;
+    if (failed) {
+        throw std::runtime_error("Could not read from spill file " + m_path.string());
+    }
+    return signal;
+}
+
+size_t SignalSpill::spilled_bytes() const {
+    std::lock_guard lock(m_mutex);
+    return m_spilled_bytes;
+}
+
+size_t SignalSpill::file_bytes() const {
+    std::lock_guard lock(m_mutex);
+    return m_file_bytes;
+}
+
+uint64_t SignalSpill::allocate(uint64_t num_bytes) {
+    for (auto it = m_free_extents.begin(); it != m_free_extents.end(); ++it) {
+        const auto [offset, size] = *it;
+        if (size >= num_bytes) {
+            m_free_extents.erase(it);
+            if (size > num_bytes) {
+                m_free_extents.emplace(offset + num_bytes, size - num_bytes);
+            }
+            return offset;
+        }
+    }
+    const auto offset = m_file_bytes;
+    m_file_bytes += num_bytes;
+    return offset;
+}
+
+void SignalSpill::free(uint64_t offset, uint64_t num_bytes) {
+    auto next = m_free_extents.lower_bound(offset);
+    if (next != m_free_extents.end() && offset + num_bytes == next->first) {
+        num_bytes += next->second;
+        next = m_free_extents.erase(next);
+    }
+    if (next != m_free_extents.begin()) {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == offset) {
+            previous->second += num_bytes;
+            return;
+        }
+    }
+    m_free_extents.emplace(offset, num_bytes);
+}
+
+}  // namespace dorado::utils
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <torch/torch.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+
+namespace dorado::utils {
+
+// A scratch file the signal of reads held for a long time, e.g. while they wait for a duplex
+// partner, is moved to, so that only where it went stays in memory.  Each signal is written to
+// the first free extent of the file it fits in, or appended, and its extent is freed once it's
+// read back, so the file only grows to the most signal spilled at any one time.  The file is
+// removed when the spill is destroyed.  Thread safe.
+class SignalSpill {
+public:
+    // Creates directory, if need be, and a file of its own in it.  Throws if either can't be
+    // made.
+    explicit SignalSpill(const std::filesystem::path& directory);
+    ~SignalSpill();
+
+    SignalSpill(const SignalSpill&) = delete;
+    SignalSpill& operator=(const SignalSpill&) = delete;
+
+    // Where a signal was spilled, and what it was.
+    struct Extent {
+        uint64_t offset;
+        int64_t num_elements;
+        torch::ScalarType dtype;
+    };
+
+    // Writes signal, a tensor on the host, to the file.  Throws if it can't be written.
+    Extent spill(const torch::Tensor& signal);
+    // Reads the signal at extent back into a pooled tensor, and frees the extent.  Throws if it
+    // can't be read.
+    torch::Tensor restore(const Extent& extent);
+
+    // The bytes of the signals spilled and not yet restored, and the size of the file.
+    size_t spilled_bytes() const;
+    size_t file_bytes() const;
+
+private:
+    // Takes num_bytes from the first free extent which has them, else from the end of the file.
+    // m_mutex must be held.
+    uint64_t allocate(uint64_t num_bytes);
+    // Frees num_bytes at offset, merging them with the free extents either side.  m_mutex must
+    // be held.
+    void free(uint64_t offset, uint64_t num_bytes);
+
+    std::filesystem::path m_path;
+    mutable std::mutex m_mutex;
+    std::fstream m_file;
+    uint64_t m_file_bytes{0};
+    size_t m_spilled_bytes{0};
+    // The free extents before the end of the file, by offset, to their sizes.  Adjacent ones
+    // are always merged.
+    std::map<uint64_t, uint64_t> m_free_extents;
+};
+
+}  // namespace dorado::utils
@@ -0,0 +1,156 @@
+#include "TensorPool.h"
+
+#include "thread_utils.h"
+
+#include <new>
+
+namespace {
+
+// Buffers are cache line aligned, which also satisfies any SIMD loads on them.
+constexpr std::align_val_t kBufferAlignment{64};
+// Smallest buffer handed out.  Smaller requests would gain little from pooling.
+constexpr size_t kMinBufferSize = 4096;
+
+void* allocate_aligned(size_t num_bytes) { return ::operator new(num_bytes, kBufferAlignment); }
+void free_aligned(void* buffer) { ::operator delete(buffer, kBufferAlignment); }
+
+}  // namespace
+
+namespace dorado::utils {
+
+TensorPool::TensorPool(size_t max_cached_bytes)
+        : m_max_cached_bytes(max_cached_bytes), m_allocator{allocate_aligned, free_aligned} {}
+
+TensorPool::~TensorPool() { shutdown(); }
+
+void TensorPool::set_allocator(BufferAllocator allocator) {
+    std::lock_guard lock(m_mutex);
+    drop_cached_buffers();
+    m_allocator = allocator;
+    m_shut_down = false;
+}
+
+void TensorPool::shutdown() {
+    std::thread free_thread;
+    {
+        std::lock_guard lock(m_mutex);
+        drop_cached_buffers();
+        m_allocator = {allocate_aligned, free_aligned};
+        m_shut_down = true;
+        m_stop_free_thread = true;
+        free_thread = std::move(m_free_thread);
+    }
+    m_free_cv.notify_one();
+    // The thread frees everything queued before it stops.
+    if (free_thread.joinable()) {
+        free_thread.join();
+    }
+    std::lock_guard lock(m_mutex);
+    m_stop_free_thread = false;
+}
+
+void TensorPool::drop_cached_buffers() {
+    for (auto& [capacity, buffers] : m_free_buffers) {
+        for (void* buffer : buffers) {
+            free_buffer(buffer, m_allocator.free);
+        }
+    }
+    m_free_buffers.clear();
+    m_cached_bytes = 0;
+}
+
+void TensorPool::free_buffer(void* buffer, void (*free)(void*)) {
+    if (free == free_aligned) {
+        free_aligned(buffer);
+        return;
+    }
+    if (m_shut_down) {
+        // The memory may belong to a device which has since been torn down.
+        return;
+    }
+    m_pending_frees.emplace_back(buffer, free);
+    if (!m_free_thread.joinable()) {
+        m_free_thread = std::thread(&TensorPool::free_thread, this);
+    }
+    m_free_cv.notify_one();
+}
+
+void TensorPool::free_thread() {
+    utils::set_thread_name("tensor_pool");
+    std::unique_lock lock(m_mutex);
+    while (true) {
+        m_free_cv.wait(lock, [this] { return !m_pending_frees.empty() || m_stop_free_thread; });
+        if (m_pending_frees.empty()) {
+            return;
+        }
+        auto pending_frees = std::move(m_pending_frees);
+        m_pending_frees.clear();
+        lock.unlock();
+        for (const auto& [buffer, free] : pending_frees) {
+            free(buffer);
+        }
+        lock.lock();
+    }
+}
+
+TensorPool& TensorPool::instance() {
+    // Enough for a few thousand typical reads to be recycled without a trip to the
+    // allocator.
+    static auto* pool = new TensorPool(size_t(1) << 30);
+    return *pool;
+}
+
+size_t TensorPool::size_class(size_t num_bytes) {
+    if (num_bytes <= kMinBufferSize) {
+        return kMinBufferSize;
+    }
+    // Round up to the next multiple of 1/8 of the largest power of two <= num_bytes.
+    size_t power_of_two = kMinBufferSize;
+    while (power_of_two <= num_bytes / 2) {
+        power_of_two *= 2;
+    }
+    const size_t step = power_of_two / 8;
+    return (num_bytes + step - 1) / step * step;
+}
+
+torch::Tensor TensorPool::empty(int64_t num_elements, torch::ScalarType dtype) {
+    const size_t capacity = size_class(num_elements * c10::elementSize(dtype));
+
+    void* buffer = nullptr;
+    BufferAllocator allocator;
+    {
+        std::lock_guard lock(m_mutex);
+        allocator = m_allocator;
+        auto it = m_free_buffers.find(capacity);
+        if (it != m_free_buffers.end() && !it->second.empty()) {
+            buffer = it->second.back();
+            it->second.pop_back();
+            m_cached_bytes -= capacity;
+        }
+    }
+    if (!buffer) {
+        buffer = allocator.allocate(capacity);
+    }
+
+    return torch::from_blob(
+            buffer, {num_elements},
+            [this, capacity, allocator](void* ptr) { release(ptr, capacity, allocator); },
+            torch::TensorOptions().dtype(dtype));
+}
+
+void TensorPool::release(void* buffer, size_t capacity, BufferAllocator allocator) {
+    std::lock_guard lock(m_mutex);
+    if (allocator.free == m_allocator.free && m_cached_bytes + capacity <= m_max_cached_bytes) {
+        m_free_buffers[capacity].push_back(buffer);
+        m_cached_bytes += capacity;
+        return;
+    }
+    free_buffer(buffer, allocator.free);
+}
+
+size_t TensorPool::cached_bytes() const {
+    std::lock_guard lock(m_mutex);
+    return m_cached_bytes;
+}
+
+}  // namespace dorado::utils
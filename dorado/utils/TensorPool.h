@@ -0,0 +1,87 @@
+#pragma once
+
+#include <torch/torch.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace dorado::utils {
+
+// Recycles the host memory backing short-lived CPU tensors, such as read signals.
+// Tensors are handed out as views of pooled buffers, and when the last tensor sharing
+// a buffer is destroyed the buffer goes back to the pool rather than to the system
+// allocator.  Buffers are rounded up to size classes spaced 1/8 of a power of two
+// apart, which bounds the wasted space at 12.5%.
+// Up to max_cached_bytes of free buffers are retained; beyond that they're released.
+// Buffers can be allocated pinned, so that copies of the tensors to a GPU go straight from
+// them, and pinning's high cost is only paid once for each buffer.
+// Buffers from an allocator other than the default are freed on a thread the pool owns, so
+// that a slow free such as cudaFreeHost never stalls the pipeline thread dropping a tensor.
+class TensorPool {
+public:
+    // How buffers are allocated and freed.  The default is aligned operator new.
+    struct BufferAllocator {
+        void* (*allocate)(size_t num_bytes);
+        void (*free)(void* buffer);
+    };
+
+    explicit TensorPool(size_t max_cached_bytes);
+    ~TensorPool();
+
+    TensorPool(const TensorPool&) = delete;
+    TensorPool& operator=(const TensorPool&) = delete;
+
+    // The process-wide pool.  It's never destroyed, since pooled tensors may outlive
+    // any static destruction order.
+    static TensorPool& instance();
+
+    // Returns an uninitialised, contiguous, 1D tensor.
+    torch::Tensor empty(int64_t num_elements, torch::ScalarType dtype);
+
+    // Allocates new buffers with allocator.  Cached buffers are released, and buffers still in
+    // use are freed with the allocator they came from rather than cached.
+    void set_allocator(BufferAllocator allocator);
+
+    // Frees the cached buffers and any waiting to be freed, and goes back to the default
+    // allocator.  Call it once the pipeline is destroyed, before the process exits, since a
+    // pinned buffer can't be freed once CUDA has been torn down.  Buffers still in use from
+    // another allocator are leaked when they're released later, for the same reason.
+    void shutdown();
+
+    // Bytes held in free buffers.
+    size_t cached_bytes() const;
+
+    // Exposed for testing.
+    static size_t size_class(size_t num_bytes);
+
+private:
+    void release(void* buffer, size_t capacity, BufferAllocator allocator);
+    // Frees the cached buffers.  m_mutex must be held.
+    void drop_cached_buffers();
+    // Frees buffer now if it came from the default allocator, else queues it for the free
+    // thread.  m_mutex must be held.
+    void free_buffer(void* buffer, void (*free)(void*));
+    void free_thread();
+
+    const size_t m_max_cached_bytes;
+    mutable std::mutex m_mutex;
+    BufferAllocator m_allocator;
+    // Free buffers, by capacity.
+    std::map<size_t, std::vector<void*>> m_free_buffers;
+    size_t m_cached_bytes{0};
+
+    // Buffers waiting for m_free_thread, with the function which frees them.
+    std::vector<std::pair<void*, void (*)(void*)>> m_pending_frees;
+    std::condition_variable m_free_cv;
+    std::thread m_free_thread;
+    bool m_stop_free_thread{false};
+    bool m_shut_down{false};
+};
+
+}  // namespace dorado::utils
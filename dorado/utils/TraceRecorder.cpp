@@ -0,0 +1,92 @@
+#include "TraceRecorder.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+namespace dorado::utils {
+
+TraceRecorder& TraceRecorder::instance() {
+    static auto* recorder = new TraceRecorder();
+    return *recorder;
+}
+
+void TraceRecorder::start(size_t events_per_thread) {
+    std::lock_guard lock(m_buffers_mutex);
+    m_enabled.store(false, std::memory_order_relaxed);
+    m_buffers.clear();
+    m_events_per_thread = std::max<size_t>(events_per_thread, 1);
+    m_start_time = Clock::now();
+    m_generation.fetch_add(1, std::memory_order_release);
+    m_enabled.store(true, std::memory_order_release);
+}
+
+void TraceRecorder::stop() { m_enabled.store(false, std::memory_order_relaxed); }
+
+TraceRecorder::ThreadBuffer& TraceRecorder::thread_buffer() {
+    thread_local std::shared_ptr<ThreadBuffer> buffer;
+    const size_t generation = m_generation.load(std::memory_order_acquire);
+    if (!buffer || buffer->generation != generation) {
+        std::lock_guard lock(m_buffers_mutex);
+        buffer = std::make_shared<ThreadBuffer>();
+        buffer->generation = generation;
+        buffer->thread_index = static_cast<int>(m_buffers.size());
+        buffer->events.resize(m_events_per_thread);
+        m_buffers.push_back(buffer);
+    }
+    return *buffer;
+}
+
+void TraceRecorder::record(const char* name, Clock::time_point start, Clock::time_point end) {
+    if (!enabled()) {
+        return;
+    }
+    auto& buffer = thread_buffer();
+    const size_t index = buffer.num_recorded.load(std::memory_order_relaxed);
+    auto& event = buffer.events[index % buffer.events.size()];
+    event.name = name;
+    event.start_ns =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(start - m_start_time).count();
+    event.duration_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    buffer.num_recorded.store(index + 1, std::memory_order_release);
+}
+
+void TraceRecorder::write_chrome_trace(std::ostream& out) const {
+    std::lock_guard lock(m_buffers_mutex);
+    const auto flags = out.flags();
+    const auto precision = out.precision();
+    // Timestamps are in microseconds, keeping the nanoseconds.
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    for (const auto& buffer : m_buffers) {
+        const size_t num_recorded = buffer->num_recorded.load(std::memory_order_acquire);
+        const size_t num_kept = std::min(num_recorded, buffer->events.size());
+        for (size_t i = num_recorded - num_kept; i < num_recorded; ++i) {
+            const auto& event = buffer->events[i % buffer->events.size()];
+            // Names are literals in the code, so need no escaping.
+            out << (first ? "\n" : ",\n") << "{\"name\":\"" << event.name
+                << "\",\"cat\":\"dorado\",\"ph\":\"X\",\"ts\":" << event.start_ns / 1000.0
+                << ",\"dur\":" << event.duration_ns / 1000.0
+                << ",\"pid\":1,\"tid\":" << buffer->thread_index << '}';
+            first = false;
+        }
+    }
+    out << "\n]}\n";
+    out.flags(flags);
+    out.precision(precision);
+}
+
+void TraceRecorder::write_chrome_trace(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out) {
+        throw std::runtime_error("Unable to open trace file " + path);
+    }
+    write_chrome_trace(out);
+    if (!out) {
+        throw std::runtime_error("Unable to write trace file " + path);
+    }
+}
+
+}  // namespace dorado::utils
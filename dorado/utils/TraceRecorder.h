@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace dorado::utils {
+
+// Records timestamped spans of pipeline work, e.g. forming a batch or writing records, for a
+// timeline of a run that can be loaded into chrome://tracing or Perfetto whatever the
+// device, unlike the NVTX ranges, which only Nsight shows on CUDA builds.
+// Each thread records into a ring buffer of its own, keeping its latest spans, so recording
+// takes no lock and allocates nothing.  While not recording, a span costs one relaxed load.
+class TraceRecorder {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t kDefaultEventsPerThread = 1 << 16;
+
+    // The process-wide recorder.  It's never destroyed, since threads may record until exit.
+    static TraceRecorder& instance();
+
+    // Starts recording, dropping anything recorded before.  Each thread keeps up to
+    // events_per_thread of its latest spans.
+    void start(size_t events_per_thread = kDefaultEventsPerThread);
+    void stop();
+    bool enabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+    // name must outlive the recorder, e.g. a string literal.
+    void record(const char* name, Clock::time_point start, Clock::time_point end);
+
+    // Writes the spans recorded so far as Chrome trace event JSON.  Threads which are still
+    // recording may overwrite their oldest spans as they're written, so this is best done
+    // once the pipeline has finished.
+    void write_chrome_trace(std::ostream& out) const;
+    // Throws if path can't be written.
+    void write_chrome_trace(const std::string& path) const;
+
+private:
+    struct Event {
+        const char* name;
+        int64_t start_ns;
+        int64_t duration_ns;
+    };
+
+    struct ThreadBuffer {
+        size_t generation;
+        int thread_index;
+        std::vector<Event> events;
+        // Spans recorded, which may be more than there is room for.  Only the owning thread
+        // adds to it.
+        std::atomic<size_t> num_recorded{0};
+    };
+
+    TraceRecorder() = default;
+    // The calling thread's buffer for the current recording, made on its first span.
+    ThreadBuffer& thread_buffer();
+
+    std::atomic<bool> m_enabled{false};
+    // Bumped by every start(), so threads know to start new buffers.
+    std::atomic<size_t> m_generation{0};
+    size_t m_events_per_thread{kDefaultEventsPerThread};
+    Clock::time_point m_start_time;
+
+    mutable std::mutex m_buffers_mutex;
+    std::vector<std::shared_ptr<ThreadBuffer>> m_buffers;
+};
+
+// Records the span of its lifetime, if the recorder is recording when it's made.
+class TraceSpan {
+public:
+    // name must outlive the recorder, e.g. a string literal.
+    explicit TraceSpan(const char* name)
+            : m_name(name), m_recording(TraceRecorder::instance().enabled()) {
+        if (m_recording) {
+            m_start = TraceRecorder::Clock::now();
+        }
+    }
+    ~TraceSpan() {
+        if (m_recording) {
+            TraceRecorder::instance().record(m_name, m_start, TraceRecorder::Clock::now());
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* m_name;
+    bool m_recording;
+    TraceRecorder::Clock::time_point m_start;
+};
+
+}  // namespace dorado::utils
@@ -0,0 +1,178 @@
+#include "WorkStealingExecutor.h"
+
+#include "thread_utils.h"
+
+#include <algorithm>
+
+namespace {
+
+// Identifies the executor and worker, if any, that the current thread belongs to,
+// so that tasks submitted from within a task stay on the submitting worker.
+thread_local const dorado::utils::WorkStealingExecutor* t_executor = nullptr;
+thread_local size_t t_worker_index = 0;
+
+}  // namespace
+
+namespace dorado::utils {
+
+WorkStealingExecutor::WorkStealingExecutor(size_t num_threads, std::string name)
+        : m_name(std::move(name)) {
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < num_threads; ++i) {
+        m_workers.push_back(std::make_unique<Worker>());
+    }
+    // Spin up the threads last, once all the worker state exists for them to steal from.
+    for (size_t i = 0; i < num_threads; ++i) {
+        m_workers[i]->thread = std::thread([this, i] { worker_thread(i); });
+    }
+}
+
+WorkStealingExecutor::~WorkStealingExecutor() {
+    {
+        std::lock_guard lock(m_sleep_mutex);
+        m_stop = true;
+    }
+    m_sleep_cv.notify_all();
+    for (auto& worker : m_workers) {
+        worker->thread.join();
+    }
+}
+
+WorkStealingExecutor& WorkStealingExecutor::instance() {
+    static WorkStealingExecutor executor;
+    return executor;
+}
+
+void WorkStealingExecutor::submit(Task task) {
+    const size_t worker_index = (t_executor == this)
+                                        ? t_worker_index
+                                        : m_next_worker.fetch_add(1) % m_workers.size();
+    {
+        // Count the task before it becomes visible, so the count never underflows when a
+        // worker takes it straight away.  Incrementing under the sleep mutex ensures a
+        // worker that's about to sleep sees it.
+        std::lock_guard lock(m_sleep_mutex);
+        ++m_num_pending;
+    }
+    {
+        std::lock_guard lock(m_workers[worker_index]->mutex);
+        m_workers[worker_index]->tasks.push_back(std::move(task));
+    }
+    m_sleep_cv.notify_one();
+}
+
+bool WorkStealingExecutor::pop_local(size_t worker_index, Task& task) {
+    auto& worker = *m_workers[worker_index];
+    std::lock_guard lock(worker.mutex);
+    if (worker.tasks.empty()) {
+        return false;
+    }
+    // Newest first, since its data is most likely to still be in cache.
+    task = std::move(worker.tasks.back());
+    worker.tasks.pop_back();
+    return true;
+}
+
+bool WorkStealingExecutor::steal(size_t thief_index, Task& task) {
+    const size_t num_workers = m_workers.size();
+    for (size_t offset = 1; offset < num_workers; ++offset) {
+        auto& victim = *m_workers[(thief_index + offset) % num_workers];
+        std::lock_guard lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            // Oldest first, to keep clear of the victim's end of the deque.
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingExecutor::worker_thread(size_t worker_index) {
+    set_thread_name(m_name + "_" + std::to_string(worker_index));
+    t_executor = this;
+    t_worker_index = worker_index;
+
+    Task task;
+    while (true) {
+        if (pop_local(worker_index, task) || steal(worker_index, task)) {
+            --m_num_pending;
+            task();
+            task = nullptr;
+            continue;
+        }
+
+        std::unique_lock lock(m_sleep_mutex);
+        m_sleep_cv.wait(lock, [this] { return m_num_pending.load() > 0 || m_stop; });
+        // Pending tasks are run to completion before stopping.
+        if (m_stop && m_num_pending.load() == 0) {
+            break;
+        }
+    }
+}
+
+TaskQueue::TaskQueue(WorkStealingExecutor& executor, size_t max_concurrency)
+        : m_executor(executor), m_max_concurrency(std::max<size_t>(max_concurrency, 1)) {}
+
+TaskQueue::~TaskQueue() {
+    std::unique_lock lock(m_mutex);
+    m_cv.wait(lock, [this] { return m_num_in_flight == 0; });
+}
+
+void TaskQueue::push(std::function<void()> task) {
+    {
+        std::unique_lock lock(m_mutex);
+        m_cv.wait(lock, [this] { return m_num_in_flight < m_max_concurrency; });
+        ++m_num_in_flight;
+    }
+    m_executor.submit([this, task = std::move(task)] {
+        std::exception_ptr error;
+        try {
+            task();
+        } catch (...) {
+            error = std::current_exception();
+        }
+        on_task_complete(error);
+    });
+}
+
+void TaskQueue::on_task_complete(std::exception_ptr error) {
+    std::lock_guard lock(m_mutex);
+    --m_num_in_flight;
+    if (error && !m_first_error) {
+        m_first_error = error;
+    }
+    // Both pushers waiting for a slot and wait() callers may be blocked.
+    // Notify while holding the lock: once it's released the destructor may run.
+    m_cv.notify_all();
+}
+
+void TaskQueue::wait() {
+    std::unique_lock lock(m_mutex);
+    m_cv.wait(lock, [this] { return m_num_in_flight == 0; });
+    if (m_first_error) {
+        std::rethrow_exception(std::exchange(m_first_error, nullptr));
+    }
+}
+
+void TaskQueue::set_max_concurrency(size_t max_concurrency) {
+    {
+        std::lock_guard lock(m_mutex);
+        m_max_concurrency = std::max<size_t>(max_concurrency, 1);
+    }
+    m_cv.notify_all();
+}
+
+size_t TaskQueue::max_concurrency() const {
+    std::lock_guard lock(m_mutex);
+    return m_max_concurrency;
+}
+
+size_t TaskQueue::num_in_flight() const {
+    std::lock_guard lock(m_mutex);
+    return m_num_in_flight;
+}
+
+}  // namespace dorado::utils
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace dorado::utils {
+
+// Fixed set of worker threads shared by every pipeline node.
+// Each worker owns a deque of tasks: it runs its own tasks newest first, and when it
+// runs out it steals the oldest tasks from other workers.  Tasks submitted from
+// outside the executor are spread across the workers.
+// Nodes should not submit to the executor directly, but via a TaskQueue, which bounds
+// how many of the shared threads a single node can occupy.
+class WorkStealingExecutor {
+public:
+    using Task = std::function<void()>;
+
+    // num_threads == 0 means one thread per hardware thread.  The workers are named after
+    // name and their index, so that profilers can tell one executor's threads from another's.
+    explicit WorkStealingExecutor(size_t num_threads = 0, std::string name = "executor");
+    // Runs any remaining tasks to completion before joining the workers.
+    ~WorkStealingExecutor();
+
+    WorkStealingExecutor(const WorkStealingExecutor&) = delete;
+    WorkStealingExecutor& operator=(const WorkStealingExecutor&) = delete;
+
+    // The process-wide executor used by pipeline nodes.
+    static WorkStealingExecutor& instance();
+
+    void submit(Task task);
+
+    size_t num_threads() const { return m_workers.size(); }
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+    };
+
+    void worker_thread(size_t worker_index);
+    bool pop_local(size_t worker_index, Task& task);
+    bool steal(size_t thief_index, Task& task);
+
+    const std::string m_name;
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    // Round robin target for tasks submitted from outside the executor.
+    std::atomic<size_t> m_next_worker{0};
+
+    // Tasks submitted but not yet started.  Idle workers sleep while this is zero.
+    std::atomic<size_t> m_num_pending{0};
+    std::mutex m_sleep_mutex;
+    std::condition_variable m_sleep_cv;
+    bool m_stop{false};
+};
+
+// A node's handle on a WorkStealingExecutor.
+// At most max_concurrency tasks from the queue are in flight at once: push() blocks
+// until a slot is free, which also provides backpressure to the node's input.
+// The limit can be changed while tasks are running.
+class TaskQueue {
+public:
+    TaskQueue(WorkStealingExecutor& executor, size_t max_concurrency);
+    // Waits for all tasks in flight.
+    ~TaskQueue();
+
+    TaskQueue(const TaskQueue&) = delete;
+    TaskQueue& operator=(const TaskQueue&) = delete;
+
+    // Fire-and-forget submission.  If the task throws, the first exception is rethrown
+    // from wait().
+    void push(std::function<void()> task);
+
+    // Submission whose result, or exception, is returned via the future.
+    template <typename F>
+    auto async(F&& f) -> std::future<std::invoke_result_t<F>> {
+        using Result = std::invoke_result_t<F>;
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(f));
+        auto future = task->get_future();
+        push([task] { (*task)(); });
+        return future;
+    }
+
+    // Blocks until every task pushed so far has completed.
+    void wait();
+
+    void set_max_concurrency(size_t max_concurrency);
+    size_t max_concurrency() const;
+    size_t num_in_flight() const;
+
+private:
+    void on_task_complete(std::exception_ptr error);
+
+    WorkStealingExecutor& m_executor;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    size_t m_max_concurrency;
+    size_t m_num_in_flight{0};
+    std::exception_ptr m_first_error;
+};
+
+}  // namespace dorado::utils
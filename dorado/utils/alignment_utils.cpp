@@ -1,6 +1,10 @@
 #include "alignment_utils.h"
 
+#include <algorithm>
+#include <cmath>
+#include <deque>
 #include <sstream>
+#include <utility>
 
 namespace dorado::utils {
 
@@ -48,4 +52,134 @@ std::string alignment_to_str(const char* query,
     return ss.str();
 }
 
+EdlibAlignResult align_within_error_rate(std::string_view query,
+                                         std::string_view target,
+                                         float max_error_rate) {
+    const size_t total_length = query.size() + target.size();
+    const int max_edit_distance = static_cast<int>(std::ceil(max_error_rate * total_length));
+
+    const size_t length_difference = std::max(query.size(), target.size()) -
+                                     std::min(query.size(), target.size());
+    if (query.empty() || target.empty() || length_difference > size_t(max_edit_distance)) {
+        EdlibAlignResult result{};
+        result.status = EDLIB_STATUS_OK;
+        result.editDistance = -1;
+        return result;
+    }
+
+    // Edlib's time and memory grow with k, and most pairs are much closer than the bound, so k
+    // starts small and is doubled until there's an alignment or the bound is reached.
+    constexpr int kInitialEditDistance = 64;
+    EdlibAlignConfig align_config = edlibDefaultAlignConfig();
+    align_config.task = EDLIB_TASK_PATH;
+    align_config.k =
+            std::min(max_edit_distance, std::max(kInitialEditDistance, int(length_difference)));
+    while (true) {
+        auto result = edlibAlign(query.data(), int(query.size()), target.data(),
+                                 int(target.size()), align_config);
+        if (result.status != EDLIB_STATUS_OK || result.editDistance >= 0 ||
+            align_config.k >= max_edit_distance) {
+            return result;
+        }
+        edlibFreeAlignResult(result);
+        align_config.k = std::min(max_edit_distance, 2 * align_config.k);
+    }
+}
+
+std::vector<uint64_t> minimizer_sketch(std::string_view sequence, int kmer_length, int window) {
+    // Thomas Wang's invertible integer hash, as minimap2 uses, so that low complexity k-mers such
+    // as poly-A aren't the least of every window they're in.
+    const uint64_t mask = (uint64_t(1) << (2 * kmer_length)) - 1;
+    const auto hash = [mask](uint64_t key) {
+        key = (~key + (key << 21)) & mask;
+        key = key ^ key >> 24;
+        key = ((key + (key << 3)) + (key << 8)) & mask;
+        key = key ^ key >> 14;
+        key = ((key + (key << 2)) + (key << 4)) & mask;
+        key = key ^ key >> 28;
+        key = (key + (key << 31)) & mask;
+        return key;
+    };
+
+    std::vector<uint64_t> minimizers;
+    if (sequence.size() < size_t(kmer_length)) {
+        return minimizers;
+    }
+    minimizers.reserve(2 * sequence.size() / (window + 1) + 1);
+
+    // The hashes, with their k-mer's index, which may yet be the least of a window: increasing
+    // from the front, which is the least of the current window.
+    std::deque<std::pair<uint64_t, int64_t>> candidates;
+    uint64_t kmer = 0;
+    int valid_bases = 0;  // Since the last base which isn't ACGT.
+    int64_t kmer_index = 0;
+    for (const char base : sequence) {
+        int code;
+        switch (base) {
+        case 'A':
+            code = 0;
+            break;
+        case 'C':
+            code = 1;
+            break;
+        case 'G':
+            code = 2;
+            break;
+        case 'T':
+            code = 3;
+            break;
+        default:
+            // The windows start again after it.
+            valid_bases = 0;
+            candidates.clear();
+            continue;
+        }
+        kmer = ((kmer << 2) | uint64_t(code)) & mask;
+        if (++valid_bases < kmer_length) {
+            continue;
+        }
+
+        const uint64_t kmer_hash = hash(kmer);
+        while (!candidates.empty() && candidates.back().first >= kmer_hash) {
+            candidates.pop_back();
+        }
+        candidates.emplace_back(kmer_hash, kmer_index);
+        if (candidates.front().second <= kmer_index - window) {
+            candidates.pop_front();
+        }
+        // Once the first window is full, each k-mer completes one.
+        if (valid_bases >= kmer_length + window - 1 &&
+            (minimizers.empty() || minimizers.back() != candidates.front().first)) {
+            minimizers.push_back(candidates.front().first);
+        }
+        ++kmer_index;
+    }
+
+    std::sort(minimizers.begin(), minimizers.end());
+    minimizers.erase(std::unique(minimizers.begin(), minimizers.end()), minimizers.end());
+    return minimizers;
+}
+
+float sketch_similarity(const std::vector<uint64_t>& sketch1,
+                        const std::vector<uint64_t>& sketch2) {
+    if (sketch1.empty() || sketch2.empty()) {
+        return 0.f;
+    }
+    size_t num_shared = 0;
+    auto it1 = sketch1.begin();
+    auto it2 = sketch2.begin();
+    while (it1 != sketch1.end() && it2 != sketch2.end()) {
+        if (*it1 < *it2) {
+            ++it1;
+        } else if (*it2 < *it1) {
+            ++it2;
+        } else {
+            ++num_shared;
+            ++it1;
+            ++it2;
+        }
+    }
+    return float(num_shared) / float(std::min(sketch1.size(), sketch2.size()));
+}
+
 }  // namespace dorado::utils
@@ -2,7 +2,10 @@
 
 #include "edlib.h"
 
+#include <cstdint>
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace dorado::utils {
 
@@ -27,4 +30,47 @@ namespace dorado::utils {
 
 std::string alignment_to_str(const char* query, const char* target, const EdlibAlignResult& result);
 
+/// The most edit distance, as a fraction of both sequences' length, of template and complement
+/// pairs good enough for duplex consensus.
+constexpr float kMaxDuplexAlignmentErrorRate = 0.2f;
+
+/**
+ * @brief Globally aligns `query` to `target`, with its path, if they're close enough.
+ *
+ * A global alignment is at most as long as both sequences together, so edlib is bounded to an
+ * edit distance of `max_error_rate` of that.  It starts with a much smaller bound, which is
+ * doubled until the sequences align, so its band, and so its time and memory, is about what
+ * the pair needs.  Pairs worse than `max_error_rate`, or whose lengths alone put them out of
+ * reach, are given up on.
+ *
+ * @return The alignment, with an editDistance of -1 if there is none within the bound.  Free it
+ *         with edlibFreeAlignResult.
+ */
+EdlibAlignResult align_within_error_rate(std::string_view query,
+                                         std::string_view target,
+                                         float max_error_rate);
+
+/**
+ * @brief The minimizers of `sequence`: the least hash of every `window` consecutive k-mers, in
+ * order and without repeats.
+ *
+ * K-mers with anything but ACGT in them are skipped.  Sequences which share much of their
+ * length share many minimizers, and unrelated ones next to none, so sketches tell whether two
+ * sequences are worth aligning in time linear in their length.
+ */
+std::vector<uint64_t> minimizer_sketch(std::string_view sequence,
+                                       int kmer_length = 12,
+                                       int window = 8);
+
+/// The fraction of the smaller sketch's minimizers which are in the other too, or 0 if either
+/// is empty.
+float sketch_similarity(const std::vector<uint64_t>& sketch1,
+                        const std::vector<uint64_t>& sketch2);
+
+/// The least sketch_similarity, with the default k-mer length and window, of a template and the
+/// reverse complement of its complement.  At kMaxDuplexAlignmentErrorRate about 7% of 12-mers
+/// survive, and unrelated reads of 20kb share about 0.1% of their minimizers by chance, so this
+/// rules out non-pairs while keeping any pair which could align.
+constexpr float kMinDuplexSketchSimilarity = 0.02f;
+
 }  // namespace dorado::utils
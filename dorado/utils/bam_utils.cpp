@@ -2,6 +2,7 @@
 
 #include "Version.h"
 #include "htslib/bgzf.h"
+#include "htslib/hfile.h"
 #include "htslib/kroundup.h"
 #include "htslib/sam.h"
 #include "minimap.h"
@@ -9,22 +10,296 @@
 //Ask lh3 t  make some of these funcs publicly available?
 #include "mmpriv.h"
 #include "read_pipeline/ReadPipeline.h"
+#include "utils/MetricsServer.h"
+#include "utils/ProgressReporter.h"
+#include "utils/TraceRecorder.h"
 #include "utils/sequence_utils.h"
+#include "utils/thread_utils.h"
 #include "utils/types.h"
 
 #include <indicators/progress_bar.hpp>
+#include <openssl/sha.h>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iomanip>
 #include <iostream>
+#include <limits>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <regex>
 #include <set>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <tuple>
 #include <unordered_set>
 #include <vector>
+#ifdef _WIN32
+#include <io.h>
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
 
 namespace dorado::utils {
 
+MinimapIndex::~MinimapIndex() {
+    for (auto part : parts) {
+        mm_idx_destroy(part);
+    }
+}
+
+namespace {
+
+using MinimapIndexPtr = std::shared_ptr<const MinimapIndex>;
+
+std::mutex index_cache_mutex;
+std::filesystem::path index_cache_directory;
+// The indexes loaded, or being loaded, by their reference and indexing options.
+struct LoadedIndex {
+    std::weak_ptr<const MinimapIndex> index;
+    // Set while the index is being loaded.
+    std::shared_future<MinimapIndexPtr> pending;
+};
+std::map<std::string, LoadedIndex> loaded_indexes;
+
+std::string index_key(const std::string& filename, const mm_idxopt_t& idx_opt) {
+    return filename + ":" + std::to_string(idx_opt.k) + ":" + std::to_string(idx_opt.w) + ":" +
+           std::to_string(idx_opt.batch_size);
+}
+
+// The first half of the SHA-256 of the file's contents, in hex.
+std::string file_checksum(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Could not open reference: " + path.string());
+    }
+    SHA256_CTX sha256;
+    SHA256_Init(&sha256);
+    std::vector<char> buffer(1 << 20);
+    while (file.read(buffer.data(), buffer.size()) || file.gcount() > 0) {
+        SHA256_Update(&sha256, buffer.data(), size_t(file.gcount()));
+    }
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+    SHA256_Final(hash, &sha256);
+    std::ostringstream hex;
+    for (int i = 0; i < SHA256_DIGEST_LENGTH / 2; ++i) {
+        hex << std::hex << std::setw(2) << std::setfill('0') << int(hash[i]);
+    }
+    return hex.str();
+}
+
+// Where the index of a FASTA reference is cached, or an empty path if it isn't.
+std::filesystem::path cached_index_path(const std::string& filename, const mm_idxopt_t& idx_opt) {
+    std::filesystem::path directory;
+    {
+        std::lock_guard<std::mutex> lock(index_cache_mutex);
+        directory = index_cache_directory;
+    }
+    if (directory.empty() || mm_idx_is_idx(filename.c_str()) != 0) {
+        return {};
+    }
+    spdlog::debug("> Checksumming {} to look for its cached index", filename);
+    return directory / (file_checksum(filename) + "-k" + std::to_string(idx_opt.k) + "-w" +
+                        std::to_string(idx_opt.w) + "-I" + std::to_string(idx_opt.batch_size) +
+                        ".mmi");
+}
+
+// Reads every part of the index for filename, from the cache if it has been built before, and
+// otherwise building it and writing it to the cache.
+MinimapIndexPtr read_minimap_index(const std::string& filename,
+                                   const mm_idxopt_t& idx_opt,
+                                   int threads) {
+    std::string source = filename;
+    std::filesystem::path dump_path, cache_path = cached_index_path(filename, idx_opt);
+    if (!cache_path.empty()) {
+        std::error_code error;
+        if (std::filesystem::exists(cache_path, error)) {
+            spdlog::info("> Loading the cached index of {} from {}", filename,
+                         cache_path.string());
+            source = cache_path.string();
+            cache_path.clear();
+        } else if (std::filesystem::create_directories(cache_path.parent_path(), error);
+                   error) {
+            spdlog::warn("Unable to cache the index of {} in {}: {}", filename,
+                         cache_path.parent_path().string(), error.message());
+            cache_path.clear();
+        } else {
+            // Written under another name until it's complete, so that no run loads part of it.
+            dump_path = cache_path;
+            dump_path += ".tmp." + std::to_string(getpid());
+        }
+    }
+
+    auto index = std::make_shared<MinimapIndex>();
+    mm_idx_reader_t* reader = mm_idx_reader_open(
+            source.c_str(), &idx_opt, dump_path.empty() ? nullptr : dump_path.string().c_str());
+    if (!reader && !dump_path.empty()) {
+        spdlog::warn("Unable to write the index of {} to {}", filename, dump_path.string());
+        dump_path.clear();
+        reader = mm_idx_reader_open(source.c_str(), &idx_opt, nullptr);
+    }
+    if (!reader) {
+        throw std::runtime_error("Could not open reference: " + filename);
+    }
+    int32_t num_targets = 0;
+    while (mm_idx_t* part = mm_idx_reader_read(reader, threads)) {
+        index->parts.push_back(part);
+        index->tid_offsets.push_back(num_targets);
+        num_targets += part->n_seq;
+    }
+    mm_idx_reader_close(reader);
+    if (index->parts.empty()) {
+        if (!dump_path.empty()) {
+            std::filesystem::remove(dump_path);
+        }
+        throw std::runtime_error("No reference sequences found in " + filename);
+    }
+    if (!dump_path.empty()) {
+        std::error_code error;
+        std::filesystem::rename(dump_path, cache_path, error);
+        if (error) {
+            std::filesystem::remove(dump_path, error);
+        } else {
+            spdlog::info("> Cached the index of {} in {}", filename, cache_path.string());
+        }
+    }
+    if (index->parts.size() > 1) {
+        spdlog::info("> Reference split into {} index parts, each read is aligned to all of them.",
+                     index->parts.size());
+    }
+    return index;
+}
+
+// Starts loading the index for filename on its own thread, unless it's already loaded or
+// being loaded.  index_cache_mutex must be held.
+void start_loading_index(LoadedIndex& loaded,
+                         const std::string& filename,
+                         const mm_idxopt_t& idx_opt,
+                         int threads) {
+    if (loaded.pending.valid() || !loaded.index.expired()) {
+        return;
+    }
+    // Detached, rather than std::async, so that exiting doesn't wait for an index nothing
+    // picked up.
+    std::promise<MinimapIndexPtr> promise;
+    loaded.pending = promise.get_future().share();
+    std::thread([promise = std::move(promise), filename, idx_opt, threads]() mutable {
+        set_thread_name("index_loader");
+        try {
+            promise.set_value(read_minimap_index(filename, idx_opt, threads));
+        } catch (...) {
+            promise.set_exception(std::current_exception());
+        }
+    }).detach();
+}
+
+// Loads every part of the index for filename, or reuses the one already loaded, or being
+// loaded, with the same options, e.g. for another input in server mode.
+MinimapIndexPtr load_minimap_index(const std::string& filename,
+                                   const mm_idxopt_t& idx_opt,
+                                   int threads) {
+    const auto key = index_key(filename, idx_opt);
+    std::shared_future<MinimapIndexPtr> pending;
+    {
+        std::lock_guard<std::mutex> lock(index_cache_mutex);
+        auto& loaded = loaded_indexes[key];
+        if (auto index = loaded.index.lock()) {
+            spdlog::debug("> Reusing loaded index for {}", filename);
+            return index;
+        }
+        start_loading_index(loaded, filename, idx_opt, threads);
+        pending = loaded.pending;
+    }
+
+    MinimapIndexPtr index;
+    try {
+        index = pending.get();
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(index_cache_mutex);
+        loaded_indexes[key].pending = {};
+        throw;
+    }
+    std::lock_guard<std::mutex> lock(index_cache_mutex);
+    auto& loaded = loaded_indexes[key];
+    loaded.index = index;
+    // So that the index is freed once the last aligner using it is.
+    loaded.pending = {};
+    return index;
+}
+
+// The map-ont options, with the given indexing parameters.
+void set_minimap_options(int k,
+                         int w,
+                         uint64_t index_batch_size,
+                         mm_idxopt_t& idx_opt,
+                         mm_mapopt_t& map_opt) {
+    mm_set_opt(0, &idx_opt, &map_opt);
+    // Setting options to map-ont default till relevant args are exposed.
+    mm_set_opt("map-ont", &idx_opt, &map_opt);
+
+    idx_opt.k = k;
+    idx_opt.w = w;
+
+    // Set batch sizes large enough to not require chunking since that's
+    // not supported yet.
+    idx_opt.batch_size = index_batch_size;
+    idx_opt.mini_batch_size = index_batch_size;
+
+    // Force cigar generation.
+    map_opt.flag |= MM_F_CIGAR;
+
+    mm_check_opt(&idx_opt, &map_opt);
+}
+
+void add_writer_metrics(MetricsRegistry& registry,
+                        const std::atomic<size_t>& num_records_written,
+                        const std::atomic<size_t>& num_bytes_written) {
+    using Type = MetricsRegistry::Type;
+    registry.add("dorado_writer_records_total", "Records written.", Type::COUNTER,
+                 [&num_records_written] { return num_records_written.load(); });
+    registry.add("dorado_writer_bytes_total", "Bytes of the records written, uncompressed.",
+                 Type::COUNTER, [&num_bytes_written] { return num_bytes_written.load(); });
+}
+
+}  // namespace
+
+void set_minimap_index_cache(const std::filesystem::path& directory) {
+    std::lock_guard<std::mutex> lock(index_cache_mutex);
+    index_cache_directory = directory;
+}
+
+void preload_minimap_index(const std::string& filename,
+                           int k,
+                           int w,
+                           uint64_t index_batch_size,
+                           int threads) {
+    mm_idxopt_t idx_opt;
+    mm_mapopt_t map_opt;
+    set_minimap_options(k, w, index_batch_size, idx_opt, map_opt);
+    std::lock_guard<std::mutex> lock(index_cache_mutex);
+    start_loading_index(loaded_indexes[index_key(filename, idx_opt)], filename, idx_opt, threads);
+}
+
+std::shared_ptr<const MinimapIndex> hold_minimap_index(const std::string& filename,
+                                                       int k,
+                                                       int w,
+                                                       uint64_t index_batch_size,
+                                                       int threads) {
+    mm_idxopt_t idx_opt;
+    mm_mapopt_t map_opt;
+    set_minimap_options(k, w, index_batch_size, idx_opt, map_opt);
+    return load_minimap_index(filename, idx_opt, threads);
+}
+
 Aligner::Aligner(MessageSink& sink,
                  const std::string& filename,
                  int k,
@@ -32,44 +307,26 @@ Aligner::Aligner(MessageSink& sink,
                  uint64_t index_batch_size,
                  int threads)
         : MessageSink(10000), m_sink(sink), m_threads(threads) {
-    // Initialize option structs.
-    mm_set_opt(0, &m_idx_opt, &m_map_opt);
-    // Setting options to map-ont default till relevant args are exposed.
-    mm_set_opt("map-ont", &m_idx_opt, &m_map_opt);
-
-    m_idx_opt.k = k;
-    m_idx_opt.w = w;
+    mm_mapopt_t map_opt;
+    set_minimap_options(k, w, index_batch_size, m_idx_opt, map_opt);
     spdlog::info("> Index parameters input by user: kmer size={} and window size={}.", m_idx_opt.k,
                  m_idx_opt.w);
 
-    // Set batch sizes large enough to not require chunking since that's
-    // not supported yet.
-    m_idx_opt.batch_size = index_batch_size;
-    m_idx_opt.mini_batch_size = index_batch_size;
-
-    // Force cigar generation.
-    m_map_opt.flag |= MM_F_CIGAR;
-
-    mm_check_opt(&m_idx_opt, &m_map_opt);
-
-    m_index_reader = mm_idx_reader_open(filename.c_str(), &m_idx_opt, 0);
-    m_index = mm_idx_reader_read(m_index_reader, m_threads);
-    if (mm_idx_reader_read(m_index_reader, m_threads) != nullptr) {
-        throw std::runtime_error(
-                "Dorado doesn't support split index for alignment. Please re-run with larger index "
-                "size.");
+    m_index = load_minimap_index(filename, m_idx_opt, m_threads);
+    for (auto part : m_index->parts) {
+        m_map_opts.push_back(map_opt);
+        mm_mapopt_update(&m_map_opts.back(), part);
+        if (mm_verbose >= 3) {
+            mm_idx_stat(part);
+        }
     }
-    mm_mapopt_update(&m_map_opt, m_index);
 
-    if (m_index->k != m_idx_opt.k || m_index->w != m_idx_opt.w) {
+    const auto first_part = m_index->parts.front();
+    if (first_part->k != m_idx_opt.k || first_part->w != m_idx_opt.w) {
         spdlog::warn(
                 "Indexing parameters mismatch prebuilt index: using paramateres kmer "
                 "size={} and window size={} from prebuilt index.",
-                m_index->k, m_index->w);
-    }
-
-    if (mm_verbose >= 3) {
-        mm_idx_stat(m_index);
+                first_part->k, first_part->w);
     }
 
     for (int i = 0; i < m_threads; i++) {
@@ -90,29 +347,79 @@ Aligner::~Aligner() {
     for (int i = 0; i < m_threads; i++) {
         mm_tbuf_destroy(m_tbufs[i]);
     }
-    mm_idx_reader_close(m_index_reader);
-    mm_idx_destroy(m_index);
     // Adding for thread safety in case worker thread throws exception.
     m_sink.terminate();
 }
 
 std::vector<std::pair<char*, uint32_t>> Aligner::get_sequence_records_for_header() {
     std::vector<std::pair<char*, uint32_t>> records;
-    for (int i = 0; i < m_index->n_seq; ++i) {
-        records.push_back(std::make_pair(m_index->seq[i].name, m_index->seq[i].len));
+    for (auto part : m_index->parts) {
+        for (uint32_t i = 0; i < part->n_seq; ++i) {
+            records.push_back(std::make_pair(part->seq[i].name, part->seq[i].len));
+        }
     }
     return records;
 }
 
+std::shared_ptr<Aligner::SharedBatch> Aligner::next_shared_batch() {
+    std::lock_guard<std::mutex> lock(m_batches_mutex);
+    while (!m_batches.empty()) {
+        auto batch = m_batches.front();
+        if (batch->next < batch->records.size()) {
+            return batch;
+        }
+        // Every record has been taken, though some may still be being aligned.
+        m_batches.pop_front();
+    }
+    return nullptr;
+}
+
 void Aligner::worker_thread(size_t tid) {
+    set_thread_name("aligner");
     m_active++;  // Track active threads.
 
-    Message message;
-    while (m_work_queue.try_pop(message)) {
-        auto read = std::get<BamPtr>(std::move(message));
-        auto records = align(read.get(), m_tbufs[tid]);
-        for (auto& record : records) {
-            m_sink.push_message(std::move(record));
+    std::vector<Message> output;
+    while (true) {
+        // Help with the records left in other workers' batches before taking a new one.
+        auto batch = next_shared_batch();
+        if (!batch) {
+            std::vector<Message> messages;
+            if (!m_work_queue.try_pop_batch(messages, kMaxBatchSize)) {
+                break;
+            }
+            // Longest first, so the long reads are started while there are short ones left
+            // for other workers to take.
+            auto length = [](const Message& message) -> size_t {
+                if (std::holds_alternative<BamPtr>(message)) {
+                    return std::get<BamPtr>(message)->core.l_qseq;
+                }
+                return std::get<std::shared_ptr<Read>>(message)->seq.size();
+            };
+            std::stable_sort(messages.begin(), messages.end(),
+                             [&length](const Message& a, const Message& b) {
+                                 return length(a) > length(b);
+                             });
+            batch = std::make_shared<SharedBatch>();
+            batch->records = std::move(messages);
+            std::lock_guard<std::mutex> lock(m_batches_mutex);
+            m_batches.push_back(batch);
+        }
+
+        for (size_t i = batch->next++; i < batch->records.size(); i = batch->next++) {
+            auto& message = batch->records[i];
+            TraceSpan span("align");
+            // Reads from the basecalling pipeline are mapped from their sequences, rather than
+            // being turned into a record first only to be decoded again.
+            auto records = std::holds_alternative<BamPtr>(message)
+                                   ? align(std::get<BamPtr>(message).get(), m_tbufs[tid])
+                                   : align(*std::get<std::shared_ptr<Read>>(message), m_tbufs[tid]);
+            message = BamPtr();
+            for (auto& record : records) {
+                output.push_back(std::move(record));
+            }
+        }
+        if (!output.empty()) {
+            m_sink.push_messages(std::move(output));
         }
     }
 
@@ -128,7 +435,9 @@ void Aligner::worker_thread(size_t tid) {
 void Aligner::add_tags(bam1_t* record,
                        const mm_reg1_t* aln,
                        const std::string& seq,
-                       const mm_tbuf_t* buf) {
+                       const mm_tbuf_t* buf,
+                       const mm_idx_t* index,
+                       bool secondary) {
     if (aln->p) {
         // NM
         int32_t nm = aln->blen - aln->mlen + aln->p->n_ambi;
@@ -162,7 +471,7 @@ void Aligner::add_tags(bam1_t* record,
 
     // tp
     char type;
-    if (aln->id == aln->parent) {
+    if (!secondary) {
         type = aln->inv ? 'I' : 'P';
     } else {
         type = aln->inv ? 'i' : 'S';
@@ -180,14 +489,17 @@ void Aligner::add_tags(bam1_t* record,
         bam_aux_append(record, "s2", 'i', sizeof(aln->subsc), (uint8_t*)&aln->subsc);
     }
 
-    // MD
-    char* md = NULL;
-    int max_len = 0;
-    int md_len = mm_gen_MD(NULL, &md, &max_len, m_index, aln, seq.c_str());
+    // MD, formatted into a buffer each thread keeps, which mm_gen_MD grows as needed.
+    struct MdBuffer {
+        ~MdBuffer() { free(data); }
+        char* data = nullptr;
+        int max_len = 0;
+    };
+    thread_local MdBuffer md;
+    int md_len = mm_gen_MD(NULL, &md.data, &md.max_len, index, aln, seq.c_str());
     if (md_len > 0) {
-        bam_aux_append(record, "MD", 'Z', md_len + 1, (uint8_t*)md);
+        bam_aux_append(record, "MD", 'Z', md_len + 1, (uint8_t*)md.data);
     }
-    free(md);
 
     // zd
     if (aln->split) {
@@ -199,45 +511,101 @@ void Aligner::add_tags(bam1_t* record,
     bam_aux_append(record, "rl", 'i', sizeof(buf->rep_len), (uint8_t*)&buf->rep_len);
 }
 
-std::vector<BamPtr> Aligner::align(bam1_t* irecord, mm_tbuf_t* buf) {
-    // some where for the hits
-    std::vector<BamPtr> results;
+void Aligner::set_read_conversion(bool emit_moves, bool rna, float modbase_threshold_frac) {
+    m_emit_moves = emit_moves;
+    m_rna = rna;
+    m_modbase_threshold = static_cast<uint8_t>(std::min(modbase_threshold_frac * 256.0f, 255.0f));
+}
 
+std::vector<BamPtr> Aligner::align(bam1_t* irecord, mm_tbuf_t* buf) {
     // get the sequence to map from the record
     auto seqlen = irecord->core.l_qseq;
+    std::string seq = convert_nt16_to_str(bam_get_seq(irecord), seqlen);
+    std::vector<uint8_t> qual(bam_get_qual(irecord), bam_get_qual(irecord) + seqlen);
+
+    auto results = align_sequence(irecord, seq, qual, buf);
+    // just return the input record
+    if (results.empty()) {
+        results.push_back(BamPtr(bam_dup1(irecord)));
+    }
+    return results;
+}
+
+std::vector<BamPtr> Aligner::align(Read& read, mm_tbuf_t* buf) {
+    if (m_rna) {
+        std::reverse(read.seq.begin(), read.seq.end());
+        std::reverse(read.qstring.begin(), read.qstring.end());
+    }
+    // The read's unmapped record, which is passed on as it is if the read doesn't map, and
+    // otherwise gives the mapped records their tags.
+    auto unmapped = read.extract_sam_lines(m_emit_moves, m_modbase_threshold);
+    std::vector<uint8_t> qual(read.qstring.size());
+    std::transform(read.qstring.begin(), read.qstring.end(), qual.begin(),
+                   [](char c) { return static_cast<uint8_t>(c - 33); });
+
+    auto results = align_sequence(unmapped.front().get(), read.seq, qual, buf);
+    return results.empty() ? std::move(unmapped) : std::move(results);
+}
+
+std::vector<BamPtr> Aligner::align_sequence(const bam1_t* irecord,
+                                            const std::string& seq,
+                                            const std::vector<uint8_t>& qual,
+                                            mm_tbuf_t* buf) {
+    // some where for the hits
+    std::vector<BamPtr> results;
 
     // get query name.
     std::string_view qname(bam_get_qname(irecord));
 
-    auto bseq = bam_get_seq(irecord);
-    std::string seq = convert_nt16_to_str(bseq, seqlen);
     // Pre-generate reverse complement sequence.
     std::string seq_rev = reverse_complement(seq);
 
     // Pre-generate reverse of quality string.
-    std::vector<uint8_t> qual;
-    std::vector<uint8_t> qual_rev;
-    if (bam_get_qual(irecord)) {
-        qual = std::vector<uint8_t>(bam_get_qual(irecord), bam_get_qual(irecord) + seqlen);
-        qual_rev = std::vector<uint8_t>(qual.rbegin(), qual.rend());
+    std::vector<uint8_t> qual_rev(qual.rbegin(), qual.rend());
+
+    // do the mapping, against each part of the index, with the hits numbered by their target
+    // IDs in the output header
+    const size_t num_parts = m_index->parts.size();
+    std::vector<mm_reg1_t> regs;
+    int rep_len = 0;
+    for (size_t part = 0; part < num_parts; ++part) {
+        int part_hits = 0;
+        mm_reg1_t* part_regs = mm_map(m_index->parts[part], seq.length(), seq.c_str(),
+                                      &part_hits, buf, &m_map_opts[part], qname.data());
+        rep_len = std::max(rep_len, buf->rep_len);
+        for (int j = 0; j < part_hits; ++j) {
+            part_regs[j].rid += m_index->tid_offsets[part];
+            regs.push_back(part_regs[j]);
+        }
+        free(part_regs);
     }
 
-    // do the mapping
-    int hits = 0;
-    mm_reg1_t* reg =
-            mm_map(m_index, seq.length(), seq.c_str(), &hits, buf, &m_map_opt, qname.data());
-
-    // just return the input record
-    if (hits == 0) {
-        results.push_back(BamPtr(bam_dup1(irecord)));
+    // Each part's hits were ranked against that part alone, so as minimap2 merges a split
+    // index, the primary and supplementary alignments, and the MAPQs, are chosen again from
+    // the hits against every part.
+    int n_regs = static_cast<int>(regs.size());
+    if (num_parts > 1 && n_regs > 0) {
+        const auto& opt = m_map_opts.front();
+        mm_hit_sort(nullptr, &n_regs, regs.data(), opt.alt_drop);
+        mm_set_parent(nullptr, opt.mask_level, opt.mask_len, n_regs, regs.data(),
+                      opt.a * 2 + opt.b, opt.flag & MM_F_HARD_MLEVEL, opt.alt_drop);
+        if (!(opt.flag & MM_F_ALL_CHAINS)) {
+            mm_select_sub(nullptr, opt.pri_ratio, m_index->parts.front()->k * 2, opt.best_n, 0,
+                          opt.max_gap * 0.8, &n_regs, regs.data());
+            mm_set_sam_pri(n_regs, regs.data());
+        }
+        mm_set_mapq(nullptr, n_regs, regs.data(), opt.min_chain_score, opt.a, rep_len,
+                    (opt.flag & MM_F_SR) != 0);
+        // The rl tag gives the repeat length over the whole index.
+        buf->rep_len = rep_len;
     }
 
-    for (int j = 0; j < hits; j++) {
+    for (int j = 0; j < n_regs; j++) {
         // new output record
         bam1_t* record = bam_init1();
 
         // mapping region
-        auto aln = &reg[j];
+        auto aln = &regs[j];
 
         // Set FLAGS
         uint16_t flag = 0x0;
@@ -251,9 +619,13 @@ std::vector<BamPtr> Aligner::align(bam1_t* irecord, mm_tbuf_t* buf) {
             flag |= BAM_FSUPPLEMENTARY;
         }
 
-        int32_t tid = aln->rid;
+        const int32_t tid = aln->rid;
         hts_pos_t pos = aln->rs;
         uint8_t mapq = aln->mapq;
+        // The part the hit is against, which numbers its target from 0.
+        const size_t part = std::upper_bound(m_index->tid_offsets.begin(),
+                                             m_index->tid_offsets.end(), tid) -
+                            m_index->tid_offsets.begin() - 1;
 
         // Create CIGAR.
         // Note: max_bam_cigar_op doesn't need to handled specially when
@@ -295,8 +667,8 @@ std::vector<BamPtr> Aligner::align(bam1_t* irecord, mm_tbuf_t* buf) {
 
         // Add SEQ and QUAL.
         size_t l_seq = 0;
-        char* seq_tmp = nullptr;
-        unsigned char* qual_tmp = nullptr;
+        const char* seq_tmp = nullptr;
+        const uint8_t* qual_tmp = nullptr;
         if (flag & BAM_FSECONDARY) {
             // To match minimap2 output behavior, don't emit sequence
             // or quality info for secondary alignments.
@@ -321,28 +693,35 @@ std::vector<BamPtr> Aligner::align(bam1_t* irecord, mm_tbuf_t* buf) {
         // TODO: See if bam_get_qname(irecord) usage can be fixed.
         bam_set1(record, qname.size(), qname.data(), flag, tid, pos, mapq, n_cigar,
                  cigar.empty() ? nullptr : cigar.data(), irecord->core.mtid, irecord->core.mpos,
-                 irecord->core.isize, l_seq, seq_tmp, (char*)qual_tmp, bam_get_l_aux(irecord));
+                 irecord->core.isize, l_seq, seq_tmp, (const char*)qual_tmp,
+                 bam_get_l_aux(irecord));
 
         // Copy over tags from input alignment.
         memcpy(bam_get_aux(record), bam_get_aux(irecord), bam_get_l_aux(irecord));
         record->l_data += bam_get_l_aux(irecord);
+        // Keeps the read's load order, for a ReorderNode.
+        record->id = irecord->id;
 
-        // Add new tags to match minimap2.
-        add_tags(record, aln, seq, buf);
+        // Add new tags to match minimap2, with the target numbered as in its part for MD.
+        aln->rid -= m_index->tid_offsets[part];
+        add_tags(record, aln, seq, buf, m_index->parts[part], flag & BAM_FSECONDARY);
 
         free(aln->p);
         results.push_back(BamPtr(record));
     }
 
-    free(reg);
     return results;
 }
 
-HtsReader::HtsReader(const std::string& filename) {
+HtsReader::HtsReader(const std::string& filename, int threads) {
     m_file = hts_open(filename.c_str(), "r");
     if (!m_file) {
         throw std::runtime_error("Could not open file: " + filename);
     }
+    if (threads > 0 && hts_set_threads(m_file, threads) < 0) {
+        hts_close(m_file);
+        throw std::runtime_error("Could not enable multi threading for reading " + filename);
+    }
     format = hts_format_description(hts_get_format(m_file));
     header = sam_hdr_read(m_file);
     if (!header) {
@@ -366,14 +745,36 @@ bool HtsReader::has_tag(std::string tagname) {
     return static_cast<bool>(tag);
 }
 
-void HtsReader::read(MessageSink& read_sink, int max_reads) {
-    int num_reads = 0;
-    while (this->read()) {
-        read_sink.push_message(BamPtr(bam_dup1(record.get())));
-        if (++num_reads >= max_reads) {
+bool HtsReader::read_batch(std::vector<BamPtr>& records, size_t max_records) {
+    const size_t initial_size = records.size();
+    while (records.size() - initial_size < max_records) {
+        BamPtr next(bam_init1());
+        if (sam_read1(m_file, header, next.get()) < 0) {
             break;
         }
-        if (num_reads % 50000 == 0) {
+        records.push_back(std::move(next));
+    }
+    return records.size() > initial_size;
+}
+
+void HtsReader::read(MessageSink& read_sink, int max_reads) {
+    // Records are read straight into their own BamPtrs, rather than into record and then
+    // copied, and pushed on a batch at a time.
+    size_t num_reads = 0;
+    const size_t limit = max_reads < 0 ? SIZE_MAX : size_t(max_reads);
+    std::vector<BamPtr> records;
+    std::vector<Message> messages;
+    while (num_reads < limit && read_batch(records, std::min(kMaxBatchSize, limit - num_reads))) {
+        const size_t previous = num_reads;
+        num_reads += records.size();
+        // record is left holding the last record read, as read() leaves it.
+        bam_copy1(record.get(), records.back().get());
+        for (auto& next : records) {
+            messages.push_back(std::move(next));
+        }
+        records.clear();
+        read_sink.push_messages(std::move(messages));
+        if (num_reads / 50000 != previous / 50000) {
             spdlog::debug("Processed {} reads", num_reads);
         }
     }
@@ -381,40 +782,301 @@ void HtsReader::read(MessageSink& read_sink, int max_reads) {
     read_sink.terminate();
 }
 
-HtsWriter::HtsWriter(const std::string& filename, OutputMode mode, size_t threads, size_t num_reads)
-        : MessageSink(10000), m_num_reads_expected(num_reads) {
+namespace {
+
+auto coordinate_key(const bam1_t* record) {
+    // Unmapped records have a tid of -1, which sorts last as unsigned.
+    return std::make_tuple(static_cast<uint32_t>(record->core.tid), record->core.pos,
+                           (record->core.flag & BAM_FREVERSE) != 0);
+}
+
+htsFile* open_run(const std::string& path, const char* mode, htsThreadPool* pool) {
+    htsFile* file = hts_open(path.c_str(), mode);
+    if (!file) {
+        throw std::runtime_error("Could not open sort run " + path);
+    }
+    if (pool && hts_set_thread_pool(file, pool) < 0) {
+        hts_close(file);
+        throw std::runtime_error("Could not enable multi threading for sort run " + path);
+    }
+    return file;
+}
+
+// A run being written, at the fastest compression level, since it's read back only once.
+class RunWriter {
+public:
+    RunWriter(const std::string& path, sam_hdr_t* header, htsThreadPool* pool)
+            : m_path(path), m_header(header), m_file(open_run(path, "wb1", pool)) {
+        if (sam_hdr_write(m_file, m_header) < 0) {
+            fail();
+        }
+    }
+    ~RunWriter() {
+        if (m_file) {
+            hts_close(m_file);
+        }
+    }
+
+    void write(bam1_t* record) {
+        if (sam_write1(m_file, m_header, record) < 0) {
+            fail();
+        }
+    }
+    void close() {
+        const int res = hts_close(m_file);
+        m_file = nullptr;
+        if (res < 0) {
+            fail();
+        }
+    }
+
+private:
+    [[noreturn]] void fail() { throw std::runtime_error("Could not write sort run " + m_path); }
+
+    const std::string m_path;
+    sam_hdr_t* m_header;
+    htsFile* m_file;
+};
+
+}  // namespace
+
+CoordinateSorter::CoordinateSorter(SortedOutputSettings settings,
+                                   std::string run_prefix,
+                                   const sam_hdr_t* header,
+                                   htsThreadPool* pool)
+        : m_settings(std::move(settings)),
+          m_run_prefix(std::move(run_prefix)),
+          m_header(sam_hdr_dup(header)),
+          m_pool(pool) {
+    if (!m_header) {
+        throw std::runtime_error("Could not copy the header for sorting.");
+    }
+    std::error_code error;
+    std::filesystem::create_directories(m_settings.scratch_directory, error);
+    if (error) {
+        throw std::runtime_error("Could not create scratch directory " +
+                                 m_settings.scratch_directory + ": " + error.message());
+    }
+}
+
+CoordinateSorter::~CoordinateSorter() {
+    // Runs left by a merge that failed, or never happened.
+    for (const auto& path : m_run_paths) {
+        std::error_code error;
+        std::filesystem::remove(path, error);
+    }
+    sam_hdr_destroy(m_header);
+}
+
+bool CoordinateSorter::less(const bam1_t* a, const bam1_t* b) {
+    return coordinate_key(a) < coordinate_key(b);
+}
+
+void CoordinateSorter::add(BamPtr record) {
+    m_run_bytes += sizeof(bam1_t) + record->m_data;
+    m_run.push_back(std::move(record));
+    if (m_run_bytes >= m_settings.max_memory_bytes) {
+        spill();
+    }
+}
+
+std::string CoordinateSorter::next_run_path() {
+    const auto name = m_run_prefix + ".tmp." + std::to_string(m_num_runs_written++) + ".bam";
+    return (std::filesystem::path(m_settings.scratch_directory) / name).string();
+}
+
+void CoordinateSorter::spill() {
+    TraceSpan span("sort_spill");
+    std::stable_sort(m_run.begin(), m_run.end(),
+                     [](const BamPtr& a, const BamPtr& b) { return less(a.get(), b.get()); });
+    const auto path = next_run_path();
+    // Listed before it's written, so that it's removed even if writing fails.
+    m_run_paths.push_back(path);
+    RunWriter run(path, m_header, m_pool);
+    for (auto& record : m_run) {
+        run.write(record.get());
+    }
+    run.close();
+    spdlog::debug("> Spilled {} sorted records to {}", m_run.size(), path);
+    m_run.clear();
+    m_run_bytes = 0;
+}
+
+void CoordinateSorter::merge(const std::function<void(bam1_t*)>& write) {
+    TraceSpan span("sort_merge");
+    std::stable_sort(m_run.begin(), m_run.end(),
+                     [](const BamPtr& a, const BamPtr& b) { return less(a.get(), b.get()); });
+    // The earliest runs are merged into one, which takes their place at the front, so that
+    // records at the same position stay in the order they were added.
+    while (m_run_paths.size() > kMaxRunsMerged) {
+        const std::vector<std::string> batch(m_run_paths.begin(),
+                                             m_run_paths.begin() + kMaxRunsMerged);
+        const auto path = next_run_path();
+        m_run_paths.push_back(path);
+        RunWriter run(path, m_header, m_pool);
+        merge_runs(batch, false, [&run](bam1_t* record) { run.write(record); });
+        run.close();
+        m_run_paths.erase(m_run_paths.begin(), m_run_paths.begin() + kMaxRunsMerged);
+        std::rotate(m_run_paths.begin(), m_run_paths.end() - 1, m_run_paths.end());
+    }
+    if (!m_run_paths.empty()) {
+        spdlog::debug("> Merging {} sorted runs", m_run_paths.size() + 1);
+    }
+    merge_runs(m_run_paths, true, write);
+    m_run_paths.clear();
+}
+
+void CoordinateSorter::merge_runs(const std::vector<std::string>& paths,
+                                  bool memory_run,
+                                  const std::function<void(bam1_t*)>& write) {
+    // Each source's next record, or null once it has none left.  The in-memory run, which has
+    // the latest records, comes after the runs on disk.
+    const size_t num_sources = paths.size() + (memory_run ? 1 : 0);
+    std::vector<std::unique_ptr<htsFile, int (*)(htsFile*)>> files;
+    std::vector<BamPtr> heads(num_sources);
+    size_t memory_index = 0;
+    for (const auto& path : paths) {
+        files.emplace_back(open_run(path, "r", m_pool), hts_close);
+        sam_hdr_t* run_header = sam_hdr_read(files.back().get());
+        if (!run_header) {
+            throw std::runtime_error("Could not read the header of sort run " + path);
+        }
+        sam_hdr_destroy(run_header);
+    }
+    auto advance = [&](size_t source) {
+        if (source == files.size()) {
+            heads[source] = memory_index < m_run.size() ? std::move(m_run[memory_index++])
+                                                        : nullptr;
+            return heads[source] != nullptr;
+        }
+        // Records from disk are read into the same record each time.
+        if (!heads[source]) {
+            heads[source].reset(bam_init1());
+        }
+        const int res = sam_read1(files[source].get(), m_header, heads[source].get());
+        if (res < -1) {
+            throw std::runtime_error("Could not read sort run " + paths[source]);
+        }
+        return res >= 0;
+    };
+
+    // A heap of the sources with records left, with the least record on top, and ties going to
+    // the earlier source.
+    auto later = [&heads](size_t a, size_t b) {
+        const auto key_a = coordinate_key(heads[a].get());
+        const auto key_b = coordinate_key(heads[b].get());
+        return key_b < key_a || (key_a == key_b && b < a);
+    };
+    std::vector<size_t> heap;
+    for (size_t source = 0; source < num_sources; ++source) {
+        if (advance(source)) {
+            heap.push_back(source);
+        }
+    }
+    std::make_heap(heap.begin(), heap.end(), later);
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        const size_t source = heap.back();
+        write(heads[source].get());
+        if (advance(source)) {
+            std::push_heap(heap.begin(), heap.end(), later);
+        } else {
+            heap.pop_back();
+        }
+    }
+
+    if (memory_run) {
+        m_run.clear();
+    }
+    files.clear();
+    for (const auto& path : paths) {
+        std::error_code error;
+        std::filesystem::remove(path, error);
+    }
+}
+
+namespace {
+
+const char* hts_write_mode(HtsWriter::OutputMode mode) {
     switch (mode) {
-    case FASTQ:
-        m_file = hts_open(filename.c_str(), "wf");
-        break;
-    case BAM:
-        m_file = hts_open(filename.c_str(), "wb");
-        break;
-    case SAM:
-        m_file = hts_open(filename.c_str(), "w");
-        break;
-    case UBAM:
-        m_file = hts_open(filename.c_str(), "wb0");
-        break;
+    case HtsWriter::FASTQ:
+        return "wf";
+    case HtsWriter::BAM:
+        return "wb";
+    case HtsWriter::SAM:
+        return "w";
+    case HtsWriter::UBAM:
+        return "wb0";
+    case HtsWriter::CRAM:
+        return "wc";
     default:
         throw std::runtime_error("Unknown output mode selected: " + std::to_string(mode));
     }
+}
+
+htsFile* hts_open_fd(int fd, HtsWriter::OutputMode mode) {
+    // htslib closes the descriptor it's given, so give it a copy.
+#ifdef _WIN32
+    fd = _dup(fd);
+#else
+    fd = dup(fd);
+#endif
+    hFILE* hfile = fd < 0 ? nullptr : hdopen(fd, "w");
+    if (!hfile) {
+        return nullptr;
+    }
+    htsFile* file = hts_hopen(hfile, ("fd:" + std::to_string(fd)).c_str(), hts_write_mode(mode));
+    if (!file) {
+        hclose_abruptly(hfile);
+    }
+    return file;
+}
+
+}  // namespace
+
+HtsWriter::HtsWriter(const std::string& filename, OutputMode mode, size_t threads, size_t num_reads)
+        : HtsWriter(hts_open(filename.c_str(), hts_write_mode(mode)),
+                    filename,
+                    threads,
+                    num_reads) {}
+
+HtsWriter::HtsWriter(int fd, OutputMode mode, size_t threads, size_t num_reads)
+        : HtsWriter(hts_open_fd(fd, mode), "fd:" + std::to_string(fd), threads, num_reads) {}
+
+HtsWriter::HtsWriter(htsFile* file, const std::string& name, size_t threads, size_t num_reads)
+        : MessageSink(10000), m_file(file), m_name(name) {
     if (!m_file) {
-        throw std::runtime_error("Could not open file: " + filename);
+        throw std::runtime_error("Could not open file: " + name);
     }
-    if (m_file->format.compression == bgzf) {
-        auto res = bgzf_mt(m_file->fp.bgzf, threads, 128);
-        if (res < 0) {
-            throw std::runtime_error("Could not enable multi threading for BAM generation.");
+    // The destructor doesn't run if construction fails, so the file and pool are freed here.
+    auto fail = [this](const std::string& message) {
+        hts_close(m_file);
+        if (m_thread_pool.pool) {
+            hts_tpool_destroy(m_thread_pool.pool);
+        }
+        throw std::runtime_error(message);
+    };
+    // htslib's pool compresses BGZF blocks (BAM) or formats batches of records (SAM) on its
+    // threads, and writes the results out in order, so the worker thread only hands records on.
+    if (threads > 0) {
+        m_thread_pool.pool = hts_tpool_init(threads);
+        if (!m_thread_pool.pool || hts_set_thread_pool(m_file, &m_thread_pool) < 0) {
+            fail("Could not enable multi threading for output generation.");
         }
     }
-
-    if (m_num_reads_expected == 0) {
-        m_progress_bar_interval = 100;
-    } else {
-        m_progress_bar_interval = m_num_reads_expected < 100 ? 1 : 100;
+    if (hts_get_format(m_file)->format == cram) {
+        // CRAM 3.1's codecs: adaptive arithmetic coding and the name tokeniser, on top of rANS.
+        // Each aux tag has a block of its own, so the move tables' runs of 0s and 1s and the
+        // modified base probabilities each compress against their own kind.  The pool encodes
+        // whole containers of records at once.
+        if (hts_set_opt(m_file, CRAM_OPT_VERSION, "3.1") < 0 ||
+            hts_set_opt(m_file, CRAM_OPT_USE_ARITH, 1) < 0 ||
+            hts_set_opt(m_file, CRAM_OPT_USE_TOK, 1) < 0) {
+            fail("Could not set up CRAM 3.1 output for " + name);
+        }
     }
 
+    m_progress = std::make_unique<ProgressReporter>(num_reads);
     m_worker = std::make_unique<std::thread>(std::thread(&HtsWriter::worker_thread, this));
 }
 
@@ -426,6 +1088,10 @@ HtsWriter::~HtsWriter() {
     }
     sam_hdr_destroy(header);
     hts_close(m_file);
+    // The pool's threads are only done with the file once it's closed.
+    if (m_thread_pool.pool) {
+        hts_tpool_destroy(m_thread_pool.pool);
+    }
 }
 
 HtsWriter::OutputMode HtsWriter::get_output_mode(std::string mode) {
@@ -435,62 +1101,63 @@ HtsWriter::OutputMode HtsWriter::get_output_mode(std::string mode) {
         return BAM;
     } else if (mode == "fastq") {
         return FASTQ;
+    } else if (mode == "cram") {
+        return CRAM;
     }
     throw std::runtime_error("Unknown output mode: " + mode);
 }
 
 void HtsWriter::join() { m_worker->join(); }
 
-void HtsWriter::worker_thread() {
-    std::unordered_set<std::string> processed_read_ids;
-    size_t write_count = 0;
+void HtsWriter::remove_expected_reads(size_t count) { m_progress->remove_expected(count); }
 
-    // Initialize progress logging.
-    if (m_num_reads_expected == 0) {
-        std::cerr << "\r> Output records written: " << write_count;
-    }
+namespace {
 
-    Message message;
-    while (m_work_queue.try_pop(message)) {
-        auto aln = std::get<BamPtr>(std::move(message));
-        write(aln.get());
-        std::string read_id = bam_get_qname(aln.get());
-        aln.reset();  // Free the bam alignment that's already written
+// Whether record stands for a read of its own, for the progress count, and isn't a duplex read
+// or another alignment of a read already counted.  Uses only the record itself, so the count
+// takes constant memory however many reads are written.
+bool counts_towards_progress(const bam1_t* record) {
+    if (record->core.flag & (BAM_FSECONDARY | BAM_FSUPPLEMENTARY)) {
+        return false;
+    }
+    // Duplex reads are tagged dx:i:1, simplex reads dx:i:0 or dx:i:-1.
+    const uint8_t* duplex_tag = bam_aux_get(record, "dx");
+    return !duplex_tag || bam_aux2i(duplex_tag) != 1;
+}
 
-        // For the purpose of estimating write count, we ignore duplex reads
-        // these can be identified by a semicolon in their ID.
-        // TODO: This is a hack, we should have a better way of identifying duplex reads.
-        bool ignore_read_id = read_id.find(';') != std::string::npos;
+}  // namespace
 
-        if (!ignore_read_id) {
-            processed_read_ids.emplace(std::move(read_id));
-        }
+void HtsWriter::worker_thread() {
+    set_thread_name("hts_writer");
+    size_t write_count = 0;
 
-        if (m_num_reads_expected != 0) {
-            write_count = processed_read_ids.size();
-        } else {
-            if (!ignore_read_id) {
+    std::vector<Message> messages;
+    while (m_work_queue.try_pop_batch(messages, kMaxBatchSize)) {
+        TraceSpan span("write");
+        for (auto& message : messages) {
+            auto aln = std::get<BamPtr>(std::move(message));
+            if (counts_towards_progress(aln.get())) {
                 write_count++;
+                m_progress->add();
             }
-        }
-
-        if ((write_count % m_progress_bar_interval) == 0) {
-            if ((write_count == 0) && !m_prog_bar_initialized) {
-                m_progress_bar.set_progress(0.0f);
-                m_prog_bar_initialized = true;
-            }
-            if (m_num_reads_expected != 0) {
-                float progress = 100.f * static_cast<float>(write_count) / m_num_reads_expected;
-                m_progress_bar.set_progress(progress);
-                std::cerr << "\033[K";
+            if (m_sorter) {
+                // Held until every record is in, and written by the merge below.
+                m_sorter->add(std::move(aln));
             } else {
-                std::cerr << "\r> Output records written: " << write_count;
+                write(aln.get());
+                aln.reset();  // Free the bam alignment that's already written
             }
         }
+        messages.clear();
     }
-    // Clear progress information.
-    if (m_num_reads_expected != 0 || write_count >= m_progress_bar_interval) {
-        std::cerr << "\r";
+    m_progress->stop();
+    if (m_sorter) {
+        spdlog::info("> Writing the records sorted by coordinate to {}", m_name);
+        m_sorter->merge([this](bam1_t* record) { write(record); });
+        m_sorter.reset();
+        if (sam_idx_save(m_file) < 0) {
+            throw std::runtime_error("Could not write the index of " + m_name);
+        }
     }
     spdlog::debug("Written {} records.", write_count);
 }
@@ -513,18 +1180,437 @@ int HtsWriter::write(bam1_t* record) {
     if (res < 0) {
         throw std::runtime_error("Failed to write SAM record, error code " + std::to_string(res));
     }
+    m_num_records_written.fetch_add(1, std::memory_order_relaxed);
+    m_num_bytes_written.fetch_add(record->l_data, std::memory_order_relaxed);
     return res;
 }
 
+void HtsWriter::add_metrics(MetricsRegistry& registry) const {
+    add_writer_metrics(registry, m_num_records_written, m_num_bytes_written);
+}
+
 void HtsWriter::add_header(const sam_hdr_t* hdr) { header = sam_hdr_dup(hdr); }
 
+void HtsWriter::set_cram_reference(const std::string& fasta_path) {
+    if (hts_set_fai_filename(m_file, fasta_path.c_str()) < 0) {
+        throw std::runtime_error("Could not use " + fasta_path + " as the CRAM reference.");
+    }
+}
+
+void HtsWriter::set_sorted_output(SortedOutputSettings settings) {
+    // The index needs BGZF blocks, and a file to go alongside.
+    if (hts_get_format(m_file)->format != bam || m_name == "-" || m_name.rfind("fd:", 0) == 0) {
+        throw std::runtime_error("Sorted output must be BAM written to a file, not " + m_name);
+    }
+    if (settings.scratch_directory.empty()) {
+        const auto directory = std::filesystem::path(m_name).parent_path();
+        settings.scratch_directory = directory.empty() ? "." : directory.string();
+    }
+    m_sorted_output = std::move(settings);
+}
+
 int HtsWriter::write_header() {
-    if (header) {
-        return sam_hdr_write(m_file, header);
+    if (!m_sorted_output) {
+        return header ? sam_hdr_write(m_file, header) : 0;
+    }
+    if (!header) {
+        throw std::runtime_error("Sorted output needs a header with the references.");
+    }
+    const int updated = sam_hdr_count_lines(header, "HD") > 0
+                                ? sam_hdr_update_hd(header, "SO", "coordinate")
+                                : sam_hdr_add_line(header, "HD", "VN", SAM_FORMAT_VERSION, "SO",
+                                                   "coordinate", NULL);
+    if (updated < 0) {
+        throw std::runtime_error("Could not mark the header as sorted by coordinate.");
+    }
+    const int res = sam_hdr_write(m_file, header);
+    if (res < 0) {
+        return res;
+    }
+
+    // A BAI can only index positions below 2^29, so longer references need a CSI.
+    int min_shift = 0;
+    for (int tid = 0; tid < sam_hdr_nref(header); ++tid) {
+        if (sam_hdr_tid2len(header, tid) >= (hts_pos_t(1) << 29)) {
+            min_shift = 14;
+        }
+    }
+    const auto index_path = m_name + (min_shift == 0 ? ".bai" : ".csi");
+    if (sam_idx_init(m_file, header, min_shift, index_path.c_str()) < 0) {
+        throw std::runtime_error("Could not start the index " + index_path);
+    }
+    m_sorter = std::make_unique<CoordinateSorter>(
+            *m_sorted_output, std::filesystem::path(m_name).filename().string(), header,
+            m_thread_pool.pool ? &m_thread_pool : nullptr);
+    return res;
+}
+
+ShardedHtsWriter::ShardedHtsWriter(ShardedOutputSettings settings,
+                                   size_t compression_threads,
+                                   size_t num_reads)
+        : MessageSink(10000), m_settings(std::move(settings)) {
+    if (m_settings.num_shards == 0) {
+        throw std::runtime_error("Sharded output needs at least one shard.");
+    }
+    std::error_code error;
+    std::filesystem::create_directories(m_settings.directory, error);
+    if (error) {
+        throw std::runtime_error("Could not create output directory " + m_settings.directory +
+                                 ": " + error.message());
+    }
+    m_first_file_index.resize(m_settings.num_shards, 0);
+    if (m_settings.resume) {
+        load_checkpoint();
+    }
+    const auto checkpoint_path =
+            (std::filesystem::path(m_settings.directory) / kCheckpointFileName).string();
+    m_checkpoint.open(checkpoint_path, m_settings.resume ? std::ios::app : std::ios::trunc);
+    if (!m_checkpoint) {
+        throw std::runtime_error("Could not open checkpoint " + checkpoint_path);
+    }
+    if (compression_threads > 0) {
+        m_thread_pool.pool = hts_tpool_init(compression_threads);
+        if (!m_thread_pool.pool) {
+            throw std::runtime_error("Could not enable multi threading for output generation.");
+        }
+    }
+    // Reads a resumed run skips were written by the run it resumes.
+    m_progress = std::make_unique<ProgressReporter>(num_reads);
+    m_progress->add(m_completed_read_ids.size());
+    for (size_t shard = 0; shard < m_settings.num_shards; ++shard) {
+        m_shard_threads.emplace_back(&ShardedHtsWriter::shard_thread, this, shard);
+    }
+}
+
+ShardedHtsWriter::~ShardedHtsWriter() {
+    terminate();
+    for (auto& thread : m_shard_threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    sam_hdr_destroy(m_header);
+    if (m_thread_pool.pool) {
+        hts_tpool_destroy(m_thread_pool.pool);
+    }
+}
+
+void ShardedHtsWriter::add_header(const sam_hdr_t* hdr) { m_header = sam_hdr_dup(hdr); }
+
+void ShardedHtsWriter::join() {
+    for (auto& thread : m_shard_threads) {
+        thread.join();
+    }
+    m_progress->stop();
+    write_manifest();
+}
+
+void ShardedHtsWriter::remove_expected_reads(size_t count) { m_progress->remove_expected(count); }
+
+void ShardedHtsWriter::shard_thread(size_t shard) {
+    set_thread_name("shard_writer");
+    htsFile* file = nullptr;
+    ShardFile current{shard, m_first_file_index[shard], {}, 0};
+    size_t num_bytes = 0;
+    // The reads written since the last checkpoint, each of them in full.
+    std::vector<std::string> unchecked_read_ids;
+    auto last_checkpoint = std::chrono::steady_clock::now();
+
+    // The records only count as written once they're out of htslib's buffers and on disk, so
+    // the checkpoint also lists where in the file they end.  A resumed run cuts the file there.
+    auto checkpoint = [&] {
+        BGZF* bgzf = file->fp.bgzf;
+        if (hts_flush(file) < 0 || hflush(bgzf->fp) < 0) {
+            throw std::runtime_error("Failed to flush " + current.name);
+        }
+        // Flushing leaves nothing in the current block, so this is where the next one starts.
+        const auto offset = static_cast<uint64_t>(bgzf_tell(bgzf) >> 16);
+        write_checkpoint(current.name, unchecked_read_ids, current.num_records, offset);
+        unchecked_read_ids.clear();
+    };
+
+    auto close_file = [&] {
+        checkpoint();
+        if (hts_close(file) < 0) {
+            throw std::runtime_error("Failed to close " + current.name);
+        }
+        file = nullptr;
+        std::lock_guard<std::mutex> lock(m_files_mutex);
+        m_files.push_back(current);
+    };
+
+    auto open_file = [&] {
+        current.name = "shard_" + std::to_string(shard) + "_" + std::to_string(current.index) +
+                       ".bam";
+        current.num_records = 0;
+        num_bytes = 0;
+        const auto path = (std::filesystem::path(m_settings.directory) / current.name).string();
+        file = hts_open(path.c_str(), "wb");
+        if (!file) {
+            throw std::runtime_error("Could not open file: " + path);
+        }
+        if (m_thread_pool.pool && hts_set_thread_pool(file, &m_thread_pool) < 0) {
+            hts_close(file);
+            file = nullptr;
+            throw std::runtime_error("Could not enable multi threading for " + path);
+        }
+        if (m_header && sam_hdr_write(file, m_header) < 0) {
+            throw std::runtime_error("Failed to write header to " + path);
+        }
+    };
+
+    auto file_is_full = [&] {
+        return (m_settings.max_records_per_file != 0 &&
+                current.num_records >= m_settings.max_records_per_file) ||
+               (m_settings.max_bytes_per_file != 0 && num_bytes >= m_settings.max_bytes_per_file);
+    };
+
+    // A read's records are pushed together, and are taken off the queue together, so that a
+    // checkpoint or a new file never comes between them.  Otherwise a resumed run would skip a
+    // read only some of whose records were written.
+    auto same_read = [](const Message& a, const Message& b) {
+        return std::strcmp(bam_get_qname(std::get<BamPtr>(a).get()),
+                           bam_get_qname(std::get<BamPtr>(b).get())) == 0;
+    };
+    std::vector<Message> messages;
+    std::string last_read_id;
+    while (m_work_queue.try_pop_batch(messages, kMaxBatchSize, same_read)) {
+        TraceSpan span("write");
+        for (auto& message : messages) {
+            auto record = std::get<BamPtr>(std::move(message));
+            const char* read_id = bam_get_qname(record.get());
+            const bool starts_read = !file || last_read_id != read_id;
+            if (starts_read && file && file_is_full()) {
+                close_file();
+                ++current.index;
+            }
+            if (!file) {
+                open_file();
+            }
+            auto res = sam_write1(file, m_header, record.get());
+            if (res < 0) {
+                throw std::runtime_error("Failed to write SAM record, error code " +
+                                         std::to_string(res));
+            }
+            ++current.num_records;
+            num_bytes += record->l_data;
+            if (starts_read) {
+                last_read_id = read_id;
+                unchecked_read_ids.push_back(last_read_id);
+            }
+            if (counts_towards_progress(record.get())) {
+                m_progress->add();
+            }
+            m_num_records_written.fetch_add(1, std::memory_order_relaxed);
+            m_num_bytes_written.fetch_add(record->l_data, std::memory_order_relaxed);
+        }
+        messages.clear();
+
+        const auto now = std::chrono::steady_clock::now();
+        if (file && !unchecked_read_ids.empty() &&
+            now - last_checkpoint >= m_settings.checkpoint_interval) {
+            checkpoint();
+            last_checkpoint = now;
+        }
+    }
+    // Shards which were never given a record don't leave an empty file behind.
+    if (file) {
+        close_file();
+    }
+}
+
+void ShardedHtsWriter::add_metrics(MetricsRegistry& registry) const {
+    add_writer_metrics(registry, m_num_records_written, m_num_bytes_written);
+}
+
+namespace {
+
+// The shard and index of a file named as ShardedHtsWriter names them.
+bool parse_shard_file_name(const std::string& name, size_t& shard, size_t& index) {
+    static const std::regex pattern(R"(shard_(\d+)_(\d+)\.bam)");
+    std::smatch match;
+    if (!std::regex_match(name, match, pattern)) {
+        return false;
+    }
+    shard = std::stoull(match[1].str());
+    index = std::stoull(match[2].str());
+    return true;
+}
+
+// Lists read_ids as written to file_name, then commits them, and the records before offset.
+void write_checkpoint_entries(std::ostream& checkpoint,
+                              const std::string& file_name,
+                              const std::vector<std::string>& read_ids,
+                              size_t num_records,
+                              uint64_t offset) {
+    for (const auto& read_id : read_ids) {
+        checkpoint << file_name << '\t' << read_id << '\n';
     }
-    return 0;
+    checkpoint << file_name << "\t\t" << num_records << '\t' << offset << '\n';
 }
 
+}  // namespace
+
+void ShardedHtsWriter::load_checkpoint() {
+    const auto directory = std::filesystem::path(m_settings.directory);
+    struct CheckedFile {
+        size_t num_records{0};
+        uint64_t offset{0};
+        // Read IDs committed, and those listed since the file's last commit line, which don't
+        // count until the next.
+        std::vector<std::string> read_ids;
+        std::vector<std::string> pending_read_ids;
+    };
+    std::map<std::string, CheckedFile> checked_files;
+    std::ifstream checkpoint(directory / kCheckpointFileName);
+    std::string line;
+    // A line without a newline was cut short by the interruption, and is left out.
+    while (std::getline(checkpoint, line) && !checkpoint.eof()) {
+        const auto tab = line.find('\t');
+        if (tab == std::string::npos) {
+            continue;
+        }
+        auto& file = checked_files[line.substr(0, tab)];
+        if (tab + 1 < line.size() && line[tab + 1] != '\t') {
+            file.pending_read_ids.push_back(line.substr(tab + 1));
+            continue;
+        }
+        // A commit line: "<file>\t\t<records>\t<offset>".
+        std::istringstream fields(line.substr(tab + 2));
+        if (!(fields >> file.num_records >> file.offset)) {
+            continue;
+        }
+        for (auto& read_id : file.pending_read_ids) {
+            m_completed_read_ids.add(read_id);
+            file.read_ids.push_back(std::move(read_id));
+        }
+        file.pending_read_ids.clear();
+    }
+    checkpoint.close();
+    m_completed_read_ids.finalise();
+
+    // Anything after a file's last commit may be a block cut short, and its reads will be
+    // written again, so it's cut off and the file given the end marker hts_close would have.
+    static constexpr char kBgzfEof[] =
+            "\037\213\010\4\0\0\0\0\0\377\6\0\102\103\2\0\033\0\3\0\0\0\0\0\0\0\0\0";
+    for (const auto& [name, file] : checked_files) {
+        if (file.num_records == 0) {
+            continue;
+        }
+        const auto path = directory / name;
+        std::error_code error;
+        const auto size = std::filesystem::file_size(path, error);
+        if (error || size < file.offset) {
+            throw std::runtime_error("Can't resume: " + path.string() +
+                                     " is missing records the checkpoint lists.");
+        }
+        std::filesystem::resize_file(path, file.offset);
+        std::ofstream stream(path, std::ios::binary | std::ios::app);
+        if (!stream.write(kBgzfEof, sizeof(kBgzfEof) - 1) || !stream.flush()) {
+            throw std::runtime_error("Can't resume: failed to write to " + path.string());
+        }
+        size_t shard = std::numeric_limits<size_t>::max(), index = 0;
+        parse_shard_file_name(name, shard, index);
+        m_files.push_back({shard, index, name, file.num_records});
+    }
+
+    // A file with nothing checkpointed only holds reads which will be written again.
+    for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+        const auto name = entry.path().filename().string();
+        size_t shard = 0, index = 0;
+        if (!parse_shard_file_name(name, shard, index)) {
+            continue;
+        }
+        const auto checked = checked_files.find(name);
+        if (checked == checked_files.end() || checked->second.num_records == 0) {
+            spdlog::debug("Removing {}, which has no checkpointed records", name);
+            std::filesystem::remove(entry.path());
+        } else if (shard < m_first_file_index.size()) {
+            // New files mustn't overwrite any old one.
+            m_first_file_index[shard] = std::max(m_first_file_index[shard], index + 1);
+        }
+    }
+
+    // The checkpoint is rewritten with only what was committed, so that this run's lines don't
+    // follow one cut short, and uncommitted read IDs can't be committed along with a new file
+    // of the same name.  It's replaced in one step, in case this run is interrupted too.
+    const auto checkpoint_path = directory / kCheckpointFileName;
+    auto rewritten_path = checkpoint_path;
+    rewritten_path += ".tmp";
+    {
+        std::ofstream rewritten(rewritten_path, std::ios::trunc);
+        for (const auto& [name, file] : checked_files) {
+            if (file.num_records > 0) {
+                write_checkpoint_entries(rewritten, name, file.read_ids, file.num_records,
+                                         file.offset);
+            }
+        }
+        if (!rewritten.flush()) {
+            throw std::runtime_error("Can't resume: failed to write " + rewritten_path.string());
+        }
+    }
+    std::filesystem::rename(rewritten_path, checkpoint_path);
+
+    spdlog::info("> Resuming from {} reads already written to {} files in {}",
+                 m_completed_read_ids.size(), m_files.size(), m_settings.directory);
+}
+
+void ShardedHtsWriter::write_checkpoint(const std::string& file_name,
+                                        const std::vector<std::string>& read_ids,
+                                        size_t num_records,
+                                        uint64_t offset) {
+    std::lock_guard<std::mutex> lock(m_checkpoint_mutex);
+    write_checkpoint_entries(m_checkpoint, file_name, read_ids, num_records, offset);
+    if (!m_checkpoint.flush()) {
+        throw std::runtime_error("Failed to write " + std::string(kCheckpointFileName));
+    }
+}
+
+void ShardedHtsWriter::write_manifest() {
+    std::sort(m_files.begin(), m_files.end(), [](const ShardFile& a, const ShardFile& b) {
+        return std::tie(a.shard, a.index) < std::tie(b.shard, b.index);
+    });
+    const auto path = std::filesystem::path(m_settings.directory) / kManifestFileName;
+    std::ofstream manifest(path);
+    manifest << "file\trecords\n";
+    size_t total_records = 0;
+    for (const auto& file : m_files) {
+        manifest << file.name << '\t' << file.num_records << '\n';
+        total_records += file.num_records;
+    }
+    if (!manifest) {
+        throw std::runtime_error("Failed to write " + path.string());
+    }
+    spdlog::debug("Written {} records to {} files in {}.", total_records, m_files.size(),
+                  m_settings.directory);
+}
+
+namespace {
+
+// The sequence and quality scores of reader's current record, as a Read.
+std::shared_ptr<Read> record_to_read(HtsReader& reader, std::string read_id) {
+    uint8_t* qstring = bam_get_qual(reader.record);
+    uint8_t* sequence = bam_get_seq(reader.record);
+
+    uint32_t seqlen = reader.record->core.l_qseq;
+    std::vector<uint8_t> qualities(seqlen);
+    std::vector<char> nucleotides(seqlen);
+
+    // Todo - there is a better way to do this.
+    for (int i = 0; i < seqlen; i++) {
+        qualities[i] = qstring[i] + 33;
+        nucleotides[i] = seq_nt16_str[bam_seqi(sequence, i)];
+    }
+
+    auto tmp_read = std::make_shared<Read>();
+    tmp_read->read_id = std::move(read_id);
+    tmp_read->seq = std::string(nucleotides.begin(), nucleotides.end());
+    tmp_read->qstring = std::string(qualities.begin(), qualities.end());
+    return tmp_read;
+}
+
+}  // namespace
+
 read_map read_bam(const std::string& filename, const std::unordered_set<std::string>& read_ids) {
     HtsReader reader(filename);
 
@@ -537,27 +1623,27 @@ read_map read_bam(const std::string& filename, const std::unordered_set<std::str
             continue;
         }
 
-        uint8_t* qstring = bam_get_qual(reader.record);
-        uint8_t* sequence = bam_get_seq(reader.record);
+        reads[read_id] = record_to_read(reader, read_id);
+    }
 
-        uint32_t seqlen = reader.record->core.l_qseq;
-        std::vector<uint8_t> qualities(seqlen);
-        std::vector<char> nucleotides(seqlen);
+    return reads;
+}
 
-        // Todo - there is a better way to do this.
-        for (int i = 0; i < seqlen; i++) {
-            qualities[i] = qstring[i] + 33;
-            nucleotides[i] = seq_nt16_str[bam_seqi(sequence, i)];
+void read_bam(const std::string& filename,
+              const std::unordered_set<std::string>& read_ids,
+              MessageSink& read_sink) {
+    HtsReader reader(filename);
+
+    while (reader.read()) {
+        std::string read_id = bam_get_qname(reader.record);
+
+        if (read_ids.find(read_id) == read_ids.end()) {
+            continue;
         }
 
-        auto tmp_read = std::make_shared<Read>();
-        tmp_read->read_id = read_id;
-        tmp_read->seq = std::string(nucleotides.begin(), nucleotides.end());
-        tmp_read->qstring = std::string(qualities.begin(), qualities.end());
-        reads[read_id] = tmp_read;
+        read_sink.push_message(record_to_read(reader, std::move(read_id)));
     }
-
-    return reads;
+    read_sink.terminate();
 }
 
 void add_rg_hdr(sam_hdr_t* hdr, const std::unordered_map<std::string, ReadGroup>& read_groups) {
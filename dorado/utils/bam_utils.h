@@ -1,17 +1,31 @@
 #pragma once
 #include "htslib/sam.h"
+#include "htslib/thread_pool.h"
 #include "minimap.h"
 #include "read_pipeline/ReadPipeline.h"
+#include "utils/ReadIdSet.h"
 #include "utils/types.h"
 
-#include <indicators/block_progress_bar.hpp>
-
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <set>
 #include <string>
+#include <thread>
+#include <vector>
 
 namespace dorado::utils {
 
+class MetricsRegistry;
+class ProgressReporter;
+
 using sq_t = std::vector<std::pair<char*, uint32_t>>;
 using read_map = std::unordered_map<std::string, std::shared_ptr<Read>>;
 
@@ -24,6 +38,37 @@ struct AlignmentOps {
     size_t substitutions;
 };
 
+// A minimap2 index, which comes in several parts if the reference is bigger than the index batch
+// size.  Aligners with the same reference and indexing options share one.
+struct MinimapIndex {
+    ~MinimapIndex();
+
+    std::vector<mm_idx_t*> parts;
+    // The target ID of each part's first sequence, as they're numbered in the output header.
+    std::vector<int32_t> tid_offsets;
+};
+
+// Has the indexes built from FASTA references written to directory, as .mmi files named by the
+// reference's checksum and the indexing options, for later runs to load instead of building
+// them again.  An empty directory, the default, means they're built every time.  Nothing is
+// ever evicted, so the cache is opt-in through --index-cache.
+void set_minimap_index_cache(const std::filesystem::path& directory);
+// Starts loading the index of filename in the background, for an Aligner made with the same
+// options to pick up, so that it's built while the rest of the pipeline is being set up.
+void preload_minimap_index(const std::string& filename,
+                           int k,
+                           int w,
+                           uint64_t index_batch_size,
+                           int threads);
+// Loads the index of filename, or takes the one already loaded, and keeps it loaded for as long
+// as the handle is held, so that Aligners made with the same options one after another share it
+// rather than each loading it again.
+std::shared_ptr<const MinimapIndex> hold_minimap_index(const std::string& filename,
+                                                       int k,
+                                                       int w,
+                                                       uint64_t index_batch_size,
+                                                       int threads);
+
 class Aligner : public MessageSink {
 public:
     Aligner(MessageSink& read_sink,
@@ -33,29 +78,65 @@ public:
             uint64_t index_batch_size,
             int threads);
     ~Aligner();
+    // How Reads pushed to the aligner are made into records, as ReadToBamType does it.
+    // BAM records can be pushed as well.
+    void set_read_conversion(bool emit_moves, bool rna, float modbase_threshold_frac);
     std::vector<BamPtr> align(bam1_t* record, mm_tbuf_t* buf);
+    std::vector<BamPtr> align(Read& read, mm_tbuf_t* buf);
     sq_t get_sequence_records_for_header();
+    uint32_t read_fields_used() const override { return m_emit_moves ? ReadFields::MOVES : 0; }
 
 private:
+    // Maximum number of records taken from the input queue at once.
+    static constexpr size_t kMaxBatchSize = 32;
+
+    // A batch of records, longest first, which any worker can take records from, so that one
+    // long read doesn't hold up the rest of the batch it came in.
+    struct SharedBatch {
+        std::vector<Message> records;
+        std::atomic<size_t> next{0};
+    };
+
     MessageSink& m_sink;
     size_t m_threads{1};
     std::atomic<size_t> m_active{0};
     std::vector<mm_tbuf_t*> m_tbufs;
     std::vector<std::unique_ptr<std::thread>> m_workers;
+    std::mutex m_batches_mutex;
+    std::deque<std::shared_ptr<SharedBatch>> m_batches;
     void worker_thread(size_t tid);
-    void add_tags(bam1_t*, const mm_reg1_t*, const std::string&, const mm_tbuf_t*);
+    // The alignments of seq, which give irecord's tags, or nothing if it doesn't map.
+    std::vector<BamPtr> align_sequence(const bam1_t* irecord,
+                                       const std::string& seq,
+                                       const std::vector<uint8_t>& qual,
+                                       mm_tbuf_t* buf);
+    // A batch with records left to align, if there is one.
+    std::shared_ptr<SharedBatch> next_shared_batch();
+    void add_tags(bam1_t*,
+                  const mm_reg1_t*,
+                  const std::string&,
+                  const mm_tbuf_t*,
+                  const mm_idx_t*,
+                  bool secondary);
 
     mm_idxopt_t m_idx_opt;
-    mm_mapopt_t m_map_opt;
-    mm_idx_t* m_index{nullptr};
-    mm_idx_reader_t* m_index_reader{nullptr};
+    // Mapping options, as updated for each part of the index.
+    std::vector<mm_mapopt_t> m_map_opts;
+    std::shared_ptr<const MinimapIndex> m_index;
+
+    bool m_emit_moves{false};
+    bool m_rna{false};
+    uint8_t m_modbase_threshold{0};
 };
 
 class HtsReader {
 public:
-    HtsReader(const std::string& filename);
+    // With threads > 0, records are decompressed (BAM) or parsed (SAM) on that many threads.
+    HtsReader(const std::string& filename, int threads = 0);
     ~HtsReader();
     bool read();
+    // Reads up to max_records new records into records, returning false if there were none.
+    bool read_batch(std::vector<BamPtr>& records, size_t max_records);
     void read(MessageSink& read_sink, int max_reads = -1);
     template <typename T>
     T get_tag(std::string tagname);
@@ -67,6 +148,9 @@ public:
     sam_hdr_t* header{nullptr};
 
 private:
+    // Number of records read ahead and pushed on together by read(MessageSink&).
+    static constexpr size_t kMaxBatchSize = 64;
+
     htsFile* m_file{nullptr};
 };
 
@@ -89,6 +173,59 @@ T HtsReader::get_tag(std::string tagname) {
     return tag_value;
 }
 
+// How HtsWriter sorts its records by coordinate, when set_sorted_output() is used.
+struct SortedOutputSettings {
+    // Directory runs of sorted records are spilled to, as temporary BAM files.  It's created if
+    // need be, and defaults to the output file's directory.
+    std::string scratch_directory;
+    // Bytes of records held in memory before they're sorted and spilled as a run.
+    size_t max_memory_bytes{size_t(2) << 30};
+};
+
+// Sorts BAM records by coordinate, as samtools sort does, in memory-bounded runs.  Once a run
+// takes up max_memory_bytes it's stably sorted and spilled to a temporary BAM in the scratch
+// directory, compressed at level 1 on the shared pool, and merge() then merges the runs on disk
+// with the last one in memory.  The runs are removed as they're merged.
+class CoordinateSorter {
+public:
+    // Runs are named <run_prefix>.tmp.<n>.bam, and written with a copy of header.  pool, which
+    // compresses and decompresses them, may be null.
+    CoordinateSorter(SortedOutputSettings settings,
+                     std::string run_prefix,
+                     const sam_hdr_t* header,
+                     htsThreadPool* pool);
+    ~CoordinateSorter();
+
+    void add(BamPtr record);
+    // Passes each record added to write, in coordinate order.  Records at the same position
+    // keep the order they were added in.
+    void merge(const std::function<void(bam1_t*)>& write);
+
+    // By reference, with unmapped records last, then position, then forward before reverse.
+    static bool less(const bam1_t* a, const bam1_t* b);
+
+private:
+    // More runs than this are merged a batch at a time into larger ones first, so that the final
+    // merge doesn't run out of file descriptors.
+    static constexpr size_t kMaxRunsMerged = 256;
+
+    void spill();
+    std::string next_run_path();
+    // Merges the runs at paths, and then the in-memory run if memory_run, into write.
+    void merge_runs(const std::vector<std::string>& paths,
+                    bool memory_run,
+                    const std::function<void(bam1_t*)>& write);
+
+    const SortedOutputSettings m_settings;
+    const std::string m_run_prefix;
+    sam_hdr_t* m_header{nullptr};
+    htsThreadPool* m_pool{nullptr};
+    std::vector<BamPtr> m_run;
+    size_t m_run_bytes{0};
+    std::vector<std::string> m_run_paths;
+    size_t m_num_runs_written{0};
+};
+
 class HtsWriter : public MessageSink {
 public:
     enum OutputMode {
@@ -96,15 +233,35 @@ public:
         BAM,
         SAM,
         FASTQ,
+        CRAM,
     };
 
     HtsWriter(const std::string& filename, OutputMode mode, size_t threads, size_t num_reads);
+    // Writes to an open file descriptor, e.g. a socket, which is left open for the caller
+    // to close once the writer has been destroyed.
+    HtsWriter(int fd, OutputMode mode, size_t threads, size_t num_reads);
     ~HtsWriter();
     void add_header(const sam_hdr_t* header);
+    // The FASTA reference CRAM output is compressed against, which needs a .fai alongside, or
+    // is indexed if it has none.  Without one, only unaligned records can be written to CRAM.
+    // Must be called before write_header().
+    void set_cram_reference(const std::string& fasta_path);
+    // Sorts the records by coordinate before writing them, and indexes the file as they're
+    // written, as a .bai, or a .csi if a reference is too long for one.  The records are held
+    // until the input terminates, so nothing is written until then.  Must be called before
+    // write_header(), and only for BAM written to a named file.
+    void set_sorted_output(SortedOutputSettings settings);
     int write_header();
     int write(bam1_t* record);
     void join();
 
+    // Takes count reads which won't be written, e.g. those dropped as they're loaded, off the
+    // number expected.  Thread safe.
+    void remove_expected_reads(size_t count);
+
+    // Adds the records written so far, and their uncompressed bytes, to registry.
+    void add_metrics(MetricsRegistry& registry) const;
+
     static OutputMode get_output_mode(std::string mode);
 
     size_t total{0};
@@ -115,18 +272,118 @@ public:
     sam_hdr_t* header{nullptr};
 
 private:
+    // Maximum number of records taken from the input queue at once.
+    static constexpr size_t kMaxBatchSize = 64;
+
+    HtsWriter(htsFile* file, const std::string& name, size_t threads, size_t num_reads);
+
     htsFile* m_file{nullptr};
+    const std::string m_name;
+    // Shared by the file's compression and formatting, and destroyed after it's closed.
+    htsThreadPool m_thread_pool{nullptr, 0};
+    std::optional<SortedOutputSettings> m_sorted_output;
+    // Made by write_header() with sorted output, once the header is final.
+    std::unique_ptr<CoordinateSorter> m_sorter;
     std::unique_ptr<std::thread> m_worker;
     void worker_thread();
     int write_hdr_sq(char* name, uint32_t length);
-    bool m_prog_bar_initialized{false};
-    size_t m_num_reads_expected;
-    int m_progress_bar_interval;
-    indicators::BlockProgressBar m_progress_bar{
-            indicators::option::Stream{std::cerr},     indicators::option::BarWidth{30},
-            indicators::option::ShowElapsedTime{true}, indicators::option::ShowRemainingTime{true},
-            indicators::option::ShowPercentage{true},
+    // Drawn from a thread of its own, so writing never waits on stderr.
+    std::unique_ptr<ProgressReporter> m_progress;
+    // Copies of total, and the bytes of the records, for reporting while writing.
+    std::atomic<size_t> m_num_records_written{0};
+    std::atomic<size_t> m_num_bytes_written{0};
+};
+
+// Where and how ShardedHtsWriter writes its files.
+struct ShardedOutputSettings {
+    // Directory the shards and manifest are written to, which is created if need be.
+    std::string directory;
+    // Number of files written at once, each by its own thread.
+    size_t num_shards{4};
+    // A shard moves on to a new file once its current one has this many records, or this many
+    // bytes of uncompressed records, and the read it's writing has all its records.  0 means no
+    // limit.
+    size_t max_records_per_file{0};
+    size_t max_bytes_per_file{0};
+    // How often each shard flushes its file and lists the records written since in the
+    // checkpoint.  0 checkpoints after every batch of records.
+    std::chrono::seconds checkpoint_interval{30};
+    // Carry on from the checkpoint a previous run left in directory, rather than starting over.
+    bool resume{false};
+};
+
+// Writes BAM records to several files in a directory at once, rather than to one stream.  Each
+// shard takes records off the input queue on its own thread and writes them to its own file, so
+// the shards never wait on each other, and they share one htslib pool for compression.  Once
+// every record is written, join() lists the files and their record counts, in manifest.tsv.
+//
+// So that an interrupted run can be resumed, each shard also flushes its file every
+// checkpoint_interval, and then appends the name of the file and the ID of each read in it since
+// the last checkpoint to checkpoint.tsv, followed by a line with the file's record count and the
+// offset its flushed records end at.  A read's records are never split by a checkpoint, so
+// everything the checkpoint lists is safely in a file.  Resuming loads the read IDs it lists, to
+// be skipped, cuts each old file back to its last checkpoint, removes those with none, and writes
+// the rest to new files alongside the old ones.  Reads written after the last checkpoint are
+// called again.
+class ShardedHtsWriter : public MessageSink {
+public:
+    // num_reads is how many reads are expected, for the progress bar, or 0 if it isn't known.
+    ShardedHtsWriter(ShardedOutputSettings settings, size_t compression_threads, size_t num_reads);
+    ~ShardedHtsWriter();
+    // Must be called before any records are pushed.  Each file starts with a copy of hdr.
+    void add_header(const sam_hdr_t* hdr);
+    void join();
+
+    // Takes count reads which won't be written off the number expected.  Thread safe.
+    void remove_expected_reads(size_t count);
+
+    // Adds the records written so far, and their uncompressed bytes, to registry.
+    void add_metrics(MetricsRegistry& registry) const;
+
+    // When resuming, the reads a previous run has already written, which needn't be called
+    // again.  Empty otherwise.
+    const ReadIdSet& completed_read_ids() const { return m_completed_read_ids; }
+
+    static constexpr const char* kManifestFileName = "manifest.tsv";
+    static constexpr const char* kCheckpointFileName = "checkpoint.tsv";
+
+private:
+    // Maximum number of records taken from the input queue at once.
+    static constexpr size_t kMaxBatchSize = 64;
+
+    struct ShardFile {
+        size_t shard;
+        size_t index;
+        std::string name;
+        size_t num_records;
     };
+
+    void shard_thread(size_t shard);
+    void write_manifest();
+    // Loads the files and read IDs listed in the checkpoint in m_settings.directory.
+    void load_checkpoint();
+    // Appends the IDs of the reads written to file_name since its last checkpoint, then a line
+    // committing them, with the file's record count and the offset its flushed records end at.
+    void write_checkpoint(const std::string& file_name,
+                          const std::vector<std::string>& read_ids,
+                          size_t num_records,
+                          uint64_t offset);
+
+    const ShardedOutputSettings m_settings;
+    sam_hdr_t* m_header{nullptr};
+    htsThreadPool m_thread_pool{nullptr, 0};
+    std::vector<std::thread> m_shard_threads;
+    std::mutex m_files_mutex;
+    std::vector<ShardFile> m_files;
+    // Where each shard's file numbering starts, past any files a resumed run left.
+    std::vector<size_t> m_first_file_index;
+    ReadIdSet m_completed_read_ids;
+    std::mutex m_checkpoint_mutex;
+    std::ofstream m_checkpoint;
+    std::atomic<size_t> m_num_records_written{0};
+    std::atomic<size_t> m_num_bytes_written{0};
+    // Shared by the shards, which count the reads they write.
+    std::unique_ptr<ProgressReporter> m_progress;
 };
 
 /**
@@ -146,6 +403,18 @@ private:
  */
 read_map read_bam(const std::string& filename, const std::unordered_set<std::string>& read_ids);
 
+/**
+ * @brief Reads the reads in read_ids from a HTS file one at a time, pushing each to read_sink as
+ *        it is read, so that they needn't all be held at once.
+ *
+ * @param filename The input BAM file path as a string.
+ * @param read_ids A set of read_ids to filter on.
+ * @param read_sink The sink to push the reads to, which is terminated after the last read.
+ */
+void read_bam(const std::string& filename,
+              const std::unordered_set<std::string>& read_ids,
+              MessageSink& read_sink);
+
 void add_rg_hdr(sam_hdr_t* hdr, const std::unordered_map<std::string, ReadGroup>& read_groups);
 
 void add_sq_hdr(sam_hdr_t* hdr, const sq_t& seqs);
@@ -1,5 +1,6 @@
 #include "base_mod_utils.h"
 
+#include "motif_scanner.h"
 #include "sequence_utils.h"
 
 #include <sstream>
@@ -68,15 +69,16 @@ std::string BaseModContext::encode() const {
 }
 
 std::vector<int> BaseModContext::get_sequence_mask(std::string_view sequence) const {
+    MotifScanner scanner;
+    for (size_t i = 0; i < 4; ++i) {
+        if (!m_motifs[i].empty()) {
+            scanner.add_motif(m_motifs[i], m_offsets[i]);
+        }
+    }
     std::vector<int> mask(sequence.size(), 0);
-    for (size_t p = 0; p < sequence.size(); ++p) {
-        auto idx = base_to_int(sequence[p]);
-        if (!m_motifs[idx].empty() && p >= m_offsets[idx] &&
-            p + m_motifs[idx].size() - m_offsets[idx] < sequence.size()) {
-            size_t a = p - m_offsets[idx];
-            if (sequence.substr(a, m_motifs[idx].size()) == m_motifs[idx]) {
-                mask[p] = 1;
-            }
+    for (const auto& hits : scanner.scan(sequence)) {
+        for (const auto hit : hits) {
+            mask[hit] = 1;
         }
     }
     return mask;
@@ -85,6 +87,7 @@ std::vector<int> BaseModContext::get_sequence_mask(std::string_view sequence) co
 void BaseModContext::update_mask(std::vector<int>& mask,
                                  const std::string& sequence,
                                  const std::string& modbase_alphabet,
+                                 const std::vector<uint32_t>& modbase_positions,
                                  const std::vector<uint8_t>& modbase_probs,
                                  uint8_t threshold) const {
     // Iterate over the provided alphabet and find all the bases that may be modified.
@@ -101,12 +104,21 @@ void BaseModContext::update_mask(std::vector<int>& mask,
                 // not be updated, regardless of the threshold.
                 continue;
             }
-            for (size_t base_idx = 0; base_idx < sequence.size(); base_idx++) {
-                if (sequence[base_idx] == current_cardinal) {
-                    if (modbase_probs[base_idx * num_channels + channel_idx] >= threshold) {
+            if (threshold == 0) {
+                // Even the bases which weren't scored pass.
+                for (size_t base_idx = 0; base_idx < sequence.size(); base_idx++) {
+                    if (sequence[base_idx] == current_cardinal) {
                         mask[base_idx] = 1;
                     }
                 }
+                continue;
+            }
+            for (size_t i = 0; i < modbase_positions.size(); i++) {
+                const auto base_idx = modbase_positions[i];
+                if (sequence[base_idx] == current_cardinal &&
+                    modbase_probs[i * num_channels + channel_idx] >= threshold) {
+                    mask[base_idx] = 1;
+                }
             }
         }
     }
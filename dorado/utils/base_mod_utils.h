@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <cstdint>
 #include <map>
 #include <string>
 #include <string_view>
@@ -80,6 +81,9 @@ public:
      * 
      *  Note that this function assumes that the provided mask vector was created via the
      *  get_sequence_mask method.
+     *
+     *  The probabilities are those of the bases at modbase_positions, in increasing order, one
+     *  for each channel of modbase_alphabet.  Any other base has a probability of 0.
      * 
      *  The mask will not be altered for any bases which have a context associated with them,
      *  as any such bases should only have their mask values determined by whether the context
@@ -89,6 +93,7 @@ public:
     void update_mask(std::vector<int>& mask,
                      const std::string& sequence,
                      const std::string& modbase_alphabet,
+                     const std::vector<uint32_t>& modbase_positions,
                      const std::vector<uint8_t>& modbase_probs,
                      uint8_t threshold) const;
 
@@ -4,8 +4,8 @@
 #include <optional>
 
 namespace dorado::utils {
-std::optional<std::unordered_set<std::string>> load_read_list(std::string read_list) {
-    std::unordered_set<std::string> read_ids;
+std::optional<ReadIdSet> load_read_list(std::string read_list) {
+    ReadIdSet read_ids;
 
     if (read_list == "") {
         return {};
@@ -20,8 +20,9 @@ std::optional<std::unordered_set<std::string>> load_read_list(std::string read_l
     std::string cell;
 
     while (std::getline(dataFile, cell)) {
-        read_ids.insert(cell);
+        read_ids.add(cell);
     }
+    read_ids.finalise();
     return read_ids;
 }
 }  // namespace dorado::utils
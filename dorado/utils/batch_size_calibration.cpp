@@ -0,0 +1,185 @@
+#include "batch_size_calibration.h"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+namespace dorado::utils {
+
+namespace {
+
+std::mutex s_cache_mutex;
+// Every entry found or inserted by this process, keyed by cache file and entry key.
+std::map<std::string, int> s_cached_values;
+
+std::string entry_key(const std::string& device_name, int chunk_size, int memory_gb) {
+    return device_name + '\t' + std::to_string(chunk_size) + '\t' + std::to_string(memory_gb);
+}
+
+std::string tuning_key(const std::string& device_id,
+                       const std::string& kernel_name,
+                       int layer_size,
+                       int batch_size) {
+    return device_id + '\t' + kernel_name + '\t' + std::to_string(layer_size) + '\t' +
+           std::to_string(batch_size);
+}
+
+std::optional<int> find_cached_value(const std::filesystem::path& cache_path,
+                                     const std::string& key) {
+    std::lock_guard lock(s_cache_mutex);
+    auto cached = s_cached_values.find(cache_path.string() + '\n' + key);
+    if (cached != s_cached_values.end()) {
+        return cached->second;
+    }
+
+    // One entry per line, as the fields of the key then the value, all tab separated.
+    // Later entries replace earlier ones.
+    std::optional<int> value;
+    std::ifstream stream(cache_path);
+    std::string line;
+    while (std::getline(stream, line)) {
+        const auto last_tab = line.rfind('\t');
+        if (last_tab == std::string::npos || line.compare(0, last_tab, key) != 0) {
+            continue;
+        }
+        std::istringstream field(line.substr(last_tab + 1));
+        int entry_value = 0;
+        if (field >> entry_value && entry_value > 0) {
+            value = entry_value;
+        }
+    }
+    if (value) {
+        s_cached_values[cache_path.string() + '\n' + key] = *value;
+    }
+    return value;
+}
+
+void insert_cached_value(const std::filesystem::path& cache_path,
+                         const std::string& key,
+                         int value) {
+    std::lock_guard lock(s_cache_mutex);
+    s_cached_values[cache_path.string() + '\n' + key] = value;
+
+    std::ofstream stream(cache_path, std::ios::app);
+    stream << key << '\t' << value << '\n';
+    if (!stream) {
+        spdlog::debug("Unable to write cache {}, it will not be reused", cache_path.string());
+    }
+}
+
+}  // namespace
+
+int max_batch_size_for_memory(const std::vector<BatchSizeMeasurement>& measurements,
+                              size_t memory_limit_bytes,
+                              int granularity) {
+    if (measurements.empty()) {
+        return 0;
+    }
+    const auto [smallest, largest] = std::minmax_element(
+            measurements.begin(), measurements.end(),
+            [](const auto& a, const auto& b) { return a.batch_size < b.batch_size; });
+    if (smallest->peak_memory_bytes > memory_limit_bytes) {
+        return 0;
+    }
+    if (largest->batch_size == smallest->batch_size ||
+        largest->peak_memory_bytes <= smallest->peak_memory_bytes) {
+        // Nothing to extrapolate from.
+        return largest->batch_size;
+    }
+
+    const double bytes_per_chunk =
+            double(largest->peak_memory_bytes - smallest->peak_memory_bytes) /
+            (largest->batch_size - smallest->batch_size);
+    const double max_batch_size =
+            smallest->batch_size +
+            (memory_limit_bytes - smallest->peak_memory_bytes) / bytes_per_chunk;
+    const int max_batches = static_cast<int>(std::min(max_batch_size / granularity, 1e6));
+    return std::max(smallest->batch_size, max_batches * granularity);
+}
+
+std::vector<int> batch_sizes_to_sweep(int max_batch_size, int granularity, int max_points) {
+    const int max_steps = max_batch_size / granularity;
+    std::vector<int> batch_sizes;
+    if (max_steps <= 0 || max_points <= 0) {
+        return batch_sizes;
+    }
+    const int steps_per_point = (max_steps + max_points - 1) / max_points;
+    // Count down from the largest batch size, so that it is always included.
+    for (int steps = max_steps; steps > 0; steps -= steps_per_point) {
+        batch_sizes.push_back(steps * granularity);
+    }
+    std::reverse(batch_sizes.begin(), batch_sizes.end());
+    return batch_sizes;
+}
+
+int select_batch_size(const std::vector<BatchSizeMeasurement>& measurements,
+                      size_t memory_limit_bytes) {
+    int best_batch_size = 0;
+    float best_chunks_per_second = 0.f;
+    for (const auto& measurement : measurements) {
+        if (measurement.peak_memory_bytes <= memory_limit_bytes &&
+            measurement.chunks_per_second > best_chunks_per_second) {
+            best_batch_size = measurement.batch_size;
+            best_chunks_per_second = measurement.chunks_per_second;
+        }
+    }
+    return best_batch_size;
+}
+
+int select_efficient_batch_size(const std::vector<BatchSizeMeasurement>& measurements,
+                                size_t memory_limit_bytes) {
+    int best_batch_size = 0;
+    float best_joules_per_chunk = 0.f;
+    for (const auto& measurement : measurements) {
+        if (measurement.peak_memory_bytes <= memory_limit_bytes &&
+            measurement.joules_per_chunk > 0.f &&
+            (best_batch_size == 0 || measurement.joules_per_chunk < best_joules_per_chunk)) {
+            best_batch_size = measurement.batch_size;
+            best_joules_per_chunk = measurement.joules_per_chunk;
+        }
+    }
+    return best_batch_size > 0 ? best_batch_size
+                               : select_batch_size(measurements, memory_limit_bytes);
+}
+
+BatchSizeCache::BatchSizeCache(const std::filesystem::path& model_path)
+        : m_cache_path(model_path / kCacheFileName) {}
+
+std::optional<int> BatchSizeCache::find(const std::string& device_name,
+                                        int chunk_size,
+                                        int memory_gb) const {
+    return find_cached_value(m_cache_path, entry_key(device_name, chunk_size, memory_gb));
+}
+
+void BatchSizeCache::insert(const std::string& device_name,
+                            int chunk_size,
+                            int memory_gb,
+                            int batch_size) {
+    insert_cached_value(m_cache_path, entry_key(device_name, chunk_size, memory_gb), batch_size);
+}
+
+KernelTuningCache::KernelTuningCache(const std::filesystem::path& model_path)
+        : m_cache_path(model_path / kCacheFileName) {}
+
+std::optional<int> KernelTuningCache::find(const std::string& device_id,
+                                           const std::string& kernel_name,
+                                           int layer_size,
+                                           int batch_size) const {
+    return find_cached_value(m_cache_path,
+                             tuning_key(device_id, kernel_name, layer_size, batch_size));
+}
+
+void KernelTuningCache::insert(const std::string& device_id,
+                               const std::string& kernel_name,
+                               int layer_size,
+                               int batch_size,
+                               int value) {
+    insert_cached_value(m_cache_path, tuning_key(device_id, kernel_name, layer_size, batch_size),
+                        value);
+}
+
+}  // namespace dorado::utils
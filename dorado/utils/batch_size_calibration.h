@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace dorado::utils {
+
+// Peak device memory and throughput of a model's forward pass at one batch size, and the energy
+// it took per chunk, if that was measured.
+struct BatchSizeMeasurement {
+    int batch_size;
+    size_t peak_memory_bytes;
+    float chunks_per_second;
+    // 0 if not measured.
+    float joules_per_chunk{0.f};
+};
+
+// Extrapolates from the smallest and largest of measurements, assuming peak memory grows
+// linearly with batch size, to find the largest multiple of granularity which should fit
+// in memory_limit_bytes.  Returns 0 if measurements is empty or the smallest measured
+// batch size already exceeds the limit.
+int max_batch_size_for_memory(const std::vector<BatchSizeMeasurement>& measurements,
+                              size_t memory_limit_bytes,
+                              int granularity);
+
+// Up to max_points evenly spaced multiples of granularity, the last of which is
+// max_batch_size rounded down to a multiple of granularity.
+std::vector<int> batch_sizes_to_sweep(int max_batch_size, int granularity, int max_points);
+
+// The measured batch size with the highest throughput whose peak memory is within
+// memory_limit_bytes, or 0 if there is none.
+int select_batch_size(const std::vector<BatchSizeMeasurement>& measurements,
+                      size_t memory_limit_bytes);
+
+// The measured batch size taking the least energy per chunk whose peak memory is within
+// memory_limit_bytes, for the most samples per joule.  Falls back to select_batch_size() if
+// none of them had their energy measured.
+int select_efficient_batch_size(const std::vector<BatchSizeMeasurement>& measurements,
+                                size_t memory_limit_bytes);
+
+// Batch sizes chosen by calibration, so that later runs of the same model can skip it.
+// Entries are keyed by device name, chunk size, and the memory available to the model in
+// whole GB, and are kept in a file in the model directory.  If that can't be written,
+// entries are only kept for the lifetime of the process.
+class BatchSizeCache {
+public:
+    static constexpr const char* kCacheFileName = ".dorado_batch_sizes";
+
+    explicit BatchSizeCache(const std::filesystem::path& model_path);
+
+    std::optional<int> find(const std::string& device_name, int chunk_size, int memory_gb) const;
+    void insert(const std::string& device_name, int chunk_size, int memory_gb, int batch_size);
+
+private:
+    std::filesystem::path m_cache_path;
+};
+
+// Kernel launch parameters chosen by benchmarking candidates on the device, kept alongside
+// BatchSizeCache entries in the same way.  Entries are keyed by device, kernel name, layer
+// size and batch size, and hold a single integer parameter such as the SIMD group count.
+class KernelTuningCache {
+public:
+    static constexpr const char* kCacheFileName = ".dorado_kernel_tuning";
+
+    explicit KernelTuningCache(const std::filesystem::path& model_path);
+
+    std::optional<int> find(const std::string& device_id,
+                            const std::string& kernel_name,
+                            int layer_size,
+                            int batch_size) const;
+    void insert(const std::string& device_id,
+                const std::string& kernel_name,
+                int layer_size,
+                int batch_size,
+                int value);
+
+private:
+    std::filesystem::path m_cache_path;
+};
+
+}  // namespace dorado::utils
@@ -0,0 +1,72 @@
+#include "chunk_size_selection.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+namespace dorado::utils {
+
+uint64_t called_samples(uint64_t num_samples,
+                        const std::vector<size_t>& chunk_sizes,
+                        size_t overlap) {
+    assert(!chunk_sizes.empty() && chunk_sizes.back() > overlap);
+    const uint64_t max_chunk_size = chunk_sizes.back();
+    // The smallest chunk size of at least min_size, which is never more than max_chunk_size.
+    auto fitting_chunk_size = [&chunk_sizes](uint64_t min_size) -> uint64_t {
+        return *std::lower_bound(chunk_sizes.begin(), std::prev(chunk_sizes.end()), min_size);
+    };
+    if (num_samples <= max_chunk_size) {
+        return fitting_chunk_size(num_samples);
+    }
+    // Full chunks a step apart, then one of the chunk sizes to cover what's left.
+    const uint64_t step = max_chunk_size - overlap;
+    uint64_t num_full_chunks = 1;
+    if (num_samples > step + max_chunk_size) {
+        num_full_chunks += (num_samples - step - max_chunk_size - 1) / step + 1;
+    }
+    const uint64_t last_chunk_start = num_full_chunks * step;
+    return num_full_chunks * max_chunk_size + fitting_chunk_size(num_samples - last_chunk_start);
+}
+
+std::vector<size_t> chunk_size_candidates(size_t max_chunk_size, size_t overlap, size_t step) {
+    std::vector<size_t> candidates;
+    // Chunks must be at least twice the overlap, for each to call some signal of its own.
+    for (size_t chunk_size = step; chunk_size < max_chunk_size; chunk_size += step) {
+        if (chunk_size > 2 * overlap) {
+            candidates.push_back(chunk_size);
+        }
+    }
+    candidates.push_back(max_chunk_size);
+    return candidates;
+}
+
+size_t select_chunk_size(const std::vector<uint64_t>& read_lengths,
+                         const std::vector<size_t>& candidates,
+                         const std::vector<size_t>& bucket_chunk_sizes,
+                         size_t overlap,
+                         float min_saving) {
+    auto sorted_candidates = candidates;
+    std::sort(sorted_candidates.begin(), sorted_candidates.end());
+    size_t best_chunk_size = sorted_candidates.back();
+    uint64_t best_samples = 0;
+    // From the largest down, so each smaller one has to beat the best so far by min_saving.
+    for (auto it = sorted_candidates.rbegin(); it != sorted_candidates.rend(); ++it) {
+        std::vector<size_t> chunk_sizes;
+        std::copy_if(bucket_chunk_sizes.begin(), bucket_chunk_sizes.end(),
+                     std::back_inserter(chunk_sizes), [it](size_t size) { return size < *it; });
+        std::sort(chunk_sizes.begin(), chunk_sizes.end());
+        chunk_sizes.push_back(*it);
+
+        uint64_t samples = 0;
+        for (const auto length : read_lengths) {
+            samples += called_samples(length, chunk_sizes, overlap);
+        }
+        if (it == sorted_candidates.rbegin() || samples < best_samples * (1.0 - min_saving)) {
+            best_chunk_size = *it;
+            best_samples = samples;
+        }
+    }
+    return best_chunk_size;
+}
+
+}  // namespace dorado::utils
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace dorado::utils {
+
+// Samples the basecaller calls for a read of num_samples, counting the padding of chunks which
+// overhang its end and the signal called twice where chunks overlap, as chunk_read() splits it
+// into chunks of chunk_sizes, ascending, overlapping by overlap.
+uint64_t called_samples(uint64_t num_samples,
+                        const std::vector<size_t>& chunk_sizes,
+                        size_t overlap);
+
+// Candidate chunk sizes for select_chunk_size(): every multiple of step from the smallest
+// worth calling with overlap up to max_chunk_size, which is always included.
+std::vector<size_t> chunk_size_candidates(size_t max_chunk_size, size_t overlap, size_t step);
+
+// The candidate chunk size which calls read_lengths, a sample of a run's reads' signal
+// lengths, in the fewest samples, with any bucket_chunk_sizes smaller than it as well.  Calling
+// throughput per sample is much the same across chunk sizes, since batch sizes are picked to
+// fill the device at each, so the fewest samples called is the fastest.  A smaller chunk size
+// is only picked if it saves at least min_saving of the samples a larger one calls, since more
+// chunks take more stitching.  Returns the largest candidate if read_lengths is empty.
+size_t select_chunk_size(const std::vector<uint64_t>& read_lengths,
+                         const std::vector<size_t>& candidates,
+                         const std::vector<size_t>& bucket_chunk_sizes,
+                         size_t overlap,
+                         float min_saving = 0.02f);
+
+}  // namespace dorado::utils
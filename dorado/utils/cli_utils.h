@@ -9,8 +9,13 @@
 #include <algorithm>
 #include <cctype>
 #include <cmath>
+#include <filesystem>
+#include <optional>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 #ifdef _WIN32
@@ -128,6 +133,70 @@ inline uint64_t parse_string_to_size(const std::string& num_str) {
     return size_num * multiplier;
 }
 
+// Parses a comma separated list of channels and inclusive ranges of them, e.g. "1-64,100".
+inline std::unordered_set<int32_t> parse_channel_list(const std::string& channel_list) {
+    std::unordered_set<int32_t> channels;
+    std::istringstream list_stream(channel_list);
+    std::string item;
+    while (std::getline(list_stream, item, ',')) {
+        const auto dash = item.find('-');
+        int32_t first = 0, last = 0;
+        try {
+            size_t first_end = 0, last_end = 0;
+            first = std::stoi(item, &first_end);
+            last = dash == std::string::npos ? first
+                                             : std::stoi(item.substr(dash + 1), &last_end);
+            if (first_end != (dash == std::string::npos ? item.size() : dash) ||
+                (dash != std::string::npos && dash + 1 + last_end != item.size())) {
+                throw std::invalid_argument(item);
+            }
+        } catch (const std::logic_error&) {
+            throw std::runtime_error("Invalid channel list " + channel_list +
+                                     ", expected e.g. 1-64,100");
+        }
+        if (first <= 0 || last < first) {
+            throw std::runtime_error("Invalid channel range " + item + " in " + channel_list);
+        }
+        for (int32_t channel = first; channel <= last; ++channel) {
+            channels.insert(channel);
+        }
+    }
+    return channels;
+}
+
+// Splits a device string such as "cuda:all,cpu" or "metal,cpu", for CPU runners alongside the
+// GPU's, into the GPU's device string and whether CPU runners were asked for too.  Other
+// device strings, including "cpu" itself, are returned as they are.
+inline std::pair<std::string, bool> split_cpu_from_device(const std::string& device) {
+    constexpr std::string_view kCpuSuffix = ",cpu";
+    if (device.size() > kCpuSuffix.size() &&
+        device.compare(device.size() - kCpuSuffix.size(), kCpuSuffix.size(), kCpuSuffix) == 0) {
+        return {device.substr(0, device.size() - kCpuSuffix.size()), true};
+    }
+    return {device, false};
+}
+
+// Resolves path, relative to root unless it's absolute, and returns it if it exists and
+// lies within root.  Symbolic links are followed first, so they can't lead outside root.
+inline std::optional<std::filesystem::path> resolve_path_within(const std::filesystem::path& root,
+                                                                const std::string& path) {
+    std::error_code error;
+    const auto canonical_root = std::filesystem::canonical(root, error);
+    if (error) {
+        return std::nullopt;
+    }
+    auto resolved = std::filesystem::canonical(canonical_root / path, error);
+    if (error) {
+        return std::nullopt;
+    }
+    const auto mismatch = std::mismatch(canonical_root.begin(), canonical_root.end(),
+                                        resolved.begin(), resolved.end());
+    if (mismatch.first != canonical_root.end()) {
+        return std::nullopt;
+    }
+    return resolved;
+}
+
 }  // namespace utils
 
 }  // namespace dorado
@@ -0,0 +1,122 @@
+#include "cpu_dispatch.h"
+
+#include <mutex>
+#include <stdexcept>
+
+namespace {
+
+using dorado::utils::CpuIsa;
+
+// Order within an architecture, or 0 for GENERIC.
+int isa_level(CpuIsa isa) {
+    switch (isa) {
+    case CpuIsa::AVX2:
+    case CpuIsa::NEON:
+        return 1;
+    case CpuIsa::AVX512:
+    case CpuIsa::SVE:
+        return 2;
+    default:
+        return 0;
+    }
+}
+
+CpuIsa best_supported_isa() {
+    for (auto isa : {CpuIsa::AVX512, CpuIsa::SVE, CpuIsa::AVX2, CpuIsa::NEON}) {
+        if (dorado::utils::cpu_supports(isa)) {
+            return isa;
+        }
+    }
+    return CpuIsa::GENERIC;
+}
+
+std::mutex isa_mutex;
+CpuIsa active_isa = CpuIsa::GENERIC;
+bool active_isa_set = false;
+
+}  // namespace
+
+namespace dorado::utils {
+
+namespace details {
+
+std::atomic<unsigned> cpu_isa_generation{0};
+
+int cpu_isa_rank(CpuIsa isa) {
+    if (isa == CpuIsa::GENERIC || !cpu_supports(isa) || isa_level(isa) > isa_level(cpu_isa())) {
+        return 0;
+    }
+    return isa_level(isa);
+}
+
+}  // namespace details
+
+bool cpu_supports(CpuIsa isa) {
+    const auto& features = cpu_features();
+    switch (isa) {
+    case CpuIsa::GENERIC:
+        return true;
+    case CpuIsa::AVX2:
+        return features.avx2;
+    case CpuIsa::AVX512:
+        return features.avx512;
+    case CpuIsa::NEON:
+        return features.neon;
+    case CpuIsa::SVE:
+        return features.sve;
+    }
+    return false;
+}
+
+CpuIsa cpu_isa() {
+    std::lock_guard lock(isa_mutex);
+    if (!active_isa_set) {
+        active_isa = best_supported_isa();
+        active_isa_set = true;
+    }
+    return active_isa;
+}
+
+void set_cpu_isa(CpuIsa isa) {
+    if (!cpu_supports(isa)) {
+        throw std::runtime_error("This CPU doesn't support " + to_string(isa) +
+                                 ", only: " + describe_cpu_features());
+    }
+    {
+        std::lock_guard lock(isa_mutex);
+        active_isa = isa;
+        active_isa_set = true;
+    }
+    if (details::cpu_isa_generation.fetch_add(1, std::memory_order_acq_rel) + 1 ==
+        details::kUnresolved) {
+        details::cpu_isa_generation.fetch_add(1, std::memory_order_acq_rel);
+    }
+}
+
+CpuIsa parse_cpu_isa(const std::string& name) {
+    for (auto isa : {CpuIsa::GENERIC, CpuIsa::AVX2, CpuIsa::AVX512, CpuIsa::NEON, CpuIsa::SVE}) {
+        if (name == to_string(isa)) {
+            return isa;
+        }
+    }
+    throw std::runtime_error("Unknown CPU instruction set: " + name +
+                             ", expected generic, avx2, avx512, neon or sve");
+}
+
+std::string to_string(CpuIsa isa) {
+    switch (isa) {
+    case CpuIsa::GENERIC:
+        return "generic";
+    case CpuIsa::AVX2:
+        return "avx2";
+    case CpuIsa::AVX512:
+        return "avx512";
+    case CpuIsa::NEON:
+        return "neon";
+    case CpuIsa::SVE:
+        return "sve";
+    }
+    return "unknown";
+}
+
+}  // namespace dorado::utils
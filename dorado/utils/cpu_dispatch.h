@@ -0,0 +1,107 @@
+#pragma once
+
+#include "cpu_features.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <initializer_list>
+#include <string>
+#include <utility>
+
+namespace dorado::utils {
+
+// Instruction sets CPU kernels can be written for.  Within each architecture, later ones are
+// preferred: AVX-512 over AVX2 on x86-64, and SVE over NEON on AArch64.
+enum class CpuIsa {
+    GENERIC,
+    AVX2,    // With FMA and F16C, as every AVX2 CPU has.
+    AVX512,  // F, BW, DQ and VL.
+    NEON,
+    SVE,
+};
+
+bool cpu_supports(CpuIsa isa);
+// The most capable instruction set kernels may use, which is the best the CPU supports unless
+// set_cpu_isa() has limited it.
+CpuIsa cpu_isa();
+// Limits kernels to isa and those before it, e.g. to benchmark them with --cpu-isa.  Throws if
+// the CPU doesn't support isa.
+void set_cpu_isa(CpuIsa isa);
+// Accepts the names to_string() gives: generic, avx2, avx512, neon and sve.
+CpuIsa parse_cpu_isa(const std::string& name);
+std::string to_string(CpuIsa isa);
+
+namespace details {
+// Bumped by set_cpu_isa(), so that CpuDispatch resolves its kernel again.  It skips
+// kUnresolved.
+extern std::atomic<unsigned> cpu_isa_generation;
+constexpr unsigned kUnresolved = ~0u;
+// Whether a kernel written for isa may be called, and if so its rank among those that may.
+int cpu_isa_rank(CpuIsa isa);
+}  // namespace details
+
+// A family of implementations of one kernel, which calls the one for the most capable
+// instruction set that cpu_isa() allows.  The kernel is resolved on first call, and again after
+// set_cpu_isa(), so calls cost an indirect call, as with function multiversioning.
+//
+//   const CpuDispatch<decltype(sum_generic)> sum(sum_generic, {{CpuIsa::AVX2, sum_avx2}});
+//
+// Null implementations, e.g. those compiled out on other platforms, are left out.  There can be
+// one implementation for each instruction set but GENERIC.  The constructor is constexpr, so a
+// CpuDispatch at namespace scope is constant initialised, and can be called from another
+// translation unit's static initialisers.
+template <typename Fn>
+class CpuDispatch {
+public:
+    constexpr CpuDispatch(Fn* generic, std::initializer_list<std::pair<CpuIsa, Fn*>> impls = {})
+            : m_generic(generic) {
+        for (const auto& impl : impls) {
+            if (impl.second && m_num_impls < m_impls.size()) {
+                m_impls[m_num_impls].isa = impl.first;
+                m_impls[m_num_impls].fn = impl.second;
+                ++m_num_impls;
+            }
+        }
+    }
+
+    template <typename... Args>
+    decltype(auto) operator()(Args&&... args) const {
+        return resolve()(std::forward<Args>(args)...);
+    }
+
+    Fn* resolve() const {
+        const unsigned generation = details::cpu_isa_generation.load(std::memory_order_acquire);
+        if (m_generation.load(std::memory_order_acquire) != generation) {
+            Fn* best = m_generic;
+            int best_rank = 0;
+            for (size_t i = 0; i < m_num_impls; ++i) {
+                const auto& impl = m_impls[i];
+                if (const int rank = details::cpu_isa_rank(impl.isa); rank > best_rank) {
+                    best = impl.fn;
+                    best_rank = rank;
+                }
+            }
+            // Racing threads resolve the same kernel, so it doesn't matter which stores last.
+            m_resolved.store(best, std::memory_order_release);
+            m_generation.store(generation, std::memory_order_release);
+            return best;
+        }
+        return m_resolved.load(std::memory_order_acquire);
+    }
+
+private:
+    struct Impl {
+        CpuIsa isa{CpuIsa::GENERIC};
+        Fn* fn{nullptr};
+    };
+
+    Fn* m_generic;
+    std::array<Impl, 4> m_impls{};
+    size_t m_num_impls{0};
+    mutable std::atomic<Fn*> m_resolved{nullptr};
+    // Never a generation cpu_isa_generation reaches, so the first call resolves the kernel.
+    mutable std::atomic<unsigned> m_generation{details::kUnresolved};
+};
+
+}  // namespace dorado::utils
@@ -0,0 +1,103 @@
+#include "cpu_features.h"
+
+#include <cstdint>
+
+#if defined(__linux__) && defined(__aarch64__)
+#include <sys/auxv.h>
+// Older kernel headers don't have them.
+#ifndef HWCAP_SVE
+#define HWCAP_SVE (1 << 22)
+#endif
+#ifndef HWCAP2_BF16
+#define HWCAP2_BF16 (1 << 14)
+#endif
+#elif defined(__x86_64__) && defined(__GNUC__)
+#include <cpuid.h>
+#endif
+
+namespace {
+
+using dorado::utils::CpuFeatures;
+
+#if defined(__x86_64__) && defined(__GNUC__)
+// Which register state the OS saves, and so which vector registers may be used.  cpuid
+// reports what the CPU has, whether or not the OS enables it.
+uint64_t xgetbv() {
+    uint32_t eax, edx;
+    __asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return (uint64_t(edx) << 32) | eax;
+}
+#endif
+
+// Read straight from cpuid rather than with __builtin_cpu_supports, since TSan's init breaks
+// the __cpu_indicator_init that needs.
+CpuFeatures detect_cpu_features() {
+    CpuFeatures features;
+#if defined(__x86_64__) && defined(__GNUC__)
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return features;
+    }
+    const bool fma = ecx & bit_FMA;
+    const bool f16c = ecx & bit_F16C;
+    const uint64_t xcr0 = (ecx & bit_OSXSAVE) ? xgetbv() : 0;
+    // SSE and AVX state, and for AVX-512 also the opmask and upper ZMM state.
+    const bool avx_state = (xcr0 & 0x6) == 0x6;
+    const bool avx512_state = (xcr0 & 0xe6) == 0xe6;
+
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return features;
+    }
+    features.avx2 = avx_state && fma && f16c && (ebx & bit_AVX2);
+    // F, DQ, BW and VL are bits 16, 17, 30 and 31 of EBX, and FP16 bit 23 of EDX.
+    constexpr unsigned int kAvx512Subsets = (1u << 16) | (1u << 17) | (1u << 30) | (1u << 31);
+    features.avx512 = features.avx2 && avx512_state && (ebx & kAvx512Subsets) == kAvx512Subsets;
+    features.avx512_fp16 = features.avx512 && (edx & (1u << 23));
+    // AVX512_BF16 is bit 5 of EAX in leaf 7, subleaf 1.
+    if (features.avx512 && __get_cpuid_count(7, 1, &eax, &ebx, &ecx, &edx)) {
+        features.avx512_bf16 = eax & (1u << 5);
+    }
+#elif defined(__aarch64__)
+    // NEON is part of every AArch64 CPU.
+    features.neon = true;
+#if defined(__linux__)
+    features.sve = getauxval(AT_HWCAP) & HWCAP_SVE;
+    features.arm_bf16 = getauxval(AT_HWCAP2) & HWCAP2_BF16;
+#endif
+#endif
+    return features;
+}
+
+}  // namespace
+
+namespace dorado::utils {
+
+const CpuFeatures& cpu_features() {
+    static const CpuFeatures features = detect_cpu_features();
+    return features;
+}
+
+std::string describe_cpu_features() {
+    const auto& features = cpu_features();
+    std::string description;
+    auto add = [&description](bool supported, const char* name) {
+        if (supported) {
+            description += description.empty() ? name : std::string(" ") + name;
+        }
+    };
+    add(features.avx2, "avx2");
+    add(features.avx512, "avx512");
+    add(features.avx512_fp16, "avx512_fp16");
+    add(features.avx512_bf16, "avx512_bf16");
+    add(features.neon, "neon");
+    add(features.sve, "sve");
+    add(features.arm_bf16, "bf16");
+    return description.empty() ? "generic" : description;
+}
+
+bool cpu_has_bf16_matmul() {
+    const auto& features = cpu_features();
+    return features.avx512_bf16 || features.arm_bf16;
+}
+
+}  // namespace dorado::utils
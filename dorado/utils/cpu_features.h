@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+
+namespace dorado::utils {
+
+// What the CPU, and the OS, support, detected once on first use.  Detected at runtime, so the
+// same binary runs everywhere.
+struct CpuFeatures {
+    bool avx2{false};    // With FMA and F16C, as every AVX2 CPU has.
+    bool avx512{false};  // F, BW, DQ and VL.
+    bool avx512_fp16{false};
+    bool avx512_bf16{false};
+    bool neon{false};
+    bool sve{false};
+    bool arm_bf16{false};
+};
+const CpuFeatures& cpu_features();
+// e.g. "avx2 avx512 avx512_bf16", or "generic".
+std::string describe_cpu_features();
+
+// Whether the CPU has bf16 matrix multiply instructions, i.e. BF16 on Arm (Graviton 3, Grace)
+// or AVX512_BF16 on x86, with which oneDNN runs bf16 matmuls and convolutions at about twice
+// the throughput of fp32.
+bool cpu_has_bf16_matmul();
+
+}  // namespace dorado::utils
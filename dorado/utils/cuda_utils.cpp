@@ -1,7 +1,12 @@
 #include "cuda_utils.h"
 
+#include "GpuMonitor.h"
+#include "MemoryBudget.h"
+#include "MetricsServer.h"
+#include "TensorPool.h"
+#include "batch_size_calibration.h"
 #include "cxxpool.h"
-#include "math_utils.h"
+#include "thread_utils.h"
 
 #include <torch/torch.h>
 
@@ -10,19 +15,33 @@ extern "C" {
 }
 
 #include <ATen/cuda/CUDAContext.h>
+#include <c10/cuda/CUDACachingAllocator.h>
 #include <c10/cuda/CUDAGuard.h>
+#include <cublasLt.h>
 #include <cublas_v2.h>
 #include <cuda_runtime.h>
 #include <cuda_runtime_api.h>
+#include <nvml.h>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
 #include <array>
+#include <cctype>
 #include <chrono>
-#include <limits>
+#include <csignal>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <optional>
 #include <regex>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 using namespace std::chrono;
 
@@ -83,6 +102,65 @@ public:
     }
 };
 
+void check_cublaslt(cublasStatus_t res) {
+    if (res != CUBLAS_STATUS_SUCCESS) {
+        spdlog::error("CuBLASLt error {}", int(res));
+        exit(EXIT_FAILURE);
+    }
+}
+
+// A cuBLASLt matmul for one device, shape and set of strides, with the algorithm cuBLASLt's
+// heuristic picked for it.  Plans are shared between threads, so they have no workspace.
+class CublasLtMatmulPlan {
+public:
+    // Row major C[M, N] = A[M, K] B[K, N] is column major C^T = B^T A^T.
+    CublasLtMatmulPlan(cublasLtHandle_t handle,
+                       int64_t M,
+                       int64_t N,
+                       int64_t K,
+                       int64_t lda,
+                       int64_t ldb,
+                       int64_t ldc)
+            : m_handle(handle) {
+        check_cublaslt(cublasLtMatmulDescCreate(&m_desc, CUBLAS_COMPUTE_16F, CUDA_R_16F));
+        check_cublaslt(cublasLtMatrixLayoutCreate(&m_b_layout, CUDA_R_16F, N, K, ldb));
+        check_cublaslt(cublasLtMatrixLayoutCreate(&m_a_layout, CUDA_R_16F, K, M, lda));
+        check_cublaslt(cublasLtMatrixLayoutCreate(&m_c_layout, CUDA_R_16F, N, M, ldc));
+
+        cublasLtMatmulPreference_t preference;
+        check_cublaslt(cublasLtMatmulPreferenceCreate(&preference));
+        const size_t workspace_size = 0;
+        check_cublaslt(cublasLtMatmulPreferenceSetAttribute(
+                preference, CUBLASLT_MATMUL_PREF_MAX_WORKSPACE_BYTES, &workspace_size,
+                sizeof(workspace_size)));
+        cublasLtMatmulHeuristicResult_t heuristic{};
+        int num_results = 0;
+        check_cublaslt(cublasLtMatmulAlgoGetHeuristic(m_handle, m_desc, m_b_layout, m_a_layout,
+                                                      m_c_layout, m_c_layout, preference, 1,
+                                                      &heuristic, &num_results));
+        cublasLtMatmulPreferenceDestroy(preference);
+        if (num_results == 0) {
+            spdlog::error("CuBLASLt has no algorithm for a {}x{}x{} matmul", M, N, K);
+            exit(EXIT_FAILURE);
+        }
+        m_algo = heuristic.algo;
+    }
+
+    void run(const void *A, const void *B, void *C, cudaStream_t stream) const {
+        constexpr uint16_t HALF_ZERO = 0;      // 0.0 in __half format
+        constexpr uint16_t HALF_ONE = 0x3C00;  // 1.0 in __half format
+        check_cublaslt(cublasLtMatmul(m_handle, m_desc, &HALF_ONE, B, m_b_layout, A, m_a_layout,
+                                      &HALF_ZERO, C, m_c_layout, C, m_c_layout, &m_algo, nullptr,
+                                      0, stream));
+    }
+
+private:
+    cublasLtHandle_t m_handle;
+    cublasLtMatmulDesc_t m_desc;
+    cublasLtMatrixLayout_t m_a_layout, m_b_layout, m_c_layout;
+    cublasLtMatmulAlgo_t m_algo;
+};
+
 }  // namespace
 
 namespace details {
@@ -106,6 +184,40 @@ void matmul_f16_cublas(torch::Tensor const &A, torch::Tensor const &B, torch::Te
     }
 }
 
+void matmul_f16_cublaslt(torch::Tensor const &A, torch::Tensor const &B, torch::Tensor &C) {
+    assert(A.dtype() == torch::kF16 && B.dtype() == torch::kF16 && C.dtype() == torch::kF16);
+    assert(A.stride(1) == 1 && B.stride(1) == 1 && C.stride(1) == 1);
+    assert(A.size(0) == C.size(0));  // M
+    assert(B.size(1) == C.size(1));  // N
+    assert(A.size(1) == B.size(0));  // K
+
+    // The LSTM layers make the same few matmuls for every timestep of every chunk, so the
+    // descriptors and the heuristic's pick are made once for each.  They live for the rest of
+    // the process, which also keeps them clear of CUDA's teardown.
+    using PlanKey = std::array<int64_t, 7>;
+    static std::mutex mutex;
+    static auto &handles = *new std::map<int, cublasLtHandle_t>();
+    static auto &plans = *new std::map<PlanKey, std::unique_ptr<CublasLtMatmulPlan>>();
+    const int device = A.get_device();
+    const PlanKey key{device, A.size(0), B.size(1), A.size(1), A.stride(0), B.stride(0),
+                      C.stride(0)};
+    const CublasLtMatmulPlan *plan = nullptr;
+    {
+        std::lock_guard lock(mutex);
+        auto &handle = handles[device];
+        if (!handle) {
+            check_cublaslt(cublasLtCreate(&handle));
+        }
+        auto &cached = plans[key];
+        if (!cached) {
+            cached = std::make_unique<CublasLtMatmulPlan>(handle, key[1], key[2], key[3], key[4],
+                                                          key[5], key[6]);
+        }
+        plan = cached.get();
+    }
+    plan->run(A.data_ptr(), B.data_ptr(), C.data_ptr(), at::cuda::getCurrentCUDAStream());
+}
+
 void matmul_f16_torch(torch::Tensor const &A, torch::Tensor const &B, torch::Tensor &C) {
     C.copy_(torch::matmul(A, B));
 }
@@ -114,8 +226,9 @@ void matmul_f16_torch(torch::Tensor const &A, torch::Tensor const &B, torch::Ten
 
 void matmul_f16(torch::Tensor const &A, torch::Tensor const &B, torch::Tensor &C) {
     // torch::matmul() is a bit slower than cublasGemmEx() on A100 and half the speed on V100,
-    // but an order of magnitude faster on our Windows CI machines (1080 Ti), so dynamically
-    // pick which one we should use on first invocation.
+    // but an order of magnitude faster on our Windows CI machines (1080 Ti), and cuBLASLt's
+    // heuristics can beat both on newer GPUs, so dynamically pick which one we should use on
+    // first invocation.  Any which disagrees with torch::matmul() isn't considered.
     static auto const fastest_mat_mul = [] {
         CUDATimer cuda_timer;
 
@@ -126,9 +239,11 @@ void matmul_f16(torch::Tensor const &A, torch::Tensor const &B, torch::Tensor &C
         const int N = 384;
 
         auto options = torch::TensorOptions().dtype(torch::kFloat16).device(c10::kCUDA);
-        auto a = torch::empty({L, M}, options);
-        auto b = torch::empty({M, N}, options);
+        auto a = torch::rand({L, M}, options);
+        auto b = torch::rand({M, N}, options);
         auto c = torch::empty({L, N}, options);
+        details::matmul_f16_torch(a, b, c);
+        const auto expected = c.clone();
 
         auto run_N_times = [&](auto matmul_impl) {
             const size_t N = 1000;
@@ -144,9 +259,32 @@ void matmul_f16(torch::Tensor const &A, torch::Tensor const &B, torch::Tensor &C
             return cuda_timer.result_ms();
         };
 
-        float const torch_time = run_N_times(details::matmul_f16_torch);
-        float const cublas_time = run_N_times(details::matmul_f16_cublas);
-        return cublas_time < torch_time ? details::matmul_f16_cublas : details::matmul_f16_torch;
+        using MatMul = void (*)(torch::Tensor const &, torch::Tensor const &, torch::Tensor &);
+        const std::pair<const char *, MatMul> candidates[] = {
+                {"torch", details::matmul_f16_torch},
+                {"cuBLAS", details::matmul_f16_cublas},
+                {"cuBLASLt", details::matmul_f16_cublaslt},
+        };
+        auto fastest = candidates[0];
+        float fastest_time = run_N_times(fastest.second);
+        for (const auto &candidate : candidates) {
+            if (candidate.second == fastest.second) {
+                continue;
+            }
+            candidate.second(a, b, c);
+            // Half precision accumulation over M loses a little more than the inputs' precision.
+            if (!torch::allclose(c, expected, 1e-2, 1e-2)) {
+                spdlog::warn("{} matmul disagrees with torch, so won't be used", candidate.first);
+                continue;
+            }
+            const float time = run_N_times(candidate.second);
+            if (time < fastest_time) {
+                fastest = candidate;
+                fastest_time = time;
+            }
+        }
+        spdlog::debug("> Using {} for half precision matmuls", fastest.first);
+        return fastest.second;
     }();
     fastest_mat_mul(A, B, C);
 }
@@ -175,16 +313,153 @@ std::vector<std::string> parse_cuda_device_string(std::string device_string) {
     return devices;
 }
 
-std::unique_lock<std::mutex> acquire_gpu_lock(int gpu_index, bool use_lock) {
+namespace {
+
+std::mutex gpu_sharing_mutex;
+bool gpu_sharing_enabled = false;
+bool gpu_sharing_takes_turns = false;
+std::unordered_map<int, std::unique_ptr<GpuArbiter>> gpu_arbiters;
+
+// Named by the device's PCI bus ID rather than its index, which depends on each process's
+// CUDA_VISIBLE_DEVICES.
+std::string gpu_arbiter_segment_name(int gpu_index) {
+    char bus_id[32] = {};
+    if (cudaDeviceGetPCIBusId(bus_id, sizeof(bus_id), gpu_index) != cudaSuccess) {
+        throw std::runtime_error("Unable to get the PCI bus ID of cuda:" +
+                                 std::to_string(gpu_index));
+    }
+    std::string name = "/dorado-gpu-";
+    for (const char* c = bus_id; *c; ++c) {
+        name += *c == ':' ? '_' : char(std::tolower(*c));
+    }
+    return name;
+}
+
+// The NVML handle of a CUDA device, or nullopt if NVML can't read it.  NVML is initialised on
+// first use and shut down at exit, rather than when whatever's reading the device is done
+// with it, since it may be read across several runs.
+std::optional<nvmlDevice_t> nvml_device(int device_index) {
+    static const bool nvml_initialised = [] {
+        const auto result = nvmlInit_v2();
+        if (result != NVML_SUCCESS) {
+            spdlog::debug("GPU monitoring unavailable: {}", nvmlErrorString(result));
+            return false;
+        }
+        std::atexit([] { nvmlShutdown(); });
+        return true;
+    }();
+    if (!nvml_initialised) {
+        return std::nullopt;
+    }
+    // NVML numbers devices differently from CUDA, which CUDA_VISIBLE_DEVICES renumbers, so the
+    // device is found by its PCI bus ID.
+    char pci_bus_id[NVML_DEVICE_PCI_BUS_ID_BUFFER_SIZE];
+    nvmlDevice_t handle;
+    if (cudaDeviceGetPCIBusId(pci_bus_id, sizeof(pci_bus_id), device_index) != cudaSuccess ||
+        nvmlDeviceGetHandleByPciBusId_v2(pci_bus_id, &handle) != NVML_SUCCESS) {
+        return std::nullopt;
+    }
+    return handle;
+}
+
+// The energy the device has used since the driver was loaded, or nullopt if it isn't reported,
+// as on GPUs older than Volta.
+std::optional<double> energy_joules(nvmlDevice_t handle) {
+    unsigned long long millijoules;
+    if (nvmlDeviceGetTotalEnergyConsumption(handle, &millijoules) != NVML_SUCCESS) {
+        return std::nullopt;
+    }
+    return millijoules / 1000.0;
+}
+
+// The power limits of the devices capped by cap_gpu_power(), as they were before, in mW.
+std::mutex power_cap_mutex;
+std::vector<std::pair<nvmlDevice_t, unsigned int>> uncapped_power_limits;
+std::terminate_handler previous_terminate_handler = nullptr;
+
+// Puts back the limits cap_gpu_power() lowered.  Also called from the terminate and signal
+// handlers, where the lock is only tried, since the thread which failed may hold it.  NVML
+// isn't async signal safe, so after a crash this is a best effort.
+void restore_power_limits(bool wait_for_lock) {
+    std::unique_lock lock(power_cap_mutex, std::defer_lock);
+    if (wait_for_lock) {
+        lock.lock();
+    } else if (!lock.try_lock()) {
+        return;
+    }
+    for (const auto& [capped_handle, limit_mw] : uncapped_power_limits) {
+        nvmlDeviceSetPowerManagementLimit(capped_handle, limit_mw);
+    }
+    uncapped_power_limits.clear();
+}
+
+// Restores the limits, then lets the signal do what it would have done.
+void restore_power_limits_on_signal(int signal_number) {
+    restore_power_limits(false);
+    std::signal(signal_number, SIG_DFL);
+    std::raise(signal_number);
+}
+
+}  // namespace
+
+void enable_gpu_sharing(bool take_turns) {
+    std::lock_guard lock(gpu_sharing_mutex);
+    gpu_sharing_enabled = true;
+    gpu_sharing_takes_turns = take_turns;
+}
+
+GpuArbiter* gpu_arbiter(int gpu_index) {
+    std::lock_guard lock(gpu_sharing_mutex);
+    if (!gpu_sharing_enabled) {
+        return nullptr;
+    }
+    auto& arbiter = gpu_arbiters[gpu_index];
+    if (!arbiter) {
+        arbiter = std::make_unique<GpuArbiter>(gpu_arbiter_segment_name(gpu_index));
+        spdlog::info("> Sharing cuda:{} with {} other dorado processes{}", gpu_index,
+                     arbiter->num_processes() - 1,
+                     gpu_sharing_takes_turns ? ", taking turns" : "");
+    }
+    return arbiter.get();
+}
+
+void check_cuda_mps() {
+    const char* pipe_directory = std::getenv("CUDA_MPS_PIPE_DIRECTORY");
+    const std::filesystem::path control =
+            std::filesystem::path(pipe_directory ? pipe_directory : "/tmp/nvidia-mps") /
+            "control";
+    if (!std::filesystem::exists(control)) {
+        throw std::runtime_error("No CUDA MPS control daemon is running at " +
+                                 control.parent_path().string() +
+                                 ": start one with nvidia-cuda-mps-control -d");
+    }
+}
+
+GpuLock acquire_gpu_lock(int gpu_index, bool use_lock) {
     static std::unordered_map<int, std::mutex> gpu_mutexes;
     static std::mutex map_mutex;
 
-    // We don't assume a particular GPU index range ahead of time,
-    // so keep GPU mutexes in an unordered_map protected by its own
-    // mutex.
-    std::lock_guard<std::mutex> map_lock(map_mutex);
-    return (use_lock ? std::unique_lock<std::mutex>(gpu_mutexes[gpu_index])
-                     : std::unique_lock<std::mutex>());
+    GpuLock lock;
+    if (use_lock) {
+        // We don't assume a particular GPU index range ahead of time,
+        // so keep GPU mutexes in an unordered_map protected by its own
+        // mutex.
+        std::unique_lock<std::mutex> map_lock(map_mutex);
+        auto& gpu_mutex = gpu_mutexes[gpu_index];
+        map_lock.unlock();
+        lock.local = std::unique_lock<std::mutex>(gpu_mutex);
+    }
+    if (auto* arbiter = gpu_arbiter(gpu_index)) {
+        bool takes_turns;
+        {
+            std::lock_guard sharing_lock(gpu_sharing_mutex);
+            takes_turns = gpu_sharing_takes_turns;
+        }
+        if (takes_turns) {
+            lock.turn = arbiter->acquire_turn();
+        }
+    }
+    return lock;
 }
 
 // Note that in general the torch caching allocator may be consuming
@@ -196,83 +471,322 @@ size_t available_memory(torch::Device device) {
     return free;
 }
 
+bool is_integrated_gpu(int device_index) {
+    cudaDeviceProp device_properties;
+    if (cudaGetDeviceProperties(&device_properties, device_index) != cudaSuccess) {
+        return false;
+    }
+    return device_properties.integrated && device_properties.canMapHostMemory;
+}
+
+MappedTensor empty_mapped(at::IntArrayRef sizes, torch::ScalarType dtype, torch::Device device) {
+    c10::cuda::CUDAGuard device_guard(device);
+    size_t num_bytes = c10::elementSize(dtype);
+    for (const auto size : sizes) {
+        num_bytes *= size_t(size);
+    }
+    void* buffer = nullptr;
+    if (cudaHostAlloc(&buffer, num_bytes, cudaHostAllocMapped | cudaHostAllocPortable) !=
+        cudaSuccess) {
+        throw std::bad_alloc();
+    }
+    void* device_pointer = nullptr;
+    if (cudaHostGetDevicePointer(&device_pointer, buffer, 0) != cudaSuccess) {
+        cudaFreeHost(buffer);
+        throw std::runtime_error("Could not map host memory into " + device.str());
+    }
+
+    MappedTensor mapped;
+    mapped.host = torch::from_blob(
+            buffer, sizes, [](void* host_buffer) { cudaFreeHost(host_buffer); },
+            torch::TensorOptions().dtype(dtype).device(torch::kCPU));
+    mapped.device = torch::from_blob(
+            device_pointer, sizes, [host = mapped.host](void*) {},
+            torch::TensorOptions().dtype(dtype).device(device));
+    return mapped;
+}
+
+void add_gpu_memory_metrics(MetricsRegistry& registry, const std::string& device_string) {
+    for (const auto& device : parse_cuda_device_string(device_string)) {
+        registry.add("dorado_gpu_memory_free_bytes", "Free memory on each GPU.",
+                     MetricsRegistry::Type::GAUGE,
+                     [device] { return available_memory(torch::Device(device)); },
+                     "device=\"" + device + "\"");
+    }
+}
+
+void add_gpu_monitor_devices(GpuMonitor& monitor, const std::string& device_string) {
+    for (const auto& device : parse_cuda_device_string(device_string)) {
+        const auto nvml_handle = nvml_device(torch::Device(device).index());
+        if (!nvml_handle) {
+            spdlog::debug("GPU monitoring unavailable for {}", device);
+            continue;
+        }
+        monitor.add_device(device, [handle = *nvml_handle] {
+            auto sample = GpuMonitor::Sample();
+            sample.fill(GpuMonitor::kNotReported);
+            nvmlUtilization_t utilisation;
+            if (nvmlDeviceGetUtilizationRates(handle, &utilisation) == NVML_SUCCESS) {
+                sample[GpuMonitor::UTILISATION] = utilisation.gpu;
+            }
+            nvmlMemory_t memory;
+            if (nvmlDeviceGetMemoryInfo(handle, &memory) == NVML_SUCCESS) {
+                sample[GpuMonitor::MEMORY_USED] = double(memory.used);
+            }
+            // In KB/s, over the last 20ms.
+            unsigned int kb_per_s;
+            if (nvmlDeviceGetPcieThroughput(handle, NVML_PCIE_UTIL_RX_BYTES, &kb_per_s) ==
+                NVML_SUCCESS) {
+                sample[GpuMonitor::PCIE_RX] = kb_per_s * 1024.0;
+            }
+            if (nvmlDeviceGetPcieThroughput(handle, NVML_PCIE_UTIL_TX_BYTES, &kb_per_s) ==
+                NVML_SUCCESS) {
+                sample[GpuMonitor::PCIE_TX] = kb_per_s * 1024.0;
+            }
+            unsigned int milliwatts;
+            if (nvmlDeviceGetPowerUsage(handle, &milliwatts) == NVML_SUCCESS) {
+                sample[GpuMonitor::POWER] = milliwatts / 1000.0;
+            }
+            if (auto energy = energy_joules(handle)) {
+                sample[GpuMonitor::ENERGY] = *energy;
+            }
+            return sample;
+        });
+    }
+}
+
+void cap_gpu_power(int device_index, float watts) {
+    const auto handle = nvml_device(device_index);
+    unsigned int current_mw, min_mw, max_mw;
+    if (!handle || nvmlDeviceGetPowerManagementLimit(*handle, &current_mw) != NVML_SUCCESS ||
+        nvmlDeviceGetPowerManagementLimitConstraints(*handle, &min_mw, &max_mw) !=
+                NVML_SUCCESS) {
+        spdlog::warn("Unable to read the power limit of cuda:{}, so it can't be capped",
+                     device_index);
+        return;
+    }
+    const auto cap_mw = std::clamp(static_cast<unsigned int>(watts * 1000), min_mw, max_mw);
+
+    std::lock_guard lock(power_cap_mutex);
+    const bool already_capped =
+            std::any_of(uncapped_power_limits.begin(), uncapped_power_limits.end(),
+                        [&handle](const auto& limit) { return limit.first == *handle; });
+    if (already_capped || cap_mw >= current_mw) {
+        return;
+    }
+    const auto result = nvmlDeviceSetPowerManagementLimit(*handle, cap_mw);
+    if (result != NVML_SUCCESS) {
+        spdlog::warn("Unable to cap the power of cuda:{} at {}W: {}", device_index,
+                     cap_mw / 1000, nvmlErrorString(result));
+        return;
+    }
+    spdlog::info("> Capped the power of cuda:{} at {}W, from {}W", device_index, cap_mw / 1000,
+                 current_mw / 1000);
+    static std::once_flag restore_registered;
+    std::call_once(restore_registered, [] {
+        // Registered after NVML's shutdown, so it's called before it.
+        std::atexit([] { restore_power_limits(true); });
+        // A process which crashes, or is killed, doesn't get as far as exiting, and would leave
+        // the device capped for whatever runs on it next.
+        previous_terminate_handler = std::set_terminate([] {
+            restore_power_limits(false);
+            if (previous_terminate_handler) {
+                previous_terminate_handler();
+            }
+            std::abort();
+        });
+        for (const int signal_number : {SIGINT, SIGTERM, SIGSEGV, SIGABRT, SIGFPE, SIGILL}) {
+            std::signal(signal_number, restore_power_limits_on_signal);
+        }
+#ifndef _WIN32
+        for (const int signal_number : {SIGHUP, SIGBUS}) {
+            std::signal(signal_number, restore_power_limits_on_signal);
+        }
+#endif
+    });
+    uncapped_power_limits.emplace_back(*handle, current_mw);
+}
+
+void use_pinned_tensor_pool() {
+    TensorPool::instance().set_allocator({
+            [](size_t num_bytes) {
+                // Portable, so that the buffers count as pinned for every device.
+                void* buffer = nullptr;
+                if (cudaHostAlloc(&buffer, num_bytes, cudaHostAllocPortable) != cudaSuccess) {
+                    throw std::bad_alloc();
+                }
+                return buffer;
+            },
+            [](void* buffer) { cudaFreeHost(buffer); },
+    });
+}
+
 int auto_gpu_batch_size(torch::nn::ModuleHolder<torch::nn::AnyModule> module,
+                        const std::filesystem::path &model_path,
                         const dorado::CRFModelConfig &model_config,
                         const torch::TensorOptions &options,
+                        int chunk_size,
                         int granularity,
-                        float memory_limit_fraction) {
+                        float memory_limit_fraction,
+                        float power_cap_watts) {
 #ifdef DORADO_TX2
     return 256;
 #else
-    // TODO: we really need something better than this hardcoded table of max batch sizes,
-    // which fails to take into account chunk size as well as varying memory requirements of
-    // different GPU code paths.
-
-    // memory breakpoints in GB
-    const std::vector<int> breakpoints{8, 12, 16, 24, 32, 40};
-    // {fast, hac, sup}
-    const std::vector<std::array<int, 3>> batch_sizes = {
-            {960, 448, 128},    // 8GB
-            {1536, 640, 192},   // 12GB
-            {2048, 1024, 256},  // 16GB
-            {2560, 1536, 512},  // 24GB
-            {3072, 2048, 640},  // 32GB
-            {4096, 2880, 768},  // 40GB
-    };
+    namespace allocator = c10::cuda::CUDACachingAllocator;
+    constexpr auto kAggregate = static_cast<size_t>(allocator::StatType::AGGREGATE);
+    // Below the memory limit, only a spread of batch sizes is timed.
+    constexpr int kMaxSweepPoints = 16;
+    // The energy counter only moves every few tens of milliseconds, so forward passes are
+    // repeated for at least this long to measure their energy.
+    constexpr auto kEnergyMeasurementTime = milliseconds(500);
+
+    const int device_index = options.device().index();
+    c10::cuda::CUDAGuard device_guard(options.device());
 
-    // compute how much free gpu memory and pick the closest breakpoint
-    auto available = available_memory(options.device()) * memory_limit_fraction / 1e+9;
-    spdlog::debug("Auto batch size: GPU memory available: {}GB", available);
-    auto presets = details::try_select_max_batch_sizes(breakpoints, batch_sizes, available);
-    if (!presets) {
-        spdlog::warn(
-                "Auto batchsize detection failed. Insufficient memory, required 8GB, available "
-                "{}GB",
-                available);
-        return pad_to(128, granularity);
+    // Release cached blocks so that they count as available, and include memory already
+    // allocated to the model, since it's part of each measured peak.
+    allocator::emptyCache();
+    const size_t allocated =
+            allocator::getDeviceStats(device_index).allocated_bytes[kAggregate].current;
+    size_t available = available_memory(options.device());
+    if (is_integrated_gpu(device_index)) {
+        // The reads in flight, and the rest of the pipeline's host memory, share the device's
+        // memory, so at least --max-host-memory, or a quarter of the total, is left for them.
+        size_t free, total;
+        cudaMemGetInfo(&free, &total);
+        const size_t host_reserve = std::max(MemoryBudget::instance().limit(), total / 4);
+        available = available > host_reserve ? available - host_reserve : 0;
+        spdlog::debug("Auto batch size: integrated GPU, {}GB set aside for the host",
+                      host_reserve / 1e+9);
+    }
+    if (auto* arbiter = gpu_arbiter(device_index)) {
+        // Other processes sharing the device may have only emptied their caches for now, so
+        // what they've set aside isn't counted as available even if it's free.
+        size_t free, total;
+        cudaMemGetInfo(&free, &total);
+        const size_t reserved = arbiter->reserved_by_others() + allocated;
+        available = std::min(available, total > reserved ? total - reserved : 0);
+        spdlog::debug("Auto batch size: {}GB set aside by other processes sharing the GPU",
+                      arbiter->reserved_by_others() / 1e+9);
+    }
+    const size_t memory_limit = allocated + size_t(available * memory_limit_fraction);
+    const int memory_limit_gb = int(memory_limit / 1e+9);
+    spdlog::debug("Auto batch size: GPU memory available: {}GB", memory_limit / 1e+9);
+
+    cudaDeviceProp device_properties;
+    cudaGetDeviceProperties(&device_properties, device_index);
+    std::string device_name = device_properties.name;
+    // Capped, the device calls at a different rate, and the batch size is picked for energy.
+    const auto nvml_handle = power_cap_watts > 0 ? nvml_device(device_index) : std::nullopt;
+    if (power_cap_watts > 0) {
+        device_name += fmt::format(" capped at {}W", int(power_cap_watts));
+    }
+    BatchSizeCache cache(model_path);
+    if (auto batch_size = cache.find(device_name, chunk_size, memory_limit_gb)) {
+        spdlog::debug("Auto batch size: using {}, calibrated for {} with chunk size {}",
+                      *batch_size, device_name, chunk_size);
+        return *batch_size;
     }
 
-    int model_type_idx = (model_config.insize <= 128) ? 0 : ((model_config.insize <= 384) ? 1 : 2);
-    const int max_batch_size = presets->at(model_type_idx);
-
-    c10::cuda::CUDAGuard device_guard(options.device());
-
-    int best_batch_size = granularity;
-    float best_time = std::numeric_limits<float>::max();
-    const int chunk_size = model_config.stride * 200;
     CUDATimer cuda_timer;
-    spdlog::debug("Auto batch size: testing up to {} in steps of {}", max_batch_size, granularity);
-    for (int batch_size = granularity; batch_size <= max_batch_size; batch_size += granularity) {
-        auto input = torch::empty({batch_size, model_config.num_features, chunk_size}, options);
-        cuda_timer.start();
-        module->forward(input);
-        cuda_timer.stop();
-        float const time = cuda_timer.result_ms() / batch_size;
-
-        spdlog::debug("Auto batchsize: {}, time per chunk {} ms", batch_size, time);
-        if (time < best_time) {
-            best_time = time;
-            best_batch_size = batch_size;
+    std::vector<BatchSizeMeasurement> measurements;
+    // Returns false if the forward pass failed, e.g. because it ran out of memory.
+    auto measure = [&](int batch_size) {
+        try {
+            auto input = torch::empty({batch_size, model_config.num_features, chunk_size}, options);
+            // The first call at each shape includes one-off costs, e.g. picking cuDNN algorithms.
+            module->forward(input);
+            allocator::resetPeakStats(device_index);
+            cuda_timer.start();
+            module->forward(input);
+            cuda_timer.stop();
+            const float time_ms = cuda_timer.result_ms();
+            const auto peak =
+                    allocator::getDeviceStats(device_index).allocated_bytes[kAggregate].peak;
+            measurements.push_back({batch_size, size_t(peak), batch_size * 1000.f / time_ms});
+            spdlog::debug("Auto batch size: {}, peak memory {:.2f}GB, {:.0f} chunks/s", batch_size,
+                          peak / 1e+9, measurements.back().chunks_per_second);
+
+            const auto start_energy = nvml_handle ? energy_joules(*nvml_handle) : std::nullopt;
+            if (start_energy) {
+                const auto start = steady_clock::now();
+                int num_passes = 0;
+                do {
+                    module->forward(input);
+                    torch::cuda::synchronize(device_index);
+                    ++num_passes;
+                } while (steady_clock::now() - start < kEnergyMeasurementTime);
+                const auto end_energy = energy_joules(*nvml_handle);
+                if (end_energy && *end_energy > *start_energy) {
+                    auto& measurement = measurements.back();
+                    measurement.joules_per_chunk =
+                            float((*end_energy - *start_energy) / (num_passes * batch_size));
+                    spdlog::debug("Auto batch size: {}, {:.3f}J/chunk", batch_size,
+                                  measurement.joules_per_chunk);
+                }
+            }
+            return true;
+        } catch (const c10::Error &e) {
+            spdlog::debug("Auto batch size: {} failed: {}", batch_size, e.what_without_backtrace());
+            allocator::emptyCache();
+            return false;
         }
-    }
+    };
 
-    return best_batch_size;
+    int max_batch_size = 0;
+    if (measure(granularity) && measure(2 * granularity)) {
+        max_batch_size = max_batch_size_for_memory(measurements, memory_limit, granularity);
+    }
+    spdlog::debug("Auto batch size: testing up to {} at chunk size {}", max_batch_size, chunk_size);
+    for (int batch_size : batch_sizes_to_sweep(max_batch_size, granularity, kMaxSweepPoints)) {
+        if (batch_size <= 2 * granularity) {
+            continue;
+        }
+        // Memory doesn't quite grow linearly, so stop at the first batch size that doesn't fit.
+        if (!measure(batch_size) || measurements.back().peak_memory_bytes > memory_limit) {
+            break;
+        }
+    }
+    allocator::emptyCache();
+
+    const int batch_size = power_cap_watts > 0
+                                   ? select_efficient_batch_size(measurements, memory_limit)
+                                   : select_batch_size(measurements, memory_limit);
+    if (batch_size == 0) {
+        spdlog::warn("Auto batchsize detection failed. Insufficient memory, available {}GB",
+                     memory_limit / 1e+9);
+        return granularity;
+    }
+    cache.insert(device_name, chunk_size, memory_limit_gb, batch_size);
+    return batch_size;
 #endif
 }
 
-namespace details {
-std::optional<std::array<int, 3>> try_select_max_batch_sizes(
-        std::vector<int> const &breakpoints,
-        std::vector<std::array<int, 3>> const &batch_sizes,
-        int available_memory_gb) {
-    assert(breakpoints.size() == batch_sizes.size());
-    int idx = std::upper_bound(breakpoints.begin(), breakpoints.end(), available_memory_gb) -
-              breakpoints.begin() - 1;
-    if (idx < 0) {
-        return std::nullopt;
+DeviceAffinity get_device_affinity(int device_index) {
+    DeviceAffinity affinity;
+#ifdef __linux__
+    char pci_bus_id[32];
+    if (cudaDeviceGetPCIBusId(pci_bus_id, sizeof(pci_bus_id), device_index) != cudaSuccess) {
+        return affinity;
+    }
+    // CUDA reports an 8 digit PCI domain in upper case, sysfs uses 4 digits in lower case.
+    std::string bus_id(pci_bus_id);
+    std::transform(bus_id.begin(), bus_id.end(), bus_id.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    if (bus_id.size() > 12) {
+        bus_id = bus_id.substr(bus_id.size() - 12);
     }
-    return batch_sizes[idx];
+    const std::string device_path = "/sys/bus/pci/devices/" + bus_id;
+
+    std::ifstream numa_node_file(device_path + "/numa_node");
+    numa_node_file >> affinity.numa_node;
+
+    std::ifstream cpu_list_file(device_path + "/local_cpulist");
+    std::string cpu_list;
+    std::getline(cpu_list_file, cpu_list);
+    affinity.cpus = parse_cpu_list(cpu_list);
+#endif  // __linux__
+    return affinity;
 }
-}  // namespace details
 
 }  // namespace dorado::utils
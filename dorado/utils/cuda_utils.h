@@ -1,23 +1,46 @@
 #pragma once
 
 #include "../nn/CRFModel.h"
+#include "GpuArbiter.h"
 
 #include <torch/torch.h>
 
-#include <array>
+#include <filesystem>
 #include <mutex>
-#include <optional>
 #include <string>
 #include <vector>
 
 namespace dorado::utils {
 
+class GpuMonitor;
+class MetricsRegistry;
+
+// Has the GPUs of this process shared with other dorado processes on the host, through a
+// GpuArbiter for each device.  Batches take turns on each device unless take_turns is false,
+// as under CUDA MPS, which runs the processes' kernels side by side.  Either way, device memory
+// the processes have set aside is left out when they pick their batch sizes.
+void enable_gpu_sharing(bool take_turns);
+// The arbiter of the device with the specified index, or nullptr if sharing isn't enabled.
+GpuArbiter* gpu_arbiter(int gpu_index);
+// Throws unless a CUDA MPS control daemon is running, for processes' kernels to run side by
+// side, at CUDA_MPS_PIPE_DIRECTORY or the default /tmp/nvidia-mps.
+void check_cuda_mps();
+
+// Access to a GPU for one batch, as acquire_gpu_lock gives.
+struct GpuLock {
+    // Held when the caller asked for exclusive access within this process.
+    std::unique_lock<std::mutex> local;
+    // Held when the device is shared with other processes, which take turns on it.
+    GpuArbiter::Turn turn;
+};
+
 // Returns a lock providing exclusive access to the GPU with the specified index.
 // In cases where > 1 model is being used, this can prevent more than one from
 // attempting to allocate GPU memory on, or submit work to, the device in question.
-// Once the returned lock goes out of scope or is explicitly unlocked,
-// the GPU is available to other users again.
-std::unique_lock<std::mutex> acquire_gpu_lock(int gpu_index, bool use_lock);
+// If the device is shared with other processes which take turns on it, this also waits for
+// this process's turn.  Once the returned lock goes out of scope, the GPU is available to
+// other users again.
+GpuLock acquire_gpu_lock(int gpu_index, bool use_lock);
 
 // Given a string representing cuda devices (e.g "cuda:0,1,3") returns a vector of strings, one for
 // each device (e.g ["cuda:0", "cuda:2", ..., "cuda:7"]
@@ -25,22 +48,72 @@ std::vector<std::string> parse_cuda_device_string(std::string device_string);
 
 // Reports the amount of available memory (in bytes) for a given device.
 size_t available_memory(torch::Device device);
+// Whether the device is an integrated GPU, as on Jetson, whose memory is the host's, and which
+// can work on mapped host memory in place.
+bool is_integrated_gpu(int device_index);
+
+// Host memory mapped into a device's address space.  host and device are views of the same
+// buffer, so on an integrated GPU each side reads what the other wrote, once work on the
+// device has been synchronised with, without anything being copied.  device keeps the buffer
+// alive.
+struct MappedTensor {
+    torch::Tensor host;
+    torch::Tensor device;
+};
+MappedTensor empty_mapped(at::IntArrayRef sizes, torch::ScalarType dtype, torch::Device device);
+// Adds the free memory of each of the devices in device_string, as parse_cuda_device_string
+// takes, to registry.
+void add_gpu_memory_metrics(MetricsRegistry& registry, const std::string& device_string);
+// Adds the devices in device_string to monitor, read through NVML.  Devices NVML can't read,
+// or all of them if the driver doesn't provide it, are left out.
+void add_gpu_monitor_devices(GpuMonitor& monitor, const std::string& device_string);
+// Lowers the power limit of the device to watts, within the range it allows, until the process
+// exits, when the limit it had is put back.  Setting the limit takes root, as it does with
+// nvidia-smi -pl: without it, or NVML, a warning is logged and the limit is left as it is.
+// The limit is also put back on std::terminate, and on the signals which end the process by
+// default, other than SIGKILL, which can't be caught.  NVML isn't safe to call from a signal
+// handler, so after a crash that's a best effort, and a killed process leaves the device
+// capped: nvidia-smi -pl puts it right.
+void cap_gpu_power(int device_index, float watts);
+// Has TensorPool::instance() allocate pinned buffers, so that read signals and the other
+// pipeline tensors taken from it are copied to any GPU by DMA, without staging.
+void use_pinned_tensor_pool();
+
+// Picks the batch size with the best measured throughput at chunk_size which fits in
+// memory_limit_fraction of the device's available memory.  A sweep of timed forward
+// passes measures the peak memory and throughput of a range of batch sizes, and the
+// result is cached in the model directory, so later runs on the same kind of device skip
+// the sweep.  On an integrated GPU, whose memory is the host's, memory for the rest of the
+// pipeline is set aside first.  With a power_cap_watts, as cap_gpu_power() applies, the
+// energy of each batch size is measured as well, through NVML, and the one taking the least
+// energy per chunk is picked instead, for the most samples per joule.
 int auto_gpu_batch_size(torch::nn::ModuleHolder<torch::nn::AnyModule> module,
+                        const std::filesystem::path &model_path,
                         const dorado::CRFModelConfig &model_config,
                         const torch::TensorOptions &options,
+                        int chunk_size,
                         int batch_size_granularity,
-                        float memory_limit_fraction);
+                        float memory_limit_fraction,
+                        float power_cap_watts = 0.f);
+
+// CPUs and NUMA node closest to a CUDA device.
+struct DeviceAffinity {
+    // -1 if the platform doesn't report a NUMA node for the device.
+    int numa_node{-1};
+    // Empty if the local CPUs could not be determined.
+    std::vector<int> cpus;
+};
+
+// Looks up the device's locality from sysfs.  Only supported on Linux: on other
+// platforms the returned affinity is empty.
+DeviceAffinity get_device_affinity(int device_index);
 
 void matmul_f16(torch::Tensor const &A, torch::Tensor const &B, torch::Tensor &C);
 
 namespace details {
 // Exposed in the header for testability
-std::optional<std::array<int, 3>> try_select_max_batch_sizes(
-        std::vector<int> const &breakpoints,
-        std::vector<std::array<int, 3>> const &batch_sizes,
-        int available_memory_gb);
-
 void matmul_f16_cublas(torch::Tensor const &A, torch::Tensor const &B, torch::Tensor &C);
+void matmul_f16_cublaslt(torch::Tensor const &A, torch::Tensor const &B, torch::Tensor &C);
 void matmul_f16_torch(torch::Tensor const &A, torch::Tensor const &B, torch::Tensor &C);
 
 }  //  namespace details
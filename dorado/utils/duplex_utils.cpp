@@ -1,9 +1,8 @@
 #include "duplex_utils.h"
 
-#include <torch/torch.h>
-
 #include <algorithm>
 #include <fstream>
+#include <stdexcept>
 #include <vector>
 
 namespace dorado::utils {
@@ -107,13 +106,26 @@ std::pair<std::pair<int, int>, std::pair<int, int>> get_trimmed_alignment(
 
 // Applies a min pool filter to q scores for basespace-duplex algorithm
 void preprocess_quality_scores(std::vector<uint8_t>& quality_scores, int pool_window) {
-    // Apply a min-pool window to the quality scores
-    auto opts = torch::TensorOptions().dtype(torch::kInt8);
-    torch::Tensor t =
-            torch::from_blob(quality_scores.data(), {1, (int)quality_scores.size()}, opts);
-    auto t_float = t.to(torch::kFloat32);
-    t.index({torch::indexing::Slice()}) =
-            -torch::max_pool1d(-t_float, pool_window, 1, pool_window / 2);
+    // Each score becomes the minimum of the pool_window scores starting pool_window / 2 before
+    // it, clipped to the ends, as a max pool of the negated scores padded by pool_window / 2.
+    // Rather than a min over each window in turn, the minimum is built up one offset into the
+    // window at a time over the whole sequence, which compilers can vectorise.
+    const int num_scores = static_cast<int>(quality_scores.size());
+    const std::vector<uint8_t> original_scores(quality_scores);
+    const int first_offset = -(pool_window / 2);
+    for (int offset = first_offset; offset < first_offset + pool_window; ++offset) {
+        if (offset == 0) {
+            continue;
+        }
+        // The scores whose window includes the score offset away.
+        const int begin = std::max(0, -offset);
+        const int end = std::min(num_scores, num_scores - offset);
+        uint8_t* const scores = quality_scores.data() + begin;
+        const uint8_t* const shifted_scores = original_scores.data() + begin + offset;
+        for (int i = 0; i < end - begin; ++i) {
+            scores[i] = std::min(scores[i], shifted_scores[i]);
+        }
+    }
 }
 
 const std::string get_stereo_model_name(const std::string& simplex_model_name,
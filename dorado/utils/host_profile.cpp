@@ -0,0 +1,176 @@
+#include "host_profile.h"
+
+#include <spdlog/spdlog.h>
+#include <toml.hpp>
+
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <system_error>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// A TOML basic string of text, as table names are written.
+std::string quoted(const std::string& text) {
+    std::string result = "\"";
+    for (const char c : text) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+        }
+        result += c;
+    }
+    return result + '"';
+}
+
+}  // namespace
+
+namespace dorado::utils {
+
+void HostProfile::apply(ThreadAllocations& allocations) const {
+    if (scaler_node_threads > 0) {
+        allocations.scaler_node_threads = scaler_node_threads;
+    }
+    if (read_converter_threads > 0) {
+        allocations.read_converter_threads = read_converter_threads;
+    }
+}
+
+fs::path default_host_profile_path() {
+    if (const char* profile = std::getenv("DORADO_HOST_PROFILE"); profile && *profile) {
+        return profile;
+    }
+#ifdef _WIN32
+    const char* home = std::getenv("LOCALAPPDATA");
+#else
+    const char* home = std::getenv("HOME");
+#endif
+    if (!home || !*home) {
+        return {};
+    }
+#ifdef _WIN32
+    return fs::path(home) / "dorado" / "host_profile.toml";
+#else
+    return fs::path(home) / ".dorado" / "host_profile.toml";
+#endif
+}
+
+std::string host_profile_model_name(const fs::path& model_path) {
+    // A directory given with a trailing separator has an empty filename.
+    auto path = model_path.lexically_normal();
+    if (!path.has_filename()) {
+        path = path.parent_path();
+    }
+    return path.filename().string();
+}
+
+HostProfiles load_host_profiles(const fs::path& path) {
+    HostProfiles profiles;
+    std::error_code error;
+    if (path.empty() || !fs::exists(path, error)) {
+        return profiles;
+    }
+
+    // One table per device, holding one table per model.
+    const auto root = toml::parse(path);
+    for (const auto& [device, models] : root.as_table()) {
+        if (!models.is_table()) {
+            continue;
+        }
+        for (const auto& [model, entry] : models.as_table()) {
+            if (!entry.is_table()) {
+                continue;
+            }
+            HostProfile profile;
+            profile.batch_size = toml::find_or<int>(entry, "batch_size", 0);
+            profile.chunk_size = toml::find_or<int>(entry, "chunk_size", 0);
+            profile.num_runners = toml::find_or<int>(entry, "num_runners", 0);
+            profile.remora_threads = toml::find_or<int>(entry, "remora_threads", 0);
+            profile.scaler_node_threads = toml::find_or<int>(entry, "scaler_node_threads", 0);
+            profile.read_converter_threads =
+                    toml::find_or<int>(entry, "read_converter_threads", 0);
+            profile.samples_per_second = toml::find_or<double>(entry, "samples_per_second", 0.0);
+            profiles[{device, model}] = profile;
+        }
+    }
+    return profiles;
+}
+
+std::optional<HostProfile> find_host_profile(const fs::path& path,
+                                             const std::string& device,
+                                             const fs::path& model_path) {
+    try {
+        const auto profiles = load_host_profiles(path);
+        const auto profile = profiles.find({device, host_profile_model_name(model_path)});
+        if (profile != profiles.end()) {
+            return profile->second;
+        }
+    } catch (const std::exception& e) {
+        spdlog::warn("Ignoring host profile {}: {}", path.string(), e.what());
+    }
+    return std::nullopt;
+}
+
+HostProfile select_host_profile(const fs::path& path,
+                                const std::string& device,
+                                const fs::path& model_path) {
+    const auto profile_path = path.empty() ? default_host_profile_path() : path;
+    if (auto profile = find_host_profile(profile_path, device, model_path)) {
+        spdlog::info("> Using the settings tuned for {} in {}", device, profile_path.string());
+        return *profile;
+    }
+    if (!path.empty()) {
+        spdlog::warn("No settings tuned for {} with {} in {}", device,
+                     host_profile_model_name(model_path), profile_path.string());
+    }
+    return {};
+}
+
+void save_host_profile(const fs::path& path,
+                       const std::string& device,
+                       const fs::path& model_path,
+                       const HostProfile& profile) {
+    if (path.empty()) {
+        throw std::runtime_error("No host profile path: set DORADO_HOST_PROFILE");
+    }
+    auto profiles = load_host_profiles(path);
+    profiles[{device, host_profile_model_name(model_path)}] = profile;
+
+    std::error_code error;
+    if (path.has_parent_path()) {
+        fs::create_directories(path.parent_path(), error);
+    }
+    // Written in full then moved over the old file, so that a run starting meanwhile never
+    // reads half a profile.
+    auto staging = path;
+    staging += ".tmp";
+    {
+        std::ofstream stream(staging);
+        stream << "# Written by dorado tune.  Settings of 0 are left at their defaults.\n";
+        for (const auto& [key, entry] : profiles) {
+            stream << "\n[" << quoted(key.first) << '.' << quoted(key.second) << "]\n"
+                   << "batch_size = " << entry.batch_size << '\n'
+                   << "chunk_size = " << entry.chunk_size << '\n'
+                   << "num_runners = " << entry.num_runners << '\n'
+                   << "remora_threads = " << entry.remora_threads << '\n'
+                   << "scaler_node_threads = " << entry.scaler_node_threads << '\n'
+                   << "read_converter_threads = " << entry.read_converter_threads << '\n'
+                   << "samples_per_second = " << std::fixed << std::setprecision(1)
+                   << entry.samples_per_second << std::defaultfloat << '\n';
+        }
+        if (!stream.flush()) {
+            throw std::runtime_error("Could not write host profile " + staging.string());
+        }
+    }
+    fs::rename(staging, path, error);
+    if (error) {
+        const auto message = error.message();
+        fs::remove(staging, error);
+        throw std::runtime_error("Could not write host profile " + path.string() + ": " +
+                                 message);
+    }
+}
+
+}  // namespace dorado::utils
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "parameters.h"
+
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <string>
+#include <utility>
+
+namespace dorado::utils {
+
+// The settings `dorado tune` found to basecall a model fastest on a device of this host, which
+// the basecaller and duplex use in place of their defaults.  A setting of 0 wasn't tuned, and is
+// left at its default.
+struct HostProfile {
+    int batch_size{0};
+    int chunk_size{0};
+    int num_runners{0};
+    int remora_threads{0};
+    int scaler_node_threads{0};
+    int read_converter_threads{0};
+    // What the whole pipeline called with these settings when they were tuned, for reference.
+    double samples_per_second{0};
+
+    // Sets the scaler and read converter thread counts in allocations, if they were tuned.  The
+    // modbase callers' count is passed to ThreadAllocations itself.
+    void apply(ThreadAllocations& allocations) const;
+};
+
+// Profiles keyed by the device string and the name of the model they were tuned for.
+using HostProfiles = std::map<std::pair<std::string, std::string>, HostProfile>;
+
+// Where profiles are kept: $DORADO_HOST_PROFILE if set, else host_profile.toml in the dorado
+// directory under the user's home.  Empty if there's no home.
+std::filesystem::path default_host_profile_path();
+
+// The name of the model at model_path, as profiles are keyed by.
+std::string host_profile_model_name(const std::filesystem::path& model_path);
+
+// Every profile in the TOML file at path.  Empty if there's no file.  Throws if it can't be
+// parsed.
+HostProfiles load_host_profiles(const std::filesystem::path& path);
+
+// The profile at path for model_path on device, if there is one.  A profile which can't be read
+// is warned about rather than thrown, since a run needn't fail for want of tuning.
+std::optional<HostProfile> find_host_profile(const std::filesystem::path& path,
+                                             const std::string& device,
+                                             const std::filesystem::path& model_path);
+
+// The profile for model_path on device from path, or the default path if path is empty, as
+// the basecaller and duplex pick it up.  All 0, changing nothing, if there's none.
+HostProfile select_host_profile(const std::filesystem::path& path,
+                                const std::string& device,
+                                const std::filesystem::path& model_path);
+
+// Writes profile for model_path on device to path, keeping the other profiles there.  Throws if
+// the file can't be written.
+void save_host_profile(const std::filesystem::path& path,
+                       const std::string& device,
+                       const std::filesystem::path& model_path,
+                       const HostProfile& profile);
+
+}  // namespace dorado::utils
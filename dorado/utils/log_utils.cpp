@@ -1,14 +1,45 @@
+#include "log_utils.h"
+
+#include "AsyncLogSink.h"
+
 #include "spdlog/sinks/stdout_color_sinks.h"
 #include "spdlog/spdlog.h"
 
+#include <memory>
+
 namespace dorado::utils {
 
 void InitLogging() {
     // Without modification, the default logger will write to stdout.
-    // Replace the default logger with a (color, multi-threaded) stderr logger
-    // (but first replace it with an arbitrarily-named logger to prevent a name clash)
-    spdlog::set_default_logger(spdlog::stderr_color_mt("unused_name"));
-    spdlog::set_default_logger(spdlog::stderr_color_mt(""));
+    // Replace the default logger with a (color) stderr logger, written to from a thread of its
+    // own so that the threads logging never wait on stderr.
+    auto sink = std::make_shared<AsyncLogSink>(
+            std::make_shared<spdlog::sinks::stderr_color_sink_mt>());
+    spdlog::set_default_logger(std::make_shared<spdlog::logger>("", std::move(sink)));
+}
+
+bool LogRateLimiter::allow(size_t& suppressed) {
+    const auto now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                std::chrono::steady_clock::now().time_since_epoch())
+                                .count();
+    if (m_num_allowed.load(std::memory_order_relaxed) >= m_burst) {
+        // Past the burst, whichever thread moves the next time on is the one let through.
+        auto next_ns = m_next_allowed_ns.load(std::memory_order_relaxed);
+        if (now_ns < next_ns || !m_next_allowed_ns.compare_exchange_strong(
+                                        next_ns, now_ns + m_interval_ns,
+                                        std::memory_order_relaxed)) {
+            m_num_suppressed.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+    } else if (m_num_allowed.fetch_add(1, std::memory_order_relaxed) >= m_burst) {
+        // Another thread used up the burst meanwhile.
+        m_num_suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    } else {
+        m_next_allowed_ns.store(now_ns + m_interval_ns, std::memory_order_relaxed);
+    }
+    suppressed = m_num_suppressed.exchange(0, std::memory_order_relaxed);
+    return true;
 }
 
 }  // namespace dorado::utils
@@ -1,8 +1,55 @@
 #pragma once
 
+#include <spdlog/spdlog.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
 namespace dorado::utils {
 
-// Initialises the default logger to point to stderr.
+// Initialises the default logger to point to stderr, written from a thread of its own.
 void InitLogging();
 
+// Lets through the first burst of messages from a call site, and then no more than one an
+// interval, counting the rest.  Lock free, so that a site logging in a per-read loop costs its
+// threads little while it's held back.
+class LogRateLimiter {
+public:
+    explicit LogRateLimiter(size_t burst = 10,
+                            std::chrono::milliseconds interval = std::chrono::seconds(1))
+            : m_burst(burst),
+              m_interval_ns(
+                      std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count()) {}
+
+    // Whether a message may be logged now.  If so, suppressed is set to the number held back
+    // since the last one let through.
+    bool allow(size_t& suppressed);
+
+private:
+    const size_t m_burst;
+    const int64_t m_interval_ns;
+    std::atomic<size_t> m_num_allowed{0};
+    std::atomic<int64_t> m_next_allowed_ns{0};
+    std::atomic<size_t> m_num_suppressed{0};
+};
+
 }  // namespace dorado::utils
+
+// Logs as spdlog::log(level, ...) does, through a LogRateLimiter of the call site's own, for
+// messages which can repeat for every read, e.g. errors reading each read of a broken file.
+#define DORADO_LOG_RATE_LIMITED(level, ...)                                                  \
+    do {                                                                                     \
+        if (spdlog::should_log(level)) {                                                     \
+            static ::dorado::utils::LogRateLimiter dorado_log_rate_limiter;                  \
+            size_t dorado_log_suppressed = 0;                                                \
+            if (dorado_log_rate_limiter.allow(dorado_log_suppressed)) {                      \
+                spdlog::log(level, __VA_ARGS__);                                             \
+                if (dorado_log_suppressed > 0) {                                             \
+                    spdlog::log(level, "({} similar messages suppressed)",                   \
+                                dorado_log_suppressed);                                      \
+                }                                                                            \
+            }                                                                                \
+        }                                                                                    \
+    } while (false)
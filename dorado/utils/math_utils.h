@@ -5,6 +5,7 @@
 #include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstdint>
 #include <iterator>
 #include <numeric>
 #include <type_traits>
@@ -51,6 +52,59 @@ inline std::vector<T> quantiles(const std::vector<T>& in_data, const std::vector
     return quantiles;
 }
 
+// Moves the elements of data[begin, end) at each of the num_ranks sorted, distinct ranks, which
+// are within the range, to where std::sort would put them.  The middle rank is selected first,
+// and then those either side of it within their own side, in O(n log(num_ranks)).
+template <typename T>
+void select_ranks(std::vector<T>& data,
+                  const size_t* ranks,
+                  size_t num_ranks,
+                  size_t begin,
+                  size_t end) {
+    if (num_ranks == 0) {
+        return;
+    }
+    const size_t mid = num_ranks / 2;
+    const size_t rank = ranks[mid];
+    std::nth_element(std::begin(data) + begin, std::begin(data) + rank, std::begin(data) + end);
+    select_ranks(data, ranks, mid, begin, rank);
+    select_ranks(data, ranks + mid + 1, num_ranks - mid - 1, rank + 1, end);
+}
+
+// As quantiles, but reorders data rather than sorting a copy of it: only the elements either
+// side of each quantile are put in their sorted place.
+template <typename T, typename = typename std::enable_if<std::is_floating_point<T>::value, T>::type>
+std::vector<T> quantiles_in_place(std::vector<T>& data, const std::vector<T>& quants) {
+    NVTX3_FUNC_RANGE();
+    if (data.size() <= 1) {
+        return data;
+    }
+
+    auto linear_interp = [](T v0, T v1, T t) { return (1 - t) * v0 + t * v1; };
+    std::vector<T> positions;
+    std::vector<size_t> ranks;
+    positions.reserve(quants.size());
+    ranks.reserve(quants.size() * 2);
+    for (const auto quant : quants) {
+        T pos = linear_interp(0, T(data.size() - 1), quant);
+        positions.push_back(pos);
+        ranks.push_back(size_t(std::max(int64_t(std::floor(pos)), int64_t(0))));
+        ranks.push_back(size_t(std::min(int64_t(std::ceil(pos)), int64_t(data.size() - 1))));
+    }
+    std::sort(std::begin(ranks), std::end(ranks));
+    ranks.erase(std::unique(std::begin(ranks), std::end(ranks)), std::end(ranks));
+    select_ranks(data, ranks.data(), ranks.size(), 0, data.size());
+
+    std::vector<T> quantiles;
+    quantiles.reserve(quants.size());
+    for (const auto pos : positions) {
+        int64_t left = std::max(int64_t(std::floor(pos)), int64_t(0));
+        int64_t right = std::min(int64_t(std::ceil(pos)), int64_t(data.size() - 1));
+        quantiles.push_back(linear_interp(data[left], data[right], pos - left));
+    }
+    return quantiles;
+}
+
 // Perform a least-squares linear regression of the form y = mx + b, solving for m and b.
 // Returns a tuple {m, b, r} where r is the regression correlation coefficient
 // Adapted from https://stackoverflow.com/questions/5083465/fast-efficient-least-squares-fit-algorithm-in-c
@@ -1,5 +1,7 @@
 #include "metal_utils.h"
 
+#include "GpuMonitor.h"
+
 #include <CoreFoundation/CoreFoundation.h>
 #if !TARGET_OS_IPHONE
 #include <IOKit/IOKitLib.h>
@@ -12,6 +14,8 @@
 #include <torch/torch.h>
 
 #include <filesystem>
+#include <functional>
+#include <numeric>
 
 using namespace MTL;
 
@@ -321,6 +325,26 @@ int get_apple_cpu_perf_core_count() {
     return cpu_perf_core_count;
 }
 
+void add_metal_monitor_device(GpuMonitor &monitor) {
+    auto *const device = get_mtl_device();
+    monitor.add_device(device->name()->utf8String(), [device] {
+        // Apple GPUs share the host's memory, so there's no PCIe traffic to report, and power
+        // is only available to root, through powermetrics.
+        auto sample = GpuMonitor::Sample();
+        sample.fill(GpuMonitor::kNotReported);
+        sample[GpuMonitor::MEMORY_USED] = double(device->currentAllocatedSize());
+#if !TARGET_OS_IPHONE
+        std::unordered_map<std::string, int64_t> stats;
+        if (retrieve_ioreg_props("IOAccelerator", "PerformanceStatistics", stats)) {
+            if (auto it = stats.find("Device Utilization %"); it != stats.cend()) {
+                sample[GpuMonitor::UTILISATION] = double(it->second);
+            }
+        }
+#endif  // if !TARGET_OS_IPHONE
+        return sample;
+    });
+}
+
 MTL::Buffer *mtl_for_tensor(const torch::Tensor &x) {
     // Metal kernels assume contiguity.
     if (!x.is_contiguous())
@@ -337,4 +361,21 @@ MTL::Buffer *extract_mtl_from_tensor(torch::Tensor &x) {
     return bfr;
 }
 
+torch::Tensor tensor_for_mtl(MTL::Buffer *const buffer,
+                             torch::IntArrayRef sizes,
+                             torch::ScalarType dtype) {
+    const auto numel = std::accumulate(sizes.begin(), sizes.end(), int64_t(1),
+                                       std::multiplies<int64_t>());
+    if (buffer->storageMode() != MTL::StorageModeShared ||
+        buffer->length() < numel * torch::elementSize(dtype)) {
+        throw std::runtime_error("Buffer can't hold a shared tensor of this size");
+    }
+    // The buffer is the storage's context, as for tensors from MTLAllocator, so that
+    // mtl_for_tensor finds it.
+    return at::for_blob(buffer->contents(), sizes)
+            .context(buffer, &MTLAllocator::deleter)
+            .options(torch::TensorOptions().dtype(dtype).device(torch::kCPU))
+            .make_tensor();
+}
+
 }  // namespace dorado::utils
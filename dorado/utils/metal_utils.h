@@ -9,6 +9,8 @@
 
 namespace dorado::utils {
 
+class GpuMonitor;
+
 // Returns an uninitialised MTL::Buffer of length bytes.
 MTL::Buffer *create_buffer(MTL::Device *device, size_t length);
 
@@ -46,7 +48,16 @@ void launch_kernel_no_wait(MTL::ComputePipelineState *cps,
 MTL::Device *get_mtl_device();
 int get_mtl_device_core_count();
 int get_apple_cpu_perf_core_count();
+// Adds the Metal device to monitor, which reads its utilisation from the IO Registry and the
+// memory allocated on it from Metal.
+void add_metal_monitor_device(GpuMonitor &monitor);
 MTL::Buffer *mtl_for_tensor(const torch::Tensor &t);
 MTL::Buffer *extract_mtl_from_tensor(torch::Tensor &t);
+// Returns a contiguous tensor of the given shape over buffer, which it takes ownership of.
+// buffer must be in shared storage, so that the CPU can write the tensor and kernels can be
+// passed mtl_for_tensor of it without a copy.
+torch::Tensor tensor_for_mtl(MTL::Buffer *buffer,
+                             torch::IntArrayRef sizes,
+                             torch::ScalarType dtype);
 
 }  // namespace dorado::utils
@@ -3,15 +3,413 @@
 #include <elzip/elzip.hpp>
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <regex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
 #define CPPHTTPLIB_OPENSSL_SUPPORT
 #include <httplib.h>
+#include <openssl/sha.h>
 #include <spdlog/spdlog.h>
 
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
 namespace fs = std::filesystem;
 
+namespace {
+
+// The most models fetched at once.
+constexpr size_t kMaxConcurrentDownloads = 4;
+// Attempts at fetching an archive, each resuming from where the last one got to.
+constexpr int kMaxFetchAttempts = 3;
+// A claim on a partial archive older than this is taken to be from a run which died.
+constexpr auto kStaleClaimAge = std::chrono::hours(1);
+
+std::mutex models_cache_mutex;
+fs::path models_cache_directory;
+
+// Appended to what a run is writing until it's complete, so that no other run reads part of it.
+std::string temporary_suffix() { return ".tmp." + std::to_string(getpid()); }
+
+// The SHA-256 of the file's contents, in hex.
+std::string file_sha256(const fs::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Could not open " + path.string());
+    }
+    SHA256_CTX sha256;
+    SHA256_Init(&sha256);
+    std::vector<char> buffer(1 << 20);
+    while (file.read(buffer.data(), buffer.size()) || file.gcount() > 0) {
+        SHA256_Update(&sha256, buffer.data(), size_t(file.gcount()));
+    }
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+    SHA256_Final(hash, &sha256);
+    std::ostringstream hex;
+    for (unsigned char byte : hash) {
+        hex << std::hex << std::setw(2) << std::setfill('0') << int(byte);
+    }
+    return hex.str();
+}
+
+// The CRC-32 of data, continuing from crc, as zip archives record it for each file.
+uint32_t crc32(uint32_t crc, const char* data, size_t length) {
+    static const auto table = [] {
+        std::array<uint32_t, 256> entries{};
+        for (uint32_t i = 0; i < entries.size(); ++i) {
+            uint32_t entry = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                entry = (entry & 1) ? 0xedb88320u ^ (entry >> 1) : entry >> 1;
+            }
+            entries[i] = entry;
+        }
+        return entries;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < length; ++i) {
+        crc = table[(crc ^ uint8_t(data[i])) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// The CRC-32 of the file's contents, or nothing if it can't be read.
+std::optional<uint32_t> file_crc32(const fs::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return std::nullopt;
+    }
+    uint32_t crc = 0;
+    std::vector<char> buffer(1 << 20);
+    while (file.read(buffer.data(), buffer.size()) || file.gcount() > 0) {
+        crc = crc32(crc, buffer.data(), size_t(file.gcount()));
+    }
+    return crc;
+}
+
+uint32_t read_le(const std::string& bytes, size_t offset, size_t length) {
+    uint32_t value = 0;
+    for (size_t i = length; i-- > 0;) {
+        value = (value << 8) | uint8_t(bytes[offset + i]);
+    }
+    return value;
+}
+
+// The CRC-32 the central directory of the zip archive records for each file in it, by name, or
+// nothing if there's no directory to be found, as when the archive was cut short.
+std::optional<std::map<std::string, uint32_t>> zip_crcs(const fs::path& archive) {
+    std::ifstream file(archive, std::ios::binary | std::ios::ate);
+    const auto size = std::streamoff(file.tellg());
+    if (!file || size < 22) {
+        return std::nullopt;
+    }
+    // The end of central directory record is last, followed by a comment of up to 64KiB.
+    const auto tail_size = std::min<std::streamoff>(size, 22 + 0xffff);
+    std::string tail(size_t(tail_size), '\0');
+    file.seekg(size - tail_size);
+    if (!file.read(tail.data(), tail_size)) {
+        return std::nullopt;
+    }
+    const auto end = tail.rfind(std::string("PK\5\6", 4));
+    if (end == std::string::npos || end + 22 > tail.size()) {
+        return std::nullopt;
+    }
+    const uint32_t directory_size = read_le(tail, end + 12, 4);
+    const uint32_t directory_offset = read_le(tail, end + 16, 4);
+    // Zip64 archives, which model archives are far too small to be, aren't read.
+    if (directory_offset == 0xffffffff ||
+        std::streamoff(directory_offset) + directory_size > size) {
+        return std::nullopt;
+    }
+    std::string directory(directory_size, '\0');
+    file.seekg(directory_offset);
+    if (!file.read(directory.data(), directory_size)) {
+        return std::nullopt;
+    }
+
+    std::map<std::string, uint32_t> crcs;
+    for (size_t offset = 0; offset + 46 <= directory.size();) {
+        if (read_le(directory, offset, 4) != 0x02014b50) {
+            return std::nullopt;
+        }
+        const size_t name_length = read_le(directory, offset + 28, 2);
+        const size_t extra_length = read_le(directory, offset + 30, 2);
+        const size_t comment_length = read_le(directory, offset + 32, 2);
+        if (offset + 46 + name_length > directory.size()) {
+            return std::nullopt;
+        }
+        auto name = directory.substr(offset + 46, name_length);
+        // Directories hold nothing to check.
+        if (!name.empty() && name.back() != '/') {
+            crcs[std::move(name)] = read_le(directory, offset + 16, 4);
+        }
+        offset += 46 + name_length + extra_length + comment_length;
+    }
+    return crcs;
+}
+
+// Whether every file in archive was extracted into directory with the contents it was archived
+// with.  The CDN publishes no checksums of its own, so this is what catches a corrupt download,
+// or a resumed one whose two halves don't belong together.
+bool verify_extracted(const fs::path& archive, const fs::path& directory) {
+    const auto crcs = zip_crcs(archive);
+    if (!crcs || crcs->empty()) {
+        spdlog::debug("- {} has no central directory", archive.string());
+        return false;
+    }
+    for (const auto& [name, crc] : *crcs) {
+        if (file_crc32(directory / fs::u8path(name)) != crc) {
+            spdlog::debug("- {} in {} doesn't match its checksum", name, archive.string());
+            return false;
+        }
+    }
+    return true;
+}
+
+// Where what identifies the version of the partial archive the server sent is kept, so that
+// resuming it can ask for the rest of that version and no other.
+fs::path validator_path(const fs::path& archive) {
+    auto path = archive;
+    path += ".validator";
+    return path;
+}
+
+// Claims the partial archive the claim is for, so that no other run appends to it meanwhile.
+// Returns false if another run has it.
+bool claim_partial_archive(const fs::path& claim) {
+    std::error_code error;
+    if (fs::exists(claim, error)) {
+        const auto age = fs::file_time_type::clock::now() - fs::last_write_time(claim, error);
+        if (!error && age > kStaleClaimAge) {
+            fs::remove(claim, error);
+        }
+    }
+    // Fails if the claim exists, however many runs try at once.
+    FILE* file = std::fopen(claim.string().c_str(), "wx");
+    if (!file) {
+        return false;
+    }
+    std::fclose(file);
+    return true;
+}
+
+// Fetches the archive of model into archive, resuming from whatever it already holds if the
+// server serves ranges of the same version of it.  Returns false if it couldn't be fetched.
+bool fetch_archive(const std::string& model, const fs::path& archive) {
+    httplib::Client http(dorado::urls::URL_ROOT);
+    http.enable_server_certificate_verification(false);
+    http.set_follow_location(true);
+    const auto path = dorado::urls::URL_PATH + model + ".zip";
+
+    for (int attempt = 0; attempt < kMaxFetchAttempts; ++attempt) {
+        std::error_code error;
+        const auto offset = fs::exists(archive, error) ? fs::file_size(archive, error) : 0;
+        std::string validator;
+        std::ifstream(validator_path(archive)) >> validator;
+        httplib::Headers headers;
+        if (offset > 0 && !validator.empty()) {
+            spdlog::debug("- resuming {} from {} bytes", model, offset);
+            headers.emplace("Range", "bytes=" + std::to_string(offset) + "-");
+            // The server sends all of the archive, not the rest, if it has changed since.
+            headers.emplace("If-Range", validator);
+        }
+        std::ofstream file;
+        int status = 0;
+        auto res = http.Get(
+                path, headers,
+                [&](const httplib::Response& response) {
+                    status = response.status;
+                    if (status != 200 && status != 206) {
+                        return false;
+                    }
+                    // A server which ignores the range, or whose archive has changed, sends all
+                    // of it again, which replaces what was resumed.
+                    const bool append = status == 206;
+                    if (!append) {
+                        // A strong ETag, failing which the time it was changed, names the
+                        // version, as If-Range takes them.
+                        auto version = response.get_header_value("ETag");
+                        if (version.empty() || version.rfind("W/", 0) == 0) {
+                            version = response.get_header_value("Last-Modified");
+                        }
+                        std::ofstream(validator_path(archive), std::ios::trunc) << version;
+                    }
+                    file.open(archive,
+                              std::ios::binary | (append ? std::ios::app : std::ios::trunc));
+                    return bool(file);
+                },
+                [&](const char* data, size_t length) {
+                    return bool(file.write(data, std::streamsize(length)));
+                });
+        file.close();
+        if (res && (status == 200 || status == 206) && file) {
+            return true;
+        }
+        if (status == 416) {
+            // The partial archive is no prefix of the one served now.
+            fs::remove(archive, error);
+            fs::remove(validator_path(archive), error);
+        }
+        spdlog::debug("- fetching {} failed, status {}", model, status);
+    }
+    return false;
+}
+
+// Extracts model from its archive into directory, where it appears all at once, so that any
+// run reading it meanwhile finds either all of it or none.  Returns false if the archive is
+// broken, or what it extracts to doesn't match the checksums it holds.
+bool extract_model(const fs::path& archive, const std::string& model, const fs::path& directory) {
+    const auto staging = directory / (model + temporary_suffix());
+    std::error_code error;
+    fs::remove_all(staging, error);
+    try {
+        elz::extractZip(archive, staging);
+    } catch (const std::exception& e) {
+        spdlog::debug("- extracting {} failed: {}", archive.string(), e.what());
+        fs::remove_all(staging, error);
+        return false;
+    }
+    if (!verify_extracted(archive, staging)) {
+        fs::remove_all(staging, error);
+        return false;
+    }
+    // Another run may have put the same model there first, which is kept.
+    fs::rename(staging / model, directory / model, error);
+    fs::remove_all(staging, error);
+    return fs::exists(directory / model, error);
+}
+
+// Fetches and extracts model into directory, through a partial archive in partial_directory
+// which a later run can resume from, unless another run is fetching it.  Returns the SHA-256
+// of the archive, or an empty string if it couldn't be fetched.
+std::string fetch_model(const std::string& model,
+                        const fs::path& partial_directory,
+                        const std::function<fs::path(const std::string&)>& directory) {
+    auto archive = partial_directory / (model + ".zip");
+    auto claim = archive;
+    claim += ".claim";
+    const bool claimed = claim_partial_archive(claim);
+    if (!claimed) {
+        spdlog::debug("- {} is being fetched by another run", model);
+        archive += temporary_suffix();
+    }
+
+    std::string checksum;
+    std::error_code error;
+    // A resumed archive which turns out to be broken is fetched again from the start.
+    for (int attempt = 0; attempt < 2 && checksum.empty(); ++attempt) {
+        if (!fetch_archive(model, archive)) {
+            break;
+        }
+        const auto sha256 = file_sha256(archive);
+        if (extract_model(archive, model, directory(sha256))) {
+            checksum = sha256;
+        }
+        fs::remove(archive, error);
+        fs::remove(validator_path(archive), error);
+    }
+    if (claimed) {
+        fs::remove(claim, error);
+    }
+    return checksum;
+}
+
+// Where model is in the cache, or an empty path if it isn't.  Models are found by the SHA-256
+// of their archive, under trees, from the record of it in refs, which is only written once the
+// model is in place, so reading the cache needs no locks.
+fs::path find_cached_model(const fs::path& cache, const std::string& model) {
+    std::ifstream ref(cache / "refs" / model);
+    std::string sha256;
+    if (!(ref >> sha256)) {
+        return {};
+    }
+    std::error_code error;
+    const auto path = cache / "trees" / sha256 / model;
+    return fs::is_directory(path, error) ? path : fs::path{};
+}
+
+// Fetches model into the cache, unless it's there already, and returns where it is, or an
+// empty path if it couldn't be fetched.
+fs::path cache_model(const fs::path& cache, const std::string& model) {
+    if (auto path = find_cached_model(cache, model); !path.empty()) {
+        spdlog::info(" - found {} in {}", model, cache.string());
+        return path;
+    }
+    std::error_code error;
+    for (const char* subdirectory : {"refs", "trees", "partial"}) {
+        fs::create_directories(cache / subdirectory, error);
+        if (error) {
+            spdlog::warn("Unable to cache models in {}: {}", cache.string(), error.message());
+            return {};
+        }
+    }
+
+    spdlog::info(" - downloading {} into {}", model, cache.string());
+    const auto sha256 = fetch_model(model, cache / "partial", [&cache](const std::string& sha256) {
+        std::error_code create_error;
+        fs::create_directories(cache / "trees" / sha256, create_error);
+        return cache / "trees" / sha256;
+    });
+    if (sha256.empty()) {
+        return {};
+    }
+    const auto ref = cache / "refs" / model;
+    auto staging = ref;
+    staging += temporary_suffix();
+    std::ofstream(staging) << sha256 << '\n';
+    fs::rename(staging, ref, error);
+    if (error) {
+        fs::remove(staging, error);
+    }
+    return cache / "trees" / sha256 / model;
+}
+
+// Copies the model at source into directory, where it appears all at once.
+bool copy_model(const fs::path& source, const std::string& model, const fs::path& directory) {
+    const auto staging = directory / (model + temporary_suffix());
+    std::error_code error;
+    fs::remove_all(staging, error);
+    fs::copy(source, staging, fs::copy_options::recursive, error);
+    if (!error) {
+        fs::rename(staging, directory / model, error);
+    }
+    fs::remove_all(staging, error);
+    return fs::exists(directory / model, error);
+}
+
+}  // namespace
+
 namespace dorado::utils {
 
+std::filesystem::path default_models_cache() {
+    const char* cache = std::getenv("DORADO_MODELS_CACHE");
+    return cache ? fs::path(cache) : fs::path{};
+}
+
+void set_models_cache(const std::filesystem::path& directory) {
+    std::lock_guard<std::mutex> lock(models_cache_mutex);
+    models_cache_directory = directory;
+}
+
 bool is_valid_model(const std::string& selected_model) {
     return selected_model == "all" ||
            std::find(simplex::models.begin(), simplex::models.end(), selected_model) !=
@@ -23,35 +421,58 @@ bool is_valid_model(const std::string& selected_model) {
 }
 
 void download_models(const std::string& target_directory, const std::string& selected_model) {
-    fs::path directory(target_directory);
+    const fs::path directory(target_directory);
+    fs::path cache;
+    {
+        std::lock_guard<std::mutex> lock(models_cache_mutex);
+        cache = models_cache_directory;
+    }
 
-    httplib::Client http(urls::URL_ROOT);
-    http.enable_server_certificate_verification(false);
-    http.set_follow_location(true);
+    std::vector<std::string> selected;
+    for (const auto* models : {&simplex::models, &stereo::models, &modified::models}) {
+        std::copy_if(models->begin(), models->end(), std::back_inserter(selected),
+                     [&selected_model](const std::string& model) {
+                         return selected_model == "all" || selected_model == model;
+                     });
+    }
 
-    auto download_model_set = [&](std::vector<std::string> models) {
-        for (const auto& model : models) {
-            if (selected_model == "all" || selected_model == model) {
-                auto url = urls::URL_ROOT + urls::URL_PATH + model + ".zip";
-                spdlog::info(" - downloading {}", model);
-                auto res = http.Get(url.c_str());
-                if (res != nullptr) {
-                    fs::path archive(directory / (model + ".zip"));
-                    std::ofstream ofs(archive.string(), std::ofstream::binary);
-                    ofs << res->body;
-                    ofs.close();
-                    elz::extractZip(archive, directory);
-                    fs::remove(archive);
-                } else {
-                    spdlog::error("Failed to download {}", model);
-                }
+    auto download_model = [&](const std::string& model) {
+        if (!cache.empty()) {
+            const auto cached = cache_model(cache, model);
+            if (!cached.empty() && copy_model(cached, model, directory)) {
+                return true;
             }
+            // Without the cache, the model is still fetched straight into the directory.
         }
+        spdlog::info(" - downloading {}", model);
+        return !fetch_model(model, directory, [&directory](const std::string&) {
+                    return directory;
+                }).empty();
     };
 
-    download_model_set(simplex::models);
-    download_model_set(stereo::models);
-    download_model_set(modified::models);
+    // Each model is fetched on a thread of its own, a few at a time.
+    std::atomic<size_t> next_model{0};
+    auto download_thread = [&] {
+        for (size_t i = next_model++; i < selected.size(); i = next_model++) {
+            bool downloaded = false;
+            try {
+                downloaded = download_model(selected[i]);
+            } catch (const std::exception& e) {
+                spdlog::debug("- downloading {} failed: {}", selected[i], e.what());
+            }
+            if (!downloaded) {
+                spdlog::error("Failed to download {}", selected[i]);
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < std::min(kMaxConcurrentDownloads, selected.size()); ++i) {
+        threads.emplace_back(download_thread);
+    }
+    download_thread();
+    for (auto& thread : threads) {
+        thread.join();
+    }
 }
 
 bool is_rna_model(const std::filesystem::path& model) {
@@ -109,4 +530,21 @@ uint16_t get_sample_rate_by_model_name(const std::string& model_name) {
     }
 }
 
+float get_bases_per_second_by_model_name(const std::string& model_name) {
+    static const std::regex speed_regex("_([0-9]+)bps");
+    std::smatch match;
+    if (std::regex_search(model_name, match, speed_regex)) {
+        return std::stof(match[1].str());
+    }
+    return model_name.rfind("rna", 0) == 0 ? 70.f : 400.f;
+}
+
+size_t min_signal_samples_for_length(size_t min_bases, float sample_rate, float bases_per_second) {
+    constexpr float kMaxSpeedFactor = 2.f;
+    if (bases_per_second <= 0.f) {
+        return 0;
+    }
+    return size_t(min_bases * sample_rate / (kMaxSpeedFactor * bases_per_second));
+}
+
 }  // namespace dorado::utils
@@ -140,6 +140,19 @@ static const std::unordered_map<std::string, uint16_t> sample_rate_by_model = {
 
 bool is_rna_model(const std::filesystem::path& model);
 bool is_valid_model(const std::string& selected_model);
+
+// The directory models are cached in from DORADO_MODELS_CACHE, e.g. on a volume shared by
+// ephemeral workers, or an empty path for no cache.
+std::filesystem::path default_models_cache();
+// Sets the directory download_models() fetches models through.  Empty means no cache.  Models
+// are kept in it by the checksum of their archive, and appear in it whole, so any number of
+// runs can read it at once without locks.
+void set_models_cache(const std::filesystem::path& directory);
+
+// Downloads selected_model, or "all" of them, into target_directory, copying them from the
+// models cache if they're there.  Several models are fetched at once, and a partial fetch from
+// a run which died is resumed if the server still has the same version.  What's extracted is
+// checked against the CRC-32 the archive records for each file.
 void download_models(const std::string& target_directory, const std::string& selected_model);
 
 // finds the matching modification model for a given modification i.e. 5mCG and a simplex model
@@ -152,6 +165,14 @@ std::string get_modification_model(const std::string& simplex_model,
 // present in the mapping, assume a sampling rate of 4000.
 uint16_t get_sample_rate_by_model_name(const std::string& model_name);
 
+// The translocation speed the model was trained for, from the "400bps" part of its name.  For
+// models without one, assume 400 bases per second, or 70 for RNA.
+float get_bases_per_second_by_model_name(const std::string& model_name);
+
+// The fewest samples, at sample_rate, in a read which could be called as min_bases bases, if it
+// had translocated at up to twice bases_per_second.  Reads with fewer can be dropped unseen.
+size_t min_signal_samples_for_length(size_t min_bases, float sample_rate, float bases_per_second);
+
 }  // namespace utils
 
 }  // namespace dorado
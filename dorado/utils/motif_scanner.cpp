@@ -0,0 +1,114 @@
+#include "motif_scanner.h"
+
+#include <stdexcept>
+
+namespace dorado::utils {
+
+namespace {
+
+// The bases (A, C, G, T as bits 0 to 3) matched by an IUPAC nucleotide code, or 0 if it
+// isn't one.
+int iupac_bases(char code) {
+    switch (code) {
+    case 'A':
+        return 0b0001;
+    case 'C':
+        return 0b0010;
+    case 'G':
+        return 0b0100;
+    case 'T':
+    case 'U':
+        return 0b1000;
+    case 'R':
+        return 0b0101;
+    case 'Y':
+        return 0b1010;
+    case 'S':
+        return 0b0110;
+    case 'W':
+        return 0b1001;
+    case 'K':
+        return 0b1100;
+    case 'M':
+        return 0b0011;
+    case 'B':
+        return 0b1110;
+    case 'D':
+        return 0b1101;
+    case 'H':
+        return 0b1011;
+    case 'V':
+        return 0b0111;
+    case 'N':
+        return 0b1111;
+    default:
+        return 0;
+    }
+}
+
+constexpr int kWordBits = 64;
+constexpr char kBases[] = "ACGT";
+
+}  // namespace
+
+size_t MotifScanner::add_motif(const std::string& motif, size_t offset) {
+    if (motif.empty() || motif.size() > kWordBits) {
+        throw std::runtime_error("Motif '" + motif + "' must be between 1 and 64 bases long.");
+    }
+    if (offset >= motif.size()) {
+        throw std::runtime_error("Offset " + std::to_string(offset) + " is outside motif '" +
+                                 motif + "'.");
+    }
+    const int length = static_cast<int>(motif.size());
+    if (m_words.empty() || m_words.back().bits_used + length > kWordBits) {
+        m_words.emplace_back();
+    }
+    auto& word = m_words.back();
+
+    for (int i = 0; i < length; ++i) {
+        const int bases = iupac_bases(motif[i]);
+        if (bases == 0) {
+            throw std::runtime_error("Invalid character '" + std::string(1, motif[i]) +
+                                     "' in motif '" + motif + "'.");
+        }
+        const uint64_t bit = uint64_t(1) << (word.bits_used + i);
+        for (int base = 0; base < 4; ++base) {
+            if (bases & (1 << base)) {
+                word.accepts[static_cast<unsigned char>(kBases[base])] |= bit;
+            }
+        }
+    }
+
+    const uint64_t last_bit = uint64_t(1) << (word.bits_used + length - 1);
+    word.first_bits |= uint64_t(1) << word.bits_used;
+    word.last_bits |= last_bit;
+    word.bits_used += length;
+    word.motifs.push_back({m_num_motifs, last_bit, motif.size(), offset});
+    return m_num_motifs++;
+}
+
+std::vector<std::vector<size_t>> MotifScanner::scan(std::string_view sequence) const {
+    std::vector<std::vector<size_t>> hits(m_num_motifs);
+    for (const auto& word : m_words) {
+        // Bit i of state is set if the sequence so far ends with the first i + 1 positions of the
+        // motif which bit i is in.  Each character extends every partial match by one position,
+        // and starts a new one at each motif's first position, keeping those it can match.
+        uint64_t state = 0;
+        for (size_t pos = 0; pos < sequence.size(); ++pos) {
+            state = ((state << 1) | word.first_bits) &
+                    word.accepts[static_cast<unsigned char>(sequence[pos])];
+            const uint64_t matches = state & word.last_bits;
+            if (matches == 0) {
+                continue;
+            }
+            for (const auto& motif : word.motifs) {
+                if (matches & motif.last_bit) {
+                    hits[motif.index].push_back(pos + 1 - motif.length + motif.offset);
+                }
+            }
+        }
+    }
+    return hits;
+}
+
+}  // namespace dorado::utils
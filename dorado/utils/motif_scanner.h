@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace dorado::utils {
+
+/** Finds the occurrences of several motifs in a sequence in one pass over it.
+ *
+ *  Motifs may contain IUPAC ambiguity codes, e.g. DRACH.  Each motif position is one bit of a
+ *  shift-and automaton, and motifs are packed side by side into 64 bit words, so that every
+ *  character of the sequence advances all of the motifs in a word with a few integer ops.
+ */
+class MotifScanner {
+public:
+    /** Add a motif to find.
+     *  @param motif The motif, made up of IUPAC nucleotide codes.
+     *  @param offset The position within the motif of the base each hit is reported at.
+     *  @return The index of the motif in the results of scan.
+     *  @throws std::runtime_error if the motif is empty, longer than 64 bases, contains a
+     *  character which isn't an IUPAC nucleotide code, or offset is outside it.
+     */
+    size_t add_motif(const std::string& motif, size_t offset);
+
+    size_t num_motifs() const { return m_num_motifs; }
+
+    /** Find every occurrence of each motif in sequence.
+     *  @return For each motif, in the order they were added, the positions in sequence of the
+     *  motif's offset base, in ascending order.  Occurrences may overlap.
+     */
+    std::vector<std::vector<size_t>> scan(std::string_view sequence) const;
+
+private:
+    struct Motif {
+        size_t index;
+        uint64_t last_bit;  // The bit of the motif's last position.
+        size_t length;
+        size_t offset;
+    };
+
+    // A group of motifs sharing one automaton.
+    struct Word {
+        std::array<uint64_t, 256> accepts{};  // The positions each character can match.
+        uint64_t first_bits = 0;
+        uint64_t last_bits = 0;
+        int bits_used = 0;
+        std::vector<Motif> motifs;
+    };
+
+    std::vector<Word> m_words;
+    size_t m_num_motifs = 0;
+};
+
+}  // namespace dorado::utils
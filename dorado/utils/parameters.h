@@ -25,6 +25,10 @@ struct DefaultParameters {
 #endif
     int remora_threads{4};
     float methylation_threshold{0.05f};
+    // Number of input files the DataLoader keeps open at once.
+    int max_concurrent_files{4};
+    // Target time, in milliseconds, from a chunk joining a batch to the batch being called.
+    int batch_latency_target{2000};
 
     // Minimum length for a sequence to be outputted.
     size_t min_seqeuence_length{5};
@@ -2,8 +2,21 @@
 
 namespace dorado::utils {
 std::shared_ptr<Read> shallow_copy_read(const Read& read) {
+    auto copy = copy_read_metadata(read);
+    copy->seq = read.seq;
+    copy->qstring = read.qstring;
+    copy->moves = read.moves;
+
+    copy->base_mod_positions = read.base_mod_positions;
+    copy->base_mod_probs = read.base_mod_probs;
+    copy->base_mod_info = read.base_mod_info;
+    return copy;
+}
+
+std::shared_ptr<Read> copy_read_metadata(const Read& read) {
     auto copy = std::make_shared<Read>();
     copy->raw_data = read.raw_data;
+    copy->released_raw_data_size = read.released_raw_data_size;
     copy->digitisation = read.digitisation;
     copy->range = read.range;
     copy->offset = read.offset;
@@ -20,15 +33,9 @@ std::shared_ptr<Read> shallow_copy_read(const Read& read) {
     copy->model_stride = read.model_stride;
 
     copy->read_id = read.read_id;
-    copy->seq = read.seq;
-    copy->qstring = read.qstring;
-    copy->moves = read.moves;
     copy->run_id = read.run_id;
     copy->model_name = read.model_name;
 
-    copy->base_mod_probs = read.base_mod_probs;
-    copy->base_mod_info = read.base_mod_info;
-
     copy->num_trimmed_samples = read.num_trimmed_samples;
 
     copy->attributes = read.attributes;
@@ -37,6 +44,8 @@ std::shared_ptr<Read> shallow_copy_read(const Read& read) {
     copy->end_sample = read.end_sample;
     copy->run_acquisition_start_time_ms = read.run_acquisition_start_time_ms;
     copy->is_duplex = read.is_duplex;
+    copy->is_priority = read.is_priority;
+    copy->sequence_number = read.sequence_number;
     return copy;
 }
 
@@ -3,4 +3,7 @@
 
 namespace dorado::utils {
 std::shared_ptr<Read> shallow_copy_read(const Read& read);
+// Copies all of read but its basecall (seq, qstring and moves) and modified base calls, e.g. for
+// a subread which takes only part of them.  The signal is shared, as with shallow_copy_read.
+std::shared_ptr<Read> copy_read_metadata(const Read& read);
 }  // namespace dorado::utils
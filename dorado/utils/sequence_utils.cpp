@@ -8,6 +8,7 @@
 #include <algorithm>
 #include <array>
 #include <cmath>
+#include <cstring>
 #include <iterator>
 #include <numeric>
 #include <vector>
@@ -20,19 +21,61 @@ const char seq_nt16_str[] = "=ACMGRSVTWYHKDBN";
 
 namespace {
 
+using dorado::utils::CpuDispatch;
+using dorado::utils::CpuIsa;
+
+// Error probabilities of each phred+33 character.
+// Unfortunately std::pow is not constexpr, so this can't be.
+const std::array<float, 256>& char_to_error_table() {
+    static const auto kCharToErrorTable = [] {
+        std::array<float, 256> a{};
+        for (int q = 33; q <= 127; ++q) {
+            auto shifted = static_cast<float>(q - 33);
+            a[q] = std::pow(10.0f, -shifted / 10.0f);
+        }
+        return a;
+    }();
+    return kCharToErrorTable;
+}
+
+float total_error_generic(const char* qstring, size_t len) {
+    const auto& table = char_to_error_table();
+    float total_error = 0.0f;
+    for (size_t i = 0; i < len; ++i) {
+        total_error += table[static_cast<uint8_t>(qstring[i])];
+    }
+    return total_error;
+}
+
 #if ENABLE_AVX2_IMPL
-__attribute__((target("default")))
-#endif
-std::string
-reverse_complement_impl(const std::string& sequence) {
-    if (sequence.empty()) {
-        return {};
+// Looks up 8 characters at a time with a gather, keeping 8 partial sums.
+__attribute__((target("avx2"))) float total_error_avx2(const char* qstring, size_t len) {
+    const float* table = char_to_error_table().data();
+    __m256 partial_sums = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        const __m128i chars = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(qstring + i));
+        const __m256i indices = _mm256_cvtepu8_epi32(chars);
+        partial_sums = _mm256_add_ps(partial_sums, _mm256_i32gather_ps(table, indices, 4));
     }
 
-    const auto num_bases = sequence.size();
-    std::string rev_comp_sequence;
-    rev_comp_sequence.resize(num_bases);
+    // Reduce the partial sums, then add on the final 0-7 chars.
+    __m128 sums = _mm_add_ps(_mm256_castps256_ps128(partial_sums),
+                             _mm256_extractf128_ps(partial_sums, 1));
+    sums = _mm_add_ps(sums, _mm_movehl_ps(sums, sums));
+    sums = _mm_add_ss(sums, _mm_shuffle_ps(sums, sums, 1));
+    float total_error = _mm_cvtss_f32(sums);
+    for (; i < len; ++i) {
+        total_error += table[static_cast<uint8_t>(qstring[i])];
+    }
+    return total_error;
+}
+#endif
 
+const CpuDispatch<decltype(total_error_generic)> total_error_impl(
+        total_error_generic, {{CpuIsa::AVX2, AVX2_KERNEL(total_error_avx2)}});
+
+void reverse_complement_generic(const char* sequence, size_t num_bases, char* rev_comp_sequence) {
     // Compile-time constant lookup table.
     static constexpr auto kComplementTable = [] {
         std::array<char, 256> a{};
@@ -45,24 +88,21 @@ reverse_complement_impl(const std::string& sequence) {
     }();
 
     // Run every template base through the table, reading in reverse order.
-    const char* template_ptr = &sequence[num_bases - 1];
-    char* complement_ptr = &rev_comp_sequence[0];
+    const char* template_ptr = sequence + num_bases;
+    char* complement_ptr = rev_comp_sequence;
     for (size_t i = 0; i < num_bases; ++i) {
-        const auto template_base = *template_ptr--;
+        const auto template_base = static_cast<uint8_t>(*--template_ptr);
         *complement_ptr++ = kComplementTable[template_base];
     }
-    return rev_comp_sequence;
 }
 
 #if ENABLE_AVX2_IMPL
 // AVX2 implementation that does in-register lookups of 32 bases at once, using
 // PSHUFB. On strings with over several thousand bases this was measured to be about 10x the speed
 // of the default implementation on Skylake.
-__attribute__((target("avx2"))) std::string reverse_complement_impl(const std::string& sequence) {
-    const auto len = sequence.size();
-    std::string rev_comp_sequence;
-    rev_comp_sequence.resize(len);
-
+__attribute__((target("avx2"))) void reverse_complement_avx2(const char* sequence,
+                                                             size_t len,
+                                                             char* rev_comp_sequence) {
     // Maps from lower 4 bits of template base ASCII to complement base ASCII.
     // It happens that the low 4 bits of A, C, G and T ASCII encodings are unique, and
     // these are the only bits the PSHUFB instruction we use cares about (aside from the high
@@ -84,13 +124,14 @@ __attribute__((target("avx2"))) std::string reverse_complement_impl(const std::s
     // Unroll to AVX register size.  Unrolling further would probably help performance.
     static constexpr size_t kUnroll = 32;
 
-    // This starts pointing at the beginning of the first complete 32 byte template chunk
-    // that we load -- i.e. the one last in memory.
-    const char* template_ptr = &sequence[len - kUnroll];
-    char* complement_ptr = &rev_comp_sequence[0];
+    // This starts pointing just past the end of the template, and moves back one 32 byte
+    // chunk before each load -- i.e. the first chunk loaded is the one last in memory.
+    const char* template_ptr = sequence + len;
+    char* complement_ptr = rev_comp_sequence;
 
     // Main vectorised loop: 32 bases per iteration.
     for (size_t chunk_i = 0; chunk_i < len / kUnroll; ++chunk_i) {
+        template_ptr -= kUnroll;
         // Load template bases.
         const __m256i template_bases =
                 _mm256_loadu_si256(reinterpret_cast<const __m256i*>(template_ptr));
@@ -106,26 +147,177 @@ __attribute__((target("avx2"))) std::string reverse_complement_impl(const std::s
         _mm_storeu_si128(reinterpret_cast<__m128i*>(complement_ptr), upper_lane);
         _mm_storeu_si128(reinterpret_cast<__m128i*>(complement_ptr + 16), lower_lane);
 
-        template_ptr -= kUnroll;
         complement_ptr += kUnroll;
     }
 
     // Loop for final 0-31 chars.
     const size_t remaining_len = len % kUnroll;
     const __m256i kZero = _mm256_setzero_si256();
-    template_ptr = &sequence[remaining_len - 1];
+    template_ptr = sequence + remaining_len;
     for (size_t i = 0; i < remaining_len; ++i) {
         // Same steps as in the main loop, but char by char, so there's no
         // reversal of byte ordering, and we load/store with scalar instructions.
-        const __m256i template_base = _mm256_insert_epi8(kZero, *template_ptr--, 0);
+        const __m256i template_base = _mm256_insert_epi8(kZero, *--template_ptr, 0);
         const __m256i complement_base = _mm256_shuffle_epi8(kComplementTable, template_base);
         *complement_ptr++ = _mm256_extract_epi8(complement_base, 0);
     }
+}
+#endif
 
-    return rev_comp_sequence;
+const CpuDispatch<decltype(reverse_complement_generic)> reverse_complement_impl(
+        reverse_complement_generic, {{CpuIsa::AVX2, AVX2_KERNEL(reverse_complement_avx2)}});
+
+void convert_nt16_to_str_generic(const uint8_t* bseq, size_t slen, char* seq) {
+    for (size_t i = 0; i < slen; i++) {
+        seq[i] = seq_nt16_str[bam_seqi(bseq, i)];
+    }
+}
+
+#if ENABLE_AVX2_IMPL
+// Decodes 32 bases from 16 bytes at once, looking up each nibble's character with PSHUFB and
+// interleaving the high (first) and low (second) nibbles' characters.
+__attribute__((target("avx2"))) void convert_nt16_to_str_avx2(const uint8_t* bseq,
+                                                              size_t slen,
+                                                              char* seq) {
+    const __m128i kNt16Table = _mm_loadu_si128(reinterpret_cast<const __m128i*>(seq_nt16_str));
+    const __m128i kLowNibbleMask = _mm_set1_epi8(0xf);
+
+    static constexpr size_t kBasesPerChunk = 32;
+    size_t i = 0;
+    for (; i + kBasesPerChunk <= slen; i += kBasesPerChunk) {
+        const __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bseq + i / 2));
+        // There's no 8 bit shift, so shift 16 bit lanes and mask off what comes in from above.
+        const __m128i high_nibbles = _mm_and_si128(_mm_srli_epi16(packed, 4), kLowNibbleMask);
+        const __m128i low_nibbles = _mm_and_si128(packed, kLowNibbleMask);
+        const __m128i first_bases = _mm_shuffle_epi8(kNt16Table, high_nibbles);
+        const __m128i second_bases = _mm_shuffle_epi8(kNt16Table, low_nibbles);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(seq + i),
+                         _mm_unpacklo_epi8(first_bases, second_bases));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(seq + i + 16),
+                         _mm_unpackhi_epi8(first_bases, second_bases));
+    }
+
+    // Loop for final 0-31 bases.
+    for (; i < slen; i++) {
+        seq[i] = seq_nt16_str[bam_seqi(bseq, i)];
+    }
 }
 #endif
 
+const CpuDispatch<decltype(convert_nt16_to_str_generic)> convert_nt16_to_str_impl(
+        convert_nt16_to_str_generic, {{CpuIsa::AVX2, AVX2_KERNEL(convert_nt16_to_str_avx2)}});
+
+void moves_to_map_generic(const uint8_t* moves,
+                          size_t num_moves,
+                          size_t block_stride,
+                          uint64_t* seq_to_sig_map) {
+    // Branchless compaction: every position is written, but the output only advances past
+    // moves.  The caller's buffer has slack after the last move, so the write past it is
+    // harmless.
+    size_t num_bases = 0;
+    for (size_t i = 0; i < num_moves; ++i) {
+        seq_to_sig_map[num_bases] = i * block_stride;
+        num_bases += moves[i] == 1;
+    }
+}
+
+#if ENABLE_AVX2_IMPL
+// Compacts 4 positions at a time: the moves among 4 entries pick a permutation which packs
+// their positions to the front of the register, which is stored whole, and the output then
+// advances past just the moves.  The caller's buffer has 3 entries of slack for the last store.
+__attribute__((target("avx2"))) void moves_to_map_avx2(const uint8_t* moves,
+                                                       size_t num_moves,
+                                                       size_t block_stride,
+                                                       uint64_t* seq_to_sig_map) {
+    // For each 4 bit mask, the 32 bit lane indices which move its set 64 bit lanes to the front.
+    static const auto kCompactTable = [] {
+        std::array<std::array<int32_t, 8>, 16> table{};
+        for (int mask = 0; mask < 16; ++mask) {
+            int out_lane = 0;
+            for (int lane = 0; lane < 4; ++lane) {
+                if (mask & (1 << lane)) {
+                    table[mask][2 * out_lane] = 2 * lane;
+                    table[mask][2 * out_lane + 1] = 2 * lane + 1;
+                    ++out_lane;
+                }
+            }
+        }
+        return table;
+    }();
+
+    const __m256i kOnes = _mm256_set1_epi8(1);
+    const auto stride = static_cast<long long>(block_stride);
+    const __m256i kStep = _mm256_set1_epi64x(4 * stride);
+    __m256i positions = _mm256_setr_epi64x(0, stride, 2 * stride, 3 * stride);
+    size_t i = 0;
+    for (; i + 32 <= num_moves; i += 32) {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(moves + i));
+        auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, kOnes)));
+        for (int k = 0; k < 8; ++k, mask >>= 4) {
+            const auto indices = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i*>(kCompactTable[mask & 0xf].data()));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(seq_to_sig_map),
+                                _mm256_permutevar8x32_epi32(positions, indices));
+            seq_to_sig_map += __builtin_popcount(mask & 0xf);
+            positions = _mm256_add_epi64(positions, kStep);
+        }
+    }
+
+    // Loop for final 0-31 entries.
+    for (; i < num_moves; ++i) {
+        if (moves[i] == 1) {
+            *seq_to_sig_map++ = i * block_stride;
+        }
+    }
+}
+#endif
+
+const CpuDispatch<decltype(moves_to_map_generic)> moves_to_map_impl(
+        moves_to_map_generic, {{CpuIsa::AVX2, AVX2_KERNEL(moves_to_map_avx2)}});
+
+void move_cum_sums_generic(const uint8_t* moves, size_t num_moves, uint64_t* cum_sums) {
+    uint64_t total = 0;
+    for (size_t i = 0; i < num_moves; ++i) {
+        total += moves[i];
+        cum_sums[i] = total;
+    }
+}
+
+#if ENABLE_AVX2_IMPL
+// Multiplying 8 packed entries by 0x0101..01 leaves the prefix sum of the first k + 1 in byte
+// k, since for 0/1 entries no byte can carry into the next.  These are widened to 64 bits and
+// added to the running total 4 at a time.
+__attribute__((target("avx2"))) void move_cum_sums_avx2(const uint8_t* moves,
+                                                        size_t num_moves,
+                                                        uint64_t* cum_sums) {
+    static constexpr uint64_t kPrefixSumMultiplier = 0x0101010101010101ull;
+    uint64_t total = 0;
+    size_t i = 0;
+    for (; i + 8 <= num_moves; i += 8) {
+        uint64_t flags;
+        std::memcpy(&flags, moves + i, sizeof(flags));
+        const uint64_t prefix_sums = flags * kPrefixSumMultiplier;
+        const __m128i packed_sums = _mm_cvtsi64_si128(static_cast<long long>(prefix_sums));
+        const __m256i totals = _mm256_set1_epi64x(static_cast<long long>(total));
+        const __m256i low_sums = _mm256_add_epi64(totals, _mm256_cvtepu8_epi64(packed_sums));
+        const __m256i high_sums = _mm256_add_epi64(
+                totals, _mm256_cvtepu8_epi64(_mm_srli_si128(packed_sums, 4)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(cum_sums + i), low_sums);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(cum_sums + i + 4), high_sums);
+        total += prefix_sums >> 56;
+    }
+
+    // Loop for final 0-7 entries.
+    for (; i < num_moves; ++i) {
+        total += moves[i];
+        cum_sums[i] = total;
+    }
+}
+#endif
+
+const CpuDispatch<decltype(move_cum_sums_generic)> move_cum_sums_impl(
+        move_cum_sums_generic, {{CpuIsa::AVX2, AVX2_KERNEL(move_cum_sums_avx2)}});
+
 }  // namespace
 
 namespace dorado::utils {
@@ -137,77 +329,110 @@ float mean_qscore_from_qstring(const std::string& qstring) {
 
     // Lookup table avoids repeated invocation of std::pow, which
     // otherwise dominates run time of this function.
-    // Unfortunately std::pow is not constexpr, so this can't be.
-    static const auto kCharToScoreTable = [] {
-        std::array<float, 256> a{};
-        for (int q = 33; q <= 127; ++q) {
-            auto shifted = static_cast<float>(q - 33);
-            a[q] = std::pow(10.0f, -shifted / 10.0f);
-        }
-        return a;
-    }();
-    float total_error =
-            std::accumulate(qstring.cbegin(), qstring.cend(), 0.0f,
-                            [](float sum, char qchar) { return sum + kCharToScoreTable[qchar]; });
+    float total_error = total_error_impl(qstring.data(), qstring.size());
     float mean_error = total_error / static_cast<float>(qstring.size());
     float mean_qscore = -10.0f * std::log10(mean_error);
     return std::clamp(mean_qscore, 1.0f, 50.0f);
 }
 
 std::vector<int> sequence_to_ints(const std::string& sequence) {
-    NVTX3_FUNC_RANGE();
     std::vector<int> sequence_ints;
-    sequence_ints.reserve(sequence.size());
-    std::transform(std::begin(sequence), std::end(sequence),
-                   std::back_insert_iterator<std::vector<int>>(sequence_ints), &base_to_int);
+    sequence_to_ints(sequence, sequence_ints);
     return sequence_ints;
 }
 
+void sequence_to_ints(const std::string& sequence, std::vector<int>& sequence_ints) {
+    NVTX3_FUNC_RANGE();
+    // Writing through a plain loop rather than a back inserter lets the compiler vectorise it.
+    sequence_ints.resize(sequence.size());
+    const char* bases = sequence.data();
+    int* ints = sequence_ints.data();
+    for (size_t i = 0, n = sequence.size(); i < n; ++i) {
+        ints[i] = base_to_int(bases[i]);
+    }
+}
+
 // Convert a move table to an array of the indices of the start/end of each base in the signal
 std::vector<uint64_t> moves_to_map(const std::vector<uint8_t>& moves,
                                    size_t block_stride,
                                    size_t signal_len,
                                    std::optional<size_t> reserve_size) {
-    NVTX3_FUNC_RANGE();
     std::vector<uint64_t> seq_to_sig_map;
     if (reserve_size) {
         seq_to_sig_map.reserve(*reserve_size);
     }
+    moves_to_map(moves, block_stride, signal_len, seq_to_sig_map);
+    return seq_to_sig_map;
+}
 
-    for (size_t i = 0; i < moves.size(); ++i) {
-        if (moves[i] == 1) {
-            seq_to_sig_map.push_back(i * block_stride);
-        }
-    }
-    seq_to_sig_map.push_back(signal_len);
+void moves_to_map(const std::vector<uint8_t>& moves,
+                  size_t block_stride,
+                  size_t signal_len,
+                  std::vector<uint64_t>& seq_to_sig_map) {
+    NVTX3_FUNC_RANGE();
+    // Counting first lets the positions be written straight into a buffer of the right size,
+    // plus slack for the vectorised stores.
+    const auto num_bases = static_cast<size_t>(std::count(moves.begin(), moves.end(), 1));
+    seq_to_sig_map.resize(num_bases + 4);
+    moves_to_map_impl(moves.data(), moves.size(), block_stride, seq_to_sig_map.data());
+    seq_to_sig_map.resize(num_bases + 1);
+    seq_to_sig_map[num_bases] = signal_len;
+}
+
+std::vector<uint64_t> moves_to_map(const MoveTable& moves,
+                                   size_t block_stride,
+                                   size_t signal_len) {
+    std::vector<uint64_t> seq_to_sig_map;
+    moves_to_map(moves, block_stride, signal_len, seq_to_sig_map);
     return seq_to_sig_map;
 }
 
+void moves_to_map(const MoveTable& moves,
+                  size_t block_stride,
+                  size_t signal_len,
+                  std::vector<uint64_t>& seq_to_sig_map) {
+    NVTX3_FUNC_RANGE();
+    const size_t num_bases = moves.count();
+    seq_to_sig_map.resize(num_bases + 1);
+    moves.move_positions(seq_to_sig_map.data(), block_stride);
+    seq_to_sig_map[num_bases] = signal_len;
+}
+
 std::vector<uint64_t> move_cum_sums(const std::vector<uint8_t>& moves) {
-    std::vector<uint64_t> ans(moves.size(), 0);
-    if (!moves.empty()) {
-        ans[0] = moves[0];
-    }
-    for (size_t i = 1, n = moves.size(); i < n; i++) {
-        ans[i] = ans[i - 1] + moves[i];
-    }
+    std::vector<uint64_t> ans;
+    move_cum_sums(moves, ans);
     return ans;
 }
 
+void move_cum_sums(const std::vector<uint8_t>& moves, std::vector<uint64_t>& cum_sums) {
+    cum_sums.resize(moves.size());
+    move_cum_sums_impl(moves.data(), moves.size(), cum_sums.data());
+}
+
 // Multiversioned function dispatch doesn't work across the dorado_lib linking
 // boundary.  Without this wrapper, AVX machines still only execute the default
 // version.
 std::string reverse_complement(const std::string& sequence) {
+    std::string rev_comp_sequence;
+    reverse_complement(sequence, rev_comp_sequence);
+    return rev_comp_sequence;
+}
+
+void reverse_complement(const std::string& sequence, std::string& rev_comp_sequence) {
     NVTX3_FUNC_RANGE();
-    return reverse_complement_impl(sequence);
+    rev_comp_sequence.resize(sequence.size());
+    reverse_complement_impl(sequence.data(), sequence.size(), rev_comp_sequence.data());
 }
 
-std::string convert_nt16_to_str(uint8_t* bseq, size_t slen) {
-    std::string seq(slen, '*');
-    for (int i = 0; i < slen; i++) {
-        seq[i] = seq_nt16_str[bam_seqi(bseq, i)];
-    }
+std::string convert_nt16_to_str(const uint8_t* bseq, size_t slen) {
+    std::string seq;
+    convert_nt16_to_str(bseq, slen, seq);
     return seq;
 }
 
+void convert_nt16_to_str(const uint8_t* bseq, size_t slen, std::string& seq) {
+    seq.resize(slen);
+    convert_nt16_to_str_impl(bseq, slen, seq.data());
+}
+
 }  // namespace dorado::utils
@@ -1,5 +1,8 @@
 #pragma once
 
+#include "MoveTable.h"
+
+#include <cstdint>
 #include <optional>
 #include <string>
 #include <vector>
@@ -16,23 +19,44 @@ inline int base_to_int(char c) { return 0b11 & ((c >> 2) ^ (c >> 1)); }
 // Convert a sequence string to integer representation
 // No checking is performed on the input
 std::vector<int> sequence_to_ints(const std::string& sequence);
+// As above, but into sequence_ints, reusing its storage.
+void sequence_to_ints(const std::string& sequence, std::vector<int>& sequence_ints);
 
 // Convert move table to vector of indices
 std::vector<uint64_t> moves_to_map(const std::vector<uint8_t>& moves,
                                    size_t block_stride,
                                    size_t signal_len,
                                    std::optional<size_t> reserve_size = std::nullopt);
+// As above, but into seq_to_sig_map, reusing its storage.
+void moves_to_map(const std::vector<uint8_t>& moves,
+                  size_t block_stride,
+                  size_t signal_len,
+                  std::vector<uint64_t>& seq_to_sig_map);
+// As above, for a packed move table.
+std::vector<uint64_t> moves_to_map(const MoveTable& moves,
+                                   size_t block_stride,
+                                   size_t signal_len);
+void moves_to_map(const MoveTable& moves,
+                  size_t block_stride,
+                  size_t signal_len,
+                  std::vector<uint64_t>& seq_to_sig_map);
 
-// Compute cumulative sums of the move table
+// Compute cumulative sums of the move table, whose entries must be 0 or 1.
 std::vector<uint64_t> move_cum_sums(const std::vector<uint8_t>& moves);
+// As above, but into cum_sums, reusing its storage.
+void move_cum_sums(const std::vector<uint8_t>& moves, std::vector<uint64_t>& cum_sums);
 
 // Compute reverse complement of a nucleotide sequence.
 // Bases are specified as capital letters.
 // Undefined output if characters other than A, C, G, T appear.
 std::string reverse_complement(const std::string& sequence);
+// As above, but into rev_comp_sequence, reusing its storage.  It mustn't be sequence itself.
+void reverse_complement(const std::string& sequence, std::string& rev_comp_sequence);
 
 // Convert the 4bit encoded sequence in a bam1_t structure
 // into a string.
-std::string convert_nt16_to_str(uint8_t* bseq, size_t slen);
+std::string convert_nt16_to_str(const uint8_t* bseq, size_t slen);
+// As above, but into seq, reusing its storage.
+void convert_nt16_to_str(const uint8_t* bseq, size_t slen, std::string& seq);
 
 }  // namespace dorado::utils
@@ -0,0 +1,326 @@
+#include "signal_utils.h"
+
+#include "simd.h"
+
+#include <c10/util/Half.h>
+#include <torch/torch.h>
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using dorado::utils::CpuDispatch;
+using dorado::utils::CpuIsa;
+
+void normalise_generic(int16_t* const samples, size_t count, float shift, float scale) {
+    // Each float16 result overwrites the int16 sample it was computed from.
+    auto* const dest = reinterpret_cast<c10::Half*>(samples);
+    for (size_t i = 0; i < count; ++i) {
+        dest[i] = static_cast<c10::Half>((static_cast<float>(samples[i]) - shift) / scale);
+    }
+}
+
+#if ENABLE_AVX2_IMPL
+__attribute__((target("avx2,f16c"))) void normalise_avx2(int16_t* const samples,
+                                                         size_t count,
+                                                         float shift,
+                                                         float scale) {
+    static constexpr size_t kUnroll = 8;
+    // Matches torch behaviour.
+    const int kRoundNearestEven = 0;
+
+    const __m256 shift_f32 = _mm256_set1_ps(shift);
+    const __m256 scale_f32 = _mm256_set1_ps(scale);
+
+    // Main vectorised loop: 8 samples per iteration.  The division is kept, rather than
+    // multiplying by the reciprocal, so results match the default implementation exactly.
+    auto* ptr = samples;
+    for (size_t chunk_i = 0; chunk_i < count / kUnroll; ++chunk_i) {
+        const __m128i elems_i16 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+        const __m256 elems_f32 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(elems_i16));
+        const __m256 normalised_f32 =
+                _mm256_div_ps(_mm256_sub_ps(elems_f32, shift_f32), scale_f32);
+        const __m128i elems_f16 = _mm256_cvtps_ph(normalised_f32, kRoundNearestEven);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(ptr), elems_f16);
+        ptr += kUnroll;
+    }
+
+    // Loop for final 0-7 samples.
+    auto* const dest = reinterpret_cast<c10::Half*>(ptr);
+    for (size_t i = 0; i < count % kUnroll; ++i) {
+        dest[i] = static_cast<c10::Half>((static_cast<float>(ptr[i]) - shift) / scale);
+    }
+}
+#endif
+
+const CpuDispatch<decltype(normalise_generic)> normalise_impl(
+        normalise_generic, {{CpuIsa::AVX2, AVX2_KERNEL(normalise_avx2)}});
+
+int count_above_generic(const c10::Half* const signal, int count, float threshold) {
+    return static_cast<int>(std::count_if(signal, signal + count, [threshold](c10::Half elem) {
+        return static_cast<float>(elem) > threshold;
+    }));
+}
+
+#if ENABLE_AVX2_IMPL
+__attribute__((target("avx2,f16c"))) int count_above_avx2(const c10::Half* const signal,
+                                                          int count,
+                                                          float threshold) {
+    static constexpr int kUnroll = 8;
+    const __m256 threshold_f32 = _mm256_set1_ps(threshold);
+
+    int num_above = 0;
+    const auto* ptr = signal;
+    for (int chunk_i = 0; chunk_i < count / kUnroll; ++chunk_i) {
+        const __m128i elems_f16 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+        const __m256 elems_f32 = _mm256_cvtph_ps(elems_f16);
+        const __m256 above = _mm256_cmp_ps(elems_f32, threshold_f32, _CMP_GT_OQ);
+        num_above += __builtin_popcount(_mm256_movemask_ps(above));
+        ptr += kUnroll;
+    }
+    for (int i = 0; i < count % kUnroll; ++i) {
+        num_above += static_cast<float>(ptr[i]) > threshold;
+    }
+    return num_above;
+}
+#endif
+
+const CpuDispatch<decltype(count_above_generic)> count_above_impl(
+        count_above_generic, {{CpuIsa::AVX2, AVX2_KERNEL(count_above_avx2)}});
+
+// The trim() search, given the number of samples above threshold in each window and
+// whether each window's last sample is above threshold.
+template <typename CountAbove, typename LastAbove>
+int find_trim_start(int signal_len,
+                    int window_size,
+                    int min_elements,
+                    CountAbove count_above,
+                    LastAbove last_above) {
+    const int min_trim = 10;
+    const int num_samples = signal_len - min_trim;
+    const int num_windows = num_samples / window_size;
+
+    bool seen_peak = false;
+    for (int pos = 0; pos < num_windows; ++pos) {
+        const int end = (pos + 1) * window_size + min_trim;
+        if (count_above(pos) > min_elements || seen_peak) {
+            seen_peak = true;
+            if (last_above(pos)) {
+                continue;
+            }
+            if (end >= num_samples) {
+                return min_trim;
+            } else {
+                return end;
+            }
+        }
+    }
+
+    return min_trim;
+}
+
+// As utils::trim, but reading the float16 signal directly.
+int trim_normalised(const c10::Half* const signal,
+                    int signal_len,
+                    float threshold,
+                    int window_size,
+                    int min_elements) {
+    const auto window_start = [=](int pos) { return &signal[pos * window_size + 10]; };
+    return find_trim_start(
+            signal_len, window_size, min_elements,
+            [&](int pos) { return count_above_impl(window_start(pos), window_size, threshold); },
+            [&](int pos) {
+                return static_cast<float>(window_start(pos)[window_size - 1]) > threshold;
+            });
+}
+
+}  // namespace
+
+namespace dorado::utils {
+
+SignalHistogram::SignalHistogram(const int16_t* const samples, size_t num_samples, size_t stride) {
+    stride = std::max<size_t>(stride, 1);
+    m_num_counted = (num_samples + stride - 1) / stride;
+    if (m_num_counted == 0) {
+        return;
+    }
+
+    // A histogram over the full int16 range means no separate pass is needed to find the
+    // signal's range first.  Runs of equal values are common in signal, and make
+    // consecutive increments of one bin wait on each other, so samples are spread over
+    // interleaved sub-histograms.  Only bins within the signal's range are touched, and
+    // they are cleared again below.
+    constexpr int kNumLanes = 4;
+    constexpr int kMinValue = std::numeric_limits<int16_t>::min();
+    thread_local std::vector<uint32_t> counts(kNumLanes << 16, 0);
+    uint32_t* const bins = counts.data();
+
+    int range_min = std::numeric_limits<int16_t>::max();
+    int range_max = kMinValue;
+    const auto count = [&](size_t i, int lane) {
+        const int value = samples[i * stride];
+        ++bins[(value - kMinValue) * kNumLanes + lane];
+        range_min = std::min(range_min, value);
+        range_max = std::max(range_max, value);
+    };
+    size_t i = 0;
+    for (; i + kNumLanes <= m_num_counted; i += kNumLanes) {
+        count(i, 0);
+        count(i + 1, 1);
+        count(i + 2, 2);
+        count(i + 3, 3);
+    }
+    for (; i < m_num_counted; ++i) {
+        count(i, 0);
+    }
+
+    m_min_value = range_min;
+    m_cumulative.resize(range_max - range_min + 1);
+    uint64_t cumulative_count = 0;
+    for (int value = range_min; value <= range_max; ++value) {
+        uint32_t* const lanes = &bins[(value - kMinValue) * kNumLanes];
+        for (int lane = 0; lane < kNumLanes; ++lane) {
+            cumulative_count += std::exchange(lanes[lane], 0);
+        }
+        m_cumulative[value - range_min] = cumulative_count;
+    }
+}
+
+size_t SignalHistogram::stride_for(size_t num_samples, size_t max_samples) {
+    if (max_samples == 0 || num_samples <= max_samples) {
+        return 1;
+    }
+    return (num_samples + max_samples - 1) / max_samples;
+}
+
+int SignalHistogram::quantile(float q) const {
+    if (m_num_counted == 0) {
+        return 0;
+    }
+    // Matches the thresholds, including their float arithmetic, used by quantile_counting.
+    const auto threshold = static_cast<uint64_t>(q * (m_num_counted - 1));
+    auto it = std::upper_bound(m_cumulative.begin(), m_cumulative.end(), threshold);
+    // Rounding can take the threshold for q == 1 past the last sample.
+    it = std::min(it, std::prev(m_cumulative.end()));
+    return m_min_value + static_cast<int>(it - m_cumulative.begin());
+}
+
+int SignalHistogram::mad() const {
+    if (m_num_counted == 0) {
+        return 0;
+    }
+    const int median_value = median();
+    const int max_value = m_min_value + static_cast<int>(m_cumulative.size()) - 1;
+    const auto threshold = static_cast<uint64_t>(0.5f * (m_num_counted - 1));
+
+    // The number of samples within a distance of the median only grows with the distance,
+    // so search for the smallest distance which covers more than threshold samples.
+    int lo = 0;
+    int hi = std::max(median_value - m_min_value, max_value - median_value);
+    while (lo < hi) {
+        const int mid = lo + (hi - lo) / 2;
+        const uint64_t num_within =
+                count_at_most(median_value + mid) - count_at_most(median_value - mid - 1);
+        if (num_within > threshold) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return lo;
+}
+
+uint64_t SignalHistogram::count_at_most(int value) const {
+    if (value < m_min_value) {
+        return 0;
+    }
+    const size_t index =
+            std::min(static_cast<size_t>(value - m_min_value), m_cumulative.size() - 1);
+    return m_cumulative[index];
+}
+
+// Multiversioned function dispatch doesn't work across the dorado_lib linking
+// boundary, so the implementations are only called from within this file.
+SignalScaling normalise_and_trim(int16_t* const samples,
+                                 size_t num_samples,
+                                 int max_trim_samples,
+                                 size_t max_quantile_samples,
+                                 float trim_threshold,
+                                 int trim_window_size,
+                                 int trim_min_elements) {
+    // First pass: quantiles, from which we get the scaling.
+    float shift = 10.0f;
+    float scale = 1.0f;
+    if (num_samples > 0) {
+        const SignalHistogram histogram(
+                samples, num_samples,
+                SignalHistogram::stride_for(num_samples, max_quantile_samples));
+        const int q20 = histogram.quantile(0.2f);
+        const int q90 = histogram.quantile(0.9f);
+        shift = std::max(10.0f, 0.51f * static_cast<float>(q20 + q90));
+        scale = std::max(1.0f, 0.53f * static_cast<float>(q90 - q20));
+    }
+
+    // Second pass: normalisation.  The samples needed for trimming are done first, so
+    // they are still in cache when trim_normalised reads them back.
+    const size_t trim_len =
+            std::min(num_samples, static_cast<size_t>(std::max(max_trim_samples, 0)));
+    normalise_impl(samples, trim_len, shift, scale);
+    const int trim_start =
+            trim_normalised(reinterpret_cast<const c10::Half*>(samples), static_cast<int>(trim_len),
+                            trim_threshold, trim_window_size, trim_min_elements);
+    normalise_impl(samples + trim_len, num_samples - trim_len, shift, scale);
+
+    return {shift, scale, trim_start};
+}
+
+torch::Tensor normalise_and_trim(const torch::Tensor& samples,
+                                 int max_trim_samples,
+                                 SignalScaling& scaling,
+                                 float trim_threshold,
+                                 int trim_window_size,
+                                 int trim_min_elements) {
+    using torch::indexing::Slice;
+
+    const int64_t num_samples = samples.size(0);
+    if (num_samples == 0) {
+        scaling = {10.0f, 1.0f, 10};
+        return samples.to(torch::kFloat16);
+    }
+
+    // Same quantile positions as quantile_counting.
+    const auto sorted = std::get<0>(torch::sort(samples));
+    const auto q20 = sorted[static_cast<int64_t>(0.2f * (num_samples - 1))].to(torch::kFloat32);
+    const auto q90 = sorted[static_cast<int64_t>(0.9f * (num_samples - 1))].to(torch::kFloat32);
+    const auto shift = (0.51f * (q20 + q90)).clamp_min(10.0f);
+    const auto scale = (0.53f * (q90 - q20)).clamp_min(1.0f);
+    auto normalised = ((samples.to(torch::kFloat32) - shift) / scale).to(torch::kFloat16);
+
+    // Per-window statistics for the trim search, compared in float32 as trim() does.
+    const int trim_len =
+            static_cast<int>(std::min<int64_t>(num_samples, std::max(max_trim_samples, 0)));
+    const int num_windows = std::max(trim_len - 10, 0) / trim_window_size;
+    const auto windows = normalised.index({Slice(10, 10 + num_windows * trim_window_size)})
+                                 .view({num_windows, trim_window_size})
+                                 .to(torch::kFloat32) > trim_threshold;
+    const auto window_counts = windows.sum(1).to(torch::kFloat32);
+    const auto window_last_above = windows.select(1, trim_window_size - 1).to(torch::kFloat32);
+
+    // A single transfer, and synchronisation, brings back everything the host needs.
+    const auto stats = torch::cat({shift.view(1), scale.view(1), window_counts, window_last_above})
+                               .cpu();
+    const float* const stats_ptr = stats.data_ptr<float>();
+    scaling.shift = stats_ptr[0];
+    scaling.scale = stats_ptr[1];
+    scaling.trim_start = find_trim_start(
+            trim_len, trim_window_size, trim_min_elements,
+            [&](int pos) { return static_cast<int>(stats_ptr[2 + pos]); },
+            [&](int pos) { return stats_ptr[2 + num_windows + pos] != 0.0f; });
+    return normalised;
+}
+
+}  // namespace dorado::utils
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <torch/torch.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace dorado::utils {
+
+// Histogram of int16 signal, from which any number of quantiles, and the median absolute
+// deviation, can be read without further passes over the signal.
+// Quantiles use interpolation='lower', and match quantile_counting().
+class SignalHistogram {
+public:
+    // If stride > 1 only every stride'th sample is counted, which gives approximate
+    // statistics of very long signals for a fraction of the cost.
+    SignalHistogram(const int16_t* samples, size_t num_samples, size_t stride = 1);
+
+    // The smallest stride which counts at most max_samples of num_samples.
+    // max_samples == 0 means no limit.
+    static size_t stride_for(size_t num_samples, size_t max_samples);
+
+    size_t num_counted() const { return m_num_counted; }
+    // Returns 0 if no samples were counted.
+    int quantile(float q) const;
+    int median() const { return quantile(0.5f); }
+    // Median of the absolute deviations from the median.
+    int mad() const;
+
+private:
+    // Number of counted samples <= value.
+    uint64_t count_at_most(int value) const;
+
+    int m_min_value{0};
+    size_t m_num_counted{0};
+    // m_cumulative[i] is the number of counted samples <= m_min_value + i.
+    std::vector<uint64_t> m_cumulative;
+};
+
+struct SignalScaling {
+    float shift;
+    float scale;
+    // Number of samples to trim from the start of the normalised signal.
+    int trim_start;
+};
+
+// Normalises raw int16 signal in place, and finds where to trim it.
+// Equivalent to taking the 0.2 and 0.9 quantiles via quantile_counting(), deriving
+// shift = max(10, 0.51 * (q20 + q90)) and scale = max(1, 0.53 * (q90 - q20)), converting
+// (x - shift) / scale to float16, and applying trim() to the first max_trim_samples of
+// the result, but in two passes over the signal rather than one per operation.
+// If max_quantile_samples is non-zero, longer signals have their quantiles estimated from
+// a strided SignalHistogram of that many samples.
+// On return, samples holds num_samples float16 values rather than int16.
+SignalScaling normalise_and_trim(int16_t* samples,
+                                 size_t num_samples,
+                                 int max_trim_samples,
+                                 size_t max_quantile_samples = 0,
+                                 float trim_threshold = 2.4,
+                                 int trim_window_size = 40,
+                                 int trim_min_elements = 3);
+
+// As above, but built from torch ops so that it runs on whichever device holds samples,
+// which are left untouched.  Returns the normalised float16 signal, on the same device.
+// Only a handful of values are copied back to the host.
+torch::Tensor normalise_and_trim(const torch::Tensor& samples,
+                                 int max_trim_samples,
+                                 SignalScaling& scaling,
+                                 float trim_threshold = 2.4,
+                                 int trim_window_size = 40,
+                                 int trim_min_elements = 3);
+
+}  // namespace dorado::utils
@@ -1,7 +1,10 @@
 #pragma once
 
-// TSan's init breaks the call to __cpu_indicator_init (which determines which implementation to take)
-#if defined(__GNUC__) && defined(__x86_64__) && !defined(__APPLE__) && !defined(__SANITIZE_THREAD__)
+#include "cpu_dispatch.h"
+
+// AVX2 kernels are built with target attributes, and picked at runtime by CpuDispatch from what
+// cpuid reports, so unlike with function multiversioning they work under TSan too.
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(__APPLE__)
 #define ENABLE_AVX2_IMPL 1
 #else
 #define ENABLE_AVX2_IMPL 0
@@ -9,4 +12,11 @@
 
 #if ENABLE_AVX2_IMPL
 #include <immintrin.h>
-#endif
\ No newline at end of file
+#endif
+
+// An AVX2 kernel for CpuDispatch, which is null where AVX2 kernels aren't built.
+#if ENABLE_AVX2_IMPL
+#define AVX2_KERNEL(kernel) kernel
+#else
+#define AVX2_KERNEL(kernel) nullptr
+#endif
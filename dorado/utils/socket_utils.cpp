@@ -0,0 +1,276 @@
+#include "socket_utils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#endif
+
+namespace dorado::utils {
+
+#ifndef _WIN32
+
+namespace {
+
+sockaddr_un socket_address(const std::filesystem::path& path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    const auto path_string = path.string();
+    if (path_string.empty() || path_string.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Invalid socket path: " + path_string);
+    }
+    std::memcpy(address.sun_path, path_string.c_str(), path_string.size() + 1);
+    return address;
+}
+
+std::runtime_error socket_error(const std::string& what, const std::filesystem::path& path) {
+    return std::runtime_error(what + " " + path.string() + ": " + std::strerror(errno));
+}
+
+std::runtime_error port_error(const std::string& what, uint16_t port) {
+    return std::runtime_error(what + " " + std::to_string(port) + ": " + std::strerror(errno));
+}
+
+}  // namespace
+
+LocalSocketServer::LocalSocketServer(const std::filesystem::path& path) : m_path(path) {
+    const auto address = socket_address(path);
+    std::error_code error;
+    if (std::filesystem::is_socket(path, error)) {
+        std::filesystem::remove(path, error);
+    }
+
+    m_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_fd < 0) {
+        throw socket_error("Unable to create socket", path);
+    }
+    if (bind(m_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(m_fd, SOMAXCONN) != 0) {
+        const auto bind_error = socket_error("Unable to listen on socket", path);
+        ::close(m_fd);
+        throw bind_error;
+    }
+}
+
+LocalSocketServer::~LocalSocketServer() {
+    ::close(m_fd);
+    std::error_code error;
+    std::filesystem::remove(m_path, error);
+}
+
+int LocalSocketServer::accept() {
+    while (true) {
+        const int fd = ::accept(m_fd, nullptr, nullptr);
+        if (fd >= 0) {
+            return fd;
+        }
+        if (errno != EINTR && errno != ECONNABORTED) {
+            throw socket_error("Unable to accept connections on socket", m_path);
+        }
+    }
+}
+
+TcpSocketServer::TcpSocketServer(uint16_t port) : m_port(port) {
+    m_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (m_fd < 0) {
+        throw port_error("Unable to create socket for port", port);
+    }
+    // A server restarted straight after another on the same port can listen at once.
+    const int reuse = 1;
+    setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    socklen_t address_length = sizeof(address);
+    if (bind(m_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(m_fd, SOMAXCONN) != 0 ||
+        getsockname(m_fd, reinterpret_cast<sockaddr*>(&address), &address_length) != 0) {
+        const auto bind_error = port_error("Unable to listen on port", port);
+        ::close(m_fd);
+        throw bind_error;
+    }
+    m_port = ntohs(address.sin_port);
+}
+
+TcpSocketServer::~TcpSocketServer() { ::close(m_fd); }
+
+std::optional<int> TcpSocketServer::accept(std::chrono::milliseconds timeout) {
+    pollfd poll_fd{m_fd, POLLIN, 0};
+    const int ready = poll(&poll_fd, 1, static_cast<int>(timeout.count()));
+    if (ready <= 0) {
+        return std::nullopt;
+    }
+    const int fd = ::accept(m_fd, nullptr, nullptr);
+    if (fd >= 0) {
+        return fd;
+    }
+    if (errno != EINTR && errno != ECONNABORTED && errno != EAGAIN) {
+        throw port_error("Unable to accept connections on port", m_port);
+    }
+    return std::nullopt;
+}
+
+int connect_local_socket(const std::filesystem::path& path) {
+    const auto address = socket_address(path);
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        throw socket_error("Unable to create socket", path);
+    }
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        const auto connect_error = socket_error("Unable to connect to socket", path);
+        ::close(fd);
+        throw connect_error;
+    }
+    return fd;
+}
+
+int connect_tcp_socket(const std::string& host, uint16_t port) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses = nullptr;
+    const int lookup_error =
+            getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses);
+    if (lookup_error != 0) {
+        throw std::runtime_error("Unable to look up " + host + ": " + gai_strerror(lookup_error));
+    }
+    // Any of the host's addresses will do.
+    int fd = -1;
+    for (auto* address = addresses; address && fd < 0; address = address->ai_next) {
+        fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (fd >= 0 && connect(fd, address->ai_addr, address->ai_addrlen) != 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    if (fd < 0) {
+        throw std::runtime_error("Unable to connect to " + host + ":" + std::to_string(port) +
+                                 ": " + std::strerror(errno));
+    }
+    return fd;
+}
+
+void close_socket(int fd) { ::close(fd); }
+
+void set_tcp_no_delay(int fd) {
+    const int no_delay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+}
+
+bool write_all(int fd, std::string_view data) {
+    while (!data.empty()) {
+        const auto num_written = ::write(fd, data.data(), data.size());
+        if (num_written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (num_written <= 0) {
+            return false;
+        }
+        data.remove_prefix(num_written);
+    }
+    return true;
+}
+
+bool read_all(int fd, void* data, size_t size) {
+    auto* bytes = static_cast<char*>(data);
+    while (size > 0) {
+        const auto num_read = ::read(fd, bytes, size);
+        if (num_read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (num_read <= 0) {
+            return false;
+        }
+        bytes += num_read;
+        size -= num_read;
+    }
+    return true;
+}
+
+std::optional<std::string> read_line(int fd, size_t max_length, std::chrono::milliseconds timeout) {
+    using Clock = std::chrono::steady_clock;
+    const auto deadline = Clock::now() + timeout;
+    std::string line;
+    // Requests are short, so read a character at a time rather than buffering anything
+    // after the newline.
+    while (line.size() <= max_length) {
+        const auto remaining =
+                std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now());
+        pollfd poll_fd{fd, POLLIN, 0};
+        const int ready = poll(&poll_fd, 1, std::max(0, static_cast<int>(remaining.count())));
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready <= 0) {
+            return std::nullopt;
+        }
+        char c;
+        const auto num_read = ::read(fd, &c, 1);
+        if (num_read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (num_read <= 0) {
+            return std::nullopt;
+        }
+        if (c == '\n') {
+            return line;
+        }
+        line.push_back(c);
+    }
+    return std::nullopt;
+}
+
+#else  // _WIN32
+
+LocalSocketServer::LocalSocketServer(const std::filesystem::path& path) : m_path(path) {
+    throw std::runtime_error("Local sockets are not supported on Windows");
+}
+
+LocalSocketServer::~LocalSocketServer() = default;
+
+int LocalSocketServer::accept() { return -1; }
+
+TcpSocketServer::TcpSocketServer(uint16_t port) : m_port(port) {
+    throw std::runtime_error("TCP sockets are not supported on Windows");
+}
+
+TcpSocketServer::~TcpSocketServer() = default;
+
+std::optional<int> TcpSocketServer::accept(std::chrono::milliseconds) { return std::nullopt; }
+
+int connect_local_socket(const std::filesystem::path&) {
+    throw std::runtime_error("Local sockets are not supported on Windows");
+}
+
+int connect_tcp_socket(const std::string&, uint16_t) {
+    throw std::runtime_error("TCP sockets are not supported on Windows");
+}
+
+void close_socket(int) {}
+
+void set_tcp_no_delay(int) {}
+
+bool write_all(int, std::string_view) { return false; }
+
+bool read_all(int, void*, size_t) { return false; }
+
+std::optional<std::string> read_line(int, size_t, std::chrono::milliseconds) {
+    return std::nullopt;
+}
+
+#endif  // _WIN32
+
+}  // namespace dorado::utils
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace dorado::utils {
+
+// Listens for connections on a Unix domain socket.
+// Not supported on Windows, where the constructor throws.
+class LocalSocketServer {
+public:
+    // Any socket already at path, e.g. one left behind by a server which was killed, is
+    // replaced.  Throws if the socket can't be created.
+    explicit LocalSocketServer(const std::filesystem::path& path);
+    // Stops listening, and removes the socket.
+    ~LocalSocketServer();
+
+    LocalSocketServer(const LocalSocketServer&) = delete;
+    LocalSocketServer& operator=(const LocalSocketServer&) = delete;
+
+    // Blocks until a client connects, and returns the connection, which the caller must
+    // close with close_socket().
+    int accept();
+
+private:
+    std::filesystem::path m_path;
+    int m_fd{-1};
+};
+
+// Listens for TCP connections on port, on every interface.
+// Not supported on Windows, where the constructor throws.
+class TcpSocketServer {
+public:
+    // Port 0 picks any free port.  Throws if the port can't be listened on.
+    explicit TcpSocketServer(uint16_t port);
+    ~TcpSocketServer();
+
+    TcpSocketServer(const TcpSocketServer&) = delete;
+    TcpSocketServer& operator=(const TcpSocketServer&) = delete;
+
+    // The port listened on.
+    uint16_t port() const { return m_port; }
+
+    // Waits up to timeout for a client to connect, and returns the connection, which the
+    // caller must close with close_socket(), or nullopt if none did.
+    std::optional<int> accept(std::chrono::milliseconds timeout);
+
+private:
+    uint16_t m_port{0};
+    int m_fd{-1};
+};
+
+// Connects to the socket at path.  Throws if it can't.
+int connect_local_socket(const std::filesystem::path& path);
+// Connects to port on host, a name or address.  Throws if it can't.
+int connect_tcp_socket(const std::string& host, uint16_t port);
+void close_socket(int fd);
+// Sends small writes on a TCP connection at once, rather than waiting to fill a packet, for
+// request and response protocols.
+void set_tcp_no_delay(int fd);
+
+// Writes all of data to fd.  Returns false if the connection failed first.
+bool write_all(int fd, std::string_view data);
+// Reads exactly size bytes from fd into data, blocking until they arrive.  Returns false if
+// the connection is closed first.
+bool read_all(int fd, void* data, size_t size);
+
+// Reads from fd up to the first newline, and returns what came before it.  Returns
+// nullopt if the connection is closed first, or if no line of at most max_length
+// characters arrives within timeout.
+std::optional<std::string> read_line(int fd, size_t max_length, std::chrono::milliseconds timeout);
+
+}  // namespace dorado::utils
@@ -1,80 +1,187 @@
 #include "../read_pipeline/ReadPipeline.h"
 #include "math_utils.h"
 
+#include <algorithm>
+#include <cassert>
+#include <mutex>
+#include <string>
+
 namespace dorado::utils {
 
-void stitch_chunks(std::shared_ptr<Read> read) {
-    // Calculate the chunk down sampling, round to closest int.
-    read->model_stride = div_round_closest(read->called_chunks[0]->raw_chunk_size,
-                                           read->called_chunks[0]->moves.size());
-
-    int start_pos = 0;
-    int mid_point_front = 0;
-    std::vector<uint8_t> moves;
-    std::vector<std::string> sequences;
-    std::vector<std::string> qstrings;
-
-    for (int i = 0; i < read->num_chunks - 1; i++) {
-        auto current_chunk = read->called_chunks[i];
-        auto next_chunk = read->called_chunks[i + 1];
-        int overlap_size = (current_chunk->raw_chunk_size + current_chunk->input_offset) -
-                           (next_chunk->input_offset);
-        assert(overlap_size % read->model_stride == 0);
-        int overlap_down_sampled = overlap_size / read->model_stride;
-        int mid_point_rear = overlap_down_sampled / 2;
-
-        int current_chunk_bases_to_trim =
-                std::accumulate(std::prev(current_chunk->moves.end(), mid_point_rear),
-                                current_chunk->moves.end(), 0);
-
-        int current_chunk_seq_len = current_chunk->seq.size();
-        int end_pos = current_chunk_seq_len - current_chunk_bases_to_trim;
-        int trimmed_len = end_pos - start_pos;
-        sequences.push_back(current_chunk->seq.substr(start_pos, trimmed_len));
-        qstrings.push_back(current_chunk->qstring.substr(start_pos, trimmed_len));
-        moves.insert(moves.end(), std::next(current_chunk->moves.begin(), mid_point_front),
-                     std::prev(current_chunk->moves.end(), mid_point_rear));
-
-        mid_point_front = overlap_down_sampled - mid_point_rear;
-
-        start_pos = 0;
-        for (int i = 0; i < mid_point_front; i++) {
-            start_pos += (int)next_chunk->moves[i];
+void chunk_read(Read& read,
+                const std::vector<size_t>& chunk_sizes,
+                size_t overlap,
+                size_t model_stride) {
+    // Time dimension.
+    const size_t raw_size = read.raw_data.sizes()[read.raw_data.sizes().size() - 1];
+    const size_t max_chunk_size = chunk_sizes.back();
+    // The smallest chunk size of at least min_size, which is never more than max_chunk_size.
+    auto fitting_chunk_size = [&chunk_sizes](size_t min_size) {
+        return *std::lower_bound(chunk_sizes.begin(), std::prev(chunk_sizes.end()), min_size);
+    };
+
+    read.called_chunks.clear();
+    if (raw_size <= max_chunk_size) {
+        // Short reads are padded out to the chunk size.
+        read.called_chunks.emplace_back(read, 0, 0, fitting_chunk_size(raw_size));
+    } else {
+        const size_t signal_chunk_step = max_chunk_size - overlap;
+        size_t offset = 0;
+        read.called_chunks.emplace_back(read, offset, 0, max_chunk_size);
+        while (offset + signal_chunk_step + max_chunk_size < raw_size) {
+            offset += signal_chunk_step;
+            read.called_chunks.emplace_back(read, offset, read.called_chunks.size(),
+                                            max_chunk_size);
         }
+        // The last chunk has to start no later than a full step on, so that it overlaps the
+        // previous one by at least overlap samples, and is moved to the next stride boundary
+        // after the point where it would end with the signal.  Any excess samples required
+        // are padded.
+        const size_t last_chunk_size =
+                fitting_chunk_size(raw_size - (offset + signal_chunk_step));
+        size_t last_chunk_offset = raw_size - last_chunk_size;
+        const size_t misalignment = last_chunk_offset % model_stride;
+        if (misalignment != 0) {
+            last_chunk_offset += model_stride - misalignment;
+        }
+        read.called_chunks.emplace_back(read, last_chunk_offset, read.called_chunks.size(),
+                                        last_chunk_size);
     }
+    read.num_chunks = read.called_chunks.size();
+    read.num_chunks_called.store(0);
+    read.num_chunks_stitched = 0;
+}
+
+namespace {
 
-    // Append the final chunk
-    auto& last_chunk = read->called_chunks[read->num_chunks - 1];
-    moves.insert(moves.end(), std::next(last_chunk->moves.begin(), mid_point_front),
-                 last_chunk->moves.end());
+// Where a chunk's output starts and ends, in its moves and in its sequence.
+struct ChunkSpan {
+    size_t moves_start;
+    size_t moves_end;
+    size_t seq_start;
+    size_t seq_end;
+};
 
-    if (read->num_chunks == 1) {
+// Moves of the overlap between a chunk and the next, of which the first chunk keeps the
+// first half, rounded up, and the next the rest.
+size_t overlap_moves(const Read& read, size_t chunk_idx) {
+    const auto& current_chunk = read.called_chunks[chunk_idx];
+    const auto& next_chunk = read.called_chunks[chunk_idx + 1];
+    int overlap_size = (current_chunk.raw_chunk_size + current_chunk.input_offset) -
+                       (next_chunk.input_offset);
+    assert(overlap_size % read.model_stride == 0);
+    return overlap_size / read.model_stride;
+}
+
+// Each overlap between adjacent chunks is split at its midpoint, so a chunk's span only
+// depends on its own basecall and where its neighbours start and end.
+ChunkSpan chunk_span(const Read& read, size_t chunk_idx) {
+    const auto& chunk = read.called_chunks[chunk_idx];
+    ChunkSpan span{0, chunk.moves.size(), 0, chunk.seq.size()};
+    if (chunk_idx > 0) {
+        const size_t overlap = overlap_moves(read, chunk_idx - 1);
+        span.moves_start = overlap - overlap / 2;
+        span.seq_start = chunk.moves.rank(span.moves_start);
+    }
+    if (chunk_idx + 1 < read.num_chunks) {
+        span.moves_end -= overlap_moves(read, chunk_idx) / 2;
+        const size_t bases_to_trim = chunk.moves.count() - chunk.moves.rank(span.moves_end);
+        span.seq_end = std::max(span.seq_start, span.seq_end - bases_to_trim);
+    } else if (read.num_chunks == 1) {
         // shorten the sequence, qstring & moves where the read is shorter than chunksize
-        int last_index_in_moves_to_keep = read->raw_data.size(0) / read->model_stride;
-        moves = std::vector<uint8_t>(moves.begin(), moves.begin() + last_index_in_moves_to_keep);
-        int end = std::accumulate(moves.begin(), moves.end(), 0);
-        sequences.push_back(last_chunk->seq.substr(start_pos, end));
-        qstrings.push_back(last_chunk->qstring.substr(start_pos, end));
+        span.moves_end =
+                std::min(span.moves_end, size_t(read.raw_data.size(0) / read.model_stride));
+        span.seq_end = std::min(span.seq_end, span.seq_start + chunk.moves.rank(span.moves_end));
+    }
+    return span;
+}
 
-    } else {
-        sequences.push_back(last_chunk->seq.substr(start_pos));
-        qstrings.push_back(last_chunk->qstring.substr(start_pos));
+// Makes room for extra more elements, growing geometrically so that repeated appends stay
+// linear overall.
+template <typename Container>
+void reserve_extra(Container& container, size_t extra) {
+    const size_t needed = container.size() + extra;
+    if (needed > container.capacity()) {
+        container.reserve(std::max(needed, 2 * container.capacity()));
     }
+}
 
-    // Set the read seq and qstring
-    read->seq = std::accumulate(sequences.begin(), sequences.end(), std::string(""));
-    read->qstring = std::accumulate(qstrings.begin(), qstrings.end(), std::string(""));
-    read->moves = std::move(moves);
+}  // namespace
+
+bool stitch_called_chunk(Read& read, size_t chunk_idx) {
+    std::lock_guard<std::mutex> lock(read.stitch_mutex);
+    read.called_chunks[chunk_idx].is_called = true;
+    ++read.num_chunks_called;
+
+    const size_t first = read.num_chunks_stitched;
+    size_t last = first;
+    while (last < read.num_chunks && read.called_chunks[last].is_called) {
+        ++last;
+    }
+    if (last == first) {
+        return false;
+    }
+    if (first == 0) {
+        // Calculate the chunk down sampling, round to closest int.
+        read.model_stride = div_round_closest(read.called_chunks[0].raw_chunk_size,
+                                              read.called_chunks[0].moves.size());
+        read.seq.clear();
+        read.qstring.clear();
+        read.moves.clear();
+    }
+
+    // The run of chunks now ready is sized first, so that it's copied in once.
+    std::vector<ChunkSpan> spans;
+    spans.reserve(last - first);
+    size_t seq_size = 0;
+    size_t moves_size = 0;
+    for (size_t i = first; i < last; ++i) {
+        const auto& span = spans.emplace_back(chunk_span(read, i));
+        seq_size += span.seq_end - span.seq_start;
+        moves_size += span.moves_end - span.moves_start;
+    }
+    reserve_extra(read.seq, seq_size);
+    reserve_extra(read.qstring, seq_size);
+    reserve_extra(read.moves, moves_size);
+    for (size_t i = first; i < last; ++i) {
+        auto& chunk = read.called_chunks[i];
+        const auto& span = spans[i - first];
+        read.seq.append(chunk.seq, span.seq_start, span.seq_end - span.seq_start);
+        read.qstring.append(chunk.qstring, span.seq_start, span.seq_end - span.seq_start);
+        read.moves.append(chunk.moves, span.moves_start, span.moves_end);
+        // The chunk's neighbours only need its position, so its basecall can go.
+        std::string().swap(chunk.seq);
+        std::string().swap(chunk.qstring);
+        chunk.moves = MoveTable();
+    }
+    read.num_chunks_stitched = last;
+    if (last < read.num_chunks) {
+        return false;
+    }
 
     // remove partial stride overhang
-    if (read->moves.size() > static_cast<int>(read->raw_data.size(0) / read->model_stride)) {
-        if (read->moves.back() == 1) {
-            read->seq.pop_back();
-            read->qstring.pop_back();
+    if (read.moves.size() > static_cast<int>(read.raw_data.size(0) / read.model_stride)) {
+        if (read.moves.back() == 1) {
+            read.seq.pop_back();
+            read.qstring.pop_back();
         }
-        read->moves.pop_back();
-        assert(std::accumulate(read->moves.begin(), read->moves.end(), 0) == read->seq.size());
+        read.moves.pop_back();
+        assert(read.moves.count() == read.seq.size());
+    }
+    // The geometric growth can leave up to half of each buffer unused, which the read would
+    // otherwise hold on to until it's written.
+    read.seq.shrink_to_fit();
+    read.qstring.shrink_to_fit();
+    read.moves.shrink_to_fit();
+    return true;
+}
+
+void stitch_chunks(std::shared_ptr<Read> read) {
+    // With every chunk called, the first call stitches them all.
+    for (auto& chunk : read->called_chunks) {
+        chunk.is_called = true;
     }
+    stitch_called_chunk(*read, 0);
 }
 
 }  // namespace dorado::utils
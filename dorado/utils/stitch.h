@@ -1,5 +1,7 @@
 #pragma once
+#include <cstddef>
 #include <memory>
+#include <vector>
 
 namespace dorado {
 class Read;
@@ -7,8 +9,29 @@ class Read;
 
 namespace dorado::utils {
 
+// Split a read's raw signal into chunks, filling in called_chunks and num_chunks.
+// chunk_sizes are the sizes, ascending and multiples of model_stride, that chunks can be
+// called at.  Chunks of the largest size step through the read, overlapping by at least
+// overlap samples, and the read's last chunk, or its only chunk if it's short, is the
+// smallest size which still covers the rest of the signal.  The last chunk ends on the
+// first stride boundary at or past the end of the signal.
+// The overlap can't be cut down to the convolutions' receptive field by carrying LSTM state
+// from one chunk of a read to the next: the models' LSTM layers alternate direction, so the
+// output near either end of a chunk depends on the signal beyond it.
+void chunk_read(Read& read,
+                const std::vector<size_t>& chunk_sizes,
+                size_t overlap,
+                size_t model_stride);
+
 // Given a read with unstitched chunks, stitch the chunks (accounting for overlap) and assign basecalled read and
 // qstring to Read
 void stitch_chunks(std::shared_ptr<Read> read);
 
+// Marks chunk_idx of the read as called, once its seq, qstring and moves are filled in, and
+// stitches every chunk from the last one stitched up to the first which hasn't been called,
+// freeing their basecalls as they go.  Chunks can be called in any order and on any thread.
+// Returns true for the call which stitches the read's last chunk, after which the read is
+// complete, as stitch_chunks would leave it.
+bool stitch_called_chunk(Read& read, size_t chunk_idx);
+
 }  // namespace dorado::utils
@@ -5,17 +5,28 @@
 #include <torch/csrc/jit/serialization/pickle.h>
 #include <torch/torch.h>
 
+#include <algorithm>
+#include <cassert>
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
 #include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 namespace {
 
-#if ENABLE_AVX2_IMPL
-__attribute__((target("default")))
-#endif
-void convert_f32_to_f16_impl(c10::Half* const dest, const float* const src, std::size_t count) {
+using dorado::utils::CpuDispatch;
+using dorado::utils::CpuIsa;
+
+void convert_f32_to_f16_generic(c10::Half* const dest, const float* const src, std::size_t count) {
     // TODO -- handle large counts properly.
     assert(count <= std::numeric_limits<int>::max());
     auto src_tensor_f32 = torch::from_blob(const_cast<float*>(src), {static_cast<int>(count)});
@@ -26,7 +37,7 @@ void convert_f32_to_f16_impl(c10::Half* const dest, const float* const src, std:
 #if ENABLE_AVX2_IMPL
 // We have to specify f16c to have _mm256_cvtps_ph available, as strictly speaking it's a separate
 // feature from AVX2.  All relevant CPUs have it.
-__attribute__((target("avx2,f16c"))) void convert_f32_to_f16_impl(c10::Half* const dest,
+__attribute__((target("avx2,f16c"))) void convert_f32_to_f16_avx2(c10::Half* const dest,
                                                                   const float* const src,
                                                                   std::size_t count) {
     if (!count)
@@ -63,6 +74,9 @@ __attribute__((target("avx2,f16c"))) void convert_f32_to_f16_impl(c10::Half* con
 }
 #endif
 
+const CpuDispatch<decltype(convert_f32_to_f16_generic)> convert_f32_to_f16_impl(
+        convert_f32_to_f16_generic, {{CpuIsa::AVX2, AVX2_KERNEL(convert_f32_to_f16_avx2)}});
+
 }  // namespace
 
 namespace dorado::utils {
@@ -85,6 +99,206 @@ std::vector<torch::Tensor> load_tensors(const std::filesystem::path& dir,
     return weights;
 }
 
+namespace {
+
+// A packed tensor file is kPackedTensorsMagic, the number of tensors as a uint64, then for
+// each tensor its name length as a uint32, its name, its c10::ScalarType and number of
+// dimensions as a byte each, its sizes as int64s, and the offset and size in bytes of its
+// data as uint64s.  The data follows, with each tensor aligned to kPackedTensorAlignment.
+// All values are in native byte order.
+constexpr char kPackedTensorsMagic[8] = {'D', 'O', 'R', 'A', 'D', 'O', 'T', '1'};
+constexpr uint64_t kPackedTensorAlignment = 64;
+
+template <typename T>
+void append_value(std::string& buffer, T value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// The contents of a file, memory mapped where that's supported.
+class FileContents {
+public:
+    explicit FileContents(const std::filesystem::path& path) {
+        const auto size = std::filesystem::file_size(path);
+#ifndef _WIN32
+        const int fd = open(path.string().c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Unable to open " + path.string());
+        }
+        // Private and writable, so the tensors can be modified in place without touching
+        // the file.
+        void* mapping = size == 0 ? MAP_FAILED
+                                  : mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            throw std::runtime_error("Unable to map " + path.string());
+        }
+        m_data = static_cast<char*>(mapping);
+        m_size = size;
+#else
+        m_buffer.resize(size);
+        std::ifstream stream(path, std::ios::binary);
+        if (!stream.read(m_buffer.data(), size)) {
+            throw std::runtime_error("Unable to read " + path.string());
+        }
+        m_data = m_buffer.data();
+        m_size = size;
+#endif
+    }
+
+    ~FileContents() {
+#ifndef _WIN32
+        munmap(m_data, m_size);
+#endif
+    }
+
+    FileContents(const FileContents&) = delete;
+    FileContents& operator=(const FileContents&) = delete;
+
+    char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    char* m_data{nullptr};
+    size_t m_size{0};
+#ifdef _WIN32
+    std::vector<char> m_buffer;
+#endif
+};
+
+}  // namespace
+
+void save_packed_tensors(const std::filesystem::path& path,
+                         const std::vector<std::string>& names,
+                         const std::vector<torch::Tensor>& tensors) {
+    if (names.size() != tensors.size()) {
+        throw std::runtime_error("Every packed tensor needs a name");
+    }
+    std::vector<torch::Tensor> contiguous_tensors;
+    size_t header_size = sizeof(kPackedTensorsMagic) + sizeof(uint64_t);
+    for (size_t i = 0; i < tensors.size(); ++i) {
+        contiguous_tensors.push_back(tensors[i].cpu().contiguous());
+        header_size += sizeof(uint32_t) + names[i].size() + 2 +
+                       tensors[i].dim() * sizeof(int64_t) + 2 * sizeof(uint64_t);
+    }
+
+    std::string header(kPackedTensorsMagic, sizeof(kPackedTensorsMagic));
+    append_value<uint64_t>(header, tensors.size());
+    std::vector<uint64_t> offsets;
+    uint64_t offset = header_size;
+    for (size_t i = 0; i < tensors.size(); ++i) {
+        const auto& tensor = contiguous_tensors[i];
+        offset = (offset + kPackedTensorAlignment - 1) / kPackedTensorAlignment *
+                 kPackedTensorAlignment;
+        offsets.push_back(offset);
+        append_value<uint32_t>(header, uint32_t(names[i].size()));
+        header.append(names[i]);
+        append_value<int8_t>(header, int8_t(tensor.scalar_type()));
+        append_value<uint8_t>(header, uint8_t(tensor.dim()));
+        for (auto size : tensor.sizes()) {
+            append_value<int64_t>(header, size);
+        }
+        append_value<uint64_t>(header, offset);
+        append_value<uint64_t>(header, tensor.nbytes());
+        offset += tensor.nbytes();
+    }
+    assert(header.size() == header_size);
+
+    std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+    stream.write(header.data(), header.size());
+    uint64_t written = header.size();
+    const std::string padding(kPackedTensorAlignment, '\0');
+    for (size_t i = 0; i < tensors.size(); ++i) {
+        stream.write(padding.data(), offsets[i] - written);
+        const auto& tensor = contiguous_tensors[i];
+        stream.write(static_cast<const char*>(tensor.data_ptr()), tensor.nbytes());
+        written = offsets[i] + tensor.nbytes();
+    }
+    if (!stream) {
+        throw std::runtime_error("Unable to write " + path.string());
+    }
+}
+
+std::vector<torch::Tensor> load_packed_tensors(const std::filesystem::path& path,
+                                               const std::vector<std::string>& names) {
+    auto contents = std::make_shared<const FileContents>(path);
+    const auto invalid = [&path] {
+        return std::runtime_error("Invalid packed tensor file: " + path.string());
+    };
+
+    size_t position = 0;
+    const auto read_bytes = [&](void* dest, size_t size) {
+        if (size > contents->size() - position) {
+            throw invalid();
+        }
+        std::memcpy(dest, contents->data() + position, size);
+        position += size;
+    };
+    char magic[sizeof(kPackedTensorsMagic)];
+    read_bytes(magic, sizeof(magic));
+    if (std::memcmp(magic, kPackedTensorsMagic, sizeof(magic)) != 0) {
+        throw invalid();
+    }
+    uint64_t num_tensors = 0;
+    read_bytes(&num_tensors, sizeof(num_tensors));
+
+    std::unordered_map<std::string, torch::Tensor> packed_tensors;
+    for (uint64_t i = 0; i < num_tensors; ++i) {
+        uint32_t name_length = 0;
+        read_bytes(&name_length, sizeof(name_length));
+        std::string name(name_length, '\0');
+        read_bytes(name.data(), name_length);
+        int8_t scalar_type = 0;
+        uint8_t num_dims = 0;
+        read_bytes(&scalar_type, sizeof(scalar_type));
+        read_bytes(&num_dims, sizeof(num_dims));
+        std::vector<int64_t> sizes(num_dims);
+        read_bytes(sizes.data(), num_dims * sizeof(int64_t));
+        uint64_t offset = 0, num_bytes = 0;
+        read_bytes(&offset, sizeof(offset));
+        read_bytes(&num_bytes, sizeof(num_bytes));
+
+        if (scalar_type < 0 || scalar_type >= int8_t(c10::ScalarType::NumOptions) ||
+            offset > contents->size() || num_bytes > contents->size() - offset) {
+            throw invalid();
+        }
+        const auto options = torch::TensorOptions().dtype(c10::ScalarType(scalar_type));
+        auto tensor = torch::from_blob(
+                contents->data() + offset, sizes, [contents](void*) {}, options);
+        if (tensor.nbytes() != num_bytes) {
+            throw invalid();
+        }
+        packed_tensors[name] = std::move(tensor);
+    }
+
+    std::vector<torch::Tensor> tensors;
+    for (const auto& name : names) {
+        auto tensor = packed_tensors.find(name);
+        if (tensor == packed_tensors.end()) {
+            throw std::runtime_error("No tensor " + name + " in " + path.string());
+        }
+        tensors.push_back(tensor->second);
+    }
+    return tensors;
+}
+
+bool packed_tensors_are_current(const std::filesystem::path& path,
+                                const std::filesystem::path& dir,
+                                const std::vector<std::string>& names) {
+    std::error_code error;
+    const auto packed_time = std::filesystem::last_write_time(path, error);
+    if (error) {
+        return false;
+    }
+    for (const auto& name : names) {
+        // Tensor files needn't be kept once they're packed.
+        const auto tensor_time = std::filesystem::last_write_time(dir / name, error);
+        if (!error && tensor_time > packed_time) {
+            return false;
+        }
+    }
+    return true;
+}
+
 torch::Tensor quantile(const torch::Tensor t, const torch::Tensor q) {
     assert(q.dtype() == torch::kF32);
 
@@ -174,4 +388,28 @@ void copy_tensor_elems(torch::Tensor& dest_tensor,
     }
 }
 
+void copy_repeat_padded(void* const dest,
+                        std::size_t dest_row_length,
+                        const torch::Tensor& src,
+                        std::size_t offset,
+                        std::size_t length) {
+    assert(src.is_contiguous());
+    assert(src.dim() == 1 || src.dim() == 2);
+    assert(length > 0 && offset + length <= size_t(src.size(-1)));
+
+    const size_t elem_size = src.element_size();
+    const size_t src_row_length = src.size(-1);
+    const size_t num_rows = src.dim() == 1 ? 1 : src.size(0);
+    const auto* const src_ptr = static_cast<const std::byte*>(src.data_ptr());
+    auto* const dest_ptr = static_cast<std::byte*>(dest);
+    for (size_t row = 0; row < num_rows; ++row) {
+        const auto* const src_row = &src_ptr[(row * src_row_length + offset) * elem_size];
+        auto* const dest_row = &dest_ptr[row * dest_row_length * elem_size];
+        for (size_t copied = 0; copied < dest_row_length; copied += length) {
+            std::memcpy(&dest_row[copied * elem_size], src_row,
+                        std::min(length, dest_row_length - copied) * elem_size);
+        }
+    }
+}
+
 }  // namespace dorado::utils
@@ -15,6 +15,23 @@ void serialise_tensor(torch::Tensor t, const std::string& path);
 std::vector<torch::Tensor> load_tensors(const std::filesystem::path& dir,
                                         const std::vector<std::string>& tensors);
 
+// Writes tensors, and their names, to a single file from which load_packed_tensors can
+// map them straight into memory, rather than deserialising each one.
+void save_packed_tensors(const std::filesystem::path& path,
+                         const std::vector<std::string>& names,
+                         const std::vector<torch::Tensor>& tensors);
+// Loads the named tensors, in the order given, from a file written by save_packed_tensors.
+// Where memory mapping is supported the tensors are backed, copy on write, by the
+// mapped file, so nothing is read until it's used.  Throws if the file is invalid or
+// doesn't hold a tensor of each name.
+std::vector<torch::Tensor> load_packed_tensors(const std::filesystem::path& path,
+                                               const std::vector<std::string>& names);
+// Whether the file at path, written by save_packed_tensors, is at least as new as each of the
+// named tensor files in dir which still exist, so none of them was replaced after packing.
+bool packed_tensors_are_current(const std::filesystem::path& path,
+                                const std::filesystem::path& dir,
+                                const std::vector<std::string>& names);
+
 // Computes the q-th quantiles of each row of the input tensor `t`
 // using a partial sort as opposed a full sort per torch::quantiles
 // Only `interpolation='lower'` is currently implemented.
@@ -37,4 +54,13 @@ void copy_tensor_elems(torch::Tensor& dest_tensor,
                        std::size_t src_offset,
                        std::size_t count);
 
+// Copies length elements, from offset along the last dimension, of each row of src, a 1D or
+// 2D contiguous tensor, to dest as rows of dest_row_length elements of src's type, repeating
+// them to fill each row.
+void copy_repeat_padded(void* dest,
+                        std::size_t dest_row_length,
+                        const torch::Tensor& src,
+                        std::size_t offset,
+                        std::size_t length);
+
 }  // namespace dorado::utils
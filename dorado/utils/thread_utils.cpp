@@ -0,0 +1,140 @@
+#include "thread_utils.h"
+
+#include "MemoryProfiler.h"
+
+#include <algorithm>
+#include <sstream>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <pthread.h>
+#endif
+#ifdef __linux__
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#ifdef __APPLE__
+#include <pthread/qos.h>
+#endif
+
+namespace dorado::utils {
+
+std::vector<int> parse_cpu_list(const std::string& cpu_list) {
+    std::vector<int> cpus;
+    std::stringstream stream(cpu_list);
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+        try {
+            const auto dash = range.find('-');
+            if (dash == std::string::npos) {
+                cpus.push_back(std::stoi(range));
+            } else {
+                const int first = std::stoi(range.substr(0, dash));
+                const int last = std::stoi(range.substr(dash + 1));
+                for (int cpu = first; cpu <= last; ++cpu) {
+                    cpus.push_back(cpu);
+                }
+            }
+        } catch (const std::exception&) {
+            // Includes the trailing newline read from sysfs.
+            continue;
+        }
+    }
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return cpus;
+}
+
+std::string format_cpu_list(std::vector<int> cpus) {
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+
+    std::string result;
+    for (size_t i = 0; i < cpus.size();) {
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) {
+            ++j;
+        }
+        if (!result.empty()) {
+            result += ",";
+        }
+        result += std::to_string(cpus[i]);
+        if (j > i) {
+            result += "-" + std::to_string(cpus[j]);
+        }
+        i = j + 1;
+    }
+    return result;
+}
+
+#ifdef __linux__
+
+bool set_thread_affinity(const std::vector<int>& cpus) {
+    if (cpus.empty()) {
+        return false;
+    }
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &cpu_set);
+        }
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+}
+
+std::vector<int> get_thread_affinity() {
+    std::vector<int> cpus;
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    if (pthread_getaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &cpu_set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    return cpus;
+}
+
+#else  // __linux__
+
+// macOS only supports affinity hints, and Windows uses processor groups, so for
+// now pinning is a no-op on those platforms.
+bool set_thread_affinity(const std::vector<int>&) { return false; }
+std::vector<int> get_thread_affinity() { return {}; }
+
+#endif  // __linux__
+
+void set_thread_name(const std::string& name) {
+    // Linux limits names to 15 characters and a terminator.
+    const std::string short_name = name.substr(0, 15);
+#if defined(__linux__)
+    pthread_setname_np(pthread_self(), short_name.c_str());
+#elif defined(__APPLE__)
+    pthread_setname_np(short_name.c_str());
+#endif
+    set_heap_profile_thread_name(name.c_str());
+}
+
+void lower_thread_priority() {
+#if defined(__linux__)
+    // Linux's nice values are per thread.
+    constexpr int kNiceness = 10;
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), kNiceness);
+#elif defined(__APPLE__)
+    pthread_set_qos_class_self_np(QOS_CLASS_UTILITY, 0);
+#endif
+}
+
+ScopedThreadAffinity::ScopedThreadAffinity(const std::vector<int>& cpus) {
+    if (!cpus.empty()) {
+        m_previous_cpus = get_thread_affinity();
+        set_thread_affinity(cpus);
+    }
+}
+
+ScopedThreadAffinity::~ScopedThreadAffinity() { set_thread_affinity(m_previous_cpus); }
+
+}  // namespace dorado::utils
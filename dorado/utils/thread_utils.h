@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <future>
+#include <string>
+#include <vector>
+
+namespace dorado::utils {
+
+// Parses a Linux-style CPU list (e.g. "0-3,8,10-11", as found in sysfs) into
+// a sorted list of CPU indices.  Malformed entries are ignored.
+std::vector<int> parse_cpu_list(const std::string& cpu_list);
+
+// Formats a list of CPU indices in the same style, e.g. {0, 1, 2, 3, 8} -> "0-3,8".
+std::string format_cpu_list(std::vector<int> cpus);
+
+// Restricts the calling thread to the given CPUs.
+// Returns false if the affinity could not be set, or if setting affinity isn't
+// supported on this platform.  An empty list leaves the affinity unchanged.
+bool set_thread_affinity(const std::vector<int>& cpus);
+
+// Returns the CPUs the calling thread may currently run on, or an empty list if
+// querying affinity isn't supported on this platform.
+std::vector<int> get_thread_affinity();
+
+// Names the calling thread, as shown by top, debuggers and heap profiles.  Names are cut to 15
+// characters for the OS, so pipeline nodes use short ones.
+void set_thread_name(const std::string& name);
+
+// Lowers the calling thread's scheduling priority, for threads which only report on the others,
+// e.g. writing logs or progress, and shouldn't take a core from them under load.  Best effort.
+void lower_thread_priority();
+
+// Calls fn(i) for each i in [0, n), each on a thread of its own, e.g. to set up every GPU at
+// once, and returns the results in order.  Once they have all finished, the exception of the
+// first call to throw, in order, is rethrown.
+template <typename Fn>
+auto run_concurrently(size_t n, Fn fn) -> std::vector<decltype(fn(size_t{}))> {
+    std::vector<std::future<decltype(fn(size_t{}))>> futures;
+    for (size_t i = 0; i < n; ++i) {
+        futures.push_back(std::async(std::launch::async, fn, i));
+    }
+    for (auto& future : futures) {
+        future.wait();
+    }
+    std::vector<decltype(fn(size_t{}))> results;
+    for (auto& future : futures) {
+        results.push_back(future.get());
+    }
+    return results;
+}
+
+// Binds the calling thread to the given CPUs for the lifetime of the object, then
+// restores the previous affinity.  Used so that memory first touched within the scope
+// is allocated on the NUMA node of those CPUs.
+class ScopedThreadAffinity {
+public:
+    explicit ScopedThreadAffinity(const std::vector<int>& cpus);
+    ~ScopedThreadAffinity();
+
+    ScopedThreadAffinity(const ScopedThreadAffinity&) = delete;
+    ScopedThreadAffinity& operator=(const ScopedThreadAffinity&) = delete;
+
+private:
+    std::vector<int> m_previous_cpus;
+};
+
+}  // namespace dorado::utils
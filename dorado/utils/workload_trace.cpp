@@ -0,0 +1,124 @@
+#include "workload_trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+std::vector<std::string> split_fields(const std::string& line) {
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while (true) {
+        const size_t end = line.find('\t', start);
+        fields.push_back(line.substr(start, end - start));
+        if (end == std::string::npos) {
+            return fields;
+        }
+        start = end + 1;
+    }
+}
+
+double parse_number(const std::string& field, size_t line_number) {
+    char* end = nullptr;
+    const double value = std::strtod(field.c_str(), &end);
+    if (field.empty() || end != field.c_str() + field.size() || !std::isfinite(value) ||
+        value < 0) {
+        throw std::runtime_error("Invalid value '" + field + "' on line " +
+                                 std::to_string(line_number) + " of the workload trace");
+    }
+    return value;
+}
+
+}  // namespace
+
+namespace dorado::utils {
+
+std::vector<TraceRead> parse_workload_trace(std::istream& input, uint64_t sample_rate) {
+    if (sample_rate == 0) {
+        throw std::runtime_error("A workload trace needs a sample rate to replay at");
+    }
+    std::string line;
+    if (!std::getline(input, line)) {
+        throw std::runtime_error("The workload trace is empty");
+    }
+    if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+    }
+    const auto header = split_fields(line);
+    auto find_column = [&header](const char* name) -> std::optional<size_t> {
+        const auto column = std::find(header.begin(), header.end(), name);
+        if (column == header.end()) {
+            return std::nullopt;
+        }
+        return size_t(column - header.begin());
+    };
+    const auto channel_column = find_column("channel");
+    const auto mux_column = find_column("mux");
+    const auto start_time_column = find_column("start_time");
+    const auto num_samples_column = find_column("num_samples");
+    const auto duration_column = find_column("duration");
+    if (!channel_column || !start_time_column || (!num_samples_column && !duration_column)) {
+        throw std::runtime_error(
+                "The workload trace needs channel, start_time and num_samples or duration "
+                "columns");
+    }
+
+    std::vector<TraceRead> reads;
+    size_t line_number = 1;
+    while (std::getline(input, line)) {
+        ++line_number;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty()) {
+            continue;
+        }
+        const auto fields = split_fields(line);
+        if (fields.size() < header.size()) {
+            throw std::runtime_error("Line " + std::to_string(line_number) +
+                                     " of the workload trace is missing fields");
+        }
+        TraceRead read;
+        read.channel = static_cast<int32_t>(parse_number(fields[*channel_column], line_number));
+        if (mux_column) {
+            read.mux = static_cast<uint32_t>(parse_number(fields[*mux_column], line_number));
+        }
+        read.start_time = parse_number(fields[*start_time_column], line_number);
+        if (num_samples_column) {
+            read.num_samples =
+                    static_cast<uint64_t>(parse_number(fields[*num_samples_column], line_number));
+        } else {
+            read.num_samples = static_cast<uint64_t>(
+                    std::llround(parse_number(fields[*duration_column], line_number) *
+                                 static_cast<double>(sample_rate)));
+        }
+        // Reads without signal aren't called, so don't make up a workload.
+        if (read.num_samples > 0) {
+            reads.push_back(read);
+        }
+    }
+
+    auto end_time = [sample_rate](const TraceRead& read) {
+        return read.start_time + static_cast<double>(read.num_samples) / sample_rate;
+    };
+    std::stable_sort(reads.begin(), reads.end(), [&end_time](const auto& a, const auto& b) {
+        return end_time(a) < end_time(b);
+    });
+    return reads;
+}
+
+std::vector<TraceRead> load_workload_trace(const std::filesystem::path& path,
+                                           uint64_t sample_rate) {
+    std::ifstream input(path);
+    if (!input) {
+        throw std::runtime_error("Failed to open workload trace " + path.string());
+    }
+    return parse_workload_trace(input, sample_rate);
+}
+
+}  // namespace dorado::utils
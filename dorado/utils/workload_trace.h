@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <istream>
+#include <vector>
+
+namespace dorado::utils {
+
+// When and where a read of a run was acquired, and how long it was, for replaying the run's
+// workload without its signal.
+struct TraceRead {
+    int32_t channel{1};
+    uint32_t mux{1};
+    // Seconds from the start of the run to the start of the read.
+    double start_time{0};
+    uint64_t num_samples{0};
+};
+
+// Parses a tab separated trace with a header naming its columns, of which those read are
+// channel, mux, start_time, and num_samples, or duration in seconds instead, at sample_rate.
+// A sequencing summary has these already, so it's a trace as it is, and it can be cut down to
+// just them to be compact.  mux is 1 if the trace has none.  Reads are returned in the order in
+// which they finished, as they would have been written and basecalled.  Throws on anything
+// malformed.
+std::vector<TraceRead> parse_workload_trace(std::istream& input, uint64_t sample_rate);
+std::vector<TraceRead> load_workload_trace(const std::filesystem::path& path,
+                                           uint64_t sample_rate);
+
+}  // namespace dorado::utils
@@ -6,7 +6,12 @@
 
 #include <catch2/catch.hpp>
 
+#include <algorithm>
 #include <filesystem>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 #define TEST_GROUP "[bam_utils][aligner]"
 
@@ -178,10 +183,148 @@ TEST_CASE("AlignerTest: Verify impact of updated aligner args", TEST_GROUP) {
     }
 }
 
-TEST_CASE("AlignerTest: Check Aligner crashes if multi index encountered", TEST_GROUP) {
+TEST_CASE("AlignerTest: Aligns against every part of a split index", TEST_GROUP) {
     fs::path aligner_test_dir = fs::path(get_aligner_data_dir());
     auto ref = aligner_test_dir / "long_target.fa";
 
+    // The index batch size is small enough for each sequence to get its own part.
     MessageSinkToVector<dorado::BamPtr> sink(100);
-    CHECK_THROWS(dorado::utils::Aligner(sink, ref.string(), 5, 5, 1e3, 1));
+    dorado::utils::Aligner aligner(sink, ref.string(), 5, 5, 1e3, 1);
+    auto header_records = aligner.get_sequence_records_for_header();
+    REQUIRE(header_records.size() == 2);
+    CHECK(header_records[0].second == 1056);
+    CHECK(header_records[1].second == 10865);
+
+    // Each sequence's primary alignment is to itself, numbered as it is in the header.
+    dorado::utils::HtsReader reader(ref.string());
+    reader.read(aligner, 100);
+    auto bam_records = sink.get_messages();
+    int num_primary = 0;
+    for (auto& record : bam_records) {
+        bam1_t* rec = record.get();
+        if (rec->core.flag & (BAM_FSECONDARY | BAM_FSUPPLEMENTARY | BAM_FUNMAP)) {
+            continue;
+        }
+        ++num_primary;
+        REQUIRE(rec->core.tid >= 0);
+        CHECK(std::string(bam_get_qname(rec)) == header_records[rec->core.tid].first);
+    }
+    CHECK(num_primary == 2);
+}
+
+TEST_CASE("AlignerTest: A split index picks primary alignments as a whole one does", TEST_GROUP) {
+    fs::path aligner_test_dir = fs::path(get_aligner_data_dir());
+    auto ref = aligner_test_dir / "long_target.fa";
+
+    // The primary and supplementary alignments of each read, in the order they're written.
+    auto align = [&ref](float index_batch_size) {
+        MessageSinkToVector<dorado::BamPtr> sink(100);
+        {
+            dorado::utils::Aligner aligner(sink, ref.string(), 5, 5, index_batch_size, 1);
+            dorado::utils::HtsReader reader(ref.string());
+            reader.read(aligner, 100);
+        }
+        std::vector<std::tuple<std::string, uint16_t, int32_t, hts_pos_t>> alignments;
+        for (auto& record : sink.get_messages()) {
+            const bam1_t* rec = record.get();
+            if (!(rec->core.flag & BAM_FSECONDARY)) {
+                alignments.emplace_back(bam_get_qname(rec), rec->core.flag, rec->core.tid,
+                                        rec->core.pos);
+            }
+        }
+        std::sort(alignments.begin(), alignments.end());
+        return alignments;
+    };
+    CHECK(align(1e3) == align(1e9));
+}
+
+TEST_CASE("AlignerTest: Aligns reads from the pipeline as it does their records", TEST_GROUP) {
+    fs::path aligner_test_dir = fs::path(get_aligner_data_dir());
+    auto ref = aligner_test_dir / "target.fq";
+
+    dorado::utils::HtsReader reader(ref.string());
+    REQUIRE(reader.read());
+    bam1_t* in_rec = reader.record.get();
+    auto read = std::make_shared<dorado::Read>();
+    read->read_id = bam_get_qname(in_rec);
+    read->seq = dorado::utils::convert_nt16_to_str(bam_get_seq(in_rec), in_rec->core.l_qseq);
+    read->qstring.resize(read->seq.size());
+    for (size_t i = 0; i < read->seq.size(); ++i) {
+        read->qstring[i] = static_cast<char>(bam_get_qual(in_rec)[i] + 33);
+    }
+    read->raw_data = torch::empty(4000);
+    read->sample_rate = 4000;
+    read->is_duplex = false;
+
+    MessageSinkToVector<dorado::BamPtr> sink(100);
+    {
+        dorado::utils::Aligner aligner(sink, ref.string(), 15, 15, 1e9, 2);
+        aligner.push_message(read);
+        aligner.push_message(dorado::BamPtr(bam_dup1(in_rec)));
+    }
+    auto bam_records = sink.get_messages();
+    REQUIRE(bam_records.size() == 2);
+
+    // The same alignment either way, with the read's own tags kept.
+    for (auto& record : bam_records) {
+        bam1_t* rec = record.get();
+        CHECK(!(rec->core.flag & BAM_FUNMAP));
+        CHECK(rec->core.tid == 0);
+        CHECK(rec->core.pos == bam_records[0]->core.pos);
+        CHECK(dorado::utils::convert_nt16_to_str(bam_get_seq(rec), rec->core.l_qseq) ==
+              read->seq);
+        CHECK(bam_aux_get(rec, "NM") != nullptr);
+    }
+    const bool read_first = bam_aux_get(bam_records[0].get(), "qs") != nullptr;
+    CHECK(bam_aux_get(bam_records[read_first ? 1 : 0].get(), "qs") == nullptr);
+}
+
+TEST_CASE("AlignerTest: Caches the index it builds, and loads it in later runs", TEST_GROUP) {
+    fs::path aligner_test_dir = fs::path(get_aligner_data_dir());
+    auto ref = aligner_test_dir / "long_target.fa";
+    const auto cache_dir = fs::temp_directory_path() / "dorado_index_cache_test";
+    fs::remove_all(cache_dir);
+    dorado::utils::set_minimap_index_cache(cache_dir);
+
+    auto cached_files = [&cache_dir] {
+        std::vector<fs::path> files;
+        for (const auto& entry : fs::directory_iterator(cache_dir)) {
+            files.push_back(entry.path());
+        }
+        return files;
+    };
+
+    MessageSinkToVector<dorado::BamPtr> sink(100);
+    // The names are copied, as they belong to the index, which is freed with the aligner.
+    std::vector<std::pair<std::string, uint32_t>> built_records;
+    {
+        dorado::utils::Aligner aligner(sink, ref.string(), 5, 5, 1e3, 1);
+        for (const auto& [name, length] : aligner.get_sequence_records_for_header()) {
+            built_records.emplace_back(name, length);
+        }
+    }
+    auto files = cached_files();
+    REQUIRE(files.size() == 1);
+    CHECK(files[0].extension() == ".mmi");
+    CHECK(files[0].filename().string().find("-k5-w5-I1000.mmi") != std::string::npos);
+
+    // The index is loaded from the cache, in the background as the pipeline is set up.
+    dorado::utils::preload_minimap_index(ref.string(), 5, 5, 1e3, 1);
+    {
+        dorado::utils::Aligner aligner(sink, ref.string(), 5, 5, 1e3, 1);
+        auto loaded_records = aligner.get_sequence_records_for_header();
+        REQUIRE(loaded_records.size() == built_records.size());
+        for (size_t i = 0; i < loaded_records.size(); ++i) {
+            CHECK(std::string(loaded_records[i].first) == built_records[i].first);
+            CHECK(loaded_records[i].second == built_records[i].second);
+        }
+    }
+    CHECK(cached_files().size() == 1);
+
+    // Other indexing options are cached separately.
+    { dorado::utils::Aligner aligner(sink, ref.string(), 7, 5, 1e3, 1); }
+    CHECK(cached_files().size() == 2);
+
+    dorado::utils::set_minimap_index_cache({});
+    fs::remove_all(cache_dir);
 }
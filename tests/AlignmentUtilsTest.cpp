@@ -0,0 +1,124 @@
+#include "utils/alignment_utils.h"
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <random>
+#include <string>
+
+#define CUT_TAG "[AlignmentUtils]"
+
+TEST_CASE(CUT_TAG ": align_within_error_rate aligns close sequences", CUT_TAG) {
+    const std::string target = "ACGTACGTACGTACGTACGTACGTACGTACGTACGTACGT";
+    std::string query = target;
+    query[10] = 'T';
+    query.erase(20, 1);
+
+    auto result = dorado::utils::align_within_error_rate(query, target, 0.1f);
+    CHECK(result.status == EDLIB_STATUS_OK);
+    CHECK(result.editDistance == 2);
+    REQUIRE(result.alignment != nullptr);
+    CHECK(result.alignmentLength == int(target.size()));
+    CHECK(result.startLocations[0] == 0);
+    CHECK(result.endLocations[0] == int(target.size()) - 1);
+    edlibFreeAlignResult(result);
+}
+
+TEST_CASE(CUT_TAG ": align_within_error_rate finds distances past its first bound", CUT_TAG) {
+    std::mt19937 rng(42);
+    const char bases[] = "ACGT";
+    std::string target(2000, 'A');
+    for (auto& base : target) {
+        base = bases[rng() % 4];
+    }
+    // Enough substitutions that the first bound or two don't reach them.
+    std::string query = target;
+    for (size_t i = 0; i < query.size(); i += 10) {
+        query[i] = query[i] == 'A' ? 'C' : 'A';
+    }
+
+    auto result = dorado::utils::align_within_error_rate(query, target, 0.2f);
+    CHECK(result.status == EDLIB_STATUS_OK);
+    CHECK(result.editDistance > 128);
+    CHECK(result.editDistance <= 200);
+    CHECK(result.alignment != nullptr);
+    edlibFreeAlignResult(result);
+}
+
+TEST_CASE(CUT_TAG ": align_within_error_rate gives up on distant sequences", CUT_TAG) {
+    const std::string target(100, 'A');
+
+    SECTION("Too many edits") {
+        auto result = dorado::utils::align_within_error_rate(std::string(100, 'C'), target, 0.2f);
+        CHECK(result.status == EDLIB_STATUS_OK);
+        CHECK(result.editDistance == -1);
+        edlibFreeAlignResult(result);
+    }
+
+    SECTION("Lengths too different") {
+        auto result = dorado::utils::align_within_error_rate(std::string(40, 'A'), target, 0.2f);
+        CHECK(result.status == EDLIB_STATUS_OK);
+        CHECK(result.editDistance == -1);
+        CHECK(result.alignment == nullptr);
+        edlibFreeAlignResult(result);
+    }
+}
+
+TEST_CASE(CUT_TAG ": minimizer sketches tell related sequences from unrelated ones", CUT_TAG) {
+    std::mt19937 rng(42);
+    const auto random_sequence = [&rng](size_t length) {
+        std::string sequence;
+        for (size_t i = 0; i < length; ++i) {
+            sequence.push_back("ACGT"[rng() % 4]);
+        }
+        return sequence;
+    };
+    // Substitutes, inserts or deletes a base at a rate of error_rate.
+    const auto mutate = [&rng](std::string sequence, float error_rate) {
+        std::uniform_real_distribution<float> uniform(0.f, 1.f);
+        std::string mutated;
+        for (const char base : sequence) {
+            if (uniform(rng) >= error_rate) {
+                mutated.push_back(base);
+                continue;
+            }
+            switch (rng() % 3) {
+            case 0:
+                mutated.push_back("ACGT"[rng() % 4]);
+                break;
+            case 1:
+                mutated.push_back(base);
+                mutated.push_back("ACGT"[rng() % 4]);
+                break;
+            default:
+                break;
+            }
+        }
+        return mutated;
+    };
+
+    const auto sequence = random_sequence(20000);
+    const auto sketch = dorado::utils::minimizer_sketch(sequence);
+    CHECK(std::is_sorted(sketch.begin(), sketch.end()));
+    CHECK(std::adjacent_find(sketch.begin(), sketch.end()) == sketch.end());
+    // About 2 of every window + 1 k-mers are minimizers.
+    CHECK(sketch.size() > sequence.size() / 8);
+    CHECK(sketch.size() < sequence.size() / 2);
+    CHECK(dorado::utils::sketch_similarity(sketch, sketch) == 1.f);
+
+    const auto close = dorado::utils::minimizer_sketch(mutate(sequence, 0.05f));
+    CHECK(dorado::utils::sketch_similarity(sketch, close) > 0.3f);
+    // Even as far apart as duplex pairs may be, they're well above the bound.
+    const auto distant = dorado::utils::minimizer_sketch(mutate(sequence, 0.2f));
+    CHECK(dorado::utils::sketch_similarity(sketch, distant) >
+          2 * dorado::utils::kMinDuplexSketchSimilarity);
+
+    const auto unrelated = dorado::utils::minimizer_sketch(random_sequence(20000));
+    CHECK(dorado::utils::sketch_similarity(sketch, unrelated) <
+          dorado::utils::kMinDuplexSketchSimilarity / 4);
+
+    // K-mers with other bases in them are left out.
+    CHECK(dorado::utils::minimizer_sketch(std::string(100, 'N')).empty());
+    CHECK(dorado::utils::minimizer_sketch("ACGTACGTACG").empty());
+    CHECK(dorado::utils::sketch_similarity({}, sketch) == 0.f);
+}
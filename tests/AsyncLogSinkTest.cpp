@@ -0,0 +1,135 @@
+#include "utils/AsyncLogSink.h"
+#include "utils/log_utils.h"
+
+#include <catch2/catch.hpp>
+#include <spdlog/sinks/base_sink.h>
+#include <spdlog/sinks/ostream_sink.h>
+#include <spdlog/spdlog.h>
+
+#include <future>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define CUT_TAG "[AsyncLogSink]"
+
+namespace {
+
+size_t count_lines(const std::string& text, const std::string& pattern) {
+    size_t count = 0;
+    std::istringstream lines(text);
+    for (std::string line; std::getline(lines, line);) {
+        count += line.find(pattern) != std::string::npos;
+    }
+    return count;
+}
+
+// Writes to an ostream, once released.
+class HeldSink : public spdlog::sinks::base_sink<std::mutex> {
+public:
+    HeldSink(std::ostream& stream, std::shared_future<void> released)
+            : m_stream(stream), m_released(std::move(released)) {}
+
+protected:
+    void sink_it_(const spdlog::details::log_msg& msg) override {
+        m_released.wait();
+        spdlog::memory_buf_t formatted;
+        formatter_->format(msg, formatted);
+        m_stream.write(formatted.data(), std::streamsize(formatted.size()));
+    }
+    void flush_() override { m_stream.flush(); }
+
+private:
+    std::ostream& m_stream;
+    std::shared_future<void> m_released;
+};
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": writes what every thread logged", CUT_TAG) {
+    std::ostringstream output;
+    {
+        auto sink = std::make_shared<dorado::utils::AsyncLogSink>(
+                std::make_shared<spdlog::sinks::ostream_sink_mt>(output), 1000);
+        sink->set_pattern("[%l] %v");
+        spdlog::logger logger("async_log_sink_test", sink);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&logger, t] {
+                for (int i = 0; i < 100; ++i) {
+                    logger.info("thread {} message {}", t, i);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        logger.flush();
+        // Only what was dropped is missing.
+        const auto num_written = count_lines(output.str(), "[info] thread");
+        CHECK(num_written + sink->num_dropped() == 400);
+        CHECK(output.str().find("[info] thread 3 message 99") != std::string::npos);
+    }
+}
+
+TEST_CASE(CUT_TAG ": says how many messages were dropped", CUT_TAG) {
+    std::ostringstream output;
+    {
+        // The sink the messages go to is held up, so a tiny ring overflows.
+        std::promise<void> release;
+        auto sink = std::make_shared<dorado::utils::AsyncLogSink>(
+                std::make_shared<HeldSink>(output, release.get_future().share()), 2);
+        spdlog::logger logger("async_log_sink_test", sink);
+        for (int i = 0; i < 100; ++i) {
+            logger.info("message {}", i);
+        }
+        release.set_value();
+        logger.flush();
+        CHECK(sink->num_dropped() > 0);
+        CHECK(count_lines(output.str(), "message ") == 100 - sink->num_dropped());
+        CHECK(count_lines(output.str(), "log messages dropped") == 1);
+    }
+}
+
+TEST_CASE(CUT_TAG ": errors are written at once, after what was queued before them", CUT_TAG) {
+    std::ostringstream output;
+    {
+        std::promise<void> release;
+        auto sink = std::make_shared<dorado::utils::AsyncLogSink>(
+                std::make_shared<HeldSink>(output, release.get_future().share()), 2);
+        spdlog::logger logger("async_log_sink_test", sink);
+        for (int i = 0; i < 100; ++i) {
+            logger.info("message {}", i);
+        }
+        auto error = std::async(std::launch::async, [&logger] { logger.error("failed"); });
+        release.set_value();
+        error.get();
+        // Written before the error returned, without a flush.
+        CHECK(count_lines(output.str(), "failed") == 1);
+        CHECK(output.str().find("failed") > output.str().rfind("message "));
+        CHECK(count_lines(output.str(), "message ") == 100 - sink->num_dropped());
+    }
+}
+
+TEST_CASE(CUT_TAG ": rate limiting lets a burst through, then counts the rest", CUT_TAG) {
+    dorado::utils::LogRateLimiter limiter(3, std::chrono::hours(1));
+    size_t suppressed = 0;
+    for (int i = 0; i < 3; ++i) {
+        CHECK(limiter.allow(suppressed));
+        CHECK(suppressed == 0);
+    }
+    for (int i = 0; i < 5; ++i) {
+        CHECK_FALSE(limiter.allow(suppressed));
+    }
+
+    dorado::utils::LogRateLimiter fast_limiter(1, std::chrono::milliseconds(10));
+    CHECK(fast_limiter.allow(suppressed));
+    CHECK_FALSE(fast_limiter.allow(suppressed));
+    CHECK_FALSE(fast_limiter.allow(suppressed));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK(fast_limiter.allow(suppressed));
+    CHECK(suppressed == 2);
+}
@@ -7,6 +7,7 @@
 #include <atomic>
 #include <iostream>
 #include <thread>
+#include <vector>
 
 TEST_CASE(TEST_GROUP ": InputsMatchOutputs") {
     const int n = 10;
@@ -90,4 +91,113 @@ TEST_CASE(TEST_GROUP ": TerminateFromOtherThread") {
 
     // This will fail, since the wait is terminated.
     REQUIRE(!try_pop_result);
-}
\ No newline at end of file
+}
+
+TEST_CASE(TEST_GROUP ": BatchInputsMatchOutputs") {
+    const int n = 10;
+    AsyncQueue<int> queue(n);
+
+    std::vector<int> items;
+    for (int i = 0; i < n; ++i) {
+        items.push_back(i);
+    }
+    REQUIRE(queue.try_push_batch(std::move(items)));
+    REQUIRE(items.empty());
+
+    // Popping is limited to the requested number of items.
+    std::vector<int> popped;
+    REQUIRE(queue.try_pop_batch(popped, 4));
+    REQUIRE(popped.size() == 4);
+    REQUIRE(queue.try_pop_batch(popped, n));
+    REQUIRE(popped.size() == n);
+    for (int i = 0; i < n; ++i) {
+        REQUIRE(popped[i] == i);
+    }
+}
+
+// A batch larger than the queue capacity has to be consumed as it is pushed.
+TEST_CASE(TEST_GROUP ": BatchLargerThanCapacity") {
+    const int n = 100;
+    AsyncQueue<int> queue(3);
+
+    std::vector<int> popped;
+    auto popping_thread = std::thread([&]() {
+        std::vector<int> batch;
+        while (queue.try_pop_batch(batch, 7)) {
+        }
+        popped = std::move(batch);
+    });
+
+    std::vector<int> items;
+    for (int i = 0; i < n; ++i) {
+        items.push_back(i);
+    }
+    const bool success = queue.try_push_batch(std::move(items));
+    queue.terminate();
+    popping_thread.join();
+
+    REQUIRE(success);
+    REQUIRE(popped.size() == n);
+    for (int i = 0; i < n; ++i) {
+        REQUIRE(popped[i] == i);
+    }
+}
+
+TEST_CASE(TEST_GROUP ": BatchPopFailsIfTerminating") {
+    AsyncQueue<int> queue(1);
+    queue.terminate();
+    std::vector<int> popped;
+    REQUIRE(!queue.try_pop_batch(popped, 10));
+    REQUIRE(!queue.try_push_batch({1, 2, 3}));
+}
+
+// Batches which fit in the queue are never interleaved with each other.
+TEST_CASE(TEST_GROUP ": ConcurrentBatchesStayTogether") {
+    const int num_pushers = 4, num_batches = 200, batch_size = 5;
+    AsyncQueue<int> queue(8);
+
+    std::vector<int> popped;
+    auto popping_thread = std::thread([&]() {
+        while (queue.try_pop_batch(popped, 3)) {
+        }
+    });
+
+    // Each item is its batch's number times batch_size plus its place in the batch.
+    std::vector<std::thread> pushers;
+    for (int pusher = 0; pusher < num_pushers; ++pusher) {
+        pushers.emplace_back([&, pusher]() {
+            for (int batch = pusher; batch < num_batches; batch += num_pushers) {
+                std::vector<int> items;
+                for (int i = 0; i < batch_size; ++i) {
+                    items.push_back(batch * batch_size + i);
+                }
+                queue.try_push_batch(std::move(items));
+            }
+        });
+    }
+    for (auto& pusher : pushers) {
+        pusher.join();
+    }
+    queue.terminate();
+    popping_thread.join();
+
+    REQUIRE(popped.size() == num_batches * batch_size);
+    for (size_t i = 0; i < popped.size(); ++i) {
+        CHECK(popped[i] % batch_size == int(i % batch_size));
+        CHECK(popped[i] / batch_size == popped[i - i % batch_size] / batch_size);
+    }
+}
+
+TEST_CASE(TEST_GROUP ": BatchPopKeepsGroupsTogether") {
+    AsyncQueue<int> queue(10);
+    REQUIRE(queue.try_push_batch({1, 1, 2, 2, 2, 3}));
+
+    // Grouped by value, the first pop carries on to the end of the 2s.
+    auto same_group = [](int a, int b) { return a == b; };
+    std::vector<int> popped;
+    REQUIRE(queue.try_pop_batch(popped, 3, same_group));
+    CHECK(popped == std::vector<int>{1, 1, 2, 2, 2});
+    popped.clear();
+    REQUIRE(queue.try_pop_batch(popped, 3, same_group));
+    CHECK(popped == std::vector<int>{3});
+}
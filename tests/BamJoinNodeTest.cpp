@@ -0,0 +1,150 @@
+#include "read_pipeline/BamJoinNode.h"
+
+#include "MessageSinkUtils.h"
+#include "htslib/sam.h"
+
+#include <catch2/catch.hpp>
+
+#define TEST_GROUP "[read_pipeline][BamJoinNode]"
+
+namespace {
+
+std::shared_ptr<dorado::Read> make_read() {
+    auto read = std::make_shared<dorado::Read>();
+    read->read_id = "read_1";
+    read->raw_data = torch::empty(40);
+    read->sample_rate = 4000;
+    read->seq = "ACGTTG";
+    read->qstring = "!+5?I+";
+    read->moves = dorado::utils::MoveTable(std::vector<uint8_t>{1, 0, 1, 1, 0, 1, 1, 1, 0, 0});
+    read->model_stride = 4;
+    read->num_trimmed_samples = 12;
+    read->run_id = "xyz";
+    read->model_name = "test_model";
+    read->is_duplex = false;
+    return read;
+}
+
+// The read as it comes from the scaler, without a basecall.
+std::shared_ptr<dorado::Read> make_scaled_read() {
+    auto read = std::make_shared<dorado::Read>();
+    read->read_id = "read_1";
+    read->raw_data = torch::empty(40);
+    read->num_trimmed_samples = 12;
+    return read;
+}
+
+}  // namespace
+
+TEST_CASE("BamJoinNode: basecalls are restored from records", TEST_GROUP) {
+    const auto read = make_read();
+    auto records = read->extract_sam_lines(true);
+    REQUIRE(records.size() == 1);
+
+    SECTION("from records of the sequence as it was read") {}
+    SECTION("from records of the reverse strand") {
+        // As an aligner would write it.
+        auto* record = records[0].get();
+        const std::string rc = "CAACGT";
+        const std::string rev_qual = "+I?5+!";
+        record->core.flag = BAM_FREVERSE;
+        for (size_t i = 0; i < rc.size(); ++i) {
+            bam_set_seqi(bam_get_seq(record), i, seq_nt16_table[uint8_t(rc[i])]);
+            bam_get_qual(record)[i] = uint8_t(rev_qual[i] - 33);
+        }
+    }
+
+    auto scaled = make_scaled_read();
+    REQUIRE(dorado::BamJoinNode::restore_basecall(*scaled, records[0].get()));
+    CHECK(scaled->seq == read->seq);
+    CHECK(scaled->qstring == read->qstring);
+    CHECK(scaled->moves == read->moves);
+    CHECK(scaled->model_stride == read->model_stride);
+}
+
+TEST_CASE("BamJoinNode: records must match the signal", TEST_GROUP) {
+    const auto read = make_read();
+    auto records = read->extract_sam_lines(true);
+    REQUIRE(records.size() == 1);
+
+    auto scaled = make_scaled_read();
+    SECTION("trimmed differently") { scaled->num_trimmed_samples = 20; }
+    SECTION("shorter than the moves") { scaled->raw_data = torch::empty(36); }
+    CHECK_FALSE(dorado::BamJoinNode::restore_basecall(*scaled, records[0].get()));
+}
+
+TEST_CASE("BamJoinNode: only primary records with moves are kept", TEST_GROUP) {
+    const auto read = make_read();
+    dorado::BamRecordMap records;
+
+    auto without_moves = read->extract_sam_lines(false);
+    CHECK_FALSE(records.add(std::move(without_moves[0])));
+    auto supplementary = read->extract_sam_lines(true);
+    supplementary[0]->core.flag |= BAM_FSUPPLEMENTARY;
+    CHECK_FALSE(records.add(std::move(supplementary[0])));
+    CHECK(records.size() == 0);
+
+    auto primary = read->extract_sam_lines(true);
+    CHECK(records.add(std::move(primary[0])));
+    CHECK(records.model_stride() == 4);
+    CHECK(records.read_ids() == std::unordered_set<std::string>{"read_1"});
+    REQUIRE(records.find("read_1") != nullptr);
+    CHECK(records.find("read_2") == nullptr);
+
+    // The records must all be from models of the same stride.
+    auto other = make_read();
+    other->read_id = "read_2";
+    other->model_stride = 6;
+    CHECK_THROWS(records.add(std::move(other->extract_sam_lines(true)[0])));
+
+    CHECK(records.take("read_1") != nullptr);
+    CHECK(records.take("read_1") == nullptr);
+    CHECK(records.size() == 0);
+}
+
+TEST_CASE("BamJoinNode: other records are kept with keep_other_records", TEST_GROUP) {
+    const auto read = make_read();
+    dorado::BamRecordMap records(true);
+
+    auto supplementary = read->extract_sam_lines(true);
+    supplementary[0]->core.flag |= BAM_FSUPPLEMENTARY;
+    CHECK_FALSE(records.add(std::move(supplementary[0])));
+    CHECK(records.add(std::move(read->extract_sam_lines(true)[0])));
+    auto other = make_read();
+    other->read_id = "read_2";
+    CHECK_FALSE(records.add(std::move(other->extract_sam_lines(false)[0])));
+    // Only the primary record with moves is joined up with a read.
+    CHECK(records.size() == 1);
+    CHECK(records.read_ids() == std::unordered_set<std::string>{"read_1"});
+
+    CHECK(records.take_others("read_1").size() == 1);
+    CHECK(records.take_others("read_1").empty());
+    CHECK(records.take_remaining().size() == 2);
+    CHECK(records.size() == 0);
+}
+
+TEST_CASE("BamJoinNode: BamModBaseTagNode passes on every record", TEST_GROUP) {
+    const auto read = make_read();
+    dorado::BamRecordMap records(true);
+    CHECK(records.add(std::move(read->extract_sam_lines(true)[0])));
+    auto supplementary = read->extract_sam_lines(true);
+    supplementary[0]->core.flag |= BAM_FSUPPLEMENTARY;
+    records.add(std::move(supplementary[0]));
+    // Of a read which isn't modbase called.
+    auto other = make_read();
+    other->read_id = "read_2";
+    records.add(std::move(other->extract_sam_lines(false)[0]));
+
+    MessageSinkToVector<dorado::BamPtr> sink(10);
+    {
+        dorado::BamModBaseTagNode tag_node(sink, records, 0.05f, 2);
+        tag_node.push_message(read);
+    }
+    const auto written = sink.get_messages();
+    REQUIRE(written.size() == 3);
+    // The read's records come first, together.
+    CHECK(std::string(bam_get_qname(written[0].get())) == "read_1");
+    CHECK(std::string(bam_get_qname(written[1].get())) == "read_1");
+    CHECK(std::string(bam_get_qname(written[2].get())) == "read_2");
+    CHECK(records.size() == 0);
+}
@@ -6,7 +6,9 @@
 #include <catch2/catch.hpp>
 
 #include <filesystem>
+#include <string>
 #include <unordered_set>
+#include <vector>
 
 #define TEST_GROUP "[bam_utils][hts_reader]"
 
@@ -76,3 +78,34 @@ TEST_CASE("HtsReaderTest: read_bam API w/ SAM", TEST_GROUP) {
     auto read_map = dorado::utils::read_bam(sam.string(), read_ids);
     REQUIRE(read_map.size() == 2);  // read_id filter is only asking for 2 reads.
 }
+
+TEST_CASE("HtsReaderTest: Read SAM in batches with threads", TEST_GROUP) {
+    fs::path aligner_test_dir = fs::path(get_data_dir("bam_reader"));
+    auto sam = aligner_test_dir / "small.sam";
+
+    dorado::utils::HtsReader reader(sam.string(), 4);
+    std::vector<dorado::BamPtr> records;
+    size_t num_batches = 0;
+    while (reader.read_batch(records, 4)) {
+        ++num_batches;
+    }
+    CHECK(num_batches == 3);
+    REQUIRE(records.size() == 11);  // SAM file has 11 reads.
+    for (auto& record : records) {
+        CHECK(record->core.l_qseq > 0);
+    }
+}
+
+TEST_CASE("HtsReaderTest: Read SAM to sink up to max reads", TEST_GROUP) {
+    fs::path aligner_test_dir = fs::path(get_data_dir("bam_reader"));
+    auto sam = aligner_test_dir / "small.sam";
+
+    MessageSinkToVector<dorado::BamPtr> sink(100);
+    dorado::utils::HtsReader reader(sam.string(), 2);
+    reader.read(sink, 5);
+    auto bam_records = sink.get_messages();
+    REQUIRE(bam_records.size() == 5);
+    // The reader's record is the last one passed on.
+    CHECK(std::string(bam_get_qname(reader.record.get())) ==
+          std::string(bam_get_qname(bam_records.back().get())));
+}
@@ -1,10 +1,18 @@
 #include "TestUtils.h"
+#include "htslib/bgzf.h"
 #include "htslib/sam.h"
 #include "utils/bam_utils.h"
 
 #include <catch2/catch.hpp>
 
+#include <chrono>
 #include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
 
 #define TEST_GROUP "[bam_utils][hts_writer]"
 
@@ -49,5 +57,390 @@ TEST_CASE("HtsWriterTest: Output mode conversion", TEST_GROUP) {
     CHECK(HtsWriter::get_output_mode("sam") == HtsWriter::OutputMode::SAM);
     CHECK(HtsWriter::get_output_mode("bam") == HtsWriter::OutputMode::BAM);
     CHECK(HtsWriter::get_output_mode("fastq") == HtsWriter::OutputMode::FASTQ);
+    CHECK(HtsWriter::get_output_mode("cram") == HtsWriter::OutputMode::CRAM);
     CHECK_THROWS_WITH(HtsWriter::get_output_mode("blah"), "Unknown output mode: blah");
 }
+
+TEST_CASE("HtsWriterTest: Sharded output covers every record", TEST_GROUP) {
+    const auto in_sam = fs::path(get_data_dir("bam_reader")) / "small.sam";
+    const auto out_dir = fs::temp_directory_path() / "sharded_out";
+    fs::remove_all(out_dir);
+
+    ShardedOutputSettings settings;
+    settings.directory = out_dir.string();
+    settings.num_shards = 2;
+    settings.max_records_per_file = 2;
+    size_t num_input_records = 0;
+    std::set<std::string> input_read_ids;
+    {
+        HtsReader counter(in_sam.string());
+        while (counter.read()) {
+            ++num_input_records;
+            input_read_ids.insert(bam_get_qname(counter.record.get()));
+        }
+
+        HtsReader reader(in_sam.string());
+        ShardedHtsWriter writer(settings, 2, 0);
+        writer.add_header(reader.header);
+        reader.read(writer, 1000);
+        writer.join();
+    }
+
+    // Each file the manifest lists holds the records it says, and no more than the limit, other
+    // than the rest of the records of the read which reached it.
+    std::ifstream manifest(out_dir / ShardedHtsWriter::kManifestFileName);
+    std::string line;
+    REQUIRE(std::getline(manifest, line));
+    CHECK(line == "file\trecords");
+    size_t num_files = 0, num_output_records = 0;
+    std::string name;
+    size_t num_records = 0;
+    while (manifest >> name >> num_records) {
+        CAPTURE(name);
+        HtsReader shard((out_dir / name).string());
+        size_t num_read = 0;
+        std::string last_read_id;
+        while (shard.read()) {
+            const std::string read_id = bam_get_qname(shard.record.get());
+            if (num_read >= settings.max_records_per_file) {
+                CHECK(read_id == last_read_id);
+            }
+            last_read_id = read_id;
+            ++num_read;
+        }
+        CHECK(num_read == num_records);
+        num_output_records += num_records;
+        ++num_files;
+    }
+    CHECK(num_output_records == num_input_records);
+    CHECK(num_files >= (input_read_ids.size() + 1) / 2);
+
+    fs::remove_all(out_dir);
+}
+
+// Reads pushed from several threads at once, each as one batch of records, never have their
+// records split between files, or interleaved with another read's.
+TEST_CASE("HtsWriterTest: Sharded output keeps each read's records together", TEST_GROUP) {
+    const auto out_dir = fs::temp_directory_path() / "sharded_together_out";
+    fs::remove_all(out_dir);
+
+    ShardedOutputSettings settings;
+    settings.directory = out_dir.string();
+    settings.num_shards = 3;
+    settings.max_records_per_file = 2;
+    settings.checkpoint_interval = std::chrono::seconds(0);
+    const size_t num_pushers = 4, reads_per_pusher = 50, records_per_read = 3;
+    {
+        ShardedHtsWriter writer(settings, 0, 0);
+        sam_hdr_t* header = sam_hdr_init();
+        writer.add_header(header);
+        sam_hdr_destroy(header);
+        std::vector<std::thread> pushers;
+        for (size_t pusher = 0; pusher < num_pushers; ++pusher) {
+            pushers.emplace_back([&, pusher] {
+                for (size_t read = 0; read < reads_per_pusher; ++read) {
+                    const auto read_id = std::to_string(pusher) + "_" + std::to_string(read);
+                    std::vector<dorado::Message> records;
+                    for (size_t i = 0; i < records_per_read; ++i) {
+                        BamPtr record(bam_init1());
+                        bam_set1(record.get(), read_id.size(), read_id.c_str(), 4, -1, -1, 0, 0,
+                                 nullptr, -1, -1, 0, 0, nullptr, nullptr, 0);
+                        records.push_back(std::move(record));
+                    }
+                    writer.push_messages(std::move(records));
+                }
+            });
+        }
+        for (auto& pusher : pushers) {
+            pusher.join();
+        }
+        writer.terminate();
+        writer.join();
+    }
+
+    std::ifstream manifest(out_dir / ShardedHtsWriter::kManifestFileName);
+    std::string line;
+    REQUIRE(std::getline(manifest, line));
+    std::string name;
+    size_t num_records = 0;
+    std::map<std::string, std::string> file_of_read;
+    while (manifest >> name >> num_records) {
+        CAPTURE(name);
+        HtsReader shard((out_dir / name).string());
+        std::string last_read_id;
+        size_t run_length = 0;
+        while (shard.read()) {
+            const std::string read_id = bam_get_qname(shard.record.get());
+            if (read_id != last_read_id) {
+                CHECK((last_read_id.empty() || run_length == records_per_read));
+                // Each read's records are all in one run, in one file.
+                CHECK(file_of_read.emplace(read_id, name).second);
+                last_read_id = read_id;
+                run_length = 0;
+            }
+            ++run_length;
+        }
+        CHECK(run_length == records_per_read);
+    }
+    CHECK(file_of_read.size() == num_pushers * reads_per_pusher);
+
+    fs::remove_all(out_dir);
+}
+
+TEST_CASE("HtsWriterTest: Sharded output resumes from its checkpoint", TEST_GROUP) {
+    const auto in_sam = fs::path(get_data_dir("bam_reader")) / "small.sam";
+    const auto out_dir = fs::temp_directory_path() / "sharded_resume_out";
+    fs::remove_all(out_dir);
+
+    ShardedOutputSettings settings;
+    settings.directory = out_dir.string();
+    settings.num_shards = 1;
+    settings.checkpoint_interval = std::chrono::seconds(0);
+    std::set<std::string> input_read_ids;
+    {
+        // The first run only gets through some of the records.
+        HtsReader reader(in_sam.string());
+        ShardedHtsWriter writer(settings, 1, 0);
+        writer.add_header(reader.header);
+        reader.read(writer, 4);
+        writer.join();
+        CHECK(writer.completed_read_ids().empty());
+    }
+    // Without its manifest, as if it had been interrupted.
+    fs::remove(out_dir / ShardedHtsWriter::kManifestFileName);
+
+    settings.resume = true;
+    {
+        HtsReader reader(in_sam.string());
+        ShardedHtsWriter writer(settings, 1, 0);
+        const auto& completed = writer.completed_read_ids();
+        CHECK(completed.size() > 0);
+        writer.add_header(reader.header);
+        // As the loader would, only the reads not yet written are passed on.
+        while (reader.read()) {
+            const std::string read_id = bam_get_qname(reader.record.get());
+            input_read_ids.insert(read_id);
+            if (!completed.contains(read_id)) {
+                writer.push_message(BamPtr(bam_dup1(reader.record.get())));
+            }
+        }
+        writer.terminate();
+        writer.join();
+    }
+
+    // The manifest lists the old file and the new, which between them hold every read.
+    std::ifstream manifest(out_dir / ShardedHtsWriter::kManifestFileName);
+    std::string line;
+    REQUIRE(std::getline(manifest, line));
+    std::string name;
+    size_t num_records = 0;
+    std::set<std::string> names, output_read_ids;
+    while (manifest >> name >> num_records) {
+        CAPTURE(name);
+        names.insert(name);
+        HtsReader shard((out_dir / name).string());
+        size_t num_read = 0;
+        while (shard.read()) {
+            output_read_ids.insert(bam_get_qname(shard.record.get()));
+            ++num_read;
+        }
+        CHECK(num_read == num_records);
+    }
+    CHECK(names == std::set<std::string>{"shard_0_0.bam", "shard_0_1.bam"});
+    CHECK(output_read_ids == input_read_ids);
+
+    fs::remove_all(out_dir);
+}
+
+TEST_CASE("HtsWriterTest: Resuming cuts files back to their checkpoint", TEST_GROUP) {
+    const auto in_sam = fs::path(get_data_dir("bam_reader")) / "small.sam";
+    const auto out_dir = fs::temp_directory_path() / "sharded_resume_cut_out";
+    fs::remove_all(out_dir);
+
+    ShardedOutputSettings settings;
+    settings.directory = out_dir.string();
+    settings.num_shards = 1;
+    settings.checkpoint_interval = std::chrono::seconds(0);
+    size_t num_checked_records = 0;
+    {
+        HtsReader reader(in_sam.string());
+        ShardedHtsWriter writer(settings, 1, 0);
+        writer.add_header(reader.header);
+        reader.read(writer, 4);
+        writer.join();
+    }
+    {
+        HtsReader shard((out_dir / "shard_0_0.bam").string());
+        while (shard.read()) {
+            ++num_checked_records;
+        }
+    }
+
+    // As if interrupted: half a block after the last checkpoint, a read listed but not
+    // committed, a line cut short, and a file which never reached a checkpoint.
+    fs::resize_file(out_dir / "shard_0_0.bam", fs::file_size(out_dir / "shard_0_0.bam") - 28);
+    std::ofstream(out_dir / "shard_0_0.bam", std::ios::binary | std::ios::app) << "\037\213\010";
+    std::ofstream(out_dir / ShardedHtsWriter::kCheckpointFileName, std::ios::app)
+            << "shard_0_0.bam\tuncommitted_read\nshard_0_1.bam\tcut_sh";
+    std::ofstream(out_dir / "shard_0_1.bam") << "partial";
+    fs::remove(out_dir / ShardedHtsWriter::kManifestFileName);
+
+    settings.resume = true;
+    std::set<std::string> input_read_ids, resumed_read_ids;
+    {
+        HtsReader reader(in_sam.string());
+        ShardedHtsWriter writer(settings, 1, 0);
+        const auto& completed = writer.completed_read_ids();
+        CHECK(completed.size() > 0);
+        CHECK(!completed.contains("uncommitted_read"));
+        // The file which never reached a checkpoint is gone before this run reuses its name.
+        CHECK(!fs::exists(out_dir / "shard_0_1.bam"));
+        writer.add_header(reader.header);
+        while (reader.read()) {
+            const std::string read_id = bam_get_qname(reader.record.get());
+            input_read_ids.insert(read_id);
+            if (!completed.contains(read_id)) {
+                resumed_read_ids.insert(read_id);
+                writer.push_message(BamPtr(bam_dup1(reader.record.get())));
+            }
+        }
+        writer.terminate();
+        writer.join();
+    }
+
+    HtsReader shard((out_dir / "shard_0_0.bam").string());
+    size_t num_read = 0;
+    while (shard.read()) {
+        ++num_read;
+    }
+    CHECK(num_read == num_checked_records);
+    BGZF* bgzf = bgzf_open((out_dir / "shard_0_0.bam").string().c_str(), "r");
+    REQUIRE(bgzf);
+    CHECK(bgzf_check_EOF(bgzf) == 1);
+    bgzf_close(bgzf);
+    std::set<std::string> new_file_read_ids;
+    HtsReader new_shard((out_dir / "shard_0_1.bam").string());
+    while (new_shard.read()) {
+        new_file_read_ids.insert(bam_get_qname(new_shard.record.get()));
+    }
+    CHECK(new_file_read_ids == resumed_read_ids);
+
+    // Resuming again finds everything the last run committed after the line cut short, and
+    // nothing listed but never committed under the reused file name.
+    fs::remove(out_dir / ShardedHtsWriter::kManifestFileName);
+    {
+        ShardedHtsWriter writer(settings, 1, 0);
+        const auto& completed = writer.completed_read_ids();
+        CHECK(completed.size() == input_read_ids.size());
+        for (const auto& read_id : input_read_ids) {
+            CHECK(completed.contains(read_id));
+        }
+        CHECK(!completed.contains("cut_sh"));
+        CHECK(!completed.contains("uncommitted_read"));
+        writer.terminate();
+        writer.join();
+    }
+    CHECK(fs::exists(out_dir / "shard_0_1.bam"));
+
+    fs::remove_all(out_dir);
+}
+
+TEST_CASE("HtsWriterTest: Sorted output is in coordinate order and indexed", TEST_GROUP) {
+    const auto in_sam = fs::path(get_data_dir("bam_reader")) / "small.sam";
+    const auto out_dir = fs::temp_directory_path() / "sorted_out";
+    fs::remove_all(out_dir);
+    fs::create_directories(out_dir);
+    const auto out_bam = out_dir / "sorted.bam";
+
+    SortedOutputSettings settings;
+    settings.scratch_directory = (out_dir / "scratch").string();
+    // Small enough for the records to be spilled in several runs, or none.
+    settings.max_memory_bytes = GENERATE(size_t(4096), size_t(1) << 30);
+    CAPTURE(settings.max_memory_bytes);
+    size_t num_input_records = 0;
+    {
+        HtsReader reader(in_sam.string());
+        HtsWriter writer(out_bam.string(), HtsWriter::OutputMode::BAM, 2, 0);
+        writer.add_header(reader.header);
+        writer.set_sorted_output(settings);
+        writer.write_header();
+        reader.read(writer, 1000);
+        writer.join();
+        num_input_records = writer.total;
+    }
+
+    CHECK(fs::exists(out_dir / "sorted.bam.bai"));
+    CHECK(fs::is_empty(settings.scratch_directory));
+
+    HtsReader sorted(out_bam.string());
+    kstring_t sort_order = KS_INITIALIZE;
+    REQUIRE(sam_hdr_find_tag_hd(sorted.header, "SO", &sort_order) == 0);
+    CHECK(std::string(ks_str(&sort_order)) == "coordinate");
+    ks_free(&sort_order);
+
+    size_t num_output_records = 0;
+    BamPtr previous;
+    while (sorted.read()) {
+        if (previous) {
+            CHECK_FALSE(CoordinateSorter::less(sorted.record.get(), previous.get()));
+        }
+        previous.reset(bam_dup1(sorted.record.get()));
+        ++num_output_records;
+    }
+    CHECK(num_output_records == num_input_records);
+    CHECK(num_output_records > 0);
+
+    fs::remove_all(out_dir);
+}
+
+TEST_CASE("HtsWriterTest: Sorted output needs a BAM file", TEST_GROUP) {
+    const auto out_sam = fs::temp_directory_path() / "sorted_out.sam";
+    HtsWriter writer(out_sam.string(), HtsWriter::OutputMode::SAM, 1, 0);
+    CHECK_THROWS(writer.set_sorted_output(SortedOutputSettings{}));
+    writer.terminate();
+    writer.join();
+    fs::remove(out_sam);
+}
+
+TEST_CASE("HtsWriterTest: CRAM keeps the move table", TEST_GROUP) {
+    dorado::Read read;
+    read.read_id = "read_1";
+    read.raw_data = torch::empty(40);
+    read.sample_rate = 4000;
+    read.seq = "ACGTTG";
+    read.qstring = "!+5?I+";
+    read.moves = MoveTable(std::vector<uint8_t>{1, 0, 1, 1, 0, 1, 1, 1, 0, 0});
+    read.model_stride = 4;
+    read.run_id = "xyz";
+    read.model_name = "test_model";
+    auto records = read.extract_sam_lines(true);
+    REQUIRE(records.size() == 1);
+
+    // Unaligned records need no reference.
+    const auto out_cram = fs::temp_directory_path() / "out.cram";
+    {
+        sam_hdr_t* header = sam_hdr_init();
+        sam_hdr_add_lines(header, "@HD\tVN:1.6\tSO:unknown", 0);
+        HtsWriter writer(out_cram.string(), HtsWriter::OutputMode::CRAM, 2, 0);
+        writer.add_header(header);
+        sam_hdr_destroy(header);
+        writer.write_header();
+        writer.push_message(BamPtr(bam_dup1(records[0].get())));
+        writer.terminate();
+        writer.join();
+    }
+
+    HtsReader reader(out_cram.string());
+    REQUIRE(reader.read());
+    CHECK(std::string(bam_get_qname(reader.record.get())) == "read_1");
+    CHECK(reader.record->core.l_qseq == 6);
+    uint8_t* mv = bam_aux_get(reader.record.get(), "mv");
+    REQUIRE(mv != nullptr);
+    const uint8_t* expected = bam_aux_get(records[0].get(), "mv");
+    REQUIRE(bam_auxB_len(mv) == bam_auxB_len(expected));
+    for (uint32_t i = 0; i < bam_auxB_len(mv); ++i) {
+        CHECK(bam_auxB2i(mv, i) == bam_auxB2i(expected, i));
+    }
+    CHECK_FALSE(reader.read());
+    fs::remove(out_cram);
+}
@@ -0,0 +1,128 @@
+#include "read_pipeline/BaseSpaceDuplexCallerNode.h"
+#include "utils/sequence_utils.h"
+
+#include <catch2/catch.hpp>
+
+#include <map>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#define TEST_GROUP "[read_pipeline][BaseSpaceDuplexCallerNode]"
+
+namespace {
+
+// Collects the read IDs of the duplex reads which are passed on.
+class DuplexReadSink : public dorado::MessageSink {
+public:
+    DuplexReadSink() : MessageSink(1000) {}
+
+    std::set<std::string> get_read_ids() {
+        std::set<std::string> read_ids;
+        dorado::Message message;
+        while (m_work_queue.try_pop(message)) {
+            read_ids.insert(std::get<std::shared_ptr<dorado::Read>>(message)->read_id);
+        }
+        return read_ids;
+    }
+};
+
+std::shared_ptr<dorado::Read> make_read(const std::string& read_id, const std::string& seq) {
+    auto read = std::make_shared<dorado::Read>();
+    read->read_id = read_id;
+    read->seq = seq;
+    read->qstring = std::string(seq.size(), '5');
+    return read;
+}
+
+// Reads of pairs whose complement is the exact reverse complement of their template.
+std::vector<std::shared_ptr<dorado::Read>> make_pair_reads(
+        int num_pairs,
+        std::map<std::string, std::string>& template_complement_map) {
+    std::mt19937 rng(42);
+    std::vector<std::shared_ptr<dorado::Read>> reads;
+    for (int i = 0; i < num_pairs; ++i) {
+        std::string seq(1000, 'A');
+        for (auto& base : seq) {
+            base = "ACGT"[rng() % 4];
+        }
+        const auto template_id = "template_" + std::to_string(i);
+        const auto complement_id = "complement_" + std::to_string(i);
+        reads.push_back(make_read(template_id, seq));
+        reads.push_back(make_read(complement_id, dorado::utils::reverse_complement(seq)));
+        template_complement_map[template_id] = complement_id;
+    }
+    return reads;
+}
+
+}  // namespace
+
+TEST_CASE("BaseSpaceDuplexCallerNode: calls pairs whichever read arrives first", TEST_GROUP) {
+    std::map<std::string, std::string> template_complement_map;
+    auto reads = make_pair_reads(20, template_complement_map);
+    // Complements first for some pairs, and a pair whose complement never arrives.
+    for (size_t i = 0; i < reads.size(); i += 4) {
+        std::swap(reads[i], reads[i + 1]);
+    }
+    template_complement_map["template_missing"] = "complement_missing";
+    reads.push_back(make_read("template_missing", std::string(1000, 'A')));
+    reads.push_back(make_read("not_in_pairs", std::string(1000, 'C')));
+
+    std::set<std::string> expected_read_ids;
+    for (int i = 0; i < 20; ++i) {
+        expected_read_ids.insert("template_" + std::to_string(i) + ";complement_" +
+                                 std::to_string(i));
+    }
+
+    DuplexReadSink sink;
+    {
+        dorado::BaseSpaceDuplexCallerNode duplex_caller_node(sink, template_complement_map, 4);
+        for (auto& read : reads) {
+            duplex_caller_node.push_message(std::move(read));
+        }
+    }
+    CHECK(sink.get_read_ids() == expected_read_ids);
+}
+
+TEST_CASE("BaseSpaceDuplexCallerNode: reads evicted from the cache aren't paired", TEST_GROUP) {
+    std::map<std::string, std::string> template_complement_map;
+    auto reads = make_pair_reads(3, template_complement_map);
+    // Every template arrives before any complement, and only two are kept, so the third
+    // template is held at the expense of the first.
+    std::vector<std::shared_ptr<dorado::Read>> ordered_reads{reads[0], reads[2], reads[4],
+                                                             reads[3], reads[5], reads[1]};
+
+    DuplexReadSink sink;
+    {
+        dorado::BaseSpaceDuplexCallerNode duplex_caller_node(sink, template_complement_map, 4, 2);
+        for (auto& read : ordered_reads) {
+            duplex_caller_node.push_message(std::move(read));
+        }
+    }
+    const std::set<std::string> expected_read_ids{"template_1;complement_1",
+                                                  "template_2;complement_2"};
+    CHECK(sink.get_read_ids() == expected_read_ids);
+}
+
+TEST_CASE("BaseSpaceDuplexCallerNode: a read seen twice is cached once", TEST_GROUP) {
+    std::map<std::string, std::string> template_complement_map;
+    auto reads = make_pair_reads(2, template_complement_map);
+    // The repeated template replaces its cached copy, so the second template fits in a cache
+    // of two without evicting it.
+    std::vector<std::shared_ptr<dorado::Read>> ordered_reads{
+            reads[0], make_read(reads[0]->read_id, reads[0]->seq), reads[2], reads[1],
+            reads[3]};
+
+    DuplexReadSink sink;
+    {
+        dorado::BaseSpaceDuplexCallerNode duplex_caller_node(sink, template_complement_map, 4, 2);
+        for (auto& read : ordered_reads) {
+            duplex_caller_node.push_message(std::move(read));
+        }
+    }
+    const std::set<std::string> expected_read_ids{"template_0;complement_0",
+                                                  "template_1;complement_1"};
+    CHECK(sink.get_read_ids() == expected_read_ids);
+}
@@ -0,0 +1,171 @@
+#include "api/BasecallSession.h"
+
+#include <catch2/catch.hpp>
+#include <torch/torch.h>
+
+#include <atomic>
+#include <future>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define CUT_TAG "[BasecallSession]"
+
+namespace {
+
+// Calls every step of every chunk as a move, emitting an A.
+class MoveEveryStepRunner : public dorado::ModelRunnerBase {
+public:
+    explicit MoveEveryStepRunner(size_t chunk_size = 1000) : m_chunk_size(chunk_size) {}
+
+    void accept_chunk(int, const torch::Tensor &) override {}
+    std::vector<dorado::DecodedChunk> call_chunks(int num_chunks) override {
+        ++num_batches;
+        const size_t num_steps = chunk_size() / model_stride();
+        return std::vector<dorado::DecodedChunk>(
+                num_chunks, {std::string(num_steps, 'A'), std::string(num_steps, '5'),
+                             std::vector<uint8_t>(num_steps, 1)});
+    }
+    size_t model_stride() const override { return 5; }
+    size_t chunk_size() const override { return m_chunk_size; }
+    size_t batch_size() const override { return 16; }
+    std::string device() const override { return "cpu"; }
+
+    std::atomic<int> num_batches{0};
+
+private:
+    const size_t m_chunk_size;
+};
+
+std::vector<int16_t> make_signal(size_t num_samples, uint32_t seed) {
+    std::mt19937 generator(seed);
+    std::normal_distribution<float> samples(500.f, 50.f);
+    std::vector<int16_t> signal(num_samples);
+    for (auto &sample : signal) {
+        sample = static_cast<int16_t>(samples(generator));
+    }
+    return signal;
+}
+
+dorado::BasecallSession::Options test_options() {
+    dorado::BasecallSession::Options options;
+    options.model_path = "test_model";
+    options.overlap = 100;
+    options.batch_latency_target_ms = 50;
+    options.max_reads_in_flight = 8;
+    return options;
+}
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": calls reads submitted from several threads", CUT_TAG) {
+    std::vector<dorado::Runner> runners{std::make_shared<MoveEveryStepRunner>(),
+                                        std::make_shared<MoveEveryStepRunner>()};
+    dorado::BasecallSession session(runners, {}, test_options());
+    CHECK(session.model_name() == "test_model");
+
+    constexpr int kNumThreads = 4;
+    constexpr int kReadsPerThread = 10;
+    std::vector<std::map<std::string, std::future<std::shared_ptr<dorado::Read>>>> futures(
+            kNumThreads);
+    std::vector<std::thread> submitters;
+    for (int t = 0; t < kNumThreads; ++t) {
+        submitters.emplace_back([&session, &futures, t] {
+            for (int i = 0; i < kReadsPerThread; ++i) {
+                const auto signal = make_signal(4000 + 1000 * i, t * kReadsPerThread + i);
+                dorado::RawRead raw_read;
+                raw_read.read_id = "read_" + std::to_string(t) + "_" + std::to_string(i);
+                raw_read.signal = signal.data();
+                raw_read.num_samples = signal.size();
+                raw_read.sample_rate = 4000;
+                raw_read.run_id = "run";
+                raw_read.channel_number = t + 1;
+                futures[t].emplace(raw_read.read_id, session.submit(raw_read));
+            }
+        });
+    }
+    for (auto &submitter : submitters) {
+        submitter.join();
+    }
+
+    for (int t = 0; t < kNumThreads; ++t) {
+        for (auto &[read_id, future] : futures[t]) {
+            const auto read = future.get();
+            CHECK(read->read_id == read_id);
+            CHECK(read->attributes.channel_number == t + 1);
+            CHECK(read->run_id == "run");
+            CHECK(read->model_name == "test_model");
+            CHECK(!read->seq.empty());
+            CHECK(read->seq.size() == read->qstring.size());
+            CHECK(read->moves.count() == read->seq.size());
+        }
+    }
+    session.flush();
+    CHECK(session.num_reads_in_flight() == 0);
+}
+
+TEST_CASE(CUT_TAG ": hands reads to callbacks, and waits for them", CUT_TAG) {
+    std::atomic<int> num_called{0};
+    {
+        dorado::BasecallSession session({std::make_shared<MoveEveryStepRunner>()}, {},
+                                        test_options());
+        const auto signal = make_signal(5000, 1);
+        dorado::RawRead raw_read;
+        raw_read.signal = signal.data();
+        raw_read.num_samples = signal.size();
+        raw_read.sample_rate = 4000;
+        for (int i = 0; i < 20; ++i) {
+            raw_read.read_id = "read_" + std::to_string(i);
+            session.submit(raw_read, [&num_called](std::shared_ptr<dorado::Read> read) {
+                if (!read->seq.empty()) {
+                    ++num_called;
+                }
+            });
+        }
+        // The session waits for the reads in flight as it's destroyed.
+    }
+    CHECK(num_called == 20);
+}
+
+TEST_CASE(CUT_TAG ": calls the starts of reads on the prefix runners", CUT_TAG) {
+    auto prefix_runner = std::make_shared<MoveEveryStepRunner>(400);
+    auto options = test_options();
+    // Long enough for the requests to be batched together.
+    options.prefix_batch_wait_ms = 500;
+    dorado::BasecallSession session({std::make_shared<MoveEveryStepRunner>()}, {}, options,
+                                    {prefix_runner});
+
+    std::vector<std::future<dorado::ReadPrefix>> prefixes;
+    for (size_t num_samples : {100, 300, 4000, 20000}) {
+        const auto signal = make_signal(num_samples, uint32_t(num_samples));
+        dorado::RawRead raw_read;
+        raw_read.read_id = std::to_string(num_samples);
+        raw_read.signal = signal.data();
+        raw_read.num_samples = signal.size();
+        prefixes.push_back(session.submit_prefix(raw_read));
+    }
+    for (auto &future : prefixes) {
+        const auto prefix = future.get();
+        const auto num_samples = std::stoul(prefix.read_id);
+        // No more than the leading chunk, without its repeat padding.
+        CHECK(prefix.num_samples <= std::min<size_t>(num_samples, 400));
+        CHECK(prefix.seq.size() == prefix.num_samples / 5);
+        CHECK(prefix.qstring.size() == prefix.seq.size());
+    }
+    CHECK(prefix_runner->num_batches == 1);
+}
+
+TEST_CASE(CUT_TAG ": rejects reads without signal", CUT_TAG) {
+    dorado::BasecallSession session({std::make_shared<MoveEveryStepRunner>()}, {},
+                                    test_options());
+    dorado::RawRead raw_read;
+    raw_read.read_id = "empty";
+    CHECK_THROWS(session.submit(raw_read));
+    // Nor can it call prefixes without prefix runners.
+    const std::vector<int16_t> signal(1000, 500);
+    raw_read.signal = signal.data();
+    raw_read.num_samples = signal.size();
+    CHECK_THROWS(session.submit_prefix(raw_read));
+}
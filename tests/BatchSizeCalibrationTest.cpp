@@ -0,0 +1,141 @@
+#include "utils/batch_size_calibration.h"
+
+#include <catch2/catch.hpp>
+
+#include <filesystem>
+#include <fstream>
+
+#define CUT_TAG "[BatchSizeCalibration]"
+
+namespace fs = std::filesystem;
+using dorado::utils::BatchSizeCache;
+using dorado::utils::BatchSizeMeasurement;
+using dorado::utils::KernelTuningCache;
+
+namespace {
+
+constexpr size_t kMB = 1000 * 1000;
+constexpr size_t kGB = 1000 * kMB;
+
+fs::path make_model_dir(const std::string& name) {
+    const auto model_dir = fs::temp_directory_path() / name;
+    fs::remove_all(model_dir);
+    fs::create_directories(model_dir);
+    return model_dir;
+}
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": max_batch_size_for_memory extrapolates linearly", CUT_TAG) {
+    // 1GB of weights and 10MB per chunk.
+    const std::vector<BatchSizeMeasurement> measurements{{64, 1640 * kMB, 100.f},
+                                                         {128, 2280 * kMB, 180.f}};
+    // 1000 chunks fit in 11GB, which rounds down to 960.
+    CHECK(dorado::utils::max_batch_size_for_memory(measurements, 11 * kGB, 64) == 960);
+    // Only the smallest measured batch size fits.
+    CHECK(dorado::utils::max_batch_size_for_memory(measurements, 2 * kGB, 64) == 64);
+    // Not even that fits.
+    CHECK(dorado::utils::max_batch_size_for_memory(measurements, kGB, 64) == 0);
+    CHECK(dorado::utils::max_batch_size_for_memory({}, kGB, 64) == 0);
+}
+
+TEST_CASE(CUT_TAG ": max_batch_size_for_memory with nothing to extrapolate from", CUT_TAG) {
+    const std::vector<BatchSizeMeasurement> measurements{{64, kGB, 100.f}};
+    CHECK(dorado::utils::max_batch_size_for_memory(measurements, 2 * kGB, 64) == 64);
+}
+
+TEST_CASE(CUT_TAG ": batch_sizes_to_sweep", CUT_TAG) {
+    using Sizes = std::vector<int>;
+    CHECK(dorado::utils::batch_sizes_to_sweep(256, 64, 16) == Sizes{64, 128, 192, 256});
+    // Spaced out to at most max_points, always ending at the largest.
+    CHECK(dorado::utils::batch_sizes_to_sweep(640, 64, 4) == Sizes{64, 256, 448, 640});
+    CHECK(dorado::utils::batch_sizes_to_sweep(700, 64, 5) == Sizes{128, 256, 384, 512, 640});
+    CHECK(dorado::utils::batch_sizes_to_sweep(63, 64, 16).empty());
+    CHECK(dorado::utils::batch_sizes_to_sweep(640, 64, 0).empty());
+}
+
+TEST_CASE(CUT_TAG ": select_batch_size picks the best throughput that fits", CUT_TAG) {
+    const std::vector<BatchSizeMeasurement> measurements{{64, 2 * kGB, 100.f},
+                                                         {128, 3 * kGB, 180.f},
+                                                         {192, 4 * kGB, 170.f},
+                                                         {256, 5 * kGB, 250.f}};
+    CHECK(dorado::utils::select_batch_size(measurements, 5 * kGB) == 256);
+    CHECK(dorado::utils::select_batch_size(measurements, 4 * kGB) == 128);
+    CHECK(dorado::utils::select_batch_size(measurements, kGB) == 0);
+    CHECK(dorado::utils::select_batch_size({}, kGB) == 0);
+}
+
+TEST_CASE(CUT_TAG ": select_efficient_batch_size picks the least energy per chunk", CUT_TAG) {
+    std::vector<BatchSizeMeasurement> measurements{{64, 2 * kGB, 100.f, 0.5f},
+                                                   {128, 3 * kGB, 180.f, 0.3f},
+                                                   {192, 4 * kGB, 170.f, 0.4f},
+                                                   {256, 5 * kGB, 250.f, 0.35f}};
+    CHECK(dorado::utils::select_efficient_batch_size(measurements, 5 * kGB) == 128);
+    CHECK(dorado::utils::select_efficient_batch_size(measurements, 2 * kGB) == 64);
+    CHECK(dorado::utils::select_efficient_batch_size(measurements, kGB) == 0);
+
+    // Without energy measurements, it's the best throughput.
+    for (auto& measurement : measurements) {
+        measurement.joules_per_chunk = 0.f;
+    }
+    CHECK(dorado::utils::select_efficient_batch_size(measurements, 5 * kGB) == 256);
+}
+
+TEST_CASE(CUT_TAG ": BatchSizeCache entries are reused", CUT_TAG) {
+    const auto model_dir = make_model_dir("batch_size_cache_reuse");
+    {
+        BatchSizeCache cache(model_dir);
+        CHECK_FALSE(cache.find("NVIDIA A100 80GB PCIe", 10000, 79).has_value());
+        cache.insert("NVIDIA A100 80GB PCIe", 10000, 79, 1536);
+        cache.insert("NVIDIA A100 80GB PCIe", 4000, 79, 4096);
+    }
+    CHECK(fs::exists(model_dir / BatchSizeCache::kCacheFileName));
+
+    BatchSizeCache cache(model_dir);
+    CHECK(cache.find("NVIDIA A100 80GB PCIe", 10000, 79) == 1536);
+    CHECK(cache.find("NVIDIA A100 80GB PCIe", 4000, 79) == 4096);
+    // Every part of the key has to match.
+    CHECK_FALSE(cache.find("NVIDIA A100 80GB PCIe", 10000, 39).has_value());
+    CHECK_FALSE(cache.find("NVIDIA A100", 10000, 79).has_value());
+}
+
+TEST_CASE(CUT_TAG ": BatchSizeCache later entries replace earlier ones", CUT_TAG) {
+    const auto model_dir = make_model_dir("batch_size_cache_replace");
+    {
+        std::ofstream stream(model_dir / BatchSizeCache::kCacheFileName);
+        stream << "Tesla V100-PCIE-16GB\t10000\t15\t640\n";
+        stream << "malformed line\n";
+        stream << "Tesla V100-PCIE-16GB\t10000\t15\t768\n";
+    }
+    BatchSizeCache cache(model_dir);
+    CHECK(cache.find("Tesla V100-PCIE-16GB", 10000, 15) == 768);
+}
+
+TEST_CASE(CUT_TAG ": BatchSizeCache without a writable model directory", CUT_TAG) {
+    const auto model_dir = fs::temp_directory_path() / "batch_size_cache_missing";
+    fs::remove_all(model_dir);
+
+    BatchSizeCache(model_dir).insert("Tesla T4", 6000, 14, 512);
+    CHECK_FALSE(fs::exists(model_dir));
+    // Still kept for the rest of the process.
+    CHECK(BatchSizeCache(model_dir).find("Tesla T4", 6000, 14) == 512);
+}
+
+TEST_CASE(CUT_TAG ": KernelTuningCache entries are reused", CUT_TAG) {
+    const auto model_dir = make_model_dir("kernel_tuning_cache_reuse");
+    {
+        KernelTuningCache cache(model_dir);
+        CHECK_FALSE(cache.find("Apple M1 Pro/16", "lstm", 384, 768).has_value());
+        cache.insert("Apple M1 Pro/16", "lstm", 384, 768, 24);
+        cache.insert("Apple M1 Pro/16", "linear", 1024, 768, 32);
+    }
+    // Kept apart from batch sizes, so that neither cache's entries can be taken for the other's.
+    CHECK(fs::exists(model_dir / KernelTuningCache::kCacheFileName));
+    CHECK_FALSE(fs::exists(model_dir / BatchSizeCache::kCacheFileName));
+
+    KernelTuningCache cache(model_dir);
+    CHECK(cache.find("Apple M1 Pro/16", "lstm", 384, 768) == 24);
+    CHECK(cache.find("Apple M1 Pro/16", "linear", 1024, 768) == 32);
+    CHECK_FALSE(cache.find("Apple M1 Pro/16", "lstm", 384, 1536).has_value());
+    CHECK_FALSE(cache.find("Apple M1 Max/32", "lstm", 384, 768).has_value());
+}
@@ -0,0 +1,90 @@
+#include "read_pipeline/BatchTimeout.h"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+
+#define TEST_GROUP "[read_pipeline][BatchTimeout]"
+
+using dorado::AdaptiveBatchTimeout;
+using namespace std::chrono_literals;
+
+TEST_CASE("AdaptiveBatchTimeout: Empty batches are never called", TEST_GROUP) {
+    AdaptiveBatchTimeout timeout(2000ms);
+    const auto start = AdaptiveBatchTimeout::Clock::now();
+    CHECK_FALSE(timeout.should_call(start + 1h));
+}
+
+TEST_CASE("AdaptiveBatchTimeout: Batches are called when arrivals stop", TEST_GROUP) {
+    AdaptiveBatchTimeout timeout(2000ms);
+    auto now = AdaptiveBatchTimeout::Clock::now();
+    // Chunks every 10ms, so a pause of 4 intervals means no more are coming.
+    for (int i = 0; i < 20; ++i) {
+        now += 10ms;
+        timeout.chunk_added(now);
+        CHECK_FALSE(timeout.should_call(now + 10ms));
+    }
+    CHECK(timeout.deadline() == now + 40ms);
+    CHECK_FALSE(timeout.should_call(now + 39ms));
+    CHECK(timeout.should_call(now + 40ms));
+}
+
+TEST_CASE("AdaptiveBatchTimeout: Fast arrivals use the minimum timeout", TEST_GROUP) {
+    AdaptiveBatchTimeout timeout(2000ms);
+    auto now = AdaptiveBatchTimeout::Clock::now();
+    for (int i = 0; i < 100; ++i) {
+        now += 10us;
+        timeout.chunk_added(now);
+    }
+    CHECK(timeout.deadline() == now + AdaptiveBatchTimeout::kMinTimeout);
+}
+
+TEST_CASE("AdaptiveBatchTimeout: Steady arrivals wait for the latency target", TEST_GROUP) {
+    AdaptiveBatchTimeout timeout(1000ms);
+    const auto start = AdaptiveBatchTimeout::Clock::now();
+    auto now = start;
+    timeout.chunk_added(now);
+    // A call time of 200ms leaves 800ms for the batch to fill.
+    timeout.batch_called(now, now + 200ms);
+
+    // Chunks every 50ms never pause for long enough to call the batch early.
+    const auto batch_start = start + 250ms;
+    for (now = batch_start; now < batch_start + 800ms; now += 50ms) {
+        CHECK_FALSE(timeout.should_call(now));
+        timeout.chunk_added(now);
+    }
+    CHECK(timeout.deadline() == batch_start + 800ms);
+    CHECK(timeout.should_call(batch_start + 800ms));
+}
+
+TEST_CASE("AdaptiveBatchTimeout: Batch latencies are recorded", TEST_GROUP) {
+    AdaptiveBatchTimeout timeout(2000ms);
+    const auto start = AdaptiveBatchTimeout::Clock::now();
+    timeout.chunk_added(start);
+    timeout.chunk_added(start + 5ms);
+    timeout.batch_called(start + 10ms, start + 30ms);
+    // Calling an empty batch isn't recorded.
+    timeout.batch_called(start + 40ms, start + 50ms);
+
+    REQUIRE(timeout.batch_latencies().count() == 1);
+    CHECK(timeout.batch_latencies().quantile(0.5f) == Approx(30.f).epsilon(0.05));
+}
+
+TEST_CASE("LatencyHistogram: Quantiles are kept in constant space", TEST_GROUP) {
+    dorado::LatencyHistogram histogram;
+    CHECK(histogram.quantile(0.5f) == 0.f);
+    for (int i = 1; i <= 1000; ++i) {
+        histogram.add(static_cast<float>(i));
+    }
+    dorado::LatencyHistogram merged;
+    merged.add(0.1f);
+    merged.add(1e9f);
+    merged.merge(histogram);
+
+    CHECK(merged.count() == 1002);
+    CHECK(merged.quantile(0.5f) == Approx(500.f).epsilon(0.05));
+    CHECK(merged.quantile(0.99f) == Approx(990.f).epsilon(0.05));
+    CHECK(merged.quantile(0.f) < dorado::LatencyHistogram::kMinLatencyMs * 1.1f);
+    // Anything past the last bucket is counted in it.
+    CHECK(merged.quantile(1.f) > 1e7f);
+}
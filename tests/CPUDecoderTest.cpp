@@ -0,0 +1,70 @@
+#include "decode/CPUDecoder.h"
+
+#include <catch2/catch.hpp>
+#include <torch/torch.h>
+
+#include <thread>
+#include <vector>
+
+#define CUT_TAG "[CPUDecoder]"
+
+namespace {
+
+void check_same_chunks(const std::vector<dorado::DecodedChunk>& actual,
+                       const std::vector<dorado::DecodedChunk>& expected) {
+    REQUIRE(actual.size() == expected.size());
+    for (size_t i = 0; i < actual.size(); ++i) {
+        CAPTURE(i);
+        CHECK(actual[i].sequence == expected[i].sequence);
+        CHECK(actual[i].qstring == expected[i].qstring);
+        CHECK(actual[i].moves == expected[i].moves);
+    }
+}
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": chunks decode the same whatever else is in the batch", CUT_TAG) {
+    torch::manual_seed(42);
+    const int num_chunks = 7;
+    // [T, N, C] at state_len 4.
+    const auto scores = torch::randn({200, num_chunks, 1024}) * 3;
+
+    dorado::CPUDecoder decoder;
+    const dorado::DecoderOptions options;
+    std::vector<dorado::DecodedChunk> expected;
+    for (int i = 0; i < num_chunks; ++i) {
+        using Slice = torch::indexing::Slice;
+        auto result = decoder.beam_search(scores.index({Slice(), Slice(i, i + 1)}), 1, options);
+        REQUIRE(result.size() == 1);
+        expected.push_back(std::move(result[0]));
+    }
+
+    check_same_chunks(decoder.beam_search(scores, num_chunks, options), expected);
+
+    // Runners share the decode threads, so several may decode at once.
+    std::vector<std::vector<dorado::DecodedChunk>> results(3);
+    std::vector<std::thread> threads;
+    for (auto& result : results) {
+        threads.emplace_back([&] {
+            dorado::CPUDecoder runner_decoder;
+            result = runner_decoder.beam_search(scores, num_chunks, options);
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (const auto& result : results) {
+        check_same_chunks(result, expected);
+    }
+}
+
+TEST_CASE(CUT_TAG ": reduced precision scores decode as their float values", CUT_TAG) {
+    torch::manual_seed(42);
+    const int num_chunks = 3;
+    const auto scores_bf16 = (torch::randn({200, num_chunks, 1024}) * 3).to(torch::kBFloat16);
+
+    dorado::CPUDecoder decoder;
+    const dorado::DecoderOptions options;
+    check_same_chunks(decoder.beam_search(scores_bf16, num_chunks, options),
+                      decoder.beam_search(scores_bf16.to(torch::kF32), num_chunks, options));
+}
@@ -0,0 +1,90 @@
+#include "read_pipeline/CascadeRouter.h"
+
+#include "MessageSinkUtils.h"
+
+#include <catch2/catch.hpp>
+#include <torch/torch.h>
+
+#include <string>
+#include <unordered_set>
+
+#define TEST_GROUP "[read_pipeline][CascadeRouter]"
+
+using dorado::CascadePolicy;
+using dorado::CascadeRouter;
+using dorado::Message;
+using dorado::Read;
+
+namespace {
+
+// A called read of num_bases, each of Q score q.
+std::shared_ptr<Read> make_read(const std::string& read_id, size_t num_bases, int q) {
+    auto read = std::make_shared<Read>();
+    read->read_id = read_id;
+    read->seq = std::string(num_bases, 'A');
+    read->qstring = std::string(num_bases, char('!' + q));
+    read->raw_data = torch::zeros({int64_t(num_bases) * 10}, torch::kFloat16);
+    return read;
+}
+
+// Uses none of the fields the basecaller may free.
+class SinkUsingNoFields : public MessageSinkToVector<std::shared_ptr<Read>> {
+public:
+    using MessageSinkToVector::MessageSinkToVector;
+    uint32_t read_fields_used() const override { return 0; }
+};
+
+}  // namespace
+
+TEST_CASE("CascadeRouter: Reads the policy picks are re-called, without their calls",
+          TEST_GROUP) {
+    MessageSinkToVector<std::shared_ptr<Read>> sink(100);
+    MessageSinkToVector<std::shared_ptr<Read>> recall_sink(100);
+
+    CascadePolicy policy;
+    policy.max_qscore = 10.f;
+    policy.min_length = 100;
+    policy.read_list = dorado::utils::ReadIdSet(std::unordered_set<std::string>{"listed"});
+    {
+        CascadeRouter router(sink, recall_sink, policy);
+        router.push_message(make_read("long_low_q", 200, 7));
+        std::vector<Message> batch;
+        batch.push_back(make_read("long_high_q", 200, 20));
+        batch.push_back(make_read("short_low_q", 50, 7));
+        batch.push_back(make_read("listed", 50, 20));
+        router.push_messages(std::move(batch));
+        CHECK(router.num_reads_recalled() == 2);
+    }
+
+    const auto reads = sink.get_messages();
+    const auto recalled_reads = recall_sink.get_messages();
+    REQUIRE(reads.size() == 2);
+    CHECK(reads[0]->read_id == "long_high_q");
+    CHECK(reads[1]->read_id == "short_low_q");
+    CHECK(!reads[0]->seq.empty());
+    REQUIRE(recalled_reads.size() == 2);
+    CHECK(recalled_reads[0]->read_id == "long_low_q");
+    CHECK(recalled_reads[1]->read_id == "listed");
+    for (const auto& read : recalled_reads) {
+        CHECK(read->seq.empty());
+        CHECK(read->qstring.empty());
+        CHECK(read->raw_data.defined());
+    }
+}
+
+TEST_CASE("CascadeRouter: Reads passed on keep only what the sink uses", TEST_GROUP) {
+    SinkUsingNoFields sink(100);
+    MessageSinkToVector<std::shared_ptr<Read>> recall_sink(100);
+    CascadePolicy policy;
+    policy.max_qscore = 10.f;
+    {
+        CascadeRouter router(sink, recall_sink, policy);
+        // The recalled reads' signal is kept whatever the sink uses.
+        CHECK(router.read_fields_used() & dorado::ReadFields::RAW_DATA);
+        router.push_message(make_read("high_q", 100, 20));
+    }
+    const auto reads = sink.get_messages();
+    REQUIRE(reads.size() == 1);
+    CHECK(!reads[0]->raw_data.defined());
+    CHECK(reads[0]->raw_data_size() == 1000);
+}
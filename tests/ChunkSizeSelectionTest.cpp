@@ -0,0 +1,70 @@
+#include "utils/chunk_size_selection.h"
+
+#include <catch2/catch.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#define CUT_TAG "[chunk_size_selection]"
+
+using dorado::utils::called_samples;
+using dorado::utils::select_chunk_size;
+
+TEST_CASE(CUT_TAG ": called_samples counts padding and overlap", CUT_TAG) {
+    const std::vector<size_t> chunk_sizes{10000};
+    // Short reads are padded out to a chunk.
+    CHECK(called_samples(1, chunk_sizes, 500) == 10000);
+    CHECK(called_samples(10000, chunk_sizes, 500) == 10000);
+    // Chunks are 9500 apart, and the last covers what's left.
+    CHECK(called_samples(10001, chunk_sizes, 500) == 20000);
+    CHECK(called_samples(19500, chunk_sizes, 500) == 20000);
+    CHECK(called_samples(19501, chunk_sizes, 500) == 30000);
+    CHECK(called_samples(1000000, chunk_sizes, 500) == 106 * 10000);
+
+    // The ends of reads go to the smallest chunk size which fits them.
+    const std::vector<size_t> bucketed{2000, 5000, 10000};
+    CHECK(called_samples(1500, bucketed, 500) == 2000);
+    CHECK(called_samples(4000, bucketed, 500) == 5000);
+    CHECK(called_samples(11000, bucketed, 500) == 12000);
+}
+
+TEST_CASE(CUT_TAG ": called_samples matches the chunks chunk_read makes", CUT_TAG) {
+    const std::vector<size_t> chunk_sizes{3000, 6000};
+    const size_t overlap = 500;
+    const size_t step = chunk_sizes.back() - overlap;
+    for (uint64_t num_samples = 6001; num_samples < 40000; num_samples += 777) {
+        // As chunk_read() lays them out.
+        uint64_t offset = 0;
+        uint64_t samples = chunk_sizes.back();
+        while (offset + step + chunk_sizes.back() < num_samples) {
+            offset += step;
+            samples += chunk_sizes.back();
+        }
+        const auto rest = num_samples - (offset + step);
+        samples += rest <= chunk_sizes.front() ? chunk_sizes.front() : chunk_sizes.back();
+        CHECK(called_samples(num_samples, chunk_sizes, overlap) == samples);
+    }
+}
+
+TEST_CASE(CUT_TAG ": chunk_size_candidates leave out chunks too small to overlap", CUT_TAG) {
+    CHECK(dorado::utils::chunk_size_candidates(10000, 500, 2000) ==
+          std::vector<size_t>{2000, 4000, 6000, 8000, 10000});
+    CHECK(dorado::utils::chunk_size_candidates(10000, 1500, 2000) ==
+          std::vector<size_t>{4000, 6000, 8000, 10000});
+    CHECK(dorado::utils::chunk_size_candidates(900, 500, 1000) == std::vector<size_t>{900});
+}
+
+TEST_CASE(CUT_TAG ": select_chunk_size fits the read lengths", CUT_TAG) {
+    const auto candidates = dorado::utils::chunk_size_candidates(10000, 500, 1000);
+    // Long reads are called in the fewest samples with the largest chunks.
+    CHECK(select_chunk_size({200000, 500000, 80000}, candidates, {}, 500) == 10000);
+    // Amplicons of about 3000 samples are padded least by chunks just big enough for them.
+    CHECK(select_chunk_size({2800, 2900, 3000, 2950}, candidates, {}, 500) == 3000);
+    // Chunk buckets already take the short reads, so the largest size is kept for the long.
+    CHECK(select_chunk_size({2800, 2900, 3000, 2950, 400000}, candidates, {3000}, 500) == 10000);
+    // Without a sample, it's the largest.
+    CHECK(select_chunk_size({}, candidates, {}, 500) == 10000);
+    // A saving too small to be worth more chunks isn't taken.
+    CHECK(select_chunk_size({9900}, {9900, 10000}, {}, 500) == 10000);
+    CHECK(select_chunk_size({9900}, {9900, 10000}, {}, 500, 0.f) == 9900);
+}
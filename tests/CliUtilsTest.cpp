@@ -2,6 +2,8 @@
 
 #include <catch2/catch.hpp>
 
+#include <filesystem>
+
 #define TEST_GROUP "[cli_utils]"
 
 using namespace dorado::utils;
@@ -38,3 +40,55 @@ TEST_CASE("CliUtils: Check number string to unsigned long conversion", TEST_GROU
     SECTION("convert unexpected size character") { CHECK_THROWS(parse_string_to_size("5L")); }
     SECTION("convert not a number") { CHECK_THROWS(parse_string_to_size("abcd")); }
 }
+
+TEST_CASE("CliUtils: Parse channel lists", TEST_GROUP) {
+    using Channels = std::unordered_set<int32_t>;
+    SECTION("empty list") { CHECK(parse_channel_list("").empty()); }
+    SECTION("single channels") { CHECK(parse_channel_list("3,100") == Channels{3, 100}); }
+    SECTION("ranges") { CHECK(parse_channel_list("1-3,5,7-7") == Channels{1, 2, 3, 5, 7}); }
+    SECTION("not a number") { CHECK_THROWS(parse_channel_list("1,a")); }
+    SECTION("trailing characters") { CHECK_THROWS(parse_channel_list("1-3x")); }
+    SECTION("backwards range") { CHECK_THROWS(parse_channel_list("5-1")); }
+    SECTION("no channel 0") { CHECK_THROWS(parse_channel_list("0-3")); }
+}
+
+TEST_CASE("CliUtils: Split CPU runners from a device string", TEST_GROUP) {
+    using dorado::utils::split_cpu_from_device;
+    using Split = std::pair<std::string, bool>;
+    CHECK(split_cpu_from_device("cuda:all,cpu") == Split{"cuda:all", true});
+    CHECK(split_cpu_from_device("cuda:0,1,cpu") == Split{"cuda:0,1", true});
+    CHECK(split_cpu_from_device("metal,cpu") == Split{"metal", true});
+    CHECK(split_cpu_from_device("cuda:0,1") == Split{"cuda:0,1", false});
+    CHECK(split_cpu_from_device("cpu") == Split{"cpu", false});
+    CHECK(split_cpu_from_device(",cpu") == Split{",cpu", false});
+}
+
+TEST_CASE("CliUtils: Resolve paths within a root directory", TEST_GROUP) {
+    namespace fs = std::filesystem;
+    const auto root = fs::temp_directory_path() / "cli_utils_resolve_root";
+    const auto outside = fs::temp_directory_path() / "cli_utils_resolve_outside";
+    fs::remove_all(root);
+    fs::remove_all(outside);
+    fs::create_directories(root / "run1");
+    fs::create_directories(outside);
+    const auto canonical_root = fs::canonical(root);
+
+    SECTION("relative path") {
+        CHECK(resolve_path_within(root, "run1") == canonical_root / "run1");
+    }
+    SECTION("absolute path") {
+        CHECK(resolve_path_within(root, (root / "run1").string()) == canonical_root / "run1");
+    }
+    SECTION("the root itself") { CHECK(resolve_path_within(root, "") == canonical_root); }
+    SECTION("missing path") { CHECK_FALSE(resolve_path_within(root, "run2").has_value()); }
+    SECTION("path outside the root") {
+        CHECK_FALSE(resolve_path_within(root, outside.string()).has_value());
+        CHECK_FALSE(resolve_path_within(root, "../cli_utils_resolve_outside").has_value());
+    }
+#ifndef _WIN32
+    SECTION("symbolic link out of the root") {
+        fs::create_directory_symlink(outside, root / "link");
+        CHECK_FALSE(resolve_path_within(root, "link").has_value());
+    }
+#endif
+}
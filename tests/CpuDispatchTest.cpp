@@ -0,0 +1,98 @@
+#include "utils/cpu_dispatch.h"
+
+#include <catch2/catch.hpp>
+
+#include <stdexcept>
+
+#define CUT_TAG "[CpuDispatch]"
+
+using dorado::utils::CpuDispatch;
+using dorado::utils::CpuIsa;
+
+namespace {
+
+int kernel_generic(int x) { return x; }
+int kernel_avx2(int x) { return x + 1; }
+int kernel_avx512(int x) { return x + 2; }
+int kernel_neon(int x) { return x + 3; }
+
+// Restores the ISA kernels were limited to before the test.
+struct CpuIsaGuard {
+    const CpuIsa isa = dorado::utils::cpu_isa();
+    ~CpuIsaGuard() { dorado::utils::set_cpu_isa(isa); }
+};
+
+int expected_best(int x) {
+    const auto& features = dorado::utils::cpu_features();
+    if (features.avx512) {
+        return kernel_avx512(x);
+    }
+    if (features.avx2) {
+        return kernel_avx2(x);
+    }
+    if (features.neon) {
+        return kernel_neon(x);
+    }
+    return kernel_generic(x);
+}
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": ISA names round trip", CUT_TAG) {
+    for (auto isa : {CpuIsa::GENERIC, CpuIsa::AVX2, CpuIsa::AVX512, CpuIsa::NEON, CpuIsa::SVE}) {
+        CHECK(dorado::utils::parse_cpu_isa(dorado::utils::to_string(isa)) == isa);
+    }
+    CHECK_THROWS_AS(dorado::utils::parse_cpu_isa("avx3"), std::runtime_error);
+}
+
+TEST_CASE(CUT_TAG ": the best supported kernel is called", CUT_TAG) {
+    CpuIsaGuard guard;
+    const CpuDispatch<decltype(kernel_generic)> kernel(
+            kernel_generic, {{CpuIsa::AVX2, kernel_avx2},
+                             {CpuIsa::AVX512, kernel_avx512},
+                             {CpuIsa::NEON, kernel_neon}});
+    CHECK(dorado::utils::cpu_supports(CpuIsa::GENERIC));
+    CHECK(kernel(10) == expected_best(10));
+}
+
+TEST_CASE(CUT_TAG ": set_cpu_isa limits the kernels called", CUT_TAG) {
+    CpuIsaGuard guard;
+    const CpuDispatch<decltype(kernel_generic)> kernel(
+            kernel_generic, {{CpuIsa::AVX2, kernel_avx2}, {CpuIsa::AVX512, kernel_avx512}});
+    // Resolve once first, so that the ISA changing has to be noticed.
+    kernel(10);
+
+    dorado::utils::set_cpu_isa(CpuIsa::GENERIC);
+    CHECK(dorado::utils::cpu_isa() == CpuIsa::GENERIC);
+    CHECK(kernel(10) == 10);
+
+    if (dorado::utils::cpu_supports(CpuIsa::AVX2)) {
+        dorado::utils::set_cpu_isa(CpuIsa::AVX2);
+        CHECK(kernel(10) == 11);
+    } else {
+        CHECK_THROWS_AS(dorado::utils::set_cpu_isa(CpuIsa::AVX2), std::runtime_error);
+        CHECK(kernel(10) == 10);
+    }
+}
+
+TEST_CASE(CUT_TAG ": null kernels are skipped", CUT_TAG) {
+    CpuIsaGuard guard;
+    const CpuDispatch<decltype(kernel_generic)> kernel(
+            kernel_generic, {{CpuIsa::AVX2, nullptr}, {CpuIsa::NEON, nullptr}});
+    CHECK(kernel(10) == 10);
+}
+
+namespace {
+
+extern const CpuDispatch<decltype(kernel_generic)> g_kernel;
+// Calls g_kernel before its definition below is reached, as a static initialiser in another
+// translation unit might.
+const int g_kernel_result = g_kernel(5);
+const CpuDispatch<decltype(kernel_generic)> g_kernel(kernel_generic,
+                                                     {{CpuIsa::AVX2, kernel_avx2}});
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": kernels can be called from static initialisers", CUT_TAG) {
+    CHECK((g_kernel_result == kernel_generic(5) || g_kernel_result == kernel_avx2(5)));
+}
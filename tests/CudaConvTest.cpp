@@ -0,0 +1,49 @@
+#include "nn/cuda_conv.h"
+
+#include <ATen/cuda/CUDAContext.h>
+#include <catch2/catch.hpp>
+#include <spdlog/spdlog.h>
+#include <torch/torch.h>
+
+#include <tuple>
+
+#define CUT_TAG "[cuda_conv]"
+#define DEFINE_TEST(name) TEST_CASE(CUT_TAG " " name, CUT_TAG)
+
+namespace {
+
+DEFINE_TEST("conv_swish_f16 matches the unfused layers") {
+    torch::manual_seed(0);
+    if (!torch::hasCUDA()) {
+        spdlog::warn("No Nvidia driver present - Test skipped");
+        return;
+    }
+
+    auto options = torch::TensorOptions().dtype(torch::kFloat16).device(c10::kCUDA);
+    const float max_value = 3.5f;
+    const int batch_size = 3;
+    const int chunk_size = 1001;
+    for (auto [in_size, out_size] : {std::tuple{1, 4}, {4, 16}, {13, 16}}) {
+        CAPTURE(in_size, out_size);
+        REQUIRE(dorado::nn::has_conv_swish_f16(in_size, out_size, 5));
+        // Transposed, as the input needn't be contiguous.
+        auto x = torch::randn({batch_size, chunk_size, in_size}, options).transpose(1, 2);
+        auto weights = torch::randn({out_size, in_size, 5}, options) * 0.5;
+        auto bias = torch::randn({out_size}, options);
+
+        auto y = torch::empty({batch_size, out_size, chunk_size}, options);
+        auto stream = at::cuda::getCurrentCUDAStream().stream();
+        dorado::nn::conv_swish_f16(stream, batch_size, chunk_size, chunk_size, in_size, out_size,
+                                   5, 1, x.stride(0), x.stride(1), x.stride(2), x.data_ptr(),
+                                   weights.data_ptr(), bias.data_ptr(), max_value, y.data_ptr());
+
+        namespace F = torch::nn::functional;
+        auto expected = F::conv1d(x.to(torch::kFloat32), weights.to(torch::kFloat32),
+                                  F::Conv1dFuncOptions().bias(bias.to(torch::kFloat32)).padding(2));
+        expected = F::silu(expected).clamp(c10::nullopt, max_value);
+        REQUIRE(torch::allclose(y.to(torch::kFloat32), expected, 1e-2, 1e-2));
+    }
+    CHECK(!dorado::nn::has_conv_swish_f16(16, 384, 19));
+}
+
+}  // namespace
@@ -0,0 +1,188 @@
+#include "TestUtils.h"
+#include "data_loader/DataLoader.h"
+#include "data_loader/DatasetIndex.h"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <set>
+#include <vector>
+
+#define TEST_GROUP "[data_loader][DatasetIndex]"
+
+namespace fs = std::filesystem;
+using dorado::DatasetIndex;
+using dorado::IndexedFile;
+
+namespace {
+
+// Copies the test POD5 files into a fresh directory, so the index file is written there.
+fs::path make_input_dir(const std::string& name) {
+    const auto input_dir = fs::temp_directory_path() / name;
+    fs::remove_all(input_dir);
+    fs::create_directories(input_dir / "subfolder");
+    fs::copy_file(fs::path(get_data_dir("multi_read_pod5")) / "filtered.pod5",
+                  input_dir / "filtered.pod5");
+    fs::copy_file(fs::path(get_pod5_data_dir()) / "single_na24385.pod5",
+                  input_dir / "subfolder" / "single_na24385.pod5");
+    return input_dir;
+}
+
+// The indexes cached in memory keep their index files open, so are dropped first.
+void remove_input_dir(const fs::path& input_dir) {
+    DatasetIndex::clear_memory_cache();
+    fs::remove_all(input_dir);
+}
+
+}  // namespace
+
+TEST_CASE("DatasetIndex: Metadata matches the input files", TEST_GROUP) {
+    const auto input_dir = make_input_dir("dataset_index_metadata");
+
+    const auto index = DatasetIndex::get(input_dir.string(), true);
+    REQUIRE(index->files().size() == 2);
+    CHECK(fs::exists(input_dir / DatasetIndex::kIndexFileName));
+
+    uint64_t num_reads = 0;
+    for (size_t i = 0; i < index->files().size(); ++i) {
+        const auto& file = index->files()[i];
+        CHECK(file.format == IndexedFile::Format::POD5);
+        CHECK(file.sample_rate == 4000);
+        CHECK(!file.runs.empty());
+
+        // The read table comes back from the index file.
+        const auto table = index->read_table(i);
+        CHECK(table.read_ids.size() == file.num_reads);
+        CHECK(table.channels.size() == file.num_reads);
+        num_reads += file.num_reads;
+    }
+    CHECK(dorado::DataLoader::get_num_reads(input_dir.string(), std::nullopt, true) ==
+          num_reads);
+
+    remove_input_dir(input_dir);
+}
+
+TEST_CASE("DatasetIndex: Non-recursive traversal only sees the top level", TEST_GROUP) {
+    const auto input_dir = make_input_dir("dataset_index_non_recursive");
+
+    const auto index = DatasetIndex::get(input_dir.string(), false);
+    REQUIRE(index->files().size() == 1);
+    CHECK(index->files().front().path.filename() == "filtered.pod5");
+
+    remove_input_dir(input_dir);
+}
+
+TEST_CASE("DatasetIndex: Corrupt index files are rebuilt", TEST_GROUP) {
+    const auto input_dir = make_input_dir("dataset_index_corrupt");
+    {
+        std::ofstream index_file(input_dir / DatasetIndex::kIndexFileName, std::ios::binary);
+        index_file << "not an index";
+    }
+
+    const auto index = DatasetIndex::get(input_dir.string(), true);
+    REQUIRE(index->files().size() == 2);
+    CHECK(dorado::DataLoader::get_sample_rate(input_dir.string(), true) == 4000);
+    CHECK(fs::file_size(input_dir / DatasetIndex::kIndexFileName) > 12);
+
+    remove_input_dir(input_dir);
+}
+
+TEST_CASE("DatasetIndex: Shards split the files between them", TEST_GROUP) {
+    const auto input_dir = make_input_dir("dataset_index_shards");
+    const auto all_files = DatasetIndex::get(input_dir.string(), true)->files();
+    const int all_reads = dorado::DataLoader::get_num_reads(input_dir.string(), std::nullopt, true);
+
+    const size_t num_shards = GENERATE(1, 2, 3);
+    CAPTURE(num_shards);
+    std::multiset<fs::path> sharded_files;
+    int sharded_reads = 0;
+    for (size_t i = 0; i < num_shards; ++i) {
+        const dorado::DatasetShard shard{i, num_shards};
+        for (const auto& file : DatasetIndex::get(input_dir.string(), true, shard)->files()) {
+            CHECK(shard.contains(file.path.lexically_relative(input_dir).generic_string()));
+            sharded_files.insert(file.path);
+        }
+        sharded_reads +=
+                dorado::DataLoader::get_num_reads(input_dir.string(), std::nullopt, true, shard);
+    }
+    // Every file is in exactly one shard.
+    std::multiset<fs::path> expected_files;
+    for (const auto& file : all_files) {
+        expected_files.insert(file.path);
+    }
+    CHECK(sharded_files == expected_files);
+    CHECK(sharded_reads == all_reads);
+
+    remove_input_dir(input_dir);
+}
+
+TEST_CASE("DatasetIndex: Shards indexed in turn keep each other's records", TEST_GROUP) {
+    const auto input_dir = make_input_dir("dataset_index_shard_merge");
+    DatasetIndex::clear_memory_cache();
+
+    std::vector<std::shared_ptr<const DatasetIndex>> indexes;
+    for (size_t i = 0; i < 2; ++i) {
+        indexes.push_back(DatasetIndex::get(input_dir.string(), true, {i, 2}));
+    }
+    // The first shard's tables are still found after the second has rewritten the index.
+    for (const auto& index : indexes) {
+        for (size_t i = 0; i < index->files().size(); ++i) {
+            CHECK(index->read_table(i).read_ids.size() == index->files()[i].num_reads);
+        }
+    }
+
+    // The index on disk lists every file, whichever shard it's in.
+    std::ifstream index_file(input_dir / DatasetIndex::kIndexFileName, std::ios::binary);
+    index_file.seekg(12);
+    uint64_t num_files = 0;
+    index_file.read(reinterpret_cast<char*>(&num_files), sizeof(num_files));
+    CHECK(num_files == 2);
+
+    indexes.clear();
+    remove_input_dir(input_dir);
+}
+
+TEST_CASE("DatasetIndex: An index rewritten for a new file is used by the next run", TEST_GROUP) {
+    const auto input_dir = make_input_dir("dataset_index_new_file");
+    const auto index_path = input_dir / DatasetIndex::kIndexFileName;
+    DatasetIndex::get(input_dir.string(), true);
+
+    fs::copy_file(fs::path(get_pod5_data_dir()) / "single_na24385.pod5", input_dir / "new.pod5");
+    DatasetIndex::clear_memory_cache();
+    REQUIRE(DatasetIndex::get(input_dir.string(), true)->files().size() == 3);
+    {
+        std::ifstream index_file(index_path, std::ios::binary);
+        index_file.seekg(12);
+        uint64_t num_files = 0;
+        index_file.read(reinterpret_cast<char*>(&num_files), sizeof(num_files));
+        CHECK(num_files == 3);
+    }
+
+    // Nothing has changed since, so the index is read and left as it is, not rebuilt.
+    const auto old_time = fs::last_write_time(index_path) - std::chrono::hours(1);
+    fs::last_write_time(index_path, old_time);
+    DatasetIndex::clear_memory_cache();
+    const auto index = DatasetIndex::get(input_dir.string(), true);
+    REQUIRE(index->files().size() == 3);
+    CHECK(fs::last_write_time(index_path) == old_time);
+    for (size_t i = 0; i < index->files().size(); ++i) {
+        CHECK(index->read_table(i).read_ids.size() == index->files()[i].num_reads);
+    }
+
+    remove_input_dir(input_dir);
+}
+
+TEST_CASE("DatasetIndex: Shards are parsed from i/N", TEST_GROUP) {
+    const auto shard = dorado::parse_dataset_shard("2/5");
+    CHECK(shard.index == 2);
+    CHECK(shard.count == 5);
+    CHECK_THROWS(dorado::parse_dataset_shard("5/5"));
+    CHECK_THROWS(dorado::parse_dataset_shard("0/0"));
+    CHECK_THROWS(dorado::parse_dataset_shard("1"));
+    CHECK_THROWS(dorado::parse_dataset_shard("1/4x"));
+    CHECK_THROWS(dorado::parse_dataset_shard("a/4"));
+}
@@ -0,0 +1,110 @@
+#include "data_loader/DirectoryWatcher.h"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+
+#define TEST_GROUP "[data_loader][DirectoryWatcher]"
+
+namespace fs = std::filesystem;
+using namespace std::chrono_literals;
+using dorado::DirectoryWatcher;
+
+namespace {
+
+fs::path make_watch_dir(const std::string& name) {
+    const auto dir = fs::temp_directory_path() / name;
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    return dir;
+}
+
+void write_file(const fs::path& path) { std::ofstream(path) << "data"; }
+
+}  // namespace
+
+TEST_CASE("DirectoryWatcher: Reports new files", TEST_GROUP) {
+    const auto dir = make_watch_dir("directory_watcher_new_files");
+    write_file(dir / "existing.pod5");
+
+    DirectoryWatcher watcher(dir.string(), false);
+    CHECK_FALSE(watcher.next_file(10ms).has_value());
+
+    write_file(dir / "new.pod5");
+    auto file = watcher.next_file(5s);
+    REQUIRE(file.has_value());
+    CHECK(file->filename() == "new.pod5");
+
+    CHECK_FALSE(watcher.next_file(10ms).has_value());
+    fs::remove_all(dir);
+}
+
+TEST_CASE("DirectoryWatcher: Reports files moved in", TEST_GROUP) {
+    const auto dir = make_watch_dir("directory_watcher_moved_files");
+    const auto staging = make_watch_dir("directory_watcher_moved_files_staging");
+    write_file(staging / "moved.pod5");
+
+    DirectoryWatcher watcher(dir.string(), false);
+    fs::rename(staging / "moved.pod5", dir / "moved.pod5");
+    auto file = watcher.next_file(5s);
+    REQUIRE(file.has_value());
+    CHECK(file->filename() == "moved.pod5");
+
+    fs::remove_all(dir);
+    fs::remove_all(staging);
+}
+
+TEST_CASE("DirectoryWatcher: Recursive watches follow new subdirectories", TEST_GROUP) {
+    const auto dir = make_watch_dir("directory_watcher_recursive");
+
+    DirectoryWatcher watcher(dir.string(), true);
+    fs::create_directories(dir / "pod5_pass");
+    write_file(dir / "pod5_pass" / "nested.pod5");
+
+    auto file = watcher.next_file(5s);
+    REQUIRE(file.has_value());
+    CHECK(file->filename() == "nested.pod5");
+
+    fs::remove_all(dir);
+}
+
+TEST_CASE("DirectoryWatcher: Existing files still being written are held back", TEST_GROUP) {
+    const auto dir = make_watch_dir("directory_watcher_existing");
+    write_file(dir / "finished.pod5");
+    fs::last_write_time(dir / "finished.pod5", fs::file_time_type::clock::now() - 1h);
+    std::ofstream writing(dir / "writing.pod5");
+    writing << "data" << std::flush;
+
+    DirectoryWatcher watcher(dir.string(), false);
+    const auto existing = watcher.existing_files(1h);
+    REQUIRE(existing.size() == 1);
+    CHECK(existing.front().filename() == "finished.pod5");
+
+    // Appended after the watch started, so only reported once it's closed.
+    writing << "more data" << std::flush;
+    writing.close();
+    auto file = watcher.next_file(5s);
+    REQUIRE(file.has_value());
+    CHECK(file->filename() == "writing.pod5");
+    CHECK(fs::file_size(*file) == 13);
+
+    CHECK_FALSE(watcher.next_file(10ms).has_value());
+    fs::remove_all(dir);
+}
+
+TEST_CASE("DirectoryWatcher: Held files are reported once they settle", TEST_GROUP) {
+    const auto dir = make_watch_dir("directory_watcher_settle");
+    std::ofstream writing(dir / "abandoned.pod5");
+    writing << "data" << std::flush;
+
+    DirectoryWatcher watcher(dir.string(), false);
+    CHECK(watcher.existing_files(100ms).empty());
+
+    // Never closed, so it's reported once it has gone unmodified for long enough.
+    auto file = watcher.next_file(5s);
+    REQUIRE(file.has_value());
+    CHECK(file->filename() == "abandoned.pod5");
+    fs::remove_all(dir);
+}
@@ -40,7 +40,7 @@ TEST_CASE("4 subread splitting test", TEST_GROUP) {
 
     read->seq = ReadFileIntoString(DataPath("seq"));
     read->qstring = ReadFileIntoString(DataPath("qstring"));
-    read->moves = ReadFileIntoVector(DataPath("moves"));
+    read->moves = dorado::utils::MoveTable(ReadFileIntoVector(DataPath("moves")));
     torch::load(read->raw_data, DataPath("raw.tensor").string());
     read->raw_data = read->raw_data.to(torch::kFloat16);
 
@@ -70,4 +70,12 @@ TEST_CASE("4 subread splitting test", TEST_GROUP) {
         names.insert(r->read_id);
     }
     REQUIRE(names.size() == 4);
+
+    // The subreads' signal is a view of the read's, and each has just its own part of the
+    // basecall.
+    for (auto &r : split_res) {
+        CHECK(r->raw_data.storage().is_alias_of(read->raw_data.storage()));
+        CHECK(r->qstring.size() == r->seq.size());
+        CHECK(r->moves.count() == r->seq.size());
+    }
 }
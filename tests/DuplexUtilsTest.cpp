@@ -0,0 +1,48 @@
+#include "utils/duplex_utils.h"
+
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#define CUT_TAG "[DuplexUtils]"
+
+namespace {
+
+// The min pool of each window in turn, clipped to the ends.
+std::vector<uint8_t> naive_min_pool(const std::vector<uint8_t>& scores, int pool_window) {
+    std::vector<uint8_t> pooled(scores.size());
+    const int num_scores = static_cast<int>(scores.size());
+    for (int i = 0; i < num_scores; ++i) {
+        const int begin = std::max(0, i - pool_window / 2);
+        const int end = std::min(num_scores, i - pool_window / 2 + pool_window);
+        pooled[i] = *std::min_element(scores.begin() + begin, scores.begin() + end);
+    }
+    return pooled;
+}
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": preprocess_quality_scores min pools the scores", CUT_TAG) {
+    std::vector<uint8_t> scores{40, 50, 35, 60, 60, 60, 60, 45, 70, 70};
+    dorado::utils::preprocess_quality_scores(scores);
+    const std::vector<uint8_t> expected{35, 35, 35, 35, 35, 45, 45, 45, 45, 45};
+    CHECK(scores == expected);
+}
+
+TEST_CASE(CUT_TAG ": preprocess_quality_scores matches a naive min pool", CUT_TAG) {
+    std::mt19937 rng(42);
+    const int pool_window = GENERATE(1, 3, 5, 9);
+    const size_t num_scores = GENERATE(0, 1, 4, 1000);
+    CAPTURE(pool_window, num_scores);
+
+    std::vector<uint8_t> scores(num_scores);
+    for (auto& score : scores) {
+        score = static_cast<uint8_t>(33 + rng() % 60);
+    }
+    const auto expected = naive_min_pool(scores, pool_window);
+    dorado::utils::preprocess_quality_scores(scores, pool_window);
+    CHECK(scores == expected);
+}
@@ -0,0 +1,71 @@
+#include "MessageSinkUtils.h"
+#include "read_pipeline/FakeDataLoader.h"
+#include "read_pipeline/ReadPipeline.h"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#define CUT_TAG "[FakeDataLoader]"
+
+using dorado::utils::TraceRead;
+
+TEST_CASE(CUT_TAG ": a replayed trace gives reads of its shape", CUT_TAG) {
+    // The last read is longer than the pool of noise signals are cut from, so takes several cuts.
+    const std::vector<TraceRead> trace{
+            {12, 2, 1.0, 20000},
+            {3, 1, 1.5, 1000},
+            {12, 4, 6.0, 5000000},
+    };
+    MessageSinkToVector<std::shared_ptr<dorado::Read>> sink(10);
+    dorado::FakeReadOptions options;
+    options.sample_rate = 4000;
+    dorado::FakeDataLoader loader(sink, options);
+    loader.replay(trace, 0);
+    sink.terminate();
+
+    const auto reads = sink.get_messages();
+    REQUIRE(reads.size() == trace.size());
+    for (size_t i = 0; i < trace.size(); ++i) {
+        CAPTURE(i);
+        const auto& read = *reads[i];
+        CHECK(read.raw_data.size(0) == int64_t(trace[i].num_samples));
+        CHECK(read.attributes.channel_number == trace[i].channel);
+        CHECK(read.attributes.mux == trace[i].mux);
+        CHECK(read.start_time_ms == uint64_t(trace[i].start_time * 1000));
+        CHECK(read.start_sample == uint64_t(trace[i].start_time * 4000));
+        CHECK(read.end_sample == read.start_sample + trace[i].num_samples);
+        CHECK(read.memory_reservation.bytes() == read.host_memory_bytes());
+        const auto min_sample = read.raw_data.min().item<int16_t>();
+        const auto max_sample = read.raw_data.max().item<int16_t>();
+        CHECK(min_sample >= 0);
+        CHECK(max_sample <= 2047);
+        CHECK(min_sample < max_sample);
+    }
+    // Reads are numbered on each channel.
+    CHECK(reads[0]->attributes.read_number == 0);
+    CHECK(reads[1]->attributes.read_number == 0);
+    CHECK(reads[2]->attributes.read_number == 1);
+    CHECK(reads[0]->read_id != reads[2]->read_id);
+}
+
+TEST_CASE(CUT_TAG ": a trace is replayed at the speed it was run", CUT_TAG) {
+    // The reads finish 0.4s apart in the run, so 0.2s apart at twice its speed.
+    const std::vector<TraceRead> trace{
+            {1, 1, 0.0, 4000},
+            {2, 1, 0.4, 4000},
+    };
+    MessageSinkToVector<std::shared_ptr<dorado::Read>> sink(10);
+    dorado::FakeReadOptions options;
+    options.sample_rate = 4000;
+    dorado::FakeDataLoader loader(sink, options);
+    const auto start = std::chrono::steady_clock::now();
+    loader.replay(trace, 2.0);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    sink.terminate();
+
+    CHECK(elapsed.count() >= 0.2);
+    CHECK(sink.get_messages().size() == trace.size());
+}
@@ -3,8 +3,12 @@
 #include "read_pipeline/ReadPipeline.h"
 
 #include <catch2/catch.hpp>
+#include <hdf5.h>
 
+#include <atomic>
+#include <filesystem>
 #include <memory>
+#include <string>
 
 #define TEST_GROUP "Fast5DataLoaderTest: "
 
@@ -24,6 +28,27 @@ size_t MockSink::get_read_count() {
     return read_count;
 }
 
+// Writes a multi-read FAST5 file to path holding num_reads copies of the read in the
+// single-read fixture, in groups of their own.
+void write_multi_read_fast5(const std::filesystem::path& path, int num_reads) {
+    const auto source_path = std::filesystem::path(get_fast5_data_dir()) / "single_read.fast5";
+    const hid_t source = H5Fopen(source_path.string().c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    REQUIRE(source >= 0);
+    const hid_t destination =
+            H5Fcreate(path.string().c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    REQUIRE(destination >= 0);
+    char group_name[256];
+    REQUIRE(H5Lget_name_by_idx(source, "/", H5_INDEX_NAME, H5_ITER_INC, 0, group_name,
+                               sizeof(group_name), H5P_DEFAULT) > 0);
+    for (int i = 0; i < num_reads; ++i) {
+        const auto copy_name = std::string(group_name) + "_" + std::to_string(i);
+        REQUIRE(H5Ocopy(source, group_name, destination, copy_name.c_str(), H5P_DEFAULT,
+                        H5P_DEFAULT) >= 0);
+    }
+    H5Fclose(destination);
+    H5Fclose(source);
+}
+
 }  // namespace
 
 TEST_CASE(TEST_GROUP "Test loading single-read Fast5 files") {
@@ -88,6 +113,40 @@ TEST_CASE(TEST_GROUP "Test loading single-read Fast5 file, matched read list") {
     REQUIRE(mock_sink.get_read_count() == 1);
 }
 
+TEST_CASE(TEST_GROUP "Test loading multi-read Fast5 file, several worker threads") {
+    const auto data_dir = std::filesystem::temp_directory_path() / "fast5_multi_read";
+    std::filesystem::remove_all(data_dir);
+    std::filesystem::create_directories(data_dir);
+    constexpr int kNumReads = 50;
+    write_multi_read_fast5(data_dir / "multi_read.fast5", kNumReads);
+
+    MockSink mock_sink;
+    dorado::DataLoader loader(mock_sink, "cpu", 4);
+    loader.load_reads(data_dir.string(), false);
+
+    REQUIRE(mock_sink.get_read_count() == kNumReads);
+    std::filesystem::remove_all(data_dir);
+}
+
+TEST_CASE(TEST_GROUP "Short reads are dropped without counting towards max reads") {
+    const auto data_dir = std::filesystem::temp_directory_path() / "fast5_short_reads";
+    std::filesystem::remove_all(data_dir);
+    std::filesystem::create_directories(data_dir);
+    constexpr int kNumReads = 10;
+    write_multi_read_fast5(data_dir / "multi_read.fast5", kNumReads);
+
+    MockSink mock_sink;
+    dorado::DataLoader loader(mock_sink, "cpu", 2, 2);
+    std::atomic<size_t> num_dropped{0};
+    loader.set_min_signal_samples(size_t(1) << 40, [&num_dropped] { ++num_dropped; });
+    loader.load_reads(data_dir.string(), false);
+
+    CHECK(mock_sink.get_read_count() == 0);
+    CHECK(loader.num_short_reads_dropped() == kNumReads);
+    CHECK(num_dropped == kNumReads);
+    std::filesystem::remove_all(data_dir);
+}
+
 TEST_CASE(TEST_GROUP "Test loading sample rate from fast5 returns nullopt") {
     std::string data_path(get_fast5_data_dir());
     REQUIRE(dorado::DataLoader::get_sample_rate(data_path) == 6024);
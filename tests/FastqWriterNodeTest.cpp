@@ -0,0 +1,78 @@
+#include "read_pipeline/FastqWriterNode.h"
+
+#include <catch2/catch.hpp>
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+
+#define TEST_GROUP "[read_pipeline][FastqWriterNode]"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+std::shared_ptr<dorado::Read> make_read(const std::string& read_id) {
+    auto read = std::make_shared<dorado::Read>();
+    read->read_id = read_id;
+    read->seq = "ACGTACGT";
+    read->qstring = "////////";
+    read->attributes.channel_number = 5;
+    read->attributes.mux = 2;
+    read->attributes.read_number = 18501;
+    read->attributes.start_time = "2017-04-29T09:10:04Z";
+    read->run_id = "xyz";
+    read->model_name = "test_model";
+    read->is_duplex = false;
+    return read;
+}
+
+}  // namespace
+
+TEST_CASE("FastqWriterNode: formats reads with their tags on the header line", TEST_GROUP) {
+    std::string buffer;
+    dorado::FastqWriterNode::format_read(*make_read("read1"), buffer);
+    CHECK(buffer ==
+          "@read1\tqs:i:14\tch:i:5\tmx:i:2\trn:i:18501\tst:Z:2017-04-29T09:10:04Z"
+          "\tRG:Z:xyz_test_model\tdx:i:0\nACGTACGT\n+\n////////\n");
+
+    auto duplex_read = make_read("read1;read2");
+    duplex_read->is_duplex = true;
+    buffer.clear();
+    dorado::FastqWriterNode::format_read(*duplex_read, buffer);
+    CHECK(buffer == "@read1;read2\tqs:i:14\tdx:i:1\nACGTACGT\n+\n////////\n");
+}
+
+TEST_CASE("FastqWriterNode: writes every read", TEST_GROUP) {
+    const auto path = fs::temp_directory_path() / "fastq_writer_test.fastq";
+    const int num_reads = 1000;
+    {
+        FILE* file = std::fopen(path.string().c_str(), "wb");
+        REQUIRE(file);
+        {
+            dorado::FastqWriterNode writer(fileno(file), false, false, 4, 0, 0);
+            for (int i = 0; i < num_reads; ++i) {
+                writer.push_message(make_read("read" + std::to_string(i)));
+            }
+            writer.terminate();
+            writer.join();
+            CHECK(writer.num_reads_written() == num_reads);
+        }
+        std::fclose(file);
+    }
+
+    std::ifstream fastq(path);
+    std::string line;
+    int num_lines = 0, num_headers = 0;
+    while (std::getline(fastq, line)) {
+        if (num_lines++ % 4 == 0) {
+            CHECK(line.rfind("@read", 0) == 0);
+            ++num_headers;
+        }
+    }
+    CHECK(num_lines == 4 * num_reads);
+    CHECK(num_headers == num_reads);
+    fs::remove(path);
+}
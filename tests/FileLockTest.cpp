@@ -0,0 +1,28 @@
+#include "utils/FileLock.h"
+
+#include <catch2/catch.hpp>
+
+#include <filesystem>
+
+#define CUT_TAG "[FileLock]"
+
+namespace fs = std::filesystem;
+using dorado::utils::FileLock;
+
+TEST_CASE(CUT_TAG ": only one lock holds a file at once", CUT_TAG) {
+    const auto path = fs::temp_directory_path() / "file_lock_test.lock";
+    fs::remove(path);
+    {
+        FileLock lock(path);
+        CHECK(fs::exists(path));
+        CHECK(!FileLock::try_lock(path));
+    }
+    auto lock = FileLock::try_lock(path);
+    CHECK(lock);
+    lock.reset();
+    fs::remove(path);
+}
+
+TEST_CASE(CUT_TAG ": a file which can't be created throws", CUT_TAG) {
+    CHECK_THROWS(FileLock(fs::temp_directory_path() / "no_such_directory" / "file.lock"));
+}
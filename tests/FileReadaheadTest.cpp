@@ -0,0 +1,76 @@
+#include "utils/FileReadahead.h"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define CUT_TAG "[FileReadahead]"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Waits up to a few seconds for the readahead to have asked for bytes.
+bool wait_for_bytes_requested(const dorado::utils::FileReadahead& readahead, uint64_t bytes) {
+    for (int i = 0; i < 500 && readahead.bytes_requested() < bytes; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return readahead.bytes_requested() == bytes;
+}
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": reads files ahead within the budget", CUT_TAG) {
+    const auto dir = fs::temp_directory_path() / "dorado_readahead_test";
+    fs::create_directories(dir);
+    const uint64_t kMiB = 1 << 20;
+    const std::vector<std::string> paths{(dir / "a.pod5").string(), (dir / "b.pod5").string()};
+    const std::vector<uint64_t> sizes{20 * kMiB, 1000};
+    for (size_t i = 0; i < paths.size(); ++i) {
+        std::ofstream(paths[i]).close();
+        fs::resize_file(paths[i], sizes[i]);
+    }
+
+    SECTION("Everything fits") {
+        dorado::utils::FileReadahead readahead(paths, 64 * kMiB, false);
+        CHECK(wait_for_bytes_requested(readahead, sizes[0] + sizes[1]));
+    }
+
+    SECTION("Held back until files are loaded") {
+        dorado::utils::FileReadahead readahead(paths, 8 * kMiB, true);
+        CHECK(wait_for_bytes_requested(readahead, 8 * kMiB));
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        CHECK(readahead.bytes_requested() == 8 * kMiB);
+        // The rest of a file which has been loaded isn't read ahead.
+        readahead.file_loaded(0);
+        CHECK(wait_for_bytes_requested(readahead, 8 * kMiB + sizes[1]));
+        readahead.file_loaded(1);
+    }
+
+    SECTION("A file larger than the budget is read ahead as it's loaded") {
+        dorado::utils::FileReadahead readahead(paths, 8 * kMiB, false);
+        CHECK(wait_for_bytes_requested(readahead, 8 * kMiB));
+        // The loaders have overtaken the readahead, which skips to where they are.
+        readahead.file_progress(0, 1, 2);
+        CHECK(wait_for_bytes_requested(readahead, 16 * kMiB));
+        // 3 MiB of the file is still ahead of them, leaving room for the rest of both files.
+        readahead.file_progress(0, 3, 4);
+        CHECK(wait_for_bytes_requested(readahead, 18 * kMiB + sizes[1]));
+        readahead.file_loaded(0);
+        readahead.file_loaded(1);
+    }
+
+    SECTION("Nothing read ahead without a budget") {
+        dorado::utils::FileReadahead readahead(paths, 0, false);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        CHECK(readahead.bytes_requested() == 0);
+    }
+
+    fs::remove_all(dir);
+}
@@ -0,0 +1,56 @@
+#include "decode/GPUDecoder.h"
+
+#include <catch2/catch.hpp>
+#include <torch/torch.h>
+
+#include <string>
+#include <vector>
+
+#define CUT_TAG "[GPUDecoder]"
+
+using dorado::GPUDecoder;
+
+TEST_CASE(CUT_TAG ": compact rows round trip on the CPU", CUT_TAG) {
+    // Not a multiple of 8, so the last byte of packed moves is partly padding.
+    constexpr int64_t T = 13;
+    const std::vector<std::vector<uint8_t>> moves = {
+            {1, 0, 1, 1, 0, 0, 0, 1, 1, 1, 0, 1, 1},
+            {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+            {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1},
+    };
+    const std::vector<std::string> sequences = {"ACGTTGCAG", "", "TTTGGGCCCAAAC"};
+    // Qscores above 63 are capped.
+    const std::vector<std::string> qstrings = {"!#+5?I+-~", "", "0123456789:;<"};
+    const std::string capped_qstring_0 = std::string("!#+5?I+-") + char(63 + 33);
+
+    const int64_t N = moves.size();
+    auto moves_u8 = torch::zeros({N, T}, torch::kUInt8);
+    auto sequence_u8 = torch::zeros({N, T}, torch::kUInt8);
+    auto qstring_u8 = torch::zeros({N, T}, torch::kUInt8);
+    for (int64_t i = 0; i < N; ++i) {
+        for (int64_t t = 0; t < T; ++t) {
+            moves_u8[i][t] = moves[i][t];
+        }
+        for (size_t b = 0; b < sequences[i].size(); ++b) {
+            sequence_u8[i][b] = uint8_t(sequences[i][b]);
+            qstring_u8[i][b] = uint8_t(qstrings[i][b]);
+        }
+    }
+    const auto move_bit_values = torch::tensor({1, 2, 4, 8, 16, 32, 64, 128}, torch::kUInt8);
+    auto compact = torch::zeros({N, GPUDecoder::compact_chunk_bytes(T)}, torch::kUInt8);
+    // The header, then 2 bytes of moves and a byte per base.
+    CHECK(compact.size(1) == 8 + 2 + T);
+
+    GPUDecoder::compact_rows(moves_u8, sequence_u8, qstring_u8, move_bit_values, compact);
+    GPUDecoder decoder;
+    const auto chunks = decoder.cpu_part(compact);
+
+    REQUIRE(chunks.size() == size_t(N));
+    for (int64_t i = 0; i < N; ++i) {
+        CHECK(chunks[i].moves == moves[i]);
+        CHECK(chunks[i].sequence == sequences[i]);
+    }
+    CHECK(chunks[0].qstring == capped_qstring_0);
+    CHECK(chunks[1].qstring.empty());
+    CHECK(chunks[2].qstring == qstrings[2]);
+}
@@ -0,0 +1,136 @@
+#include "utils/GpuArbiter.h"
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#define CUT_TAG "[GpuArbiter]"
+
+using dorado::utils::GpuArbiter;
+
+using namespace std::chrono_literals;
+
+#ifdef __linux__
+
+namespace {
+
+// A segment of the test's own, removed once it's done.  Each GpuArbiter attached takes its own
+// slot, so two in one process stand in for two processes.
+struct TestSegment {
+    const std::string name = "/dorado-test-gpu-arbiter-" + std::to_string(getpid());
+    TestSegment() { GpuArbiter::remove(name); }
+    ~TestSegment() { GpuArbiter::remove(name); }
+};
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": processes are counted and their reservations shared", CUT_TAG) {
+    TestSegment segment;
+    GpuArbiter first(segment.name);
+    CHECK(first.num_processes() == 1);
+    {
+        GpuArbiter second(segment.name);
+        CHECK(first.num_processes() == 2);
+        first.add_reservation(1000);
+        second.add_reservation(300);
+        second.add_reservation(200);
+        CHECK(first.reserved_by_others() == 500);
+        CHECK(second.reserved_by_others() == 1000);
+    }
+    // The second's slot and reservation are given back as it detaches.
+    CHECK(first.num_processes() == 1);
+    CHECK(first.reserved_by_others() == 0);
+}
+
+TEST_CASE(CUT_TAG ": turns are passed to whoever is waiting", CUT_TAG) {
+    TestSegment segment;
+    GpuArbiter first(segment.name);
+    GpuArbiter second(segment.name);
+
+    auto turn = first.acquire_turn();
+    CHECK(turn.holds_turn());
+    std::atomic<bool> second_has_turn{false};
+    std::thread waiter([&] {
+        auto second_turn = second.acquire_turn();
+        second_has_turn = true;
+    });
+    std::this_thread::sleep_for(50ms);
+    CHECK_FALSE(second_has_turn);
+    turn.release();
+    CHECK_FALSE(turn.holds_turn());
+    waiter.join();
+    CHECK(second_has_turn);
+    CHECK(first.turns_taken() == 1);
+    CHECK(second.turns_taken() == 1);
+}
+
+TEST_CASE(CUT_TAG ": turns alternate between processes which both want them", CUT_TAG) {
+    TestSegment segment;
+    GpuArbiter first(segment.name);
+    GpuArbiter second(segment.name);
+
+    // Each takes its next turn as soon as it's given one up, so without turns being handed over
+    // to whoever is waiting, one could keep the device to itself.
+    constexpr int kTurns = 20;
+    std::vector<int> order;
+    std::mutex order_mutex;
+    auto take_turns = [&](GpuArbiter& arbiter, int id) {
+        for (int i = 0; i < kTurns; ++i) {
+            auto turn = arbiter.acquire_turn();
+            {
+                std::lock_guard lock(order_mutex);
+                order.push_back(id);
+            }
+            // A batch.
+            std::this_thread::sleep_for(2ms);
+        }
+    };
+    std::thread first_thread(take_turns, std::ref(first), 0);
+    std::thread second_thread(take_turns, std::ref(second), 1);
+    first_thread.join();
+    second_thread.join();
+
+    REQUIRE(order.size() == 2 * kTurns);
+    // Once both are waiting, no one has two turns in a row, except at the start and end while
+    // the other is starting or finished.
+    int repeats = 0;
+    for (size_t i = 1; i < order.size(); ++i) {
+        repeats += order[i] == order[i - 1];
+    }
+    CHECK(repeats <= kTurns / 2);
+}
+
+TEST_CASE(CUT_TAG ": the turn and reservation of an exited process are cleared", CUT_TAG) {
+    TestSegment segment;
+    GpuArbiter arbiter(segment.name);
+
+    const pid_t child = fork();
+    if (child == 0) {
+        // Exits with the turn and a reservation, without detaching.
+        auto* crashed = new GpuArbiter(segment.name);
+        crashed->add_reservation(1000);
+        auto* turn = new GpuArbiter::Turn(crashed->acquire_turn());
+        (void)turn;
+        _exit(0);
+    }
+    int status = 0;
+    REQUIRE(waitpid(child, &status, 0) == child);
+
+    auto turn = arbiter.acquire_turn();
+    CHECK(turn.holds_turn());
+    CHECK(arbiter.reserved_by_others() == 0);
+    CHECK(arbiter.num_processes() == 1);
+}
+
+#endif  // __linux__
@@ -0,0 +1,111 @@
+#include "utils/GpuMonitor.h"
+#include "utils/MetricsServer.h"
+
+#include <catch2/catch.hpp>
+
+#include <cmath>
+#include <string>
+
+#define CUT_TAG "[GpuMonitor]"
+
+using dorado::utils::GpuMonitor;
+using dorado::utils::MetricsRegistry;
+
+namespace {
+
+// Reports the utilisation and memory it's set to, and its energy if that's set, and nothing
+// else.
+struct FakeGpu {
+    double utilisation{0};
+    double memory_used{0};
+    double energy{GpuMonitor::kNotReported};
+
+    GpuMonitor::Reader reader() {
+        return [this] {
+            auto sample = GpuMonitor::Sample();
+            sample.fill(GpuMonitor::kNotReported);
+            sample[GpuMonitor::UTILISATION] = utilisation;
+            sample[GpuMonitor::MEMORY_USED] = memory_used;
+            sample[GpuMonitor::ENERGY] = energy;
+            return sample;
+        };
+    }
+};
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": samples are summarised per counter", CUT_TAG) {
+    FakeGpu gpu;
+    GpuMonitor monitor;
+    monitor.add_device("cuda:0", gpu.reader());
+    REQUIRE(monitor.num_devices() == 1);
+
+    // Nothing is counted until sampled, not even the read made as the device is added.
+    CHECK(monitor.summary(0, GpuMonitor::UTILISATION).count == 0);
+
+    for (double utilisation : {20.0, 90.0, 40.0}) {
+        gpu.utilisation = utilisation;
+        gpu.memory_used = 10 * utilisation;
+        monitor.sample();
+    }
+    const auto utilisation = monitor.summary(0, GpuMonitor::UTILISATION);
+    CHECK(utilisation.count == 3);
+    CHECK(utilisation.min == 20);
+    CHECK(utilisation.mean() == Approx(50));
+    CHECK(utilisation.max == 90);
+    CHECK(utilisation.last == 40);
+    CHECK(monitor.summary(0, GpuMonitor::MEMORY_USED).max == 900);
+
+    // Counters the device doesn't report are left empty.
+    CHECK(monitor.summary(0, GpuMonitor::POWER).count == 0);
+}
+
+TEST_CASE(CUT_TAG ": only reported counters are added to the metrics", CUT_TAG) {
+    FakeGpu gpu;
+    GpuMonitor monitor;
+    monitor.add_device("cuda:0", gpu.reader());
+    MetricsRegistry registry;
+    monitor.add_metrics(registry);
+
+    gpu.utilisation = 75;
+    monitor.sample();
+    const auto text = registry.format();
+    CHECK(text.find("dorado_gpu_utilisation_percent{device=\"cuda:0\",stat=\"max\"} 75\n") !=
+          std::string::npos);
+    CHECK(text.find("dorado_gpu_memory_used_bytes{") != std::string::npos);
+    CHECK(text.find("dorado_gpu_power_watts") == std::string::npos);
+}
+
+TEST_CASE(CUT_TAG ": energy is what was used while sampling", CUT_TAG) {
+    FakeGpu gpu_0, gpu_1, gpu_without_energy;
+    gpu_0.energy = 1000;
+    gpu_1.energy = 5000;
+    GpuMonitor monitor;
+    monitor.add_device("cuda:0", gpu_0.reader());
+    monitor.add_device("cuda:1", gpu_1.reader());
+    monitor.add_device("cuda:2", gpu_without_energy.reader());
+    MetricsRegistry registry;
+    monitor.add_metrics(registry);
+    CHECK(std::isnan(monitor.energy_joules()));
+
+    monitor.sample();
+    gpu_0.energy = 1250;
+    gpu_1.energy = 5500;
+    monitor.sample();
+    CHECK(monitor.energy_joules() == Approx(750));
+    const auto text = registry.format();
+    CHECK(text.find("dorado_gpu_energy_joules_total{device=\"cuda:0\"} 250\n") !=
+          std::string::npos);
+    CHECK(text.find("dorado_gpu_energy_joules_total{device=\"cuda:2\"}") == std::string::npos);
+}
+
+TEST_CASE(CUT_TAG ": devices are sampled in the background", CUT_TAG) {
+    FakeGpu gpu;
+    GpuMonitor monitor(std::chrono::milliseconds(1));
+    monitor.add_device("cuda:0", gpu.reader());
+    monitor.start();
+    CHECK_THROWS(monitor.add_device("cuda:1", gpu.reader()));
+    monitor.stop();
+    // A sample is taken as soon as sampling starts.
+    CHECK(monitor.summary(0, GpuMonitor::UTILISATION).count > 0);
+}
@@ -0,0 +1,86 @@
+#include "utils/host_profile.h"
+
+#include <catch2/catch.hpp>
+
+#include <filesystem>
+#include <fstream>
+
+#define CUT_TAG "[HostProfile]"
+
+namespace fs = std::filesystem;
+using dorado::utils::HostProfile;
+
+namespace {
+
+fs::path make_profile_path(const std::string& name) {
+    const auto directory = fs::temp_directory_path() / name;
+    fs::remove_all(directory);
+    return directory / "host_profile.toml";
+}
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": profiles are kept per device and model", CUT_TAG) {
+    const auto path = make_profile_path("host_profile_round_trip");
+    CHECK(dorado::utils::load_host_profiles(path).empty());
+
+    HostProfile fast;
+    fast.batch_size = 1536;
+    fast.chunk_size = 5000;
+    fast.num_runners = 3;
+    fast.scaler_node_threads = 8;
+    fast.read_converter_threads = 2;
+    fast.samples_per_second = 4.5e7;
+    dorado::utils::save_host_profile(path, "cuda:all", "models/dna_fast@v4.1.0/", fast);
+
+    HostProfile cpu;
+    cpu.chunk_size = 10000;
+    cpu.remora_threads = 8;
+    dorado::utils::save_host_profile(path, "cpu", "models/dna_fast@v4.1.0", cpu);
+
+    const auto profiles = dorado::utils::load_host_profiles(path);
+    REQUIRE(profiles.size() == 2);
+    const auto found = dorado::utils::find_host_profile(path, "cuda:all", "dna_fast@v4.1.0");
+    REQUIRE(found);
+    CHECK(found->batch_size == 1536);
+    CHECK(found->chunk_size == 5000);
+    CHECK(found->num_runners == 3);
+    CHECK(found->remora_threads == 0);
+    CHECK(found->scaler_node_threads == 8);
+    CHECK(found->read_converter_threads == 2);
+    CHECK(found->samples_per_second == Approx(4.5e7));
+    CHECK(dorado::utils::find_host_profile(path, "cpu", "dna_fast@v4.1.0")->remora_threads == 8);
+    CHECK(!dorado::utils::find_host_profile(path, "cuda:0", "dna_fast@v4.1.0"));
+    CHECK(!dorado::utils::find_host_profile(path, "cuda:all", "dna_sup@v4.1.0"));
+
+    // Tuning again replaces the old settings.
+    fast.batch_size = 1024;
+    dorado::utils::save_host_profile(path, "cuda:all", "dna_fast@v4.1.0", fast);
+    CHECK(dorado::utils::find_host_profile(path, "cuda:all", "dna_fast@v4.1.0")->batch_size ==
+          1024);
+    CHECK(dorado::utils::load_host_profiles(path).size() == 2);
+    fs::remove_all(path.parent_path());
+}
+
+TEST_CASE(CUT_TAG ": only tuned thread counts are applied", CUT_TAG) {
+    auto allocations = dorado::utils::default_thread_allocations(2, 4, 64);
+    const auto writer_threads = allocations.writer_threads;
+    const auto read_converter_threads = allocations.read_converter_threads;
+
+    HostProfile profile;
+    profile.scaler_node_threads = 3;
+    profile.apply(allocations);
+    CHECK(allocations.scaler_node_threads == 3);
+    CHECK(allocations.read_converter_threads == read_converter_threads);
+    CHECK(allocations.writer_threads == writer_threads);
+}
+
+TEST_CASE(CUT_TAG ": a profile which can't be parsed is ignored", CUT_TAG) {
+    const auto path = make_profile_path("host_profile_bad");
+    fs::create_directories(path.parent_path());
+    std::ofstream(path) << "[\"cuda:all\".\"model\"\nbatch_size = ";
+    CHECK_THROWS(dorado::utils::load_host_profiles(path));
+    CHECK(!dorado::utils::find_host_profile(path, "cuda:all", "model"));
+    CHECK(dorado::utils::select_host_profile(path, "cuda:all", "model").batch_size == 0);
+    fs::remove_all(path.parent_path());
+}
@@ -0,0 +1,69 @@
+#include "utils/InternedString.h"
+
+#include <catch2/catch.hpp>
+
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define CUT_TAG "[InternedString]"
+
+using dorado::utils::InternedString;
+
+TEST_CASE(CUT_TAG ": equal strings share one copy", CUT_TAG) {
+    const std::string run_id = "fc2d5b2f-0b3a-4a9e-9e5e-2f0a1c3b4d5e";
+    InternedString a(run_id);
+    InternedString b(std::string("fc2d5b2f-0b3a-4a9e-9e5e-2f0a1c3b4d5e"));
+    InternedString c("another_run");
+
+    CHECK(a == b);
+    CHECK(a.id() == b.id());
+    CHECK(&a.str() == &b.str());
+    CHECK(a != c);
+    CHECK(a.str() == run_id);
+    CHECK(std::string(a.c_str()) == run_id);
+    CHECK(a.size() == run_id.size());
+
+    InternedString copy = a;
+    CHECK(copy == a);
+    CHECK(copy.id() == a.id());
+}
+
+TEST_CASE(CUT_TAG ": the empty string", CUT_TAG) {
+    InternedString empty;
+    CHECK(empty.empty());
+    CHECK(empty.size() == 0);
+    CHECK(empty.str().empty());
+    CHECK(std::string(empty.c_str()).empty());
+    CHECK(empty == InternedString(""));
+    CHECK(empty != InternedString("x"));
+}
+
+TEST_CASE(CUT_TAG ": orders by value", CUT_TAG) {
+    // Interned in the opposite order to their values.
+    std::map<InternedString, int> values{{"zebra", 2}, {"apple", 1}};
+    CHECK(values.begin()->first.str() == "apple");
+    CHECK(!(InternedString("apple") < InternedString("apple")));
+    CHECK(InternedString("apple") < InternedString("zebra"));
+    CHECK(!(InternedString("zebra") < InternedString("apple")));
+}
+
+TEST_CASE(CUT_TAG ": threads interning the same strings share them", CUT_TAG) {
+    constexpr int kNumThreads = 8;
+    std::vector<InternedString> interned(kNumThreads);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kNumThreads; ++i) {
+        threads.emplace_back([&interned, i] {
+            for (int j = 0; j < 1000; ++j) {
+                interned[i] = InternedString("file_" + std::to_string(j % 10) + ".pod5");
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (const auto& value : interned) {
+        CHECK(value == InternedString("file_9.pod5"));
+    }
+}
@@ -0,0 +1,230 @@
+#include "utils/LanedQueue.h"
+
+#include <catch2/catch.hpp>
+
+#define TEST_GROUP "LanedQueue "
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Negative items go in the first lane.
+struct SignLane {
+    size_t operator()(int item) const { return item < 0 ? 0 : 1; }
+};
+
+using Queue = LanedQueue<int, 2, SignLane>;
+
+}  // namespace
+
+TEST_CASE(TEST_GROUP ": first lane is popped first, each lane in order") {
+    Queue queue(10);
+    for (int item : {1, 2, -1, 3, -2}) {
+        REQUIRE(queue.try_push(std::move(item)));
+    }
+    CHECK(queue.size() == 5);
+    CHECK(queue.lane_size(0) == 2);
+    std::vector<int> popped;
+    int item = 0;
+    while (queue.size() > 0 && queue.try_pop(item)) {
+        popped.push_back(item);
+    }
+    CHECK(popped == std::vector<int>{-1, -2, 1, 2, 3});
+}
+
+TEST_CASE(TEST_GROUP ": the lanes share one capacity") {
+    Queue queue(2);
+    REQUIRE(queue.try_push(1));
+    REQUIRE(queue.try_push(2));
+    CHECK(queue.capacity() == 2);
+
+    // Either lane's push waits for space in the queue as a whole.
+    std::atomic<bool> pushed{false};
+    std::thread pushing_thread([&] { pushed = queue.try_push(-1); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK_FALSE(pushed);
+    std::vector<int> popped;
+    REQUIRE(queue.try_pop_batch(popped, 1));
+    pushing_thread.join();
+    CHECK(pushed);
+    CHECK(queue.size() == 2);
+    REQUIRE(queue.try_pop_batch(popped, 5));
+    CHECK(popped == std::vector<int>{1, -1, 2});
+    CHECK(queue.stats().push_blocked_ns > 0);
+}
+
+TEST_CASE(TEST_GROUP ": termination drains every lane") {
+    Queue queue(4);
+    REQUIRE(queue.try_push(1));
+    REQUIRE(queue.try_push(-1));
+    queue.terminate();
+    CHECK_FALSE(queue.try_push(2));
+    int item = 0;
+    REQUIRE(queue.try_pop(item));
+    CHECK(item == -1);
+    REQUIRE(queue.try_pop(item));
+    CHECK(item == 1);
+    CHECK_FALSE(queue.try_pop(item));
+
+    const auto stats = queue.stats();
+    CHECK(stats.num_pushed == 2);
+    CHECK(stats.num_popped == 2);
+    CHECK(stats.capacity == 4);
+}
+
+// A parked popper is woken by a push to any lane.
+TEST_CASE(TEST_GROUP ": pop from other thread") {
+    Queue queue(1);
+    std::atomic<int> popped{0};
+    std::thread popping_thread([&] {
+        int item = 0;
+        while (queue.try_pop(item)) {
+            popped += item;
+        }
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    REQUIRE(queue.try_push(-5));
+    REQUIRE(queue.try_push(7));
+    while (popped != 2) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    queue.terminate();
+    popping_thread.join();
+    CHECK(popped == 2);
+}
+
+// Every push which succeeds, even one racing terminate(), is popped before pops fail.
+TEST_CASE(TEST_GROUP ": terminate during pushes") {
+    for (int round = 0; round < 200; ++round) {
+        Queue queue(1024);
+        std::atomic<int> pushed_count{0};
+        int popped_count = 0;
+
+        std::thread popping_thread([&] {
+            int item = 0;
+            while (queue.try_pop(item)) {
+                ++popped_count;
+            }
+        });
+        std::vector<std::thread> pushing_threads;
+        for (int i = 0; i < 4; ++i) {
+            pushing_threads.emplace_back([&, i] {
+                for (int j = 0; j < 200; ++j) {
+                    if (queue.try_push(i % 2 == 0 ? j : -j)) {
+                        ++pushed_count;
+                    }
+                }
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+        queue.terminate();
+        for (auto& pushing_thread : pushing_threads) {
+            pushing_thread.join();
+        }
+        popping_thread.join();
+        REQUIRE(popped_count == pushed_count.load());
+    }
+}
+
+// A batch waits until there's room for all of it, then goes into each lane as one run.
+TEST_CASE(TEST_GROUP ": a batch takes its slots at once") {
+    Queue queue(4);
+    REQUIRE(queue.try_push_batch({1, 2, 3, 4}));
+
+    std::atomic<bool> pushed{false};
+    std::thread pushing_thread([&] { pushed = queue.try_push_batch({5, -5}); });
+    std::vector<int> popped;
+    REQUIRE(queue.try_pop_batch(popped, 1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK_FALSE(pushed);
+    REQUIRE(queue.try_pop_batch(popped, 1));
+    pushing_thread.join();
+    CHECK(pushed);
+    REQUIRE(queue.try_pop_batch(popped, 5));
+    CHECK(popped == std::vector<int>{1, 2, -5, 3, 4, 5});
+
+    // One larger than the capacity goes in as there's room.
+    std::thread popping_thread([&] {
+        int item = 0;
+        while (queue.try_pop(item)) {
+            popped.push_back(item);
+        }
+    });
+    REQUIRE(queue.try_push_batch({6, 7, 8, 9, 10, 11}));
+    queue.terminate();
+    popping_thread.join();
+    CHECK(popped.size() == 12);
+}
+
+// Grouped by value, a pop carries on to the end of the last group in its lane.
+TEST_CASE(TEST_GROUP ": a grouped pop keeps groups together") {
+    Queue queue(10);
+    REQUIRE(queue.try_push_batch({1, 1, 2, -1, 2, 2, 3}));
+    auto same_group = [](int a, int b) { return a == b; };
+    std::vector<int> popped;
+    REQUIRE(queue.try_pop_batch(popped, 3, same_group));
+    CHECK(popped == std::vector<int>{-1, 1, 1});
+    popped.clear();
+    REQUIRE(queue.try_pop_batch(popped, 1, same_group));
+    CHECK(popped == std::vector<int>{2, 2, 2});
+    popped.clear();
+    queue.terminate();
+    REQUIRE(queue.try_pop_batch(popped, 1, same_group));
+    CHECK(popped == std::vector<int>{3});
+    CHECK_FALSE(queue.try_pop_batch(popped, 1, same_group));
+}
+
+// Batches pushed from several threads, each a group, are popped whole by several threads.
+TEST_CASE(TEST_GROUP ": concurrent batches stay together") {
+    const int num_pushers = 4, num_poppers = 3, num_batches = 200, batch_size = 5;
+    Queue queue(8);
+
+    // Each item is its batch's number times batch_size plus its place in the batch.
+    auto same_group = [](int a, int b) { return a / batch_size == b / batch_size; };
+    std::atomic<int> num_split{0}, num_popped{0};
+    std::vector<std::thread> poppers;
+    for (int popper = 0; popper < num_poppers; ++popper) {
+        poppers.emplace_back([&] {
+            std::vector<int> popped;
+            while (queue.try_pop_batch(popped, 2, same_group)) {
+                // A batch starts at the start of a group and ends at the end of one.
+                if (popped.front() % batch_size != 0 ||
+                    popped.back() % batch_size != batch_size - 1) {
+                    ++num_split;
+                }
+                for (size_t i = 1; i < popped.size(); ++i) {
+                    if (same_group(popped[i - 1], popped[i]) &&
+                        popped[i] != popped[i - 1] + 1) {
+                        ++num_split;
+                    }
+                }
+                num_popped += int(popped.size());
+                popped.clear();
+            }
+        });
+    }
+    std::vector<std::thread> pushers;
+    for (int pusher = 0; pusher < num_pushers; ++pusher) {
+        pushers.emplace_back([&, pusher] {
+            for (int batch = pusher; batch < num_batches; batch += num_pushers) {
+                std::vector<int> items;
+                for (int i = 0; i < batch_size; ++i) {
+                    items.push_back(batch * batch_size + i);
+                }
+                queue.try_push_batch(std::move(items));
+            }
+        });
+    }
+    for (auto& pusher : pushers) {
+        pusher.join();
+    }
+    queue.terminate();
+    for (auto& popper : poppers) {
+        popper.join();
+    }
+    CHECK(num_split == 0);
+    CHECK(num_popped == num_batches * batch_size);
+}
@@ -0,0 +1,68 @@
+#include "utils/LatencyHistogram.h"
+
+#include <catch2/catch.hpp>
+
+#include <thread>
+#include <vector>
+
+#define CUT_TAG "[LatencyHistogram]"
+
+using dorado::utils::LatencyHistogram;
+
+TEST_CASE(CUT_TAG ": an empty histogram reports zeros", CUT_TAG) {
+    LatencyHistogram histogram;
+    CHECK(histogram.count() == 0);
+    CHECK(histogram.mean() == 0);
+    CHECK(histogram.max() == 0);
+    CHECK(histogram.value_at_percentile(99) == 0);
+}
+
+TEST_CASE(CUT_TAG ": small values are counted exactly", CUT_TAG) {
+    LatencyHistogram histogram;
+    for (uint64_t value = 1; value <= 50; ++value) {
+        histogram.record(value);
+    }
+    CHECK(histogram.count() == 50);
+    CHECK(histogram.mean() == Approx(25.5));
+    CHECK(histogram.max() == 50);
+    CHECK(histogram.value_at_percentile(0) == 1);
+    CHECK(histogram.value_at_percentile(50) == 25);
+    CHECK(histogram.value_at_percentile(90) == 45);
+    CHECK(histogram.value_at_percentile(100) == 50);
+}
+
+TEST_CASE(CUT_TAG ": large values are counted to within a few percent", CUT_TAG) {
+    LatencyHistogram histogram;
+    for (uint64_t value = 1; value <= 100000; ++value) {
+        histogram.record(value * 100);
+    }
+    for (double percentile : {10.0, 50.0, 99.0, 99.9}) {
+        const double expected = percentile * 100000;
+        const auto value = histogram.value_at_percentile(percentile);
+        CHECK(value >= expected);
+        CHECK(value <= expected * 1.04);
+    }
+    CHECK(histogram.value_at_percentile(100) == 10000000);
+
+    // Values too large for the buckets are counted in the last, but keep their maximum.
+    histogram.record(uint64_t(1) << 40);
+    CHECK(histogram.max() == uint64_t(1) << 40);
+    CHECK(histogram.value_at_percentile(100) == uint64_t(1) << 40);
+}
+
+TEST_CASE(CUT_TAG ": threads can record at once", CUT_TAG) {
+    LatencyHistogram histogram;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&histogram, t] {
+            for (int i = 0; i < 10000; ++i) {
+                histogram.record(t * 1000 + i % 1000);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    CHECK(histogram.count() == 40000);
+    CHECK(histogram.max() == 3999);
+}
@@ -0,0 +1,395 @@
+#include "utils/LockFreeQueue.h"
+
+#include <catch2/catch.hpp>
+
+#define TEST_GROUP "LockFreeQueue "
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+TEST_CASE(TEST_GROUP ": InputsMatchOutputs") {
+    const int n = 10;
+    LockFreeQueue<int> queue(n);
+
+    for (int i = 0; i < n; ++i) {
+        const bool success = queue.try_push(std::move(i));
+        REQUIRE(success);
+    }
+    for (int i = 0; i < n; ++i) {
+        int val = -1;
+        const bool success = queue.try_pop(val);
+        REQUIRE(val == i);
+    }
+}
+
+TEST_CASE(TEST_GROUP ": PushFailsIfTerminating") {
+    LockFreeQueue<int> queue(1);
+    queue.terminate();
+    const bool success = queue.try_push(42);
+    REQUIRE(!success);
+}
+
+TEST_CASE(TEST_GROUP ": PushNowFailsIfFull") {
+    LockFreeQueue<int> queue(2);
+    REQUIRE(queue.try_push_now(1));
+    REQUIRE(queue.try_push_now(2));
+    REQUIRE(!queue.try_push_now(3));
+    int val = -1;
+    REQUIRE(queue.try_pop_now(val));
+    REQUIRE(val == 1);
+    REQUIRE(queue.try_push_now(3));
+    queue.terminate();
+    REQUIRE(!queue.try_push_now(4));
+}
+
+TEST_CASE(TEST_GROUP ": PopFailsIfTerminating") {
+    LockFreeQueue<int> queue(1);
+    queue.terminate();
+    int val;
+    const bool success = queue.try_pop(val);
+    REQUIRE(!success);
+}
+
+// Spawned thread sits waiting for an item.
+// Main thread supplies that item.
+TEST_CASE(TEST_GROUP ": PopFromOtherThread") {
+    LockFreeQueue<int> queue(1);
+    std::atomic_bool thread_started{false};
+    bool try_pop_result = false;
+
+    auto popping_thread = std::thread([&]() {
+        thread_started.store(true, std::memory_order_relaxed);
+        int val = -1;
+        // catch2 isn't thread safe so we have to check this on the main thread
+        try_pop_result = queue.try_pop(val);
+    });
+
+    // Wait for thread to start
+    while (!thread_started.load(std::memory_order_relaxed)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    // Feed data to the thread
+    const bool success = queue.try_push(42);
+    REQUIRE(success);
+
+    popping_thread.join();
+    REQUIRE(try_pop_result);
+}
+
+// Spawned thread sits waiting for an item.
+// Main thread terminates wait.
+TEST_CASE(TEST_GROUP ": TerminateFromOtherThread") {
+    LockFreeQueue<int> queue(1);
+    std::atomic_bool thread_started{false};
+    bool try_pop_result = false;
+
+    auto popping_thread = std::thread([&]() {
+        thread_started.store(true, std::memory_order_relaxed);
+        int val = -1;
+        // catch2 isn't thread safe so we have to check this on the main thread
+        try_pop_result = queue.try_pop(val);
+    });
+
+    // Wait for thread to start
+    while (!thread_started.load(std::memory_order_relaxed)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    // Stop it
+    queue.terminate();
+    popping_thread.join();
+
+    // This will fail, since the wait is terminated.
+    REQUIRE(!try_pop_result);
+}
+
+TEST_CASE(TEST_GROUP ": BatchInputsMatchOutputs") {
+    const int n = 10;
+    LockFreeQueue<int> queue(n);
+
+    std::vector<int> items;
+    for (int i = 0; i < n; ++i) {
+        items.push_back(i);
+    }
+    REQUIRE(queue.try_push_batch(std::move(items)));
+    REQUIRE(items.empty());
+
+    // Popping is limited to the requested number of items.
+    std::vector<int> popped;
+    REQUIRE(queue.try_pop_batch(popped, 4));
+    REQUIRE(popped.size() == 4);
+    REQUIRE(queue.try_pop_batch(popped, n));
+    REQUIRE(popped.size() == n);
+    for (int i = 0; i < n; ++i) {
+        REQUIRE(popped[i] == i);
+    }
+}
+
+// A batch larger than the queue capacity has to be consumed as it is pushed.
+TEST_CASE(TEST_GROUP ": BatchLargerThanCapacity") {
+    const int n = 100;
+    LockFreeQueue<int> queue(3);
+
+    std::vector<int> popped;
+    auto popping_thread = std::thread([&]() {
+        std::vector<int> batch;
+        while (queue.try_pop_batch(batch, 7)) {
+        }
+        popped = std::move(batch);
+    });
+
+    std::vector<int> items;
+    for (int i = 0; i < n; ++i) {
+        items.push_back(i);
+    }
+    const bool success = queue.try_push_batch(std::move(items));
+    queue.terminate();
+    popping_thread.join();
+
+    REQUIRE(success);
+    REQUIRE(popped.size() == n);
+    for (int i = 0; i < n; ++i) {
+        REQUIRE(popped[i] == i);
+    }
+}
+
+TEST_CASE(TEST_GROUP ": BatchPopFailsIfTerminating") {
+    LockFreeQueue<int> queue(1);
+    queue.terminate();
+    std::vector<int> popped;
+    REQUIRE(!queue.try_pop_batch(popped, 10));
+    REQUIRE(!queue.try_push_batch({1, 2, 3}));
+}
+
+// Items cycle through a queue much smaller than the number of items, so producers
+// and consumers repeatedly hit the full and empty cases and have to park.
+TEST_CASE(TEST_GROUP ": MultipleProducersAndConsumers") {
+    const int num_producers = 4;
+    const int num_consumers = 4;
+    const int items_per_producer = 20000;
+    LockFreeQueue<int> queue(8);
+
+    std::atomic<int64_t> popped_sum{0};
+    std::atomic<int> popped_count{0};
+
+    std::vector<std::thread> consumers;
+    for (int i = 0; i < num_consumers; ++i) {
+        consumers.emplace_back([&]() {
+            int val = 0;
+            while (queue.try_pop(val)) {
+                popped_sum += val;
+                ++popped_count;
+            }
+        });
+    }
+
+    std::vector<std::thread> producers;
+    for (int i = 0; i < num_producers; ++i) {
+        producers.emplace_back([&]() {
+            for (int j = 1; j <= items_per_producer; ++j) {
+                queue.try_push(int(j));
+            }
+        });
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+
+    // Termination only takes effect for consumers once the queue is drained.
+    queue.terminate();
+    for (auto& consumer : consumers) {
+        consumer.join();
+    }
+
+    const int64_t expected_sum =
+            int64_t(num_producers) * items_per_producer * (items_per_producer + 1) / 2;
+    REQUIRE(popped_count.load() == num_producers * items_per_producer);
+    REQUIRE(popped_sum.load() == expected_sum);
+}
+
+// Batches from several producers each arrive whole and in order, if interleaved.
+TEST_CASE(TEST_GROUP ": ConcurrentBatchesKeepOrder") {
+    const int num_producers = 4;
+    const int num_batches = 500;
+    const int batch_size = 7;
+    LockFreeQueue<int> queue(16);
+
+    std::atomic<int> num_failed{0};
+    std::vector<int> last_seen(num_producers, -1);
+    bool in_order = true;
+    int popped_count = 0;
+    std::thread consumer([&]() {
+        int val = 0;
+        while (queue.try_pop(val)) {
+            const int producer = val % num_producers;
+            in_order = in_order && val / num_producers > last_seen[producer];
+            last_seen[producer] = val / num_producers;
+            ++popped_count;
+        }
+    });
+    std::vector<std::thread> producers;
+    for (int p = 0; p < num_producers; ++p) {
+        producers.emplace_back([&, p]() {
+            for (int b = 0; b < num_batches; ++b) {
+                std::vector<int> batch;
+                for (int i = 0; i < batch_size; ++i) {
+                    batch.push_back((b * batch_size + i) * num_producers + p);
+                }
+                if (!queue.try_push_batch(std::move(batch))) {
+                    ++num_failed;
+                }
+            }
+        });
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    queue.terminate();
+    consumer.join();
+    CHECK(num_failed == 0);
+    CHECK(in_order);
+    CHECK(popped_count == num_producers * num_batches * batch_size);
+}
+
+// Every push which succeeds, even one racing terminate(), is popped before pops fail.
+TEST_CASE(TEST_GROUP ": TerminateDuringPushes") {
+    for (int round = 0; round < 200; ++round) {
+        LockFreeQueue<int> queue(1024);
+        std::atomic<int> pushed_count{0};
+        int popped_count = 0;
+
+        std::thread consumer([&]() {
+            int val = 0;
+            while (queue.try_pop(val)) {
+                ++popped_count;
+            }
+        });
+        std::vector<std::thread> producers;
+        for (int i = 0; i < 4; ++i) {
+            producers.emplace_back([&]() {
+                for (int j = 0; j < 200; ++j) {
+                    if (queue.try_push(int(j))) {
+                        ++pushed_count;
+                    }
+                }
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+        queue.terminate();
+        for (auto& producer : producers) {
+            producer.join();
+        }
+        consumer.join();
+        REQUIRE(popped_count == pushed_count.load());
+    }
+}
+
+// Unconsumed items must be destroyed along with the queue.
+TEST_CASE(TEST_GROUP ": DestroysRemainingItems") {
+    auto item = std::make_shared<int>(42);
+    {
+        LockFreeQueue<std::shared_ptr<int>> queue(4);
+        queue.try_push(std::shared_ptr<int>(item));
+        queue.try_push(std::shared_ptr<int>(item));
+        REQUIRE(item.use_count() == 3);
+    }
+    REQUIRE(item.use_count() == 1);
+}
+
+// Counts follow the queue positions, and only waits past a first failed attempt are timed.
+TEST_CASE(TEST_GROUP ": StatsCountsAndWaits") {
+    LockFreeQueue<int> queue(2);
+    auto stats = queue.stats();
+    REQUIRE(stats.num_pushed == 0);
+    REQUIRE(stats.capacity == 2);
+
+    queue.try_push(1);
+    queue.try_push(2);
+    int val = 0;
+    queue.try_pop(val);
+    stats = queue.stats();
+    REQUIRE(stats.num_pushed == 2);
+    REQUIRE(stats.num_popped == 1);
+    REQUIRE(stats.size == 1);
+    REQUIRE(stats.push_blocked_ns == 0);
+    REQUIRE(stats.pop_waiting_ns == 0);
+
+    queue.try_pop(val);
+    std::thread producer([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        queue.try_push(3);
+    });
+    queue.try_pop(val);
+    producer.join();
+    REQUIRE(val == 3);
+    stats = queue.stats();
+    REQUIRE(stats.pop_waiting_ns >= 10'000'000);
+    REQUIRE(stats.push_blocked_ns == 0);
+
+    queue.try_push(4);
+    queue.try_push(5);
+    std::thread consumer([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        int popped = 0;
+        queue.try_pop(popped);
+    });
+    queue.try_push(6);
+    consumer.join();
+    REQUIRE(queue.stats().push_blocked_ns >= 10'000'000);
+}
+
+// Batches which fit in the queue are never interleaved with each other.
+TEST_CASE(TEST_GROUP ": ConcurrentBatchesStayTogether") {
+    const int num_pushers = 4, num_batches = 200, batch_size = 5;
+    LockFreeQueue<int> queue(8);
+
+    std::vector<int> popped;
+    auto popping_thread = std::thread([&]() {
+        while (queue.try_pop_batch(popped, 3)) {
+        }
+    });
+
+    // Each item is its batch's number times batch_size plus its place in the batch.
+    std::vector<std::thread> pushers;
+    for (int pusher = 0; pusher < num_pushers; ++pusher) {
+        pushers.emplace_back([&, pusher]() {
+            for (int batch = pusher; batch < num_batches; batch += num_pushers) {
+                std::vector<int> items;
+                for (int i = 0; i < batch_size; ++i) {
+                    items.push_back(batch * batch_size + i);
+                }
+                queue.try_push_batch(std::move(items));
+            }
+        });
+    }
+    for (auto& pusher : pushers) {
+        pusher.join();
+    }
+    queue.terminate();
+    popping_thread.join();
+
+    REQUIRE(popped.size() == num_batches * batch_size);
+    for (size_t i = 0; i < popped.size(); ++i) {
+        CHECK(popped[i] % batch_size == int(i % batch_size));
+        CHECK(popped[i] / batch_size == popped[i - i % batch_size] / batch_size);
+    }
+}
+
+TEST_CASE(TEST_GROUP ": PopNowIfChecksTheNextItem") {
+    LockFreeQueue<int> queue(4);
+    REQUIRE(queue.try_push_batch({1, 2}));
+    auto is_odd = [](int item) { return item % 2 == 1; };
+    int item = 0;
+    REQUIRE(queue.try_pop_now_if(item, is_odd));
+    CHECK(item == 1);
+    CHECK_FALSE(queue.try_pop_now_if(item, is_odd));
+    CHECK(queue.size() == 1);
+    REQUIRE(queue.try_pop_now(item));
+    CHECK(item == 2);
+    CHECK_FALSE(queue.try_pop_now_if(item, is_odd));
+}
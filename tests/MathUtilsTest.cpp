@@ -2,6 +2,9 @@
 
 #include <catch2/catch.hpp>
 
+#include <algorithm>
+#include <random>
+
 #define CUT_TAG "[MathUtils]"
 
 TEST_CASE(CUT_TAG ": test quantiles", CUT_TAG) {
@@ -25,4 +28,24 @@ TEST_CASE(CUT_TAG ": test linear_regression", CUT_TAG) {
     REQUIRE(m == Approx(expected_m));
     REQUIRE(b == Approx(expected_b));
     REQUIRE(r == Approx(expected_r));
-}
\ No newline at end of file
+}
+
+TEST_CASE(CUT_TAG ": quantiles_in_place matches quantiles", CUT_TAG) {
+    const size_t size = GENERATE(1, 2, 7, 980);
+    std::mt19937 rng(size);
+    std::uniform_real_distribution<float> dist(-100.f, 100.f);
+    std::vector<float> data(size);
+    std::generate(data.begin(), data.end(), [&] { return dist(rng); });
+    // With repeated values, and quantiles out of order.
+    if (size > 2) {
+        data[1] = data[0];
+    }
+    const std::vector<float> quants = {0.5f, 0.05f, 0.95f, 0.f, 1.f, 0.5f, 0.33f};
+
+    const auto expected = dorado::utils::quantiles(data, quants);
+    auto reordered = data;
+    CHECK(dorado::utils::quantiles_in_place(reordered, quants) == expected);
+    std::sort(data.begin(), data.end());
+    std::sort(reordered.begin(), reordered.end());
+    CHECK(reordered == data);
+}
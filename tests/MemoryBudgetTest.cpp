@@ -0,0 +1,78 @@
+#include "utils/MemoryBudget.h"
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#define CUT_TAG "[MemoryBudget]"
+
+using dorado::utils::MemoryBudget;
+using dorado::utils::MemoryReservation;
+
+using namespace std::chrono_literals;
+
+TEST_CASE(CUT_TAG ": reservations are counted and given back", CUT_TAG) {
+    MemoryBudget budget(1000);
+    {
+        MemoryReservation first(budget);
+        first.resize(600);
+        MemoryReservation second(budget);
+        CHECK(second.try_resize(400));
+        CHECK(budget.reserved_bytes() == 1000);
+
+        // Over the limit, so the reservation is left as it was.
+        CHECK_FALSE(second.try_resize(401));
+        CHECK(second.bytes() == 400);
+
+        first.resize(100);
+        CHECK(budget.reserved_bytes() == 500);
+        MemoryReservation moved(std::move(second));
+        CHECK(second.bytes() == 0);
+        CHECK(budget.reserved_bytes() == 500);
+    }
+    CHECK(budget.reserved_bytes() == 0);
+}
+
+TEST_CASE(CUT_TAG ": a reservation bigger than the budget waits for nothing else", CUT_TAG) {
+    MemoryBudget budget(1000);
+    MemoryReservation huge(budget);
+    CHECK(huge.try_resize(5000));
+    MemoryReservation other(budget);
+    CHECK_FALSE(other.try_resize(1));
+    huge.resize(0);
+    CHECK(other.try_resize(1000));
+}
+
+TEST_CASE(CUT_TAG ": growing waits until memory is given back", CUT_TAG) {
+    MemoryBudget budget(1000);
+    MemoryReservation held(budget);
+    held.resize(800);
+
+    std::atomic<bool> reserved{false};
+    std::thread waiter([&] {
+        MemoryReservation reservation(budget);
+        reservation.resize(500);
+        reserved = true;
+    });
+
+    // Until held shrinks, the waiter can't have its memory.
+    while (!budget.has_waiters()) {
+        std::this_thread::sleep_for(1ms);
+    }
+    CHECK_FALSE(reserved);
+    held.resize(500);
+    waiter.join();
+    CHECK(reserved);
+    CHECK(budget.reserved_bytes() == 500);
+}
+
+TEST_CASE(CUT_TAG ": without a limit nothing waits", CUT_TAG) {
+    MemoryBudget budget;
+    MemoryReservation first(budget);
+    MemoryReservation second(budget);
+    first.resize(size_t(1) << 40);
+    CHECK(second.try_resize(size_t(1) << 40));
+    CHECK(budget.reserved_bytes() == size_t(1) << 41);
+}
@@ -0,0 +1,40 @@
+#include "utils/MemoryProfiler.h"
+
+#include <catch2/catch.hpp>
+
+#include <sstream>
+
+#define CUT_TAG "[MemoryProfiler]"
+
+using dorado::utils::parse_heap_profile_threads;
+
+TEST_CASE(CUT_TAG ": heap profiles are summed by thread name", CUT_TAG) {
+    std::istringstream profile(
+            "heap_v2/524288\n"
+            "  t*: 40: 8000 [0: 0]\n"
+            "  t0: 5: 1000 [0: 0]\n"
+            "  t1: 20: 2000 [3: 300] pairing\n"
+            "  t2: 10: 3000 [0: 0] basecall\n"
+            "  t3: 5: 2000 [0: 0] pairing\n"
+            "@ 0x1 0x2 0x3\n"
+            "  t*: 40: 7000 [0: 0]\n"
+            "  t4: 40: 7000 [0: 0] backtraces are not counted\n");
+    const auto threads = parse_heap_profile_threads(profile);
+    REQUIRE(threads.size() == 3);
+    CHECK(threads[0].name == "pairing");
+    CHECK(threads[0].objects == 25);
+    CHECK(threads[0].bytes == 4000);
+    CHECK(threads[1].name == "basecall");
+    CHECK(threads[1].bytes == 3000);
+    CHECK(threads[2].name == "unnamed");
+    CHECK(threads[2].bytes == 1000);
+}
+
+TEST_CASE(CUT_TAG ": profiling is unavailable without jemalloc", CUT_TAG) {
+    // As on macOS and Windows.
+    if (!dorado::utils::jemalloc_available()) {
+        dorado::utils::AllocatorStats stats;
+        CHECK_FALSE(dorado::utils::get_allocator_stats(stats));
+        CHECK_FALSE(dorado::utils::heap_profiling_available());
+    }
+}
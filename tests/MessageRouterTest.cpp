@@ -0,0 +1,54 @@
+#include "read_pipeline/MessageRouter.h"
+
+#include "MessageSinkUtils.h"
+
+#include <catch2/catch.hpp>
+
+#define TEST_GROUP "[read_pipeline][MessageRouter]"
+
+using dorado::Message;
+using dorado::MessageRouter;
+using dorado::Read;
+using dorado::ReadPair;
+
+TEST_CASE("MessageRouter: Messages are routed by type", TEST_GROUP) {
+    MessageSinkToVector<std::shared_ptr<Read>> read_sink(100);
+    MessageSinkToVector<std::shared_ptr<ReadPair>> pair_sink(100);
+    {
+        MessageRouter router(read_sink);
+        router.route<std::shared_ptr<ReadPair>>(pair_sink);
+
+        router.push_message(std::make_shared<Read>());
+        router.push_message(std::make_shared<ReadPair>());
+
+        std::vector<Message> batch;
+        batch.push_back(std::make_shared<ReadPair>());
+        batch.push_back(std::make_shared<Read>());
+        batch.push_back(std::make_shared<Read>());
+        router.push_messages(std::move(batch));
+
+        router.terminate();
+    }
+
+    REQUIRE(read_sink.get_messages().size() == 3);
+    REQUIRE(pair_sink.get_messages().size() == 2);
+}
+
+TEST_CASE("MessageRouter: Fan-in sink terminates after all routers", TEST_GROUP) {
+    MessageSinkToVector<std::shared_ptr<Read>> read_sink(100);
+    {
+        MessageRouter router_1(read_sink);
+        MessageRouter router_2(read_sink);
+
+        router_1.push_message(std::make_shared<Read>());
+        // Repeated terminations from the same router only count once.
+        router_1.terminate();
+        router_1.terminate();
+
+        // The sink must still accept messages from the other router.
+        router_2.push_message(std::make_shared<Read>());
+        router_2.terminate();
+    }
+
+    REQUIRE(read_sink.get_messages().size() == 2);
+}
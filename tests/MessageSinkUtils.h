@@ -2,6 +2,9 @@
 
 #include "read_pipeline/ReadPipeline.h"
 
+#include <atomic>
+#include <thread>
+
 template <typename T>
 class MessageSinkToVector : public dorado::MessageSink {
 public:
@@ -16,3 +19,34 @@ public:
         return vec;
     }
 };
+
+// Pops and counts the messages pushed to it on a thread of its own, so that it never holds up
+// the node feeding it, e.g. while the node is timed.
+class MessageSinkCounter : public dorado::MessageSink {
+public:
+    MessageSinkCounter(size_t max_messages) : MessageSink(max_messages) {
+        m_thread = std::thread([this] {
+            dorado::Message message;
+            while (m_work_queue.try_pop(message)) {
+                ++m_num_messages;
+            }
+        });
+    }
+    ~MessageSinkCounter() {
+        terminate();
+        wait_for_terminate();
+    }
+
+    // Waits for the sink to be terminated, and for every message pushed before to be popped,
+    // returning how many there were.
+    size_t wait_for_terminate() {
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+        return m_num_messages;
+    }
+
+private:
+    std::atomic<size_t> m_num_messages{0};
+    std::thread m_thread;
+};
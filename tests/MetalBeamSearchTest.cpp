@@ -0,0 +1,110 @@
+#include "decode/beam_search.h"
+#include "utils/metal_utils.h"
+
+#include <catch2/catch.hpp>
+#include <torch/torch.h>
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace dorado::utils;
+
+#define TEST_GROUP "Metal: "
+
+namespace {
+
+// Matches BeamSearchArgs in nn.metal.
+struct BeamSearchArgs {
+    int32_t T;
+    int32_t N;
+    int32_t C;
+    int32_t beam_width;
+    float log_beam_cut;
+    float fixed_stay_score;
+    float temperature;
+    float q_shift;
+    float q_scale;
+    int32_t chunk_offset;
+};
+
+}  // namespace
+
+TEST_CASE(TEST_GROUP "Beam search matches the CPU") {
+    MTL::Device *const device = get_mtl_device();
+    REQUIRE(device != nullptr);
+    MTL::CommandQueue *const command_queue = device->newCommandQueue();
+    REQUIRE(command_queue != nullptr);
+
+    // state_len 4, as for fast and HAC models.
+    const int T = 200;
+    const int N = 48;
+    const int num_states = 256;
+    const int beam_width = 32;
+    const float beam_cut = 100.f;
+    const float fixed_stay_score = 2.f;
+    const float q_shift = 0.5f;
+    const float q_scale = 1.2f;
+    const float byte_score_scale = static_cast<float>(5.0 / 127.0);
+
+    torch::manual_seed(42);
+    const auto scores = (torch::randn({T, N, num_states * 4}) * 40)
+                                .clamp(-127, 127)
+                                .to(torch::kInt8)
+                                .contiguous();
+    auto bwd = torch::empty({N, T + 1, num_states});
+    auto posts = torch::empty({N, T + 1, num_states});
+
+    const std::vector<int32_t> scan_args_{T, N, num_states};
+    MTL::Buffer *const scan_args = create_vec_buffer(device, scan_args_);
+    launch_kernel(make_cps(device, "forward_scan", {}), command_queue,
+                  {scan_args, mtl_for_tensor(scores), mtl_for_tensor(posts)}, {}, N, num_states);
+    launch_kernel(make_cps(device, "backward_scan", {}), command_queue,
+                  {scan_args, mtl_for_tensor(scores), mtl_for_tensor(bwd)}, {}, N, num_states);
+    launch_kernel(make_cps(device, "add_softmax", {}), command_queue,
+                  {scan_args, mtl_for_tensor(posts), mtl_for_tensor(bwd)}, {}, N, num_states);
+
+    const std::vector<BeamSearchArgs> beam_search_args_{
+            {T, N, num_states, beam_width, logf(beam_cut), fixed_stay_score, 1.f, q_shift, q_scale,
+             0}};
+    MTL::Buffer *const beam_search_args = create_vec_buffer(device, beam_search_args_);
+    auto beam = torch::empty({N, T + 1, beam_width}, torch::kInt32);
+    auto states = torch::empty({N, T}, torch::kInt32);
+    auto block_probs = torch::empty({N, T});
+    auto moves = torch::empty({N, T}, torch::kUInt8);
+    auto sequence = torch::empty({N, T}, torch::kInt8);
+    auto qstring = torch::empty({N, T}, torch::kInt8);
+    auto sequence_len = torch::empty({N}, torch::kInt32);
+    launch_kernel(make_cps(device, "beam_search", {}), command_queue,
+                  {beam_search_args, mtl_for_tensor(scores), mtl_for_tensor(bwd),
+                   mtl_for_tensor(posts), mtl_for_tensor(beam), mtl_for_tensor(states),
+                   mtl_for_tensor(block_probs), mtl_for_tensor(moves), mtl_for_tensor(sequence),
+                   mtl_for_tensor(qstring), mtl_for_tensor(sequence_len)},
+                  {}, N, 32);
+
+    // The GPU's exp and log aren't exactly the CPU's, so the odd merge can tip the other way.
+    int num_matching = 0;
+    for (int chunk = 0; chunk < N; ++chunk) {
+        using torch::indexing::Slice;
+        const auto [expected_sequence, expected_qstring, expected_moves] = beam_search_decode(
+                scores.index({Slice(), chunk}), bwd[chunk], posts[chunk], beam_width, beam_cut,
+                fixed_stay_score, q_shift, q_scale, 1.f, byte_score_scale);
+
+        const int len = sequence_len[chunk].item<int32_t>();
+        const std::string gpu_sequence(
+                reinterpret_cast<const char *>(sequence[chunk].data_ptr<int8_t>()), len);
+        const std::string gpu_qstring(
+                reinterpret_cast<const char *>(qstring[chunk].data_ptr<int8_t>()), len);
+        const auto *const gpu_moves = moves[chunk].data_ptr<uint8_t>();
+        if (gpu_sequence == expected_sequence &&
+            std::vector<uint8_t>(gpu_moves, gpu_moves + T) == expected_moves) {
+            ++num_matching;
+            // Qscores are rounded down to a character, so allow them to be off by one.
+            for (int i = 0; i < len; ++i) {
+                CHECK(std::abs(gpu_qstring[i] - expected_qstring[i]) <= 1);
+            }
+        }
+    }
+    CHECK(num_matching >= N * 9 / 10);
+}
@@ -0,0 +1,101 @@
+#include "utils/MetricsServer.h"
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#ifndef _WIN32
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#define CUT_TAG "[MetricsServer]"
+
+using dorado::utils::MetricsRegistry;
+using dorado::utils::MetricsServer;
+using dorado::utils::ScopedMetrics;
+
+TEST_CASE(CUT_TAG ": metrics are formatted for Prometheus", CUT_TAG) {
+    MetricsRegistry registry;
+    std::atomic<int> num_reads{0};
+    registry.add("dorado_reads_total", "Reads called.", MetricsRegistry::Type::COUNTER,
+                 [&num_reads] { return num_reads.load(); });
+    registry.add("dorado_free_bytes", "Free memory.", MetricsRegistry::Type::GAUGE,
+                 [] { return 2.5; }, R"(device="cuda:0")");
+    registry.add("dorado_free_bytes", "Free memory.", MetricsRegistry::Type::GAUGE,
+                 [] { return 1e12; }, R"(device="cuda:1")");
+
+    num_reads = 42;
+    CHECK(registry.format() ==
+          "# HELP dorado_reads_total Reads called.\n"
+          "# TYPE dorado_reads_total counter\n"
+          "dorado_reads_total 42\n"
+          "# HELP dorado_free_bytes Free memory.\n"
+          "# TYPE dorado_free_bytes gauge\n"
+          "dorado_free_bytes{device=\"cuda:0\"} 2.5\n"
+          "dorado_free_bytes{device=\"cuda:1\"} 1000000000000\n");
+    CHECK(registry.total("dorado_reads_total") == 42);
+    CHECK(registry.total("dorado_free_bytes") == 1e12 + 2.5);
+    CHECK(registry.total("dorado_bases_total") == 0);
+
+    CHECK_THROWS(registry.add("dorado_reads_total", "Reads called.",
+                              MetricsRegistry::Type::GAUGE, [] { return 0.0; }));
+}
+
+#ifndef _WIN32
+
+namespace {
+
+// Sends request to the server on port of this host, and returns everything it sends back.
+std::string http_get(uint16_t port, const std::string& request) {
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    REQUIRE(fd >= 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    REQUIRE(connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0);
+    REQUIRE(dorado::utils::write_all(fd, request));
+    std::string response;
+    char buffer[1024];
+    ssize_t num_read;
+    while ((num_read = ::read(fd, buffer, sizeof(buffer))) > 0) {
+        response.append(buffer, num_read);
+    }
+    ::close(fd);
+    return response;
+}
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": metrics are served over HTTP while in scope", CUT_TAG) {
+    MetricsServer server(0);
+    REQUIRE(server.port() != 0);
+    const std::string request = "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n";
+
+    {
+        auto registry = std::make_shared<MetricsRegistry>();
+        registry->add("dorado_reads_total", "Reads called.", MetricsRegistry::Type::COUNTER,
+                      [] { return 7; });
+        const ScopedMetrics scoped_metrics(&server, registry);
+
+        const auto response = http_get(server.port(), request);
+        CHECK(response.rfind("HTTP/1.1 200 OK\r\n", 0) == 0);
+        CHECK(response.find("\r\n\r\n# HELP dorado_reads_total") != std::string::npos);
+        CHECK(response.find("\ndorado_reads_total 7\n") != std::string::npos);
+
+        CHECK(http_get(server.port(), "GET / HTTP/1.1\r\n\r\n").rfind("HTTP/1.1 404", 0) == 0);
+        CHECK(http_get(server.port(), "POST /metrics HTTP/1.1\r\n\r\n").rfind("HTTP/1.1 405",
+                                                                               0) == 0);
+    }
+
+    // Once out of scope there's nothing left to serve.
+    const auto response = http_get(server.port(), request);
+    CHECK(response.rfind("HTTP/1.1 200 OK\r\n", 0) == 0);
+    CHECK(response.find("dorado_reads_total") == std::string::npos);
+}
+
+#endif  // _WIN32
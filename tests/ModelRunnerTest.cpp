@@ -0,0 +1,64 @@
+#include "nn/ModelRunner.h"
+
+#include <catch2/catch.hpp>
+#include <torch/torch.h>
+
+#include <vector>
+
+#define CUT_TAG "[ModelRunner]"
+
+TEST_CASE(CUT_TAG ": copy_chunks_to_batch matches padded chunk inputs", CUT_TAG) {
+    torch::manual_seed(42);
+    const size_t chunk_size = 100;
+    // Enough chunks to be copied across threads.
+    const int batch_size = 200;
+    // Simplex signal, and stereo signal with a row per feature.
+    for (const auto &sizes : {std::vector<int64_t>{1234}, std::vector<int64_t>{13, 1234}}) {
+        const auto signal = torch::rand(sizes, torch::kFloat16);
+        const int64_t num_features = sizes.size() == 1 ? 1 : sizes[0];
+        std::vector<dorado::ChunkSignal> chunks;
+        for (int i = 0; i < batch_size - 1; ++i) {
+            const size_t offset = (i * 37) % (1234 - 1);
+            const size_t length = std::min(chunk_size, size_t(1234) - offset);
+            chunks.push_back({&signal, offset, length});
+        }
+
+        auto batch = torch::zeros({batch_size, num_features, int64_t(chunk_size)},
+                                  torch::kFloat16);
+        REQUIRE(dorado::copy_chunks_to_batch(batch, 1, chunks));
+        CHECK(torch::equal(batch[0], torch::zeros({num_features, int64_t(chunk_size)},
+                                                  torch::kFloat16)));
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            const auto expected = dorado::chunk_input(chunks[i], chunk_size)
+                                          .view({num_features, int64_t(chunk_size)});
+            CHECK(torch::equal(batch[i + 1], expected));
+        }
+    }
+}
+
+TEST_CASE(CUT_TAG ": copy_chunks_to_batch leaves mismatched chunks alone", CUT_TAG) {
+    const auto signal = torch::rand({500}, torch::kFloat32);
+    auto batch = torch::zeros({4, 1, 100}, torch::kFloat16);
+    // Wrong dtype, and too many chunks for the batch.
+    CHECK_FALSE(dorado::copy_chunks_to_batch(batch, 0, {{&signal, 0, 100}}));
+    const auto half_signal = signal.to(torch::kFloat16);
+    CHECK_FALSE(dorado::copy_chunks_to_batch(batch, 3, {{&half_signal, 0, 100},
+                                                        {&half_signal, 100, 100}}));
+    CHECK(torch::equal(batch, torch::zeros_like(batch)));
+}
+
+TEST_CASE(CUT_TAG ": trimmed_batch_size halves batches which are mostly empty", CUT_TAG) {
+    using dorado::trimmed_batch_size;
+    CHECK(trimmed_batch_size(1024, 1024, 64) == 1024);
+    CHECK(trimmed_batch_size(513, 1024, 64) == 1024);
+    CHECK(trimmed_batch_size(512, 1024, 64) == 512);
+    CHECK(trimmed_batch_size(100, 1024, 64) == 128);
+    // No smaller than the granularity, or a row.
+    CHECK(trimmed_batch_size(3, 1024, 64) == 64);
+    CHECK(trimmed_batch_size(0, 1024, 64) == 64);
+    CHECK(trimmed_batch_size(3, 128, 1) == 4);
+    CHECK(trimmed_batch_size(0, 128, 1) == 1);
+    // Sizes which don't halve into multiples of the granularity are left as they are.
+    CHECK(trimmed_batch_size(10, 960, 64) == 960);
+    CHECK(trimmed_batch_size(10, 1920, 64) == 960);
+}
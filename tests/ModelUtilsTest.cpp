@@ -2,6 +2,10 @@
 
 #include <catch2/catch.hpp>
 
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
 #define TEST_TAG "[ModelUtils]"
 
 TEST_CASE(TEST_TAG " Get model sample rate by name") {
@@ -17,3 +21,47 @@ TEST_CASE(TEST_TAG " Get model sample rate by name") {
         CHECK(dorado::utils::get_sample_rate_by_model_name("blah") == 4000);
     }
 }
+
+TEST_CASE(TEST_TAG " Get model translocation speed by name") {
+    CHECK(dorado::utils::get_bases_per_second_by_model_name(
+                  "dna_r10.4.1_e8.2_5khz_400bps_fast@v4.2.0") == 400.f);
+    CHECK(dorado::utils::get_bases_per_second_by_model_name("dna_r10.4.1_e8.2_260bps_hac@v4.0.0") ==
+          260.f);
+    CHECK(dorado::utils::get_bases_per_second_by_model_name("rna003_120bps_sup@v3") == 120.f);
+    CHECK(dorado::utils::get_bases_per_second_by_model_name("dna_r9.4.1_e8_fast@v3.4") == 400.f);
+    CHECK(dorado::utils::get_bases_per_second_by_model_name("rna002_something") == 70.f);
+}
+
+TEST_CASE(TEST_TAG " Fewest samples for a read length") {
+    // At 5kHz and 400bps, twice as fast is 6.25 samples a base.
+    CHECK(dorado::utils::min_signal_samples_for_length(200, 5000.f, 400.f) == 1250);
+    CHECK(dorado::utils::min_signal_samples_for_length(0, 5000.f, 400.f) == 0);
+    CHECK(dorado::utils::min_signal_samples_for_length(200, 5000.f, 0.f) == 0);
+}
+
+TEST_CASE(TEST_TAG " Models are copied from the models cache") {
+    namespace fs = std::filesystem;
+    const std::string model = "dna_r10.4.1_e8.2_4khz_stereo@v1.1";
+    const auto cache = fs::temp_directory_path() / "models_cache_test";
+    const auto target = fs::temp_directory_path() / "models_cache_test_target";
+    fs::remove_all(cache);
+    fs::remove_all(target);
+    fs::create_directories(target);
+
+    // As a run which downloaded the model left it, under the checksum of its archive.
+    const std::string checksum = "0123456789abcdef";
+    fs::create_directories(cache / "trees" / checksum / model);
+    std::ofstream(cache / "trees" / checksum / model / "config.toml") << "[model]\n";
+    fs::create_directories(cache / "refs");
+    std::ofstream(cache / "refs" / model) << checksum << '\n';
+
+    dorado::utils::set_models_cache(cache);
+    dorado::utils::download_models(target.string(), model);
+    dorado::utils::set_models_cache({});
+
+    CHECK(fs::exists(target / model / "config.toml"));
+    // Nothing is left behind from copying it.
+    CHECK(std::distance(fs::directory_iterator(target), fs::directory_iterator{}) == 1);
+    fs::remove_all(cache);
+    fs::remove_all(target);
+}
@@ -0,0 +1,120 @@
+#include "utils/base_mod_utils.h"
+#include "utils/motif_scanner.h"
+
+#include <catch2/catch.hpp>
+
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#define CUT_TAG "[MotifScanner]"
+
+using dorado::utils::MotifScanner;
+
+namespace {
+
+// The codes used by the motifs below.
+bool iupac_matches(char code, char base) {
+    switch (code) {
+    case 'R':
+        return base == 'A' || base == 'G';
+    case 'Y':
+        return base == 'C' || base == 'T';
+    case 'W':
+        return base == 'A' || base == 'T';
+    case 'D':
+        return base != 'C';
+    case 'H':
+        return base != 'G';
+    case 'N':
+        return true;
+    default:
+        return base == code;
+    }
+}
+
+// Tries every position, as the scanner is checked against.
+std::vector<size_t> naive_hits(const std::string& sequence,
+                               const std::string& motif,
+                               size_t offset) {
+    std::vector<size_t> hits;
+    for (size_t start = 0; start + motif.size() <= sequence.size(); ++start) {
+        size_t i = 0;
+        while (i < motif.size() && iupac_matches(motif[i], sequence[start + i])) {
+            ++i;
+        }
+        if (i == motif.size()) {
+            hits.push_back(start + offset);
+        }
+    }
+    return hits;
+}
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": finds every motif in one pass", CUT_TAG) {
+    MotifScanner scanner;
+    CHECK(scanner.add_motif("CG", 0) == 0);
+    CHECK(scanner.add_motif("DRACH", 2) == 1);
+    CHECK(scanner.add_motif("A", 0) == 2);
+    REQUIRE(scanner.num_motifs() == 3);
+
+    //                      0         1         2
+    //                      012345678901234567890
+    const std::string seq{"CGAGACTTGGACACGTTAACG"};
+    const auto hits = scanner.scan(seq);
+    REQUIRE(hits.size() == 3);
+    // Including the CG which ends the sequence.
+    CHECK(hits[0] == std::vector<size_t>{0, 13, 19});
+    // AGACT and GGACA, but not TAACG.
+    CHECK(hits[1] == std::vector<size_t>{4, 10});
+    CHECK(hits[2] == std::vector<size_t>{2, 4, 10, 12, 17, 18});
+}
+
+TEST_CASE(CUT_TAG ": matches a naive search", CUT_TAG) {
+    std::mt19937 rng(42);
+    // Enough long motifs that they need more than one automaton word.
+    const std::vector<std::pair<std::string, size_t>> motifs{
+            {"CG", 0},   {"DRACH", 2}, {"GATC", 1}, {"CCWGG", 1}, {"N", 0},
+            {"ACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGTACGT", 3},
+            {"RYRYRYRYRYRYRYRYRY", 17}};
+    MotifScanner scanner;
+    for (const auto& [motif, offset] : motifs) {
+        scanner.add_motif(motif, offset);
+    }
+
+    std::string seq(5000, 'A');
+    for (auto& base : seq) {
+        base = "ACGT"[rng() % 4];
+    }
+    // Something for the long motif to find.
+    seq.replace(100, motifs[5].first.size(), motifs[5].first);
+
+    const auto hits = scanner.scan(seq);
+    REQUIRE(hits.size() == motifs.size());
+    for (size_t i = 0; i < motifs.size(); ++i) {
+        CAPTURE(motifs[i].first);
+        CHECK(hits[i] == naive_hits(seq, motifs[i].first, motifs[i].second));
+    }
+    CHECK_FALSE(hits[5].empty());
+}
+
+TEST_CASE(CUT_TAG ": rejects invalid motifs", CUT_TAG) {
+    MotifScanner scanner;
+    CHECK_THROWS_AS(scanner.add_motif("", 0), std::runtime_error);
+    CHECK_THROWS_AS(scanner.add_motif("CXG", 0), std::runtime_error);
+    CHECK_THROWS_AS(scanner.add_motif("CG", 2), std::runtime_error);
+    CHECK_THROWS_AS(scanner.add_motif(std::string(65, 'A'), 0), std::runtime_error);
+    CHECK(scanner.num_motifs() == 0);
+}
+
+TEST_CASE(CUT_TAG ": BaseModContext masks motif hits", CUT_TAG) {
+    dorado::utils::BaseModContext context;
+    context.set_context("CG", 0);
+    context.set_context("DRACH", 2);
+
+    const std::string seq{"CGAGACTTACGAACG"};
+    const std::vector<int> expected{1, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 1, 0};
+    CHECK(context.get_sequence_mask(seq) == expected);
+}
@@ -0,0 +1,133 @@
+#include "utils/MoveTable.h"
+
+#include <catch2/catch.hpp>
+
+#include <random>
+#include <vector>
+
+#define CUT_TAG "[MoveTable]"
+
+using dorado::utils::MoveTable;
+
+namespace {
+
+std::vector<uint8_t> random_moves(size_t len, std::mt19937& gen) {
+    std::bernoulli_distribution is_move(0.3);
+    std::vector<uint8_t> moves(len);
+    for (auto& move : moves) {
+        move = is_move(gen);
+    }
+    return moves;
+}
+
+// Checks every entry, rank and select of table against moves.
+void check_matches(const MoveTable& table, const std::vector<uint8_t>& moves) {
+    REQUIRE(table.size() == moves.size());
+    CHECK(table.to_vector() == moves);
+    size_t rank = 0;
+    std::vector<size_t> move_positions;
+    bool ranks_match = true;
+    for (size_t i = 0; i < moves.size(); ++i) {
+        ranks_match &= table.rank(i) == rank && table[i] == bool(moves[i]);
+        if (moves[i]) {
+            move_positions.push_back(i);
+            ++rank;
+        }
+    }
+    CHECK(ranks_match);
+    CHECK(table.count() == rank);
+    bool selects_match = true;
+    for (size_t n = 0; n < move_positions.size(); ++n) {
+        selects_match &= table.select(n) == move_positions[n];
+    }
+    CHECK(selects_match);
+}
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": packs, ranks and selects moves", CUT_TAG) {
+    std::mt19937 gen(42);
+    // Lengths either side of word and block boundaries.
+    const size_t len = GENERATE(size_t(0), size_t(1), size_t(63), size_t(64), size_t(65),
+                                size_t(511), size_t(512), size_t(513), size_t(100003));
+    const auto moves = random_moves(len, gen);
+    const MoveTable table(moves);
+    check_matches(table, moves);
+
+    // A byte per entry takes 8 times as much as the packed bits, plus their small index.
+    if (len > 100000) {
+        CHECK(table.memory_bytes() * 7 < moves.size());
+    }
+}
+
+TEST_CASE(CUT_TAG ": appends ranges at any offset", CUT_TAG) {
+    std::mt19937 gen(42);
+    const auto source_moves = random_moves(5000, gen);
+    const MoveTable source(source_moves);
+
+    // Ranges of all sorts of lengths, from all sorts of offsets, onto all sorts of offsets.
+    std::uniform_int_distribution<size_t> position(0, source_moves.size());
+    MoveTable table;
+    std::vector<uint8_t> moves;
+    for (int i = 0; i < 100; ++i) {
+        auto begin = position(gen);
+        auto end = position(gen);
+        if (begin > end) {
+            std::swap(begin, end);
+        }
+        table.append(source, begin, end);
+        moves.insert(moves.end(), source_moves.begin() + begin, source_moves.begin() + end);
+    }
+    check_matches(table, moves);
+
+    CHECK(source.slice(17, 4321).to_vector() ==
+          std::vector<uint8_t>(source_moves.begin() + 17, source_moves.begin() + 4321));
+    CHECK(source.slice(100, 100).empty());
+}
+
+TEST_CASE(CUT_TAG ": pushes and pops across block boundaries", CUT_TAG) {
+    std::mt19937 gen(42);
+    auto moves = random_moves(1100, gen);
+    MoveTable table;
+    for (auto move : moves) {
+        table.push_back(move);
+    }
+    check_matches(table, moves);
+
+    // Down through the boundaries at 1024 and 512, and then back up with a run of moves.
+    for (int i = 0; i < 600; ++i) {
+        CHECK(table.back() == bool(moves.back()));
+        table.pop_back();
+        moves.pop_back();
+    }
+    check_matches(table, moves);
+    for (int i = 0; i < 600; ++i) {
+        table.push_back(true);
+        moves.push_back(1);
+    }
+    check_matches(table, moves);
+    CHECK(table == MoveTable(moves));
+
+    table.clear();
+    CHECK(table.empty());
+    CHECK(table.count() == 0);
+}
+
+TEST_CASE(CUT_TAG ": moved-from tables are empty and usable", CUT_TAG) {
+    std::mt19937 gen(42);
+    const auto moves = random_moves(1100, gen);
+    MoveTable table(moves);
+
+    MoveTable moved(std::move(table));
+    check_matches(moved, moves);
+    CHECK(table.empty());
+    CHECK(table.count() == 0);
+    table.push_back(true);
+    CHECK(table.count() == 1);
+
+    table = std::move(moved);
+    check_matches(table, moves);
+    CHECK(moved.empty());
+    CHECK(moved.count() == 0);
+    CHECK(moved == MoveTable());
+}
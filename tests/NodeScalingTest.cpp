@@ -0,0 +1,312 @@
+#include "MessageSinkUtils.h"
+#include "TestUtils.h"
+#include "htslib/sam.h"
+#include "read_pipeline/DuplexSplitNode.h"
+#include "read_pipeline/FakeDataLoader.h"
+#include "read_pipeline/PairingNode.h"
+#include "read_pipeline/ReadPipeline.h"
+#include "read_pipeline/ReadToBamTypeNode.h"
+#include "read_pipeline/ScalerNode.h"
+#include "read_pipeline/StereoDuplexEncoderNode.h"
+#include "utils/bam_utils.h"
+#include "utils/read_utils.h"
+
+#include <catch2/catch.hpp>
+#include <torch/torch.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Times each node on its own at 1, 2, 4... threads, up to the machine's cores, and prints its
+// throughput and scaling efficiency, its throughput as a fraction of the single threaded
+// throughput times the threads.  Contention shows up as efficiency falling off well before the
+// cores run out.  The tests are hidden, as they take a while and their numbers depend on the
+// machine: run them with
+//   dorado_tests "[scaling]"
+#define TEST_GROUP "[.][scaling]"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr int kMaxThreads = 32;
+
+std::vector<int> thread_counts() {
+    const int max_threads =
+            std::clamp(static_cast<int>(std::thread::hardware_concurrency()), 1, kMaxThreads);
+    std::vector<int> counts;
+    for (int threads = 1; threads < max_threads; threads *= 2) {
+        counts.push_back(threads);
+    }
+    counts.push_back(max_threads);
+    return counts;
+}
+
+// Pushes messages through a node with num_threads threads, returning once it has passed them
+// all on.
+using RunNode = std::function<void(int num_threads, std::vector<dorado::Message>& messages)>;
+
+// Runs a node made by make_node(sink, num_threads), pushing messages from num_producers threads,
+// each pushing every num_producers'th message in turn.
+template <typename MakeNode>
+RunNode through_node(MakeNode make_node, bool threads_are_producers = false) {
+    return [make_node, threads_are_producers](int num_threads,
+                                              std::vector<dorado::Message>& messages) {
+        MessageSinkCounter sink(1000);
+        {
+            auto node = make_node(sink, num_threads);
+            const int num_producers = threads_are_producers ? num_threads : 1;
+            std::vector<std::thread> producers;
+            for (int producer = 0; producer < num_producers; ++producer) {
+                producers.emplace_back([&, producer] {
+                    for (size_t i = producer; i < messages.size(); i += num_producers) {
+                        node->push_message(std::move(messages[i]));
+                    }
+                });
+            }
+            for (auto& producer : producers) {
+                producer.join();
+            }
+            // Destroying the node waits for it to pass everything on.
+        }
+        // Not every node terminates its sink.
+        sink.terminate();
+        CHECK(sink.wait_for_terminate() > 0);
+    };
+}
+
+// Times run over fresh messages from make_messages at each thread count, and prints the results.
+void report_scaling(const std::string& name,
+                    const std::function<std::vector<dorado::Message>()>& make_messages,
+                    const RunNode& run) {
+    std::cout << "\n"
+              << name << "\n"
+              << std::setw(8) << "threads" << std::setw(14) << "msgs/s" << std::setw(12)
+              << "efficiency" << "\n";
+    double single_threaded_rate = 0;
+    for (const int num_threads : thread_counts()) {
+        auto messages = make_messages();
+        const auto num_messages = messages.size();
+        const auto start = std::chrono::steady_clock::now();
+        run(num_threads, messages);
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        const double rate = num_messages / std::max(elapsed.count(), 1e-9);
+        if (single_threaded_rate == 0) {
+            single_threaded_rate = rate;
+        }
+        std::cout << std::setw(8) << num_threads << std::fixed << std::setprecision(1)
+                  << std::setw(14) << rate << std::setprecision(2) << std::setw(12)
+                  << rate / (single_threaded_rate * num_threads) << "\n"
+                  << std::defaultfloat;
+        CHECK(rate > 0);
+    }
+}
+
+std::string random_sequence(size_t length, std::mt19937& generator) {
+    static constexpr char kBases[] = "ACGT";
+    std::uniform_int_distribution<int> bases(0, 3);
+    std::string sequence(length, 'A');
+    for (auto& base : sequence) {
+        base = kBases[bases(generator)];
+    }
+    return sequence;
+}
+
+// Basecalled reads of 5000 bases, on 512 channels in turn, one after another on each.
+std::vector<std::shared_ptr<dorado::Read>> make_called_reads(size_t num_reads) {
+    std::mt19937 generator(42);
+    std::vector<std::shared_ptr<dorado::Read>> reads;
+    for (size_t i = 0; i < num_reads; ++i) {
+        auto read = std::make_shared<dorado::Read>();
+        read->read_id = "read_" + std::to_string(i);
+        read->seq = random_sequence(5000, generator);
+        read->qstring = std::string(read->seq.size(), '5');
+        read->sample_rate = 4000;
+        read->raw_data = torch::empty({0}, torch::kFloat16);
+        read->attributes.num_samples = 50000;
+        read->attributes.channel_number = static_cast<int32_t>(i % 512) + 1;
+        read->attributes.mux = 1;
+        read->attributes.read_number = static_cast<int32_t>(i);
+        read->attributes.start_time = "2023-02-21T12:46:01.526+00:00";
+        read->start_time_ms = (i / 512) * 15000;
+        read->run_id = "run";
+        read->flowcell_id = "flowcell";
+        read->model_name = "model";
+        read->is_duplex = false;
+        reads.push_back(std::move(read));
+    }
+    return reads;
+}
+
+template <typename T>
+std::vector<dorado::Message> to_messages(std::vector<T> items) {
+    std::vector<dorado::Message> messages;
+    messages.reserve(items.size());
+    for (auto& item : items) {
+        messages.emplace_back(std::move(item));
+    }
+    return messages;
+}
+
+}  // namespace
+
+TEST_CASE("NodeScaling: ScalerNode", TEST_GROUP) {
+    report_scaling(
+            "ScalerNode",
+            [] {
+                dorado::NullNode unused_sink;
+                dorado::FakeReadOptions options;
+                options.mean_length = 20000;
+                return to_messages(
+                        dorado::FakeDataLoader(unused_sink, options).make_reads(2000));
+            },
+            through_node([](dorado::MessageSink& sink, int num_threads) {
+                return std::make_unique<dorado::ScalerNode>(sink, num_threads);
+            }));
+}
+
+TEST_CASE("NodeScaling: DuplexSplitNode", TEST_GROUP) {
+    const fs::path data_dir = get_split_data_dir();
+    auto read = std::make_shared<dorado::Read>();
+    read->sample_rate = 4000;
+    read->scaling = 0.14620706f;
+    read->offset = -287;
+    read->shift = 94.717316f;
+    read->scale = 26.888939f;
+    read->model_stride = 5;
+    read->read_id = "00a2dd45-f6a9-49ba-86ee-5d2a37b861cb";
+    read->num_trimmed_samples = 10;
+    read->attributes.start_time = "2023-02-21T12:46:01.526+00:00";
+    read->attributes.num_samples = 256790;
+    read->seq = ReadFileIntoString(data_dir / "seq");
+    read->qstring = ReadFileIntoString(data_dir / "qstring");
+    read->moves = dorado::utils::MoveTable(ReadFileIntoVector(data_dir / "moves"));
+    torch::load(read->raw_data, (data_dir / "raw.tensor").string());
+    read->raw_data = read->raw_data.to(torch::kFloat16);
+
+    report_scaling(
+            "DuplexSplitNode",
+            [&read] {
+                std::vector<std::shared_ptr<dorado::Read>> reads;
+                for (int i = 0; i < 200; ++i) {
+                    reads.push_back(dorado::utils::shallow_copy_read(*read));
+                }
+                return to_messages(std::move(reads));
+            },
+            through_node([](dorado::MessageSink& sink, int num_threads) {
+                return std::make_unique<dorado::DuplexSplitNode>(
+                        sink, dorado::DuplexSplitSettings{}, num_threads);
+            }));
+}
+
+TEST_CASE("NodeScaling: PairingNode", TEST_GROUP) {
+    // The node's threads are fixed, so it's the threads pushing to it that are varied.
+    report_scaling(
+            "PairingNode, by producer threads",
+            [] { return to_messages(make_called_reads(20000)); },
+            through_node(
+                    [](dorado::MessageSink& sink, int) {
+                        return std::make_unique<dorado::PairingNode>(sink);
+                    },
+                    true));
+}
+
+TEST_CASE("NodeScaling: StereoDuplexEncoderNode", TEST_GROUP) {
+    const fs::path data_dir = get_stereo_data_dir();
+    auto load_read = [&data_dir](const std::string& strand) {
+        auto read = std::make_shared<dorado::Read>();
+        read->read_id = strand;
+        read->seq = ReadFileIntoString(data_dir / (strand + "_seq"));
+        read->qstring = ReadFileIntoString(data_dir / (strand + "_qstring"));
+        read->moves = dorado::utils::MoveTable(ReadFileIntoVector(data_dir / (strand + "_moves")));
+        torch::load(read->raw_data, (data_dir / (strand + "_raw_data.tensor")).string());
+        read->raw_data = read->raw_data.to(torch::kFloat16);
+        return read;
+    };
+    const auto template_read = load_read("template");
+    const auto complement_read = load_read("complement");
+
+    report_scaling(
+            "StereoDuplexEncoderNode",
+            [&] {
+                std::vector<std::shared_ptr<dorado::ReadPair>> pairs;
+                for (int i = 0; i < 500; ++i) {
+                    auto pair = std::make_shared<dorado::ReadPair>();
+                    pair->read_1 = template_read;
+                    pair->read_2 = complement_read;
+                    pairs.push_back(std::move(pair));
+                }
+                return to_messages(std::move(pairs));
+            },
+            through_node([](dorado::MessageSink& sink, int num_threads) {
+                return std::make_unique<dorado::StereoDuplexEncoderNode>(sink, 5, num_threads);
+            }));
+}
+
+TEST_CASE("NodeScaling: ReadToBamType", TEST_GROUP) {
+    report_scaling(
+            "ReadToBamType", [] { return to_messages(make_called_reads(20000)); },
+            through_node([](dorado::MessageSink& sink, int num_threads) {
+                return std::make_unique<dorado::ReadToBamType>(sink, false, false, num_threads);
+            }));
+}
+
+TEST_CASE("NodeScaling: Aligner", TEST_GROUP) {
+    const auto reference = fs::path(get_aligner_data_dir()) / "target.fq";
+    dorado::utils::HtsReader reader(reference.string());
+    REQUIRE(reader.read());
+
+    report_scaling(
+            "Aligner",
+            [&reader] {
+                std::vector<dorado::BamPtr> records;
+                for (int i = 0; i < 5000; ++i) {
+                    records.emplace_back(bam_dup1(reader.record.get()));
+                }
+                return to_messages(std::move(records));
+            },
+            through_node([&reference](dorado::MessageSink& sink, int num_threads) {
+                return std::make_unique<dorado::utils::Aligner>(sink, reference.string(), 15, 15,
+                                                                1e9, num_threads);
+            }));
+}
+
+TEST_CASE("NodeScaling: HtsWriter", TEST_GROUP) {
+    const auto out_dir = fs::temp_directory_path() / "node_scaling_writer";
+    fs::create_directories(out_dir);
+    const auto out_bam = (out_dir / "out.bam").string();
+
+    report_scaling(
+            "HtsWriter, by compression threads",
+            [] {
+                std::vector<dorado::BamPtr> records;
+                for (const auto& read : make_called_reads(20000)) {
+                    for (auto& record : read->extract_sam_lines(false)) {
+                        records.push_back(std::move(record));
+                    }
+                }
+                return to_messages(std::move(records));
+            },
+            [&out_bam](int num_threads, std::vector<dorado::Message>& messages) {
+                dorado::utils::HtsWriter writer(out_bam, dorado::utils::HtsWriter::BAM,
+                                                num_threads, 0);
+                sam_hdr_t* header = sam_hdr_init();
+                writer.add_header(header);
+                sam_hdr_destroy(header);
+                writer.write_header();
+                for (auto& message : messages) {
+                    writer.push_message(std::move(message));
+                }
+                // Destroying the writer waits for it to write everything.
+            });
+    fs::remove_all(out_dir);
+}
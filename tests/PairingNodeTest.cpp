@@ -0,0 +1,257 @@
+#include "read_pipeline/PairingNode.h"
+
+#include <catch2/catch.hpp>
+#include <torch/torch.h>
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#define TEST_GROUP "[read_pipeline][PairingNode]"
+
+namespace {
+
+// Collects the reads and pairs which are passed on.
+class PairingSink : public dorado::MessageSink {
+public:
+    PairingSink() : MessageSink(100000) {}
+
+    // The read IDs of the pairs passed on, and the IDs of the reads.
+    std::pair<std::set<std::pair<std::string, std::string>>, std::vector<std::string>>
+    get_messages() {
+        std::set<std::pair<std::string, std::string>> pairs;
+        std::vector<std::string> reads;
+        dorado::Message message;
+        while (m_work_queue.try_pop(message)) {
+            if (std::holds_alternative<std::shared_ptr<dorado::ReadPair>>(message)) {
+                const auto& pair = std::get<std::shared_ptr<dorado::ReadPair>>(message);
+                pairs.emplace(pair->read_1->read_id, pair->read_2->read_id);
+            } else {
+                reads.push_back(std::get<std::shared_ptr<dorado::Read>>(message)->read_id);
+            }
+        }
+        return {pairs, reads};
+    }
+
+    std::vector<dorado::Message> take_messages() {
+        std::vector<dorado::Message> messages;
+        dorado::Message message;
+        while (m_work_queue.try_pop(message)) {
+            messages.push_back(std::move(message));
+        }
+        return messages;
+    }
+};
+
+// A 1s read of 1000 bases on channel, starting at start_time_ms.
+std::shared_ptr<dorado::Read> make_read(const std::string& read_id,
+                                        int channel,
+                                        uint64_t start_time_ms) {
+    auto read = std::make_shared<dorado::Read>();
+    read->read_id = read_id;
+    read->seq = std::string(1000, 'A');
+    read->sample_rate = 4000;
+    read->attributes.num_samples = 4000;
+    read->attributes.channel_number = channel;
+    read->attributes.mux = 1;
+    read->run_id = "run";
+    read->flowcell_id = "flowcell";
+    read->start_time_ms = start_time_ms;
+    return read;
+}
+
+}  // namespace
+
+TEST_CASE("PairingNode: pairs consecutive reads on a pore however reads are interleaved",
+          TEST_GROUP) {
+    // Each of 50 channels has a pair of reads 1s apart, and then a read too late to pair.  The
+    // second read of each pair only comes in after every channel's first, as it might from
+    // unordered input.
+    const int num_channels = 50;
+    std::vector<std::shared_ptr<dorado::Read>> reads;
+    std::set<std::pair<std::string, std::string>> expected_pairs;
+    for (int channel = 0; channel < num_channels; ++channel) {
+        reads.push_back(make_read("first_" + std::to_string(channel), channel, 10000));
+    }
+    for (int channel = num_channels - 1; channel >= 0; --channel) {
+        const auto suffix = std::to_string(channel);
+        reads.push_back(make_read("second_" + suffix, channel, 12000));
+        reads.push_back(make_read("late_" + suffix, channel, 30000));
+        expected_pairs.emplace("first_" + suffix, "second_" + suffix);
+    }
+
+    PairingSink sink;
+    {
+        dorado::PairingNode pairing_node(sink);
+        for (auto& read : reads) {
+            pairing_node.push_message(std::move(read));
+        }
+    }
+
+    auto [pairs, read_ids] = sink.get_messages();
+    CHECK(pairs == expected_pairs);
+    // Every read is passed on once as well, whether or not it was paired.
+    CHECK(read_ids.size() == 3 * num_channels);
+    CHECK(std::set<std::string>(read_ids.begin(), read_ids.end()).size() == read_ids.size());
+}
+
+TEST_CASE("PairingNode: reads past the time horizon can't be paired", TEST_GROUP) {
+    // The late read pushes the first out of the horizon before its partner comes in.
+    PairingSink sink;
+    {
+        dorado::PairingNode pairing_node(sink, std::nullopt, 5000, 100);
+        pairing_node.push_message(make_read("first", 1, 10000));
+        pairing_node.push_message(make_read("late", 1, 30000));
+        pairing_node.push_message(make_read("second", 1, 12000));
+    }
+
+    auto [pairs, read_ids] = sink.get_messages();
+    CHECK(pairs.empty());
+    CHECK(read_ids.size() == 3);
+}
+
+TEST_CASE("PairingNode: pairs reads from a pairs file in either order", TEST_GROUP) {
+    const std::string template_1 = "550e8400-e29b-41d4-a716-446655440000";
+    const std::string complement_1 = "550e8400-e29b-41d4-a716-446655440001";
+    const std::string template_2 = "550e8400-e29b-41d4-a716-446655440002";
+    const std::string complement_2 = "550e8400-e29b-41d4-a716-446655440003";
+    const std::map<std::string, std::string> pairs_file{{template_1, complement_1},
+                                                        {template_2, complement_2}};
+
+    PairingSink sink;
+    {
+        dorado::PairingNode pairing_node(sink, pairs_file);
+        pairing_node.push_message(make_read(complement_1, 1, 0));
+        pairing_node.push_message(make_read(template_2, 2, 0));
+        pairing_node.push_message(make_read("550e8400-e29b-41d4-a716-446655440004", 3, 0));
+        pairing_node.push_message(make_read("not_a_uuid", 4, 0));
+        pairing_node.push_message(make_read(template_1, 1, 0));
+        pairing_node.push_message(make_read(complement_2, 2, 0));
+    }
+
+    auto [pairs, read_ids] = sink.get_messages();
+    const std::set<std::pair<std::string, std::string>> expected_pairs{
+            {template_1, complement_1}, {template_2, complement_2}};
+    CHECK(pairs == expected_pairs);
+    CHECK(read_ids.empty());
+}
+
+TEST_CASE("PairingNode: rejects pairs files with invalid read ids", TEST_GROUP) {
+    PairingSink sink;
+    const std::map<std::string, std::string> pairs_file{
+            {"550e8400-e29b-41d4-a716-446655440000", "complement"}};
+    CHECK_THROWS_AS(dorado::PairingNode(sink, pairs_file), std::runtime_error);
+}
+
+TEST_CASE("PairingNode: rejects pairs files pairing a read twice", TEST_GROUP) {
+    PairingSink sink;
+    const std::string read_1 = "550e8400-e29b-41d4-a716-446655440000";
+    const std::string read_2 = "550e8400-e29b-41d4-a716-446655440001";
+    const std::string read_3 = "550e8400-e29b-41d4-a716-446655440002";
+
+    SECTION("Paired with itself") {
+        const std::map<std::string, std::string> pairs_file{{read_1, read_1}};
+        CHECK_THROWS_AS(dorado::PairingNode(sink, pairs_file), std::runtime_error);
+    }
+    SECTION("A complement of two templates") {
+        const std::map<std::string, std::string> pairs_file{{read_1, read_3}, {read_2, read_3}};
+        CHECK_THROWS_AS(dorado::PairingNode(sink, pairs_file), std::runtime_error);
+    }
+    SECTION("The same ID written differently") {
+        // IDs are compared as parsed, not as text.
+        std::string upper_read_1 = read_1;
+        std::transform(upper_read_1.begin(), upper_read_1.end(), upper_read_1.begin(), ::toupper);
+        const std::map<std::string, std::string> pairs_file{{upper_read_1, read_1}};
+        CHECK_THROWS_AS(dorado::PairingNode(sink, pairs_file), std::runtime_error);
+    }
+}
+
+TEST_CASE("PairingNode: spilled reads are passed on with their signal", TEST_GROUP) {
+    const auto spill_directory = std::filesystem::temp_directory_path() / "dorado_pairing_spill";
+    std::map<std::string, torch::Tensor> signals;
+    auto make_read_with_signal = [&signals](const std::string& read_id, uint64_t start_time_ms) {
+        auto read = make_read(read_id, 1, start_time_ms);
+        read->raw_data = torch::randn({4000}).to(torch::kFloat16);
+        signals[read_id] = read->raw_data.clone();
+        return read;
+    };
+
+    SECTION("Pairs generated from pores") {
+        PairingSink sink;
+        {
+            dorado::PairingNode pairing_node(sink, std::nullopt, 60000, 10000, spill_directory);
+            pairing_node.push_message(make_read_with_signal("first", 10000));
+            pairing_node.push_message(make_read_with_signal("second", 12000));
+            pairing_node.push_message(make_read_with_signal("late", 30000));
+        }
+        int num_pairs = 0;
+        int num_reads = 0;
+        for (const auto& message : sink.take_messages()) {
+            if (std::holds_alternative<std::shared_ptr<dorado::ReadPair>>(message)) {
+                const auto& pair = std::get<std::shared_ptr<dorado::ReadPair>>(message);
+                CHECK(torch::equal(pair->read_1->raw_data, signals.at(pair->read_1->read_id)));
+                CHECK(torch::equal(pair->read_2->raw_data, signals.at(pair->read_2->read_id)));
+                ++num_pairs;
+            } else {
+                const auto& read = std::get<std::shared_ptr<dorado::Read>>(message);
+                CHECK(torch::equal(read->raw_data, signals.at(read->read_id)));
+                ++num_reads;
+            }
+        }
+        CHECK(num_pairs == 1);
+        CHECK(num_reads == 3);
+    }
+
+    SECTION("Pairs from a pairs file") {
+        const std::string template_id = "550e8400-e29b-41d4-a716-446655440000";
+        const std::string complement_id = "550e8400-e29b-41d4-a716-446655440001";
+        PairingSink sink;
+        {
+            dorado::PairingNode pairing_node(
+                    sink, std::map<std::string, std::string>{{template_id, complement_id}}, 60000,
+                    10000, spill_directory);
+            pairing_node.push_message(make_read_with_signal(complement_id, 0));
+            pairing_node.push_message(make_read_with_signal(template_id, 0));
+        }
+        const auto messages = sink.take_messages();
+        REQUIRE(messages.size() == 1);
+        const auto& pair = std::get<std::shared_ptr<dorado::ReadPair>>(messages.front());
+        CHECK(pair->read_1->read_id == template_id);
+        CHECK(torch::equal(pair->read_1->raw_data, signals.at(template_id)));
+        CHECK(torch::equal(pair->read_2->raw_data, signals.at(complement_id)));
+    }
+    // The nodes' spill files go with them.
+    CHECK(std::filesystem::is_empty(spill_directory));
+}
+
+TEST_CASE("PairingNode: signal nothing downstream reads isn't spilled", TEST_GROUP) {
+    // Takes no fields of the reads but their sequences.
+    class SequenceSink : public PairingSink {
+    public:
+        uint32_t read_fields_used() const override { return 0; }
+    };
+
+    const auto spill_directory =
+            std::filesystem::temp_directory_path() / "dorado_pairing_spill_unused";
+    SequenceSink sink;
+    {
+        dorado::PairingNode pairing_node(sink, std::nullopt, 60000, 10000, spill_directory);
+        // On pores of their own, so neither is paired before it's cached.
+        for (int channel = 1; channel <= 2; ++channel) {
+            auto read = make_read("read" + std::to_string(channel), channel, 10000);
+            read->raw_data = torch::randn({4000}).to(torch::kFloat16);
+            pairing_node.push_message(std::move(read));
+        }
+    }
+    const auto messages = sink.take_messages();
+    REQUIRE(messages.size() == 2);
+    for (const auto& message : messages) {
+        CHECK(!std::get<std::shared_ptr<dorado::Read>>(message)->raw_data.defined());
+    }
+}
@@ -0,0 +1,102 @@
+#include "read_pipeline/PipelineTelemetry.h"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#define TEST_GROUP "[read_pipeline][PipelineTelemetry]"
+
+using dorado::MessageSink;
+using dorado::PipelineTelemetry;
+using dorado::Read;
+
+namespace {
+
+// A node with nothing draining its input, so its queue is under the test's control.
+class StalledNode : public MessageSink {
+public:
+    StalledNode(size_t capacity) : MessageSink(capacity) {}
+
+    void fill(size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            push_message(std::make_shared<Read>());
+        }
+    }
+};
+
+}  // namespace
+
+TEST_CASE("PipelineTelemetry: Samples give changes since the last", TEST_GROUP) {
+    StalledNode node(10);
+    PipelineTelemetry telemetry;
+    telemetry.add_node("stalled", node);
+
+    node.fill(3);
+    auto samples = telemetry.sample();
+    REQUIRE(samples.size() == 1);
+    CHECK(samples[0].name == "stalled");
+    CHECK(samples[0].queue_size == 3);
+    CHECK(samples[0].queue_capacity == 10);
+    // Nothing has been taken off the queue, nor has anything waited.
+    CHECK(samples[0].messages_per_s == 0);
+    CHECK(samples[0].push_blocked == 0);
+    CHECK(samples[0].pop_waiting == 0);
+
+    samples = telemetry.sample();
+    CHECK(samples[0].queue_size == 3);
+    CHECK(samples[0].time_s >= 0);
+}
+
+TEST_CASE("PipelineTelemetry: Samples are written to the file", TEST_GROUP) {
+    const auto path = std::filesystem::temp_directory_path() / "dorado_telemetry_test.tsv";
+    std::filesystem::remove(path);
+    {
+        StalledNode node(4);
+        node.fill(2);
+        PipelineTelemetry telemetry(std::chrono::milliseconds(10), path.string());
+        telemetry.add_node("stalled", node);
+        telemetry.start();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        telemetry.stop();
+    }
+
+    std::ifstream file(path);
+    std::string line;
+    REQUIRE(std::getline(file, line));
+    CHECK(line.rfind("time_s\tnode\t", 0) == 0);
+    size_t num_rows = 0;
+    while (std::getline(file, line)) {
+        CHECK(line.find("\tstalled\t2\t4\t") != std::string::npos);
+        ++num_rows;
+    }
+    CHECK(num_rows >= 1);
+    file.close();
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("PipelineTelemetry: The bottleneck is the most downstream blocked node", TEST_GROUP) {
+    auto make_sample = [](const std::string& name, double push_blocked) {
+        PipelineTelemetry::NodeSample sample{};
+        sample.name = name;
+        sample.push_blocked = push_blocked;
+        return sample;
+    };
+
+    // Everything upstream of the writer backs up behind it.
+    std::vector<PipelineTelemetry::NodeSample> samples{make_sample("scaler", 0.9),
+                                                       make_sample("basecaller", 2.0),
+                                                       make_sample("writer", 0.5)};
+    CHECK(PipelineTelemetry::find_bottleneck(samples) == 2);
+
+    samples[2].push_blocked = 0.01;
+    CHECK(PipelineTelemetry::find_bottleneck(samples) == 1);
+
+    for (auto& sample : samples) {
+        sample.push_blocked = 0;
+    }
+    CHECK(!PipelineTelemetry::find_bottleneck(samples));
+}
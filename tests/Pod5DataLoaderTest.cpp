@@ -5,6 +5,10 @@
 
 #include <catch2/catch.hpp>
 
+#include <atomic>
+#include <filesystem>
+#include <stdexcept>
+
 #define TEST_GROUP "Pod5DataLoaderTest: "
 
 namespace {
@@ -23,6 +27,15 @@ size_t MockSink::get_read_count() {
     return read_count;
 }
 
+// Refuses every read, as a sink which has failed would.
+class ThrowingSink : public dorado::MessageSink {
+public:
+    ThrowingSink() : MessageSink(1) {}
+    void push_message(dorado::Message&&) override {
+        throw std::runtime_error("Sink failed");
+    }
+};
+
 }  // namespace
 
 TEST_CASE(TEST_GROUP "Test loading single-read POD5 files") {
@@ -133,3 +146,106 @@ TEST_CASE(TEST_GROUP "Load data sorted by channel id.") {
         start_channel_id = i->attributes.channel_number;
     }
 }
+
+TEST_CASE(TEST_GROUP "Prefetch limits don't change the reads loaded.") {
+    std::string data_path(get_data_dir("multi_read_pod5"));
+
+    MessageSinkToVector<std::shared_ptr<dorado::Read>> reference_sink(100);
+    dorado::DataLoader reference_loader(reference_sink, "cpu", 2);
+    reference_loader.load_reads(data_path, true);
+    auto reference_reads = reference_sink.get_messages();
+    REQUIRE(!reference_reads.empty());
+
+    // A budget smaller than any batch still loads one batch at a time.
+    MessageSinkToVector<std::shared_ptr<dorado::Read>> sink(100);
+    dorado::DataLoader loader(sink, "cpu", 2);
+    loader.set_prefetch_limits(1, 1);
+    loader.load_reads(data_path, true);
+    auto reads = sink.get_messages();
+
+    REQUIRE(reads.size() == reference_reads.size());
+    for (size_t i = 0; i < reads.size(); ++i) {
+        CHECK(reads[i]->read_id == reference_reads[i]->read_id);
+    }
+}
+
+TEST_CASE(TEST_GROUP "Prefetching respects max reads.") {
+    std::string data_path(get_data_dir("multi_read_pod5"));
+
+    MessageSinkToVector<std::shared_ptr<dorado::Read>> sink(100);
+    dorado::DataLoader loader(sink, "cpu", 2, 1);
+    loader.load_reads(data_path, true);
+
+    CHECK(sink.get_messages().size() == 1);
+}
+
+// The prefetch thread is stopped, rather than left running, when a read can't be sent on.
+TEST_CASE(TEST_GROUP "Errors sending reads on are passed to the caller.") {
+    std::string data_path(get_data_dir("multi_read_pod5"));
+
+    ThrowingSink sink;
+    dorado::DataLoader loader(sink, "cpu", 2);
+    loader.set_prefetch_limits(1, 1);
+    CHECK_THROWS_WITH(loader.load_reads(data_path, true), "Sink failed");
+}
+
+TEST_CASE(TEST_GROUP "Load multiple files concurrently.") {
+    namespace fs = std::filesystem;
+
+    // Gather several input files, of both formats, into one directory.
+    const auto input_dir = fs::temp_directory_path() / "concurrent_file_loading";
+    fs::remove_all(input_dir);
+    fs::create_directories(input_dir);
+    fs::copy_file(fs::path(get_data_dir("multi_read_pod5")) / "filtered.pod5",
+                  input_dir / "filtered.pod5");
+    fs::copy_file(fs::path(get_pod5_data_dir()) / "single_na24385.pod5",
+                  input_dir / "single_na24385.pod5");
+    fs::copy_file(fs::path(get_fast5_data_dir()) / "single_read.fast5",
+                  input_dir / "single_read.fast5");
+
+    MessageSinkToVector<std::shared_ptr<dorado::Read>> reference_sink(100);
+    dorado::DataLoader reference_loader(reference_sink, "cpu", 1);
+    reference_loader.load_reads(input_dir.string());
+    const auto num_reads = reference_sink.get_messages().size();
+
+    SECTION("All reads are loaded") {
+        MessageSinkToVector<std::shared_ptr<dorado::Read>> sink(100);
+        dorado::DataLoader loader(sink, "cpu", 2);
+        loader.set_max_concurrent_files(3);
+        loader.load_reads(input_dir.string());
+        CHECK(sink.get_messages().size() == num_reads);
+    }
+
+    SECTION("Max reads is shared between files") {
+        MessageSinkToVector<std::shared_ptr<dorado::Read>> sink(100);
+        dorado::DataLoader loader(sink, "cpu", 2, 2);
+        loader.set_max_concurrent_files(3);
+        loader.load_reads(input_dir.string());
+        CHECK(sink.get_messages().size() == 2);
+    }
+
+    fs::remove_all(input_dir);
+}
+
+TEST_CASE(TEST_GROUP "Reads with too few samples are dropped") {
+    auto traversal_order = GENERATE(dorado::DataLoader::UNRESTRICTED,
+                                    dorado::DataLoader::BY_CHANNEL);
+    std::string data_path(get_pod5_data_dir());
+    MockSink mock_sink;
+    dorado::DataLoader loader(mock_sink, "cpu", 1);
+
+    SECTION("Longer reads are kept") {
+        loader.set_min_signal_samples(1);
+        loader.load_reads(data_path, false, traversal_order);
+        CHECK(mock_sink.get_read_count() == 1);
+        CHECK(loader.num_short_reads_dropped() == 0);
+    }
+    SECTION("Shorter reads are dropped") {
+        std::atomic<size_t> num_dropped{0};
+        loader.set_min_signal_samples(size_t(1) << 40, [&num_dropped] { ++num_dropped; });
+        loader.load_reads(data_path, false, traversal_order);
+        CHECK(mock_sink.get_read_count() == 0);
+        CHECK(loader.num_short_reads_dropped() == 1);
+        CHECK(num_dropped == 1);
+    }
+}
@@ -0,0 +1,55 @@
+#include "nn/QuantizedLSTM.h"
+
+#include <catch2/catch.hpp>
+#include <torch/torch.h>
+
+#define CUT_TAG "[QuantizedLSTM]"
+
+namespace {
+
+// Runs x through layer and its quantised equivalent, and returns the largest difference.
+float max_abs_diff_to_fp32(torch::nn::LSTM& layer, const torch::Tensor& x, bool reverse) {
+    auto params = layer->named_parameters();
+    const dorado::nn::QuantizedLSTMLayer quantized(params["weight_ih_l0"], params["weight_hh_l0"],
+                                                  params["bias_ih_l0"], params["bias_hh_l0"]);
+
+    torch::NoGradGuard no_grad;
+    auto expected = std::get<0>(layer(reverse ? x.flip(1) : x));
+    if (reverse) {
+        expected = expected.flip(1);
+    }
+    const auto actual = quantized.forward(x, reverse);
+    REQUIRE(actual.sizes() == expected.sizes());
+    return (actual - expected).abs().max().item<float>();
+}
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": int8 LSTM layers match fp32", CUT_TAG) {
+    torch::manual_seed(42);
+    // 96 and 128 are the fast and hac model layer sizes, which have kernels of their own.  40
+    // isn't a multiple of the SIMD width, and 5 chunks don't fill the last tile of samples.
+    auto layer_size = GENERATE(96, 128, 40);
+    auto reverse = GENERATE(false, true);
+    CAPTURE(layer_size, reverse);
+
+    torch::nn::LSTM layer(torch::nn::LSTMOptions(layer_size, layer_size).batch_first(true));
+    const auto x = torch::rand({5, 200, layer_size}) * 2 - 1;
+    CHECK(max_abs_diff_to_fp32(layer, x, reverse) < 0.01f);
+}
+
+TEST_CASE(CUT_TAG ": non-contiguous input", CUT_TAG) {
+    torch::manual_seed(42);
+    const int layer_size = 96;
+    torch::nn::LSTM layer(torch::nn::LSTMOptions(layer_size, layer_size).batch_first(true));
+    // [T, N, C] transposed to [N, T, C], as the CPU model's convolutions produce.
+    const auto x = (torch::rand({100, 3, layer_size}) * 2 - 1).transpose(0, 1);
+    CHECK(max_abs_diff_to_fp32(layer, x, false) < 0.01f);
+}
+
+TEST_CASE(CUT_TAG ": mismatched weights are rejected", CUT_TAG) {
+    const auto weights = torch::zeros({4 * 96, 96});
+    const auto bias = torch::zeros({4 * 96});
+    CHECK_THROWS(dorado::nn::QuantizedLSTMLayer(weights, torch::zeros({96, 96}), bias, bias));
+    CHECK_THROWS(dorado::nn::QuantizedLSTMLayer(weights, weights, bias, torch::zeros({96})));
+}
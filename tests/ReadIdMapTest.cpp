@@ -0,0 +1,118 @@
+#include "utils/ReadIdMap.h"
+
+#include <catch2/catch.hpp>
+
+#include <map>
+#include <random>
+#include <thread>
+#include <vector>
+
+#define CUT_TAG "[ReadIdMap]"
+
+using dorado::utils::parse_read_id;
+using dorado::utils::ReadIdBytes;
+using dorado::utils::ReadIdMap;
+
+namespace {
+
+std::vector<ReadIdBytes> random_ids(size_t num_ids, std::mt19937& rng) {
+    std::vector<ReadIdBytes> ids(num_ids);
+    for (auto& id : ids) {
+        for (auto& byte : id) {
+            byte = static_cast<uint8_t>(rng());
+        }
+    }
+    return ids;
+}
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": parses UUID read ids", CUT_TAG) {
+    ReadIdBytes id;
+    REQUIRE(parse_read_id("550e8400-E29B-41d4-a716-446655440000", id));
+    const ReadIdBytes expected{0x55, 0x0e, 0x84, 0x00, 0xe2, 0x9b, 0x41, 0xd4,
+                               0xa7, 0x16, 0x44, 0x66, 0x55, 0x44, 0x00, 0x00};
+    CHECK(id == expected);
+
+    CHECK_FALSE(parse_read_id("", id));
+    CHECK_FALSE(parse_read_id("550e8400-e29b-41d4-a716-44665544000", id));
+    CHECK_FALSE(parse_read_id("550e8400-e29b-41d4-a716-4466554400000", id));
+    CHECK_FALSE(parse_read_id("550e8400e-29b-41d4-a716-446655440000", id));
+    CHECK_FALSE(parse_read_id("550e8400-e29b-41d4-a716-44665544000g", id));
+}
+
+TEST_CASE(CUT_TAG ": matches std::map", CUT_TAG) {
+    std::mt19937 rng(42);
+    const auto ids = random_ids(5000, rng);
+
+    // Left empty to start with, so the shards grow as they fill.
+    ReadIdMap<int> map;
+    std::map<ReadIdBytes, int> expected;
+    for (int i = 0; i < 50000; ++i) {
+        const auto& id = ids[rng() % ids.size()];
+        switch (rng() % 3) {
+        case 0:
+            map.insert_or_assign(id, i);
+            expected[id] = i;
+            break;
+        case 1: {
+            auto it = expected.find(id);
+            const auto value = map.extract(id);
+            REQUIRE(value.has_value() == (it != expected.end()));
+            if (value) {
+                CHECK(*value == it->second);
+                expected.erase(it);
+            }
+            break;
+        }
+        default: {
+            auto it = expected.find(id);
+            const auto value = map.extract_or_insert(id, i);
+            REQUIRE(value.has_value() == (it != expected.end()));
+            if (value) {
+                CHECK(*value == it->second);
+                expected.erase(it);
+            } else {
+                expected[id] = i;
+            }
+            break;
+        }
+        }
+    }
+
+    CHECK(map.size() == expected.size());
+    for (const auto& id : ids) {
+        auto it = expected.find(id);
+        const auto value = map.find(id);
+        REQUIRE(value.has_value() == (it != expected.end()));
+        if (value) {
+            CHECK(*value == it->second);
+        }
+    }
+}
+
+TEST_CASE(CUT_TAG ": threads meeting on a key find each other", CUT_TAG) {
+    std::mt19937 rng(42);
+    const auto ids = random_ids(20000, rng);
+
+    // Each key is handed to both threads, and exactly one of them should find the other's value.
+    ReadIdMap<int> map(ids.size());
+    std::vector<int> num_found(2, 0);
+    std::vector<std::thread> threads;
+    for (int thread_id = 0; thread_id < 2; ++thread_id) {
+        threads.emplace_back([&, thread_id] {
+            for (size_t i = 0; i < ids.size(); ++i) {
+                // The threads go through the keys in opposite directions.
+                const size_t index = thread_id == 0 ? i : ids.size() - 1 - i;
+                if (map.extract_or_insert(ids[index], thread_id)) {
+                    ++num_found[thread_id];
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    CHECK(num_found[0] + num_found[1] == int(ids.size()));
+    CHECK(map.size() == 0);
+}
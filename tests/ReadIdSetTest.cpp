@@ -0,0 +1,41 @@
+#include "utils/ReadIdSet.h"
+
+#include <catch2/catch.hpp>
+
+#include <string>
+#include <unordered_set>
+
+#define CUT_TAG "[ReadIdSet]"
+
+using dorado::utils::parse_read_id;
+using dorado::utils::ReadIdBytes;
+using dorado::utils::ReadIdSet;
+
+TEST_CASE(CUT_TAG ": finds UUIDs by their bytes or either case of string", CUT_TAG) {
+    const std::string listed = "550e8400-e29b-41d4-a716-446655440000";
+    const std::string unlisted = "550e8400-e29b-41d4-a716-446655440001";
+    ReadIdSet read_ids;
+    read_ids.add(listed);
+    read_ids.add(listed);
+    read_ids.add("550E8400-E29B-41D4-A716-446655440002");
+    read_ids.finalise();
+    CHECK(read_ids.size() == 2);
+
+    ReadIdBytes bytes;
+    REQUIRE(parse_read_id(listed, bytes));
+    CHECK(read_ids.contains(bytes.data()));
+    CHECK(read_ids.contains(listed));
+    CHECK(read_ids.contains("550e8400-e29b-41d4-a716-446655440002"));
+    REQUIRE(parse_read_id(unlisted, bytes));
+    CHECK_FALSE(read_ids.contains(bytes.data()));
+    CHECK_FALSE(read_ids.contains(unlisted));
+}
+
+TEST_CASE(CUT_TAG ": keeps IDs which aren't UUIDs as strings", CUT_TAG) {
+    const ReadIdSet read_ids(std::unordered_set<std::string>{"read_1", "read_2"});
+    CHECK(read_ids.size() == 2);
+    CHECK(read_ids.contains("read_1"));
+    CHECK_FALSE(read_ids.contains("read_3"));
+    CHECK_FALSE(read_ids.contains("550e8400-e29b-41d4-a716-446655440000"));
+    CHECK(ReadIdSet().empty());
+}
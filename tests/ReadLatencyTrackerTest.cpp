@@ -0,0 +1,63 @@
+#include "read_pipeline/ReadLatencyTracker.h"
+
+#include "MessageSinkUtils.h"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <thread>
+
+#define TEST_GROUP "[read_pipeline][ReadLatencyTracker]"
+
+using dorado::Read;
+using dorado::ReadLatencyTracker;
+
+TEST_CASE("ReadLatencyTracker: Reads are timed through each stage", TEST_GROUP) {
+    MessageSinkToVector<std::shared_ptr<Read>> first(10), second(10), last(10);
+    ReadLatencyTracker tracker;
+    tracker.add_stage("first", first);
+    tracker.add_stage("second", second);
+    tracker.add_stage("last", last);
+    REQUIRE(tracker.num_stages() == 3);
+
+    auto read = std::make_shared<Read>();
+    first.push_message(read);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    second.push_message(read);
+    // Nothing is counted until the read reaches the last stage.
+    CHECK(tracker.total_latency().count() == 0);
+
+    last.push_message(read);
+    REQUIRE(tracker.total_latency().count() == 1);
+    CHECK(tracker.stage_latency(0).count() == 1);
+    CHECK(tracker.stage_latency(0).max() >= 20000);
+    CHECK(tracker.stage_latency(1).max() < tracker.stage_latency(0).max());
+    CHECK(tracker.total_latency().max() >=
+          tracker.stage_latency(0).max() + tracker.stage_latency(1).max());
+}
+
+TEST_CASE("ReadLatencyTracker: Skipped stages are left out", TEST_GROUP) {
+    MessageSinkToVector<std::shared_ptr<Read>> first(10), optional(10), last(10);
+    ReadLatencyTracker tracker;
+    tracker.add_stage("first", first);
+    tracker.add_stage("optional", optional);
+    tracker.add_stage("last", last);
+
+    auto read = std::make_shared<Read>();
+    first.push_message(read);
+    last.push_message(read);
+    CHECK(tracker.stage_latency(0).count() == 1);
+    CHECK(tracker.stage_latency(1).count() == 0);
+    CHECK(tracker.total_latency().count() == 1);
+}
+
+TEST_CASE("ReadLatencyTracker: Nodes stop stamping once it's destroyed", TEST_GROUP) {
+    MessageSinkToVector<std::shared_ptr<Read>> node(10);
+    {
+        ReadLatencyTracker tracker;
+        tracker.add_stage("node", node);
+    }
+    auto read = std::make_shared<Read>();
+    node.push_message(read);
+    CHECK(read->latency_stages_reached == 0);
+}
@@ -59,6 +59,29 @@ TEST_CASE(TEST_GROUP ": Test tag generation", TEST_GROUP) {
     CHECK(bam_aux2i(bam_aux_get(aln, "dx")) == 1);
 }
 
+TEST_CASE(TEST_GROUP ": Released signal still counts towards tags", TEST_GROUP) {
+    dorado::Read test_read;
+    test_read.read_id = "read1";
+    test_read.raw_data = torch::empty(4000);
+    test_read.seq = "ACGT";
+    test_read.qstring = "////";
+    test_read.sample_rate = 4000.0;
+    test_read.num_trimmed_samples = 132;
+    test_read.run_id = "xyz";
+    test_read.model_name = "test_model";
+    test_read.is_duplex = false;
+
+    test_read.release_raw_data();
+    CHECK_FALSE(test_read.raw_data.defined());
+    CHECK(test_read.raw_data_size() == 4000);
+
+    auto alignments = test_read.extract_sam_lines(false);
+    REQUIRE(alignments.size() == 1);
+    bam1_t* aln = alignments[0].get();
+    CHECK(bam_aux2i(bam_aux_get(aln, "ns")) == 4132);
+    CHECK(bam_aux2f(bam_aux_get(aln, "du")) == Approx(1.033).margin(1e-6));
+}
+
 TEST_CASE(TEST_GROUP ": Test sam record generation", TEST_GROUP) {
     dorado::Read test_read{};
     SECTION("Generating sam record for empty read throws") {
@@ -148,6 +171,10 @@ TEST_CASE(TEST_GROUP ": Methylation tag generation", TEST_GROUP) {
     read.read_id = "read";
     read.seq = "ACAGTGACTAAACTC";
     read.qstring = "***************";
+    // Every base was scored.
+    for (uint32_t i = 0; i < read.seq.size(); ++i) {
+        read.base_mod_positions.push_back(i);
+    }
     read.base_mod_probs = modbase_probs;
 
     std::string methylation_tag;
@@ -229,3 +256,68 @@ TEST_CASE(TEST_GROUP ": Methylation tag generation", TEST_GROUP) {
         CHECK(bam_aux_get(aln, "ML") == NULL);
     }
 }
+
+TEST_CASE(TEST_GROUP ": Methylation tags of sparsely scored bases", TEST_GROUP) {
+    // Only the Cs followed by G are scored with 5mC.
+    dorado::Read read;
+    read.read_id = "read";
+    read.seq = "ACGTCACGCA";
+    read.qstring = "**********";
+    read.base_mod_positions = {1, 6};
+    read.base_mod_probs = {
+            0, 0, 10,  245, 0, 0,  // C 5mC (weak call)
+            0, 0, 100, 155, 0, 0,  // C 5mC
+    };
+
+    SECTION("in context") {
+        read.base_mod_info =
+                std::make_shared<dorado::utils::BaseModInfo>("ACMGT", "5mC", "_:XG:_:_");
+        read.base_mod_probs = {0, 10, 245, 0, 0, 0, 100, 155, 0, 0};
+
+        auto lines = read.extract_sam_lines(false, 200);
+        REQUIRE(!lines.empty());
+        bam1_t* aln = lines[0].get();
+        CHECK_THAT(bam_aux2Z(bam_aux_get(aln, "MM")), Equals("C+m?,0,1;"));
+        require_sam_tag_B_int_matches(bam_aux_get(aln, "ML"), {245, 155});
+    }
+
+    SECTION("in all contexts, where bases which weren't scored only pass a threshold of 0") {
+        read.base_mod_info =
+                std::make_shared<dorado::utils::BaseModInfo>("AXCYGT", "6mA 5mC", "");
+
+        auto lines = read.extract_sam_lines(false, 10);
+        REQUIRE(!lines.empty());
+        bam1_t* aln = lines[0].get();
+        CHECK_THAT(bam_aux2Z(bam_aux_get(aln, "MM")), Equals("A+a.;C+m.,0,1;"));
+        require_sam_tag_B_int_matches(bam_aux_get(aln, "ML"), {245, 155});
+
+        lines = read.extract_sam_lines(false, 0);
+        REQUIRE(!lines.empty());
+        aln = lines[0].get();
+        CHECK_THAT(bam_aux2Z(bam_aux_get(aln, "MM")), Equals("A+a.,0,0,0;C+m.,0,0,0,0;"));
+        require_sam_tag_B_int_matches(bam_aux_get(aln, "ML"), {0, 0, 0, 245, 0, 155, 0});
+    }
+
+    SECTION("mismatched with the sequence") {
+        read.base_mod_info =
+                std::make_shared<dorado::utils::BaseModInfo>("AXCYGT", "6mA 5mC", "");
+        read.base_mod_positions = {1, 10};
+        CHECK_THROWS(read.extract_sam_lines(false, 10));
+    }
+}
+
+TEST_CASE(TEST_GROUP ": Read groups stay valid after others are looked up", TEST_GROUP) {
+    dorado::Read first;
+    first.run_id = "run_a";
+    first.model_name = "model";
+    dorado::Read second;
+    second.run_id = "run_b";
+    second.model_name = "model";
+    dorado::Read unnamed;
+
+    const auto first_group = first.read_group();
+    CHECK(second.read_group().str() == "run_b_model");
+    CHECK(unnamed.read_group().empty());
+    CHECK(first_group.str() == "run_a_model");
+    CHECK(first.read_group() == first_group);
+}
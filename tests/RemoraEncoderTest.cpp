@@ -2,6 +2,9 @@
 #include "utils/sequence_utils.h"
 
 #include <catch2/catch.hpp>
+#include <torch/torch.h>
+
+#include <numeric>
 
 #define TEST_GROUP "[remora_encoder]"
 
@@ -95,3 +98,65 @@ TEST_CASE("Encode sequence for modified basecalling", TEST_GROUP) {
     // clang-format on    
     CHECK(expected_slice2 == slice2.data);
 }
+
+TEST_CASE("Encode several contexts at once for modified basecalling", TEST_GROUP) {
+    const size_t BLOCK_STRIDE = 2;
+    const size_t SLICE_BLOCKS = 6;
+    const size_t CONTEXT_SAMPLES = SLICE_BLOCKS * BLOCK_STRIDE;
+    std::string sequence{"TATTCAGTAC"};
+    auto seq_ints = dorado::utils::sequence_to_ints(sequence);
+    std::vector<uint8_t> moves{1, 1, 0, 1, 0, 0, 1, 1, 0, 1, 0, 1, 0, 0, 1, 0, 1, 1, 0, 0};
+    auto seq_to_sig_map =
+            dorado::utils::moves_to_map(moves, BLOCK_STRIDE, moves.size() * BLOCK_STRIDE);
+    const auto signal = torch::arange(1, int64_t(moves.size() * BLOCK_STRIDE) + 1)
+                                .to(torch::kFloat16);
+
+    dorado::RemoraEncoder encoder(BLOCK_STRIDE, CONTEXT_SAMPLES, 1, 1);
+    encoder.init(seq_ints, seq_to_sig_map);
+
+    // Padded at the start, unpadded, and padded at the end.
+    const std::vector<size_t> positions{0, 4, 9};
+    const auto contexts = encoder.get_contexts(positions, signal);
+    REQUIRE(contexts.signals.sizes() == std::vector<int64_t>{3, CONTEXT_SAMPLES});
+    REQUIRE(contexts.signals.dtype() == torch::kFloat16);
+    REQUIRE(contexts.kmers.sizes() == std::vector<int64_t>{3, 12, CONTEXT_SAMPLES});
+
+    for (size_t i = 0; i < positions.size(); ++i) {
+        CAPTURE(i);
+        const auto context = encoder.get_context(positions[i]);
+        const auto kmers = contexts.kmers[i].flatten().contiguous();
+        const auto* const kmers_ptr = kmers.data_ptr<float>();
+        CHECK(std::vector<float>(kmers_ptr, kmers_ptr + kmers.numel()) == context.data);
+
+        using torch::indexing::Slice;
+        const auto expected_signal = torch::constant_pad_nd(
+                signal.index({Slice(context.first_sample,
+                                    context.first_sample + context.num_samples)}),
+                {int64_t(context.lead_samples_needed), int64_t(context.tail_samples_needed)});
+        CHECK(torch::equal(contexts.signals[i], expected_signal));
+    }
+}
+
+TEST_CASE("Kmer bases expand to the one-hot encoding", TEST_GROUP) {
+    const size_t BLOCK_STRIDE = 2;
+    std::string sequence{"TATTCAGTAC"};
+    auto seq_ints = dorado::utils::sequence_to_ints(sequence);
+    std::vector<uint8_t> moves{1, 1, 0, 1, 0, 0, 1, 1, 0, 1, 0, 1, 0, 0, 1, 0, 1, 1, 0, 0};
+    auto seq_to_sig_map =
+            dorado::utils::moves_to_map(moves, BLOCK_STRIDE, moves.size() * BLOCK_STRIDE);
+    const auto signal = torch::randn({int64_t(moves.size() * BLOCK_STRIDE)});
+
+    dorado::RemoraEncoder encoder(BLOCK_STRIDE, 6 * BLOCK_STRIDE, 1, 2);
+    encoder.init(seq_ints, seq_to_sig_map);
+
+    std::vector<size_t> positions(sequence.size());
+    std::iota(positions.begin(), positions.end(), 0);
+    using KmerEncoding = dorado::RemoraEncoder::KmerEncoding;
+    const auto one_hot = encoder.get_contexts(positions, signal, KmerEncoding::OneHot);
+    const auto bases = encoder.get_contexts(positions, signal, KmerEncoding::Bases);
+    REQUIRE(bases.kmers.dtype() == torch::kInt8);
+    CHECK(bases.kmers.sizes() == std::vector<int64_t>{10, 4, 12});
+    CHECK(torch::equal(bases.signals, one_hot.signals));
+    CHECK(torch::equal(dorado::RemoraEncoder::expand_kmer_bases(bases.kmers, torch::kFloat32),
+                       one_hot.kmers));
+}
@@ -0,0 +1,98 @@
+#include "nn/RemoteModelRunner.h"
+#include "utils/socket_utils.h"
+
+#include <catch2/catch.hpp>
+#include <torch/torch.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#define CUT_TAG "[RemoteModelRunner]"
+
+#ifndef _WIN32
+
+namespace {
+
+// Decodes each chunk to its first sample, so the calls can be checked against the input.
+class FakeRunner final : public dorado::ModelRunnerBase {
+public:
+    void accept_chunk(int chunk_idx, const torch::Tensor& chunk) final {
+        m_input.index_put_({chunk_idx}, chunk);
+    }
+    std::vector<dorado::DecodedChunk> call_chunks(int num_chunks) final {
+        std::vector<dorado::DecodedChunk> decoded;
+        for (int i = 0; i < num_chunks; ++i) {
+            const float first = m_input[i][0].item<float>();
+            decoded.push_back({std::to_string(first), "!", {uint8_t(i), 1}});
+        }
+        return decoded;
+    }
+    size_t model_stride() const final { return 5; }
+    size_t chunk_size() const final { return m_input.size(1); }
+    size_t batch_size() const final { return m_input.size(0); }
+    std::string device() const final { return "fake"; }
+
+private:
+    torch::Tensor m_input{torch::zeros({4, 20}, torch::kFloat32)};
+};
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": batches are called on the worker's runners", CUT_TAG) {
+    dorado::utils::TcpSocketServer server(0);
+    const std::vector<dorado::Runner> runners{std::make_shared<FakeRunner>()};
+    std::atomic<bool> stop{false};
+    std::thread worker([&] { dorado::serve_remote_runners(server, runners, stop); });
+
+    {
+        const auto remote = dorado::connect_remote_runners("localhost:" +
+                                                           std::to_string(server.port()));
+        REQUIRE(remote.size() == 1);
+        CHECK(remote[0]->model_stride() == 5);
+        CHECK(remote[0]->chunk_size() == 20);
+        CHECK(remote[0]->batch_size() == 4);
+        CHECK(remote[0]->device() == "localhost:" + std::to_string(server.port()) + "/fake");
+
+        // The worker's only runner is taken.
+        CHECK_THROWS(dorado::RemoteModelRunner("localhost", server.port()));
+
+        for (int batch = 0; batch < 2; ++batch) {
+            for (int i = 0; i < 3; ++i) {
+                remote[0]->accept_chunk(i, torch::full({20}, batch + i + 0.5f, torch::kFloat16));
+            }
+            const auto decoded = remote[0]->call_chunks(3);
+            REQUIRE(decoded.size() == 3);
+            for (int i = 0; i < 3; ++i) {
+                CHECK(decoded[i].sequence == std::to_string(batch + i + 0.5f));
+                CHECK(decoded[i].qstring == "!");
+                CHECK(decoded[i].moves == std::vector<uint8_t>{uint8_t(i), 1});
+            }
+        }
+        CHECK(remote[0]->call_chunks(0).empty());
+    }
+
+    // Once the runner disconnects, which the worker notices in its own time, it can be
+    // connected to again.
+    bool reconnected = false;
+    for (int attempt = 0; attempt < 100 && !reconnected; ++attempt) {
+        try {
+            dorado::RemoteModelRunner runner("localhost", server.port());
+            reconnected = true;
+        } catch (const std::runtime_error&) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+    CHECK(reconnected);
+
+    stop = true;
+    worker.join();
+}
+
+TEST_CASE(CUT_TAG ": addresses must have a port", CUT_TAG) {
+    CHECK_THROWS(dorado::connect_remote_runners("localhost"));
+    CHECK_THROWS(dorado::connect_remote_runners("localhost:port"));
+    CHECK_THROWS(dorado::connect_remote_runners("localhost:0"));
+}
+
+#endif  // _WIN32
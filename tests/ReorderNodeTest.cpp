@@ -0,0 +1,125 @@
+#include "read_pipeline/ReorderNode.h"
+
+#include "MessageSinkUtils.h"
+
+#include <catch2/catch.hpp>
+#include <htslib/sam.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define TEST_GROUP "[read_pipeline][ReorderNode]"
+
+namespace {
+
+dorado::BamPtr make_record(uint64_t sequence_number, const std::string& name) {
+    dorado::BamPtr record(bam_init1());
+    bam_set1(record.get(), name.size(), name.c_str(), 4, -1, -1, 0, 0, nullptr, -1, -1, 0, 0,
+             nullptr, nullptr, 0);
+    record->id = sequence_number;
+    return record;
+}
+
+std::vector<std::string> names_of(const std::vector<dorado::BamPtr>& records) {
+    std::vector<std::string> names;
+    for (const auto& record : records) {
+        names.push_back(bam_get_qname(record.get()));
+    }
+    return names;
+}
+
+// Collects the names of the records pushed to it on a thread of its own, so that they can be
+// checked while the node feeding it is still running.
+class NameCollector : public dorado::MessageSink {
+public:
+    NameCollector() : MessageSink(100) {
+        m_thread = std::thread([this] {
+            dorado::Message message;
+            while (m_work_queue.try_pop(message)) {
+                std::lock_guard lock(m_mutex);
+                m_names.push_back(bam_get_qname(std::get<dorado::BamPtr>(message).get()));
+                m_names_cv.notify_all();
+            }
+        });
+    }
+    ~NameCollector() {
+        terminate();
+        wait_for_terminate();
+    }
+
+    // The names collected once there are at least num_names, or after a few seconds.
+    std::vector<std::string> wait_for(size_t num_names) {
+        std::unique_lock lock(m_mutex);
+        m_names_cv.wait_for(lock, std::chrono::seconds(10),
+                            [this, num_names] { return m_names.size() >= num_names; });
+        return m_names;
+    }
+
+    std::vector<std::string> wait_for_terminate() {
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+        return m_names;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_names_cv;
+    std::vector<std::string> m_names;
+    std::thread m_thread;
+};
+
+}  // namespace
+
+TEST_CASE("ReorderNode: puts records back in load order", TEST_GROUP) {
+    MessageSinkToVector<dorado::BamPtr> sink(100);
+    {
+        dorado::ReorderNode reorder(sink, 10);
+        for (uint64_t number : {3, 1, 2, 5, 4}) {
+            reorder.push_message(make_record(number, std::to_string(number)));
+        }
+        // A second record of read 4, e.g. of a subread, which still goes with the first, as read
+        // 5 is held until a later read comes.
+        reorder.push_message(make_record(4, "4b"));
+    }
+    CHECK(names_of(sink.get_messages()) ==
+          std::vector<std::string>{"1", "2", "3", "4", "4b", "5"});
+}
+
+TEST_CASE("ReorderNode: releases records past gaps once enough are held", TEST_GROUP) {
+    MessageSinkToVector<dorado::BamPtr> sink(100);
+    {
+        dorado::ReorderNode reorder(sink, 2);
+        // Read 1 was filtered out, so never comes.
+        for (uint64_t number : {3, 2, 5, 4}) {
+            reorder.push_message(make_record(number, std::to_string(number)));
+        }
+        // Later reads have gone on by now, so this one is passed on as it is.
+        reorder.push_message(make_record(1, "1"));
+        reorder.push_message(make_record(0, "unnumbered"));
+    }
+    // Nothing after read 5 came, so it was held until the end.
+    CHECK(names_of(sink.get_messages()) ==
+          std::vector<std::string>{"2", "3", "4", "1", "unnumbered", "5"});
+}
+
+TEST_CASE("ReorderNode: skipped reads aren't waited for", TEST_GROUP) {
+    NameCollector sink;
+    {
+        dorado::ReorderNode reorder(sink, 100);
+        // Read 1 was filtered out.  Read 2 goes on once read 3 has come, long before the
+        // window fills.
+        reorder.skip(1);
+        reorder.push_message(make_record(3, "3"));
+        reorder.push_message(make_record(2, "2"));
+        CHECK(sink.wait_for(1) == std::vector<std::string>{"2"});
+        // A read skipped after later reads have gone on changes nothing.
+        reorder.skip(1);
+    }
+    CHECK(sink.wait_for_terminate() == std::vector<std::string>{"2", "3"});
+}
@@ -0,0 +1,88 @@
+#include "read_pipeline/SampleRateRouter.h"
+
+#include "MessageSinkUtils.h"
+
+#include <catch2/catch.hpp>
+
+#define TEST_GROUP "[read_pipeline][SampleRateRouter]"
+
+using dorado::Message;
+using dorado::Read;
+using dorado::ReadPair;
+using dorado::SampleRateRouter;
+
+namespace {
+
+std::shared_ptr<Read> make_read(uint64_t sample_rate) {
+    auto read = std::make_shared<Read>();
+    read->sample_rate = sample_rate;
+    return read;
+}
+
+}  // namespace
+
+TEST_CASE("SampleRateRouter: Reads are routed by sample rate", TEST_GROUP) {
+    MessageSinkToVector<std::shared_ptr<Read>> sink_4khz(100);
+    MessageSinkToVector<std::shared_ptr<Read>> sink_5khz(100);
+    {
+        SampleRateRouter router(sink_4khz);
+        router.route(5000, sink_5khz);
+
+        router.push_message(make_read(4000));
+        router.push_message(make_read(5000));
+
+        std::vector<Message> batch;
+        batch.push_back(make_read(5000));
+        batch.push_back(make_read(5000));
+        batch.push_back(make_read(4000));
+        // No sink of its own, so it goes to the default.
+        batch.push_back(make_read(3012));
+        router.push_messages(std::move(batch));
+        CHECK(batch.empty());
+
+        router.terminate();
+    }
+
+    const auto reads_4khz = sink_4khz.get_messages();
+    const auto reads_5khz = sink_5khz.get_messages();
+    REQUIRE(reads_4khz.size() == 3);
+    REQUIRE(reads_5khz.size() == 3);
+    CHECK(reads_4khz[0]->sample_rate == 4000);
+    CHECK(reads_4khz[1]->sample_rate == 4000);
+    CHECK(reads_4khz[2]->sample_rate == 3012);
+    for (const auto& read : reads_5khz) {
+        CHECK(read->sample_rate == 5000);
+    }
+}
+
+TEST_CASE("SampleRateRouter: Other messages go to the default sink", TEST_GROUP) {
+    MessageSinkToVector<std::shared_ptr<ReadPair>> default_sink(100);
+    MessageSinkToVector<std::shared_ptr<Read>> sink_5khz(100);
+    {
+        SampleRateRouter router(default_sink);
+        router.route(5000, sink_5khz);
+        router.push_message(std::make_shared<ReadPair>());
+    }
+    CHECK(default_sink.get_messages().size() == 1);
+    CHECK(sink_5khz.get_messages().empty());
+}
+
+TEST_CASE("SampleRateRouter: Sinks fed by another router terminate after both", TEST_GROUP) {
+    MessageSinkToVector<std::shared_ptr<Read>> default_sink(100);
+    MessageSinkToVector<std::shared_ptr<Read>> sink_5khz(100);
+    {
+        SampleRateRouter router(default_sink);
+        // Routing two sample rates to one sink counts the router once.
+        router.route(5000, sink_5khz).route(5012, sink_5khz);
+        dorado::MessageRouter other_router(sink_5khz);
+
+        router.push_message(make_read(5012));
+        router.terminate();
+
+        // The sink must still accept messages from the other router.
+        other_router.push_message(make_read(5000));
+        other_router.terminate();
+    }
+    CHECK(sink_5khz.get_messages().size() == 2);
+    CHECK(default_sink.get_messages().empty());
+}
@@ -0,0 +1,42 @@
+#include "decode/scan.h"
+
+#include <catch2/catch.hpp>
+#include <torch/torch.h>
+
+#define CUT_TAG "[CRFScan]"
+
+TEST_CASE(CUT_TAG ": native scans match libtorch", CUT_TAG) {
+    torch::manual_seed(42);
+    // state_len 2 falls back to the scalar code for backward scores, and 3-5 are what models
+    // use.
+    auto state_len = GENERATE(2, 3, 4, 5);
+    CAPTURE(state_len);
+    const int num_scores = 4 << (2 * state_len);
+    const float fixed_stay_score = 2.f;
+
+    const auto scores = torch::randn({150, 3, num_scores}) * 2;
+    const auto fwd = dorado::forward_scores(scores, fixed_stay_score);
+    const auto bwd = dorado::backward_scores(scores, fixed_stay_score);
+    const auto expected_fwd = dorado::forward_scores_torch(scores, fixed_stay_score);
+    const auto expected_bwd = dorado::backward_scores_torch(scores, fixed_stay_score);
+
+    REQUIRE(fwd.sizes() == expected_fwd.sizes());
+    REQUIRE(bwd.sizes() == expected_bwd.sizes());
+    CHECK(torch::allclose(fwd, expected_fwd, 1e-4, 1e-3));
+    CHECK(torch::allclose(bwd, expected_bwd, 1e-4, 1e-3));
+}
+
+TEST_CASE(CUT_TAG ": native scans of a slice of chunks", CUT_TAG) {
+    torch::manual_seed(42);
+    const float fixed_stay_score = 2.f;
+    const auto scores = torch::randn({100, 8, 1024}) * 2;
+    // CPUDecoder hands each thread a slice of its chunks, which isn't contiguous.
+    using Slice = torch::indexing::Slice;
+    const auto slice = scores.index({Slice(), Slice(2, 5)});
+    REQUIRE_FALSE(slice.is_contiguous());
+
+    CHECK(torch::allclose(dorado::forward_scores(slice, fixed_stay_score),
+                          dorado::forward_scores(slice.contiguous(), fixed_stay_score)));
+    CHECK(torch::allclose(dorado::backward_scores(slice, fixed_stay_score),
+                          dorado::backward_scores_torch(slice, fixed_stay_score), 1e-4, 1e-3));
+}
@@ -1,13 +1,37 @@
+#include "utils/cpu_dispatch.h"
 #include "utils/sequence_utils.h"
 
 #include <catch2/catch.hpp>
 
+#include <cmath>
+#include <cstdint>
 #include <cstdlib>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
 
 #define TEST_GROUP "[utils]"
 
 using namespace dorado::utils;
 
+namespace {
+
+// 100 kb, so the vectorised loops run many times, plus a few bases so their tails do too.
+constexpr size_t kLongSequenceLength = 100000 + 13;
+
+std::string random_sequence(size_t len, std::mt19937& gen) {
+    const std::string bases("ACGT");
+    std::uniform_int_distribution<int> dist(0, 3);
+    std::string sequence(len, ' ');
+    for (auto& base : sequence) {
+        base = bases[dist(gen)];
+    }
+    return sequence;
+}
+
+}  // namespace
+
 TEST_CASE(TEST_GROUP ": Test base_to_int") {
     CHECK(base_to_int('A') == 0);
     CHECK(base_to_int('C') == 1);
@@ -47,6 +71,56 @@ TEST_CASE(TEST_GROUP "reverse_complement") {
     }
 }
 
+TEST_CASE(TEST_GROUP "reverse_complement into a buffer") {
+    std::mt19937 gen(42);
+    const auto sequence = random_sequence(kLongSequenceLength, gen);
+    std::string expected(sequence.rbegin(), sequence.rend());
+    for (auto& base : expected) {
+        base = "TGCA"[base_to_int(base)];
+    }
+
+    // The buffer's old contents, whether longer or shorter, are replaced.
+    std::string rev_comp(GENERATE(size_t(0), size_t(7), kLongSequenceLength * 2), 'N');
+    dorado::utils::reverse_complement(sequence, rev_comp);
+    CHECK(rev_comp == expected);
+    CHECK(dorado::utils::reverse_complement(sequence) == expected);
+}
+
+TEST_CASE(TEST_GROUP "sequence_to_ints into a buffer") {
+    std::mt19937 gen(42);
+    const auto sequence = random_sequence(kLongSequenceLength, gen);
+    std::vector<int> expected;
+    for (char base : sequence) {
+        expected.push_back(static_cast<int>(std::string("ACGT").find(base)));
+    }
+
+    std::vector<int> ints(3, -1);
+    sequence_to_ints(sequence, ints);
+    CHECK(ints == expected);
+}
+
+TEST_CASE(TEST_GROUP "convert_nt16_to_str") {
+    // Random nt16 codes, rather than just ACGT, so every entry of the table is looked up.
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> dist(0, 255);
+    const std::string kNt16Chars = "=ACMGRSVTWYHKDBN";
+    const size_t len = GENERATE(size_t(0), size_t(1), size_t(31), size_t(32), size_t(33),
+                                kLongSequenceLength);
+    std::vector<uint8_t> packed((len + 1) / 2);
+    std::string expected;
+    for (auto& code : packed) {
+        code = static_cast<uint8_t>(dist(gen));
+        expected += kNt16Chars[code >> 4];
+        expected += kNt16Chars[code & 0xf];
+    }
+    expected.resize(len);
+
+    CHECK(convert_nt16_to_str(packed.data(), len) == expected);
+    std::string seq(5, '*');
+    convert_nt16_to_str(packed.data(), len, seq);
+    CHECK(seq == expected);
+}
+
 TEST_CASE(TEST_GROUP "mean_q_score") {
     CHECK(dorado::utils::mean_qscore_from_qstring("") == 0.0f);
 
@@ -71,3 +145,83 @@ TEST_CASE(TEST_GROUP "mean_q_score") {
         CHECK(dorado::utils::mean_qscore_from_qstring(str) == Approx(score));
     }
 }
+
+TEST_CASE(TEST_GROUP "mean_q_score of a long read") {
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> dist(0, 50);
+    std::string q_string(kLongSequenceLength, ' ');
+    double total_error = 0.0;
+    for (auto& qchar : q_string) {
+        const int q = dist(gen);
+        qchar = static_cast<char>('!' + q);
+        total_error += std::pow(10.0, -q / 10.0);
+    }
+    const double expected = -10.0 * std::log10(total_error / q_string.size());
+    CHECK(dorado::utils::mean_qscore_from_qstring(q_string) == Approx(expected).epsilon(1e-4));
+}
+
+TEST_CASE(TEST_GROUP "moves_to_map and move_cum_sums") {
+    // A 6 kHz sized move table, about 1 in 3 of them moves, with lengths either side of the
+    // vectorised block sizes.
+    std::mt19937 gen(42);
+    std::bernoulli_distribution is_move(0.3);
+    const size_t len = GENERATE(size_t(0), size_t(1), size_t(7), size_t(8), size_t(33),
+                                kLongSequenceLength);
+    const size_t block_stride = 6;
+    const size_t signal_len = len * block_stride + 3;
+    std::vector<uint8_t> moves(len);
+    std::vector<uint64_t> expected_map, expected_sums;
+    uint64_t total = 0;
+    for (size_t i = 0; i < len; ++i) {
+        moves[i] = is_move(gen);
+        if (moves[i]) {
+            expected_map.push_back(i * block_stride);
+        }
+        total += moves[i];
+        expected_sums.push_back(total);
+    }
+    expected_map.push_back(signal_len);
+
+    CHECK(moves_to_map(moves, block_stride, signal_len) == expected_map);
+    CHECK(moves_to_map(MoveTable(moves), block_stride, signal_len) == expected_map);
+    CHECK(move_cum_sums(moves) == expected_sums);
+
+    // The buffers' old contents, whether longer or shorter, are replaced.
+    std::vector<uint64_t> map(GENERATE(size_t(0), size_t(5), kLongSequenceLength * 2), 99);
+    std::vector<uint64_t> sums(map);
+    moves_to_map(moves, block_stride, signal_len, map);
+    move_cum_sums(moves, sums);
+    CHECK(map == expected_map);
+    CHECK(sums == expected_sums);
+}
+
+TEST_CASE(TEST_GROUP "generic and vectorised kernels agree") {
+    std::mt19937 gen(42);
+    const auto sequence = random_sequence(kLongSequenceLength, gen);
+    std::string qstring(kLongSequenceLength, ' ');
+    std::uniform_int_distribution<int> qscore(0, 50);
+    for (auto& q : qstring) {
+        q = static_cast<char>(qscore(gen) + 33);
+    }
+    std::vector<uint8_t> moves(kLongSequenceLength);
+    std::bernoulli_distribution is_move(0.3);
+    for (auto& move : moves) {
+        move = is_move(gen);
+    }
+
+    auto run_kernels = [&] {
+        return std::make_tuple(reverse_complement(sequence), mean_qscore_from_qstring(qstring),
+                               moves_to_map(moves, 6, moves.size() * 6), move_cum_sums(moves));
+    };
+    const auto best_isa = cpu_isa();
+    const auto vectorised = run_kernels();
+    set_cpu_isa(CpuIsa::GENERIC);
+    const auto generic = run_kernels();
+    set_cpu_isa(best_isa);
+
+    CHECK(std::get<0>(vectorised) == std::get<0>(generic));
+    // The error probabilities are summed in a different order, in float.
+    CHECK(std::get<1>(vectorised) == Approx(std::get<1>(generic)).epsilon(1e-3));
+    CHECK(std::get<2>(vectorised) == std::get<2>(generic));
+    CHECK(std::get<3>(vectorised) == std::get<3>(generic));
+}
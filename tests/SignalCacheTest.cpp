@@ -0,0 +1,115 @@
+#include "utils/SignalCache.h"
+
+#include <catch2/catch.hpp>
+#include <torch/torch.h>
+
+#include <filesystem>
+
+#define CUT_TAG "[SignalCache]"
+
+namespace fs = std::filesystem;
+using dorado::utils::SignalCache;
+using dorado::utils::SignalScaling;
+
+namespace {
+
+fs::path fresh_cache_path(const std::string& name) {
+    const auto path = fs::temp_directory_path() / name;
+    fs::remove(path);
+    return path;
+}
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": reads stored by one run are loaded by the next", CUT_TAG) {
+    const auto path = fresh_cache_path("signal_cache_reuse.bin");
+    const auto signal_a = torch::randn({1000}).to(torch::kFloat16);
+    const auto signal_b = torch::randn({10}).to(torch::kFloat16);
+    {
+        SignalCache cache(path, "key");
+        CHECK(cache.num_cached_reads() == 0);
+        cache.store("read_a", SignalScaling{1.5f, 2.5f, 7}, signal_a);
+        cache.store("read_b", SignalScaling{-1.f, 3.f, 0}, signal_b);
+        // Only reads cached by earlier runs are loaded.
+        torch::Tensor signal;
+        SignalScaling scaling{};
+        CHECK_FALSE(cache.load("read_a", signal, scaling));
+    }
+
+    SignalCache cache(path, "key");
+    CHECK(cache.num_cached_reads() == 2);
+    torch::Tensor signal;
+    SignalScaling scaling{};
+    REQUIRE(cache.load("read_a", signal, scaling));
+    CHECK(signal.dtype() == torch::kFloat16);
+    CHECK(torch::equal(signal, signal_a));
+    CHECK(scaling.shift == 1.5f);
+    CHECK(scaling.scale == 2.5f);
+    CHECK(scaling.trim_start == 7);
+    REQUIRE(cache.load("read_b", signal, scaling));
+    CHECK(torch::equal(signal, signal_b));
+    CHECK_FALSE(cache.load("read_c", signal, scaling));
+}
+
+TEST_CASE(CUT_TAG ": a cache with another scaling key is left alone", CUT_TAG) {
+    const auto path = fresh_cache_path("signal_cache_key.bin");
+    {
+        SignalCache cache(path, "key");
+        cache.store("read_a", SignalScaling{1.f, 1.f, 0}, torch::ones({5}, torch::kFloat16));
+    }
+    {
+        SignalCache cache(path, "other key");
+        CHECK(cache.num_cached_reads() == 0);
+        cache.store("read_b", SignalScaling{1.f, 1.f, 0}, torch::ones({5}, torch::kFloat16));
+    }
+    SignalCache cache(path, "key");
+    CHECK(cache.num_cached_reads() == 1);
+    torch::Tensor signal;
+    SignalScaling scaling{};
+    CHECK(cache.load("read_a", signal, scaling));
+}
+
+TEST_CASE(CUT_TAG ": caches open at once both append", CUT_TAG) {
+    const auto path = fresh_cache_path("signal_cache_shared.bin");
+    {
+        SignalCache first(path, "key");
+        SignalCache second(path, "key");
+        for (int i = 0; i < 10; ++i) {
+            first.store("first_" + std::to_string(i), SignalScaling{1.f, 1.f, 0},
+                        torch::ones({100 + i}, torch::kFloat16));
+            second.store("second_" + std::to_string(i), SignalScaling{1.f, 1.f, 0},
+                         torch::zeros({50 + i}, torch::kFloat16));
+        }
+    }
+    SignalCache cache(path, "key");
+    CHECK(cache.num_cached_reads() == 20);
+    torch::Tensor signal;
+    SignalScaling scaling{};
+    REQUIRE(cache.load("second_9", signal, scaling));
+    CHECK(torch::equal(signal, torch::zeros({59}, torch::kFloat16)));
+}
+
+TEST_CASE(CUT_TAG ": a read cut short is dropped", CUT_TAG) {
+    const auto path = fresh_cache_path("signal_cache_truncated.bin");
+    {
+        SignalCache cache(path, "key");
+        cache.store("read_a", SignalScaling{1.f, 1.f, 0}, torch::ones({5}, torch::kFloat16));
+        cache.store("read_b", SignalScaling{1.f, 1.f, 0}, torch::ones({50}, torch::kFloat16));
+    }
+    fs::resize_file(path, fs::file_size(path) - 3);
+
+    {
+        SignalCache cache(path, "key");
+        CHECK(cache.num_cached_reads() == 1);
+        // Appended after the complete reads.
+        cache.store("read_c", SignalScaling{1.f, 1.f, 0}, torch::zeros({8}, torch::kFloat16));
+    }
+    SignalCache cache(path, "key");
+    CHECK(cache.num_cached_reads() == 2);
+    torch::Tensor signal;
+    SignalScaling scaling{};
+    CHECK(cache.load("read_a", signal, scaling));
+    CHECK_FALSE(cache.load("read_b", signal, scaling));
+    REQUIRE(cache.load("read_c", signal, scaling));
+    CHECK(torch::equal(signal, torch::zeros({8}, torch::kFloat16)));
+}
@@ -0,0 +1,57 @@
+#include "utils/SignalSpill.h"
+
+#include <catch2/catch.hpp>
+#include <torch/torch.h>
+
+#include <filesystem>
+#include <vector>
+
+#define CUT_TAG "[SignalSpill]"
+
+namespace fs = std::filesystem;
+using dorado::utils::SignalSpill;
+
+TEST_CASE(CUT_TAG ": signals are read back as they were spilled", CUT_TAG) {
+    const auto directory = fs::temp_directory_path() / "dorado_signal_spill_test";
+    fs::remove_all(directory);
+    {
+        SignalSpill spill(directory);
+        const auto signal_a = torch::randn({1000}).to(torch::kFloat16);
+        const auto signal_b = torch::randint(-100, 100, {10}, torch::kInt16);
+        const auto extent_a = spill.spill(signal_a);
+        const auto extent_b = spill.spill(signal_b);
+        CHECK(spill.spilled_bytes() == 2020);
+
+        const auto restored_b = spill.restore(extent_b);
+        CHECK(restored_b.scalar_type() == torch::kInt16);
+        CHECK(torch::equal(restored_b, signal_b));
+        CHECK(torch::equal(spill.restore(extent_a), signal_a));
+        CHECK(spill.spilled_bytes() == 0);
+        // The spill file is in the directory until the spill goes.
+        CHECK(!fs::is_empty(directory));
+    }
+    CHECK(fs::is_empty(directory));
+}
+
+TEST_CASE(CUT_TAG ": the space of signals read back is reused", CUT_TAG) {
+    SignalSpill spill(fs::temp_directory_path() / "dorado_signal_spill_test");
+    std::vector<torch::Tensor> signals;
+    std::vector<SignalSpill::Extent> extents;
+    for (int i = 0; i < 4; ++i) {
+        signals.push_back(torch::full({100}, float(i)).to(torch::kFloat16));
+        extents.push_back(spill.spill(signals.back()));
+    }
+    CHECK(spill.file_bytes() == 800);
+
+    // Freeing the middle two leaves one extent, which a signal of both their sizes fits in.
+    spill.restore(extents[1]);
+    spill.restore(extents[2]);
+    const auto large = torch::ones({200}, torch::kFloat16);
+    const auto large_extent = spill.spill(large);
+    CHECK(large_extent.offset == 200);
+    CHECK(spill.file_bytes() == 800);
+
+    CHECK(torch::equal(spill.restore(extents[0]), signals[0]));
+    CHECK(torch::equal(spill.restore(large_extent), large));
+    CHECK(torch::equal(spill.restore(extents[3]), signals[3]));
+}
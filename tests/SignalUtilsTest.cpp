@@ -0,0 +1,158 @@
+#include "utils/signal_utils.h"
+
+#include "utils/tensor_utils.h"
+#include "utils/trim.h"
+
+#include <catch2/catch.hpp>
+#include <torch/torch.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#define CUT_TAG "[SignalUtils]"
+
+using Slice = torch::indexing::Slice;
+
+namespace {
+
+// The separate steps normalise_and_trim replaces.
+dorado::utils::SignalScaling reference_normalise_and_trim(torch::Tensor& samples,
+                                                          int max_trim_samples) {
+    auto quantiles = dorado::utils::quantile_counting(samples, torch::tensor({0.2, 0.9}));
+    float q20 = quantiles[0].item<float>();
+    float q90 = quantiles[1].item<float>();
+    float shift = std::max(10.0f, 0.51f * (q20 + q90));
+    float scale = std::max(1.0f, 0.53f * (q90 - q20));
+
+    samples = ((samples.to(torch::kFloat32) - shift) / scale).to(torch::kFloat16);
+    int trim_start =
+            dorado::utils::trim(samples.index({Slice(torch::indexing::None, max_trim_samples)}));
+    return {shift, scale, trim_start};
+}
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": normalise_and_trim matches separate steps", CUT_TAG) {
+    std::mt19937 gen{42};
+    std::normal_distribution<float> rng{400, 60};
+
+    // Lengths which aren't multiples of the vector width are included.
+    auto num_samples = GENERATE(1, 7, 100, 4001, 20000, 100003);
+    auto samples = torch::empty({num_samples}, torch::kInt16);
+    auto* const samples_ptr = samples.data_ptr<int16_t>();
+    for (int i = 0; i < num_samples; ++i) {
+        samples_ptr[i] = static_cast<int16_t>(rng(gen));
+    }
+    // Add a peak near the start so there's something to trim.
+    for (int i = 0; i < std::min(num_samples, 150); ++i) {
+        samples_ptr[i] += 800;
+    }
+
+    const int max_trim_samples = std::min(8000, num_samples / 2);
+    auto expected_samples = samples.clone();
+    const auto expected = reference_normalise_and_trim(expected_samples, max_trim_samples);
+
+    const auto scaling =
+            dorado::utils::normalise_and_trim(samples_ptr, num_samples, max_trim_samples);
+    CHECK(scaling.shift == expected.shift);
+    CHECK(scaling.scale == expected.scale);
+    CHECK(scaling.trim_start == expected.trim_start);
+    CHECK(torch::equal(samples.view(torch::kFloat16), expected_samples));
+}
+
+TEST_CASE(CUT_TAG ": normalise_and_trim handles the full int16 range", CUT_TAG) {
+    auto samples = torch::tensor({-32768, 32767, 0, 0, 0, 10, 20}, torch::kInt16);
+    auto expected_samples = samples.clone();
+    const auto expected = reference_normalise_and_trim(expected_samples, 3);
+
+    const auto scaling =
+            dorado::utils::normalise_and_trim(samples.data_ptr<int16_t>(), samples.numel(), 3);
+    CHECK(scaling.shift == expected.shift);
+    CHECK(scaling.scale == expected.scale);
+    CHECK(scaling.trim_start == expected.trim_start);
+    CHECK(torch::equal(samples.view(torch::kFloat16), expected_samples));
+}
+
+TEST_CASE(CUT_TAG ": tensor normalise_and_trim matches in place version", CUT_TAG) {
+    std::mt19937 gen{7};
+    std::normal_distribution<float> rng{500, 80};
+
+    auto num_samples = GENERATE(0, 5, 1000, 30011);
+    auto samples = torch::empty({num_samples}, torch::kInt16);
+    auto* const samples_ptr = samples.data_ptr<int16_t>();
+    for (int i = 0; i < num_samples; ++i) {
+        samples_ptr[i] = static_cast<int16_t>(rng(gen) + (i < 200 ? 900 : 0));
+    }
+    const int max_trim_samples = std::min(8000, num_samples / 2);
+
+    dorado::utils::SignalScaling scaling;
+    const auto normalised = dorado::utils::normalise_and_trim(samples, max_trim_samples, scaling);
+    CHECK(normalised.dtype() == torch::kFloat16);
+
+    const auto expected =
+            dorado::utils::normalise_and_trim(samples_ptr, num_samples, max_trim_samples);
+    CHECK(scaling.shift == expected.shift);
+    CHECK(scaling.scale == expected.scale);
+    CHECK(scaling.trim_start == expected.trim_start);
+    CHECK(torch::equal(normalised, samples.view(torch::kFloat16)));
+}
+
+TEST_CASE(CUT_TAG ": SignalHistogram quantiles match quantile_counting", CUT_TAG) {
+    auto samples = torch::randint(-500, 3000, {54321}).to(torch::kInt16);
+    const dorado::utils::SignalHistogram histogram(samples.data_ptr<int16_t>(), samples.numel());
+    CHECK(histogram.num_counted() == samples.numel());
+
+    auto q = torch::tensor({0.0, 0.05, 0.2, 0.5, 0.9, 0.95, 1.0}, {torch::kFloat});
+    auto expected = dorado::utils::quantile_counting(samples, q);
+    for (int i = 0; i < q.numel(); ++i) {
+        CAPTURE(q[i].item<float>());
+        CHECK(histogram.quantile(q[i].item<float>()) == expected[i].item<int>());
+    }
+}
+
+TEST_CASE(CUT_TAG ": SignalHistogram median and MAD", CUT_TAG) {
+    std::mt19937 gen{11};
+    std::normal_distribution<float> rng{200, 35};
+    std::vector<int16_t> samples(10001);
+    std::generate(samples.begin(), samples.end(), [&] { return static_cast<int16_t>(rng(gen)); });
+
+    const dorado::utils::SignalHistogram histogram(samples.data(), samples.size());
+
+    auto sorted = samples;
+    std::sort(sorted.begin(), sorted.end());
+    const int median = sorted[sorted.size() / 2];
+    std::vector<int> deviations;
+    for (auto sample : samples) {
+        deviations.push_back(std::abs(sample - median));
+    }
+    std::sort(deviations.begin(), deviations.end());
+
+    CHECK(histogram.median() == median);
+    CHECK(histogram.mad() == deviations[deviations.size() / 2]);
+}
+
+TEST_CASE(CUT_TAG ": SignalHistogram strided sampling", CUT_TAG) {
+    std::vector<int16_t> samples(1000);
+    std::iota(samples.begin(), samples.end(), 0);
+
+    CHECK(dorado::utils::SignalHistogram::stride_for(1000, 0) == 1);
+    CHECK(dorado::utils::SignalHistogram::stride_for(1000, 1000) == 1);
+    CHECK(dorado::utils::SignalHistogram::stride_for(1000, 300) == 4);
+
+    // Every 4th sample is counted: 0, 4, ..., 996.
+    const dorado::utils::SignalHistogram histogram(samples.data(), samples.size(), 4);
+    CHECK(histogram.num_counted() == 250);
+    CHECK(histogram.quantile(0.0f) == 0);
+    CHECK(histogram.quantile(1.0f) == 996);
+    CHECK(histogram.median() == 496);
+}
+
+TEST_CASE(CUT_TAG ": SignalHistogram of no samples", CUT_TAG) {
+    const dorado::utils::SignalHistogram histogram(nullptr, 0);
+    CHECK(histogram.num_counted() == 0);
+    CHECK(histogram.quantile(0.5f) == 0);
+    CHECK(histogram.mad() == 0);
+}
@@ -0,0 +1,79 @@
+#include "utils/socket_utils.h"
+
+#include <catch2/catch.hpp>
+
+#include <filesystem>
+#include <string>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#define CUT_TAG "[socket_utils]"
+
+#ifndef _WIN32
+
+namespace {
+
+std::filesystem::path socket_path(const std::string& name) {
+    return std::filesystem::temp_directory_path() / name;
+}
+
+void write_string(int fd, const std::string& data) {
+    REQUIRE(::write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size()));
+}
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": request lines are read from clients", CUT_TAG) {
+    const auto path = socket_path("dorado_socket_test_lines");
+    dorado::utils::LocalSocketServer server(path);
+    CHECK(std::filesystem::is_socket(path));
+
+    const int client = dorado::utils::connect_local_socket(path);
+    const int connection = server.accept();
+    write_string(client, "run1/pod5\nrun2");
+
+    using namespace std::chrono_literals;
+    CHECK(dorado::utils::read_line(connection, 100, 1s) == "run1/pod5");
+    // The second line never ends, so the read times out.
+    CHECK_FALSE(dorado::utils::read_line(connection, 100, 50ms).has_value());
+
+    dorado::utils::close_socket(client);
+    dorado::utils::close_socket(connection);
+}
+
+TEST_CASE(CUT_TAG ": read_line stops at the maximum length or a closed connection", CUT_TAG) {
+    const auto path = socket_path("dorado_socket_test_limits");
+    dorado::utils::LocalSocketServer server(path);
+
+    using namespace std::chrono_literals;
+    const int client = dorado::utils::connect_local_socket(path);
+    const int connection = server.accept();
+    write_string(client, "0123456789\n");
+    CHECK_FALSE(dorado::utils::read_line(connection, 5, 1s).has_value());
+    dorado::utils::close_socket(client);
+    dorado::utils::close_socket(connection);
+
+    const int second_client = dorado::utils::connect_local_socket(path);
+    const int second_connection = server.accept();
+    write_string(second_client, "unterminated");
+    dorado::utils::close_socket(second_client);
+    CHECK_FALSE(dorado::utils::read_line(second_connection, 100, 1s).has_value());
+    dorado::utils::close_socket(second_connection);
+}
+
+TEST_CASE(CUT_TAG ": stale sockets are replaced and removed", CUT_TAG) {
+    const auto path = socket_path("dorado_socket_test_stale");
+    {
+        dorado::utils::LocalSocketServer first(path);
+        // A second server takes over the socket of the first, as if it had been killed.
+        dorado::utils::LocalSocketServer second(path);
+        const int client = dorado::utils::connect_local_socket(path);
+        dorado::utils::close_socket(client);
+    }
+    CHECK_FALSE(std::filesystem::exists(path));
+    CHECK_THROWS(dorado::utils::connect_local_socket(path));
+}
+
+#endif  // _WIN32
@@ -2,11 +2,14 @@
 #include "read_pipeline/NullNode.h"
 #include "read_pipeline/ReadPipeline.h"
 #include "read_pipeline/StereoDuplexEncoderNode.h"
+#include "utils/sequence_utils.h"
 
 #include <catch2/catch.hpp>
 #include <torch/torch.h>
 
 #include <filesystem>
+#include <random>
+#include <string>
 #include <vector>
 
 #define TEST_GROUP "StereoDuplexTest"
@@ -23,14 +26,16 @@ TEST_CASE(TEST_GROUP "Encoder", "[.]") {
     const auto template_read = std::make_shared<dorado::Read>();
     template_read->seq = ReadFileIntoString(DataPath("template_seq"));
     template_read->qstring = ReadFileIntoString(DataPath("template_qstring"));
-    template_read->moves = ReadFileIntoVector(DataPath("template_moves"));
+    template_read->moves =
+            dorado::utils::MoveTable(ReadFileIntoVector(DataPath("template_moves")));
     torch::load(template_read->raw_data, DataPath("template_raw_data.tensor").string());
     template_read->raw_data = template_read->raw_data.to(torch::kFloat16);
 
     const auto complement_read = std::make_shared<dorado::Read>();
     complement_read->seq = ReadFileIntoString(DataPath("complement_seq"));
     complement_read->qstring = ReadFileIntoString(DataPath("complement_qstring"));
-    complement_read->moves = ReadFileIntoVector(DataPath("complement_moves"));
+    complement_read->moves =
+            dorado::utils::MoveTable(ReadFileIntoVector(DataPath("complement_moves")));
     torch::load(complement_read->raw_data, DataPath("complement_raw_data.tensor").string());
     complement_read->raw_data = complement_read->raw_data.to(torch::kFloat16);
 
@@ -54,3 +59,83 @@ TEST_CASE(TEST_GROUP "Encoder", "[.]") {
     // Check if the encoded signal is NOT equal to the expected stereo_raw_data
     REQUIRE(!torch::equal(stereo_raw_data, swapped_stereo_read->raw_data));
 }
+
+// Tests that pairs whose sequences can't be a template and complement aren't encoded.
+TEST_CASE(TEST_GROUP "Encoder rejects pairs which don't align", TEST_GROUP) {
+    std::mt19937 rng(42);
+    const auto make_read = [&rng](size_t num_bases) {
+        auto read = std::make_shared<dorado::Read>();
+        for (size_t i = 0; i < num_bases; ++i) {
+            read->seq.push_back("ACGT"[rng() % 4]);
+        }
+        read->qstring = std::string(num_bases, '5');
+        read->moves = dorado::utils::MoveTable(std::vector<uint8_t>(num_bases, 1));
+        read->raw_data = torch::rand({int64_t(num_bases) * 5}).to(torch::kFloat16);
+        return read;
+    };
+
+    dorado::NullNode null_node;
+    dorado::StereoDuplexEncoderNode stereo_node(null_node, 5, 1);
+
+    // Unrelated sequences are too far apart to align within the error rate bound.
+    const auto unrelated_read = stereo_node.stereo_encode(make_read(2000), make_read(2000));
+    CHECK(!unrelated_read->raw_data.defined());
+    CHECK(!unrelated_read->is_duplex);
+
+    // As are sequences of very different lengths, whatever they contain.
+    const auto short_read = stereo_node.stereo_encode(make_read(2000), make_read(200));
+    CHECK(!short_read->raw_data.defined());
+    CHECK(!short_read->is_duplex);
+}
+
+// Tests that features built with tensor ops, as on a GPU, are those built on the host.
+TEST_CASE(TEST_GROUP "Encoder builds the same features on a device", TEST_GROUP) {
+    std::mt19937 rng(42);
+    // Bases each of a random number of steps, with random samples and Q scores.
+    const auto make_read = [&rng](const std::string& seq) {
+        auto read = std::make_shared<dorado::Read>();
+        read->seq = seq;
+        std::vector<uint8_t> moves;
+        for (size_t i = 0; i < seq.size(); ++i) {
+            read->qstring.push_back(char('!' + rng() % 50));
+            moves.push_back(1);
+            moves.insert(moves.end(), rng() % 4, 0);
+        }
+        read->moves = dorado::utils::MoveTable(moves);
+        read->raw_data = torch::randn({int64_t(moves.size()) * 5}).to(torch::kFloat16);
+        return read;
+    };
+
+    std::string template_seq;
+    for (int i = 0; i < 2000; ++i) {
+        template_seq.push_back("ACGT"[rng() % 4]);
+    }
+    // The complement has a few substitutions, insertions and deletions, so that the alignment
+    // has columns of every kind.
+    auto complement_seq = template_seq;
+    for (int i = 0; i < 40; ++i) {
+        const size_t position = 100 + rng() % (complement_seq.size() - 200);
+        switch (i % 3) {
+        case 0:
+            complement_seq[position] = "ACGT"[rng() % 4];
+            break;
+        case 1:
+            complement_seq.insert(position, 1, "ACGT"[rng() % 4]);
+            break;
+        default:
+            complement_seq.erase(position, 1);
+        }
+    }
+    const auto template_read = make_read(template_seq);
+    const auto complement_read = make_read(dorado::utils::reverse_complement(complement_seq));
+
+    dorado::NullNode null_node;
+    dorado::StereoDuplexEncoderNode host_node(null_node, 5, 1);
+    dorado::StereoDuplexEncoderNode device_node(null_node, 5, 1, "cpu");
+    const auto host_read = host_node.stereo_encode(template_read, complement_read);
+    const auto device_read = device_node.stereo_encode(template_read, complement_read);
+    REQUIRE(host_read->raw_data.defined());
+    CHECK(device_read->is_duplex);
+    CHECK(device_read->read_id == host_read->read_id);
+    CHECK(torch::equal(device_read->raw_data, host_read->raw_data));
+}
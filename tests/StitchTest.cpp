@@ -4,8 +4,87 @@
 
 #include <catch2/catch.hpp>
 
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
 #define TEST_GROUP "[utils]"
 
+namespace {
+
+// Stitching as it was done by concatenating each chunk's trimmed strings, which the
+// preallocating version is checked against.
+void reference_stitch(const dorado::Read& read,
+                      std::string& seq,
+                      std::string& qstring,
+                      std::vector<uint8_t>& moves) {
+    int start_pos = 0;
+    int mid_point_front = 0;
+    std::vector<std::string> sequences;
+    std::vector<std::string> qstrings;
+    moves.clear();
+    for (size_t i = 0; i + 1 < read.num_chunks; i++) {
+        const auto& current_chunk = read.called_chunks[i];
+        const auto& next_chunk = read.called_chunks[i + 1];
+        const auto current_moves = current_chunk.moves.to_vector();
+        const auto next_moves = next_chunk.moves.to_vector();
+        int overlap_size = (current_chunk.raw_chunk_size + current_chunk.input_offset) -
+                           (next_chunk.input_offset);
+        int overlap_down_sampled = overlap_size / read.model_stride;
+        int mid_point_rear = overlap_down_sampled / 2;
+        int current_chunk_bases_to_trim =
+                std::accumulate(std::prev(current_moves.end(), mid_point_rear),
+                                current_moves.end(), 0);
+        int end_pos = int(current_chunk.seq.size()) - current_chunk_bases_to_trim;
+        sequences.push_back(current_chunk.seq.substr(start_pos, end_pos - start_pos));
+        qstrings.push_back(current_chunk.qstring.substr(start_pos, end_pos - start_pos));
+        moves.insert(moves.end(), std::next(current_moves.begin(), mid_point_front),
+                     std::prev(current_moves.end(), mid_point_rear));
+        mid_point_front = overlap_down_sampled - mid_point_rear;
+        start_pos = std::accumulate(next_moves.begin(),
+                                    std::next(next_moves.begin(), mid_point_front), 0);
+    }
+    const auto& last_chunk = read.called_chunks.back();
+    const auto last_moves = last_chunk.moves.to_vector();
+    moves.insert(moves.end(), std::next(last_moves.begin(), mid_point_front), last_moves.end());
+    sequences.push_back(last_chunk.seq.substr(start_pos));
+    qstrings.push_back(last_chunk.qstring.substr(start_pos));
+    seq = std::accumulate(sequences.begin(), sequences.end(), std::string(""));
+    qstring = std::accumulate(qstrings.begin(), qstrings.end(), std::string(""));
+    if (moves.size() > size_t(read.raw_data.size(0) / read.model_stride)) {
+        if (moves.back() == 1) {
+            seq.pop_back();
+            qstring.pop_back();
+        }
+        moves.pop_back();
+    }
+}
+
+// Chunks the read with a stride of 5, and gives each chunk a random basecall.
+void call_random_chunks(dorado::Read& read, std::mt19937& rng) {
+    constexpr size_t CHUNK_SIZE = 1000;
+    constexpr size_t OVERLAP = 100;
+    constexpr size_t STRIDE = 5;
+    dorado::utils::chunk_read(read, {CHUNK_SIZE}, OVERLAP, STRIDE);
+    for (auto& chunk : read.called_chunks) {
+        std::vector<uint8_t> moves(chunk.raw_chunk_size / STRIDE);
+        for (auto& move : moves) {
+            move = rng() % 3 == 0;
+        }
+        chunk.moves = dorado::utils::MoveTable(moves);
+        const int num_bases = std::accumulate(moves.begin(), moves.end(), 0);
+        for (int i = 0; i < num_bases; ++i) {
+            chunk.seq.push_back("ACGT"[rng() % 4]);
+            chunk.qstring.push_back(char('!' + rng() % 40));
+        }
+    }
+    read.model_stride = STRIDE;
+}
+
+}  // namespace
+
 // clang-format off
 constexpr size_t RAW_SIGNAL_SIZE = 50;
 const std::vector<std::string> SEQS(7, "ACGT");
@@ -48,19 +127,17 @@ TEST_CASE("Test stitch_chunks", TEST_GROUP) {
     size_t offset = 0;
     size_t chunk_in_read_idx = 0;
     size_t signal_chunk_step = CHUNK_SIZE - OVERLAP;
-    auto chunk = std::make_shared<dorado::Chunk>(read, offset, chunk_in_read_idx++, CHUNK_SIZE);
+    auto* chunk = &read->called_chunks.emplace_back(*read, offset, chunk_in_read_idx++, CHUNK_SIZE);
     chunk->qstring = QSTR[read->num_chunks];
     chunk->seq = SEQS[read->num_chunks];
-    chunk->moves = MOVES[read->num_chunks];
-    read->called_chunks.push_back(chunk);
+    chunk->moves = dorado::utils::MoveTable(MOVES[read->num_chunks]);
     read->num_chunks++;
     while (offset + CHUNK_SIZE < RAW_SIGNAL_SIZE) {
         offset = std::min(offset + signal_chunk_step, RAW_SIGNAL_SIZE - CHUNK_SIZE);
-        chunk = std::make_shared<dorado::Chunk>(read, offset, chunk_in_read_idx++, CHUNK_SIZE);
+        chunk = &read->called_chunks.emplace_back(*read, offset, chunk_in_read_idx++, CHUNK_SIZE);
         chunk->qstring = QSTR[read->num_chunks];
         chunk->seq = SEQS[read->num_chunks];
-        chunk->moves = MOVES[read->num_chunks];
-        read->called_chunks.push_back(chunk);
+        chunk->moves = dorado::utils::MoveTable(MOVES[read->num_chunks]);
         read->num_chunks++;
     }
 
@@ -74,5 +151,127 @@ TEST_CASE("Test stitch_chunks", TEST_GROUP) {
 
     REQUIRE(read->seq == expected_sequence);
     REQUIRE(read->qstring == expected_qstring);
-    REQUIRE(read->moves == expected_moves);
+    REQUIRE(read->moves.to_vector() == expected_moves);
+}
+
+TEST_CASE("Test chunk_read with one chunk size", TEST_GROUP) {
+    constexpr size_t CHUNK_SIZE = 100;
+    constexpr size_t OVERLAP = 20;
+    constexpr size_t STRIDE = 5;
+
+    dorado::Read read;
+    read.raw_data = torch::empty(403);
+    dorado::utils::chunk_read(read, {CHUNK_SIZE}, OVERLAP, STRIDE);
+
+    // Chunks step by 80 until the last, which is moved back to end on the first stride
+    // boundary past the end of the signal.
+    const std::vector<size_t> expected_offsets = {0, 80, 160, 240, 305};
+    REQUIRE(read.num_chunks == expected_offsets.size());
+    for (size_t i = 0; i < read.num_chunks; ++i) {
+        CHECK(read.called_chunks[i].input_offset == expected_offsets[i]);
+        CHECK(read.called_chunks[i].idx_in_read == i);
+        CHECK(read.called_chunks[i].raw_chunk_size == CHUNK_SIZE);
+    }
+
+    // Short reads are a single padded chunk.
+    read.raw_data = torch::empty(37);
+    dorado::utils::chunk_read(read, {CHUNK_SIZE}, OVERLAP, STRIDE);
+    REQUIRE(read.num_chunks == 1);
+    CHECK(read.called_chunks[0].input_offset == 0);
+    CHECK(read.called_chunks[0].raw_chunk_size == CHUNK_SIZE);
+}
+
+TEST_CASE("Test chunk_read with several chunk sizes", TEST_GROUP) {
+    const std::vector<size_t> chunk_sizes = {25, 50, 100};
+    constexpr size_t OVERLAP = 20;
+    constexpr size_t STRIDE = 5;
+
+    dorado::Read read;
+    SECTION("Short reads use the smallest chunk size which fits") {
+        read.raw_data = torch::empty(37);
+        dorado::utils::chunk_read(read, chunk_sizes, OVERLAP, STRIDE);
+        REQUIRE(read.num_chunks == 1);
+        CHECK(read.called_chunks[0].raw_chunk_size == 50);
+
+        read.raw_data = torch::empty(25);
+        dorado::utils::chunk_read(read, chunk_sizes, OVERLAP, STRIDE);
+        REQUIRE(read.num_chunks == 1);
+        CHECK(read.called_chunks[0].raw_chunk_size == 25);
+    }
+
+    SECTION("Read tails use the smallest chunk size which fits") {
+        // After chunks at 0, 80 and 160, the next chunk could start at 240.
+        const size_t raw_size = GENERATE(263, 286, 303, 340);
+        read.raw_data = torch::empty(raw_size);
+        dorado::utils::chunk_read(read, chunk_sizes, OVERLAP, STRIDE);
+        REQUIRE(read.num_chunks == 4);
+
+        const auto& last_chunk = read.called_chunks.back();
+        const size_t expected_size = raw_size - 240 <= 25 ? 25 : raw_size - 240 <= 50 ? 50 : 100;
+        CHECK(last_chunk.raw_chunk_size == expected_size);
+        CHECK(last_chunk.input_offset % STRIDE == 0);
+        CHECK(last_chunk.input_offset + last_chunk.raw_chunk_size >= raw_size);
+        CHECK(last_chunk.input_offset + last_chunk.raw_chunk_size < raw_size + STRIDE);
+        // It still overlaps the previous chunk by at least the minimum.
+        CHECK(last_chunk.input_offset <= 240);
+        for (size_t i = 0; i + 1 < read.num_chunks; ++i) {
+            CHECK(read.called_chunks[i].raw_chunk_size == 100);
+        }
+    }
+}
+
+TEST_CASE("Test stitch_chunks matches concatenation for ultra-long reads", TEST_GROUP) {
+    std::mt19937 rng(42);
+    // Thousands of chunks, and a signal which doesn't end on a stride boundary.
+    auto read = std::make_shared<dorado::Read>();
+    read->raw_data = torch::empty(GENERATE(2000003, 2500000));
+    call_random_chunks(*read, rng);
+    REQUIRE(read->num_chunks > 2000);
+
+    std::string expected_seq;
+    std::string expected_qstring;
+    std::vector<uint8_t> expected_moves;
+    reference_stitch(*read, expected_seq, expected_qstring, expected_moves);
+
+    dorado::utils::stitch_chunks(read);
+    REQUIRE(read->seq.size() == expected_seq.size());
+    CHECK(read->seq == expected_seq);
+    CHECK(read->qstring == expected_qstring);
+    CHECK(read->moves.to_vector() == expected_moves);
+}
+
+TEST_CASE("Test stitch_called_chunk stitches chunks as they're called", TEST_GROUP) {
+    std::mt19937 rng(42);
+    auto read = std::make_shared<dorado::Read>();
+    read->raw_data = torch::empty(GENERATE(4003, 200003));
+    call_random_chunks(*read, rng);
+
+    std::string expected_seq;
+    std::string expected_qstring;
+    std::vector<uint8_t> expected_moves;
+    reference_stitch(*read, expected_seq, expected_qstring, expected_moves);
+
+    std::vector<size_t> order(read->num_chunks);
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), rng);
+    for (size_t i = 0; i < order.size(); ++i) {
+        // Only the call which completes the read says so.
+        CHECK(dorado::utils::stitch_called_chunk(*read, order[i]) == (i + 1 == order.size()));
+        // Every chunk before the first uncalled one has been stitched and freed.
+        for (size_t chunk = 0; chunk < read->num_chunks_stitched; ++chunk) {
+            CHECK(read->called_chunks[chunk].seq.empty());
+            CHECK(read->called_chunks[chunk].moves.empty());
+        }
+        if (read->num_chunks_stitched < read->num_chunks) {
+            CHECK_FALSE(read->called_chunks[read->num_chunks_stitched].is_called);
+        }
+    }
+
+    CHECK(read->num_chunks_stitched == read->num_chunks);
+    CHECK(read->seq == expected_seq);
+    CHECK(read->qstring == expected_qstring);
+    CHECK(read->moves.to_vector() == expected_moves);
+    // Nothing is kept past what the stitched read needs.
+    CHECK(read->seq.capacity() < read->seq.size() + 32);
+    CHECK(read->moves.capacity() < read->moves.size() + 64);
 }
@@ -0,0 +1,145 @@
+#include "utils/TensorPool.h"
+
+#include <catch2/catch.hpp>
+#include <torch/torch.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <thread>
+
+#define CUT_TAG "[TensorPool]"
+
+using dorado::utils::TensorPool;
+
+TEST_CASE(CUT_TAG ": size classes bound the wasted space", CUT_TAG) {
+    CHECK(TensorPool::size_class(1) == 4096);
+    CHECK(TensorPool::size_class(4096) == 4096);
+    CHECK(TensorPool::size_class(4097) == 4096 + 512);
+    CHECK(TensorPool::size_class(8192) == 8192);
+    for (size_t num_bytes : {5000, 100000, 2000000, 12345678}) {
+        const auto size_class = TensorPool::size_class(num_bytes);
+        CHECK(size_class >= num_bytes);
+        CHECK(size_class <= num_bytes + num_bytes / 8);
+    }
+}
+
+TEST_CASE(CUT_TAG ": buffers are recycled", CUT_TAG) {
+    TensorPool pool(1 << 20);
+
+    void* first_buffer = nullptr;
+    {
+        auto tensor = pool.empty(10000, torch::kInt16);
+        CHECK(tensor.numel() == 10000);
+        CHECK(tensor.dtype() == torch::kInt16);
+        CHECK(tensor.is_contiguous());
+        first_buffer = tensor.data_ptr();
+
+        // Views keep the buffer alive.
+        auto view = tensor.view(torch::kFloat16);
+        tensor = torch::Tensor();
+        CHECK(pool.cached_bytes() == 0);
+    }
+    CHECK(pool.cached_bytes() == TensorPool::size_class(20000));
+
+    // A request in the same size class reuses the buffer.
+    auto tensor = pool.empty(9900, torch::kInt16);
+    CHECK(tensor.data_ptr() == first_buffer);
+    CHECK(pool.cached_bytes() == 0);
+}
+
+TEST_CASE(CUT_TAG ": cache size is bounded", CUT_TAG) {
+    TensorPool pool(8192);
+    {
+        auto a = pool.empty(4096, torch::kInt8);
+        auto b = pool.empty(4096, torch::kInt8);
+        auto c = pool.empty(4096, torch::kInt8);
+    }
+    CHECK(pool.cached_bytes() == 8192);
+}
+
+namespace {
+
+std::atomic<int> g_num_allocated{0};
+std::atomic<int> g_num_freed{0};
+
+void* counting_allocate(size_t num_bytes) {
+    ++g_num_allocated;
+    return std::malloc(num_bytes);
+}
+
+void counting_free(void* buffer) {
+    ++g_num_freed;
+    std::free(buffer);
+}
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": buffers are freed by the allocator they came from", CUT_TAG) {
+    g_num_allocated = 0;
+    g_num_freed = 0;
+    TensorPool pool(1 << 20);
+    auto default_tensor = pool.empty(1000, torch::kInt8);
+    { auto cached = pool.empty(1000, torch::kInt8); }
+    CHECK(pool.cached_bytes() == 4096);
+
+    // Switching drops the cached buffer, which the new allocator never sees.
+    pool.set_allocator({counting_allocate, counting_free});
+    CHECK(pool.cached_bytes() == 0);
+    {
+        auto tensor = pool.empty(1000, torch::kInt8);
+        CHECK(g_num_allocated == 1);
+    }
+    CHECK(pool.cached_bytes() == 4096);
+    {
+        auto tensor = pool.empty(1000, torch::kInt8);
+        CHECK(g_num_allocated == 1);
+    }
+
+    // A buffer from before the switch isn't cached with the new allocator's.
+    default_tensor = torch::Tensor();
+    CHECK(pool.cached_bytes() == 4096);
+    CHECK(g_num_freed == 0);
+}
+
+namespace {
+
+std::atomic<bool> g_freed_on_caller{false};
+std::thread::id g_caller;
+
+void recording_free(void* buffer) {
+    if (std::this_thread::get_id() == g_caller) {
+        g_freed_on_caller = true;
+    }
+    counting_free(buffer);
+}
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": other allocators' buffers are freed on the pool's thread", CUT_TAG) {
+    g_num_allocated = 0;
+    g_num_freed = 0;
+    g_freed_on_caller = false;
+    g_caller = std::this_thread::get_id();
+    TensorPool pool(4096);
+    pool.set_allocator({counting_allocate, recording_free});
+    auto in_use = pool.empty(1000, torch::kInt8);
+    {
+        auto cached = pool.empty(1000, torch::kInt8);
+        // Beyond the cache's bound, so it's freed.
+        auto freed = pool.empty(1000, torch::kInt8);
+    }
+    CHECK(pool.cached_bytes() == 4096);
+
+    // Shutting down frees the queued and cached buffers, but one still in use is leaked.
+    pool.shutdown();
+    CHECK(pool.cached_bytes() == 0);
+    CHECK(g_num_freed == 2);
+    in_use = torch::Tensor();
+    CHECK(g_num_freed == 2);
+    CHECK(!g_freed_on_caller);
+
+    // The pool goes on working with the default allocator.
+    { auto tensor = pool.empty(1000, torch::kInt8); }
+    CHECK(g_num_allocated == 3);
+    CHECK(pool.cached_bytes() == 4096);
+}
@@ -3,7 +3,10 @@
 #include <catch2/catch.hpp>
 #include <torch/torch.h>
 
+#include <chrono>
 #include <cstdlib>
+#include <filesystem>
+#include <fstream>
 #include <random>
 
 #define CUT_TAG "[TensorUtils]"
@@ -136,3 +139,60 @@ TEST_CASE(CUT_TAG ": copy_tensor_elems", CUT_TAG) {
         }
     }
 }
+
+TEST_CASE(CUT_TAG ": packed tensors round trip", CUT_TAG) {
+    const auto path = std::filesystem::temp_directory_path() / "tensor_utils_packed.dorado";
+    const std::vector<std::string> names{"0.conv.weight.tensor", "4.rnn.bias_ih_l0.tensor",
+                                         "9.linear.weight.tensor", "scalar"};
+    const std::vector<torch::Tensor> tensors{
+            torch::rand({16, 1, 5}), torch::rand({1536}, torch::kFloat16),
+            // Not contiguous, which is packed as if it were.
+            torch::rand({1024, 384}).t(), torch::tensor(7, torch::kInt64)};
+    dorado::utils::save_packed_tensors(path, names, tensors);
+
+    // Tensors can be loaded in any order.
+    const auto loaded = dorado::utils::load_packed_tensors(path, {names[2], names[0], names[3]});
+    REQUIRE(loaded.size() == 3);
+    CHECK(torch::equal(loaded[0], tensors[2]));
+    CHECK(torch::equal(loaded[1], tensors[0]));
+    CHECK(torch::equal(loaded[2], tensors[3]));
+    CHECK(loaded[0].dtype() == torch::kFloat32);
+    CHECK(dorado::utils::load_packed_tensors(path, {names[1]})[0].dtype() == torch::kFloat16);
+
+    // Modifying a loaded tensor leaves the file alone.
+    loaded[1].zero_();
+    CHECK(torch::equal(dorado::utils::load_packed_tensors(path, {names[0]})[0], tensors[0]));
+
+    CHECK_THROWS(dorado::utils::load_packed_tensors(path, {"missing.tensor"}));
+}
+
+TEST_CASE(CUT_TAG ": invalid packed tensor files are rejected", CUT_TAG) {
+    const auto path = std::filesystem::temp_directory_path() / "tensor_utils_invalid.dorado";
+    dorado::utils::save_packed_tensors(path, {"weights"}, {torch::rand({100, 100})});
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+    CHECK_THROWS(dorado::utils::load_packed_tensors(path, {"weights"}));
+
+    {
+        std::ofstream stream(path, std::ios::trunc);
+        stream << "not a packed tensor file";
+    }
+    CHECK_THROWS(dorado::utils::load_packed_tensors(path, {"weights"}));
+}
+
+TEST_CASE(CUT_TAG ": packed tensors older than their tensor files are stale", CUT_TAG) {
+    const auto dir = std::filesystem::temp_directory_path() / "tensor_utils_stale";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    const auto path = dir / "weights.dorado";
+    CHECK_FALSE(dorado::utils::packed_tensors_are_current(path, dir, {"weights"}));
+
+    std::ofstream(dir / "weights") << "tensor";
+    dorado::utils::save_packed_tensors(path, {"weights"}, {torch::rand({10})});
+    const auto packed_time = std::filesystem::last_write_time(path);
+    std::filesystem::last_write_time(dir / "weights", packed_time - std::chrono::hours(1));
+    CHECK(dorado::utils::packed_tensors_are_current(path, dir, {"weights", "removed"}));
+
+    std::filesystem::last_write_time(dir / "weights", packed_time + std::chrono::hours(1));
+    CHECK_FALSE(dorado::utils::packed_tensors_are_current(path, dir, {"weights"}));
+    std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,122 @@
+#include "read_pipeline/ThreadAllocationController.h"
+
+#include "utils/ConcurrencyGate.h"
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#define TEST_GROUP "[read_pipeline][ThreadAllocationController]"
+
+using dorado::Message;
+using dorado::MessageSink;
+using dorado::Read;
+using dorado::ThreadAllocationController;
+using dorado::utils::ConcurrencyGate;
+
+namespace {
+
+// A node with nothing draining its input, so its occupancy is under the test's control.
+class StalledNode : public MessageSink {
+public:
+    StalledNode(size_t capacity) : MessageSink(capacity) {}
+
+    void fill(size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            push_message(std::make_shared<Read>());
+        }
+    }
+};
+
+}  // namespace
+
+TEST_CASE("ConcurrencyGate: Limit is respected", TEST_GROUP) {
+    ConcurrencyGate gate(2);
+    std::atomic<int> active{0};
+    std::atomic<int> max_active{0};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 8; ++i) {
+        threads.emplace_back([&] {
+            for (int j = 0; j < 50; ++j) {
+                gate.acquire();
+                const int now_active = ++active;
+                int expected = max_active.load();
+                while (now_active > expected &&
+                       !max_active.compare_exchange_weak(expected, now_active)) {
+                }
+                std::this_thread::yield();
+                --active;
+                gate.release();
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    REQUIRE(max_active.load() <= 2);
+    REQUIRE(max_active.load() >= 1);
+}
+
+TEST_CASE("ConcurrencyGate: Raising the limit releases waiters", TEST_GROUP) {
+    ConcurrencyGate gate(1);
+    gate.acquire();
+    std::atomic<bool> acquired{false};
+    std::thread waiter([&] {
+        gate.acquire();
+        acquired = true;
+        gate.release();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK_FALSE(acquired.load());
+    gate.set_limit(2);
+    waiter.join();
+    REQUIRE(acquired.load());
+    gate.release();
+}
+
+TEST_CASE("ThreadAllocationController: Workers move towards the congested node", TEST_GROUP) {
+    StalledNode busy_node(10);
+    StalledNode idle_node(10);
+    busy_node.fill(9);
+
+    ConcurrencyGate busy_gate(2);
+    ConcurrencyGate idle_gate(4);
+
+    ThreadAllocationController controller;
+    controller.add_node("busy", busy_node, busy_gate, 1, 4);
+    controller.add_node("idle", idle_node, idle_gate, 1, 4);
+
+    REQUIRE(controller.rebalance());
+    CHECK(busy_gate.limit() == 3);
+    CHECK(idle_gate.limit() == 3);
+
+    REQUIRE(controller.rebalance());
+    CHECK(busy_gate.limit() == 4);
+    CHECK(idle_gate.limit() == 2);
+
+    // The congested node is at its maximum, so nothing more moves.
+    REQUIRE_FALSE(controller.rebalance());
+    CHECK(busy_gate.limit() == 4);
+    CHECK(idle_gate.limit() == 2);
+}
+
+TEST_CASE("ThreadAllocationController: Balanced nodes are left alone", TEST_GROUP) {
+    StalledNode node_1(10);
+    StalledNode node_2(10);
+    node_1.fill(3);
+    node_2.fill(3);
+
+    ConcurrencyGate gate_1(2);
+    ConcurrencyGate gate_2(2);
+
+    ThreadAllocationController controller;
+    controller.add_node("node_1", node_1, gate_1, 1, 4);
+    controller.add_node("node_2", node_2, gate_2, 1, 4);
+
+    REQUIRE_FALSE(controller.rebalance());
+    CHECK(gate_1.limit() == 2);
+    CHECK(gate_2.limit() == 2);
+}
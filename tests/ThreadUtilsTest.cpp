@@ -0,0 +1,82 @@
+#include "utils/thread_utils.h"
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#define TEST_GROUP "[utils][thread_utils]"
+
+using dorado::utils::format_cpu_list;
+using dorado::utils::parse_cpu_list;
+
+TEST_CASE("parse_cpu_list: Ranges and single CPUs", TEST_GROUP) {
+    CHECK(parse_cpu_list("0-3,8,10-11\n") == std::vector<int>{0, 1, 2, 3, 8, 10, 11});
+    CHECK(parse_cpu_list("5") == std::vector<int>{5});
+    CHECK(parse_cpu_list("").empty());
+}
+
+TEST_CASE("parse_cpu_list: Output is sorted without duplicates", TEST_GROUP) {
+    CHECK(parse_cpu_list("4,2-4,0") == std::vector<int>{0, 2, 3, 4});
+}
+
+TEST_CASE("parse_cpu_list: Malformed entries are skipped", TEST_GROUP) {
+    CHECK(parse_cpu_list("x,1,-,3") == std::vector<int>{1, 3});
+}
+
+TEST_CASE("format_cpu_list: Round trips", TEST_GROUP) {
+    CHECK(format_cpu_list({0, 1, 2, 3, 8, 10, 11}) == "0-3,8,10-11");
+    CHECK(format_cpu_list({3, 1, 2}) == "1-3");
+    CHECK(format_cpu_list({}).empty());
+    CHECK(parse_cpu_list(format_cpu_list({0, 2, 4, 5, 6})) == std::vector<int>{0, 2, 4, 5, 6});
+}
+
+#ifdef __linux__
+TEST_CASE("ScopedThreadAffinity: Restores the previous affinity", TEST_GROUP) {
+    std::thread thread([] {
+        const auto original = dorado::utils::get_thread_affinity();
+        REQUIRE_FALSE(original.empty());
+        {
+            dorado::utils::ScopedThreadAffinity affinity({original.front()});
+            CHECK(dorado::utils::get_thread_affinity() == std::vector<int>{original.front()});
+        }
+        CHECK(dorado::utils::get_thread_affinity() == original);
+    });
+    thread.join();
+}
+#endif  // __linux__
+
+TEST_CASE("run_concurrently: Results are in order, and the calls overlap", TEST_GROUP) {
+    std::atomic<int> running{0};
+    std::atomic<int> max_running{0};
+    auto results = dorado::utils::run_concurrently(4, [&](size_t i) {
+        const int now = ++running;
+        for (int seen = max_running; now > seen && !max_running.compare_exchange_weak(seen, now);) {
+        }
+        // Long enough for the others to have started.
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        --running;
+        return int(i) * 10;
+    });
+    CHECK(results == std::vector<int>{0, 10, 20, 30});
+    CHECK(max_running > 1);
+}
+
+TEST_CASE("run_concurrently: Rethrows once every call has finished", TEST_GROUP) {
+    std::atomic<int> finished{0};
+    auto run = [&] {
+        dorado::utils::run_concurrently(3, [&](size_t i) {
+            if (i == 0) {
+                throw std::runtime_error("first");
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            ++finished;
+            return i;
+        });
+    };
+    CHECK_THROWS_WITH(run(), "first");
+    CHECK(finished == 2);
+}
@@ -0,0 +1,80 @@
+#include "utils/TraceRecorder.h"
+
+#include <catch2/catch.hpp>
+
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#define CUT_TAG "[TraceRecorder]"
+
+using dorado::utils::TraceRecorder;
+using dorado::utils::TraceSpan;
+
+namespace {
+
+size_t count_occurrences(const std::string& text, const std::string& pattern) {
+    size_t count = 0;
+    for (auto pos = text.find(pattern); pos != std::string::npos;
+         pos = text.find(pattern, pos + 1)) {
+        ++count;
+    }
+    return count;
+}
+
+std::string chrome_trace() {
+    std::ostringstream out;
+    TraceRecorder::instance().write_chrome_trace(out);
+    return out.str();
+}
+
+}  // namespace
+
+TEST_CASE(CUT_TAG ": spans are only recorded while recording", CUT_TAG) {
+    auto& recorder = TraceRecorder::instance();
+    recorder.start();
+    { TraceSpan span("recorded"); }
+    recorder.stop();
+    { TraceSpan span("dropped"); }
+
+    const auto trace = chrome_trace();
+    CHECK(trace.rfind("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", 0) == 0);
+    CHECK(count_occurrences(trace, "\"name\":\"recorded\",\"cat\":\"dorado\",\"ph\":\"X\"") == 1);
+    CHECK(count_occurrences(trace, "dropped") == 0);
+    CHECK(trace.find("\n]}\n") == trace.size() - 4);
+}
+
+TEST_CASE(CUT_TAG ": each thread keeps its latest spans", CUT_TAG) {
+    auto& recorder = TraceRecorder::instance();
+    recorder.start(4);
+    auto record_spans = [] {
+        for (int i = 0; i < 10; ++i) {
+            TraceSpan span(i < 6 ? "old" : "new");
+        }
+    };
+    record_spans();
+    std::thread thread(record_spans);
+    thread.join();
+    recorder.stop();
+
+    const auto trace = chrome_trace();
+    CHECK(count_occurrences(trace, "\"name\":\"new\"") == 8);
+    CHECK(count_occurrences(trace, "\"name\":\"old\"") == 0);
+    CHECK(count_occurrences(trace, "\"tid\":0}") == 4);
+    CHECK(count_occurrences(trace, "\"tid\":1}") == 4);
+
+    // Starting again drops what was recorded before.
+    recorder.start();
+    recorder.stop();
+    CHECK(count_occurrences(chrome_trace(), "\"name\"") == 0);
+}
+
+TEST_CASE(CUT_TAG ": times are in microseconds", CUT_TAG) {
+    auto& recorder = TraceRecorder::instance();
+    recorder.start();
+    const auto start = TraceRecorder::Clock::now();
+    recorder.record("span", start, start + std::chrono::nanoseconds(1500));
+    recorder.stop();
+    CHECK(count_occurrences(chrome_trace(), "\"dur\":1.500,") == 1);
+}
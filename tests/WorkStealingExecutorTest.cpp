@@ -0,0 +1,88 @@
+#include "utils/WorkStealingExecutor.h"
+
+#include <catch2/catch.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#define TEST_GROUP "[utils][WorkStealingExecutor]"
+
+using dorado::utils::TaskQueue;
+using dorado::utils::WorkStealingExecutor;
+
+TEST_CASE("WorkStealingExecutor: All tasks run", TEST_GROUP) {
+    std::atomic<int> count{0};
+    {
+        WorkStealingExecutor executor(4);
+        for (int i = 0; i < 1000; ++i) {
+            executor.submit([&count] { ++count; });
+        }
+        // Destruction runs remaining tasks to completion.
+    }
+    REQUIRE(count.load() == 1000);
+}
+
+TEST_CASE("WorkStealingExecutor: Nested submissions run", TEST_GROUP) {
+    std::atomic<int> count{0};
+    {
+        WorkStealingExecutor executor(4);
+        TaskQueue tasks(executor, 2);
+        for (int i = 0; i < 10; ++i) {
+            tasks.push([&] {
+                for (int j = 0; j < 10; ++j) {
+                    executor.submit([&count] { ++count; });
+                }
+            });
+        }
+        tasks.wait();
+    }
+    REQUIRE(count.load() == 100);
+}
+
+TEST_CASE("WorkStealingExecutor: TaskQueue respects concurrency limit", TEST_GROUP) {
+    WorkStealingExecutor executor(8);
+    TaskQueue tasks(executor, 3);
+
+    std::atomic<int> running{0};
+    std::atomic<int> max_running{0};
+    for (int i = 0; i < 50; ++i) {
+        tasks.push([&] {
+            int now_running = ++running;
+            int prev_max = max_running.load();
+            while (now_running > prev_max &&
+                   !max_running.compare_exchange_weak(prev_max, now_running)) {
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            --running;
+        });
+    }
+    tasks.wait();
+
+    REQUIRE(max_running.load() <= 3);
+    REQUIRE(tasks.num_in_flight() == 0);
+}
+
+TEST_CASE("WorkStealingExecutor: TaskQueue async returns results", TEST_GROUP) {
+    WorkStealingExecutor executor(2);
+    TaskQueue tasks(executor, 2);
+
+    std::vector<std::future<int>> futures;
+    for (int i = 0; i < 20; ++i) {
+        futures.push_back(tasks.async([i] { return i * i; }));
+    }
+    for (int i = 0; i < 20; ++i) {
+        REQUIRE(futures[i].get() == i * i);
+    }
+}
+
+TEST_CASE("WorkStealingExecutor: TaskQueue wait rethrows task errors", TEST_GROUP) {
+    WorkStealingExecutor executor(2);
+    TaskQueue tasks(executor, 2);
+    tasks.push([] { throw std::runtime_error("task failed"); });
+    REQUIRE_THROWS_AS(tasks.wait(), std::runtime_error);
+    // The error is only reported once.
+    REQUIRE_NOTHROW(tasks.wait());
+}
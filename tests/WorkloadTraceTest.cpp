@@ -0,0 +1,55 @@
+#include "utils/workload_trace.h"
+
+#include <catch2/catch.hpp>
+
+#include <sstream>
+
+#define CUT_TAG "[WorkloadTrace]"
+
+TEST_CASE(CUT_TAG ": parses a sequencing summary in the order reads finished", CUT_TAG) {
+    std::istringstream summary(
+            "filename\tread_id\trun_id\tchannel\tmux\tstart_time\tduration\n"
+            "a.pod5\tr0\trun\t12\t2\t10.0\t5.0\n"
+            "a.pod5\tr1\trun\t3\t1\t11.0\t1.5\n"
+            "a.pod5\tr2\trun\t12\t4\t15.5\t0.25\n");
+    const auto reads = dorado::utils::parse_workload_trace(summary, 4000);
+    REQUIRE(reads.size() == 3);
+    CHECK(reads[0].channel == 3);
+    CHECK(reads[0].mux == 1);
+    CHECK(reads[0].start_time == 11.0);
+    CHECK(reads[0].num_samples == 6000);
+    CHECK(reads[1].channel == 12);
+    CHECK(reads[1].mux == 2);
+    CHECK(reads[1].num_samples == 20000);
+    CHECK(reads[2].mux == 4);
+    CHECK(reads[2].num_samples == 1000);
+}
+
+TEST_CASE(CUT_TAG ": parses a compact trace", CUT_TAG) {
+    std::istringstream trace(
+            "channel\tstart_time\tnum_samples\r\n"
+            "7\t0.5\t4321\r\n"
+            "\r\n"
+            "8\t0.5\t0\r\n");
+    const auto reads = dorado::utils::parse_workload_trace(trace, 5000);
+    // The read without signal is left out.
+    REQUIRE(reads.size() == 1);
+    CHECK(reads[0].channel == 7);
+    CHECK(reads[0].mux == 1);
+    CHECK(reads[0].num_samples == 4321);
+}
+
+TEST_CASE(CUT_TAG ": rejects malformed traces", CUT_TAG) {
+    SECTION("No length") {
+        std::istringstream trace("channel\tstart_time\n1\t0\n");
+        CHECK_THROWS(dorado::utils::parse_workload_trace(trace, 4000));
+    }
+    SECTION("Bad value") {
+        std::istringstream trace("channel\tstart_time\tduration\n1\tsoon\t1\n");
+        CHECK_THROWS(dorado::utils::parse_workload_trace(trace, 4000));
+    }
+    SECTION("Missing field") {
+        std::istringstream trace("channel\tstart_time\tduration\n1\t0\n");
+        CHECK_THROWS(dorado::utils::parse_workload_trace(trace, 4000));
+    }
+}